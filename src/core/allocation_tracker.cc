@@ -4,7 +4,12 @@
 
 #include "core/allocation_tracker.h"
 
+#include <map>
+
+#include "absl/debugging/stacktrace.h"
 #include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "base/logging.h"
 #include "util/fibers/stacktrace.h"
 
@@ -14,6 +19,11 @@ thread_local AllocationTracker g_tracker;
 thread_local absl::InsecureBitGen g_bitgen;
 }  // namespace
 
+AllocationTracker::~AllocationTracker() {
+  // The members are destroyed after this, their deallocations must not reach ProcessDelete.
+  inside_tracker_ = true;
+}
+
 AllocationTracker& AllocationTracker::Get() {
   return g_tracker;
 }
@@ -53,7 +63,70 @@ absl::Span<const AllocationTracker::TrackingInfo> AllocationTracker::GetRanges()
   return absl::MakeConstSpan(tracking_);
 }
 
+void AllocationTracker::SetSampleInterval(size_t bytes) {
+  sample_interval_ = bytes;
+  bytes_until_sample_ = bytes;
+  if (bytes == 0) {
+    inside_tracker_ = true;
+    samples_.clear();
+    inside_tracker_ = false;
+  }
+}
+
+void AllocationTracker::CollectSamples(std::vector<Sample>* out) {
+  inside_tracker_ = true;
+  out->reserve(out->size() + samples_.size());
+  for (const auto& [ptr, sample] : samples_)
+    out->push_back(sample);
+  inside_tracker_ = false;
+}
+
+std::string AllocationTracker::HeapProfile(const std::vector<Sample>& samples,
+                                           size_t sample_interval,
+                                           std::string_view mapped_libraries) {
+  // Aggregate the samples by stack, pprof scales them by the sampling probability of their size.
+  std::map<std::vector<void*>, std::pair<size_t, size_t>> stacks;
+  size_t total_count = 0, total_bytes = 0;
+  for (const Sample& sample : samples) {
+    auto& [count, bytes] = stacks[std::vector<void*>(sample.stack, sample.stack + sample.depth)];
+    count++;
+    bytes += sample.size;
+    total_count++;
+    total_bytes += sample.size;
+  }
+
+  std::string res = absl::StrFormat("heap profile: %6d: %8d [%6d: %8d] @ heap_v2/%d\n",
+                                    total_count, total_bytes, total_count, total_bytes,
+                                    sample_interval);
+  for (const auto& [stack, count_bytes] : stacks) {
+    const auto& [count, bytes] = count_bytes;
+    absl::StrAppendFormat(&res, "%6d: %8d [%6d: %8d] @", count, bytes, count, bytes);
+    for (void* pc : stack)
+      absl::StrAppendFormat(&res, " %p", pc);
+    res.push_back('\n');
+  }
+  absl::StrAppend(&res, "\nMAPPED_LIBRARIES:\n", mapped_libraries);
+  return res;
+}
+
+void AllocationTracker::SampleNew(void* ptr, size_t size) {
+  inside_tracker_ = true;
+  Sample& sample = samples_[ptr];
+  sample.size = size;
+  sample.depth = absl::GetStackTrace(sample.stack, kMaxStackDepth, 2);
+
+  // Exponentially distributed distances make the sampling a Poisson process over the bytes.
+  bytes_until_sample_ = absl::Exponential<double>(g_bitgen, 1.0 / sample_interval_);
+  inside_tracker_ = false;
+}
+
 void AllocationTracker::ProcessNew(void* ptr, size_t size) {
+  if (sample_interval_ > 0 && ptr != nullptr && !inside_tracker_) {
+    bytes_until_sample_ -= size;
+    if (bytes_until_sample_ < 0)
+      SampleNew(ptr, size);
+  }
+
   if (size < abs_min_size_ || size > abs_max_size_) {
     return;
   }
@@ -89,6 +162,9 @@ void AllocationTracker::ProcessDelete(void* ptr) {
   }
 
   inside_tracker_ = true;
+  if (!samples_.empty())
+    samples_.erase(ptr);
+
   // we partially handle deletes, specifically when specifying a single range with
   // 100% sampling rate.
   if (tracking_.size() == 1 && tracking_.front().sample_odds == 1) {
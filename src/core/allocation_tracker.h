@@ -3,10 +3,14 @@
 //
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
 #include <mimalloc.h>
 
 #include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace dfly {
 
@@ -14,6 +18,11 @@ namespace dfly {
 // the stack trace of the memory allocation, if matched by size & sampling criteria.
 // Supports up to 4 different bands in parallel.
 //
+// Also samples allocations of all sizes for heap profiling, at the mean rate of one per
+// sample interval bytes, so that every allocated byte has the same chance of being sampled.
+// Samples of live allocations keep their stack traces until the allocations are freed
+// in the same thread.
+//
 // Thread-local. Must be configured in all relevant threads separately.
 //
 // #define INJECT_ALLOCATION_TRACKER before #include exactly once to override new/delete
@@ -25,6 +34,17 @@ class AllocationTracker {
     double sample_odds = 0.0;
   };
 
+  static constexpr unsigned kMaxStackDepth = 32;
+
+  // Sampled live allocation.
+  struct Sample {
+    size_t size = 0;
+    unsigned depth = 0;
+    void* stack[kMaxStackDepth];
+  };
+
+  ~AllocationTracker();
+
   // Returns a thread-local reference.
   static AllocationTracker& Get();
 
@@ -42,14 +62,35 @@ class AllocationTracker {
 
   absl::Span<const TrackingInfo> GetRanges() const;
 
+  // Sets the mean interval in bytes between sampled allocations, 0 disables sampling and drops
+  // the samples of the thread.
+  void SetSampleInterval(size_t bytes);
+
+  size_t sample_interval() const {
+    return sample_interval_;
+  }
+
+  // Appends the samples of the live allocations of this thread to out.
+  void CollectSamples(std::vector<Sample>* out);
+
+  // Returns the samples as a heap profile in the legacy gperftools format that pprof reads.
+  // mapped_libraries is the content of /proc/self/maps, used by pprof to symbolize the stacks.
+  static std::string HeapProfile(const std::vector<Sample>& samples, size_t sample_interval,
+                                 std::string_view mapped_libraries);
+
   void ProcessNew(void* ptr, size_t size);
   void ProcessDelete(void* ptr);
 
  private:
   void UpdateAbsSizes();
+  void SampleNew(void* ptr, size_t size);
 
   absl::InlinedVector<TrackingInfo, 4> tracking_;
   bool inside_tracker_ = false;
+
+  size_t sample_interval_ = 0;
+  int64_t bytes_until_sample_ = 0;
+  absl::flat_hash_map<void*, Sample> samples_;
   size_t abs_min_size_ = 0;
   size_t abs_max_size_ = 0;
 };
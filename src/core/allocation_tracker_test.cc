@@ -2,6 +2,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -162,5 +163,30 @@ TEST_F(AllocationTrackerTest, Sampling) {
   EXPECT_EQ(deallocations, 0);  // we only track deletions when sample_odds == 1.0
 }
 
+TEST_F(AllocationTrackerTest, HeapProfile) {
+  auto is_buffer = [](const AllocationTracker::Sample& s) { return s.size >= 1'000'000; };
+  AllocationTracker::Get().SetSampleInterval(1000);
+
+  Allocate(1'000'000);
+  vector<AllocationTracker::Sample> samples;
+  AllocationTracker::Get().CollectSamples(&samples);
+  auto it = find_if(samples.begin(), samples.end(), is_buffer);
+  ASSERT_TRUE(it != samples.end());
+  EXPECT_GT(it->depth, 0u);
+
+  string profile = AllocationTracker::HeapProfile(samples, 1000, "maps");
+  EXPECT_TRUE(absl::StartsWith(profile, "heap profile:"));
+  EXPECT_THAT(profile, HasSubstr("@ heap_v2/1000\n"));
+  EXPECT_THAT(profile, HasSubstr("\nMAPPED_LIBRARIES:\nmaps"));
+
+  // Freed allocations are no longer sampled
+  Deallocate();
+  samples.clear();
+  AllocationTracker::Get().CollectSamples(&samples);
+  EXPECT_EQ(count_if(samples.begin(), samples.end(), is_buffer), 0);
+
+  AllocationTracker::Get().SetSampleInterval(0);
+}
+
 }  // namespace
 }  // namespace dfly
@@ -12,6 +12,7 @@
 #include <cmath>
 
 #include "base/logging.h"
+#include "core/sse_port.h"
 
 namespace dfly {
 
@@ -34,27 +35,116 @@ inline uint64_t BitIndex(uint64_t low, uint64_t hi, unsigned i, uint64_t mask) {
 constexpr double kDenom = M_LN2 * M_LN2;
 constexpr double kSBFErrorFactor = 0.5;
 
-inline double BPE(double fp_prob) {
-  return -log(fp_prob) / kDenom;
+constexpr unsigned kBlockBits = Bloom::kBlockSize * 8;
+constexpr unsigned kBlockLog = 9;
+constexpr unsigned kBlockWords = Bloom::kBlockSize / 8;
+static_assert(kBlockBits == 1U << kBlockLog);
+
+// Number of items that the batched SBF operations hash and prefetch at once.
+constexpr size_t kPrefetchBatch = 16;
+
+// Expected error rate of a blocked filter. The number of items per block follows a Poisson
+// distribution, the crowded blocks dominate the error rate.
+double BlockedErrorRate(double bpe) {
+  // The hashes of an item may select the same bit, which leaves fewer distinct bits per item.
+  double hash_cnt = ceil(M_LN2 * bpe);
+  double item_bits = kBlockBits * (1 - pow(1 - 1.0 / kBlockBits, hash_cnt));
+  double mean = kBlockBits / bpe;
+  double prob = exp(-mean);  // of a block having i items.
+  double res = 0;
+  for (unsigned i = 0; i < 4 * mean + 64; ++i) {
+    double bit_set = 1 - pow(1 - item_bits / kBlockBits, i);
+    res += prob * pow(bit_set, item_bits);
+    prob *= mean / (i + 1);
+  }
+  return res;
+}
+
+inline double BPE(double fp_prob, bool blocked) {
+  double bpe = -log(fp_prob) / kDenom;
+  if (blocked) {
+    // The blocks fill unevenly, so a blocked filter needs more bits for the same error rate.
+    while (bpe < kBlockBits && BlockedErrorRate(bpe) > fp_prob)
+      bpe *= 1.02;
+  }
+  return bpe;
+}
+
+size_t BlobAlignment(bool blocked) {
+  return blocked ? Bloom::kBlockSize : alignof(max_align_t);
+}
+
+#ifndef __s390x__
+
+// Returns true if all the bits of mask are set in block.
+inline bool TestBlock(const uint8_t* block, const uint64_t* mask) {
+  __m128i missing = _mm_setzero_si128();
+  for (unsigned i = 0; i < Bloom::kBlockSize / 16; ++i) {
+    __m128i b = mm_loadu_si128(reinterpret_cast<const __m128i*>(block) + i);
+    __m128i m = mm_loadu_si128(reinterpret_cast<const __m128i*>(mask) + i);
+    missing = _mm_or_si128(missing, _mm_andnot_si128(b, m));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+}
+
+// Sets the bits of mask in block, returns true if any of them was not set before.
+inline bool SetBlock(uint8_t* block, const uint64_t* mask) {
+  __m128i missing = _mm_setzero_si128();
+  for (unsigned i = 0; i < Bloom::kBlockSize / 16; ++i) {
+    __m128i* dest = reinterpret_cast<__m128i*>(block) + i;
+    __m128i b = mm_loadu_si128(dest);
+    __m128i m = mm_loadu_si128(reinterpret_cast<const __m128i*>(mask) + i);
+    missing = _mm_or_si128(missing, _mm_andnot_si128(b, m));
+    _mm_storeu_si128(dest, _mm_or_si128(b, m));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) != 0xFFFF;
+}
+
+#else
+
+inline bool TestBlock(const uint8_t* block, const uint64_t* mask) {
+  uint64_t missing = 0;
+  for (unsigned i = 0; i < kBlockWords; ++i) {
+    uint64_t word;
+    memcpy(&word, block + i * 8, 8);
+    missing |= mask[i] & ~word;
+  }
+  return missing == 0;
 }
 
+inline bool SetBlock(uint8_t* block, const uint64_t* mask) {
+  uint64_t missing = 0;
+  for (unsigned i = 0; i < kBlockWords; ++i) {
+    uint64_t word;
+    memcpy(&word, block + i * 8, 8);
+    missing |= mask[i] & ~word;
+    word |= mask[i];
+    memcpy(block + i * 8, &word, 8);
+  }
+  return missing != 0;
+}
+
+#endif
+
 }  // namespace
 
 Bloom::~Bloom() {
   CHECK(bf_ == nullptr);
 }
 
-Bloom::Bloom(Bloom&& o) : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), bf_(o.bf_) {
+Bloom::Bloom(Bloom&& o)
+    : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), blocked_(o.blocked_), bf_(o.bf_) {
   o.bf_ = nullptr;
 }
 
-void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap) {
+void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap, bool blocked) {
   CHECK(bf_ == nullptr);
   CHECK(fp_prob > 0 && fp_prob < 1);
 
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
+  blocked_ = blocked;
+  double bpe = BPE(fp_prob, blocked);
 
   hash_cnt_ = ceil(M_LN2 * bpe);
 
@@ -65,21 +155,23 @@ void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap
   bits = absl::bit_ceil(bits);  // make it power of 2.
 
   uint64_t length = bits / 8;
-  bf_ = (uint8_t*)heap->allocate(length);
+  bf_ = (uint8_t*)heap->allocate(length, BlobAlignment(blocked));
   memset(bf_, 0, length);
   bit_log_ = absl::countr_zero(bits);
 }
 
-void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt) {
+void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked) {
   DCHECK_EQ(len * 8, absl::bit_ceil(len * 8));  // must be power of two.
+  DCHECK(!blocked || len >= kBlockSize);
   CHECK(bf_ == nullptr);
   hash_cnt_ = hash_cnt;
+  blocked_ = blocked;
   bf_ = blob;
   bit_log_ = absl::countr_zero(len * 8);
 }
 
 void Bloom::Destroy(PMR_NS::memory_resource* resource) {
-  resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8);
+  resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8, BlobAlignment(blocked_));
   bf_ = nullptr;
 }
 
@@ -91,6 +183,11 @@ bool Bloom::Exists(std::string_view str) const {
 }
 
 bool Bloom::Exists(const uint64_t fp[2]) const {
+  if (blocked_) {
+    uint64_t block_mask[kBlockWords];
+    return TestBlock(BlockMask(fp, block_mask), block_mask);
+  }
+
   uint64_t mask = GetMask(bit_log_);
   for (unsigned i = 0; i < hash_cnt_; ++i) {
     uint64_t index = BitIndex(fp[0], fp[1], i, mask);
@@ -107,6 +204,11 @@ bool Bloom::Add(std::string_view str) {
 }
 
 bool Bloom::Add(const uint64_t fp[2]) {
+  if (blocked_) {
+    uint64_t block_mask[kBlockWords];
+    return SetBlock(BlockMask(fp, block_mask), block_mask);
+  }
+
   uint64_t mask = GetMask(bit_log_);
 
   unsigned changes = 0;
@@ -118,13 +220,38 @@ bool Bloom::Add(const uint64_t fp[2]) {
   return changes != 0;
 }
 
+void Bloom::Prefetch(const uint64_t fp[2]) const {
+  if (blocked_) {
+    __builtin_prefetch(bf_ + (fp[1] & GetMask(bit_log_ - kBlockLog)) * kBlockSize);
+    return;
+  }
+
+  uint64_t mask = GetMask(bit_log_);
+  for (unsigned i = 0; i < hash_cnt_; ++i)
+    __builtin_prefetch(bf_ + BitIndex(fp[0], fp[1], i, mask) / 8);
+}
+
 size_t Bloom::Capacity(double fp_prob) const {
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
+  double bpe = BPE(fp_prob, blocked_);
   return floor(bitlen() / bpe);
 }
 
+uint8_t* Bloom::BlockMask(const uint64_t fp[2], uint64_t mask[kBlockWords]) const {
+  // The block is selected by the second fingerprint, the bits within it by the top bits of
+  // a linear congruential sequence seeded by the first one. Double hashing within a block this
+  // small clusters the bits when the step is short and raises the error rate.
+  uint64_t h = fp[0];
+  memset(mask, 0, kBlockSize);
+  for (unsigned i = 0; i < hash_cnt_; ++i) {
+    h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned bit = h >> (64 - kBlockLog);
+    mask[bit / 64] |= 1ULL << (bit % 64);
+  }
+  return bf_ + (fp[1] & GetMask(bit_log_ - kBlockLog)) * kBlockSize;
+}
+
 inline bool Bloom::IsSet(size_t bit_idx) const {
   uint64_t byte_idx = bit_idx / 8;
   bit_idx %= 8;  // index within the byte
@@ -144,20 +271,25 @@ inline bool Bloom::Set(size_t bit_idx) {
 ///////////////////////////////////////////////////////////////////////////////
 // SBF implementation
 ///////////////////////////////////////////////////////////////////////////////
-SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr)
-    : filters_(1, mr), grow_factor_(grow_factor), fp_prob_(fp_prob * kSBFErrorFactor) {
-  filters_.front().Init(initial_capacity, fp_prob_, mr);
+SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+         bool blocked)
+    : filters_(1, mr),
+      grow_factor_(grow_factor),
+      fp_prob_(fp_prob * kSBFErrorFactor),
+      blocked_(blocked) {
+  filters_.front().Init(initial_capacity, fp_prob_, mr, blocked);
   max_capacity_ = filters_.front().Capacity(fp_prob_);
 }
 
 SBF::SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-         size_t current_size, PMR_NS::memory_resource* mr)
+         size_t current_size, PMR_NS::memory_resource* mr, bool blocked)
     : filters_(mr),
       grow_factor_(grow_factor),
       fp_prob_(fp_prob),
       prev_size_(prev_size),
       current_size_(current_size),
-      max_capacity_(max_capacity) {
+      max_capacity_(max_capacity),
+      blocked_(blocked) {
 }
 
 SBF::~SBF() {
@@ -173,22 +305,26 @@ SBF& SBF::operator=(SBF&& src) {
   fp_prob_ = src.fp_prob_;
   current_size_ = src.current_size_;
   max_capacity_ = src.max_capacity_;
+  blocked_ = src.blocked_;
 
   return *this;
 }
 
 void SBF::AddFilter(const std::string& blob, unsigned hash_cnt) {
   PMR_NS::memory_resource* mr = filters_.get_allocator().resource();
-  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), 1);
+  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), BlobAlignment(blocked_));
   memcpy(ptr, blob.data(), blob.size());
-  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt);
+  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt, blocked_);
 }
 
 bool SBF::Add(std::string_view str) {
-  DCHECK_LT(current_size_, max_capacity_);
-
   XXH128_hash_t hash = Hash(str);
   uint64_t fp[2] = {hash.low64, hash.high64};
+  return Add(fp);
+}
+
+bool SBF::Add(const uint64_t fp[2]) {
+  DCHECK_LT(current_size_, max_capacity_);
 
   auto exists = [fp](const Bloom& b) { return b.Exists(fp); };
 
@@ -207,7 +343,7 @@ bool SBF::Add(std::string_view str) {
   if (current_size_ >= max_capacity_) {
     fp_prob_ *= kSBFErrorFactor;
     filters_.emplace_back().Init(max_capacity_ * grow_factor_, fp_prob_,
-                                 filters_.get_allocator().resource());
+                                 filters_.get_allocator().resource(), blocked_);
     current_size_ = 0;
     max_capacity_ = filters_.back().Capacity(fp_prob_);
   }
@@ -224,6 +360,48 @@ bool SBF::Exists(std::string_view str) const {
   return any_of(filters_.crbegin(), filters_.crend(), exists);
 }
 
+void SBF::Add(absl::Span<const std::string_view> items, bool* res) {
+  uint64_t fps[kPrefetchBatch][2];
+  for (size_t start = 0; start < items.size(); start += kPrefetchBatch) {
+    size_t count = min(kPrefetchBatch, items.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+      XXH128_hash_t hash = Hash(items[start + i]);
+      fps[i][0] = hash.low64;
+      fps[i][1] = hash.high64;
+      filters_.back().Prefetch(fps[i]);
+    }
+
+    // The items are added in order, so that duplicates within the batch are detected.
+    for (size_t i = 0; i < count; ++i)
+      res[start + i] = Add(fps[i]);
+  }
+}
+
+void SBF::Exists(absl::Span<const std::string_view> items, bool* res) const {
+  uint64_t fps[kPrefetchBatch][2];
+  for (size_t start = 0; start < items.size(); start += kPrefetchBatch) {
+    size_t count = min(kPrefetchBatch, items.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+      XXH128_hash_t hash = Hash(items[start + i]);
+      fps[i][0] = hash.low64;
+      fps[i][1] = hash.high64;
+      res[start + i] = false;
+    }
+
+    // Like Exists(), probe the largest filter first.
+    for (auto it = filters_.crbegin(); it != filters_.crend(); ++it) {
+      for (size_t i = 0; i < count; ++i) {
+        if (!res[start + i])
+          it->Prefetch(fps[i]);
+      }
+      for (size_t i = 0; i < count; ++i) {
+        if (!res[start + i])
+          res[start + i] = it->Exists(fps[i]);
+      }
+    }
+  }
+}
+
 size_t SBF::MallocUsed() const {
   size_t res = filters_.capacity() * sizeof(Bloom);
   for (const auto& b : filters_) {
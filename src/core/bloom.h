@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/types/span.h>
+
 #include <cstdint>
 #include <string_view>
 #include <vector>
@@ -13,6 +15,9 @@
 namespace dfly {
 
 /// Bloom filter based on the design of https://github.com/jvirkki/libbloom
+/// A blocked filter sets all the bits of an item within a single 64-byte block selected by the
+/// hash, so that a lookup costs one cache miss instead of up to hash_cnt. It needs slightly more
+/// bits for the same error rate, see Capacity().
 class Bloom {
   Bloom(const Bloom&) = delete;
   Bloom& operator=(const Bloom&) = delete;
@@ -27,10 +32,13 @@ class Bloom {
   // entries - entries are silently rounded up to the minimum capacity.
   // fp_prob - False-positive probability of collision. Must be in (0, 1) range.
   // heap
-  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource);
+  // blocked - whether to use the blocked layout.
+  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource,
+            bool blocked = false);
 
-  // Direct initializer. len*8 must be power of 2.
-  void Init(uint8_t* blob, size_t len, unsigned hash_cnt);
+  // Direct initializer. len*8 must be power of 2. The blob of a blocked filter must be aligned
+  // to kBlockSize and at least kBlockSize long.
+  void Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked = false);
 
   // Destroys the object, must be called before destructing the object.
   // resource - resource with which the object was initialized.
@@ -49,6 +57,9 @@ class Bloom {
   bool Add(std::string_view str);
   bool Add(const uint64_t fp[2]);
 
+  // Prefetches the memory that Exists(fp) and Add(fp) access.
+  void Prefetch(const uint64_t fp[2]) const;
+
   size_t bitlen() const {
     return 1ULL << bit_log_;
   }
@@ -66,12 +77,22 @@ class Bloom {
     return hash_cnt_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
+  static constexpr unsigned kBlockSize = 64;
+
  private:
   bool IsSet(size_t index) const;
   bool Set(size_t index);  // return true if bit was set (i.e was 0 before)
 
+  // Returns the block of the item and fills mask with its bits within the block.
+  uint8_t* BlockMask(const uint64_t fp[2], uint64_t mask[kBlockSize / 8]) const;
+
   uint8_t hash_cnt_ = 0;
   uint8_t bit_log_ = 0;    // log of bit length of the filter. bit length is always power of 2.
+  bool blocked_ = false;
   uint8_t* bf_ = nullptr;  // pointer to the blob.
 };
 
@@ -87,12 +108,14 @@ class SBF {
   SBF(const SBF&) = delete;
 
  public:
-  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr);
+  // blocked - whether the filters use the blocked layout, see Bloom.
+  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+      bool blocked = false);
 
   // C'tor used for loading persisted filters into SBF.
   // Should be followed by AddFilter.
   SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-      size_t current_size, PMR_NS::memory_resource* mr);
+      size_t current_size, PMR_NS::memory_resource* mr, bool blocked = false);
   ~SBF();
 
   SBF& operator=(SBF&& src);
@@ -102,6 +125,12 @@ class SBF {
   bool Add(std::string_view str);
   bool Exists(std::string_view str) const;
 
+  // Batched variants, equivalent to calling Add or Exists for every item in order and storing
+  // the results in res. Hash a batch of items first and prefetch their blocks, so that the cache
+  // misses of large filters overlap.
+  void Add(absl::Span<const std::string_view> items, bool* res);
+  void Exists(absl::Span<const std::string_view> items, bool* res) const;
+
   size_t current_size() const {
     return current_size_;
   }
@@ -136,9 +165,15 @@ class SBF {
     return max_capacity_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
   size_t MallocUsed() const;
 
  private:
+  bool Add(const uint64_t fp[2]);
+
   // multiple filters from the smallest to the largest.
   std::vector<Bloom, PMR_NS::polymorphic_allocator<Bloom>> filters_;
   double grow_factor_;
@@ -146,6 +181,7 @@ class SBF {
   size_t prev_size_ = 0;
   size_t current_size_ = 0;
   size_t max_capacity_;
+  bool blocked_ = false;
 };
 
 }  // namespace dfly
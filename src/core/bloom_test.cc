@@ -88,10 +88,58 @@ TEST_F(BloomTest, SBF) {
   EXPECT_LE(collisions, kNumElems * 0.008);
 }
 
+TEST_F(BloomTest, Blocked) {
+  Bloom bloom;
+  bloom.Init(100000, 0.001, PMR_NS::get_default_resource(), true);
+  ASSERT_TRUE(bloom.blocked());
+
+  size_t capacity = bloom.Capacity(0.001);
+  for (unsigned i = 0; i < capacity; ++i) {
+    bloom.Add(absl::StrCat("item", i));
+  }
+  for (unsigned i = 0; i < capacity; ++i) {
+    ASSERT_TRUE(bloom.Exists(absl::StrCat("item", i)));
+  }
+
+  unsigned false_positives = 0;
+  constexpr unsigned kProbes = 200000;
+  for (unsigned i = 0; i < kProbes; ++i) {
+    false_positives += bloom.Exists(absl::StrCat("other", i));
+  }
+  EXPECT_LE(false_positives, kProbes * 0.0015);
+  bloom.Destroy(PMR_NS::get_default_resource());
+}
+
+TEST_F(BloomTest, SBFBatch) {
+  for (bool blocked : {false, true}) {
+    SBF batched(10, 0.01, 2, PMR_NS::get_default_resource(), blocked);
+    SBF single(10, 0.01, 2, PMR_NS::get_default_resource(), blocked);
+
+    vector<string> items;
+    for (unsigned i = 0; i < 10000; ++i) {
+      items.push_back(absl::StrCat("item", i % 6000));
+    }
+    vector<string_view> views(items.begin(), items.end());
+    unique_ptr<bool[]> res(new bool[views.size()]);
+
+    batched.Add(absl::MakeSpan(views), res.get());
+    for (size_t i = 0; i < views.size(); ++i) {
+      ASSERT_EQ(res[i], single.Add(views[i])) << i;
+    }
+    EXPECT_GT(batched.num_filters(), 1u);
+    EXPECT_EQ(batched.current_size(), single.current_size());
+
+    batched.Exists(absl::MakeSpan(views), res.get());
+    for (size_t i = 0; i < views.size(); ++i) {
+      ASSERT_TRUE(res[i]);
+    }
+  }
+}
+
 static void BM_BloomExist(benchmark::State& state) {
   constexpr size_t kCapacity = 1U << 22;
   Bloom bloom;
-  bloom.Init(kCapacity, 0.001, PMR_NS::get_default_resource());
+  bloom.Init(kCapacity, 0.001, PMR_NS::get_default_resource(), state.range(0));
   for (size_t i = 0; i < kCapacity * 0.8; ++i) {
     bloom.Add(absl::StrCat("val", i));
   }
@@ -105,6 +153,6 @@ static void BM_BloomExist(benchmark::State& state) {
   }
   bloom.Destroy(PMR_NS::get_default_resource());
 }
-BENCHMARK(BM_BloomExist);
+BENCHMARK(BM_BloomExist)->Arg(0)->Arg(1);
 
 }  // namespace dfly
@@ -6,6 +6,7 @@
 
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "base/pmr/memory_resource.h"
 #include "core/detail/bptree_internal.h"
@@ -48,6 +49,10 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
 
   bool Delete(KeyT item);
 
+  // Replaces item with replacement, which must compare equal to it. Used to update the stored
+  // pointer when an item is re-allocated. Returns false if item was not found.
+  bool Replace(KeyT item, KeyT replacement);
+
   std::optional<uint32_t> GetRank(KeyT item) const;
 
   size_t Height() const {
@@ -104,6 +109,17 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
   /// @param path
   void Delete(BPTreePath path);
 
+  /// @brief Deletes all items in the range [rank_start, rank_end] by rank.
+  /// @param cb - called for each deleted item, must not access the tree.
+  /// Large ranges are deleted by rebuilding the tree from the remaining items, which avoids
+  /// rebalancing the nodes after every deletion.
+  void DeleteRange(uint32_t rank_start, uint32_t rank_end, std::function<void(KeyT)> cb);
+
+  /// @brief Builds the tree bottom-up from count items in ascending order, supplied by
+  ///        successive calls to next(). The tree must be empty.
+  /// Much faster than inserting the items one by one since it does not search or split nodes.
+  template <typename NextFn> void FromSorted(uint32_t count, NextFn&& next);
+
  private:
   BPTreeNode* CreateNode(bool leaf);
 
@@ -221,6 +237,20 @@ template <typename T, typename Policy> bool BPTree<T, Policy>::Delete(KeyT item)
   return true;
 }
 
+template <typename T, typename Policy>
+bool BPTree<T, Policy>::Replace(KeyT item, KeyT replacement) {
+  if (!root_)
+    return false;
+
+  BPTreePath path;
+  if (!Locate(item, &path))
+    return false;
+
+  auto [node, pos] = path.Last();
+  node->SetKey(pos, replacement);
+  return true;
+}
+
 template <typename T, typename Policy>
 std::optional<uint32_t> BPTree<T, Policy>::GetRank(KeyT item) const {
   if (!root_)
@@ -579,6 +609,114 @@ template <typename T, typename Policy> void BPTree<T, Policy>::Delete(BPTreePath
   }
 }
 
+template <typename T, typename Policy>
+void BPTree<T, Policy>::DeleteRange(uint32_t rank_start, uint32_t rank_end,
+                                    std::function<void(KeyT)> cb) {
+  assert(rank_start <= rank_end && rank_end < count_);
+  uint32_t num_deleted = rank_end - rank_start + 1;
+
+  // A deletion costs a descent from the root and possibly a rebalancing of the path,
+  // while the rebuild costs a sequential pass over the tree.
+  if (num_deleted < count_ / 8) {
+    for (uint32_t i = 0; i < num_deleted; ++i) {
+      BPTreePath path;
+      ToRank(rank_start, &path);
+      KeyT item = path.Terminal();
+      Delete(path);
+      cb(item);
+    }
+    return;
+  }
+
+  std::vector<KeyT> kept;
+  kept.reserve(count_ - num_deleted);
+
+  BPTreePath path;
+  ToRank(0, &path);
+  uint32_t rank = 0;
+  do {
+    KeyT item = path.Terminal();
+    if (rank < rank_start || rank > rank_end)
+      kept.push_back(item);
+    else
+      cb(item);
+    ++rank;
+  } while (path.Next());
+
+  Clear();
+  size_t index = 0;
+  FromSorted(kept.size(), [&] { return kept[index++]; });
+}
+
+template <typename T, typename Policy>
+template <typename NextFn>
+void BPTree<T, Policy>::FromSorted(uint32_t count, NextFn&& next) {
+  using Layout = detail::BPNodeLayout<T>;
+  assert(root_ == nullptr);
+
+  if (count == 0)
+    return;
+
+  // Splits total into parts that differ by at most one and returns the size of part i.
+  auto part_size = [](uint32_t total, uint32_t parts, uint32_t i) -> unsigned {
+    return total / parts + (i < total % parts);
+  };
+
+  // Each leaf but the last is followed by a separator that goes to the level above,
+  // so count + 1 slots are divided between the leaves. An even division keeps every node at or
+  // above its minimal size.
+  uint32_t num_nodes = (count + Layout::kMaxLeafKeys + 1) / (Layout::kMaxLeafKeys + 1);
+  std::vector<BPTreeNode*> nodes(num_nodes);
+  std::vector<KeyT> separators;  // separators[i] lies between nodes[i] and nodes[i + 1].
+  separators.reserve(num_nodes);
+
+  for (uint32_t i = 0; i < num_nodes; ++i) {
+    BPTreeNode* leaf = CreateNode(true);
+    unsigned num_items = part_size(count + 1, num_nodes, i) - 1;
+    for (unsigned j = 0; j < num_items; ++j)
+      leaf->SetKey(j, next());
+    leaf->num_items_ = num_items;
+    nodes[i] = leaf;
+    if (i + 1 < num_nodes)
+      separators.push_back(next());
+  }
+  height_ = 1;
+
+  // Build the inner levels, an inner node with k keys takes k + 1 nodes of the level below.
+  while (nodes.size() > 1) {
+    uint32_t num_parents = (nodes.size() + Layout::kMaxInnerKeys) / (Layout::kMaxInnerKeys + 1);
+    std::vector<BPTreeNode*> parents(num_parents);
+    std::vector<KeyT> parent_separators;
+    parent_separators.reserve(num_parents);
+
+    size_t child = 0;
+    for (uint32_t i = 0; i < num_parents; ++i) {
+      BPTreeNode* parent = CreateNode(false);
+      unsigned num_items = part_size(nodes.size(), num_parents, i) - 1;
+      uint32_t tree_count = num_items;
+      for (unsigned j = 0; j <= num_items; ++j) {
+        if (j < num_items)
+          parent->SetKey(j, separators[child + j]);
+        parent->SetChild(j, nodes[child + j]);
+        tree_count += nodes[child + j]->TreeCount();
+      }
+      parent->num_items_ = num_items;
+      parent->SetTreeCount(tree_count);
+      child += num_items + 1;
+
+      if (i + 1 < num_parents)
+        parent_separators.push_back(separators[child - 1]);
+      parents[i] = parent;
+    }
+    nodes.swap(parents);
+    separators.swap(parent_separators);
+    height_++;
+  }
+
+  root_ = nodes.front();
+  count_ = count;
+}
+
 template <typename T, typename Policy> void BPTree<T, Policy>::DestroyNode(BPTreeNode* node) {
   void* ptr = node;
   mr_->deallocate(ptr, detail::kBPNodeSize, 8);
@@ -277,6 +277,67 @@ TEST_F(BPTreeSetTest, Ranges) {
   EXPECT_TRUE(path.Empty());
 }
 
+TEST_F(BPTreeSetTest, FromSorted) {
+  for (uint32_t count : {0u, 1u, 31u, 32u, 33u, 500u, 100000u}) {
+    uint64_t next = 0;
+    bptree_.FromSorted(count, [&] { return 2 * next++; });
+    ASSERT_EQ(count, bptree_.Size());
+    ASSERT_TRUE(Validate()) << count;
+
+    for (uint32_t i = 0; i < count; i += 1 + count / 100) {
+      ASSERT_EQ(i, bptree_.GetRank(2 * i));
+      ASSERT_FALSE(bptree_.Contains(2 * i + 1));
+    }
+
+    // The tree stays functional after the bulk load.
+    if (count > 0) {
+      ASSERT_TRUE(bptree_.Insert(1));
+      ASSERT_TRUE(bptree_.Delete(0));
+      ASSERT_TRUE(Validate()) << count;
+    }
+    bptree_.Clear();
+    ASSERT_EQ(mi_alloc_.used(), 0u);
+  }
+
+  // Bulk loading packs the nodes more densely than the inserts.
+  FillTree();
+  size_t inserted_nodes = bptree_.NodeCount();
+  bptree_.Clear();
+  uint64_t next = 0;
+  bptree_.FromSorted(kNumElems, [&] { return next++; });
+  EXPECT_LT(bptree_.NodeCount(), inserted_nodes);
+}
+
+TEST_F(BPTreeSetTest, DeleteRange) {
+  absl::btree_set<uint64_t> expected;
+  FillTree();
+  for (unsigned i = 0; i < kNumElems; ++i)
+    expected.insert(i);
+
+  while (!expected.empty()) {
+    uint32_t start = generator_() % expected.size();
+    // Mostly small ranges that are deleted one by one, sometimes large ones that rebuild the tree.
+    uint32_t len = generator_() % (generator_() % 4 ? 10 : expected.size() - start);
+    uint32_t end = min<uint32_t>(start + len, expected.size() - 1);
+
+    vector<uint64_t> deleted;
+    bptree_.DeleteRange(start, end, [&](uint64_t val) { deleted.push_back(val); });
+
+    auto first = next(expected.begin(), start);
+    auto last = next(first, end - start + 1);
+    ASSERT_EQ(vector<uint64_t>(first, last), deleted);
+    expected.erase(first, last);
+
+    ASSERT_EQ(expected.size(), bptree_.Size());
+    ASSERT_TRUE(Validate());
+    if (!expected.empty()) {
+      ASSERT_EQ(*expected.begin(), bptree_.FromRank(0).Terminal());
+      ASSERT_EQ(*expected.rbegin(), bptree_.FromRank(expected.size() - 1).Terminal());
+    }
+  }
+  ASSERT_EQ(mi_alloc_.used(), 0u);
+}
+
 TEST_F(BPTreeSetTest, MemoryUsage) {
   zskiplist* zsl = zslCreate();
   std::vector<sds> sds_vec;
@@ -0,0 +1,76 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/chunked_string.h"
+
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+ChunkedString::ChunkedString(PMR_NS::memory_resource* mr) : chunks_{mr} {
+}
+
+ChunkedString::~ChunkedString() {
+  PMR_NS::memory_resource* mr = chunks_.get_allocator().resource();
+  for (char* chunk : chunks_)
+    mr->deallocate(chunk, kChunkSize, 8);
+}
+
+void ChunkedString::Write(size_t offset, string_view str) {
+  size_t end = max(size_, offset + str.size());
+  PMR_NS::memory_resource* mr = chunks_.get_allocator().resource();
+  while (chunks_.size() * kChunkSize < end)
+    chunks_.push_back(static_cast<char*>(mr->allocate(kChunkSize, 8)));
+
+  if (offset > size_)
+    Fill(size_, offset);
+
+  while (!str.empty()) {
+    size_t pos = offset % kChunkSize;
+    size_t piece = min(str.size(), kChunkSize - pos);
+    memcpy(chunks_[offset / kChunkSize] + pos, str.data(), piece);
+    offset += piece;
+    str.remove_prefix(piece);
+  }
+  size_ = end;
+}
+
+void ChunkedString::CopyTo(char* dest) const {
+  Read(0, size_, [&dest](string_view piece) {
+    memcpy(dest, piece.data(), piece.size());
+    dest += piece.size();
+  });
+}
+
+bool ChunkedString::Equal(string_view str) const {
+  if (str.size() != size_)
+    return false;
+
+  bool equal = true;
+  Read(0, size_, [&](string_view piece) {
+    equal = equal && str.substr(0, piece.size()) == piece;
+    str.remove_prefix(piece.size());
+  });
+  return equal;
+}
+
+size_t ChunkedString::MallocUsed() const {
+  return chunks_.size() * kChunkSize + chunks_.capacity() * sizeof(char*);
+}
+
+void ChunkedString::Fill(size_t from, size_t to) {
+  DCHECK_LE(to, chunks_.size() * kChunkSize);
+  while (from < to) {
+    size_t pos = from % kChunkSize;
+    size_t piece = min(to - from, kChunkSize - pos);
+    memset(chunks_[from / kChunkSize] + pos, 0, piece);
+    from += piece;
+  }
+}
+
+}  // namespace dfly
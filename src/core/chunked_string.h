@@ -0,0 +1,67 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// A string stored in fixed size chunks, used for huge strings that grow with APPEND or SETRANGE.
+// Appending never moves the existing bytes, so it costs O(appended size) instead of reallocating
+// and copying the whole value, and ranges are read piecewise without flattening the string.
+class ChunkedString {
+ public:
+  static constexpr size_t kChunkSize = 1 << 16;
+
+  explicit ChunkedString(PMR_NS::memory_resource* mr);
+  ~ChunkedString();
+
+  ChunkedString(const ChunkedString&) = delete;
+  ChunkedString& operator=(const ChunkedString&) = delete;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  void Append(std::string_view str) {
+    Write(size_, str);
+  }
+
+  // Overwrites the bytes at offset with str, zero-padding the gap if offset is past the end.
+  void Write(size_t offset, std::string_view str);
+
+  // Calls cb with the consecutive pieces of [offset, offset + len), which must be within Size().
+  template <typename F> void Read(size_t offset, size_t len, F&& cb) const;
+
+  // Copies all Size() bytes to dest.
+  void CopyTo(char* dest) const;
+
+  bool Equal(std::string_view str) const;
+
+  size_t MallocUsed() const;
+
+ private:
+  // Zeroes [from, to) of the allocated chunks.
+  void Fill(size_t from, size_t to);
+
+  size_t size_ = 0;
+  PMR_NS::vector<char*> chunks_;
+};
+
+template <typename F> void ChunkedString::Read(size_t offset, size_t len, F&& cb) const {
+  while (len > 0) {
+    size_t pos = offset % kChunkSize;
+    size_t piece = std::min(len, kChunkSize - pos);
+    cb(std::string_view{chunks_[offset / kChunkSize] + pos, piece});
+    offset += piece;
+    len -= piece;
+  }
+}
+
+}  // namespace dfly
@@ -0,0 +1,71 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/chunked_string.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class ChunkedStringTest : public ::testing::Test {
+ protected:
+  static string Contents(const ChunkedString& cs) {
+    string res(cs.Size(), '\0');
+    cs.CopyTo(res.data());
+    return res;
+  }
+
+  static string Range(const ChunkedString& cs, size_t offset, size_t len) {
+    string res;
+    cs.Read(offset, len, [&res](string_view piece) { res.append(piece); });
+    return res;
+  }
+
+  ChunkedString cs_{PMR_NS::get_default_resource()};
+};
+
+constexpr size_t kChunk = ChunkedString::kChunkSize;
+
+TEST_F(ChunkedStringTest, Append) {
+  string expected;
+  for (unsigned i = 0; i < 1000; ++i) {
+    string part(i % 300 + 1, 'a' + i % 26);
+    cs_.Append(part);
+    expected.append(part);
+  }
+
+  EXPECT_EQ(cs_.Size(), expected.size());
+  EXPECT_EQ(Contents(cs_), expected);
+  EXPECT_TRUE(cs_.Equal(expected));
+  EXPECT_FALSE(cs_.Equal(expected.substr(1)));
+  EXPECT_GE(cs_.MallocUsed(), expected.size());
+
+  // Ranges are read in pieces that end at the chunk borders.
+  vector<size_t> pieces;
+  cs_.Read(kChunk - 10, kChunk + 20, [&pieces](string_view piece) {
+    pieces.push_back(piece.size());
+  });
+  EXPECT_EQ(pieces, vector<size_t>({10, kChunk, 10}));
+  EXPECT_EQ(Range(cs_, kChunk - 10, kChunk + 20), expected.substr(kChunk - 10, kChunk + 20));
+}
+
+TEST_F(ChunkedStringTest, Write) {
+  cs_.Append("hello");
+  cs_.Write(kChunk * 2 + 3, "world");
+  EXPECT_EQ(cs_.Size(), kChunk * 2 + 8);
+
+  string expected = "hello" + string(kChunk * 2 - 2, '\0') + "world";
+  EXPECT_EQ(Contents(cs_), expected);
+
+  // Overwrites across the chunk border do not change the size.
+  cs_.Write(kChunk - 1, "xy");
+  expected.replace(kChunk - 1, 2, "xy");
+  EXPECT_EQ(Contents(cs_), expected);
+  EXPECT_EQ(Range(cs_, kChunk - 2, 4), string_view("\0xy\0", 4));
+}
+
+}  // namespace dfly
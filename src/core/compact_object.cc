@@ -26,15 +26,28 @@ extern "C" {
 #include "base/logging.h"
 #include "base/pod_array.h"
 #include "core/bloom.h"
+#include "core/chunked_string.h"
 #include "core/detail/bitpacking.h"
+#include "core/key_prefix_dict.h"
+#include "core/packed_map.h"
+#include "core/qlist.h"
+#include "core/roaring_int_set.h"
+#include "core/sketch.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/time_series.h"
 
 ABSL_RETIRED_FLAG(bool, use_set2, true, "If true use DenseSet for an optimized set data structure");
 
 ABSL_FLAG(bool, experimental_flat_json, false, "If true uses flat json implementation.");
 
+ABSL_FLAG(string, key_prefix_delimiter, "",
+          "If set, the keys share their prefixes through a per-shard prefix dictionary. The prefix "
+          "of a key spans its first key_prefix_segments segments separated by this delimiter.");
+ABSL_FLAG(uint32_t, key_prefix_segments, 2,
+          "Number of delimited segments that make up the shared prefix of a key.");
+
 namespace dfly {
 using namespace std;
 using absl::GetFlag;
@@ -62,6 +75,9 @@ inline void FreeObjSet(unsigned encoding, void* ptr, MemoryResource* mr) {
     case kEncodingIntSet:
       zfree((void*)ptr);
       break;
+    case kEncodingRoaring:
+      CompactObj::DeleteMR<RoaringIntSet>(ptr);
+      break;
     default:
       LOG(FATAL) << "Unknown set encoding type";
   }
@@ -71,10 +87,13 @@ size_t MallocUsedSet(unsigned encoding, void* ptr) {
   switch (encoding) {
     case kEncodingStrMap2: {
       StringSet* ss = (StringSet*)ptr;
-      return ss->ObjMallocUsed() + ss->SetMallocUsed() + zmalloc_usable_size(ptr);
+      return ss->ObjMallocUsed() + ss->SetMallocUsed() + ss->SlabUnusedBytes() +
+             zmalloc_usable_size(ptr);
     }
     case kEncodingIntSet:
       return intsetBlobLen((intset*)ptr);
+    case kEncodingRoaring:
+      return ((RoaringIntSet*)ptr)->MallocUsed() + sizeof(RoaringIntSet);
   }
 
   LOG(DFATAL) << "Unknown set encoding type " << encoding;
@@ -85,6 +104,8 @@ size_t MallocUsedHSet(unsigned encoding, void* ptr) {
   switch (encoding) {
     case kEncodingListPack:
       return zmalloc_usable_size(reinterpret_cast<uint8_t*>(ptr));
+    case kEncodingPackedMap:
+      return PackedMap::MallocUsed(reinterpret_cast<uint8_t*>(ptr));
     case kEncodingStrMap2: {
       StringMap* sm = (StringMap*)ptr;
       return sm->ObjMallocUsed() + sm->SetMallocUsed() + zmalloc_usable_size(ptr);
@@ -120,6 +141,9 @@ inline void FreeObjHash(unsigned encoding, void* ptr) {
     case kEncodingListPack:
       lpFree((uint8_t*)ptr);
       break;
+    case kEncodingPackedMap:
+      PackedMap::Free((uint8_t*)ptr);
+      break;
     default:
       LOG(FATAL) << "Unknown hset encoding type " << encoding;
   }
@@ -138,15 +162,6 @@ inline void FreeObjZset(unsigned encoding, void* ptr) {
   }
 }
 
-pair<void*, bool> DefragStrMap2(StringMap* sm, float ratio) {
-  bool realloced = false;
-
-  for (auto it = sm->begin(); it != sm->end(); ++it)
-    realloced |= it.ReallocIfNeeded(ratio);
-
-  return {sm, realloced};
-}
-
 pair<void*, bool> DefragListPack(uint8_t* lp, float ratio) {
   if (!zmalloc_page_is_underutilized(lp, ratio))
     return {lp, false};
@@ -159,6 +174,18 @@ pair<void*, bool> DefragListPack(uint8_t* lp, float ratio) {
   return {replacement, true};
 }
 
+pair<void*, bool> DefragPackedMap(uint8_t* pm, float ratio) {
+  if (!zmalloc_page_is_underutilized(pm, ratio))
+    return {pm, false};
+
+  const size_t blob_len = PackedMap::BlobBytes(pm);
+  uint8_t* replacement = (uint8_t*)zmalloc(blob_len);
+  memcpy(replacement, pm, blob_len);
+  PackedMap::Free(pm);
+
+  return {replacement, true};
+}
+
 pair<void*, bool> DefragIntSet(intset* is, float ratio) {
   if (!zmalloc_page_is_underutilized(is, ratio))
     return {is, false};
@@ -171,43 +198,6 @@ pair<void*, bool> DefragIntSet(intset* is, float ratio) {
   return {replacement, true};
 }
 
-// Iterates over allocations of internal hash data structures and re-allocates
-// them if their pages are underutilized.
-// Returns pointer to new object ptr and whether any re-allocations happened.
-pair<void*, bool> DefragHash(unsigned encoding, void* ptr, float ratio) {
-  switch (encoding) {
-    // Listpack is stored as a single contiguous array
-    case kEncodingListPack: {
-      return DefragListPack((uint8_t*)ptr, ratio);
-    }
-
-    // StringMap supports re-allocation of it's internal nodes
-    case kEncodingStrMap2: {
-      return DefragStrMap2((StringMap*)ptr, ratio);
-    }
-
-    default:
-      ABSL_UNREACHABLE();
-  }
-}
-
-pair<void*, bool> DefragSet(unsigned encoding, void* ptr, float ratio) {
-  switch (encoding) {
-    // Int sets have flat storage
-    case kEncodingIntSet: {
-      return DefragIntSet((intset*)ptr, ratio);
-    }
-
-    // StringMap supports re-allocation of it's internal nodes
-    case kEncodingStrMap2: {
-      return DefragStrMap2((StringMap*)ptr, ratio);
-    }
-
-    default:
-      ABSL_UNREACHABLE();
-  }
-}
-
 inline void FreeObjStream(void* ptr) {
   freeStream((stream*)ptr);
 }
@@ -241,19 +231,38 @@ struct TL {
   size_t small_str_bytes;
   base::PODArray<uint8_t> tmp_buf;
   string tmp_str;
+
+  std::unique_ptr<KeyPrefixDict> prefix_dict;  // set if key prefix compression is enabled.
+  char prefix_delim = 0;
+  unsigned prefix_segments = 0;
 };
 
 thread_local TL tl;
 
 constexpr bool kUseSmallStrings = true;
 
+// Shorter prefixes are not worth a dictionary lookup.
+constexpr size_t kMinKeyPrefixLen = 4;
+
+// Returns the length of the shared prefix of the key, or 0 if it has none.
+size_t KeyPrefixLen(string_view key) {
+  size_t pos = 0;
+  for (unsigned i = 0; i < tl.prefix_segments; ++i) {
+    pos = key.find(tl.prefix_delim, pos);
+    if (pos == string_view::npos)
+      return 0;
+    ++pos;
+  }
+  return pos >= kMinKeyPrefixLen ? pos : 0;
+}
+
 /// TODO: Ascii encoding becomes slow for large blobs. We should factor it out into a separate
 /// file and implement with SIMD instructions.
 constexpr bool kUseAsciiEncoding = true;
 
 }  // namespace
 
-static_assert(sizeof(CompactObj) == 18);
+static_assert(sizeof(CompactObj) == CompactObj::InlineLen() + 2);
 
 namespace detail {
 
@@ -263,9 +272,13 @@ size_t RobjWrapper::MallocUsed() const {
 
   switch (type_) {
     case OBJ_STRING:
+      if (encoding_ == kEncodingStrChunked)
+        return ((ChunkedString*)inner_obj_)->MallocUsed();
       CHECK_EQ(OBJ_ENCODING_RAW, encoding_);
       return InnerObjMallocUsed();
     case OBJ_LIST:
+      if (encoding_ == kEncodingQL2)
+        return ((QList*)inner_obj_)->MallocUsed();
       DCHECK_EQ(encoding_, OBJ_ENCODING_QUICKLIST);
       return QlMAllocSize((quicklist*)inner_obj_);
     case OBJ_SET:
@@ -287,9 +300,13 @@ size_t RobjWrapper::MallocUsed() const {
 size_t RobjWrapper::Size() const {
   switch (type_) {
     case OBJ_STRING:
+      if (encoding_ == kEncodingStrChunked)
+        return ((ChunkedString*)inner_obj_)->Size();
       DCHECK_EQ(OBJ_ENCODING_RAW, encoding_);
       return sz_;
     case OBJ_LIST:
+      if (encoding_ == kEncodingQL2)
+        return ((QList*)inner_obj_)->Size();
       return quicklistCount((quicklist*)inner_obj_);
     case OBJ_ZSET: {
       switch (encoding_) {
@@ -313,6 +330,8 @@ size_t RobjWrapper::Size() const {
           StringSet* ss = (StringSet*)inner_obj_;
           return ss->UpperBoundSize();
         }
+        case kEncodingRoaring:
+          return ((RoaringIntSet*)inner_obj_)->Size();
         default:
           LOG(FATAL) << "Unexpected encoding " << encoding_;
       };
@@ -323,6 +342,9 @@ size_t RobjWrapper::Size() const {
           return lpLength(lp) / 2;
         } break;
 
+        case kEncodingPackedMap:
+          return PackedMap::Size((uint8_t*)inner_obj_);
+
         case kEncodingStrMap2: {
           StringMap* sm = (StringMap*)inner_obj_;
           return sm->UpperBoundSize();
@@ -341,12 +363,20 @@ void RobjWrapper::Free(MemoryResource* mr) {
   switch (type_) {
     case OBJ_STRING:
       DVLOG(2) << "Freeing string object";
+      if (encoding_ == kEncodingStrChunked) {
+        CompactObj::DeleteMR<ChunkedString>(inner_obj_);
+        break;
+      }
       DCHECK_EQ(OBJ_ENCODING_RAW, encoding_);
       mr->deallocate(inner_obj_, 0, 8);  // we do not keep the allocated size.
       break;
     case OBJ_LIST:
-      CHECK_EQ(encoding_, OBJ_ENCODING_QUICKLIST);
-      quicklistRelease((quicklist*)inner_obj_);
+      if (encoding_ == kEncodingQL2) {
+        CompactObj::DeleteMR<QList>(inner_obj_);
+      } else {
+        CHECK_EQ(encoding_, OBJ_ENCODING_QUICKLIST);
+        quicklistRelease((quicklist*)inner_obj_);
+      }
       break;
     case OBJ_SET:
       FreeObjSet(encoding_, inner_obj_, mr);
@@ -373,6 +403,11 @@ void RobjWrapper::Free(MemoryResource* mr) {
 uint64_t RobjWrapper::HashCode() const {
   switch (type_) {
     case OBJ_STRING:
+      if (encoding_ == kEncodingStrChunked) {
+        string str(Size(), '\0');
+        ((ChunkedString*)inner_obj_)->CopyTo(str.data());
+        return XXH3_64bits_withSeed(str.data(), str.size(), kHashSeed);
+      }
       DCHECK_EQ(OBJ_ENCODING_RAW, encoding());
       {
         auto str = AsView();
@@ -386,13 +421,21 @@ uint64_t RobjWrapper::HashCode() const {
 }
 
 bool RobjWrapper::Equal(const RobjWrapper& ow) const {
-  if (ow.type_ != type_ || ow.encoding_ != encoding_)
+  if (ow.type_ != type_)
     return false;
 
   if (type_ == OBJ_STRING) {
-    DCHECK_EQ(OBJ_ENCODING_RAW, encoding());
-    return AsView() == ow.AsView();
+    if (ow.encoding_ == kEncodingStrChunked) {
+      string str(ow.Size(), '\0');
+      ((ChunkedString*)ow.inner_obj_)->CopyTo(str.data());
+      return Equal(str);
+    }
+    return Equal(ow.AsView());
   }
+
+  if (ow.encoding_ != encoding_)
+    return false;
+
   LOG(FATAL) << "Unsupported type " << type_;
   return false;
 }
@@ -401,6 +444,8 @@ bool RobjWrapper::Equal(string_view sv) const {
   if (type() != OBJ_STRING)
     return false;
 
+  if (encoding_ == kEncodingStrChunked)
+    return ((ChunkedString*)inner_obj_)->Equal(sv);
   DCHECK_EQ(OBJ_ENCODING_RAW, encoding());
   return AsView() == sv;
 }
@@ -420,21 +465,118 @@ void RobjWrapper::SetString(string_view s, MemoryResource* mr) {
 }
 
 bool RobjWrapper::DefragIfNeeded(float ratio) {
-  if (type() == OBJ_STRING) {
-    if (zmalloc_page_is_underutilized(inner_obj(), ratio)) {
-      ReallocateString(tl.local_mr);
-      return true;
-    }
-  } else if (type() == OBJ_HASH) {
-    auto [new_ptr, realloced] = DefragHash(encoding_, inner_obj_, ratio);
-    inner_obj_ = new_ptr;
-    return realloced;
-  } else if (type() == OBJ_SET) {
-    auto [new_ptr, realloced] = DefragSet(encoding_, inner_obj_, ratio);
-    inner_obj_ = new_ptr;
-    return realloced;
+  DefragState state{.ratio = ratio, .budget = SIZE_MAX};
+  DefragStep(&state);
+  return state.moved_bytes > 0;
+}
+
+void RobjWrapper::DefragStep(DefragState* state) {
+  uint32_t cursor = state->cursor;
+  state->cursor = 0;
+
+  // Values stored as a single blob are handled at once.
+  auto update_blob = [&](pair<void*, bool> res) {
+    inner_obj_ = res.first;
+    if (res.second)
+      state->moved_bytes += zmalloc_usable_size(inner_obj_);
+    state->budget -= state->budget > 0;
+  };
+
+  switch (type()) {
+    case OBJ_STRING:
+      // The chunks of huge strings are not moved.
+      if (encoding_ == OBJ_ENCODING_RAW &&
+          zmalloc_page_is_underutilized(inner_obj(), state->ratio)) {
+        state->moved_bytes += zmalloc_usable_size(inner_obj_);
+        ReallocateString(tl.local_mr);
+      }
+      state->budget -= state->budget > 0;
+      break;
+    case OBJ_HASH:
+      switch (encoding_) {
+        case kEncodingListPack:
+          update_blob(DefragListPack((uint8_t*)inner_obj_, state->ratio));
+          break;
+        case kEncodingPackedMap:
+          update_blob(DefragPackedMap((uint8_t*)inner_obj_, state->ratio));
+          break;
+        case kEncodingStrMap2:
+          state->cursor = ((StringMap*)inner_obj_)
+                              ->DefragStep(cursor, state->ratio, &state->budget,
+                                           &state->moved_bytes);
+          break;
+        default:
+          ABSL_UNREACHABLE();
+      }
+      break;
+    case OBJ_SET:
+      if (encoding_ == kEncodingIntSet) {
+        update_blob(DefragIntSet((intset*)inner_obj_, state->ratio));
+      } else if (encoding_ == kEncodingStrMap2) {
+        state->cursor = ((StringSet*)inner_obj_)
+                            ->DefragStep(cursor, state->ratio, &state->budget,
+                                         &state->moved_bytes);
+      }
+      break;
+    case OBJ_ZSET:
+      if (encoding_ == OBJ_ENCODING_LISTPACK) {
+        update_blob(DefragListPack((uint8_t*)inner_obj_, state->ratio));
+      } else {
+        state->cursor = ((detail::SortedMap*)inner_obj_)
+                            ->DefragStep(cursor, state->ratio, &state->budget,
+                                         &state->moved_bytes);
+      }
+      break;
+    case OBJ_LIST:
+      if (encoding_ == kEncodingQL2) {
+        state->cursor = ((QList*)inner_obj_)
+                            ->DefragStep(cursor, state->ratio, &state->budget,
+                                         &state->moved_bytes);
+      }
+      break;
+    default:
+      break;
   }
-  return false;
+}
+
+bool RobjWrapper::FreeStep(uint32_t* cursor, uint32_t count) {
+  switch (type_) {
+    case OBJ_SET:
+      if (encoding_ == kEncodingStrMap2) {
+        StringSet* ss = (StringSet*)inner_obj_;
+        *cursor = ss->ClearStep(*cursor, count);
+        return ss->Empty();
+      }
+      break;
+    case OBJ_HASH:
+      if (encoding_ == kEncodingStrMap2) {
+        StringMap* sm = (StringMap*)inner_obj_;
+        *cursor = sm->ClearStep(*cursor, count);
+        return sm->Empty();
+      }
+      break;
+    case OBJ_ZSET:
+      if (encoding_ != OBJ_ENCODING_LISTPACK) {
+        detail::SortedMap* zs = (detail::SortedMap*)inner_obj_;
+        if (zs->Size() > count) {
+          zs->DeleteRangeByRank(0, count - 1);
+          return false;
+        }
+      }
+      break;
+    case OBJ_LIST:
+      if (encoding_ == kEncodingQL2) {
+        QList* ql = (QList*)inner_obj_;
+        if (ql->Size() > count) {
+          ql->Erase(0, count);
+          return false;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  return true;
 }
 
 int RobjWrapper::ZsetAdd(double score, sds ele, int in_flags, int* out_flags, double* newscore) {
@@ -572,6 +714,10 @@ using namespace std;
 auto CompactObj::GetStats() -> Stats {
   Stats res;
   res.small_string_bytes = tl.small_str_bytes;
+  if (tl.prefix_dict) {
+    res.key_prefixes = tl.prefix_dict->size();
+    res.key_prefix_bytes = tl.prefix_dict->MallocUsed();
+  }
 
   return res;
 }
@@ -579,6 +725,14 @@ auto CompactObj::GetStats() -> Stats {
 void CompactObj::InitThreadLocal(MemoryResource* mr) {
   tl.local_mr = mr;
   tl.tmp_buf = base::PODArray<uint8_t>{mr};
+
+  string delim = GetFlag(FLAGS_key_prefix_delimiter);
+  if (!delim.empty() && !tl.prefix_dict) {
+    LOG_IF(WARNING, delim.size() > 1) << "Only the first character of key_prefix_delimiter is used";
+    tl.prefix_dict = make_unique<KeyPrefixDict>();
+    tl.prefix_delim = delim[0];
+    tl.prefix_segments = max(1u, GetFlag(FLAGS_key_prefix_segments));
+  }
 }
 
 CompactObj::~CompactObj() {
@@ -631,6 +785,18 @@ size_t CompactObj::Size() const {
       case SBF_TAG:
         raw_size = u_.sbf->current_size();
         break;
+      case TS_TAG:
+        raw_size = u_.ts->size();
+        break;
+      case CMS_TAG:
+        raw_size = u_.cms->count();
+        break;
+      case TOPK_TAG:
+        raw_size = u_.topk->list_size();
+        break;
+      case PREFIX_TAG:
+        raw_size = PrefixOf().size() + SuffixOf().size();
+        break;
       default:
         LOG(DFATAL) << "Should not reach " << int(taglen_);
     }
@@ -653,7 +819,7 @@ uint64_t CompactObj::HashCode() const {
     return XXH3_64bits_withSeed(u_.inline_str, taglen_, kHashSeed);
   }
 
-  if (encoded) {
+  if (encoded || taglen_ == PREFIX_TAG) {
     GetString(&tl.tmp_str);
     return XXH3_64bits_withSeed(tl.tmp_str.data(), tl.tmp_str.size(), kHashSeed);
   }
@@ -679,9 +845,12 @@ uint64_t CompactObj::HashCode(string_view str) {
 }
 
 CompactObjType CompactObj::ObjType() const {
-  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == EXTERNAL_TAG)
+  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == PREFIX_TAG)
     return OBJ_STRING;
 
+  if (taglen_ == EXTERNAL_TAG)
+    return u_.ext_ptr.obj_type;
+
   if (taglen_ == ROBJ_TAG)
     return u_.r_obj.type();
 
@@ -693,6 +862,18 @@ CompactObjType CompactObj::ObjType() const {
     return OBJ_SBF;
   }
 
+  if (taglen_ == TS_TAG) {
+    return OBJ_TS;
+  }
+
+  if (taglen_ == CMS_TAG) {
+    return OBJ_CMS;
+  }
+
+  if (taglen_ == TOPK_TAG) {
+    return OBJ_TOPK;
+  }
+
   LOG(FATAL) << "TBD " << int(taglen_);
   return kInvalidCompactObjType;
 }
@@ -714,6 +895,28 @@ void CompactObj::InitRobj(CompactObjType type, unsigned encoding, void* obj) {
   u_.r_obj.Init(type, encoding, obj);
 }
 
+ChunkedString* CompactObj::GetChunked() const {
+  if (taglen_ != ROBJ_TAG || u_.r_obj.type() != OBJ_STRING ||
+      u_.r_obj.encoding() != kEncodingStrChunked)
+    return nullptr;
+  return (ChunkedString*)u_.r_obj.inner_obj();
+}
+
+ChunkedString* CompactObj::ToChunked() {
+  DCHECK_EQ(ObjType(), OBJ_STRING);
+  if (ChunkedString* cs = GetChunked(); cs)
+    return cs;
+
+  ChunkedString* cs = AllocateMR<ChunkedString>();
+  string scratch;
+  cs->Append(GetSlice(&scratch));
+
+  // The chunks hold the decoded bytes.
+  SetMeta(ROBJ_TAG, mask_ & ~kEncMask);
+  u_.r_obj.Init(OBJ_STRING, kEncodingStrChunked, cs);
+  return cs;
+}
+
 void CompactObj::SetInt(int64_t val) {
   if (INT_TAG != taglen_) {
     SetMeta(INT_TAG, mask_ & ~kEncMask);
@@ -737,6 +940,14 @@ auto CompactObj::GetJson() const -> JsonType* {
   return nullptr;
 }
 
+absl::Span<uint8_t> CompactObj::GetJsonFlat() const {
+  if (ObjType() == OBJ_JSON) {
+    DCHECK_EQ(JsonEnconding(), kEncodingJsonFlat);
+    return {u_.json_obj.flat.flat_ptr, u_.json_obj.flat.json_len};
+  }
+  return {};
+}
+
 void CompactObj::SetJson(JsonType&& j) {
   if (taglen_ == JSON_TAG && JsonEnconding() == kEncodingJsonCons) {
     DCHECK(u_.json_obj.cons.json_ptr != nullptr);  // must be allocated
@@ -772,12 +983,13 @@ void CompactObj::SetJson(const uint8_t* buf, size_t len) {
   u_.json_obj.flat.json_len = len;
 }
 
-void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor) {
+void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor,
+                        bool blocked) {
   if (taglen_ == SBF_TAG) {  // already json
-    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   } else {
     SetMeta(SBF_TAG);
-    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   }
 }
 
@@ -786,6 +998,36 @@ SBF* CompactObj::GetSBF() const {
   return u_.sbf;
 }
 
+void CompactObj::SetTimeSeries(uint64_t retention_ms) {
+  SetMeta(TS_TAG);
+  u_.ts = AllocateMR<TimeSeries>(retention_ms, tl.local_mr);
+}
+
+TimeSeries* CompactObj::GetTimeSeries() const {
+  DCHECK_EQ(TS_TAG, taglen_);
+  return u_.ts;
+}
+
+void CompactObj::SetCMS(uint32_t width, uint32_t depth) {
+  SetMeta(CMS_TAG);
+  u_.cms = AllocateMR<CountMinSketch>(width, depth, tl.local_mr);
+}
+
+CountMinSketch* CompactObj::GetCMS() const {
+  DCHECK_EQ(CMS_TAG, taglen_);
+  return u_.cms;
+}
+
+void CompactObj::SetTopK(uint32_t k, uint32_t width, uint32_t depth, double decay) {
+  SetMeta(TOPK_TAG);
+  u_.topk = AllocateMR<TopK>(k, width, depth, decay, tl.local_mr);
+}
+
+TopK* CompactObj::GetTopK() const {
+  DCHECK_EQ(TOPK_TAG, taglen_);
+  return u_.topk;
+}
+
 void CompactObj::SetString(std::string_view str) {
   uint8_t mask = mask_ & ~kEncMask;
   CHECK(!IsExternal());
@@ -813,6 +1055,34 @@ void CompactObj::SetString(std::string_view str) {
   EncodeString(str);
 }
 
+void CompactObj::SetKey(string_view key) {
+  if (tl.prefix_dict && key.size() > kInlineLen) {
+    size_t prefix_len = KeyPrefixLen(key);
+    optional<uint16_t> id;
+    if (prefix_len > 0)
+      id = tl.prefix_dict->Acquire(key.substr(0, prefix_len));
+
+    if (id) {
+      string_view suffix = key.substr(prefix_len);
+      SetMeta(PREFIX_TAG, mask_ & ~kEncMask);
+      u_.prefixed.prefix_id = *id;
+      if (suffix.size() <= PrefixedKey::kInlineSuffixLen) {
+        u_.prefixed.suffix_len = suffix.size();
+        memcpy(u_.prefixed.inline_suffix, suffix.data(), suffix.size());
+      } else {
+        char* ptr = (char*)tl.local_mr->allocate(suffix.size(), kAlignSize);
+        memcpy(ptr, suffix.data(), suffix.size());
+        u_.prefixed.suffix_len = PrefixedKey::kHeapSuffix;
+        u_.prefixed.heap.ptr = ptr;
+        u_.prefixed.heap.len = suffix.size();
+      }
+      return;
+    }
+  }
+
+  SetString(key);
+}
+
 string_view CompactObj::GetSlice(string* scratch) const {
   CHECK(!IsExternal());
   uint8_t is_encoded = mask_ & kEncMask;
@@ -840,6 +1110,12 @@ string_view CompactObj::GetSlice(string* scratch) const {
     return *scratch;
   }
 
+  if (taglen_ == PREFIX_TAG) {
+    scratch->assign(PrefixOf());
+    scratch->append(SuffixOf());
+    return *scratch;
+  }
+
   if (is_encoded) {
     if (taglen_ == ROBJ_TAG) {
       CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -870,6 +1146,11 @@ string_view CompactObj::GetSlice(string* scratch) const {
   // no encoding.
   if (taglen_ == ROBJ_TAG) {
     CHECK_EQ(OBJ_STRING, u_.r_obj.type());
+    if (const ChunkedString* cs = GetChunked(); cs) {
+      scratch->resize(cs->Size());
+      cs->CopyTo(scratch->data());
+      return *scratch;
+    }
     DCHECK_EQ(OBJ_ENCODING_RAW, u_.r_obj.encoding());
     return u_.r_obj.AsView();
   }
@@ -885,24 +1166,41 @@ string_view CompactObj::GetSlice(string* scratch) const {
 }
 
 bool CompactObj::DefragIfNeeded(float ratio) {
+  DefragState state{.ratio = ratio, .budget = SIZE_MAX};
+  DefragStep(&state);
+  return state.moved_bytes > 0;
+}
+
+void CompactObj::DefragStep(DefragState* state) {
   switch (taglen_) {
     case ROBJ_TAG:
       // currently only these objet types are supported for this operation
       if (u_.r_obj.inner_obj() != nullptr) {
-        return u_.r_obj.DefragIfNeeded(ratio);
+        u_.r_obj.DefragStep(state);
+        return;
       }
-      return false;
+      break;
     case SMALL_TAG:
-      return u_.small_str.DefragIfNeeded(ratio);
+      if (u_.small_str.DefragIfNeeded(state->ratio))
+        state->moved_bytes += u_.small_str.MallocUsed();
+      break;
     case INT_TAG:
       // this is not relevant in this case
-      return false;
+      break;
     case EXTERNAL_TAG:
-      return false;
+      break;
     default:
       // This is the case when the object is at inline_str
-      return false;
+      break;
   }
+  state->cursor = 0;
+  state->budget -= state->budget > 0;
+}
+
+bool CompactObj::FreeStep(uint32_t* cursor, uint32_t count) {
+  if (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() != nullptr)
+    return u_.r_obj.FreeStep(cursor, count);
+  return true;
 }
 
 bool CompactObj::HasAllocated() const {
@@ -910,14 +1208,16 @@ bool CompactObj::HasAllocated() const {
       (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() == nullptr))
     return false;
 
-  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG || taglen_ == SBF_TAG);
+  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG ||
+         taglen_ == SBF_TAG || taglen_ == PREFIX_TAG || taglen_ == TS_TAG ||
+         taglen_ == CMS_TAG || taglen_ == TOPK_TAG);
   return true;
 }
 
 bool CompactObj::TagAllowsEmptyValue() const {
   const auto type = ObjType();
   return type == OBJ_JSON || type == OBJ_STREAM || type == OBJ_STRING || type == OBJ_SBF ||
-         type == OBJ_SET;
+         type == OBJ_SET || type == OBJ_TS || type == OBJ_CMS || type == OBJ_TOPK;
 }
 
 void __attribute__((noinline)) CompactObj::GetString(string* res) const {
@@ -951,6 +1251,13 @@ void CompactObj::GetString(char* dest) const {
     return;
   }
 
+  if (taglen_ == PREFIX_TAG) {
+    string_view prefix = PrefixOf(), suffix = SuffixOf();
+    memcpy(dest, prefix.data(), prefix.size());
+    memcpy(dest + prefix.size(), suffix.data(), suffix.size());
+    return;
+  }
+
   if (is_encoded) {
     if (taglen_ == ROBJ_TAG) {
       CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -978,6 +1285,8 @@ void CompactObj::GetString(char* dest) const {
   // no encoding.
   if (taglen_ == ROBJ_TAG) {
     CHECK_EQ(OBJ_STRING, u_.r_obj.type());
+    if (const ChunkedString* cs = GetChunked(); cs)
+      return cs->CopyTo(dest);
     DCHECK_EQ(OBJ_ENCODING_RAW, u_.r_obj.encoding());
     memcpy(dest, u_.r_obj.inner_obj(), u_.r_obj.Size());
     return;
@@ -996,10 +1305,13 @@ void CompactObj::GetString(char* dest) const {
   LOG(FATAL) << "Bad tag " << int(taglen_);
 }
 
-void CompactObj::SetExternal(size_t offset, uint32_t sz) {
+void CompactObj::SetExternal(size_t offset, uint32_t sz, CompactObjType type) {
+  DCHECK_LE(type, OBJ_HASH);
   SetMeta(EXTERNAL_TAG, mask_);
 
   u_.ext_ptr.is_cool = 0;
+  u_.ext_ptr.obj_type = type;
+  u_.ext_ptr.is_compressed = 0;
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.serialized_size = sz;
   u_.ext_ptr.offload.page_index = offset / 4096;
@@ -1010,18 +1322,36 @@ void CompactObj::SetCool(size_t offset, uint32_t sz, detail::TieredColdRecord* r
   SetMeta(EXTERNAL_TAG, record->value.mask_);
 
   u_.ext_ptr.is_cool = 1;
+  u_.ext_ptr.obj_type = record->value.ObjType();
+  u_.ext_ptr.is_compressed = 0;
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.serialized_size = sz;
   u_.ext_ptr.cool_record = record;
 }
 
+void CompactObj::SetExternalCompressed(uint32_t raw_size) {
+  DCHECK(IsExternal() && !u_.ext_ptr.is_compressed);
+  DCHECK_EQ(u_.ext_ptr.page_offset, 0u);
+
+  size_t pages = (size_t(u_.ext_ptr.serialized_size) + 4095) / 4096;
+  DCHECK_LE(pages, UINT16_MAX);
+  u_.ext_ptr.is_compressed = 1;
+  u_.ext_ptr.page_offset = pages;
+  u_.ext_ptr.serialized_size = raw_size;
+}
+
 auto CompactObj::GetCool() const -> CoolItem {
   DCHECK(IsExternal() && u_.ext_ptr.is_cool);
 
   CoolItem res;
-  res.page_offset = u_.ext_ptr.page_offset;
-  res.serialized_size = u_.ext_ptr.serialized_size;
   res.record = u_.ext_ptr.cool_record;
+  if (u_.ext_ptr.is_compressed) {
+    res.page_offset = 0;
+    res.serialized_size = size_t(u_.ext_ptr.page_offset) * 4096;
+  } else {
+    res.page_offset = u_.ext_ptr.page_offset;
+    res.serialized_size = u_.ext_ptr.serialized_size;
+  }
   return res;
 }
 
@@ -1034,8 +1364,12 @@ void CompactObj::ImportExternal(const CompactObj& src) {
 std::pair<size_t, size_t> CompactObj::GetExternalSlice() const {
   DCHECK_EQ(EXTERNAL_TAG, taglen_);
   auto& ext = u_.ext_ptr;
-  size_t offset = ext.page_offset;
-  offset += size_t(ext.is_cool ? ext.cool_record->page_index : ext.offload.page_index) * 4096;
+  size_t offset =
+      size_t(ext.is_cool ? ext.cool_record->page_index : ext.offload.page_index) * 4096;
+  if (ext.is_compressed)
+    return pair<size_t, size_t>(offset, size_t(ext.page_offset) * 4096);
+
+  offset += ext.page_offset;
   return pair<size_t, size_t>(offset, size_t(u_.ext_ptr.serialized_size));
 }
 
@@ -1059,6 +1393,15 @@ void CompactObj::Materialize(std::string_view blob, bool is_raw) {
   }
 }
 
+void CompactObj::Materialize(CompactObj&& obj) {
+  CHECK(IsExternal()) << int(taglen_);
+  DCHECK_EQ(ObjType(), obj.ObjType());
+
+  uint8_t mask = mask_ & ~kEncMask;
+  *this = std::move(obj);
+  mask_ |= mask;
+}
+
 void CompactObj::Reset() {
   if (HasAllocated()) {
     Free();
@@ -1085,6 +1428,16 @@ void CompactObj::Free() {
     }
   } else if (taglen_ == SBF_TAG) {
     DeleteMR<SBF>(u_.sbf);
+  } else if (taglen_ == TS_TAG) {
+    DeleteMR<TimeSeries>(u_.ts);
+  } else if (taglen_ == CMS_TAG) {
+    DeleteMR<CountMinSketch>(u_.cms);
+  } else if (taglen_ == TOPK_TAG) {
+    DeleteMR<TopK>(u_.topk);
+  } else if (taglen_ == PREFIX_TAG) {
+    if (u_.prefixed.suffix_len == PrefixedKey::kHeapSuffix)
+      tl.local_mr->deallocate(u_.prefixed.heap.ptr, u_.prefixed.heap.len, kAlignSize);
+    tl.prefix_dict->Release(u_.prefixed.prefix_id);
   } else {
     LOG(FATAL) << "Unsupported tag " << int(taglen_);
   }
@@ -1117,6 +1470,22 @@ size_t CompactObj::MallocUsed() const {
   if (taglen_ == SBF_TAG) {
     return u_.sbf->MallocUsed();
   }
+
+  if (taglen_ == TS_TAG) {
+    return u_.ts->MallocUsed();
+  }
+
+  if (taglen_ == CMS_TAG) {
+    return u_.cms->MallocUsed();
+  }
+
+  if (taglen_ == TOPK_TAG) {
+    return u_.topk->MallocUsed();
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    return u_.prefixed.suffix_len == PrefixedKey::kHeapSuffix ? u_.prefixed.heap.len : 0;
+  }
   LOG(DFATAL) << "should not reach";
   return 0;
 }
@@ -1124,6 +1493,17 @@ size_t CompactObj::MallocUsed() const {
 bool CompactObj::operator==(const CompactObj& o) const {
   DCHECK(taglen_ != JSON_TAG && o.taglen_ != JSON_TAG) << "cannot use JSON type to check equal";
 
+  // The same key may be stored with or without a prefix id, depending on the dictionary state.
+  if (taglen_ == PREFIX_TAG || o.taglen_ == PREFIX_TAG) {
+    if (taglen_ == o.taglen_ && u_.prefixed.prefix_id == o.u_.prefixed.prefix_id)
+      return SuffixOf() == o.SuffixOf();
+
+    const CompactObj& prefixed = taglen_ == PREFIX_TAG ? *this : o;
+    const CompactObj& other = taglen_ == PREFIX_TAG ? o : *this;
+    string tmp;
+    return prefixed == other.GetSlice(&tmp);
+  }
+
   uint8_t m1 = mask_ & kEncMask;
   uint8_t m2 = o.mask_ & kEncMask;
   if (m1 != m2)
@@ -1157,12 +1537,28 @@ bool CompactObj::EqualNonInline(std::string_view sv) const {
       return u_.r_obj.Equal(sv);
     case SMALL_TAG:
       return u_.small_str.Equal(sv);
+    case PREFIX_TAG: {
+      string_view prefix = PrefixOf();
+      return absl::StartsWith(sv, prefix) && sv.substr(prefix.size()) == SuffixOf();
+    }
     default:
       break;
   }
   return false;
 }
 
+string_view CompactObj::PrefixOf() const {
+  DCHECK_EQ(taglen_, PREFIX_TAG);
+  return tl.prefix_dict->Get(u_.prefixed.prefix_id);
+}
+
+string_view CompactObj::SuffixOf() const {
+  DCHECK_EQ(taglen_, PREFIX_TAG);
+  if (u_.prefixed.suffix_len == PrefixedKey::kHeapSuffix)
+    return {u_.prefixed.heap.ptr, u_.prefixed.heap.len};
+  return {u_.prefixed.inline_suffix, u_.prefixed.suffix_len};
+}
+
 bool CompactObj::CmpEncoded(string_view sv) const {
   size_t encode_len = binpacked_len(sv.size());
 
@@ -1177,7 +1573,7 @@ bool CompactObj::CmpEncoded(string_view sv) const {
   }
 
   if (taglen_ == ROBJ_TAG) {
-    if (u_.r_obj.type() != OBJ_STRING)
+    if (u_.r_obj.type() != OBJ_STRING || u_.r_obj.encoding() != OBJ_ENCODING_RAW)
       return false;
 
     if (u_.r_obj.Size() != encode_len)
@@ -1293,6 +1689,11 @@ StringOrView CompactObj::GetRawString() const {
 
   if (taglen_ == ROBJ_TAG) {
     CHECK_EQ(OBJ_STRING, u_.r_obj.type());
+    if (const ChunkedString* cs = GetChunked(); cs) {
+      string tmp(cs->Size(), '\0');
+      cs->CopyTo(tmp.data());
+      return StringOrView::FromString(std::move(tmp));
+    }
     DCHECK_EQ(OBJ_ENCODING_RAW, u_.r_obj.encoding());
     return StringOrView::FromView(u_.r_obj.AsView());
   }
@@ -1303,6 +1704,10 @@ StringOrView CompactObj::GetRawString() const {
     return StringOrView::FromString(std::move(tmp));
   }
 
+  if (taglen_ == PREFIX_TAG) {
+    return StringOrView::FromString(absl::StrCat(PrefixOf(), SuffixOf()));
+  }
+
   LOG(FATAL) << "Unsupported tag for GetRawString(): " << taglen_;
   return {};
 }
@@ -1315,10 +1720,11 @@ MemoryResource* CompactObj::memory_resource() {
   return tl.local_mr;
 }
 
-constexpr std::pair<CompactObjType, std::string_view> kObjTypeToString[8] = {
-    {OBJ_STRING, "string"sv},  {OBJ_LIST, "list"sv},    {OBJ_SET, "set"sv},
-    {OBJ_ZSET, "zset"sv},      {OBJ_HASH, "hash"sv},    {OBJ_STREAM, "stream"sv},
-    {OBJ_JSON, "ReJSON-RL"sv}, {OBJ_SBF, "MBbloom--"sv}};
+constexpr std::pair<CompactObjType, std::string_view> kObjTypeToString[11] = {
+    {OBJ_STRING, "string"sv},  {OBJ_LIST, "list"sv},        {OBJ_SET, "set"sv},
+    {OBJ_ZSET, "zset"sv},      {OBJ_HASH, "hash"sv},        {OBJ_STREAM, "stream"sv},
+    {OBJ_JSON, "ReJSON-RL"sv}, {OBJ_SBF, "MBbloom--"sv},    {OBJ_TS, "TSDB-TYPE"sv},
+    {OBJ_CMS, "CMSk-TYPE"sv},  {OBJ_TOPK, "TopK-TYPE"sv}};
 
 std::string_view ObjTypeToString(CompactObjType type) {
   for (auto& p : kObjTypeToString) {
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/base/internal/endian.h>
+#include <absl/types/span.h>
 
 #include <boost/intrusive/list_hook.hpp>
 #include <optional>
@@ -22,10 +23,26 @@ constexpr unsigned kEncodingIntSet = 0;
 constexpr unsigned kEncodingStrMap = 1;   // for set/map encodings of strings
 constexpr unsigned kEncodingStrMap2 = 2;  // for set/map encodings of strings using DenseSet
 constexpr unsigned kEncodingListPack = 3;
+constexpr unsigned kEncodingPackedMap = 4;  // for map encodings of short strings using PackedMap
+constexpr unsigned kEncodingRoaring = 5;    // for sets of integers using RoaringIntSet
+constexpr unsigned kEncodingQL2 = 1;        // for lists using QList
+constexpr unsigned kEncodingStrChunked = 1;  // for huge strings using ChunkedString
 constexpr unsigned kEncodingJsonCons = 0;
 constexpr unsigned kEncodingJsonFlat = 1;
 
 class SBF;
+class TimeSeries;
+class CountMinSketch;
+class TopK;
+class ChunkedString;
+
+// Progress of an incremental defragmentation pass over a single value.
+struct DefragState {
+  float ratio;             // page utilization threshold, see zmalloc_page_is_underutilized.
+  size_t budget;           // internal allocations that may still be visited.
+  uint64_t cursor = 0;     // position inside the value, 0 once the value was fully visited.
+  size_t moved_bytes = 0;  // bytes re-allocated so far.
+};
 
 namespace detail {
 
@@ -70,6 +87,13 @@ class RobjWrapper {
   // Returns true if re-allocated.
   bool DefragIfNeeded(float ratio);
 
+  // Resumable variant of DefragIfNeeded, which visits at most state->budget of the members of
+  // large containers per call, see CompactObj::DefragStep.
+  void DefragStep(DefragState* state);
+
+  // See CompactObj::FreeStep.
+  bool FreeStep(uint32_t* cursor, uint32_t count);
+
   // as defined in zset.h
   int ZsetAdd(double score, char* ele, int in_flags, int* out_flags, double* newscore);
 
@@ -105,20 +129,33 @@ constexpr CompactObjType kInvalidCompactObjType = std::numeric_limits<CompactObj
 
 uint32_t JsonEnconding();
 
+// Bytes of the strings that are stored inline, which is also the size of the union of the
+// representations and so of every key and value slot in the tables. Keys are typically 20-30
+// bytes long, so builds can set it to 32 to keep them inline instead of allocating each of them,
+// at the cost of 16 more bytes per slot.
+#ifndef DF_COMPACT_OBJ_INLINE_LEN
+#define DF_COMPACT_OBJ_INLINE_LEN 16
+#endif
+
 class CompactObj {
-  static constexpr unsigned kInlineLen = 16;
+  static constexpr unsigned kInlineLen = DF_COMPACT_OBJ_INLINE_LEN;
+  static_assert(kInlineLen >= 16 && kInlineLen <= 64 && kInlineLen % 8 == 0);
 
   void operator=(const CompactObj&) = delete;
   CompactObj(const CompactObj&) = delete;
 
-  // 0-16 is reserved for inline lengths of string type.
+  // 0-kInlineLen is reserved for inline lengths of string type.
   enum TagEnum {
-    INT_TAG = 17,
-    SMALL_TAG = 18,
-    ROBJ_TAG = 19,
-    EXTERNAL_TAG = 20,
-    JSON_TAG = 21,
-    SBF_TAG = 22,
+    INT_TAG = kInlineLen + 1,
+    SMALL_TAG,
+    ROBJ_TAG,
+    EXTERNAL_TAG,
+    JSON_TAG,
+    SBF_TAG,
+    PREFIX_TAG,  // key whose prefix is stored in the thread-local prefix dictionary.
+    TS_TAG,
+    CMS_TAG,
+    TOPK_TAG,
   };
 
   enum MaskBit {
@@ -251,6 +288,16 @@ class CompactObj {
 
   bool DefragIfNeeded(float ratio);
 
+  // Re-allocates the allocations of the value that sit on underutilized pages, starting from
+  // state->cursor. Containers are processed incrementally: the call returns once the budget is
+  // used up, with state->cursor set to the position to resume from on the next call.
+  void DefragStep(DefragState* state);
+
+  // Frees about count members of a large container, resuming from *cursor, so that the value can
+  // be destroyed in several steps. Returns true once the rest can be freed at once by Reset().
+  // Between the calls the value is valid but holds only part of its members.
+  bool FreeStep(uint32_t* cursor, uint32_t count);
+
   bool HasStashPending() const {
     return mask_ & IO_PENDING;
   }
@@ -290,6 +337,12 @@ class CompactObj {
   // type should not be OBJ_STRING.
   void InitRobj(CompactObjType type, unsigned encoding, void* obj_inner);
 
+  // Returns the chunks of a string stored as ChunkedString, nullptr for other values.
+  ChunkedString* GetChunked() const;
+
+  // Converts the string to a ChunkedString, which lets huge values grow without copying them.
+  ChunkedString* ToChunked();
+
   // For STR object.
   void SetInt(int64_t val);
   std::optional<int64_t> TryGetInt() const;
@@ -307,6 +360,11 @@ class CompactObj {
   void SetString(std::string_view str);
   void GetString(std::string* res) const;
 
+  // Same as SetString, but for keys of the prime table: if key prefix compression is enabled,
+  // the prefix of the key is replaced by an id of the thread-local prefix dictionary.
+  // Such keys can only be read on the thread that created them.
+  void SetKey(std::string_view key);
+
   // Will set this to hold OBJ_JSON, after that it is safe to call GetJson
   // NOTE: in order to avid copy which can be expensive in this case,
   // you need to move an object that created with the function JsonFromString
@@ -319,14 +377,41 @@ class CompactObj {
   // pre condition - the type here is OBJ_JSON and was set with SetJson
   JsonType* GetJson() const;
 
+  // Same as above but for the flat encoding, the buffer can be mutated in place
+  absl::Span<uint8_t> GetJsonFlat() const;
+
   void SetSBF(SBF* sbf) {
     SetMeta(SBF_TAG);
     u_.sbf = sbf;
   }
 
-  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor);
+  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor, bool blocked = false);
   SBF* GetSBF() const;
 
+  void SetTimeSeries(TimeSeries* ts) {
+    SetMeta(TS_TAG);
+    u_.ts = ts;
+  }
+
+  void SetTimeSeries(uint64_t retention_ms);
+  TimeSeries* GetTimeSeries() const;
+
+  void SetCMS(CountMinSketch* cms) {
+    SetMeta(CMS_TAG);
+    u_.cms = cms;
+  }
+
+  void SetCMS(uint32_t width, uint32_t depth);
+  CountMinSketch* GetCMS() const;
+
+  void SetTopK(TopK* topk) {
+    SetMeta(TOPK_TAG);
+    u_.topk = topk;
+  }
+
+  void SetTopK(uint32_t k, uint32_t width, uint32_t depth, double decay);
+  TopK* GetTopK() const;
+
   // dest must have at least Size() bytes available
   void GetString(char* dest) const;
 
@@ -339,12 +424,28 @@ class CompactObj {
     return u_.ext_ptr.is_cool;
   }
 
-  void SetExternal(size_t offset, uint32_t sz);
+  // type is the type of the offloaded object. Only strings and containers serialized with
+  // SerializerBase::DumpObject can be offloaded.
+  void SetExternal(size_t offset, uint32_t sz, CompactObjType type);
   void SetCool(size_t offset, uint32_t serialized_size, detail::TieredColdRecord* record);
 
+  // Marks the external object as compressed. Compressed blobs start on a page boundary and are
+  // read as whole pages, while Size() keeps reporting raw_size.
+  void SetExternalCompressed(uint32_t raw_size);
+
+  bool IsExternalCompressed() const {
+    return IsExternal() && u_.ext_ptr.is_compressed;
+  }
+
+  // True if the string is stored ascii packed, so its stored bytes are not the string itself.
+  bool IsAsciiPacked() const {
+    return mask_ & kEncMask;
+  }
+
+  // Describes the location of the cool object on disk.
   struct CoolItem {
     uint16_t page_offset;
-    size_t serialized_size;
+    size_t serialized_size;  // for compressed objects, the bytes of their pages
     detail::TieredColdRecord* record;
   };
   CoolItem GetCool() const;
@@ -359,6 +460,9 @@ class CompactObj {
   // Postcondition: The object is an in-memory string.
   void Materialize(std::string_view str, bool is_raw);
 
+  // Replaces the external object with the decoded container, keeping the flags of this object.
+  void Materialize(CompactObj&& obj);
+
   // In case this object a single blob, returns number of bytes allocated on heap
   // for that blob. Otherwise returns 0.
   size_t MallocUsed() const;
@@ -376,6 +480,8 @@ class CompactObj {
 
   struct Stats {
     size_t small_string_bytes = 0;
+    size_t key_prefixes = 0;
+    size_t key_prefix_bytes = 0;
   };
 
   static Stats GetStats();
@@ -410,6 +516,11 @@ class CompactObj {
     return taglen_;
   }
 
+  // True if the object is held by a RobjWrapper, i.e. a heap allocated string or a container.
+  bool IsRObj() const {
+    return taglen_ == ROBJ_TAG;
+  }
+
  private:
   void EncodeString(std::string_view str);
   size_t DecodedLen(size_t sz) const;
@@ -421,6 +532,10 @@ class CompactObj {
 
   bool CmpEncoded(std::string_view sv) const;
 
+  // Requires: taglen_ == PREFIX_TAG.
+  std::string_view PrefixOf() const;
+  std::string_view SuffixOf() const;
+
   void SetMeta(uint8_t taglen, uint8_t mask = 0) {
     if (HasAllocated()) {
       Free();
@@ -431,12 +546,14 @@ class CompactObj {
     mask_ = mask;
   }
 
-  // Must be 16 bytes.
+  // Must fit into 16 bytes.
   struct ExternalPtr {
     uint32_t serialized_size;
     uint16_t page_offset;  // 0 for multi-page blobs. != 0 for small blobs.
     uint16_t is_cool : 1;
-    uint16_t is_reserved : 15;
+    uint16_t obj_type : 4;  // OBJ_STRING or a container type
+    uint16_t is_compressed : 1;  // if set, page_offset holds the number of pages of the blob
+    uint16_t is_reserved : 10;
 
     // We do not have enough space in the common area to store page_index together with
     // cool_record pointer. Therefore, we moved this field into TieredColdRecord itself.
@@ -451,6 +568,22 @@ class CompactObj {
     };
   } __attribute__((packed));
 
+  // Must fit into 16 bytes. Suffixes of up to kInlineSuffixLen bytes are stored inline.
+  struct PrefixedKey {
+    static constexpr unsigned kInlineSuffixLen = 13;
+    static constexpr uint8_t kHeapSuffix = 0xFF;
+
+    union {
+      char inline_suffix[kInlineSuffixLen];
+      struct {
+        char* ptr;
+        uint32_t len;
+      } __attribute__((packed)) heap;
+    };
+    uint8_t suffix_len;  // kHeapSuffix if the suffix is allocated on heap.
+    uint16_t prefix_id;
+  } __attribute__((packed));
+
   struct JsonConsT {
     JsonType* json_ptr;
     size_t bytes_used;
@@ -469,7 +602,7 @@ class CompactObj {
   };
 
   // My main data structure. Union of representations.
-  // RobjWrapper is kInlineLen=16 bytes, so we employ SSO of that size via inline_str.
+  // RobjWrapper is 16 bytes, so we employ SSO of at least that size via inline_str.
   // In case of int values, we waste 8 bytes. I am assuming it's ok and it's not the data type
   // with biggest memory usage.
   union U {
@@ -481,19 +614,23 @@ class CompactObj {
     // using 'packed' to reduce alignement of U to 1.
     JsonWrapper json_obj __attribute__((packed));
     SBF* sbf __attribute__((packed));
+    TimeSeries* ts __attribute__((packed));
+    CountMinSketch* cms __attribute__((packed));
+    TopK* topk __attribute__((packed));
     int64_t ival __attribute__((packed));
     ExternalPtr ext_ptr;
+    PrefixedKey prefixed;
 
     U() : r_obj() {
     }
   } u_;
 
   //
-  static_assert(sizeof(u_) == 16);
+  static_assert(sizeof(u_) == kInlineLen);
 
   uint8_t mask_ = 0;
 
-  // We currently reserve 5 bits for tags and 3 bits for extending the mask. currently reserved.
+  // Inline lengths and tags take 5 bits with the default kInlineLen and 6 bits with 32.
   uint8_t taglen_ = 0;
 };
 
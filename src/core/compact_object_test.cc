@@ -17,6 +17,8 @@
 #include "core/flat_set.h"
 #include "core/mi_memory_resource.h"
 
+ABSL_DECLARE_FLAG(std::string, key_prefix_delimiter);
+
 extern "C" {
 #include "redis/intset.h"
 #include "redis/redis_aux.h"
@@ -266,6 +268,24 @@ TEST_F(CompactObjectTest, InlineAsciiEncoded) {
   EXPECT_EQ(s.size(), obj.Size());
 }
 
+// Keys are inline up to InlineLen() bytes, or longer if their ascii packing fits, and allocate
+// otherwise. Builds with DF_COMPACT_OBJ_INLINE_LEN=32 keep typical keys of 20-30 bytes inline.
+TEST_F(CompactObjectTest, InlineLen) {
+  for (unsigned len = 10; len <= 40; ++len) {
+    string ascii = absl::StrCat("key:", string(len - 4, '7'));
+    string binary(len, '\xff');
+    for (const string& key : {ascii, binary}) {
+      CompactObj obj{key};
+      size_t packed_len = key == ascii ? (len * 7 + 7) / 8 : len;
+      bool is_inline = len <= CompactObj::InlineLen() || packed_len <= CompactObj::InlineLen();
+      EXPECT_EQ(obj.IsInline(), is_inline) << len;
+      EXPECT_EQ(obj.MallocUsed() == 0, is_inline) << len;
+      EXPECT_EQ(obj.ToString(), key);
+      EXPECT_EQ(obj, key);
+    }
+  }
+}
+
 TEST_F(CompactObjectTest, Int) {
   cobj_.SetString("0");
   EXPECT_EQ(0, cobj_.TryGetInt());
@@ -297,6 +317,56 @@ TEST_F(CompactObjectTest, MediumString) {
   EXPECT_EQ(27463, cobj_.Size());
 }
 
+TEST_F(CompactObjectTest, PrefixedKey) {
+  string plain_key = "user:1234:profile";
+  CompactObj plain{plain_key};
+
+  // Without a delimiter, keys are stored as regular strings.
+  cobj_.SetKey(plain_key);
+  EXPECT_EQ(plain, cobj_);
+  EXPECT_EQ(0u, CompactObj::GetStats().key_prefixes);
+
+  absl::SetFlag(&FLAGS_key_prefix_delimiter, ":");
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+
+  vector<string> keys = {plain_key, "user:1234:a-suffix-that-is-stored-on-heap",
+                         "user:42:xxxxxxxxxx", "order:1:items-and-more"};
+  vector<CompactObj> objs(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    objs[i].SetKey(keys[i]);
+    EXPECT_EQ(keys[i], objs[i]);
+    EXPECT_EQ(keys[i].size(), objs[i].Size());
+    EXPECT_EQ(keys[i], objs[i].GetSlice(&tmp_));
+    EXPECT_EQ(keys[i], objs[i].ToString());
+    EXPECT_EQ(CompactObj{keys[i]}.HashCode(), objs[i].HashCode());
+    EXPECT_EQ(OBJ_STRING, objs[i].ObjType());
+  }
+  EXPECT_EQ(3u, CompactObj::GetStats().key_prefixes);
+
+  EXPECT_EQ(plain, objs[0]);
+  EXPECT_EQ(objs[0], plain);
+  EXPECT_FALSE(objs[0] == objs[1]);
+  EXPECT_FALSE(objs[0] == objs[2]);
+  EXPECT_FALSE(objs[0] == "user:1234:profilf");
+
+  CompactObj same;
+  same.SetKey(plain_key);
+  EXPECT_EQ(objs[0], same);
+  EXPECT_EQ(3u, CompactObj::GetStats().key_prefixes);
+
+  // Keys with less than two delimiters have no prefix.
+  cobj_.SetKey("user:no-second-delimiter");
+  EXPECT_EQ("user:no-second-delimiter", cobj_);
+  EXPECT_EQ(3u, CompactObj::GetStats().key_prefixes);
+
+  same.Reset();
+  objs.pop_back();
+  EXPECT_EQ(2u, CompactObj::GetStats().key_prefixes);
+  objs.clear();
+  EXPECT_EQ(0u, CompactObj::GetStats().key_prefixes);
+  absl::SetFlag(&FLAGS_key_prefix_delimiter, "");
+}
+
 TEST_F(CompactObjectTest, AsciiUtil) {
   std::string_view data{"aaaaaabb"};
   uint8_t buf[32];
@@ -583,7 +653,7 @@ TEST_F(CompactObjectTest, RawInterface) {
     EXPECT_LT(raw_blob.view().size(), str.size());
 
     raw_blob.MakeOwned();
-    cobj_.SetExternal(0, 10);  // dummy external pointer
+    cobj_.SetExternal(0, 10, OBJ_STRING);  // dummy external pointer
     cobj_.Materialize(raw_blob.view(), true);
 
     EXPECT_EQ(str, cobj_.GetSlice(&tmp));
@@ -598,7 +668,7 @@ TEST_F(CompactObjectTest, RawInterface) {
     EXPECT_EQ(raw_blob.view(), str);
 
     raw_blob.MakeOwned();
-    cobj_.SetExternal(0, 10);  // dummy external pointer
+    cobj_.SetExternal(0, 10, OBJ_STRING);  // dummy external pointer
     cobj_.Materialize(raw_blob.view(), true);
 
     EXPECT_EQ(str, cobj_.GetSlice(&tmp));
@@ -0,0 +1,474 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// Microbenchmarks of the core containers and the RESP parser. Inputs are generated with fixed
+// seeds outside of the measured loops, so that results are comparable across commits:
+//   core_bench --bench --benchmark_repetitions=5 --benchmark_out=before.json
+// and then compare two runs with tools/compare.py of google benchmark.
+
+#include <mimalloc.h>
+
+#include <absl/strings/str_cat.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/gtest.h"
+#include "base/init.h"
+#include "base/logging.h"
+#include "core/bptree_set.h"
+#include "core/compact_object.h"
+#include "core/listpack_find.h"
+#include "core/mi_memory_resource.h"
+#include "core/search/compressed_sorted_set.h"
+#include "core/small_string.h"
+#include "core/sorted_map.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
+#include "core/tagged_set.h"
+#include "core/time_series.h"
+#include "facade/redis_parser.h"
+
+extern "C" {
+#include "redis/listpack.h"
+#include "redis/redis_aux.h"
+#include "redis/zmalloc.h"
+#include "redis/zset.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+string RandomString(mt19937& rand, unsigned len) {
+  const string_view alpanum = "1234567890abcdefghijklmnopqrstuvwxyz";
+  string ret(len, ' ');
+  for (char& c : ret)
+    c = alpanum[rand() % alpanum.size()];
+  return ret;
+}
+
+vector<string> RandomStrings(size_t count, unsigned len, unsigned seed = 10) {
+  mt19937 rand(seed);
+  vector<string> res(count);
+  for (string& s : res)
+    s = RandomString(rand, len);
+  return res;
+}
+
+}  // namespace
+
+// StringSet and TaggedStringSet share the benchmark code to compare the layouts of their tables.
+// Lookups also report the bytes of the table per member.
+template <typename Set> void SetAdd(benchmark::State& state) {
+  vector<string> members = RandomStrings(state.range(0), 16);
+  for (auto _ : state) {
+    Set ss;
+    for (const string& m : members)
+      benchmark::DoNotOptimize(ss.Add(m));
+  }
+  state.SetItemsProcessed(state.iterations() * members.size());
+}
+
+template <typename Set> void SetFind(benchmark::State& state) {
+  vector<string> members = RandomStrings(state.range(0), 16);
+  vector<string> misses = RandomStrings(state.range(0), 16, 11);
+  Set ss;
+  for (const string& m : members)
+    ss.Add(m);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ss.Contains(members[i]));
+    benchmark::DoNotOptimize(ss.Contains(misses[i]));
+    i = (i + 1) % members.size();
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+  state.counters["table_bytes_per_member"] = double(ss.SetMallocUsed()) / members.size();
+}
+
+template <typename Set> void SetErase(benchmark::State& state) {
+  vector<string> members = RandomStrings(state.range(0), 16);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Set ss;
+    for (const string& m : members)
+      ss.Add(m);
+    state.ResumeTiming();
+
+    for (const string& m : members)
+      benchmark::DoNotOptimize(ss.Erase(m));
+  }
+  state.SetItemsProcessed(state.iterations() * members.size());
+}
+
+static void BM_StringSetAdd(benchmark::State& state) {
+  SetAdd<StringSet>(state);
+}
+BENCHMARK(BM_StringSetAdd)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_StringSetFind(benchmark::State& state) {
+  SetFind<StringSet>(state);
+}
+BENCHMARK(BM_StringSetFind)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_StringSetErase(benchmark::State& state) {
+  SetErase<StringSet>(state);
+}
+BENCHMARK(BM_StringSetErase)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_TaggedSetAdd(benchmark::State& state) {
+  SetAdd<TaggedStringSet>(state);
+}
+BENCHMARK(BM_TaggedSetAdd)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_TaggedSetFind(benchmark::State& state) {
+  SetFind<TaggedStringSet>(state);
+}
+BENCHMARK(BM_TaggedSetFind)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_TaggedSetErase(benchmark::State& state) {
+  SetErase<TaggedStringSet>(state);
+}
+BENCHMARK(BM_TaggedSetErase)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_StringMapAdd(benchmark::State& state) {
+  vector<string> fields = RandomStrings(state.range(0), 16);
+  for (auto _ : state) {
+    StringMap sm;
+    for (const string& f : fields)
+      benchmark::DoNotOptimize(sm.AddOrUpdate(f, f));
+  }
+  state.SetItemsProcessed(state.iterations() * fields.size());
+}
+BENCHMARK(BM_StringMapAdd)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_StringMapFind(benchmark::State& state) {
+  vector<string> fields = RandomStrings(state.range(0), 16);
+  StringMap sm;
+  for (const string& f : fields)
+    sm.AddOrUpdate(f, f);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sm.Find(fields[i]) != sm.end());
+    i = (i + 1) % fields.size();
+  }
+}
+BENCHMARK(BM_StringMapFind)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_StringMapErase(benchmark::State& state) {
+  vector<string> fields = RandomStrings(state.range(0), 16);
+  for (auto _ : state) {
+    state.PauseTiming();
+    StringMap sm;
+    for (const string& f : fields)
+      sm.AddOrUpdate(f, f);
+    state.ResumeTiming();
+
+    for (const string& f : fields)
+      benchmark::DoNotOptimize(sm.Erase(f));
+  }
+  state.SetItemsProcessed(state.iterations() * fields.size());
+}
+BENCHMARK(BM_StringMapErase)->Arg(1 << 10)->Arg(1 << 16);
+
+// Range of range(1) members by score from a map of range(0) members with scores 0..n-1.
+static void BM_SortedMapRange(benchmark::State& state) {
+  MiMemoryResource mr(mi_heap_get_backing());
+  detail::SortedMap sm(&mr);
+  vector<string> members = RandomStrings(state.range(0), 12);
+  for (size_t i = 0; i < members.size(); ++i)
+    sm.InsertNew(i, members[i]);
+
+  unsigned len = state.range(1);
+  mt19937 rand(10);
+  zrangespec range{};
+  for (auto _ : state) {
+    range.min = rand() % (members.size() - len);
+    range.max = range.min + len - 1;
+    benchmark::DoNotOptimize(sm.GetRange(range, 0, len, false));
+  }
+}
+BENCHMARK(BM_SortedMapRange)->Args({1 << 10, 10})->Args({1 << 16, 10})->Args({1 << 16, 100});
+
+static void BM_SortedMapRank(benchmark::State& state) {
+  MiMemoryResource mr(mi_heap_get_backing());
+  detail::SortedMap sm(&mr);
+  vector<string> members = RandomStrings(state.range(0), 12);
+  vector<sds> keys;
+  for (size_t i = 0; i < members.size(); ++i) {
+    sm.InsertNew(i, members[i]);
+    keys.push_back(sdsnewlen(members[i].data(), members[i].size()));
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sm.GetRank(keys[i], false));
+    i = (i + 1) % keys.size();
+  }
+  for (sds key : keys)
+    sdsfree(key);
+}
+BENCHMARK(BM_SortedMapRank)->Arg(1 << 10)->Arg(1 << 16);
+
+// Appends range(0) samples of a gauge scraped every second with a small jitter and reports the
+// memory footprint per sample, to compare with ~40+ bytes per member of a sorted set.
+static void BM_TimeSeriesAdd(benchmark::State& state) {
+  MiMemoryResource mr(mi_heap_get_backing());
+  mt19937 rand(10);
+  vector<TimeSeries::Sample> samples(state.range(0));
+  int64_t ts = 1'700'000'000'000;
+  double value = 100;
+  for (auto& sample : samples) {
+    ts += 1000 + (rand() % 16 == 0 ? rand() % 20 : 0);
+    value += (int(rand() % 21) - 10) / 10.0;
+    sample = {ts, value};
+  }
+
+  size_t used = 0;
+  for (auto _ : state) {
+    TimeSeries series(0, &mr);
+    for (const auto& sample : samples)
+      series.Add(sample.ts, sample.value);
+    used = series.MallocUsed();
+  }
+  state.SetItemsProcessed(state.iterations() * samples.size());
+  state.counters["bytes_per_sample"] = double(used) / samples.size();
+}
+BENCHMARK(BM_TimeSeriesAdd)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_CompactObjString(benchmark::State& state) {
+  vector<string> values = RandomStrings(1024, state.range(0));
+  CompactObj obj;
+  string out;
+  size_t i = 0;
+  for (auto _ : state) {
+    obj.SetString(values[i]);
+    obj.GetString(&out);
+    benchmark::DoNotOptimize(out.data());
+    i = (i + 1) % values.size();
+  }
+  obj.Reset();
+}
+BENCHMARK(BM_CompactObjString)->Arg(8)->Arg(20)->Arg(64)->Arg(256);
+
+static void BM_CompactObjInt(benchmark::State& state) {
+  mt19937_64 rand(10);
+  vector<string> values(1024);
+  for (string& v : values)
+    v = absl::StrCat(int64_t(rand()));
+
+  CompactObj obj;
+  string out;
+  size_t i = 0;
+  for (auto _ : state) {
+    obj.SetString(values[i]);
+    obj.GetString(&out);
+    benchmark::DoNotOptimize(out.data());
+    i = (i + 1) % values.size();
+  }
+  obj.Reset();
+}
+BENCHMARK(BM_CompactObjInt);
+
+static void BM_CompressedSortedSetInsert(benchmark::State& state) {
+  mt19937 rand(10);
+  vector<uint32_t> ids(state.range(0));
+  for (uint32_t& id : ids)
+    id = rand() % (ids.size() * 4);
+
+  for (auto _ : state) {
+    search::CompressedSortedSet set{PMR_NS::get_default_resource()};
+    for (uint32_t id : ids)
+      benchmark::DoNotOptimize(set.Insert(id));
+  }
+  state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK(BM_CompressedSortedSetInsert)->Arg(1 << 8)->Arg(1 << 12);
+
+static void BM_CompressedSortedSetIterate(benchmark::State& state) {
+  search::CompressedSortedSet set{PMR_NS::get_default_resource()};
+  for (uint32_t id = 0; id < state.range(0); ++id)
+    set.Insert(id * 3);
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (uint32_t id : set)
+      sum += id;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * set.Size());
+}
+BENCHMARK(BM_CompressedSortedSetIterate)->Arg(1 << 12)->Arg(1 << 16);
+
+static void BM_BPTreeInsertErase(benchmark::State& state) {
+  mt19937_64 rand(10);
+  vector<uint64_t> vals(state.range(0));
+  for (uint64_t& v : vals)
+    v = rand();
+
+  for (auto _ : state) {
+    BPTree<uint64_t> tree;
+    for (uint64_t v : vals)
+      tree.Insert(v);
+    for (uint64_t v : vals)
+      tree.Delete(v);
+  }
+  state.SetItemsProcessed(state.iterations() * vals.size() * 2);
+}
+BENCHMARK(BM_BPTreeInsertErase)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_BPTreeFind(benchmark::State& state) {
+  mt19937_64 rand(10);
+  vector<uint64_t> vals(state.range(0));
+  BPTree<uint64_t> tree;
+  for (uint64_t& v : vals) {
+    v = rand();
+    tree.Insert(v);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tree.GEQ(vals[i]));
+    i = (i + 1) % vals.size();
+  }
+}
+BENCHMARK(BM_BPTreeFind)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_ListpackAppend(benchmark::State& state) {
+  vector<string> values = RandomStrings(state.range(0), 16);
+  for (auto _ : state) {
+    uint8_t* lp = lpNew(0);
+    for (const string& v : values)
+      lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(v.data()), v.size());
+    lpFree(lp);
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_ListpackAppend)->Arg(16)->Arg(128);
+
+static void BM_ListpackFind(benchmark::State& state) {
+  vector<string> values = RandomStrings(state.range(0), 16);
+  uint8_t* lp = lpNew(0);
+  for (const string& v : values)
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(v.data()), v.size());
+
+  size_t i = 0;
+  for (auto _ : state) {
+    uint8_t* s = reinterpret_cast<uint8_t*>(values[i].data());
+    benchmark::DoNotOptimize(lpFind(lp, lpFirst(lp), s, values[i].size(), 0));
+    i = (i + 1) % values.size();
+  }
+  lpFree(lp);
+}
+BENCHMARK(BM_ListpackFind)->Arg(16)->Arg(128);
+
+static void BM_ListpackFindStr(benchmark::State& state) {
+  vector<string> values = RandomStrings(state.range(0), 16);
+  uint8_t* lp = lpNew(0);
+  for (const string& v : values)
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(v.data()), v.size());
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(LpFindStr(lp, lpFirst(lp), values[i], 0));
+    i = (i + 1) % values.size();
+  }
+  lpFree(lp);
+}
+BENCHMARK(BM_ListpackFindStr)->Arg(16)->Arg(128);
+
+// Looks up the fields of a listpack hash with range(0) fields, skipping the values as HGET does.
+template <bool kVectorized> void ListpackHashFind(benchmark::State& state) {
+  vector<string> fields = RandomStrings(state.range(0), 16);
+  vector<string> values = RandomStrings(state.range(0), 32);
+  uint8_t* lp = lpNew(0);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(fields[i].data()), fields[i].size());
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(values[i].data()), values[i].size());
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    string& field = fields[i];
+    if constexpr (kVectorized) {
+      benchmark::DoNotOptimize(LpFindStr(lp, lpFirst(lp), field, 1));
+    } else {
+      uint8_t* s = reinterpret_cast<uint8_t*>(field.data());
+      benchmark::DoNotOptimize(lpFind(lp, lpFirst(lp), s, field.size(), 1));
+    }
+    i = (i + 1) % fields.size();
+  }
+  lpFree(lp);
+}
+
+static void BM_ListpackHashFind(benchmark::State& state) {
+  ListpackHashFind<false>(state);
+}
+BENCHMARK(BM_ListpackHashFind)->Arg(16)->Arg(128);
+
+static void BM_ListpackHashFindStr(benchmark::State& state) {
+  ListpackHashFind<true>(state);
+}
+BENCHMARK(BM_ListpackHashFindStr)->Arg(16)->Arg(128);
+
+static void BM_ListpackIterate(benchmark::State& state) {
+  uint8_t* lp = lpNew(0);
+  for (int64_t i = 0; i < state.range(0); ++i)
+    lp = lpAppendInteger(lp, i * 1000);
+
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (uint8_t* p = lpFirst(lp); p; p = lpNext(lp, p)) {
+      int64_t val;
+      lpGet(p, &val, nullptr);
+      sum += val;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  lpFree(lp);
+}
+BENCHMARK(BM_ListpackIterate)->Arg(16)->Arg(128);
+
+// Parses a pipeline of range(0) SET commands with values of range(1) bytes.
+static void BM_RedisParserPipeline(benchmark::State& state) {
+  mt19937 rand(10);
+  string pipeline;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    string value = RandomString(rand, state.range(1));
+    absl::StrAppend(&pipeline, "*3\r\n$3\r\nSET\r\n$8\r\nkey:", 1000 + i % 9000, "\r\n$",
+                    value.size(), "\r\n", value, "\r\n");
+  }
+
+  facade::RespVec args;
+  for (auto _ : state) {
+    facade::RedisParser parser;
+    facade::RedisParser::Buffer buf{reinterpret_cast<uint8_t*>(pipeline.data()), pipeline.size()};
+    while (!buf.empty()) {
+      uint32_t consumed = 0;
+      auto res = parser.Parse(buf, &consumed, &args);
+      CHECK_EQ(res, facade::RedisParser::OK);
+      buf.remove_prefix(consumed);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * pipeline.size());
+}
+BENCHMARK(BM_RedisParserPipeline)->Args({64, 16})->Args({64, 1024});
+
+void InitCoreBench() {
+  InitRedisTables();
+
+  auto* tlh = mi_heap_get_backing();
+  init_zmalloc_threadlocal(tlh);
+  SmallString::InitThreadLocal(tlh);
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+}
+
+REGISTER_MODULE_INITIALIZER(CoreBench, InitCoreBench());
+
+}  // namespace dfly
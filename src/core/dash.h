@@ -3,11 +3,13 @@
 //
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "absl/random/random.h"
 #include "base/pmr/memory_resource.h"
 #include "core/dash_internal.h"
+#include "core/usdt.h"
 
 namespace dfly {
 
@@ -41,6 +43,7 @@ class DashTable : public detail::DashTableBase {
  public:
   using Key_t = _Key;
   using Value_t = _Value;
+  using Ext_t = typename SegmentType::Ext_t;
   using Segment_t = SegmentType;
 
   //! Total number of buckets in a segment (including stash).
@@ -119,8 +122,17 @@ class DashTable : public detail::DashTableBase {
             PMR_NS::memory_resource* mr = PMR_NS::get_default_resource());
   ~DashTable();
 
+  // Grows the table to hold at least size items without splitting segments on insertion.
   void Reserve(size_t size);
 
+  // Splits the segments that are filled to at least the utilization ratio, so that the inserts
+  // that would fill them up do not pay for the split, or for doubling the directory, themselves.
+  // Visits up to max_segments segments starting from the directory index *cursor, and stops
+  // after max_splits splits. *cursor is set to the index to resume from, 0 after the last
+  // segment. Returns the number of splits.
+  unsigned PreSplitStep(size_t* cursor, unsigned max_segments, unsigned max_splits,
+                        double utilization);
+
   // false for duplicate, true if inserted.
   template <typename U, typename V> std::pair<iterator, bool> Insert(U&& key, V&& value) {
     DefaultEvictionPolicy policy;
@@ -149,6 +161,17 @@ class DashTable : public detail::DashTableBase {
   template <typename U> const_iterator Find(U&& key) const;
   template <typename U> iterator Find(U&& key);
 
+  // Same as Find but uses a precomputed key_hash that must be equal to DoHash(key).
+  template <typename U> iterator Find(U&& key, uint64_t key_hash) {
+    return FindFirst(key_hash, EqPred(key));
+  }
+
+  // Prefetches the buckets that may host an entry with the given hash. Used to overlap cache
+  // misses when resolving many keys: hash and prefetch all of them first, then Find each.
+  void Prefetch(uint64_t key_hash) const {
+    segment_[SegmentId(key_hash)]->Prefetch(key_hash);
+  }
+
   // Find first entry with given key hash that evaulates to true on pred.
   // Pred accepts either (const key&) or (const key&, const value&)
   template <typename Pred> iterator FindFirst(uint64_t key_hash, Pred&& pred);
@@ -156,6 +179,15 @@ class DashTable : public detail::DashTableBase {
   // it must be valid.
   void Erase(iterator it);
 
+  // Returns the slot payload of the entry (see detail::SlotExtOf), allocating the payload array
+  // of its segment if needed. it must be valid.
+  Ext_t& MutableExt(iterator it);
+
+  // Returns true if the segment of the entry has a payload array, i.e. it.ext() is accessible.
+  bool HasExt(const_iterator it) const {
+    return segment_[it.seg_id_]->ext() != nullptr;
+  }
+
   size_t Erase(const Key_t& k);
 
   iterator begin() {
@@ -202,7 +234,8 @@ class DashTable : public detail::DashTableBase {
   // Flat memory usage (allocated) of the table, not including the the memory allocated
   // by the hosted objects.
   size_t mem_usage() const {
-    return segment_.capacity() * sizeof(void*) + sizeof(SegmentType) * unique_segments_;
+    return segment_.capacity() * sizeof(void*) + sizeof(SegmentType) * unique_segments_ +
+           ext_arrays_ * kExtBytes;
   }
 
   size_t bucket_count() const {
@@ -296,6 +329,18 @@ class DashTable : public detail::DashTableBase {
     return stash_unloaded_;
   }
 
+  // Number of inserts that succeeded by relocating entries instead of splitting the segment.
+  uint64_t displaced_inserts() const {
+    return displaced_inserts_;
+  }
+
+  // Up to how many entries an insert may relocate within a full segment before splitting it,
+  // see Segment::InsertDisplaced. 0 disables the relocation. Must be 0 while bucket versions
+  // are used to track changes, because the relocated entries are not reported by CVCOnInsert.
+  void set_max_displacements(uint8_t max_moves) {
+    max_displacements_ = max_moves;
+  }
+
  private:
   enum class InsertMode {
     kInsertIfNotFound,
@@ -308,6 +353,11 @@ class DashTable : public detail::DashTableBase {
   void IncreaseDepth(unsigned new_depth);
   void Split(uint32_t seg_id);
 
+  static constexpr size_t kExtBytes = sizeof(Ext_t) * SegmentType::capacity();
+
+  void AllocateExt(SegmentType* seg);
+  void ReleaseExt(SegmentType* seg);
+
   // Segment directory contains multiple segment pointers, some of them pointing to
   // the same object. IterateDistinct goes over all distinct segments in the table.
   template <typename Cb> void IterateDistinct(Cb&& cb);
@@ -321,6 +371,9 @@ class DashTable : public detail::DashTableBase {
 
   uint64_t garbage_collected_ = 0;
   uint64_t stash_unloaded_ = 0;
+  uint64_t displaced_inserts_ = 0;
+  size_t ext_arrays_ = 0;  // number of allocated slot payload arrays.
+  uint8_t max_displacements_ = 0;
 };  // DashTable
 
 template <typename _Key, typename _Value, typename Policy>
@@ -402,6 +455,11 @@ class DashTable<_Key, _Value, Policy>::Iterator {
     return {seg->Key(bucket_id_, slot_id_), seg->Value(bucket_id_, slot_id_)};
   }
 
+  // Slot payload of the entry. Requires owner().HasExt(*this).
+  std::conditional_t<IsConst, const Ext_t&, Ext_t&> ext() const {
+    return owner_->segment_[seg_id_]->Ext(bucket_id_, slot_id_);
+  }
+
   // Make it self-contained. Does not need container::end().
   bool is_done() const {
     return owner_ == nullptr;
@@ -529,6 +587,7 @@ DashTable<_Key, _Value, Policy>::~DashTable() {
   using alloc_traits = std::allocator_traits<decltype(pa)>;
 
   IterateDistinct([&](SegmentType* seg) {
+    ReleaseExt(seg);
     alloc_traits::destroy(pa, seg);
     alloc_traits::deallocate(pa, seg, 1);
     return false;
@@ -589,6 +648,7 @@ void DashTable<_Key, _Value, Policy>::Clear() {
       policy_.DestroyValue(seg->Value(it.index, it.slot));
     });
     seg->Clear();
+    ReleaseExt(seg);
     return false;
   };
 
@@ -730,19 +790,90 @@ void DashTable<_Key, _Value, Policy>::Erase(iterator it) {
   --size_;
 }
 
+template <typename _Key, typename _Value, typename Policy>
+auto DashTable<_Key, _Value, Policy>::MutableExt(iterator it) -> Ext_t& {
+  SegmentType* seg = segment_[it.seg_id_];
+  if (seg->ext() == nullptr)
+    AllocateExt(seg);
+  return seg->Ext(it.bucket_id_, it.slot_id_);
+}
+
+template <typename _Key, typename _Value, typename Policy>
+void DashTable<_Key, _Value, Policy>::AllocateExt(SegmentType* seg) {
+  PMR_NS::polymorphic_allocator<Ext_t> pa(segment_.get_allocator().resource());
+  Ext_t* ext = pa.allocate(SegmentType::capacity());
+  std::uninitialized_value_construct_n(ext, SegmentType::capacity());
+  seg->set_ext(ext);
+  ++ext_arrays_;
+}
+
+template <typename _Key, typename _Value, typename Policy>
+void DashTable<_Key, _Value, Policy>::ReleaseExt(SegmentType* seg) {
+  if (Ext_t* ext = seg->ext(); ext) {
+    PMR_NS::polymorphic_allocator<Ext_t> pa(segment_.get_allocator().resource());
+    std::destroy_n(ext, SegmentType::capacity());
+    pa.deallocate(ext, SegmentType::capacity());
+    seg->set_ext(nullptr);
+    --ext_arrays_;
+  }
+}
+
 template <typename _Key, typename _Value, typename Policy>
 void DashTable<_Key, _Value, Policy>::Reserve(size_t size) {
   if (size <= capacity())
     return;
 
   size_t sg_floor = (size - 1) / SegmentType::capacity();
-  if (sg_floor < segment_.size()) {
-    return;
+  if (sg_floor >= segment_.size()) {
+    assert(sg_floor > 1u);
+    unsigned new_depth = 1 + (63 ^ __builtin_clzll(sg_floor));
+
+    IncreaseDepth(new_depth);
+  }
+
+  // Split the segments level by level, so that the capacity is spread evenly over the hash space.
+  for (unsigned depth = 0; depth < global_depth_ && capacity() < size; ++depth) {
+    for (size_t i = 0; i < segment_.size() && capacity() < size;) {
+      size_t chunk_size = 1u << (global_depth_ - segment_[i]->local_depth());
+      if (segment_[i]->local_depth() == depth)
+        Split(i);
+      i += chunk_size;
+    }
+  }
+}
+
+template <typename _Key, typename _Value, typename Policy>
+unsigned DashTable<_Key, _Value, Policy>::PreSplitStep(size_t* cursor, unsigned max_segments,
+                                                       unsigned max_splits, double utilization) {
+  const size_t min_size = utilization * SegmentType::capacity();
+  unsigned splits = 0;
+  size_t i = *cursor;
+
+  for (unsigned visited = 0; visited < max_segments && splits < max_splits; ++visited) {
+    if (i >= segment_.size()) {
+      i = 0;
+      break;
+    }
+
+    // Align to the first directory entry of the segment, the directory may have grown since.
+    SegmentType* seg = segment_[i];
+    i &= ~((size_t(1) << (global_depth_ - seg->local_depth())) - 1);
+
+    if (seg->SlowSize() >= min_size) {
+      if (seg->local_depth() == global_depth_) {
+        IncreaseDepth(global_depth_ + 1);
+        i <<= 1;
+      }
+      Split(i);
+      ++splits;
+    }
+
+    // Skip the (possibly split) segment, a freshly split half is only half full.
+    i += size_t(1) << (global_depth_ - segment_[i]->local_depth());
   }
-  assert(sg_floor > 1u);
-  unsigned new_depth = 1 + (63 ^ __builtin_clzll(sg_floor));
 
-  IncreaseDepth(new_depth);
+  *cursor = i < segment_.size() ? i : 0;
+  return splits;
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -837,6 +968,17 @@ auto DashTable<_Key, _Value, Policy>::InsertInternal(U&& key, V&& value, Evictio
       }
     }
 
+    // Trade a bounded number of relocations for a denser segment before growing the table.
+    if (max_displacements_ > 0) {
+      auto it = target->InsertDisplaced(std::forward<U>(key), std::forward<V>(value), key_hash,
+                                        max_displacements_);
+      if (it.found()) {
+        ++size_;
+        ++displaced_inserts_;
+        return std::make_pair(iterator{this, target_seg_id, it.index, it.slot}, true);
+      }
+    }
+
     if (!ev.CanGrow(*this)) {
       throw std::bad_alloc{};
     }
@@ -874,6 +1016,7 @@ void DashTable<_Key, _Value, Policy>::IncreaseDepth(unsigned new_depth) {
 template <typename _Key, typename _Value, typename Policy>
 void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id) {
   SegmentType* source = segment_[seg_id];
+  DFLY_TRACE(dash_split, seg_id, source->local_depth(), unique_segments_);
 
   size_t chunk_size = 1u << (global_depth_ - source->local_depth());
   size_t start_idx = seg_id & (~(chunk_size - 1));
@@ -881,6 +1024,8 @@ void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id) {
   PMR_NS::polymorphic_allocator<SegmentType> alloc(segment_.get_allocator().resource());
   SegmentType* target = alloc.allocate(1);
   alloc.construct(target, source->local_depth() + 1);
+  if (source->ext())
+    AllocateExt(target);
 
   auto hash_fn = [this](const auto& k) { return policy_.HashFn(k); };
 
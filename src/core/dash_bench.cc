@@ -6,11 +6,15 @@
 
 #include <absl/base/internal/cycleclock.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
 
 #include "base/hash.h"
 #include "base/histogram.h"
 #include "base/init.h"
+#include "core/compact_object.h"
 #include "core/dash.h"
+#include "core/huge_page_resource.h"
+#include "core/small_string.h"
 
 extern "C" {
 #include "redis/dict.h"
@@ -23,6 +27,13 @@ using namespace std;
 ABSL_FLAG(uint32_t, n, 100000, "num items");
 ABSL_FLAG(string, type, "dash", "");
 ABSL_FLAG(bool, sds, false, "If true, uses sds as primary key");
+ABSL_FLAG(bool, find, false,
+          "If true, prefills the table with n items and measures lookups instead of inserts");
+ABSL_FLAG(double, miss_ratio, 0.5, "Fraction of lookups that query missing keys in find mode");
+ABSL_FLAG(string, huge_pages, "off", "Dash segment backing: off, madvise or explicit");
+ABSL_FLAG(uint32_t, max_displacements, 0,
+          "Entries an insert may relocate within a full segment before splitting it");
+ABSL_FLAG(uint32_t, key_len, 24, "Length of the keys of the compact table type");
 
 namespace dfly {
 
@@ -85,8 +96,37 @@ struct SdsDashPolicy {
   }
 };
 
+struct CompactDashPolicy {
+  enum { kSlotNum = 14, kBucketNum = 56, kStashBucketNum = 4 };
+  static constexpr bool kUseVersion = false;
+
+  static uint64_t HashFn(const CompactObj& co) {
+    return co.HashCode();
+  }
+
+  static uint64_t HashFn(std::string_view u) {
+    return CompactObj::HashCode(u);
+  }
+
+  static void DestroyKey(CompactObj& co) {
+    co.Reset();
+  }
+
+  static void DestroyValue(uint64_t) {
+  }
+
+  static bool Equal(const CompactObj& c1, const CompactObj& c2) {
+    return c1 == c2;
+  }
+
+  static bool Equal(const CompactObj& c1, std::string_view c2) {
+    return c1 == c2;
+  }
+};
+
 using Dash64 = DashTable<uint64_t, uint64_t, UInt64Policy>;
 using DashSds = DashTable<sds, uint64_t, SdsDashPolicy>;
+using DashCompact = DashTable<CompactObj, uint64_t, CompactDashPolicy>;
 
 using absl::GetFlag;
 
@@ -94,8 +134,10 @@ inline void Sample(int64_t start, int64_t end, base::Histogram* hist) {
   hist->Add((end - start) / 100);
 }
 
-Dash64 udt;
-DashSds sds_dt;
+// Created in main, so that segments can be placed on huge pages.
+Dash64* udt = nullptr;
+DashSds* sds_dt = nullptr;
+DashCompact* compact_dt = nullptr;
 base::Histogram hist;
 
 #define USE_TIME 1
@@ -130,7 +172,7 @@ void BenchFlat(uint64_t num) {
 void BenchDash(uint64_t num) {
   for (uint64_t i = 0; i < num; ++i) {
     time_t start = GetNow();
-    udt.Insert(i, 0);
+    udt->Insert(i, 0);
     LFENCE;
 
     time_t end = GetNow();
@@ -138,15 +180,77 @@ void BenchDash(uint64_t num) {
   }
 }
 
+// Prefills the table and then measures Find latency. Missing keys are taken from
+// the range just above the inserted ones so they hash into the same segments.
+void BenchDashFind(uint64_t num) {
+  for (uint64_t i = 0; i < num; ++i) {
+    udt->Insert(i, 0);
+  }
+
+  double miss_ratio = GetFlag(FLAGS_miss_ratio);
+  uint64_t misses = uint64_t(num * miss_ratio);
+  uint64_t found = 0;
+  for (uint64_t i = misses; i < num + misses; ++i) {
+    time_t start = GetNow();
+    auto it = udt->Find(i);
+    LFENCE;
+    time_t end = GetNow();
+    found += !it.is_done();
+    Sample(start, end, &hist);
+  }
+  CONSOLE_INFO << "Found " << found << " out of " << num;
+}
+
+void BenchFlatFind(uint64_t num) {
+  for (uint64_t i = 0; i < num; ++i) {
+    mymap.emplace(i, 0);
+  }
+
+  double miss_ratio = GetFlag(FLAGS_miss_ratio);
+  uint64_t misses = uint64_t(num * miss_ratio);
+  uint64_t found = 0;
+  for (uint64_t i = misses; i < num + misses; ++i) {
+    time_t start = GetNow();
+    auto it = mymap.find(i);
+    LFENCE;
+    time_t end = GetNow();
+    found += it != mymap.end();
+    Sample(start, end, &hist);
+  }
+  CONSOLE_INFO << "Found " << found << " out of " << num;
+}
+
 inline sds Prefix() {
   return sdsnew("xxxxxxxxxxxxxxxxxxxxxxx");
 }
 
+void BenchDashSdsFind(uint64_t num) {
+  vector<sds> keys(num);
+  for (uint64_t i = 0; i < num; ++i) {
+    keys[i] = sdscatsds(Prefix(), sdsfromlonglong(i));
+    sds_dt->Insert(keys[i], 0);
+  }
+
+  double miss_ratio = GetFlag(FLAGS_miss_ratio);
+  uint64_t misses = uint64_t(num * miss_ratio);
+  uint64_t found = 0;
+  for (uint64_t i = misses; i < num + misses; ++i) {
+    string key = absl::StrCat("xxxxxxxxxxxxxxxxxxxxxxx", i);
+    time_t start = GetNow();
+    auto it = sds_dt->Find(string_view{key});
+    LFENCE;
+    time_t end = GetNow();
+    found += !it.is_done();
+    Sample(start, end, &hist);
+  }
+  CONSOLE_INFO << "Found " << found << " out of " << num;
+}
+
 void BenchDashSds(uint64_t num) {
   sds key = sdscatsds(Prefix(), sdsfromlonglong(0));
   for (uint64_t i = 0; i < num; ++i) {
     time_t start = GetNow();
-    sds_dt.Insert(key, 0);
+    sds_dt->Insert(key, 0);
     time_t end = GetNow();
     Sample(start, end, &hist);
 
@@ -154,6 +258,30 @@ void BenchDashSds(uint64_t num) {
   }
 }
 
+// Inserts CompactObj keys of key_len bytes, to weigh the slot size of the table against the heap
+// bytes of the keys that do not fit inline, see DF_COMPACT_OBJ_INLINE_LEN.
+void BenchDashCompact(uint64_t num) {
+  unsigned key_len = GetFlag(FLAGS_key_len);
+  size_t inline_keys = 0, key_heap_bytes = 0;
+  for (uint64_t i = 0; i < num; ++i) {
+    string key = absl::StrCat(i);
+    if (key.size() < key_len)
+      key.insert(0, key_len - key.size(), 'k');
+
+    CompactObj co{key};
+    inline_keys += co.IsInline();
+    key_heap_bytes += co.MallocUsed();
+
+    time_t start = GetNow();
+    compact_dt->Insert(std::move(co), 0);
+    LFENCE;
+    time_t end = GetNow();
+    Sample(start, end, &hist);
+  }
+  CONSOLE_INFO << "Inline keys " << inline_keys << " out of " << num << ", key heap bytes per key "
+               << double(key_heap_bytes) / num << ", inline length " << CompactObj::InlineLen();
+}
+
 static uint64_t callbackHash(const void* key) {
   return XXH64(&key, sizeof(key), 0);
 }
@@ -198,14 +326,42 @@ int main(int argc, char* argv[]) {
   MainInitGuard guard(&argc, &argv);
 
   init_zmalloc_threadlocal(mi_heap_get_backing());
+  SmallString::InitThreadLocal(mi_heap_get_backing());
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+
+  PMR_NS::memory_resource* mr = PMR_NS::get_default_resource();
+  unique_ptr<HugePageResource> hp_mr;
+  if (string mode = GetFlag(FLAGS_huge_pages); mode != "off") {
+    hp_mr = make_unique<HugePageResource>(
+        mode == "explicit" ? HugePageResource::Mode::kExplicit : HugePageResource::Mode::kMadvise,
+        vector<size_t>{Dash64::kSegBytes, DashSds::kSegBytes, DashCompact::kSegBytes}, mr);
+    mr = hp_mr.get();
+  }
+  Dash64 dash64(1, UInt64Policy{}, mr);
+  DashSds dash_sds(1, SdsDashPolicy{}, mr);
+  DashCompact dash_compact(1, CompactDashPolicy{}, mr);
+  udt = &dash64;
+  sds_dt = &dash_sds;
+  compact_dt = &dash_compact;
+  udt->set_max_displacements(GetFlag(FLAGS_max_displacements));
+  sds_dt->set_max_displacements(GetFlag(FLAGS_max_displacements));
 
   string table_type = GetFlag(FLAGS_type);
 
   bool is_sds = GetFlag(FLAGS_sds);
+  bool is_find = GetFlag(FLAGS_find);
   uint64_t start = absl::GetCurrentTimeNanos();
   uint64_t num = GetFlag(FLAGS_n);
 
-  if (table_type == "dash") {
+  if (is_find) {
+    if (table_type == "dash") {
+      is_sds ? BenchDashSdsFind(num) : BenchDashFind(num);
+    } else if (table_type == "flat") {
+      BenchFlatFind(num);
+    } else {
+      LOG(FATAL) << "find mode is not supported for " << table_type;
+    }
+  } else if (table_type == "dash") {
     if (is_sds) {
       BenchDashSds(num);
     } else {
@@ -219,6 +375,8 @@ int main(int argc, char* argv[]) {
     }
   } else if (table_type == "flat") {
     BenchFlat(num);
+  } else if (table_type == "compact") {
+    BenchDashCompact(num);
   } else {
     LOG(FATAL) << "Unknown type " << table_type;
   }
@@ -226,6 +384,20 @@ int main(int argc, char* argv[]) {
   CONSOLE_INFO << "latencies histogram (jiffies, 100ns):\n" << hist.ToString();
   uint64_t delta = (absl::GetCurrentTimeNanos() - start) / 1000000;
   CONSOLE_INFO << "Took " << delta << " ms";
+  auto report_table = [](const char* name, const auto& dt) {
+    if (dt.size() == 0)
+      return;
+    CONSOLE_INFO << name << ": load factor " << dt.load_factor() << ", table bytes per key "
+                 << double(dt.mem_usage()) / dt.size() << ", displaced inserts "
+                 << dt.displaced_inserts();
+  };
+  report_table("dash64", *udt);
+  report_table("dash_sds", *sds_dt);
+  report_table("dash_compact", *compact_dt);
+  if (hp_mr) {
+    CONSOLE_INFO << "Huge page chunks: " << hp_mr->stats().chunks
+                 << ", explicit: " << hp_mr->stats().explicit_chunks;
+  }
 
   return 0;
 }
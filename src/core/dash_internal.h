@@ -6,6 +6,7 @@
 
 #include <absl/base/internal/endian.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
@@ -110,6 +111,7 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
 
   static constexpr unsigned kStashFpLen = NUM_STASH_FPS;
   static constexpr unsigned kStashPresentBit = 1 << 4;
+  static constexpr unsigned kStashFpMask = (1u << NUM_STASH_FPS) - 1;
 
   using FpArray = std::array<uint8_t, NUM_SLOTS>;
   using StashFpArray = std::array<uint8_t, NUM_STASH_FPS>;
@@ -148,6 +150,13 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
     return mask & GetProbe(probe);
   }
 
+  // Returns the mask of busy stash fingerprint slots that match fp_hash and belong
+  // to this bucket (probe=false) or to its neighbour (probe=true).
+  unsigned FindStash(uint8_t fp_hash, bool probe) const {
+    unsigned om = probe ? stash_probe_mask_ : ~stash_probe_mask_;
+    return CompareStashFP(fp_hash) & stash_busy_ & om & kStashFpMask;
+  }
+
   uint8_t Fp(unsigned i) const {
     assert(i < finger_arr_.size());
     return finger_arr_[i];
@@ -208,6 +217,10 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
 
  protected:
   uint32_t CompareFP(uint8_t fp) const;
+
+  // Compares fp against all stash fingerprints at once. Only the lower kStashFpLen bits
+  // of the result are meaningful.
+  uint32_t CompareStashFP(uint8_t fp) const;
   bool ShiftRight();
 
   // Returns true if stash_pos was stored, false overwise
@@ -289,6 +302,18 @@ static_assert(alignof(VersionedBB<14, 4>) == 1, "");
 static_assert(sizeof(VersionedBB<12, 4>) == 12 * 2 + 8, "");
 static_assert(sizeof(VersionedBB<14, 4>) <= 14 * 2 + 8, "");
 
+// A policy may declare `using SlotExt = T;` to attach a payload of type T to every slot.
+// Segments keep the payloads out of line in an array that is allocated by the table on first
+// use, so tables that never use them pay only for a null pointer per segment. A payload follows
+// its entry when the entry moves, and slots without an entry hold a value-initialized payload.
+template <typename Policy, typename = void> struct SlotExtOf {
+  using type = uint8_t;  // never allocated.
+};
+
+template <typename Policy> struct SlotExtOf<Policy, std::void_t<typename Policy::SlotExt>> {
+  using type = typename Policy::SlotExt;
+};
+
 // Segment - static-hashtable of size kSlotNum*(kBucketNum + kStashBucketNum).
 struct DefaultSegmentPolicy {
   static constexpr unsigned kSlotNum = 12;
@@ -330,6 +355,9 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
 
     template <typename Pred> SlotId FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const;
 
+    // Checks pred only against slots set in mask, which is usually computed by Find().
+    template <typename Pred> SlotId FindByMask(unsigned mask, Pred&& pred) const;
+
     bool ShiftRight();
 
     void Swap(unsigned slot_a, unsigned slot_b) {
@@ -395,6 +423,7 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   using Value_t = _Value;
   using Key_t = _Key;
   using Hash_t = uint64_t;
+  using Ext_t = typename SlotExtOf<Policy>::type;
 
   explicit Segment(size_t depth) : local_depth_(depth) {
   }
@@ -412,6 +441,7 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   // If MoveFrom fails, the dashtable will abort, assert and will be left in an inconsistent state.
   // If MoveFrom succeeds, the src segment will be left empty but with inconsistent metadata, so
   // should it should be deallocated or reinitialized.
+  // Requires: this segment has a payload array if src has one.
   template <typename HashFn> void MoveFrom(HashFn&& hfunc, Segment* src);
 
   void Delete(const Iterator& it, Hash_t key_hash);
@@ -491,6 +521,26 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
     return bucket_[bid].value[slot];
   }
 
+  // Slot payloads array of kMaxSize entries, null if not allocated.
+  Ext_t* ext() const {
+    return ext_;
+  }
+
+  // Requires: the array is null or value-initialized.
+  void set_ext(Ext_t* ext) {
+    ext_ = ext;
+  }
+
+  Ext_t& Ext(unsigned bid, unsigned slot) {
+    assert(ext_);
+    return ext_[bid * kSlotNum + slot];
+  }
+
+  const Ext_t& Ext(unsigned bid, unsigned slot) const {
+    assert(ext_);
+    return ext_[bid * kSlotNum + slot];
+  }
+
   // fill bucket ids that may be used probing for this key_hash.
   // The order is: exact, neighbour buckets.
   static void FillProbeArray(Hash_t key_hash, uint8_t dest[4]) {
@@ -503,6 +553,13 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   // Find item with given key hash and truthy predicate
   template <typename Pred> Iterator FindIt(Hash_t key_hash, Pred&& pred) const;
 
+  // Prefetches the home and the neighbour buckets of key_hash.
+  void Prefetch(Hash_t key_hash) const {
+    uint8_t bid = BucketIndex(key_hash);
+    __builtin_prefetch(&bucket_[bid]);
+    __builtin_prefetch(&bucket_[NextBid(bid)]);
+  }
+
   // Returns valid iterator if succeeded or invalid if not (it's full).
   // Requires: key should be not present in the segment.
   // if spread is true, tries to spread the load between neighbour and home buckets,
@@ -512,6 +569,15 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   template <typename U, typename V>
   Iterator InsertUniq(U&& key, V&& value, Hash_t key_hash, bool spread);
 
+  // Fallback for when InsertUniq fails. Frees a slot for the key by relocating entries along a
+  // chain of up to max_moves adjacent buckets, cuckoo style: an entry may move from its home
+  // bucket to the next one and back, so a free slot a few buckets away can be shifted towards
+  // the key. Lets the segment fill up further before it must be split. Requires: key should be
+  // not present in the segment. Returns an invalid iterator if no chain was found.
+  // Important! Moves entries between buckets without capturing their versions.
+  template <typename U, typename V>
+  Iterator InsertDisplaced(U&& key, V&& value, Hash_t key_hash, unsigned max_moves);
+
   // capture version change in case of insert.
   // Returns ids of buckets whose version would cross ver_threshold upon insertion of key_hash
   // into the segment.
@@ -540,6 +606,12 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
         RemoveStashReference(bid - kBucketNum, right_hashval);
     }
 
+    if (ext_) {
+      Ext_t* first = ext_ + bid * kSlotNum;
+      std::move_backward(first, first + kSlotNum - 1, first + kSlotNum);
+      first[0] = Ext_t{};
+    }
+
     return bucket_[bid].ShiftRight();
   }
 
@@ -596,8 +668,24 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   // returns a valid iterator if succeeded.
   Iterator TryMoveFromStash(unsigned stash_id, unsigned stash_slot_id, Hash_t key_hash);
 
+  // Moves the payload of an entry that moved to (to_bid, to_slot) of dest and resets the source.
+  void MoveExt(unsigned from_bid, unsigned from_slot, Segment* dest, unsigned to_bid,
+               unsigned to_slot) {
+    if (ext_) {
+      Ext_t& src = Ext(from_bid, from_slot);
+      dest->Ext(to_bid, to_slot) = std::move(src);
+      src = Ext_t{};
+    }
+  }
+
+  void ResetExt(unsigned bid, unsigned slot) {
+    if (ext_)
+      Ext(bid, slot) = Ext_t{};
+  }
+
   Bucket bucket_[kTotalBuckets];
   size_t local_depth_;
+  Ext_t* ext_ = nullptr;
 
  public:
   static constexpr size_t kBucketSz = sizeof(Bucket);
@@ -931,6 +1019,15 @@ uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareFP(uint8_t fp) const {
 
   return mask;
 }
+
+template <unsigned NUM_SLOTS, unsigned NUM_OVR>
+uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareStashFP(uint8_t fp) const {
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < kStashFpLen; ++i) {
+    mask |= uint32_t(stash_arr_[i] == fp) << i;
+  }
+  return mask;
+}
 #else
 template <unsigned NUM_SLOTS, unsigned NUM_OVR>
 uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareFP(uint8_t fp) const {
@@ -951,6 +1048,20 @@ uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareFP(uint8_t fp) const {
   // Note: Last 2 operations can be combined in skylake with _mm_cmpeq_epi8_mask.
   return mask;
 }
+
+template <unsigned NUM_SLOTS, unsigned NUM_OVR>
+uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareStashFP(uint8_t fp) const {
+  static_assert(sizeof(StashFpArray) <= 4);
+
+  // stash_arr_ is followed by other bucket fields, so we copy it into a zeroed word
+  // instead of loading 4 bytes directly. The caller masks out the unused lanes anyway.
+  uint32_t stash_fps = 0;
+  memcpy(&stash_fps, stash_arr_.data(), sizeof(StashFpArray));
+
+  __m128i stash_data = _mm_cvtsi32_si128(stash_fps);
+  __m128i rv_mask = _mm_cmpeq_epi8(stash_data, _mm_set1_epi8(fp));
+  return _mm_movemask_epi8(rv_mask);
+}
 #endif
 
 // Bucket slot array goes from left to right: [x, x, ...]
@@ -972,19 +1083,16 @@ template <unsigned NUM_SLOTS, unsigned NUM_OVR>
 template <typename F>
 auto BucketBase<NUM_SLOTS, NUM_OVR>::IterateStash(uint8_t fp, bool is_probe, F&& func) const
     -> ::std::pair<unsigned, SlotId> {
-  unsigned om = is_probe ? stash_probe_mask_ : ~stash_probe_mask_;
-  unsigned ob = stash_busy_;
-
-  for (unsigned i = 0; i < kStashFpLen; ++i) {
-    if ((ob & 1) && (stash_arr_[i] == fp) && (om & 1)) {
-      unsigned pos = (stash_pos_ >> (i * 2)) & 3;
-      auto sid = func(i, pos);
-      if (sid != BucketBase::kNanSlot) {
-        return std::pair<unsigned, SlotId>(pos, sid);
-      }
+  unsigned mask = FindStash(fp, is_probe);
+
+  while (mask) {
+    unsigned i = __builtin_ctz(mask);
+    unsigned pos = (stash_pos_ >> (i * 2)) & 3;
+    auto sid = func(i, pos);
+    if (sid != BucketBase::kNanSlot) {
+      return std::pair<unsigned, SlotId>(pos, sid);
     }
-    ob >>= 1;
-    om >>= 1;
+    mask &= mask - 1;
   }
   return std::pair<unsigned, SlotId>(0, BucketBase::kNanSlot);
 }
@@ -1024,7 +1132,12 @@ template <typename Key, typename Value, typename Policy>
 template <typename Pred>
 auto Segment<Key, Value, Policy>::Bucket::FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const
     -> SlotId {
-  unsigned mask = this->Find(fp_hash, probe);
+  return FindByMask(this->Find(fp_hash, probe), std::forward<Pred>(pred));
+}
+
+template <typename Key, typename Value, typename Policy>
+template <typename Pred>
+auto Segment<Key, Value, Policy>::Bucket::FindByMask(unsigned mask, Pred&& pred) const -> SlotId {
   if (!mask)
     return kNanSlot;
 
@@ -1094,6 +1207,7 @@ auto Segment<Key, Value, Policy>::TryMoveFromStash(unsigned stash_id, unsigned s
       uint64_t ver = bucket_[stash_bid].GetVersion();
       bucket_[bid].UpdateVersion(ver);
     }
+    MoveExt(stash_bid, stash_slot_id, this, bid, reg_slot);
     RemoveStashReference(stash_id, key_hash);
     return Iterator{bid, SlotId(reg_slot)};
   }
@@ -1125,16 +1239,22 @@ auto Segment<Key, Value, Policy>::FindIt(Hash_t key_hash, Pred&& pred) const ->
   // since we are going to access this memory in a bit.
   __builtin_prefetch(&target);
 
+  uint8_t nid = NextBid(bidx);
+  const Bucket& probe = bucket_[nid];
+
+  // Compute the fingerprint matches of both the home and the neighbour buckets before touching
+  // any keys. Both are a handful of SIMD instructions and this way the key comparisons below
+  // do not interleave with the probing itself.
   uint8_t fp_hash = key_hash & kFpMask;
-  SlotId sid = target.FindByFp(fp_hash, false, pred);
+  unsigned target_mask = target.Find(fp_hash, false);
+  unsigned probe_mask = probe.Find(fp_hash, true);
+
+  SlotId sid = target.FindByMask(target_mask, pred);
   if (sid != BucketType::kNanSlot) {
     return Iterator{bidx, sid};
   }
 
-  uint8_t nid = NextBid(bidx);
-  const Bucket& probe = bucket_[nid];
-
-  sid = probe.FindByFp(fp_hash, true, pred);
+  sid = probe.FindByMask(probe_mask, pred);
 
 #ifdef ENABLE_DASH_STATS
   stats.neighbour_probes++;
@@ -1161,8 +1281,13 @@ auto Segment<Key, Value, Policy>::FindIt(Hash_t key_hash, Pred&& pred) const ->
     stats.stash_overflow_probes++;
 #endif
 
+    unsigned stash_masks[kStashBucketNum];
     for (unsigned i = 0; i < kStashBucketNum; ++i) {
-      auto sid = stash_cb(0, i);
+      stash_masks[i] = bucket_[kBucketNum + i].Find(fp_hash, false);
+    }
+
+    for (unsigned i = 0; i < kStashBucketNum; ++i) {
+      auto sid = bucket_[kBucketNum + i].FindByMask(stash_masks[i], pred);
       if (sid != BucketType::kNanSlot) {
         return Iterator{uint8_t(kBucketNum + i), sid};
       }
@@ -1200,6 +1325,8 @@ template <typename Key, typename Value, typename Policy> void Segment<Key, Value
   for (unsigned i = 0; i < kTotalBuckets; ++i) {
     bucket_[i].Clear();
   }
+  if (ext_)
+    std::fill(ext_, ext_ + kMaxSize, Ext_t{});
 }
 
 template <typename Key, typename Value, typename Policy>
@@ -1213,6 +1340,7 @@ void Segment<Key, Value, Policy>::Delete(const Iterator& it, Hash_t key_hash) {
   }
 
   b.Delete(it.slot);
+  ResetExt(it.index, it.slot);
 }
 
 // Split items from the left segment to the right during the growth phase.
@@ -1264,7 +1392,7 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
       // for our dash hash function, thus avoiding the case where someone, on purpose or due to
       // selective bias will be able to hit our dashtable with items with the same bucket id.
       assert(it.found());
-      (void)it;
+      MoveExt(i, slot, dest_right, it.index, it.slot);
 
       if constexpr (kUseVersion) {
         // Maintaining consistent versioning.
@@ -1299,8 +1427,8 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
       invalid_mask |= (1u << slot);
       auto it = dest_right->InsertUniq(std::forward<Key_t>(bucket->key[slot]),
                                        std::forward<Value_t>(bucket->value[slot]), hash, false);
-      (void)it;
       assert(it.index != kNanBid);
+      MoveExt(bid, slot, dest_right, it.index, it.slot);
 
       if constexpr (kUseVersion) {
         // Update the version in the destination bucket.
@@ -1335,6 +1463,7 @@ void Segment<Key, Value, Policy>::MoveFrom(HFunc&& hfunc, Segment* src) {
         success = false;
         return;
       }
+      src->MoveExt(bid, slot, this, it.index, it.slot);
 
       if constexpr (kUseVersion) {
         // Update the version in the destination bucket.
@@ -1363,6 +1492,8 @@ int Segment<Key, Value, Policy>::MoveToOther(bool own_items, unsigned from_bid,
   if (dst_slot < 0)
     return -1;
 
+  MoveExt(from_bid, src_slot, this, to_bid, dst_slot);
+
   // We never decrease the version of the entry.
   if constexpr (kUseVersion) {
     auto& dst = bucket_[to_bid];
@@ -1447,6 +1578,62 @@ auto Segment<Key, Value, Policy>::InsertUniq(U&& key, V&& value, Hash_t key_hash
   return Iterator{};
 }
 
+template <typename Key, typename Value, typename Policy>
+template <typename U, typename V>
+auto Segment<Key, Value, Policy>::InsertDisplaced(U&& key, V&& value, Hash_t key_hash,
+                                                  unsigned max_moves) -> Iterator {
+  const uint8_t bid = BucketIndex(key_hash);
+  const uint8_t nid = NextBid(bid);
+  const uint8_t meta_hash = key_hash & kFpMask;
+
+  // Forward chain: a free slot in nid + k is shifted back to nid by moving one own entry of each
+  // bucket on the way to its next bucket, starting from the farthest one.
+  uint8_t cur = nid;
+  for (unsigned k = 1; k <= max_moves && bucket_[cur].GetProbe(false); ++k) {
+    uint8_t next = NextBid(cur);
+    if (next == bid)
+      break;
+    if (!bucket_[next].IsFull()) {
+      for (uint8_t to = next; to != nid;) {
+        uint8_t from = PrevBid(to);
+        int moved = MoveToOther(true, from, to);
+        assert(moved >= 0);
+        (void)moved;
+        to = from;
+      }
+      int slot = TryInsertToBucket(nid, std::forward<U>(key), std::forward<V>(value), meta_hash,
+                                   true);
+      assert(slot >= 0);
+      return Iterator{nid, uint8_t(slot)};
+    }
+    cur = next;
+  }
+
+  // Backward chain: entries that probe into a bucket move back to their home bucket.
+  cur = bid;
+  for (unsigned k = 1; k <= max_moves && bucket_[cur].GetProbe(true); ++k) {
+    uint8_t prev = PrevBid(cur);
+    if (prev == nid)
+      break;
+    if (!bucket_[prev].IsFull()) {
+      for (uint8_t to = prev; to != bid;) {
+        uint8_t from = NextBid(to);
+        int moved = MoveToOther(false, from, to);
+        assert(moved >= 0);
+        (void)moved;
+        to = from;
+      }
+      int slot = TryInsertToBucket(bid, std::forward<U>(key), std::forward<V>(value), meta_hash,
+                                   false);
+      assert(slot >= 0);
+      return Iterator{bid, uint8_t(slot)};
+    }
+    cur = prev;
+  }
+
+  return Iterator{};
+}
+
 template <typename Key, typename Value, typename Policy>
 template <bool UV>
 std::enable_if_t<UV, unsigned> Segment<Key, Value, Policy>::CVCOnInsert(uint64_t ver_threshold,
@@ -1653,6 +1840,8 @@ auto Segment<Key, Value, Policy>::BumpUp(uint8_t bid, SlotId slot, Hash_t key_ha
     // non stash case.
     if (slot > 0 && bp.CanBump(from.key[slot - 1])) {
       from.Swap(slot - 1, slot);
+      if (ext_)
+        std::swap(Ext(bid, slot - 1), Ext(bid, slot));
       return Iterator{bid, uint8_t(slot - 1)};
     }
     // TODO: We could promote further, by swapping probing bucket with its previous one.
@@ -1700,6 +1889,8 @@ auto Segment<Key, Value, Policy>::BumpUp(uint8_t bid, SlotId slot, Hash_t key_ha
   // swap keys, values and fps. update slots meta.
   std::swap(from.key[slot], swapb.key[kLastSlot]);
   std::swap(from.value[slot], swapb.value[kLastSlot]);
+  if (ext_)
+    std::swap(Ext(bid, slot), Ext(swap_bid, kLastSlot));
   from.Delete(slot);
   from.SetHash(slot, swap_fp, false);
 
@@ -501,9 +501,68 @@ TEST_F(DashTest, Reserve) {
   for (unsigned i = 0; i <= bc * 2; ++i) {
     dt_.Reserve(i);
     ASSERT_GE((1 << dt_.depth()) * Dash64::kSegCapacity, i);
+    ASSERT_GE(dt_.capacity(), i);
   }
 }
 
+TEST_F(DashTest, PreSplitStep) {
+  constexpr size_t kNumItems = 20000;
+  for (size_t i = 0; i < kNumItems; ++i)
+    dt_.Insert(i, i);
+
+  // Sweep the directory until no segment is at least half full.
+  size_t cursor = 0;
+  unsigned splits = 0, rounds = 0;
+  do {
+    splits = 0;
+    do {
+      splits += dt_.PreSplitStep(&cursor, 8, 2, 0.5);
+    } while (cursor != 0);
+    ++rounds;
+  } while (splits > 0 && rounds < 10);
+
+  EXPECT_EQ(splits, 0u);
+  EXPECT_LT(dt_.load_factor(), 0.5);
+  EXPECT_EQ(kNumItems, dt_.size());
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt_.Find(i);
+    ASSERT_TRUE(it != dt_.end());
+    ASSERT_EQ(it->second, i);
+  }
+
+  // Inserting into the half-empty segments does not split them.
+  size_t segments = dt_.unique_segments();
+  for (size_t i = kNumItems; i < kNumItems + 1000; ++i)
+    dt_.Insert(i, i);
+  EXPECT_EQ(segments, dt_.unique_segments());
+}
+
+TEST_F(DashTest, InsertDisplaced) {
+  constexpr size_t kNumItems = 100000;
+  Dash64 dense;
+  dense.set_max_displacements(8);
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i, i);
+    dense.Insert(i, i);
+  }
+
+  // Relocations postpone the splits, so the same items fit into fewer segments.
+  EXPECT_GT(dense.displaced_inserts(), 0u);
+  EXPECT_LE(dense.unique_segments(), dt_.unique_segments());
+  EXPECT_EQ(kNumItems, dense.size());
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dense.Find(i);
+    ASSERT_TRUE(it != dense.end()) << i;
+    ASSERT_EQ(it->second, i);
+  }
+
+  for (size_t i = 0; i < kNumItems; i += 2)
+    ASSERT_EQ(1u, dense.Erase(i));
+  for (size_t i = 1; i < kNumItems; i += 2)
+    ASSERT_TRUE(dense.Find(i) != dense.end()) << i;
+}
+
 TEST_F(DashTest, Insert) {
   constexpr size_t kNumItems = 10000;
   double sum = 0;
@@ -543,6 +602,63 @@ TEST_F(DashTest, Insert) {
   ASSERT_TRUE(dt_.Find(some_val).is_done());
 }
 
+TEST_F(DashTest, SlotExt) {
+  struct ExtPolicy : public UInt64Policy {
+    using SlotExt = uint64_t;
+  };
+  using ExtDash = DashTable<uint64_t, uint64_t, ExtPolicy>;
+
+  constexpr size_t kNumItems = 20000;
+  ExtDash dt;
+  size_t mem_usage = dt.mem_usage();
+
+  // Payloads must follow their entries through the bucket moves and splits of later inserts.
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto [it, inserted] = dt.Insert(i, i);
+    ASSERT_TRUE(inserted);
+    if (i % 3 == 0)
+      dt.MutableExt(it) = i + 1;
+  }
+  EXPECT_GT(dt.mem_usage(), mem_usage);
+
+  for (size_t i = 0; i < kNumItems; i += 2) {
+    ASSERT_EQ(1u, dt.Erase(i));
+  }
+
+  for (size_t i = kNumItems; i < kNumItems * 2; ++i) {
+    dt.Insert(i, i);  // reuses the slots of the erased entries.
+  }
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt.Find(i);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(it.is_done());
+      continue;
+    }
+    ASSERT_FALSE(it.is_done());
+    if (dt.HasExt(it)) {
+      ASSERT_EQ(i % 3 == 0 ? i + 1 : 0, it.ext()) << i;
+    } else {
+      ASSERT_NE(0u, i % 3);
+    }
+    dt.BumpUp(it, RelaxedBumpPolicy{});
+  }
+
+  for (size_t i = 1; i < kNumItems; i += 2) {
+    auto it = dt.Find(i);
+    ASSERT_EQ(i % 3 == 0 ? i + 1 : 0, dt.HasExt(it) ? it.ext() : 0) << i;
+  }
+
+  for (size_t i = kNumItems; i < kNumItems * 2; ++i) {
+    auto it = dt.Find(i);
+    ASSERT_TRUE(!dt.HasExt(it) || it.ext() == 0) << i;
+  }
+
+  // Clear releases the payload arrays.
+  dt.Clear();
+  EXPECT_FALSE(dt.HasExt(dt.Insert(1, 1).first));
+}
+
 TEST_F(DashTest, Traverse) {
   constexpr auto kNumItems = 50;
   for (size_t i = 0; i < kNumItems; ++i) {
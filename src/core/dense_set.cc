@@ -50,6 +50,8 @@ void DenseSet::IteratorBase::SetExpiryTime(uint32_t ttl_sec) {
   if (!HasExpiry()) {
     auto src = curr_entry_->GetObject();
     void* new_obj = owner_->ObjectClone(src, false, true);
+    owner_->obj_malloc_used_ += owner_->ObjectAllocSize(new_obj);
+    owner_->obj_malloc_used_ -= owner_->ObjectAllocSize(src);
     curr_entry_->SetObject(new_obj);
     curr_entry_->SetTtl(true);
     owner_->ObjDelete(src, false);
@@ -817,6 +819,43 @@ void DenseSet::CollectExpired() {
   }
 }
 
+uint32_t DenseSet::CollectExpiredStep(uint32_t cursor, uint32_t count) {
+  if (!expiration_used_)
+    return 0;
+
+  uint32_t end = std::min<size_t>(entries_.size(), size_t(cursor) + count);
+  for (; cursor < end; ++cursor) {
+    DensePtr* curr = &entries_[cursor];
+    ExpireIfNeeded(nullptr, curr);
+    while (curr->IsLink()) {
+      if (ExpireIfNeeded(curr, &curr->AsLink()->next) && !curr->IsLink())
+        break;
+      curr = &curr->AsLink()->next;
+    }
+  }
+
+  return cursor < entries_.size() ? cursor : 0;
+}
+
+uint32_t DenseSet::TraverseStep(uint32_t cursor, size_t* budget,
+                                const std::function<void(DensePtr*)>& cb) {
+  for (; cursor < entries_.size() && *budget > 0; ++cursor) {
+    DensePtr* curr = &entries_[cursor];
+    ExpireIfNeeded(nullptr, curr);
+    while (!curr->IsEmpty()) {
+      cb(curr->IsLink() ? curr->AsLink() : curr);
+      *budget -= *budget > 0;
+      if (!curr->IsLink())
+        break;
+      if (ExpireIfNeeded(curr, &curr->AsLink()->next) && !curr->IsLink())
+        break;
+      curr = &curr->AsLink()->next;
+    }
+  }
+
+  return cursor < entries_.size() ? cursor : 0;
+}
+
 size_t DenseSet::SizeSlow() {
   CollectExpired();
   return size_;
@@ -217,6 +217,12 @@ class DenseSet {
     ClearInternal(0, entries_.size());
   }
 
+  // Frees the members of count buckets starting from bucket start and returns the bucket to
+  // continue from, so that a large set can be cleared in several steps.
+  uint32_t ClearStep(uint32_t start, uint32_t count) {
+    return ClearInternal(start, count);
+  }
+
   // Returns the number of elements in the map. Note that it might be that some of these elements
   // have expired and can't be accessed.
   size_t UpperBoundSize() const {
@@ -266,6 +272,10 @@ class DenseSet {
     return expiration_used_;
   }
 
+  // Deletes the expired items of up to count buckets, starting from the bucket at cursor.
+  // Returns the cursor to continue from or 0 if the last bucket was reached.
+  uint32_t CollectExpiredStep(uint32_t cursor, uint32_t count);
+
  protected:
   // Virtual functions to be implemented for generic data
   virtual uint64_t Hash(const void* obj, uint32_t cookie) const = 0;
@@ -278,6 +288,11 @@ class DenseSet {
 
   void CollectExpired();
 
+  // Calls cb with the entry holding each object in the buckets starting at cursor. Stops at the
+  // end of the bucket in which the budget of visited objects runs out and decrements *budget.
+  // Returns the cursor to continue from or 0 if the last bucket was reached.
+  uint32_t TraverseStep(uint32_t cursor, size_t* budget, const std::function<void(DensePtr*)>& cb);
+
   bool EraseInternal(void* obj, uint32_t cookie) {
     auto [prev, found] = Find(obj, BucketId(obj, cookie), cookie);
     if (found) {
@@ -324,6 +339,10 @@ class DenseSet {
 
   void Prefetch(uint64_t hash);
 
+  MemoryResource* mr() const {
+    return entries_.get_allocator().resource();
+  }
+
  private:
   DenseSet(const DenseSet&) = delete;
   DenseSet& operator=(DenseSet&) = delete;
@@ -341,10 +360,6 @@ class DenseSet {
   using ClearItem = CloneItem;
   void ClearBatch(unsigned len, ClearItem* items);
 
-  MemoryResource* mr() {
-    return entries_.get_allocator().resource();
-  }
-
   uint32_t BucketId(uint64_t hash) const {
     assert(capacity_log_ > 0);
     return hash >> (64 - capacity_log_);
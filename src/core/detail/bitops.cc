@@ -0,0 +1,210 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/detail/bitops.h"
+
+#include <absl/base/config.h>
+#include <absl/numeric/bits.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DFLY_BITOPS_X86 1
+#endif
+
+namespace dfly {
+
+namespace detail {
+
+namespace {
+
+inline uint64_t LoadWord(const uint8_t* p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+inline void StoreWord(uint8_t* p, uint64_t w) {
+  memcpy(p, &w, sizeof(w));
+}
+
+template <BitOpKind op, typename T> inline T ApplyOp(T a, T b) {
+  if constexpr (op == BitOpKind::AND)
+    return a & b;
+  else if constexpr (op == BitOpKind::OR)
+    return a | b;
+  else
+    return a ^ b;
+}
+
+size_t PopcountPortable(const uint8_t* data, size_t len) {
+  // Independent counters let the popcounts of consecutive words run in parallel.
+  size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    c0 += absl::popcount(LoadWord(data + i));
+    c1 += absl::popcount(LoadWord(data + i + 8));
+    c2 += absl::popcount(LoadWord(data + i + 16));
+    c3 += absl::popcount(LoadWord(data + i + 24));
+  }
+  for (; i + 8 <= len; i += 8) {
+    c0 += absl::popcount(LoadWord(data + i));
+  }
+  for (; i < len; ++i) {
+    c0 += absl::popcount(data[i]);
+  }
+  return c0 + c1 + c2 + c3;
+}
+
+template <BitOpKind op> void BitOpPortable(const uint8_t* src, size_t len, uint8_t* dest) {
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    StoreWord(dest + i, ApplyOp<op>(LoadWord(dest + i), LoadWord(src + i)));
+  }
+  for (; i < len; ++i) {
+    dest[i] = ApplyOp<op>(dest[i], src[i]);
+  }
+}
+
+size_t FindNotEqualPortable(const uint8_t* data, size_t len, uint8_t byte) {
+  const uint64_t pattern = 0x0101010101010101ULL * byte;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t diff = LoadWord(data + i) ^ pattern;
+    if (diff) {
+#ifdef ABSL_IS_LITTLE_ENDIAN
+      return i + absl::countr_zero(diff) / 8;
+#else
+      return i + absl::countl_zero(diff) / 8;
+#endif
+    }
+  }
+  for (; i < len; ++i) {
+    if (data[i] != byte)
+      return i;
+  }
+  return len;
+}
+
+#ifdef DFLY_BITOPS_X86
+
+__attribute__((target("avx2"))) size_t PopcountAvx2(const uint8_t* data, size_t len) {
+  // Nibble lookup popcount: the per-byte counts are accumulated in 8 bit lanes and flushed
+  // into 64 bit lanes with sad_epu8 before they can overflow.
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                                          2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  constexpr size_t kMaxInnerLoops = 255 / 8;
+
+  __m256i acc = zero;
+  size_t i = 0;
+  while (i + 32 <= len) {
+    __m256i local = zero;
+    for (size_t j = 0; j < kMaxInnerLoops && i + 32 <= len; ++j, i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i lo = _mm256_and_si256(v, low_mask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+      local = _mm256_add_epi8(local, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                                     _mm256_shuffle_epi8(lookup, hi)));
+    }
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(local, zero));
+  }
+
+  size_t res = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+               _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+  return res + PopcountPortable(data + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) size_t PopcountAvx512(const uint8_t* data,
+                                                                         size_t len) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(data + i)));
+  }
+  return _mm512_reduce_add_epi64(acc) + PopcountPortable(data + i, len - i);
+}
+
+template <BitOpKind op>
+__attribute__((target("avx2"))) void BitOpAvx2(const uint8_t* src, size_t len, uint8_t* dest) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i r;
+    if constexpr (op == BitOpKind::AND)
+      r = _mm256_and_si256(a, b);
+    else if constexpr (op == BitOpKind::OR)
+      r = _mm256_or_si256(a, b);
+    else
+      r = _mm256_xor_si256(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), r);
+  }
+  BitOpPortable<op>(src + i, len - i, dest + i);
+}
+
+__attribute__((target("avx2"))) size_t FindNotEqualAvx2(const uint8_t* data, size_t len,
+                                                        uint8_t byte) {
+  const __m256i pattern = _mm256_set1_epi8(byte);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    uint32_t eq_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+    if (eq_mask != UINT32_MAX)
+      return i + absl::countr_zero(~eq_mask);
+  }
+  return i + FindNotEqualPortable(data + i, len - i, byte);
+}
+
+#endif
+
+struct Kernels {
+  size_t (*popcount)(const uint8_t*, size_t) = PopcountPortable;
+  void (*bitop[3])(const uint8_t*, size_t, uint8_t*) = {BitOpPortable<BitOpKind::AND>,
+                                                         BitOpPortable<BitOpKind::OR>,
+                                                         BitOpPortable<BitOpKind::XOR>};
+  size_t (*find_not_equal)(const uint8_t*, size_t, uint8_t) = FindNotEqualPortable;
+};
+
+Kernels ResolveKernels() {
+  Kernels kernels;
+#ifdef DFLY_BITOPS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.popcount = PopcountAvx2;
+    kernels.bitop[0] = BitOpAvx2<BitOpKind::AND>;
+    kernels.bitop[1] = BitOpAvx2<BitOpKind::OR>;
+    kernels.bitop[2] = BitOpAvx2<BitOpKind::XOR>;
+    kernels.find_not_equal = FindNotEqualAvx2;
+  }
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+    kernels.popcount = PopcountAvx512;
+  }
+#endif
+  return kernels;
+}
+
+const Kernels& GetKernels() {
+  static const Kernels kernels = ResolveKernels();
+  return kernels;
+}
+
+}  // namespace
+
+size_t popcount_bytes(const uint8_t* data, size_t len) {
+  return GetKernels().popcount(data, len);
+}
+
+void bitop_bytes(BitOpKind op, const uint8_t* src, size_t len, uint8_t* dest) {
+  GetKernels().bitop[static_cast<unsigned>(op)](src, len, dest);
+}
+
+size_t find_first_byte_not_equal(const uint8_t* data, size_t len, uint8_t byte) {
+  return GetKernels().find_not_equal(data, len, byte);
+}
+
+}  // namespace detail
+}  // namespace dfly
@@ -0,0 +1,31 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dfly {
+
+namespace detail {
+
+// Kernels used by the bitmap commands. On x86_64 the widest implementation supported by the cpu
+// (AVX-512 VPOPCNTDQ, AVX2 or the portable one) is selected at runtime, since release binaries
+// are built for a baseline cpu.
+
+enum class BitOpKind : uint8_t { AND, OR, XOR };
+
+// Returns the number of set bits in the `len` bytes at `data`.
+size_t popcount_bytes(const uint8_t* data, size_t len);
+
+// Applies `dest[i] = dest[i] <op> src[i]` for the first `len` bytes.
+void bitop_bytes(BitOpKind op, const uint8_t* src, size_t len, uint8_t* dest);
+
+// Returns the index of the first of the `len` bytes at `data` that differs from `byte`,
+// or `len` if there is none.
+size_t find_first_byte_not_equal(const uint8_t* data, size_t len, uint8_t byte);
+
+}  // namespace detail
+}  // namespace dfly
@@ -764,6 +764,12 @@ template <typename T> bool BPTreePath<T>::Next() {
     Push(node, 0);
   } while (!node->IsLeaf());
 
+  // Sequential scans visit the sibling leaf next, fetch it while the current one is consumed.
+  BPTreeNode<T>* parent = Node(depth_ - 2);
+  unsigned pos = Position(depth_ - 2);
+  if (pos < parent->NumItems())
+    __builtin_prefetch(parent->Child(pos + 1));
+
   return true;
 }
 
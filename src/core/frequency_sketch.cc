@@ -0,0 +1,64 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/frequency_sketch.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+namespace dfly {
+
+namespace {
+
+constexpr uint64_t kSeeds[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                               0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(size_t num_counters) {
+  num_counters = absl::bit_ceil(std::max<size_t>(num_counters, 64));
+  table_.resize(num_counters / 16);
+  counter_mask_ = num_counters - 1;
+  max_samples_ = num_counters * 10;
+}
+
+size_t FrequencySketch::CounterIndex(uint64_t hash, unsigned i) const {
+  uint64_t h = (hash + kSeeds[i]) * kSeeds[i];
+  h += h >> 32;
+  return h & counter_mask_;
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+  bool added = false;
+  for (unsigned i = 0; i < kDepth; ++i) {
+    size_t index = CounterIndex(hash, i);
+    uint64_t& word = table_[index / 16];
+    unsigned shift = (index % 16) * 4;
+    if (((word >> shift) & 0xf) < kMaxFrequency) {
+      word += 1ULL << shift;
+      added = true;
+    }
+  }
+
+  if (added && ++samples_ >= max_samples_)
+    Age();
+}
+
+unsigned FrequencySketch::Estimate(uint64_t hash) const {
+  unsigned res = kMaxFrequency;
+  for (unsigned i = 0; i < kDepth; ++i) {
+    size_t index = CounterIndex(hash, i);
+    res = std::min<unsigned>(res, (table_[index / 16] >> ((index % 16) * 4)) & 0xf);
+  }
+  return res;
+}
+
+void FrequencySketch::Age() {
+  for (uint64_t& word : table_)
+    word = (word >> 1) & 0x7777777777777777ULL;
+  samples_ /= 2;
+}
+
+}  // namespace dfly
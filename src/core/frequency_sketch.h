@@ -0,0 +1,47 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dfly {
+
+// Approximate access frequency estimator, a count-min sketch with 4-bit counters.
+// Counters are halved once the number of samples reaches 10 times the number of counters,
+// so that the estimate reflects recent activity (see TinyLFU by Einziger, Friedman and Manes).
+// Estimates can only be overstated due to collisions, never understated.
+class FrequencySketch {
+ public:
+  static constexpr unsigned kMaxFrequency = 15;
+
+  // num_counters is rounded up to a power of 2 and at least 64.
+  explicit FrequencySketch(size_t num_counters);
+
+  void Increment(uint64_t hash);
+
+  // Returns the estimated recent frequency of hash in [0, kMaxFrequency].
+  unsigned Estimate(uint64_t hash) const;
+
+  // Halves all counters.
+  void Age();
+
+  size_t MallocUsed() const {
+    return table_.capacity() * sizeof(uint64_t);
+  }
+
+ private:
+  static constexpr unsigned kDepth = 4;
+
+  // Returns the index of the counter for hash in row i.
+  size_t CounterIndex(uint64_t hash, unsigned i) const;
+
+  std::vector<uint64_t> table_;  // 16 counters per word
+  size_t counter_mask_;
+  size_t samples_ = 0, max_samples_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,51 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/frequency_sketch.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+class FrequencySketchTest : public ::testing::Test {
+ protected:
+  FrequencySketch sketch_{1024};
+};
+
+TEST_F(FrequencySketchTest, Basic) {
+  EXPECT_EQ(sketch_.Estimate(1), 0u);
+
+  for (unsigned i = 0; i < 5; i++)
+    sketch_.Increment(1);
+  EXPECT_EQ(sketch_.Estimate(1), 5u);
+
+  for (unsigned i = 0; i < 100; i++)
+    sketch_.Increment(2);
+  EXPECT_EQ(sketch_.Estimate(2), FrequencySketch::kMaxFrequency);
+
+  sketch_.Age();
+  EXPECT_EQ(sketch_.Estimate(1), 2u);
+  EXPECT_EQ(sketch_.Estimate(2), FrequencySketch::kMaxFrequency / 2);
+}
+
+TEST_F(FrequencySketchTest, HotAndCold) {
+  FrequencySketch sketch{8192};
+
+  // Touch a few hot keys often among many cold keys touched once.
+  for (uint64_t i = 0; i < 5000; i++) {
+    sketch.Increment(i * 0x9e3779b97f4a7c15ULL);
+    sketch.Increment(i % 10);
+  }
+
+  for (uint64_t i = 0; i < 10; i++)
+    EXPECT_GE(sketch.Estimate(i), 5u);
+
+  unsigned cold_overestimated = 0;
+  for (uint64_t i = 10; i < 5000; i++)
+    cold_overestimated += sketch.Estimate(i * 0x9e3779b97f4a7c15ULL) >= 5;
+  EXPECT_LT(cold_overestimated, 50u);
+}
+
+}  // namespace dfly
@@ -0,0 +1,155 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/glob_matcher.h"
+
+#include <algorithm>
+
+extern "C" {
+#include "redis/util.h"
+}
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Returns the position after the bracket expression that starts at pos, skipping it the same
+// way stringmatchlen does, including its handling of escapes, ranges and a missing ']'.
+size_t SkipBracket(string_view pattern, size_t pos) {
+  size_t len = pattern.size();
+  size_t i = pos + 1;
+  if (i < len && pattern[i] == '^')
+    ++i;
+
+  while (true) {
+    if (i < len && pattern[i] == '\\' && len - i >= 2) {
+      ++i;
+    } else if (i < len && pattern[i] == ']') {
+      break;
+    } else if (i >= len) {
+      i = len - 1;
+      break;
+    } else if (len - i >= 3 && pattern[i + 1] == '-') {
+      i += 2;
+    }
+    ++i;
+  }
+  return i + 1;
+}
+
+}  // namespace
+
+GlobMatcher::GlobMatcher(string_view pattern) : pattern_(pattern) {
+  // Splits the pattern into tokens that match a single character, except for '*'. The prefix is
+  // the run of literals before the first other token and the suffix is the run after the last.
+  bool in_prefix = true;
+  size_t i = 0;
+  while (i < pattern.size()) {
+    char c = pattern[i];
+    if (c == '*' || c == '?' || c == '[') {
+      if (in_prefix)
+        rest_pos_ = i;
+      in_prefix = false;
+      suffix_.clear();
+      min_len_ += c != '*';
+      i = c == '[' ? SkipBracket(pattern, i) : i + 1;
+      continue;
+    }
+
+    // A backslash escapes the next character, unless it ends the pattern.
+    if (c == '\\' && i + 1 < pattern.size())
+      c = pattern[++i];
+    (in_prefix ? prefix_ : suffix_).push_back(c);
+    ++min_len_;
+    ++i;
+  }
+
+  if (in_prefix) {
+    kind_ = LITERAL;
+    rest_pos_ = pattern.size();
+  } else if (pattern.find_first_not_of('*', rest_pos_) == string_view::npos) {
+    kind_ = PREFIX;
+  }
+}
+
+bool GlobMatcher::Matches(string_view str) const {
+  if (str.size() < min_len_ || str.compare(0, prefix_.size(), prefix_) != 0)
+    return false;
+  return MatchesAfterPrefix(str);
+}
+
+bool GlobMatcher::MatchesAfterPrefix(string_view str) const {
+  // stringmatchlen does not match an empty string even with "*".
+  if (str.empty())
+    return pattern_.empty();
+
+  switch (kind_) {
+    case LITERAL:
+      return str.size() == prefix_.size();
+    case PREFIX:
+      return true;
+    case GENERIC:
+      break;
+  }
+
+  if (str.size() < min_len_ ||
+      str.compare(str.size() - suffix_.size(), suffix_.size(), suffix_) != 0)
+    return false;
+
+  string_view rest = string_view{pattern_}.substr(rest_pos_);
+  str.remove_prefix(prefix_.size());
+  return stringmatchlen(rest.data(), rest.size(), str.data(), str.size(), 0) == 1;
+}
+
+GlobIndex::GlobIndex() : nodes_(1) {
+}
+
+void GlobIndex::Add(string_view pattern) {
+  uint32_t id = matchers_.size();
+  matchers_.emplace_back(pattern);
+
+  uint32_t node = 0;
+  for (char c : matchers_.back().prefix()) {
+    auto& children = nodes_[node].children;
+    auto it = lower_bound(children.begin(), children.end(), c,
+                          [](const auto& child, char c) { return child.first < c; });
+    if (it != children.end() && it->first == c) {
+      node = it->second;
+      continue;
+    }
+
+    uint32_t next = nodes_.size();
+    children.emplace(it, c, next);
+    nodes_.emplace_back();
+    node = next;
+  }
+  nodes_[node].matchers.push_back(id);
+}
+
+void GlobIndex::Match(string_view str, absl::FunctionRef<void(string_view)> cb) const {
+  uint32_t node = 0;
+  for (size_t depth = 0;; ++depth) {
+    for (uint32_t id : nodes_[node].matchers) {
+      const GlobMatcher& matcher = matchers_[id];
+      if (matcher.MatchesAfterPrefix(str))
+        cb(matcher.pattern());
+    }
+
+    if (depth == str.size())
+      break;
+
+    const auto& children = nodes_[node].children;
+    auto it = lower_bound(children.begin(), children.end(), str[depth],
+                          [](const auto& child, char c) { return child.first < c; });
+    if (it == children.end() || it->first != str[depth])
+      break;
+    node = it->second;
+  }
+}
+
+}  // namespace dfly
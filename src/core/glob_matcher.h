@@ -0,0 +1,79 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dfly {
+
+// Glob pattern with the syntax and semantics of stringmatchlen, compiled for matching many
+// strings. The literal prefix and suffix of the pattern and its minimal match length are checked
+// before the pattern is interpreted, so that most strings are rejected with a length check and a
+// memcmp, and patterns of the form "literal" or "prefix*" are never interpreted at all.
+class GlobMatcher {
+ public:
+  explicit GlobMatcher(std::string_view pattern);
+
+  bool Matches(std::string_view str) const;
+
+  std::string_view pattern() const {
+    return pattern_;
+  }
+
+  // The unescaped literal characters that every match starts with.
+  std::string_view prefix() const {
+    return prefix_;
+  }
+
+ private:
+  friend class GlobIndex;
+
+  enum Kind : uint8_t { LITERAL, PREFIX, GENERIC };
+
+  // Matches str whose prefix is known to match.
+  bool MatchesAfterPrefix(std::string_view str) const;
+
+  std::string pattern_;
+  std::string prefix_, suffix_;
+  uint32_t rest_pos_ = 0;  // position in pattern_ after the prefix.
+  uint32_t min_len_ = 0;
+  Kind kind_ = GENERIC;
+};
+
+// Set of glob patterns that finds all the patterns matching a string in a single pass over it.
+// The patterns are kept in a trie keyed by their literal prefix, so matching a string walks
+// down its characters and only checks the patterns whose prefix it starts with, instead of
+// interpreting every pattern. Patterns without a prefix, like "*suffix", are checked for every
+// string. The set is immutable once built.
+class GlobIndex {
+ public:
+  GlobIndex();
+
+  void Add(std::string_view pattern);
+
+  // Calls cb with every pattern that matches str, in no particular order.
+  void Match(std::string_view str, absl::FunctionRef<void(std::string_view pattern)> cb) const;
+
+  size_t size() const {
+    return matchers_.size();
+  }
+
+ private:
+  struct Node {
+    std::vector<std::pair<char, uint32_t>> children;  // sorted by character.
+    std::vector<uint32_t> matchers;                   // ids of patterns whose prefix ends here.
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<GlobMatcher> matchers_;
+};
+
+}  // namespace dfly
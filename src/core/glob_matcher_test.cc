@@ -0,0 +1,193 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/glob_matcher.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+
+#include <random>
+
+extern "C" {
+#include "redis/util.h"
+}
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::UnorderedElementsAreArray;
+
+class GlobMatcherTest : public ::testing::Test {
+ protected:
+  static bool RedisMatches(string_view pattern, string_view str) {
+    return stringmatchlen(pattern.data(), pattern.size(), str.data(), str.size(), 0) == 1;
+  }
+
+  static vector<string> IndexMatches(const GlobIndex& index, string_view str) {
+    vector<string> res;
+    index.Match(str, [&](string_view pattern) { res.emplace_back(pattern); });
+    return res;
+  }
+};
+
+TEST_F(GlobMatcherTest, Basic) {
+  EXPECT_TRUE(GlobMatcher{"foo"}.Matches("foo"));
+  EXPECT_FALSE(GlobMatcher{"foo"}.Matches("foobar"));
+  EXPECT_TRUE(GlobMatcher{"foo*"}.Matches("foo"));
+  EXPECT_TRUE(GlobMatcher{"foo**"}.Matches("foobar"));
+  EXPECT_FALSE(GlobMatcher{"foo*"}.Matches("fo"));
+  EXPECT_TRUE(GlobMatcher{"*bar"}.Matches("foobar"));
+  EXPECT_FALSE(GlobMatcher{"*bar"}.Matches("barfoo"));
+  EXPECT_TRUE(GlobMatcher{"f?o*[a-c]r"}.Matches("fooobar"));
+  EXPECT_FALSE(GlobMatcher{"f?o*[^a-c]r"}.Matches("fooobar"));
+  EXPECT_TRUE(GlobMatcher{"a\\*b"}.Matches("a*b"));
+  EXPECT_FALSE(GlobMatcher{"a\\*b"}.Matches("axb"));
+  EXPECT_TRUE(GlobMatcher{"a\\"}.Matches("a\\"));
+  EXPECT_TRUE(GlobMatcher{""}.Matches(""));
+  EXPECT_FALSE(GlobMatcher{""}.Matches("a"));
+  EXPECT_FALSE(GlobMatcher{"*"}.Matches(""));
+
+  EXPECT_EQ(GlobMatcher{"a\\*b*c"}.prefix(), "a*b");
+  EXPECT_EQ(GlobMatcher{"*abc"}.prefix(), "");
+}
+
+// Checks that the compiled patterns agree with stringmatchlen, including on malformed brackets
+// and escapes.
+TEST_F(GlobMatcherTest, Random) {
+  const char kPatternChars[] = "ab*?[]^-\\";
+  mt19937 rng(1);
+  for (unsigned i = 0; i < 20000; ++i) {
+    string pattern;
+    for (unsigned len = rng() % 8; len > 0; --len)
+      pattern.push_back(kPatternChars[rng() % (sizeof(kPatternChars) - 1)]);
+    GlobMatcher matcher{pattern};
+
+    for (unsigned j = 0; j < 20; ++j) {
+      string str;
+      for (unsigned len = rng() % 8; len > 0; --len)
+        str.push_back(kPatternChars[rng() % (sizeof(kPatternChars) - 1)]);
+      ASSERT_EQ(matcher.Matches(str), RedisMatches(pattern, str)) << pattern << " " << str;
+    }
+  }
+}
+
+TEST_F(GlobMatcherTest, Index) {
+  GlobIndex index;
+  for (string_view pattern : {"news.*", "news.sport.*", "news.sport", "*.sport", "n?ws.*", "*",
+                              "weather.[a-m]*", "news.\\*"}) {
+    index.Add(pattern);
+  }
+  EXPECT_EQ(index.size(), 8u);
+
+  EXPECT_THAT(IndexMatches(index, "news.sport"),
+              UnorderedElementsAreArray({"news.*", "news.sport", "*.sport", "n?ws.*", "*"}));
+  EXPECT_THAT(IndexMatches(index, "news.*"),
+              UnorderedElementsAreArray({"news.*", "n?ws.*", "*", "news.\\*"}));
+  EXPECT_THAT(IndexMatches(index, "weather.berlin"),
+              UnorderedElementsAreArray({"weather.[a-m]*", "*"}));
+  EXPECT_THAT(IndexMatches(index, "weather.paris"), UnorderedElementsAreArray({"*"}));
+  EXPECT_THAT(IndexMatches(index, ""), testing::IsEmpty());
+}
+
+TEST_F(GlobMatcherTest, IndexRandom) {
+  const char kChars[] = "abc.*?";
+  mt19937 rng(2);
+  vector<string> patterns;
+  GlobIndex index;
+  for (unsigned i = 0; i < 1000; ++i) {
+    string pattern;
+    for (unsigned len = rng() % 6; len > 0; --len)
+      pattern.push_back(kChars[rng() % (sizeof(kChars) - 1)]);
+    patterns.push_back(pattern);
+    index.Add(pattern);
+  }
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    string str;
+    for (unsigned len = rng() % 6; len > 0; --len)
+      str.push_back(kChars[rng() % 4]);
+
+    vector<string> expected;
+    for (const string& pattern : patterns) {
+      if (RedisMatches(pattern, str))
+        expected.push_back(pattern);
+    }
+    ASSERT_THAT(IndexMatches(index, str), UnorderedElementsAreArray(expected)) << str;
+  }
+}
+
+// 10k subscription patterns, mostly with distinct literal prefixes, and a channel that matches
+// a few of them.
+static vector<string> BenchPatterns() {
+  vector<string> res;
+  for (unsigned i = 0; i < 10000; ++i) {
+    switch (i % 4) {
+      case 0:
+        res.push_back(absl::StrCat("user:", i, ":*"));
+        break;
+      case 1:
+        res.push_back(absl::StrCat("orders.", i, ".[a-z]*"));
+        break;
+      case 2:
+        res.push_back(absl::StrCat("feed:", i, ":?"));
+        break;
+      default:
+        res.push_back(absl::StrCat("*:event", i));
+    }
+  }
+  return res;
+}
+
+constexpr string_view kBenchChannel = "user:4000:event4003";
+
+static void BM_MatchPatternsLinear(benchmark::State& state) {
+  vector<string> patterns = BenchPatterns();
+  while (state.KeepRunning()) {
+    size_t matched = 0;
+    for (const string& pattern : patterns) {
+      matched += stringmatchlen(pattern.data(), pattern.size(), kBenchChannel.data(),
+                                kBenchChannel.size(), 0);
+    }
+    CHECK_EQ(matched, 2u);
+  }
+}
+BENCHMARK(BM_MatchPatternsLinear);
+
+static void BM_MatchPatternsIndex(benchmark::State& state) {
+  GlobIndex index;
+  for (const string& pattern : BenchPatterns())
+    index.Add(pattern);
+
+  while (state.KeepRunning()) {
+    size_t matched = 0;
+    index.Match(kBenchChannel, [&](string_view) { ++matched; });
+    CHECK_EQ(matched, 2u);
+  }
+}
+BENCHMARK(BM_MatchPatternsIndex);
+
+// SCAN MATCH with a prefix pattern over keys that mostly do not match it.
+static void BM_ScanMatch(benchmark::State& state) {
+  constexpr string_view kPattern = "session:user:42*";
+  vector<string> keys;
+  for (unsigned i = 0; i < 1024; ++i)
+    keys.push_back(absl::StrCat("session:user:", i * 7, ":data"));
+
+  GlobMatcher matcher{kPattern};
+  while (state.KeepRunning()) {
+    size_t matched = 0;
+    for (const string& key : keys) {
+      matched += state.range(0) ? matcher.Matches(key)
+                                : stringmatchlen(kPattern.data(), kPattern.size(), key.data(),
+                                                 key.size(), 0);
+    }
+    benchmark::DoNotOptimize(matched);
+  }
+}
+BENCHMARK(BM_ScanMatch)->Arg(0)->Arg(1);
+
+}  // namespace dfly
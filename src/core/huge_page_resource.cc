@@ -0,0 +1,181 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kStrideAlign = 64;
+
+}  // namespace
+
+HugePageResource::HugePageResource(Mode mode, vector<size_t> segment_sizes,
+                                   PMR_NS::memory_resource* upstream)
+    : mode_(mode), upstream_(upstream) {
+  for (size_t size : segment_sizes) {
+    bool known = any_of(classes_.begin(), classes_.end(),
+                        [size](const SizeClass& sc) { return sc.size == size; });
+    size_t stride = (size + kStrideAlign - 1) & ~(kStrideAlign - 1);
+    if (known || stride > kChunkSize)
+      continue;
+
+    SizeClass& sc = classes_.emplace_back();
+    sc.size = size;
+    sc.stride = stride;
+    sc.capacity = kChunkSize / stride;
+  }
+}
+
+HugePageResource::~HugePageResource() {
+  LOG_IF(WARNING, stats_.used_bytes > 0)
+      << "Releasing huge page chunks with " << stats_.used_bytes << " bytes still in use";
+  for (auto [base, chunk] : chunks_) {
+    munmap(chunk->base, kChunkSize);
+    delete chunk;
+  }
+}
+
+void* HugePageResource::do_allocate(size_t size, size_t align) {
+  auto it = find_if(classes_.begin(), classes_.end(),
+                    [size](const SizeClass& sc) { return sc.size == size; });
+  if (it == classes_.end() || align > kStrideAlign)
+    return upstream_->allocate(size, align);
+
+  SizeClass& sc = *it;
+  if (sc.with_space.empty()) {
+    if (sc.spare) {
+      sc.with_space.push_back(sc.spare);
+      sc.spare = nullptr;
+    } else if (!MapChunk(it - classes_.begin())) {
+      ++stats_.fallback_allocs;
+      return upstream_->allocate(size, align);
+    }
+  }
+
+  Chunk* chunk = sc.with_space.back();
+  void* res;
+  if (chunk->free_list) {
+    res = chunk->free_list;
+    chunk->free_list = *reinterpret_cast<void**>(res);
+  } else {
+    res = chunk->base + size_t(chunk->carved) * sc.stride;
+    ++chunk->carved;
+  }
+  ++chunk->live;
+  stats_.used_bytes += sc.stride;
+
+  if (!chunk->free_list && chunk->carved == sc.capacity)
+    sc.with_space.pop_back();
+
+  return res;
+}
+
+void HugePageResource::do_deallocate(void* ptr, size_t size, size_t align) {
+  auto it = chunks_.find(reinterpret_cast<uintptr_t>(ptr) & ~(kChunkSize - 1));
+  if (it == chunks_.end()) {
+    upstream_->deallocate(ptr, size, align);
+    return;
+  }
+
+  Chunk* chunk = it->second;
+  SizeClass& sc = classes_[chunk->size_class];
+  DCHECK_EQ(sc.size, size);
+  DCHECK_GT(chunk->live, 0u);
+
+  bool was_full = !chunk->free_list && chunk->carved == sc.capacity;
+  *reinterpret_cast<void**>(ptr) = chunk->free_list;
+  chunk->free_list = ptr;
+  --chunk->live;
+  stats_.used_bytes -= sc.stride;
+
+  if (chunk->live == 0) {
+    RemoveChunk(chunk, &sc.with_space);
+    if (sc.spare) {
+      UnmapChunk(chunk);
+    } else {
+      chunk->free_list = nullptr;
+      chunk->carved = 0;
+      sc.spare = chunk;
+    }
+  } else if (was_full) {
+    sc.with_space.push_back(chunk);
+  }
+}
+
+auto HugePageResource::MapChunk(uint32_t size_class) -> Chunk* {
+  void* mem = MAP_FAILED;
+  bool explicit_pages = false;
+
+  if (mode_ == Mode::kExplicit) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+    flags |= MAP_HUGE_2MB;
+#endif
+    mem = mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    explicit_pages = mem != MAP_FAILED;
+    LOG_IF_EVERY_N(WARNING, !explicit_pages, 1000)
+        << "Could not map explicit huge pages, using transparent huge pages";
+  }
+
+  if (mem == MAP_FAILED) {
+    // Map twice the size, so that an aligned chunk can be cut out of the mapping.
+    void* raw = mmap(nullptr, kChunkSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (raw == MAP_FAILED)
+      return nullptr;
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + kChunkSize - 1) & ~(kChunkSize - 1);
+    size_t head = aligned - start;
+    if (head > 0)
+      munmap(raw, head);
+    if (kChunkSize - head > 0)
+      munmap(reinterpret_cast<void*>(aligned + kChunkSize), kChunkSize - head);
+
+    mem = reinterpret_cast<void*>(aligned);
+    // Failure only means that transparent huge pages are disabled, the memory is still usable.
+    madvise(mem, kChunkSize, MADV_HUGEPAGE);
+  }
+
+  Chunk* chunk = new Chunk{.base = reinterpret_cast<uint8_t*>(mem),
+                           .size_class = size_class,
+                           .explicit_pages = explicit_pages};
+  chunks_.emplace(reinterpret_cast<uintptr_t>(mem), chunk);
+  classes_[size_class].with_space.push_back(chunk);
+
+  ++stats_.chunks;
+  stats_.chunk_bytes += kChunkSize;
+  stats_.explicit_chunks += explicit_pages;
+  return chunk;
+}
+
+void HugePageResource::UnmapChunk(Chunk* chunk) {
+  chunks_.erase(reinterpret_cast<uintptr_t>(chunk->base));
+  munmap(chunk->base, kChunkSize);
+
+  --stats_.chunks;
+  stats_.chunk_bytes -= kChunkSize;
+  stats_.explicit_chunks -= chunk->explicit_pages;
+  delete chunk;
+}
+
+void HugePageResource::RemoveChunk(Chunk* chunk, vector<Chunk*>* chunks) {
+  auto it = find(chunks->begin(), chunks->end(), chunk);
+  if (it != chunks->end()) {
+    *it = chunks->back();
+    chunks->pop_back();
+  }
+}
+
+}  // namespace dfly
@@ -0,0 +1,86 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Memory resource for DashTable segments. Allocations of the registered segment sizes are carved
+// out of 2MiB chunks backed by huge pages, which reduces the TLB misses of random table lookups.
+// All other allocations, and segment allocations for which no chunk could be mapped, are
+// forwarded to the upstream resource. Not thread safe, like the per-shard resources it wraps.
+class HugePageResource : public PMR_NS::memory_resource {
+ public:
+  static constexpr size_t kChunkSize = 1ULL << 21;
+
+  enum class Mode : uint8_t {
+    // Anonymous memory with MADV_HUGEPAGE, backed by transparent huge pages.
+    kMadvise,
+    // Preallocated hugetlbfs pages (MAP_HUGETLB). Falls back to kMadvise if none are available.
+    kExplicit,
+  };
+
+  struct Stats {
+    size_t chunks = 0;
+    size_t chunk_bytes = 0;    // bytes mapped for chunks.
+    size_t used_bytes = 0;     // bytes of segments allocated from chunks.
+    size_t explicit_chunks = 0;
+    size_t fallback_allocs = 0;  // segment allocations forwarded upstream after a failed mapping.
+  };
+
+  HugePageResource(Mode mode, std::vector<size_t> segment_sizes,
+                   PMR_NS::memory_resource* upstream);
+  ~HugePageResource();
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+  PMR_NS::memory_resource* upstream() const {
+    return upstream_;
+  }
+
+ private:
+  struct Chunk {
+    uint8_t* base;
+    void* free_list = nullptr;  // intrusive list of freed segments.
+    uint32_t carved = 0;        // segments carved so far from the start of the chunk.
+    uint32_t live = 0;
+    uint32_t size_class;
+    bool explicit_pages;
+  };
+
+  struct SizeClass {
+    size_t size;
+    size_t stride;                   // size rounded up to a cache line.
+    uint32_t capacity;               // segments per chunk.
+    std::vector<Chunk*> with_space;  // chunks that can serve an allocation.
+    Chunk* spare = nullptr;          // one empty chunk kept mapped to avoid remapping churn.
+  };
+
+  void* do_allocate(size_t size, size_t align) final;
+  void do_deallocate(void* ptr, size_t size, size_t align) final;
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  Chunk* MapChunk(uint32_t size_class);
+  void UnmapChunk(Chunk* chunk);
+  static void RemoveChunk(Chunk* chunk, std::vector<Chunk*>* chunks);
+
+  Mode mode_;
+  std::vector<SizeClass> classes_;
+  absl::flat_hash_map<uintptr_t, Chunk*> chunks_;  // keyed by the chunk base address.
+  PMR_NS::memory_resource* upstream_;
+  Stats stats_;
+};
+
+}  // namespace dfly
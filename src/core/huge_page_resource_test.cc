@@ -0,0 +1,97 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <random>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace std;
+
+namespace dfly {
+
+class HugePageResourceTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kSegSize = 12600;
+
+  // Counts the allocations forwarded upstream.
+  class CountingResource : public PMR_NS::memory_resource {
+   public:
+    size_t live = 0;
+
+   private:
+    void* do_allocate(size_t size, size_t align) final {
+      ++live;
+      return PMR_NS::new_delete_resource()->allocate(size, align);
+    }
+
+    void do_deallocate(void* ptr, size_t size, size_t align) final {
+      --live;
+      PMR_NS::new_delete_resource()->deallocate(ptr, size, align);
+    }
+
+    bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+      return this == &o;
+    }
+  };
+
+  CountingResource upstream_;
+};
+
+TEST_F(HugePageResourceTest, Segments) {
+  HugePageResource mr(HugePageResource::Mode::kMadvise, {kSegSize}, &upstream_);
+  const size_t per_chunk = HugePageResource::kChunkSize / 12608;
+
+  vector<void*> segs;
+  for (size_t i = 0; i < per_chunk * 3 + 1; ++i) {
+    void* p = mr.allocate(kSegSize, 8);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0u);
+    memset(p, i, kSegSize);
+    segs.push_back(p);
+  }
+  EXPECT_EQ(mr.stats().chunks, 4u);
+  EXPECT_EQ(mr.stats().used_bytes, segs.size() * 12608);
+  EXPECT_EQ(upstream_.live, 0u);
+
+  // Other sizes are served upstream.
+  void* other = mr.allocate(64, 8);
+  EXPECT_EQ(upstream_.live, 1u);
+  mr.deallocate(other, 64, 8);
+  EXPECT_EQ(upstream_.live, 0u);
+
+  shuffle(segs.begin(), segs.end(), default_random_engine{});
+  for (size_t i = 0; i < segs.size() / 2; ++i) {
+    mr.deallocate(segs[i], kSegSize, 8);
+  }
+  segs.erase(segs.begin(), segs.begin() + segs.size() / 2);
+
+  // Freed slots are reused before new chunks are mapped.
+  size_t chunks = mr.stats().chunks;
+  for (size_t i = 0; i < per_chunk; ++i) {
+    segs.push_back(mr.allocate(kSegSize, 8));
+  }
+  EXPECT_EQ(mr.stats().chunks, chunks);
+
+  for (void* p : segs) {
+    mr.deallocate(p, kSegSize, 8);
+  }
+  EXPECT_EQ(mr.stats().used_bytes, 0u);
+  // A single empty chunk stays mapped.
+  EXPECT_EQ(mr.stats().chunks, 1u);
+}
+
+TEST_F(HugePageResourceTest, ExplicitFallsBack) {
+  // Works whether or not the host has hugetlbfs pages reserved.
+  HugePageResource mr(HugePageResource::Mode::kExplicit, {kSegSize}, &upstream_);
+  void* p = mr.allocate(kSegSize, 8);
+  memset(p, 0, kSegSize);
+  EXPECT_EQ(mr.stats().chunks, 1u);
+  EXPECT_LE(mr.stats().explicit_chunks, 1u);
+  mr.deallocate(p, kSegSize, 8);
+  EXPECT_EQ(upstream_.live, 0u);
+}
+
+}  // namespace dfly
@@ -6,6 +6,8 @@
 
 #include <absl/base/casts.h>
 #include <absl/container/fixed_array.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/inlined_vector.h>
 #include <absl/strings/str_cat.h>
 #include <absl/time/clock.h>
 #include <mimalloc.h>
@@ -13,6 +15,8 @@
 #include <xxhash.h>
 
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <regex>
 #include <set>
@@ -103,6 +107,14 @@ struct StringCollectorTranslator : public ObjectExplorer {
   vector<string> values;
 };
 
+// Bound of the formatted length of a lua number passed to redis.call, including the terminating
+// null written by SNPrintF. "%.17g" produces at most 24 characters, an integer at most 20.
+constexpr size_t kMaxNumberLen = 32;
+
+// The arguments of redis.call are copied into a buffer that is kept between calls while it is
+// not larger than this.
+constexpr size_t kMaxArgsBufferCapacity = 4096;
+
 class RedisTranslator : public ObjectExplorer {
  public:
   RedisTranslator(lua_State* lua) : lua_(lua) {
@@ -131,7 +143,7 @@ class RedisTranslator : public ObjectExplorer {
 
   lua_State* lua_;
   bool has_error_{false};
-  vector<unsigned> array_index_{};
+  absl::InlinedVector<unsigned, 4> array_index_{};
 };
 
 void RedisTranslator::OnBool(bool b) {
@@ -473,23 +485,60 @@ int RedisLogCommand(lua_State* lua) {
   return 0;
 }
 
-// See https://www.lua.org/manual/5.3/manual.html#lua_Alloc
-void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
-  (void)ud;
-  if (nsize == 0) {
-    InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
-    mi_free_size(ptr, osize);
-    return nullptr;
-  } else if (ptr == nullptr) {
-    ptr = mi_malloc(nsize);
-    InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
-    return ptr;
-  } else {
-    InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
-    ptr = mi_realloc(ptr, nsize);
-    InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
-    return ptr;
+// Lua needs its blocks aligned like malloc does.
+constexpr size_t kArenaAlign = 16;
+
+// Larger blocks, like the arrays of big tables, go to mimalloc and do not exhaust the arena.
+constexpr size_t kMaxArenaBlock = 1024;
+
+inline size_t ArenaBlockSize(size_t size) {
+  return (size + kArenaAlign - 1) & ~(kArenaAlign - 1);
+}
+
+// Bytecode of the chunks that define the script functions, keyed by sha. Every script is compiled
+// once per process and the other interpreters load it from its bytecode.
+class BytecodeCache {
+ public:
+  shared_ptr<const string> Find(string_view sha) const {
+    lock_guard lk{mu_};
+    auto it = entries_.find(sha);
+    return it == entries_.end() ? nullptr : it->second;
   }
+
+  void Insert(string_view sha, string bytecode) {
+    lock_guard lk{mu_};
+    auto [it, inserted] = entries_.try_emplace(string{sha});
+    if (inserted) {
+      bytes_ += bytecode.size();
+      it->second = make_shared<const string>(std::move(bytecode));
+    }
+  }
+
+  void Clear() {
+    lock_guard lk{mu_};
+    entries_.clear();
+    bytes_ = 0;
+  }
+
+  Interpreter::BytecodeCacheStats GetStats() const {
+    lock_guard lk{mu_};
+    return {entries_.size(), bytes_};
+  }
+
+ private:
+  mutable mutex mu_;
+  absl::flat_hash_map<string, shared_ptr<const string>> entries_;
+  size_t bytes_ = 0;
+};
+
+BytecodeCache& GetBytecodeCache() {
+  static BytecodeCache* cache = new BytecodeCache;
+  return *cache;
+}
+
+int DumpWriter(lua_State* lua, const void* data, size_t size, void* ud) {
+  static_cast<string*>(ud)->append(static_cast<const char*>(data), size);
+  return 0;
 }
 
 }  // namespace
@@ -497,7 +546,8 @@ void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
 Interpreter::Interpreter() {
   InterpreterManager::tl_stats().interpreter_cnt++;
 
-  lua_ = lua_newstate(mimalloc_glue, nullptr);
+  alloc_ = make_unique<Allocator>();
+  lua_ = lua_newstate(AllocGlue, alloc_.get());
   InitLua(lua_);
   void** ptr = static_cast<void**>(lua_getextraspace(lua_));
   *ptr = this;
@@ -543,6 +593,11 @@ Interpreter::Interpreter() {
   lua_pushcfunction(lua_, RedisAPCallCommand);
   lua_settable(lua_, -3);
 
+  /* redis.mcall */
+  lua_pushstring(lua_, "mcall");
+  lua_pushcfunction(lua_, RedisMCallCommand);
+  lua_settable(lua_, -3);
+
   lua_pushstring(lua_, "sha1hex");
   lua_pushcfunction(lua_, RedisSha1Command);
   lua_settable(lua_, -3);
@@ -620,11 +675,22 @@ bool Interpreter::Exists(string_view sha) const {
   return type == LUA_TFUNCTION;
 }
 
+void Interpreter::SetRunMemory(size_t arena_bytes, size_t max_bytes) {
+  alloc_->requested_arena_size = arena_bytes;
+  alloc_->max_run_bytes = max_bytes;
+}
+
 auto Interpreter::RunFunction(string_view sha, std::string* error) -> RunResult {
   DVLOG(2) << "RunFunction " << sha << " " << lua_gettop(lua_);
 
   DCHECK_EQ(40u, sha.size());
 
+  // The arena is reset only once all its blocks are freed, so collect the garbage of the previous
+  // runs if it holds on to more than a half of the arena.
+  if (alloc_->arena_live > 0 && alloc_->arena_top > alloc_->arena_size / 2)
+    lua_gc(lua_, LUA_GCCOLLECT);
+  alloc_->ResizeArena();
+
   lua_getglobal(lua_, "__redis__err__handler");
   char fname[43];
   fname[0] = 'f';
@@ -641,11 +707,30 @@ auto Interpreter::RunFunction(string_view sha, std::string* error) -> RunResult
 
   // At this point lua stack has 2 globals.
 
+  if (sampling_period_ > 0) {
+    running_sha_ = sha;
+    lua_sethook(lua_, SampleStackHook, LUA_MASKCOUNT, sampling_period_);
+  }
+
+  alloc_->running = true;
+  alloc_->run_bytes = 0;
+  alloc_->limit_hit = false;
+
   /* We have zero arguments and expect
    * a single return value. */
   int err = lua_pcall(lua_, 0, 1, -2);
 
-  if (err) {
+  alloc_->running = false;
+
+  if (sampling_period_ > 0) {
+    lua_sethook(lua_, nullptr, 0, 0);
+    running_sha_ = {};
+  }
+
+  if (err == LUA_ERRMEM && alloc_->limit_hit) {
+    InterpreterManager::tl_stats().memory_aborts++;
+    *error = absl::StrCat("script exceeded the memory limit of ", alloc_->max_run_bytes, " bytes");
+  } else if (err) {
     *error = lua_tostring(lua_, -1);
   }
 
@@ -722,6 +807,39 @@ optional<string> Interpreter::DetectPossibleAsyncCalls(string_view body_sv) {
   return body;
 }
 
+auto Interpreter::tl_stack_samples() -> StackSamples& {
+  static thread_local StackSamples samples;
+  return samples;
+}
+
+void Interpreter::SampleStackHook(lua_State* lua, lua_Debug* ar) {
+  constexpr int kMaxDepth = 32;
+
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  Interpreter* interpreter = reinterpret_cast<Interpreter*>(*ptr);
+
+  absl::InlinedVector<string, 8> frames;
+  lua_Debug frame;
+  for (int level = 0; level < kMaxDepth && lua_getstack(lua, level, &frame); ++level) {
+    if (!lua_getinfo(lua, "nSl", &frame) || strcmp(frame.what, "C") == 0)
+      continue;
+    frames.push_back(absl::StrCat(frame.name ? frame.name : "?", ":", frame.currentline));
+  }
+
+  string stack{interpreter->running_sha_};
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+    absl::StrAppend(&stack, ";", *it);
+  tl_stack_samples()[stack]++;
+}
+
+auto Interpreter::GetBytecodeCacheStats() -> BytecodeCacheStats {
+  return GetBytecodeCache().GetStats();
+}
+
+void Interpreter::ClearBytecodeCache() {
+  GetBytecodeCache().Clear();
+}
+
 bool Interpreter::IsResultSafe() const {
   int top = lua_gettop(lua_);
   if (top >= 128)
@@ -741,10 +859,26 @@ bool Interpreter::IsResultSafe() const {
 }
 
 bool Interpreter::AddInternal(const char* f_id, string_view body, string* error) {
-  string script = absl::StrCat("function ", f_id, "() \n");
-  absl::StrAppend(&script, body, "\nend");
+  string_view sha{f_id + 2, 40};
+  BytecodeCache& cache = GetBytecodeCache();
+
+  int res;
+  if (shared_ptr<const string> bytecode = cache.Find(sha); bytecode) {
+    res = luaL_loadbufferx(lua_, bytecode->data(), bytecode->size(), "@user_script", "b");
+    InterpreterManager::tl_stats().bytecode_loads++;
+  } else {
+    string script = absl::StrCat("function ", f_id, "() \n");
+    absl::StrAppend(&script, body, "\nend");
+
+    res = luaL_loadbuffer(lua_, script.data(), script.size(), "@user_script");
+    if (res == 0) {
+      // Debug info is kept so that errors report the same lines as the compiled script.
+      string dump;
+      CHECK_EQ(0, lua_dump(lua_, DumpWriter, &dump, 0));
+      cache.Insert(sha, std::move(dump));
+    }
+  }
 
-  int res = luaL_loadbuffer(lua_, script.data(), script.size(), "@user_script");
   if (res == 0) {
     res = lua_pcall(lua_, 0, 0, 0);  // run func definition code
   }
@@ -883,6 +1017,112 @@ void Interpreter::SerializeResult(ObjectExplorer* serializer) {
   lua_pop(lua_, 1);
 }
 
+// See https://www.lua.org/manual/5.3/manual.html#lua_Alloc
+void* Interpreter::AllocGlue(void* ud, void* ptr, size_t osize, size_t nsize) {
+  Allocator* alloc = static_cast<Allocator*>(ud);
+  auto& stats = InterpreterManager::tl_stats();
+
+  // osize is the type of the object if ptr is null.
+  size_t old_size = ptr ? osize : 0;
+  if (alloc->running) {
+    int64_t delta = int64_t(nsize) - int64_t(old_size);
+    if (delta > 0 && alloc->max_run_bytes > 0 &&
+        alloc->run_bytes + delta > int64_t(alloc->max_run_bytes)) {
+      // Lua raises an out of memory error, which aborts the script.
+      alloc->limit_hit = true;
+      return nullptr;
+    }
+    alloc->run_bytes += delta;
+  }
+
+  if (alloc->Contains(ptr)) {
+    if (nsize == 0) {
+      alloc->Free(ptr, osize);
+      return nullptr;
+    }
+    if (nsize <= osize)
+      return ptr;
+
+    // Lua does not resize its objects, but move the block to mimalloc if it ever does.
+    void* res = mi_malloc(nsize);
+    if (res == nullptr)
+      return nullptr;
+    stats.used_bytes += mi_usable_size(res);
+    memcpy(res, ptr, osize);
+    alloc->Free(ptr, osize);
+    return res;
+  }
+
+  if (nsize == 0) {
+    stats.used_bytes -= mi_usable_size(ptr);
+    mi_free_size(ptr, osize);
+    return nullptr;
+  } else if (ptr == nullptr) {
+    // Only the objects, tagged by their type, go to the arena. The collector frees the garbage
+    // objects of a run, while internal buffers like call frames can live as long as the state.
+    if (void* res = osize != 0 ? alloc->Allocate(nsize) : nullptr; res)
+      return res;
+    ptr = mi_malloc(nsize);
+    stats.used_bytes += mi_usable_size(ptr);
+    return ptr;
+  } else {
+    stats.used_bytes -= mi_usable_size(ptr);
+    ptr = mi_realloc(ptr, nsize);
+    stats.used_bytes += mi_usable_size(ptr);
+    return ptr;
+  }
+}
+
+Interpreter::Allocator::~Allocator() {
+  if (arena) {
+    InterpreterManager::tl_stats().used_bytes -= arena_size;
+    mi_free(arena);
+  }
+}
+
+void* Interpreter::Allocator::Allocate(size_t size) {
+  size_t block_size = ArenaBlockSize(size);
+  if (!running || size > kMaxArenaBlock || arena_top + block_size > arena_size)
+    return nullptr;
+
+  void* res = arena + arena_top;
+  arena_top += block_size;
+  arena_live++;
+
+  auto& stats = InterpreterManager::tl_stats();
+  stats.arena_allocs++;
+  stats.arena_peak_bytes = max<uint64_t>(stats.arena_peak_bytes, arena_top);
+  return res;
+}
+
+void Interpreter::Allocator::Free(void* ptr, size_t size) {
+  DCHECK_GT(arena_live, 0u);
+  if (--arena_live == 0) {
+    arena_top = 0;
+    InterpreterManager::tl_stats().arena_resets++;
+  } else if (static_cast<char*>(ptr) + ArenaBlockSize(size) == arena + arena_top) {
+    arena_top -= ArenaBlockSize(size);
+  }
+}
+
+void Interpreter::Allocator::ResizeArena() {
+  if (arena_size == requested_arena_size || arena_live > 0)
+    return;
+
+  auto& stats = InterpreterManager::tl_stats();
+  if (arena) {
+    stats.used_bytes -= arena_size;
+    mi_free(arena);
+    arena = nullptr;
+  }
+  arena_size = requested_arena_size;
+  arena_top = 0;
+  if (arena_size > 0) {
+    arena = static_cast<char*>(mi_malloc_aligned(arena_size, kArenaAlign));
+    stats.used_bytes += arena_size;
+  }
+}
+
 void Interpreter::ResetStack() {
   lua_settop(lua_, 0);
 }
@@ -928,20 +1168,14 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
   }
 
   size_t blob_len = 0;
-  char tmpbuf[64];
 
-  // Determine size required for backing storage for all args.
-  // Skip command name (idx=1), as its stored in a separate buffer.
+  // Determine an upper bound of the size required for backing storage for all args, numbers are
+  // formatted only once when they are copied. Skip command name (idx=1), as its stored in a
+  // separate buffer.
   for (int idx = 2; idx <= argc; idx++) {
     switch (lua_type(lua_, idx)) {
       case LUA_TNUMBER:
-        if (lua_isinteger(lua_, idx)) {
-          blob_len += absl::AlphaNum{lua_tointeger(lua_, idx)}.size();
-        } else {
-          int fmt_len = absl::SNPrintF(tmpbuf, sizeof(tmpbuf), "%.17g", lua_tonumber(lua_, idx));
-          CHECK_GT(fmt_len, 0);
-          blob_len += fmt_len;
-        }
+        blob_len += kMaxNumberLen;
         continue;
       case LUA_TSTRING:
         blob_len += lua_rawlen(lua_, idx) + 1;
@@ -965,7 +1199,6 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
   buffer_.resize(blob_len + 4, '\0');  // backing storage for args
 
   char* cur = buffer_.data();
-  char* end = cur + blob_len;
   for (int idx = 2; idx <= argc; idx++) {
     size_t len = 0;
     switch (lua_type(lua_, idx)) {
@@ -974,9 +1207,7 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
           char* next = absl::numbers_internal::FastIntToBuffer(lua_tointeger(lua_, idx), cur);
           len = next - cur;
         } else if (lua_isnumber(lua_, idx)) {
-          // we pass `end - cur + 1` because we do not want to skip the last character
-          // if it's the last argument.
-          int fmt_len = absl::SNPrintF(cur, end - cur + 1, "%.17g", lua_tonumber(lua_, idx));
+          int fmt_len = absl::SNPrintF(cur, kMaxNumberLen, "%.17g", lua_tonumber(lua_, idx));
           CHECK_GT(fmt_len, 0);
           len = fmt_len;
         }
@@ -989,6 +1220,7 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
     args[idx - 1] = {cur, len};
     cur += len;
   }
+  buffer_.resize(cur - buffer_.data());
 
   /* Pop all arguments from the stack, we do not need them anymore
    * and this way we guaranty we will have room on the stack for the result. */
@@ -1004,11 +1236,12 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
     explorer = &*translator;
   }
 
-  redis_func_(CallArgs{MutSliceSpan{args}, &buffer_, explorer, async, raise_error, &raise_error});
+  redis_func_(CallArgs{MutSliceSpan{args}, &buffer_, explorer, async, raise_error, &raise_error,
+                       batching_});
   cmd_depth_--;
 
   // Shrink reusable buffer if it's too big.
-  if (buffer_.capacity() > 128) {
+  if (buffer_.capacity() > kMaxArgsBufferCapacity) {
     buffer_.clear();
     buffer_.shrink_to_fit();
   }
@@ -1022,6 +1255,11 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
     return RaiseError(lua_);
   }
 
+  // A batched command leaves either nothing when it was queued or the replies of the batch
+  // flushed before it and its own reply.
+  if (batching_)
+    return lua_gettop(lua_);
+
   if (!async)
     DCHECK_EQ(1, lua_gettop(lua_));
 
@@ -1048,10 +1286,91 @@ int Interpreter::RedisAPCallCommand(lua_State* lua) {
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(false, true);
 }
 
+int Interpreter::RedisMCallCommand(lua_State* lua) {
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  return reinterpret_cast<Interpreter*>(*ptr)->RedisBatchCommand();
+}
+
+int Interpreter::RedisBatchedCallCommand(lua_State* lua) {
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  auto* interpreter = reinterpret_cast<Interpreter*>(*ptr);
+
+  interpreter->batching_ = true;
+  int res = interpreter->RedisGenericCommand(false, true);
+  interpreter->batching_ = false;
+  return res;
+}
+
+// Commands of redis.mcall are queued and executed together, so commands on different shards
+// run in parallel in a single hop. Every command gets a reply like with pcall, the replies are
+// accumulated on the stack in order and returned as a single table.
+int Interpreter::RedisBatchCommand() {
+  if (!redis_func_) {
+    PushError(lua_, "internal error - redis function not defined");
+    return RaiseError(lua_);
+  }
+
+  // Arguments are validated before anything is queued, so that errors of single commands are
+  // only reported by the server and their replies keep the order of the commands.
+  int num_cmds = lua_gettop(lua_);
+  for (int i = 1; i <= num_cmds; ++i) {
+    bool valid = lua_istable(lua_, i) && lua_rawlen(lua_, i) > 0;
+    for (int j = 1; valid && j <= int(lua_rawlen(lua_, i)); ++j) {
+      int type = lua_rawgeti(lua_, i, j);
+      valid = type == LUA_TSTRING || type == LUA_TNUMBER;
+      lua_pop(lua_, 1);
+    }
+    if (!valid) {
+      PushError(lua_, "redis.mcall() arguments must be tables with a command and its arguments");
+      return RaiseError(lua_);
+    }
+  }
+
+  if (!lua_checkstack(lua_, num_cmds + 2)) {
+    PushError(lua_, "Too many commands for redis.mcall()");
+    return RaiseError(lua_);
+  }
+
+  for (int i = 1; i <= num_cmds; ++i) {
+    int argc = lua_rawlen(lua_, i);
+    if (!lua_checkstack(lua_, argc + 1)) {
+      PushError(lua_, "Too many arguments for redis.mcall()");
+      return RaiseError(lua_);
+    }
+
+    lua_pushcfunction(lua_, RedisBatchedCallCommand);
+    for (int j = 1; j <= argc; ++j)
+      lua_rawgeti(lua_, i, j);
+    lua_call(lua_, argc, LUA_MULTRET);
+  }
+
+  // Flush the rest of the batch.
+  bool requested_abort = false;
+  RedisTranslator translator(lua_);
+  redis_func_(CallArgs{MutSliceSpan{}, &buffer_, &translator, true, false, &requested_abort, true});
+
+  // An uncaught error of a preceding acall is on top of the stack.
+  if (requested_abort)
+    return RaiseError(lua_);
+
+  DCHECK_EQ(lua_gettop(lua_), 2 * num_cmds);
+  lua_createtable(lua_, num_cmds, 0);
+  for (int i = 1; i <= num_cmds; ++i) {
+    lua_pushvalue(lua_, num_cmds + i);
+    lua_rawseti(lua_, -2, i);
+  }
+  return 1;
+}
+
 InterpreterManager::Stats& InterpreterManager::Stats::operator+=(const Stats& other) {
   this->used_bytes += other.used_bytes;
   this->interpreter_cnt += other.interpreter_cnt;
   this->blocked_cnt += other.blocked_cnt;
+  this->bytecode_loads += other.bytecode_loads;
+  this->arena_allocs += other.arena_allocs;
+  this->arena_resets += other.arena_resets;
+  this->arena_peak_bytes = std::max(this->arena_peak_bytes, other.arena_peak_bytes);
+  this->memory_aborts += other.memory_aborts;
 
   return *this;
 }
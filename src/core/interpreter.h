@@ -4,14 +4,19 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
+
 #include <functional>
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 
 #include "core/core_types.h"
 #include "util/fibers/synchronization.h"
 
 typedef struct lua_State lua_State;
+struct lua_Debug;
 
 namespace dfly {
 
@@ -57,6 +62,10 @@ class Interpreter {
     // The function can request an abort due to an error, even if error_abort is false.
     // It happens when async cmds are flushed and result in an uncatched error.
     bool* requested_abort;
+
+    // Part of a redis.mcall batch: replies of queued commands are sent in order once the batch
+    // is flushed, which happens on a call with empty args at the end of the batch.
+    bool batch = false;
   };
 
   using RedisFunc = std::function<void(CallArgs)>;
@@ -118,6 +127,35 @@ class Interpreter {
 
   static std::optional<std::string> DetectPossibleAsyncCalls(std::string_view body);
 
+  struct BytecodeCacheStats {
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  // Scripts are compiled once per process, other interpreters load them lazily from the bytecode
+  // that is kept in a process-wide cache.
+  static BytecodeCacheStats GetBytecodeCacheStats();
+
+  // Drops the bytecode of all scripts, should be called once they are removed.
+  static void ClearBytecodeCache();
+
+  // Samples the lua stack of functions run by RunFunction() every period VM instructions,
+  // 0 disables sampling.
+  void SetSamplingPeriod(unsigned period) {
+    sampling_period_ = period;
+  }
+
+  // Sets the memory of the following runs of RunFunction(). The objects of up to 1KB that a run
+  // creates are bumped from an arena of arena_bytes, which is reset at once when all its blocks
+  // are freed, so the temporaries of a run cost no allocator calls. A run that grows the lua heap
+  // by more than max_bytes is aborted with an error, 0 disables the limit.
+  void SetRunMemory(size_t arena_bytes, size_t max_bytes);
+
+  // Stack samples taken on this thread, keyed by folded stacks in the format of flamegraph tools:
+  // the sha of the function followed by its frames "name:line", outermost first, separated by ';'.
+  using StackSamples = absl::flat_hash_map<std::string, uint64_t>;
+  static StackSamples& tl_stack_samples();
+
   template <typename U> void SetRedisFunc(U&& u) {
     redis_func_ = std::forward<U>(u);
   }
@@ -135,9 +173,48 @@ class Interpreter {
   static int RedisPCallCommand(lua_State* lua);
   static int RedisACallCommand(lua_State* lua);
   static int RedisAPCallCommand(lua_State* lua);
+  static int RedisMCallCommand(lua_State* lua);
+  static int RedisBatchedCallCommand(lua_State* lua);
+  static void SampleStackHook(lua_State* lua, lua_Debug* ar);
+
+  // Runs the commands given as tables on the lua stack as a batch, returns a table of replies.
+  int RedisBatchCommand();
+
+  // State of the lua allocator, passed to AllocGlue() as its user data.
+  struct Allocator {
+    ~Allocator();
+
+    bool Contains(const void* ptr) const {
+      return ptr >= arena && ptr < arena + arena_size;
+    }
+
+    // Bumps a block from the arena, returns nullptr if it does not fit or no run is active.
+    void* Allocate(size_t size);
+
+    void Free(void* ptr, size_t size);
+
+    // Replaces the arena with one of the requested size, only once it is empty.
+    void ResizeArena();
+
+    char* arena = nullptr;
+    size_t arena_size = 0;
+    size_t arena_top = 0;
+    size_t arena_live = 0;  // blocks allocated from the arena and not freed yet.
+    size_t requested_arena_size = 0;
+    size_t max_run_bytes = 0;
+    int64_t run_bytes = 0;  // growth of the lua heap during the current run.
+    bool running = false;
+    bool limit_hit = false;
+  };
+
+  static void* AllocGlue(void* ud, void* ptr, size_t osize, size_t nsize);
 
+  std::unique_ptr<Allocator> alloc_;
   lua_State* lua_;
   unsigned cmd_depth_ = 0;
+  bool batching_ = false;  // set while queueing a command of redis.mcall
+  unsigned sampling_period_ = 0;
+  std::string_view running_sha_;  // sha of the function that RunFunction() runs.
   RedisFunc redis_func_;
   std::string buffer_;
 };
@@ -152,6 +229,11 @@ class InterpreterManager {
     uint64_t used_bytes = 0;
     uint64_t interpreter_cnt = 0;
     uint64_t blocked_cnt = 0;
+    uint64_t bytecode_loads = 0;  // scripts loaded from the bytecode cache.
+    uint64_t arena_allocs = 0;    // allocations served by the arenas of the runs.
+    uint64_t arena_resets = 0;
+    uint64_t arena_peak_bytes = 0;  // high-water mark of the arenas, aggregated by max.
+    uint64_t memory_aborts = 0;     // runs aborted for exceeding their memory limit.
   };
 
  public:
@@ -9,6 +9,7 @@ extern "C" {
 #include <lua.h>
 }
 
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 #include <gmock/gmock.h>
@@ -236,6 +237,110 @@ TEST_F(InterpreterTest, Add) {
   EXPECT_TRUE(intptr_.Exists(sha1));
 }
 
+TEST_F(InterpreterTest, BytecodeCache) {
+  const char* script = "local x = 'bytecode'\nreturn error(x .. ARGV[1])";
+  char sha_buf[64];
+  Interpreter::FuncSha1(script, sha_buf);
+  string_view sha{sha_buf, std::strlen(sha_buf)};
+
+  string err;
+  Interpreter::BytecodeCacheStats before = Interpreter::GetBytecodeCacheStats();
+  EXPECT_EQ(Interpreter::ADD_OK, intptr_.AddFunction(sha, script, &err));
+
+  Interpreter::BytecodeCacheStats after = Interpreter::GetBytecodeCacheStats();
+  EXPECT_EQ(before.entries + 1, after.entries);
+  EXPECT_GT(after.bytes, before.bytes);
+
+  // Another interpreter loads the script from its bytecode, the body is not compiled again.
+  uint64_t loads = InterpreterManager::tl_stats().bytecode_loads;
+  Interpreter other;
+  EXPECT_EQ(Interpreter::ADD_OK, other.AddFunction(sha, "syntax error", &err));
+  EXPECT_EQ(loads + 1, InterpreterManager::tl_stats().bytecode_loads);
+  EXPECT_EQ(Interpreter::GetBytecodeCacheStats().entries, after.entries);
+
+  vector<MutableSlice> args{MutableSlice{const_cast<char*>("1"), 1}};
+  other.SetGlobalArray("ARGV", MutSliceSpan{args});
+  EXPECT_EQ(Interpreter::RUN_ERR, other.RunFunction(sha, &err));
+  EXPECT_THAT(err, testing::HasSubstr("user_script:3: bytecode1"));
+  other.ResetStack();
+
+  // Scripts that fail to compile are not cached.
+  const char* bad = "foobar";
+  Interpreter::FuncSha1(bad, sha_buf);
+  EXPECT_EQ(Interpreter::COMPILE_ERR, intptr_.AddFunction(sha, bad, &err));
+  EXPECT_EQ(Interpreter::GetBytecodeCacheStats().entries, after.entries);
+
+  Interpreter::ClearBytecodeCache();
+  EXPECT_EQ(0u, Interpreter::GetBytecodeCacheStats().entries);
+  EXPECT_EQ(0u, Interpreter::GetBytecodeCacheStats().bytes);
+}
+
+TEST_F(InterpreterTest, SampleStacks) {
+  const char* script = R"(
+local function inner(n)
+  local s = 0
+  for i = 1, n do s = s + i end
+  return s
+end
+return inner(1000))";
+
+  char sha_buf[64];
+  Interpreter::FuncSha1(script, sha_buf);
+  Interpreter::tl_stack_samples().clear();
+
+  intptr_.SetSamplingPeriod(10);
+  ASSERT_TRUE(Execute(script));
+  EXPECT_EQ("i(500500)", ser_.res);
+
+  uint64_t inner_samples = 0;
+  for (const auto& [stack, count] : Interpreter::tl_stack_samples()) {
+    EXPECT_TRUE(absl::StartsWith(stack, sha_buf)) << stack;
+    if (absl::StrContains(stack, ";inner:5"))
+      inner_samples += count;
+  }
+  EXPECT_GT(inner_samples, 100u);
+
+  // Sampling stops once it is disabled.
+  intptr_.SetSamplingPeriod(0);
+  Interpreter::tl_stack_samples().clear();
+  ASSERT_TRUE(Execute(script));
+  EXPECT_TRUE(Interpreter::tl_stack_samples().empty());
+}
+
+TEST_F(InterpreterTest, RunMemory) {
+  const char* script = R"(
+local t = {}
+for i = 1, 100 do t[i] = {i, tostring(i)} end
+return #t)";
+
+  auto& stats = InterpreterManager::tl_stats();
+  uint64_t allocs = stats.arena_allocs, resets = stats.arena_resets;
+  intptr_.SetRunMemory(64 << 10, 0);
+  for (unsigned i = 0; i < 3; ++i) {
+    ASSERT_TRUE(Execute(script));
+    EXPECT_EQ("i(100)", ser_.res);
+    intptr_.ResetStack();
+  }
+  EXPECT_GT(stats.arena_allocs, allocs + 300);
+
+  // The arena is reset once the collector frees the objects of the runs.
+  intptr_.RunGC();
+  EXPECT_GT(stats.arena_resets, resets);
+  EXPECT_GT(stats.arena_peak_bytes, 0u);
+  EXPECT_LE(stats.arena_peak_bytes, 64u << 10);
+
+  // A run that grows the heap beyond the limit is aborted, and the following runs still work.
+  intptr_.SetRunMemory(64 << 10, 1 << 20);
+  uint64_t aborts = stats.memory_aborts;
+  EXPECT_FALSE(Execute("local t = {} for i = 1, 1000000 do t[i] = tostring(i) end return 1"));
+  EXPECT_THAT(error_, testing::HasSubstr("memory limit"));
+  EXPECT_EQ(stats.memory_aborts, aborts + 1);
+  intptr_.ResetStack();
+
+  ASSERT_TRUE(Execute(script));
+  EXPECT_EQ("i(100)", ser_.res);
+}
+
 // Test cases taken from scripting.tcl
 TEST_F(InterpreterTest, Execute) {
   ASSERT_TRUE(Execute("return 42"));
@@ -308,6 +413,40 @@ TEST_F(InterpreterTest, Call) {
   EXPECT_EQ("[str(table) status(mystatus)]", ser_.res);
 }
 
+TEST_F(InterpreterTest, CallArgs) {
+  vector<string> calls;
+  vector<const char*> buffers;
+  auto cb = [&](auto ca) {
+    string joined;
+    for (size_t i = 1; i < ca.args.size(); ++i) {
+      // Arguments are packed back to back in the buffer.
+      if (i + 1 < ca.args.size())
+        EXPECT_EQ(ca.args[i].data() + ca.args[i].size(), ca.args[i + 1].data());
+      absl::StrAppend(&joined, i > 1 ? " " : "", string_view{ca.args[i].data(), ca.args[i].size()});
+    }
+    calls.push_back(joined);
+    buffers.push_back(ca.buffer->data());
+    ca.translator->OnInt(ca.args.size() - 1);
+  };
+
+  intptr_.SetRedisFunc(cb);
+  ASSERT_TRUE(Execute(R"(
+local n = 0
+for i = 1, 3 do
+  n = n + redis.call('hget', string.rep('k', 200), -1234567890123, 0.1, 1e300, '')
+end
+return n)"));
+  EXPECT_EQ("i(15)", ser_.res);
+
+  ASSERT_EQ(3u, calls.size());
+  string expected = absl::StrCat(string(200, 'k'),
+                                 " -1234567890123 0.10000000000000001 1.0000000000000001e+300 ");
+  EXPECT_THAT(calls, testing::Each(expected));
+
+  // The argument buffer is reused between calls.
+  EXPECT_THAT(buffers, testing::Each(buffers[0]));
+}
+
 TEST_F(InterpreterTest, CallArray) {
   auto cb = [](auto ca) {
     auto* reply = ca.translator;
@@ -2,6 +2,7 @@
 // See LICENSE for licensing terms.
 //
 
+#include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 
 #include <jsoncons/json.hpp>
@@ -10,6 +11,8 @@
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "core/json/path.h"
+#include "core/json/simd_parser.h"
 
 namespace dfly {
 using namespace jsoncons;
@@ -197,4 +200,85 @@ TEST_F(JsonTest, JsonWithPolymorhicAllocator) {
   EXPECT_EQ("Im Westen nichts Neues", j1["store"]["book"][1]["title"].as_string());
   EXPECT_EQ(10.00, j1["store"]["book"][1]["price"].as_double());
 }
+
+TEST_F(JsonTest, SimdParse) {
+  std::string input = R"(
+    {"b": [1, -2, 18446744073709551615, 2.5, "str", true, null, {}], "a": {"x": "\u00e9"}}
+  )";
+  auto* mr = std::pmr::get_default_resource();
+
+  auto expected = JsonFromString(input, mr);
+  ASSERT_TRUE(expected);
+  auto res = json::ParseSimd(input, mr);
+  ASSERT_TRUE(res);
+  EXPECT_EQ(*expected, *res);
+
+  // Falls back to jsoncons for integers above 64 bits and reports invalid json
+  std::string big = R"({"a": 123456789012345678901234567890})";
+  EXPECT_EQ(*JsonFromString(big, mr), *json::ParseSimd(big, mr));
+  EXPECT_FALSE(json::ParseSimd("{\"a\":", mr));
+
+  flexbuffers::Builder fbb;
+  std::string flat_input = R"({"b": [1, -2, 2.5, "str", true, null, {}], "a": {"x": 1}})";
+  ASSERT_TRUE(json::ParseSimdFlat(flat_input, &fbb));
+  EXPECT_EQ(*JsonFromString(flat_input, mr), json::FromFlat(flexbuffers::GetRoot(fbb.GetBuffer())));
+
+  // Flexbuffer maps can not hold duplicate keys
+  fbb.Clear();
+  EXPECT_FALSE(json::ParseSimdFlat(R"({"a": 1, "a": 2})", &fbb));
+}
+
+// Objects of about 20KB, like the documents of bulk loads
+static std::string GenerateDocument() {
+  std::string doc = "{";
+  for (unsigned i = 0; i < 200; i++) {
+    absl::StrAppend(&doc, i ? "," : "", "\"field", i, "\": {\"id\": ", i,
+                    ", \"score\": ", i * 0.25, ", \"name\": \"name", i,
+                    "\", \"tags\": [\"a\", \"b\"], \"active\": true}");
+  }
+  return doc + "}";
+}
+
+static void BM_ParseJsoncons(benchmark::State& state) {
+  std::string doc = GenerateDocument();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(JsonFromString(doc, std::pmr::get_default_resource()));
+  }
+  state.SetBytesProcessed(state.iterations() * doc.size());
+}
+BENCHMARK(BM_ParseJsoncons);
+
+static void BM_ParseSimd(benchmark::State& state) {
+  std::string doc = GenerateDocument();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(json::ParseSimd(doc, std::pmr::get_default_resource()));
+  }
+  state.SetBytesProcessed(state.iterations() * doc.size());
+}
+BENCHMARK(BM_ParseSimd);
+
+static void BM_ParseFlat(benchmark::State& state) {
+  std::string doc = GenerateDocument();
+  flexbuffers::Builder fbb;
+  while (state.KeepRunning()) {
+    auto json = JsonFromString(doc, std::pmr::get_default_resource());
+    fbb.Clear();
+    json::FromJsonType(*json, &fbb);
+    fbb.Finish();
+  }
+  state.SetBytesProcessed(state.iterations() * doc.size());
+}
+BENCHMARK(BM_ParseFlat);
+
+static void BM_ParseSimdFlat(benchmark::State& state) {
+  std::string doc = GenerateDocument();
+  flexbuffers::Builder fbb;
+  while (state.KeepRunning()) {
+    fbb.Clear();
+    benchmark::DoNotOptimize(json::ParseSimdFlat(doc, &fbb));
+  }
+  state.SetBytesProcessed(state.iterations() * doc.size());
+}
+BENCHMARK(BM_ParseSimdFlat);
+
 }  // namespace dfly
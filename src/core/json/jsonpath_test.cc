@@ -482,8 +482,8 @@ TYPED_TEST(JsonPathTest, Mutate) {
   } else {
     flexbuffers::Builder fbb;
     MutatePath(path, cb, json, &fbb);
-    FlatJson fj = flexbuffers::GetRoot(fbb.GetBuffer());
-    auto vec = fj.AsVector();
+    ASSERT_EQ(0u, fbb.GetSize());  // mutated in place
+    auto vec = json.AsVector();
     for (unsigned i = 0; i < vec.size(); ++i) {
       arr.push_back(to_int(vec[i]));
     }
@@ -521,6 +521,45 @@ TYPED_TEST(JsonPathTest, Mutate) {
   }
 }
 
+using FlatJsonPathTest = JsonPathTest<FlatJson>;
+
+TEST_F(FlatJsonPathTest, MutateInPlace) {
+  FlatJson json = ValidJson<FlatJson>(R"({"a": {"n": 1, "s": "abc", "b": true}, "n": 2.5})");
+  flexbuffers::Builder fbb;
+
+  auto set_value = [&](string_view path_str, string_view value) {
+    fbb.Clear();
+    CHECK_EQ(0, Parse(string{path_str}));
+    Path path = driver_.TakePath();
+    JsonType new_value = ValidJson<JsonType>(value);
+    return MutatePath(
+        path,
+        [&](optional<string_view>, JsonType* val) {
+          *val = new_value;
+          return false;
+        },
+        json, &fbb);
+  };
+
+  // Values of the same type and width are overwritten in the buffer
+  EXPECT_EQ(1u, set_value("$.a.n", "100"));
+  EXPECT_EQ(0u, fbb.GetSize());
+  EXPECT_EQ(1u, set_value("$.a.s", R"("xyz")"));
+  EXPECT_EQ(1u, set_value("$..b", "false"));
+  EXPECT_EQ(1u, set_value("$.n", "0.5"));
+  EXPECT_EQ(0u, fbb.GetSize());
+  EXPECT_EQ(ValidJson<JsonType>(R"({"a": {"n": 100, "s": "xyz", "b": false}, "n": 0.5})"),
+            FromFlat(json));
+
+  // Wider values, other types and containers rebuild the json
+  for (string_view value : {"100000", R"("longer")", "1.5", "[1]"}) {
+    EXPECT_EQ(1u, set_value("$.a.n", value));
+    ASSERT_GT(fbb.GetSize(), 0u);
+    auto root = flexbuffers::GetRoot(fbb.GetBuffer()).AsMap();
+    EXPECT_EQ(ValidJson<JsonType>(value), FromFlat(root["a"].AsMap()["n"]));
+  }
+}
+
 TYPED_TEST(JsonPathTest, SubRange) {
   TypeParam json = ValidJson<TypeParam>(R"({"arr": [1, 2, 3, 4, 5]})");
   ASSERT_EQ(0, this->Parse("$.arr[1:2]"));
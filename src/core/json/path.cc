@@ -7,6 +7,8 @@
 #include <absl/strings/str_cat.h>
 #include <absl/types/span.h>
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "core/json/detail/flat_dfs.h"
 #include "core/json/detail/jsoncons_dfs.h"
@@ -32,6 +34,25 @@ class JsonPathDriver : public json::Driver {
   }
 };
 
+// Overwrites a flat scalar of the same type if the value fits into its width
+bool MutateFlatScalar(const JsonType& src, FlatJson dest) {
+  if (src.is_bool())
+    return dest.IsBool() && dest.MutateBool(src.as_bool());
+
+  if (src.is_int64())
+    return dest.IsInt() && dest.MutateInt(src.as<int64_t>());
+
+  if (src.is_double())
+    return dest.IsFloat() && dest.MutateFloat(src.as_double());
+
+  if (src.is_string()) {
+    string_view sv = src.as_string_view();
+    return dest.IsString() && dest.MutateString(sv.data(), sv.size());
+  }
+
+  return src.is_null() && dest.IsNull();
+}
+
 }  // namespace
 
 const char* SegmentName(SegmentType type) {
@@ -286,14 +307,59 @@ void FromJsonType(const JsonType& src, flexbuffers::Builder* fbb) {
 
 unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
                     flexbuffers::Builder* fbb) {
-  JsonType mut_json = FromFlat(json);
-  unsigned res = MutatePath(path, std::move(callback), &mut_json);
-  if (res) {
-    FromJsonType(mut_json, fbb);
-    fbb->Finish();
+  vector<pair<optional<string_view>, FlatJson>> matches;
+  if (path.empty()) {
+    matches.emplace_back(nullopt, json);
+  } else {
+    FlatDfs::Traverse(path, json, [&](optional<string_view> key, FlatJson val) {
+      matches.emplace_back(key, val);
+    });
   }
 
-  return res;
+  // Containers can nest and change in size, so mutate them on a full tree
+  bool all_scalars = all_of(matches.begin(), matches.end(),
+                            [](const auto& match) { return !match.second.IsVector(); });
+  if (!all_scalars) {
+    JsonType mut_json = FromFlat(json);
+    unsigned res = MutatePath(path, std::move(callback), &mut_json);
+    if (res) {
+      FromJsonType(mut_json, fbb);
+      fbb->Finish();
+    }
+    return res;
+  }
+
+  // Scalars are mutated as copies and written back if they keep their type and width
+  vector<pair<JsonType, bool>> results;  // new value, should be deleted
+  bool in_place = true;
+  for (auto& [key, val] : matches) {
+    JsonType copy = FromFlat(val);
+    bool deleted = callback(key, &copy);
+    in_place = in_place && !deleted && MutateFlatScalar(copy, val);
+    results.emplace_back(std::move(copy), deleted);
+  }
+
+  if (in_place)
+    return matches.size();
+
+  // Otherwise replay the results on a tree, it visits the matches in the same order
+  JsonType mut_json = FromFlat(json);
+  size_t idx = 0;
+  MutatePath(
+      path,
+      [&](optional<string_view>, JsonType* val) {
+        if (idx == results.size())
+          return false;
+        auto& [value, deleted] = results[idx++];
+        *val = std::move(value);
+        return deleted;
+      },
+      &mut_json);
+  DCHECK_EQ(idx, results.size());
+
+  FromJsonType(mut_json, fbb);
+  fbb->Finish();
+  return matches.size();
 }
 
 }  // namespace dfly::json
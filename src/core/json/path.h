@@ -135,6 +135,10 @@ void EvaluatePath(const Path& path, FlatJson json, PathFlatCallback callback);
 
 // returns number of matches found with the given path.
 unsigned MutatePath(const Path& path, MutateCallback callback, JsonType* json);
+
+// Same as above but for flatbuffers. Scalar matches that keep their type and fit into their
+// width are overwritten in the buffer of json and fbb is left empty. Otherwise the mutated json
+// is built into fbb.
 unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
                     flexbuffers::Builder* fbb);
 
@@ -0,0 +1,163 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/json/simd_parser.h"
+
+#include <simdjson.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+
+using namespace std;
+
+namespace dfly::json {
+
+namespace {
+
+using simdjson::dom::element;
+using simdjson::dom::element_type;
+
+// Parser buffers are reused by all documents parsed on the thread
+simdjson::dom::parser& ThreadParser() {
+  static thread_local simdjson::dom::parser parser;
+  return parser;
+}
+
+bool Parse(string_view input, element* doc) {
+  auto error = ThreadParser().parse(input.data(), input.size()).get(*doc);
+  if (error) {
+    VLOG(1) << "simdjson failed to parse json: " << simdjson::error_message(error);
+    return false;
+  }
+  return true;
+}
+
+// Feeds the tape to the visitor, decoders build trees with the allocator and object layout
+// that jsoncons uses for its own parser.
+void Visit(element el, jsoncons::json_visitor* visitor, error_code& ec) {
+  jsoncons::ser_context ctx;
+  auto tag = jsoncons::semantic_tag::none;
+  switch (el.type()) {
+    case element_type::OBJECT: {
+      auto obj = el.get_object().value_unsafe();
+      visitor->begin_object(obj.size(), tag, ctx, ec);
+      for (auto field : obj) {
+        visitor->key(field.key, ctx, ec);
+        Visit(field.value, visitor, ec);
+      }
+      visitor->end_object(ctx, ec);
+      break;
+    }
+    case element_type::ARRAY: {
+      auto arr = el.get_array().value_unsafe();
+      visitor->begin_array(arr.size(), tag, ctx, ec);
+      for (element child : arr)
+        Visit(child, visitor, ec);
+      visitor->end_array(ctx, ec);
+      break;
+    }
+    case element_type::INT64:
+      visitor->int64_value(el.get_int64().value_unsafe(), tag, ctx, ec);
+      break;
+    case element_type::UINT64:
+      visitor->uint64_value(el.get_uint64().value_unsafe(), tag, ctx, ec);
+      break;
+    case element_type::DOUBLE:
+      visitor->double_value(el.get_double().value_unsafe(), tag, ctx, ec);
+      break;
+    case element_type::STRING:
+      visitor->string_value(el.get_string().value_unsafe(), tag, ctx, ec);
+      break;
+    case element_type::BOOL:
+      visitor->bool_value(el.get_bool().value_unsafe(), tag, ctx, ec);
+      break;
+    default:
+      visitor->null_value(tag, ctx, ec);
+      break;
+  }
+}
+
+bool BuildFlat(element el, flexbuffers::Builder* fbb) {
+  switch (el.type()) {
+    case element_type::OBJECT: {
+      auto obj = el.get_object().value_unsafe();
+
+      // Flexbuffer maps are looked up with binary search and can not hold duplicate keys
+      vector<string_view> keys;
+      keys.reserve(obj.size());
+      for (auto field : obj)
+        keys.push_back(field.key);
+      sort(keys.begin(), keys.end());
+      if (adjacent_find(keys.begin(), keys.end()) != keys.end())
+        return false;
+
+      size_t start = fbb->StartMap();
+      for (auto field : obj) {
+        fbb->Key(field.key.data(), field.key.size());
+        if (!BuildFlat(field.value, fbb))
+          return false;
+      }
+      fbb->EndMap(start);
+      return true;
+    }
+    case element_type::ARRAY: {
+      size_t start = fbb->StartVector();
+      for (element child : el.get_array().value_unsafe()) {
+        if (!BuildFlat(child, fbb))
+          return false;
+      }
+      fbb->EndVector(start, false, false);
+      return true;
+    }
+    case element_type::INT64:
+      fbb->Int(el.get_int64().value_unsafe());
+      return true;
+    case element_type::DOUBLE:
+      fbb->Double(el.get_double().value_unsafe());
+      return true;
+    case element_type::STRING: {
+      string_view str = el.get_string().value_unsafe();
+      fbb->String(str.data(), str.size());
+      return true;
+    }
+    case element_type::BOOL:
+      fbb->Bool(el.get_bool().value_unsafe());
+      return true;
+    case element_type::NULL_VALUE:
+      fbb->Null();
+      return true;
+    default:  // Unsigned integers above the int64 range are encoded by jsoncons
+      return false;
+  }
+}
+
+}  // namespace
+
+optional<JsonType> ParseSimd(string_view input, PMR_NS::memory_resource* mr) {
+  element doc;
+  if (!Parse(input, &doc))
+    return JsonFromString(input, mr);
+
+  jsoncons::json_decoder<JsonType> decoder(PMR_NS::polymorphic_allocator<char>{mr});
+  error_code ec;
+  Visit(doc, &decoder, ec);
+  decoder.flush();
+
+  if (ec || !decoder.is_valid())
+    return JsonFromString(input, mr);
+  return decoder.get_result();
+}
+
+bool ParseSimdFlat(string_view input, flexbuffers::Builder* fbb) {
+  element doc;
+  if (!Parse(input, &doc) || !BuildFlat(doc, fbb))
+    return false;
+
+  fbb->Finish();
+  return true;
+}
+
+}  // namespace dfly::json
@@ -0,0 +1,23 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+#include "core/flatbuffers.h"
+#include "core/json/json_object.h"
+
+namespace dfly::json {
+
+// Same as JsonFromString but parses input with simdjson and builds the tree from its tape.
+// Falls back to jsoncons for inputs simdjson rejects, e.g. integers that do not fit into 64 bits.
+std::optional<JsonType> ParseSimd(std::string_view input, PMR_NS::memory_resource* mr);
+
+// Parses input with simdjson straight into fbb and finishes it. Returns false if simdjson
+// rejects input or an object has duplicate keys, fbb must be cleared before reuse then.
+bool ParseSimdFlat(std::string_view input, flexbuffers::Builder* fbb);
+
+}  // namespace dfly::json
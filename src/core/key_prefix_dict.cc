@@ -0,0 +1,57 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/key_prefix_dict.h"
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+optional<uint16_t> KeyPrefixDict::Acquire(string_view prefix) {
+  if (auto it = ids_.find(prefix); it != ids_.end()) {
+    ++entries_[it->second].refs;
+    return it->second;
+  }
+
+  uint16_t id;
+  if (!free_ids_.empty()) {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  } else if (entries_.size() < kMaxPrefixes) {
+    id = entries_.size();
+    entries_.emplace_back();
+  } else {
+    return nullopt;
+  }
+
+  Entry& entry = entries_[id];
+  entry.prefix.assign(prefix);
+  entry.refs = 1;
+  prefix_bytes_ += entry.prefix.capacity();
+  ids_.emplace(entry.prefix, id);
+  return id;
+}
+
+void KeyPrefixDict::Release(uint16_t id) {
+  Entry& entry = entries_[id];
+  DCHECK_GT(entry.refs, 0u);
+  if (--entry.refs > 0)
+    return;
+
+  ids_.erase(entry.prefix);
+  prefix_bytes_ -= entry.prefix.capacity();
+  entry.prefix.clear();
+  entry.prefix.shrink_to_fit();
+  free_ids_.push_back(id);
+}
+
+size_t KeyPrefixDict::MallocUsed() const {
+  return entries_.size() * sizeof(Entry) + prefix_bytes_ +
+         free_ids_.capacity() * sizeof(uint16_t) +
+         ids_.capacity() * (sizeof(pair<string_view, uint16_t>) + 1);
+}
+
+}  // namespace dfly
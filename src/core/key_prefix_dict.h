@@ -0,0 +1,55 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// Reference counted dictionary of the key prefixes of a shard. Keys that start with a known
+// prefix store only its 16 bit id followed by the rest of the key. Not thread safe: ids are only
+// meaningful on the thread that owns the dictionary.
+class KeyPrefixDict {
+ public:
+  static constexpr size_t kMaxPrefixes = 1u << 16;
+
+  // Returns the id of prefix and increments its reference count, or nullopt if the dictionary
+  // is full.
+  std::optional<uint16_t> Acquire(std::string_view prefix);
+
+  // Decrements the reference count of the prefix and removes it once unused.
+  void Release(uint16_t id);
+
+  std::string_view Get(uint16_t id) const {
+    return entries_[id].prefix;
+  }
+
+  // Number of prefixes in use.
+  size_t size() const {
+    return ids_.size();
+  }
+
+  size_t MallocUsed() const;
+
+ private:
+  struct Entry {
+    std::string prefix;
+    size_t refs = 0;
+  };
+
+  // deque keeps the prefixes in place, so ids_ can reference them.
+  std::deque<Entry> entries_;
+  std::vector<uint16_t> free_ids_;
+  absl::flat_hash_map<std::string_view, uint16_t> ids_;
+  size_t prefix_bytes_ = 0;
+};
+
+}  // namespace dfly
@@ -0,0 +1,113 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/listpack_find.h"
+
+#include <cstring>
+
+#include "base/logging.h"
+#include "core/sse_port.h"
+
+extern "C" {
+#include "redis/listpack.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr uint8_t kEncoding6BitStr = 0x80;
+constexpr uint8_t kEncoding12BitStr = 0xE0;
+constexpr uint8_t kEncoding32BitStr = 0xF0;
+constexpr uint8_t kEof = 0xFF;
+
+// The first bytes of the entry that holds str: its encoding header followed by str.
+class EntryPrefix {
+ public:
+  explicit EntryPrefix(string_view str) : str_{str} {
+    uint32_t len = str.size();
+    if (len < 64) {
+      bytes_[0] = kEncoding6BitStr | len;
+      header_len_ = 1;
+    } else if (len < 4096) {
+      bytes_[0] = kEncoding12BitStr | (len >> 8);
+      bytes_[1] = len & 0xFF;
+      header_len_ = 2;
+    } else {
+      bytes_[0] = kEncoding32BitStr;
+      for (unsigned i = 0; i < 4; ++i)
+        bytes_[1 + i] = (len >> (8 * i)) & 0xFF;
+      header_len_ = 5;
+    }
+
+    prefix_len_ = min<size_t>(sizeof(bytes_), header_len_ + len);
+    str.copy(reinterpret_cast<char*>(bytes_) + header_len_, prefix_len_ - header_len_);
+#ifndef __s390x__
+    pattern_ = mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes_));
+    mask_ = prefix_len_ == 16 ? 0xFFFF : (1u << prefix_len_) - 1;
+#endif
+  }
+
+  // Returns true if the entry at p holds str. end is the end of the listpack.
+  bool Matches(const uint8_t* p, const uint8_t* end) const {
+#ifndef __s390x__
+    // The trailing bytes of the listpack allocation are loaded as well when they are within it.
+    if (p + 16 <= end) {
+      __m128i entry = mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      uint32_t eq = _mm_movemask_epi8(_mm_cmpeq_epi8(entry, pattern_));
+      if ((eq & mask_) != mask_)
+        return false;
+      return RestMatches(p);
+    }
+#endif
+    // The header is compared first, so that str is only compared within an entry of its length.
+    return memcmp(p, bytes_, header_len_) == 0 && View(p + header_len_, str_.size()) == str_;
+  }
+
+ private:
+  bool RestMatches(const uint8_t* p) const {
+    size_t compared = prefix_len_ - header_len_;
+    return View(p + prefix_len_, str_.size() - compared) == str_.substr(compared);
+  }
+
+  static string_view View(const uint8_t* p, size_t len) {
+    return {reinterpret_cast<const char*>(p), len};
+  }
+
+  string_view str_;
+  uint8_t bytes_[16] = {};
+  unsigned header_len_ = 0;
+  unsigned prefix_len_ = 0;
+#ifndef __s390x__
+  __m128i pattern_;
+  uint32_t mask_ = 0;
+#endif
+};
+
+}  // namespace
+
+uint8_t* LpFindStr(uint8_t* lp, uint8_t* p, string_view str, unsigned skip) {
+  DCHECK(p);
+
+  int64_t ival;
+  if (lpStringToInt64(str.data(), str.size(), &ival)) {
+    auto* s = reinterpret_cast<uint8_t*>(const_cast<char*>(str.data()));
+    return lpFind(lp, p, s, str.size(), skip);
+  }
+
+  const uint8_t* end = lp + lpBytes(lp);
+  EntryPrefix prefix{str};
+  while (*p != kEof) {
+    if (prefix.Matches(p, end))
+      return p;
+
+    for (unsigned i = 0; i <= skip && *p != kEof; ++i)
+      p = lpSkip(p);
+  }
+  return nullptr;
+}
+
+}  // namespace dfly
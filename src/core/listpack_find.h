@@ -0,0 +1,19 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace dfly {
+
+// Same as lpFind(lp, p, str, skip): returns the first of every skip + 1 entries from p on that
+// equals str or nullptr. lpFind decodes every entry it compares. Here the encoding header that
+// str would be stored with and its first bytes are compared with the first 16 bytes of each
+// entry in a single SIMD instruction, and only matching entries are compared in full. Strings
+// that look like integers are stored as integers and are delegated to lpFind.
+uint8_t* LpFindStr(uint8_t* lp, uint8_t* p, std::string_view str, unsigned skip);
+
+}  // namespace dfly
@@ -0,0 +1,100 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/listpack_find.h"
+
+#include <absl/strings/str_cat.h>
+#include <mimalloc.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+extern "C" {
+#include "redis/listpack.h"
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+using absl::StrCat;
+
+class ListpackFindTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    init_zmalloc_threadlocal(mi_heap_get_backing());
+  }
+
+  void TearDown() override {
+    lpFree(lp_);
+  }
+
+  void Append(string_view str) {
+    lp_ = lpAppend(lp_, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+  }
+
+  // Checks that LpFindStr finds the same entry as lpFind.
+  void ExpectFind(string_view str, unsigned skip) {
+    uint8_t* s = reinterpret_cast<uint8_t*>(const_cast<char*>(str.data()));
+    uint8_t* expected = lpFind(lp_, lpFirst(lp_), s, str.size(), skip);
+    EXPECT_EQ(LpFindStr(lp_, lpFirst(lp_), str, skip), expected) << str.size() << " " << skip;
+  }
+
+  uint8_t* lp_ = lpNew(0);
+};
+
+TEST_F(ListpackFindTest, Encodings) {
+  // Strings with the 6, 12 and 32 bit length headers and integers.
+  vector<string> entries = {"", "a", string(15, 'b'), string(63, 'c'), "123", "-7",
+                            string(64, 'd'), string(4095, 'e'), "12a", "1234567890123",
+                            string(4096, 'f'), string(70'000, 'g')};
+  for (const string& entry : entries)
+    Append(entry);
+
+  for (const string& entry : entries) {
+    ExpectFind(entry, 0);
+    EXPECT_NE(LpFindStr(lp_, lpFirst(lp_), entry, 0), nullptr);
+  }
+
+  // Strings that share a prefix or a length with an entry.
+  vector<string> missing = {"b", "12", "124", "ccc", string(63, 'x'), string(4094, 'e'),
+                            string(4096, 'g')};
+  for (const string& str : missing) {
+    ExpectFind(str, 0);
+    EXPECT_EQ(LpFindStr(lp_, lpFirst(lp_), str, 0), nullptr) << str.size();
+  }
+}
+
+TEST_F(ListpackFindTest, Skip) {
+  // Values equal to the fields are skipped, as with the values of a hash.
+  for (unsigned i = 0; i < 100; ++i) {
+    Append(StrCat("field:", i));
+    Append(StrCat("field:", i + 1));
+  }
+
+  for (unsigned i = 0; i <= 100; ++i) {
+    ExpectFind(StrCat("field:", i), 1);
+    ExpectFind(StrCat("field:", i), 0);
+  }
+  EXPECT_EQ(LpFindStr(lp_, lpFirst(lp_), "field:100", 1), nullptr);
+  EXPECT_NE(LpFindStr(lp_, lpFirst(lp_), "field:100", 0), nullptr);
+
+  // Odd number of entries, the skip stops at the end.
+  Append("last");
+  ExpectFind("last", 1);
+  ExpectFind("missing", 1);
+}
+
+TEST_F(ListpackFindTest, End) {
+  // The last entries are within 16 bytes of the end of the listpack.
+  for (unsigned len = 0; len < 20; ++len)
+    Append(string(len, 'a' + len));
+
+  for (unsigned len = 0; len < 20; ++len) {
+    ExpectFind(string(len, 'a' + len), 0);
+    ExpectFind(string(len, 'z'), 0);
+  }
+}
+
+}  // namespace dfly
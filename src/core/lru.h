@@ -167,8 +167,6 @@ template <typename T> void Lru<T>::MoveToPosition(uint32_t index, Position posit
   }
 
   auto& node = node_arr_[index];
-  CHECK_NE(node.prev, node.next);
-
   if (position == Position::kHead && index == tail) {
     head_ = index;  // just shift the cycle.
     return;
@@ -178,6 +176,9 @@ template <typename T> void Lru<T>::MoveToPosition(uint32_t index, Position posit
     return;
   }
 
+  // With two items the node is either the head or the tail, so it has two distinct neighbours.
+  CHECK_NE(node.prev, node.next);
+
   // remove from list
   node_arr_[node.prev].next = node.next;
   node_arr_[node.next].prev = node.prev;
@@ -87,6 +87,19 @@ TEST_F(StringLruTest, PutAndPutTail) {
   ASSERT_EQ("e", cache_.GetPrev("a"));
 }
 
+TEST_F(StringLruTest, TwoItems) {
+  cache_.Put("a");
+  cache_.Put("b");  // b -> a
+  cache_.Put("a");  // a -> b
+  ASSERT_EQ("a", cache_.GetHead());
+  ASSERT_EQ("b", cache_.GetTail());
+  cache_.Put("a", Position::kTail);  // b -> a
+  ASSERT_EQ("b", cache_.GetHead());
+  ASSERT_EQ("a", cache_.GetTail());
+  cache_.Put("b", Position::kTail);  // a -> b
+  ASSERT_EQ("b", cache_.GetTail());
+}
+
 TEST_F(StringLruTest, BumpTest) {
   cache_.Put("a");
   cache_.Put("b");
@@ -0,0 +1,260 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_map.h"
+
+#include <xxhash.h>
+
+#include <algorithm>
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr uint8_t kEmptyTag = 0;
+constexpr uint8_t kDeletedTag = 1;
+constexpr uint8_t kLiveTagBit = 0x80;
+constexpr uint8_t kMinLogCap = 2;
+
+inline uint64_t HashField(string_view field) {
+  return XXH3_64bits(field.data(), field.size());
+}
+
+inline uint8_t TagOf(uint64_t hash) {
+  return kLiveTagBit | (hash >> 57);
+}
+
+inline bool IsLive(uint8_t tag) {
+  return tag & kLiveTagBit;
+}
+
+// Minimal log2 of the number of slots that keeps the load factor at most 3/4.
+uint8_t LogCapacityFor(size_t entries) {
+  uint8_t log_cap = kMinLogCap;
+  while ((size_t(1) << log_cap) * 3 < entries * 4)
+    ++log_cap;
+  return log_cap;
+}
+
+}  // namespace
+
+size_t PackedMap::AllocSize(uint8_t log_cap, size_t data_cap) {
+  return sizeof(Header) + (size_t(1) << log_cap) * 3 + data_cap;
+}
+
+uint8_t* PackedMap::Allocate(uint8_t log_cap, size_t data_cap) {
+  DCHECK_LE(data_cap, kMaxDataBytes);
+
+  uint8_t* pm = (uint8_t*)zmalloc(AllocSize(log_cap, data_cap));
+  Header* hdr = header(pm);
+  memset(hdr, 0, sizeof(Header));
+  hdr->log_cap = log_cap;
+  hdr->data_cap = data_cap;
+  memset(tags(pm), kEmptyTag, size_t(1) << log_cap);
+  return pm;
+}
+
+uint8_t* PackedMap::New(size_t entries, size_t data_bytes) {
+  return Allocate(LogCapacityFor(entries), min(data_bytes, kMaxDataBytes));
+}
+
+void PackedMap::Free(uint8_t* pm) {
+  zfree(pm);
+}
+
+size_t PackedMap::BlobBytes(const uint8_t* pm) {
+  return AllocSize(header(pm)->log_cap, header(pm)->data_cap);
+}
+
+size_t PackedMap::MallocUsed(const uint8_t* pm) {
+  return zmalloc_usable_size(pm);
+}
+
+uint16_t PackedMap::GetOffset(const uint8_t* pm, size_t slot) {
+  uint16_t res;
+  memcpy(&res, tags(pm) + Capacity(pm) + slot * 2, sizeof(res));
+  return res;
+}
+
+void PackedMap::SetOffset(uint8_t* pm, size_t slot, uint16_t offset) {
+  memcpy(tags(pm) + Capacity(pm) + slot * 2, &offset, sizeof(offset));
+}
+
+int64_t PackedMap::FindSlot(const uint8_t* pm, string_view field, uint64_t hash) {
+  const size_t mask = Capacity(pm) - 1;
+  const uint8_t tag = TagOf(hash);
+  const uint8_t* slot_tags = tags(pm);
+  const uint8_t* data = entries(pm);
+
+  // The load factor is bounded, so there is always an empty slot to stop at.
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    uint8_t cur = slot_tags[slot];
+    if (cur == kEmptyTag)
+      return -1;
+
+    if (cur == tag) {
+      const uint8_t* entry = data + GetOffset(pm, slot);
+      if (entry[0] == field.size() && memcmp(entry + 1, field.data(), field.size()) == 0)
+        return slot;
+    }
+  }
+}
+
+void PackedMap::PlaceSlot(uint8_t* pm, uint64_t hash, uint16_t offset) {
+  const size_t mask = Capacity(pm) - 1;
+  uint8_t* slot_tags = tags(pm);
+
+  size_t slot = hash & mask;
+  while (IsLive(slot_tags[slot]))
+    slot = (slot + 1) & mask;
+
+  if (slot_tags[slot] == kDeletedTag)
+    header(pm)->deleted--;
+  slot_tags[slot] = TagOf(hash);
+  SetOffset(pm, slot, offset);
+}
+
+void PackedMap::ShiftOffsets(uint8_t* pm, uint16_t offset, int delta) {
+  const uint8_t* slot_tags = tags(pm);
+  for (size_t slot = 0; slot < Capacity(pm); ++slot) {
+    if (!IsLive(slot_tags[slot]))
+      continue;
+    uint16_t cur = GetOffset(pm, slot);
+    if (cur > offset)
+      SetOffset(pm, slot, cur + delta);
+  }
+}
+
+uint8_t* PackedMap::ReserveData(uint8_t* pm, size_t extra) {
+  Header* hdr = header(pm);
+  size_t need = hdr->data_len + extra;
+  if (need <= hdr->data_cap)
+    return pm;
+
+  DCHECK_LE(need, kMaxDataBytes);
+  size_t data_cap = min(max<size_t>(need, hdr->data_cap * 3u / 2u), kMaxDataBytes);
+  pm = (uint8_t*)zrealloc(pm, AllocSize(hdr->log_cap, data_cap));
+  header(pm)->data_cap = data_cap;
+  return pm;
+}
+
+uint8_t* PackedMap::Rehash(uint8_t* pm, uint8_t log_cap, size_t data_cap) {
+  const Header* hdr = header(pm);
+  DCHECK_GE(data_cap, hdr->data_len);
+
+  uint8_t* res = Allocate(log_cap, data_cap);
+  header(res)->size = hdr->size;
+  header(res)->data_len = hdr->data_len;
+  memcpy(entries(res), entries(pm), hdr->data_len);
+
+  const uint8_t* data = entries(res);
+  Iterate(res, [&](string_view field, string_view) {
+    PlaceSlot(res, HashField(field), reinterpret_cast<const uint8_t*>(field.data()) - 1 - data);
+    return true;
+  });
+
+  Free(pm);
+  return res;
+}
+
+optional<string_view> PackedMap::Find(const uint8_t* pm, string_view field) {
+  int64_t slot = FindSlot(pm, field, HashField(field));
+  if (slot < 0)
+    return nullopt;
+
+  const uint8_t* entry = entries(pm) + GetOffset(pm, slot);
+  entry += entry[0] + 1;
+  return string_view{reinterpret_cast<const char*>(entry + 1), entry[0]};
+}
+
+pair<uint8_t*, bool> PackedMap::Insert(uint8_t* pm, string_view field, string_view value,
+                                       bool skip_exists) {
+  DCHECK(IsGoodEntry(field, value));
+
+  uint64_t hash = HashField(field);
+  if (int64_t slot = FindSlot(pm, field, hash); slot >= 0) {
+    if (skip_exists)
+      return {pm, false};
+
+    uint16_t offset = GetOffset(pm, slot);
+    size_t val_pos = offset + 1 + entries(pm)[offset];
+    size_t old_len = entries(pm)[val_pos];
+    int delta = int(value.size()) - int(old_len);
+
+    if (delta > 0)
+      pm = ReserveData(pm, delta);
+
+    uint8_t* data = entries(pm);
+    if (delta != 0) {
+      size_t tail = val_pos + 1 + old_len;
+      memmove(data + tail + delta, data + tail, header(pm)->data_len - tail);
+      ShiftOffsets(pm, offset, delta);
+      header(pm)->data_len += delta;
+    }
+
+    data[val_pos] = value.size();
+    memcpy(data + val_pos + 1, value.data(), value.size());
+    return {pm, false};
+  }
+
+  Header* hdr = header(pm);
+  size_t entry_bytes = EntryBytes(field, value);
+  DCHECK_LE(hdr->data_len + entry_bytes, kMaxDataBytes);
+
+  // Grow or purge deleted slots. Either way the new entry fits into the result.
+  if ((hdr->size + hdr->deleted + 1u) * 4 > Capacity(pm) * 3) {
+    size_t data_cap = max<size_t>(hdr->data_cap, hdr->data_len + entry_bytes);
+    pm = Rehash(pm, LogCapacityFor(hdr->size + 1u), data_cap);
+  } else {
+    pm = ReserveData(pm, entry_bytes);
+  }
+
+  hdr = header(pm);
+  uint16_t offset = hdr->data_len;
+  uint8_t* entry = entries(pm) + offset;
+
+  entry[0] = field.size();
+  memcpy(entry + 1, field.data(), field.size());
+  entry += field.size() + 1;
+  entry[0] = value.size();
+  memcpy(entry + 1, value.data(), value.size());
+
+  hdr->data_len += entry_bytes;
+  hdr->size++;
+  PlaceSlot(pm, hash, offset);
+
+  return {pm, true};
+}
+
+bool PackedMap::Erase(uint8_t* pm, string_view field) {
+  int64_t slot = FindSlot(pm, field, HashField(field));
+  if (slot < 0)
+    return false;
+
+  Header* hdr = header(pm);
+  uint16_t offset = GetOffset(pm, slot);
+  uint8_t* data = entries(pm);
+
+  size_t entry_bytes = data[offset] + 1u;
+  entry_bytes += data[offset + entry_bytes] + 1u;
+  memmove(data + offset, data + offset + entry_bytes, hdr->data_len - offset - entry_bytes);
+
+  tags(pm)[slot] = kDeletedTag;
+  hdr->deleted++;
+  hdr->size--;
+  hdr->data_len -= entry_bytes;
+  ShiftOffsets(pm, offset, -int(entry_bytes));
+
+  return true;
+}
+
+}  // namespace dfly
@@ -0,0 +1,146 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace dfly {
+
+// PackedMap is a compact open-addressing map of short strings, stored in a single zmalloc-ed
+// blob. It fills the gap between listpack, that has linear lookups, and StringMap, that has
+// high per-entry overhead.
+//
+// Layout: Header | tags[capacity] | offsets[capacity] | entries
+// Each slot has a 1-byte tag (0 - empty, 1 - deleted, otherwise 7 bits of the field hash) and
+// a 16-bit offset of its entry. Entries are stored back to back in insertion order as
+// [field_len:1][field][value_len:1][value], so deletions compact the entries section and
+// iteration does not touch the slots at all.
+//
+// Similarly to listpack, all functions operate on a raw pointer and the ones that may
+// reallocate the blob return the new pointer.
+class PackedMap {
+ public:
+  static constexpr size_t kMaxStrLen = UINT8_MAX;      // lengths are stored in a single byte
+  static constexpr size_t kMaxDataBytes = UINT16_MAX;  // entries are addressed by 16-bit offsets
+
+  // Allocates an empty map with room for `entries` pairs taking `data_bytes` bytes in total.
+  static uint8_t* New(size_t entries = 0, size_t data_bytes = 0);
+  static void Free(uint8_t* pm);
+
+  static size_t Size(const uint8_t* pm) {
+    return header(pm)->size;
+  }
+
+  // Bytes taken by the entries, including their length prefixes.
+  static size_t DataBytes(const uint8_t* pm) {
+    return header(pm)->data_len;
+  }
+
+  // Total size of the blob.
+  static size_t BlobBytes(const uint8_t* pm);
+
+  static size_t MallocUsed(const uint8_t* pm);
+
+  // Number of bytes a pair takes in the entries section.
+  static size_t EntryBytes(std::string_view field, std::string_view value) {
+    return field.size() + value.size() + 2;
+  }
+
+  // Whether a pair can be stored in a map.
+  static bool IsGoodEntry(std::string_view field, std::string_view value) {
+    return field.size() <= kMaxStrLen && value.size() <= kMaxStrLen;
+  }
+
+  static std::optional<std::string_view> Find(const uint8_t* pm, std::string_view field);
+
+  // Returns the map, possibly reallocated, and whether the field was inserted.
+  // If the field exists, its value is overridden unless skip_exists is set.
+  // The pair must pass IsGoodEntry() and the entries must stay within kMaxDataBytes.
+  static std::pair<uint8_t*, bool> Insert(uint8_t* pm, std::string_view field,
+                                          std::string_view value, bool skip_exists);
+
+  // Returns true if the field was found and deleted. Never reallocates.
+  static bool Erase(uint8_t* pm, std::string_view field);
+
+  // Calls cb(field, value) for each pair in insertion order until it returns false.
+  template <typename Cb> static void Iterate(const uint8_t* pm, Cb&& cb) {
+    const uint8_t* ptr = entries(pm);
+    const uint8_t* end = ptr + header(pm)->data_len;
+    while (ptr < end) {
+      std::string_view field{reinterpret_cast<const char*>(ptr + 1), ptr[0]};
+      ptr += field.size() + 1;
+      std::string_view value{reinterpret_cast<const char*>(ptr + 1), ptr[0]};
+      ptr += value.size() + 1;
+      if (!cb(field, value))
+        break;
+    }
+  }
+
+ private:
+  struct Header {
+    uint16_t size;        // number of pairs
+    uint16_t deleted;     // number of deleted slots
+    uint16_t data_len;    // used bytes in the entries section
+    uint16_t data_cap;    // allocated bytes for the entries section
+    uint8_t log_cap;      // log2 of number of slots
+    uint8_t reserved[1];  // padding that keeps the offsets aligned
+  };
+  static_assert(sizeof(Header) == 10);
+
+  static Header* header(uint8_t* pm) {
+    return reinterpret_cast<Header*>(pm);
+  }
+
+  static const Header* header(const uint8_t* pm) {
+    return reinterpret_cast<const Header*>(pm);
+  }
+
+  static size_t Capacity(const uint8_t* pm) {
+    return size_t(1) << header(pm)->log_cap;
+  }
+
+  static const uint8_t* tags(const uint8_t* pm) {
+    return pm + sizeof(Header);
+  }
+
+  static uint8_t* tags(uint8_t* pm) {
+    return pm + sizeof(Header);
+  }
+
+  static const uint8_t* entries(const uint8_t* pm) {
+    return pm + sizeof(Header) + Capacity(pm) * 3;
+  }
+
+  static uint8_t* entries(uint8_t* pm) {
+    return pm + sizeof(Header) + Capacity(pm) * 3;
+  }
+
+  static size_t AllocSize(uint8_t log_cap, size_t data_cap);
+  static uint8_t* Allocate(uint8_t log_cap, size_t data_cap);
+
+  static uint16_t GetOffset(const uint8_t* pm, size_t slot);
+  static void SetOffset(uint8_t* pm, size_t slot, uint16_t offset);
+
+  // Returns the slot holding field or -1.
+  static int64_t FindSlot(const uint8_t* pm, std::string_view field, uint64_t hash);
+
+  // Registers an entry at offset in the first free slot of its probe sequence.
+  static void PlaceSlot(uint8_t* pm, uint64_t hash, uint16_t offset);
+
+  // Shifts the offsets of all entries located after `offset` by delta bytes.
+  static void ShiftOffsets(uint8_t* pm, uint16_t offset, int delta);
+
+  // Makes sure the entries section has `extra` more bytes available.
+  static uint8_t* ReserveData(uint8_t* pm, size_t extra);
+
+  // Reallocates the map with the given number of slots, rehashing all entries.
+  static uint8_t* Rehash(uint8_t* pm, uint8_t log_cap, size_t data_cap);
+};
+
+}  // namespace dfly
@@ -0,0 +1,153 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_map.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
+#include <gtest/gtest.h>
+#include <mimalloc.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+using absl::StrCat;
+
+class PackedMapTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    init_zmalloc_threadlocal(mi_heap_get_backing());
+  }
+
+  void SetUp() override {
+    pm_ = PackedMap::New();
+  }
+
+  void TearDown() override {
+    PackedMap::Free(pm_);
+  }
+
+  bool Insert(string_view field, string_view value, bool skip_exists = false) {
+    auto [pm, inserted] = PackedMap::Insert(pm_, field, value, skip_exists);
+    pm_ = pm;
+    return inserted;
+  }
+
+  vector<pair<string, string>> Entries() const {
+    vector<pair<string, string>> res;
+    PackedMap::Iterate(pm_, [&](string_view field, string_view value) {
+      res.emplace_back(field, value);
+      return true;
+    });
+    return res;
+  }
+
+  uint8_t* pm_ = nullptr;
+};
+
+TEST_F(PackedMapTest, Basic) {
+  EXPECT_EQ(0u, PackedMap::Size(pm_));
+  EXPECT_FALSE(PackedMap::Find(pm_, "a"));
+
+  EXPECT_TRUE(Insert("a", "1"));
+  EXPECT_TRUE(Insert("bb", ""));
+  EXPECT_FALSE(Insert("a", "2", true));
+  EXPECT_EQ("1", PackedMap::Find(pm_, "a"));
+  EXPECT_EQ("", PackedMap::Find(pm_, "bb"));
+
+  EXPECT_FALSE(Insert("a", "long value"));
+  EXPECT_EQ("long value", PackedMap::Find(pm_, "a"));
+  EXPECT_EQ("", PackedMap::Find(pm_, "bb"));
+  EXPECT_EQ(2u, PackedMap::Size(pm_));
+  EXPECT_EQ(PackedMap::EntryBytes("a", "long value") + PackedMap::EntryBytes("bb", ""),
+            PackedMap::DataBytes(pm_));
+
+  EXPECT_FALSE(Insert("a", "s"));
+  EXPECT_EQ("s", PackedMap::Find(pm_, "a"));
+  EXPECT_EQ("", PackedMap::Find(pm_, "bb"));
+
+  EXPECT_FALSE(PackedMap::Erase(pm_, "c"));
+  EXPECT_TRUE(PackedMap::Erase(pm_, "a"));
+  EXPECT_FALSE(PackedMap::Find(pm_, "a"));
+  EXPECT_EQ("", PackedMap::Find(pm_, "bb"));
+  EXPECT_EQ(1u, PackedMap::Size(pm_));
+  EXPECT_EQ(PackedMap::EntryBytes("bb", ""), PackedMap::DataBytes(pm_));
+}
+
+TEST_F(PackedMapTest, IterationOrder) {
+  for (unsigned i = 0; i < 10; ++i)
+    Insert(StrCat("f", i), StrCat("v", i));
+  PackedMap::Erase(pm_, "f3");
+  Insert("f0", "updated");
+
+  auto entries = Entries();
+  ASSERT_EQ(9u, entries.size());
+  EXPECT_EQ(make_pair(string{"f0"}, string{"updated"}), entries[0]);
+  EXPECT_EQ("f4", entries[3].first);
+  EXPECT_EQ("v9", entries.back().second);
+
+  unsigned visited = 0;
+  PackedMap::Iterate(pm_, [&](string_view, string_view) { return ++visited < 2; });
+  EXPECT_EQ(2u, visited);
+}
+
+TEST_F(PackedMapTest, MaxLengths) {
+  string field(PackedMap::kMaxStrLen, 'f');
+  string value(PackedMap::kMaxStrLen, 'v');
+  EXPECT_TRUE(PackedMap::IsGoodEntry(field, value));
+  EXPECT_FALSE(PackedMap::IsGoodEntry(field + "f", value));
+  EXPECT_FALSE(PackedMap::IsGoodEntry(field, value + "v"));
+
+  EXPECT_TRUE(Insert(field, value));
+  EXPECT_EQ(value, PackedMap::Find(pm_, field));
+  EXPECT_GE(PackedMap::MallocUsed(pm_), PackedMap::BlobBytes(pm_));
+}
+
+TEST_F(PackedMapTest, Reserve) {
+  PackedMap::Free(pm_);
+  pm_ = PackedMap::New(100, 100 * PackedMap::EntryBytes("field00", "value00"));
+  size_t blob_bytes = PackedMap::BlobBytes(pm_);
+
+  for (unsigned i = 0; i < 100; ++i)
+    ASSERT_TRUE(Insert(absl::StrFormat("field%02u", i), absl::StrFormat("value%02u", i)));
+  EXPECT_EQ(blob_bytes, PackedMap::BlobBytes(pm_));
+}
+
+TEST_F(PackedMapTest, Random) {
+  absl::flat_hash_map<string, string> expected;
+  mt19937 gen(42);
+
+  // Field churn exercises both growth and reuse of deleted slots.
+  for (unsigned i = 0; i < 20000; ++i) {
+    string field = StrCat("f", gen() % 300);
+    if (gen() % 3 == 0) {
+      EXPECT_EQ(expected.erase(field) > 0, PackedMap::Erase(pm_, field));
+    } else {
+      string value(gen() % 32, 'a' + i % 26);
+      EXPECT_EQ(expected.insert_or_assign(field, value).second, Insert(field, value));
+    }
+  }
+
+  ASSERT_EQ(expected.size(), PackedMap::Size(pm_));
+  size_t data_bytes = 0;
+  for (const auto& [field, value] : expected) {
+    EXPECT_EQ(value, PackedMap::Find(pm_, field));
+    data_bytes += PackedMap::EntryBytes(field, value);
+  }
+  EXPECT_EQ(data_bytes, PackedMap::DataBytes(pm_));
+  EXPECT_EQ(expected.size(), Entries().size());
+}
+
+}  // namespace dfly
@@ -0,0 +1,696 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/qlist.h"
+
+extern "C" {
+#include "redis/listpack.h"
+#include "redis/quicklist.h"
+#include "redis/zmalloc.h"
+}
+
+#include <absl/strings/str_cat.h>
+#include <lz4.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Overestimation of the bytes an element adds to a listpack, see quicklist.c.
+constexpr size_t kSizeEstimateOverhead = 8;
+
+// Listpacks below this size are not worth compressing.
+constexpr size_t kMinCompressBytes = 48;
+
+// Lists with at most this many nodes are seeked by walking the nodes.
+constexpr size_t kIndexMinNodes = 8;
+
+// A compressed listpack is stored as its compressed length followed by the LZ4 block.
+uint32_t CompressedLen(const uint8_t* blob) {
+  uint32_t len;
+  memcpy(&len, blob, sizeof(len));
+  return len;
+}
+
+void Decompress(const uint8_t* blob, uint8_t* dest, uint32_t sz) {
+  int res = LZ4_decompress_safe(reinterpret_cast<const char*>(blob) + sizeof(uint32_t),
+                                reinterpret_cast<char*>(dest), CompressedLen(blob), sz);
+  CHECK_EQ(res, int(sz));
+}
+
+QList::Entry GetEntry(uint8_t* p) {
+  unsigned int slen;
+  long long lval;
+  uint8_t* ptr = lpGetValue(p, &slen, &lval);
+  if (ptr)
+    return QList::Entry{string_view{reinterpret_cast<char*>(ptr), slen}};
+  return QList::Entry{int64_t(lval)};
+}
+
+uint8_t* LpPush(uint8_t* lp, string_view value, QList::Where where) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(value.data());
+  return where == QList::HEAD ? lpPrepend(lp, data, value.size())
+                              : lpAppend(lp, data, value.size());
+}
+
+}  // namespace
+
+string QList::Entry::to_string() const {
+  if (is_int())
+    return absl::StrCat(ival());
+  return string{view()};
+}
+
+bool QList::Entry::operator==(string_view sv) const {
+  if (is_int())
+    return absl::AlphaNum{ival()}.Piece() == sv;
+  return view() == sv;
+}
+
+uint8_t* QList::Iterator::Listpack() {
+  if (!current_->compressed)
+    return current_->entry;
+
+  if (buf_owner_ != current_->entry) {
+    buf_.reset(new uint8_t[current_->sz]);
+    Decompress(current_->entry, buf_.get(), current_->sz);
+    buf_owner_ = current_->entry;
+  }
+  return buf_.get();
+}
+
+bool QList::Iterator::Next() {
+  if (!current_)
+    return false;
+
+  uint8_t* lp = Listpack();
+  if (!started_) {
+    started_ = true;
+    zi_ = lpSeek(lp, offset_);
+  } else {
+    zi_ = direction_ == HEAD ? lpNext(lp, zi_) : lpPrev(lp, zi_);
+  }
+
+  while (!zi_) {
+    current_ = direction_ == HEAD ? current_->next : current_->prev;
+    if (!current_)
+      return false;
+    lp = Listpack();
+    zi_ = direction_ == HEAD ? lpFirst(lp) : lpLast(lp);
+  }
+  return true;
+}
+
+QList::Entry QList::Iterator::Get() const {
+  DCHECK(zi_);
+  return GetEntry(zi_);
+}
+
+QList::QList(int fill, int compress, PMR_NS::memory_resource* mr)
+    : mr_(mr), fill_(fill), compress_(max(compress, 0)) {
+}
+
+QList::~QList() {
+  Clear();
+  if (spare_) {
+    mr_->deallocate(spare_, sizeof(Node), alignof(Node));
+  }
+}
+
+void QList::Clear() {
+  Node* node = head_;
+  while (node) {
+    Node* next = node->next;
+    FreeNode(node);
+    node = next;
+  }
+  head_ = tail_ = nullptr;
+  count_ = len_ = 0;
+  index_.reset();
+}
+
+QList::Node* QList::CreateNode(uint8_t* lp, uint32_t count) {
+  Node* node = spare_;
+  if (node) {
+    spare_ = nullptr;
+  } else {
+    node = static_cast<Node*>(mr_->allocate(sizeof(Node), alignof(Node)));
+    malloc_size_ += sizeof(Node);
+  }
+
+  new (node) Node{};
+  node->entry = lp;
+  node->sz = lpBytes(lp);
+  node->count = count;
+  malloc_size_ += zmalloc_usable_size(lp);
+  return node;
+}
+
+void QList::FreeNode(Node* node) {
+  malloc_size_ -= zmalloc_usable_size(node->entry);
+  zfree(node->entry);
+
+  if (spare_) {
+    mr_->deallocate(node, sizeof(Node), alignof(Node));
+    malloc_size_ -= sizeof(Node);
+  } else {
+    spare_ = node;
+  }
+}
+
+void QList::InsertNode(Node* old_node, Node* node, InsertOpt opt) {
+  if (!old_node) {
+    DCHECK(!head_);
+    head_ = tail_ = node;
+  } else if (opt == AFTER) {
+    node->prev = old_node;
+    node->next = old_node->next;
+    if (old_node->next)
+      old_node->next->prev = node;
+    old_node->next = node;
+    if (tail_ == old_node)
+      tail_ = node;
+  } else {
+    node->next = old_node;
+    node->prev = old_node->prev;
+    if (old_node->prev)
+      old_node->prev->next = node;
+    old_node->prev = node;
+    if (head_ == old_node)
+      head_ = node;
+  }
+
+  ++len_;
+  if (old_node)
+    Compress(old_node);
+  Compress(node);
+}
+
+void QList::DelNode(Node* node) {
+  if (node->next)
+    node->next->prev = node->prev;
+  if (node->prev)
+    node->prev->next = node->next;
+  if (node == tail_)
+    tail_ = node->prev;
+  if (node == head_)
+    head_ = node->next;
+
+  --len_;
+  count_ -= node->count;
+  FreeNode(node);
+
+  // Nodes that moved into the uncompressed depth must be decompressed.
+  Compress(nullptr);
+}
+
+bool QList::AllowInsert(const Node* node, size_t sz) const {
+  if (!node)
+    return false;
+  return !quicklistNodeExceedsLimit(fill_, node->sz + sz + kSizeEstimateOverhead, node->count + 1);
+}
+
+void QList::SetListpack(Node* node, uint8_t* lp) {
+  // The caller has already accounted for the previous listpack.
+  node->entry = lp;
+  node->sz = lpBytes(lp);
+  node->attempted_compress = false;
+  malloc_size_ += zmalloc_usable_size(lp);
+}
+
+void QList::DecompressNode(Node* node) {
+  if (!node || !node->compressed)
+    return;
+
+  uint8_t* lp = static_cast<uint8_t*>(zmalloc(node->sz));
+  Decompress(node->entry, lp, node->sz);
+  malloc_size_ -= zmalloc_usable_size(node->entry);
+  zfree(node->entry);
+  node->compressed = false;
+  SetListpack(node, lp);
+}
+
+void QList::CompressNode(Node* node) {
+  if (!node || node->compressed || node->attempted_compress || node->sz < kMinCompressBytes)
+    return;
+
+  int bound = LZ4_compressBound(node->sz);
+  uint8_t* blob = static_cast<uint8_t*>(zmalloc(sizeof(uint32_t) + bound));
+  int len = LZ4_compress_default(reinterpret_cast<const char*>(node->entry),
+                                 reinterpret_cast<char*>(blob) + sizeof(uint32_t), node->sz, bound);
+
+  // Keep the listpack if compression does not save at least a few bytes.
+  if (len <= 0 || size_t(len) + sizeof(uint32_t) + 8 >= node->sz) {
+    zfree(blob);
+    node->attempted_compress = true;
+    return;
+  }
+
+  uint32_t clen = len;
+  memcpy(blob, &clen, sizeof(clen));
+  blob = static_cast<uint8_t*>(zrealloc(blob, sizeof(uint32_t) + clen));
+
+  malloc_size_ -= zmalloc_usable_size(node->entry);
+  zfree(node->entry);
+  node->entry = blob;
+  node->compressed = true;
+  malloc_size_ += zmalloc_usable_size(blob);
+}
+
+// Follows __quicklistCompress: the compress_ nodes at each end stay uncompressed.
+void QList::Compress(Node* node) {
+  if (compress_ == 0 || !head_)
+    return;
+
+  Node* fwd = head_;
+  Node* rev = tail_;
+  bool in_depth = false;
+  for (unsigned depth = 0; depth < compress_; ++depth) {
+    DecompressNode(fwd);
+    DecompressNode(rev);
+
+    in_depth |= (fwd == node || rev == node);
+
+    // The whole list is within the uncompressed depth.
+    if (fwd == rev || fwd->next == rev)
+      return;
+
+    fwd = fwd->next;
+    rev = rev->prev;
+  }
+
+  if (!in_depth)
+    CompressNode(node);
+
+  // Forward and reverse are one node beyond the depth now.
+  CompressNode(fwd);
+  CompressNode(rev);
+}
+
+void QList::Push(string_view value, Where where) {
+  Node* orig = where == HEAD ? head_ : tail_;
+
+  if (AllowInsert(orig, value.size())) {
+    DecompressNode(orig);
+    malloc_size_ -= zmalloc_usable_size(orig->entry);
+    SetListpack(orig, LpPush(orig->entry, value, where));
+    orig->count++;
+    count_++;
+    IndexPush(where, nullptr);
+    return;
+  }
+
+  Node* node = CreateNode(LpPush(lpNew(0), value, where), 1);
+  InsertNode(orig, node, where == HEAD ? BEFORE : AFTER);
+  count_++;
+  IndexPush(where, node);
+}
+
+string QList::Pop(Where where) {
+  DCHECK_GT(count_, 0u);
+  Node* node = where == HEAD ? head_ : tail_;
+  DecompressNode(node);
+
+  uint8_t* p = where == HEAD ? lpFirst(node->entry) : lpLast(node->entry);
+  string res = GetEntry(p).to_string();
+
+  bool node_removed = node->count == 1;
+  if (node_removed) {
+    DelNode(node);
+  } else {
+    malloc_size_ -= zmalloc_usable_size(node->entry);
+    SetListpack(node, lpDelete(node->entry, p, nullptr));
+    node->count--;
+    count_--;
+  }
+
+  IndexPop(where, node_removed);
+  return res;
+}
+
+void QList::AppendListpack(uint8_t* lp) {
+  Node* node = CreateNode(lp, lpLength(lp));
+  InsertNode(tail_, node, AFTER);
+  count_ += node->count;
+  IndexPush(TAIL, node);
+}
+
+void QList::IndexPush(Where where, Node* new_node) {
+  if (!index_ || !index_->valid)
+    return;
+
+  if (len_ == 1) {  // a new list, nothing to keep
+    InvalidateIndex();
+    return;
+  }
+
+  Index& index = *index_;
+  if (where == HEAD) {
+    index.bias += new_node ? new_node->count : 1;
+    if (new_node) {
+      // The former head is not at position 0 anymore.
+      index.pos.front() = new_node->count - index.bias;
+      index.nodes.push_front(new_node);
+      index.pos.push_front(0);
+    }
+  } else if (new_node) {
+    index.nodes.push_back(new_node);
+    index.pos.push_back(int64_t(count_ - new_node->count) - index.bias);
+  }
+}
+
+void QList::IndexPop(Where where, bool node_removed) {
+  if (!index_ || !index_->valid)
+    return;
+
+  Index& index = *index_;
+  if (where == HEAD) {
+    index.bias -= 1;
+    if (node_removed) {
+      index.nodes.pop_front();
+      index.pos.pop_front();
+    }
+  } else if (node_removed) {
+    index.nodes.pop_back();
+    index.pos.pop_back();
+  }
+}
+
+void QList::RebuildIndex() const {
+  if (!index_)
+    index_ = make_unique<Index>();
+
+  Index& index = *index_;
+  index.nodes.clear();
+  index.pos.clear();
+  index.bias = 0;
+
+  int64_t pos = 0;
+  for (Node* node = head_; node; node = node->next) {
+    index.nodes.push_back(node);
+    index.pos.push_back(pos);
+    pos += node->count;
+  }
+  index.valid = true;
+}
+
+pair<QList::Node*, uint32_t> QList::Seek(size_t index) const {
+  DCHECK_LT(index, count_);
+
+  if (len_ <= kIndexMinNodes) {
+    // Walk from the closer end.
+    if (index < count_ / 2) {
+      Node* node = head_;
+      while (index >= node->count) {
+        index -= node->count;
+        node = node->next;
+      }
+      return {node, index};
+    }
+
+    size_t rindex = count_ - 1 - index;
+    Node* node = tail_;
+    while (rindex >= node->count) {
+      rindex -= node->count;
+      node = node->prev;
+    }
+    return {node, node->count - 1 - rindex};
+  }
+
+  if (!index_ || !index_->valid)
+    RebuildIndex();
+
+  // Find the last node that starts at or before index.
+  const Index& idx = *index_;
+  int64_t target = int64_t(index) - idx.bias;
+  auto it = upper_bound(idx.pos.begin() + 1, idx.pos.end(), target);
+  size_t i = it - idx.pos.begin() - 1;
+  int64_t start = i == 0 ? 0 : idx.pos[i] + idx.bias;
+
+  Node* node = idx.nodes[i];
+  DCHECK_GE(int64_t(index), start);
+  DCHECK_LT(index - start, node->count);
+  return {node, uint32_t(index - start)};
+}
+
+QList::Iterator QList::GetIterator(long index, Where where) const {
+  Iterator it;
+  it.owner_ = this;
+  it.direction_ = where;
+
+  long idx = index < 0 ? long(count_) + index : index;
+  if (idx < 0 || size_t(idx) >= count_)
+    return it;
+
+  auto [node, offset] = Seek(idx);
+  it.current_ = node;
+  it.offset_ = offset;
+  return it;
+}
+
+optional<string> QList::Get(long index) const {
+  Iterator it = GetIterator(index);
+  if (!it.Next())
+    return nullopt;
+  return it.Get().to_string();
+}
+
+bool QList::Replace(long index, string_view elem) {
+  long idx = index < 0 ? long(count_) + index : index;
+  if (idx < 0 || size_t(idx) >= count_)
+    return false;
+
+  // Like quicklist, the element is replaced in place even if the node grows past its limit.
+  auto [node, offset] = Seek(idx);
+  DecompressNode(node);
+  uint8_t* p = lpSeek(node->entry, offset);
+  malloc_size_ -= zmalloc_usable_size(node->entry);
+  SetListpack(node, lpReplace(node->entry, &p, reinterpret_cast<const uint8_t*>(elem.data()),
+                              elem.size()));
+  Compress(node);
+  return true;
+}
+
+bool QList::Insert(string_view pivot, string_view elem, InsertOpt opt) {
+  unique_ptr<uint8_t[]> buf;
+  Node* node = head_;
+  uint32_t offset = 0;
+  bool found = false;
+
+  while (node) {
+    uint8_t* lp = const_cast<uint8_t*>(NodeListpack(node, &buf));
+    offset = 0;
+    for (uint8_t* p = lpFirst(lp); p && !found; p = lpNext(lp, p)) {
+      found = GetEntry(p) == pivot;
+      offset += !found;
+    }
+    if (found)
+      break;
+    node = node->next;
+  }
+
+  if (!found)
+    return false;
+
+  DecompressNode(node);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(elem.data());
+  uint32_t split = opt == AFTER ? offset + 1 : offset;  // position of the new element
+
+  if (AllowInsert(node, elem.size())) {
+    uint8_t* p = lpSeek(node->entry, offset);
+    malloc_size_ -= zmalloc_usable_size(node->entry);
+    SetListpack(node, lpInsertString(node->entry, data, elem.size(), p,
+                                     opt == AFTER ? LP_AFTER : LP_BEFORE, nullptr));
+    node->count++;
+    count_++;
+    Compress(node);
+  } else {
+    // Split the full node at the insertion point and put the element at the end of the left
+    // part, or into a node of its own if it still does not fit.
+    if (split > 0 && split < node->count) {
+      uint8_t* copy = static_cast<uint8_t*>(zmalloc(node->sz));
+      memcpy(copy, node->entry, node->sz);
+      Node* right = CreateNode(lpDeleteRange(copy, 0, split), node->count - split);
+      malloc_size_ -= zmalloc_usable_size(node->entry);
+      SetListpack(node, lpDeleteRange(node->entry, split, right->count));
+      node->count = split;
+      InsertNode(node, right, AFTER);
+    }
+
+    if (split > 0 && AllowInsert(node, elem.size())) {
+      malloc_size_ -= zmalloc_usable_size(node->entry);
+      SetListpack(node, LpPush(node->entry, elem, TAIL));
+      node->count++;
+      Compress(node);
+    } else {
+      Node* new_node = CreateNode(LpPush(lpNew(0), elem, TAIL), 1);
+      InsertNode(node, new_node, split > 0 ? AFTER : BEFORE);
+    }
+    count_++;
+  }
+
+  InvalidateIndex();
+  return true;
+}
+
+uint8_t* QList::DelElement(Node* node, uint8_t* p) {
+  if (node->count == 1) {
+    DelNode(node);
+    return nullptr;
+  }
+
+  uint8_t* next = nullptr;
+  malloc_size_ -= zmalloc_usable_size(node->entry);
+  SetListpack(node, lpDelete(node->entry, p, &next));
+  node->count--;
+  count_--;
+  return next;
+}
+
+unsigned QList::Remove(string_view elem, long count) {
+  bool forward = count >= 0;
+  size_t limit = count == 0 ? SIZE_MAX : size_t(abs(count));
+  unsigned removed = 0;
+  unique_ptr<uint8_t[]> buf;
+
+  Node* node = forward ? head_ : tail_;
+  while (node && removed < limit) {
+    Node* next = forward ? node->next : node->prev;
+
+    // Skip nodes without matches without decompressing them.
+    bool has_match = false;
+    uint8_t* clp = const_cast<uint8_t*>(NodeListpack(node, &buf));
+    for (uint8_t* p = lpFirst(clp); p && !has_match; p = lpNext(clp, p)) {
+      has_match = GetEntry(p) == elem;
+    }
+
+    if (has_match) {
+      DecompressNode(node);
+      uint8_t* p = forward ? lpFirst(node->entry) : lpLast(node->entry);
+      bool node_deleted = false;
+      while (p && removed < limit) {
+        if (!(GetEntry(p) == elem)) {
+          p = forward ? lpNext(node->entry, p) : lpPrev(node->entry, p);
+          continue;
+        }
+
+        ++removed;
+        if (forward) {
+          node_deleted = node->count == 1;
+          p = DelElement(node, p);
+        } else {
+          // Elements before p keep their offsets when p is deleted.
+          uint8_t* prev = lpPrev(node->entry, p);
+          size_t prev_off = prev ? prev - node->entry : 0;
+          node_deleted = node->count == 1;
+          DelElement(node, p);
+          p = (prev && !node_deleted) ? node->entry + prev_off : nullptr;
+        }
+        if (node_deleted)
+          break;
+      }
+      if (!node_deleted)
+        Compress(node);
+    }
+    node = next;
+  }
+
+  if (removed)
+    InvalidateIndex();
+  return removed;
+}
+
+void QList::Erase(long start, long count) {
+  if (count <= 0)
+    return;
+
+  long idx = start < 0 ? long(count_) + start : start;
+  if (idx < 0 || size_t(idx) >= count_)
+    return;
+
+  size_t remaining = min<size_t>(count, count_ - idx);
+  auto [node, offset] = Seek(idx);
+
+  while (remaining > 0) {
+    Node* next = node->next;
+    uint32_t del = min<size_t>(remaining, node->count - offset);
+
+    if (offset == 0 && del == node->count) {
+      DelNode(node);
+    } else {
+      DecompressNode(node);
+      malloc_size_ -= zmalloc_usable_size(node->entry);
+      SetListpack(node, lpDeleteRange(node->entry, offset, del));
+      node->count -= del;
+      count_ -= del;
+      Compress(node);
+    }
+
+    remaining -= del;
+    offset = 0;
+    node = next;
+  }
+
+  InvalidateIndex();
+}
+
+bool QList::Iterate(const IterateFunc& cb, long start, long end) const {
+  if (count_ == 0)
+    return true;
+  if (end < 0 || size_t(end) >= count_)
+    end = count_ - 1;
+  if (start < 0)
+    start = 0;
+
+  Iterator it = GetIterator(start);
+  for (long left = end - start + 1; left > 0 && it.Next(); --left) {
+    if (!cb(it.Get()))
+      return false;
+  }
+  return true;
+}
+
+bool QList::DefragIfNeeded(float ratio) {
+  size_t budget = SIZE_MAX, moved = 0;
+  DefragStep(0, ratio, &budget, &moved);
+  return moved > 0;
+}
+
+uint32_t QList::DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved) {
+  Node* node = head_;
+  for (uint32_t i = 0; i < cursor && node; ++i)
+    node = node->next;
+
+  for (; node && *budget > 0; node = node->next, ++cursor, --*budget) {
+    if (!zmalloc_page_is_underutilized(node->entry, ratio))
+      continue;
+
+    size_t sz = zmalloc_usable_size(node->entry);
+    uint8_t* entry = static_cast<uint8_t*>(zmalloc(sz));
+    memcpy(entry, node->entry, node->compressed ? sizeof(uint32_t) + CompressedLen(node->entry)
+                                                : node->sz);
+    malloc_size_ += zmalloc_usable_size(entry) - sz;
+    zfree(node->entry);
+    node->entry = entry;
+    *moved += sz;
+  }
+  return node ? cursor : 0;
+}
+
+const uint8_t* QList::NodeListpack(const Node* node, unique_ptr<uint8_t[]>* buf) {
+  if (!node->compressed)
+    return node->entry;
+
+  buf->reset(new uint8_t[node->sz]);
+  Decompress(node->entry, buf->get(), node->sz);
+  return buf->get();
+}
+
+}  // namespace dfly
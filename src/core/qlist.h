@@ -0,0 +1,237 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// QList is a Dragonfly native replacement for the redis quicklist. Like quicklist, it is a
+// doubly linked list of listpack nodes, with the nodes in the middle of the list optionally
+// compressed. Unlike quicklist:
+// 1. Node structs are allocated from the memory resource of the shard and the last released
+//    node is kept for reuse, so queue-like workloads do not allocate nodes at all.
+// 2. It keeps an index with the position of the first element of every node, so seeking
+//    to an index costs O(log nodes) instead of walking half of the nodes. Pushes and pops at
+//    both ends keep the index up to date, other mutations invalidate it and it is rebuilt by
+//    the next seek.
+// 3. Middle nodes are compressed with LZ4, and reading them does not change the list.
+// 4. The memory used by the list is tracked precisely and its listpacks can be defragmented.
+class QList {
+ public:
+  enum Where : uint8_t { TAIL, HEAD };
+  enum InsertOpt : uint8_t { BEFORE, AFTER };
+
+  struct Node {
+    Node* prev = nullptr;
+    Node* next = nullptr;
+    uint8_t* entry = nullptr;  // listpack or, if compressed, a CompressedBlob
+    uint32_t sz = 0;           // size of the uncompressed listpack
+    uint32_t count = 0;        // number of elements
+    bool compressed = false;
+    bool attempted_compress = false;  // the listpack did not compress well
+  };
+
+  // An element of the list, listpacks store integers in a compact form.
+  class Entry {
+   public:
+    explicit Entry(std::string_view sv) : value_(sv) {
+    }
+
+    explicit Entry(int64_t ival) : value_(ival) {
+    }
+
+    bool is_int() const {
+      return std::holds_alternative<int64_t>(value_);
+    }
+
+    int64_t ival() const {
+      return std::get<int64_t>(value_);
+    }
+
+    std::string_view view() const {
+      return std::get<std::string_view>(value_);
+    }
+
+    std::string to_string() const;
+
+    bool operator==(std::string_view sv) const;
+
+   private:
+    std::variant<std::string_view, int64_t> value_;
+  };
+
+  // Read only iterator. Reads compressed nodes into its own buffer.
+  class Iterator {
+   public:
+    // Moves to the next element, must be called before the first Get().
+    // Returns false when the iteration is over.
+    bool Next();
+
+    Entry Get() const;
+
+   private:
+    friend class QList;
+
+    uint8_t* Listpack();
+
+    const QList* owner_ = nullptr;
+    Node* current_ = nullptr;
+    uint8_t* zi_ = nullptr;  // current element in the listpack of current_
+    long offset_ = 0;        // offset of the element to start from in current_
+    Where direction_ = HEAD;
+    bool started_ = false;
+    std::unique_ptr<uint8_t[]> buf_;  // decompressed listpack of current_
+    uint8_t* buf_owner_ = nullptr;    // the compressed entry buf_ was filled from
+  };
+
+  using IterateFunc = std::function<bool(Entry)>;
+
+  // fill and compress have the same meaning as list_max_listpack_size and list_compress_depth.
+  QList(int fill, int compress, PMR_NS::memory_resource* mr);
+  QList(const QList&) = delete;
+  ~QList();
+
+  QList& operator=(const QList&) = delete;
+
+  size_t Size() const {
+    return count_;
+  }
+
+  size_t node_count() const {
+    return len_;
+  }
+
+  const Node* Head() const {
+    return head_;
+  }
+
+  void Clear();
+
+  void Push(std::string_view value, Where where);
+
+  // Pops an element from a non-empty list.
+  std::string Pop(Where where);
+
+  // Appends a listpack, the list takes ownership over it. Used by the rdb loader.
+  void AppendListpack(uint8_t* lp);
+
+  // Index is zero based, negative indices count from the tail (-1 is the last element).
+  // Returns an iterator positioned before the element or an exhausted one if the index is out
+  // of range. The direction of the iteration is given by where.
+  Iterator GetIterator(long index, Where where = HEAD) const;
+
+  Iterator GetIterator(Where where) const {
+    return GetIterator(where == HEAD ? 0 : -1, where);
+  }
+
+  std::optional<std::string> Get(long index) const;
+
+  // Replaces the element at index, returns false if the index is out of range.
+  bool Replace(long index, std::string_view elem);
+
+  // Inserts elem next to the first element that equals pivot, searching from the head.
+  // Returns false if the pivot was not found.
+  bool Insert(std::string_view pivot, std::string_view elem, InsertOpt opt);
+
+  // Removes up to count elements equal to elem. count 0 removes all the matches and a negative
+  // count searches from the tail. Returns the number of removed elements.
+  unsigned Remove(std::string_view elem, long count);
+
+  // Erases count elements starting from index start, which can be negative.
+  void Erase(long start, long count);
+
+  // Calls cb for the elements in range [start, end] until cb returns false.
+  // Returns false if cb returned false.
+  bool Iterate(const IterateFunc& cb, long start, long end) const;
+
+  size_t MallocUsed() const {
+    return malloc_size_;
+  }
+
+  // Reallocates the listpacks that reside on underutilized pages.
+  // Returns true if any listpack was moved.
+  bool DefragIfNeeded(float ratio);
+
+  // Same as DefragIfNeeded, but visits at most *budget nodes starting from the node at index
+  // cursor. Adds the moved bytes to *moved. Returns the cursor to continue from or 0 once the
+  // tail was reached.
+  uint32_t DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved);
+
+  // Returns the uncompressed listpack of a node, decompressing into buf if needed.
+  static const uint8_t* NodeListpack(const Node* node, std::unique_ptr<uint8_t[]>* buf);
+
+ private:
+  Node* CreateNode(uint8_t* lp, uint32_t count);
+  void FreeNode(Node* node);
+
+  // Links node after (or before) old_node, which is null only if the list is empty.
+  void InsertNode(Node* old_node, Node* node, InsertOpt opt);
+  void DelNode(Node* node);
+
+  bool AllowInsert(const Node* node, size_t sz) const;
+
+  // Replaces the listpack of a node, keeping malloc_size_ up to date.
+  void SetListpack(Node* node, uint8_t* lp);
+
+  void DecompressNode(Node* node);
+  void CompressNode(Node* node);
+
+  // Compresses node if it lies outside of the uncompressed depth and makes sure the nodes at
+  // both ends of the list are uncompressed.
+  void Compress(Node* node);
+
+  // Returns the node containing the element at index (non-negative) and the offset of
+  // the element in it.
+  std::pair<Node*, uint32_t> Seek(size_t index) const;
+  void RebuildIndex() const;
+  void InvalidateIndex() {
+    if (index_)
+      index_->valid = false;
+  }
+
+  // Removes the element at p of node. Returns the listpack position of the next element or
+  // null if node was removed or p was its last element.
+  uint8_t* DelElement(Node* node, uint8_t* p);
+
+  Node* head_ = nullptr;
+  Node* tail_ = nullptr;
+  Node* spare_ = nullptr;  // last released node, kept for reuse
+  PMR_NS::memory_resource* mr_;
+
+  size_t count_ = 0;        // total number of elements
+  size_t len_ = 0;          // number of nodes
+  size_t malloc_size_ = 0;  // listpacks and nodes
+  int fill_;
+  unsigned compress_;
+
+  // The index holds the nodes and the positions of their first elements in list order.
+  // The position of the head is always 0, the positions of the rest of the nodes are
+  // pos[i] + bias, so that pushes and pops at the head only change the bias.
+  // It is allocated by the first seek into a list with more than a few nodes.
+  struct Index {
+    std::deque<Node*> nodes;
+    std::deque<int64_t> pos;
+    int64_t bias = 0;
+    bool valid = false;
+  };
+
+  // Index maintenance by pushes and pops. Node is the new or the removed node, if any.
+  void IndexPush(Where where, Node* new_node);
+  void IndexPop(Where where, bool node_removed);
+
+  mutable std::unique_ptr<Index> index_;
+};
+
+}  // namespace dfly
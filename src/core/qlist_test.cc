@@ -0,0 +1,255 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/qlist.h"
+
+#include <absl/strings/str_cat.h>
+
+#include <deque>
+#include <random>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "core/mi_memory_resource.h"
+
+extern "C" {
+#include "redis/listpack.h"
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+class QListTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    auto* tlh = mi_heap_get_backing();
+    init_zmalloc_threadlocal(tlh);
+  }
+
+  QListTest() : mr_(mi_heap_get_backing()) {
+  }
+
+  void TearDown() override {
+    ql_.reset();
+    EXPECT_EQ(zmalloc_used_memory_tl, 0);
+  }
+
+  void Init(int fill, int compress) {
+    ql_ = make_unique<QList>(fill, compress, &mr_);
+  }
+
+  vector<string> ToItems() const {
+    vector<string> res;
+    ql_->Iterate(
+        [&](QList::Entry e) {
+          res.push_back(e.to_string());
+          return true;
+        },
+        0, -1);
+    return res;
+  }
+
+  void Verify(const deque<string>& expected) {
+    ASSERT_EQ(expected.size(), ql_->Size());
+    EXPECT_EQ(vector<string>(expected.begin(), expected.end()), ToItems());
+    for (size_t i = 0; i < expected.size(); i += 1 + expected.size() / 50) {
+      EXPECT_EQ(expected[i], ql_->Get(i)) << i;
+    }
+  }
+
+  MiMemoryResource mr_;
+  unique_ptr<QList> ql_;
+};
+
+TEST_F(QListTest, Basic) {
+  Init(-2, 0);
+  EXPECT_EQ(0u, ql_->Size());
+
+  ql_->Push("abc", QList::HEAD);
+  ql_->Push("123", QList::TAIL);
+  ql_->Push("def", QList::HEAD);
+  EXPECT_EQ(3u, ql_->Size());
+  EXPECT_EQ(1u, ql_->node_count());
+  EXPECT_THAT(ToItems(), testing::ElementsAre("def", "abc", "123"));
+
+  auto it = ql_->GetIterator(1);
+  ASSERT_TRUE(it.Next());
+  EXPECT_EQ("abc", it.Get().view());
+  ASSERT_TRUE(it.Next());
+  EXPECT_TRUE(it.Get().is_int());
+  EXPECT_EQ(123, it.Get().ival());
+  EXPECT_FALSE(it.Next());
+
+  EXPECT_EQ("123", ql_->Get(-1));
+  EXPECT_EQ(nullopt, ql_->Get(3));
+  EXPECT_EQ("123", ql_->Pop(QList::TAIL));
+  EXPECT_EQ("def", ql_->Pop(QList::HEAD));
+  EXPECT_EQ("abc", ql_->Pop(QList::HEAD));
+  EXPECT_EQ(0u, ql_->node_count());
+  EXPECT_GT(ql_->MallocUsed(), 0u);  // the spare node
+}
+
+TEST_F(QListTest, InsertRemove) {
+  Init(4, 0);
+  for (unsigned i = 0; i < 8; ++i)
+    ql_->Push(absl::StrCat("v", i % 4), QList::TAIL);
+  EXPECT_EQ(2u, ql_->node_count());
+
+  // Inserting into a full node splits it.
+  EXPECT_TRUE(ql_->Insert("v1", "a", QList::AFTER));
+  EXPECT_TRUE(ql_->Insert("v0", "b", QList::BEFORE));
+  EXPECT_FALSE(ql_->Insert("x", "c", QList::BEFORE));
+  Verify({"b", "v0", "v1", "a", "v2", "v3", "v0", "v1", "v2", "v3"});
+
+  EXPECT_EQ(1u, ql_->Remove("v1", -1));
+  Verify({"b", "v0", "v1", "a", "v2", "v3", "v0", "v2", "v3"});
+  EXPECT_EQ(2u, ql_->Remove("v0", 0));
+  Verify({"b", "v1", "a", "v2", "v3", "v2", "v3"});
+
+  EXPECT_TRUE(ql_->Replace(-1, "z"));
+  EXPECT_FALSE(ql_->Replace(7, "z"));
+  ql_->Erase(1, 4);
+  Verify({"b", "v2", "z"});
+  ql_->Erase(-2, 10);
+  Verify({"b"});
+}
+
+// Compares random operations against a deque, with nodes small enough to have many of them.
+TEST_F(QListTest, Random) {
+  for (int compress : {0, 1, 2}) {
+    Init(8, compress);
+    deque<string> expected;
+    mt19937 rng(compress);
+
+    for (unsigned i = 0; i < 20000; ++i) {
+      string val = absl::StrCat(rng() % 64 == 0 ? string(100, 'x') : "", "v", rng() % 100);
+      unsigned op = rng() % 100;
+      if (op < 35) {
+        ql_->Push(val, QList::HEAD);
+        expected.push_front(val);
+      } else if (op < 70) {
+        ql_->Push(val, QList::TAIL);
+        expected.push_back(val);
+      } else if (op < 80 && !expected.empty()) {
+        bool head = rng() % 2;
+        EXPECT_EQ(head ? expected.front() : expected.back(),
+                  ql_->Pop(head ? QList::HEAD : QList::TAIL));
+        head ? expected.pop_front() : expected.pop_back();
+      } else if (op < 90 && !expected.empty()) {
+        long idx = rng() % expected.size();
+        ASSERT_EQ(expected[idx], ql_->Get(idx));
+        ASSERT_EQ(expected[idx], ql_->Get(idx - long(expected.size())));
+      } else if (op < 93 && !expected.empty()) {
+        long idx = rng() % expected.size();
+        ql_->Replace(idx, val);
+        expected[idx] = val;
+      } else if (op < 96 && !expected.empty()) {
+        long idx = rng() % expected.size();
+        long count = rng() % 10;
+        ql_->Erase(idx, count);
+        expected.erase(expected.begin() + idx,
+                       expected.begin() + min<size_t>(idx + count, expected.size()));
+      } else if (op < 98) {
+        string pivot = absl::StrCat("v", rng() % 100);
+        auto it = find(expected.begin(), expected.end(), pivot);
+        bool after = rng() % 2;
+        EXPECT_EQ(it != expected.end(),
+                  ql_->Insert(pivot, val, after ? QList::AFTER : QList::BEFORE));
+        if (it != expected.end())
+          expected.insert(after ? it + 1 : it, val);
+      } else {
+        string elem = absl::StrCat("v", rng() % 100);
+        long count = long(rng() % 5) - 2;
+        size_t removed = 0;
+        if (count >= 0) {
+          for (auto it = expected.begin(); it != expected.end();) {
+            if (*it == elem && (count == 0 || removed < size_t(count))) {
+              it = expected.erase(it);
+              ++removed;
+            } else {
+              ++it;
+            }
+          }
+        } else {
+          for (size_t j = expected.size(); j > 0 && removed < size_t(-count); --j) {
+            if (expected[j - 1] == elem) {
+              expected.erase(expected.begin() + j - 1);
+              ++removed;
+            }
+          }
+        }
+        EXPECT_EQ(removed, ql_->Remove(elem, count));
+      }
+    }
+    Verify(expected);
+
+    // Reverse iteration from the middle.
+    if (!expected.empty()) {
+      long mid = expected.size() / 2;
+      auto it = ql_->GetIterator(mid, QList::TAIL);
+      for (long i = mid; i >= 0; --i) {
+        ASSERT_TRUE(it.Next());
+        ASSERT_EQ(expected[i], it.Get().to_string());
+      }
+      EXPECT_FALSE(it.Next());
+    }
+  }
+}
+
+TEST_F(QListTest, Compress) {
+  Init(-2, 1);
+  string val(64, 'a');
+  for (unsigned i = 0; i < 1000; ++i)
+    ql_->Push(val, QList::TAIL);
+  ASSERT_GT(ql_->node_count(), 3u);
+
+  unsigned compressed = 0;
+  for (const QList::Node* node = ql_->Head(); node; node = node->next)
+    compressed += node->compressed;
+  EXPECT_EQ(ql_->node_count() - 2, compressed);
+  EXPECT_FALSE(ql_->Head()->compressed);
+
+  // Reads do not decompress the nodes.
+  size_t used = ql_->MallocUsed();
+  EXPECT_EQ(val, ql_->Get(500));
+  EXPECT_EQ(used, ql_->MallocUsed());
+
+  ql_->Erase(1, 998);
+  EXPECT_THAT(ToItems(), testing::ElementsAre(val, val));
+}
+
+TEST_F(QListTest, AppendListpack) {
+  Init(-2, 0);
+  for (unsigned i = 0; i < 3; ++i) {
+    uint8_t* lp = lpNew(0);
+    for (unsigned j = 0; j < 100; ++j) {
+      string val = absl::StrCat(i * 100 + j);
+      lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(val.data()), val.size());
+    }
+    ql_->AppendListpack(lp);
+  }
+  EXPECT_EQ(300u, ql_->Size());
+  EXPECT_EQ("299", ql_->Get(-1));
+  EXPECT_EQ("150", ql_->Get(150));
+  ql_->Push("x", QList::HEAD);
+  EXPECT_EQ("150", ql_->Get(151));
+}
+
+static void BM_QListGet(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  MiMemoryResource mr(mi_heap_get_backing());
+  QList ql(-2, 0, &mr);
+  for (int64_t i = 0; i < state.range(0); ++i)
+    ql.Push(absl::StrCat("value", i), QList::TAIL);
+
+  mt19937 rng(0);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ql.Get(rng() % state.range(0)));
+  }
+}
+BENCHMARK(BM_QListGet)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+}  // namespace dfly
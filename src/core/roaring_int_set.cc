@@ -0,0 +1,280 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/roaring_int_set.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Words are combined in strides that the compiler turns into vector instructions.
+constexpr size_t kStride = 8;
+
+uint32_t PopCount(const uint64_t* words, size_t size) {
+  uint32_t res = 0;
+  for (size_t i = 0; i < size; ++i)
+    res += absl::popcount(words[i]);
+  return res;
+}
+
+}  // namespace
+
+bool RoaringIntSet::Chunk::Contains(uint16_t low) const {
+  if (IsBitmap())
+    return bitmap[low / 64] & (uint64_t{1} << (low % 64));
+  return binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringIntSet::Chunk::ToBitmap() {
+  bitmap.assign(kBitmapWords, 0);
+  for (uint16_t low : array)
+    bitmap[low / 64] |= uint64_t{1} << (low % 64);
+
+  array.clear();
+  array.shrink_to_fit();
+}
+
+void RoaringIntSet::Chunk::ToArray() {
+  array.reserve(cardinality);
+  for (size_t i = 0; i < kBitmapWords; ++i) {
+    for (uint64_t word = bitmap[i]; word != 0; word &= word - 1)
+      array.push_back(i * 64 + absl::countr_zero(word));
+  }
+
+  bitmap.clear();
+  bitmap.shrink_to_fit();
+}
+
+RoaringIntSet::RoaringIntSet(PMR_NS::memory_resource* mr) : chunks_{mr} {
+}
+
+bool RoaringIntSet::Add(int64_t value) {
+  int64_t key = value >> 16;
+  uint16_t low = value & 0xFFFF;
+
+  size_t index = LowerBound(key);
+  if (index == chunks_.size() || chunks_[index].key != key)
+    chunks_.emplace(chunks_.begin() + index, key, chunks_.get_allocator().resource());
+
+  Chunk& chunk = chunks_[index];
+  if (chunk.IsBitmap()) {
+    uint64_t& word = chunk.bitmap[low / 64];
+    if (word & (uint64_t{1} << (low % 64)))
+      return false;
+    word |= uint64_t{1} << (low % 64);
+  } else {
+    auto pos = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+    if (pos != chunk.array.end() && *pos == low)
+      return false;
+    chunk.array.insert(pos, low);
+  }
+
+  if (++chunk.cardinality > kMaxArraySize && !chunk.IsBitmap())
+    chunk.ToBitmap();
+
+  size_++;
+  return true;
+}
+
+bool RoaringIntSet::Remove(int64_t value) {
+  int64_t key = value >> 16;
+  uint16_t low = value & 0xFFFF;
+
+  size_t index = LowerBound(key);
+  if (index == chunks_.size() || chunks_[index].key != key)
+    return false;
+
+  Chunk& chunk = chunks_[index];
+  if (chunk.IsBitmap()) {
+    uint64_t& word = chunk.bitmap[low / 64];
+    if (!(word & (uint64_t{1} << (low % 64))))
+      return false;
+    word &= ~(uint64_t{1} << (low % 64));
+  } else {
+    auto pos = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+    if (pos == chunk.array.end() || *pos != low)
+      return false;
+    chunk.array.erase(pos);
+  }
+
+  if (--chunk.cardinality == 0)
+    chunks_.erase(chunks_.begin() + index);
+  else if (chunk.IsBitmap() && chunk.cardinality <= kMaxArraySize / 2)
+    chunk.ToArray();
+
+  size_--;
+  return true;
+}
+
+bool RoaringIntSet::Contains(int64_t value) const {
+  size_t index = LowerBound(value >> 16);
+  return index < chunks_.size() && chunks_[index].key == (value >> 16) &&
+         chunks_[index].Contains(value & 0xFFFF);
+}
+
+int64_t RoaringIntSet::Select(size_t rank) const {
+  DCHECK_LT(rank, size_);
+  for (const Chunk& chunk : chunks_) {
+    if (rank >= chunk.cardinality) {
+      rank -= chunk.cardinality;
+      continue;
+    }
+
+    if (!chunk.IsBitmap())
+      return chunk.Value(chunk.array[rank]);
+
+    for (size_t i = 0; i < kBitmapWords; ++i) {
+      uint64_t word = chunk.bitmap[i];
+      unsigned bits = absl::popcount(word);
+      if (rank >= bits) {
+        rank -= bits;
+        continue;
+      }
+      for (; rank > 0; --rank)
+        word &= word - 1;
+      return chunk.Value(i * 64 + absl::countr_zero(word));
+    }
+  }
+
+  LOG(DFATAL) << "Rank out of range";
+  return 0;
+}
+
+size_t RoaringIntSet::MallocUsed() const {
+  size_t bytes = chunks_.capacity() * sizeof(Chunk);
+  for (const Chunk& chunk : chunks_)
+    bytes += chunk.array.capacity() * sizeof(uint16_t) + chunk.bitmap.capacity() * sizeof(uint64_t);
+  return bytes;
+}
+
+void RoaringIntSet::Unite(const RoaringIntSet& other) {
+  PMR_NS::memory_resource* mr = chunks_.get_allocator().resource();
+  PMR_NS::vector<Chunk> merged{mr};
+  merged.reserve(chunks_.size() + other.chunks_.size());
+
+  auto li = chunks_.begin();
+  auto ri = other.chunks_.begin();
+  while (li != chunks_.end() || ri != other.chunks_.end()) {
+    if (ri == other.chunks_.end() || (li != chunks_.end() && li->key < ri->key)) {
+      merged.push_back(std::move(*li++));
+      continue;
+    }
+
+    if (li == chunks_.end() || ri->key < li->key) {
+      merged.emplace_back(ri->key, mr);
+      merged.back().cardinality = ri->cardinality;
+      merged.back().array.assign(ri->array.begin(), ri->array.end());
+      merged.back().bitmap.assign(ri->bitmap.begin(), ri->bitmap.end());
+      ++ri;
+      continue;
+    }
+
+    Chunk& chunk = merged.emplace_back(std::move(*li++));
+    const Chunk& src = *ri++;
+    if (!chunk.IsBitmap() && !src.IsBitmap()) {
+      PMR_NS::vector<uint16_t> lows{mr};
+      lows.reserve(chunk.array.size() + src.array.size());
+      set_union(chunk.array.begin(), chunk.array.end(), src.array.begin(), src.array.end(),
+                back_inserter(lows));
+      chunk.array = std::move(lows);
+      chunk.cardinality = chunk.array.size();
+      if (chunk.cardinality > kMaxArraySize)
+        chunk.ToBitmap();
+      continue;
+    }
+
+    if (!chunk.IsBitmap())
+      chunk.ToBitmap();
+    if (src.IsBitmap()) {
+      uint64_t* dest = chunk.bitmap.data();
+      const uint64_t* words = src.bitmap.data();
+      for (size_t i = 0; i < kBitmapWords; i += kStride) {
+        for (size_t j = 0; j < kStride; ++j)
+          dest[i + j] |= words[i + j];
+      }
+    } else {
+      for (uint16_t low : src.array)
+        chunk.bitmap[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    chunk.cardinality = PopCount(chunk.bitmap.data(), kBitmapWords);
+  }
+
+  chunks_ = std::move(merged);
+  size_ = 0;
+  for (const Chunk& chunk : chunks_)
+    size_ += chunk.cardinality;
+}
+
+void RoaringIntSet::Intersect(absl::Span<const RoaringIntSet* const> sets, size_t limit,
+                              vector<int64_t>* out) {
+  if (sets.empty())
+    return;
+
+  const RoaringIntSet* smallest = *min_element(
+      sets.begin(), sets.end(), [](const auto* l, const auto* r) { return l->size_ < r->size_; });
+  size_t start = out->size();
+  vector<const Chunk*> matches;
+  vector<uint64_t> words;
+
+  for (const Chunk& chunk : smallest->chunks_) {
+    // The chunks of the key in all the sets, the values are looked up from the smallest array.
+    matches.clear();
+    const Chunk* sparse = &chunk;
+    for (const RoaringIntSet* set : sets) {
+      size_t index = set->LowerBound(chunk.key);
+      if (index == set->chunks_.size() || set->chunks_[index].key != chunk.key)
+        break;
+      const Chunk& match = set->chunks_[index];
+      matches.push_back(&match);
+      if (!match.IsBitmap() && (sparse->IsBitmap() || match.cardinality < sparse->cardinality))
+        sparse = &match;
+    }
+    if (matches.size() != sets.size())
+      continue;
+
+    if (sparse->IsBitmap()) {
+      words.assign(chunk.bitmap.begin(), chunk.bitmap.end());
+      for (const Chunk* match : matches) {
+        const uint64_t* other = match->bitmap.data();
+        for (size_t i = 0; i < kBitmapWords; i += kStride) {
+          for (size_t j = 0; j < kStride; ++j)
+            words[i + j] &= other[i + j];
+        }
+      }
+      for (size_t i = 0; i < kBitmapWords; ++i) {
+        for (uint64_t word = words[i]; word != 0; word &= word - 1)
+          out->push_back(chunk.Value(i * 64 + absl::countr_zero(word)));
+      }
+    } else {
+      for (uint16_t low : sparse->array) {
+        bool found = all_of(matches.begin(), matches.end(), [&](const Chunk* match) {
+          return match == sparse || match->Contains(low);
+        });
+        if (found)
+          out->push_back(chunk.Value(low));
+      }
+    }
+
+    if (limit && out->size() - start >= limit) {
+      out->resize(start + limit);
+      return;
+    }
+  }
+}
+
+size_t RoaringIntSet::LowerBound(int64_t key) const {
+  auto it = lower_bound(chunks_.begin(), chunks_.end(), key,
+                        [](const Chunk& chunk, int64_t key) { return chunk.key < key; });
+  return it - chunks_.begin();
+}
+
+}  // namespace dfly
@@ -0,0 +1,116 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/numeric/bits.h>
+#include <absl/types/span.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// A set of 64-bit integers in the layout of roaring bitmaps, used for large sets of integers like
+// ids, which take 2 bytes per member or a bit per member of dense ranges instead of an sds string
+// and a hash table slot.
+// Values are grouped into chunks by their upper 48 bits, sorted by the signed value of the bits.
+// Sparse chunks keep a sorted array of the lower 16 bits, chunks with more than kMaxArraySize
+// values switch to a bitmap of all 2^16 values. Intersections and unions combine whole chunks,
+// bitmaps word by word.
+class RoaringIntSet {
+ public:
+  // Chunks switch to a bitmap above this size and back to an array at half of it.
+  static constexpr size_t kMaxArraySize = 4096;
+
+  explicit RoaringIntSet(PMR_NS::memory_resource* mr);
+
+  bool Add(int64_t value);
+  bool Remove(int64_t value);
+  bool Contains(int64_t value) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // Returns the value at the given position in ascending order, rank < Size().
+  int64_t Select(size_t rank) const;
+
+  size_t MallocUsed() const;
+
+  // Calls cb for the values not less than from in ascending order while it returns true.
+  // Returns false if cb stopped the iteration.
+  template <typename F>
+  bool Iterate(F&& cb, int64_t from = std::numeric_limits<int64_t>::min()) const;
+
+  // Adds the values of other.
+  void Unite(const RoaringIntSet& other);
+
+  // Appends the values present in all the sets to out, at most limit values if limit is not 0.
+  static void Intersect(absl::Span<const RoaringIntSet* const> sets, size_t limit,
+                        std::vector<int64_t>* out);
+
+ private:
+  static constexpr size_t kBitmapWords = (1 << 16) / 64;
+
+  struct Chunk {
+    Chunk(int64_t key, PMR_NS::memory_resource* mr) : key{key}, array{mr}, bitmap{mr} {
+    }
+
+    bool IsBitmap() const {
+      return !bitmap.empty();
+    }
+
+    int64_t Value(uint16_t low) const {
+      return int64_t(uint64_t(key) << 16) | low;
+    }
+
+    bool Contains(uint16_t low) const;
+
+    void ToBitmap();
+    void ToArray();
+
+    int64_t key;
+    uint32_t cardinality = 0;
+    PMR_NS::vector<uint16_t> array;   // sorted lower bits of sparse chunks.
+    PMR_NS::vector<uint64_t> bitmap;  // kBitmapWords words of dense chunks.
+  };
+
+  // Returns the index of the first chunk with a key not less than key.
+  size_t LowerBound(int64_t key) const;
+
+  size_t size_ = 0;
+  PMR_NS::vector<Chunk> chunks_;
+};
+
+template <typename F> bool RoaringIntSet::Iterate(F&& cb, int64_t from) const {
+  for (size_t index = LowerBound(from >> 16); index < chunks_.size(); ++index) {
+    const Chunk& chunk = chunks_[index];
+    uint32_t start = chunk.key == (from >> 16) ? (from & 0xFFFF) : 0;
+    if (chunk.IsBitmap()) {
+      for (size_t i = start / 64; i < kBitmapWords; ++i) {
+        uint64_t word = chunk.bitmap[i];
+        if (i == start / 64)
+          word &= ~uint64_t{0} << (start % 64);
+        for (; word != 0; word &= word - 1) {
+          if (!cb(chunk.Value(i * 64 + absl::countr_zero(word))))
+            return false;
+        }
+      }
+    } else {
+      for (auto it = std::lower_bound(chunk.array.begin(), chunk.array.end(), start);
+           it != chunk.array.end(); ++it) {
+        if (!cb(chunk.Value(*it)))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace dfly
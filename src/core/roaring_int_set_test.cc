@@ -0,0 +1,125 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/roaring_int_set.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <set>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class RoaringIntSetTest : public ::testing::Test {
+ protected:
+  static vector<int64_t> Values(const RoaringIntSet& rs) {
+    vector<int64_t> res;
+    rs.Iterate([&res](int64_t value) {
+      res.push_back(value);
+      return true;
+    });
+    return res;
+  }
+};
+
+using IntVec = vector<int64_t>;
+
+TEST_F(RoaringIntSetTest, AddRemove) {
+  RoaringIntSet rs{PMR_NS::get_default_resource()};
+
+  IntVec values = {numeric_limits<int64_t>::min(), -65'537, -1, 0, 7, 65'535, 65'536,
+                   numeric_limits<int64_t>::max()};
+  for (int64_t value : values)
+    EXPECT_TRUE(rs.Add(value));
+  EXPECT_FALSE(rs.Add(7));
+
+  // Negative values come first as chunks are ordered by their signed keys.
+  EXPECT_EQ(Values(rs), values);
+  EXPECT_EQ(rs.Size(), values.size());
+  EXPECT_TRUE(rs.Contains(-65'537));
+  EXPECT_FALSE(rs.Contains(-65'536));
+
+  for (size_t i = 0; i < values.size(); ++i)
+    EXPECT_EQ(rs.Select(i), values[i]);
+
+  IntVec positive;
+  rs.Iterate(
+      [&positive](int64_t value) {
+        positive.push_back(value);
+        return true;
+      },
+      1);
+  EXPECT_EQ(positive, IntVec(values.begin() + 4, values.end()));
+
+  EXPECT_TRUE(rs.Remove(-1));
+  EXPECT_FALSE(rs.Remove(-1));
+  values.erase(find(values.begin(), values.end(), -1));
+  EXPECT_EQ(Values(rs), values);
+
+  for (int64_t value : values)
+    EXPECT_TRUE(rs.Remove(value));
+  EXPECT_EQ(rs.Size(), 0u);
+  EXPECT_TRUE(Values(rs).empty());
+}
+
+// Dense chunks switch to bitmaps, which take a bit per value, and back to arrays.
+TEST_F(RoaringIntSetTest, DenseChunks) {
+  RoaringIntSet rs{PMR_NS::get_default_resource()};
+  for (int64_t value = 0; value < 100'000; ++value)
+    rs.Add(value);
+
+  EXPECT_EQ(rs.Size(), 100'000u);
+  EXPECT_LT(rs.MallocUsed(), 100'000u / 4);
+  EXPECT_EQ(rs.Select(70'000), 70'000);
+
+  for (int64_t value = 0; value < 100'000; value += 2)
+    rs.Remove(value);
+  EXPECT_EQ(rs.Size(), 50'000u);
+  EXPECT_TRUE(rs.Contains(99'999));
+  EXPECT_FALSE(rs.Contains(99'998));
+  EXPECT_EQ(rs.Select(0), 1);
+}
+
+TEST_F(RoaringIntSetTest, SetOps) {
+  default_random_engine rand{42};
+  uniform_int_distribution<int64_t> dist{-200'000, 200'000};
+
+  // Sparse and dense sets, so that arrays and bitmaps are combined in all ways.
+  vector<unique_ptr<RoaringIntSet>> sets;
+  vector<set<int64_t>> expected(3);
+  for (unsigned i = 0; i < 3; ++i) {
+    sets.push_back(make_unique<RoaringIntSet>(PMR_NS::get_default_resource()));
+    unsigned count = i == 0 ? 1'000 : 300'000;
+    for (unsigned j = 0; j < count; ++j) {
+      int64_t value = dist(rand);
+      sets.back()->Add(value);
+      expected[i].insert(value);
+    }
+  }
+
+  IntVec inter;
+  RoaringIntSet::Intersect({sets[0].get(), sets[1].get(), sets[2].get()}, 0, &inter);
+  IntVec expected_inter;
+  for (int64_t value : expected[0]) {
+    if (expected[1].count(value) && expected[2].count(value))
+      expected_inter.push_back(value);
+  }
+  EXPECT_EQ(inter, expected_inter);
+
+  inter.clear();
+  RoaringIntSet::Intersect({sets[1].get(), sets[2].get()}, 10, &inter);
+  EXPECT_EQ(inter.size(), 10u);
+
+  sets[0]->Unite(*sets[1]);
+  expected[0].insert(expected[1].begin(), expected[1].end());
+  EXPECT_EQ(Values(*sets[0]), IntVec(expected[0].begin(), expected[0].end()));
+  EXPECT_EQ(sets[0]->Size(), expected[0].size());
+}
+
+}  // namespace dfly
@@ -86,6 +86,25 @@ std::optional<double> ScoreMap::Find(std::string_view field) {
   return GetValue(str);
 }
 
+uint32_t ScoreMap::DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved,
+                              const std::function<void(void*, void*)>& on_move) {
+  return TraverseStep(cursor, budget, [&](DensePtr* ptr) {
+    sds s = (sds)ptr->GetObject();
+    char* alloc_ptr = (char*)sdsAllocPtr(s);
+    if (!zmalloc_page_is_underutilized(alloc_ptr, ratio))
+      return;
+
+    size_t alloc_size = zmalloc_usable_size(alloc_ptr);
+    char* copy = (char*)zmalloc(alloc_size);
+    memcpy(copy, alloc_ptr, alloc_size);
+    sds new_s = copy + (s - alloc_ptr);
+    ptr->SetObject(new_s);
+    on_move(s, new_s);
+    zfree(alloc_ptr);
+    *moved += alloc_size;
+  });
+}
+
 uint64_t ScoreMap::Hash(const void* obj, uint32_t cookie) const {
   DCHECK_LT(cookie, 2u);
 
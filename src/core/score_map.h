@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <string_view>
 
@@ -113,6 +114,12 @@ class ScoreMap : public DenseSet {
     return iterator{this, true};
   }
 
+  // Re-allocates the members of the buckets starting at cursor that sit on underutilized pages,
+  // see StringMap::DefragStep. on_move is called with the old and the new member before the old
+  // one is freed.
+  uint32_t DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved,
+                      const std::function<void(void*, void*)>& on_move);
+
  private:
   uint64_t Hash(const void* obj, uint32_t cookie) const final;
   bool ObjEqual(const void* left, const void* right, uint32_t right_cookie) const final;
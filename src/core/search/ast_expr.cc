@@ -23,6 +23,15 @@ AstPrefixNode::AstPrefixNode(string prefix) : prefix{std::move(prefix)} {
   this->prefix.pop_back();
 }
 
+AstSuffixNode::AstSuffixNode(string suffix) : suffix{std::move(suffix)} {
+  this->suffix.erase(0, 1);
+}
+
+AstInfixNode::AstInfixNode(string infix) : infix{std::move(infix)} {
+  this->infix.pop_back();
+  this->infix.erase(0, 1);
+}
+
 AstRangeNode::AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl)
     : lo{lo_excl ? nextafter(lo, hi) : lo}, hi{hi_excl ? nextafter(hi, lo) : hi} {
 }
@@ -76,6 +85,111 @@ AstKnnNode::AstKnnNode(AstNode&& filter, AstKnnNode&& self) {
   this->filter = make_unique<AstNode>(std::move(filter));
 }
 
+namespace {
+
+void AppendNormalized(const AstNode& node, string* out);
+
+template <typename T>
+void AppendRaw(const T& value, string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Strings are prefixed with their length to keep the encoding unambiguous
+void AppendString(string_view str, string* out) {
+  AppendRaw(str.size(), out);
+  out->append(str);
+}
+
+// Sub-nodes are normalized separately and appended in sorted order
+void AppendUnordered(vector<string> parts, string* out) {
+  sort(parts.begin(), parts.end());
+  AppendRaw(parts.size(), out);
+  for (const auto& part : parts)
+    AppendString(part, out);
+}
+
+void AppendNode(monostate, string* out) {
+}
+
+void AppendNode(const AstStarNode&, string* out) {
+}
+
+void AppendNode(const AstTermNode& node, string* out) {
+  AppendString(node.term, out);
+}
+
+void AppendNode(const AstPrefixNode& node, string* out) {
+  AppendString(node.prefix, out);
+}
+
+void AppendNode(const AstSuffixNode& node, string* out) {
+  AppendString(node.suffix, out);
+}
+
+void AppendNode(const AstInfixNode& node, string* out) {
+  AppendString(node.infix, out);
+}
+
+void AppendNode(const AstRangeNode& node, string* out) {
+  AppendRaw(node.lo, out);
+  AppendRaw(node.hi, out);
+}
+
+void AppendNode(const AstNegateNode& node, string* out) {
+  AppendNormalized(*node.node, out);
+}
+
+void AppendNode(const AstLogicalNode& node, string* out) {
+  vector<string> parts(node.nodes.size());
+  for (size_t i = 0; i < node.nodes.size(); i++)
+    AppendNormalized(node.nodes[i], &parts[i]);
+
+  AppendRaw(node.op, out);
+  AppendUnordered(std::move(parts), out);
+}
+
+void AppendNode(const AstFieldNode& node, string* out) {
+  AppendString(node.field, out);
+  AppendNormalized(*node.node, out);
+}
+
+void AppendNode(const AstTagsNode& node, string* out) {
+  AppendUnordered(node.tags, out);
+}
+
+void AppendNode(const AstKnnNode& node, string* out) {
+  if (node.filter)
+    AppendNormalized(*node.filter, out);
+  else
+    AppendNormalized(AstStarNode{}, out);
+  AppendRaw(node.limit, out);
+  AppendString(node.field, out);
+  string_view vec{reinterpret_cast<const char*>(node.vec.first.get()),
+                  node.vec.second * sizeof(float)};
+  AppendString(vec, out);
+  AppendString(node.score_alias, out);
+  AppendRaw(node.ef_runtime.value_or(0), out);
+}
+
+void AppendNode(const AstSortNode& node, string* out) {
+  AppendNormalized(*node.filter, out);
+  AppendString(node.field, out);
+  AppendRaw(node.descending, out);
+}
+
+void AppendNormalized(const AstNode& node, string* out) {
+  AppendRaw(uint8_t(node.index()), out);
+  visit([out](const auto& inner) { AppendNode(inner, out); }, node.Variant());
+}
+
+}  // namespace
+
+string NormalizedQuery(const AstExpr& expr) {
+  string out;
+  AppendNormalized(expr, &out);
+  return out;
+}
+
 }  // namespace dfly::search
 
 namespace std {
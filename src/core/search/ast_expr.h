@@ -35,6 +35,20 @@ struct AstPrefixNode {
   std::string prefix;
 };
 
+// Matches terms ending with suffix, `*suffix`
+struct AstSuffixNode {
+  explicit AstSuffixNode(std::string suffix);
+
+  std::string suffix;
+};
+
+// Matches terms containing infix, `*infix*`
+struct AstInfixNode {
+  explicit AstInfixNode(std::string infix);
+
+  std::string infix;
+};
+
 // Matches numeric range
 struct AstRangeNode {
   AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl);
@@ -103,8 +117,9 @@ struct AstSortNode {
 };
 
 using NodeVariants =
-    std::variant<std::monostate, AstStarNode, AstTermNode, AstPrefixNode, AstRangeNode,
-                 AstNegateNode, AstLogicalNode, AstFieldNode, AstTagsNode, AstKnnNode, AstSortNode>;
+    std::variant<std::monostate, AstStarNode, AstTermNode, AstPrefixNode, AstSuffixNode,
+                 AstInfixNode, AstRangeNode, AstNegateNode, AstLogicalNode, AstFieldNode,
+                 AstTagsNode, AstKnnNode, AstSortNode>;
 
 struct AstNode : public NodeVariants {
   using variant::variant;
@@ -120,6 +135,10 @@ struct AstNode : public NodeVariants {
 
 using AstExpr = AstNode;
 
+// Serialize the query to a canonical binary form. Queries that differ only in the order of the
+// operands of logical nodes or of tags map to the same string.
+std::string NormalizedQuery(const AstExpr& expr);
+
 }  // namespace search
 }  // namespace dfly
 
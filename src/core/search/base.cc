@@ -4,6 +4,8 @@
 
 #include "core/search/base.h"
 
+#include <absl/strings/numbers.h>
+
 namespace dfly::search {
 
 std::string_view QueryParams::operator[](std::string_view name) const {
@@ -37,4 +39,13 @@ WrappedStrPtr::operator std::string_view() const {
   return std::string_view{ptr.get(), std::strlen(ptr.get())};
 }
 
+DocumentAccessor::NumsList DocumentAccessor::GetNumbers(std::string_view active_field) const {
+  NumsList out;
+  for (std::string_view str : GetStrings(active_field)) {
+    if (double num; absl::SimpleAtod(str, &num))
+      out.push_back(num);
+  }
+  return out;
+}
+
 }  // namespace dfly::search
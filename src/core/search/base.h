@@ -23,6 +23,10 @@ using DocId = uint32_t;
 
 enum class VectorSimilarity { L2, COSINE };
 
+// How vector indices store the vectors. FLOAT16 rounds the elements to half precision and INT8
+// quantizes them with a scale per vector.
+enum class VectorStorage : uint8_t { FLOAT32, FLOAT16, INT8 };
+
 using OwnedFtVector = std::pair<std::unique_ptr<float[]>, size_t /* dimension (size) */>;
 
 // Query params represent named parameters for queries supplied via PARAMS.
@@ -69,11 +73,16 @@ using SortableValue = std::variant<std::monostate, double, std::string>;
 struct DocumentAccessor {
   using VectorInfo = search::OwnedFtVector;
   using StringList = absl::InlinedVector<std::string_view, 1>;
+  using NumsList = absl::InlinedVector<double, 1>;
 
   virtual ~DocumentAccessor() = default;
 
   virtual StringList GetStrings(std::string_view active_field) const = 0;
   virtual VectorInfo GetVector(std::string_view active_field) const = 0;
+
+  // Returns the values of the field that are numbers. By default parses the strings of the field,
+  // accessors of typed documents return their numbers without converting them to strings.
+  virtual NumsList GetNumbers(std::string_view active_field) const;
 };
 
 // Base class for type-specific indices.
@@ -6,9 +6,10 @@
 
 #include <absl/container/flat_hash_set.h>
 #include <absl/strings/ascii.h>
-#include <absl/strings/numbers.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_split.h>
+#include <absl/types/span.h>
 
 #define UNI_ALGO_DISABLE_NFKC_NFKD
 
@@ -21,8 +22,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
 
 #include "base/logging.h"
+#include "core/search/vector_utils.h"
 
 namespace dfly::search {
 
@@ -49,6 +52,24 @@ absl::flat_hash_set<std::string> TokenizeWords(std::string_view text,
   return words;
 }
 
+void AppendVarint(uint32_t value, string* out) {
+  for (; value >= 0x80; value >>= 7)
+    out->push_back(char(value | 0x80));
+  out->push_back(char(value));
+}
+
+uint32_t ReadVarint(string_view* in) {
+  uint32_t value = 0;
+  for (unsigned shift = 0; !in->empty(); shift += 7) {
+    uint8_t byte = in->front();
+    in->remove_prefix(1);
+    value |= uint32_t(byte & 0x7f) << shift;
+    if (byte < 0x80)
+      break;
+  }
+  return value;
+}
+
 // Split taglist, remove duplicates and convert all to lowercase
 // TODO: introduce unicode support if needed
 absl::flat_hash_set<string> NormalizeTags(string_view taglist, bool case_sensitive,
@@ -68,45 +89,141 @@ absl::flat_hash_set<string> NormalizeTags(string_view taglist, bool case_sensiti
 
 };  // namespace
 
-NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : entries_{mr} {
+NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : entries_{mr}, buckets_{mr} {
+  buckets_.try_emplace(-numeric_limits<double>::infinity(), mr);
 }
 
 void NumericIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
-  for (auto str : doc->GetStrings(field)) {
-    double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.emplace(num, id);
+  for (double num : doc->GetNumbers(field)) {
+    if (isnan(num) || !entries_.emplace(num, id).second)
+      continue;
+
+    auto bucket = FindBucket(num);
+    bucket->second.num_entries++;
+    bucket->second.ids.Insert(id);
+    TrySplit(bucket);
   }
 }
 
 void NumericIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
-  for (auto str : doc->GetStrings(field)) {
-    double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.erase({num, id});
+  for (double num : doc->GetNumbers(field)) {
+    if (isnan(num) || entries_.erase({num, id}) == 0)
+      continue;
+
+    // All values of the document are removed, so its id can be dropped from every bucket
+    auto bucket = FindBucket(num);
+    bucket->second.num_entries--;
+    bucket->second.ids.Remove(id);
+    if (bucket->second.num_entries == 0 && bucket != buckets_.begin())
+      buckets_.erase(bucket);
   }
 }
 
-vector<DocId> NumericIndex::Range(double l, double r) const {
-  if (r < l)
-    return {};
+NumericIndex::RangeResult NumericIndex::Range(double l, double r) const {
+  if (!(l <= r))
+    return vector<DocId>{};
+
+  // Buckets inside [l, r] are taken as a whole, entries of edge buckets are filtered by value
+  vector<const Container*> covered;
+  vector<DocId> edges;
+  for (auto it = prev(buckets_.upper_bound(l)), end = buckets_.upper_bound(r); it != end; ++it) {
+    auto [first, last] = BucketEntries(it);
+    if (first == last)
+      continue;
+
+    if (l <= first->first && prev(last)->first <= r) {
+      covered.push_back(&it->second.ids);
+      continue;
+    }
+
+    auto e = l <= first->first ? first : entries_.lower_bound({l, 0});
+    for (; e != last && e->first <= r; ++e)
+      edges.push_back(e->second);
+  }
 
-  auto it_l = entries_.lower_bound({l, 0});
-  auto it_r = entries_.lower_bound({r, numeric_limits<DocId>::max()});
-  DCHECK_GE(it_r - it_l, 0);
+  if (edges.empty() && covered.size() == 1)
+    return covered.front();
 
-  vector<DocId> out;
-  for (auto it = it_l; it != it_r; ++it)
-    out.push_back(it->second);
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
 
-  sort(out.begin(), out.end());
-  out.erase(unique(out.begin(), out.end()), out.end());
+  // Buckets are sorted already, union them starting from the smallest ones
+  sort(covered.begin(), covered.end(),
+       [](const auto* lhs, const auto* rhs) { return lhs->Size() < rhs->Size(); });
+
+  vector<DocId> out = std::move(edges), tmp;
+  for (const Container* ids : covered) {
+    tmp.clear();
+    tmp.reserve(out.size() + ids->Size());
+    set_union(out.begin(), out.end(), ids->begin(), ids->end(), back_inserter(tmp));
+    swap(out, tmp);
+  }
   return out;
 }
 
+size_t NumericIndex::EstimateRange(double l, double r) const {
+  if (!(l <= r))
+    return 0;
+
+  size_t res = 0;
+  for (auto it = prev(buckets_.upper_bound(l)), end = buckets_.upper_bound(r); it != end; ++it)
+    res += it->second.num_entries;
+  return res;
+}
+
+NumericIndex::BucketMap::iterator NumericIndex::FindBucket(double value) {
+  return prev(buckets_.upper_bound(value));
+}
+
+void NumericIndex::TrySplit(BucketMap::iterator bucket) {
+  if (bucket->second.num_entries <= kMaxBucketEntries)
+    return;
+
+  auto [first, last] = BucketEntries(bucket);
+
+  // Buckets holding a single repeated value can't be split
+  if (first->first == prev(last)->first)
+    return;
+
+  // Split at the first entry of the median value, or of the next larger one if the lower half is
+  // a single repeated value
+  auto median = next(first, bucket->second.num_entries / 2);
+  if (median->first == first->first)
+    median = entries_.upper_bound({first->first, numeric_limits<DocId>::max()});
+  else
+    median = entries_.lower_bound({median->first, 0});
+  DCHECK(median != last);
+
+  double lo = bucket->first, mid = median->first;
+  auto* mr = buckets_.get_allocator().resource();
+  auto hint = buckets_.erase(bucket);
+  auto upper = buckets_.try_emplace(hint, mid, mr);
+  auto lower = buckets_.try_emplace(upper, lo, mr);
+
+  FillBucket(first, median, &lower->second);
+  FillBucket(median, last, &upper->second);
+}
+
+void NumericIndex::FillBucket(EntryIt first, EntryIt last, Bucket* bucket) {
+  for (auto it = first; it != last; ++it) {
+    bucket->num_entries++;
+    bucket->ids.Insert(it->second);
+  }
+}
+
+pair<NumericIndex::EntryIt, NumericIndex::EntryIt> NumericIndex::BucketEntries(
+    BucketMap::const_iterator bucket) const {
+  auto next_it = next(bucket);
+  return {entries_.lower_bound({bucket->first, 0}),
+          next_it == buckets_.end() ? entries_.end() : entries_.lower_bound({next_it->first, 0})};
+}
+
 template <typename C>
-BaseStringIndex<C>::BaseStringIndex(PMR_NS::memory_resource* mr, bool case_sensitive)
+BaseStringIndex<C>::BaseStringIndex(PMR_NS::memory_resource* mr, bool case_sensitive,
+                                    bool with_suffix_trie)
     : case_sensitive_{case_sensitive}, entries_{mr} {
+  if (with_suffix_trie)
+    suffix_trie_.emplace(mr);
 }
 
 template <typename C>
@@ -132,10 +249,90 @@ void BaseStringIndex<C>::MatchingPrefix(std::string_view prefix,
   }
 }
 
+template <typename C>
+void BaseStringIndex<C>::MatchingSuffix(string_view suffix,
+                                        absl::FunctionRef<void(const Container*)> cb) const {
+  string tmp;
+  if (!case_sensitive_) {
+    tmp = ToLower(suffix);
+    suffix = tmp;
+  }
+
+  if (suffix_trie_) {
+    if (auto it = suffix_trie_->find(suffix); it) {
+      for (const Container* container : it->second)
+        cb(container);
+    }
+    return;
+  }
+
+  for (const auto& [term, container] : entries_) {
+    if (absl::EndsWith(term, suffix))
+      cb(&container);
+  }
+}
+
+template <typename C>
+void BaseStringIndex<C>::MatchingInfix(string_view infix,
+                                       absl::FunctionRef<void(const Container*)> cb) const {
+  string tmp;
+  if (!case_sensitive_) {
+    tmp = ToLower(infix);
+    infix = tmp;
+  }
+
+  if (suffix_trie_) {
+    // Terms with the infix repeated have multiple suffixes starting with it
+    absl::flat_hash_set<const Container*> visited;
+    for (auto it = suffix_trie_->lower_bound(infix);
+         it != suffix_trie_->end() && (*it).first.rfind(infix, 0) == 0; ++it) {
+      for (const Container* container : (*it).second) {
+        if (visited.insert(container).second)
+          cb(container);
+      }
+    }
+    return;
+  }
+
+  for (const auto& [term, container] : entries_) {
+    if (absl::StrContains(term, infix))
+      cb(&container);
+  }
+}
+
 template <typename C>
 typename BaseStringIndex<C>::Container* BaseStringIndex<C>::GetOrCreate(string_view word) {
   auto* mr = entries_.get_allocator().resource();
-  return &entries_.try_emplace(PMR_NS::string{word, mr}, mr, 1000 /* block size */).first->second;
+  auto [it, inserted] = entries_.try_emplace(PMR_NS::string{word, mr}, mr);
+  if (inserted && suffix_trie_)
+    AddSuffixes(word, &it->second);
+  return &it->second;
+}
+
+template <typename C>
+void BaseStringIndex<C>::AddSuffixes(string_view term, const Container* container) {
+  auto* mr = suffix_trie_->get_allocator().resource();
+  for (size_t i = 0; i < term.size(); i++) {
+    if ((term[i] & 0xC0) == 0x80)  // Skip UTF-8 continuation bytes
+      continue;
+    suffix_trie_->try_emplace(term.substr(i), mr).first->second.push_back(container);
+  }
+}
+
+template <typename C>
+void BaseStringIndex<C>::RemoveSuffixes(string_view term, const Container* container) {
+  for (size_t i = 0; i < term.size(); i++) {
+    auto it = suffix_trie_->find(term.substr(i));
+    if (!it)
+      continue;
+
+    auto& containers = it->second;
+    auto pos = find(containers.begin(), containers.end(), container);
+    DCHECK(pos != containers.end());
+    containers.erase(pos);
+    if (containers.empty())
+      suffix_trie_->erase(it);
+  }
 }
 
 template <typename C>
@@ -160,8 +357,11 @@ void BaseStringIndex<C>::Remove(DocId id, DocumentAccessor* doc, string_view fie
       continue;
 
     it->second.Remove(id);
-    if (it->second.Size() == 0)
+    if (it->second.Size() == 0) {
+      if (suffix_trie_)
+        RemoveSuffixes(token, &it->second);
       entries_.erase(it);
+    }
   }
 }
 
@@ -174,13 +374,131 @@ template <typename C> vector<string> BaseStringIndex<C>::GetTerms() const {
   return res;
 }
 
-template struct BaseStringIndex<CompressedSortedSet>;
-template struct BaseStringIndex<SortedVector>;
+template struct BaseStringIndex<BlockList<CompressedSortedSet>>;
+template struct BaseStringIndex<RoaringSet>;
 
 absl::flat_hash_set<std::string> TextIndex::Tokenize(std::string_view value) const {
   return TokenizeWords(value, *stopwords_);
 }
 
+vector<pair<string, uint32_t>> TextIndex::TokenizeWithPositions(string_view value,
+                                                                uint32_t start) const {
+  vector<pair<string, uint32_t>> words;
+  uint32_t pos = start;
+  for (string_view word : una::views::word_only::utf8(value)) {
+    if (string word_lc = una::cases::to_lowercase_utf8(word); !stopwords_->contains(word_lc))
+      words.emplace_back(std::move(word_lc), pos);
+    pos++;
+  }
+  return words;
+}
+
+vector<pair<string, uint32_t>> TextIndex::TokenizeDoc(DocumentAccessor* doc,
+                                                      string_view field) const {
+  vector<pair<string, uint32_t>> words;
+  for (string_view str : doc->GetStrings(field)) {
+    // Leave a gap between values, so that phrases don't match across them
+    uint32_t start = words.empty() ? 0 : words.back().second + 2;
+    auto value_words = TokenizeWithPositions(str, start);
+    move(value_words.begin(), value_words.end(), back_inserter(words));
+  }
+  return words;
+}
+
+void TextIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
+  BaseStringIndex::Add(id, doc, field);
+  if (!with_positions_)
+    return;
+
+  auto words = TokenizeDoc(doc, field);
+  absl::flat_hash_map<string_view, vector<uint32_t>> word_positions;
+  for (const auto& [word, pos] : words)
+    word_positions[word].push_back(pos);
+
+  for (const auto& [word, positions] : word_positions) {
+    string encoded;
+    AppendVarint(positions.size(), &encoded);
+    uint32_t last = 0;
+    for (uint32_t pos : positions) {
+      AppendVarint(pos - last, &encoded);
+      last = pos;
+    }
+    positions_.try_emplace(word).first->second[id] = std::move(encoded);
+  }
+
+  if (id >= doc_lengths_.size())
+    doc_lengths_.resize(id + 1);
+  doc_lengths_[id] = words.size();
+  num_docs_ += !words.empty();
+  total_length_ += words.size();
+}
+
+void TextIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
+  BaseStringIndex::Remove(id, doc, field);
+  if (!with_positions_)
+    return;
+
+  for (const auto& [word, _] : TokenizeDoc(doc, field)) {
+    auto it = positions_.find(word);
+    if (!it)
+      continue;
+
+    it->second.erase(id);
+    if (it->second.empty())
+      positions_.erase(it);
+  }
+
+  if (id < doc_lengths_.size()) {
+    num_docs_ -= doc_lengths_[id] > 0;
+    total_length_ -= doc_lengths_[id];
+    doc_lengths_[id] = 0;
+  }
+}
+
+uint32_t TextIndex::TermFrequency(string_view word, DocId id) const {
+  if (!with_positions_)
+    return 1;
+
+  auto it = positions_.find(word);
+  if (!it)
+    return 0;
+
+  auto doc_it = it->second.find(id);
+  if (doc_it == it->second.end())
+    return 0;
+
+  string_view encoded = doc_it->second;
+  return ReadVarint(&encoded);
+}
+
+vector<uint32_t> TextIndex::Positions(string_view word, DocId id) const {
+  if (!with_positions_)
+    return {};
+
+  auto it = positions_.find(word);
+  if (!it)
+    return {};
+
+  auto doc_it = it->second.find(id);
+  if (doc_it == it->second.end())
+    return {};
+
+  string_view encoded = doc_it->second;
+  vector<uint32_t> positions(ReadVarint(&encoded));
+  uint32_t pos = 0;
+  for (uint32_t& out : positions)
+    out = pos += ReadVarint(&encoded);
+  return positions;
+}
+
+uint32_t TextIndex::DocLength(DocId id) const {
+  return id < doc_lengths_.size() ? doc_lengths_[id] : 0;
+}
+
+double TextIndex::AvgDocLength() const {
+  return num_docs_ > 0 ? double(total_length_) / num_docs_ : 0;
+}
+
 absl::flat_hash_set<std::string> TagIndex::Tokenize(std::string_view value) const {
   return NormalizeTags(value, case_sensitive_, separator_);
 }
@@ -194,37 +512,95 @@ std::pair<size_t /*dim*/, VectorSimilarity> BaseVectorIndex::Info() const {
 
 FlatVectorIndex::FlatVectorIndex(const SchemaField::VectorParams& params,
                                  PMR_NS::memory_resource* mr)
-    : BaseVectorIndex{params.dim, params.sim}, entries_{mr} {
+    : BaseVectorIndex{params.dim, params.sim},
+      storage_{params.storage},
+      entry_size_{VectorStorageSize(params.dim, params.storage)},
+      entries_{mr} {
   DCHECK(!params.use_hnsw);
-  entries_.reserve(params.capacity * params.dim);
+  entries_.reserve(params.capacity * entry_size_);
 }
 
 void FlatVectorIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
-  DCHECK_LE(id * dim_, entries_.size());
-  if (id * dim_ == entries_.size())
-    entries_.resize((id + 1) * dim_);
+  DCHECK_LE(id * entry_size_, entries_.size());
+  if (id * entry_size_ == entries_.size())
+    entries_.resize((id + 1) * entry_size_);
 
   // TODO: Let get vector write to buf itself
   auto [ptr, size] = doc->GetVector(field);
 
   if (size == dim_)
-    memcpy(&entries_[id * dim_], ptr.get(), dim_ * sizeof(float));
+    EncodeVector(ptr.get(), dim_, storage_, &entries_[id * entry_size_]);
 }
 
 void FlatVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   // noop
 }
 
-const float* FlatVectorIndex::Get(DocId doc) const {
-  return &entries_[doc * dim_];
+float FlatVectorIndex::Distance(const float* vec, DocId doc) const {
+  return VectorDistance(vec, &entries_[doc * entry_size_], dim_, sim_, storage_);
+}
+
+void FlatVectorIndex::Distances(const float* vec, absl::Span<const DocId> docs,
+                                float* out) const {
+  vector<const char*> entries(docs.size());
+  for (size_t i = 0; i < docs.size(); i++)
+    entries[i] = &entries_[docs[i] * entry_size_];
+  VectorDistances(vec, entries, dim_, sim_, storage_, out);
 }
 
+// hnswlib space for the vectors that are stored in FLOAT16 or INT8, distances are computed
+// on the encoded data with the metrics of the float spaces.
+class EncodedSpace : public hnswlib::SpaceInterface<float> {
+ public:
+  EncodedSpace(size_t dim, VectorSimilarity sim, VectorStorage storage)
+      : params_{dim, storage},
+        data_size_{VectorStorageSize(dim, storage)},
+        dist_func_{sim == VectorSimilarity::L2 ? &L2Sqr : &InnerProductDistance} {
+  }
+
+  size_t get_data_size() override {
+    return data_size_;
+  }
+
+  hnswlib::DISTFUNC<float> get_dist_func() override {
+    return dist_func_;
+  }
+
+  void* get_dist_func_param() override {
+    return &params_;
+  }
+
+ private:
+  struct Params {
+    size_t dim;
+    VectorStorage storage;
+  };
+
+  static float L2Sqr(const void* u, const void* v, const void* param) {
+    auto* params = static_cast<const Params*>(param);
+    return EncodedL2Sqr(static_cast<const char*>(u), static_cast<const char*>(v), params->dim,
+                        params->storage);
+  }
+
+  static float InnerProductDistance(const void* u, const void* v, const void* param) {
+    auto* params = static_cast<const Params*>(param);
+    return EncodedInnerProductDistance(static_cast<const char*>(u), static_cast<const char*>(v),
+                                       params->dim, params->storage);
+  }
+
+  Params params_;
+  size_t data_size_;
+  hnswlib::DISTFUNC<float> dist_func_;
+};
+
 struct HnswlibAdapter {
   // Default setting of hnswlib/hnswalg
   constexpr static size_t kDefaultEfRuntime = 10;
 
   HnswlibAdapter(const SchemaField::VectorParams& params)
-      : space_{MakeSpace(params.dim, params.sim)},
+      : dim_{params.dim},
+        storage_{params.storage},
+        space_{MakeSpace(params.dim, params.sim, params.storage)},
         world_{GetSpacePtr(), params.capacity, params.hnsw_m, params.hnsw_ef_construction,
                100 /* seed*/} {
   }
@@ -232,7 +608,7 @@ struct HnswlibAdapter {
   void Add(float* data, DocId id) {
     if (world_.cur_element_count + 1 >= world_.max_elements_)
       world_.resizeIndex(world_.cur_element_count * 2);
-    world_.addPoint(data, id);
+    world_.addPoint(Encode(data).data(), id);
   }
 
   void Remove(DocId id) {
@@ -241,7 +617,7 @@ struct HnswlibAdapter {
 
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef) {
     world_.setEf(ef.value_or(kDefaultEfRuntime));
-    return QueueToVec(world_.searchKnn(target, k));
+    return QueueToVec(world_.searchKnn(Encode(target).data(), k));
   }
 
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
@@ -258,19 +634,49 @@ struct HnswlibAdapter {
 
     world_.setEf(ef.value_or(kDefaultEfRuntime));
     BinsearchFilter filter{&allowed};
-    return QueueToVec(world_.searchKnn(target, k, &filter));
+    return QueueToVec(world_.searchKnn(Encode(target).data(), k, &filter));
+  }
+
+  vector<pair<float, DocId>> KnnExact(float* target, size_t k, const vector<DocId>& allowed) {
+    absl::Span<const char> encoded = Encode(target);
+    vector<pair<float, DocId>> out;
+    out.reserve(allowed.size());
+    for (DocId id : allowed) {
+      auto it = world_.label_lookup_.find(id);
+      if (it == world_.label_lookup_.end() || world_.isMarkedDeleted(it->second))
+        continue;
+      float dist = world_.fstdistfunc_(encoded.data(), world_.getDataByInternalId(it->second),
+                                       world_.dist_func_param_);
+      out.emplace_back(dist, id);
+    }
+
+    size_t prefix_size = min(k, out.size());
+    partial_sort(out.begin(), out.begin() + prefix_size, out.end());
+    out.resize(prefix_size);
+    return out;
   }
 
  private:
-  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace>;
+  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace, EncodedSpace>;
 
-  static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim) {
+  static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim, VectorStorage storage) {
+    if (storage != VectorStorage::FLOAT32)
+      return EncodedSpace{dim, sim, storage};
     if (sim == VectorSimilarity::L2)
       return hnswlib::L2Space{dim};
     else
       return hnswlib::InnerProductSpace{dim};
   }
 
+  // Returns the vector in the format of the space, float vectors are used as is.
+  absl::Span<const char> Encode(const float* data) {
+    if (storage_ == VectorStorage::FLOAT32)
+      return {reinterpret_cast<const char*>(data), dim_ * sizeof(float)};
+    encode_buf_.resize(VectorStorageSize(dim_, storage_));
+    EncodeVector(data, dim_, storage_, encode_buf_.data());
+    return encode_buf_;
+  }
+
   hnswlib::SpaceInterface<float>* GetSpacePtr() {
     return visit([](auto& space) -> hnswlib::SpaceInterface<float>* { return &space; }, space_);
   }
@@ -285,6 +691,9 @@ struct HnswlibAdapter {
     return out;
   }
 
+  size_t dim_;
+  VectorStorage storage_;
+  std::vector<char> encode_buf_;
   SpaceUnion space_;
   hnswlib::HierarchicalNSW<float> world_;
 };
@@ -314,6 +723,11 @@ std::vector<std::pair<float, DocId>> HnswVectorIndex::Knn(float* target, size_t
   return adapter_->Knn(target, k, ef, allowed);
 }
 
+std::vector<std::pair<float, DocId>> HnswVectorIndex::KnnExact(
+    float* target, size_t k, const std::vector<DocId>& allowed) const {
+  return adapter_->KnnExact(target, k, allowed);
+}
+
 void HnswVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   adapter_->Remove(id);
 }
@@ -5,10 +5,12 @@
 #include <absl/container/btree_set.h>
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
+#include <absl/types/span.h>
 
 #include <map>
 #include <memory>
 #include <optional>
+#include <variant>
 #include <vector>
 
 #include "absl/functional/function_ref.h"
@@ -17,6 +19,7 @@
 #include "core/search/block_list.h"
 #include "core/search/compressed_sorted_set.h"
 #include "core/search/rax_tree.h"
+#include "core/search/roaring_set.h"
 
 // TODO: move core field definitions out of big header
 #include "core/search/search.h"
@@ -24,25 +27,72 @@
 namespace dfly::search {
 
 // Index for integer fields.
-// Range bounds are queried in logarithmic time, iteration is constant.
+// Values are split into buckets of adjacent value ranges, each keeping the sorted ids of its
+// documents. Range queries union the ids of the buckets they fully cover and filter only the two
+// edge buckets by value, so results are built without sorting all matched entries.
 struct NumericIndex : public BaseIndex {
+  // Buckets with more entries are split in two by their median value
+  static constexpr size_t kMaxBucketEntries = 4096;
+
+  using Container = BlockList<SortedVector>;
+
+  // Either owned ids or a bucket that matched the range exactly
+  using RangeResult = std::variant<std::vector<DocId>, const Container*>;
+
   explicit NumericIndex(PMR_NS::memory_resource* mr);
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
 
-  std::vector<DocId> Range(double l, double r) const;
+  // Sorted ids of all documents with a value in [l, r]. Pointer results are valid as long as the
+  // index is not mutated.
+  RangeResult Range(double l, double r) const;
+
+  // Upper bound of the number of documents in [l, r]: the entries of the buckets it overlaps.
+  size_t EstimateRange(double l, double r) const;
+
+  size_t NumBuckets() const {
+    return buckets_.size();
+  }
 
  private:
   using Entry = std::pair<double, DocId>;
-  absl::btree_set<Entry, std::less<Entry>, PMR_NS::polymorphic_allocator<Entry>> entries_;
+
+  struct Bucket {
+    explicit Bucket(PMR_NS::memory_resource* mr) : ids{mr} {
+    }
+
+    size_t num_entries = 0;  // values, a document can have multiple in one bucket
+    Container ids;
+  };
+
+  // Buckets are keyed by the lowest value they hold, the first one always starts at -inf
+  using BucketMap = std::map<double, Bucket, std::less<double>,
+                             PMR_NS::polymorphic_allocator<std::pair<const double, Bucket>>>;
+
+  using EntrySet = absl::btree_set<Entry, std::less<Entry>, PMR_NS::polymorphic_allocator<Entry>>;
+  using EntryIt = EntrySet::const_iterator;
+
+  BucketMap::iterator FindBucket(double value);
+
+  // Split bucket by its median value if it grew too large
+  void TrySplit(BucketMap::iterator bucket);
+
+  // Insert entries [first, last) into bucket
+  void FillBucket(EntryIt first, EntryIt last, Bucket* bucket);
+
+  // Range of entries that belong to bucket
+  std::pair<EntryIt, EntryIt> BucketEntries(BucketMap::const_iterator bucket) const;
+
+  EntrySet entries_;
+  BucketMap buckets_;
 };
 
 // Base index for string based indices.
-template <typename C> struct BaseStringIndex : public BaseIndex {
-  using Container = BlockList<C>;
+template <typename C /* posting list */> struct BaseStringIndex : public BaseIndex {
+  using Container = C;
 
-  BaseStringIndex(PMR_NS::memory_resource* mr, bool case_sensitive);
+  BaseStringIndex(PMR_NS::memory_resource* mr, bool case_sensitive, bool with_suffix_trie = false);
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
@@ -56,34 +106,89 @@ template <typename C> struct BaseStringIndex : public BaseIndex {
   // Iterate over all Machting on prefix.
   void MatchingPrefix(std::string_view prefix, absl::FunctionRef<void(const Container*)> cb) const;
 
+  // Iterate over all terms ending with suffix. Scans all terms without the suffix trie.
+  void MatchingSuffix(std::string_view suffix, absl::FunctionRef<void(const Container*)> cb) const;
+
+  // Iterate over all terms containing infix. Scans all terms without the suffix trie.
+  void MatchingInfix(std::string_view infix, absl::FunctionRef<void(const Container*)> cb) const;
+
   // Returns all the terms that appear as keys in the reverse index.
   std::vector<std::string> GetTerms() const;
 
  protected:
   Container* GetOrCreate(std::string_view word);
 
+  // Add or remove all suffixes of a term to the suffix trie
+  void AddSuffixes(std::string_view term, const Container* container);
+  void RemoveSuffixes(std::string_view term, const Container* container);
+
   bool case_sensitive_ = false;
   search::RaxTreeMap<Container> entries_;
+
+  // Posting lists of all terms by each of their suffixes. A term containing an infix has a
+  // suffix starting with it, so infixes are matched by a prefix scan.
+  using SuffixTerms = PMR_NS::vector<const Container*>;
+  std::optional<search::RaxTreeMap<SuffixTerms>> suffix_trie_;
 };
 
 // Index for text fields.
-// Hashmap based lookup per word.
-struct TextIndex : public BaseStringIndex<CompressedSortedSet> {
+// Hashmap based lookup per word. With positions enabled, it also keeps the positions of the words
+// in every document and the document lengths, for phrase queries and BM25 scoring.
+struct TextIndex : public BaseStringIndex<BlockList<CompressedSortedSet>> {
   using StopWords = absl::flat_hash_set<std::string>;
 
-  TextIndex(PMR_NS::memory_resource* mr, const StopWords* stopwords)
-      : BaseStringIndex(mr, false), stopwords_{stopwords} {
+  TextIndex(PMR_NS::memory_resource* mr, const StopWords* stopwords,
+            SchemaField::TextParams params = {})
+      : BaseStringIndex(mr, false, params.with_suffix_trie),
+        stopwords_{stopwords},
+        with_positions_{params.with_positions},
+        positions_{mr},
+        doc_lengths_{mr} {
   }
 
+  void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+
   absl::flat_hash_set<std::string> Tokenize(std::string_view value) const override;
 
+  // Words of the value in order without stop words, with their positions among all words.
+  std::vector<std::pair<std::string, uint32_t>> TokenizeWithPositions(std::string_view value,
+                                                                      uint32_t start = 0) const;
+
+  bool HasPositions() const {
+    return with_positions_;
+  }
+
+  // Number of occurrences of the word in the document, 1 without positions.
+  uint32_t TermFrequency(std::string_view word, DocId id) const;
+
+  // Sorted positions of the word in the document, empty without positions.
+  std::vector<uint32_t> Positions(std::string_view word, DocId id) const;
+
+  // Number of words in the document and the average over all documents, 0 without positions.
+  uint32_t DocLength(DocId id) const;
+  double AvgDocLength() const;
+
  private:
+  // Positions of a word by document, as a varint count followed by varint deltas.
+  using WordPositions = absl::flat_hash_map<DocId, std::string>;
+
+  std::vector<std::pair<std::string, uint32_t>> TokenizeDoc(DocumentAccessor* doc,
+                                                            std::string_view field) const;
+
   const StopWords* stopwords_;
+  bool with_positions_;
+
+  search::RaxTreeMap<WordPositions> positions_;
+  PMR_NS::vector<uint32_t> doc_lengths_;
+  size_t num_docs_ = 0;  // documents with at least one word
+  uint64_t total_length_ = 0;
 };
 
-// Index for text fields.
-// Hashmap based lookup per word.
-struct TagIndex : public BaseStringIndex<SortedVector> {
+// Index for tag fields.
+// Hashmap based lookup per tag. Tags with few values often match a large share of all documents,
+// so their posting lists switch to bitmaps when dense.
+struct TagIndex : public BaseStringIndex<RoaringSet> {
   TagIndex(PMR_NS::memory_resource* mr, SchemaField::TagParams params)
       : BaseStringIndex(mr, params.case_sensitive), separator_{params.separator} {
   }
@@ -112,10 +217,16 @@ struct FlatVectorIndex : public BaseVectorIndex {
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
 
-  const float* Get(DocId doc) const;
+  // Distance from the full precision vector to the vector of the document.
+  float Distance(const float* vec, DocId doc) const;
+
+  // Distances from the full precision vector to the vectors of docs, written to out.
+  void Distances(const float* vec, absl::Span<const DocId> docs, float* out) const;
 
  private:
-  PMR_NS::vector<float> entries_;
+  VectorStorage storage_;
+  size_t entry_size_;  // bytes per vector with storage_
+  PMR_NS::vector<char> entries_;
 };
 
 struct HnswlibAdapter;
@@ -131,6 +242,11 @@ struct HnswVectorIndex : public BaseVectorIndex {
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
                                            const std::vector<DocId>& allowed) const;
 
+  // Exact k nearest among the allowed documents, computing the distance to each of them. Cheaper
+  // than the graph search for a few allowed documents, which it would mostly visit and skip.
+  std::vector<std::pair<float, DocId>> KnnExact(float* target, size_t k,
+                                                const std::vector<DocId>& allowed) const;
+
  private:
   std::unique_ptr<HnswlibAdapter> adapter_;
 };
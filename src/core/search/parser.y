@@ -70,6 +70,7 @@ double toDouble(string_view src);
 // Needed 0 at the end to satisfy bison 3.5.1
 %token YYEOF 0
 %token <std::string> TERM "term" TAG_VAL "tag_val" PARAM "param" FIELD "field" PREFIX "prefix"
+%token <std::string> SUFFIX "suffix" INFIX "infix"
 
 %precedence TERM TAG_VAL
 %left OR_OP
@@ -133,12 +134,17 @@ search_unary_expr:
   | NOT_OP search_unary_expr          { $$ = AstNegateNode(std::move($2)); }
   | TERM                              { $$ = AstTermNode(std::move($1)); }
   | PREFIX                            { $$ = AstPrefixNode(std::move($1)); }
+  | SUFFIX                            { $$ = AstSuffixNode(std::move($1)); }
+  | INFIX                             { $$ = AstInfixNode(std::move($1)); }
   | UINT32                            { $$ = AstTermNode(std::move($1)); }
   | FIELD COLON field_cond            { $$ = AstFieldNode(std::move($1), std::move($3)); }
 
 field_cond:
   TERM                                                  { $$ = AstTermNode(std::move($1)); }
   | UINT32                                              { $$ = AstTermNode(std::move($1)); }
+  | PREFIX                                              { $$ = AstPrefixNode(std::move($1)); }
+  | SUFFIX                                              { $$ = AstSuffixNode(std::move($1)); }
+  | INFIX                                               { $$ = AstInfixNode(std::move($1)); }
   | NOT_OP field_cond                                   { $$ = AstNegateNode(std::move($2)); }
   | LPAREN field_cond_expr RPAREN                       { $$ = std::move($2); }
   | LBRACKET numeric_filter_expr RBRACKET               { $$ = std::move($2); }
@@ -173,6 +179,9 @@ field_unary_expr:
   | NOT_OP field_unary_expr                      { $$ = AstNegateNode(std::move($2)); };
   | TERM                                         { $$ = AstTermNode(std::move($1)); }
   | UINT32                                       { $$ = AstTermNode(std::move($1)); }
+  | PREFIX                                       { $$ = AstPrefixNode(std::move($1)); }
+  | SUFFIX                                       { $$ = AstSuffixNode(std::move($1)); }
+  | INFIX                                        { $$ = AstInfixNode(std::move($1)); }
 
 tag_list:
   tag_list_element                       { $$ = AstTagsNode(std::move($1)); }
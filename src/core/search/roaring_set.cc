@@ -0,0 +1,269 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/roaring_set.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace dfly::search {
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t kChunkBits = 1 << 16;
+
+// Words are combined in strides that the compiler turns into vector instructions
+constexpr size_t kStride = 8;
+
+// Index of first set bit not less than from, kChunkBits if none
+uint32_t NextSetBit(const PMR_NS::vector<uint64_t>& words, uint32_t from) {
+  for (size_t i = from / 64; i < words.size(); i++) {
+    uint64_t word = words[i];
+    if (i == from / 64)
+      word &= ~uint64_t{0} << (from % 64);
+    if (word != 0)
+      return i * 64 + absl::countr_zero(word);
+  }
+  return kChunkBits;
+}
+
+void AppendBits(uint32_t base, uint64_t word, vector<DocId>* out) {
+  for (; word != 0; word &= word - 1)
+    out->push_back(base + absl::countr_zero(word));
+}
+
+template <typename Op>
+void CombineBitmaps(uint32_t base, const uint64_t* l, const uint64_t* r, size_t size, Op op,
+                    vector<DocId>* out) {
+  DCHECK_EQ(size % kStride, 0u);
+  for (size_t i = 0; i < size; i += kStride) {
+    uint64_t words[kStride];
+    for (size_t j = 0; j < kStride; j++)
+      words[j] = op(l[i + j], r[i + j]);
+    for (size_t j = 0; j < kStride; j++)
+      AppendBits(base + (i + j) * 64, words[j], out);
+  }
+}
+
+}  // namespace
+
+RoaringSet::ConstIterator::ConstIterator(const RoaringSet* set, size_t chunk)
+    : set_{set}, chunk_{chunk} {
+  SeekChunk();
+}
+
+void RoaringSet::ConstIterator::SeekChunk() {
+  pos_ = 0;
+  if (chunk_ < set_->chunks_.size() && set_->chunks_[chunk_].IsBitmap())
+    pos_ = NextSetBit(set_->chunks_[chunk_].bitmap, 0);
+}
+
+RoaringSet::IntType RoaringSet::ConstIterator::operator*() const {
+  const Chunk& chunk = set_->chunks_[chunk_];
+  uint32_t low = chunk.IsBitmap() ? pos_ : chunk.array[pos_];
+  return (IntType{chunk.key} << 16) | low;
+}
+
+RoaringSet::ConstIterator& RoaringSet::ConstIterator::operator++() {
+  const Chunk& chunk = set_->chunks_[chunk_];
+  pos_ = chunk.IsBitmap() ? NextSetBit(chunk.bitmap, pos_ + 1) : pos_ + 1;
+  if (pos_ == (chunk.IsBitmap() ? kChunkBits : chunk.array.size())) {
+    chunk_++;
+    SeekChunk();
+  }
+  return *this;
+}
+
+bool RoaringSet::Chunk::Contains(uint16_t low) const {
+  if (IsBitmap())
+    return bitmap[low / 64] & (uint64_t{1} << (low % 64));
+  return binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringSet::Chunk::ToBitmap() {
+  bitmap.assign(kBitmapWords, 0);
+  for (uint16_t low : array)
+    bitmap[low / 64] |= uint64_t{1} << (low % 64);
+
+  array.clear();
+  array.shrink_to_fit();
+}
+
+void RoaringSet::Chunk::ToArray() {
+  array.reserve(cardinality);
+  for (size_t i = 0; i < kBitmapWords; i++) {
+    for (uint64_t word = bitmap[i]; word != 0; word &= word - 1)
+      array.push_back(i * 64 + absl::countr_zero(word));
+  }
+
+  bitmap.clear();
+  bitmap.shrink_to_fit();
+}
+
+RoaringSet::RoaringSet(PMR_NS::memory_resource* mr) : chunks_{mr} {
+}
+
+RoaringSet::ConstIterator RoaringSet::begin() const {
+  return ConstIterator{this, 0};
+}
+
+RoaringSet::ConstIterator RoaringSet::end() const {
+  return ConstIterator{this, chunks_.size()};
+}
+
+bool RoaringSet::Insert(IntType value) {
+  uint16_t key = value >> 16, low = value & 0xFFFF;
+
+  auto it = chunks_.begin() + (LowerBound(key) - chunks_.cbegin());
+  if (it == chunks_.end() || it->key != key)
+    it = chunks_.emplace(it, key, chunks_.get_allocator().resource());
+
+  if (it->IsBitmap()) {
+    uint64_t& word = it->bitmap[low / 64];
+    if (word & (uint64_t{1} << (low % 64)))
+      return false;
+    word |= uint64_t{1} << (low % 64);
+  } else {
+    auto pos = lower_bound(it->array.begin(), it->array.end(), low);
+    if (pos != it->array.end() && *pos == low)
+      return false;
+    it->array.insert(pos, low);
+  }
+
+  if (++it->cardinality > kMaxArraySize && !it->IsBitmap())
+    it->ToBitmap();
+
+  size_++;
+  return true;
+}
+
+bool RoaringSet::Remove(IntType value) {
+  uint16_t key = value >> 16, low = value & 0xFFFF;
+
+  auto it = chunks_.begin() + (LowerBound(key) - chunks_.cbegin());
+  if (it == chunks_.end() || it->key != key)
+    return false;
+
+  if (it->IsBitmap()) {
+    uint64_t& word = it->bitmap[low / 64];
+    if (!(word & (uint64_t{1} << (low % 64))))
+      return false;
+    word &= ~(uint64_t{1} << (low % 64));
+  } else {
+    auto pos = lower_bound(it->array.begin(), it->array.end(), low);
+    if (pos == it->array.end() || *pos != low)
+      return false;
+    it->array.erase(pos);
+  }
+
+  if (--it->cardinality == 0)
+    chunks_.erase(it);
+  else if (it->IsBitmap() && it->cardinality <= kMaxArraySize / 2)
+    it->ToArray();
+
+  size_--;
+  return true;
+}
+
+bool RoaringSet::Contains(IntType value) const {
+  auto it = LowerBound(value >> 16);
+  return it != chunks_.end() && it->key == (value >> 16) && it->Contains(value & 0xFFFF);
+}
+
+size_t RoaringSet::ByteSize() const {
+  size_t bytes = chunks_.capacity() * sizeof(Chunk);
+  for (const Chunk& chunk : chunks_)
+    bytes += chunk.array.capacity() * sizeof(uint16_t) + chunk.bitmap.capacity() * sizeof(uint64_t);
+  return bytes;
+}
+
+void RoaringSet::Intersect(const RoaringSet& l, const RoaringSet& r, vector<IntType>* out) {
+  for (auto li = l.chunks_.begin(), ri = r.chunks_.begin();
+       li != l.chunks_.end() && ri != r.chunks_.end();) {
+    if (li->key != ri->key) {
+      li->key < ri->key ? ++li : ++ri;
+      continue;
+    }
+
+    uint32_t base = uint32_t{li->key} << 16;
+    if (li->IsBitmap() && ri->IsBitmap()) {
+      CombineBitmaps(base, li->bitmap.data(), ri->bitmap.data(), kBitmapWords, bit_and{}, out);
+    } else if (li->IsBitmap() || ri->IsBitmap()) {
+      const Chunk& sparse = li->IsBitmap() ? *ri : *li;
+      const Chunk& dense = li->IsBitmap() ? *li : *ri;
+      for (uint16_t low : sparse.array) {
+        if (dense.Contains(low))
+          out->push_back(base | low);
+      }
+    } else {
+      auto lv = li->array.begin(), rv = ri->array.begin();
+      while (lv != li->array.end() && rv != ri->array.end()) {
+        if (*lv == *rv)
+          out->push_back(base | *lv);
+        uint16_t lv_val = *lv, rv_val = *rv;
+        lv += lv_val <= rv_val;
+        rv += rv_val <= lv_val;
+      }
+    }
+    ++li, ++ri;
+  }
+}
+
+void RoaringSet::Unite(const RoaringSet& l, const RoaringSet& r, vector<IntType>* out) {
+  auto append_chunk = [out](const Chunk& chunk) {
+    uint32_t base = uint32_t{chunk.key} << 16;
+    if (chunk.IsBitmap()) {
+      for (size_t i = 0; i < kBitmapWords; i++)
+        AppendBits(base + i * 64, chunk.bitmap[i], out);
+    } else {
+      for (uint16_t low : chunk.array)
+        out->push_back(base | low);
+    }
+  };
+
+  vector<uint64_t> tmp;  // Bitmap for uniting sparse with dense chunks
+  auto li = l.chunks_.begin(), ri = r.chunks_.begin();
+  while (li != l.chunks_.end() || ri != r.chunks_.end()) {
+    if (ri == r.chunks_.end() || (li != l.chunks_.end() && li->key < ri->key)) {
+      append_chunk(*li++);
+      continue;
+    }
+    if (li == l.chunks_.end() || ri->key < li->key) {
+      append_chunk(*ri++);
+      continue;
+    }
+
+    uint32_t base = uint32_t{li->key} << 16;
+    if (li->IsBitmap() && ri->IsBitmap()) {
+      CombineBitmaps(base, li->bitmap.data(), ri->bitmap.data(), kBitmapWords, bit_or{}, out);
+    } else if (li->IsBitmap() || ri->IsBitmap()) {
+      const Chunk& sparse = li->IsBitmap() ? *ri : *li;
+      const Chunk& dense = li->IsBitmap() ? *li : *ri;
+      tmp.assign(dense.bitmap.begin(), dense.bitmap.end());
+      for (uint16_t low : sparse.array)
+        tmp[low / 64] |= uint64_t{1} << (low % 64);
+      for (size_t i = 0; i < kBitmapWords; i++)
+        AppendBits(base + i * 64, tmp[i], out);
+    } else {
+      size_t start = out->size();
+      set_union(li->array.begin(), li->array.end(), ri->array.begin(), ri->array.end(),
+                back_inserter(*out));
+      for (size_t i = start; i < out->size(); i++)
+        (*out)[i] |= base;
+    }
+    ++li, ++ri;
+  }
+}
+
+RoaringSet::ChunkIt RoaringSet::LowerBound(uint16_t key) const {
+  return lower_bound(chunks_.begin(), chunks_.end(), key,
+                     [](const Chunk& chunk, uint16_t key) { return chunk.key < key; });
+}
+
+}  // namespace dfly::search
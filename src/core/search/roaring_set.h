@@ -0,0 +1,117 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+#include "core/search/base.h"
+
+namespace dfly::search {
+
+// A set of sorted unique integers in the layout of roaring bitmaps.
+// Values are grouped into chunks by their upper 16 bits. Sparse chunks keep a sorted array of the
+// lower bits, chunks with more than kMaxArraySize values switch to a bitmap of all 2^16 values.
+// Dense sets take a bit per value and are intersected and unified word by word.
+class RoaringSet {
+ public:
+  using IntType = DocId;
+
+  // Chunks switch to a bitmap above this size and back to an array at half of it
+  static constexpr size_t kMaxArraySize = 4096;
+
+  // Const access iterator that scans the arrays and bitmaps on traversal
+  struct ConstIterator {
+    friend class RoaringSet;
+
+    // To make it work with std container contructors
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = IntType;
+    using pointer = IntType*;
+    using reference = IntType&;
+
+    IntType operator*() const;
+    ConstIterator& operator++();
+
+    friend bool operator==(const ConstIterator& l, const ConstIterator& r) {
+      return l.chunk_ == r.chunk_ && l.pos_ == r.pos_;
+    }
+
+    friend bool operator!=(const ConstIterator& l, const ConstIterator& r) {
+      return !(l == r);
+    }
+
+   private:
+    ConstIterator(const RoaringSet* set, size_t chunk);
+
+    void SeekChunk();  // Position on first value of chunk_, if any
+
+    const RoaringSet* set_;
+    size_t chunk_;
+    uint32_t pos_ = 0;  // Index in array or bit in bitmap
+  };
+
+  using iterator = ConstIterator;
+
+  explicit RoaringSet(PMR_NS::memory_resource* mr);
+
+  ConstIterator begin() const;
+  ConstIterator end() const;
+
+  bool Insert(IntType value);
+  bool Remove(IntType value);
+  bool Contains(IntType value) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t ByteSize() const;
+
+  // Append values present in both sets to out
+  static void Intersect(const RoaringSet& l, const RoaringSet& r, std::vector<IntType>* out);
+
+  // Append values present in any of the sets to out
+  static void Unite(const RoaringSet& l, const RoaringSet& r, std::vector<IntType>* out);
+
+ private:
+  static constexpr size_t kBitmapWords = (1 << 16) / 64;
+
+  struct Chunk {
+    Chunk(uint16_t key, PMR_NS::memory_resource* mr) : key{key}, array{mr}, bitmap{mr} {
+    }
+
+    bool IsBitmap() const {
+      return !bitmap.empty();
+    }
+
+    bool Contains(uint16_t low) const;
+
+    void ToBitmap();
+    void ToArray();
+
+    uint16_t key;
+    uint32_t cardinality = 0;
+    PMR_NS::vector<uint16_t> array;   // Sorted lower bits of sparse chunks
+    PMR_NS::vector<uint64_t> bitmap;  // kBitmapWords words for dense chunks
+  };
+
+  using ChunkIt = PMR_NS::vector<Chunk>::const_iterator;
+
+  // Find first chunk with key not less than key
+  ChunkIt LowerBound(uint16_t key) const;
+
+  size_t size_ = 0;
+  PMR_NS::vector<Chunk> chunks_;
+};
+
+}  // namespace dfly::search
@@ -0,0 +1,101 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/roaring_set.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <set>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly::search {
+
+using namespace std;
+
+class RoaringSetTest : public ::testing::Test {
+ protected:
+};
+
+using IdVec = vector<uint32_t>;
+
+TEST_F(RoaringSetTest, InsertRemove) {
+  RoaringSet rs{PMR_NS::get_default_resource()};
+
+  IdVec values = {0, 7, 65'535, 65'536, 1'000'000, numeric_limits<uint32_t>::max()};
+  for (uint32_t value : values)
+    EXPECT_TRUE(rs.Insert(value));
+  EXPECT_FALSE(rs.Insert(7));
+
+  EXPECT_EQ(IdVec(rs.begin(), rs.end()), values);
+  EXPECT_EQ(rs.Size(), values.size());
+  EXPECT_TRUE(rs.Contains(65'536));
+  EXPECT_FALSE(rs.Contains(65'537));
+
+  EXPECT_TRUE(rs.Remove(65'535));
+  EXPECT_FALSE(rs.Remove(65'535));
+  values.erase(find(values.begin(), values.end(), 65'535));
+  EXPECT_EQ(IdVec(rs.begin(), rs.end()), values);
+
+  for (uint32_t value : values)
+    EXPECT_TRUE(rs.Remove(value));
+  EXPECT_EQ(rs.Size(), 0u);
+  EXPECT_TRUE(rs.begin() == rs.end());
+}
+
+// Dense chunks switch to bitmaps and back to arrays when values are removed
+TEST_F(RoaringSetTest, DenseChunks) {
+  RoaringSet rs{PMR_NS::get_default_resource()};
+  set<uint32_t> values;
+
+  mt19937 rng(7);
+  for (size_t i = 0; i < 50'000; i++) {
+    uint32_t value = rng() % 150'000;
+    EXPECT_EQ(rs.Insert(value), values.insert(value).second);
+  }
+
+  EXPECT_EQ(IdVec(rs.begin(), rs.end()), IdVec(values.begin(), values.end()));
+  EXPECT_LT(rs.ByteSize(), values.size() * sizeof(uint32_t));
+
+  for (uint32_t value = 0; value < 150'000; value += 2) {
+    EXPECT_EQ(rs.Remove(value), values.erase(value) > 0);
+    EXPECT_EQ(rs.Contains(value + 1), values.count(value + 1) > 0);
+  }
+
+  EXPECT_EQ(IdVec(rs.begin(), rs.end()), IdVec(values.begin(), values.end()));
+}
+
+TEST_F(RoaringSetTest, IntersectUnite) {
+  auto* mr = PMR_NS::get_default_resource();
+  mt19937 rng(11);
+
+  // Combine sparse and dense chunks in all variations
+  for (uint32_t l_range : {20'000u, 1'000'000u}) {
+    for (uint32_t r_range : {20'000u, 1'000'000u}) {
+      RoaringSet l{mr}, r{mr};
+      set<uint32_t> l_values, r_values;
+      for (size_t i = 0; i < 10'000; i++) {
+        l.Insert(*l_values.insert(rng() % l_range).first);
+        r.Insert(*r_values.insert(rng() % r_range).first);
+      }
+
+      IdVec expected, result;
+      set_intersection(l_values.begin(), l_values.end(), r_values.begin(), r_values.end(),
+                       back_inserter(expected));
+      RoaringSet::Intersect(l, r, &result);
+      EXPECT_EQ(result, expected);
+
+      expected.clear();
+      result.clear();
+      set_union(l_values.begin(), l_values.end(), r_values.begin(), r_values.end(),
+                back_inserter(expected));
+      RoaringSet::Unite(l, r, &result);
+      EXPECT_EQ(result, expected);
+    }
+  }
+}
+
+}  // namespace dfly::search
@@ -10,6 +10,7 @@
 #include <absl/strings/str_join.h>
 
 #include <chrono>
+#include <cmath>
 #include <type_traits>
 #include <variant>
 
@@ -29,6 +30,10 @@ namespace dfly::search {
 
 namespace {
 
+// Filtered KNN queries on an HNSW index with at most as many matched documents compute the exact
+// distances to them instead of searching the graph.
+constexpr size_t kKnnExactMaxDocs = 1024;
+
 AstExpr ParseQuery(std::string_view query, const QueryParams* params) {
   QueryDriver driver{};
   driver.ResetScanner();
@@ -48,8 +53,8 @@ AstExpr ParseQuery(std::string_view query, const QueryParams* params) {
 // Represents an either owned or non-owned result set that can be accessed transparently.
 struct IndexResult {
   using DocVec = vector<DocId>;
-  using BorrowedView =
-      variant<const DocVec*, const BlockList<CompressedSortedSet>*, const BlockList<SortedVector>*>;
+  using BorrowedView = variant<const DocVec*, const BlockList<CompressedSortedSet>*,
+                               const BlockList<SortedVector>*, const RoaringSet*>;
 
   IndexResult() : value_{DocVec{}} {
   }
@@ -110,7 +115,7 @@ struct IndexResult {
 
  private:
   variant<DocVec /*owned*/, const DocVec*, const BlockList<CompressedSortedSet>*,
-          const BlockList<SortedVector>*>
+          const BlockList<SortedVector>*, const RoaringSet*>
       value_;
 };
 
@@ -120,6 +125,8 @@ struct ProfileBuilder {
         [](monostate) -> string { return ""s; },
         [](const AstTermNode& n) { return absl::StrCat("Term{", n.term, "}"); },
         [](const AstPrefixNode& n) { return absl::StrCat("Prefix{", n.prefix, "}"); },
+        [](const AstSuffixNode& n) { return absl::StrCat("Suffix{", n.suffix, "}"); },
+        [](const AstInfixNode& n) { return absl::StrCat("Infix{", n.infix, "}"); },
         [](const AstRangeNode& n) { return absl::StrCat("Range{", n.lo, "<>", n.hi, "}"); },
         [](const AstLogicalNode& n) {
           auto op = n.op == AstLogicalNode::AND ? "and" : "or";
@@ -142,15 +149,25 @@ struct ProfileBuilder {
     return chrono::steady_clock::now();
   }
 
-  void Finish(Tp start, const AstNode& node, const IndexResult& result) {
+  // estimate is set for the children of intersections, which are evaluated in its order.
+  void Finish(Tp start, const AstNode& node, const IndexResult& result,
+              optional<size_t> estimate) {
     DCHECK_GE(depth_, 1u);
     auto took = chrono::steady_clock::now() - start;
     size_t micros = chrono::duration_cast<chrono::microseconds>(took).count();
     auto descr = GetNodeInfo(node);
+    if (estimate)
+      absl::StrAppend(&descr, " est=", *estimate);
     profile_.events.push_back({std::move(descr), micros, depth_ - 1, result.Size()});
     depth_--;
   }
 
+  // A child of an intersection that was not evaluated, because the intersection became empty.
+  void Skip(const AstNode& node, size_t estimate) {
+    auto descr = absl::StrCat(GetNodeInfo(node), " est=", estimate, " skipped");
+    profile_.events.push_back({std::move(descr), 0, depth_, 0});
+  }
+
   AlgorithmProfile Take() {
     reverse(profile_.events.begin(), profile_.events.end());
     return std::move(profile_);
@@ -172,6 +189,10 @@ struct BasicSearch {
     profile_builder_ = ProfileBuilder{};
   }
 
+  void EnableBm25Scoring() {
+    bm25_scoring_ = record_terms_ = true;
+  }
+
   // Get casted sub index by field
   template <typename T> T* GetIndex(string_view field) {
     static_assert(is_base_of_v<BaseIndex, T>);
@@ -216,14 +237,34 @@ struct BasicSearch {
 
     if (op == LogicOp::AND) {
       tmp_vec_.reserve(min(matched.Size(), current.Size()));
-      auto cb = [this](auto* s1, auto* s2) {
+      auto intersect = [this](auto* s1, auto* s2) {
         set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
       };
+      // Probe roaring sets with the elements of smaller sets instead of scanning them
+      auto probe = [this, intersect](const RoaringSet* rs, auto* set) {
+        if (set->size() >= rs->size())
+          return intersect(rs, set);
+        copy_if(set->begin(), set->end(), back_inserter(tmp_vec_),
+                [rs](DocId id) { return rs->Contains(id); });
+      };
+      Overloaded cb{
+          [this](const RoaringSet* s1, const RoaringSet* s2) {
+            RoaringSet::Intersect(*s1, *s2, &tmp_vec_);
+          },
+          [probe](const RoaringSet* s1, auto* s2) { probe(s1, s2); },
+          [probe](auto* s1, const RoaringSet* s2) { probe(s2, s1); },
+          intersect,
+      };
       visit(cb, matched.Borrowed(), current.Borrowed());
     } else {
       tmp_vec_.reserve(matched.Size() + current.Size());
-      auto cb = [this](auto* s1, auto* s2) {
-        set_union(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
+      Overloaded cb{
+          [this](const RoaringSet* s1, const RoaringSet* s2) {
+            RoaringSet::Unite(*s1, *s2, &tmp_vec_);
+          },
+          [this](auto* s1, auto* s2) {
+            set_union(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
+          },
       };
       visit(cb, matched.Borrowed(), current.Borrowed());
     }
@@ -257,21 +298,74 @@ struct BasicSearch {
     return {&indices_->GetAllDocs()};
   }
 
+  // Whether the words appear in the document at the same distances as in the phrase.
+  static bool MatchesPhrase(const TextIndex& index, const vector<pair<string, uint32_t>>& words,
+                            DocId doc) {
+    vector<vector<uint32_t>> positions;
+    for (const auto& [word, _] : words)
+      positions.push_back(index.Positions(word, doc));
+
+    for (uint32_t start : positions[0]) {
+      bool matches = true;
+      for (size_t i = 1; i < words.size() && matches; i++) {
+        uint32_t expected = start + words[i].second - words[0].second;
+        matches = binary_search(positions[i].begin(), positions[i].end(), expected);
+      }
+      if (matches)
+        return true;
+    }
+    return false;
+  }
+
+  // Match a single word or a quoted phrase of several words in a text index. Without positions,
+  // phrases match all documents that contain their words.
+  IndexResult SearchTerm(TextIndex* index, string_view term) {
+    auto words = index->TokenizeWithPositions(term);
+    if (words.size() <= 1) {
+      if (record_terms_)
+        scored_terms_.emplace_back(index, words.empty() ? string{term} : words[0].first);
+      return index->Matching(term);
+    }
+
+    vector<IndexResult> sub_results;
+    for (const auto& [word, _] : words) {
+      sub_results.emplace_back(index->Matching(word));
+      if (record_terms_)
+        scored_terms_.emplace_back(index, word);
+    }
+
+    IndexResult result = UnifyResults(std::move(sub_results), LogicOp::AND);
+    if (!index->HasPositions())
+      return result;
+
+    vector<DocId> out;
+    auto cb = [&](auto* set) {
+      for (DocId doc : *set) {
+        if (MatchesPhrase(*index, words, doc))
+          out.push_back(doc);
+      }
+    };
+    visit(cb, result.Borrowed());
+    return out;
+  }
+
   // "term": access field's text index or unify results from all text indices if no field is set
   IndexResult Search(const AstTermNode& node, string_view active_field) {
     if (!active_field.empty()) {
       if (auto* index = GetIndex<TextIndex>(active_field); index)
-        return index->Matching(node.term);
+        return SearchTerm(index, node.term);
       return IndexResult{};
     }
 
     vector<TextIndex*> selected_indices = indices_->GetAllTextIndices();
-    auto mapping = [&node](TextIndex* index) { return index->Matching(node.term); };
+    auto mapping = [&node, this](TextIndex* index) { return SearchTerm(index, node.term); };
 
     return UnifyResults(GetSubResults(selected_indices, mapping), LogicOp::OR);
   }
 
-  IndexResult Search(const AstPrefixNode& node, string_view active_field) {
+  // Unite the posting lists of all terms that match(index, term, cb) reports for the text indices
+  template <typename F>
+  IndexResult SearchMatchingTerms(string_view term, string_view active_field, F match) {
     vector<TextIndex*> indices;
     if (!active_field.empty()) {
       if (auto* index = GetIndex<TextIndex>(active_field); index)
@@ -282,9 +376,9 @@ struct BasicSearch {
       indices = indices_->GetAllTextIndices();
     }
 
-    auto mapping = [&node, this](TextIndex* index) {
+    auto mapping = [term, &match, this](TextIndex* index) {
       IndexResult result{};
-      index->MatchingPrefix(node.prefix, [&result, this](const auto* c) {
+      (index->*match)(term, [&result, this](const auto* c) {
         Merge(IndexResult{c}, &result, LogicOp::OR);
       });
       return result;
@@ -293,17 +387,33 @@ struct BasicSearch {
     return UnifyResults(GetSubResults(indices, mapping), LogicOp::OR);
   }
 
+  IndexResult Search(const AstPrefixNode& node, string_view active_field) {
+    return SearchMatchingTerms(node.prefix, active_field, &TextIndex::MatchingPrefix);
+  }
+
+  IndexResult Search(const AstSuffixNode& node, string_view active_field) {
+    return SearchMatchingTerms(node.suffix, active_field, &TextIndex::MatchingSuffix);
+  }
+
+  IndexResult Search(const AstInfixNode& node, string_view active_field) {
+    return SearchMatchingTerms(node.infix, active_field, &TextIndex::MatchingInfix);
+  }
+
   // [range]: access field's numeric index
   IndexResult Search(const AstRangeNode& node, string_view active_field) {
     DCHECK(!active_field.empty());
     if (auto* index = GetIndex<NumericIndex>(active_field); index)
-      return index->Range(node.lo, node.hi);
+      return visit([](auto range) { return IndexResult{std::move(range)}; },
+                   index->Range(node.lo, node.hi));
     return IndexResult{};
   }
 
   // negate -(*subquery*): explicitly compute result complement. Needs further optimizations
   IndexResult Search(const AstNegateNode& node, string_view active_field) {
+    // Negated terms don't contribute to scores
+    bool record_terms = exchange(record_terms_, false);
     vector<DocId> matched = SearchGeneric(*node.node, active_field).Take();
+    record_terms_ = record_terms;
     vector<DocId> all = indices_->GetAllDocs();
 
     // To negate a result, we have to find the complement of matched to all documents,
@@ -315,8 +425,101 @@ struct BasicSearch {
     return all;
   }
 
+  template <typename T> T* FindIndex(string_view field) const {
+    return dynamic_cast<T*>(indices_->GetIndex(field));
+  }
+
+  vector<TextIndex*> TextIndices(string_view active_field) const {
+    if (active_field.empty())
+      return indices_->GetAllTextIndices();
+    if (auto* index = FindIndex<TextIndex>(active_field); index)
+      return {index};
+    return {};
+  }
+
+  // Upper bound of the number of documents that match the node, taken from the sizes of the
+  // posting lists and of the numeric buckets without evaluating it. Nodes that can not be
+  // estimated cheaply match all documents. Invalid fields estimate 0, so that they are evaluated
+  // first and report their errors.
+  size_t EstimateSize(const AstNode& node, string_view active_field) const {
+    size_t all = indices_->GetAllDocs().size();
+    Overloaded cb{
+        [all](const auto&) { return all; },
+        [&](const AstTermNode& n) -> size_t {
+          size_t res = 0;
+          for (TextIndex* index : TextIndices(active_field)) {
+            size_t matched = all;  // a phrase matches at most the documents of its rarest word
+            for (const auto& [word, _] : index->TokenizeWithPositions(n.term)) {
+              auto* container = index->Matching(word);
+              matched = min(matched, container ? container->Size() : 0);
+            }
+            res += matched;
+          }
+          return min(res, all);
+        },
+        [&](const AstRangeNode& n) -> size_t {
+          auto* index = FindIndex<NumericIndex>(active_field);
+          return index ? index->EstimateRange(n.lo, n.hi) : 0;
+        },
+        [&](const AstTagsNode& n) -> size_t {
+          auto* index = FindIndex<TagIndex>(active_field);
+          if (!index)
+            return 0;
+          size_t res = 0;
+          for (const auto& tag : n.tags) {
+            auto* container = index->Matching(tag);
+            res += container ? container->Size() : 0;
+          }
+          return min(res, all);
+        },
+        [&](const AstFieldNode& n) { return EstimateSize(*n.node, n.field); },
+        [&](const AstLogicalNode& n) {
+          size_t res = n.op == LogicOp::AND ? all : 0;
+          for (const auto& child : n.nodes) {
+            size_t child_size = EstimateSize(child, active_field);
+            res = n.op == LogicOp::AND ? min(res, child_size) : res + child_size;
+          }
+          return min(res, all);
+        },
+    };
+    return visit(cb, node.Variant());
+  }
+
+  // Intersections are evaluated in the order of the estimated sizes of their nodes, so that the
+  // large posting lists are merged into small results, and the remaining nodes are not evaluated
+  // at all once the result is empty. Nodes estimated to match nothing are cheap to evaluate, so
+  // they are never skipped.
+  IndexResult SearchIntersection(const AstLogicalNode& node, string_view active_field) {
+    vector<pair<size_t, const AstNode*>> plan;
+    for (const auto& child : node.nodes)
+      plan.emplace_back(EstimateSize(child, active_field), &child);
+    stable_sort(plan.begin(), plan.end(),
+                [](const auto& l, const auto& r) { return l.first < r.first; });
+
+    IndexResult out{};
+    for (size_t i = 0; i < plan.size(); i++) {
+      auto [estimate, child] = plan[i];
+      if (i > 0 && out.Size() == 0 && estimate > 0) {
+        if (profile_builder_)
+          profile_builder_->Skip(*child, estimate);
+        continue;
+      }
+
+      next_estimate_ = estimate;
+      IndexResult matched = SearchGeneric(*child, active_field);
+      if (i == 0)
+        out = std::move(matched);
+      else
+        Merge(std::move(matched), &out, LogicOp::AND);
+    }
+    return out;
+  }
+
   // logical query: unify all sub results
   IndexResult Search(const AstLogicalNode& node, string_view active_field) {
+    if (node.op == LogicOp::AND && !node.nodes.empty())
+      return SearchIntersection(node, active_field);
+
     auto mapping = [&](auto& node) { return SearchGeneric(node, active_field); };
     return UnifyResults(GetSubResults(node.nodes, mapping), node.op);
   }
@@ -359,25 +562,35 @@ struct BasicSearch {
   }
 
   void SearchKnnFlat(FlatVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
-    knn_distances_.reserve(sub_results.Size());
+    vector<DocId> docs;
+    docs.reserve(sub_results.Size());
     auto cb = [&](auto* set) {
-      auto [dim, sim] = vec_index->Info();
-      for (DocId matched_doc : *set) {
-        float dist = VectorDistance(knn.vec.first.get(), vec_index->Get(matched_doc), dim, sim);
-        knn_distances_.emplace_back(dist, matched_doc);
-      }
+      for (DocId matched_doc : *set)
+        docs.push_back(matched_doc);
     };
     visit(cb, sub_results.Borrowed());
 
+    // Distances are computed in one batch, which selects the distance kernel once.
+    vector<float> distances(docs.size());
+    vec_index->Distances(knn.vec.first.get(), docs, distances.data());
+
+    knn_distances_.reserve(docs.size());
+    for (size_t i = 0; i < docs.size(); i++)
+      knn_distances_.emplace_back(distances[i], docs[i]);
+
     size_t prefix_size = min(knn.limit, knn_distances_.size());
     partial_sort(knn_distances_.begin(), knn_distances_.begin() + prefix_size,
                  knn_distances_.end());
     knn_distances_.resize(prefix_size);
   }
 
+  // A selective filter is applied before the search by computing the distances to the matched
+  // documents, a broad one while searching the graph.
   void SearchKnnHnsw(HnswVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
     if (indices_->GetAllDocs().size() == sub_results.Size())
       knn_distances_ = vec_index->Knn(knn.vec.first.get(), knn.limit, knn.ef_runtime);
+    else if (sub_results.Size() <= max(kKnnExactMaxDocs, knn.limit))
+      knn_distances_ = vec_index->KnnExact(knn.vec.first.get(), knn.limit, sub_results.Take());
     else
       knn_distances_ =
           vec_index->Knn(knn.vec.first.get(), knn.limit, knn.ef_runtime, sub_results.Take());
@@ -418,6 +631,7 @@ struct BasicSearch {
 
   // Determine node type and call specific search function
   IndexResult SearchGeneric(const AstNode& node, string_view active_field, bool top_level = false) {
+    optional<size_t> estimate = exchange(next_estimate_, nullopt);
     if (!error_.empty())
       return IndexResult{};
 
@@ -432,19 +646,21 @@ struct BasicSearch {
            visit([](auto* set) { return is_sorted(set->begin(), set->end()); }, result.Borrowed()));
 
     if (profile_builder_)
-      profile_builder_->Finish(start, node, result);
+      profile_builder_->Finish(start, node, result, estimate);
 
     return result;
   }
 
   SearchResult Search(const AstNode& query) {
     IndexResult result = SearchGeneric(query, "", true);
+    size_t total = result.Size();
+    if (bm25_scoring_)
+      result = RankBm25(std::move(result));
 
     // Extract profile if enabled
     optional<AlgorithmProfile> profile =
         profile_builder_ ? make_optional(profile_builder_->Take()) : nullopt;
 
-    size_t total = result.Size();
     return SearchResult{total,
                         max(total, preagg_total_),
                         result.Take(limit_),
@@ -453,12 +669,69 @@ struct BasicSearch {
                         std::move(error_)};
   }
 
+  // Rank the results by the sum of the BM25 scores of the query terms, keep the best limit_
+  IndexResult RankBm25(IndexResult result) {
+    constexpr double kK1 = 1.2, kB = 0.75;
+
+    vector<DocId> ids = result.Take();
+    sort(ids.begin(), ids.end());
+    vector<double> scores(ids.size());
+
+    double num_docs = indices_->GetAllDocs().size();
+    for (const auto& [index, word] : scored_terms_) {
+      const auto* postings = index->Matching(word);
+      if (!postings)
+        continue;
+
+      double freq = postings->Size();
+      double idf = log(1 + (num_docs - freq + 0.5) / (freq + 0.5));
+      double avg_length = index->AvgDocLength();
+
+      // Both are sorted, so the matched documents of the term are found in a single pass
+      auto it = ids.begin();
+      for (DocId doc : *postings) {
+        it = lower_bound(it, ids.end(), doc);
+        if (it == ids.end())
+          break;
+        if (*it != doc)
+          continue;
+
+        double tf = index->TermFrequency(word, doc);
+        double norm = avg_length > 0 ? 1 - kB + kB * index->DocLength(doc) / avg_length : 1;
+        scores[it - ids.begin()] += idf * tf * (kK1 + 1) / (tf + kK1 * norm);
+      }
+    }
+
+    vector<pair<double, DocId>> ranked(ids.size());
+    for (size_t i = 0; i < ids.size(); i++)
+      ranked[i] = {scores[i], ids[i]};
+
+    size_t prefix = min(limit_, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + prefix, ranked.end(),
+                 [](const auto& l, const auto& r) {
+                   return l.first > r.first || (l.first == r.first && l.second < r.second);
+                 });
+
+    ids.resize(prefix);
+    scores_.reserve(prefix);
+    for (size_t i = 0; i < prefix; i++) {
+      ids[i] = ranked[i].second;
+      scores_.emplace_back(ranked[i].first);
+    }
+    return ids;
+  }
+
   const FieldIndices* indices_;
   size_t limit_;
 
+  bool bm25_scoring_ = false;
+  bool record_terms_ = false;  // collect text terms for scoring
+  vector<pair<TextIndex*, string>> scored_terms_;
+
   size_t preagg_total_ = 0;
   string error_;
   optional<ProfileBuilder> profile_builder_ = ProfileBuilder{};
+  optional<size_t> next_estimate_;  // estimate of the intersection child evaluated next
 
   std::vector<ResultScore> scores_;
 
@@ -500,9 +773,12 @@ void FieldIndices::CreateIndices(PMR_NS::memory_resource* mr) {
       continue;
 
     switch (field_info.type) {
-      case SchemaField::TEXT:
-        indices_[field_ident] = make_unique<TextIndex>(mr, &options_.stopwords);
+      case SchemaField::TEXT: {
+        const auto* tparams = get_if<SchemaField::TextParams>(&field_info.special_params);
+        auto text_params = tparams ? *tparams : SchemaField::TextParams{};
+        indices_[field_ident] = make_unique<TextIndex>(mr, &options_.stopwords, text_params);
         break;
+      }
       case SchemaField::NUMERIC:
         indices_[field_ident] = make_unique<NumericIndex>(mr);
         break;
@@ -633,6 +909,9 @@ SearchResult SearchAlgorithm::Search(const FieldIndices* index, size_t limit) co
   auto bs = BasicSearch{index, limit};
   if (profiling_enabled_)
     bs.EnableProfiling();
+  if (bm25_scoring_ && !holds_alternative<AstKnnNode>(*query_) &&
+      !holds_alternative<AstSortNode>(*query_))
+    bs.EnableBm25Scoring();
   return bs.Search(*query_);
 }
 
@@ -650,6 +929,9 @@ optional<AggregationInfo> SearchAlgorithm::HasAggregation() const {
     return AggregationInfo{nullopt, alias, sort->descending};
   }
 
+  if (bm25_scoring_)
+    return AggregationInfo{nullopt, "", true};
+
   return nullopt;
 }
 
@@ -657,4 +939,15 @@ void SearchAlgorithm::EnableProfiling() {
   profiling_enabled_ = true;
 }
 
+void SearchAlgorithm::EnableBm25Scoring() {
+  bm25_scoring_ = true;
+}
+
+optional<string> SearchAlgorithm::CacheKey() const {
+  DCHECK(query_);
+  if (profiling_enabled_)
+    return nullopt;
+  return absl::StrCat(NormalizedQuery(*query_), bm25_scoring_ ? "+" : "-");
+}
+
 }  // namespace dfly::search
@@ -35,6 +35,7 @@ struct SchemaField {
     size_t capacity = 1000;                       // initial capacity
     size_t hnsw_ef_construction = 200;
     size_t hnsw_m = 16;
+    VectorStorage storage = VectorStorage::FLOAT32;
   };
 
   struct TagParams {
@@ -42,7 +43,15 @@ struct SchemaField {
     bool case_sensitive = false;
   };
 
-  using ParamsVariant = std::variant<std::monostate, VectorParams, TagParams>;
+  struct TextParams {
+    // Keep the positions of words and the lengths of documents, for phrase queries and BM25.
+    bool with_positions = false;
+
+    // Keep all suffixes of words, for suffix and infix queries without scanning all words.
+    bool with_suffix_trie = false;
+  };
+
+  using ParamsVariant = std::variant<std::monostate, VectorParams, TagParams, TextParams>;
 
   FieldType type;
   uint8_t flags;
@@ -155,8 +164,16 @@ class SearchAlgorithm {
 
   void EnableProfiling();
 
+  // Rank results of queries without KNN or SORTBY by the BM25 score of their text terms.
+  void EnableBm25Scoring();
+
+  // Canonical form of the query and its scoring, equal for searches with equal results.
+  // Empty if the results can't be cached because profiling is enabled.
+  std::optional<std::string> CacheKey() const;
+
  private:
   bool profiling_enabled_ = false;
+  bool bm25_scoring_ = false;
   std::unique_ptr<AstNode> query_;
 };
 
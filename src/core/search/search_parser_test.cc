@@ -183,6 +183,11 @@ TEST_F(SearchParserTest, Scanner) {
   NEXT_EQ(TOK_TERM, string, "pre");
   NEXT_TOK(TOK_STAR);
 
+  // Suffix and infix
+  SetInput("*fix *fix*");
+  NEXT_EQ(TOK_SUFFIX, string, "*fix");
+  NEXT_EQ(TOK_INFIX, string, "*fix*");
+
   SetInput("почтальон Печкин");
   NEXT_EQ(TOK_TERM, string, "почтальон");
   NEXT_EQ(TOK_TERM, string, "Печкин");
@@ -205,9 +210,8 @@ TEST_F(SearchParserTest, Parse) {
   EXPECT_EQ(1, Parse(" @foo:@bar "));
   EXPECT_EQ(1, Parse(" @foo: "));
 
-  // We don't support suffix/any other position for now
-  EXPECT_EQ(1, Parse("*pre"));
-  EXPECT_EQ(1, Parse("*pre*"));
+  EXPECT_EQ(0, Parse("*fix"));
+  EXPECT_EQ(0, Parse("*fix* @foo:*fix @foo:(pre* | *fix*)"));
 
   EXPECT_EQ(1, Parse("pre***"));
 }
@@ -8,6 +8,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/escaping.h>
 #include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -20,6 +21,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/search/base.h"
+#include "core/search/indices.h"
 #include "core/search/query_driver.h"
 #include "core/search/vector_utils.h"
 
@@ -291,6 +293,42 @@ TEST_F(SearchTest, CheckPrefix) {
 
 using Map = MockedDocument::Map;
 
+TEST_F(SearchTest, SuffixAndInfix) {
+  for (bool with_suffix_trie : {false, true}) {
+    auto schema = MakeSimpleSchema({{"title", SchemaField::TEXT}});
+    schema.fields["title"].special_params = SchemaField::TextParams{false, with_suffix_trie};
+    FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+    vector<string> titles = {"Sunflower", "wildflowers", "flow", "overflow errors", "Плов", "ОВ"};
+    for (DocId i = 0; i < titles.size(); i++) {
+      MockedDocument doc{Map{{"title", titles[i]}}};
+      indices.Add(i, &doc);
+    }
+
+    auto search = [&](string_view query) {
+      SearchAlgorithm algo{};
+      QueryParams params;
+      EXPECT_TRUE(algo.Init(query, &params)) << query;
+      return algo.Search(&indices).ids;
+    };
+
+    EXPECT_THAT(search("*flow"), testing::ElementsAre(2, 3));
+    EXPECT_THAT(search("*FLOWER"), testing::ElementsAre(0));
+    EXPECT_THAT(search("*flow*"), testing::ElementsAre(0, 1, 2, 3));
+    EXPECT_THAT(search("@title:*rs"), testing::ElementsAre(1, 3));
+    EXPECT_THAT(search("*ов"), testing::ElementsAre(4, 5));
+    EXPECT_THAT(search("*flow* -*flower*"), testing::ElementsAre(2, 3));
+    EXPECT_THAT(search("*o*"), testing::ElementsAre(0, 1, 2, 3));
+    EXPECT_THAT(search("*xyz*"), testing::ElementsAre());
+
+    // Removed words are no longer matched
+    MockedDocument removed{Map{{"title", titles[3]}}};
+    indices.Remove(3, &removed);
+    EXPECT_THAT(search("*flow"), testing::ElementsAre(2));
+    EXPECT_THAT(search("*rors*"), testing::ElementsAre());
+  }
+}
+
 TEST_F(SearchTest, MatchField) {
   PrepareSchema({{"f1", SchemaField::TEXT}, {"f2", SchemaField::TEXT}, {"f3", SchemaField::TEXT}});
   PrepareQuery("@f1:foo @f2:bar @f3:baz");
@@ -339,6 +377,98 @@ TEST_F(SearchTest, MatchDoubleRange) {
   }
 }
 
+// Enough values to split the numeric index into buckets, with ranges that cover whole buckets,
+// only parts of them or a single repeated value.
+TEST(NumericIndexTest, Buckets) {
+  NumericIndex index{PMR_NS::get_default_resource()};
+  vector<MockedDocument> docs;
+  for (size_t i = 0; i < 20'000; i++)
+    docs.emplace_back(i % 5 == 0 ? "42" : absl::StrCat(i));
+  for (size_t i = 0; i < docs.size(); i++)
+    index.Add(i, &docs[i], "field");
+  for (size_t i = 0; i < docs.size(); i += 3)
+    index.Remove(i, &docs[i], "field");
+
+  EXPECT_GT(index.NumBuckets(), 2u);
+
+  auto range = [&index](double l, double r) {
+    auto result = index.Range(l, r);
+    if (auto* ids = get_if<vector<DocId>>(&result))
+      return *ids;
+    auto* ids = get<const NumericIndex::Container*>(result);
+    return vector<DocId>(ids->begin(), ids->end());
+  };
+
+  auto expected = [&docs](double l, double r) {
+    vector<DocId> out;
+    for (size_t i = 0; i < docs.size(); i++) {
+      double value;
+      CHECK(absl::SimpleAtod(docs[i].GetStrings("field").front(), &value));
+      if (i % 3 != 0 && l <= value && value <= r)
+        out.push_back(i);
+    }
+    return out;
+  };
+
+  for (auto [l, r] : vector<pair<double, double>>{{0, 20'000},
+                                                  {42, 42},
+                                                  {-1, 41},
+                                                  {100, 17'500},
+                                                  {9'999.5, 10'000.5},
+                                                  {-INFINITY, INFINITY},
+                                                  {500, 100}}) {
+    EXPECT_EQ(range(l, r), expected(l, r)) << l << " " << r;
+    EXPECT_GE(index.EstimateRange(l, r), expected(l, r).size()) << l << " " << r;
+  }
+  EXPECT_LT(index.EstimateRange(42, 42), 10'000u);
+
+  // Removing the remaining documents merges all buckets into the first one
+  for (size_t i = 0; i < docs.size(); i++)
+    index.Remove(i, &docs[i], "field");
+  EXPECT_EQ(index.NumBuckets(), 1u);
+  EXPECT_TRUE(range(-INFINITY, INFINITY).empty());
+}
+
+// Intersections are evaluated from their most selective node and stop once they are empty.
+TEST_F(SearchTest, IntersectionPlan) {
+  auto schema = MakeSimpleSchema(
+      {{"title", SchemaField::TEXT}, {"kind", SchemaField::TAG}, {"price", SchemaField::NUMERIC}});
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+  for (size_t i = 0; i < 1000; i++) {
+    MockedDocument doc{Map{{"title", i == 7 ? "rare" : "common words"},
+                           {"kind", "common"},
+                           {"price", absl::StrCat(i)}}};
+    indices.Add(i, &doc);
+  }
+
+  auto descriptions = [](const SearchResult& result) {
+    vector<string> out;
+    for (const auto& event : result.profile->events)
+      out.push_back(event.descr);
+    return out;
+  };
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("@kind:{common} @price:[0 500] @title:rare", &params);
+  algo.EnableProfiling();
+  SearchResult result = algo.Search(&indices);
+  EXPECT_THAT(result.ids, testing::ElementsAre(7));
+  EXPECT_THAT(descriptions(result), testing::Contains(HasSubstr("Term{rare} est=1")));
+  EXPECT_THAT(descriptions(result), testing::Contains(HasSubstr("Tags{common} est=1000")));
+
+  algo.Init("@kind:{common} @price:[0 500] @title:missing", &params);
+  algo.EnableProfiling();
+  result = algo.Search(&indices);
+  EXPECT_TRUE(result.ids.empty());
+  EXPECT_THAT(descriptions(result), testing::Contains(HasSubstr("Tags{common} est=1000 skipped")));
+  EXPECT_THAT(descriptions(result), testing::Contains(HasSubstr("skipped")).Times(2));
+
+  // Errors of invalid fields are reported even if the intersection is empty.
+  algo.Init("@title:missing @cantfindme:[1 10]", &params);
+  EXPECT_THAT(algo.Search(&indices).error, HasSubstr("Invalid field"));
+}
+
 TEST_F(SearchTest, MatchStar) {
   PrepareQuery("*");
   ExpectAll("one", "two", "three", "and", "all", "documents");
@@ -437,6 +567,121 @@ std::string ToBytes(absl::Span<const float> vec) {
   return string{reinterpret_cast<const char*>(vec.data()), sizeof(float) * vec.size()};
 }
 
+TEST_F(SearchTest, PhraseAndBm25) {
+  for (bool with_positions : {false, true}) {
+    auto schema = MakeSimpleSchema({{"title", SchemaField::TEXT}});
+    schema.fields["title"].special_params = SchemaField::TextParams{with_positions};
+    FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+    vector<string> titles = {"red apple pie", "apple red", "red red red apple", "green pear",
+                             "the red big apple"};
+    for (DocId i = 0; i < titles.size(); i++) {
+      MockedDocument doc{Map{{"title", titles[i]}}};
+      indices.Add(i, &doc);
+    }
+
+    auto search = [&](string_view query, bool bm25) {
+      SearchAlgorithm algo{};
+      QueryParams params;
+      EXPECT_TRUE(algo.Init(query, &params)) << query;
+      if (bm25)
+        algo.EnableBm25Scoring();
+      return algo.Search(&indices);
+    };
+
+    // Without positions, phrases match all documents with their words
+    auto res = search("\"red apple\"", false);
+    sort(res.ids.begin(), res.ids.end());
+    if (with_positions)
+      EXPECT_THAT(res.ids, testing::ElementsAre(0, 2));
+    else
+      EXPECT_THAT(res.ids, testing::ElementsAre(0, 1, 2, 4));
+
+    if (!with_positions)
+      continue;
+
+    // Higher term frequencies and shorter documents rank first
+    res = search("red", true);
+    EXPECT_EQ(res.total, 4u);
+    EXPECT_THAT(res.ids, testing::ElementsAre(2, 1, 0, 4));
+    ASSERT_EQ(res.scores.size(), 4u);
+    EXPECT_TRUE(is_sorted(res.scores.rbegin(), res.scores.rend()));
+
+    res = search("red -pie", true);
+    EXPECT_THAT(res.ids, testing::ElementsAre(2, 1, 4));
+
+    MockedDocument removed{Map{{"title", titles[2]}}};
+    indices.Remove(2, &removed);
+    res = search("\"red apple\"", true);
+    EXPECT_THAT(res.ids, testing::ElementsAre(0));
+  }
+}
+
+TEST_F(SearchTest, CacheKey) {
+  QueryParams params;
+  params["lo"] = "1";
+
+  auto key = [&params](string_view query) {
+    SearchAlgorithm algo{};
+    EXPECT_TRUE(algo.Init(query, &params)) << query;
+    return *algo.CacheKey();
+  };
+
+  // Operands of logical nodes and tags are unordered
+  EXPECT_EQ(key("a b c"), key("c a b"));
+  EXPECT_EQ(key("@f:{x | y} | @n:[1 2]"), key("@n:[1 2] | @f:{y | x}"));
+  EXPECT_EQ(key("@n:[$lo 2]"), key("@n:[1 2]"));
+
+  EXPECT_NE(key("a b"), key("a | b"));
+  EXPECT_NE(key("@f:{x}"), key("@g:{x}"));
+  EXPECT_NE(key("@n:[1 2]"), key("@n:[(1 2]"));
+  EXPECT_NE(key("-a b"), key("a -b"));
+  EXPECT_NE(key("ab"), key("\"a b\""));
+
+  SearchAlgorithm algo{};
+  algo.Init("a", &params);
+  string plain_key = *algo.CacheKey();
+  algo.EnableBm25Scoring();
+  EXPECT_NE(*algo.CacheKey(), plain_key);
+  algo.EnableProfiling();
+  EXPECT_FALSE(algo.CacheKey());
+}
+
+// Large result sets are sorted by walking the sort index, small ones with a partial sort
+TEST_F(SearchTest, SortTopK) {
+  auto schema = MakeSimpleSchema({{"num", SchemaField::NUMERIC}, {"tag", SchemaField::TAG}});
+  schema.fields["num"].flags = SchemaField::SORTABLE;
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+  // Values are unique, so the order is well defined
+  const size_t kNumDocs = 10'000;
+  auto value = [](DocId id) { return (id * 7) % kNumDocs; };
+  for (DocId i = 0; i < kNumDocs; i++) {
+    MockedDocument doc{Map{{"num", to_string(value(i))}, {"tag", to_string(i % 1000)}}};
+    indices.Add(i, &doc);
+  }
+
+  for (string_view query : {"*", "@tag:{1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9 | 10}", "@tag:{7}"}) {
+    SearchAlgorithm unsorted{};
+    QueryParams params;
+    ASSERT_TRUE(unsorted.Init(query, &params));
+    auto expected = unsorted.Search(&indices).ids;
+
+    for (bool desc : {false, true}) {
+      SortOption sort_option{"num", desc};
+      SearchAlgorithm algo{};
+      ASSERT_TRUE(algo.Init(query, &params, &sort_option));
+      auto result = algo.Search(&indices, 5);
+      EXPECT_EQ(result.total, expected.size());
+
+      sort(expected.begin(), expected.end(), [&](DocId l, DocId r) {
+        return desc ? value(l) > value(r) : value(l) < value(r);
+      });
+      EXPECT_EQ(result.ids, vector<DocId>(expected.begin(), expected.begin() + 5)) << query;
+    }
+  }
+}
+
 TEST_F(SearchTest, Errors) {
   auto schema = MakeSimpleSchema(
       {{"score", SchemaField::NUMERIC}, {"even", SchemaField::TAG}, {"pos", SchemaField::VECTOR}});
@@ -686,6 +931,95 @@ TEST_P(KnnTest, AutoResize) {
   EXPECT_EQ(indices.GetAllDocs().size(), 100);
 }
 
+TEST_P(KnnTest, QuantizedStorage) {
+  const size_t kDims = 32, kNumDocs = 500, kK = 10;
+
+  mt19937 rng(7);
+  normal_distribution<float> dist;
+  auto random_vec = [&] {
+    vector<float> res(kDims);
+    for (float& v : res)
+      v = dist(rng);
+    return res;
+  };
+
+  vector<vector<float>> vecs(kNumDocs);
+  for (auto& vec : vecs)
+    vec = random_vec();
+  vector<float> query = random_vec();
+
+  // The exact neighbours of the query
+  vector<pair<float, DocId>> exact;
+  for (DocId i = 0; i < kNumDocs; i++)
+    exact.emplace_back(VectorDistance(query.data(), vecs[i].data(), kDims, VectorSimilarity::L2),
+                       i);
+  sort(exact.begin(), exact.end());
+
+  for (auto storage : {VectorStorage::FLOAT16, VectorStorage::INT8}) {
+    auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+    SchemaField::VectorParams vparams{GetParam(), kDims, VectorSimilarity::L2};
+    vparams.storage = storage;
+    schema.fields["pos"].special_params = vparams;
+    FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+    for (DocId i = 0; i < kNumDocs; i++) {
+      MockedDocument doc{Map{{"pos", ToBytes(vecs[i])}}};
+      indices.Add(i, &doc);
+    }
+
+    SearchAlgorithm algo{};
+    QueryParams params;
+    params["vec"] = ToBytes(query);
+    algo.Init(absl::StrCat("* =>[KNN ", kK, " @pos $vec EF_RUNTIME 100]"), &params);
+    auto ids = algo.Search(&indices).ids;
+    ASSERT_EQ(ids.size(), kK);
+
+    size_t found = 0;
+    for (size_t i = 0; i < kK; i++)
+      found += find(ids.begin(), ids.end(), exact[i].second) != ids.end();
+    EXPECT_GE(found, kK - 2) << int(storage);
+  }
+}
+
+// The distance kernels handle the elements that do not fill a register separately, so
+// dimensions around the register widths are checked against a plain loop.
+TEST(VectorDistanceTest, Kernels) {
+  mt19937 rng(3);
+  normal_distribution<float> dist;
+  for (size_t dims : {1, 3, 7, 8, 9, 15, 16, 17, 33, 100, 768}) {
+    vector<float> u(dims), v(dims);
+    for (size_t i = 0; i < dims; i++) {
+      u[i] = dist(rng);
+      v[i] = dist(rng);
+    }
+
+    double l2 = 0, uv = 0, uu = 0, vv = 0;
+    for (size_t i = 0; i < dims; i++) {
+      l2 += (u[i] - v[i]) * (u[i] - v[i]);
+      uv += u[i] * v[i];
+      uu += u[i] * u[i];
+      vv += v[i] * v[i];
+    }
+    EXPECT_NEAR(VectorDistance(u.data(), v.data(), dims, VectorSimilarity::L2), sqrt(l2), 1e-3);
+    EXPECT_NEAR(VectorDistance(u.data(), v.data(), dims, VectorSimilarity::COSINE),
+                1 - uv / sqrt(uu * vv), 1e-4);
+
+    // The batched distances are the same as the single ones, also for unaligned vectors.
+    for (auto storage : {VectorStorage::FLOAT32, VectorStorage::FLOAT16, VectorStorage::INT8}) {
+      vector<char> encoded(VectorStorageSize(dims, storage) + 1);
+      EncodeVector(v.data(), dims, storage, encoded.data() + 1);
+      const char* entries[] = {encoded.data() + 1, encoded.data() + 1};
+
+      for (auto sim : {VectorSimilarity::L2, VectorSimilarity::COSINE}) {
+        float out[2];
+        VectorDistances(u.data(), entries, dims, sim, storage, out);
+        EXPECT_FLOAT_EQ(out[0], VectorDistance(u.data(), entries[0], dims, sim, storage));
+        EXPECT_FLOAT_EQ(out[0], out[1]);
+      }
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(KnnFlat, KnnTest, testing::Values(false));
 INSTANTIATE_TEST_SUITE_P(KnnHnsw, KnnTest, testing::Values(true));
 
@@ -725,6 +1059,96 @@ static void BM_VectorSearch(benchmark::State& state) {
 
 BENCHMARK(BM_VectorSearch)->Args({120, 10'000});
 
+// Queries per second of KNN 10 over random vectors and the recall of the results against the
+// exact neighbours, for the storage types and the flat and hnsw indices.
+static void BM_VectorSearchRecall(benchmark::State& state) {
+  const size_t kDims = 128, kNumDocs = 10'000, kNumQueries = 100, kK = 10;
+  auto storage = static_cast<VectorStorage>(state.range(0));
+  bool use_hnsw = state.range(1);
+
+  mt19937 rng(1);
+  normal_distribution<float> dist;
+  auto random_vec = [&] {
+    vector<float> res(kDims);
+    for (float& v : res)
+      v = dist(rng);
+    return res;
+  };
+
+  auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+  SchemaField::VectorParams vparams{use_hnsw, kDims, VectorSimilarity::L2};
+  vparams.storage = storage;
+  schema.fields["pos"].special_params = vparams;
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+  vector<vector<float>> vecs(kNumDocs);
+  for (DocId i = 0; i < kNumDocs; i++) {
+    vecs[i] = random_vec();
+    MockedDocument doc{Map{{"pos", ToBytes(vecs[i])}}};
+    indices.Add(i, &doc);
+  }
+
+  vector<SearchAlgorithm> queries(kNumQueries);
+  vector<QueryParams> params(kNumQueries);
+  vector<vector<DocId>> exact(kNumQueries);
+  for (size_t q = 0; q < kNumQueries; q++) {
+    vector<float> query = random_vec();
+    params[q]["vec"] = ToBytes(query);
+    queries[q].Init(absl::StrCat("* =>[KNN ", kK, " @pos $vec EF_RUNTIME 64]"), &params[q]);
+
+    vector<pair<float, DocId>> distances;
+    for (DocId i = 0; i < kNumDocs; i++)
+      distances.emplace_back(
+          VectorDistance(query.data(), vecs[i].data(), kDims, VectorSimilarity::L2), i);
+    partial_sort(distances.begin(), distances.begin() + kK, distances.end());
+    for (size_t i = 0; i < kK; i++)
+      exact[q].push_back(distances[i].second);
+  }
+
+  size_t found = 0, total = 0;
+  while (state.KeepRunningBatch(kNumQueries)) {
+    for (size_t q = 0; q < kNumQueries; q++) {
+      auto ids = queries[q].Search(&indices).ids;
+      for (DocId id : ids)
+        found += find(exact[q].begin(), exact[q].end(), id) != exact[q].end();
+      total += kK;
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["recall"] = double(found) / total;
+}
+
+BENCHMARK(BM_VectorSearchRecall)
+    ->ArgNames({"storage", "hnsw"})
+    ->ArgsProduct({{0, 1, 2}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Intersections of low cardinality tags that each match a large share of the documents
+static void BM_SearchTags(benchmark::State& state) {
+  const size_t kNumDocs = state.range(0);
+
+  auto schema = MakeSimpleSchema({{"status", SchemaField::TAG}, {"country", SchemaField::TAG}});
+  FieldIndices indices{schema, kEmptyOptions, PMR_NS::get_default_resource()};
+
+  mt19937 rng(1);
+  for (size_t i = 0; i < kNumDocs; i++) {
+    MockedDocument doc{Map{{"status", absl::StrCat("s", rng() % 2)},
+                           {"country", absl::StrCat("c", rng() % 4)}}};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("@status:{s0} @country:{c1 | c2}", &params);
+
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(algo.Search(&indices));
+  state.SetItemsProcessed(state.iterations() * kNumDocs);
+}
+
+BENCHMARK(BM_SearchTags)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMicrosecond);
+
 }  // namespace search
 
 }  // namespace dfly
@@ -6,20 +6,35 @@
 
 #include <absl/container/flat_hash_set.h>
 #include <absl/strings/ascii.h>
-#include <absl/strings/numbers.h>
 #include <absl/strings/str_split.h>
 
 #include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <type_traits>
 
 namespace dfly::search {
 
 using namespace std;
 
-namespace {}  // namespace
+namespace {
+
+// Walking all documents in order until limit of them match visits about limit * total / matched
+// documents with a binary search each, a partial sort takes about matched * log(limit) steps.
+bool PreferOrderedWalk(size_t matched, size_t limit, size_t total) {
+  if (limit >= matched)
+    return false;
+
+  double walk_cost = double(limit) * total / matched * log2(matched);
+  double sort_cost = matched * log2(limit + 1);
+  return walk_cost < sort_cost;
+}
+
+}  // namespace
 
 template <typename T>
-SimpleValueSortIndex<T>::SimpleValueSortIndex(PMR_NS::memory_resource* mr) : values_{mr} {
+SimpleValueSortIndex<T>::SimpleValueSortIndex(PMR_NS::memory_resource* mr)
+    : values_{mr}, ordered_{IdLess{&values_}, mr} {
 }
 
 template <typename T> SortableValue SimpleValueSortIndex<T>::Lookup(DocId doc) const {
@@ -34,10 +49,14 @@ template <typename T> SortableValue SimpleValueSortIndex<T>::Lookup(DocId doc) c
 template <typename T>
 std::vector<ResultScore> SimpleValueSortIndex<T>::Sort(std::vector<DocId>* ids, size_t limit,
                                                        bool desc) const {
-  auto cb = [this, desc](const auto& lhs, const auto& rhs) {
-    return desc ? (values_[lhs] > values_[rhs]) : (values_[lhs] < values_[rhs]);
-  };
-  std::partial_sort(ids->begin(), ids->begin() + std::min(ids->size(), limit), ids->end(), cb);
+  if (PreferOrderedWalk(ids->size(), limit, ordered_.size())) {
+    WalkOrdered(ids, limit, desc);
+  } else {
+    auto cb = [this, desc](const auto& lhs, const auto& rhs) {
+      return desc ? (values_[lhs] > values_[rhs]) : (values_[lhs] < values_[rhs]);
+    };
+    std::partial_sort(ids->begin(), ids->begin() + std::min(ids->size(), limit), ids->end(), cb);
+  }
 
   vector<ResultScore> out(min(ids->size(), limit));
   for (size_t i = 0; i < out.size(); i++)
@@ -45,17 +64,49 @@ std::vector<ResultScore> SimpleValueSortIndex<T>::Sort(std::vector<DocId>* ids,
   return out;
 }
 
+template <typename T>
+void SimpleValueSortIndex<T>::WalkOrdered(std::vector<DocId>* ids, size_t limit,
+                                          bool desc) const {
+  DCHECK(is_sorted(ids->begin(), ids->end()));
+
+  vector<DocId> best;
+  best.reserve(limit);
+  auto walk = [ids, limit, &best](auto it, auto end) {
+    for (; it != end && best.size() < limit; ++it) {
+      if (binary_search(ids->begin(), ids->end(), *it))
+        best.push_back(*it);
+    }
+  };
+
+  if (desc)
+    walk(ordered_.rbegin(), ordered_.rend());
+  else
+    walk(ordered_.begin(), ordered_.end());
+
+  // Keep all other ids after the best ones, they are still counted as matches
+  vector<DocId> best_sorted = best;
+  sort(best_sorted.begin(), best_sorted.end());
+  set_difference(ids->begin(), ids->end(), best_sorted.begin(), best_sorted.end(),
+                 back_inserter(best));
+  *ids = std::move(best);
+}
+
 template <typename T>
 void SimpleValueSortIndex<T>::Add(DocId id, DocumentAccessor* doc, std::string_view field) {
   DCHECK_LE(id, values_.size());  // Doc ids grow at most by one
   if (id >= values_.size())
     values_.resize(id + 1);
+  else
+    ordered_.erase(id);  // Position depends on the old value
+
   values_[id] = Get(id, doc, field);
+  ordered_.insert(id);
 }
 
 template <typename T>
 void SimpleValueSortIndex<T>::Remove(DocId id, DocumentAccessor* doc, std::string_view field) {
   DCHECK_LT(id, values_.size());
+  ordered_.erase(id);
   values_[id] = T{};
 }
 
@@ -67,14 +118,8 @@ template struct SimpleValueSortIndex<double>;
 template struct SimpleValueSortIndex<PMR_NS::string>;
 
 double NumericSortIndex::Get(DocId id, DocumentAccessor* doc, std::string_view field) {
-  auto str = doc->GetStrings(field);
-  if (str.empty())
-    return 0;
-
-  double v;
-  if (!absl::SimpleAtod(str.front(), &v))
-    return 0;
-  return v;
+  auto nums = doc->GetNumbers(field);
+  return nums.empty() ? 0 : nums.front();
 }
 
 PMR_NS::string StringSortIndex::Get(DocId id, DocumentAccessor* doc, std::string_view field) {
@@ -9,6 +9,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <vector>
 
 #include "base/logging.h"
@@ -18,10 +19,15 @@
 
 namespace dfly::search {
 
+// Stores the values of all documents by id and keeps the ids ordered by value, so that the first
+// results of a large result set can be found without sorting it.
 template <typename T> struct SimpleValueSortIndex : BaseSortIndex {
   SimpleValueSortIndex(PMR_NS::memory_resource* mr);
 
   SortableValue Lookup(DocId doc) const override;
+
+  // Move the best limit ids to the front in order. Ids must be sorted. Walks the ordered ids
+  // until enough of them are found when that is cheaper than a partial sort.
   std::vector<ResultScore> Sort(std::vector<DocId>* ids, size_t limit, bool desc) const override;
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
@@ -33,7 +39,20 @@ template <typename T> struct SimpleValueSortIndex : BaseSortIndex {
   PMR_NS::memory_resource* GetMemRes() const;
 
  private:
+  // Orders ids by their values, ties by id
+  struct IdLess {
+    bool operator()(DocId l, DocId r) const {
+      return std::tie((*values)[l], l) < std::tie((*values)[r], r);
+    }
+
+    const PMR_NS::vector<T>* values;
+  };
+
+  // Select the best ids by walking all ids in order and keeping those present in ids
+  void WalkOrdered(std::vector<DocId>* ids, size_t limit, bool desc) const;
+
   PMR_NS::vector<T> values_;
+  absl::btree_set<DocId, IdLess, PMR_NS::polymorphic_allocator<DocId>> ordered_;
 };
 
 struct NumericSortIndex : public SimpleValueSortIndex<double> {
@@ -4,8 +4,19 @@
 
 #include "core/search/vector_utils.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
+#include <type_traits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DFLY_VECTOR_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define DFLY_VECTOR_NEON 1
+#endif
 
 #include "base/logging.h"
 
@@ -15,30 +26,515 @@ using namespace std;
 
 namespace {
 
-// Euclidean vector distance: sqrt( sum: (u[i] - v[i])^2  )
-__attribute__((optimize("fast-math"))) float L2Distance(const float* u, const float* v,
-                                                        size_t dims) {
+uint16_t FloatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t exp = (x >> 23) & 0xff;
+  uint32_t mant = x & 0x7fffff;
+
+  if (exp == 0xff)  // inf or nan
+    return sign | 0x7c00 | (mant ? 0x200 : 0);
+
+  int e = int(exp) - 127 + 15;
+  if (e >= 0x1f)  // overflows to inf
+    return sign | 0x7c00;
+
+  if (e <= 0) {  // subnormal half
+    if (e < -10)
+      return sign;
+    mant |= 0x800000;
+    unsigned shift = 14 - e;
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (half & 1)))
+      ++half;
+    return sign | half;
+  }
+
+  // Rounds to nearest even, a carry out of the mantissa increments the exponent.
+  uint32_t half = sign | (uint32_t(e) << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+    ++half;
+  return half;
+}
+
+float HalfToFloat(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+
+  float f;
+  if (exp == 0) {  // zero or subnormal, mant * 2^-24
+    f = mant * (1.0f / 16777216.0f);
+    return sign ? -f : f;
+  }
+
+  uint32_t x = sign | (mant << 13) | (exp == 0x1f ? 0x7f800000 : (exp + 112) << 23);
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// Views of encoded vectors that decode their elements. The data of encoded vectors is not
+// aligned, so it is read with memcpy.
+struct Float32View {
+  Float32View(const char* data, size_t dims) : data{data} {
+  }
+
+  float operator[](size_t i) const {
+    float res;
+    memcpy(&res, data + i * sizeof(float), sizeof(float));
+    return res;
+  }
+
+  const char* data;
+};
+
+struct Float16View {
+  Float16View(const char* data, size_t dims) : data{data} {
+  }
+
+  float operator[](size_t i) const {
+    uint16_t h;
+    memcpy(&h, data + i * sizeof(h), sizeof(h));
+    return HalfToFloat(h);
+  }
+
+  const char* data;
+};
+
+struct Int8View {
+  Int8View(const char* data, size_t dims) : data{reinterpret_cast<const int8_t*>(data)} {
+    memcpy(&scale, data + dims, sizeof(scale));
+  }
+
+  float operator[](size_t i) const {
+    return scale * data[i];
+  }
+
+  const int8_t* data;
+  float scale;
+};
+
+struct DotSums {
+  float uv = 0, uu = 0, vv = 0;
+};
+
+template <typename U, typename V>
+__attribute__((optimize("fast-math"))) float L2Sqr(const U& u, const V& v, size_t dims) {
   float sum = 0;
   for (size_t i = 0; i < dims; i++)
     sum += (u[i] - v[i]) * (u[i] - v[i]);
-  return sqrt(sum);
+  return sum;
+}
+
+template <typename U, typename V>
+__attribute__((optimize("fast-math"))) DotSums Dot(const U& u, const V& v, size_t dims) {
+  DotSums res;
+  for (size_t i = 0; i < dims; i++) {
+    res.uv += u[i] * v[i];
+    res.uu += u[i] * u[i];
+    res.vv += v[i] * v[i];
+  }
+  return res;
+}
+
+// Int8 vectors are multiplied in integers and scaled once.
+DotSums Dot(const Int8View& u, const Int8View& v, size_t dims) {
+  int32_t uv = 0, uu = 0, vv = 0;
+  for (size_t i = 0; i < dims; i++) {
+    uv += int32_t(u.data[i]) * v.data[i];
+    uu += int32_t(u.data[i]) * u.data[i];
+    vv += int32_t(v.data[i]) * v.data[i];
+  }
+  return {u.scale * v.scale * uv, u.scale * u.scale * uu, v.scale * v.scale * vv};
+}
+
+float L2Sqr(const Int8View& u, const Int8View& v, size_t dims) {
+  DotSums sums = Dot(u, v, dims);
+  return max(sums.uu + sums.vv - 2 * sums.uv, 0.0f);
 }
 
-// TODO: Normalize vectors ahead if cosine distance is used
-__attribute__((optimize("fast-math"))) float CosineDistance(const float* u, const float* v,
-                                                            size_t dims) {
-  float sum_uv = 0, sum_uu = 0, sum_vv = 0;
+// Query vectors are kept in full precision, the int8 elements are scaled once.
+DotSums Dot(const float* u, const Int8View& v, size_t dims) {
+  DotSums res;
+  int32_t vv = 0;
   for (size_t i = 0; i < dims; i++) {
-    sum_uv += u[i] * v[i];
-    sum_uu += u[i] * u[i];
-    sum_vv += v[i] * v[i];
+    res.uv += u[i] * v.data[i];
+    res.uu += u[i] * u[i];
+    vv += int32_t(v.data[i]) * v.data[i];
   }
+  res.uv *= v.scale;
+  res.vv = v.scale * v.scale * vv;
+  return res;
+}
 
-  if (float denom = sum_uu * sum_vv; denom != 0.0f)
-    return 1 - sum_uv / sqrt(denom);
+float CosineDistance(const DotSums& sums) {
+  if (float denom = sums.uu * sums.vv; denom != 0.0f)
+    return 1 - sums.uv / sqrt(denom);
   return 0.0f;
 }
 
+// Portable kernels of a full precision vector u and a vector v encoded with View.
+template <typename View> float L2SqrPortable(const float* u, const char* v, size_t dims) {
+  return L2Sqr(u, View{v, dims}, dims);
+}
+
+template <typename View> DotSums DotPortable(const float* u, const char* v, size_t dims) {
+  return Dot(u, View{v, dims}, dims);
+}
+
+// Portable kernels of two vectors encoded with View.
+template <typename View> float EncodedL2SqrPortable(const char* u, const char* v, size_t dims) {
+  return L2Sqr(View{u, dims}, View{v, dims}, dims);
+}
+
+template <typename View> float EncodedDotPortable(const char* u, const char* v, size_t dims) {
+  return Dot(View{u, dims}, View{v, dims}, dims).uv;
+}
+
+#ifdef DFLY_VECTOR_X86
+
+__attribute__((target("avx2,fma"))) float HSum(__m256 v) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma"))) int32_t HSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// Load 8 elements starting at element i of an encoded vector, int8 elements are not scaled.
+__attribute__((target("avx2,fma"))) __m256 LoadFloat32(const char* v, size_t i) {
+  return _mm256_loadu_ps(reinterpret_cast<const float*>(v) + i);
+}
+
+__attribute__((target("avx2,fma,f16c"))) __m256 LoadFloat16(const char* v, size_t i) {
+  return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i * 2)));
+}
+
+__attribute__((target("avx2,fma"))) __m256 LoadInt8(const char* v, size_t i) {
+  __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + i));
+  return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+}
+
+template <typename View> float ScaleOf(const View& view) {
+  if constexpr (is_same_v<View, Int8View>)
+    return view.scale;
+  return 1.0f;
+}
+
+// Kernels of a full precision vector and an encoded one, the elements of v are scaled by the
+// int8 scale, which is 1 for the float storages, after the loop.
+template <typename View, __m256 (*Load)(const char*, size_t)>
+__attribute__((target("avx2,fma,f16c"))) float L2SqrAvx2(const float* u, const char* v,
+                                                         size_t dims) {
+  View view{v, dims};
+  __m256 scale = _mm256_set1_ps(ScaleOf(view));
+  __m256 acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 d = _mm256_fnmadd_ps(scale, Load(v, i), _mm256_loadu_ps(u + i));
+    acc = _mm256_fmadd_ps(d, d, acc);
+  }
+
+  float sum = HSum(acc);
+  for (; i < dims; i++)
+    sum += (u[i] - view[i]) * (u[i] - view[i]);
+  return sum;
+}
+
+template <typename View, __m256 (*Load)(const char*, size_t)>
+__attribute__((target("avx2,fma,f16c"))) DotSums DotAvx2(const float* u, const char* v,
+                                                         size_t dims) {
+  View view{v, dims};
+  __m256 uv = _mm256_setzero_ps(), uu = _mm256_setzero_ps(), vv = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 a = _mm256_loadu_ps(u + i), b = Load(v, i);
+    uv = _mm256_fmadd_ps(a, b, uv);
+    uu = _mm256_fmadd_ps(a, a, uu);
+    vv = _mm256_fmadd_ps(b, b, vv);
+  }
+
+  float scale = ScaleOf(view);
+  DotSums res{HSum(uv) * scale, HSum(uu), HSum(vv) * scale * scale};
+  for (; i < dims; i++) {
+    res.uv += u[i] * view[i];
+    res.uu += u[i] * u[i];
+    res.vv += view[i] * view[i];
+  }
+  return res;
+}
+
+__attribute__((target("avx2,fma,f16c"))) DotSums Float16DotAvx2(const char* u, const char* v,
+                                                                size_t dims) {
+  __m256 uv = _mm256_setzero_ps(), uu = _mm256_setzero_ps(), vv = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 a = LoadFloat16(u, i), b = LoadFloat16(v, i);
+    uv = _mm256_fmadd_ps(a, b, uv);
+    uu = _mm256_fmadd_ps(a, a, uu);
+    vv = _mm256_fmadd_ps(b, b, vv);
+  }
+
+  Float16View uview{u, dims}, vview{v, dims};
+  DotSums res{HSum(uv), HSum(uu), HSum(vv)};
+  for (; i < dims; i++) {
+    res.uv += uview[i] * vview[i];
+    res.uu += uview[i] * uview[i];
+    res.vv += vview[i] * vview[i];
+  }
+  return res;
+}
+
+__attribute__((target("avx2,fma,f16c"))) float Float16L2SqrAvx2(const char* u, const char* v,
+                                                                size_t dims) {
+  __m256 acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 d = _mm256_sub_ps(LoadFloat16(u, i), LoadFloat16(v, i));
+    acc = _mm256_fmadd_ps(d, d, acc);
+  }
+
+  Float16View uview{u, dims}, vview{v, dims};
+  float sum = HSum(acc);
+  for (; i < dims; i++)
+    sum += (uview[i] - vview[i]) * (uview[i] - vview[i]);
+  return sum;
+}
+
+__attribute__((target("avx2,fma,f16c"))) float Float16DotUvAvx2(const char* u, const char* v,
+                                                                size_t dims) {
+  return Float16DotAvx2(u, v, dims).uv;
+}
+
+// Multiplies 16 int8 pairs at a time in 16 bit lanes, pairs of products are summed into 32 bits.
+__attribute__((target("avx2,fma"))) DotSums Int8DotAvx2(const char* u, const char* v,
+                                                        size_t dims) {
+  __m256i uv = _mm256_setzero_si256(), uu = _mm256_setzero_si256(), vv = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= dims; i += 16) {
+    __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(u + i)));
+    __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)));
+    uv = _mm256_add_epi32(uv, _mm256_madd_epi16(a, b));
+    uu = _mm256_add_epi32(uu, _mm256_madd_epi16(a, a));
+    vv = _mm256_add_epi32(vv, _mm256_madd_epi16(b, b));
+  }
+
+  Int8View uview{u, dims}, vview{v, dims};
+  int32_t sum_uv = HSum(uv), sum_uu = HSum(uu), sum_vv = HSum(vv);
+  for (; i < dims; i++) {
+    sum_uv += int32_t(uview.data[i]) * vview.data[i];
+    sum_uu += int32_t(uview.data[i]) * uview.data[i];
+    sum_vv += int32_t(vview.data[i]) * vview.data[i];
+  }
+  return {uview.scale * vview.scale * sum_uv, uview.scale * uview.scale * sum_uu,
+          vview.scale * vview.scale * sum_vv};
+}
+
+__attribute__((target("avx2,fma"))) float Int8L2SqrAvx2(const char* u, const char* v,
+                                                        size_t dims) {
+  DotSums sums = Int8DotAvx2(u, v, dims);
+  return max(sums.uu + sums.vv - 2 * sums.uv, 0.0f);
+}
+
+__attribute__((target("avx2,fma"))) float Int8DotUvAvx2(const char* u, const char* v,
+                                                        size_t dims) {
+  return Int8DotAvx2(u, v, dims).uv;
+}
+
+__attribute__((target("avx512f"))) float HSum(__m512 v) {
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, v);
+  float sum = 0;
+  for (float lane : lanes)
+    sum += lane;
+  return sum;
+}
+
+// The tail is loaded with a mask, so no scalar loop is needed.
+__attribute__((target("avx512f"))) float L2SqrAvx512(const float* u, const char* v,
+                                                     size_t dims) {
+  const float* fv = reinterpret_cast<const float*>(v);
+  __m512 acc = _mm512_setzero_ps();
+  for (size_t i = 0; i < dims; i += 16) {
+    __mmask16 mask = dims - i >= 16 ? 0xffff : (1u << (dims - i)) - 1;
+    __m512 a = _mm512_maskz_loadu_ps(mask, u + i), b = _mm512_maskz_loadu_ps(mask, fv + i);
+    __m512 d = _mm512_sub_ps(a, b);
+    acc = _mm512_fmadd_ps(d, d, acc);
+  }
+  return HSum(acc);
+}
+
+__attribute__((target("avx512f"))) DotSums DotAvx512(const float* u, const char* v, size_t dims) {
+  const float* fv = reinterpret_cast<const float*>(v);
+  __m512 uv = _mm512_setzero_ps(), uu = _mm512_setzero_ps(), vv = _mm512_setzero_ps();
+  for (size_t i = 0; i < dims; i += 16) {
+    __mmask16 mask = dims - i >= 16 ? 0xffff : (1u << (dims - i)) - 1;
+    __m512 a = _mm512_maskz_loadu_ps(mask, u + i), b = _mm512_maskz_loadu_ps(mask, fv + i);
+    uv = _mm512_fmadd_ps(a, b, uv);
+    uu = _mm512_fmadd_ps(a, a, uu);
+    vv = _mm512_fmadd_ps(b, b, vv);
+  }
+  return {HSum(uv), HSum(uu), HSum(vv)};
+}
+
+#endif
+
+#ifdef DFLY_VECTOR_NEON
+
+float HSum(float32x4_t v) {
+  return vaddvq_f32(v);
+}
+
+float L2SqrNeon(const float* u, const char* v, size_t dims) {
+  const float* fv = reinterpret_cast<const float*>(v);
+  float32x4_t acc = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t d = vsubq_f32(vld1q_f32(u + i), vld1q_f32(fv + i));
+    acc = vfmaq_f32(acc, d, d);
+  }
+
+  Float32View view{v, dims};
+  float sum = HSum(acc);
+  for (; i < dims; i++)
+    sum += (u[i] - view[i]) * (u[i] - view[i]);
+  return sum;
+}
+
+DotSums DotNeon(const float* u, const char* v, size_t dims) {
+  const float* fv = reinterpret_cast<const float*>(v);
+  float32x4_t uv = vdupq_n_f32(0), uu = vdupq_n_f32(0), vv = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t a = vld1q_f32(u + i), b = vld1q_f32(fv + i);
+    uv = vfmaq_f32(uv, a, b);
+    uu = vfmaq_f32(uu, a, a);
+    vv = vfmaq_f32(vv, b, b);
+  }
+
+  Float32View view{v, dims};
+  DotSums res{HSum(uv), HSum(uu), HSum(vv)};
+  for (; i < dims; i++) {
+    res.uv += u[i] * view[i];
+    res.uu += u[i] * u[i];
+    res.vv += view[i] * view[i];
+  }
+  return res;
+}
+
+// Half precision elements are widened with the conversion instruction of armv8.
+float32x4_t LoadFloat16Neon(const char* v, size_t i) {
+  return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t*>(v) + i)));
+}
+
+float Float16L2SqrNeon(const float* u, const char* v, size_t dims) {
+  float32x4_t acc = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t d = vsubq_f32(vld1q_f32(u + i), LoadFloat16Neon(v, i));
+    acc = vfmaq_f32(acc, d, d);
+  }
+
+  Float16View view{v, dims};
+  float sum = HSum(acc);
+  for (; i < dims; i++)
+    sum += (u[i] - view[i]) * (u[i] - view[i]);
+  return sum;
+}
+
+DotSums Float16DotNeon(const float* u, const char* v, size_t dims) {
+  float32x4_t uv = vdupq_n_f32(0), uu = vdupq_n_f32(0), vv = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t a = vld1q_f32(u + i), b = LoadFloat16Neon(v, i);
+    uv = vfmaq_f32(uv, a, b);
+    uu = vfmaq_f32(uu, a, a);
+    vv = vfmaq_f32(vv, b, b);
+  }
+
+  Float16View view{v, dims};
+  DotSums res{HSum(uv), HSum(uu), HSum(vv)};
+  for (; i < dims; i++) {
+    res.uv += u[i] * view[i];
+    res.uu += u[i] * u[i];
+    res.vv += view[i] * view[i];
+  }
+  return res;
+}
+
+#endif
+
+constexpr size_t kFloat32 = size_t(VectorStorage::FLOAT32);
+constexpr size_t kFloat16 = size_t(VectorStorage::FLOAT16);
+constexpr size_t kInt8 = size_t(VectorStorage::INT8);
+
+// Distance kernels of each storage type, indexed by VectorStorage. They default to the portable
+// loops and are replaced with the widest instruction set that the cpu supports once.
+struct Kernels {
+  float (*l2sqr[3])(const float* u, const char* v, size_t dims);
+  DotSums (*dot[3])(const float* u, const char* v, size_t dims);
+  float (*encoded_l2sqr[3])(const char* u, const char* v, size_t dims);
+  float (*encoded_dot[3])(const char* u, const char* v, size_t dims);
+};
+
+Kernels ResolveKernels() {
+  Kernels res{
+      {L2SqrPortable<Float32View>, L2SqrPortable<Float16View>, L2SqrPortable<Int8View>},
+      {DotPortable<Float32View>, DotPortable<Float16View>, DotPortable<Int8View>},
+      {EncodedL2SqrPortable<Float32View>, EncodedL2SqrPortable<Float16View>,
+       EncodedL2SqrPortable<Int8View>},
+      {EncodedDotPortable<Float32View>, EncodedDotPortable<Float16View>,
+       EncodedDotPortable<Int8View>}};
+
+#ifdef DFLY_VECTOR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    res.l2sqr[kFloat32] = L2SqrAvx2<Float32View, LoadFloat32>;
+    res.dot[kFloat32] = DotAvx2<Float32View, LoadFloat32>;
+    res.l2sqr[kInt8] = L2SqrAvx2<Int8View, LoadInt8>;
+    res.dot[kInt8] = DotAvx2<Int8View, LoadInt8>;
+    res.encoded_l2sqr[kInt8] = Int8L2SqrAvx2;
+    res.encoded_dot[kInt8] = Int8DotUvAvx2;
+
+    // Every cpu with avx2 has f16c, but it is checked separately for virtualized environments.
+    if (__builtin_cpu_supports("f16c")) {
+      res.l2sqr[kFloat16] = L2SqrAvx2<Float16View, LoadFloat16>;
+      res.dot[kFloat16] = DotAvx2<Float16View, LoadFloat16>;
+      res.encoded_l2sqr[kFloat16] = Float16L2SqrAvx2;
+      res.encoded_dot[kFloat16] = Float16DotUvAvx2;
+    }
+  }
+
+  if (__builtin_cpu_supports("avx512f")) {
+    res.l2sqr[kFloat32] = L2SqrAvx512;
+    res.dot[kFloat32] = DotAvx512;
+  }
+#endif
+
+#ifdef DFLY_VECTOR_NEON
+  res.l2sqr[kFloat32] = L2SqrNeon;
+  res.dot[kFloat32] = DotNeon;
+  res.l2sqr[kFloat16] = Float16L2SqrNeon;
+  res.dot[kFloat16] = Float16DotNeon;
+#endif
+
+  return res;
+}
+
+const Kernels& GetKernels() {
+  static const Kernels kernels = ResolveKernels();
+  return kernels;
+}
+
 }  // namespace
 
 OwnedFtVector BytesToFtVector(string_view value) {
@@ -54,13 +550,84 @@ OwnedFtVector BytesToFtVector(string_view value) {
 }
 
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim) {
-  switch (sim) {
-    case VectorSimilarity::L2:
-      return L2Distance(u, v, dims);
-    case VectorSimilarity::COSINE:
-      return CosineDistance(u, v, dims);
-  };
-  return 0.0f;
+  return VectorDistance(u, reinterpret_cast<const char*>(v), dims, sim, VectorStorage::FLOAT32);
+}
+
+size_t VectorStorageSize(size_t dims, VectorStorage storage) {
+  switch (storage) {
+    case VectorStorage::FLOAT32:
+      return dims * sizeof(float);
+    case VectorStorage::FLOAT16:
+      return dims * sizeof(uint16_t);
+    case VectorStorage::INT8:
+      return dims + sizeof(float);
+  }
+  return 0;
+}
+
+void EncodeVector(const float* src, size_t dims, VectorStorage storage, char* dest) {
+  switch (storage) {
+    case VectorStorage::FLOAT32:
+      memcpy(dest, src, dims * sizeof(float));
+      break;
+    case VectorStorage::FLOAT16:
+      for (size_t i = 0; i < dims; i++) {
+        uint16_t h = FloatToHalf(src[i]);
+        memcpy(dest + i * sizeof(h), &h, sizeof(h));
+      }
+      break;
+    case VectorStorage::INT8: {
+      float max_abs = 0;
+      for (size_t i = 0; i < dims; i++)
+        max_abs = max(max_abs, fabs(src[i]));
+      float scale = max_abs / 127;
+      float inv_scale = scale > 0 ? 1 / scale : 0;
+      for (size_t i = 0; i < dims; i++)
+        dest[i] = static_cast<int8_t>(lrintf(src[i] * inv_scale));
+      memcpy(dest + dims, &scale, sizeof(scale));
+      break;
+    }
+  }
+}
+
+float VectorDistance(const float* u, const char* v, size_t dims, VectorSimilarity sim,
+                     VectorStorage storage) {
+  const Kernels& kernels = GetKernels();
+  size_t idx = size_t(storage);
+  if (sim == VectorSimilarity::L2)
+    return sqrt(kernels.l2sqr[idx](u, v, dims));
+  return CosineDistance(kernels.dot[idx](u, v, dims));
+}
+
+void VectorDistances(const float* u, absl::Span<const char* const> vs, size_t dims,
+                     VectorSimilarity sim, VectorStorage storage, float* out) {
+  const Kernels& kernels = GetKernels();
+  size_t idx = size_t(storage);
+  if (sim == VectorSimilarity::L2) {
+    auto* l2sqr = kernels.l2sqr[idx];
+    for (size_t i = 0; i < vs.size(); i++) {
+      if (i + 1 < vs.size())
+        __builtin_prefetch(vs[i + 1]);
+      out[i] = sqrt(l2sqr(u, vs[i], dims));
+    }
+    return;
+  }
+
+  auto* dot = kernels.dot[idx];
+  for (size_t i = 0; i < vs.size(); i++) {
+    if (i + 1 < vs.size())
+      __builtin_prefetch(vs[i + 1]);
+    out[i] = CosineDistance(dot(u, vs[i], dims));
+  }
+}
+
+float EncodedL2Sqr(const char* u, const char* v, size_t dims, VectorStorage storage) {
+  return GetKernels().encoded_l2sqr[size_t(storage)](u, v, dims);
+}
+
+float EncodedInnerProductDistance(const char* u, const char* v, size_t dims,
+                                  VectorStorage storage) {
+  return 1.0f - GetKernels().encoded_dot[size_t(storage)](u, v, dims);
 }
 
 }  // namespace dfly::search
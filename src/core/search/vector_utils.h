@@ -4,12 +4,41 @@
 
 #pragma once
 
+#include <absl/types/span.h>
+
 #include "core/search/base.h"
 
 namespace dfly::search {
 
 OwnedFtVector BytesToFtVector(std::string_view value);
 
+// The distance functions use AVX2, AVX-512 or NEON kernels when the cpu supports them, which are
+// selected once at runtime.
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim);
 
+// Number of bytes that a vector of dims elements takes with the storage type.
+size_t VectorStorageSize(size_t dims, VectorStorage storage);
+
+// Writes VectorStorageSize bytes of the encoded vector to dest, which needs no alignment.
+// FLOAT16 rounds to the nearest half, INT8 stores the elements scaled to [-127, 127] followed by
+// the float scale.
+void EncodeVector(const float* src, size_t dims, VectorStorage storage, char* dest);
+
+// Distance between the full precision vector u and the encoded vector v, with the same metric
+// as VectorDistance.
+float VectorDistance(const float* u, const char* v, size_t dims, VectorSimilarity sim,
+                     VectorStorage storage);
+
+// Distances between u and each of the encoded vectors vs, written to out. Faster than calling
+// VectorDistance for every vector, as the kernel is selected once and the next vector is
+// prefetched while the current one is computed.
+void VectorDistances(const float* u, absl::Span<const char* const> vs, size_t dims,
+                     VectorSimilarity sim, VectorStorage storage, float* out);
+
+// Squared euclidean distance and 1 - inner product of two encoded vectors, the metrics of the
+// hnswlib spaces.
+float EncodedL2Sqr(const char* u, const char* v, size_t dims, VectorStorage storage);
+float EncodedInnerProductDistance(const char* u, const char* v, size_t dims,
+                                  VectorStorage storage);
+
 }  // namespace dfly::search
@@ -0,0 +1,137 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/shm_ring.h"
+
+#include <absl/numeric/bits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+error_code LastError() {
+  return error_code{errno, system_category()};
+}
+
+}  // namespace
+
+nonstd::expected<ShmRing, error_code> ShmRing::Create(size_t capacity) {
+  capacity = absl::bit_ceil(max<size_t>(capacity, 64));
+
+  int fd = memfd_create("dfly_shm_ring", MFD_CLOEXEC);
+  if (fd < 0)
+    return nonstd::make_unexpected(LastError());
+
+  size_t size = sizeof(Header) + capacity;
+  void* map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED) {
+    error_code ec = LastError();
+    close(fd);
+    return nonstd::make_unexpected(ec);
+  }
+
+  // The memfd is zero-filled, so the positions start at 0.
+  static_cast<Header*>(map)->capacity = capacity;
+  return ShmRing{fd, map, capacity};
+}
+
+nonstd::expected<ShmRing, error_code> ShmRing::Attach(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error_code ec = LastError();
+    close(fd);
+    return nonstd::make_unexpected(ec);
+  }
+
+  size_t size = st.st_size;
+  void* map = MAP_FAILED;
+  if (size > sizeof(Header))
+    map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return nonstd::make_unexpected(make_error_code(errc::invalid_argument));
+  }
+
+  size_t capacity = static_cast<Header*>(map)->capacity;
+  if (capacity != size - sizeof(Header) || !absl::has_single_bit(capacity)) {
+    munmap(map, size);
+    close(fd);
+    return nonstd::make_unexpected(make_error_code(errc::invalid_argument));
+  }
+
+  return ShmRing{fd, map, capacity};
+}
+
+ShmRing::ShmRing(int fd, void* map, size_t capacity)
+    : fd_{fd},
+      header_{static_cast<Header*>(map)},
+      data_{static_cast<char*>(map) + sizeof(Header)},
+      capacity_{capacity} {
+}
+
+ShmRing::ShmRing(ShmRing&& other) noexcept {
+  *this = std::move(other);
+}
+
+ShmRing& ShmRing::operator=(ShmRing&& other) noexcept {
+  swap(fd_, other.fd_);
+  swap(header_, other.header_);
+  swap(data_, other.data_);
+  swap(capacity_, other.capacity_);
+  return *this;
+}
+
+ShmRing::~ShmRing() {
+  if (header_)
+    munmap(header_, sizeof(Header) + capacity_);
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+size_t ShmRing::Write(string_view data) {
+  uint64_t write_pos = header_->write_pos.load(memory_order_relaxed);
+  uint64_t read_pos = header_->read_pos.load(memory_order_acquire);
+  size_t len = min(data.size(), capacity_ - Distance(read_pos, write_pos));
+
+  size_t offset = write_pos & (capacity_ - 1);
+  size_t first = min(len, capacity_ - offset);
+  memcpy(data_ + offset, data.data(), first);
+  memcpy(data_, data.data() + first, len - first);
+
+  header_->write_pos.store(write_pos + len, memory_order_release);
+  return len;
+}
+
+size_t ShmRing::Read(char* dest, size_t len) {
+  uint64_t read_pos = header_->read_pos.load(memory_order_relaxed);
+  uint64_t write_pos = header_->write_pos.load(memory_order_acquire);
+  len = min(len, Distance(read_pos, write_pos));
+
+  size_t offset = read_pos & (capacity_ - 1);
+  size_t first = min(len, capacity_ - offset);
+  memcpy(dest, data_ + offset, first);
+  memcpy(dest + first, data_, len - first);
+
+  header_->read_pos.store(read_pos + len, memory_order_release);
+  return len;
+}
+
+size_t ShmRing::ReadableBytes() const {
+  return Distance(header_->read_pos.load(memory_order_relaxed),
+                  header_->write_pos.load(memory_order_acquire));
+}
+
+}  // namespace dfly
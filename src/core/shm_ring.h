@@ -0,0 +1,71 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+#include "base/expected.hpp"
+
+namespace dfly {
+
+// A single producer single consumer byte ring in a shared memory mapping, the building block of a
+// transport for clients that run on the same host. The ring lives in a memfd that one side creates
+// and passes to the other, e.g. over a unix socket, and both sides map. The mapping starts with
+// the read and write positions, each on its own cache line, followed by a power of 2 number of
+// data bytes. The positions only grow and are masked into the data on access, so the ring is full
+// when they are capacity bytes apart. The peer is not trusted, positions it wrote are validated.
+class ShmRing {
+ public:
+  // Creates a ring of at least capacity bytes in a new memfd.
+  static nonstd::expected<ShmRing, std::error_code> Create(size_t capacity);
+
+  // Maps the ring of a memfd created by the other side. Takes ownership of fd.
+  static nonstd::expected<ShmRing, std::error_code> Attach(int fd);
+
+  ShmRing(ShmRing&& other) noexcept;
+  ShmRing& operator=(ShmRing&& other) noexcept;
+  ~ShmRing();
+
+  int fd() const {
+    return fd_;
+  }
+
+  size_t Capacity() const {
+    return capacity_;
+  }
+
+  // Copies as much of data as fits and returns the number of bytes written. Producer only.
+  size_t Write(std::string_view data);
+
+  // Copies up to len bytes to dest and returns the number of bytes read. Consumer only.
+  size_t Read(char* dest, size_t len);
+
+  size_t ReadableBytes() const;
+
+ private:
+  struct Header {
+    alignas(64) std::atomic_uint64_t write_pos;
+    alignas(64) std::atomic_uint64_t read_pos;
+    alignas(64) uint64_t capacity;
+  };
+
+  ShmRing(int fd, void* map, size_t capacity);
+
+  // Returns the bytes between the positions, 0 if the peer corrupted them.
+  size_t Distance(uint64_t read_pos, uint64_t write_pos) const {
+    uint64_t dist = write_pos - read_pos;
+    return dist <= capacity_ ? dist : 0;
+  }
+
+  int fd_ = -1;
+  Header* header_ = nullptr;
+  char* data_ = nullptr;
+  size_t capacity_ = 0;
+};
+
+}  // namespace dfly
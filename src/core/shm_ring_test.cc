@@ -0,0 +1,98 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/shm_ring.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class ShmRingTest : public ::testing::Test {
+ protected:
+  // Returns the producer and consumer sides of a ring, mapped separately as by two processes.
+  static pair<ShmRing, ShmRing> MakeRing(size_t capacity) {
+    auto producer = ShmRing::Create(capacity);
+    CHECK(producer) << producer.error().message();
+    auto consumer = ShmRing::Attach(dup(producer->fd()));
+    CHECK(consumer) << consumer.error().message();
+    return {std::move(*producer), std::move(*consumer)};
+  }
+};
+
+TEST_F(ShmRingTest, WriteRead) {
+  auto [producer, consumer] = MakeRing(100);
+  EXPECT_EQ(producer.Capacity(), 128u);
+  EXPECT_EQ(consumer.Capacity(), 128u);
+
+  char buf[256];
+  EXPECT_EQ(consumer.Read(buf, sizeof(buf)), 0u);
+
+  // Partial writes once the ring is full and reads that wrap around its end.
+  string data(200, 'x');
+  for (size_t i = 0; i < data.size(); ++i)
+    data[i] = 'a' + i % 26;
+  EXPECT_EQ(producer.Write(string_view{data}.substr(0, 100)), 100u);
+  EXPECT_EQ(producer.Write(string_view{data}.substr(100)), 28u);
+  EXPECT_EQ(producer.Write("y"), 0u);
+  EXPECT_EQ(consumer.ReadableBytes(), 128u);
+
+  EXPECT_EQ(consumer.Read(buf, 60), 60u);
+  EXPECT_EQ(string_view(buf, 60), string_view{data}.substr(0, 60));
+  EXPECT_EQ(producer.Write(string_view{data}.substr(128)), 60u);
+
+  EXPECT_EQ(consumer.Read(buf, sizeof(buf)), 128u);
+  EXPECT_EQ(string_view(buf, 128), string_view{data}.substr(60, 128));
+  EXPECT_EQ(consumer.ReadableBytes(), 0u);
+}
+
+TEST_F(ShmRingTest, AttachInvalid) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  EXPECT_FALSE(ShmRing::Attach(fds[0]));
+  close(fds[1]);
+}
+
+TEST_F(ShmRingTest, ProducerConsumer) {
+  auto [producer, consumer] = MakeRing(1024);
+  constexpr size_t kTotal = 1 << 20;
+
+  thread writer([&producer = producer] {
+    string chunk(333, '\0');
+    for (size_t pos = 0; pos < kTotal;) {
+      size_t len = min(chunk.size(), kTotal - pos);
+      for (size_t i = 0; i < len; ++i)
+        chunk[i] = char((pos + i) % 251);
+      string_view pending{chunk.data(), len};
+      while (!pending.empty()) {
+        if (size_t written = producer.Write(pending); written > 0)
+          pending.remove_prefix(written);
+        else
+          this_thread::yield();
+      }
+      pos += len;
+    }
+  });
+
+  char buf[500];
+  size_t pos = 0;
+  while (pos < kTotal) {
+    size_t len = consumer.Read(buf, sizeof(buf));
+    if (len == 0)
+      this_thread::yield();
+    for (size_t i = 0; i < len; ++i, ++pos)
+      ASSERT_EQ(buf[i], char(pos % 251)) << pos;
+  }
+  writer.join();
+  EXPECT_EQ(consumer.ReadableBytes(), 0u);
+}
+
+}  // namespace dfly
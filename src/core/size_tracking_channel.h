@@ -69,6 +69,11 @@ template <typename T, typename Queue = folly::ProducerConsumerQueue<T>> class Si
     return queue_.Capacity() * sizeof(T) + size_.load(std::memory_order_relaxed);
   }
 
+  // Heap size of the Ts in the channel, without the fixed size of the queue.
+  size_t GetItemsSize() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
  private:
   util::fb2::SimpleChannel<T, Queue> queue_;
   std::atomic<size_t> size_ = 0;
@@ -0,0 +1,296 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sketch.h"
+
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/logging.h"
+#include "core/sse_port.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+inline XXH128_hash_t Hash(string_view str) {
+  return XXH3_128bits_withSeed(str.data(), str.size(), 0xc6a4a7935bd1e995ULL);  // murmur2 seed
+}
+
+// Index of the counter of the item with the given hash in row i, by double hashing of the two
+// halves of the hash reduced to [0, width) with a multiplication instead of a division.
+inline uint32_t RowIndex(const XXH128_hash_t& hash, uint32_t i, uint32_t width) {
+  uint32_t h = (hash.low64 + i * hash.high64) >> 32;
+  return (uint64_t(h) * width) >> 32;
+}
+
+inline uint32_t AddSaturated(uint32_t a, uint64_t b) {
+  return min<uint64_t>(a + b, UINT32_MAX);
+}
+
+// dst[i] = min(dst[i] + src[i], UINT32_MAX) for i in [0, len).
+void AddSaturated(const uint32_t* src, size_t len, uint32_t* dst) {
+  size_t i = 0;
+#ifndef __s390x__
+  // SSE2 has no unsigned comparison, so the operands are biased to compare them as signed.
+  // The sum overflowed if it is smaller than the addend and is then set to all ones.
+  const __m128i bias = _mm_set1_epi32(INT32_MIN);
+  for (; i + 4 <= len; i += 4) {
+    __m128i a = mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i b = mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i sum = _mm_add_epi32(a, b);
+    __m128i overflow = _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(sum, bias));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(sum, overflow));
+  }
+#endif
+  for (; i < len; ++i)
+    dst[i] = AddSaturated(dst[i], src[i]);
+}
+
+template <typename T> T Clamp(double val, T max_val) {
+  return val <= 0 ? 0 : val >= double(max_val) ? max_val : T(val);
+}
+
+}  // namespace
+
+CountMinSketch::CountMinSketch(uint32_t width, uint32_t depth, PMR_NS::memory_resource* mr)
+    : width_(width), depth_(depth), counters_(size_t(width) * depth, 0, mr) {
+  DCHECK_GT(width, 0u);
+  DCHECK_GT(depth, 0u);
+}
+
+uint32_t CountMinSketch::IncrBy(string_view item, uint32_t incr) {
+  XXH128_hash_t hash = Hash(item);
+  uint32_t res = UINT32_MAX;
+  uint32_t* row = counters_.data();
+  for (uint32_t i = 0; i < depth_; ++i, row += width_) {
+    uint32_t& counter = row[RowIndex(hash, i, width_)];
+    counter = AddSaturated(counter, incr);
+    res = min(res, counter);
+  }
+  count_ += incr;
+  return res;
+}
+
+uint32_t CountMinSketch::Query(string_view item) const {
+  XXH128_hash_t hash = Hash(item);
+  uint32_t res = UINT32_MAX;
+  const uint32_t* row = counters_.data();
+  for (uint32_t i = 0; i < depth_; ++i, row += width_) {
+    res = min(res, row[RowIndex(hash, i, width_)]);
+  }
+  return res;
+}
+
+void CountMinSketch::Merge(absl::Span<const CountMinSketch* const> srcs,
+                           absl::Span<const int64_t> weights) {
+  DCHECK(!srcs.empty());
+  DCHECK_EQ(srcs.size(), weights.size());
+
+  size_t len = counters_.size();
+  for (const CountMinSketch* src : srcs) {
+    DCHECK_EQ(src->counters_.size(), len);
+  }
+
+  // Merge into a temporary buffer if this sketch is one of the sources.
+  vector<uint32_t> tmp;
+  uint32_t* dst = counters_.data();
+  if (find(srcs.begin(), srcs.end(), this) != srcs.end()) {
+    tmp.resize(len);
+    dst = tmp.data();
+  }
+
+  double count = 0;
+  if (all_of(weights.begin(), weights.end(), [](int64_t w) { return w == 1; })) {
+    // The common unweighted merge adds whole rows with SIMD.
+    memcpy(dst, srcs[0]->counters_.data(), len * sizeof(uint32_t));
+    for (size_t i = 1; i < srcs.size(); ++i) {
+      AddSaturated(srcs[i]->counters_.data(), len, dst);
+    }
+  } else {
+    for (size_t j = 0; j < len; ++j) {
+      double sum = 0;
+      for (size_t i = 0; i < srcs.size(); ++i)
+        sum += double(weights[i]) * srcs[i]->counters_[j];
+      dst[j] = Clamp<uint32_t>(sum, UINT32_MAX);
+    }
+  }
+
+  for (size_t i = 0; i < srcs.size(); ++i)
+    count += double(weights[i]) * srcs[i]->count_;
+
+  if (!tmp.empty())
+    memcpy(counters_.data(), tmp.data(), len * sizeof(uint32_t));
+  count_ = Clamp<uint64_t>(count, UINT64_MAX);
+}
+
+bool CountMinSketch::Load(string_view data, uint64_t count) {
+  if (data.size() != counters_.size() * sizeof(uint32_t))
+    return false;
+  memcpy(counters_.data(), data.data(), data.size());
+  count_ = count;
+  return true;
+}
+
+TopK::TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, PMR_NS::memory_resource* mr)
+    : k_(k),
+      width_(width),
+      depth_(depth),
+      decay_(decay),
+      seed_(0x9e3779b97f4a7c15ULL),
+      buckets_(size_t(width) * depth, Bucket{0, 0}, mr),
+      heap_(mr) {
+  DCHECK_GT(k, 0u);
+  DCHECK_GT(width, 0u);
+  DCHECK_GT(depth, 0u);
+  heap_.reserve(k);
+}
+
+optional<string> TopK::Add(string_view item, uint32_t incr) {
+  XXH128_hash_t hash = Hash(item);
+  uint32_t fp = hash.high64 >> 32;
+  uint32_t max_count = 0;
+
+  Bucket* row = buckets_.data();
+  for (uint32_t i = 0; i < depth_; ++i, row += width_) {
+    Bucket& bucket = row[RowIndex(hash, i, width_)];
+    if (bucket.count == 0) {
+      bucket = {fp, incr};
+    } else if (bucket.fp == fp) {
+      bucket.count = AddSaturated(bucket.count, incr);
+    } else {
+      // Every occurrence decays the colliding counter with probability decay^count and takes
+      // the bucket over once the counter drops to zero.
+      for (uint32_t left = incr; left > 0; --left) {
+        if (NextRandom() < pow(decay_, bucket.count) && --bucket.count == 0) {
+          bucket = {fp, left};
+          break;
+        }
+      }
+      if (bucket.fp != fp)
+        continue;
+    }
+    max_count = max(max_count, bucket.count);
+  }
+
+  if (HeapEntry* entry = Find(fp, item); entry) {
+    entry->count = max(entry->count, max_count);
+    SiftDown(entry - heap_.data());
+    return nullopt;
+  }
+
+  PMR_NS::memory_resource* mr = heap_.get_allocator().resource();
+  if (heap_.size() < k_) {
+    if (max_count > 0) {
+      heap_.emplace_back(max_count, fp, item, mr);
+      push_heap(heap_.begin(), heap_.end(), [](const auto& a, const auto& b) {
+        return a.count > b.count;
+      });
+    }
+    return nullopt;
+  }
+
+  if (max_count <= heap_.front().count)
+    return nullopt;
+
+  string expelled(heap_.front().item);
+  heap_.front() = HeapEntry(max_count, fp, item, mr);
+  SiftDown(0);
+  return expelled;
+}
+
+bool TopK::Query(string_view item) const {
+  return Find(uint32_t(Hash(item).high64 >> 32), item) != nullptr;
+}
+
+uint32_t TopK::Count(string_view item) const {
+  XXH128_hash_t hash = Hash(item);
+  uint32_t fp = hash.high64 >> 32;
+  uint32_t res = 0;
+  const Bucket* row = buckets_.data();
+  for (uint32_t i = 0; i < depth_; ++i, row += width_) {
+    const Bucket& bucket = row[RowIndex(hash, i, width_)];
+    if (bucket.fp == fp)
+      res = max(res, bucket.count);
+  }
+  return res;
+}
+
+vector<TopK::Entry> TopK::List() const {
+  vector<Entry> res;
+  res.reserve(heap_.size());
+  for (const HeapEntry& entry : heap_)
+    res.push_back({entry.item, entry.count});
+  sort(res.begin(), res.end(), [](const Entry& a, const Entry& b) { return a.count > b.count; });
+  return res;
+}
+
+bool TopK::Load(uint64_t seed, string_view data, absl::Span<const Entry> list) {
+  if (data.size() != buckets_.size() * sizeof(Bucket) || list.size() > k_)
+    return false;
+
+  seed_ = seed;
+  memcpy(buckets_.data(), data.data(), data.size());
+  heap_.clear();
+  PMR_NS::memory_resource* mr = heap_.get_allocator().resource();
+  for (const Entry& entry : list) {
+    heap_.emplace_back(entry.count, uint32_t(Hash(entry.item).high64 >> 32), entry.item, mr);
+  }
+  make_heap(heap_.begin(), heap_.end(), [](const auto& a, const auto& b) {
+    return a.count > b.count;
+  });
+  return true;
+}
+
+size_t TopK::MallocUsed() const {
+  size_t res = buckets_.capacity() * sizeof(Bucket) + heap_.capacity() * sizeof(HeapEntry);
+  for (const HeapEntry& entry : heap_) {
+    if (entry.item.capacity() > sizeof(PMR_NS::string))
+      res += entry.item.capacity() + 1;
+  }
+  return res;
+}
+
+auto TopK::Find(uint32_t fp, string_view item) -> HeapEntry* {
+  for (HeapEntry& entry : heap_) {
+    if (entry.fp == fp && entry.item == item)
+      return &entry;
+  }
+  return nullptr;
+}
+
+auto TopK::Find(uint32_t fp, string_view item) const -> const HeapEntry* {
+  return const_cast<TopK*>(this)->Find(fp, item);
+}
+
+void TopK::SiftDown(size_t pos) {
+  size_t size = heap_.size();
+  while (true) {
+    size_t smallest = pos;
+    for (size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < size; ++child) {
+      if (heap_[child].count < heap_[smallest].count)
+        smallest = child;
+    }
+    if (smallest == pos)
+      break;
+    swap(heap_[pos], heap_[smallest]);
+    pos = smallest;
+  }
+}
+
+double TopK::NextRandom() {
+  // splitmix64
+  uint64_t x = (seed_ += 0x9e3779b97f4a7c15ULL);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return (x >> 11) * 0x1.0p-53;
+}
+
+}  // namespace dfly
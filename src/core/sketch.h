@@ -0,0 +1,168 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/types/span.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Count-Min Sketch of depth rows of width 32-bit counters, see "An Improved Data Stream Summary:
+// The Count-Min Sketch and its Applications" by Cormode and Muthukrishnan.
+// An item increments one counter per row and its estimate is the minimum of its counters, so
+// estimates are never understated. Counters saturate at UINT32_MAX.
+class CountMinSketch {
+  CountMinSketch(const CountMinSketch&) = delete;
+  CountMinSketch& operator=(const CountMinSketch&) = delete;
+
+ public:
+  CountMinSketch(uint32_t width, uint32_t depth, PMR_NS::memory_resource* mr);
+
+  // Increments the counters of item by incr and returns its new estimate.
+  uint32_t IncrBy(std::string_view item, uint32_t incr);
+
+  uint32_t Query(std::string_view item) const;
+
+  // Replaces the counters with the weighted sum of the counters of srcs, clamped to the range
+  // of the counters. All the sketches must have the same dimensions, this may be one of them.
+  void Merge(absl::Span<const CountMinSketch* const> srcs, absl::Span<const int64_t> weights);
+
+  uint32_t width() const {
+    return width_;
+  }
+
+  uint32_t depth() const {
+    return depth_;
+  }
+
+  // Total of all the increments.
+  uint64_t count() const {
+    return count_;
+  }
+
+  // Raw counters, used for serialization.
+  std::string_view data() const {
+    return {reinterpret_cast<const char*>(counters_.data()), counters_.size() * sizeof(uint32_t)};
+  }
+
+  // Restores the counters returned by data(). Returns false if the size does not match.
+  bool Load(std::string_view data, uint64_t count);
+
+  size_t MallocUsed() const {
+    return counters_.capacity() * sizeof(uint32_t);
+  }
+
+ private:
+  uint32_t width_, depth_;
+  uint64_t count_ = 0;
+  std::vector<uint32_t, PMR_NS::polymorphic_allocator<uint32_t>> counters_;  // row by row.
+};
+
+// Top-K list of the most frequent items based on HeavyKeeper, see "HeavyKeeper: An Accurate
+// Algorithm for Finding Top-k Elephant Flows" by Gong et al. Follows the RedisBloom variant,
+// which keeps the k items with the largest estimates in a min-heap.
+// The decay decisions are drawn from a generator owned by the sketch, so that replaying the
+// same additions on a replica or after a reload yields the same state.
+class TopK {
+  TopK(const TopK&) = delete;
+  TopK& operator=(const TopK&) = delete;
+
+ public:
+  struct Entry {
+    std::string_view item;
+    uint32_t count;
+  };
+
+  // decay - probability base of decrementing a colliding counter, in (0, 1].
+  TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, PMR_NS::memory_resource* mr);
+
+  // Adds incr occurrences of item. Returns the item that was expelled from the list, if any.
+  std::optional<std::string> Add(std::string_view item, uint32_t incr = 1);
+
+  // Returns true if the item is in the list.
+  bool Query(std::string_view item) const;
+
+  // Estimated count of the item.
+  uint32_t Count(std::string_view item) const;
+
+  // Items of the list, from the most frequent to the least frequent.
+  std::vector<Entry> List() const;
+
+  size_t list_size() const {
+    return heap_.size();
+  }
+
+  uint32_t k() const {
+    return k_;
+  }
+
+  uint32_t width() const {
+    return width_;
+  }
+
+  uint32_t depth() const {
+    return depth_;
+  }
+
+  double decay() const {
+    return decay_;
+  }
+
+  // State of the decay generator, used for serialization.
+  uint64_t seed() const {
+    return seed_;
+  }
+
+  // Raw buckets, used for serialization.
+  std::string_view data() const {
+    return {reinterpret_cast<const char*>(buckets_.data()), buckets_.size() * sizeof(Bucket)};
+  }
+
+  // Restores the state returned by seed(), data() and List(). Returns false if it does not
+  // match the dimensions.
+  bool Load(uint64_t seed, std::string_view data, absl::Span<const Entry> list);
+
+  size_t MallocUsed() const;
+
+ private:
+  struct Bucket {
+    uint32_t fp;
+    uint32_t count;
+  };
+
+  struct HeapEntry {
+    HeapEntry(uint32_t count, uint32_t fp, std::string_view item, PMR_NS::memory_resource* mr)
+        : count(count), fp(fp), item(item, mr) {
+    }
+
+    uint32_t count;
+    uint32_t fp;
+    PMR_NS::string item;
+  };
+
+  // Returns the list entry of item, or nullptr.
+  HeapEntry* Find(uint32_t fp, std::string_view item);
+  const HeapEntry* Find(uint32_t fp, std::string_view item) const;
+
+  void SiftDown(size_t pos);
+
+  // Uniform random number in [0, 1).
+  double NextRandom();
+
+  uint32_t k_, width_, depth_;
+  double decay_;
+  uint64_t seed_;
+  std::vector<Bucket, PMR_NS::polymorphic_allocator<Bucket>> buckets_;  // row by row.
+  std::vector<HeapEntry, PMR_NS::polymorphic_allocator<HeapEntry>> heap_;  // min-heap by count.
+};
+
+}  // namespace dfly
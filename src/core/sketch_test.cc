@@ -0,0 +1,121 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sketch.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class SketchTest : public ::testing::Test {
+ protected:
+  PMR_NS::memory_resource* mr() {
+    return PMR_NS::get_default_resource();
+  }
+};
+
+TEST_F(SketchTest, CountMin) {
+  CountMinSketch cms(2000, 5, mr());
+  EXPECT_EQ(cms.Query("a"), 0u);
+  EXPECT_EQ(cms.IncrBy("a", 3), 3u);
+  EXPECT_EQ(cms.IncrBy("a", 2), 5u);
+
+  for (unsigned i = 0; i < 10000; ++i) {
+    cms.IncrBy(absl::StrCat("item", i % 1000), 1);
+  }
+  EXPECT_EQ(cms.count(), 10005u);
+
+  // Estimates are never understated and rarely overstated for a sketch this wide.
+  unsigned overstated = 0;
+  for (unsigned i = 0; i < 1000; ++i) {
+    uint32_t count = cms.Query(absl::StrCat("item", i));
+    ASSERT_GE(count, 10u);
+    overstated += count > 10;
+  }
+  EXPECT_LT(overstated, 50u);
+
+  CountMinSketch small(8, 1, mr());
+  small.IncrBy("a", UINT32_MAX - 1);
+  EXPECT_EQ(small.IncrBy("a", 5), UINT32_MAX);
+}
+
+TEST_F(SketchTest, CountMinMerge) {
+  CountMinSketch a(1000, 4, mr()), b(1000, 4, mr()), dest(1000, 4, mr());
+  for (unsigned i = 0; i < 100; ++i) {
+    a.IncrBy(absl::StrCat("item", i), i);
+    b.IncrBy(absl::StrCat("item", i), 1);
+  }
+
+  const CountMinSketch* srcs[] = {&a, &b};
+  int64_t ones[] = {1, 1};
+  dest.Merge(srcs, ones);
+  EXPECT_EQ(dest.Query("item10"), a.Query("item10") + b.Query("item10"));
+  EXPECT_EQ(dest.count(), a.count() + b.count());
+
+  // The destination can be one of the sources and weights scale the counters.
+  const CountMinSketch* self[] = {&dest, &b};
+  int64_t weights[] = {2, -1};
+  uint32_t expected = 2 * dest.Query("item10") - b.Query("item10");
+  dest.Merge(self, weights);
+  EXPECT_EQ(dest.Query("item10"), expected);
+
+  CountMinSketch copy(1000, 4, mr());
+  ASSERT_TRUE(copy.Load(dest.data(), dest.count()));
+  EXPECT_EQ(copy.Query("item10"), expected);
+  EXPECT_FALSE(copy.Load(dest.data().substr(4), 0));
+}
+
+TEST_F(SketchTest, TopK) {
+  TopK topk(3, 100, 4, 0.9, mr());
+  for (unsigned i = 0; i < 10; ++i) {
+    for (unsigned j = 0; j <= i; ++j) {
+      topk.Add(absl::StrCat("item", i));
+    }
+  }
+
+  vector<TopK::Entry> list = topk.List();
+  ASSERT_EQ(list.size(), 3u);
+  EXPECT_EQ(list[0].item, "item9");
+  EXPECT_EQ(list[1].item, "item8");
+  EXPECT_EQ(list[2].item, "item7");
+  EXPECT_TRUE(topk.Query("item9"));
+  EXPECT_FALSE(topk.Query("item0"));
+  EXPECT_EQ(topk.Count("item9"), 10u);
+
+  auto expelled = topk.Add("item5", 20);
+  ASSERT_TRUE(expelled);
+  EXPECT_EQ(*expelled, "item7");
+  EXPECT_FALSE(topk.Add("item5"));
+}
+
+TEST_F(SketchTest, TopKHeavyHitters) {
+  TopK topk(10, 1000, 5, 0.9, mr());
+
+  // Heavy items interleaved with a long tail of rare ones.
+  for (unsigned i = 0; i < 100000; ++i) {
+    topk.Add(absl::StrCat("heavy", i % 10));
+    topk.Add(absl::StrCat("rare", i));
+  }
+  for (unsigned i = 0; i < 10; ++i) {
+    EXPECT_TRUE(topk.Query(absl::StrCat("heavy", i))) << i;
+  }
+
+  // Replaying the same additions after a reload gives the same state.
+  TopK copy(10, 1000, 5, 0.9, mr());
+  vector<TopK::Entry> list = topk.List();
+  ASSERT_TRUE(copy.Load(topk.seed(), topk.data(), list));
+  for (unsigned i = 0; i < 1000; ++i) {
+    topk.Add(absl::StrCat("other", i % 7));
+    copy.Add(absl::StrCat("other", i % 7));
+  }
+  EXPECT_EQ(topk.data(), copy.data());
+  EXPECT_EQ(topk.seed(), copy.seed());
+}
+
+}  // namespace dfly
@@ -304,6 +304,27 @@ bool SortedMap::Insert(double score, sds ele) {
   return true;
 }
 
+void SortedMap::InsertNew(double score, std::string_view member) {
+  DCHECK(!isnan(score));
+  ScoreSds obj = score_map->AddUnique(member, score);
+  DCHECK(obj) << member;
+  bool added = score_tree->Insert(obj);
+  DCHECK(added);
+}
+
+void SortedMap::InsertSorted(absl::Span<const std::pair<double, std::string_view>> members) {
+  DCHECK_EQ(0u, score_tree->Size());
+  score_map->Reserve(members.size());
+
+  size_t index = 0;
+  score_tree->FromSorted(members.size(), [&] {
+    const auto& [score, member] = members[index++];
+    ScoreSds obj = score_map->AddUnique(member, score);
+    DCHECK(obj) << member;
+    return obj;
+  });
+}
+
 optional<unsigned> SortedMap::GetRank(sds ele, bool reverse) const {
   ScoreSds obj = score_map->FindObj(ele);
   if (obj == nullptr)
@@ -492,84 +513,43 @@ size_t SortedMap::DeleteRangeByRank(unsigned start, unsigned end) {
   DCHECK_LE(start, end);
   DCHECK_LT(end, score_tree->Size());
 
-  for (uint32_t i = start; i <= end; ++i) {
-    /* Ideally, we would want to advance path to the next item and delete the previous one.
-     * However, we can not do that because the path is invalidated after the
-     * deletion. So we have to recreate the path for each item using the same rank.
-     * Note, it is probably could be improved, but it's much more complicated.
-     */
-
-    auto path = score_tree->FromRank(start);
-    sds ele = (sds)path.Terminal();
-    score_tree->Delete(path);
-    score_map->Erase(ele);
-  }
+  // score_map owns the objects, so they are erased from it only after leaving the tree.
+  score_tree->DeleteRange(start, end, [this](ScoreSds obj) { score_map->Erase((sds)obj); });
 
   return end - start + 1;
 }
 
 size_t SortedMap::DeleteRangeByScore(const zrangespec& range) {
-  char buf[16] = {0};
-  size_t deleted = 0;
-
-  while (score_tree->Size() > 0) {
-    ScoreSds min_key = BuildScoredKey(range.min, range.minex, buf);
-    auto path = score_tree->GEQ(min_key);
-    if (path.Empty())
-      break;
-
-    ScoreSds item = path.Terminal();
-    double score = GetObjScore(item);
+  if (range.min > range.max)
+    return 0;
 
-    if (range.minex) {
-      DCHECK_GT(score, range.min);
-    } else {
-      DCHECK_GE(score, range.min);
-    }
-    if (score > range.max || (range.maxex && score == range.max))
-      break;
+  size_t count = Count(range);
+  if (count == 0)
+    return 0;
 
-    score_tree->Delete(item);
-    ++deleted;
-    score_map->Erase((sds)item);
-  }
+  char buf[16] = {0};
+  ScoreSds min_key = BuildScoredKey(range.min, range.minex, buf);
+  uint32_t rank = score_tree->GEQ(min_key).Rank();
 
-  return deleted;
+  return DeleteRangeByRank(rank, rank + count - 1);
 }
 
 size_t SortedMap::DeleteRangeByLex(const zlexrangespec& range) {
-  if (score_tree->Size() == 0)
+  size_t count = LexCount(range);
+  if (count == 0)
     return 0;
 
-  size_t deleted = 0;
-
   uint32_t rank = 0;
   if (range.min != cminstring) {
     ScoreSds range_key = (ScoreSds)(uint64_t(range.min) | kIgnoreDoubleTag);
     auto path = score_tree->GEQ(range_key);
-    if (path.Empty())
-      return {};
-
     rank = path.Rank();
     if (range.minex && sdscmp((sds)path.Terminal(), range.min) == 0) {
       ++rank;
     }
   }
 
-  while (rank < score_tree->Size()) {
-    auto path = score_tree->FromRank(rank);
-    ScoreSds item = path.Terminal();
-    if (range.max != cmaxstring) {
-      int cmp = sdscmp((sds)item, range.max);
-      if (cmp > 0 || (cmp == 0 && range.maxex))
-        break;
-    }
-    ++deleted;
-    score_tree->Delete(path);
-    score_map->Erase((sds)item);
-  }
-
-  return deleted;
+  return DeleteRangeByRank(rank, rank + count - 1);
 }
 
 SortedMap::ScoredArray SortedMap::PopTopScores(unsigned count, bool reverse) {
@@ -591,33 +571,17 @@ SortedMap::ScoredArray SortedMap::PopTopScores(unsigned count, bool reverse) {
 
   auto cb = [&](ScoreSds obj) {
     res.emplace_back(string{(sds)obj, sdslen((sds)obj)}, GetObjScore(obj));
-
-    // We can not delete from score_tree because we are in the middle of the iteration.
-    CHECK(score_map->Erase((sds)obj));
     return true;  // continue with the iteration.
   };
 
-  unsigned rank = 0;
-  unsigned step = 0;
+  unsigned start = 0;
   if (reverse) {
     score_tree->IterateReverse(0, count - 1, std::move(cb));
-    rank = score_tree->Size() - 1;
-    step = 1;
+    start = score_tree->Size() - count;
   } else {
     score_tree->Iterate(0, count - 1, std::move(cb));
   }
-
-  // We already deleted elements from score_map, so what's left is to delete from the tree.
-  if (score_map->Empty()) {
-    // Corner case optimization.
-    score_tree->Clear();
-  } else {
-    for (unsigned i = 0; i < res.size(); ++i) {
-      auto path = score_tree->FromRank(rank);
-      score_tree->Delete(path);
-      rank -= step;
-    }
-  }
+  DeleteRangeByRank(start, start + count - 1);
 
   return res;
 }
@@ -726,6 +690,26 @@ bool SortedMap::Iterate(unsigned start_rank, unsigned len, bool reverse,
   return success;
 }
 
+bool SortedMap::IterateScoreRange(const zrangespec& range,
+                                  absl::FunctionRef<bool(std::string_view, double)> cb) const {
+  char buf[16];
+  ScoreSds key = BuildScoredKey(range.min, range.minex, buf);
+  auto path = score_tree->GEQ(key);
+  if (path.Empty())
+    return true;
+
+  do {
+    ScoreSds ele = path.Terminal();
+    double score = GetObjScore(ele);
+    if (range.max < score || (range.max == score && range.maxex))
+      break;
+    if (!cb(string_view{(sds)ele, sdslen((sds)ele)}, score))
+      return false;
+  } while (path.Next());
+
+  return true;
+}
+
 uint64_t SortedMap::Scan(uint64_t cursor,
                          absl::FunctionRef<void(std::string_view, double)> cb) const {
   auto scan_cb = [&cb](const void* obj) {
@@ -736,6 +720,13 @@ uint64_t SortedMap::Scan(uint64_t cursor,
   return this->score_map->Scan(cursor, std::move(scan_cb));
 }
 
+uint32_t SortedMap::DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved) {
+  // The tree references the members of the map, so it must point to the new copies.
+  return score_map->DefragStep(cursor, ratio, budget, moved, [this](void* from, void* to) {
+    CHECK(score_tree->Replace(from, to));
+  });
+}
+
 // taken from zsetConvert
 SortedMap* SortedMap::FromListPack(PMR_NS::memory_resource* res, const uint8_t* lp) {
   uint8_t* zl = (uint8_t*)lp;
@@ -743,7 +734,6 @@ SortedMap* SortedMap::FromListPack(PMR_NS::memory_resource* res, const uint8_t*
   unsigned char* vstr;
   unsigned int vlen;
   long long vlong;
-  sds ele;
 
   void* ptr = res->allocate(sizeof(SortedMap), alignof(SortedMap));
   SortedMap* zs = new (ptr) SortedMap{res};
@@ -754,17 +744,25 @@ SortedMap* SortedMap::FromListPack(PMR_NS::memory_resource* res, const uint8_t*
     CHECK(sptr != NULL);
   }
 
-  while (eptr != NULL) {
+  // The listpack is sorted in the order of the tree, so the tree is built bottom-up.
+  size_t count = lpLength(zl) / 2;
+  zs->Reserve(count);
+  zs->score_tree->FromSorted(count, [&] {
     double score = zzlGetScore(sptr);
     vstr = lpGetValue(eptr, &vlen, &vlong);
-    if (vstr == NULL)
-      ele = sdsfromlonglong(vlong);
-    else
-      ele = sdsnewlen((char*)vstr, vlen);
+    string_view member;
+    char buf[LONG_STR_SIZE];
+    if (vstr == NULL) {
+      member = string_view{buf, size_t(ll2string(buf, sizeof(buf), vlong))};
+    } else {
+      member = string_view{(char*)vstr, vlen};
+    }
 
-    CHECK(zs->Insert(score, ele));
+    ScoreSds obj = zs->score_map->AddUnique(member, score);
+    CHECK(obj) << member;
     zzlNext(zl, &eptr, &sptr);
-  }
+    return obj;
+  });
 
   return zs;
 }
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/functional/function_ref.h>
+#include <absl/types/span.h>
 
 #include <functional>
 #include <memory>
@@ -53,6 +54,14 @@ class SortedMap {
   bool Reserve(size_t sz);
   int Add(double score, sds ele, int in_flags, int* out_flags, double* newscore);
   bool Insert(double score, sds member);
+
+  // Adds a member that is known to be absent. Inserting members in ascending score order
+  // appends to the rightmost leaf of the tree, which is the fastest way to bulk load a map.
+  void InsertNew(double score, std::string_view member);
+
+  // Loads distinct members sorted by (score, member) into an empty map. The tree is built
+  // bottom-up instead of inserting the members one by one.
+  void InsertSorted(absl::Span<const std::pair<double, std::string_view>> members);
   bool Delete(sds ele);
 
   // Upper bound size of the set.
@@ -83,8 +92,16 @@ class SortedMap {
   bool Iterate(unsigned start_rank, unsigned len, bool reverse,
                std::function<bool(sds, double)> cb) const;
 
+  // Runs cb for each element with a score within range, in ascending order, without copying
+  // the members. Stops iteration if cb returns false. Returns false in this case.
+  bool IterateScoreRange(const zrangespec& range,
+                         absl::FunctionRef<bool(std::string_view, double)> cb) const;
+
   uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(std::string_view, double)> cb) const;
 
+  // Re-allocates members that sit on underutilized pages, see StringMap::DefragStep.
+  uint32_t DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved);
+
   uint8_t* ToListPack() const;
   static SortedMap* FromListPack(PMR_NS::memory_resource* res, const uint8_t* lp);
 
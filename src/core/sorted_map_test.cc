@@ -203,6 +203,22 @@ TEST_F(SortedMapTest, ScoreRanges) {
   range.min = 3;
   array = sm_.GetRange(range, 0, 2, true);
   ASSERT_EQ(0, array.size());
+
+  vector<string> members;
+  auto collect = [&](string_view member, double score) {
+    members.emplace_back(member);
+    return members.size() < 12;
+  };
+  range = {.min = 1, .max = 2, .minex = 1, .maxex = 0};
+  EXPECT_TRUE(sm_.IterateScoreRange(range, collect));
+  ASSERT_EQ(10u, members.size());
+  EXPECT_EQ("b0", members.front());
+
+  members.clear();
+  range.minex = 0;
+  EXPECT_FALSE(sm_.IterateScoreRange(range, collect));
+  ASSERT_EQ(12u, members.size());
+  EXPECT_EQ("b1", members.back());
 }
 
 TEST_F(SortedMapTest, DeleteRange) {
@@ -246,6 +262,41 @@ TEST_F(SortedMapTest, DeleteRange) {
   EXPECT_EQ(96, sm_.DeleteRangeByLex(lex_range));
 }
 
+TEST_F(SortedMapTest, DefragStep) {
+  auto build_str = [](size_t i) { return string(120, 'm') + to_string(i); };
+
+  for (size_t i = 0; i < 10'000; ++i) {
+    sds ele = sdsnew(build_str(i).c_str());
+    sm_.Insert(i, ele);
+  }
+  for (size_t i = 0; i < 10'000; ++i) {
+    if (i % 10 == 0)
+      continue;
+    sds ele = sdsnew(build_str(i).c_str());
+    ASSERT_TRUE(sm_.Delete(ele));
+    sdsfree(ele);
+  }
+
+  // Defragment in small steps, the tree must keep pointing to the valid members.
+  uint32_t cursor = 0;
+  size_t moved = 0;
+  unsigned steps = 0;
+  do {
+    size_t budget = 64;
+    cursor = sm_.DefragStep(cursor, 0.9, &budget, &moved);
+    ++steps;
+  } while (cursor != 0);
+  EXPECT_GT(steps, 1u);
+  EXPECT_GT(moved, 0u);
+
+  for (size_t i = 0; i < 1000; ++i) {
+    sds ele = sdsnew(build_str(i * 10).c_str());
+    EXPECT_EQ(sm_.GetRank(ele, false), i);
+    EXPECT_EQ(sm_.GetScore(ele), i * 10);
+    sdsfree(ele);
+  }
+}
+
 // not a real test, just to see how much memory is used by zskiplist.
 TEST_F(SortedMapTest, MemoryUsage) {
   zskiplist* zsl = zslCreate();
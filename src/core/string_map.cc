@@ -217,6 +217,16 @@ pair<sds, bool> StringMap::ReallocIfNeeded(void* obj, float ratio) {
   return {new_key, true};
 }
 
+uint32_t StringMap::DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved) {
+  return TraverseStep(cursor, budget, [&](DensePtr* ptr) {
+    auto [new_obj, realloced] = ReallocIfNeeded(ptr->GetObject(), ratio);
+    if (realloced) {
+      ptr->SetObject(new_obj);
+      *moved += ObjectAllocSize(new_obj);
+    }
+  });
+}
+
 uint64_t StringMap::Hash(const void* obj, uint32_t cookie) const {
   DCHECK_LT(cookie, 2u);
 
@@ -146,6 +146,11 @@ class StringMap : public DenseSet {
   void RandomPairs(unsigned int count, std::vector<sds>& keys, std::vector<sds>& vals,
                    bool with_value);
 
+  // Re-allocates the fields and values of the buckets starting at cursor that sit on
+  // underutilized pages, visiting about *budget fields. Adds the bytes of the re-allocated
+  // entries to *moved. Returns the cursor to continue from or 0 once the end was reached.
+  uint32_t DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved);
+
  private:
   // Reallocate key and/or value if their pages are underutilized.
   // Returns new pointer (stays same if key utilization is enough) and if reallocation happened.
@@ -192,4 +192,32 @@ TEST_F(StringMapTest, ReallocIfNeeded) {
     EXPECT_EQ(sm_->Find(build_str(i * 10))->second, build_str(i * 10 + 1));
 }
 
+TEST_F(StringMapTest, DefragStep) {
+  auto build_str = [](size_t i) { return to_string(i) + string(131, 'a'); };
+
+  for (size_t i = 0; i < 10'000; i++)
+    sm_->AddOrUpdate(build_str(i), build_str(i + 1));
+
+  for (size_t i = 0; i < 10'000; i++) {
+    if (i % 10 == 0)
+      continue;
+    sm_->Erase(build_str(i));
+  }
+
+  uint32_t cursor = 0;
+  size_t moved = 0;
+  unsigned steps = 0;
+  do {
+    size_t budget = 100;
+    cursor = sm_->DefragStep(cursor, 0.9, &budget, &moved);
+    ++steps;
+  } while (cursor != 0);
+  EXPECT_GT(steps, 1u);
+  EXPECT_GT(moved, 0u);
+
+  EXPECT_EQ(sm_->UpperBoundSize(), 1000);
+  for (size_t i = 0; i < 1000; i++)
+    EXPECT_EQ(sm_->Find(build_str(i * 10))->second, build_str(i * 10 + 1));
+}
+
 }  // namespace dfly
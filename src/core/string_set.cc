@@ -4,6 +4,11 @@
 
 #include "core/string_set.h"
 
+#include <absl/container/flat_hash_set.h>
+
+#include <algorithm>
+#include <array>
+
 #include "core/compact_object.h"
 #include "core/sds_utils.h"
 
@@ -32,10 +37,90 @@ sds AllocImmutableWithTtl(uint32_t len, uint32_t at) {
   return res;
 }
 
+constexpr size_t kSlabBlockSize = 4096;
+
+// Sets with less members embed none of them, to avoid allocating a block for a few members.
+constexpr size_t kSlabMinSetSize = 512;
+
+// The longest member that fits a single byte sds header.
+constexpr size_t kMaxEmbeddedLen = (1 << (8 - SDS_TYPE_BITS)) - 1;
+
+// A free slot holds the pointer to the next free slot of the same size.
+constexpr size_t kMinSlotSize = sizeof(char*);
+
+// The header, the member and the null terminator.
+constexpr size_t SlotSize(size_t len) {
+  return std::max(len + 2, kMinSlotSize);
+}
+
 }  // namespace
 
+// Allocates slots back to back in blocks. Freed slots are kept in free lists by their size
+// and the blocks are released only when the slab is destroyed.
+class StringSet::Slab {
+ public:
+  explicit Slab(MemoryResource* mr) : mr_(mr) {
+  }
+
+  ~Slab() {
+    for (uintptr_t block : blocks_)
+      mr_->deallocate((void*)block, kSlabBlockSize, kSlabBlockSize);
+  }
+
+  bool Owns(const void* ptr) const {
+    return blocks_.contains(uintptr_t(ptr) & ~(kSlabBlockSize - 1));
+  }
+
+  char* Allocate(size_t size) {
+    DCHECK_LT(size, free_.size());
+    used_bytes_ += size;
+
+    char* res = free_[size];
+    if (res) {
+      memcpy(&free_[size], res, sizeof(char*));
+      return res;
+    }
+
+    if (size_t(end_ - pos_) < size) {
+      pos_ = (char*)mr_->allocate(kSlabBlockSize, kSlabBlockSize);
+      end_ = pos_ + kSlabBlockSize;
+      blocks_.insert(uintptr_t(pos_));
+    }
+    res = pos_;
+    pos_ += size;
+    return res;
+  }
+
+  void Free(char* slot, size_t size) {
+    DCHECK_GE(used_bytes_, size);
+    used_bytes_ -= size;
+    memcpy(slot, &free_[size], sizeof(char*));
+    free_[size] = slot;
+  }
+
+  size_t UsedBytes() const {
+    return used_bytes_;
+  }
+
+  size_t UnusedBytes() const {
+    return blocks_.size() * kSlabBlockSize - used_bytes_;
+  }
+
+ private:
+  MemoryResource* mr_;
+  absl::flat_hash_set<uintptr_t> blocks_;
+  char* pos_ = nullptr;  // the unused tail of the last block
+  char* end_ = nullptr;
+  size_t used_bytes_ = 0;
+  std::array<char*, SlotSize(kMaxEmbeddedLen) + 1> free_{};
+};
+
 StringSet::~StringSet() {
   Clear();
+  if (slab_) {
+    slab_->~Slab();
+    mr()->deallocate(slab_, sizeof(Slab), alignof(Slab));
+  }
 }
 
 bool StringSet::Add(string_view src, uint32_t ttl_sec) {
@@ -45,7 +130,7 @@ bool StringSet::Add(string_view src, uint32_t ttl_sec) {
     return false;
   }
 
-  sds newsds = MakeSetSds(src, ttl_sec);
+  sds newsds = MakeMember(src, ttl_sec);
   bool has_ttl = ttl_sec != UINT32_MAX;
   AddUnique(newsds, has_ttl, hash);
   return true;
@@ -68,7 +153,7 @@ unsigned StringSet::AddBatch(absl::Span<std::string_view> span, uint32_t ttl_sec
     void* prev = FindInternal(&span[i], hash[i], 1);
     if (prev == nullptr) {
       ++res;
-      sds field = MakeSetSds(span[i], ttl_sec);
+      sds field = MakeMember(span[i], ttl_sec);
       AddUnique(field, has_ttl, hash[i]);
     }
   }
@@ -84,11 +169,16 @@ std::optional<std::string> StringSet::Pop() {
   }
 
   std::string ret{str, sdslen(str)};
-  sdsfree(str);
+  FreeMember(str);
+  MaybeCompactSlab();
 
   return ret;
 }
 
+size_t StringSet::SlabUnusedBytes() const {
+  return slab_ ? slab_->UnusedBytes() : 0;
+}
+
 uint32_t StringSet::Scan(uint32_t cursor, const std::function<void(const sds)>& func) const {
   return DenseSet::Scan(cursor, [func](const void* ptr) { func((sds)ptr); });
 }
@@ -126,6 +216,8 @@ bool StringSet::ObjEqual(const void* left, const void* right, uint32_t right_coo
 }
 
 size_t StringSet::ObjectAllocSize(const void* s1) const {
+  if (IsEmbedded(s1))
+    return SlotSize(sdslen((sds)s1));
   return zmalloc_usable_size(sdsAllocPtr((sds)s1));
 }
 
@@ -142,7 +234,7 @@ void StringSet::ObjUpdateExpireTime(const void* obj, uint32_t ttl_sec) {
 }
 
 void StringSet::ObjDelete(void* obj, bool has_ttl) const {
-  sdsfree((sds)obj);
+  FreeMember((sds)obj);
 }
 
 void* StringSet::ObjectClone(const void* obj, bool has_ttl, bool add_ttl) const {
@@ -165,4 +257,98 @@ sds StringSet::MakeSetSds(string_view src, uint32_t ttl_sec) const {
   return sdsnewlen(src.data(), src.size());
 }
 
+sds StringSet::MakeMember(string_view src, uint32_t ttl_sec) {
+  // Members with ttl are not embedded, so that all embedded slots have the same layout.
+  if (ttl_sec != UINT32_MAX || src.empty() || src.size() > kMaxEmbeddedLen ||
+      UpperBoundSize() < kSlabMinSetSize) {
+    return MakeSetSds(src, ttl_sec);
+  }
+
+  if (!slab_) {
+    slab_ = new (mr()->allocate(sizeof(Slab), alignof(Slab))) Slab(mr());
+  }
+  return MakeEmbedded(src);
+}
+
+sds StringSet::MakeEmbedded(string_view src) {
+  char* slot = slab_->Allocate(SlotSize(src.size()));
+  slot[0] = SDS_TYPE_5 | (src.size() << SDS_TYPE_BITS);
+  memcpy(slot + 1, src.data(), src.size());
+  slot[src.size() + 1] = '\0';
+  return slot + 1;
+}
+
+void StringSet::FreeMember(sds s) const {
+  if (IsEmbedded(s)) {
+    slab_->Free(s - 1, SlotSize(sdslen(s)));
+  } else {
+    sdsfree(s);
+  }
+}
+
+bool StringSet::IsEmbedded(const void* obj) const {
+  return slab_ && slab_->Owns(obj);
+}
+
+void StringSet::MaybeCompactSlab() {
+  if (!slab_ || slab_->UnusedBytes() < 4 * kSlabBlockSize ||
+      slab_->UnusedBytes() < slab_->UsedBytes()) {
+    return;
+  }
+
+  Slab* old = slab_;
+  slab_ = nullptr;
+  if (old->UsedBytes() > 0) {
+    slab_ = new (mr()->allocate(sizeof(Slab), alignof(Slab))) Slab(mr());
+    for (iterator it = begin(); it != end(); ++it)
+      it.MoveToSlab(old);
+  }
+
+  old->~Slab();
+  mr()->deallocate(old, sizeof(Slab), alignof(Slab));
+}
+
+bool StringSet::iterator::ReallocIfNeeded(float ratio) {
+  // Unwrap all links to correctly call SetObject()
+  auto* ptr = curr_entry_;
+  while (ptr->IsLink())
+    ptr = ptr->AsLink();
+
+  return static_cast<StringSet*>(owner_)->ReallocIfNeeded(ptr, ratio) > 0;
+}
+
+size_t StringSet::ReallocIfNeeded(DensePtr* ptr, float ratio) {
+  // Embedded members are defragmented by the slab compaction.
+  sds s = (sds)ptr->GetObject();
+  if (IsEmbedded(s))
+    return 0;
+
+  char* alloc_ptr = (char*)sdsAllocPtr(s);
+  if (!zmalloc_page_is_underutilized(alloc_ptr, ratio))
+    return 0;
+
+  // Copy the whole allocation to preserve the expiry time stored after the member.
+  size_t alloc_size = zmalloc_usable_size(alloc_ptr);
+  char* copy = (char*)zmalloc(alloc_size);
+  memcpy(copy, alloc_ptr, alloc_size);
+  ptr->SetObject(copy + (s - alloc_ptr));
+  zfree(alloc_ptr);
+  return alloc_size;
+}
+
+uint32_t StringSet::DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved) {
+  return TraverseStep(cursor, budget,
+                      [&](DensePtr* ptr) { *moved += ReallocIfNeeded(ptr, ratio); });
+}
+
+void StringSet::iterator::MoveToSlab(const Slab* from) {
+  auto* ptr = curr_entry_;
+  while (ptr->IsLink())
+    ptr = ptr->AsLink();
+
+  sds s = (sds)ptr->GetObject();
+  if (from->Owns(s))
+    ptr->SetObject(static_cast<StringSet*>(owner_)->MakeEmbedded({s, sdslen(s)}));
+}
+
 }  // namespace dfly
@@ -19,7 +19,13 @@ extern "C" {
 
 namespace dfly {
 
+// Members shorter than 32 bytes of sets that hold many members are embedded into a slab:
+// they are laid out back to back in blocks allocated from the memory resource of the set, without
+// the rounding to the size classes of the allocator. Embedded members are still sds strings
+// with a single byte header, so the API of the set does not depend on how a member is stored.
 class StringSet : public DenseSet {
+  class Slab;
+
  public:
   StringSet(MemoryResource* res = PMR_NS::get_default_resource()) : DenseSet(res) {
   }
@@ -32,7 +38,10 @@ class StringSet : public DenseSet {
   template <typename T> unsigned AddMany(absl::Span<T> span, uint32_t ttl_sec);
 
   bool Erase(std::string_view str) {
-    return EraseInternal(&str, 1);
+    if (!EraseInternal(&str, 1))
+      return false;
+    MaybeCompactSlab();
+    return true;
   }
 
   bool Contains(std::string_view s1) const {
@@ -41,6 +50,9 @@ class StringSet : public DenseSet {
 
   std::optional<std::string> Pop();
 
+  // Bytes of the slab blocks that do not hold members.
+  size_t SlabUnusedBytes() const;
+
   class iterator : private IteratorBase {
    public:
     using iterator_category = std::forward_iterator_tag;
@@ -82,9 +94,19 @@ class StringSet : public DenseSet {
       return (value_type)curr_entry_->GetObject();
     }
 
+    // Reallocates the current member if its page is underutilized.
+    // Returns true if the member was reallocated.
+    bool ReallocIfNeeded(float ratio);
+
     using IteratorBase::ExpiryTime;
     using IteratorBase::HasExpiry;
     using IteratorBase::SetExpiryTime;
+
+   private:
+    friend class StringSet;
+
+    // Moves the current member to the slab of the set if it resides in from.
+    void MoveToSlab(const Slab* from);
   };
 
   iterator begin() {
@@ -97,6 +119,11 @@ class StringSet : public DenseSet {
 
   uint32_t Scan(uint32_t, const std::function<void(sds)>&) const;
 
+  // Re-allocates the members of the buckets starting at cursor that sit on underutilized pages,
+  // visiting about *budget members. Adds the re-allocated bytes to *moved. Returns the cursor to
+  // continue from or 0 once the end was reached.
+  uint32_t DefragStep(uint32_t cursor, float ratio, size_t* budget, size_t* moved);
+
   iterator Find(std::string_view member) {
     return iterator{FindIt(&member, 1)};
   }
@@ -114,6 +141,23 @@ class StringSet : public DenseSet {
   void ObjDelete(void* obj, bool has_ttl) const override;
   void* ObjectClone(const void* obj, bool has_ttl, bool add_ttl) const override;
   sds MakeSetSds(std::string_view src, uint32_t ttl_sec) const;
+
+ private:
+  // Creates a new member, embedding it into the slab if possible.
+  sds MakeMember(std::string_view src, uint32_t ttl_sec);
+  sds MakeEmbedded(std::string_view src);
+  void FreeMember(sds s) const;
+
+  bool IsEmbedded(const void* obj) const;
+
+  // Re-allocates the member held by ptr if its page is underutilized. Returns the number of
+  // re-allocated bytes.
+  size_t ReallocIfNeeded(DensePtr* ptr, float ratio);
+
+  // Moves the embedded members to a new slab once most of the slab is unused.
+  void MaybeCompactSlab();
+
+  Slab* slab_ = nullptr;
 };
 
 template <typename T> unsigned StringSet::AddMany(absl::Span<T> span, uint32_t ttl_sec) {
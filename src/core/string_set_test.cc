@@ -37,6 +37,10 @@ class DenseSetAllocator : public PMR_NS::memory_resource {
     return alloced_ == 0;
   }
 
+  size_t alloced() const {
+    return alloced_;
+  }
+
   void* do_allocate(size_t bytes, size_t alignment) override {
     alloced_ += bytes;
     void* p = PMR_NS::new_delete_resource()->allocate(bytes, alignment);
@@ -474,6 +478,51 @@ TEST_F(StringSetTest, IterateEmpty) {
   }
 }
 
+// Short members of large sets are embedded into the slab of the set. Reports their memory usage
+// compared to separately allocated sds strings.
+TEST_F(StringSetTest, EmbeddedMembers) {
+  constexpr size_t kNum = 100000;
+  vector<string> members(kNum);
+  for (size_t i = 0; i < kNum; ++i)
+    members[i] = StrCat("id:", string(generator_() % 11, 'x'), i);
+
+  size_t sds_bytes = 0;
+  for (const auto& m : members) {
+    sds s = sdsnewlen(m.data(), m.size());
+    sds_bytes += zmalloc_usable_size(sdsAllocPtr(s));
+    sdsfree(s);
+  }
+
+  for (const auto& m : members)
+    ASSERT_TRUE(ss_->Add(m));
+
+  size_t member_bytes = alloc_.alloced() - ss_->SetMallocUsed() + zmalloc_used_memory_tl;
+  LOG(INFO) << "sds members: " << sds_bytes << " bytes, embedded members: " << member_bytes
+            << " bytes";
+  EXPECT_LT(member_bytes * 10, sds_bytes * 9);
+
+  // Erasing most of the members compacts the slab.
+  for (size_t i = 0; i < kNum; ++i) {
+    if (i % 10)
+      ASSERT_TRUE(ss_->Erase(members[i]));
+  }
+  EXPECT_LT(ss_->SlabUnusedBytes(), ss_->ObjMallocUsed());
+
+  for (size_t i = 0; i < kNum; ++i)
+    ASSERT_EQ(i % 10 == 0, ss_->Contains(members[i])) << i;
+
+  size_t count = 0;
+  for (sds s : *ss_) {
+    EXPECT_TRUE(absl::StartsWith(string_view{s, sdslen(s)}, "id:"));
+    ++count;
+  }
+  EXPECT_EQ(kNum / 10, count);
+
+  while (auto member = ss_->Pop())
+    EXPECT_TRUE(absl::StartsWith(*member, "id:"));
+  EXPECT_EQ(0u, ss_->ObjMallocUsed());
+}
+
 void BM_Clone(benchmark::State& state) {
   vector<string> strs;
   mt19937 generator(0);
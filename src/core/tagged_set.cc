@@ -0,0 +1,263 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/tagged_set.h"
+
+#include <absl/numeric/bits.h>
+
+#include "base/endian.h"
+#include "base/logging.h"
+#include "core/compact_object.h"
+#include "core/sds_utils.h"
+#include "core/sse_port.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+TaggedSet::TaggedSet(MemoryResource* mr) : tags_{mr}, slots_{mr} {
+}
+
+TaggedSet::~TaggedSet() {
+  DCHECK_EQ(size_, 0u) << "derived classes must clear the set";
+}
+
+void TaggedSet::Clear() {
+  for (size_t pos = 0; pos < slots_.size(); ++pos) {
+    if (tags_[pos] & kEmpty)
+      continue;
+    ObjDelete((void*)(slots_[pos] & ~kTtlBit), slots_[pos] & kTtlBit);
+  }
+  tags_.clear();
+  slots_.clear();
+  tags_.shrink_to_fit();
+  slots_.shrink_to_fit();
+  size_ = used_ = obj_malloc_used_ = 0;
+  expiration_used_ = false;
+}
+
+void TaggedSet::Reserve(size_t size) {
+  size_t num_groups = max<size_t>(NumGroups(), 1);
+  while (num_groups * kGroupSize * 7 / 8 < size)
+    num_groups *= 2;
+  if (num_groups > NumGroups())
+    Rehash(num_groups);
+}
+
+uint32_t TaggedSet::Scan(uint32_t cursor, const function<void(const void*)>& cb) const {
+  for (size_t group = cursor; group < NumGroups(); ++group) {
+    bool visited = false;
+    for (uint32_t full = ~MatchFree(group) & 0xFFFF; full != 0; full &= full - 1) {
+      size_t pos = group * kGroupSize + absl::countr_zero(full);
+      if (!ExpireIfNeeded(pos)) {
+        cb((const void*)(slots_[pos] & ~kTtlBit));
+        visited = true;
+      }
+    }
+
+    if (visited)
+      return group + 1 < NumGroups() ? group + 1 : 0;
+  }
+  return 0;
+}
+
+void* TaggedSet::FindInternal(const void* obj, uint64_t hash, uint32_t cookie) const {
+  size_t pos = FindSlot(obj, hash, cookie);
+  if (pos == kNotFound || ExpireIfNeeded(pos))
+    return nullptr;
+  return (void*)(slots_[pos] & ~kTtlBit);
+}
+
+bool TaggedSet::EraseInternal(const void* obj, uint32_t cookie) {
+  size_t pos = FindSlot(obj, Hash(obj, cookie), cookie);
+  if (pos == kNotFound)
+    return false;
+
+  void* found = (void*)(slots_[pos] & ~kTtlBit);
+  obj_malloc_used_ -= ObjectAllocSize(found);
+  ObjDelete(found, slots_[pos] & kTtlBit);
+  EraseSlot(pos);
+  return true;
+}
+
+void TaggedSet::AddUnique(void* obj, bool has_ttl, uint64_t hash) {
+  DCHECK_EQ(uintptr_t(obj) & kTtlBit, 0u);
+
+  // Rehashing at the same size is enough to drop the deleted slots if they are the majority.
+  if (used_ + 1 > slots_.size() * 7 / 8) {
+    size_t num_groups = NumGroups();
+    if (num_groups == 0)
+      num_groups = 1;
+    else if (size_ + 1 > slots_.size() * 7 / 16)
+      num_groups *= 2;
+    Rehash(num_groups);
+  }
+
+  Insert(uintptr_t(obj) | (has_ttl ? kTtlBit : 0), hash);
+  ++size_;
+  obj_malloc_used_ += ObjectAllocSize(obj);
+  expiration_used_ |= has_ttl;
+}
+
+#ifdef __s390x__
+uint32_t TaggedSet::MatchTag(size_t group, uint8_t tag) const {
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < kGroupSize; ++i)
+    mask |= uint32_t(tags_[group * kGroupSize + i] == tag) << i;
+  return mask;
+}
+
+uint32_t TaggedSet::MatchFree(size_t group) const {
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < kGroupSize; ++i)
+    mask |= uint32_t((tags_[group * kGroupSize + i] & kEmpty) != 0) << i;
+  return mask;
+}
+#else
+uint32_t TaggedSet::MatchTag(size_t group, uint8_t tag) const {
+  __m128i tags = mm_loadu_si128(reinterpret_cast<const __m128i*>(&tags_[group * kGroupSize]));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+}
+
+uint32_t TaggedSet::MatchFree(size_t group) const {
+  __m128i tags = mm_loadu_si128(reinterpret_cast<const __m128i*>(&tags_[group * kGroupSize]));
+  return _mm_movemask_epi8(tags);
+}
+#endif
+
+size_t TaggedSet::FindSlot(const void* obj, uint64_t hash, uint32_t cookie) const {
+  if (size_ == 0)
+    return kNotFound;
+
+  size_t mask = NumGroups() - 1;
+  size_t group = FirstGroup(hash);
+  for (size_t step = 1; step <= NumGroups(); ++step) {
+    for (uint32_t match = MatchTag(group, Tag(hash)); match != 0; match &= match - 1) {
+      size_t pos = group * kGroupSize + absl::countr_zero(match);
+      if (ObjEqual((const void*)(slots_[pos] & ~kTtlBit), obj, cookie))
+        return pos;
+    }
+
+    if (MatchTag(group, kEmpty) != 0)
+      return kNotFound;
+    group = (group + step) & mask;
+  }
+  return kNotFound;
+}
+
+void TaggedSet::Insert(uintptr_t slot, uint64_t hash) {
+  size_t mask = NumGroups() - 1;
+  size_t group = FirstGroup(hash);
+  for (size_t step = 1;; ++step) {
+    if (uint32_t free = MatchFree(group); free != 0) {
+      size_t pos = group * kGroupSize + absl::countr_zero(free);
+      used_ += tags_[pos] == kEmpty;
+      tags_[pos] = Tag(hash);
+      slots_[pos] = slot;
+      return;
+    }
+    DCHECK_LE(step, NumGroups());
+    group = (group + step) & mask;
+  }
+}
+
+void TaggedSet::EraseSlot(size_t pos) {
+  // A probe that reached a group with an empty slot would have stopped there, so no probe
+  // sequence passes through this group and the slot can become empty as well.
+  size_t group = pos / kGroupSize;
+  if (MatchTag(group, kEmpty) != 0) {
+    tags_[pos] = kEmpty;
+    --used_;
+  } else {
+    tags_[pos] = kDeleted;
+  }
+  slots_[pos] = 0;
+  --size_;
+}
+
+bool TaggedSet::ExpireIfNeeded(size_t pos) const {
+  uintptr_t slot = slots_[pos];
+  if ((slot & kTtlBit) == 0 || ObjExpireTime((const void*)(slot & ~kTtlBit)) > time_now_)
+    return false;
+
+  TaggedSet* self = const_cast<TaggedSet*>(this);
+  self->obj_malloc_used_ -= ObjectAllocSize((const void*)(slot & ~kTtlBit));
+  ObjDelete((void*)(slot & ~kTtlBit), true);
+  self->EraseSlot(pos);
+  return true;
+}
+
+void TaggedSet::Rehash(size_t num_groups) {
+  PMR_NS::vector<uint8_t> tags(num_groups * kGroupSize, kEmpty, mr());
+  PMR_NS::vector<uintptr_t> slots(num_groups * kGroupSize, 0, mr());
+  tags.swap(tags_);
+  slots.swap(slots_);
+  used_ = 0;
+
+  for (size_t pos = 0; pos < slots.size(); ++pos) {
+    if ((tags[pos] & kEmpty) == 0)
+      Insert(slots[pos], Hash((const void*)(slots[pos] & ~kTtlBit), 0));
+  }
+}
+
+TaggedStringSet::~TaggedStringSet() {
+  Clear();
+}
+
+bool TaggedStringSet::Add(string_view str, uint32_t ttl_sec) {
+  uint64_t hash = Hash(&str, 1);
+  if (FindInternal(&str, hash, 1) != nullptr)
+    return false;
+
+  sds member;
+  if (ttl_sec == UINT32_MAX) {
+    member = sdsnewlen(str.data(), str.size());
+  } else {
+    member = AllocSdsWithSpace(str.size(), sizeof(uint32_t));
+    if (!str.empty())
+      memcpy(member, str.data(), str.size());
+    absl::little_endian::Store32(member + str.size() + 1, time_now() + ttl_sec);
+  }
+
+  AddUnique(member, ttl_sec != UINT32_MAX, hash);
+  return true;
+}
+
+uint32_t TaggedStringSet::Scan(uint32_t cursor, const function<void(sds)>& cb) const {
+  return TaggedSet::Scan(cursor, [&cb](const void* obj) { cb((sds)obj); });
+}
+
+uint64_t TaggedStringSet::Hash(const void* obj, uint32_t cookie) const {
+  DCHECK_LT(cookie, 2u);
+  if (cookie == 0)
+    return CompactObj::HashCode(string_view{(sds)obj, sdslen((sds)obj)});
+  return CompactObj::HashCode(*(const string_view*)obj);
+}
+
+bool TaggedStringSet::ObjEqual(const void* left, const void* right, uint32_t right_cookie) const {
+  DCHECK_LT(right_cookie, 2u);
+  string_view left_sv{(sds)left, sdslen((sds)left)};
+  if (right_cookie == 0)
+    return left_sv == string_view{(sds)right, sdslen((sds)right)};
+  return left_sv == *(const string_view*)right;
+}
+
+size_t TaggedStringSet::ObjectAllocSize(const void* obj) const {
+  return zmalloc_usable_size(sdsAllocPtr((sds)obj));
+}
+
+uint32_t TaggedStringSet::ObjExpireTime(const void* obj) const {
+  sds str = (sds)obj;
+  return absl::little_endian::Load32(str + sdslen(str) + 1);
+}
+
+void TaggedStringSet::ObjDelete(void* obj, bool has_ttl) const {
+  sdsfree((sds)obj);
+}
+
+}  // namespace dfly
@@ -0,0 +1,184 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+extern "C" {
+#include "redis/sds.h"
+}
+
+namespace dfly {
+
+// An open addressing alternative to DenseSet with the same hooks for the derived classes.
+// DenseSet resolves collisions with displaced entries and linked chains, which cost a link
+// allocation and a pointer hop per collision. TaggedSet keeps the objects in a flat array of
+// slots, grouped by 16, and a parallel array of 1 byte tags holding 7 bits of the hash of a full
+// slot or marking it empty or deleted. A lookup compares the tags of a whole group with a single
+// SSE instruction and dereferences only the objects with a matching tag, probing the groups
+// quadratically until a group with an empty slot. The table grows when 7/8 of the slots are full
+// or deleted, so it takes 9 / 0.875 ~ 10.3 bytes per object at most and twice that right after
+// growing.
+class TaggedSet {
+ public:
+  using MemoryResource = PMR_NS::memory_resource;
+  static constexpr unsigned kGroupSize = 16;
+
+  explicit TaggedSet(MemoryResource* mr = PMR_NS::get_default_resource());
+  virtual ~TaggedSet();
+
+  // Derived classes must call Clear in their destructors, since it calls the virtual ObjDelete.
+  void Clear();
+
+  // Grows the table to hold size objects without rehashing.
+  void Reserve(size_t size);
+
+  // Returns the number of objects, some of which may have expired.
+  size_t UpperBoundSize() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  size_t SlotCount() const {
+    return slots_.size();
+  }
+
+  size_t ObjMallocUsed() const {
+    return obj_malloc_used_;
+  }
+
+  size_t SetMallocUsed() const {
+    return tags_.capacity() + slots_.capacity() * sizeof(uintptr_t);
+  }
+
+  // Calls cb for the objects of the groups from cursor on, until at least one object is visited.
+  // Returns the cursor to continue from or 0 after the last group. Unlike DenseSet::Scan, a scan
+  // that spans a growth of the table may miss or repeat objects, as growing moves them to other
+  // groups.
+  uint32_t Scan(uint32_t cursor, const std::function<void(const void*)>& cb) const;
+
+  // Sets an abstract time that allows expiry.
+  void set_time(uint32_t val) {
+    time_now_ = val;
+  }
+
+  uint32_t time_now() const {
+    return time_now_;
+  }
+
+  bool ExpirationUsed() const {
+    return expiration_used_;
+  }
+
+ protected:
+  // Virtual functions to be implemented for generic data, as in DenseSet.
+  virtual uint64_t Hash(const void* obj, uint32_t cookie) const = 0;
+  virtual bool ObjEqual(const void* left, const void* right, uint32_t right_cookie) const = 0;
+  virtual size_t ObjectAllocSize(const void* obj) const = 0;
+  virtual uint32_t ObjExpireTime(const void* obj) const = 0;
+  virtual void ObjDelete(void* obj, bool has_ttl) const = 0;
+
+  // Returns the object equal to obj or nullptr. Expired objects are deleted on the way.
+  void* FindInternal(const void* obj, uint64_t hash, uint32_t cookie) const;
+
+  bool EraseInternal(const void* obj, uint32_t cookie);
+
+  // Assumes that the set holds no object equal to obj.
+  void AddUnique(void* obj, bool has_ttl, uint64_t hash);
+
+  MemoryResource* mr() const {
+    return slots_.get_allocator().resource();
+  }
+
+ private:
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kDeleted = 0xFE;
+  static constexpr uintptr_t kTtlBit = 1ULL << 55;
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  TaggedSet(const TaggedSet&) = delete;
+  TaggedSet& operator=(const TaggedSet&) = delete;
+
+  static uint8_t Tag(uint64_t hash) {
+    return hash & 0x7F;
+  }
+
+  size_t NumGroups() const {
+    return tags_.size() / kGroupSize;
+  }
+
+  // Returns the first group to probe, the following ones are at triangular offsets from it.
+  size_t FirstGroup(uint64_t hash) const {
+    return (hash >> 7) & (NumGroups() - 1);
+  }
+
+  // Returns the bit mask of the slots of the group with the given tag.
+  uint32_t MatchTag(size_t group, uint8_t tag) const;
+
+  // Returns the bit mask of the empty and deleted slots of the group, the only tags with the high
+  // bit set.
+  uint32_t MatchFree(size_t group) const;
+
+  size_t FindSlot(const void* obj, uint64_t hash, uint32_t cookie) const;
+
+  // Puts obj into the first free slot on its probe sequence, the table must have one.
+  void Insert(uintptr_t slot, uint64_t hash);
+
+  void EraseSlot(size_t pos);
+
+  // Deletes the object of the slot if it has expired and returns true if it did.
+  bool ExpireIfNeeded(size_t pos) const;
+
+  void Rehash(size_t num_groups);
+
+  PMR_NS::vector<uint8_t> tags_;
+  PMR_NS::vector<uintptr_t> slots_;
+  size_t size_ = 0;
+  size_t used_ = 0;  // full and deleted slots, the probes stop only at the empty ones.
+  size_t obj_malloc_used_ = 0;
+  uint32_t time_now_ = 0;
+  bool expiration_used_ = false;
+};
+
+// The string set of StringSet on top of TaggedSet, used to compare the two layouts. Members are
+// sds strings, followed by their expiry time if they have one.
+class TaggedStringSet : public TaggedSet {
+ public:
+  explicit TaggedStringSet(MemoryResource* mr = PMR_NS::get_default_resource()) : TaggedSet(mr) {
+  }
+
+  ~TaggedStringSet();
+
+  // Returns true if str was added.
+  bool Add(std::string_view str, uint32_t ttl_sec = UINT32_MAX);
+
+  bool Erase(std::string_view str) {
+    return EraseInternal(&str, 1);
+  }
+
+  bool Contains(std::string_view str) const {
+    return FindInternal(&str, Hash(&str, 1), 1) != nullptr;
+  }
+
+  uint32_t Scan(uint32_t cursor, const std::function<void(sds)>& cb) const;
+
+ protected:
+  // Cookie 0 means an sds member, 1 a string_view.
+  uint64_t Hash(const void* obj, uint32_t cookie) const override;
+  bool ObjEqual(const void* left, const void* right, uint32_t right_cookie) const override;
+  size_t ObjectAllocSize(const void* obj) const override;
+  uint32_t ObjExpireTime(const void* obj) const override;
+  void ObjDelete(void* obj, bool has_ttl) const override;
+};
+
+}  // namespace dfly
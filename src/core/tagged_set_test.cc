@@ -0,0 +1,116 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/tagged_set.h"
+
+#include <absl/strings/str_cat.h>
+#include <mimalloc.h>
+
+#include <set>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+using absl::StrCat;
+
+class TaggedSetTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    init_zmalloc_threadlocal(mi_heap_get_backing());
+  }
+
+  static set<string> Members(const TaggedStringSet& ts) {
+    set<string> res;
+    uint32_t cursor = 0;
+    do {
+      cursor = ts.Scan(cursor, [&res](sds member) {
+        EXPECT_TRUE(res.emplace(member, sdslen(member)).second);
+      });
+    } while (cursor != 0);
+    return res;
+  }
+
+  TaggedStringSet ts_;
+};
+
+TEST_F(TaggedSetTest, AddErase) {
+  EXPECT_TRUE(ts_.Add("foo"));
+  EXPECT_FALSE(ts_.Add("foo"));
+  EXPECT_TRUE(ts_.Add(""));
+  EXPECT_TRUE(ts_.Contains("foo"));
+  EXPECT_TRUE(ts_.Contains(""));
+  EXPECT_FALSE(ts_.Contains("bar"));
+  EXPECT_EQ(ts_.UpperBoundSize(), 2u);
+
+  EXPECT_TRUE(ts_.Erase("foo"));
+  EXPECT_FALSE(ts_.Erase("foo"));
+  EXPECT_FALSE(ts_.Contains("foo"));
+  EXPECT_EQ(Members(ts_), set<string>({""}));
+}
+
+// Grows through many sizes and keeps finding the members while others are erased around them.
+TEST_F(TaggedSetTest, GrowAndErase) {
+  set<string> expected;
+  for (unsigned i = 0; i < 10'000; ++i) {
+    string member = StrCat("member:", i);
+    ASSERT_TRUE(ts_.Add(member));
+    expected.insert(member);
+  }
+  EXPECT_EQ(ts_.UpperBoundSize(), 10'000u);
+  EXPECT_GE(ts_.SlotCount() * 7 / 8, ts_.UpperBoundSize());
+  EXPECT_GT(ts_.ObjMallocUsed(), 0u);
+
+  for (unsigned i = 0; i < 10'000; i += 3) {
+    ASSERT_TRUE(ts_.Erase(StrCat("member:", i)));
+    expected.erase(StrCat("member:", i));
+  }
+  for (unsigned i = 0; i < 10'000; ++i)
+    ASSERT_EQ(ts_.Contains(StrCat("member:", i)), i % 3 != 0) << i;
+  EXPECT_EQ(Members(ts_), expected);
+
+  // Churn reuses the deleted slots instead of growing the table.
+  size_t slots = ts_.SlotCount();
+  for (unsigned round = 0; round < 5; ++round) {
+    for (unsigned i = 0; i < 1000; ++i)
+      ASSERT_TRUE(ts_.Add(StrCat("churn:", i)));
+    for (unsigned i = 0; i < 1000; ++i)
+      ASSERT_TRUE(ts_.Erase(StrCat("churn:", i)));
+  }
+  EXPECT_EQ(ts_.SlotCount(), slots);
+
+  ts_.Clear();
+  EXPECT_TRUE(ts_.Empty());
+  EXPECT_EQ(ts_.ObjMallocUsed(), 0u);
+  EXPECT_FALSE(ts_.Contains("member:1"));
+}
+
+TEST_F(TaggedSetTest, Ttl) {
+  ts_.set_time(100);
+  EXPECT_TRUE(ts_.Add("short", 5));
+  EXPECT_TRUE(ts_.Add("long", 50));
+  EXPECT_TRUE(ts_.Add("forever"));
+  EXPECT_TRUE(ts_.ExpirationUsed());
+
+  ts_.set_time(104);
+  EXPECT_TRUE(ts_.Contains("short"));
+
+  ts_.set_time(105);
+  EXPECT_FALSE(ts_.Contains("short"));
+  EXPECT_EQ(ts_.UpperBoundSize(), 2u);
+  EXPECT_EQ(Members(ts_), set<string>({"long", "forever"}));
+
+  // An expired member can be added again.
+  ts_.set_time(200);
+  EXPECT_TRUE(ts_.Add("long"));
+  EXPECT_EQ(Members(ts_), set<string>({"long", "forever"}));
+}
+
+}  // namespace dfly
@@ -0,0 +1,388 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/time_series.h"
+
+#include <absl/base/casts.h>
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Delta-of-delta buckets: the prefix of the control bits, the number of payload bits and the
+// bias that makes the payload non-negative. Values outside of all buckets are written as
+// '1111' followed by the full 64 bits.
+struct DodBucket {
+  uint8_t prefix;
+  uint8_t prefix_len;
+  uint8_t bits;
+  int64_t bias;
+};
+
+constexpr DodBucket kDodBuckets[] = {{0b10, 2, 7, 63}, {0b110, 3, 9, 255}, {0b1110, 4, 12, 2047}};
+
+// Timestamps are subtracted with wrap-around so that extreme values can not overflow.
+inline int64_t WrapSub(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+
+inline int64_t WrapAdd(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+inline uint64_t LowMask(unsigned len) {
+  return len == 64 ? ~0ULL : (1ULL << len) - 1;
+}
+
+// Decodes a chunk bitstream sample by sample, mirroring TimeSeries::Chunk::Append.
+class ChunkReader {
+ public:
+  ChunkReader(const uint64_t* words, uint64_t bit_len) : words_(words), bit_len_(bit_len) {
+  }
+
+  // Returns false if the bitstream is exhausted or corrupted.
+  bool Next(TimeSeries::Sample* sample);
+
+  uint64_t pos() const {
+    return pos_;
+  }
+
+  int64_t delta = 0;
+  uint64_t value_bits = 0;
+  uint8_t leading = 0xFF;
+  uint8_t trailing = 0;
+
+ private:
+  bool ReadBits(unsigned len, uint64_t* res);
+  bool ReadTs(int64_t* ts);
+  bool ReadValue();
+
+  const uint64_t* words_;
+  uint64_t bit_len_;
+  uint64_t pos_ = 0;
+  int64_t ts_ = 0;
+  bool first_ = true;
+};
+
+bool ChunkReader::ReadBits(unsigned len, uint64_t* res) {
+  if (pos_ + len > bit_len_)
+    return false;
+  if (len == 0) {
+    *res = 0;
+    return true;
+  }
+
+  uint64_t idx = pos_ / 64;
+  unsigned offs = pos_ % 64;
+  unsigned room = 64 - offs;
+  if (len <= room) {
+    *res = (words_[idx] << offs) >> (64 - len);
+  } else {
+    unsigned rest = len - room;
+    uint64_t head = words_[idx] & LowMask(room);
+    *res = (head << rest) | (words_[idx + 1] >> (64 - rest));
+  }
+  pos_ += len;
+  return true;
+}
+
+bool ChunkReader::ReadTs(int64_t* ts) {
+  uint64_t bit;
+  if (!ReadBits(1, &bit))
+    return false;
+
+  int64_t dod = 0;
+  if (bit) {
+    unsigned ones = 1;
+    while (ones < 4) {
+      if (!ReadBits(1, &bit))
+        return false;
+      if (!bit)
+        break;
+      ++ones;
+    }
+
+    uint64_t payload;
+    if (ones == 4) {
+      if (!ReadBits(64, &payload))
+        return false;
+      dod = static_cast<int64_t>(payload);
+    } else {
+      const DodBucket& bucket = kDodBuckets[ones - 1];
+      if (!ReadBits(bucket.bits, &payload))
+        return false;
+      dod = static_cast<int64_t>(payload) - bucket.bias;
+    }
+  }
+  delta = WrapAdd(delta, dod);
+  *ts = WrapAdd(ts_, delta);
+  return true;
+}
+
+bool ChunkReader::ReadValue() {
+  uint64_t ctrl;
+  if (!ReadBits(1, &ctrl))
+    return false;
+  if (ctrl == 0)
+    return true;
+
+  if (!ReadBits(1, &ctrl))
+    return false;
+
+  if (ctrl == 1) {
+    uint64_t lead, sig;
+    if (!ReadBits(5, &lead) || !ReadBits(6, &sig))
+      return false;
+    ++sig;
+    if (lead + sig > 64)
+      return false;
+    leading = lead;
+    trailing = 64 - lead - sig;
+  } else if (leading == 0xFF) {
+    return false;
+  }
+
+  uint64_t xor_bits;
+  if (!ReadBits(64 - leading - trailing, &xor_bits))
+    return false;
+  value_bits ^= xor_bits << trailing;
+  return true;
+}
+
+bool ChunkReader::Next(TimeSeries::Sample* sample) {
+  if (first_) {
+    uint64_t ts;
+    if (!ReadBits(64, &ts) || !ReadBits(64, &value_bits))
+      return false;
+    ts_ = static_cast<int64_t>(ts);
+    first_ = false;
+  } else {
+    int64_t ts;
+    if (!ReadTs(&ts) || !ReadValue())
+      return false;
+    ts_ = ts;
+  }
+
+  sample->ts = ts_;
+  sample->value = absl::bit_cast<double>(value_bits);
+  return true;
+}
+
+}  // namespace
+
+void TimeSeries::Chunk::WriteBits(uint64_t val, unsigned len) {
+  if (len == 0)
+    return;
+
+  val &= LowMask(len);
+  unsigned offs = bit_len % 64;
+  if (offs == 0)
+    words.push_back(0);
+
+  unsigned room = 64 - offs;
+  if (len <= room) {
+    words.back() |= val << (room - len);
+  } else {
+    unsigned rest = len - room;
+    words.back() |= val >> rest;
+    words.push_back(val << (64 - rest));
+  }
+  bit_len += len;
+}
+
+void TimeSeries::Chunk::Append(int64_t ts, double value) {
+  uint64_t value_bits = absl::bit_cast<uint64_t>(value);
+
+  if (count == 0) {
+    WriteBits(ts, 64);
+    WriteBits(value_bits, 64);
+    first_ts = last_ts = ts;
+    last_value_bits = value_bits;
+    count = 1;
+    return;
+  }
+
+  int64_t delta = WrapSub(ts, last_ts);
+  int64_t dod = WrapSub(delta, last_delta);
+  if (dod == 0) {
+    WriteBits(0, 1);
+  } else {
+    auto it = find_if(begin(kDodBuckets), end(kDodBuckets), [dod](const DodBucket& b) {
+      return dod >= -b.bias && dod <= b.bias + 1;
+    });
+    if (it == end(kDodBuckets)) {
+      WriteBits(0b1111, 4);
+      WriteBits(dod, 64);
+    } else {
+      WriteBits(it->prefix, it->prefix_len);
+      WriteBits(dod + it->bias, it->bits);
+    }
+  }
+
+  uint64_t xor_bits = value_bits ^ last_value_bits;
+  if (xor_bits == 0) {
+    WriteBits(0, 1);
+  } else {
+    unsigned lead = min(absl::countl_zero(xor_bits), 31);
+    unsigned trail = absl::countr_zero(xor_bits);
+    if (leading != 0xFF && lead >= leading && trail >= trailing) {
+      WriteBits(0b10, 2);
+    } else {
+      WriteBits(0b11, 2);
+      WriteBits(lead, 5);
+      WriteBits(63 - lead - trail, 6);  // significant bits - 1
+      leading = lead;
+      trailing = trail;
+    }
+    WriteBits(xor_bits >> trailing, 64 - leading - trailing);
+  }
+
+  last_ts = ts;
+  last_delta = delta;
+  last_value_bits = value_bits;
+  ++count;
+}
+
+TimeSeries::TimeSeries(uint64_t retention_ms, PMR_NS::memory_resource* mr)
+    : chunks_(mr), retention_ms_(retention_ms) {
+}
+
+TimeSeries::~TimeSeries() {
+}
+
+bool TimeSeries::Add(int64_t ts, double value) {
+  if (!chunks_.empty() && ts <= chunks_.back().last_ts)
+    return false;
+
+  if (chunks_.empty() || chunks_.back().full()) {
+    if (!chunks_.empty())
+      chunks_.back().words.shrink_to_fit();  // sealed chunks are immutable.
+    chunks_.emplace_back(chunks_.get_allocator().resource());
+  }
+  chunks_.back().Append(ts, value);
+  ++size_;
+
+  ApplyRetention();
+  return true;
+}
+
+void TimeSeries::ApplyRetention() {
+  if (retention_ms_ == 0 || chunks_.size() < 2)
+    return;
+
+  // The last chunk holds the last sample and is never dropped.
+  int64_t min_ts = WrapSub(chunks_.back().last_ts, retention_ms_);
+  if (min_ts > chunks_.back().last_ts)  // wrapped around
+    return;
+
+  auto it = chunks_.begin();
+  while (it + 1 != chunks_.end() && it->last_ts < min_ts) {
+    size_ -= it->count;
+    ++it;
+  }
+  chunks_.erase(chunks_.begin(), it);
+}
+
+void TimeSeries::Range(int64_t from, int64_t to,
+                       absl::FunctionRef<bool(const Sample&)> cb) const {
+  if (chunks_.empty())
+    return;
+
+  if (retention_ms_) {
+    int64_t min_ts = WrapSub(chunks_.back().last_ts, retention_ms_);
+    if (min_ts <= chunks_.back().last_ts)
+      from = max(from, min_ts);
+  }
+
+  for (const Chunk& chunk : chunks_) {
+    if (chunk.last_ts < from)
+      continue;
+    if (chunk.first_ts > to)
+      break;
+
+    ChunkReader reader(chunk.words.data(), chunk.bit_len);
+    Sample sample;
+    for (uint32_t i = 0; i < chunk.count; ++i) {
+      if (!reader.Next(&sample)) {
+        LOG(DFATAL) << "Corrupted time series chunk";
+        return;
+      }
+      if (sample.ts < from)
+        continue;
+      if (sample.ts > to || !cb(sample))
+        return;
+    }
+  }
+}
+
+TimeSeries::Sample TimeSeries::last() const {
+  DCHECK(!chunks_.empty());
+  const Chunk& chunk = chunks_.back();
+  return Sample{chunk.last_ts, absl::bit_cast<double>(chunk.last_value_bits)};
+}
+
+string_view TimeSeries::chunk_data(size_t idx) const {
+  const Chunk& chunk = chunks_[idx];
+  return string_view{reinterpret_cast<const char*>(chunk.words.data()),
+                     chunk.words.size() * sizeof(uint64_t)};
+}
+
+bool TimeSeries::AddChunk(string_view data, uint32_t count) {
+  if (count == 0)
+    return false;
+
+  Chunk chunk(chunks_.get_allocator().resource());
+  chunk.words.resize((data.size() + 7) / 8);
+  if (!data.empty())
+    memcpy(chunk.words.data(), data.data(), data.size());
+
+  ChunkReader reader(chunk.words.data(), data.size() * 8);
+  Sample sample;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!reader.Next(&sample))
+      return false;
+    if (i == 0) {
+      if (!chunks_.empty() && sample.ts <= chunks_.back().last_ts)
+        return false;
+      chunk.first_ts = sample.ts;
+    } else if (sample.ts <= chunk.last_ts) {
+      return false;
+    }
+    chunk.last_ts = sample.ts;
+  }
+
+  // Restore the encoder state so that the chunk can be appended to, the bits past the end of
+  // the stream must be zero for WriteBits.
+  chunk.bit_len = reader.pos();
+  chunk.words.resize((chunk.bit_len + 63) / 64);
+  if (chunk.bit_len % 64)
+    chunk.words.back() &= ~LowMask(64 - chunk.bit_len % 64);
+  chunk.count = count;
+  chunk.last_delta = reader.delta;
+  chunk.last_value_bits = reader.value_bits;
+  chunk.leading = reader.leading;
+  chunk.trailing = reader.trailing;
+
+  chunks_.push_back(std::move(chunk));
+  size_ += count;
+  return true;
+}
+
+size_t TimeSeries::MallocUsed() const {
+  size_t res = sizeof(TimeSeries) + chunks_.capacity() * sizeof(Chunk);
+  for (const Chunk& chunk : chunks_) {
+    res += chunk.words.capacity() * sizeof(uint64_t);
+  }
+  return res;
+}
+
+}  // namespace dfly
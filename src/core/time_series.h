@@ -0,0 +1,113 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Time series of (timestamp, double) samples stored in Gorilla-style compressed chunks
+// (see "Gorilla: A Fast, Scalable, In-Memory Time Series Database", VLDB 2015).
+// Timestamps are encoded as delta-of-deltas and values as XORs with the previous value,
+// so regularly sampled metrics take 1-2 bytes per sample instead of 40+ in a sorted set.
+// Samples must be appended with strictly increasing timestamps.
+class TimeSeries {
+  TimeSeries(const TimeSeries&) = delete;
+  TimeSeries& operator=(const TimeSeries&) = delete;
+
+ public:
+  struct Sample {
+    int64_t ts;
+    double value;
+  };
+
+  // Chunks are sealed once their bitstream reaches this size.
+  static constexpr size_t kMaxChunkBytes = 1024;
+
+  // retention_ms - samples older than the last timestamp minus retention are dropped,
+  // 0 keeps all the samples.
+  TimeSeries(uint64_t retention_ms, PMR_NS::memory_resource* mr);
+  ~TimeSeries();
+
+  // Appends a sample. Returns false if ts is not greater than the last timestamp.
+  // Drops the chunks that fell completely out of the retention window.
+  bool Add(int64_t ts, double value);
+
+  // Calls cb for the samples with from <= ts <= to in ascending order until it returns false.
+  void Range(int64_t from, int64_t to, absl::FunctionRef<bool(const Sample&)> cb) const;
+
+  // Number of samples in the series.
+  size_t size() const {
+    return size_;
+  }
+
+  // Requires: size() > 0.
+  Sample last() const;
+
+  uint64_t retention_ms() const {
+    return retention_ms_;
+  }
+
+  void set_retention_ms(uint64_t retention_ms) {
+    retention_ms_ = retention_ms;
+  }
+
+  uint32_t num_chunks() const {
+    return chunks_.size();
+  }
+
+  // Raw bitstream of the chunk and its number of samples, used for serialization.
+  std::string_view chunk_data(size_t idx) const;
+  uint32_t chunk_count(size_t idx) const {
+    return chunks_[idx].count;
+  }
+
+  // Appends a chunk previously returned by chunk_data(). The chunk must start after the last
+  // sample of the series. Returns false if the data is corrupted.
+  bool AddChunk(std::string_view data, uint32_t count);
+
+  size_t MallocUsed() const;
+
+ private:
+  using Words = std::vector<uint64_t, PMR_NS::polymorphic_allocator<uint64_t>>;
+
+  struct Chunk {
+    explicit Chunk(PMR_NS::memory_resource* mr) : words(mr) {
+    }
+
+    void Append(int64_t ts, double value);
+    void WriteBits(uint64_t val, unsigned len);
+
+    bool full() const {
+      return bit_len >= kMaxChunkBytes * 8;
+    }
+
+    Words words;  // bitstream, most significant bit first.
+    uint64_t bit_len = 0;
+    uint32_t count = 0;
+    int64_t first_ts = 0;
+    int64_t last_ts = 0;
+
+    // Encoder state.
+    int64_t last_delta = 0;
+    uint64_t last_value_bits = 0;
+    uint8_t leading = 0xFF;  // leading zeros of the current XOR window, 0xFF if not set.
+    uint8_t trailing = 0;
+  };
+
+  void ApplyRetention();
+
+  std::vector<Chunk, PMR_NS::polymorphic_allocator<Chunk>> chunks_;
+  uint64_t retention_ms_;
+  size_t size_ = 0;
+};
+
+}  // namespace dfly
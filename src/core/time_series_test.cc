@@ -0,0 +1,129 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/time_series.h"
+
+#include <absl/base/casts.h>
+#include <gmock/gmock.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class TimeSeriesTest : public ::testing::Test {
+ protected:
+  vector<TimeSeries::Sample> Collect(const TimeSeries& ts, int64_t from = INT64_MIN,
+                                     int64_t to = INT64_MAX) {
+    vector<TimeSeries::Sample> res;
+    ts.Range(from, to, [&](const TimeSeries::Sample& s) {
+      res.push_back(s);
+      return true;
+    });
+    return res;
+  }
+
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+TEST_F(TimeSeriesTest, Basic) {
+  TimeSeries ts(0, mr_);
+  EXPECT_EQ(0, ts.size());
+  EXPECT_TRUE(Collect(ts).empty());
+
+  EXPECT_TRUE(ts.Add(1000, 1.5));
+  EXPECT_TRUE(ts.Add(2000, 1.5));
+  EXPECT_TRUE(ts.Add(3000, -2.25));
+  EXPECT_FALSE(ts.Add(3000, 1));
+  EXPECT_FALSE(ts.Add(10, 1));
+  EXPECT_EQ(3, ts.size());
+  EXPECT_EQ(3000, ts.last().ts);
+  EXPECT_EQ(-2.25, ts.last().value);
+
+  auto samples = Collect(ts, 1500, 3000);
+  ASSERT_EQ(2, samples.size());
+  EXPECT_EQ(2000, samples[0].ts);
+  EXPECT_EQ(1.5, samples[0].value);
+  EXPECT_EQ(-2.25, samples[1].value);
+}
+
+TEST_F(TimeSeriesTest, Encoding) {
+  // Irregular intervals and values that exercise all delta-of-delta buckets and XOR windows.
+  vector<TimeSeries::Sample> expected;
+  mt19937 rand(10);
+  int64_t ts = -5000;
+  const int64_t steps[] = {1, 60, 64, 300, 2000, 4000, 1LL << 40};
+  const double values[] = {0,   -0.0, 1e300, numeric_limits<double>::denorm_min(), NAN,
+                           1.1, 1.2,  1.3,   -INFINITY};
+  for (unsigned i = 0; i < 5000; ++i) {
+    ts += steps[rand() % size(steps)];
+    double value = rand() % 2 ? values[rand() % size(values)] : double(rand() % 100);
+    expected.push_back({ts, value});
+  }
+
+  TimeSeries series(0, mr_);
+  for (const auto& s : expected)
+    ASSERT_TRUE(series.Add(s.ts, s.value));
+  EXPECT_GT(series.num_chunks(), 1u);
+
+  auto samples = Collect(series);
+  ASSERT_EQ(expected.size(), samples.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i].ts, samples[i].ts) << i;
+    ASSERT_EQ(absl::bit_cast<uint64_t>(expected[i].value),
+              absl::bit_cast<uint64_t>(samples[i].value))
+        << i;
+  }
+}
+
+TEST_F(TimeSeriesTest, Compression) {
+  TimeSeries series(0, mr_);
+  for (unsigned i = 0; i < 10000; ++i)
+    series.Add(1'700'000'000'000 + i * 1000, 20 + (i % 10) * 0.5);
+
+  // A regular series must take a few bytes per sample.
+  EXPECT_LT(series.MallocUsed(), 10000 * 4);
+}
+
+TEST_F(TimeSeriesTest, Retention) {
+  TimeSeries series(1000, mr_);
+  for (int64_t i = 0; i < 100000; i += 10)
+    series.Add(i, i);
+
+  auto samples = Collect(series);
+  ASSERT_EQ(101, samples.size());
+  EXPECT_EQ(98990, samples.front().ts);
+  EXPECT_LE(series.num_chunks(), 2u);
+  EXPECT_LT(series.size(), 10000u);
+}
+
+TEST_F(TimeSeriesTest, Chunks) {
+  TimeSeries series(0, mr_);
+  for (unsigned i = 0; i < 3000; ++i)
+    series.Add(i * 7, i * 0.25);
+
+  TimeSeries copy(0, mr_);
+  for (unsigned i = 0; i < series.num_chunks(); ++i)
+    ASSERT_TRUE(copy.AddChunk(series.chunk_data(i), series.chunk_count(i)));
+  EXPECT_EQ(series.size(), copy.size());
+  EXPECT_FALSE(copy.AddChunk(series.chunk_data(0), series.chunk_count(0)));
+
+  // The restored series continues the encoding of its last chunk.
+  ASSERT_TRUE(copy.Add(3000 * 7, 1));
+  auto samples = Collect(copy, 2999 * 7);
+  ASSERT_EQ(2, samples.size());
+  EXPECT_EQ(2999 * 0.25, samples[0].value);
+  EXPECT_EQ(1, samples[1].value);
+
+  TimeSeries broken(0, mr_);
+  string_view data = series.chunk_data(0);
+  EXPECT_FALSE(broken.AddChunk(data.substr(0, 10), series.chunk_count(0)));
+}
+
+}  // namespace dfly
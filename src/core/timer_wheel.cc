@@ -0,0 +1,167 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/timer_wheel.h"
+
+#include <absl/numeric/bits.h>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Keys longer than this are allocated on the heap by std::string.
+constexpr size_t kInlineKeyLen = 15;
+
+size_t KeyHeapBytes(const string& key) {
+  return key.size() > kInlineKeyLen ? key.capacity() + 1 : 0;
+}
+
+}  // namespace
+
+TimerWheel::TimerWheel(uint32_t tick_ms, uint64_t now_ms)
+    : tick_ms_(tick_ms), now_tick_(now_ms / tick_ms), cascaded_tick_(now_tick_) {
+  DCHECK_GT(tick_ms, 0u);
+}
+
+void TimerWheel::Add(string_view key, uint64_t deadline_ms) {
+  Place(string{key}, deadline_ms);
+}
+
+void TimerWheel::Place(string key, uint64_t deadline_ms) {
+  uint64_t tick = max((deadline_ms + tick_ms_ - 1) / tick_ms_, now_tick_);
+
+  // The level is the highest base-64 digit in which the tick differs from the current one, so
+  // that the slot is cascaded before the level wraps around.
+  uint64_t diff = tick ^ now_tick_;
+  unsigned level = diff ? (63 - absl::countl_zero(diff)) / kSlotBits : 0;
+
+  Slot* slot;
+  if (level < kLevels) {
+    slot = &levels_[level][(tick >> (level * kSlotBits)) & (kSlots - 1)];
+  } else {
+    slot = &far_;
+  }
+
+  size_t key_bytes = KeyHeapBytes(key);
+  auto [it, inserted] = slot->try_emplace(std::move(key), deadline_ms);
+  if (!inserted) {
+    it->second = min(it->second, deadline_ms);
+    return;
+  }
+
+  ++size_;
+  key_bytes_ += key_bytes;
+  if (level < kLevels)
+    ++level_size_[level];
+}
+
+void TimerWheel::Cascade() {
+  auto redistribute = [this](Slot* slot, size_t* level_size) {
+    Slot entries = std::move(*slot);
+    slot->clear();
+    size_ -= entries.size();
+    if (level_size)
+      *level_size -= entries.size();
+
+    while (!entries.empty()) {
+      auto node = entries.extract(entries.begin());
+      key_bytes_ -= KeyHeapBytes(node.key());
+      Place(std::move(node.key()), node.mapped());
+    }
+  };
+
+  for (unsigned level = 1; level < kLevels; ++level) {
+    unsigned shift = level * kSlotBits;
+    if (now_tick_ & ((uint64_t(1) << shift) - 1))
+      return;
+    redistribute(&levels_[level][(now_tick_ >> shift) & (kSlots - 1)], &level_size_[level]);
+  }
+
+  if ((now_tick_ & ((uint64_t(1) << (kLevels * kSlotBits)) - 1)) == 0)
+    redistribute(&far_, nullptr);
+}
+
+size_t TimerWheel::Advance(uint64_t now_ms, size_t limit,
+                           absl::FunctionRef<void(string_view, uint64_t)> cb) {
+  uint64_t target = now_ms / tick_ms_;
+  size_t reported = 0;
+
+  while (now_tick_ <= target) {
+    if (size_ == 0) {
+      now_tick_ = cascaded_tick_ = target + 1;
+      break;
+    }
+
+    if (cascaded_tick_ != now_tick_) {
+      Cascade();
+      cascaded_tick_ = now_tick_;
+    }
+
+    Slot& slot = levels_[0][now_tick_ & (kSlots - 1)];
+    while (!slot.empty()) {
+      if (reported == limit)
+        return reported;
+
+      auto node = slot.extract(slot.begin());
+      --size_;
+      --level_size_[0];
+      key_bytes_ -= KeyHeapBytes(node.key());
+      ++reported;
+      cb(node.key(), node.mapped());
+    }
+
+    // With level 0 empty, nothing happens until the next cascade.
+    uint64_t next = level_size_[0] ? now_tick_ + 1 : (now_tick_ | (kSlots - 1)) + 1;
+    now_tick_ = min(next, target + 1);
+  }
+
+  return reported;
+}
+
+size_t TimerWheel::DueCount(uint64_t now_ms) const {
+  uint64_t target = now_ms / tick_ms_;
+  if (target < now_tick_)
+    return 0;
+
+  // Counts the slots whose range starts at or before target. Slots of the upper levels may also
+  // hold keys that are not due yet, hence the estimate.
+  size_t res = 0;
+  for (unsigned level = 0; level < kLevels; ++level) {
+    unsigned shift = level * kSlotBits;
+    uint64_t current = now_tick_ >> shift;
+    uint64_t last = min(target >> shift, current | (kSlots - 1));
+    for (uint64_t i = level ? current + 1 : current; i <= last; ++i) {
+      res += levels_[level][i & (kSlots - 1)].size();
+    }
+  }
+  return res;
+}
+
+size_t TimerWheel::MallocUsed() const {
+  constexpr size_t kEntryBytes = sizeof(Slot::value_type) + 1;  // includes the control byte.
+  size_t res = key_bytes_ + far_.capacity() * kEntryBytes;
+  for (const auto& level : levels_) {
+    for (const Slot& slot : level) {
+      res += slot.capacity() * kEntryBytes;
+    }
+  }
+  return res;
+}
+
+void TimerWheel::Clear() {
+  for (auto& level : levels_) {
+    for (Slot& slot : level) {
+      slot = Slot{};
+    }
+  }
+  far_ = Slot{};
+  level_size_.fill(0);
+  size_ = key_bytes_ = 0;
+}
+
+}  // namespace dfly
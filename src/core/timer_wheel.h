@@ -0,0 +1,70 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/functional/function_ref.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace dfly {
+
+// Hierarchical timing wheel of keys indexed by their deadline. Deadlines are rounded up to ticks
+// of tick_ms, so a key is reported at most one tick after its deadline and never before it.
+// Level l holds the keys due within 64^(l + 1) ticks; its slots are moved to the lower levels
+// as time advances, so Advance only touches the keys that are due. Keys that are further away
+// than the top level are kept aside until the top level wraps around.
+//
+// The wheel does not track removals: a key may be reported even though it was deleted or its
+// deadline was changed, and the caller is expected to check the actual state of the key.
+// Adding a key twice to the same slot keeps a single entry with the earliest deadline.
+class TimerWheel {
+ public:
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 6;
+  static constexpr unsigned kSlots = 1u << kSlotBits;
+
+  TimerWheel(uint32_t tick_ms, uint64_t now_ms);
+
+  void Add(std::string_view key, uint64_t deadline_ms);
+
+  // Passes to cb up to limit keys that are due at now_ms, together with their deadline, and
+  // removes them from the wheel. Returns the number of keys passed. If the limit is reached,
+  // the remaining due keys are reported by the next call.
+  size_t Advance(uint64_t now_ms, size_t limit,
+                 absl::FunctionRef<void(std::string_view key, uint64_t deadline_ms)> cb);
+
+  // Estimate of the number of keys that are due at now_ms but were not reported yet.
+  size_t DueCount(uint64_t now_ms) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t MallocUsed() const;
+
+  void Clear();
+
+ private:
+  // key -> deadline in milliseconds.
+  using Slot = absl::flat_hash_map<std::string, uint64_t>;
+
+  void Place(std::string key, uint64_t deadline_ms);
+  void Cascade();
+
+  uint32_t tick_ms_;
+  uint64_t now_tick_;       // the tick whose level 0 slot is drained next.
+  uint64_t cascaded_tick_;  // the last tick for which the upper levels were cascaded.
+  size_t size_ = 0;
+  size_t key_bytes_ = 0;  // heap memory of the stored keys.
+  std::array<size_t, kLevels> level_size_{};
+  std::array<std::array<Slot, kSlots>, kLevels> levels_;
+  Slot far_;  // keys beyond the range of the top level.
+};
+
+}  // namespace dfly
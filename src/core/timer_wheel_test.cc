@@ -0,0 +1,114 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/timer_wheel.h"
+
+#include <absl/strings/str_cat.h>
+
+#include <map>
+#include <random>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class TimerWheelTest : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kTick = 10;
+
+  // Advances the wheel until now_ms and checks that every reported key is due.
+  vector<string> AdvanceTo(TimerWheel* wheel, uint64_t now_ms, size_t limit = SIZE_MAX) {
+    vector<string> res;
+    wheel->Advance(now_ms, limit, [&](string_view key, uint64_t deadline_ms) {
+      EXPECT_LE(deadline_ms, now_ms) << key;
+      res.emplace_back(key);
+    });
+    return res;
+  }
+};
+
+TEST_F(TimerWheelTest, Basic) {
+  TimerWheel wheel(kTick, 1000);
+  wheel.Add("a", 1005);
+  wheel.Add("b", 1010);
+  wheel.Add("c", 900);  // already due.
+  wheel.Add("a", 1003);
+  EXPECT_EQ(wheel.size(), 3u);
+
+  EXPECT_EQ(AdvanceTo(&wheel, 1000), vector<string>{"c"});
+  EXPECT_EQ(wheel.DueCount(1009), 0u);
+  EXPECT_EQ(wheel.DueCount(1010), 2u);
+  EXPECT_TRUE(AdvanceTo(&wheel, 1009).empty());
+
+  auto keys = AdvanceTo(&wheel, 1010);
+  sort(keys.begin(), keys.end());
+  EXPECT_EQ(keys, (vector<string>{"a", "b"}));
+  EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, Limit) {
+  TimerWheel wheel(kTick, 0);
+  for (unsigned i = 0; i < 100; ++i) {
+    wheel.Add(absl::StrCat("key", i), 50);
+  }
+
+  EXPECT_EQ(AdvanceTo(&wheel, 100, 30).size(), 30u);
+  EXPECT_EQ(wheel.DueCount(100), 70u);
+  EXPECT_EQ(AdvanceTo(&wheel, 100, 80).size(), 70u);
+  EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, Levels) {
+  const uint64_t start = 123456;
+  TimerWheel wheel(kTick, start);
+
+  // Spreads deadlines over all levels and beyond, up to 100 days.
+  mt19937_64 rng(1);
+  uniform_int_distribution<uint64_t> exp_dist(0, 33);
+  map<string, uint64_t> deadlines;
+  for (unsigned i = 0; i < 2000; ++i) {
+    uint64_t delay = rng() % (uint64_t(1) << exp_dist(rng));
+    string key = absl::StrCat("key:", i);
+    deadlines[key] = start + delay;
+    wheel.Add(key, start + delay);
+  }
+  EXPECT_GT(wheel.MallocUsed(), 0u);
+
+  // Advances in irregular steps and checks that each key is reported exactly once and at most a
+  // tick after its deadline.
+  uint64_t now = start;
+  size_t reported = 0;
+  while (wheel.size() > 0) {
+    now += 1 + rng() % (uint64_t(1) << exp_dist(rng) % 25);
+    wheel.Advance(now, SIZE_MAX, [&](string_view key, uint64_t deadline_ms) {
+      auto it = deadlines.find(string(key));
+      ASSERT_TRUE(it != deadlines.end()) << key;
+      EXPECT_EQ(it->second, deadline_ms);
+      EXPECT_LE(deadline_ms, now);
+      deadlines.erase(it);
+      ++reported;
+    });
+
+    // Nothing that is left is due.
+    for (const auto& [key, deadline] : deadlines) {
+      ASSERT_GT(deadline + kTick, now - now % kTick) << key;
+    }
+  }
+  EXPECT_EQ(reported, 2000u);
+  EXPECT_TRUE(deadlines.empty());
+}
+
+TEST_F(TimerWheelTest, Clear) {
+  TimerWheel wheel(kTick, 0);
+  wheel.Add("a", 10);
+  wheel.Add(string(100, 'x'), 1ULL << 40);
+  wheel.Clear();
+  EXPECT_EQ(wheel.size(), 0u);
+  EXPECT_TRUE(AdvanceTo(&wheel, 1ULL << 41).empty());
+}
+
+}  // namespace dfly
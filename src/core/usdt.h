@@ -0,0 +1,31 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// Statically defined tracing probes (USDT) for attaching bpftrace or perf to a running process.
+// A probe compiles to a single nop plus an ELF note describing the location and its arguments,
+// so it costs nothing until a tracer attaches. Arguments must be integers or pointers and are
+// not evaluated when the build has no probe support.
+//
+// Example:
+// DFLY_TRACE(tx_run_start, txid, shard_id);
+// bpftrace -e 'usdt:./dragonfly:dragonfly:tx_run_start { @[arg1] = count(); }'
+//
+// See tools/usdt for ready made scripts.
+
+#pragma once
+
+#ifdef DFLY_USDT
+
+#define SDT_USE_VARIADIC
+#include <sys/sdt.h>
+
+#define DFLY_TRACE(name, ...) STAP_PROBEV(dragonfly, name, ##__VA_ARGS__)
+
+#else
+
+#define DFLY_TRACE(name, ...) \
+  do {                        \
+  } while (0)
+
+#endif
@@ -24,6 +24,12 @@ struct AclKeys {
   // The user is allowed to "touch" any key. No glob matching required.
   // Alias for ~*
   bool all_keys = false;
+
+  // Derived from key_globs by acl::CompileKeyGlobs. Patterns of the form "<literal>*" sorted by
+  // their literal prefix, matched with a comparison instead of a glob match.
+  std::vector<GlobType> prefix_globs;
+  // Indices into key_globs of the remaining patterns.
+  std::vector<uint32_t> other_globs;
 };
 
 // The second bool denotes if the pattern contains an asterisk and it's
@@ -7,6 +7,8 @@
 #include <absl/strings/match.h>
 #include <absl/strings/numbers.h>
 
+#include <array>
+#include <cstdint>
 #include <optional>
 #include <string_view>
 #include <utility>
@@ -31,6 +33,68 @@ template <class T> constexpr bool is_fint = false;
 
 template <auto min, auto max> constexpr bool is_fint<FInt<min, max>> = true;
 
+// Compile time table of the option keywords of a command, matched ignoring case. The table is
+// indexed by a perfect hash of the length and the first, second and last characters of the
+// keywords, whose multiplier is searched when the table is built, so that matching an argument
+// takes a single comparison instead of one per keyword. Create with MakeTagTable.
+template <typename T, size_t N> class TagTable {
+ public:
+  using Tag = std::pair<std::string_view, T>;
+
+  consteval explicit TagTable(const Tag (&tags)[N]) {
+    static_assert(N > 0 && N <= kSlots / 2, "too many tags");
+    for (size_t i = 0; i < N; ++i)
+      tags_[i] = tags[i];
+
+    for (uint32_t seed = 0x9E3779B1u, attempt = 0; attempt < 1024; seed += 2, ++attempt) {
+      if (TrySeed(seed))
+        return;
+    }
+    throw "no perfect hash for the tags, they are too alike";
+  }
+
+  std::optional<T> Find(std::string_view arg) const {
+    uint8_t pos = slots_[Slot(seed_, arg)];
+    if (pos == 0 || !absl::EqualsIgnoreCase(arg, tags_[pos - 1].first))
+      return std::nullopt;
+    return tags_[pos - 1].second;
+  }
+
+ private:
+  static constexpr unsigned kBits = 6;
+  static constexpr size_t kSlots = 1u << kBits;
+
+  // ORing 0x20 lower cases the letters, other characters may collide but are compared anyway.
+  static constexpr uint32_t Slot(uint32_t seed, std::string_view str) {
+    auto at = [str](size_t i) -> uint32_t { return i < str.size() ? uint8_t(str[i]) | 0x20 : 0; };
+    uint32_t key = uint32_t(str.size()) << 24 | at(0) << 16 | at(1) << 8 | at(str.size() - 1);
+    return (key * seed) >> (32 - kBits);
+  }
+
+  consteval bool TrySeed(uint32_t seed) {
+    std::array<uint8_t, kSlots> slots{};
+    for (size_t i = 0; i < N; ++i) {
+      uint8_t& slot = slots[Slot(seed, tags_[i].first)];
+      if (slot != 0)
+        return false;
+      slot = i + 1;
+    }
+    seed_ = seed;
+    slots_ = slots;
+    return true;
+  }
+
+  std::array<Tag, N> tags_{};
+  std::array<uint8_t, kSlots> slots_{};  // index + 1 of the tag, 0 if empty
+  uint32_t seed_ = 0;
+};
+
+// Builds a TagTable, e.g. constexpr auto kTags = MakeTagTable<Opt>({{"NX", Opt::NX}, ...})
+template <typename T, size_t N>
+consteval TagTable<T, N> MakeTagTable(const std::pair<std::string_view, T> (&tags)[N]) {
+  return TagTable<T, N>{tags};
+}
+
 // Utility class for easily parsing command options from argument lists.
 struct CmdArgParser {
   enum ErrorType {
@@ -117,6 +181,32 @@ struct CmdArgParser {
     return res;
   }
 
+  // Like MapNext, with the cases of a TagTable.
+  template <typename T, size_t N> T MapNextTag(const TagTable<T, N>& table) {
+    if (cur_i_ >= args_.size()) {
+      Report(OUT_OF_BOUNDS, cur_i_);
+      return T{};
+    }
+
+    auto idx = cur_i_++;
+    std::optional<T> res = table.Find(SafeSV(idx));
+    if (!res) {
+      Report(INVALID_CASES, idx);
+      return T{};
+    }
+    return *res;
+  }
+
+  // Like TryMapNext, with the cases of a TagTable.
+  template <typename T, size_t N> std::optional<T> TryMapNextTag(const TagTable<T, N>& table) {
+    if (cur_i_ >= args_.size())
+      return std::nullopt;
+
+    std::optional<T> res = table.Find(SafeSV(cur_i_));
+    cur_i_ += res.has_value();
+    return res;
+  }
+
   // Check if the next value is equal to a specific tag. If equal, its consumed.
   template <class... Args> bool Check(std::string_view tag, Args*... args) {
     if (cur_i_ + sizeof...(Args) >= args_.size())
@@ -132,6 +132,34 @@ TEST_F(CmdArgParserTest, TryMapNext) {
   EXPECT_FALSE(parser.HasError());
 }
 
+TEST_F(CmdArgParserTest, TagTable) {
+  enum class Opt { NX, XX, GT, LT, EXAT, PXAT };
+  constexpr auto kOpts = MakeTagTable<Opt>({{"NX", Opt::NX},
+                                            {"XX", Opt::XX},
+                                            {"GT", Opt::GT},
+                                            {"LT", Opt::LT},
+                                            {"EXAT", Opt::EXAT},
+                                            {"PXAT", Opt::PXAT}});
+
+  EXPECT_EQ(kOpts.Find("XX"), Opt::XX);
+  EXPECT_EQ(kOpts.Find("pxAT"), Opt::PXAT);
+  EXPECT_EQ(kOpts.Find("lt"), Opt::LT);
+  EXPECT_EQ(kOpts.Find("XXX"), std::nullopt);
+  EXPECT_EQ(kOpts.Find("EXA"), std::nullopt);
+  EXPECT_EQ(kOpts.Find(""), std::nullopt);
+
+  auto parser = Make({"gt", "NOPE", "exat"});
+  EXPECT_EQ(parser.TryMapNextTag(kOpts), Opt::GT);
+  EXPECT_EQ(parser.TryMapNextTag(kOpts), std::nullopt);
+  EXPECT_FALSE(parser.HasError());
+
+  parser.MapNextTag(kOpts);
+  auto err = parser.Error();
+  EXPECT_TRUE(err);
+  EXPECT_EQ(err->type, CmdArgParser::INVALID_CASES);
+  EXPECT_EQ(err->index, 1);
+}
+
 TEST_F(CmdArgParserTest, IgnoreCase) {
   auto parser = Make({"hello", "marker", "taail", "world"});
 
@@ -83,6 +83,11 @@ class ConnectionContext {
 
   virtual size_t UsedMemory() const;
 
+  // Called when the server dropped the subscription to a shard channel, for example because its
+  // slot was migrated to another node.
+  virtual void OnShardChannelRemoved(std::string_view channel) {
+  }
+
   // connection state / properties.
   bool conn_closing : 1;
   bool req_auth : 1;
@@ -99,6 +104,9 @@ class ConnectionContext {
   // Skip ACL validation, used by internal commands and commands run on admin port
   bool skip_acl_validation = false;
 
+  // Parameters and feedback of the last squashed pipeline dispatch.
+  SquashInfo squash_info;
+
   // How many async subscription sources are active: monitor and/or pubsub - at most 2.
   uint8_t subscriptions;
 
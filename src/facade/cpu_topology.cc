@@ -0,0 +1,232 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/cpu_topology.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+#include <absl/strings/strip.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "facade/dragonfly_listener.h"
+#include "facade/numa.h"
+#include "io/file_util.h"
+#include "util/proactor_pool.h"
+
+ABSL_FLAG(bool, cpu_placement, false,
+          "If true, pins the proactor threads by the cpu topology: the shard and connection "
+          "threads are placed on the cache domains that serve the interrupts of nic_interface, "
+          "and on separate cores before SMT siblings. The layout is logged at startup.");
+ABSL_FLAG(std::string, nic_interface, "",
+          "Network interface whose interrupt affinity guides cpu_placement, e.g. eth0.");
+
+namespace facade {
+
+using namespace std;
+
+namespace {
+
+constexpr char kCpuDir[] = "/sys/devices/system/cpu";
+
+// The first cpu of a sysfs list identifies the group of cpus, i.e. a core or a cache domain.
+int FirstCpu(const string& path) {
+  auto list = io::ReadFileToString(path);
+  if (!list)
+    return -1;
+  vector<int> cpus = ParseCpuList(*list);
+  return cpus.empty() ? -1 : *min_element(cpus.begin(), cpus.end());
+}
+
+// Returns the domain of the highest level cache of the cpu.
+int LastLevelCacheDomain(int cpu) {
+  int res = -1, max_level = 0;
+  for (unsigned index = 0;; ++index) {
+    string dir = absl::StrCat(kCpuDir, "/cpu", cpu, "/cache/index", index);
+    auto level_str = io::ReadFileToString(absl::StrCat(dir, "/level"));
+    int level;
+    if (!level_str)
+      break;
+    if (!absl::SimpleAtoi(absl::StripAsciiWhitespace(*level_str), &level) || level < max_level)
+      continue;
+    if (int domain = FirstCpu(absl::StrCat(dir, "/shared_cpu_list")); domain >= 0) {
+      max_level = level;
+      res = domain;
+    }
+  }
+  return res;
+}
+
+// Returns the cpus that serve the interrupts of the msi vectors of the nic.
+vector<int> NicIrqCpus(string_view nic) {
+  namespace fs = std::filesystem;
+
+  error_code ec;
+  fs::directory_iterator it{absl::StrCat("/sys/class/net/", nic, "/device/msi_irqs"), ec};
+  if (ec) {
+    LOG(WARNING) << "Could not read the interrupts of " << nic << ": " << ec.message();
+    return {};
+  }
+
+  vector<int> res;
+  for (const fs::directory_entry& entry : it) {
+    string irq = entry.path().filename().string();
+    auto list = io::ReadFileToString(absl::StrCat("/proc/irq/", irq, "/effective_affinity_list"));
+    if (!list || absl::StripAsciiWhitespace(*list).empty())
+      list = io::ReadFileToString(absl::StrCat("/proc/irq/", irq, "/smp_affinity_list"));
+    if (list) {
+      vector<int> cpus = ParseCpuList(*list);
+      res.insert(res.end(), cpus.begin(), cpus.end());
+    }
+  }
+  sort(res.begin(), res.end());
+  res.erase(unique(res.begin(), res.end()), res.end());
+  return res;
+}
+
+// The threads near every cpu after PlaceProactorThreads, written once before the listeners start.
+vector<vector<unsigned>> placed_cpu_threads;
+
+}  // namespace
+
+CpuTopology::CpuTopology(vector<Cpu> cpus, vector<int> irq_cpus)
+    : cpus_{std::move(cpus)}, irq_cpus_{std::move(irq_cpus)} {
+  sort(cpus_.begin(), cpus_.end(), [](const Cpu& a, const Cpu& b) { return a.id < b.id; });
+  sort(irq_cpus_.begin(), irq_cpus_.end());
+}
+
+CpuTopology CpuTopology::Load(string_view nic) {
+  vector<Cpu> cpus;
+  if (auto online = io::ReadFileToString(absl::StrCat(kCpuDir, "/online")); online) {
+    for (int id : ParseCpuList(*online)) {
+      Cpu cpu{id, FirstCpu(absl::StrCat(kCpuDir, "/cpu", id, "/topology/thread_siblings_list")),
+              LastLevelCacheDomain(id)};
+      // Without sysfs details every cpu is a core of its own in a single domain.
+      if (cpu.core < 0)
+        cpu.core = id;
+      if (cpu.l3 < 0)
+        cpu.l3 = 0;
+      cpus.push_back(cpu);
+    }
+  }
+
+  return CpuTopology{std::move(cpus), nic.empty() ? vector<int>{} : NicIrqCpus(nic)};
+}
+
+auto CpuTopology::Find(int cpu) const -> const Cpu* {
+  auto it = lower_bound(cpus_.begin(), cpus_.end(), cpu,
+                        [](const Cpu& c, int id) { return c.id < id; });
+  return it != cpus_.end() && it->id == cpu ? &*it : nullptr;
+}
+
+vector<int> CpuTopology::PlaceThreads(unsigned num_threads, unsigned num_shards,
+                                      unsigned conn_start, unsigned conn_total) const {
+  if (cpus_.empty())
+    return {};
+
+  absl::flat_hash_map<int, unsigned> domain_irqs;
+  for (int id : irq_cpus_) {
+    if (const Cpu* cpu = Find(id); cpu)
+      domain_irqs[cpu->l3]++;
+  }
+
+  // The rank of a cpu among the SMT siblings of its core.
+  absl::flat_hash_map<int, unsigned> core_cpus;
+  vector<unsigned> smt_rank(cpus_.size());
+  for (size_t i = 0; i < cpus_.size(); ++i)
+    smt_rank[i] = core_cpus[cpus_[i].core]++;
+
+  vector<size_t> order(cpus_.size());
+  iota(order.begin(), order.end(), 0);
+  auto cpu_key = [&](size_t i) {
+    const Cpu& cpu = cpus_[i];
+    auto it = domain_irqs.find(cpu.l3);
+    unsigned irqs = it == domain_irqs.end() ? 0 : it->second;
+    bool is_irq = binary_search(irq_cpus_.begin(), irq_cpus_.end(), cpu.id);
+    return make_tuple(smt_rank[i], -int(irqs), cpu.l3, is_irq, cpu.id);
+  };
+  sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cpu_key(a) < cpu_key(b); });
+
+  auto thread_rank = [&](unsigned thread) {
+    bool shard = thread < num_shards;
+    bool conn = thread >= conn_start && thread < conn_start + conn_total;
+    return shard && conn ? 0 : (conn ? 1 : (shard ? 2 : 3));
+  };
+  vector<unsigned> threads(num_threads);
+  iota(threads.begin(), threads.end(), 0);
+  stable_sort(threads.begin(), threads.end(),
+              [&](unsigned a, unsigned b) { return thread_rank(a) < thread_rank(b); });
+
+  vector<int> res(num_threads);
+  for (size_t i = 0; i < threads.size(); ++i)
+    res[threads[i]] = cpus_[order[i % order.size()]].id;
+  return res;
+}
+
+void PlaceProactorThreads(util::ProactorPool* pool, unsigned num_shards) {
+  if (!absl::GetFlag(FLAGS_cpu_placement))
+    return;
+
+  string nic = absl::GetFlag(FLAGS_nic_interface);
+  CpuTopology topology = CpuTopology::Load(nic);
+  auto [conn_start, conn_total] = Listener::ConnectionThreads(pool->size());
+  vector<int> plan = topology.PlaceThreads(pool->size(), num_shards, conn_start, conn_total);
+  if (plan.empty()) {
+    LOG(WARNING) << "Could not read the cpu topology, cpu_placement is ignored";
+    return;
+  }
+
+  pool->AwaitBrief([&](unsigned index, auto*) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(plan[index], &cpus);
+    if (int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); res != 0)
+      LOG(WARNING) << "Could not pin thread " << index << " to cpu " << plan[index] << ": "
+                   << strerror(res);
+  });
+
+  placed_cpu_threads.assign(topology.cpus().back().id + 1, {});
+  for (unsigned thread = 0; thread < plan.size(); ++thread)
+    placed_cpu_threads[plan[thread]].push_back(thread);
+  vector<vector<unsigned>> domain_threads = placed_cpu_threads;
+  for (const auto& cpu : topology.cpus()) {
+    if (placed_cpu_threads[cpu.id].empty()) {
+      for (const auto& other : topology.cpus()) {
+        if (other.l3 == cpu.l3)
+          domain_threads[cpu.id].insert(domain_threads[cpu.id].end(),
+                                        placed_cpu_threads[other.id].begin(),
+                                        placed_cpu_threads[other.id].end());
+      }
+    }
+  }
+  placed_cpu_threads = std::move(domain_threads);
+
+  LOG(INFO) << "Placed " << plan.size() << " threads on " << topology.cpus().size() << " cpus"
+            << (nic.empty() ? "" : absl::StrCat(", ", nic, " interrupts on cpus ",
+                                                absl::StrJoin(topology.irq_cpus(), ",")));
+  for (unsigned thread = 0; thread < plan.size(); ++thread) {
+    const CpuTopology::Cpu* cpu = topology.Find(plan[thread]);
+    bool conn = thread >= conn_start && thread < conn_start + conn_total;
+    LOG(INFO) << "Thread " << thread << ": cpu " << cpu->id << ", core " << cpu->core
+              << ", cache domain " << cpu->l3 << (thread < num_shards ? ", shard" : "")
+              << (conn ? ", connections" : "");
+  }
+}
+
+const vector<unsigned>* PlacedThreadsOfCpu(int cpu) {
+  if (cpu < 0 || size_t(cpu) >= placed_cpu_threads.size())
+    return nullptr;
+  return &placed_cpu_threads[cpu];
+}
+
+}  // namespace facade
@@ -0,0 +1,65 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace util {
+class ProactorPool;
+}  // namespace util
+
+namespace facade {
+
+// CPU topology of the host as exposed by sysfs: the physical core and the last level cache domain
+// of every online cpu, and the cpus that serve the interrupts of a network interface.
+class CpuTopology {
+ public:
+  struct Cpu {
+    int id = -1;
+    int core = -1;  // cpus of the same core are SMT siblings.
+    int l3 = -1;    // cpus of the same domain share the last level cache.
+  };
+
+  CpuTopology() = default;
+  CpuTopology(std::vector<Cpu> cpus, std::vector<int> irq_cpus);
+
+  // Reads the topology of the online cpus. The interrupts of nic are read unless it is empty.
+  static CpuTopology Load(std::string_view nic);
+
+  const std::vector<Cpu>& cpus() const {
+    return cpus_;
+  }
+
+  const std::vector<int>& irq_cpus() const {
+    return irq_cpus_;
+  }
+
+  const Cpu* Find(int cpu) const;
+
+  // Returns the cpu of each of num_threads threads, where the threads [0, num_shards) run shards
+  // and the threads [conn_start, conn_start + conn_total) handle connections.
+  // The cpus are ordered so that every core is taken before the SMT siblings, and among them the
+  // domains that serve the nic interrupts come first and the interrupt cpus last. The threads that
+  // handle connections and run shards take the first cpus, then the ones that do either. This way
+  // network RX, parsing and execution of a request share a cache as long as the domains of the
+  // interrupts have free cores.
+  std::vector<int> PlaceThreads(unsigned num_threads, unsigned num_shards, unsigned conn_start,
+                                unsigned conn_total) const;
+
+ private:
+  std::vector<Cpu> cpus_;  // sorted by id.
+  std::vector<int> irq_cpus_;
+};
+
+// Pins the threads of the pool to the cpus chosen by CpuTopology::PlaceThreads and logs the
+// layout, if cpu_placement is set. Must run before the threads bind to their numa nodes.
+void PlaceProactorThreads(util::ProactorPool* pool, unsigned num_shards);
+
+// Returns the threads that PlaceProactorThreads pinned to cpu, or to the other cpus of its cache
+// domain if none. Returns nullptr if the threads were not placed.
+const std::vector<unsigned>* PlacedThreadsOfCpu(int cpu);
+
+}  // namespace facade
@@ -0,0 +1,54 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/cpu_topology.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace testing;
+using namespace std;
+
+namespace facade {
+
+class CpuTopologyTest : public testing::Test {
+ protected:
+  // Two cache domains of two cores with two SMT siblings each, the siblings are numbered after
+  // all the cores like on most hosts.
+  static vector<CpuTopology::Cpu> Cpus() {
+    vector<CpuTopology::Cpu> res;
+    for (int id = 0; id < 8; ++id)
+      res.push_back({id, id % 4, id % 4 / 2});
+    return res;
+  }
+};
+
+TEST_F(CpuTopologyTest, CoresBeforeSiblings) {
+  CpuTopology topology{Cpus(), {}};
+  EXPECT_THAT(topology.PlaceThreads(4, 4, 0, 4), ElementsAre(0, 1, 2, 3));
+
+  // More threads than cpus wrap around.
+  EXPECT_THAT(topology.PlaceThreads(10, 10, 0, 10), ElementsAre(0, 1, 2, 3, 4, 5, 6, 7, 0, 1));
+}
+
+TEST_F(CpuTopologyTest, InterruptDomainFirst) {
+  // The interrupts are served by cpu 3, so its domain comes first, but the threads take the other
+  // core of the domain before cpu 3 itself.
+  CpuTopology topology{Cpus(), {3}};
+  EXPECT_THAT(topology.PlaceThreads(6, 6, 0, 6), ElementsAre(2, 3, 0, 1, 6, 7));
+
+  // The thread that handles connections and runs a shard is placed next to the interrupts first.
+  EXPECT_THAT(topology.PlaceThreads(3, 3, 2, 1), ElementsAre(3, 0, 2));
+}
+
+TEST_F(CpuTopologyTest, Find) {
+  CpuTopology topology{Cpus(), {}};
+  ASSERT_NE(topology.Find(6), nullptr);
+  EXPECT_EQ(topology.Find(6)->core, 2);
+  EXPECT_EQ(topology.Find(6)->l3, 1);
+  EXPECT_EQ(topology.Find(8), nullptr);
+  EXPECT_THAT(CpuTopology{}.PlaceThreads(2, 2, 0, 2), IsEmpty());
+}
+
+}  // namespace facade
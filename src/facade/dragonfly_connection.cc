@@ -18,15 +18,20 @@
 #include "base/logging.h"
 #include "core/heap_size.h"
 #include "core/uring.h"
+#include "core/usdt.h"
 #include "facade/conn_context.h"
 #include "facade/dragonfly_listener.h"
+#include "facade/ktls.h"
 #include "facade/memcache_parser.h"
 #include "facade/redis_parser.h"
 #include "facade/service_interface.h"
+#include "facade/squash_controller.h"
 #include "io/file.h"
 #include "util/fibers/proactor_base.h"
 
 #ifdef DFLY_USE_SSL
+#include <openssl/ssl.h>
+
 #include "util/tls/tls_socket.h"
 #endif
 
@@ -35,6 +40,10 @@ using facade::operator""_MB;
 
 ABSL_FLAG(bool, tcp_nodelay, true,
           "Configures dragonfly connections with socket option TCP_NODELAY");
+ABSL_FLAG(uint32_t, reply_zerocopy_threshold, 0,
+          "If positive, replies of at least this many bytes are sent with MSG_ZEROCOPY on "
+          "plain TCP connections. Each such send waits for the peer to acknowledge the data, "
+          "so it only pays off for large values. 0 disables zero-copy sends.");
 ABSL_FLAG(bool, primary_port_http_enabled, true,
           "If true allows accessing http console on main TCP port");
 
@@ -57,13 +66,35 @@ ABSL_FLAG(uint64_t, publish_buffer_limit, 128_MB,
 
 ABSL_FLAG(bool, no_tls_on_admin_port, false, "Allow non-tls connections on admin port");
 
+ABSL_FLAG(uint32_t, tls_handshake_rate, 0,
+          "If positive, the number of TLS handshakes per second that each connection thread "
+          "starts. Handshakes above the rate wait, so that a reconnect storm does not starve the "
+          "requests of established connections. 0 means no limit");
+
 ABSL_FLAG(uint32_t, pipeline_squash, 10,
           "Number of queued pipelined commands above which squashing is enabled, 0 means disabled");
 
+ABSL_FLAG(bool, pipeline_squash_adaptive, false,
+          "If true, each connection adjusts its squashing threshold and per-shard squashing "
+          "batch size based on the observed squash ratio and hop latency. pipeline_squash "
+          "serves as the initial threshold");
+
+ABSL_FLAG(uint32_t, pipeline_squash_hop_target_usec, 1000,
+          "Latency target for a single squashed hop used by adaptive pipeline squashing");
+
 ABSL_FLAG(uint32_t, pipeline_queue_limit, 1000,
           "Pipeline queue max length, the server will stop reading from the client socket"
           " once the pipeline reaches this limit");
 
+ABSL_FLAG(uint32_t, pipeline_deadline_ms, 0,
+          "If positive, pipelined commands that waited in the dispatch queue longer than this "
+          "are dropped with an error instead of being executed. Can be changed per connection "
+          "with CLIENT DEADLINE. 0 means disabled");
+
+ABSL_FLAG(uint32_t, pipeline_shed_queue_len, 0,
+          "If positive, the oldest pipelined commands of a connection are dropped with an error "
+          "while its dispatch queue is longer than this. 0 means disabled");
+
 // When changing this constant, also update `test_large_cmd` test in connection_test.py.
 ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
           "Maximum multi-bulk (array) length that is "
@@ -72,6 +103,19 @@ ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
 ABSL_FLAG(size_t, max_client_iobuf_len, 1u << 16,
           "Maximum io buffer length that is used to read client requests.");
 
+ABSL_FLAG(uint64_t, subscriber_output_limit, 0,
+          "If positive, the maximum bytes of published messages queued for a single subscriber. "
+          "Publishers to a subscriber over the limit wait until it catches up, unless "
+          "disconnect_slow_subscribers is set");
+
+ABSL_FLAG(bool, disconnect_slow_subscribers, false,
+          "If true, subscribers that exceed subscriber_output_limit are disconnected instead of "
+          "pacing their publishers");
+
+ABSL_FLAG(bool, conn_shared_read_buffers, false,
+          "If true, connections that wait for input give their read buffer back to a per-thread "
+          "pool and borrow one once data arrives, so that idle connections hold no read buffer");
+
 ABSL_FLAG(bool, migrate_connections, true,
           "When enabled, Dragonfly will try to migrate connections to the target thread on which "
           "they operate. Currently this is only supported for Lua script invocations, and can "
@@ -254,8 +298,42 @@ void LogTraffic(uint32_t id, bool has_more, absl::Span<RespExpr> resp,
 
 constexpr size_t kMinReadSize = 256;
 
+// Size of the buffer on the fiber stack that receives the first bytes of a connection that gave
+// its read buffer back. A shorter read suggests that the socket was drained.
+constexpr size_t kStackReadSize = 1024;
+
+// Read buffers given back by connections that wait for input. The holders of lent buffers are
+// kept, so that buffers are swapped in and out without allocations.
+struct ReadBufPool {
+  static constexpr size_t kMaxBufs = 64;
+
+  vector<unique_ptr<io::IoBuf>> bufs;
+  vector<unique_ptr<io::IoBuf>> holders;
+};
+
+thread_local ReadBufPool tl_read_buf_pool;
+
 thread_local uint32_t free_req_release_weight = 0;
 
+// Token bucket of the TLS handshakes started by the thread, see --tls_handshake_rate.
+struct HandshakeLimiter {
+  double tokens = 0;
+  uint64_t last_ns = 0;
+
+  // Takes a token and returns how long the caller must wait before the token is due.
+  chrono::nanoseconds Reserve(uint32_t rate) {
+    uint64_t now = ProactorBase::GetMonotonicTimeNs();
+
+    // Bursts of up to a second worth of handshakes start right away.
+    tokens = min<double>(rate, tokens + (now - last_ns) * 1e-9 * rate);
+    last_ns = now;
+    tokens -= 1;
+    return chrono::nanoseconds(tokens >= 0 ? 0 : uint64_t(-tokens * 1e9 / rate));
+  }
+};
+
+thread_local HandshakeLimiter tl_handshake_limiter;
+
 const char* kPhaseName[Connection::NUM_PHASES] = {"SETUP", "READ", "PROCESS", "SHUTTING_DOWN",
                                                   "PRECLOSE"};
 
@@ -280,10 +358,26 @@ struct Connection::QueueBackpressure {
   // Used together with pipeline_buffer_limit to limit the pipeline usage per thread.
   util::fb2::CondVarAny pipeline_cnd;
 
-  size_t publish_buffer_limit = 0;        // cached flag publish_buffer_limit
-  size_t pipeline_cache_limit = 0;        // cached flag pipeline_cache_limit
-  size_t pipeline_buffer_limit = 0;       // cached flag for buffer size in bytes
-  uint32_t pipeline_queue_max_len = 256;  // cached flag for pipeline queue max length.
+  size_t publish_buffer_limit = 0;           // cached flag publish_buffer_limit
+  size_t subscriber_output_limit = 0;        // cached flag subscriber_output_limit
+  bool disconnect_slow_subscribers = false;  // cached flag disconnect_slow_subscribers
+  size_t pipeline_cache_limit = 0;           // cached flag pipeline_cache_limit
+  size_t pipeline_buffer_limit = 0;          // cached flag for buffer size in bytes
+  uint32_t pipeline_queue_max_len = 256;     // cached flag for pipeline queue max length.
+  uint32_t pipeline_deadline_ms = 0;         // cached flag pipeline_deadline_ms
+  uint32_t pipeline_shed_queue_len = 0;      // cached flag pipeline_shed_queue_len
+};
+
+// Bytes of the published messages queued for a subscriber. Shared with the references held by
+// publishers, so that they can wait for this subscriber only.
+struct Connection::OutputBacklog {
+  bool IsOverLimit() const {
+    return bytes.load(memory_order_relaxed) > limit;
+  }
+
+  std::atomic_size_t bytes = 0;
+  size_t limit = 0;
+  util::fb2::EventCount ec;
 };
 
 thread_local vector<Connection::PipelineMessagePtr> Connection::pipeline_req_pool_;
@@ -328,7 +422,7 @@ Connection::MCPipelineMessage::MCPipelineMessage(MemcacheParser::Command cmd_in,
   // but there are no other uses like this so far.
 
   // Compute total size and create backing
-  backing_size = cmd.key.size() + value.size();
+  backing_size = cmd.key.size() + value.size() + cmd.meta.opaque.size();
   for (const auto& ext_key : cmd.keys_ext)
     backing_size += ext_key.size();
 
@@ -354,6 +448,11 @@ Connection::MCPipelineMessage::MCPipelineMessage(MemcacheParser::Command cmd_in,
     key = {backing.get() + offset, key.size()};
     offset += key.size();
   }
+
+  if (!cmd.meta.opaque.empty()) {
+    memcpy(backing.get() + offset, cmd.meta.opaque.data(), cmd.meta.opaque.size());
+    cmd.meta.opaque = {backing.get() + offset, cmd.meta.opaque.size()};
+  }
 }
 
 void Connection::MessageDeleter::operator()(PipelineMessage* msg) const {
@@ -402,7 +501,10 @@ size_t Connection::MessageHandle::UsedMemory() const {
       return 0;  // no access to internal type, memory usage negligible
     }
     size_t operator()(const InvalidationMessage& msg) {
-      return 0;
+      size_t res = msg.keys.capacity() * sizeof(string);
+      for (const string& key : msg.keys)
+        res += key.capacity();
+      return res;
     }
     size_t operator()(const MCPipelineMessagePtr& msg) {
       return sizeof(MCPipelineMessage) + msg->backing_size +
@@ -417,7 +519,8 @@ bool Connection::MessageHandle::IsReplying() const {
   return IsPubMsg() || holds_alternative<MonitorMessage>(handle) ||
          holds_alternative<PipelineMessagePtr>(handle) ||
          (holds_alternative<MCPipelineMessagePtr>(handle) &&
-          !get<MCPipelineMessagePtr>(handle)->cmd.no_reply);
+          !get<MCPipelineMessagePtr>(handle)->cmd.no_reply &&
+          !get<MCPipelineMessagePtr>(handle)->cmd.meta.quiet);
 }
 
 struct Connection::DispatchOperations {
@@ -460,6 +563,16 @@ void Connection::DispatchOperations::operator()(const AclUpdateMessage& msg) {
 
 void Connection::DispatchOperations::operator()(const PubMessage& pub_msg) {
   RedisReplyBuilder* rbuilder = (RedisReplyBuilder*)builder;
+  if (pub_msg.force_unsubscribe) {
+    self->cntx()->OnShardChannelRemoved(pub_msg.channel);
+    return;
+  }
+
+  if (!pub_msg.frame_tail.empty()) {
+    rbuilder->SendPushFrame(pub_msg.frame_tail);
+    return;
+  }
+
   unsigned i = 0;
   array<string_view, 4> arr;
   if (pub_msg.pattern.empty()) {
@@ -506,8 +619,7 @@ void Connection::DispatchOperations::operator()(const InvalidationMessage& msg)
   if (msg.invalidate_due_to_flush) {
     rbuilder->SendNull();
   } else {
-    std::string_view keys[] = {msg.key};
-    rbuilder->SendStringArr(keys);
+    rbuilder->SendStringArr(OwnedArgSlice{msg.keys});
   }
 }
 
@@ -633,9 +745,14 @@ void Connection::OnConnectionStart() {
   // may be created in a differrent thread from where it runs.
   if (tl_queue_backpressure_.publish_buffer_limit == 0) {
     tl_queue_backpressure_.publish_buffer_limit = GetFlag(FLAGS_publish_buffer_limit);
+    tl_queue_backpressure_.subscriber_output_limit = GetFlag(FLAGS_subscriber_output_limit);
+    tl_queue_backpressure_.disconnect_slow_subscribers =
+        GetFlag(FLAGS_disconnect_slow_subscribers);
     tl_queue_backpressure_.pipeline_cache_limit = GetFlag(FLAGS_request_cache_limit);
     tl_queue_backpressure_.pipeline_buffer_limit = GetFlag(FLAGS_pipeline_buffer_limit);
     tl_queue_backpressure_.pipeline_queue_max_len = GetFlag(FLAGS_pipeline_queue_limit);
+    tl_queue_backpressure_.pipeline_deadline_ms = GetFlag(FLAGS_pipeline_deadline_ms);
+    tl_queue_backpressure_.pipeline_shed_queue_len = GetFlag(FLAGS_pipeline_shed_queue_len);
 
     if (tl_queue_backpressure_.publish_buffer_limit == 0 ||
         tl_queue_backpressure_.pipeline_cache_limit == 0 ||
@@ -687,14 +804,38 @@ void Connection::HandleRequests() {
         unique_ptr<tls::TlsSocket> tls_sock = make_unique<tls::TlsSocket>(std::move(socket_));
         tls_sock->InitSSL(ssl_ctx_, buf);
         SetSocket(tls_sock.release());
+        is_tls_ = true;
+      }
+      if (uint32_t rate = GetFlag(FLAGS_tls_handshake_rate); rate > 0) {
+        if (auto delay = tl_handshake_limiter.Reserve(rate); delay.count() > 0) {
+          stats_->tls_handshakes_throttled++;
+          ThisFiber::SleepFor(delay);
+        }
       }
+
+      uint64_t handshake_start = ProactorBase::GetMonotonicTimeNs();
       FiberSocketBase::AcceptResult aresult = socket_->Accept();
+      stats_->tls_handshake_usec += (ProactorBase::GetMonotonicTimeNs() - handshake_start) / 1000;
 
       if (!aresult) {
+        stats_->tls_handshake_failures++;
         LOG(WARNING) << "Error handshaking " << aresult.error().message();
         return;
       }
+      stats_->tls_handshakes++;
+      SSL* ssl = static_cast<tls::TlsSocket*>(socket_.get())->ssl_handle();
+      stats_->tls_handshakes_resumed += SSL_session_reused(ssl);
       VLOG(1) << "TLS handshake succeeded";
+
+      {
+        FiberAtomicGuard fg;
+        auto offloaded = OffloadTlsToKernel(&socket_);
+        if (!offloaded) {
+          LOG(WARNING) << "Error moving TLS to the kernel " << offloaded.error().message();
+          return;
+        }
+        is_ktls_ = *offloaded;
+      }
     }
   }
 #endif
@@ -716,6 +857,11 @@ void Connection::HandleRequests() {
     cc_.reset(service_->CreateContext(socket_.get(), this));
     reply_builder_ = cc_->reply_builder();
 
+    if (uint32_t zc_threshold = GetFlag(FLAGS_reply_zerocopy_threshold);
+        zc_threshold > 0 && !is_tls_ && !socket_->IsUDS()) {
+      EnableZeroCopyReplies(zc_threshold);
+    }
+
     if (*http_res) {
       VLOG(1) << "HTTP1.1 identified";
       is_http_ = true;
@@ -793,9 +939,17 @@ std::pair<std::string, std::string> Connection::GetClientInfoBeforeAfterTid() co
 
   string after;
   absl::StrAppend(&after, " irqmatch=", int(cpu == my_cpu_id));
+  absl::StrAppend(&after, " omem=", pub_bytes_);
+  if (is_tls_) {
+    absl::StrAppend(&after, " tls=", is_ktls_ ? "kernel" : "user");
+  }
   if (dispatch_q_.size()) {
     absl::StrAppend(&after, " pipeline=", dispatch_q_.size());
   }
+  if (squash_ctrl_) {
+    absl::StrAppend(&after, " squash-threshold=", squash_ctrl_->threshold(),
+                    " squash-batch=", squash_ctrl_->batch_limit());
+  }
   absl::StrAppend(&after, " age=", now - creation_time_, " idle=", now - last_interaction_);
   string_view phase_name = PHASE_NAMES[phase_];
 
@@ -834,7 +988,7 @@ string Connection::GetClientInfo() const {
   // are missing from the pyclient.
 
   absl::StrAppend(&before, " qbuf=0 ", "qbuf-free=0 ", "obl=0 ", "argv-mem=0 ");
-  absl::StrAppend(&before, "oll=0 ", "omem=0 ", "tot-mem=0 ", "multi=0 ");
+  absl::StrAppend(&before, "oll=0 ", "tot-mem=0 ", "multi=0 ");
   absl::StrAppend(&before, "psub=0 ", "sub=0");
   return before;
 }
@@ -1035,6 +1189,7 @@ void Connection::DispatchSingle(bool has_more, absl::FunctionRef<void()> invoke_
 
   // Dispatch async if we're handling a pipeline or if we can't dispatch sync.
   if (optimize_for_async || !can_dispatch_sync) {
+    DFLY_TRACE(conn_dispatch_async, id_, dispatch_q_.size());
     SendAsync(cmd_msg_cb());
 
     auto epoch = fb2::FiberSwitchEpoch();
@@ -1053,7 +1208,9 @@ void Connection::DispatchSingle(bool has_more, absl::FunctionRef<void()> invoke_
     ShrinkPipelinePool();  // Gradually release pipeline request pool.
     {
       cc_->sync_dispatch = true;
+      DFLY_TRACE(conn_dispatch_start, id_);
       invoke_cb();
+      DFLY_TRACE(conn_dispatch_done, id_);
       cc_->sync_dispatch = false;
     }
     last_interaction_ = time(nullptr);
@@ -1173,6 +1330,22 @@ auto Connection::ParseMemcache() -> ParserStatus {
   return OK;
 }
 
+void Connection::EnableZeroCopyReplies(uint32_t threshold) {
+#ifdef __linux__
+  auto* rb2 = dynamic_cast<SinkReplyBuilder2*>(reply_builder_);
+  if (!rb2)
+    return;
+
+  int val = 1;
+  int fd = socket_->native_handle();
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) != 0) {
+    VLOG(1) << "SO_ZEROCOPY is not supported: " << strerror(errno);
+    return;
+  }
+  rb2->EnableZeroCopy(fd, threshold);
+#endif
+}
+
 void Connection::OnBreakCb(int32_t mask) {
   if (mask <= 0)
     return;  // we cancelled the poller, which means we do not need to break from anything.
@@ -1230,17 +1403,25 @@ auto Connection::IoLoop() -> variant<error_code, ParserStatus> {
   ParserStatus parse_status = OK;
 
   size_t max_iobfuf_len = GetFlag(FLAGS_max_client_iobuf_len);
+  bool shared_read_buffers = GetFlag(FLAGS_conn_shared_read_buffers);
   auto* peer = socket_.get();
+  size_t last_recv_sz = 0;
 
   do {
     HandleMigrateRequest();
 
-    io::MutableBytes append_buf = io_buf_.AppendBuffer();
-    DCHECK(!append_buf.empty());
-
     phase_ = READ_SOCKET;
 
-    ::io::Result<size_t> recv_sz = peer->Recv(append_buf);
+    ::io::Result<size_t> recv_sz;
+    if (shared_read_buffers && io_buf_.InputLen() == 0 && last_recv_sz < kStackReadSize) {
+      recv_sz = RecvWithoutReadBuffer(peer);
+    } else {
+      io::MutableBytes append_buf = io_buf_.AppendBuffer();
+      DCHECK(!append_buf.empty());
+      recv_sz = peer->Recv(append_buf);
+      if (recv_sz)
+        io_buf_.CommitWrite(*recv_sz);
+    }
     last_interaction_ = time(nullptr);
 
     if (!recv_sz) {
@@ -1249,7 +1430,7 @@ auto Connection::IoLoop() -> variant<error_code, ParserStatus> {
       break;
     }
 
-    io_buf_.CommitWrite(*recv_sz);
+    last_recv_sz = *recv_sz;
     stats_->io_read_bytes += *recv_sz;
     ++stats_->io_read_cnt;
 
@@ -1313,6 +1494,50 @@ auto Connection::IoLoop() -> variant<error_code, ParserStatus> {
   return parse_status;
 }
 
+io::Result<size_t> Connection::RecvWithoutReadBuffer(FiberSocketBase* peer) {
+  DCHECK_EQ(io_buf_.InputLen(), 0u);
+  io_buf_.Clear();
+
+  // Give the buffer back to the pool, or free it if the pool is full.
+  auto& pool = tl_read_buf_pool;
+  unique_ptr<io::IoBuf> holder;
+  if (pool.holders.empty()) {
+    holder = make_unique<io::IoBuf>(0);
+  } else {
+    holder = std::move(pool.holders.back());
+    pool.holders.pop_back();
+  }
+
+  const size_t released = io_buf_.Capacity();
+  UpdateIoBufCapacity(io_buf_, stats_, [&]() { holder->Swap(io_buf_); });
+  if (pool.bufs.size() < ReadBufPool::kMaxBufs) {
+    stats_->read_buf_pool_bytes += released;
+    pool.bufs.push_back(std::move(holder));
+  }
+  stats_->read_buf_saved_bytes += released;
+
+  uint8_t buf[kStackReadSize];
+  io::Result<size_t> res = peer->Recv(io::MutableBytes{buf, sizeof(buf)});
+
+  // Borrow a buffer even on errors, so that the connection always has one outside of Recv.
+  stats_->read_buf_saved_bytes -= released;
+  if (pool.bufs.empty()) {
+    UpdateIoBufCapacity(io_buf_, stats_, [&]() { io_buf_.Reserve(kMinReadSize); });
+  } else {
+    holder = std::move(pool.bufs.back());
+    pool.bufs.pop_back();
+    stats_->read_buf_pool_bytes -= holder->Capacity();
+    UpdateIoBufCapacity(io_buf_, stats_, [&]() { holder->Swap(io_buf_); });
+    pool.holders.push_back(std::move(holder));
+  }
+
+  if (res) {
+    UpdateIoBufCapacity(io_buf_, stats_, [&]() { io_buf_.EnsureCapacity(*res); });
+    io_buf_.WriteAndCommit(buf, *res);
+  }
+  return res;
+}
+
 bool Connection::ShouldEndDispatchFiber(const MessageHandle& msg) {
   if (!holds_alternative<MigrationRequestMessage>(msg.handle)) {
     return false;
@@ -1338,6 +1563,47 @@ bool Connection::ShouldEndDispatchFiber(const MessageHandle& msg) {
   return false;
 }
 
+size_t Connection::MCGetRun() const {
+  size_t run = 0;
+  for (const auto& msg : dispatch_q_) {
+    auto* mc_msg = get_if<MCPipelineMessagePtr>(&msg.handle);
+    if (!mc_msg)
+      break;
+    auto type = (*mc_msg)->cmd.type;
+    if (type != MemcacheParser::GET && type != MemcacheParser::META_GET)
+      break;
+    ++run;
+  }
+  return run;
+}
+
+void Connection::SquashMCGets(size_t count) {
+  vector<const MemcacheParser::Command*> cmds(count);
+  for (size_t i = 0; i < count; ++i)
+    cmds[i] = &get<MCPipelineMessagePtr>(dispatch_q_[i].handle)->cmd;
+
+  cc_->async_dispatch = true;
+  service_->DispatchManyMC(cmds, cc_.get());
+  cc_->async_dispatch = false;
+  last_interaction_ = time(nullptr);
+
+  // Flush if no new commands appeared
+  if (count_if(dispatch_q_.begin(), dispatch_q_.end(),
+               [](const auto& msg) { return msg.IsPipelineMsg(); }) == ptrdiff_t(count)) {
+    reply_builder_->FlushBatch();
+    reply_builder_->SetBatchMode(false);
+  }
+
+  auto it = dispatch_q_.begin();
+  while (it->IsControl())  // Skip all newly received intrusive messages
+    ++it;
+
+  for (auto rit = it; rit != it + count; ++rit)
+    RecycleMessage(std::move(*rit));
+
+  dispatch_q_.erase(it, it + count);
+}
+
 void Connection::SquashPipeline() {
   DCHECK_EQ(dispatch_q_.size(), pending_pipeline_cmd_cnt_);
 
@@ -1353,9 +1619,18 @@ void Connection::SquashPipeline() {
   }
 
   cc_->async_dispatch = true;
+  cc_->squash_info.batch_limit = squash_ctrl_ ? squash_ctrl_->batch_limit() : 0;
 
+  uint64_t start = ProactorBase::GetMonotonicTimeNs();
   size_t dispatched = service_->DispatchManyCommands(absl::MakeSpan(squash_cmds), cc_.get());
 
+  if (squash_ctrl_) {
+    uint64_t usec = (ProactorBase::GetMonotonicTimeNs() - start) / 1000;
+    auto update = squash_ctrl_->Record(dispatched, cc_->squash_info, usec);
+    stats_->squash_threshold_updates += update.threshold;
+    stats_->squash_batch_updates += update.batch;
+  }
+
   if (pending_pipeline_cmd_cnt_ == squash_cmds.size()) {  // Flush if no new commands appeared
     reply_builder_->FlushBatch();
     reply_builder_->SetBatchMode(false);  // in case the next dispatch is sync
@@ -1393,6 +1668,31 @@ void Connection::ClearPipelinedMessages() {
   queue_backpressure_->pubsub_ec.notifyAll();
 }
 
+void Connection::ShedPipelinedMessages() {
+  uint64_t deadline_ns = uint64_t(GetDeadline()) * 1'000'000;
+  uint32_t max_len = queue_backpressure_->pipeline_shed_queue_len;
+  if (deadline_ns == 0 && max_len == 0)
+    return;
+
+  // Messages are queued in arrival order, so the expired ones are at the front.
+  uint64_t now = ProactorBase::GetMonotonicTimeNs();
+  while (!dispatch_q_.empty() && dispatch_q_.front().IsPipelineMsg()) {
+    const MessageHandle& msg = dispatch_q_.front();
+    bool expired = deadline_ns && now - msg.dispatch_ts > deadline_ns;
+    if (!expired && (max_len == 0 || dispatch_q_.size() <= max_len))
+      break;
+
+    reply_builder_->SendError(kDeadlineExceededErr);
+    ++stats_->pipeline_shed_cnt;
+    RecycleMessage(std::move(dispatch_q_.front()));
+    dispatch_q_.pop_front();
+  }
+}
+
+uint32_t Connection::GetDeadline() const {
+  return deadline_ms_ ? *deadline_ms_ : queue_backpressure_->pipeline_deadline_ms;
+}
+
 std::string Connection::DebugInfo() const {
   std::string info = "{";
 
@@ -1428,6 +1728,11 @@ void Connection::ExecutionFiber() {
   DispatchOperations dispatch_op{reply_builder_, this};
 
   size_t squashing_threshold = GetFlag(FLAGS_pipeline_squash);
+  if (squashing_threshold > 0 && GetFlag(FLAGS_pipeline_squash_adaptive) && !squash_ctrl_) {
+    squash_ctrl_ = make_unique<SquashController>(squashing_threshold,
+                                                 GetFlag(FLAGS_pipeline_squash_hop_target_usec));
+  }
+  bool burst_start = true;  // whether the previous iteration drained the dispatch queue
 
   uint64_t prev_epoch = fb2::FiberSwitchEpoch();
   fb2::NoOpLock noop_lk;
@@ -1456,6 +1761,19 @@ void Connection::ExecutionFiber() {
     }
     prev_epoch = cur_epoch;
 
+    if (squash_ctrl_ && burst_start && squash_ctrl_->ObserveDepth(pending_pipeline_cmd_cnt_))
+      stats_->squash_threshold_updates++;
+
+    // Drop stale commands before they reach the transactional layer.
+    reply_builder_->SetBatchMode(true);
+    ShedPipelinedMessages();
+    if (dispatch_q_.empty()) {
+      reply_builder_->FlushBatch();
+      queue_backpressure_->pipeline_cnd.notify_all();
+      burst_start = true;
+      continue;
+    }
+
     reply_builder_->SetBatchMode(dispatch_q_.size() > 1);
 
     bool subscriber_over_limit =
@@ -1466,10 +1784,13 @@ void Connection::ExecutionFiber() {
     // It is only enabled if the threshold is reached and the whole dispatch queue
     // consists only of commands (no pubsub or monitor messages)
     bool squashing_enabled = squashing_threshold > 0;
-    bool threshold_reached = pending_pipeline_cmd_cnt_ > squashing_threshold;
+    size_t threshold = squash_ctrl_ ? squash_ctrl_->threshold() : squashing_threshold;
+    bool threshold_reached = pending_pipeline_cmd_cnt_ > threshold;
     bool are_all_plain_cmds = pending_pipeline_cmd_cnt_ == dispatch_q_.size();
     if (squashing_enabled && threshold_reached && are_all_plain_cmds && !skip_next_squashing_) {
       SquashPipeline();
+    } else if (size_t run = squashing_enabled ? MCGetRun() : 0; run > 1) {
+      SquashMCGets(run);
     } else {
       MessageHandle msg = std::move(dispatch_q_.front());
       dispatch_q_.pop_front();
@@ -1504,6 +1825,8 @@ void Connection::ExecutionFiber() {
     if (subscriber_over_limit &&
         stats_->dispatch_queue_subscriber_bytes < queue_backpressure_->publish_buffer_limit)
       queue_backpressure_->pubsub_ec.notify();
+
+    burst_start = dispatch_q_.empty();
   }
 
   DCHECK(cc_->conn_closing || reply_builder_->GetError());
@@ -1598,7 +1921,15 @@ Connection::WeakRef Connection::Borrow() {
   // unsafe. All external mechanisms that borrow references should register subscriptions.
   DCHECK_GT(cc_->subscriptions, 0);
 
-  return WeakRef(self_, queue_backpressure_, socket_->proactor()->GetPoolIndex(), id_);
+  if (!output_backlog_ && queue_backpressure_->subscriber_output_limit > 0 &&
+      !queue_backpressure_->disconnect_slow_subscribers) {
+    output_backlog_ = make_shared<OutputBacklog>();
+    output_backlog_->limit = queue_backpressure_->subscriber_output_limit;
+    output_backlog_->bytes.store(pub_bytes_, memory_order_relaxed);
+  }
+
+  return WeakRef(self_, queue_backpressure_, output_backlog_,
+                 socket_->proactor()->GetPoolIndex(), id_);
 }
 
 void Connection::ShutdownThreadLocal() {
@@ -1670,6 +2001,9 @@ void Connection::SendAsync(MessageHandle msg) {
 
   DCHECK_NE(phase_, PRECLOSE);  // No more messages are processed after this point
 
+  if (msg.IsPubMsg() && !CheckOutputLimit())
+    return;
+
   size_t used_mem = msg.UsedMemory();
   stats_->dispatch_queue_entries++;
   stats_->dispatch_queue_bytes += used_mem;
@@ -1678,6 +2012,9 @@ void Connection::SendAsync(MessageHandle msg) {
   if (msg.IsPubMsg()) {
     queue_backpressure_->subscriber_bytes.fetch_add(used_mem, memory_order_relaxed);
     stats_->dispatch_queue_subscriber_bytes += used_mem;
+    pub_bytes_ += used_mem;
+    if (output_backlog_)
+      output_backlog_->bytes.fetch_add(used_mem, memory_order_relaxed);
   }
 
   // Squashing is only applied to redis commands
@@ -1700,6 +2037,23 @@ void Connection::SendAsync(MessageHandle msg) {
   }
 }
 
+bool Connection::CheckOutputLimit() {
+  if (output_limit_exceeded_)
+    return false;
+
+  const auto& bp = *queue_backpressure_;
+  if (!bp.disconnect_slow_subscribers || bp.subscriber_output_limit == 0 ||
+      pub_bytes_ <= bp.subscriber_output_limit)
+    return true;
+
+  LOG_EVERY_T(WARNING, 1) << "Disconnecting subscriber " << GetClientId() << " with "
+                          << pub_bytes_ << " bytes of queued messages";
+  output_limit_exceeded_ = true;
+  ++stats_->slow_subscriber_disconnects;
+  ShutdownSelf();
+  return false;
+}
+
 void Connection::RecycleMessage(MessageHandle msg) {
   size_t used_mem = msg.UsedMemory();
 
@@ -1709,6 +2063,12 @@ void Connection::RecycleMessage(MessageHandle msg) {
   if (msg.IsPubMsg()) {
     queue_backpressure_->subscriber_bytes.fetch_sub(used_mem, memory_order_relaxed);
     stats_->dispatch_queue_subscriber_bytes -= used_mem;
+    pub_bytes_ -= used_mem;
+    if (output_backlog_) {
+      output_backlog_->bytes.fetch_sub(used_mem, memory_order_relaxed);
+      if (!output_backlog_->IsOverLimit())
+        output_backlog_->ec.notifyAll();
+    }
   }
 
   if (msg.IsPipelineMsg()) {
@@ -1762,14 +2122,15 @@ facade::ConnectionContext* Connection::cntx() {
   return cc_.get();
 }
 
-void Connection::RequestAsyncMigration(util::fb2::ProactorBase* dest) {
+bool Connection::RequestAsyncMigration(util::fb2::ProactorBase* dest, bool once) {
   if (!migration_enabled_ || cc_ == nullptr) {
-    return;
+    return false;
   }
 
-  // Connections can migrate at most once.
-  migration_enabled_ = false;
+  if (once)
+    migration_enabled_ = false;
   migration_request_ = dest;
+  return true;
 }
 
 void Connection::StartTrafficLogging(string_view path) {
@@ -1840,8 +2201,13 @@ void Connection::TrackRequestSize(bool enable) {
 }
 
 Connection::WeakRef::WeakRef(std::shared_ptr<Connection> ptr, QueueBackpressure* backpressure,
-                             unsigned thread, uint32_t client_id)
-    : ptr_{ptr}, backpressure_{backpressure}, thread_{thread}, client_id_{client_id} {
+                             std::shared_ptr<OutputBacklog> backlog, unsigned thread,
+                             uint32_t client_id)
+    : ptr_{ptr},
+      backpressure_{backpressure},
+      backlog_{std::move(backlog)},
+      thread_{thread},
+      client_id_{client_id} {
   DCHECK(backpressure);
 }
 
@@ -1877,6 +2243,12 @@ bool Connection::WeakRef::EnsureMemoryBudget() const {
   return false;
 }
 
+void Connection::WeakRef::EnsureOutputBudget() const {
+  // A closing connection releases its messages, so the wait ends with it as well.
+  if (backlog_)
+    backlog_->ec.await([this] { return !backlog_->IsOverLimit(); });
+}
+
 bool Connection::WeakRef::operator<(const WeakRef& other) {
   return client_id_ < other.client_id_;
 }
@@ -10,6 +10,7 @@
 
 #include <deque>
 #include <memory>
+#include <optional>
 #include <string_view>
 #include <utility>
 #include <variant>
@@ -47,6 +48,7 @@ class ConnectionContext;
 class RedisParser;
 class ServiceInterface;
 class SinkReplyBuilder;
+class SquashController;
 
 // Connection represents an active connection for a client.
 //
@@ -55,6 +57,7 @@ class SinkReplyBuilder;
 // a separate dispatch queue that is processed on a separate fiber.
 class Connection : public util::Connection {
   struct QueueBackpressure;
+  struct OutputBacklog;
 
  public:
   Connection(Protocol protocol, util::HttpListenerBase* http_listener, SSL_CTX* ctx,
@@ -74,6 +77,13 @@ class Connection : public util::Connection {
     std::string pattern{};              // non-empty for pattern subscriber
     std::shared_ptr<char[]> buf;        // stores channel name and message
     std::string_view channel, message;  // channel and message parts from buf
+
+    // Push frame of the message without its type character, serialized once for all subscribers
+    // into buf. If empty, the frame is serialized by the connection.
+    std::string_view frame_tail{};
+
+    // Set if the subscription to the shard channel was removed by the server.
+    bool force_unsubscribe = false;
   };
 
   // Pipeline message, accumulated Redis command to be executed.
@@ -124,8 +134,9 @@ class Connection : public util::Connection {
     util::fb2::BlockingCounter bc;  // Decremented counter when processed
   };
 
+  // Invalidated keys of client side caching, sent in a single push.
   struct InvalidationMessage {
-    std::string key;
+    std::vector<std::string> keys;
     bool invalidate_due_to_flush = false;
   };
 
@@ -199,17 +210,22 @@ class Connection : public util::Connection {
     // Ensure owner thread's memory budget. If expired, skips and returns false. Thread-safe.
     bool EnsureMemoryBudget() const;
 
+    // Blocks while the messages queued for this subscriber exceed subscriber_output_limit.
+    // Thread-safe.
+    void EnsureOutputBudget() const;
+
     bool operator<(const WeakRef& other);
     bool operator==(const WeakRef& other) const;
 
    private:
     friend class Connection;
 
-    WeakRef(std::shared_ptr<Connection> ptr, QueueBackpressure* backpressure, unsigned thread,
-            uint32_t client_id);
+    WeakRef(std::shared_ptr<Connection> ptr, QueueBackpressure* backpressure,
+            std::shared_ptr<OutputBacklog> backlog, unsigned thread, uint32_t client_id);
 
     std::weak_ptr<Connection> ptr_;
     QueueBackpressure* backpressure_;
+    std::shared_ptr<OutputBacklog> backlog_;  // null unless publishers are paced
     unsigned thread_;
     uint32_t client_id_;
   };
@@ -285,6 +301,15 @@ class Connection : public util::Connection {
     return name_;
   }
 
+  // Pipelined commands that waited in the dispatch queue longer than the deadline are dropped
+  // with an error instead of being executed. 0 disables the deadline, nullopt resets it to
+  // the pipeline_deadline_ms flag.
+  void SetDeadline(std::optional<uint32_t> msec) {
+    deadline_ms_ = msec;
+  }
+
+  uint32_t GetDeadline() const;
+
   struct MemoryUsage {
     size_t mem = 0;
     io::IoBuf::MemoryUsage buf_mem;
@@ -294,8 +319,14 @@ class Connection : public util::Connection {
   ConnectionContext* cntx();
 
   // Requests that at some point, this connection will be migrated to `dest` thread.
-  // Connections will migrate at most once, and only when the flag --migrate_connections is true.
-  void RequestAsyncMigration(util::fb2::ProactorBase* dest);
+  // Connections migrate only when the flag --migrate_connections is true. Unless `once` is false,
+  // the connection will not accept further migration requests, so callers that migrate
+  // repeatedly must prevent ping-pong themselves. Returns false if the request was ignored.
+  bool RequestAsyncMigration(util::fb2::ProactorBase* dest, bool once = true);
+
+  time_t LastInteractionTime() const {
+    return last_interaction_;
+  }
 
   // Starts traffic logging in the calling thread. Must be a proactor thread.
   // Each thread creates its own log file combining requests from all the connections in
@@ -338,6 +369,10 @@ class Connection : public util::Connection {
   // Main loop reading client messages and passing requests to dispatch queue.
   std::variant<std::error_code, ParserStatus> IoLoop();
 
+  // Gives io_buf_ back to the thread pool while waiting for input, and borrows a buffer for the
+  // received data. Used with --conn_shared_read_buffers.
+  io::Result<size_t> RecvWithoutReadBuffer(util::FiberSocketBase* peer);
+
   // Returns true if HTTP header is detected.
   io::Result<bool> CheckForHttpProto();
 
@@ -356,6 +391,10 @@ class Connection : public util::Connection {
   // Updates memory stats and pooling, must be called for all used messages
   void RecycleMessage(MessageHandle msg);
 
+  // Returns false if a published message should be dropped because the connection exceeded
+  // subscriber_output_limit, in which case it is shut down.
+  bool CheckOutputLimit();
+
   // Create new pipeline request, re-use from pool when possible.
   PipelineMessagePtr FromArgs(RespVec args, mi_heap_t* heap);
 
@@ -364,6 +403,9 @@ class Connection : public util::Connection {
 
   void OnBreakCb(int32_t mask);
 
+  // Enables MSG_ZEROCOPY sends in the reply builder for replies of at least threshold bytes.
+  void EnableZeroCopyReplies(uint32_t threshold);
+
   // Shrink pipeline pool by a little while handling regular commands.
   void ShrinkPipelinePool();
 
@@ -378,9 +420,19 @@ class Connection : public util::Connection {
   // Squashes pipelined commands from the dispatch queue to spread load over all threads
   void SquashPipeline();
 
+  // Returns the number of memcache get and meta get commands at the front of the dispatch queue.
+  size_t MCGetRun() const;
+
+  // Dispatches together the first count messages of the queue, which are memcache gets.
+  void SquashMCGets(size_t count);
+
   // Clear pipelined messages, disaptching only intrusive ones.
   void ClearPipelinedMessages();
 
+  // Replies with an error to the pipelined commands at the front of the dispatch queue that
+  // exceeded the deadline or overflow the shedding queue length.
+  void ShedPipelinedMessages();
+
   std::pair<std::string, std::string> GetClientInfoBeforeAfterTid() const;
 
   void DecreaseStatsOnClose();
@@ -392,6 +444,9 @@ class Connection : public util::Connection {
 
   uint64_t pending_pipeline_cmd_cnt_ = 0;  // how many queued Redis async commands in dispatch_q
 
+  // Tunes pipeline squashing for this connection, set only if pipeline_squash_adaptive is on.
+  std::unique_ptr<SquashController> squash_ctrl_;
+
   // how many bytes of the current request have been consumed
   size_t request_consumed_bytes_ = 0;
 
@@ -420,6 +475,8 @@ class Connection : public util::Connection {
 
   unsigned parser_error_ = 0;
 
+  std::optional<uint32_t> deadline_ms_;
+
   // amount of times we enqued requests asynchronously during the same async_fiber_epoch_.
   unsigned async_streak_len_ = 0;
   uint64_t async_fiber_epoch_ = 0;
@@ -437,6 +494,12 @@ class Connection : public util::Connection {
   // Needed for access from different threads by EnsureAsyncMemoryBudget().
   QueueBackpressure* queue_backpressure_ = nullptr;
 
+  // Bytes of the published messages in dispatch_q_.
+  size_t pub_bytes_ = 0;
+
+  // Mirrors pub_bytes_ for publishers on other threads, created once the connection subscribes.
+  std::shared_ptr<OutputBacklog> output_backlog_;
+
   util::fb2::ProactorBase* migration_request_ = nullptr;
 
   // Pooled pipeline messages per-thread
@@ -457,6 +520,12 @@ class Connection : public util::Connection {
       bool migration_enabled_ : 1;
       bool migration_in_process_ : 1;
       bool is_http_ : 1;
+
+      bool is_tls_ : 1;
+      bool is_ktls_ : 1;  // TLS records are encrypted by the kernel, see facade/ktls.h
+
+      // Published messages exceeded subscriber_output_limit and the connection is shutting down.
+      bool output_limit_exceeded_ : 1;
     };
   };
 };
@@ -16,7 +16,10 @@
 #endif
 #include "base/flags.h"
 #include "base/logging.h"
+#include "facade/cpu_topology.h"
 #include "facade/dragonfly_connection.h"
+#include "facade/ktls.h"
+#include "facade/numa.h"
 #include "facade/service_interface.h"
 #include "util/proactor_pool.h"
 
@@ -28,6 +31,10 @@ ABSL_FLAG(bool, tls, false, "");
 ABSL_FLAG(bool, conn_use_incoming_cpu, false,
           "If true uses incoming cpu of a socket in order to distribute"
           " incoming connections");
+ABSL_FLAG(bool, numa_aware, false,
+          "If true, binds every thread and its memory to the numa node it runs on, and prefers "
+          "threads on the node of the cpu that received a connection when distributing "
+          "connections");
 
 ABSL_FLAG(string, tls_cert_file, "", "cert file for tls connections");
 ABSL_FLAG(string, tls_key_file, "", "key file for tls connections");
@@ -35,6 +42,14 @@ ABSL_FLAG(string, tls_ca_cert_file, "", "ca signed certificate to validate tls c
 ABSL_FLAG(string, tls_ca_cert_dir, "",
           "ca signed certificates directory. Use c_rehash before, read description in "
           "https://www.openssl.org/docs/man3.0/man1/c_rehash.html");
+ABSL_FLAG(uint32_t, tls_session_cache_size, 20480,
+          "Number of TLS sessions the server caches, so that reconnecting clients resume them "
+          "with an abbreviated handshake instead of a full one. 0 disables the cache");
+ABSL_FLAG(bool, tls_session_tickets, true,
+          "If true, issues TLS session tickets that let clients resume their sessions without "
+          "a server side cache entry");
+ABSL_FLAG(uint32_t, tls_session_timeout, 300,
+          "Seconds during which a cached TLS session or a session ticket can be resumed");
 ABSL_FLAG(uint32_t, tcp_keepalive, 300,
           "the period in seconds of inactivity after which keep-alives are triggerred,"
           "the duration until an inactive connection is terminated is twice the specified time");
@@ -73,6 +88,27 @@ namespace {
 
 #ifdef DFLY_USE_SSL
 
+// An abbreviated handshake skips the certificate exchange and the asymmetric crypto of a full
+// one, which dominate the cost of a reconnect storm.
+void ConfigureSessionResumption(SSL_CTX* ctx) {
+  // Resumption fails without a session id context when client certificates are verified.
+  static constexpr char kSessionIdContext[] = "dragonfly";
+  DFLY_SSL_CHECK(1 == SSL_CTX_set_session_id_context(
+                          ctx, reinterpret_cast<const unsigned char*>(kSessionIdContext),
+                          sizeof(kSessionIdContext) - 1));
+  SSL_CTX_set_timeout(ctx, GetFlag(FLAGS_tls_session_timeout));
+
+  if (uint32_t cache_size = GetFlag(FLAGS_tls_session_cache_size); cache_size > 0) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, cache_size);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  }
+
+  if (!GetFlag(FLAGS_tls_session_tickets))
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+}
+
 // Creates the TLS context. Returns nullptr if the TLS configuration is invalid.
 // To connect: openssl s_client -state -crlf -connect 127.0.0.1:6380
 SSL_CTX* CreateSslServerCntx() {
@@ -122,6 +158,9 @@ SSL_CTX* CreateSslServerCntx() {
 
   DFLY_SSL_CHECK(1 == SSL_CTX_set_dh_auto(ctx, 1));
 
+  ConfigureSessionResumption(ctx);
+  PrepareKtlsContext(ctx);
+
   return ctx;
 }
 #endif
@@ -288,6 +327,12 @@ uint64_t Listener::RefusedConnectionMaxClientsCount() {
 
 void Listener::PreAcceptLoop(util::ProactorBase* pb) {
   per_thread_.resize(pool()->size());
+
+  if (GetFlag(FLAGS_numa_aware) && NumaTopology::Get().num_nodes() > 1) {
+    pool()->AwaitBrief([this](unsigned index, auto*) {
+      per_thread_[index].numa_node = NumaTopology::Get().CurrentNode();
+    });
+  }
 }
 
 bool Listener::IsPrivilegedInterface() const {
@@ -396,7 +441,10 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
       }
 
       if (GetFlag(FLAGS_conn_use_incoming_cpu)) {
-        const vector<unsigned>& ids = pool()->MapCpuToThreads(cpu);
+        // The threads may have been moved away from the cpus the pool pinned them to.
+        const vector<unsigned>* placed = PlacedThreadsOfCpu(cpu);
+        const vector<unsigned>& ids =
+            placed && !placed->empty() ? *placed : pool()->MapCpuToThreads(cpu);
 
         absl::base_internal::SpinLockHolder lock{&mutex_};
         for (auto id : ids) {
@@ -413,24 +461,50 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
                   << cpu;
           res_id = min_cnt_thread_id_;
         }
+      } else if (GetFlag(FLAGS_numa_aware)) {
+        res_id = PickNumaLocalThread(NumaTopology::Get().NodeOfCpu(cpu));
       }
     }
   }
 
   if (res_id == kuint32max) {
-    uint32_t total = GetFlag(FLAGS_conn_io_threads);
-    uint32_t start = GetFlag(FLAGS_conn_io_thread_start) % pp->size();
-
-    if (total == 0 || total + start > pp->size()) {
-      total = pp->size() - start;
-    }
-
+    auto [start, total] = ConnectionThreads(pp->size());
     res_id = start + (next_id_.fetch_add(1, std::memory_order_relaxed) % total);
   }
 
   return pp->at(res_id);
 }
 
+// Returns the thread with the least connections on `node`, or kuint32max if there is none.
+uint32_t Listener::PickNumaLocalThread(int node) {
+  if (node < 0)
+    return kuint32max;
+
+  auto [start, total] = ConnectionThreads(per_thread_.size());
+  uint32_t res_id = kuint32max;
+
+  absl::base_internal::SpinLockHolder lock{&mutex_};
+  for (uint32_t id = start; id < start + total; ++id) {
+    const auto& pth = per_thread_[id];
+    if (pth.numa_node == node &&
+        (res_id == kuint32max || pth.num_connections < per_thread_[res_id].num_connections)) {
+      res_id = id;
+    }
+  }
+  VLOG_IF(1, res_id != kuint32max) << "using thread " << res_id << " on numa node " << node;
+  return res_id;
+}
+
+pair<uint32_t, uint32_t> Listener::ConnectionThreads(uint32_t pool_size) {
+  uint32_t total = GetFlag(FLAGS_conn_io_threads);
+  uint32_t start = GetFlag(FLAGS_conn_io_thread_start) % pool_size;
+
+  if (total == 0 || total + start > pool_size) {
+    total = pool_size - start;
+  }
+  return {start, total};
+}
+
 DispatchTracker::DispatchTracker(absl::Span<facade::Listener* const> listeners,
                                  facade::Connection* issuer, bool ignore_paused,
                                  bool ignore_blocked)
@@ -50,9 +50,14 @@ class Listener : public util::ListenerInterface {
   bool IsPrivilegedInterface() const;
   bool IsMainInterface() const;
 
+  // Returns the first thread index and the number of threads that handle client connections,
+  // according to conn_io_threads and conn_io_thread_start.
+  static std::pair<uint32_t, uint32_t> ConnectionThreads(uint32_t pool_size);
+
  private:
   util::Connection* NewConnection(ProactorBase* proactor) final;
   ProactorBase* PickConnectionProactor(util::FiberSocketBase* sock) final;
+  uint32_t PickNumaLocalThread(int node);
 
   void OnConnectionStart(util::Connection* conn) final;
   void OnConnectionClose(util::Connection* conn) final;
@@ -69,6 +74,7 @@ class Listener : public util::ListenerInterface {
   struct PerThread {
     int32_t num_connections{0};
     unsigned napi_id = 0;
+    int numa_node = -1;
   };
   std::vector<PerThread> per_thread_;
 
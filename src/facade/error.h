@@ -36,6 +36,7 @@ extern const char kLoadingErr[];
 extern const char kUndeclaredKeyErr[];
 extern const char kInvalidDumpValueErr[];
 extern const char kInvalidJsonPathErr[];
+extern const char kDeadlineExceededErr[];
 
 extern const char kSyntaxErrType[];
 extern const char kScriptErrType[];
@@ -20,9 +20,11 @@ constexpr size_t kSizeConnStats = sizeof(ConnectionStats);
 
 ConnectionStats& ConnectionStats::operator+=(const ConnectionStats& o) {
   // To break this code deliberately if we add/remove a field to this struct.
-  static_assert(kSizeConnStats == 112u);
+  static_assert(kSizeConnStats == 200u);
 
   ADD(read_buf_capacity);
+  ADD(read_buf_pool_bytes);
+  ADD(read_buf_saved_bytes);
   ADD(dispatch_queue_entries);
   ADD(dispatch_queue_bytes);
   ADD(dispatch_queue_subscriber_bytes);
@@ -37,14 +39,26 @@ ConnectionStats& ConnectionStats::operator+=(const ConnectionStats& o) {
   ADD(num_replicas);
   ADD(num_blocked_clients);
   ADD(num_migrations);
+  ADD(squash_threshold_updates);
+  ADD(squash_batch_updates);
+  ADD(pipeline_shed_cnt);
+  ADD(slow_subscriber_disconnects);
+  ADD(tls_handshakes);
+  ADD(tls_handshakes_resumed);
+  ADD(tls_handshake_failures);
+  ADD(tls_handshakes_throttled);
+  ADD(tls_handshake_usec);
 
   return *this;
 }
 
 ReplyStats& ReplyStats::operator+=(const ReplyStats& o) {
-  static_assert(sizeof(ReplyStats) == 72u + kSanitizerOverhead);
+  static_assert(sizeof(ReplyStats) == 96u + kSanitizerOverhead);
   ADD(io_write_cnt);
   ADD(io_write_bytes);
+  ADD(zerocopy_send_cnt);
+  ADD(zerocopy_send_bytes);
+  ADD(zerocopy_copied_cnt);
 
   for (const auto& k_v : o.err_count) {
     err_count[k_v.first] += k_v.second;
@@ -97,6 +111,7 @@ const char kLoadingErr[] = "-LOADING Dragonfly is loading the dataset in memory"
 const char kUndeclaredKeyErr[] = "script tried accessing undeclared key";
 const char kInvalidDumpValueErr[] = "DUMP payload version or checksum are wrong";
 const char kInvalidJsonPathErr[] = "invalid JSON path";
+const char kDeadlineExceededErr[] = "-TIMEOUT command dropped after exceeding its queue deadline";
 
 const char kSyntaxErrType[] = "syntax_error";
 const char kScriptErrType[] = "script_error";
@@ -132,7 +147,8 @@ CommandId::CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first
       first_key_(first_key),
       last_key_(last_key),
       acl_categories_(acl_categories) {
-  if (name_ == "PUBLISH" || name_ == "SUBSCRIBE" || name_ == "UNSUBSCRIBE") {
+  if (name_ == "PUBLISH" || name_ == "SUBSCRIBE" || name_ == "UNSUBSCRIBE" ||
+      name_ == "SPUBLISH" || name_ == "SSUBSCRIBE" || name_ == "SUNSUBSCRIBE") {
     is_pub_sub_ = true;
   } else if (name_ == "PSUBSCRIBE" || name_ == "PUNSUBSCRIBE") {
     is_p_sub_ = true;
@@ -97,8 +97,19 @@ struct ArgRange {
 
   std::variant<CmdArgList, ArgSlice, OwnedArgSlice> span;
 };
+// Pipeline squashing parameters and feedback exchanged between a connection and
+// ServiceInterface::DispatchManyCommands.
+struct SquashInfo {
+  uint32_t batch_limit = 0;  // max commands per shard within a single hop, 0 - service default
+  uint32_t squashed = 0;     // commands executed within squashed hops
+  uint32_t hops = 0;         // number of squashed hops
+  uint32_t full_hops = 0;    // hops flushed early because a shard reached batch_limit
+};
+
 struct ConnectionStats {
   size_t read_buf_capacity = 0;                // total capacity of input buffers
+  size_t read_buf_pool_bytes = 0;   // capacity of the input buffers pooled for waiting connections
+  size_t read_buf_saved_bytes = 0;  // capacity given back by connections waiting for input
   uint64_t dispatch_queue_entries = 0;         // total number of dispatch queue entries
   size_t dispatch_queue_bytes = 0;             // total size of all dispatch queue entries
   size_t dispatch_queue_subscriber_bytes = 0;  // total size of all publish messages
@@ -118,6 +129,23 @@ struct ConnectionStats {
   uint32_t num_blocked_clients = 0;
   uint64_t num_migrations = 0;
 
+  // Adjustments made by adaptive pipeline squashing.
+  uint64_t squash_threshold_updates = 0;
+  uint64_t squash_batch_updates = 0;
+
+  // Pipelined commands dropped because of their deadline or the shedding queue length.
+  uint64_t pipeline_shed_cnt = 0;
+
+  // Subscribers disconnected because of subscriber_output_limit.
+  uint64_t slow_subscriber_disconnects = 0;
+
+  // TLS handshakes of accepted connections, see --tls_handshake_rate.
+  uint64_t tls_handshakes = 0;
+  uint64_t tls_handshakes_resumed = 0;    // abbreviated handshakes that resumed a session
+  uint64_t tls_handshake_failures = 0;
+  uint64_t tls_handshakes_throttled = 0;  // handshakes that waited for the rate limit
+  uint64_t tls_handshake_usec = 0;        // total time spent in handshakes
+
   ConnectionStats& operator+=(const ConnectionStats& o);
 };
 
@@ -140,6 +168,11 @@ struct ReplyStats {
 
   size_t io_write_cnt = 0;
   size_t io_write_bytes = 0;
+
+  // Sends done with MSG_ZEROCOPY and the ones the kernel still had to copy.
+  size_t zerocopy_send_cnt = 0;
+  size_t zerocopy_send_bytes = 0;
+  size_t zerocopy_copied_cnt = 0;
   absl::flat_hash_map<std::string, uint64_t> err_count;
   size_t script_error_count = 0;
 
@@ -0,0 +1,223 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/ktls.h"
+
+#include <absl/strings/escaping.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef DFLY_USE_SSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+#include "util/tls/tls_socket.h"
+#endif
+
+#ifdef __linux__
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#include "base/flags.h"
+#include "base/logging.h"
+
+ABSL_FLAG(bool, tls_ktls, false,
+          "If true, moves the encryption of TLS 1.3 connections with AES-GCM ciphers to the "
+          "kernel once the handshake completes. Connections that can not be offloaded keep using "
+          "TLS in userspace. Servers with this flag do not send session tickets, so replicas "
+          "should only use it with masters that run with it as well");
+
+namespace facade {
+
+using namespace std;
+
+#if defined(DFLY_USE_SSL) && defined(__linux__) && defined(TLS_1_3_VERSION)
+
+namespace {
+
+// Cleared once the kernel reports that the tls module is not available.
+atomic_bool ulp_available{true};
+
+// Traffic secrets of the application data, captured from the key log of the handshake.
+struct TrafficSecrets {
+  string client, server;
+
+  ~TrafficSecrets() {
+    OPENSSL_cleanse(client.data(), client.size());
+    OPENSSL_cleanse(server.data(), server.size());
+  }
+};
+
+void FreeSecrets(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp) {
+  delete static_cast<TrafficSecrets*>(ptr);
+}
+
+int SecretsIndex() {
+  static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, FreeSecrets);
+  return index;
+}
+
+// Lines have the form "<label> <client random> <secret>" in hex.
+void KeylogCb(const SSL* ssl, const char* line) {
+  vector<string_view> parts = absl::StrSplit(line, ' ');
+  if (parts.size() != 3)
+    return;
+
+  bool client = parts[0] == "CLIENT_TRAFFIC_SECRET_0";
+  if (!client && parts[0] != "SERVER_TRAFFIC_SECRET_0")
+    return;
+
+  SSL* mut_ssl = const_cast<SSL*>(ssl);
+  auto* secrets = static_cast<TrafficSecrets*>(SSL_get_ex_data(ssl, SecretsIndex()));
+  if (!secrets) {
+    secrets = new TrafficSecrets;
+    SSL_set_ex_data(mut_ssl, SecretsIndex(), secrets);
+  }
+  (client ? secrets->client : secrets->server) = absl::HexStringToBytes(parts[2]);
+}
+
+// HKDF-Expand-Label of RFC 8446, section 7.1, with an empty context.
+bool ExpandLabel(const EVP_MD* md, string_view secret, string_view label, uint8_t* out,
+                 size_t len) {
+  string tls_label = absl::StrCat("tls13 ", label);
+  string info;
+  info.push_back(char(len >> 8));
+  info.push_back(char(len & 0xff));
+  info.push_back(char(tls_label.size()));
+  info.append(tls_label);
+  info.push_back(0);
+
+  EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+  bool ok = pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+            EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+            EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+            EVP_PKEY_CTX_set1_hkdf_key(pctx, reinterpret_cast<const uint8_t*>(secret.data()),
+                                       secret.size()) > 0 &&
+            EVP_PKEY_CTX_add1_hkdf_info(pctx, reinterpret_cast<const uint8_t*>(info.data()),
+                                        info.size()) > 0 &&
+            EVP_PKEY_derive(pctx, out, &len) > 0;
+  EVP_PKEY_CTX_free(pctx);
+  return ok;
+}
+
+// Installs the keys derived from secret for one direction. Returns 0 or the errno.
+template <typename Info>
+int SetKeys(int fd, int direction, uint16_t cipher, const EVP_MD* md, string_view secret) {
+  Info info;
+  memset(&info, 0, sizeof(info));
+  info.info.version = TLS_1_3_VERSION;
+  info.info.cipher_type = cipher;
+
+  // The kernel takes the 12 byte nonce as a salt followed by an iv. Record sequences start at 0,
+  // as nothing was sent with the traffic keys yet.
+  uint8_t iv[sizeof(info.salt) + sizeof(info.iv)];
+  int res = EINVAL;
+  if (ExpandLabel(md, secret, "key", info.key, sizeof(info.key)) &&
+      ExpandLabel(md, secret, "iv", iv, sizeof(iv))) {
+    memcpy(info.salt, iv, sizeof(info.salt));
+    memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+    res = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info)) == 0 ? 0 : errno;
+  }
+
+  OPENSSL_cleanse(iv, sizeof(iv));
+  OPENSSL_cleanse(&info, sizeof(info));
+  return res;
+}
+
+}  // namespace
+
+void PrepareKtlsContext(SSL_CTX* ctx) {
+  if (!absl::GetFlag(FLAGS_tls_ktls))
+    return;
+
+  SSL_CTX_set_keylog_callback(ctx, KeylogCb);
+
+  // Tickets are sent with the traffic keys after the handshake and would offset the sequence of
+  // the records.
+  SSL_CTX_set_num_tickets(ctx, 0);
+}
+
+io::Result<bool> OffloadTlsToKernel(unique_ptr<util::FiberSocketBase>* sock) {
+  if (!absl::GetFlag(FLAGS_tls_ktls) || !ulp_available.load(memory_order_relaxed))
+    return false;
+
+  auto* tls_sock = static_cast<util::tls::TlsSocket*>(sock->get());
+  SSL* ssl = tls_sock->ssl_handle();
+  auto* secrets = static_cast<TrafficSecrets*>(SSL_get_ex_data(ssl, SecretsIndex()));
+  if (!secrets || secrets->client.empty() || secrets->server.empty() ||
+      SSL_version(ssl) != TLS1_3_VERSION)
+    return false;
+
+  // Records that were already read into userspace can not be handed to the kernel.
+  if (SSL_has_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)) > 0)
+    return false;
+
+  uint16_t cipher;
+  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+    case TLS1_3_CK_AES_128_GCM_SHA256:
+      cipher = TLS_CIPHER_AES_GCM_128;
+      break;
+    case TLS1_3_CK_AES_256_GCM_SHA384:
+      cipher = TLS_CIPHER_AES_GCM_256;
+      break;
+    default:
+      return false;
+  }
+
+  int fd = (*sock)->native_handle();
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+    if (errno == ENOENT) {
+      LOG_FIRST_N(WARNING, 1) << "kTLS is not available, the tls kernel module is not loaded";
+      ulp_available.store(false, memory_order_relaxed);
+    }
+    return false;
+  }
+
+  const EVP_MD* md = SSL_CIPHER_get_handshake_digest(SSL_get_current_cipher(ssl));
+  bool is_server = SSL_is_server(ssl);
+  string_view rx_secret = is_server ? secrets->client : secrets->server;
+  string_view tx_secret = is_server ? secrets->server : secrets->client;
+  auto set_keys = cipher == TLS_CIPHER_AES_GCM_128 ? SetKeys<tls12_crypto_info_aes_gcm_128>
+                                                   : SetKeys<tls12_crypto_info_aes_gcm_256>;
+
+  // Until keys are installed the socket passes data through, so a failure here leaves the
+  // connection in userspace.
+  if (int err = set_keys(fd, TLS_RX, cipher, md, rx_secret); err) {
+    VLOG(1) << "Could not install kTLS rx keys: " << strerror(err);
+    return false;
+  }
+
+  if (int err = set_keys(fd, TLS_TX, cipher, md, tx_secret); err) {
+    return nonstd::make_unexpected(error_code{err, system_category()});
+  }
+
+  SSL_set_ex_data(ssl, SecretsIndex(), nullptr);
+  delete secrets;
+
+  auto next = tls_sock->ReleaseNext();
+  *sock = std::move(next);
+  return true;
+}
+
+#else
+
+void PrepareKtlsContext(SSL_CTX* ctx) {
+}
+
+io::Result<bool> OffloadTlsToKernel(unique_ptr<util::FiberSocketBase>* sock) {
+  return false;
+}
+
+#endif
+
+}  // namespace facade
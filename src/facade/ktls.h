@@ -0,0 +1,29 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <memory>
+
+#include "io/io.h"
+#include "util/fiber_socket_base.h"
+
+typedef struct ssl_ctx_st SSL_CTX;
+
+namespace facade {
+
+// Kernel TLS offload. Once OpenSSL completes the handshake, the traffic keys are installed on the
+// socket (SOL_TLS), so that the kernel encrypts and decrypts the records during send and recv and
+// the connection reads and writes plaintext. Supports TLS 1.3 with AES-GCM ciphers; all other
+// connections keep using TLS in userspace.
+
+// Configures ctx so that its connections can be offloaded. No-op unless --tls_ktls is set.
+void PrepareKtlsContext(SSL_CTX* ctx);
+
+// Tries to offload the TLS socket *sock, whose handshake has completed. On success replaces it
+// with the underlying socket and returns true. Returns false if the connection stays in
+// userspace, and an error if the socket was left unusable.
+io::Result<bool> OffloadTlsToKernel(std::unique_ptr<util::FiberSocketBase>* sock);
+
+}  // namespace facade
@@ -26,7 +26,9 @@ MP::CmdType From(string_view token) {
       {"get", MP::GET},       {"gets", MP::GETS},       {"gat", MP::GAT},
       {"gats", MP::GATS},     {"stats", MP::STATS},     {"incr", MP::INCR},
       {"decr", MP::DECR},     {"delete", MP::DELETE},   {"flush_all", MP::FLUSHALL},
-      {"quit", MP::QUIT},     {"version", MP::VERSION},
+      {"quit", MP::QUIT},     {"version", MP::VERSION}, {"mn", MP::META_NOOP},
+      {"mg", MP::META_GET},   {"ms", MP::META_SET},     {"md", MP::META_DELETE},
+      {"ma", MP::META_ARITHM},
   };
 
   auto it = cmd_map.find(token);
@@ -116,10 +118,111 @@ MP::Result ParseValueless(TokensView tokens, MP::Command* res) {
   return MP::OK;
 }
 
+// mg <key> <flags>*
+// ms <key> <datalen> <flags>*
+// md <key> <flags>*
+// ma <key> <flags>*
+MP::Result ParseMeta(TokensView tokens, MP::Command* res) {
+  if (res->type == MP::META_NOOP)
+    return MP::OK;
+
+  if (tokens.empty() || tokens[0].size() > 250)
+    return MP::PARSE_ERROR;
+
+  res->key = tokens[0];
+  res->expire_ts = 0;
+  res->flags = 0;
+
+  size_t flag_pos = 1;
+  string_view allowed;
+  switch (res->type) {
+    case MP::META_GET:
+      allowed = "qOkvfcs";
+      break;
+    case MP::META_SET:
+      if (tokens.size() < 2)
+        return MP::PARSE_ERROR;
+      if (!absl::SimpleAtoi(tokens[1], &res->bytes_len))
+        return MP::BAD_INT;
+      ++flag_pos;
+      allowed = "qOkFTM";
+      res->meta.mode = 'S';
+      break;
+    case MP::META_DELETE:
+      allowed = "qOk";
+      break;
+    default:
+      allowed = "qOkvDM";
+      res->delta = 1;
+      res->meta.mode = 'I';
+      break;
+  }
+
+  // Each flag is a single character, optionally followed by its argument.
+  for (string_view token : tokens.subspan(flag_pos)) {
+    char flag = token[0];
+    string_view arg = token.substr(1);
+    if (allowed.find(flag) == string_view::npos)
+      return MP::PARSE_ERROR;
+
+    switch (flag) {
+      case 'q':
+        res->meta.quiet = true;
+        break;
+      case 'O':
+        if (arg.size() > 32)
+          return MP::PARSE_ERROR;
+        res->meta.opaque = arg;
+        break;
+      case 'k':
+        res->meta.return_key = true;
+        break;
+      case 'v':
+        res->meta.return_value = true;
+        break;
+      case 'f':
+        res->meta.return_flags = true;
+        break;
+      case 'c':
+        res->meta.return_cas = true;
+        break;
+      case 's':
+        res->meta.return_size = true;
+        break;
+      case 'F':
+        if (!absl::SimpleAtoi(arg, &res->flags))
+          return MP::BAD_INT;
+        break;
+      case 'T':
+        if (!absl::SimpleAtoi(arg, &res->expire_ts))
+          return MP::BAD_INT;
+        break;
+      case 'D':
+        if (!absl::SimpleAtoi(arg, &res->delta))
+          return MP::BAD_DELTA;
+        break;
+      case 'M':
+        if (arg.size() != 1)
+          return MP::PARSE_ERROR;
+        res->meta.mode = absl::ascii_toupper(arg[0]);
+        break;
+    }
+  }
+
+  // Store modes: set, add (E), append, prepend and replace. Arithmetic modes: incr, decr.
+  string_view modes = res->type == MP::META_SET ? "SEAPR" : "I+D-";
+  if (res->meta.mode && modes.find(res->meta.mode) == string_view::npos)
+    return MP::PARSE_ERROR;
+
+  return MP::OK;
+}
+
 }  // namespace
 
 auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
   cmd->no_reply = false;  // re-initialize
+  cmd->keys_ext.clear();
+  cmd->meta = MetaFlags{};
   auto pos = str.find("\r\n");
   *consumed = 0;
   if (pos == string_view::npos) {
@@ -148,6 +251,11 @@ auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
     return UNKNOWN_CMD;
   }
 
+  if (cmd->IsMeta()) {
+    TokensView tokens_view{tokens.begin() + 1, num_tokens - 1};
+    return ParseMeta(tokens_view, cmd);
+  }
+
   if (cmd->type <= CAS) {                            // Store command
     if (num_tokens < 5 || tokens[1].size() > 250) {  // key length limit
       return MP::PARSE_ERROR;
@@ -39,6 +39,25 @@ class MemcacheParser {
     INCR = 32,
     DECR = 33,
     FLUSHALL = 34,
+
+    // Meta commands, see https://github.com/memcached/memcached/wiki/MetaCommands
+    META_NOOP = 40,
+    META_GET = 41,
+    META_SET = 42,
+    META_DELETE = 43,
+    META_ARITHM = 44,
+  };
+
+  // Flags of meta commands.
+  struct MetaFlags {
+    std::string_view opaque;    // O: echoed back in the reply.
+    bool quiet = false;         // q: suppresses the replies that report success or a miss.
+    bool return_value = false;  // v
+    bool return_key = false;    // k
+    bool return_flags = false;  // f
+    bool return_cas = false;    // c
+    bool return_size = false;   // s
+    char mode = 0;              // M: the store mode of ms or the arithmetic mode of ma.
   };
 
   // According to https://github.com/memcached/memcached/wiki/Commands#standard-protocol
@@ -57,6 +76,11 @@ class MemcacheParser {
     uint32_t bytes_len = 0;
     uint32_t flags = 0;
     bool no_reply = false;
+    MetaFlags meta;
+
+    bool IsMeta() const {
+      return type >= META_NOOP;
+    }
   };
 
   enum Result {
@@ -69,7 +93,7 @@ class MemcacheParser {
   };
 
   static bool IsStoreCmd(CmdType type) {
-    return type >= SET && type <= CAS;
+    return (type >= SET && type <= CAS) || type == META_SET;
   }
 
   Result Parse(std::string_view str, uint32_t* consumed, Command* res);
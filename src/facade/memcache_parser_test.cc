@@ -78,6 +78,63 @@ TEST_F(MCParserTest, Stats) {
   EXPECT_EQ(MemcacheParser::PARSE_ERROR, st);
 }
 
+TEST_F(MCParserTest, Meta) {
+  MemcacheParser::Result st = parser_.Parse("mg key v f c k Oabc q\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_GET, cmd_.type);
+  EXPECT_EQ("key", cmd_.key);
+  EXPECT_TRUE(cmd_.meta.return_value && cmd_.meta.return_flags && cmd_.meta.return_cas &&
+              cmd_.meta.return_key);
+  EXPECT_FALSE(cmd_.meta.return_size);
+  EXPECT_EQ("abc", cmd_.meta.opaque);
+  EXPECT_TRUE(cmd_.meta.quiet);
+  EXPECT_FALSE(cmd_.no_reply);
+
+  st = parser_.Parse("ms key 5 F7 T100 MA\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_SET, cmd_.type);
+  EXPECT_TRUE(MemcacheParser::IsStoreCmd(cmd_.type));
+  EXPECT_EQ(5, cmd_.bytes_len);
+  EXPECT_EQ(7, cmd_.flags);
+  EXPECT_EQ(100, cmd_.expire_ts);
+  EXPECT_EQ('A', cmd_.meta.mode);
+  EXPECT_FALSE(cmd_.meta.quiet);
+
+  st = parser_.Parse("ms key 5\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(0, cmd_.flags);
+  EXPECT_EQ(0, cmd_.expire_ts);
+  EXPECT_EQ('S', cmd_.meta.mode);
+
+  st = parser_.Parse("ma key D10 MD v\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_ARITHM, cmd_.type);
+  EXPECT_EQ(10, cmd_.delta);
+  EXPECT_EQ('D', cmd_.meta.mode);
+  EXPECT_TRUE(cmd_.meta.return_value);
+
+  st = parser_.Parse("ma key\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(1, cmd_.delta);
+  EXPECT_EQ('I', cmd_.meta.mode);
+
+  st = parser_.Parse("md key q\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_DELETE, cmd_.type);
+  EXPECT_TRUE(cmd_.meta.quiet);
+
+  st = parser_.Parse("mn\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_NOOP, cmd_.type);
+
+  // Unsupported flags and modes.
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("mg key T10\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("ms key 5 MX\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("mg\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::BAD_INT, parser_.Parse("ms key x\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::BAD_DELTA, parser_.Parse("ma key D-1\r\n", &consumed_, &cmd_));
+}
+
 TEST_F(MCParserTest, NoreplyBasic) {
   MemcacheParser::Result st = parser_.Parse("set mykey 1 2 3 noreply\r\n", &consumed_, &cmd_);
 
@@ -0,0 +1,144 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/numa.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "base/logging.h"
+#include "io/file_util.h"
+
+namespace facade {
+
+using namespace std;
+
+vector<int> ParseCpuList(string_view list) {
+  vector<int> res;
+  for (string_view range : absl::StrSplit(absl::StripAsciiWhitespace(list), ',',
+                                          absl::SkipWhitespace())) {
+    pair<string_view, string_view> bounds = absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first))
+      return {};
+    if (bounds.second.empty()) {
+      last = first;
+    } else if (!absl::SimpleAtoi(bounds.second, &last)) {
+      return {};
+    }
+    for (int i = first; i <= last; ++i)
+      res.push_back(i);
+  }
+  return res;
+}
+
+const NumaTopology& NumaTopology::Get() {
+  static const NumaTopology topology = [] {
+    NumaTopology res;
+    auto online = io::ReadFileToString("/sys/devices/system/node/online");
+    if (!online)
+      return res;
+
+    vector<int> nodes = ParseCpuList(*online);
+    if (nodes.size() < 2)
+      return res;
+
+    res.node_cpus_.resize(nodes.back() + 1);
+    for (int node : nodes) {
+      auto cpulist = io::ReadFileToString(absl::StrCat("/sys/devices/system/node/node", node,
+                                                       "/cpulist"));
+      if (!cpulist)
+        continue;
+      for (int cpu : ParseCpuList(*cpulist)) {
+        if (unsigned(cpu) >= res.cpu_to_node_.size())
+          res.cpu_to_node_.resize(cpu + 1, -1);
+        res.cpu_to_node_[cpu] = node;
+        res.node_cpus_[node].push_back(cpu);
+      }
+    }
+    VLOG(1) << "Found " << nodes.size() << " numa nodes";
+    return res;
+  }();
+
+  return topology;
+}
+
+int NumaTopology::CurrentNode() const {
+  return NodeOfCpu(sched_getcpu());
+}
+
+int BindThreadToCurrentNode() {
+  const NumaTopology& topology = NumaTopology::Get();
+  int node = topology.CurrentNode();
+  if (node < 0)
+    return -1;
+
+  // Keep any finer pinning of the thread, only drop the cpus of other nodes.
+  cpu_set_t current, allowed;
+  CPU_ZERO(&allowed);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(current), &current) != 0)
+    return -1;
+  for (int cpu : topology.CpusOfNode(node)) {
+    if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &current))
+      CPU_SET(cpu, &allowed);
+  }
+  if (CPU_COUNT(&allowed) > 0 && !CPU_EQUAL(&allowed, &current)) {
+    if (int res = pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed); res != 0) {
+      LOG(WARNING) << "Could not bind thread to numa node " << node << ": " << strerror(res);
+      return -1;
+    }
+  }
+
+  // The preferred policy falls back to other nodes when the local one is exhausted.
+  unsigned long mask[4] = {0};
+  constexpr unsigned kBitsPerWord = sizeof(mask[0]) * 8;
+  if (unsigned(node) >= sizeof(mask) * 8)
+    return -1;
+  mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) != 0) {
+    LOG(WARNING) << "Could not set memory policy for numa node " << node << ": "
+                 << strerror(errno);
+    return -1;
+  }
+
+  return node;
+}
+
+bool ReadNumaMemoryStats(NumaMemoryStats* stats) {
+  const NumaTopology& topology = NumaTopology::Get();
+  if (topology.num_nodes() < 2)
+    return false;
+
+  *stats = NumaMemoryStats{};
+  for (unsigned node = 0; node < topology.num_nodes(); ++node) {
+    auto numastat =
+        io::ReadFileToString(absl::StrCat("/sys/devices/system/node/node", node, "/numastat"));
+    if (!numastat)
+      continue;
+
+    for (string_view line : absl::StrSplit(*numastat, '\n', absl::SkipWhitespace())) {
+      pair<string_view, string_view> kv = absl::StrSplit(line, absl::MaxSplits(' ', 1));
+      uint64_t val;
+      if (!absl::SimpleAtoi(kv.second, &val))
+        continue;
+      if (kv.first == "local_node")
+        stats->local_pages += val;
+      else if (kv.first == "other_node")
+        stats->remote_pages += val;
+    }
+  }
+  return true;
+}
+
+}  // namespace facade
@@ -0,0 +1,59 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace facade {
+
+// Parses a sysfs cpu or node list, i.e. "0-3,8,10-11". Returns an empty list if it is malformed.
+std::vector<int> ParseCpuList(std::string_view list);
+
+// NUMA topology of the host as exposed by sysfs. On hosts with a single node, or when sysfs is
+// not available, it reports a single node and NodeOfCpu() returns -1.
+class NumaTopology {
+ public:
+  // Loaded once, on first use.
+  static const NumaTopology& Get();
+
+  unsigned num_nodes() const {
+    return node_cpus_.empty() ? 1 : node_cpus_.size();
+  }
+
+  // Returns the node of `cpu` or -1 if unknown.
+  int NodeOfCpu(int cpu) const {
+    return cpu >= 0 && unsigned(cpu) < cpu_to_node_.size() ? cpu_to_node_[cpu] : -1;
+  }
+
+  const std::vector<int>& CpusOfNode(unsigned node) const {
+    return node_cpus_[node];
+  }
+
+  // Returns the node of the cpu the calling thread runs on or -1 if unknown.
+  int CurrentNode() const;
+
+ private:
+  std::vector<int> cpu_to_node_;
+  std::vector<std::vector<int>> node_cpus_;
+};
+
+// Restricts the calling thread to the cpus of the node it currently runs on, and makes that node
+// the preferred source of the memory the thread faults in. Returns the node, or -1 if the host
+// has a single node or the binding failed.
+int BindThreadToCurrentNode();
+
+struct NumaMemoryStats {
+  // Pages allocated on the intended node and on other nodes, summed over all nodes since boot.
+  uint64_t local_pages = 0;
+  uint64_t remote_pages = 0;
+};
+
+// Reads the per node allocation counters of the kernel. These are host wide, not per process.
+// Returns false if they are not available.
+bool ReadNumaMemoryStats(NumaMemoryStats* stats);
+
+}  // namespace facade
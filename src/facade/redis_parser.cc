@@ -7,11 +7,56 @@
 
 #include "base/logging.h"
 #include "core/heap_size.h"
+#include "core/sse_port.h"
 
 namespace facade {
 
 using namespace std;
 
+namespace {
+
+// Minimal number of readable bytes for the vectorized header parsing.
+constexpr size_t kHeaderWindow = 16;
+
+// Returns a bitmask of '\r' positions within the kHeaderWindow bytes starting at ptr.
+inline uint32_t CRMask(const uint8_t* ptr) {
+#ifndef __s390x__
+  __m128i window = dfly::mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(window, _mm_set1_epi8('\r')));
+#else
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < kHeaderWindow; ++i)
+    mask |= uint32_t(ptr[i] == '\r') << i;
+  return mask;
+#endif
+}
+
+// Parses a non-negative decimal number terminated by CRLF. Requires kHeaderWindow readable bytes.
+// Returns the number of bytes consumed including CRLF, or 0 if the input is not a plain decimal
+// number of up to 9 digits, in which case the generic path should handle it.
+inline unsigned ParseLenFast(const uint8_t* ptr, uint32_t* len) {
+  uint32_t mask = CRMask(ptr);
+  if (mask == 0)
+    return 0;
+
+  unsigned pos = __builtin_ctz(mask);
+  if (pos == 0 || pos > 9 || ptr[pos + 1] != '\n')
+    return 0;
+
+  uint32_t val = 0;
+  for (unsigned i = 0; i < pos; ++i) {
+    unsigned digit = ptr[i] - '0';
+    if (digit > 9)
+      return 0;
+    val = val * 10 + digit;
+  }
+
+  *len = val;
+  return pos + 2;
+}
+
+}  // namespace
+
 auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> Result {
   *consumed = 0;
   res->clear();
@@ -41,6 +86,8 @@ auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> R
       case PARSE_ARG_S:
         if (str.size() == 0 || (str.size() < 4 && str[0] != '_')) {
           last_result_ = INPUT_PENDING;
+        } else if (server_mode_ && ParseBulkRun(str)) {
+          last_result_ = OK;
         } else {
           last_result_ = ParseArg(str);
         }
@@ -211,6 +258,15 @@ auto RedisParser::ParseNum(Buffer str, int64_t* res) -> Result {
   }
   DCHECK(str[0] == '$' || str[0] == '*' || str[0] == '%' || str[0] == '~');
 
+  if (str.size() > kHeaderWindow) {
+    uint32_t len;
+    if (unsigned hdr_len = ParseLenFast(str.data() + 1, &len); hdr_len) {
+      *res = len;
+      last_consumed_ = hdr_len + 1;
+      return OK;
+    }
+  }
+
   char* s = reinterpret_cast<char*>(str.data() + 1);
   char* pos = reinterpret_cast<char*>(memchr(s, '\n', str.size() - 1));
   if (!pos) {
@@ -436,6 +492,40 @@ auto RedisParser::ConsumeBulk(Buffer str) -> Result {
   return INPUT_PENDING;
 }
 
+bool RedisParser::ParseBulkRun(Buffer str) {
+  DCHECK(!parse_stack_.empty());
+  DCHECK(!is_broken_token_);
+
+  uint8_t* ptr = str.data();
+  uint8_t* end = ptr + str.size();
+  uint32_t& remaining = parse_stack_.back().first;
+
+  while (size_t(end - ptr) > kHeaderWindow && *ptr == '$') {
+    uint32_t len;
+    unsigned hdr_len = ParseLenFast(ptr + 1, &len);
+    if (hdr_len == 0 || len > kMaxBulkLen)
+      break;
+
+    uint8_t* data = ptr + 1 + hdr_len;
+    if (size_t(end - data) < size_t(len) + 2 || data[len] != '\r' || data[len + 1] != '\n')
+      break;
+
+    cached_expr_->emplace_back(RespExpr::STRING);
+    cached_expr_->back().u = Buffer{data, len};
+    ptr = data + len + 2;
+
+    // Let HandleFinishArg complete the array.
+    if (remaining == 1) {
+      state_ = FINISH_ARG_S;
+      break;
+    }
+    --remaining;
+  }
+
+  last_consumed_ = ptr - str.data();
+  return last_consumed_ > 0;
+}
+
 void RedisParser::HandleFinishArg() {
   state_ = PARSE_ARG_S;
   DCHECK(!parse_stack_.empty());
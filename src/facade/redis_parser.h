@@ -73,6 +73,11 @@ class RedisParser {
   Result ConsumeBulk(Buffer str);
   Result ParseInline(Buffer str);
 
+  // Server mode fast path: consumes a run of complete bulk strings of the current array without
+  // going through the state machine. Stops at the first incomplete or non-bulk element, which is
+  // then handled by ParseArg. Returns true if at least one element was consumed.
+  bool ParseBulkRun(Buffer str);
+
   // Updates last_consumed_
   Result ParseNum(Buffer str, int64_t* res);
   void HandleFinishArg();
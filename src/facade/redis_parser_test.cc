@@ -210,6 +210,69 @@ TEST_F(RedisParserTest, NestedArray) {
   ASSERT_THAT(args_[1].GetVec(), ElementsAre("car"));
 }
 
+TEST_F(RedisParserTest, BulkRun) {
+  // Long enough to go through the bulk fast path.
+  string cmd = "*7\r\n$4\r\nMSET\r\n";
+  for (unsigned i = 0; i < 3; ++i) {
+    string key = absl::StrCat("key:", i), val(100 + i, 'a' + i);
+    absl::StrAppend(&cmd, "$", key.size(), "\r\n", key, "\r\n$", val.size(), "\r\n", val, "\r\n");
+  }
+  string expected_val0(100, 'a'), expected_val2(102, 'c');
+
+  ASSERT_EQ(RedisParser::OK, Parse(cmd));
+  EXPECT_EQ(cmd.size(), consumed_);
+  ASSERT_EQ(7, args_.size());
+  EXPECT_THAT(args_[0], "MSET");
+  EXPECT_THAT(args_[1], "key:0");
+  EXPECT_THAT(args_[2], expected_val0);
+  EXPECT_THAT(args_[6], expected_val2);
+
+  // Pipelined commands are parsed one at a time.
+  string pipeline = absl::StrCat(cmd, cmd);
+  ASSERT_EQ(RedisParser::OK, Parse(pipeline));
+  EXPECT_EQ(cmd.size(), consumed_);
+  EXPECT_EQ(7, args_.size());
+
+  // Any split yields the same result as parsing in one go.
+  for (size_t split = 1; split < cmd.size(); ++split) {
+    RedisParser parser;
+    string buf = cmd;
+    RespVec args;
+    uint32_t consumed = 0;
+    RedisParser::Buffer first{reinterpret_cast<uint8_t*>(buf.data()), split};
+    ASSERT_EQ(RedisParser::INPUT_PENDING, parser.Parse(first, &consumed, &args)) << split;
+
+    // Tail contains the unconsumed part of the first chunk followed by the rest.
+    string tail = buf.substr(consumed);
+    RedisParser::Buffer second{reinterpret_cast<uint8_t*>(tail.data()), tail.size()};
+    ASSERT_EQ(RedisParser::OK, parser.Parse(second, &consumed, &args)) << split;
+    EXPECT_EQ(tail.size(), consumed);
+    ASSERT_EQ(7, args.size()) << split;
+    EXPECT_THAT(args[2], expected_val0) << split;
+    EXPECT_THAT(args[6], expected_val2) << split;
+  }
+}
+
+TEST_F(RedisParserTest, BulkRunErrors) {
+  string val(32, 'x');
+  string prefix = "*2\r\n$3\r\nSET\r\n";
+
+  // Missing CRLF after the bulk payload.
+  ASSERT_EQ(RedisParser::BAD_STRING, Parse(absl::StrCat(prefix, "$32\r\n", val, "XX")));
+
+  // Bulk length that does not fit the fast path is handled by the generic one.
+  parser_ = RedisParser{};
+  ASSERT_EQ(RedisParser::OK, Parse(absl::StrCat(prefix, "$00000000032\r\n", val, "\r\n")));
+  EXPECT_THAT(args_, ElementsAre("SET", val));
+
+  parser_ = RedisParser{};
+  ASSERT_EQ(RedisParser::BAD_ARRAYLEN, Parse(absl::StrCat(prefix, "$-2\r\n", val, "\r\n")));
+
+  // Non bulk element in server mode.
+  parser_ = RedisParser{};
+  ASSERT_EQ(RedisParser::BAD_BULKLEN, Parse(absl::StrCat(prefix, ":32\r\n", val, "\r\n")));
+}
+
 TEST_F(RedisParserTest, UsedMemory) {
   vector<vector<uint8_t>> blobs;
   for (size_t i = 0; i < 100; ++i) {
@@ -230,4 +293,21 @@ TEST_F(RedisParserTest, UsedMemory) {
   EXPECT_GT(dfly::HeapSize(stash), 30000);
 }
 
+static void BM_ParseMSet(benchmark::State& state) {
+  string cmd = absl::StrCat("*", state.range(0) * 2 + 1, "\r\n$4\r\nMSET\r\n");
+  for (unsigned i = 0; i < state.range(0); ++i) {
+    string key = absl::StrCat("key:", i);
+    absl::StrAppend(&cmd, "$", key.size(), "\r\n", key, "\r\n$16\r\n", string(16, 'v'), "\r\n");
+  }
+
+  RedisParser parser;
+  RespVec args;
+  uint32_t consumed;
+  RedisParser::Buffer buf{reinterpret_cast<uint8_t*>(cmd.data()), cmd.size()};
+  while (state.KeepRunning()) {
+    CHECK_EQ(RedisParser::OK, parser.Parse(buf, &consumed, &args));
+  }
+}
+BENCHMARK(BM_ParseMSet)->Arg(1)->Arg(10)->Arg(100);
+
 }  // namespace facade
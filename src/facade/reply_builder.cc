@@ -5,6 +5,7 @@
 
 #include <absl/cleanup/cleanup.h>
 #include <absl/container/fixed_array.h>
+#include <absl/container/inlined_vector.h>
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <double-conversion/double-to-string.h>
@@ -13,8 +14,17 @@
 #include "base/logging.h"
 #include "core/heap_size.h"
 #include "facade/error.h"
+#include "util/fibers/fibers.h"
 #include "util/fibers/proactor_base.h"
 
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <linux/errqueue.h>  // must follow time.h
+#endif
+
 #ifdef __APPLE__
 #ifndef UIO_MAXIOV
 // Some versions of MacOSX dont have IOV_MAX
@@ -108,6 +118,7 @@ void SinkReplyBuilder::Send(const iovec* v, uint32_t len) {
   for (unsigned i = 0; i < len; ++i) {
     bsize += v[i].iov_len;
   }
+  reply_bytes_ += bsize;
 
   // Allow batching with up to kMaxBatchSize of data.
   if ((should_batch_ || should_aggregate_) && (batch_.size() + bsize < kMaxBatchSize)) {
@@ -150,6 +161,7 @@ void SinkReplyBuilder::Send(const iovec* v, uint32_t len) {
   }
   send_active_ = false;
   int64_t after_ns = util::fb2::ProactorBase::GetMonotonicTimeNs();
+  send_usec_ += (after_ns - before_ns) / 1'000;
   tl_facade_stats->reply_stats.send_stats.count++;
   tl_facade_stats->reply_stats.send_stats.total_duration += (after_ns - before_ns) / 1'000;
 
@@ -298,7 +310,13 @@ void SinkReplyBuilder2::Send() {
   reply_stats.io_write_cnt++;
   reply_stats.io_write_bytes += total_size_;
 
-  if (auto ec = sink_->Write(vecs_.data(), vecs_.size()); ec)
+  error_code ec;
+  if (zc_fd_ >= 0 && total_size_ >= zc_threshold_) {
+    ec = SendZeroCopy();
+  } else {
+    ec = sink_->Write(vecs_.data(), vecs_.size());
+  }
+  if (ec)
     ec_ = ec;
 
   uint64_t after_ns = util::fb2::ProactorBase::GetMonotonicTimeNs();
@@ -307,6 +325,92 @@ void SinkReplyBuilder2::Send() {
   send_active_ = false;
 }
 
+error_code SinkReplyBuilder2::SendZeroCopy() {
+#ifdef __linux__
+  auto& reply_stats = tl_facade_stats->reply_stats;
+
+  msghdr msg{};
+  msg.msg_iov = vecs_.data();
+  msg.msg_iovlen = vecs_.size();
+
+  // Non blocking, whatever the socket does not accept is written with the regular path below.
+  ssize_t res = sendmsg(zc_fd_, &msg, MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (res < 0) {
+    if (errno != EAGAIN && errno != ENOBUFS)
+      return error_code{errno, system_category()};
+    res = 0;
+  } else {
+    zc_pending_++;
+    reply_stats.zerocopy_send_cnt++;
+    reply_stats.zerocopy_send_bytes += res;
+  }
+
+  // Skip what was sent already.
+  size_t sent = res;
+  iovec* next = vecs_.data();
+  iovec* end = next + vecs_.size();
+  while (next != end && sent >= next->iov_len) {
+    sent -= next->iov_len;
+    ++next;
+  }
+
+  error_code ec;
+  if (next != end) {
+    next->iov_base = reinterpret_cast<char*>(next->iov_base) + sent;
+    next->iov_len -= sent;
+    ec = sink_->Write(next, end - next);
+  }
+
+  if (auto wait_ec = WaitZeroCopyCompletions(); !ec)
+    ec = wait_ec;
+  return ec;
+#else
+  return sink_->Write(vecs_.data(), vecs_.size());
+#endif
+}
+
+error_code SinkReplyBuilder2::WaitZeroCopyCompletions() {
+#ifdef __linux__
+  auto& reply_stats = tl_facade_stats->reply_stats;
+
+  // Notifications arrive once the peer acknowledged the data, so this takes about an RTT.
+  // Other fibers of the thread keep running while we wait.
+  while (zc_pending_ > 0) {
+    char control[128];
+    msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(zc_fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        util::ThisFiber::SleepFor(20us);
+        continue;
+      }
+      zc_pending_ = 0;
+      return error_code{errno, system_category()};
+    }
+
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      bool is_err = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                    (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+      if (!is_err)
+        continue;
+
+      auto* serr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+        continue;
+
+      // [ee_info, ee_data] is the inclusive range of completed sends.
+      uint32_t completed = serr->ee_data - serr->ee_info + 1;
+      zc_pending_ -= min(completed, zc_pending_);
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        reply_stats.zerocopy_copied_cnt += completed;
+    }
+  }
+#endif
+  return {};
+}
+
 void SinkReplyBuilder2::FinishScope() {
   if (!batched_ || total_size_ * 2 >= kMaxBufferSize)
     return Flush();
@@ -350,32 +454,107 @@ void MCReplyBuilder::SendSimpleString(std::string_view str) {
 }
 
 void MCReplyBuilder::SendStored() {
+  if (const auto* cmd = MetaCmd(); cmd)
+    return SendMeta("HD", *cmd);
   SendSimpleString("STORED");
 }
 
 void MCReplyBuilder::SendLong(long val) {
   char buf[32];
   char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
-  SendSimpleString(string_view(buf, next - buf));
+  string_view str(buf, next - buf);
+  const auto* cmd = MetaCmd();
+  if (!cmd)
+    return SendSimpleString(str);
+
+  if (!cmd->meta.return_value)
+    return SendMeta("HD", *cmd);
+
+  string header = absl::StrCat("VA ", str.size());
+  SendMeta(header, *cmd);
+  SendSimpleString(str);
 }
 
 void MCReplyBuilder::SendMGetResponse(MGetResponse resp) {
-  string header;
-  for (unsigned i = 0; i < resp.resp_arr.size(); ++i) {
-    if (resp.resp_arr[i]) {
+  // The text around the values is rendered first and the values are referenced from it, so that
+  // the whole response goes out in a few vectored writes.
+  string text;
+  struct Piece {
+    size_t text_end;  // the text up to here precedes the value
+    string_view value;
+  };
+  vector<Piece> pieces;
+
+  size_t key_index = 0;
+  auto append_classic = [&](size_t num_keys) {
+    for (size_t i = key_index; i < key_index + num_keys; ++i) {
+      if (!resp.resp_arr[i])
+        continue;
+
       const auto& src = *resp.resp_arr[i];
-      absl::StrAppend(&header, "VALUE ", src.key, " ", src.mc_flag, " ", src.value.size());
+      absl::StrAppend(&text, "VALUE ", src.key, " ", src.mc_flag, " ", src.value.size());
       if (src.mc_ver) {
-        absl::StrAppend(&header, " ", src.mc_ver);
+        absl::StrAppend(&text, " ", src.mc_ver);
       }
+      text.append(kCRLF);
+      pieces.push_back({text.size(), src.value});
+    }
+    text.append("END\r\n");
+    key_index += num_keys;
+  };
+
+  if (cmds_.empty())
+    append_classic(resp.resp_arr.size());
+
+  string flags;
+  for (const auto* cmd : cmds_) {
+    if (!cmd->IsMeta()) {
+      append_classic(1 + cmd->keys_ext.size());
+      continue;
+    }
+
+    const auto& res = resp.resp_arr[key_index++];
+    if (!res) {
+      AppendMeta("EN", *cmd, {}, &text);
+      continue;
+    }
 
-      absl::StrAppend(&header, "\r\n");
-      iovec v[] = {IoVec(header), IoVec(src.value), IoVec(kCRLF)};
-      Send(v, ABSL_ARRAYSIZE(v));
-      header.clear();
+    flags.clear();
+    if (cmd->meta.return_flags)
+      absl::StrAppend(&flags, " f", res->mc_flag);
+    if (cmd->meta.return_cas)
+      absl::StrAppend(&flags, " c", res->mc_ver);
+    if (cmd->meta.return_size)
+      absl::StrAppend(&flags, " s", res->value.size());
+
+    if (cmd->meta.return_value) {
+      AppendMeta(absl::StrCat("VA ", res->value.size()), *cmd, flags, &text);
+      pieces.push_back({text.size(), res->value});
+    } else {
+      AppendMeta("HD", *cmd, flags, &text);
+    }
+  }
+  DCHECK_EQ(key_index, resp.resp_arr.size());
+
+  // Bounded, as Send copies the vector on the stack.
+  constexpr size_t kMaxVecLen = 256;
+  absl::InlinedVector<iovec, 16> vec;
+  size_t text_pos = 0;
+  for (const Piece& piece : pieces) {
+    if (piece.text_end > text_pos)
+      vec.push_back(IoVec(string_view{text}.substr(text_pos, piece.text_end - text_pos)));
+    text_pos = piece.text_end;
+    vec.push_back(IoVec(piece.value));
+    vec.push_back(IoVec(kCRLF));
+    if (vec.size() + 3 > kMaxVecLen) {
+      Send(vec.data(), vec.size());
+      vec.clear();
     }
   }
-  SendSimpleString("END");
+  if (text_pos < text.size())
+    vec.push_back(IoVec(string_view{text}.substr(text_pos)));
+  if (!vec.empty())
+    Send(vec.data(), vec.size());
 }
 
 void MCReplyBuilder::SendError(string_view str, std::string_view type) {
@@ -387,7 +566,7 @@ void MCReplyBuilder::SendProtocolError(std::string_view str) {
 }
 
 bool MCReplyBuilder::NoReply() const {
-  return noreply_;
+  return noreply_ || meta_quiet_;
 }
 
 void MCReplyBuilder::SendClientError(string_view str) {
@@ -396,13 +575,56 @@ void MCReplyBuilder::SendClientError(string_view str) {
 }
 
 void MCReplyBuilder::SendSetSkipped() {
+  if (const auto* cmd = MetaCmd(); cmd)
+    return SendMeta("NS", *cmd);
   SendSimpleString("NOT_STORED");
 }
 
 void MCReplyBuilder::SendNotFound() {
+  if (const auto* cmd = MetaCmd(); cmd)
+    return SendMeta("NF", *cmd);
   SendSimpleString("NOT_FOUND");
 }
 
+void MCReplyBuilder::SendDeleted() {
+  if (const auto* cmd = MetaCmd(); cmd)
+    return SendMeta("HD", *cmd);
+  SendSimpleString("DELETED");
+}
+
+void MCReplyBuilder::SetCommands(absl::Span<const MemcacheParser::Command* const> cmds) {
+  cmds_ = cmds;
+  meta_quiet_ = any_of(cmds.begin(), cmds.end(), [](const auto* cmd) { return cmd->meta.quiet; });
+}
+
+const MemcacheParser::Command* MCReplyBuilder::MetaCmd() const {
+  return !cmds_.empty() && cmds_.front()->IsMeta() ? cmds_.front() : nullptr;
+}
+
+bool MCReplyBuilder::AppendMeta(string_view code, const MemcacheParser::Command& cmd,
+                                string_view flags, string* dest) {
+  // Quiet mode suppresses the replies the client does not need to act on: success, a get miss
+  // and the delete of a missing key.
+  if (cmd.meta.quiet &&
+      (code == "HD" || code == "EN" || (code == "NF" && cmd.type == MemcacheParser::META_DELETE)))
+    return false;
+
+  absl::StrAppend(dest, code, flags);
+  if (cmd.meta.return_key)
+    absl::StrAppend(dest, " k", cmd.key);
+  if (!cmd.meta.opaque.empty())
+    absl::StrAppend(dest, " O", cmd.meta.opaque);
+  dest->append(kCRLF);
+  return true;
+}
+
+void MCReplyBuilder::SendMeta(string_view code, const MemcacheParser::Command& cmd,
+                              string_view flags) {
+  string line;
+  if (AppendMeta(code, cmd, flags, &line))
+    SendRaw(line);
+}
+
 MCReplyBuilder2::MCReplyBuilder2(::io::Sink* sink) : SinkReplyBuilder2(sink), noreply_(false) {
 }
 
@@ -534,6 +756,27 @@ void RedisReplyBuilder::SendBulkString(std::string_view str) {
   return Send(v, ABSL_ARRAYSIZE(v));
 }
 
+void RedisReplyBuilder::SendBulkString(absl::Span<const std::string_view> pieces) {
+  size_t size = 0;
+  for (std::string_view piece : pieces)
+    size += piece.size();
+
+  char tmp[absl::numbers_internal::kFastToBufferSize + 3];
+  tmp[0] = '$';
+  char* next = absl::numbers_internal::FastIntToBuffer(uint32_t(size), tmp + 1);
+  *next++ = '\r';
+  *next++ = '\n';
+
+  std::vector<iovec> v;
+  v.reserve(pieces.size() + 2);
+  v.push_back(IoVec(std::string_view{tmp, size_t(next - tmp)}));
+  for (std::string_view piece : pieces)
+    v.push_back(IoVec(piece));
+  v.push_back(IoVec(kCRLF));
+
+  return Send(v.data(), v.size());
+}
+
 void RedisReplyBuilder::SendVerbatimString(std::string_view str, VerbatimFormat format) {
   if (!is_resp3_)
     return SendBulkString(str);
@@ -720,6 +963,15 @@ void RedisReplyBuilder::SendStringArr(StrSpan arr, CollectionType type) {
   SendStringArrInternal(arr.Size(), std::move(cb), type);
 }
 
+void RedisReplyBuilder::SendPushFrame(std::string_view frame_tail) {
+  iovec v[] = {IoVec(is_resp3_ ? ">"sv : "*"sv), IoVec(frame_tail)};
+  Send(v, ABSL_ARRAYSIZE(v));
+}
+
+void RedisReplyBuilder::SendRawReply(std::string_view reply) {
+  SendRaw(reply);
+}
+
 void RedisReplyBuilder::StartArray(unsigned len) {
   StartCollection(len, ARRAY);
 }
@@ -860,6 +1112,24 @@ void RedisReplyBuilder2Base::SendSimpleString(std::string_view str) {
   WritePieces(kCRLF);
 }
 
+void RedisReplyBuilder2Base::SendPushFrame(std::string_view frame_tail) {
+  ReplyScope scope(this);
+  string_view type = resp3_ ? ">"sv : "*"sv;
+  if (frame_tail.size() <= kMaxInlineSize)
+    return WritePieces(type, frame_tail);
+
+  WritePieces(type);
+  WriteRef(frame_tail);
+}
+
+void RedisReplyBuilder2Base::SendRawReply(std::string_view reply) {
+  ReplyScope scope(this);
+  has_replied_ = true;
+  if (reply.size() <= kMaxInlineSize)
+    return WritePieces(reply);
+  WriteRef(reply);
+}
+
 void RedisReplyBuilder2Base::SendBulkString(std::string_view str) {
   ReplyScope scope(this);
   has_replied_ = true;
@@ -871,6 +1141,19 @@ void RedisReplyBuilder2Base::SendBulkString(std::string_view str) {
   WritePieces(kCRLF);
 }
 
+void RedisReplyBuilder2Base::SendBulkString(absl::Span<const std::string_view> pieces) {
+  ReplyScope scope(this);
+  has_replied_ = true;
+  size_t size = 0;
+  for (std::string_view piece : pieces)
+    size += piece.size();
+
+  WritePieces(kLengthPrefix, uint32_t(size), kCRLF);
+  for (std::string_view piece : pieces)
+    WriteRef(piece);
+  WritePieces(kCRLF);
+}
+
 void RedisReplyBuilder2Base::SendLong(long val) {
   ReplyScope scope(this);
   has_replied_ = true;
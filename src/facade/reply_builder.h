@@ -9,6 +9,7 @@
 #include <string_view>
 
 #include "facade/facade_types.h"
+#include "facade/memcache_parser.h"
 #include "facade/op_status.h"
 #include "io/io.h"
 
@@ -160,6 +161,16 @@ class SinkReplyBuilder {
     return type_;
   }
 
+  // Totals over the lifetime of the builder. Batched replies are counted when they are appended,
+  // their write time when the batch is flushed.
+  size_t reply_bytes() const {
+    return reply_bytes_;
+  }
+
+  uint64_t send_usec() const {
+    return send_usec_;
+  }
+
  protected:
   void SendRaw(std::string_view str);  // Sends raw without any formatting.
 
@@ -172,6 +183,9 @@ class SinkReplyBuilder {
   // msg and kind/type
   std::string last_error_;
 
+  size_t reply_bytes_ = 0;
+  uint64_t send_usec_ = 0;
+
   bool should_batch_ : 1;
 
   // Similarly to batch mode but is controlled by at operation level.
@@ -236,6 +250,15 @@ class SinkReplyBuilder2 {
     batched_ = b;
   }
 
+  // Sends flushes of at least threshold bytes directly to fd with MSG_ZEROCOPY, so the kernel
+  // does not copy the payload. The socket must be a plain TCP socket with SO_ZEROCOPY enabled.
+  // Referenced data is valid only for the duration of Send(), hence each zero-copy send waits
+  // for its completion notification before returning.
+  void EnableZeroCopy(int fd, size_t threshold) {
+    zc_fd_ = fd;
+    zc_threshold_ = threshold;
+  }
+
   void CloseConnection();
 
   static const ReplyStats& GetThreadLocalStats() {
@@ -268,6 +291,9 @@ class SinkReplyBuilder2 {
   void Send();
 
  private:
+  std::error_code SendZeroCopy();
+  std::error_code WaitZeroCopyCompletions();
+
   io::Sink* sink_;
   std::error_code ec_;
 
@@ -282,6 +308,10 @@ class SinkReplyBuilder2 {
   // lifetime ends or copies refs to the buffer.
   absl::InlinedVector<iovec, 16> vecs_;
   size_t guaranteed_pieces_ = 0;  // length of prefix of vecs_ that are guaranteed to be pieces
+
+  int zc_fd_ = -1;            // socket for MSG_ZEROCOPY sends, -1 if disabled
+  size_t zc_threshold_ = 0;   // minimal flush size for zero-copy sends
+  uint32_t zc_pending_ = 0;   // zero-copy sends without completion notification
 };
 
 class MCReplyBuilder : public SinkReplyBuilder {
@@ -311,6 +341,26 @@ class MCReplyBuilder : public SinkReplyBuilder {
   }
 
   bool NoReply() const;
+
+  // Replies to cmds, which are either a single meta command or a batch of gets served by one
+  // multi key lookup, with one reply per command. Classic replies are used if cmds is empty.
+  void SetCommands(absl::Span<const MemcacheParser::Command* const> cmds);
+
+  void SendDeleted();
+
+ private:
+  const MemcacheParser::Command* MetaCmd() const;
+
+  // Appends to dest the status line of a meta command followed by the flags it asked for.
+  // Returns false if the command is quiet and the code reports success or a miss.
+  static bool AppendMeta(std::string_view code, const MemcacheParser::Command& cmd,
+                         std::string_view flags, std::string* dest);
+
+  void SendMeta(std::string_view code, const MemcacheParser::Command& cmd,
+                std::string_view flags = {});
+
+  absl::Span<const MemcacheParser::Command* const> cmds_;
+  bool meta_quiet_ = false;  // whether any of cmds_ is quiet
 };
 
 class MCReplyBuilder2 : public SinkReplyBuilder2 {
@@ -373,12 +423,22 @@ class RedisReplyBuilder : public SinkReplyBuilder {
   virtual void SendSimpleStrArr(StrSpan arr);
   virtual void SendStringArr(StrSpan arr, CollectionType type = ARRAY);
 
+  // Sends a push message serialized ahead of time, without its leading type character, which
+  // depends on the protocol version.
+  virtual void SendPushFrame(std::string_view frame_tail);
+
+  // Sends a complete reply that was already serialized in the protocol version of this builder,
+  // for example one relayed from another node.
+  virtual void SendRawReply(std::string_view reply);
+
   virtual void SendNull();
   void SendLong(long val) override;
   virtual void SendDouble(double val);
   void SendSimpleString(std::string_view str) override;
 
   virtual void SendBulkString(std::string_view str);
+  // Sends the concatenation of pieces as a single bulk string without joining them.
+  virtual void SendBulkString(absl::Span<const std::string_view> pieces);
   virtual void SendVerbatimString(std::string_view str, VerbatimFormat format = TXT);
   virtual void SendScoredArray(absl::Span<const std::pair<std::string, double>> arr,
                                bool with_scores);
@@ -412,12 +472,15 @@ class RedisReplyBuilder2Base : public SinkReplyBuilder2, public RedisReplyBuilde
 
   void SendSimpleString(std::string_view str) override;
   void SendBulkString(std::string_view str) override;  // RESP: Blob String
+  void SendBulkString(absl::Span<const std::string_view> pieces) override;
 
   void SendLong(long val) override;
   void SendDouble(double val) override;  // RESP: Number
 
   void SendNullArray() override;
   void StartCollection(unsigned len, CollectionType ct) override;
+  void SendPushFrame(std::string_view frame_tail) override;
+  void SendRawReply(std::string_view reply) override;
 
   using SinkReplyBuilder2::SendError;
   void SendError(std::string_view str, std::string_view type = {}) override;
@@ -745,6 +745,22 @@ TEST_F(RedisReplyBuilderTest, SendStringArrayAsSet) {
       << "SendStringArrayAsSet Resp3 Failed.";
 }
 
+TEST_F(RedisReplyBuilderTest, SendPushFrame) {
+  const std::string_view tail = "3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$3\r\nmsg\r\n";
+  const std::vector<std::string> push{"message", "ch", "msg"};
+
+  for (bool resp3 : {false, true}) {
+    builder_->SetResp3(resp3);
+    builder_->SendBulkStrArr(push, builder_->PUSH);
+    ASSERT_TRUE(NoErrors());
+    std::string expected = TakePayload();
+
+    builder_->SendPushFrame(tail);
+    ASSERT_TRUE(NoErrors());
+    ASSERT_EQ(TakePayload(), expected) << "resp3: " << resp3;
+  }
+}
+
 TEST_F(RedisReplyBuilderTest, SendScoredArray) {
   const std::vector<std::pair<std::string, double>> scored_array{
       {"e1", 1.1}, {"e2", 2.2}, {"e3", 3.3}};
@@ -3,6 +3,7 @@
 //
 #include "facade/reply_capture.h"
 
+#include "absl/strings/str_join.h"
 #include "absl/types/span.h"
 #include "base/logging.h"
 #include "reply_capture.h"
@@ -86,6 +87,11 @@ void CapturingReplyBuilder::SendBulkString(std::string_view str) {
   Capture(BulkString{string{str}});
 }
 
+void CapturingReplyBuilder::SendBulkString(absl::Span<const std::string_view> pieces) {
+  SKIP_LESS(ReplyMode::FULL);
+  Capture(BulkString{absl::StrJoin(pieces, "")});
+}
+
 void CapturingReplyBuilder::SendScoredArray(absl::Span<const std::pair<std::string, double>> arr,
                                             bool with_scores) {
   SKIP_LESS(ReplyMode::FULL);
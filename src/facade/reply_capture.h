@@ -42,6 +42,7 @@ class CapturingReplyBuilder : public RedisReplyBuilder {
   void SendSimpleString(std::string_view str) override;
 
   void SendBulkString(std::string_view str) override;
+  void SendBulkString(absl::Span<const std::string_view> pieces) override;
   void SendScoredArray(absl::Span<const std::pair<std::string, double>> arr,
                        bool with_scores) override;
 
@@ -27,13 +27,21 @@ class ServiceInterface {
 
   virtual void DispatchCommand(CmdArgList args, ConnectionContext* cntx) = 0;
 
-  // Returns number of processed commands
+  // Returns number of processed commands.
+  // Respects cntx->squash_info.batch_limit and fills the rest of cntx->squash_info as feedback.
   virtual size_t DispatchManyCommands(absl::Span<CmdArgList> args_list,
                                       ConnectionContext* cntx) = 0;
 
   virtual void DispatchMC(const MemcacheParser::Command& cmd, std::string_view value,
                           ConnectionContext* cntx) = 0;
 
+  // Dispatches a run of pipelined get and meta get commands, which can be served together.
+  virtual void DispatchManyMC(absl::Span<const MemcacheParser::Command* const> cmds,
+                              ConnectionContext* cntx) {
+    for (const auto* cmd : cmds)
+      DispatchMC(*cmd, {}, cntx);
+  }
+
   virtual ConnectionContext* CreateContext(util::FiberSocketBase* peer, Connection* owner) = 0;
 
   virtual void ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privileged) {
@@ -0,0 +1,107 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/squash_controller.h"
+
+#include <algorithm>
+
+namespace facade {
+
+using namespace std;
+
+namespace {
+
+// Below this ratio of squashed commands, squashing mostly falls back to standalone execution
+// and only adds overhead.
+constexpr double kLowSquashRatio = 0.5;
+constexpr double kHighSquashRatio = 0.9;
+
+// How many depth samples without squashes to wait before probing lower thresholds again.
+constexpr uint32_t kReprobeSamples = SquashController::kWindow * 128;
+
+}  // namespace
+
+SquashController::SquashController(uint32_t threshold, uint32_t hop_target_usec)
+    : threshold_{clamp(threshold, kMinThreshold, kMaxThreshold)},
+      hop_target_usec_{hop_target_usec} {
+}
+
+bool SquashController::ObserveDepth(size_t depth) {
+  if (depth < kMinThreshold)
+    return false;
+
+  depth_avg_ = depth_samples_ == 0 ? depth : depth_avg_ * 0.875 + depth * 0.125;
+
+  // The workload might have changed since squashing was found ineffective.
+  if (++idle_samples_ >= kReprobeSamples) {
+    idle_samples_ = 0;
+    squash_effective_ = true;
+  }
+
+  if (++depth_samples_ % kWindow != 0)
+    return false;
+
+  // Pipelines already reach the threshold or squashing does not pay off.
+  if (!squash_effective_ || depth_avg_ > threshold_)
+    return false;
+
+  // Squash is triggered once more than threshold commands are queued, so stay just below the
+  // typical depth and approach it gradually.
+  uint32_t next = max(kMinThreshold, threshold_ / 2);
+  next = max(next, static_cast<uint32_t>(depth_avg_) - 1);
+  if (next >= threshold_)
+    return false;
+
+  threshold_ = next;
+  return true;
+}
+
+SquashController::Update SquashController::Record(uint32_t cmds, const SquashInfo& info,
+                                                  uint64_t usec) {
+  idle_samples_ = 0;
+
+  win_cmds_ += cmds;
+  win_squashed_ += info.squashed;
+  win_hops_ += info.hops;
+  win_full_hops_ += info.full_hops;
+  win_usec_ += usec;
+
+  if (++win_batches_ < kWindow)
+    return {};
+
+  Update res;
+  double ratio = win_cmds_ ? double(win_squashed_) / win_cmds_ : 0;
+  if (ratio < kLowSquashRatio) {
+    squash_effective_ = false;
+    if (threshold_ < kMaxThreshold) {
+      threshold_ = min(threshold_ * 2, kMaxThreshold);
+      res.threshold = true;
+    }
+  } else if (ratio >= kHighSquashRatio) {
+    squash_effective_ = true;
+  }
+
+  // The duration includes commands that were executed standalone, so it overestimates the hop
+  // latency for partially squashed pipelines, which errs on the side of smaller batches.
+  if (win_hops_ > 0) {
+    uint64_t hop_usec = win_usec_ / win_hops_;
+    if (hop_usec > hop_target_usec_) {
+      if (batch_limit_ > kMinBatch) {
+        batch_limit_ = max(batch_limit_ / 2, kMinBatch);
+        res.batch = true;
+      }
+    } else if (win_full_hops_ * 2 >= win_hops_ && hop_usec * 2 <= hop_target_usec_ &&
+               batch_limit_ < kMaxBatch) {
+      batch_limit_ = min(batch_limit_ * 2, kMaxBatch);
+      res.batch = true;
+    }
+  }
+
+  win_batches_ = 0;
+  win_cmds_ = win_squashed_ = win_hops_ = win_full_hops_ = win_usec_ = 0;
+
+  return res;
+}
+
+}  // namespace facade
@@ -0,0 +1,76 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "facade/facade_types.h"
+
+namespace facade {
+
+// Per-connection controller for adaptive pipeline squashing.
+//
+// Tunes two knobs based on the observed behaviour of the connection:
+// 1. threshold - how many pipelined commands must be queued before they are squashed.
+//    Raised when squashing mostly falls back to standalone execution (low squash ratio),
+//    lowered towards the typical queue depth when squashing is effective.
+// 2. batch limit - the maximal number of commands per shard within a single squashed hop.
+//    Reduced when hops exceed the latency target to bound tail latency, grown back when hops
+//    are cut short by the limit and stay well within the target.
+// Decisions are taken once per window of observations to avoid reacting to single outliers.
+class SquashController {
+ public:
+  struct Update {
+    bool threshold = false;
+    bool batch = false;
+  };
+
+  static constexpr uint32_t kMinThreshold = 2;
+  static constexpr uint32_t kMaxThreshold = 256;
+  static constexpr uint32_t kMinBatch = 4;
+  static constexpr uint32_t kMaxBatch = 32;  // Should not exceed MultiCommandSquasher's limit.
+  static constexpr uint32_t kWindow = 8;
+
+  SquashController(uint32_t threshold, uint32_t hop_target_usec);
+
+  uint32_t threshold() const {
+    return threshold_;
+  }
+
+  uint32_t batch_limit() const {
+    return batch_limit_;
+  }
+
+  // Records the pipeline depth at the start of a dispatch burst.
+  // Returns true if the threshold was changed.
+  bool ObserveDepth(size_t depth);
+
+  // Records the result of squashing `cmds` pipelined commands that took `usec` microseconds.
+  Update Record(uint32_t cmds, const SquashInfo& info, uint64_t usec);
+
+ private:
+  uint32_t threshold_;
+  uint32_t batch_limit_ = kMaxBatch;
+  uint32_t hop_target_usec_;
+
+  // Whether the last window showed squashing to be effective. Optimistic by default so that
+  // connections with shallow pipelines get a chance to try it.
+  bool squash_effective_ = true;
+
+  uint32_t depth_samples_ = 0;
+  uint32_t idle_samples_ = 0;  // depth samples since the last recorded squash
+  double depth_avg_ = 0;
+
+  // Accumulated over the current window.
+  uint32_t win_batches_ = 0;
+  uint64_t win_cmds_ = 0;
+  uint64_t win_squashed_ = 0;
+  uint64_t win_hops_ = 0;
+  uint64_t win_full_hops_ = 0;
+  uint64_t win_usec_ = 0;
+};
+
+}  // namespace facade
@@ -0,0 +1,84 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/squash_controller.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace testing;
+using namespace std;
+
+namespace facade {
+
+class SquashControllerTest : public testing::Test {
+ protected:
+  // Records a full window of identical squash results.
+  SquashController::Update RecordWindow(uint32_t cmds, SquashInfo info, uint64_t usec) {
+    SquashController::Update res;
+    for (unsigned i = 0; i < SquashController::kWindow; i++)
+      res = ctrl_.Record(cmds, info, usec);
+    return res;
+  }
+
+  SquashController ctrl_{10, 1000};
+};
+
+TEST_F(SquashControllerTest, RaiseThresholdOnLowRatio) {
+  // Only 2 out of 20 commands were squashed.
+  auto update = RecordWindow(20, SquashInfo{0, 2, 1, 0}, 50);
+  EXPECT_TRUE(update.threshold);
+  EXPECT_FALSE(update.batch);
+  EXPECT_EQ(20u, ctrl_.threshold());
+
+  for (unsigned i = 0; i < 10; i++)
+    RecordWindow(20, SquashInfo{0, 2, 1, 0}, 50);
+  EXPECT_EQ(SquashController::kMaxThreshold, ctrl_.threshold());
+
+  // Squashing was found ineffective, so shallow pipelines do not lower the threshold.
+  for (unsigned i = 0; i < SquashController::kWindow * 4; i++)
+    EXPECT_FALSE(ctrl_.ObserveDepth(4));
+  EXPECT_EQ(SquashController::kMaxThreshold, ctrl_.threshold());
+}
+
+TEST_F(SquashControllerTest, LowerThresholdToDepth) {
+  for (unsigned i = 0; i < SquashController::kWindow; i++)
+    ctrl_.ObserveDepth(5);
+  EXPECT_EQ(5u, ctrl_.threshold());
+
+  for (unsigned i = 0; i < SquashController::kWindow * 4; i++)
+    ctrl_.ObserveDepth(5);
+  EXPECT_EQ(4u, ctrl_.threshold());
+
+  // Single commands are not pipelines and are ignored.
+  for (unsigned i = 0; i < SquashController::kWindow * 4; i++)
+    EXPECT_FALSE(ctrl_.ObserveDepth(1));
+  EXPECT_EQ(4u, ctrl_.threshold());
+}
+
+TEST_F(SquashControllerTest, BatchLimit) {
+  EXPECT_EQ(SquashController::kMaxBatch, ctrl_.batch_limit());
+
+  // Slow hops shrink the batch.
+  auto update = RecordWindow(64, SquashInfo{0, 64, 2, 2}, 5000);
+  EXPECT_TRUE(update.batch);
+  EXPECT_FALSE(update.threshold);
+  EXPECT_EQ(SquashController::kMaxBatch / 2, ctrl_.batch_limit());
+
+  for (unsigned i = 0; i < 10; i++)
+    RecordWindow(64, SquashInfo{0, 64, 2, 2}, 5000);
+  EXPECT_EQ(SquashController::kMinBatch, ctrl_.batch_limit());
+
+  // Fast hops that are cut short by the limit grow it back.
+  update = RecordWindow(64, SquashInfo{0, 64, 4, 4}, 400);
+  EXPECT_TRUE(update.batch);
+  EXPECT_EQ(SquashController::kMinBatch * 2, ctrl_.batch_limit());
+
+  // Fast hops that do not reach the limit leave it as is.
+  update = RecordWindow(64, SquashInfo{0, 64, 4, 0}, 400);
+  EXPECT_FALSE(update.batch);
+  EXPECT_EQ(SquashController::kMinBatch * 2, ctrl_.batch_limit());
+}
+
+}  // namespace facade
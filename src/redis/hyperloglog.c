@@ -34,6 +34,15 @@
 #include <math.h>
 #include <string.h>
 
+/* Vectorized register merging uses SSSE3, or NEON through sse2neon on arm. */
+#if defined(__aarch64__)
+#include "base/sse2neon.h"
+#define HLL_SIMD 1
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define HLL_SIMD 1
+#endif
+
 #include "redis/redis_aux.h"
 #include "redis/util.h"
 
@@ -979,22 +988,31 @@ void hllRawRegHisto(uint8_t* registers, int* reghisto) {
   uint8_t* bytes;
   int j;
 
+  /* Neighbouring registers tend to have the same value, so their increments
+   * are spread over separate histograms to avoid serializing on the same
+   * counter. */
+  int histo[4][HLL_REGISTER_MAX + 1];
+  memset(histo, 0, sizeof(histo));
+
   for (j = 0; j < HLL_REGISTERS / 8; j++) {
     if (*word == 0) {
-      reghisto[0] += 8;
+      histo[0][0] += 8;
     } else {
       bytes = (uint8_t*)word;
-      reghisto[bytes[0]]++;
-      reghisto[bytes[1]]++;
-      reghisto[bytes[2]]++;
-      reghisto[bytes[3]]++;
-      reghisto[bytes[4]]++;
-      reghisto[bytes[5]]++;
-      reghisto[bytes[6]]++;
-      reghisto[bytes[7]]++;
+      histo[0][bytes[0]]++;
+      histo[1][bytes[1]]++;
+      histo[2][bytes[2]]++;
+      histo[3][bytes[3]]++;
+      histo[0][bytes[4]]++;
+      histo[1][bytes[5]]++;
+      histo[2][bytes[6]]++;
+      histo[3][bytes[7]]++;
     }
     word++;
   }
+
+  for (j = 0; j <= HLL_REGISTER_MAX; j++)
+    reghisto[j] += histo[0][j] + histo[1][j] + histo[2][j] + histo[3][j];
 }
 
 /* Helper function sigma as defined in
@@ -1367,20 +1385,81 @@ int64_t pfcountSingle(struct HllBufferPtr hll_ptr) {
   return card;
 }
 
-/* Merge dense-encoded HLL */
-static void hllMergeDense(uint8_t* max, struct HllBufferPtr to) {
-  uint8_t* registers = max + HLL_HDR_SIZE;
-  uint8_t val;
-  struct hllhdr* hll_hdr = (struct hllhdr*)to.hll;
+/* Merges the 16 dense registers packed into the 12 bytes at 'r' into the
+ * raw 8 bit registers at 'max'. */
+static inline void hllMergeDense16(uint8_t* max, const uint8_t* r) {
+  for (int k = 0; k < 4; k++, r += 3, max += 4) {
+    uint32_t v = r[0] | (uint32_t)r[1] << 8 | (uint32_t)r[2] << 16;
+    for (int i = 0; i < 4; i++) {
+      uint8_t val = (v >> (i * HLL_BITS)) & HLL_REGISTER_MAX;
+      if (val > max[i])
+        max[i] = val;
+    }
+  }
+}
 
-  for (int i = 0; i < HLL_REGISTERS; i++) {
-    HLL_DENSE_GET_REGISTER(val, hll_hdr->registers, i);
-    if (val > registers[i]) {
-      registers[i] = val;
+/* Merges the dense registers of an HLL into the raw 8 bit registers 'max',
+ * 16 registers at a time. */
+static void hllMergeDenseRegisters(uint8_t* max, const uint8_t* registers) {
+  if (HLL_REGISTERS != 16384 || HLL_BITS != 6) {
+    uint8_t val;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+      HLL_DENSE_GET_REGISTER(val, registers, i);
+      if (val > max[i])
+        max[i] = val;
     }
+    return;
+  }
+
+  int j = 0;
+#ifdef HLL_SIMD
+  /* Every 32 bit lane gets 3 bytes, i.e. 4 registers, which are then moved
+   * into separate bytes. The last group is merged by the scalar code because
+   * the 16 bytes load would read past the end of the registers. */
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i mask0 = _mm_set1_epi32(0x3f);
+  const __m128i mask1 = _mm_set1_epi32(0x3f00);
+  const __m128i mask2 = _mm_set1_epi32(0x3f0000);
+  const __m128i mask3 = _mm_set1_epi32(0x3f000000);
+
+  for (; j < HLL_REGISTERS / 16 - 1; j++) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(registers + j * 12));
+    v = _mm_shuffle_epi8(v, shuffle);
+    __m128i lo = _mm_or_si128(_mm_and_si128(v, mask0), _mm_and_si128(_mm_slli_epi32(v, 2), mask1));
+    __m128i hi = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 4), mask2),
+                              _mm_and_si128(_mm_slli_epi32(v, 6), mask3));
+    __m128i* dst = (__m128i*)(max + j * 16);
+    _mm_storeu_si128(dst, _mm_max_epu8(_mm_loadu_si128(dst), _mm_or_si128(lo, hi)));
+  }
+#endif
+  for (; j < HLL_REGISTERS / 16; j++) {
+    hllMergeDense16(max + j * 16, registers + j * 12);
+  }
+}
+
+/* Writes the raw 8 bit registers 'max' into the dense registers of an HLL. */
+static void hllDensePackRegisters(uint8_t* registers, const uint8_t* max) {
+  if (HLL_REGISTERS != 16384 || HLL_BITS != 6) {
+    for (int i = 0; i < HLL_REGISTERS; i++)
+      HLL_DENSE_SET_REGISTER(registers, i, max[i]);
+    return;
+  }
+
+  for (int i = 0; i < HLL_REGISTERS; i += 4, registers += 3) {
+    uint32_t v = max[i] | (uint32_t)max[i + 1] << 6 | (uint32_t)max[i + 2] << 12 |
+                 (uint32_t)max[i + 3] << 18;
+    registers[0] = v;
+    registers[1] = v >> 8;
+    registers[2] = v >> 16;
   }
 }
 
+/* Merge dense-encoded HLL */
+static void hllMergeDense(uint8_t* max, struct HllBufferPtr to) {
+  struct hllhdr* hll_hdr = (struct hllhdr*)to.hll;
+  hllMergeDenseRegisters(max + HLL_HDR_SIZE, hll_hdr->registers);
+}
+
 int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count) {
   struct hllhdr* hdr;
   uint8_t max[HLL_HDR_SIZE + HLL_REGISTERS];
@@ -1421,13 +1500,13 @@ int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBuffer
       return C_ERR;
     }
 
-    hllMergeDense(max, hll);
+    hllMergeDenseRegisters(max, ((struct hllhdr*)hll.hll)->registers);
   }
 
+  /* Registers of 'out_hll' are never decreased, like in hllDenseSet(). */
   struct hllhdr* hdr = (struct hllhdr*)out_hll.hll;
-  for (size_t j = 0; j < HLL_REGISTERS; j++) {
-    hllDenseSet(hdr->registers, j, max[j]);
-  }
+  hllMergeDenseRegisters(max, hdr->registers);
+  hllDensePackRegisters(hdr->registers, max);
   HLL_INVALIDATE_CACHE(hdr);
 
   return C_OK;
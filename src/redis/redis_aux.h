@@ -8,9 +8,12 @@
  * this will add enough place for Redis types to grow */
 #define OBJ_JSON 15U
 #define OBJ_SBF  16U
+#define OBJ_TS   17U
+#define OBJ_CMS  18U
+#define OBJ_TOPK 19U
 
 /* How many types of objects exist */
-#define OBJ_TYPE_MAX 17U
+#define OBJ_TYPE_MAX 20U
 
 #define CONFIG_RUN_ID_SIZE 40U
 
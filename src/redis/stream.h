@@ -18,8 +18,26 @@ typedef struct streamID {
     uint64_t seq;       /* Sequence number. */
 } streamID;
 
+/* Index of the listpack nodes of a stream, ordered by the master entry ID of
+ * every node. It is a B+ tree (see core/bptree_set.h) holding the ID and the
+ * listpack pointer of a node in a single 24 bytes slot, so seeking a node
+ * scans a few contiguous 256 bytes tree nodes instead of chasing the pointers
+ * of the radix tree nodes. Implemented in stream_nodes.cc. */
+typedef struct streamNodes streamNodes;
+
+/* Opaque storage for the position of an iterator inside the tree. */
+#define STREAM_NODES_PATH_WORDS 34
+
+typedef struct streamNodesIterator {
+    streamNodes *nodes;     /* The index we are iterating. */
+    streamID id;            /* Master ID of the current node. */
+    unsigned char *lp;      /* Listpack of the current node. */
+    int state;              /* Seeked, positioned or EOF. */
+    uint64_t path[STREAM_NODES_PATH_WORDS];
+} streamNodesIterator;
+
 typedef struct stream {
-    rax *rax_tree;               /* The radix tree holding the stream. */
+    streamNodes *nodes;     /* The listpacks holding the stream entries. */
     uint64_t length;        /* Current number of elements inside this stream. */
     streamID last_id;       /* Zero if there are yet no items. */
     streamID first_id;      /* The first non-tombstone entry, zero if empty. */
@@ -45,7 +63,7 @@ typedef struct streamIterator {
     int skip_tombstones;    /* True if not emitting tombstone entries. */
     uint64_t start_key[2];  /* Start key as 128 bit big endian. */
     uint64_t end_key[2];    /* End key as 128 bit big endian. */
-    raxIterator ri;         /* Rax iterator. */
+    streamNodesIterator ri; /* Nodes iterator. */
     unsigned char *lp;      /* Current listpack. */
     unsigned char *lp_ele;  /* Current listpack cursor. */
     unsigned char *lp_flags; /* Current entry flags pointer. */
@@ -115,12 +133,32 @@ typedef struct {
                               * the trim argument is not applied verbatim. */
   long long limit;           /* Maximum amount of entries to trim. If 0, no limitation
                               * on the amount of trimming work is enforced. */
+  long long limit_nodes;     /* Maximum amount of whole nodes to remove, approx_trim
+                              * only. If 0, no limitation is enforced. */
   /* TRIM_STRATEGY_MAXLEN options */
   long long maxlen; /* After trimming, leave stream at this length . */
   /* TRIM_STRATEGY_MINID options */
   streamID minid; /* Trim by ID (No stream entries with ID < 'minid' will remain) */
 } streamAddTrimArgs;
 
+/* Listpack nodes index API, the seek operators are "^", "$", "<=" and ">=".
+ * Just like with a rax iterator, the first streamNodesNext() or
+ * streamNodesPrev() call after a seek returns the sought node. The iterator
+ * must be seeked again after a node is removed from the index. */
+streamNodes *streamNodesNew(void);
+void streamNodesFree(streamNodes *nodes, void (*free_lp)(unsigned char *lp));
+uint64_t streamNodesSize(const streamNodes *nodes);
+uint64_t streamNodesTreeNodes(const streamNodes *nodes);
+int streamNodesInsert(streamNodes *nodes, const streamID *id, unsigned char *lp);
+int streamNodesTryInsert(streamNodes *nodes, const streamID *id, unsigned char *lp);
+int streamNodesRemove(streamNodes *nodes, const streamID *id);
+unsigned char *streamNodesLast(const streamNodes *nodes, streamID *id);
+void streamNodesIterStart(streamNodesIterator *it, streamNodes *nodes);
+void streamNodesSeek(streamNodesIterator *it, const char *op, const streamID *id);
+int streamNodesNext(streamNodesIterator *it);
+int streamNodesPrev(streamNodesIterator *it);
+int streamNodesEOF(const streamNodesIterator *it);
+
 /* Prototypes of exported APIs. */
 // struct client;
 
@@ -0,0 +1,227 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// B+ tree index of the listpack nodes of a stream, exposed to t_stream.c through the C API
+// declared in stream.h.
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "core/bptree_set.h"
+
+extern "C" {
+#include "redis/stream.h"
+#include "redis/zmalloc.h"
+}
+
+namespace {
+
+struct StreamNode {
+  streamID id;
+  unsigned char* lp;
+};
+
+struct StreamNodePolicy {
+  using KeyT = StreamNode;
+
+  struct KeyCompareTo {
+    int operator()(const StreamNode& a, const StreamNode& b) const {
+      if (a.id.ms != b.id.ms)
+        return a.id.ms < b.id.ms ? -1 : 1;
+      if (a.id.seq != b.id.seq)
+        return a.id.seq < b.id.seq ? -1 : 1;
+      return 0;
+    }
+  };
+};
+
+using NodeTree = dfly::BPTree<StreamNode, StreamNodePolicy>;
+using NodePath = dfly::detail::BPTreePath<StreamNode>;
+
+static_assert(sizeof(NodePath) <= sizeof(streamNodesIterator::path));
+static_assert(std::is_trivially_copyable_v<NodePath>);
+
+// Tree nodes are allocated with zmalloc like the listpacks they point to, so they are
+// accounted in the memory usage of the stream.
+class ZmallocResource : public PMR_NS::memory_resource {
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) final {
+    return zmalloc(bytes);
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) final {
+    zfree(p);
+  }
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+};
+
+ZmallocResource zmalloc_resource;
+
+enum IterState { kIterEOF = 0, kIterSeeked = 1, kIterPositioned = 2 };
+
+NodeTree* AsTree(streamNodes* nodes) {
+  return reinterpret_cast<NodeTree*>(nodes);
+}
+
+const NodeTree* AsTree(const streamNodes* nodes) {
+  return reinterpret_cast<const NodeTree*>(nodes);
+}
+
+NodePath LoadPath(const streamNodesIterator* it) {
+  NodePath path;
+  memcpy(&path, it->path, sizeof(path));
+  return path;
+}
+
+void StorePath(const NodePath& path, streamNodesIterator* it) {
+  memcpy(it->path, &path, sizeof(path));
+}
+
+// Returns the path to the node with the given id or an empty path if there is none.
+NodePath FindExact(const NodeTree* tree, const streamID* id) {
+  if (tree->Size() == 0)
+    return NodePath{};
+
+  NodePath path = tree->GEQ(StreamNode{*id, nullptr});
+  if (path.Empty())
+    return path;
+  streamID found = path.Terminal().id;
+  if (found.ms != id->ms || found.seq != id->seq)
+    path.Clear();
+  return path;
+}
+
+// Loads the current node of the iterator path or marks the iterator as exhausted.
+int SetCurrent(streamNodesIterator* it, const NodePath& path, bool valid) {
+  if (!valid || !path.HasValidTerminal()) {
+    it->state = kIterEOF;
+    it->lp = nullptr;
+    return 0;
+  }
+
+  StreamNode node = path.Terminal();
+  it->id = node.id;
+  it->lp = node.lp;
+  it->state = kIterPositioned;
+  StorePath(path, it);
+  return 1;
+}
+
+}  // namespace
+
+extern "C" {
+
+streamNodes* streamNodesNew(void) {
+  void* ptr = zmalloc(sizeof(NodeTree));
+  return reinterpret_cast<streamNodes*>(new (ptr) NodeTree(&zmalloc_resource));
+}
+
+void streamNodesFree(streamNodes* nodes, void (*free_lp)(unsigned char* lp)) {
+  NodeTree* tree = AsTree(nodes);
+  if (free_lp && tree->Size() > 0) {
+    tree->Iterate(0, tree->Size() - 1, [free_lp](StreamNode node) {
+      free_lp(node.lp);
+      return true;
+    });
+  }
+  tree->~NodeTree();
+  zfree(tree);
+}
+
+uint64_t streamNodesSize(const streamNodes* nodes) {
+  return AsTree(nodes)->Size();
+}
+
+uint64_t streamNodesTreeNodes(const streamNodes* nodes) {
+  return AsTree(nodes)->NodeCount();
+}
+
+int streamNodesInsert(streamNodes* nodes, const streamID* id, unsigned char* lp) {
+  NodeTree* tree = AsTree(nodes);
+  NodePath path = FindExact(tree, id);
+  if (path.Empty()) {
+    tree->Insert(StreamNode{*id, lp});
+    return 1;
+  }
+
+  // Replacing the listpack pointer does not change the order, update the slot in place.
+  auto [node, pos] = path.Last();
+  node->SetKey(pos, StreamNode{*id, lp});
+  return 0;
+}
+
+int streamNodesTryInsert(streamNodes* nodes, const streamID* id, unsigned char* lp) {
+  return AsTree(nodes)->Insert(StreamNode{*id, lp});
+}
+
+int streamNodesRemove(streamNodes* nodes, const streamID* id) {
+  return AsTree(nodes)->Delete(StreamNode{*id, nullptr});
+}
+
+unsigned char* streamNodesLast(const streamNodes* nodes, streamID* id) {
+  const NodeTree* tree = AsTree(nodes);
+  if (tree->Size() == 0)
+    return nullptr;
+
+  StreamNode node = tree->FromRank(tree->Size() - 1).Terminal();
+  if (id)
+    *id = node.id;
+  return node.lp;
+}
+
+void streamNodesIterStart(streamNodesIterator* it, streamNodes* nodes) {
+  it->nodes = nodes;
+  it->lp = nullptr;
+  it->state = kIterEOF;
+}
+
+void streamNodesSeek(streamNodesIterator* it, const char* op, const streamID* id) {
+  const NodeTree* tree = AsTree(it->nodes);
+  NodePath path;
+
+  if (tree->Size() > 0) {
+    if (op[0] == '^') {
+      path = tree->FromRank(0);
+    } else if (op[0] == '$') {
+      path = tree->FromRank(tree->Size() - 1);
+    } else if (op[0] == '<') {
+      path = tree->LEQ(StreamNode{*id, nullptr});
+    } else {
+      path = tree->GEQ(StreamNode{*id, nullptr});
+    }
+  }
+
+  if (SetCurrent(it, path, true))
+    it->state = kIterSeeked;
+}
+
+int streamNodesNext(streamNodesIterator* it) {
+  if (it->state == kIterEOF)
+    return 0;
+  NodePath path = LoadPath(it);
+  if (it->state == kIterSeeked)
+    return SetCurrent(it, path, true);
+  bool valid = path.Next();
+  return SetCurrent(it, path, valid);
+}
+
+int streamNodesPrev(streamNodesIterator* it) {
+  if (it->state == kIterEOF)
+    return 0;
+  NodePath path = LoadPath(it);
+  if (it->state == kIterSeeked)
+    return SetCurrent(it, path, true);
+  bool valid = path.Prev();
+  return SetCurrent(it, path, valid);
+}
+
+int streamNodesEOF(const streamNodesIterator* it) {
+  return it->state == kIterEOF;
+}
+
+}  // extern "C"
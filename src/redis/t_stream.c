@@ -68,7 +68,7 @@ void streamFreeNACK(streamNACK *na);
 /* Create a new stream data structure. */
 stream *streamNew(void) {
     stream *s = zmalloc(sizeof(*s));
-    s->rax_tree = raxNew();
+    s->nodes = streamNodesNew();
     s->length = 0;
     s->first_id.ms = 0;
     s->first_id.seq = 0;
@@ -83,7 +83,7 @@ stream *streamNew(void) {
 
 /* Free a stream, including the listpacks stored inside the radix tree. */
 void freeStream(stream *s) {
-    raxFreeWithCallback(s->rax_tree,(void(*)(void*))lpFree);
+    streamNodesFree(s->nodes,lpFree);
     if (s->cgroups)
         raxFreeWithCallback(s->cgroups,(void(*)(void*))streamFreeCG);
     zfree(s);
@@ -314,6 +314,7 @@ void streamGetEdgeID(stream *s, int first, int skip_tombstones, streamID *edge_i
  * Much like the 'approx', if 'limit' is smaller than the number of entries
  * that should be trimmed, there is a chance we will still have entries with
  * IDs < 'id' (or number of elements >= maxlen in case of MAXLEN).
+ * args->limit_nodes similarly bounds the number of whole nodes removed.
  */
 int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
     size_t maxlen = args->maxlen;
@@ -325,21 +326,31 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
     if (trim_strategy == TRIM_STRATEGY_NONE)
         return 0;
 
-    raxIterator ri;
-    raxStart(&ri,s->rax_tree);
-    raxSeek(&ri,"^",NULL,0);
+    /* Nothing to trim, skip seeking the head node. The first ID skips the
+     * tombstones, so no entry before it can be deleted. */
+    if (trim_strategy == TRIM_STRATEGY_MAXLEN && s->length <= maxlen)
+        return 0;
+    if (trim_strategy == TRIM_STRATEGY_MINID && s->length &&
+        streamCompareID(&s->first_id, id) >= 0)
+        return 0;
 
-    int64_t deleted = 0;
-    while (raxNext(&ri)) {
+    streamNodesIterator ri;
+    streamNodesIterStart(&ri,s->nodes);
+    streamNodesSeek(&ri,"^",NULL);
+
+    int64_t deleted = 0, removed_nodes = 0;
+    while (streamNodesNext(&ri)) {
         if (trim_strategy == TRIM_STRATEGY_MAXLEN && s->length <= maxlen)
             break;
 
-        unsigned char *lp = ri.data, *p = lpFirst(lp);
+        unsigned char *lp = ri.lp, *p = lpFirst(lp);
         int64_t entries = lpGetInteger(p);
 
         /* Check if we exceeded the amount of work we could do */
         if (limit && (deleted + entries) > limit)
             break;
+        if (args->limit_nodes && removed_nodes == args->limit_nodes)
+            break;
 
         /* Check if we can remove the whole node. */
         int remove_node;
@@ -347,8 +358,8 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
         if (trim_strategy == TRIM_STRATEGY_MAXLEN) {
             remove_node = s->length - entries >= maxlen;
         } else {
-            /* Read the master ID from the radix tree key. */
-            streamDecodeID(ri.key, &master_id);
+            /* Read the master ID of the node. */
+            master_id = ri.id;
 
             /* Read last ID. */
             streamID last_id;
@@ -359,11 +370,13 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
         }
 
         if (remove_node) {
+            streamID node_id = ri.id;
             lpFree(lp);
-            raxRemove(s->rax_tree,ri.key,ri.key_len,NULL);
-            raxSeek(&ri,">=",ri.key,ri.key_len);
+            streamNodesRemove(s->nodes,&node_id);
+            streamNodesSeek(&ri,">=",&node_id);
             s->length -= entries;
             deleted += entries;
+            removed_nodes++;
             continue;
         }
 
@@ -458,12 +471,11 @@ int64_t streamTrim(stream *s, streamAddTrimArgs *args) {
         }
 
         /* Update the listpack with the new pointer. */
-        raxInsert(s->rax_tree,ri.key,ri.key_len,lp,NULL);
+        streamNodesInsert(s->nodes,&ri.id,lp);
 
         break; /* If we are here, there was enough to delete in the current
                   node, so no need to go to the next node. */
     }
-    raxStop(&ri);
 
     /* Update the stream's first ID after the trimming. */
     if (s->length == 0) {
@@ -536,23 +548,21 @@ void streamIteratorStart(streamIterator *si, stream *s, streamID *start, streamI
         si->end_key[1] = UINT64_MAX;
     }
 
-    /* Seek the correct node in the radix tree. */
-    raxStart(&si->ri,s->rax_tree);
+    /* Seek the correct node in the nodes index. */
+    streamNodesIterStart(&si->ri,s->nodes);
     if (!rev) {
         if (start && (start->ms || start->seq)) {
-            raxSeek(&si->ri,"<=",(unsigned char*)si->start_key,
-                    sizeof(si->start_key));
-            if (raxEOF(&si->ri)) raxSeek(&si->ri,"^",NULL,0);
+            streamNodesSeek(&si->ri,"<=",start);
+            if (streamNodesEOF(&si->ri)) streamNodesSeek(&si->ri,"^",NULL);
         } else {
-            raxSeek(&si->ri,"^",NULL,0);
+            streamNodesSeek(&si->ri,"^",NULL);
         }
     } else {
         if (end && (end->ms || end->seq)) {
-            raxSeek(&si->ri,"<=",(unsigned char*)si->end_key,
-                    sizeof(si->end_key));
-            if (raxEOF(&si->ri)) raxSeek(&si->ri,"$",NULL,0);
+            streamNodesSeek(&si->ri,"<=",end);
+            if (streamNodesEOF(&si->ri)) streamNodesSeek(&si->ri,"$",NULL);
         } else {
-            raxSeek(&si->ri,"$",NULL,0);
+            streamNodesSeek(&si->ri,"$",NULL);
         }
     }
     si->stream = s;
@@ -571,13 +581,12 @@ int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields) {
          * iteration or the previous listpack was completely iterated.
          * Go to the next node. */
         if (si->lp == NULL || si->lp_ele == NULL) {
-            if (!si->rev && !raxNext(&si->ri)) return 0;
-            else if (si->rev && !raxPrev(&si->ri)) return 0;
-            serverAssert(si->ri.key_len == sizeof(streamID));
+            if (!si->rev && !streamNodesNext(&si->ri)) return 0;
+            else if (si->rev && !streamNodesPrev(&si->ri)) return 0;
             /* Get the master ID. */
-            streamDecodeID(si->ri.key,&si->master_id);
+            si->master_id = si->ri.id;
             /* Get the master fields count. */
-            si->lp = si->ri.data;
+            si->lp = si->ri.lp;
             si->lp_ele = lpFirst(si->lp);           /* Seek items count */
             si->lp_ele = lpNext(si->lp,si->lp_ele); /* Seek deleted count. */
             si->lp_ele = lpNext(si->lp,si->lp_ele); /* Seek num fields. */
@@ -754,7 +763,7 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
         /* If this is the last element in the listpack, we can remove the whole
          * node. */
         lpFree(lp);
-        raxRemove(si->stream->rax_tree,si->ri.key,si->ri.key_len,NULL);
+        streamNodesRemove(si->stream->nodes,&si->ri.id);
     } else {
         /* In the base case we alter the counters of valid/deleted entries. */
         lp = lpReplaceInteger(lp,&p,aux-1);
@@ -764,7 +773,7 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
 
         /* Update the listpack with the new pointer. */
         if (si->lp != lp)
-            raxInsert(si->stream->rax_tree,si->ri.key,si->ri.key_len,lp,NULL);
+            streamNodesInsert(si->stream->nodes,&si->ri.id,lp);
     }
 
     /* Update the number of entries counter. */
@@ -786,11 +795,11 @@ void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
      * deleted and valid goes over a certain limit. */
 }
 
-/* Stop the stream iterator. The only cleanup we need is to free the rax
- * iterator, since the stream iterator itself is supposed to be stack
- * allocated. */
+/* Stop the stream iterator. The nodes iterator does not own any memory and
+ * the stream iterator itself is supposed to be stack allocated, so there is
+ * nothing to clean up. */
 void streamIteratorStop(streamIterator *si) {
-    raxStop(&si->ri);
+    (void)si;
 }
 
 /* Return 1 if `id` exists in `s` (and not marked as deleted) */
@@ -41,6 +41,9 @@ enum AclCat {
   SCRIPTING = 1ULL << 20,
 
   // Extensions
+  TOPK = 1ULL << 25,
+  CMS = 1ULL << 26,
+  TIMESERIES = 1ULL << 27,
   BLOOM = 1ULL << 28,
   FT_SEARCH = 1ULL << 29,
   THROTTLE = 1ULL << 30,
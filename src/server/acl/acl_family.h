@@ -120,6 +120,9 @@ class AclFamily final {
                                       {"CONNECTION", CONNECTION},
                                       {"TRANSACTION", TRANSACTION},
                                       {"SCRIPTING", SCRIPTING},
+                                      {"TOPK", TOPK},
+                                      {"CMS", CMS},
+                                      {"TIMESERIES", TIMESERIES},
                                       {"BLOOM", BLOOM},
                                       {"FT_SEARCH", FT_SEARCH},
                                       {"THROTTLE", THROTTLE},
@@ -133,7 +136,7 @@ class AclFamily final {
       "KEYSPACE",  "READ",      "WRITE",     "SET",       "SORTEDSET",  "LIST",        "HASH",
       "STRING",    "BITMAP",    "HYPERLOG",  "GEO",       "STREAM",     "PUBSUB",      "ADMIN",
       "FAST",      "SLOW",      "BLOCKING",  "DANGEROUS", "CONNECTION", "TRANSACTION", "SCRIPTING",
-      "_RESERVED", "_RESERVED", "_RESERVED", "_RESERVED", "_RESERVED",  "_RESERVED",   "_RESERVED",
+      "_RESERVED", "_RESERVED", "_RESERVED", "_RESERVED", "TOPK",       "CMS",         "TIMESERIES",
       "BLOOM",     "FT_SEARCH", "THROTTLE",  "JSON"};
 
   // We need this to act as a const member, since the initialization of const data members
@@ -209,6 +209,36 @@ TEST_F(AclFamilyTest, AclAuth) {
   EXPECT_THAT(resp, "OK");
 }
 
+TEST_F(AclFamilyTest, AclKeyPrefixes) {
+  TestInitAclFam();
+  auto resp = Run({"ACL", "SETUSER", "kostas", "ON", ">pass", "+@string", "resetkeys", "~a*",
+                   "~abc*", "%R~abd*", "~x?z", "~user:*"});
+  EXPECT_THAT(resp, "OK");
+
+  resp = Run({"AUTH", "kostas", "pass"});
+  EXPECT_THAT(resp, "OK");
+
+  EXPECT_EQ(Run({"SET", "a", "1"}), "OK");
+  EXPECT_EQ(Run({"SET", "abcd", "1"}), "OK");
+  EXPECT_EQ(Run({"SET", "abd", "1"}), "OK");
+  EXPECT_EQ(Run({"SET", "user:1", "1"}), "OK");
+  EXPECT_EQ(Run({"SET", "xyz", "1"}), "OK");
+  EXPECT_THAT(Run({"SET", "b", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "user", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "xyzz", "1"}), ErrArg("NOPERM"));
+
+  resp = Run({"AUTH", "default", R"("")"});
+  EXPECT_THAT(resp, "OK");
+  resp = Run({"ACL", "SETUSER", "kostas", "resetkeys", "~abc*", "%R~abd*"});
+  EXPECT_THAT(resp, "OK");
+  resp = Run({"AUTH", "kostas", "pass"});
+  EXPECT_THAT(resp, "OK");
+  EXPECT_EQ(Run({"GET", "abd"}), "1");
+  EXPECT_THAT(Run({"SET", "abd", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "ab", "1"}), ErrArg("NOPERM"));
+  EXPECT_EQ(Run({"SET", "abc", "1"}), "OK");
+}
+
 TEST_F(AclFamilyTest, AclWhoAmI) {
   TestInitAclFam();
   auto resp = Run({"ACL", "WHOAMI", "WHO"});
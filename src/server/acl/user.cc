@@ -11,6 +11,7 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/escaping.h"
 #include "core/overloaded.h"
+#include "server/acl/validator.h"
 
 namespace dfly::acl {
 
@@ -242,6 +243,7 @@ void User::SetKeyGlobs(std::vector<UpdateKey> keys) {
       keys_.key_globs.push_back({std::move(key.key), key.op});
     }
   }
+  CompileKeyGlobs(&keys_);
 }
 
 void User::SetPubSub(std::vector<UpdatePubSub> pub_sub) {
@@ -4,6 +4,8 @@
 
 #include "server/acl/validator.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
 #include "server/acl/acl_commands_def.h"
@@ -17,6 +19,57 @@ extern "C" {
 
 namespace dfly::acl {
 
+namespace {
+
+// Returns true if the glob is a literal followed by a single trailing '*'.
+bool IsPrefixGlob(std::string_view glob) {
+  return !glob.empty() && glob.back() == '*' &&
+         glob.find_first_of("*?[\\") == glob.size() - 1;
+}
+
+bool AllowsAccess(KeyOp op, bool is_read, bool is_write) {
+  return (is_read && op != KeyOp::WRITE) || (is_write && op != KeyOp::READ);
+}
+
+// Looks for a prefix of key in the sorted prefix globs that allows the access. Every prefix of
+// key sorts before key, so the candidate is the last glob not greater than it. On a mismatch,
+// only globs that are also prefixes of the common part can still match, so the search continues
+// below the candidate with the key truncated to that common part.
+bool MatchPrefixGlobs(const std::vector<GlobType>& prefix_globs, std::string_view key,
+                      bool is_read, bool is_write) {
+  auto end = prefix_globs.end();
+  while (true) {
+    auto it = std::upper_bound(prefix_globs.begin(), end, key,
+                               [](std::string_view k, const GlobType& g) { return k < g.first; });
+    if (it == prefix_globs.begin())
+      return false;
+    --it;
+
+    std::string_view prefix = it->first;
+    auto diff = std::mismatch(prefix.begin(), prefix.end(), key.begin(), key.end());
+    size_t common = diff.first - prefix.begin();
+    if (common == prefix.size() && AllowsAccess(it->second, is_read, is_write))
+      return true;
+    key = key.substr(0, common);
+    end = it;
+  }
+}
+
+}  // namespace
+
+void CompileKeyGlobs(AclKeys* keys) {
+  keys->prefix_globs.clear();
+  keys->other_globs.clear();
+  for (size_t i = 0; i < keys->key_globs.size(); ++i) {
+    const auto& [glob, op] = keys->key_globs[i];
+    if (IsPrefixGlob(glob))
+      keys->prefix_globs.emplace_back(glob.substr(0, glob.size() - 1), op);
+    else
+      keys->other_globs.push_back(i);
+  }
+  std::sort(keys->prefix_globs.begin(), keys->prefix_globs.end());
+}
+
 [[nodiscard]] bool IsUserAllowedToInvokeCommand(const ConnectionContext& cntx, const CommandId& id,
                                                 CmdArgList tail_args) {
   if (cntx.skip_acl_validation) {
@@ -71,16 +124,13 @@ static bool ValidateCommand(const std::vector<uint64_t>& acl_commands, const Com
   const bool is_read_command = id.IsReadOnly();
   const bool is_write_command = id.IsWriteOnly();
 
-  auto iterate_globs = [&](auto target) {
-    for (auto& [elem, op] : keys.key_globs) {
-      if (match(elem, target)) {
-        if (is_read_command && (op == KeyOp::READ || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-        if (is_write_command && (op == KeyOp::WRITE || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-      }
+  auto iterate_globs = [&](std::string_view target) {
+    if (MatchPrefixGlobs(keys.prefix_globs, target, is_read_command, is_write_command))
+      return true;
+    for (uint32_t index : keys.other_globs) {
+      auto& [elem, op] = keys.key_globs[index];
+      if (AllowsAccess(op, is_read_command, is_write_command) && match(elem, target))
+        return true;
     }
     return false;
   };
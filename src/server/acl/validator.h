@@ -15,6 +15,9 @@ namespace dfly::acl {
 struct AclKeys;
 struct AclPubSub;
 
+// Rebuilds the prefix index of keys, must be called whenever keys->key_globs changes.
+void CompileKeyGlobs(AclKeys* keys);
+
 std::pair<bool, AclLog::Reason> IsUserAllowedToInvokeCommandGeneric(
     const std::vector<uint64_t>& acl_commands, const AclKeys& keys, facade::CmdArgList tail_args,
     const CommandId& id);
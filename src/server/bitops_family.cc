@@ -9,6 +9,7 @@
 #include "absl/strings/match.h"
 #include "base/expected.hpp"
 #include "base/logging.h"
+#include "core/detail/bitops.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/op_status.h"
 #include "server/acl/acl_commands_def.h"
@@ -20,11 +21,13 @@
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "src/core/overloaded.h"
+#include "util/fibers/fibers.h"
 #include "util/varz.h"
 
 namespace dfly {
 using namespace facade;
 using namespace std;
+using namespace util;
 
 namespace {
 
@@ -37,6 +40,14 @@ const char* NOT_OP_NAME = "NOT";
 
 using BitsStrVec = vector<string>;
 
+// Commands on very large bitmaps process them in chunks of this size and yield between the
+// chunks, so that other fibers of the shard thread are not starved.
+constexpr size_t kYieldChunkBytes = 1 << 22;
+
+// BITOP applies all the operands to a block of the destination before moving to the next one,
+// so that the block stays in cache.
+constexpr size_t kBitOpBlockBytes = 1 << 16;
+
 // The following is the list of the functions that would handle the
 // commands that handle the bit operations
 void BitPos(CmdArgList args, ConnectionContext* cntx);
@@ -62,61 +73,51 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values);
 
 // ------------------------------------------------------------------------- //
 
-// This function can be used for any case where we allowing out of bound
-// access where the default in this case would be 0 -such as bitop
-uint8_t GetByteAt(string_view s, std::size_t at) {
-  return at >= s.size() ? 0 : s[at];
-}
-
-// For XOR, OR, AND operations on a collection of bytes
-template <typename BitOp, typename SkipOp>
-string BitOpString(BitOp operation_f, SkipOp skip_f, const BitsStrVec& values, string new_value) {
-  // at this point, values are not empty
-  std::size_t max_size = new_value.size();
-
-  if (values.size() > 1) {
-    for (std::size_t i = 0; i < max_size; i++) {
-      std::uint8_t new_entry = operation_f(GetByteAt(values[0], i), GetByteAt(values[1], i));
-      for (std::size_t j = 2; j < values.size(); ++j) {
-        new_entry = operation_f(new_entry, GetByteAt(values[j], i));
-        if (skip_f(new_entry)) {
-          break;
-        }
-      }
-      new_value[i] = new_entry;
+// Yields the fiber once every kYieldChunkBytes of processed data.
+class YieldPacer {
+ public:
+  void Add(size_t bytes) {
+    processed_ += bytes;
+    if (processed_ >= kYieldChunkBytes) {
+      processed_ = 0;
+      ThisFiber::Yield();
     }
-    return new_value;
-  } else {
-    return values[0];
   }
-}
-
-// Helper functions to support operations
-// so we would not need to check which
-// operations to run in the look (unlike
-// https://github.com/redis/redis/blob/c2b0c13d5c0fab49131f6f5e844f80bfa43f6219/src/bitops.c#L607)
-constexpr bool SkipAnd(uint8_t byte) {
-  return byte == 0x0;
-}
 
-constexpr bool SkipOr(uint8_t byte) {
-  return byte == 0xff;
-}
-
-constexpr bool SkipXor(uint8_t) {
-  return false;
-}
+ private:
+  size_t processed_ = 0;
+};
 
-constexpr uint8_t AndOp(uint8_t left, uint8_t right) {
-  return left & right;
-}
+// For XOR, OR, AND operations on a collection of bytes. Shorter values are treated as if they
+// were padded with zeros up to `max_len`.
+string BitOpString(detail::BitOpKind op, const BitsStrVec& values, size_t max_len) {
+  // at this point, values are not empty
+  if (values.size() == 1) {
+    return values[0];
+  }
 
-constexpr uint8_t OrOp(uint8_t left, uint8_t right) {
-  return left | right;
-}
+  string new_value(max_len, 0);
+  memcpy(new_value.data(), values[0].data(), values[0].size());
+  uint8_t* dest = reinterpret_cast<uint8_t*>(new_value.data());
 
-constexpr uint8_t XorOp(uint8_t left, uint8_t right) {
-  return left ^ right;
+  YieldPacer pacer;
+  for (size_t offset = 0; offset < max_len; offset += kBitOpBlockBytes) {
+    const size_t block_end = std::min(max_len, offset + kBitOpBlockBytes);
+    for (size_t j = 1; j < values.size(); ++j) {
+      const string& value = values[j];
+      const size_t value_end = std::min(block_end, value.size());
+      if (value_end > offset) {
+        detail::bitop_bytes(op, reinterpret_cast<const uint8_t*>(value.data()) + offset,
+                            value_end - offset, dest + offset);
+      }
+      if (op == detail::BitOpKind::AND && value_end < block_end) {
+        const size_t zero_from = std::max(offset, value_end);
+        memset(dest + zero_from, 0, block_end - zero_from);
+      }
+    }
+    pacer.Add((block_end - offset) * values.size());
+  }
+  return new_value;
 }
 
 string BitOpNotString(string from) {
@@ -156,13 +157,20 @@ constexpr std::uint8_t CountBitsRange(std::uint8_t byte, std::uint8_t from, uint
 // Count the number of bits that are on, on bytes boundaries: i.e. Start and end are the indices for
 // bytes locations inside str CountBitSetByByteIndices
 std::size_t CountBitSetByByteIndices(string_view at, std::size_t start, std::size_t end) {
+  end = std::min(end, at.size());  // don't overflow
   if (start >= end) {
     return 0;
   }
-  end = std::min(end, at.size());  // don't overflow
-  std::uint32_t count =
-      std::accumulate(std::next(at.begin(), start), std::next(at.begin(), end), 0,
-                      [](auto counter, uint8_t ch) { return counter + absl::popcount(ch); });
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(at.data());
+  std::size_t count = 0;
+  YieldPacer pacer;
+  while (start < end) {
+    std::size_t len = std::min(end - start, kYieldChunkBytes);
+    count += detail::popcount_bytes(data + start, len);
+    start += len;
+    pacer.Add(len);
+  }
   return count;
 }
 
@@ -177,11 +185,13 @@ std::size_t CountBitSetByBitIndices(string_view at, std::size_t start, std::size
   const auto last_bit_first_byte =
       first_byte_index != last_byte_index ? OFFSET_FACTOR : GetBitIndex(end);
   const auto first_byte = GetByteValue(at, start);
-  std::uint32_t count = CountBitsRange(first_byte, GetBitIndex(start), last_bit_first_byte);
+  std::size_t count = CountBitsRange(first_byte, GetBitIndex(start), last_bit_first_byte);
   if (first_byte_index < last_byte_index) {
     first_byte_index++;
-    const auto last_byte = GetByteValue(at, end);
-    count += CountBitsRange(last_byte, 0, GetBitIndex(end));
+    // `end` is exclusive, so the last byte is only read if the range ends inside it.
+    if (GetBitIndex(end) != 0) {
+      count += CountBitsRange(GetByteValue(at, end), 0, GetBitIndex(end));
+    }
     count += CountBitSetByByteIndices(at, first_byte_index, last_byte_index);
   }
   return count;
@@ -396,16 +406,14 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values) {
   // is shorter than the other it would return a 0 and the operation would continue
   // until we ran the longest value. The function will return the resulting new value
   std::size_t max_len = 0;
-  std::size_t max_len_index = 0;
 
   const auto BitOperation = [&]() {
     if (op == OR_OP_NAME) {
-      string default_str{values[max_len_index]};
-      return BitOpString(OrOp, SkipOr, std::move(values), std::move(default_str));
+      return BitOpString(detail::BitOpKind::OR, values, max_len);
     } else if (op == XOR_OP_NAME) {
-      return BitOpString(XorOp, SkipXor, std::move(values), string(max_len, 0));
+      return BitOpString(detail::BitOpKind::XOR, values, max_len);
     } else if (op == AND_OP_NAME) {
-      return BitOpString(AndOp, SkipAnd, std::move(values), string(max_len, 0));
+      return BitOpString(detail::BitOpKind::AND, values, max_len);
     } else if (op == NOT_OP_NAME) {
       return BitOpNotString(values[0]);
     } else {
@@ -420,10 +428,7 @@ string RunBitOperationOnValues(string_view op, const BitsStrVec& values) {
   // The new result is the max length input
   max_len = values[0].size();
   for (std::size_t i = 1; i < values.size(); ++i) {
-    if (values[i].size() > max_len) {
-      max_len = values[i].size();
-      max_len_index = i;
-    }
+    max_len = std::max(max_len, values[i].size());
   }
   return BitOperation();
 }
@@ -433,8 +438,7 @@ OpResult<string> CombineResultOp(ShardStringResults result, string_view op) {
   BitsStrVec values;
   for (auto&& res : result) {
     if (res) {
-      auto v = res.value();
-      values.emplace_back(std::move(v));
+      values.emplace_back(std::move(res.value()));
     } else {
       if (res.status() != OpStatus::KEY_NOTFOUND) {
         // something went wrong, just bale out
@@ -1286,19 +1290,52 @@ std::size_t GetFirstBitWithValueInByte(uint8_t byte, bool value) {
   }
 }
 
+// Returns the index of the first byte in [start, end) that has a bit equal to `value`, or `end`.
+std::size_t FindFirstByteWithBit(string_view value_str, bool bit_value, std::size_t start,
+                                 std::size_t end) {
+  const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(value_str.data());
+  YieldPacer pacer;
+  while (start < end) {
+    std::size_t len = std::min(end - start, kYieldChunkBytes);
+    std::size_t pos = detail::find_first_byte_not_equal(data + start, len, kNotFoundByte);
+    if (pos < len) {
+      return start + pos;
+    }
+    start += len;
+    pacer.Add(len);
+  }
+  return end;
+}
+
 int64_t FindFirstBitWithValueAsBit(string_view value_str, bool bit_value, int64_t start,
                                    int64_t end) {
-  for (int64_t i = start; i <= end; ++i) {
-    if (static_cast<size_t>(GetByteIndex(i)) >= value_str.size()) {
-      break;
+  end = std::min<int64_t>(end, value_str.size() * OFFSET_FACTOR - 1);
+
+  int64_t i = start;
+  // Bits up to the first byte boundary.
+  for (; i <= end && i % OFFSET_FACTOR != 0; ++i) {
+    if (CheckBitStatus(GetByteValue(value_str, i), GetNormalizedBitIndex(i)) == bit_value) {
+      return i;
     }
-    const uint8_t current_byte = GetByteValue(value_str, i);
-    bool current_bit = CheckBitStatus(current_byte, GetNormalizedBitIndex(i));
-    if (current_bit != bit_value) {
-      continue;
+  }
+
+  // Whole bytes inside the range are scanned at once.
+  const int64_t full_bytes_end = (end + 1) / OFFSET_FACTOR;
+  if (i <= end && i / OFFSET_FACTOR < full_bytes_end) {
+    std::size_t byte =
+        FindFirstByteWithBit(value_str, bit_value, i / OFFSET_FACTOR, full_bytes_end);
+    if (byte < static_cast<std::size_t>(full_bytes_end)) {
+      return byte * OFFSET_FACTOR + GetFirstBitWithValueInByte(value_str[byte], bit_value);
     }
+    i = full_bytes_end * OFFSET_FACTOR;
+  }
 
-    return i;
+  // Remaining bits of the last byte.
+  for (; i <= end; ++i) {
+    if (CheckBitStatus(GetByteValue(value_str, i), GetNormalizedBitIndex(i)) == bit_value) {
+      return i;
+    }
   }
 
   return -1;
@@ -1306,20 +1343,16 @@ int64_t FindFirstBitWithValueAsBit(string_view value_str, bool bit_value, int64_
 
 int64_t FindFirstBitWithValueAsByte(string_view value_str, bool bit_value, int64_t start,
                                     int64_t end) {
-  for (int64_t i = start; i <= end; ++i) {
-    if (static_cast<size_t>(i) >= value_str.size()) {
-      break;
-    }
-    const uint8_t current_byte = value_str[i];
-    const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
-    if (current_byte == kNotFoundByte) {
-      continue;
-    }
-
-    return i * OFFSET_FACTOR + GetFirstBitWithValueInByte(current_byte, bit_value);
+  end = std::min<int64_t>(end, value_str.size() - 1);
+  if (start > end) {
+    return -1;
   }
 
-  return -1;
+  std::size_t byte = FindFirstByteWithBit(value_str, bit_value, start, end + 1);
+  if (byte > static_cast<std::size_t>(end)) {
+    return -1;
+  }
+  return byte * OFFSET_FACTOR + GetFirstBitWithValueInByte(value_str[byte], bit_value);
 }
 
 OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, string_view key, bool bit_value,
@@ -8,12 +8,14 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <random>
 #include <string>
 #include <string_view>
 
 #include "absl/strings/str_cat.h"
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "core/detail/bitops.h"
 #include "facade/facade_test.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
@@ -805,4 +807,75 @@ TEST_F(BitOpsFamilyTest, BitFieldOperations) {
   ASSERT_THAT(Run({"bitfield", "foo", "get", "u1", "15"}), IntArg(1));
 }
 
+TEST_F(BitOpsFamilyTest, LargeBitmap) {
+  // Larger than the chunk after which the commands yield.
+  constexpr int64_t kSize = 10 << 20;
+  string first(kSize, '\xff');
+  string second(kSize / 2, '\x0f');
+  second.back() = '\x01';
+  first[kSize - 3] = '\xfe';
+
+  Run({"set", "first", first});
+  Run({"set", "second", second});
+
+  EXPECT_EQ(CheckedInt({"bitcount", "first"}), kSize * 8 - 1);
+  EXPECT_EQ(CheckedInt({"bitcount", "second"}), (kSize / 2 - 1) * 4 + 1);
+  EXPECT_EQ(CheckedInt({"bitcount", "first", "1", "-1", "BIT"}), kSize * 8 - 2);
+  EXPECT_EQ(CheckedInt({"bitpos", "first", "0"}), (kSize - 3) * 8 + 7);
+  EXPECT_EQ(CheckedInt({"bitpos", "first", "0", "8", "-1", "BIT"}), (kSize - 3) * 8 + 7);
+  EXPECT_EQ(CheckedInt({"bitpos", "second", "1", "-1"}), (kSize / 2 - 1) * 8 + 7);
+
+  EXPECT_EQ(CheckedInt({"bitop", "and", "dest", "first", "second"}), kSize);
+  EXPECT_EQ(CheckedInt({"bitcount", "dest"}), (kSize / 2 - 1) * 4 + 1);
+  EXPECT_EQ(CheckedInt({"bitpos", "dest", "1", absl::StrCat(kSize / 2 - 1)}),
+            (kSize / 2 - 1) * 8 + 7);
+  EXPECT_EQ(CheckedInt({"bitpos", "dest", "1", absl::StrCat(kSize / 2)}), -1);
+
+  EXPECT_EQ(CheckedInt({"bitop", "xor", "dest", "first", "second"}), kSize);
+  EXPECT_EQ(CheckedInt({"bitcount", "dest"}), kSize * 8 - 1 - ((kSize / 2 - 1) * 4 + 1));
+}
+
+static string RandomBitmap(size_t size) {
+  string bitmap(size, 0);
+  std::mt19937_64 gen(size);
+  for (char& c : bitmap) {
+    c = gen();
+  }
+  return bitmap;
+}
+
+static void BM_BitCount(benchmark::State& state) {
+  string bitmap = RandomBitmap(state.range(0));
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(bitmap.data());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(detail::popcount_bytes(data, bitmap.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * bitmap.size());
+}
+BENCHMARK(BM_BitCount)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 27);
+
+static void BM_BitOpAnd(benchmark::State& state) {
+  string src = RandomBitmap(state.range(0));
+  string dest = RandomBitmap(state.range(0));
+  while (state.KeepRunning()) {
+    detail::bitop_bytes(detail::BitOpKind::AND, reinterpret_cast<const uint8_t*>(src.data()),
+                        src.size(), reinterpret_cast<uint8_t*>(dest.data()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+BENCHMARK(BM_BitOpAnd)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 27);
+
+static void BM_BitPos(benchmark::State& state) {
+  string bitmap(state.range(0), 0);
+  bitmap.back() = 1;
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(bitmap.data());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(detail::find_first_byte_not_equal(data, bitmap.size(), 0));
+  }
+  state.SetBytesProcessed(state.iterations() * bitmap.size());
+}
+BENCHMARK(BM_BitPos)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 27);
+
+
 }  // end of namespace dfly
@@ -17,20 +17,19 @@ namespace dfly {
 
 using namespace std;
 
-struct WatchItem {
-  Transaction* trans;
-  KeyReadyChecker key_ready_checker;
-
-  Transaction* get() const {
-    return trans;
+// Waiters of a key in FIFO order. Removing a waiter from the middle of the queue leaves a hole
+// that is skipped once it reaches the front, so both wake-ups and timeouts are O(1).
+struct BlockingController::WatchQueue {
+  explicit WatchQueue(string_view k) : key(k) {
   }
 
-  WatchItem(Transaction* t, KeyReadyChecker krc) : trans(t), key_ready_checker(std::move(krc)) {
-  }
-};
+  const string key;  // queue_map references it.
+  deque<Transaction*> items;
+
+  // Position of every waiter in items, offset by the number of items popped so far.
+  absl::flat_hash_map<Transaction*, uint64_t> positions;
+  uint64_t popped = 0;
 
-struct BlockingController::WatchQueue {
-  deque<WatchItem> items;
   TxId notify_txid = UINT64_MAX;
 
   // Updated  by both coordinator and shard threads but at different times.
@@ -41,9 +40,58 @@ struct BlockingController::WatchQueue {
     notify_txid = UINT64_MAX;
   }
 
-  auto Find(Transaction* tx) const {
-    return find_if(items.begin(), items.end(),
-                   [tx](const WatchItem& wi) { return wi.get() == tx; });
+  bool empty() const {
+    return positions.empty();
+  }
+
+  bool Contains(Transaction* tx) const {
+    return positions.contains(tx);
+  }
+
+  void Push(Transaction* tx) {
+    positions.emplace(tx, popped + items.size());
+    items.push_back(tx);
+  }
+
+  Transaction* Front() {
+    TrimFront();
+    return items.empty() ? nullptr : items.front();
+  }
+
+  void PopFront() {
+    DCHECK(Front());
+    positions.erase(items.front());
+    items.pop_front();
+    ++popped;
+  }
+
+  bool Remove(Transaction* tx) {
+    auto it = positions.find(tx);
+    if (it == positions.end())
+      return false;
+
+    items[it->second - popped] = nullptr;
+    positions.erase(it);
+    TrimFront();
+
+    // Holes behind a long waiting head are compacted once they dominate the queue.
+    if (items.size() > 2 * positions.size() + 16)
+      Compact();
+    return true;
+  }
+
+ private:
+  void TrimFront() {
+    while (!items.empty() && items.front() == nullptr) {
+      items.pop_front();
+      ++popped;
+    }
+  }
+
+  void Compact() {
+    items.erase(remove(items.begin(), items.end(), nullptr), items.end());
+    for (size_t i = 0; i < items.size(); ++i)
+      positions[items[i]] = popped + i;
   }
 };
 
@@ -51,18 +99,25 @@ struct BlockingController::WatchQueue {
 struct BlockingController::DbWatchTable {
   WatchQueueMap queue_map;
 
-  // awakened keys point to blocked keys that can potentially be unblocked.
-  absl::flat_hash_set<std::string> awakened_keys;
+  // awakened queues contain blocked keys that can potentially be unblocked.
+  absl::flat_hash_set<WatchQueue*> awakened_queues;
 
   // returns true if awake event was added.
   // Requires that the key queue be in the required state.
   bool AddAwakeEvent(string_view key);
 
-  // Returns true if awakened tx was removed from the queue.
-  bool UnwatchTx(string_view key, Transaction* tx);
+  // Removes tx from the queue of key and returns whether tx was awakened by that queue.
+  // Sets *removed if tx was found in the queue.
+  bool UnwatchTx(string_view key, Transaction* tx, bool* removed);
+
+  void EraseQueue(WatchQueueMap::iterator it) {
+    awakened_queues.erase(it->second.get());
+    queue_map.erase(it);
+  }
 };
 
-bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* tx) {
+bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* tx, bool* removed) {
+  *removed = false;
   auto wq_it = queue_map.find(key);
 
   // With multiple same keys we may have misses because the first iteration
@@ -71,34 +126,31 @@ bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* t
     return false;
 
   WatchQueue* wq = wq_it->second.get();
-  DCHECK(!wq->items.empty());
+  DCHECK(!wq->empty());
 
   bool res = false;
-  if (wq->state == WatchQueue::ACTIVE && wq->items.front().get() == tx) {
-    wq->items.pop_front();
+  if (wq->state == WatchQueue::ACTIVE && wq->Front() == tx) {
+    wq->PopFront();
 
     // We suspend the queue and add keys to re-verification.
     // If they are still present, this queue will be reactivated below.
     wq->state = WatchQueue::SUSPENDED;
 
-    if (!wq->items.empty())
-      awakened_keys.insert(wq_it->first);  // send for further validation.
-    res = true;
+    if (!wq->empty())
+      awakened_queues.insert(wq);  // send for further validation.
+    *removed = res = true;
   } else {
     // tx can be is_awakened == true because of some other key and this queue would be
     // in suspended and we still need to clean it up.
     // the suspended item does not have to be the first one in the queue.
     // This shard has not been awakened and in case this transaction in the queue
     // we must clean it up.
-    if (auto it = wq->Find(tx); it != wq->items.end()) {
-      wq->items.erase(it);
-    }
+    *removed = wq->Remove(tx);
   }
 
-  if (wq->items.empty()) {
+  if (wq->empty()) {
     DVLOG(1) << "queue_map.erase";
-    awakened_keys.erase(wq_it->first);
-    queue_map.erase(wq_it);
+    EraseQueue(wq_it);
   }
   return res;
 }
@@ -115,7 +167,14 @@ bool BlockingController::DbWatchTable::AddAwakeEvent(string_view key) {
   if (it == queue_map.end() || it->second->state != WatchQueue::SUSPENDED)
     return false;  /// nobody watches this key or state does not match.
 
-  return awakened_keys.insert(it->first).second;
+  return awakened_queues.insert(it->second.get()).second;
+}
+
+void BlockingController::ReleaseWaiter(Transaction* tx) {
+  auto it = waiters_.find(tx);
+  DCHECK(it != waiters_.end());
+  if (--it->second.num_keys == 0)
+    waiters_.erase(it);
 }
 
 // Removes tx from its watch queues if tx appears there.
@@ -137,9 +196,12 @@ void BlockingController::FinalizeWatched(Keys keys, Transaction* tx) {
   // Add keys of processed transaction so we could awake the next one in the queue
   // in case those keys still exist.
   for (string_view key : base::it::Wrap(facade::kToSV, keys)) {
-    bool removed_awakened = wt.UnwatchTx(key, tx);
+    bool unwatched = false;
+    bool removed_awakened = wt.UnwatchTx(key, tx, &unwatched);
     CHECK(!removed_awakened || removed)
         << tx->DebugId() << " " << key << " " << tx->DEBUG_GetLocalMask(owner_->shard_id());
+    if (unwatched)
+      ReleaseWaiter(tx);
   }
 
   if (wt.queue_map.empty()) {
@@ -157,6 +219,8 @@ void BlockingController::NotifyPending() {
   context.ns = ns_;
   context.time_now_ms = GetCurrentTimeMs();
 
+  // All the keys awakened since the last cycle are verified in a single pass, each queue
+  // at most once regardless of how many times its key was touched.
   for (DbIndex index : awakened_indices_) {
     auto dbit = watched_dbs_.find(index);
     if (dbit == watched_dbs_.end())
@@ -164,33 +228,15 @@ void BlockingController::NotifyPending() {
 
     context.db_index = index;
     DbWatchTable& wt = *dbit->second;
-    for (const auto& key : wt.awakened_keys) {
-      string_view sv_key = key;
-      DVLOG(1) << "Processing awakened key " << sv_key;
-      auto w_it = wt.queue_map.find(sv_key);
-      if (w_it == wt.queue_map.end()) {
-        // This should not happen because we remove keys from awakened_keys every type we remove
-        // the entry from queue_map. TODO: to make it a CHECK after Dec 2024
-        LOG(ERROR) << "Internal error: Key " << sv_key
-                   << " was not found in the watch queue, wt.awakened_keys len is "
-                   << wt.awakened_keys.size() << " wt.queue_map len is " << wt.queue_map.size();
-        for (const auto& item : wt.awakened_keys) {
-          LOG(ERROR) << "Awakened key: " << item;
-        }
-
-        continue;
-      }
-
-      CHECK(w_it != wt.queue_map.end());
-      DVLOG(1) << "Notify WQ: [" << owner_->shard_id() << "] " << key;
-      WatchQueue* wq = w_it->second.get();
-      NotifyWatchQueue(sv_key, wq, context);
-      if (wq->items.empty()) {
-        // we erase awakened_keys right after this loop finishes running.
-        wt.queue_map.erase(w_it);
+    for (WatchQueue* wq : wt.awakened_queues) {
+      DVLOG(1) << "Notify WQ: [" << owner_->shard_id() << "] " << wq->key;
+      NotifyWatchQueue(wq, context);
+      if (wq->empty()) {
+        // we clear awakened_queues right after this loop finishes running.
+        wt.queue_map.erase(wq->key);
       }
     }
-    wt.awakened_keys.clear();
+    wt.awakened_queues.clear();
 
     if (wt.queue_map.empty()) {
       watched_dbs_.erase(dbit);
@@ -206,23 +252,23 @@ void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transa
   }
 
   DbWatchTable& wt = *dbit->second;
+  Waiter& waiter = waiters_[trans];
+  waiter.krc = std::move(krc);
 
   for (auto key : base::it::Wrap(facade::kToSV, watch_keys)) {
-    auto [res, inserted] = wt.queue_map.emplace(key, nullptr);
-    if (inserted) {
-      res->second.reset(new WatchQueue);
+    auto it = wt.queue_map.find(key);
+    if (it == wt.queue_map.end()) {
+      auto wq = make_unique<WatchQueue>(key);
+      it = wt.queue_map.emplace(wq->key, std::move(wq)).first;
     }
 
-    if (!res->second->items.empty()) {
-      Transaction* last = res->second->items.back().get();
-      DCHECK_GT(last->GetUseCount(), 0u);
+    // Duplicate keys case. We push only once per key.
+    if (it->second->Contains(trans))
+      continue;
 
-      // Duplicate keys case. We push only once per key.
-      if (last == trans)
-        continue;
-    }
     DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
-    res->second->items.emplace_back(trans, krc);
+    it->second->Push(trans);
+    ++waiter.num_keys;
   }
 }
 
@@ -243,22 +289,24 @@ void BlockingController::AwakeWatched(DbIndex db_index, string_view db_key) {
 }
 
 // Marks the queue as active and notifies the first transaction in the queue.
-void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueue* wq,
-                                          const DbContext& context) {
+void BlockingController::NotifyWatchQueue(WatchQueue* wq, const DbContext& context) {
   DCHECK_EQ(wq->state, WatchQueue::SUSPENDED);
 
-  auto& queue = wq->items;
+  string_view key = wq->key;
   ShardId sid = owner_->shard_id();
 
   // In the most cases we shouldn't have skipped elements at all
-  absl::InlinedVector<dfly::WatchItem, 4> skipped;
-  while (!queue.empty()) {
-    auto& wi = queue.front();
-    Transaction* head = wi.get();
+  absl::InlinedVector<Transaction*, 4> skipped;
+  while (Transaction* head = wq->Front()) {
     // We check may the transaction be notified otherwise move it to the end of the queue
-    if (wi.key_ready_checker(owner_, context, head, key)) {
+    auto w_it = waiters_.find(head);
+    DCHECK(w_it != waiters_.end());
+    if (w_it->second.krc(owner_, context, head, key)) {
       DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key;
-      if (head->NotifySuspended(owner_->committed_txid(), sid, key)) {
+      if (head->CanDeliverSuspended()) {
+        // Served right here, so we go on with the next waiter instead of activating the queue.
+        head->DeliverSuspended(owner_, key);
+      } else if (head->NotifySuspended(owner_->committed_txid(), sid, key)) {
         wq->state = WatchQueue::ACTIVE;
         // We deliberately keep the notified transaction in the queue to know which queue
         // must handled when this transaction finished.
@@ -266,13 +314,16 @@ void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueue* wq,
         awakened_transactions_.insert(head);
         break;
       }
+      ReleaseWaiter(head);
     } else {
-      skipped.push_back(std::move(wi));
+      skipped.push_back(head);
     }
 
-    queue.pop_front();
+    wq->PopFront();
   }
-  std::move(skipped.begin(), skipped.end(), std::back_inserter(queue));
+
+  for (Transaction* tx : skipped)
+    wq->Push(tx);
 }
 
 size_t BlockingController::NumWatched(DbIndex db_indx) const {
@@ -289,7 +340,7 @@ vector<string> BlockingController::GetWatchedKeys(DbIndex db_indx) const {
 
   if (it != watched_dbs_.end()) {
     for (const auto& k_v : it->second->queue_map) {
-      res.push_back(k_v.first);
+      res.emplace_back(k_v.first);
     }
   }
 
@@ -54,9 +54,19 @@ class BlockingController {
   struct WatchQueue;
   struct DbWatchTable;
 
-  using WatchQueueMap = absl::flat_hash_map<std::string, std::unique_ptr<WatchQueue>>;
+  // Keys reference the key stored in their queue.
+  using WatchQueueMap = absl::flat_hash_map<std::string_view, std::unique_ptr<WatchQueue>>;
 
-  void NotifyWatchQueue(std::string_view key, WatchQueue* wqm, const DbContext& context);
+  // The checker is shared by all the keys a transaction watches.
+  struct Waiter {
+    KeyReadyChecker krc;
+    unsigned num_keys = 0;  // number of queues the transaction is in
+  };
+
+  void NotifyWatchQueue(WatchQueue* wqm, const DbContext& context);
+
+  // Called when tx leaves one of its watch queues.
+  void ReleaseWaiter(Transaction* tx);
 
   // void NotifyConvergence(Transaction* tx);
 
@@ -64,6 +74,7 @@ class BlockingController {
   Namespace* ns_;
 
   absl::flat_hash_map<DbIndex, std::unique_ptr<DbWatchTable>> watched_dbs_;
+  absl::flat_hash_map<Transaction*, Waiter> waiters_;
 
   // serves as a temporary queue that aggregates all the possible awakened dbs.
   // flushed by RunStep().
@@ -93,6 +93,35 @@ TEST_F(BlockingControllerTest, Basic) {
   });
 }
 
+// Waiters that leave a long queue out of order do not disturb the ones still waiting.
+TEST_F(BlockingControllerTest, ManyWaiters) {
+  constexpr unsigned kNum = 200;
+  vector<boost::intrusive_ptr<Transaction>> trans;
+  for (unsigned i = 0; i < kNum; ++i) {
+    trans.emplace_back(new Transaction{&cid_});
+    trans.back()->InitByArgs(&namespaces.GetDefaultNamespace(), 0,
+                            {arg_vec_.data(), arg_vec_.size()});
+  }
+
+  shard_set->Await(0, [&] {
+    BlockingController bc(EngineShard::tlocal(), &namespaces.GetDefaultNamespace());
+    ArgSlice keys{str_vec_[0]};
+    for (auto& t : trans) {
+      bc.AddWatched(
+          keys, [](auto...) { return true; }, t.get());
+    }
+    EXPECT_EQ(1, bc.NumWatched(0));
+
+    for (unsigned i = 1; i < kNum; i += 2)
+      bc.FinalizeWatched(keys, trans[i].get());
+    EXPECT_EQ(1, bc.NumWatched(0));
+
+    for (unsigned i = 0; i < kNum; i += 2)
+      bc.FinalizeWatched(keys, trans[i].get());
+    EXPECT_EQ(0, bc.NumWatched(0));
+  });
+}
+
 TEST_F(BlockingControllerTest, Timeout) {
   time_point tp = steady_clock::now() + chrono::milliseconds(10);
   bool blocked;
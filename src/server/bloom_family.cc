@@ -25,6 +25,7 @@ struct SbfParams {
   uint32_t init_capacity;
   double error;
   double grow_factor = kDefaultGrowFactor;
+  bool blocked = false;
 
   bool ok() const {
     return error > 0 and error < 0.5;
@@ -34,6 +35,13 @@ struct SbfParams {
 using AddResult = absl::InlinedVector<OpResult<bool>, 4>;
 using ExistsResult = absl::InlinedVector<bool, 4>;
 
+absl::InlinedVector<string_view, 4> ToItems(CmdArgList items) {
+  absl::InlinedVector<string_view, 4> res(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    res[i] = ToSV(items[i]);
+  return res;
+}
+
 OpStatus OpReserve(const SbfParams& params, const OpArgs& op_args, string_view key) {
   auto& db_slice = op_args.GetDbSlice();
   OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
@@ -43,7 +51,7 @@ OpStatus OpReserve(const SbfParams& params, const OpArgs& op_args, string_view k
     return OpStatus::KEY_EXISTS;
 
   PrimeValue& pv = op_res->it->second;
-  pv.SetSBF(params.init_capacity, params.error, params.grow_factor);
+  pv.SetSBF(params.init_capacity, params.error, params.grow_factor, params.blocked);
 
   return OpStatus::OK;
 }
@@ -65,9 +73,12 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, string_view key, CmdArgList ite
   }
 
   SBF* sbf = pv.GetSBF();
+  ExistsResult added(items.size());
+  sbf->Add(ToItems(items), added.data());
+
   AddResult result(items.size());
   for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Add(ToSV(items[i]));
+    result[i] = added[i];
   }
   return result;
 }
@@ -81,10 +92,7 @@ OpResult<ExistsResult> OpExists(const OpArgs& op_args, string_view key, CmdArgLi
 
   const SBF* sbf = it->second.GetSBF();
   ExistsResult result(items.size());
-
-  for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Exists(ToSV(items[i]));
-  }
+  sbf->Exists(ToItems(items), result.data());
 
   return result;
 }
@@ -98,9 +106,22 @@ void BloomFamily::Reserve(CmdArgList args, ConnectionContext* cntx) {
 
   tie(params.error, params.init_capacity) = parser.Next<double, uint32_t>();
 
+  while (parser.HasNext()) {
+    if (parser.Check("BLOCKED")) {
+      params.blocked = true;
+    } else if (parser.Check("EXPANSION")) {
+      params.grow_factor = parser.Next<uint32_t>();
+    } else {
+      return cntx->SendError(kSyntaxErr);
+    }
+  }
+
   if (parser.Error())
     return cntx->SendError(kSyntaxErr);
 
+  if (params.grow_factor < 1)
+    return cntx->SendError("expansion must be positive", kSyntaxErrType);
+
   if (!params.ok())
     return cntx->SendError("error rate is out of range", kSyntaxErrType);
 
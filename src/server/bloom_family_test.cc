@@ -51,4 +51,33 @@ TEST_F(BloomFamilyTest, Multiple) {
   EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(1), IntArg(1), IntArg(1))));
 }
 
+TEST_F(BloomFamilyTest, Blocked) {
+  EXPECT_EQ(Run({"bf.reserve", "b1", "0.01", "100", "blocked", "expansion", "4"}), "OK");
+  EXPECT_THAT(Run({"bf.reserve", "b2", "0.01", "100", "foo"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"bf.reserve", "b2", "0.01", "100", "expansion", "0"}), ErrArg("expansion"));
+
+  vector<string> args = {"bf.madd", "b1"};
+  for (unsigned i = 0; i < 1000; ++i) {
+    args.push_back(absl::StrCat("item", i));
+  }
+  auto resp = Run(absl::MakeSpan(args));
+  ASSERT_THAT(resp, ArrLen(1000));
+
+  args[0] = "bf.mexists";
+  resp = Run(absl::MakeSpan(args));
+  ASSERT_THAT(resp, ArrLen(1000));
+  for (const auto& val : resp.GetVec()) {
+    EXPECT_THAT(val, IntArg(1));
+  }
+
+  // The layout survives a reload.
+  Run({"debug", "reload"});
+  resp = Run(absl::MakeSpan(args));
+  for (const auto& val : resp.GetVec()) {
+    EXPECT_THAT(val, IntArg(1));
+  }
+  EXPECT_THAT(Run({"bf.madd", "b1", "item1", "new"}),
+              RespArray(ElementsAre(IntArg(0), IntArg(1))));
+}
+
 }  // namespace dfly
@@ -6,13 +6,11 @@
 
 #include <shared_mutex>
 
-extern "C" {
-#include "redis/util.h"
-}
-
 #include <absl/container/fixed_array.h>
+#include <absl/strings/str_cat.h>
 
 #include "base/logging.h"
+#include "server/cluster/slot_set.h"
 #include "server/engine_shard_set.h"
 #include "server/server_state.h"
 
@@ -21,33 +19,76 @@ using namespace std;
 
 namespace {
 
-bool Matches(string_view pattern, string_view channel) {
-  return stringmatchlen(pattern.data(), pattern.size(), channel.data(), channel.size(), 0) == 1;
-}
+// Build functor for sending messages to connection. The push frames are serialized once for every
+// pattern of the subscribers, without their type character that depends on the protocol. The
+// channel and message views of each message point into its frame.
+auto BuildSender(string_view channel, facade::ArgRange messages, bool sharded,
+                 const vector<ChannelStore::Subscriber>& subscribers) {
+  vector<string_view> patterns;
+  for (const auto& sub : subscribers) {
+    if (find(patterns.begin(), patterns.end(), sub.pattern) == patterns.end())
+      patterns.push_back(sub.pattern);
+  }
+
+  auto frame_prefix = [sharded](string_view pattern) {
+    if (sharded)
+      return string{"3\r\n$8\r\nsmessage\r\n"};
+    return pattern.empty() ? string{"3\r\n$7\r\nmessage\r\n"}
+                           : absl::StrCat("4\r\n$8\r\npmessage\r\n$", pattern.size(), "\r\n",
+                                          pattern, "\r\n");
+  };
+  string channel_part = absl::StrCat("$", channel.size(), "\r\n", channel, "\r\n");
+
+  size_t total_size = 0;
+  for (string_view pattern : patterns) {
+    total_size += pattern.size();
+    size_t prefix_size = frame_prefix(pattern).size() + channel_part.size();
+    for (string_view message : messages)
+      total_size += prefix_size + absl::StrCat("$", message.size(), "\r\n").size() +
+                    message.size() + 2;
+  }
 
-// Build functor for sending messages to connection
-auto BuildSender(string_view channel, facade::ArgRange messages) {
-  absl::FixedArray<string_view, 1> views(messages.Size());
-  size_t messages_size = accumulate(messages.begin(), messages.end(), 0,
-                                    [](int sum, string_view str) { return sum + str.size(); });
-  auto buf = shared_ptr<char[]>{new char[channel.size() + messages_size]};
-  {
-    memcpy(buf.get(), channel.data(), channel.size());
-    char* ptr = buf.get() + channel.size();
-
-    size_t i = 0;
+  struct Frame {
+    string_view channel, message, tail;
+  };
+
+  // Frames are laid out by pattern, then by message.
+  size_t num_messages = messages.Size();
+  absl::FixedArray<Frame, 1> frames(patterns.size() * num_messages);
+  auto buf = shared_ptr<char[]>{new char[total_size]};
+  char* ptr = buf.get();
+  auto append = [&ptr](string_view str) {
+    memcpy(ptr, str.data(), str.size());
+    ptr += str.size();
+    return string_view{ptr - str.size(), str.size()};
+  };
+
+  Frame* frame = frames.data();
+  for (string_view& pattern : patterns) {
+    pattern = append(pattern);
+    string prefix = frame_prefix(pattern);
     for (string_view message : messages) {
-      memcpy(ptr, message.data(), message.size());
-      views[i++] = {ptr, message.size()};
-      ptr += message.size();
+      char* start = ptr;
+      append(prefix);
+      frame->channel = append(channel_part).substr(channel_part.size() - channel.size() - 2,
+                                                   channel.size());
+      append(absl::StrCat("$", message.size(), "\r\n"));
+      frame->message = append(message);
+      append("\r\n");
+      frame->tail = {start, size_t(ptr - start)};
+      ++frame;
     }
   }
-
-  return [channel, buf = std::move(buf), views = std::move(views)](facade::Connection* conn,
-                                                                   string pattern) {
-    string_view channel_view{buf.get(), channel.size()};
-    for (std::string_view message_view : views)
-      conn->SendPubMessageAsync({std::move(pattern), buf, channel_view, message_view});
+  DCHECK_EQ(size_t(ptr - buf.get()), total_size);
+
+  return [buf = std::move(buf), patterns = std::move(patterns), frames = std::move(frames),
+          num_messages](facade::Connection* conn, const string& pattern) {
+    size_t index = find(patterns.begin(), patterns.end(), pattern) - patterns.begin();
+    DCHECK_LT(index, patterns.size());
+    for (size_t i = 0; i < num_messages; ++i) {
+      const Frame& frame = frames[index * num_messages + i];
+      conn->SendPubMessageAsync({pattern, buf, frame.channel, frame.message, frame.tail});
+    }
   };
 }
 
@@ -101,12 +142,27 @@ void ChannelStore::ChannelMap::DeleteAll() {
     delete ptr.Get();
 }
 
-ChannelStore::ChannelStore() : channels_{new ChannelMap{}}, patterns_{new ChannelMap{}} {
+ChannelStore::ChannelStore()
+    : channels_{new ChannelMap{}},
+      patterns_{new ChannelMap{}},
+      pattern_index_{new GlobIndex{}},
+      shard_channels_{new ChannelMap{}} {
   control_block.most_recent = this;
 }
 
-ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns)
-    : channels_{channels}, patterns_{patterns} {
+ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns, GlobIndex* pattern_index,
+                           ChannelMap* shard_channels)
+    : channels_{channels},
+      patterns_{patterns},
+      pattern_index_{pattern_index},
+      shard_channels_{shard_channels} {
+}
+
+GlobIndex* ChannelStore::BuildPatternIndex(const ChannelMap& patterns) {
+  auto* index = new GlobIndex{};
+  for (const auto& [pattern, _] : patterns)
+    index->Add(pattern);
+  return index;
 }
 
 void ChannelStore::Destroy() {
@@ -114,26 +170,30 @@ void ChannelStore::Destroy() {
   control_block.update_mu.unlock();
 
   auto* store = control_block.most_recent.load(memory_order_relaxed);
-  for (auto* chan_map : {store->channels_, store->patterns_}) {
+  for (auto* chan_map : {store->channels_, store->patterns_, store->shard_channels_}) {
     chan_map->DeleteAll();
     delete chan_map;
   }
+  delete store->pattern_index_;
   delete control_block.most_recent;
 }
 
 ChannelStore::ControlBlock ChannelStore::control_block;
 
-unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange messages) const {
-  vector<Subscriber> subscribers = FetchSubscribers(channel);
+unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange messages,
+                                    bool sharded) const {
+  vector<Subscriber> subscribers = FetchSubscribers(channel, sharded);
   if (subscribers.empty())
     return 0;
 
   // Make sure none of the threads publish buffer limits is reached. We don't reserve memory ahead
   // and don't prevent the buffer from possibly filling, but the approach is good enough for
   // limiting fast producers. Most importantly, we can use DispatchBrief below as we block here
+  // Subscribers that read slowly only pace the publishers to them with subscriber_output_limit.
   optional<uint32_t> last_thread;
   for (auto& sub : subscribers) {
     DCHECK_LE(last_thread.value_or(0), sub.Thread());
+    sub.EnsureOutputBudget();
     if (last_thread && *last_thread == sub.Thread())  // skip same thread
       continue;
 
@@ -141,8 +201,9 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
       last_thread = sub.Thread();
   }
 
+  auto send = BuildSender(channel, messages, sharded, subscribers);
   auto subscribers_ptr = make_shared<decltype(subscribers)>(std::move(subscribers));
-  auto cb = [subscribers_ptr, send = BuildSender(channel, messages)](unsigned idx, auto*) {
+  auto cb = [subscribers_ptr, send = std::move(send)](unsigned idx, auto*) {
     auto it = lower_bound(subscribers_ptr->begin(), subscribers_ptr->end(), idx,
                           ChannelStore::Subscriber::ByThreadId);
     while (it != subscribers_ptr->end() && it->Thread() == idx) {
@@ -157,16 +218,25 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
   return subscribers_ptr->size();
 }
 
-vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view channel) const {
+vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view channel,
+                                                                bool sharded) const {
   vector<Subscriber> res;
 
+  if (sharded) {
+    if (auto it = shard_channels_->find(channel); it != shard_channels_->end())
+      Fill(*it->second, string{}, &res);
+    sort(res.begin(), res.end(), Subscriber::ByThread);
+    return res;
+  }
+
   if (auto it = channels_->find(channel); it != channels_->end())
     Fill(*it->second, string{}, &res);
 
-  for (const auto& [pat, subs] : *patterns_) {
-    if (Matches(pat, channel))
-      Fill(*subs, pat, &res);
-  }
+  pattern_index_->Match(channel, [this, &res](string_view pattern) {
+    auto it = patterns_->find(pattern);
+    DCHECK(it != patterns_->end());
+    Fill(*it->second, it->first, &res);
+  });
 
   sort(res.begin(), res.end(), Subscriber::ByThread);
   return res;
@@ -183,10 +253,11 @@ void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<S
   }
 }
 
-std::vector<string> ChannelStore::ListChannels(const string_view pattern) const {
+std::vector<string> ChannelStore::ListChannels(const string_view pattern, bool sharded) const {
   vector<string> res;
-  for (const auto& [channel, _] : *channels_) {
-    if (pattern.empty() || Matches(pattern, channel))
+  GlobMatcher matcher{pattern};
+  for (const auto& [channel, _] : *(sharded ? shard_channels_ : channels_)) {
+    if (pattern.empty() || matcher.Matches(channel))
       res.push_back(channel);
   }
   return res;
@@ -196,9 +267,93 @@ size_t ChannelStore::PatternCount() const {
   return patterns_->size();
 }
 
-ChannelStoreUpdater::ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx,
-                                         uint32_t thread_id)
-    : pattern_{pattern}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
+bool ChannelStore::IsShardSubscriber(string_view channel, ConnectionContext* cntx) const {
+  auto it = shard_channels_->find(channel);
+  return it != shard_channels_->end() && it->second->contains(cntx);
+}
+
+void ChannelStore::RemoveShardChannels(const cluster::SlotSet& slots) {
+  auto& cb = control_block;
+  cb.update_mu.lock();
+  auto* store = cb.most_recent.load(memory_order_relaxed);
+
+  // Split the shard channels into those that stay and those that are removed, whose subscribers
+  // are borrowed while the subscribe maps are still guaranteed to be valid.
+  struct Removed {
+    shared_ptr<char[]> buf;  // stores the channel name.
+    string_view channel;
+    vector<Subscriber> subscribers;
+  };
+
+  auto* shard_channels = new ChannelMap{};
+  vector<SubscribeMap*> removed;
+  vector<Removed> notify;
+  for (const auto& [channel, subs] : *store->shard_channels_) {
+    if (!slots.Contains(cluster::KeySlot(channel))) {
+      shard_channels->emplace(channel, subs);
+      continue;
+    }
+
+    removed.push_back(subs.Get());
+    Removed& entry = notify.emplace_back();
+    entry.buf.reset(new char[channel.size()]);
+    memcpy(entry.buf.get(), channel.data(), channel.size());
+    entry.channel = {entry.buf.get(), channel.size()};
+    Fill(*subs, string{}, &entry.subscribers);
+  }
+
+  if (removed.empty()) {
+    cb.update_mu.unlock();
+    delete shard_channels;
+    return;
+  }
+
+  auto* replacement =
+      new ChannelStore{store->channels_, store->patterns_, store->pattern_index_, shard_channels};
+  cb.most_recent.store(replacement, memory_order_relaxed);
+  cb.update_mu.unlock();
+
+  shard_set->pool()->AwaitBrief([](unsigned idx, util::ProactorBase*) {
+    ServerState::tlocal()->UpdateChannelStore(
+        ChannelStore::control_block.most_recent.load(memory_order_relaxed));
+  });
+
+  delete store->shard_channels_;
+  delete store;
+  for (auto* ptr : removed)
+    delete ptr;
+
+  // The connections drop the channels from their own state when they handle the message, so
+  // that it is serialized with their commands.
+  auto notify_ptr = make_shared<decltype(notify)>(std::move(notify));
+  shard_set->pool()->DispatchBrief([notify_ptr](unsigned idx, auto*) {
+    for (const Removed& entry : *notify_ptr) {
+      for (const auto& sub : entry.subscribers) {
+        if (auto* ptr = sub.Thread() == idx ? sub.Get() : nullptr; ptr && ptr->cntx() != nullptr) {
+          facade::Connection::PubMessage msg{{}, entry.buf, entry.channel, {}};
+          msg.force_unsubscribe = true;
+          ptr->SendPubMessageAsync(std::move(msg));
+        }
+      }
+    }
+  });
+}
+
+ChannelStoreUpdater::ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add,
+                                         ConnectionContext* cntx, uint32_t thread_id)
+    : kind_{kind}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
+}
+
+ChannelStore::ChannelMap*& ChannelStoreUpdater::TargetMap(ChannelStore* store) const {
+  switch (kind_) {
+    case ChannelStore::CHANNEL:
+      return store->channels_;
+    case ChannelStore::PATTERN:
+      return store->patterns_;
+    case ChannelStore::SHARD_CHANNEL:
+      return store->shard_channels_;
+  }
+  return store->channels_;
 }
 
 void ChannelStoreUpdater::Record(string_view key) {
@@ -206,11 +361,15 @@ void ChannelStoreUpdater::Record(string_view key) {
 }
 
 pair<ChannelStore::ChannelMap*, bool> ChannelStoreUpdater::GetTargetMap(ChannelStore* store) {
-  auto* target = pattern_ ? store->patterns_ : store->channels_;
+  auto* target = TargetMap(store);
 
   for (auto key : ops_) {
     auto it = target->find(key);
-    DCHECK(it != target->end() || to_add_);
+    // Shard channels can be removed from the store before their subscribers handle it.
+    DCHECK(it != target->end() || to_add_ || kind_ == ChannelStore::SHARD_CHANNEL);
+    if (!to_add_ && (it == target->end() || !it->second->contains(cntx_)))
+      continue;
+
     // We need to make a copy, if we are going to add or delete new map slot.
     if ((to_add_ && it == target->end()) || (!to_add_ && it->second->size() == 1))
       return {new ChannelStore::ChannelMap{*target}, true};
@@ -223,6 +382,8 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
   using SubscribeMap = ChannelStore::SubscribeMap;
 
   auto it = target->find(key);
+  if (!to_add_ && (it == target->end() || !it->second->contains(cntx_)))
+    return;
 
   // New key, add new slot.
   if (to_add_ && it == target->end()) {
@@ -266,9 +427,10 @@ void ChannelStoreUpdater::Apply() {
   // Prepare replacement.
   auto* replacement = store;
   if (copied) {
-    auto* new_chans = pattern_ ? store->channels_ : target;
-    auto* new_patterns = pattern_ ? target : store->patterns_;
-    replacement = new ChannelStore{new_chans, new_patterns};
+    replacement = new ChannelStore{*store};
+    TargetMap(replacement) = target;
+    if (kind_ == ChannelStore::PATTERN)
+      replacement->pattern_index_ = ChannelStore::BuildPatternIndex(*target);
   }
 
   // Update control block and unlock it.
@@ -287,7 +449,9 @@ void ChannelStoreUpdater::Apply() {
 
   // Delete previous map and channel store.
   if (copied) {
-    delete (pattern_ ? store->patterns_ : store->channels_);
+    delete TargetMap(store);
+    if (kind_ == ChannelStore::PATTERN)
+      delete store->pattern_index_;
     delete store;
   }
 
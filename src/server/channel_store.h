@@ -7,6 +7,7 @@
 
 #include <string_view>
 
+#include "core/glob_matcher.h"
 #include "facade/dragonfly_connection.h"
 #include "server/conn_context.h"
 
@@ -14,6 +15,10 @@ namespace dfly {
 
 class ChannelStoreUpdater;
 
+namespace cluster {
+class SlotSet;
+}
+
 // ChannelStore manages PUB/SUB subscriptions.
 //
 // Updates are carried out via RCU (read-copy-update). Each thread stores a pointer to ChannelStore
@@ -29,6 +34,13 @@ class ChannelStoreUpdater;
 // we can update only it with a simpler version of RCU, as SubscribeMap is stored as an atomic
 // pointer inside ChannelMap.
 //
+// Shard channels of SSUBSCRIBE are kept in a separate ChannelMap, as they form a namespace of
+// their own. In cluster mode they are hashed to slots like keys and are served only by the owner
+// of their slot, so their subscriptions are dropped once the slot is migrated away.
+//
+// Patterns are also compiled into a GlobIndex, which is rebuilt together with their ChannelMap
+// and used to find the patterns that match a published channel without checking each of them.
+//
 // To prevent parallel (and thus overlapping) updates, a centralized ControlBlock is used.
 // Update operations are carried out by the ChannelStoreUpdater.
 //
@@ -52,17 +64,29 @@ class ChannelStore {
     std::string pattern;  // non-empty if registered via psubscribe
   };
 
+  // Type of subscription, each stored in its own ChannelMap.
+  enum Kind : uint8_t { CHANNEL, PATTERN, SHARD_CHANNEL };
+
   ChannelStore();
 
   // Send messages to channel, block on connection backpressure
-  unsigned SendMessages(std::string_view channel, facade::ArgRange messages) const;
+  unsigned SendMessages(std::string_view channel, facade::ArgRange messages,
+                        bool sharded = false) const;
 
-  // Fetch all subscribers for channel, including matching patterns.
-  std::vector<Subscriber> FetchSubscribers(std::string_view channel) const;
+  // Fetch all subscribers for channel, including matching patterns. Shard channels have no
+  // pattern subscribers.
+  std::vector<Subscriber> FetchSubscribers(std::string_view channel, bool sharded = false) const;
 
-  std::vector<std::string> ListChannels(const std::string_view pattern) const;
+  std::vector<std::string> ListChannels(const std::string_view pattern, bool sharded = false) const;
   size_t PatternCount() const;
 
+  // Whether cntx is subscribed to the shard channel.
+  bool IsShardSubscriber(std::string_view channel, ConnectionContext* cntx) const;
+
+  // Removes all subscriptions to shard channels that belong to slots. Their subscribers are
+  // notified asynchronously with a sunsubscribe message.
+  static void RemoveShardChannels(const cluster::SlotSet& slots);
+
   // Destroy current instance and delete it.
   static void Destroy();
 
@@ -109,13 +133,18 @@ class ChannelStore {
  private:
   static ControlBlock control_block;
 
-  ChannelStore(ChannelMap* channels, ChannelMap* patterns);
+  ChannelStore(ChannelMap* channels, ChannelMap* patterns, GlobIndex* pattern_index,
+               ChannelMap* shard_channels);
+
+  static GlobIndex* BuildPatternIndex(const ChannelMap& patterns);
 
   static void Fill(const SubscribeMap& src, const std::string& pattern,
                    std::vector<Subscriber>* out);
 
   ChannelMap* channels_;
   ChannelMap* patterns_;
+  GlobIndex* pattern_index_;  // compiled keys of patterns_.
+  ChannelMap* shard_channels_;
 };
 
 // Performs RCU (read-copy-update) updates to the channel store.
@@ -123,7 +152,8 @@ class ChannelStore {
 // Queues operations and performs them with Apply().
 class ChannelStoreUpdater {
  public:
-  ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx, uint32_t thread_id);
+  ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add, ConnectionContext* cntx,
+                      uint32_t thread_id);
 
   void Record(std::string_view key);
   void Apply();
@@ -131,6 +161,9 @@ class ChannelStoreUpdater {
  private:
   using ChannelMap = ChannelStore::ChannelMap;
 
+  // The map of store that holds subscriptions of kind_.
+  ChannelMap*& TargetMap(ChannelStore* store) const;
+
   // Get target map and flag whether it was copied.
   // Must be called with locked control block.
   std::pair<ChannelMap*, bool> GetTargetMap(ChannelStore* store);
@@ -139,7 +172,7 @@ class ChannelStoreUpdater {
   void Modify(ChannelMap* target, std::string_view key);
 
  private:
-  bool pattern_;
+  ChannelStore::Kind kind_;
   bool to_add_;
   ConnectionContext* cntx_;
   uint32_t thread_id_;
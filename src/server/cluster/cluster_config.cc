@@ -112,6 +112,15 @@ shared_ptr<ClusterConfig> ClusterConfig::CreateFromConfig(string_view my_id,
     }
   }
 
+  auto slot_shards = make_shared<SlotShards>();
+  for (size_t i = 0; i < result->config_.size(); ++i) {
+    for (const auto& slot_range : result->config_[i].slot_ranges) {
+      for (SlotId slot = slot_range.start; slot <= slot_range.end; ++slot)
+        (*slot_shards)[slot] = i;
+    }
+  }
+  result->slot_shards_ = std::move(slot_shards);
+
   return result;
 }
 
@@ -323,23 +332,17 @@ bool ClusterConfig::IsMySlot(std::string_view key) const {
 ClusterNodeInfo ClusterConfig::GetMasterNodeForSlot(SlotId id) const {
   CHECK_LE(id, cluster::kMaxSlotNum) << "Requesting a non-existing slot id " << id;
 
-  for (const auto& shard : config_) {
-    if (shard.slot_ranges.Contains(id)) {
-      if (shard.master.id == my_id_) {
-        // The only reason why this function call and shard.master == my_id_ is the slot was
-        // migrated
-        for (const auto& m : shard.migrations) {
-          if (m.slot_ranges.Contains(id)) {
-            return m.node_info;
-          }
-        }
+  const ClusterShardInfo& shard = config_[(*slot_shards_)[id]];
+  if (shard.master.id == my_id_) {
+    // The only reason why this function call and shard.master == my_id_ is the slot was
+    // migrated
+    for (const auto& m : shard.migrations) {
+      if (m.slot_ranges.Contains(id)) {
+        return m.node_info;
       }
-      return shard.master;
     }
   }
-
-  DCHECK(false) << "Can't find master node for slot " << id;
-  return {};
+  return shard.master;
 }
 
 ClusterShardInfos ClusterConfig::GetConfig() const {
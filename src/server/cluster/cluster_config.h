@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string_view>
 #include <vector>
@@ -32,7 +33,7 @@ class ClusterConfig {
   bool IsMySlot(SlotId id) const;
   bool IsMySlot(std::string_view key) const;
 
-  // Returns the master configured for `id`.
+  // Returns the master configured for `id`, or the target of its outgoing migration.
   ClusterNodeInfo GetMasterNodeForSlot(SlotId id) const;
 
   ClusterShardInfos GetConfig() const;
@@ -53,16 +54,17 @@ class ClusterConfig {
   }
 
  private:
-  struct SlotEntry {
-    const ClusterShardInfo* shard = nullptr;
-    bool owned_by_me = false;
-  };
+  // Index in config_ of the shard of every slot.
+  using SlotShards = std::array<uint16_t, SlotSet::kSlotsNumber>;
 
   ClusterConfig() = default;
 
   std::string my_id_;
   ClusterShardInfos config_;
 
+  // Built once per config, the clones share it since they keep config_ as is.
+  std::shared_ptr<const SlotShards> slot_shards_;
+
   SlotSet my_slots_;
   std::vector<MigrationInfo> my_outgoing_migrations_;
   std::vector<MigrationInfo> my_incoming_migrations_;
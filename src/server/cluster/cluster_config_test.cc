@@ -540,6 +540,44 @@ TEST_F(ClusterConfigTest, ConfigSetMigrations) {
   EXPECT_TRUE(config5->GetNewOutgoingMigrations(config2).empty());
 }
 
+TEST_F(ClusterConfigTest, MasterNodeForSlot) {
+  // Interleaved ranges of two shards, with a migration of some of my slots.
+  auto config = ClusterConfig::CreateFromConfig(kMyId, R"json(
+  [
+    {
+      "slot_ranges": [ { "start": 0, "end": 99 }, { "start": 200, "end": 16383 } ],
+      "master": { "id": "other", "ip": "localhost", "port": 3000 },
+      "replicas": []
+    },
+    {
+      "slot_ranges": [ { "start": 100, "end": 199 } ],
+      "master": { "id": "my-id", "ip": "localhost", "port": 3001 },
+      "replicas": [],
+      "migrations": [{ "slot_ranges": [ { "start": 150, "end": 199 } ]
+                     , "ip": "127.0.0.1", "port" : 9001, "node_id": "other" }]
+    }
+  ])json");
+  ASSERT_NE(config, nullptr);
+
+  Node other{.id = "other", .ip = "localhost", .port = 3000};
+  Node me{.id = kMyId, .ip = "localhost", .port = 3001};
+  Node target{.id = "other", .ip = "127.0.0.1", .port = 9001};
+  EXPECT_THAT(config->GetMasterNodeForSlot(0), NodeMatches(other));
+  EXPECT_THAT(config->GetMasterNodeForSlot(99), NodeMatches(other));
+  EXPECT_THAT(config->GetMasterNodeForSlot(100), NodeMatches(me));
+  EXPECT_THAT(config->GetMasterNodeForSlot(149), NodeMatches(me));
+  EXPECT_THAT(config->GetMasterNodeForSlot(150), NodeMatches(target));
+  EXPECT_THAT(config->GetMasterNodeForSlot(200), NodeMatches(other));
+  EXPECT_THAT(config->GetMasterNodeForSlot(16383), NodeMatches(other));
+
+  // Clones change the owned slots, but not the configured masters.
+  auto clone = config->CloneWithChanges({}, SlotRanges({{150, 199}}));
+  EXPECT_FALSE(clone->IsMySlot(150));
+  EXPECT_TRUE(clone->IsMySlot(149));
+  EXPECT_THAT(clone->GetMasterNodeForSlot(150), NodeMatches(target));
+  EXPECT_THAT(clone->GetMasterNodeForSlot(300), NodeMatches(other));
+}
+
 TEST_F(ClusterConfigTest, InvalidConfigMigrationsWithoutIP) {
   auto config = ClusterConfig::CreateFromConfig("id0", R"json(
   [
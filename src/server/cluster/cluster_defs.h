@@ -147,6 +147,10 @@ class ClusterShardInfos {
     return infos_.empty();
   }
 
+  const ClusterShardInfo& operator[](size_t i) const noexcept {
+    return infos_[i];
+  }
+
   bool operator==(const ClusterShardInfos& r) const noexcept {
     return infos_ == r.infos_;
   }
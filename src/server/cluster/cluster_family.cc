@@ -4,8 +4,11 @@
 
 #include "server/cluster/cluster_family.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <string>
 
 #include "absl/cleanup/cleanup.h"
@@ -15,6 +18,8 @@
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/channel_store.h"
+#include "server/cluster/cluster_utility.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/dflycmd.h"
@@ -406,10 +411,13 @@ void ClusterFamily::Cluster(CmdArgList args, ConnectionContext* cntx) {
   } else if (sub_cmd == "MYID") {
     return ClusterMyId(cntx);
   } else if (sub_cmd == "SHARDS") {
+    cntx->conn_state.moved_hint_pending = true;
     return ClusterShards(cntx);
   } else if (sub_cmd == "SLOTS") {
+    cntx->conn_state.moved_hint_pending = true;
     return ClusterSlots(cntx);
   } else if (sub_cmd == "NODES") {
+    cntx->conn_state.moved_hint_pending = true;
     return ClusterNodes(cntx);
   } else if (sub_cmd == "INFO") {
     return ClusterInfo(cntx);
@@ -453,6 +461,10 @@ void ClusterFamily::DflyCluster(CmdArgList args, ConnectionContext* cntx) {
     return DflyClusterFlushSlots(args, cntx);
   } else if (sub_cmd == "SLOT-MIGRATION-STATUS") {
     return DflySlotMigrationStatus(args, cntx);
+  } else if (sub_cmd == "SLOT-MIGRATION-PROGRESS") {
+    return DflySlotMigrationProgress(args, cntx);
+  } else if (sub_cmd == "SLOT-HEATMAP") {
+    return DflySlotHeatmap(args, cntx);
   }
 
   return cntx->SendError(UnknownSubCmd(sub_cmd, "DFLYCLUSTER"), kSyntaxErrType);
@@ -477,6 +489,9 @@ void DeleteSlots(const SlotRanges& slots_ranges) {
     namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id()).FlushSlots(slots_ranges);
   };
   shard_set->pool()->AwaitFiberOnAll(std::move(cb));
+
+  // Shard channels are served by the owner of their slot as well.
+  ChannelStore::RemoveShardChannels(SlotSet(slots_ranges));
 }
 
 void WriteFlushSlotsToJournal(const SlotRanges& slot_ranges) {
@@ -566,33 +581,40 @@ void ClusterFamily::DflyClusterConfig(CmdArgList args, ConnectionContext* cntx)
     StartSlotMigrations(new_config->GetNewOutgoingMigrations(tl_cluster_config));
 
     SlotSet before = tl_cluster_config ? tl_cluster_config->GetOwnedSlots() : SlotSet(true);
-
-    // Ignore blocked commands because we filter them with CancelBlockingOnThread
-    DispatchTracker tracker{server_family_->GetNonPriviligedListeners(), cntx->conn(),
-                            true /* ignore paused */, true /* ignore blocked */};
-
-    auto blocking_filter = [&new_config](ArgSlice keys) {
-      bool moved =
-          any_of(keys.begin(), keys.end(), [&](auto k) { return !new_config->IsMySlot(k); });
-      return moved ? OpStatus::KEY_MOVED : OpStatus::OK;
-    };
-
-    auto cb = [this, &tracker, &new_config, blocking_filter](util::ProactorBase*) {
-      server_family_->CancelBlockingOnThread(blocking_filter);
-      tl_cluster_config = new_config;
-      tracker.TrackOnThread();
-    };
-
-    server_family_->service().proactor_pool().AwaitFiberOnAll(std::move(cb));
-    DCHECK(tl_cluster_config != nullptr);
-
-    if (!tracker.Wait(absl::Seconds(1))) {
-      LOG(WARNING) << "Cluster config change timed for: " << MyID();
+    SlotSet removed = before.GetRemovedSlots(new_config->GetOwnedSlots());
+
+    if (removed.Empty() && outgoing_migrations.slot_ranges.Empty()) {
+      // No slot leaves this node, so the running and blocked commands stay valid and only the
+      // config pointer is swapped on every thread.
+      server_family_->service().proactor_pool().AwaitBrief(
+          [&new_config](unsigned, util::ProactorBase*) { tl_cluster_config = new_config; });
+    } else {
+      // Ignore blocked commands because we filter them with CancelBlockingOnThread
+      DispatchTracker tracker{server_family_->GetNonPriviligedListeners(), cntx->conn(),
+                              true /* ignore paused */, true /* ignore blocked */};
+
+      auto blocking_filter = [&new_config](ArgSlice keys) {
+        bool moved =
+            any_of(keys.begin(), keys.end(), [&](auto k) { return !new_config->IsMySlot(k); });
+        return moved ? OpStatus::KEY_MOVED : OpStatus::OK;
+      };
+
+      auto cb = [this, &tracker, &new_config, blocking_filter](util::ProactorBase*) {
+        server_family_->CancelBlockingOnThread(blocking_filter);
+        tl_cluster_config = new_config;
+        tracker.TrackOnThread();
+      };
+
+      server_family_->service().proactor_pool().AwaitFiberOnAll(std::move(cb));
+      DCHECK(tl_cluster_config != nullptr);
+
+      if (!tracker.Wait(absl::Seconds(1))) {
+        LOG(WARNING) << "Cluster config change timed for: " << MyID();
+      }
     }
 
-    SlotSet after = tl_cluster_config->GetOwnedSlots();
     if (ServerState::tlocal()->is_master) {
-      auto deleted_slots = (before.GetRemovedSlots(after)).ToSlotRanges();
+      auto deleted_slots = removed.ToSlotRanges();
       deleted_slots.Merge(outgoing_migrations.slot_ranges);
       DeleteSlots(deleted_slots);
       LOG_IF(INFO, !deleted_slots.Empty())
@@ -651,6 +673,92 @@ void ClusterFamily::DflyClusterGetSlotInfo(CmdArgList args, ConnectionContext* c
   }
 }
 
+// DFLYCLUSTER SLOT-HEATMAP [TOP count] [LOAD node_id ops_per_sec]...
+// Replies with the rolling ops/sec of this node, its busiest slots and a plan of migrations that
+// evens out the load with the other masters, whose loads are passed with LOAD.
+void ClusterFamily::DflySlotHeatmap(CmdArgList args, ConnectionContext* cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  CmdArgParser parser(args);
+
+  uint32_t top = 10;
+  absl::flat_hash_map<string, double> peer_loads;
+  while (parser.HasNext()) {
+    string_view node_id;
+    double load = 0;
+    if (parser.Check("TOP", &top))
+      continue;
+    if (parser.Check("LOAD", &node_id, &load)) {
+      peer_loads[string(node_id)] = load;
+      continue;
+    }
+    return cntx->SendError(kSyntaxErr);
+  }
+
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  if (tl_cluster_config == nullptr)
+    return cntx->SendError(kClusterNotConfigured);
+
+  vector<double> slot_ops(kMaxSlotNum + 1);
+  vector<SlotStats> slot_stats(kMaxSlotNum + 1);
+  fb2::Mutex mu;
+
+  shard_set->pool()->AwaitFiberOnAll([&](auto*) ABSL_LOCKS_EXCLUDED(mu) {
+    EngineShard* shard = EngineShard::tlocal();
+    if (shard == nullptr)
+      return;
+
+    const DbSlice& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    util::fb2::LockGuard lk(mu);
+    for (SlotId sid = 0; sid <= kMaxSlotNum; ++sid) {
+      slot_ops[sid] += db_slice.GetSlotOpsRate(sid);
+      slot_stats[sid] += db_slice.GetSlotStats(sid);
+    }
+  });
+
+  vector<SlotId> hot_slots;
+  for (SlotId sid = 0; sid <= kMaxSlotNum; ++sid) {
+    if (slot_ops[sid] >= 0.5)
+      hot_slots.push_back(sid);
+  }
+  auto by_ops = [&](SlotId l, SlotId r) { return slot_ops[l] > slot_ops[r]; };
+  size_t top_count = min<size_t>(top, hot_slots.size());
+  partial_sort(hot_slots.begin(), hot_slots.begin() + top_count, hot_slots.end(), by_ops);
+  hot_slots.resize(top_count);
+
+  auto plan = PlanSlotRebalance(id_, tl_cluster_config->GetConfig(), slot_ops, peer_loads);
+
+  rb->StartArray(6);
+  rb->SendBulkString("ops_per_sec");
+  rb->SendLong(llround(accumulate(slot_ops.begin(), slot_ops.end(), 0.0)));
+
+  rb->SendBulkString("top_slots");
+  rb->StartArray(hot_slots.size());
+  for (SlotId sid : hot_slots) {
+    rb->StartArray(4);
+    rb->SendLong(sid);
+    rb->SendLong(llround(slot_ops[sid]));
+    rb->SendLong(slot_stats[sid].key_count);
+    rb->SendLong(slot_stats[sid].memory_bytes);
+  }
+
+  rb->SendBulkString("plan");
+  rb->StartArray(plan.size());
+  for (const MigrationInfo& migration : plan) {
+    rb->StartArray(4);
+    rb->SendBulkString(migration.node_info.id);
+    rb->SendBulkString(migration.node_info.ip);
+    rb->SendLong(migration.node_info.port);
+    rb->StartArray(migration.slot_ranges.Size());
+    for (const SlotRange& range : migration.slot_ranges) {
+      rb->StartArray(2);
+      rb->SendLong(range.start);
+      rb->SendLong(range.end);
+    }
+  }
+}
+
 void ClusterFamily::DflyClusterFlushSlots(CmdArgList args, ConnectionContext* cntx) {
   std::vector<SlotRange> slot_ranges;
 
@@ -745,6 +853,60 @@ void ClusterFamily::DflySlotMigrationStatus(CmdArgList args, ConnectionContext*
   }
 }
 
+// Replies with the transfer progress of outgoing migrations as flat key-value arrays.
+// keys_per_sec and eta_sec are derived from the keys sent since the current sync attempt started,
+// eta_sec is -1 while no keys were sent.
+void ClusterFamily::DflySlotMigrationProgress(CmdArgList args, ConnectionContext* cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  CmdArgParser parser(args);
+
+  string_view node_id;
+  if (parser.HasNext()) {
+    node_id = parser.Next<std::string_view>();
+    if (auto err = parser.Error(); err) {
+      return cntx->SendError(err->MakeReply());
+    }
+  }
+
+  vector<shared_ptr<OutgoingMigration>> migrations;
+  {
+    util::fb2::LockGuard lk(migration_mu_);
+    for (const auto& m : outgoing_migration_jobs_) {
+      if (node_id.empty() || node_id == m->GetMigrationInfo().node_info.id)
+        migrations.push_back(m);
+    }
+  }
+
+  rb->StartArray(migrations.size());
+  for (const auto& m : migrations) {
+    MigrationState state = m->GetState();
+    OutgoingMigration::Progress progress = m->GetProgress();
+
+    size_t keys_per_sec = progress.keys_sent * 1000 / max<uint64_t>(progress.elapsed_ms, 1);
+    int64_t eta_sec = -1;
+    if (state == MigrationState::C_FINISHED || progress.keys_sent >= progress.total_keys)
+      eta_sec = 0;
+    else if (keys_per_sec > 0)
+      eta_sec = (progress.total_keys - progress.keys_sent + keys_per_sec - 1) / keys_per_sec;
+
+    rb->StartArray(14);
+    rb->SendBulkString("node_id");
+    rb->SendBulkString(m->GetMigrationInfo().node_info.id);
+    rb->SendBulkString("state");
+    rb->SendBulkString(StateToStr(state));
+    rb->SendBulkString("bytes_sent");
+    rb->SendLong(progress.bytes_sent);
+    rb->SendBulkString("keys_sent");
+    rb->SendLong(progress.keys_sent);
+    rb->SendBulkString("total_keys");
+    rb->SendLong(progress.total_keys);
+    rb->SendBulkString("keys_per_sec");
+    rb->SendLong(keys_per_sec);
+    rb->SendBulkString("eta_sec");
+    rb->SendLong(eta_sec);
+  }
+}
+
 void ClusterFamily::DflyMigrate(CmdArgList args, ConnectionContext* cntx) {
   string sub_cmd = absl::AsciiStrToUpper(ArgS(args, 0));
 
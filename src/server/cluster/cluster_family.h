@@ -66,6 +66,9 @@ class ClusterFamily {
  private:  // Slots migration section
   void DflySlotMigrationStatus(CmdArgList args, ConnectionContext* cntx)
       ABSL_LOCKS_EXCLUDED(migration_mu_);
+  void DflySlotMigrationProgress(CmdArgList args, ConnectionContext* cntx)
+      ABSL_LOCKS_EXCLUDED(migration_mu_);
+  void DflySlotHeatmap(CmdArgList args, ConnectionContext* cntx);
 
   // DFLYMIGRATE is internal command defines several steps in slots migrations process
   void DflyMigrate(CmdArgList args, ConnectionContext* cntx);
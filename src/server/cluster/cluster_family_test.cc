@@ -705,6 +705,90 @@ TEST_F(ClusterFamilyTest, ClusterCrossSlot) {
   EXPECT_THAT(Run({"MGET", "key{tag}", "key2{tag}"}), RespArray(ElementsAre("value", "value2")));
 }
 
+TEST_F(ClusterFamilyTest, SlotHeatmap) {
+  string config = absl::Substitute(R"json(
+      [
+        {
+          "slot_ranges": [ { "start": 0, "end": 10000 } ],
+          "master": { "id": "$0", "ip": "10.0.0.1", "port": 7000 },
+          "replicas": []
+        },
+        {
+          "slot_ranges": [ { "start": 10001, "end": 16383 } ],
+          "master": { "id": "other", "ip": "10.0.0.2", "port": 7001 },
+          "replicas": []
+        }
+      ])json",
+                                   GetMyId());
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", config}), "OK");
+
+  const SlotId slot1 = KeySlot("key1"), slot2 = KeySlot("key2");
+  ASSERT_LE(max(slot1, slot2), 10000);
+  EXPECT_EQ(Run({"set", "key1", "a"}), "OK");
+  EXPECT_EQ(Run({"set", "key2", "b"}), "OK");
+
+  // Rates are updated by the heartbeat once a second, so keep the slots busy until then
+  RespExpr resp;
+  ExpectConditionWithinTimeout([&] {
+    for (unsigned i = 0; i < 100; ++i) {
+      Run({"get", "key1"});
+      Run({"get", "key1"});
+      Run({"get", "key2"});
+    }
+    resp = RunPrivileged({"dflycluster", "slot-heatmap", "top", "1"});
+    return resp.GetVec()[1].GetInt() > 0;
+  });
+
+  auto top_slots = resp.GetVec()[3].GetVec();
+  ASSERT_EQ(top_slots.size(), 1u);
+  EXPECT_THAT(top_slots[0].GetVec()[0], IntArg(slot1));
+  EXPECT_THAT(top_slots[0].GetVec()[2], IntArg(1));  // key_count
+
+  // Moving the hottest slot to an idle peer brings this node below the average
+  EXPECT_THAT(resp.GetVec()[5], RespArray(ElementsAre(RespArray(ElementsAre(
+                                    "other", "10.0.0.2", IntArg(7001),
+                                    RespArray(ElementsAre(RespArray(
+                                        ElementsAre(IntArg(slot1), IntArg(slot1))))))))));
+
+  // A busier peer receives nothing
+  resp = RunPrivileged({"dflycluster", "slot-heatmap", "load", "other", "1000000000"});
+  EXPECT_THAT(resp.GetVec()[5], ArrLen(0));
+
+  EXPECT_THAT(RunPrivileged({"dflycluster", "slot-heatmap", "load", "other"}),
+              ErrArg("syntax error"));
+}
+
+class ClusterFamilySlotKeyIndexTest : public ClusterFamilyTest {
+ public:
+  ClusterFamilySlotKeyIndexTest() {
+    SetTestFlag("cluster_slot_key_index", "true");
+  }
+};
+
+TEST_F(ClusterFamilySlotKeyIndexTest, FlushSlots) {
+  ConfigSingleNodeCluster(GetMyId());
+  EXPECT_EQ(Run({"debug", "populate", "100", "key", "4", "slots", "0", "1"}), "OK");
+  EXPECT_EQ(Run({"set", "other", "x"}), "OK");
+  ASSERT_NE(CheckedInt({"cluster", "keyslot", "other"}), 0);
+  auto slot_info = RunPrivileged({"dflycluster", "getslotinfo", "slots", "1"});
+  auto slot_1_keys = slot_info.GetVec()[2].GetInt();
+  ASSERT_TRUE(slot_1_keys.has_value());
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "0", "0"}), "OK");
+  ExpectConditionWithinTimeout([&]() {
+    auto resp = RunPrivileged({"dflycluster", "getslotinfo", "slots", "0"});
+    return resp.GetVec()[2].GetInt() == 0;
+  });
+
+  // Keys of the other slots are kept, keys added after the flush are indexed as well
+  EXPECT_EQ(CheckedInt({"dbsize"}), *slot_1_keys + 1);
+  EXPECT_EQ(Run({"get", "other"}), "x");
+  EXPECT_EQ(Run({"set", "key:0", "y"}), "OK");
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "0", "16383"}), "OK");
+  ExpectConditionWithinTimeout([&]() { return CheckedInt({"dbsize"}) == 0; });
+}
+
 class ClusterFamilyEmulatedTest : public ClusterFamilyTest {
  public:
   ClusterFamilyEmulatedTest() {
@@ -1,6 +1,10 @@
 #include "server/cluster/cluster_utility.h"
 
+#include <algorithm>
+#include <numeric>
+
 #include "server/cluster/cluster_defs.h"
+#include "server/cluster/slot_set.h"
 #include "server/engine_shard_set.h"
 #include "server/namespaces.h"
 
@@ -62,4 +66,60 @@ uint64_t GetKeyCount(const SlotRanges& slots) {
   return keys.load();
 }
 
+vector<MigrationInfo> PlanSlotRebalance(string_view my_id, const ClusterShardInfos& config,
+                                        const vector<double>& slot_ops,
+                                        const absl::flat_hash_map<string, double>& peer_loads) {
+  struct Peer {
+    const ClusterNodeInfo* node;
+    double load;
+    SlotSet slots;
+  };
+
+  double my_load = accumulate(slot_ops.begin(), slot_ops.end(), 0.0);
+  double total_load = my_load;
+  vector<Peer> peers;
+  for (const ClusterShardInfo& shard : config) {
+    if (shard.master.id == my_id)
+      continue;
+    auto it = peer_loads.find(shard.master.id);
+    double load = it == peer_loads.end() ? 0 : it->second;
+    peers.push_back(Peer{&shard.master, load, SlotSet{}});
+    total_load += load;
+  }
+
+  vector<MigrationInfo> plan;
+  if (peers.empty())
+    return plan;
+  double avg_load = total_load / (peers.size() + 1);
+
+  vector<SlotId> hot_slots;
+  for (SlotId sid = 0; sid < slot_ops.size(); ++sid) {
+    if (slot_ops[sid] > 0)
+      hot_slots.push_back(sid);
+  }
+  sort(hot_slots.begin(), hot_slots.end(),
+       [&](SlotId l, SlotId r) { return slot_ops[l] > slot_ops[r]; });
+
+  for (SlotId sid : hot_slots) {
+    if (my_load <= avg_load)
+      break;
+
+    // Moving a slot that makes the receiver busier than us only moves the hot spot
+    auto peer = min_element(peers.begin(), peers.end(),
+                            [](const Peer& l, const Peer& r) { return l.load < r.load; });
+    if (peer->load + slot_ops[sid] >= my_load)
+      continue;
+
+    peer->load += slot_ops[sid];
+    peer->slots.Set(sid, true);
+    my_load -= slot_ops[sid];
+  }
+
+  for (const Peer& peer : peers) {
+    if (!peer.slots.Empty())
+      plan.push_back(MigrationInfo{peer.slots.ToSlotRanges(), *peer.node});
+  }
+  return plan;
+}
+
 }  // namespace dfly::cluster
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
+
 #include <optional>
 #include <string_view>
+#include <vector>
 
 #include "server/cluster/cluster_defs.h"
 
@@ -26,4 +29,12 @@ class UniqueSlotChecker {
 
 uint64_t GetKeyCount(const SlotRanges& slots);
 
+// Greedy plan that moves the busiest slots of my_id to the other masters of config, until the
+// load of my_id is not above the average load of the masters. slot_ops holds the ops/sec of all
+// slots of my_id, peer_loads the ops/sec of the other masters, missing masters count as idle.
+// A slot is moved only if the receiving master stays below the load of my_id.
+std::vector<MigrationInfo> PlanSlotRebalance(
+    std::string_view my_id, const ClusterShardInfos& config, const std::vector<double>& slot_ops,
+    const absl::flat_hash_map<std::string, double>& peer_loads);
+
 }  // namespace dfly::cluster
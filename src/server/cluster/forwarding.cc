@@ -0,0 +1,143 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cluster/forwarding.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "facade/reply_builder.h"
+#include "server/conn_context.h"
+#include "server/error.h"
+#include "server/protocol_client.h"
+
+ABSL_FLAG(bool, cluster_forward_moved, false,
+          "If true, commands for slots owned by other nodes are executed on the owner and its "
+          "reply is relayed, instead of replying with a MOVED redirection");
+
+namespace dfly::cluster {
+
+using namespace std;
+using namespace facade;
+
+namespace {
+
+constexpr size_t kMaxIdleConnections = 16;
+constexpr auto kConnectTimeout = 2000ms;
+
+// Connection to another node of the cluster, negotiated to the protocol version of the clients
+// it serves.
+class ForwardingClient : public ProtocolClient {
+ public:
+  ForwardingClient(string host, uint16_t port, bool resp3)
+      : ProtocolClient(std::move(host), port), resp3_(resp3) {
+  }
+
+  error_code Connect() {
+    RETURN_ON_ERR(ResolveHostDns());
+    RETURN_ON_ERR(ConnectAndAuth(kConnectTimeout, &cntx_));
+    if (resp3_) {
+      RETURN_ON_ERR(SendCommandAndReadResponse("HELLO 3"));
+      PC_RETURN_ON_BAD_RESPONSE(!CheckRespFirstTypes({RespExpr::ERROR}));
+    }
+    return {};
+  }
+
+  error_code Send(string_view command) {
+    return Sock()->Write(io::Buffer(command));
+  }
+
+  // Reads a single reply, which is kept serialized in last_resp_
+  io::Result<string_view> Read() {
+    if (auto res = ReadRespReply(); !res)
+      return nonstd::make_unexpected(res.error());
+    return last_resp_;
+  }
+
+ private:
+  bool resp3_;
+};
+
+using ClientPtr = unique_ptr<ForwardingClient>;
+
+// Idle connections of this thread by target address and protocol version
+thread_local absl::flat_hash_map<string, vector<ClientPtr>> tl_idle_clients;
+
+bool ParseMovedError(string_view error, string* host, uint16_t* port) {
+  vector<string_view> parts = absl::StrSplit(error, ' ');
+  if (parts.size() != 3 || parts[0] != "-MOVED")
+    return false;
+
+  size_t pos = parts[2].rfind(':');
+  if (pos == string_view::npos)
+    return false;
+
+  uint32_t port_val;
+  if (!absl::SimpleAtoi(parts[2].substr(pos + 1), &port_val) || port_val > UINT16_MAX)
+    return false;
+
+  *host = parts[2].substr(0, pos);
+  *port = port_val;
+  return true;
+}
+
+string SerializeArgs(CmdArgList args) {
+  string res = absl::StrCat("*", args.size(), "\r\n");
+  for (auto arg : args)
+    absl::StrAppend(&res, "$", arg.size(), "\r\n", facade::ToSV(arg), "\r\n");
+  return res;
+}
+
+}  // namespace
+
+bool IsForwardingEnabled() {
+  return absl::GetFlag(FLAGS_cluster_forward_moved);
+}
+
+bool ForwardMovedCommand(string_view moved_error, CmdArgList args, ConnectionContext* cntx) {
+  string host;
+  uint16_t port;
+  if (!ParseMovedError(moved_error, &host, &port))
+    return false;
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  bool resp3 = rb->IsResp3();
+  string pool_key = absl::StrCat(host, ":", port, resp3 ? ":3" : ":2");
+
+  ClientPtr client;
+  if (auto& idle = tl_idle_clients[pool_key]; !idle.empty()) {
+    client = std::move(idle.back());
+    idle.pop_back();
+  } else {
+    client = make_unique<ForwardingClient>(host, port, resp3);
+    if (auto ec = client->Connect(); ec) {
+      VLOG(1) << "Could not connect to " << host << ":" << port << " for forwarding: " << ec;
+      return false;
+    }
+  }
+
+  if (auto ec = client->Send(SerializeArgs(args)); ec) {
+    VLOG(1) << "Could not forward command to " << host << ":" << port << ": " << ec;
+    return false;
+  }
+
+  // The command was sent and might have been executed, so it must not be retried by the client
+  auto reply = client->Read();
+  if (!reply) {
+    rb->SendError(absl::StrCat("Forwarding to ", host, ":", port, " failed"));
+    return true;
+  }
+
+  rb->SendRawReply(*reply);
+
+  if (auto& idle = tl_idle_clients[pool_key]; idle.size() < kMaxIdleConnections)
+    idle.push_back(std::move(client));
+  return true;
+}
+
+}  // namespace dfly::cluster
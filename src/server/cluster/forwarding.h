@@ -0,0 +1,26 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string_view>
+
+#include "facade/facade_types.h"
+
+namespace dfly {
+class ConnectionContext;
+}  // namespace dfly
+
+namespace dfly::cluster {
+
+// Whether commands for slots of other nodes are forwarded instead of rejected with MOVED
+bool IsForwardingEnabled();
+
+// Tries to execute a command that was rejected with moved_error ("-MOVED <slot> <ip>:<port>") on
+// the owner of its slot and relays the reply to the client. Connections to other nodes are pooled
+// per thread. Returns false if nothing was sent, in which case the caller replies with the error.
+bool ForwardMovedCommand(std::string_view moved_error, facade::CmdArgList args,
+                         ConnectionContext* cntx);
+
+}  // namespace dfly::cluster
@@ -21,6 +21,10 @@
 #include "util/fibers/synchronization.h"
 
 ABSL_FLAG(int, slot_migration_connection_timeout_ms, 2000, "Timeout for network operations");
+ABSL_FLAG(uint64_t, slot_migration_max_bandwidth, 0,
+          "Bytes per second of the initial data transfer of each outgoing slot migration, split "
+          "evenly between the shards. 0 means no limit. Applied when a migration (re)starts "
+          "syncing.");
 
 using namespace std;
 using namespace facade;
@@ -28,6 +32,15 @@ using namespace util;
 
 namespace dfly::cluster {
 
+namespace {
+
+uint64_t NowMs() {
+  using namespace chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
 class OutgoingMigration::SliceSlotMigration : private ProtocolClient {
  public:
   SliceSlotMigration(DbSlice* slice, ServerContext server_context, SlotSet slots,
@@ -75,6 +88,7 @@ class OutgoingMigration::SliceSlotMigration : private ProtocolClient {
 
   // Run restore streamer
   void RunSync() {
+    streamer_.SetRateLimit(absl::GetFlag(FLAGS_slot_migration_max_bandwidth) / shard_set->size());
     streamer_.Run();
   }
 
@@ -90,6 +104,10 @@ class OutgoingMigration::SliceSlotMigration : private ProtocolClient {
     return cntx_.GetError();
   }
 
+  const RestoreStreamer& GetStreamer() const {
+    return streamer_;
+  }
+
  private:
   RestoreStreamer streamer_;
 };
@@ -225,6 +243,8 @@ void OutgoingMigration::SyncFb() {
     if (!ChangeState(MigrationState::C_SYNC)) {
       break;
     }
+    sync_total_keys_ = cluster::GetKeyCount(migration_info_.slot_ranges);
+    sync_start_ms_ = NowMs();
 
     OnAllShards([this](auto& migration) { migration->PrepareFlow(cf_->MyID()); });
     if (CheckFlowsForErrors()) {
@@ -362,6 +382,26 @@ bool OutgoingMigration::CheckFlowsForErrors() {
   return false;
 }
 
+OutgoingMigration::Progress OutgoingMigration::GetProgress() {
+  Progress res;
+  if (sync_start_ms_ == 0)
+    return res;
+
+  res.total_keys = sync_total_keys_;
+  res.elapsed_ms = NowMs() - sync_start_ms_;
+
+  atomic<size_t> bytes_sent = 0, keys_sent = 0;
+  OnAllShards([&](auto& migration) {
+    if (migration) {
+      bytes_sent.fetch_add(migration->GetStreamer().GetTotalSent(), memory_order_relaxed);
+      keys_sent.fetch_add(migration->GetStreamer().GetKeysWritten(), memory_order_relaxed);
+    }
+  });
+  res.bytes_sent = bytes_sent;
+  res.keys_sent = keys_sent;
+  return res;
+}
+
 size_t OutgoingMigration::GetKeyCount() const {
   util::fb2::LockGuard lk(state_mu_);
   if (state_ == MigrationState::C_FINISHED) {
@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <atomic>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 
 #include "io/io.h"
@@ -58,6 +59,17 @@ class OutgoingMigration : private ProtocolClient {
 
   size_t GetKeyCount() const ABSL_LOCKS_EXCLUDED(state_mu_);
 
+  // Progress of the current sync attempt, summed over the shard flows
+  struct Progress {
+    size_t bytes_sent = 0;
+    size_t keys_sent = 0;   // RESTORE entries, keys changed during the sync are counted again
+    size_t total_keys = 0;  // keys in the migrated slots when the sync started
+    uint64_t elapsed_ms = 0;
+  };
+
+  // Hops into all shard threads to collect the counters of the flows
+  Progress GetProgress();
+
   static constexpr long kInvalidAttempt = -1;
   static constexpr std::string_view kUnknownMigration = "UNKNOWN_MIGRATION";
 
@@ -97,6 +109,10 @@ class OutgoingMigration : private ProtocolClient {
   // when migration is finished we need to store number of migrated keys
   // because new request can add or remove keys and we get incorrect statistic
   size_t keys_number_ = 0;
+
+  // Set by SyncFb when the flows start syncing, read by GetProgress
+  std::atomic<size_t> sync_total_keys_ = 0;
+  std::atomic<uint64_t> sync_start_ms_ = 0;
 };
 
 }  // namespace dfly::cluster
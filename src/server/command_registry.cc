@@ -4,11 +4,17 @@
 
 #include "server/command_registry.h"
 
+#include <absl/numeric/bits.h>
 #include <absl/strings/str_split.h>
 #include <absl/time/clock.h>
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
 #include "absl/container/inlined_vector.h"
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "base/bits.h"
 #include "base/flags.h"
@@ -27,6 +33,9 @@ ABSL_FLAG(vector<string>, restricted_commands, {},
 
 ABSL_FLAG(vector<string>, oom_deny_commands, {},
           "Additinal commands that will be marked as denyoom");
+ABSL_FLAG(vector<string>, command_latency_buckets, {},
+          "Upper bounds in usec of the buckets of the per command latency histograms exported "
+          "in /metrics, for example 100,1000,10000. Empty disables the histograms");
 namespace dfly {
 
 using namespace facade;
@@ -37,6 +46,60 @@ using absl::StrAppend;
 using absl::StrCat;
 using absl::StrSplit;
 
+namespace {
+
+// Sorted upper bounds of the latency histogram buckets, set once before the commands run
+vector<uint64_t> latency_bounds;
+
+constexpr uint64_t kByteOnes = 0x0101010101010101ULL;
+
+// Lowercases the ASCII letters among the 8 bytes of w at once. A byte is an upper case letter
+// if its low 7 bits are within ['A', 'Z'] and its high bit is clear; for those bytes the 0x80
+// marker is shifted down to the 0x20 case bit.
+uint64_t ToLower8(uint64_t w) {
+  uint64_t low7 = w & (0x7F * kByteOnes);
+  uint64_t ge_a = low7 + (0x80 - 'A') * kByteOnes;
+  uint64_t gt_z = low7 + (0x80 - 'Z' - 1) * kByteOnes;
+  uint64_t is_upper = ge_a & ~gt_z & ~w & (0x80 * kByteOnes);
+  return w | (is_upper >> 2);
+}
+
+// Loads up to 8 bytes of s starting at pos, zero padded.
+uint64_t LoadWord(string_view s, size_t pos) {
+  uint64_t w = 0;
+  memcpy(&w, s.data() + pos, min<size_t>(8, s.size() - pos));
+  return w;
+}
+
+uint64_t Mix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t HashIgnoreCase(string_view name) {
+  uint64_t h = name.size();
+  for (size_t i = 0; i < name.size(); i += 8)
+    h = Mix64(h ^ ToLower8(LoadWord(name, i)));
+  return h;
+}
+
+// Compares name case insensitively with lower, which is already lower case.
+bool EqualsLower(string_view name, string_view lower) {
+  if (name.size() != lower.size())
+    return false;
+  for (size_t i = 0; i < name.size(); i += 8) {
+    if (ToLower8(LoadWord(name, i)) != LoadWord(lower, i))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 CommandId::CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first_key,
                      int8_t last_key, uint32_t acl_categories)
     : facade::CommandId(name, mask, arity, first_key, last_key, acl_categories) {
@@ -44,6 +107,31 @@ CommandId::CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first
     opt_mask_ |= CO::NOSCRIPT;
 }
 
+void CommandId::Init(unsigned thread_count) {
+  command_stats_ = std::make_unique<CmdCallStats[]>(thread_count);
+  if (!latency_bounds.empty())
+    latency_buckets_ = std::make_unique<uint64_t[]>(thread_count * (latency_bounds.size() + 1));
+}
+
+void CommandId::ResetStats(unsigned thread_index) {
+  command_stats_[thread_index] = {0, 0};
+  if (latency_buckets_) {
+    size_t len = latency_bounds.size() + 1;
+    std::fill_n(latency_buckets_.get() + thread_index * len, len, 0);
+  }
+}
+
+absl::Span<const uint64_t> CommandId::GetLatencyBuckets(unsigned thread_index) const {
+  if (!latency_buckets_)
+    return {};
+  size_t len = latency_bounds.size() + 1;
+  return {latency_buckets_.get() + thread_index * len, len};
+}
+
+absl::Span<const uint64_t> CommandId::LatencyBounds() {
+  return latency_bounds;
+}
+
 bool CommandId::IsTransactional() const {
   if (first_key_ > 0 || (opt_mask_ & CO::GLOBAL_TRANS) || (opt_mask_ & CO::NO_KEY_TRANSACTIONAL))
     return true;
@@ -71,6 +159,14 @@ uint64_t CommandId::Invoke(CmdArgList args, ConnectionContext* cntx) const {
   ++ent.first;
   ent.second += execution_time_usec;
 
+  if (latency_buckets_) {
+    // Buckets count the calls up to and including their bound, as in prometheus
+    size_t bucket = lower_bound(latency_bounds.begin(), latency_bounds.end(),
+                                uint64_t(execution_time_usec)) -
+                    latency_bounds.begin();
+    ++latency_buckets_[ss->thread_index() * (latency_bounds.size() + 1) + bucket];
+  }
+
   return execution_time_usec;
 }
 
@@ -133,9 +229,83 @@ CommandRegistry::CommandRegistry() {
 }
 
 void CommandRegistry::Init(unsigned int thread_count) {
+  latency_bounds.clear();
+  for (const string& bound : GetFlag(FLAGS_command_latency_buckets)) {
+    uint64_t usec;
+    if (!absl::SimpleAtoi(bound, &usec) || usec == 0) {
+      LOG(ERROR) << "Invalid latency bucket " << bound << ", disabling latency histograms";
+      latency_bounds.clear();
+      break;
+    }
+    latency_bounds.push_back(usec);
+  }
+  sort(latency_bounds.begin(), latency_bounds.end());
+  latency_bounds.erase(unique(latency_bounds.begin(), latency_bounds.end()), latency_bounds.end());
+
   for (auto& [_, cmd] : cmd_map_) {
     cmd.Init(thread_count);
   }
+  BuildDispatchIndex();
+}
+
+// Builds a perfect hash over the registered names (hash, displace and compress): the names are
+// split into buckets by their hash and, starting from the largest bucket, each bucket gets the
+// first seed that places all its names into free slots. A lookup is then one hash of the
+// incoming name, two array reads and a single comparison, regardless of the name case.
+void CommandRegistry::BuildDispatchIndex() {
+  using Entry = pair<uint64_t, decltype(cmd_map_)::const_pointer>;
+
+  size_t num_buckets = absl::bit_ceil(max<size_t>(cmd_map_.size() / 4, 1));
+  size_t num_slots = absl::bit_ceil(max<size_t>(cmd_map_.size() * 2, 1));
+  vector<vector<Entry>> buckets(num_buckets);
+  for (const auto& k_v : cmd_map_) {
+    uint64_t hash = HashIgnoreCase(k_v.first);
+    buckets[hash & (num_buckets - 1)].emplace_back(hash, &k_v);
+  }
+
+  vector<uint32_t> order(num_buckets);
+  iota(order.begin(), order.end(), 0);
+  sort(order.begin(), order.end(),
+       [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+  dispatch_seeds_.assign(num_buckets, 0);
+  dispatch_slots_.assign(num_slots, {});
+  vector<size_t> placed;
+  for (uint32_t bucket_id : order) {
+    const vector<Entry>& bucket = buckets[bucket_id];
+    if (bucket.empty())
+      break;
+
+    for (uint32_t seed = 1;; ++seed) {
+      CHECK_LT(seed, 1u << 24) << "Could not build the command dispatch table";
+      placed.clear();
+      for (const auto& [hash, _] : bucket) {
+        size_t slot = Mix64(hash + seed) & (num_slots - 1);
+        if (dispatch_slots_[slot].cid || find(placed.begin(), placed.end(), slot) != placed.end())
+          break;
+        placed.push_back(slot);
+      }
+      if (placed.size() < bucket.size())
+        continue;
+
+      for (size_t i = 0; i < bucket.size(); ++i) {
+        const auto& [name, cid] = *bucket[i].second;
+        dispatch_slots_[placed[i]] = {absl::AsciiStrToLower(name), &cid};
+      }
+      dispatch_seeds_[bucket_id] = seed;
+      break;
+    }
+  }
+}
+
+const CommandId* CommandRegistry::FindIgnoreCase(string_view cmd) const {
+  if (dispatch_slots_.empty())  // Init has not run yet
+    return Find(AsciiStrToUpper(cmd));
+
+  uint64_t hash = HashIgnoreCase(cmd);
+  uint32_t seed = dispatch_seeds_[hash & (dispatch_seeds_.size() - 1)];
+  const DispatchSlot& slot = dispatch_slots_[Mix64(hash + seed) & (dispatch_slots_.size() - 1)];
+  return slot.cid && EqualsLower(cmd, slot.lower_name) ? slot.cid : nullptr;
 }
 
 CommandRegistry& CommandRegistry::operator<<(CommandId cmd) {
@@ -191,18 +361,18 @@ CommandRegistry::FamiliesVec CommandRegistry::GetFamilies() {
 
 std::pair<const CommandId*, CmdArgList> CommandRegistry::FindExtended(string_view cmd,
                                                                       CmdArgList tail_args) const {
-  if (cmd == RenamedOrOriginal("ACL"sv)) {
+  if (absl::EqualsIgnoreCase(cmd, RenamedOrOriginal("ACL"sv))) {
     if (tail_args.empty()) {
-      return {Find(cmd), {}};
+      return {FindIgnoreCase(cmd), {}};
     }
 
     auto second_cmd = absl::AsciiStrToUpper(ArgS(tail_args, 0));
-    string full_cmd = absl::StrCat(cmd, " ", second_cmd);
+    string full_cmd = absl::StrCat(AsciiStrToUpper(cmd), " ", second_cmd);
 
     return {Find(full_cmd), tail_args.subspan(1)};
   }
 
-  const CommandId* res = Find(cmd);
+  const CommandId* res = FindIgnoreCase(cmd);
   if (!res)
     return {nullptr, {}};
 
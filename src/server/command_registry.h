@@ -81,9 +81,7 @@ class CommandId : public facade::CommandId {
 
   CommandId(CommandId&&) = default;
 
-  void Init(unsigned thread_count) {
-    command_stats_ = std::make_unique<CmdCallStats[]>(thread_count);
-  }
+  void Init(unsigned thread_count);
 
   using Handler =
       fu2::function_base<true /*owns*/, true /*copyable*/, fu2::capacity_default,
@@ -140,16 +138,23 @@ class CommandId : public facade::CommandId {
     return (last_key_ != first_key_) || (opt_mask_ & CO::VARIADIC_KEYS);
   }
 
-  void ResetStats(unsigned thread_index) {
-    command_stats_[thread_index] = {0, 0};
-  }
+  void ResetStats(unsigned thread_index);
 
   CmdCallStats GetStats(unsigned thread_index) const {
     return command_stats_[thread_index];
   }
 
+  // Counts of the calls of this thread per bucket of LatencyBounds(), the last one for calls
+  // slower than all bounds. Empty if latency histograms are disabled.
+  absl::Span<const uint64_t> GetLatencyBuckets(unsigned thread_index) const;
+
+  // Upper bounds in usec of the buckets of the latency histograms, from the
+  // command_latency_buckets flag.
+  static absl::Span<const uint64_t> LatencyBounds();
+
  private:
   std::unique_ptr<CmdCallStats[]> command_stats_;
+  std::unique_ptr<uint64_t[]> latency_buckets_;  // LatencyBounds().size() + 1 per thread
   Handler handler_;
   ArgValidator validator_;
 };
@@ -196,6 +201,16 @@ class CommandRegistry {
     }
   }
 
+  void MergeLatencyBuckets(
+      unsigned thread_index,
+      std::function<void(std::string_view, absl::Span<const uint64_t>)> cb) const {
+    for (const auto& k_v : cmd_map_) {
+      if (k_v.second.GetStats(thread_index).first == 0)
+        continue;
+      cb(k_v.second.name(), k_v.second.GetLatencyBuckets(thread_index));
+    }
+  }
+
   void StartFamily();
 
   std::string_view RenamedOrOriginal(std::string_view orig) const;
@@ -203,10 +218,21 @@ class CommandRegistry {
   using FamiliesVec = std::vector<std::vector<std::string>>;
   FamiliesVec GetFamilies();
 
+  // Resolves a command name in any letter case, without allocating an upper case copy.
+  const CommandId* FindIgnoreCase(std::string_view cmd) const;
+
+  // Like FindIgnoreCase but also resolves the ACL subcommands and XGROUP HELP from tail_args.
   std::pair<const CommandId*, facade::CmdArgList> FindExtended(std::string_view cmd,
                                                                facade::CmdArgList tail_args) const;
 
  private:
+  struct DispatchSlot {
+    std::string lower_name;
+    const CommandId* cid = nullptr;
+  };
+
+  void BuildDispatchIndex();
+
   absl::flat_hash_map<std::string, CommandId> cmd_map_;
   absl::flat_hash_map<std::string, std::string> cmd_rename_map_;
   absl::flat_hash_set<std::string> restricted_cmds_;
@@ -214,6 +240,10 @@ class CommandRegistry {
 
   FamiliesVec family_of_commands_;
   size_t bit_index_;
+
+  // Perfect hash index over cmd_map_ built by Init, see BuildDispatchIndex.
+  std::vector<uint32_t> dispatch_seeds_;
+  std::vector<DispatchSlot> dispatch_slots_;
 };
 
 }  // namespace dfly
@@ -233,7 +233,7 @@ bool ParseDouble(string_view src, double* value) {
 #define ADD(x) (x) += o.x
 
 TieredStats& TieredStats::operator+=(const TieredStats& o) {
-  static_assert(sizeof(TieredStats) == 144);
+  static_assert(sizeof(TieredStats) == 240);
 
   ADD(total_stashes);
   ADD(total_fetches);
@@ -242,14 +242,22 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(total_defrags);
   ADD(total_uploads);
   ADD(total_heap_buf_allocs);
+  ADD(total_coalesced_reads);
+  ADD(total_range_reads);
+  ADD(total_compressed_stashes);
   ADD(total_registered_buf_allocs);
 
   ADD(allocated_bytes);
   ADD(capacity_bytes);
+  ADD(committed_bytes);
 
   ADD(pending_read_cnt);
   ADD(pending_stash_cnt);
 
+  backing_files = std::max(backing_files, o.backing_files);
+  for (size_t i = 0; i < file_pending_ops.size(); ++i)
+    file_pending_ops[i] += o.file_pending_ops[i];
+
   ADD(small_bins_cnt);
   ADD(small_bins_entries_cnt);
   ADD(small_bins_filling_bytes);
@@ -257,6 +265,9 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(cold_storage_bytes);
   ADD(total_offloading_steps);
   ADD(total_offloading_stashes);
+  ADD(total_hot_skips);
+  ADD(total_evacuations);
+  ADD(total_released_bytes);
   return *this;
 }
 
@@ -292,7 +303,7 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
     } else if (opt == "MATCH") {
       string_view pattern = ArgS(args, i + 1);
       if (pattern != "*")
-        scan_opts.pattern = pattern;
+        scan_opts.matcher.emplace(pattern);
     } else if (opt == "TYPE") {
       auto obj_type = ObjTypeFromString(ArgS(args, i + 1));
       if (!obj_type) {
@@ -311,9 +322,7 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
 }
 
 bool ScanOpts::Matches(std::string_view val_name) const {
-  if (!pattern)
-    return true;
-  return stringmatchlen(pattern->data(), pattern->size(), val_name.data(), val_name.size(), 0) == 1;
+  return !matcher || matcher->Matches(val_name);
 }
 
 GenericError::operator std::error_code() const {
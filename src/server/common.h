@@ -8,6 +8,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/types/span.h>
 
+#include <array>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -16,6 +17,7 @@
 
 #include "base/logging.h"
 #include "core/compact_object.h"
+#include "core/glob_matcher.h"
 #include "facade/facade_types.h"
 #include "facade/op_status.h"
 #include "util/fibers/fibers.h"
@@ -70,18 +72,29 @@ struct TieredStats {
   uint64_t total_uploads = 0;
   uint64_t total_registered_buf_allocs = 0;
   uint64_t total_heap_buf_allocs = 0;
+  uint64_t total_coalesced_reads = 0;
+  uint64_t total_range_reads = 0;  // reads of only the pages covering a requested range
+  uint64_t total_compressed_stashes = 0;
 
   // How many times the system did not perform Stash call (disjoint with total_stashes).
   uint64_t total_stash_overflows = 0;
   uint64_t total_offloading_steps = 0;
   uint64_t total_offloading_stashes = 0;
+  uint64_t total_hot_skips = 0;  // stash candidates kept in memory as they're hot
+  uint64_t total_evacuations = 0;      // pages emptied by compaction
+  uint64_t total_released_bytes = 0;  // freed pages returned to the filesystem
 
   size_t allocated_bytes = 0;
   size_t capacity_bytes = 0;
+  size_t committed_bytes = 0;  // bytes of pages hosting allocated segments
 
   uint32_t pending_read_cnt = 0;
   uint32_t pending_stash_cnt = 0;
 
+  // Pending io requests per backing file index, i.e. per tiered prefix.
+  uint32_t backing_files = 0;
+  std::array<uint32_t, 8> file_pending_ops{};
+
   uint64_t small_bins_cnt = 0;
   uint64_t small_bins_entries_cnt = 0;
   size_t small_bins_filling_bytes = 0;
@@ -282,7 +295,7 @@ class Context : protected Cancellation {
 };
 
 struct ScanOpts {
-  std::optional<std::string_view> pattern;
+  std::optional<GlobMatcher> matcher;  // compiled MATCH pattern, unset for "*".
   size_t limit = 10;
   std::optional<CompactObjType> type_filter;
   unsigned bucket_id = UINT_MAX;
@@ -119,7 +119,7 @@ ConnectionContext::ConnectionContext(const ConnectionContext* owner, Transaction
   CHECK_EQ(prev_reply_builder, nullptr);
 }
 
-void ConnectionContext::ChangeMonitor(bool start) {
+void ConnectionContext::ChangeMonitor(bool start, MonitorFilter filter) {
   // This will either remove or register a new connection
   // at the "top level" thread --> ServerState context
   // note that we are registering/removing this connection to the thread at which at run
@@ -131,14 +131,20 @@ void ConnectionContext::ChangeMonitor(bool start) {
     VLOG(1) << "connection " << conn()->GetClientId() << " no longer needs to be monitored";
     my_monitors.Remove(conn());
   }
-  // Tell other threads that about the change in the number of connection that we monitor
-  shard_set->pool()->AwaitBrief(
-      [start](unsigned, auto*) { ServerState::tlocal()->Monitors().NotifyChangeCount(start); });
+  // Tell other threads about the change in the connections that we monitor
+  filter.monitor_id = conn()->GetClientId();
+  shard_set->pool()->AwaitBrief([start, &filter](unsigned, auto*) {
+    auto& monitors = ServerState::tlocal()->Monitors();
+    if (start)
+      monitors.AddFilter(filter);
+    else
+      monitors.RemoveFilter(filter.monitor_id);
+  });
   EnableMonitoring(start);
 }
 
-vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add, bool to_reply,
-                                     ConnectionContext* conn) {
+vector<unsigned> ChangeSubscriptions(ChannelStore::Kind kind, CmdArgList args, bool to_add,
+                                     bool to_reply, ConnectionContext* conn) {
   vector<unsigned> result(to_reply ? args.size() : 0, 0);
 
   auto& conn_state = conn->conn_state;
@@ -153,12 +159,14 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
   }
 
   auto& sinfo = *conn->conn_state.subscribe_info.get();
-  auto& local_store = pattern ? sinfo.patterns : sinfo.channels;
+  auto& local_store = kind == ChannelStore::CHANNEL   ? sinfo.channels
+                      : kind == ChannelStore::PATTERN ? sinfo.patterns
+                                                      : sinfo.shard_channels;
 
   int32_t tid = util::ProactorBase::me()->GetPoolIndex();
   DCHECK_GE(tid, 0);
 
-  ChannelStoreUpdater csu{pattern, to_add, conn, uint32_t(tid)};
+  ChannelStoreUpdater csu{kind, to_add, conn, uint32_t(tid)};
 
   // Gather all the channels we need to subscribe to / remove.
   size_t i = 0;
@@ -168,8 +176,10 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
     else if (!to_add && local_store.erase(channel) > 0)
       csu.Record(channel);
 
-    if (to_reply)
-      result[i++] = sinfo.SubscriptionCount();
+    if (to_reply) {
+      bool sharded = kind == ChannelStore::SHARD_CHANNEL;
+      result[i++] = sharded ? sinfo.shard_channels.size() : sinfo.SubscriptionCount();
+    }
   }
 
   csu.Apply();
@@ -186,7 +196,8 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
 }
 
 void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(false, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::CHANNEL, args, to_add, to_reply, this);
 
   if (to_reply) {
     for (size_t i = 0; i < result.size(); ++i) {
@@ -201,7 +212,8 @@ void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgLis
 }
 
 void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(true, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::PATTERN, args, to_add, to_reply, this);
 
   if (to_reply) {
     const char* action[2] = {"punsubscribe", "psubscribe"};
@@ -215,6 +227,22 @@ void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgLi
   }
 }
 
+void ConnectionContext::ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args) {
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::SHARD_CHANNEL, args, to_add, to_reply, this);
+
+  if (to_reply) {
+    const char* action[2] = {"sunsubscribe", "ssubscribe"};
+    if (result.size() == 0) {
+      return SendSubscriptionChangedResponse(action[to_add], std::nullopt, 0);
+    }
+
+    for (size_t i = 0; i < result.size(); ++i) {
+      SendSubscriptionChangedResponse(action[to_add], ArgS(args, i), result[i]);
+    }
+  }
+}
+
 void ConnectionContext::UnsubscribeAll(bool to_reply) {
   if (to_reply && (!conn_state.subscribe_info || conn_state.subscribe_info->channels.empty())) {
     return SendSubscriptionChangedResponse("unsubscribe", std::nullopt, 0);
@@ -236,6 +264,33 @@ void ConnectionContext::PUnsubscribeAll(bool to_reply) {
   ChangePSubscription(false, to_reply, CmdArgList{arg_vec});
 }
 
+void ConnectionContext::SUnsubscribeAll(bool to_reply) {
+  if (to_reply &&
+      (!conn_state.subscribe_info || conn_state.subscribe_info->shard_channels.empty())) {
+    return SendSubscriptionChangedResponse("sunsubscribe", std::nullopt, 0);
+  }
+
+  StringVec channels(conn_state.subscribe_info->shard_channels.begin(),
+                     conn_state.subscribe_info->shard_channels.end());
+  CmdArgVec arg_vec(channels.begin(), channels.end());
+  ChangeSSubscription(false, to_reply, CmdArgList{arg_vec});
+}
+
+void ConnectionContext::OnShardChannelRemoved(string_view channel) {
+  // The channel might have been unsubscribed, or subscribed again once its slot came back.
+  auto* sinfo = conn_state.subscribe_info.get();
+  if (!sinfo || ServerState::tlocal()->channel_store()->IsShardSubscriber(channel, this) ||
+      sinfo->shard_channels.erase(channel) == 0)
+    return;
+
+  SendSubscriptionChangedResponse("sunsubscribe", channel, sinfo->shard_channels.size());
+  if (sinfo->IsEmpty()) {
+    conn_state.subscribe_info.reset();
+    DCHECK_GE(subscriptions, 1u);
+    subscriptions--;
+  }
+}
+
 void ConnectionContext::SendSubscriptionChangedResponse(string_view action,
                                                         std::optional<string_view> topic,
                                                         unsigned count) {
@@ -250,19 +305,25 @@ void ConnectionContext::SendSubscriptionChangedResponse(string_view action,
 }
 
 size_t ConnectionState::ExecInfo::UsedMemory() const {
-  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys);
+  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys) + dfly::HeapSize(watched_versions) +
+         dfly::HeapSize(declared_keys);
 }
 
 size_t ConnectionState::ScriptInfo::UsedMemory() const {
-  return dfly::HeapSize(lock_tags) + async_cmds_heap_mem;
+  return dfly::HeapSize(lock_tags) + async_cmds_heap_mem + batch_cmds_heap_mem;
 }
 
 size_t ConnectionState::SubscribeInfo::UsedMemory() const {
-  return dfly::HeapSize(channels) + dfly::HeapSize(patterns);
+  return dfly::HeapSize(channels) + dfly::HeapSize(patterns) + dfly::HeapSize(shard_channels);
+}
+
+size_t ConnectionState::ShardAffinity::UsedMemory() const {
+  return dfly::HeapSize(hist_);
 }
 
 size_t ConnectionState::UsedMemory() const {
-  return dfly::HeapSize(exec_info) + dfly::HeapSize(script_info) + dfly::HeapSize(subscribe_info);
+  return dfly::HeapSize(exec_info) + dfly::HeapSize(script_info) + dfly::HeapSize(subscribe_info) +
+         shard_affinity.UsedMemory();
 }
 
 size_t ConnectionContext::UsedMemory() const {
@@ -297,13 +358,44 @@ void ConnectionState::ExecInfo::Clear() {
   state = EXEC_INACTIVE;
   body.clear();
   is_write = false;
+  declared_keys.clear();
   ClearWatched();
 }
 
 void ConnectionState::ExecInfo::ClearWatched() {
   watched_keys.clear();
-  watched_dirty.store(false, memory_order_relaxed);
-  watched_existed = 0;
+  watched_versions.clear();
+}
+
+optional<ShardId> ConnectionState::ShardAffinity::Record(ShardId sid, unsigned conn_thread,
+                                                         unsigned window) {
+  if (hist_.empty())
+    hist_.resize(shard_set->size());
+  ++hist_[sid];
+  if (++count_ < window)
+    return nullopt;
+
+  auto max_it = max_element(hist_.begin(), hist_.end());
+  ShardId dominant = max_it - hist_.begin();
+  bool dominates = *max_it * 100 >= count_ * kDominantPercent;
+  fill(hist_.begin(), hist_.end(), 0);
+  count_ = 0;
+
+  if (cooldown_ > 0) {
+    --cooldown_;
+    return nullopt;
+  }
+
+  if (!dominates || dominant == conn_thread) {
+    streak_ = 0;
+    return nullopt;
+  }
+
+  streak_ = dominant == candidate_ ? min(streak_ + 1u, kStableWindows) : 1;
+  candidate_ = dominant;
+  if (streak_ < kStableWindows)
+    return nullopt;
+  return dominant;
 }
 
 bool ConnectionState::ClientTracking::ShouldTrackKeys() const {
@@ -311,6 +403,11 @@ bool ConnectionState::ClientTracking::ShouldTrackKeys() const {
     return false;
   }
 
+  if (bcast_) {
+    // Broadcasting clients are notified by their prefixes.
+    return false;
+  }
+
   if (noloop_ == true) {
     // Once we implement REDIRECT this should return true since noloop
     // without it only affects the current connection
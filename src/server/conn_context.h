@@ -78,7 +78,7 @@ struct ConnectionState {
     // Resets to blank state after EXEC or DISCARD
     void Clear();
 
-    // Resets local watched keys info. Does not unregister the keys from DbSlices.
+    // Resets local watched keys info.
     void ClearWatched();
 
     size_t UsedMemory() const;
@@ -88,8 +88,13 @@ struct ConnectionState {
     bool is_write = false;
 
     std::vector<std::pair<DbIndex, std::string>> watched_keys;  // List of keys registered by WATCH
-    std::atomic_bool watched_dirty = false;  // Set if a watched key was changed before EXEC
-    uint32_t watched_existed = 0;            // Number of times watch was called on an existing key
+
+    // DbSlice::WatchVersion of every watched key, EXEC validates the keys against them.
+    std::vector<uint64_t> watched_versions;
+
+    // Sorted keys declared with MULTI KEYS. If set, queued commands may only access them and EXEC
+    // locks just them instead of falling back to a global transaction.
+    std::vector<std::string> declared_keys;
 
     // If the transaction contains EVAL calls, preborrow an interpreter that will be used for all of
     // them. This has to be done to avoid potentially blocking when borrowing interpreters amid
@@ -107,14 +112,22 @@ struct ConnectionState {
     size_t async_cmds_heap_mem = 0;     // bytes used by async_cmds
     size_t async_cmds_heap_limit = 0;   // max bytes allowed for async_cmds
     std::vector<StoredCmd> async_cmds;  // aggregated by acall
+
+    size_t batch_cmds_heap_mem = 0;     // bytes used by batch_cmds
+    std::vector<StoredCmd> batch_cmds;  // aggregated by mcall, replies are returned to the script
+
+    uint64_t redis_call_ns = 0;  // time spent in redis.call and its variants
+    uint32_t redis_calls = 0;
+    uint32_t hops = 0;  // dispatches of commands and squashed batches to the shards
   };
 
   // PUB-SUB messaging related data.
   struct SubscribeInfo {
     bool IsEmpty() const {
-      return channels.empty() && patterns.empty();
+      return channels.empty() && patterns.empty() && shard_channels.empty();
     }
 
+    // Shard channels are counted separately, as in the replies of SSUBSCRIBE.
     unsigned SubscriptionCount() const {
       return channels.size() + patterns.size();
     }
@@ -124,6 +137,7 @@ struct ConnectionState {
     // TODO: to provide unique_strings across service. This will allow us to use string_view here.
     absl::flat_hash_set<std::string> channels;
     absl::flat_hash_set<std::string> patterns;
+    absl::flat_hash_set<std::string> shard_channels;
   };
 
   struct ReplicationInfo {
@@ -143,6 +157,38 @@ struct ConnectionState {
     const ConnectionContext* owner = nullptr;
   };
 
+  // Histogram of the shards accessed by the single shard commands of the connection, used to move
+  // it to the thread of the shard it mostly works with, see conn_affinity_window.
+  class ShardAffinity {
+   public:
+    // Share of a window's commands that a shard must get to dominate it.
+    static constexpr unsigned kDominantPercent = 80;
+
+    // Consecutive windows a shard must dominate before the connection moves to it.
+    static constexpr unsigned kStableWindows = 2;
+
+    // Windows that are skipped after a migration.
+    static constexpr unsigned kCooldownWindows = 8;
+
+    // Records a command that ran only on shard sid. Once every window commands, returns the shard
+    // that dominated the last kStableWindows windows, unless it is local to conn_thread.
+    std::optional<ShardId> Record(ShardId sid, unsigned conn_thread, unsigned window);
+
+    void OnMigrated() {
+      streak_ = 0;
+      cooldown_ = kCooldownWindows;
+    }
+
+    size_t UsedMemory() const;
+
+   private:
+    std::vector<uint32_t> hist_;
+    uint32_t count_ = 0;
+    ShardId candidate_ = kInvalidSid;
+    uint8_t streak_ = 0;
+    uint8_t cooldown_ = 0;
+  };
+
   enum MCGetMask {
     FETCH_CAS_VER = 1,
   };
@@ -216,6 +262,16 @@ struct ConnectionState {
       noloop_ = noloop;
     }
 
+    // Set if BCAST is used in CLIENT TRACKING. The keys are not tracked per client then, the
+    // client is notified about all the changed keys that match its prefixes.
+    void SetBcast(bool bcast) {
+      bcast_ = bcast;
+    }
+
+    bool IsBcast() const {
+      return bcast_;
+    }
+
     // Check if the keys should be tracked. Result adheres to the state machine described above.
     bool ShouldTrackKeys() const;
 
@@ -242,6 +298,7 @@ struct ConnectionState {
     // a flag indicating whether the client has turned on client tracking.
     bool tracking_enabled_ = false;
     bool noloop_ = false;
+    bool bcast_ = false;
     Options option_ = NONE;
     // sequence number
     size_t seq_num_ = 0;
@@ -256,6 +313,10 @@ struct ConnectionState {
   // For get op - we use it as a mask of MCGetMask values.
   uint32_t memcache_flag = 0;
 
+  // Set when the client fetched the cluster topology. Its next command for a slot of another node
+  // gets a MOVED reply instead of being forwarded, so that smart clients update their slot maps.
+  bool moved_hint_pending = false;
+
   ExecInfo exec_info;
   ReplicationInfo replication_info;
 
@@ -263,6 +324,17 @@ struct ConnectionState {
   std::unique_ptr<ScriptInfo> script_info;
   std::unique_ptr<SubscribeInfo> subscribe_info;
   ClientTracking tracking_info_;
+  ShardAffinity shard_affinity;
+};
+
+// Options of MONITOR. A default filter passes all the commands.
+struct MonitorFilter {
+  uint32_t monitor_id = 0;                // client id of the monitoring connection
+  double sample_ratio = 1.0;              // share of the matching commands that are sent
+  uint32_t max_rate = 0;                  // messages per second and thread, 0 for unlimited
+  std::vector<std::string> commands;      // upper case names of the commands, all if empty
+  std::vector<std::string> key_prefixes;  // prefixes of the keys of the commands, all if empty
+  std::vector<uint32_t> clients;          // ids of the monitored clients, all if empty
 };
 
 class ConnectionContext : public facade::ConnectionContext {
@@ -295,12 +367,17 @@ class ConnectionContext : public facade::ConnectionContext {
 
   void ChangeSubscription(bool to_add, bool to_reply, CmdArgList args);
   void ChangePSubscription(bool to_add, bool to_reply, CmdArgList args);
+  void ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args);
   void UnsubscribeAll(bool to_reply);
   void PUnsubscribeAll(bool to_reply);
-  void ChangeMonitor(bool start);  // either start or stop monitor on a given connection
+  void SUnsubscribeAll(bool to_reply);
+  // Either start or stop monitor on a given connection, the filter is used when starting.
+  void ChangeMonitor(bool start, MonitorFilter filter = {});
 
   size_t UsedMemory() const override;
 
+  void OnShardChannelRemoved(std::string_view channel) override;
+
   void SendError(std::string_view str, std::string_view type = std::string_view{}) override;
   void SendError(facade::ErrorReply error) override;
   void SendError(facade::OpStatus status) override;
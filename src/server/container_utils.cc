@@ -5,6 +5,9 @@
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/listpack_find.h"
+#include "core/qlist.h"
+#include "core/roaring_int_set.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
@@ -22,6 +25,9 @@ extern "C" {
 }
 
 ABSL_FLAG(bool, singlehop_blocking, true, "Use single hop optimization for blocking commands");
+ABSL_FLAG(uint32_t, container_reply_chunk_size, 8192,
+          "Replies of HGETALL, HKEYS, HVALS, SMEMBERS and LRANGE with more elements are read and "
+          "sent in chunks of this size, releasing the shard thread in between. 0 to disable.");
 
 namespace dfly::container_utils {
 using namespace std;
@@ -152,6 +158,16 @@ quicklistEntry QLEntry() {
 }
 
 bool IterateList(const PrimeValue& pv, const IterateFunc& func, long start, long end) {
+  if (pv.Encoding() == kEncodingQL2) {
+    const QList* ql = static_cast<const QList*>(pv.RObjPtr());
+    return ql->Iterate(
+        [&func](QList::Entry entry) {
+          return entry.is_int() ? func(ContainerEntry{entry.ival()})
+                                : func(ContainerEntry{entry.view().data(), entry.view().size()});
+        },
+        start, end);
+  }
+
   quicklist* ql = static_cast<quicklist*>(pv.RObjPtr());
   long llen = quicklistCount(ql);
   if (end < 0 || end >= llen)
@@ -183,6 +199,10 @@ bool IterateSet(const PrimeValue& pv, const IterateFunc& func) {
     while (success && intsetGet(is, ii++, &ival)) {
       success = func(ContainerEntry{ival});
     }
+  } else if (pv.Encoding() == kEncodingRoaring) {
+    success = static_cast<const RoaringIntSet*>(pv.RObjPtr())->Iterate([&func](int64_t val) {
+      return func(ContainerEntry{val});
+    });
   } else {
     for (sds ptr : *static_cast<StringSet*>(pv.RObjPtr())) {
       if (!func(ContainerEntry{ptr, sdslen(ptr)})) {
@@ -264,7 +284,7 @@ optional<string_view> LpFind(uint8_t* lp, string_view key, uint8_t int_buf[]) {
   uint8_t* fptr = lpFirst(lp);
   DCHECK(fptr);
 
-  fptr = lpFind(lp, fptr, (unsigned char*)key.data(), key.size(), 1);
+  fptr = LpFindStr(lp, fptr, key, 1);
   if (!fptr)
     return std::nullopt;
   uint8_t* vptr = lpNext(lp, fptr);
@@ -373,4 +393,50 @@ OpResult<string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_ty
   return result_key;
 }
 
+void SendChunkedReply(Transaction* tx, facade::RedisReplyBuilder* rb,
+                      facade::RedisReplyBuilder::CollectionType type,
+                      const ReplyChunkFunc& read_chunk) {
+  ReplyChunk chunk;
+  chunk.limit = absl::GetFlag(FLAGS_container_reply_chunk_size);
+  if (chunk.limit == 0 || tx->IsMulti())
+    chunk.limit = numeric_limits<size_t>::max();
+
+  // Avoid concluding while more chunks follow, so that the key stays locked between the hops.
+  auto cb = [&](Transaction* t, EngineShard* shard) -> Transaction::RunnableResult {
+    chunk.elements.clear();
+    OpStatus status = read_chunk(t, shard, &chunk);
+    if (status == OpStatus::OK && chunk.cursor != 0)
+      return {OpStatus::OK, Transaction::RunnableResult::AVOID_CONCLUDING};
+    return status;
+  };
+
+  OpStatus status = tx->ScheduleSingleHop(cb);
+  if (status != OpStatus::OK && status != OpStatus::KEY_NOTFOUND)
+    return rb->SendError(status);
+
+  size_t total = status == OpStatus::OK ? chunk.total : 0;
+  size_t sent = 0;
+  for (bool first = true;; first = false) {
+    {
+      facade::SinkReplyBuilder::ReplyAggregator agg(rb);
+      if (first)
+        rb->StartCollection(type == facade::RedisReplyBuilder::MAP ? total / 2 : total, type);
+      for (const string& elem : chunk.elements)
+        rb->SendBulkString(elem);
+      sent += chunk.elements.size();
+    }
+
+    if (status != OpStatus::OK || chunk.cursor == 0)
+      break;
+
+    rb->FlushBatch();
+    status = tx->ScheduleSingleHop(cb);
+  }
+
+  // The key is locked, so the following chunks can not fail, but keep the reply well formed.
+  DCHECK_EQ(sent, total);
+  for (; sent < total; ++sent)
+    rb->SendNull();
+}
+
 }  // namespace dfly::container_utils
@@ -81,6 +81,25 @@ std::string_view LpGetView(uint8_t* lp_it, uint8_t int_buf[]);
 // Find value by key and return stringview to it, otherwise nullopt.
 std::optional<std::string_view> LpFind(uint8_t* lp, std::string_view key, uint8_t int_buf[]);
 
+// A chunk of a read-only array reply that is produced by consecutive hops of a transaction.
+struct ReplyChunk {
+  size_t limit;         // max number of elements per chunk.
+  size_t total = 0;     // number of elements of the whole reply, set with the first chunk.
+  uint64_t cursor = 0;  // position of the next chunk, 0 for the first one and after the last one.
+  std::vector<std::string> elements;
+};
+
+// Appends the elements of the chunk at chunk->cursor and advances the cursor.
+using ReplyChunkFunc = std::function<OpStatus(Transaction*, EngineShard*, ReplyChunk*)>;
+
+// Sends a collection of the given type that is read with read_chunk, by chunks of
+// container_reply_chunk_size elements for huge containers. The shard thread is released between
+// the chunks, which are flushed to the client while the transaction keeps the key locked.
+// Multi transactions can run only a single hop, so they read the whole reply at once.
+void SendChunkedReply(Transaction* tx, facade::RedisReplyBuilder* rb,
+                      facade::RedisReplyBuilder::CollectionType type,
+                      const ReplyChunkFunc& read_chunk);
+
 using BlockingResultCb =
     std::function<void(Transaction*, EngineShard*, std::string_view /* key */)>;
 
@@ -0,0 +1,444 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/counter_family.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "facade/error.h"
+#include "server/acl/acl_commands_def.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/error.h"
+#include "server/transaction.h"
+#include "util/fibers/synchronization.h"
+
+ABSL_FLAG(uint32_t, counter_flush_ms, 10,
+          "Period in milliseconds of flushing the increments buffered by CINCRBY to the shards. "
+          "0 disables buffering and CINCRBY behaves like INCRBY.");
+
+ABSL_FLAG(uint32_t, counter_max_keys, 4096,
+          "Max number of counters buffered by CINCRBY per thread. Increments of other keys are "
+          "applied synchronously.");
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+// Argument index of the key and the new value of the counter.
+using ShardValues = vector<pair<size_t, OpResult<int64_t>>>;
+
+OpResult<int64_t> OpIncrBy(const OpArgs& op_args, string_view key, int64_t incr) {
+  auto& db_slice = op_args.GetDbSlice();
+  auto res = db_slice.FindMutable(op_args.db_cntx, key);
+
+  if (!IsValid(res.it)) {
+    CompactObj cobj;
+    cobj.SetInt(incr);
+
+    auto op_result = db_slice.AddNew(op_args.db_cntx, key, std::move(cobj), 0);
+    RETURN_ON_BAD_STATUS(op_result);
+    return incr;
+  }
+
+  if (res.it->second.ObjType() != OBJ_STRING)
+    return OpStatus::WRONG_TYPE;
+
+  auto opt_prev = res.it->second.TryGetInt();
+  if (!opt_prev)
+    return OpStatus::INVALID_VALUE;
+
+  int64_t new_val;
+  if (__builtin_add_overflow(*opt_prev, incr, &new_val))
+    return OpStatus::OUT_OF_RANGE;
+
+  DCHECK(!res.it->second.IsExternal());
+  res.it->second.SetInt(new_val);
+  return new_val;
+}
+
+OpResult<int64_t> OpGet(const OpArgs& op_args, string_view key) {
+  auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
+  if (!it_res)
+    return it_res.status();
+
+  auto val = (*it_res)->second.TryGetInt();
+  if (!val)
+    return OpStatus::INVALID_VALUE;
+  return *val;
+}
+
+// Applies key delta pairs of the shard. Invalid deltas were rejected by the caller.
+ShardValues OpApplyDeltas(const OpArgs& op_args, const ShardArgs& args) {
+  ShardValues res;
+  for (auto it = args.begin(); it != args.end();) {
+    size_t index = it.index();
+    string_view key = *(it++);
+    int64_t delta = 0;
+    CHECK(absl::SimpleAtoi(*(it++), &delta));
+    res.emplace_back(index, OpIncrBy(op_args, key, delta));
+  }
+  return res;
+}
+
+bool ValidateDeltas(CmdArgList args) {
+  for (size_t i = 1; i < args.size(); i += 2) {
+    int64_t delta;
+    if (!absl::SimpleAtoi(ArgS(args, i), &delta))
+      return false;
+  }
+  return true;
+}
+
+void SendIncrError(OpStatus status, ConnectionContext* cntx) {
+  if (status == OpStatus::INVALID_VALUE)
+    return cntx->SendError(kInvalidIntErr);
+  if (status == OpStatus::OUT_OF_RANGE)
+    return cntx->SendError(kIncrOverflow);
+  cntx->SendError(status);
+}
+
+// Thread local buffer of counter increments. The buffer is only accessed by the fibers of its
+// thread, so it needs no locking. Each entry caches the last value seen on the shard, which
+// CINCRBY replies with after adding the pending delta.
+class CounterBuffer {
+ public:
+  CounterBuffer(const CommandId* flush_cid, uint32_t max_keys)
+      : flush_cid_(flush_cid), max_keys_(max_keys) {
+  }
+
+  // Adds delta to the buffered counter and returns its estimated value. Returns nullopt if the
+  // counter is not buffered yet or the estimate overflows, so the increment must be applied
+  // synchronously.
+  optional<int64_t> TryAdd(Namespace* ns, DbIndex db, string_view key, int64_t delta);
+
+  // Sets the value of the counter after a synchronous increment, starting to buffer it.
+  void Seed(Namespace* ns, DbIndex db, string_view key, int64_t value);
+
+  // Removes the pending delta of the counter and returns it.
+  int64_t Extract(Namespace* ns, DbIndex db, string_view key);
+
+  void Start(uint32_t period_ms);
+  void Stop();
+
+ private:
+  struct Entry {
+    int64_t delta = 0;
+    int64_t value = 0;
+    bool touched = true;  // incremented since the last flush.
+  };
+
+  using Counters = absl::flat_hash_map<string, Entry>;
+
+  struct Batch {
+    Namespace* ns;
+    DbIndex db;
+    vector<string> args;  // key delta pairs.
+  };
+
+  void Flush();
+  void ApplyBatch(Batch* batch);
+
+  const CommandId* flush_cid_;
+  uint32_t max_keys_;
+  size_t num_keys_ = 0;
+
+  absl::flat_hash_map<pair<Namespace*, DbIndex>, Counters> dbs_;
+
+  util::fb2::Fiber flush_fb_;
+  util::fb2::Done flush_done_;
+};
+
+optional<int64_t> CounterBuffer::TryAdd(Namespace* ns, DbIndex db, string_view key,
+                                        int64_t delta) {
+  auto db_it = dbs_.find(make_pair(ns, db));
+  if (db_it == dbs_.end())
+    return nullopt;
+
+  auto it = db_it->second.find(key);
+  if (it == db_it->second.end())
+    return nullopt;
+
+  Entry& entry = it->second;
+  int64_t new_delta, estimate;
+  if (__builtin_add_overflow(entry.delta, delta, &new_delta) ||
+      __builtin_add_overflow(entry.value, new_delta, &estimate))
+    return nullopt;
+
+  entry.delta = new_delta;
+  entry.touched = true;
+  return estimate;
+}
+
+void CounterBuffer::Seed(Namespace* ns, DbIndex db, string_view key, int64_t value) {
+  Counters& counters = dbs_[make_pair(ns, db)];
+  auto it = counters.find(key);
+  if (it == counters.end()) {
+    if (num_keys_ >= max_keys_)
+      return;
+    it = counters.emplace(key, Entry{}).first;
+    ++num_keys_;
+  }
+  it->second.value = value;
+  it->second.touched = true;
+}
+
+int64_t CounterBuffer::Extract(Namespace* ns, DbIndex db, string_view key) {
+  auto db_it = dbs_.find(make_pair(ns, db));
+  if (db_it == dbs_.end())
+    return 0;
+
+  auto it = db_it->second.find(key);
+  if (it == db_it->second.end() || it->second.delta == 0)
+    return 0;
+
+  return exchange(it->second.delta, 0);
+}
+
+void CounterBuffer::Start(uint32_t period_ms) {
+  flush_fb_ = util::fb2::Fiber("counter_flush", [this, period_ms] {
+    while (!flush_done_.WaitFor(chrono::milliseconds(period_ms))) {
+      if (num_keys_ > 0)
+        Flush();
+    }
+    Flush();
+  });
+}
+
+void CounterBuffer::Stop() {
+  flush_done_.Notify();
+  flush_fb_.JoinIfNeeded();
+}
+
+void CounterBuffer::Flush() {
+  vector<Batch> batches;
+
+  // Move the pending deltas out before preempting, so that CINCRBY calls running during the flush
+  // accumulate new deltas. Counters that stayed idle during the whole period are evicted.
+  for (auto db_it = dbs_.begin(); db_it != dbs_.end();) {
+    Counters& counters = db_it->second;
+    Batch batch{db_it->first.first, db_it->first.second, {}};
+    for (auto it = counters.begin(); it != counters.end();) {
+      Entry& entry = it->second;
+      if (entry.delta == 0 && !entry.touched) {
+        counters.erase(it++);
+        --num_keys_;
+        continue;
+      }
+      if (entry.delta != 0) {
+        batch.args.push_back(it->first);
+        batch.args.push_back(absl::StrCat(exchange(entry.delta, 0)));
+      }
+      entry.touched = false;
+      ++it;
+    }
+
+    if (!batch.args.empty())
+      batches.push_back(std::move(batch));
+
+    if (counters.empty())
+      dbs_.erase(db_it++);
+    else
+      ++db_it;
+  }
+
+  for (Batch& batch : batches)
+    ApplyBatch(&batch);
+}
+
+void CounterBuffer::ApplyBatch(Batch* batch) {
+  CmdArgVec args;
+  args.reserve(batch->args.size());
+  for (string& s : batch->args)
+    args.emplace_back(s.data(), s.size());
+
+  // CFLUSH is journaled automatically with the keys of each shard, so replicas apply the same
+  // aggregated deltas.
+  boost::intrusive_ptr<Transaction> trans(new Transaction{flush_cid_});
+  OpStatus status = trans->InitByArgs(batch->ns, batch->db, absl::MakeSpan(args));
+  if (status != OpStatus::OK) {
+    LOG(DFATAL) << "Failed to flush counters " << status;
+    return;
+  }
+
+  vector<ShardValues> shard_values(shard_set->size());
+  trans->ScheduleSingleHop([&](Transaction* t, EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    shard_values[sid] = OpApplyDeltas(t->GetOpArgs(shard), t->GetShardArgs(sid));
+    return OpStatus::OK;
+  });
+
+  // The counters could be evicted by a flush or altered by CGET while the transaction ran.
+  auto db_it = dbs_.find(make_pair(batch->ns, batch->db));
+  for (const ShardValues& values : shard_values) {
+    for (const auto& [index, res] : values) {
+      const string& key = batch->args[index];
+      if (!res) {
+        LOG_EVERY_T(WARNING, 1) << "Dropped counter increment of " << key << ": " << res.status();
+      }
+      if (db_it == dbs_.end())
+        continue;
+
+      auto it = db_it->second.find(key);
+      if (it == db_it->second.end())
+        continue;
+
+      if (res) {
+        it->second.value = *res;
+      } else {
+        // The key does not hold a counter anymore, stop buffering it.
+        db_it->second.erase(it);
+        --num_keys_;
+      }
+    }
+  }
+}
+
+__thread CounterBuffer* tl_counters = nullptr;
+
+}  // namespace
+
+void CounterFamily::InitThreadLocal(const CommandId* flush_cid) {
+  uint32_t period_ms = absl::GetFlag(FLAGS_counter_flush_ms);
+  if (period_ms == 0)
+    return;
+
+  tl_counters = new CounterBuffer(flush_cid, absl::GetFlag(FLAGS_counter_max_keys));
+  tl_counters->Start(period_ms);
+}
+
+void CounterFamily::ShutdownThreadLocal() {
+  if (tl_counters) {
+    tl_counters->Stop();
+    delete tl_counters;
+    tl_counters = nullptr;
+  }
+}
+
+void CounterFamily::CIncrBy(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  string_view delta_arg = ArgS(args, 1);
+  int64_t delta;
+  if (!absl::SimpleAtoi(delta_arg, &delta))
+    return cntx->SendError(kInvalidIntErr);
+
+  Namespace* ns = cntx->ns;
+  DbIndex db = cntx->db_index();
+  if (tl_counters) {
+    if (optional<int64_t> estimate = tl_counters->TryAdd(ns, db, key, delta); estimate)
+      return cntx->SendLong(*estimate);
+  }
+
+  // The first increment of a counter on this thread is applied synchronously. It validates the
+  // type of the key and fetches the value that the following estimates are based on.
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    OpArgs op_args = t->GetOpArgs(shard);
+    OpResult<int64_t> res = OpIncrBy(op_args, key, delta);
+    if (res && shard->journal())
+      RecordJournal(op_args, "INCRBY"sv, ArgSlice{key, delta_arg});
+    return res;
+  };
+
+  OpResult<int64_t> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendIncrError(res.status(), cntx);
+
+  if (tl_counters)
+    tl_counters->Seed(ns, db, key, *res);
+  cntx->SendLong(*res);
+}
+
+void CounterFamily::CGet(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  Namespace* ns = cntx->ns;
+  DbIndex db = cntx->db_index();
+
+  // Collect the deltas buffered on all the threads. Squashed commands run inside a shard callback
+  // and can not wait for other threads, so they only collect the deltas of their own thread.
+  vector<int64_t> deltas(shard_set->pool()->size(), 0);
+  if (cntx->conn_state.squashing_info) {
+    if (tl_counters)
+      deltas[0] = tl_counters->Extract(ns, db, key);
+  } else {
+    shard_set->pool()->AwaitBrief([&](unsigned index, util::ProactorBase*) {
+      if (tl_counters)
+        deltas[index] = tl_counters->Extract(ns, db, key);
+    });
+  }
+
+  int64_t sum = 0;
+  bool overflow = false;
+  for (int64_t delta : deltas)
+    overflow |= __builtin_add_overflow(sum, delta, &sum);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<int64_t> {
+    OpArgs op_args = t->GetOpArgs(shard);
+    if (overflow)
+      return OpStatus::OUT_OF_RANGE;
+    if (sum == 0)
+      return OpGet(op_args, key);
+
+    OpResult<int64_t> res = OpIncrBy(op_args, key, sum);
+    if (res && shard->journal()) {
+      string sum_str = absl::StrCat(sum);
+      RecordJournal(op_args, "INCRBY"sv, ArgSlice{key, sum_str});
+    }
+    return res;
+  };
+
+  OpResult<int64_t> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (res)
+    return cntx->SendLong(*res);
+  if (res.status() == OpStatus::KEY_NOTFOUND)
+    return cntx->SendNull();
+  SendIncrError(res.status(), cntx);
+}
+
+void CounterFamily::CFlush(CmdArgList args, ConnectionContext* cntx) {
+  if (args.size() % 2 != 0)
+    return cntx->SendError(WrongNumArgsError("CFLUSH"));
+  if (!ValidateDeltas(args))
+    return cntx->SendError(kInvalidIntErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    OpApplyDeltas(t->GetOpArgs(shard), t->GetShardArgs(shard->shard_id()));
+    return OpStatus::OK;
+  };
+
+  cntx->transaction->ScheduleSingleHop(std::move(cb));
+  cntx->SendOk();
+}
+
+#define HFUNC(x) SetHandler(&CounterFamily::x)
+
+namespace acl {
+constexpr uint32_t kCIncrBy = WRITE | STRING | FAST;
+constexpr uint32_t kCGet = WRITE | STRING | SLOW;
+constexpr uint32_t kCFlush = WRITE | STRING | SLOW;
+}  // namespace acl
+
+void CounterFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  // CGET applies the collected deltas and journals them as INCRBY, CFLUSH applies the deltas
+  // flushed by the threads and is journaled as is.
+  *registry
+      << CI{"CINCRBY", CO::WRITE | CO::DENYOOM | CO::FAST | CO::NO_AUTOJOURNAL, 3, 1, 1,
+            acl::kCIncrBy}
+             .HFUNC(CIncrBy)
+      << CI{"CGET", CO::WRITE | CO::NO_AUTOJOURNAL, 2, 1, 1, acl::kCGet}.HFUNC(CGet)
+      << CI{"CFLUSH", CO::WRITE | CO::DENYOOM | CO::INTERLEAVED_KEYS | CO::HIDDEN, -3, 1, -1,
+            acl::kCFlush}
+             .HFUNC(CFlush);
+}
+
+}  // namespace dfly
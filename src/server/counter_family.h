@@ -0,0 +1,36 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandId;
+class CommandRegistry;
+class ConnectionContext;
+
+// Counters for keys that receive too many increments for a single shard thread.
+// CINCRBY accumulates the increments in a delta buffer of the connection thread and a background
+// fiber flushes the aggregated deltas to the shards every --counter_flush_ms with a single
+// multi-key transaction, which is also what gets journaled. CINCRBY replies with a bounded-stale
+// estimate, CGET collects the buffered deltas of all the threads and returns the exact value.
+class CounterFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+  // Starts the flushing fiber of the calling thread. flush_cid is the CFLUSH command.
+  static void InitThreadLocal(const CommandId* flush_cid);
+
+  // Flushes the remaining deltas and stops the fiber of the calling thread.
+  static void ShutdownThreadLocal();
+
+ private:
+  static void CIncrBy(CmdArgList args, ConnectionContext* cntx);
+  static void CGet(CmdArgList args, ConnectionContext* cntx);
+  static void CFlush(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
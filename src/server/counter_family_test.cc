@@ -0,0 +1,83 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/counter_family.h"
+
+#include "base/gtest.h"
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using namespace std;
+using namespace util;
+using testing::ElementsAre;
+
+class CounterFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(CounterFamilyTest, Basic) {
+  // The first increment is applied synchronously, the following ones are buffered.
+  EXPECT_THAT(Run({"cincrby", "c", "5"}), IntArg(5));
+  EXPECT_THAT(Run({"cincrby", "c", "3"}), IntArg(8));
+  EXPECT_THAT(Run({"cincrby", "c", "-10"}), IntArg(-2));
+  EXPECT_THAT(Run({"cget", "c"}), IntArg(-2));
+  EXPECT_THAT(Run({"get", "c"}), "-2");
+
+  EXPECT_THAT(Run({"cincrby", "c", "a"}), ErrArg("not an integer"));
+  EXPECT_EQ(Run({"cget", "missing"}).type, RespExpr::NIL);
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"cincrby", "str", "1"}), ErrArg("not an integer"));
+  EXPECT_THAT(Run({"cget", "str"}), ErrArg("not an integer"));
+  Run({"lpush", "l", "a"});
+  EXPECT_THAT(Run({"cincrby", "l", "1"}), ErrArg("WRONGTYPE"));
+
+  Run({"set", "max", absl::StrCat(INT64_MAX - 1)});
+  EXPECT_THAT(Run({"cincrby", "max", "1"}), IntArg(INT64_MAX));
+  EXPECT_THAT(Run({"cincrby", "max", "1"}), ErrArg("overflow"));
+}
+
+TEST_F(CounterFamilyTest, Flush) {
+  Run({"cincrby", "c", "1"});
+  for (unsigned i = 0; i < 100; ++i)
+    Run({"cincrby", "c", "1"});
+
+  // The flushing fiber eventually applies the buffered increments.
+  for (unsigned i = 0; i < 100 && Run({"get", "c"}) != "101"; ++i)
+    ThisFiber::SleepFor(10ms);
+  EXPECT_EQ(Run({"get", "c"}), "101");
+
+  // A key that changed its type drops its buffered increments and stops being buffered.
+  Run({"lpush", "c2", "a"});
+  Run({"rename", "c2", "c"});
+  Run({"cincrby", "c", "1"});
+  ThisFiber::SleepFor(50ms);
+  EXPECT_THAT(Run({"cincrby", "c", "1"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(CounterFamilyTest, MultipleThreads) {
+  const unsigned kThreads = min(3u, unsigned(pp_->size()));
+  for (unsigned i = 0; i < kThreads; ++i) {
+    pp_->at(i)->Await([&] {
+      for (unsigned j = 0; j < 10; ++j)
+        Run({"cincrby", "c", "2"});
+    });
+  }
+
+  // CGET collects the increments buffered on all the threads.
+  EXPECT_THAT(Run({"cget", "c"}), IntArg(20 * kThreads));
+  EXPECT_EQ(Run({"get", "c"}), absl::StrCat(20 * kThreads));
+}
+
+TEST_F(CounterFamilyTest, CFlush) {
+  Run({"set", "a", "1"});
+  EXPECT_EQ(Run({"cflush", "a", "5", "b", "-3"}), "OK");
+  EXPECT_THAT(Run({"mget", "a", "b"}), RespArray(ElementsAre("6", "-3")));
+  EXPECT_THAT(Run({"cflush", "a", "x"}), ErrArg("not an integer"));
+  EXPECT_THAT(Run({"cflush", "a", "1", "b"}), ErrArg("wrong number"));
+}
+
+}  // namespace dfly
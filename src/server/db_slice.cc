@@ -5,16 +5,23 @@
 #include "server/db_slice.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/strings/match.h>
+
+#include <cmath>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/dense_set.h"
+#include "core/frequency_sketch.h"
 #include "search/doc_index.h"
 #include "server/channel_store.h"
 #include "server/cluster/cluster_defs.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/generic_family.h"
+#include "server/hot_key_replicas.h"
 #include "server/journal/journal.h"
+#include "server/lazy_free.h"
 #include "server/server_state.h"
 #include "server/tiered_storage.h"
 #include "strings/human_readable.h"
@@ -33,9 +40,48 @@ ABSL_FLAG(double, table_growth_margin, 0.4,
           "Prevents table from growing if number of free slots x average object size x this ratio "
           "is larger than memory budget.");
 
+ABSL_FLAG(float, dash_presplit_utilization, 0,
+          "If positive, the heartbeat splits the dashtable segments that are filled above this "
+          "ratio, so that inserts rarely split segments or double the directory on their own. "
+          "Lower values trade memory for fewer latency spikes on writes");
+
+ABSL_FLAG(uint32_t, dash_max_displacements, 0,
+          "If positive, an insert into a full dashtable segment may relocate up to this many "
+          "entries between adjacent buckets before the segment is split. Raises the slot "
+          "utilization at the cost of a slower insert once in a while");
+
+ABSL_FLAG(uint32_t, expire_wheel_tick_ms, 0,
+          "If positive, active expiry deletes exactly the keys that are due, found with a timing "
+          "wheel of deadlines with this resolution, instead of sampling the expire table. "
+          "Costs a copy of every key with expiry.");
+
+ABSL_FLAG(std::string, cache_eviction_policy, "lru",
+          "Eviction policy of cache_mode. lru evicts the least recently used entry of the "
+          "segment an insertion goes to. tinylfu in addition tracks the access frequency of keys "
+          "and rejects the insertion with an out of memory error if the entry to evict is "
+          "accessed more frequently than the inserted key. volatile-ttl makes the memory "
+          "reclaiming evictions prefer the keys that are about to expire, sampled from the expire "
+          "table and weighted by the size of their values, and falls back to lru when no key has "
+          "an expiry.");
+
 ABSL_FLAG(std::string, notify_keyspace_events, "",
           "notify-keyspace-events. Only Ex is supported for now");
 
+ABSL_FLAG(std::vector<std::string>, notify_keyspace_events_prefixes, {},
+          "Comma separated list of key prefixes. If set, keyspace events are only published for "
+          "the keys that start with one of them");
+
+ABSL_FLAG(uint32_t, hot_key_replicas, 0,
+          "Max number of hot string keys per shard whose values are copied to all the threads, "
+          "so that GET is served by the connection thread without hopping to the shard. "
+          "0 disables the replication.");
+
+ABSL_FLAG(uint32_t, hot_key_replica_min_rps, 1000,
+          "Min number of reads per second of a key to be replicated with hot_key_replicas. "
+          "Replicas serving fewer reads are dropped.");
+
+ABSL_DECLARE_FLAG(uint32_t, top_keys_half_life_sec);
+
 namespace dfly {
 
 using namespace std;
@@ -56,6 +102,10 @@ static_assert(kPrimeSegmentSize == 32288);
 // 24576
 static_assert(kExpireSegmentSize == 23528);
 
+// 4 bit counters, 512KB per shard. Matches the access history of a few million keys per shard,
+// beyond which the estimates become coarser.
+constexpr size_t kAccessFreqCounters = 1 << 20;
+
 void AccountObjectMemory(string_view key, unsigned type, int64_t size, DbTable* db) {
   DCHECK_NE(db, nullptr);
   DbTableStats& stats = db->stats;
@@ -77,13 +127,14 @@ class PrimeEvictionPolicy {
   // mem_offset - memory_offset that we should account for in addition to DbSlice::memory_budget.
   // May be negative.
   PrimeEvictionPolicy(const DbContext& cntx, bool can_evict, ssize_t mem_offset, ssize_t soft_limit,
-                      DbSlice* db_slice, bool apply_memory_limit)
+                      DbSlice* db_slice, bool apply_memory_limit, bool can_expire = true)
       : db_slice_(db_slice),
         mem_offset_(mem_offset),
         soft_limit_(soft_limit),
         cntx_(cntx),
         can_evict_(can_evict),
-        apply_memory_limit_(apply_memory_limit) {
+        apply_memory_limit_(apply_memory_limit),
+        can_expire_(can_expire) {
   }
 
   // A hook function that is called every time a segment is full and requires splitting.
@@ -104,6 +155,10 @@ class PrimeEvictionPolicy {
     return checked_;
   }
 
+  unsigned rejected() const {
+    return rejected_;
+  }
+
  private:
   DbSlice* db_slice_;
   ssize_t mem_offset_;
@@ -112,11 +167,13 @@ class PrimeEvictionPolicy {
 
   unsigned evicted_ = 0;
   unsigned checked_ = 0;
+  unsigned rejected_ = 0;
 
   // unlike static constexpr can_evict, this parameter tells whether we can evict
   // items in runtime.
   const bool can_evict_;
   const bool apply_memory_limit_;
+  const bool can_expire_;  // whether GarbageCollect looks for expired items
 };
 
 class PrimeBumpPolicy {
@@ -154,6 +211,9 @@ bool PrimeEvictionPolicy::CanGrow(const PrimeTable& tbl) const {
 }
 
 unsigned PrimeEvictionPolicy::GarbageCollect(const PrimeTable::HotspotBuckets& eb, PrimeTable* me) {
+  if (!can_expire_)
+    return 0;
+
   unsigned res = 0;
   // bool should_print = (eb.key_hash % 128) == 0;
 
@@ -203,6 +263,14 @@ unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotspotBuckets& eb, PrimeT
     if (lt.Find(LockTag(key)).has_value())
       return 0;
 
+    // TinyLFU admission: keep the victim if it is more popular than the key being inserted.
+    if (const FrequencySketch* freq = db_slice_->access_freq(); freq) {
+      if (freq->Estimate(eb.key_hash) < freq->Estimate(last_slot_it->first.HashCode())) {
+        ++rejected_;
+        return 0;
+      }
+    }
+
     // log the evicted keys to journal.
     if (auto journal = db_slice_->shard_owner()->journal(); journal) {
       RecordExpiry(cntx_.db_index, key);
@@ -242,7 +310,7 @@ class FetchedItemsRestorer {
 
 DbStats& DbStats::operator+=(const DbStats& o) {
   constexpr size_t kDbSz = sizeof(DbStats) - sizeof(DbTableStats);
-  static_assert(kDbSz == 32);
+  static_assert(kDbSz == 40);
 
   DbTableStats::operator+=(o);
 
@@ -250,12 +318,13 @@ DbStats& DbStats::operator+=(const DbStats& o) {
   ADD(expire_count);
   ADD(bucket_count);
   ADD(table_mem_usage);
+  ADD(hot_key_replicas);
 
   return *this;
 }
 
 SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
-  static_assert(sizeof(SliceEvents) == 120, "You should update this function with new fields");
+  static_assert(sizeof(SliceEvents) == 136, "You should update this function with new fields");
 
   ADD(evicted_keys);
   ADD(hard_evictions);
@@ -268,6 +337,8 @@ SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
   ADD(misses);
   ADD(mutations);
   ADD(insertion_rejections);
+  ADD(admission_rejections);
+  ADD(evicted_volatile_keys);
   ADD(update);
   ADD(ram_hits);
   ADD(ram_cool_hits);
@@ -294,6 +365,15 @@ DbSlice::DbSlice(uint32_t index, bool caching_mode, EngineShard* owner)
     exit(0);
   }
   expired_keys_events_recording_ = !keyspace_events.empty();
+  keyspace_events_prefixes_ = GetFlag(FLAGS_notify_keyspace_events_prefixes);
+
+  if (string policy = GetFlag(FLAGS_cache_eviction_policy); policy == "tinylfu") {
+    access_freq_ = make_unique<FrequencySketch>(kAccessFreqCounters);
+  } else if (policy == "volatile-ttl") {
+    evict_volatile_first_ = true;
+  } else {
+    LOG_IF(WARNING, policy != "lru") << "Unknown cache_eviction_policy " << policy << ", using lru";
+  }
 }
 
 DbSlice::~DbSlice() {
@@ -320,10 +400,18 @@ auto DbSlice::GetStats() const -> Stats {
     stats = db_wrap.stats;
     stats.key_count = db_wrap.prime.size();
     stats.bucket_count = db_wrap.prime.bucket_count();
-    stats.expire_count = db_wrap.expire.size();
+    stats.expire_count = db_wrap.expire_count();
     stats.table_mem_usage = db_wrap.table_memory();
+    stats.hot_key_replicas = db_wrap.hot_replicas.size();
+    if (db_wrap.expire_wheel)
+      s.expire_wheel_bytes += db_wrap.expire_wheel->MallocUsed();
+    s.expired_pending_bytes += db_wrap.expired_pending * bytes_per_object_;
   }
-  s.small_string_bytes = CompactObj::GetStats().small_string_bytes;
+  s.reply_cache_bytes = reply_cache_.MallocUsed();
+  CompactObj::Stats co_stats = CompactObj::GetStats();
+  s.small_string_bytes = co_stats.small_string_bytes;
+  s.key_prefixes = co_stats.key_prefixes;
+  s.key_prefix_bytes = co_stats.key_prefix_bytes;
 
   return s;
 }
@@ -333,13 +421,170 @@ SlotStats DbSlice::GetSlotStats(cluster::SlotId sid) const {
   return db_arr_[0]->slots_stats[sid];
 }
 
-void DbSlice::Reserve(DbIndex db_ind, size_t key_size) {
+void DbSlice::PreSplitStep() {
+  // Bounds the heartbeat work: SlowSize() of a segment sums its buckets.
+  constexpr unsigned kVisitSegments = 512, kMaxSplits = 4;
+
+  float utilization = GetFlag(FLAGS_dash_presplit_utilization);
+
+  // Like Reserve(), splitting outside of insertions bypasses the change callbacks of snapshots in
+  // progress. We also grow the tables ahead of time only while memory is plentiful.
+  if (utilization <= 0 || HasRegisteredCallbacks() || memory_budget_ < ssize_t(soft_budget_limit_))
+    return;
+
+  util::fb2::LockGuard lk(local_mu_);
+  for (auto& db : db_arr_) {
+    if (!db)
+      continue;
+
+    ssize_t prime_before = db->prime.mem_usage();
+    db->prime.PreSplitStep(&db->presplit_cursor, kVisitSegments, kMaxSplits, utilization);
+    ssize_t prime_increase = db->prime.mem_usage() - prime_before;
+    memory_budget_ -= prime_increase;
+    table_memory_ += prime_increase;
+  }
+}
+
+void DbSlice::UpdateSlotLoad(uint64_t now_ms) {
+  // Time constant of the moving average, older rates fade out with exp(-age / kSlotLoadWindowMs)
+  constexpr double kSlotLoadWindowMs = 10000;
+
+  if (!db_arr_[0] || db_arr_[0]->slots_load.empty())
+    return;
+
+  uint64_t elapsed_ms = now_ms - slot_load_update_ms_;
+  if (elapsed_ms < 1000)
+    return;
+
+  bool first = slot_load_update_ms_ == 0;
+  slot_load_update_ms_ = now_ms;
+  double alpha = 1 - exp(-double(elapsed_ms) / kSlotLoadWindowMs);
+
+  DbTable& db = *db_arr_[0];
+  for (size_t sid = 0; sid < db.slots_load.size(); ++sid) {
+    SlotLoad& load = db.slots_load[sid];
+    uint64_t ops = db.slots_stats[sid].total_reads + db.slots_stats[sid].total_writes;
+    if (!first && ops > load.last_ops) {
+      double rate = (ops - load.last_ops) * 1000.0 / elapsed_ms;
+      load.ops_per_sec += alpha * (rate - load.ops_per_sec);
+    } else {
+      load.ops_per_sec -= alpha * load.ops_per_sec;
+    }
+    load.last_ops = ops;
+  }
+}
+
+void DbSlice::UpdateHotKeyReplicas(uint64_t now_ms) {
+  // Values are copied to every thread, large ones are not worth the memory.
+  constexpr size_t kMaxValueSize = 64_KB;
+
+  uint64_t elapsed_ms = now_ms - hot_replicas_update_ms_;
+  if (elapsed_ms < 1000)
+    return;
+  hot_replicas_update_ms_ = now_ms;
+
+  size_t max_replicas = GetFlag(FLAGS_hot_key_replicas);
+  uint64_t min_rps = GetFlag(FLAGS_hot_key_replica_min_rps);
+
+  // Reads served by the replicas are not seen by the shard, so they are counted by the replicas.
+  size_t num_replicas = 0;
+  for (auto& db : db_arr_) {
+    if (!db)
+      continue;
+    for (auto it = db->hot_replicas.begin(); it != db->hot_replicas.end();) {
+      HotKeyReplica& replica = *it->second;
+      uint64_t hits = replica.Hits();
+      uint64_t rps = (hits - replica.checked_hits) * 1000 / elapsed_ms;
+      replica.checked_hits = hits;
+      if (num_replicas < max_replicas && rps >= min_rps) {
+        ++num_replicas;
+        ++it;
+        continue;
+      }
+      HotKeyReplicas::Invalidate(std::move(it->second));
+      db->hot_replicas.erase(it++);
+    }
+  }
+
+  if (num_replicas >= max_replicas)
+    return;
+
+  // With a half life of H seconds, the top keys count of a key read R times per second stays
+  // between R * H and 2 * R * H, so we take the lower bound of the rate.
+  uint64_t half_life_sec = GetFlag(FLAGS_top_keys_half_life_sec);
+  uint64_t min_count = min_rps * max<uint64_t>(half_life_sec * 2, 1);
+
+  for (auto& db : db_arr_) {
+    if (!db || !db->top_keys.IsEnabled())
+      continue;
+
+    db->top_keys.MaybeDecay(absl::GetCurrentTimeNanos() / 1000000);
+    for (const TopKeys::Entry& entry : db->top_keys.GetTopEntries()) {
+      if (num_replicas >= max_replicas)
+        return;
+      if (entry.count < min_count || db->hot_replicas.contains(entry.key))
+        continue;
+
+      PrimeIterator it = db->prime.Find(entry.key);
+      if (!IsValid(it))
+        continue;
+
+      // Keys with expiry are not replicated, so that the copies never outlive their keys.
+      const PrimeValue& pv = it->second;
+      if (pv.ObjType() != OBJ_STRING || pv.HasExpire() || pv.IsExternal() ||
+          pv.Size() > kMaxValueSize)
+        continue;
+
+      string value;
+      pv.GetString(&value);
+      auto replica = make_shared<HotKeyReplica>(db->index, entry.key, std::move(value),
+                                                shard_set->pool()->size());
+      db->hot_replicas.emplace(entry.key, replica);
+      HotKeyReplicas::Publish(std::move(replica));
+      ++num_replicas;
+    }
+  }
+}
+
+void DbSlice::InvalidateHotKeyReplica(DbTable* db, std::string_view key) {
+  if (db->hot_replicas.empty())
+    return;
+
+  if (auto it = db->hot_replicas.find(key); it != db->hot_replicas.end()) {
+    HotKeyReplicas::Invalidate(std::move(it->second));
+    db->hot_replicas.erase(it);
+  }
+}
+
+double DbSlice::GetSlotOpsRate(cluster::SlotId sid) const {
+  CHECK(db_arr_[0]);
+  return db_arr_[0]->slots_load[sid].ops_per_sec;
+}
+
+void DbSlice::Reserve(DbIndex db_ind, size_t key_size, size_t expire_size) {
   ActivateDb(db_ind);
 
   auto& db = db_arr_[db_ind];
   DCHECK(db);
 
-  db->prime.Reserve(key_size);
+  db->reserved_keys += key_size;
+  db->reserved_expires += expire_size;
+
+  // Growing splits segments outside of insertions, which bypasses the change callbacks that keep
+  // the buckets of snapshots in progress consistent.
+  if (HasRegisteredCallbacks())
+    return;
+
+  util::fb2::LockGuard lk(local_mu_);
+  ssize_t prime_before = db->prime.mem_usage();
+  size_t expire_before = db->expire.mem_usage();
+  db->prime.Reserve(db->reserved_keys);
+  if (!db->inline_expire)
+    db->expire.Reserve(db->reserved_expires);
+
+  ssize_t prime_increase = db->prime.mem_usage() - prime_before;
+  memory_budget_ -= prime_increase;
+  table_memory_ += prime_increase + (db->expire.mem_usage() - expire_before);
 }
 
 DbSlice::AutoUpdater::AutoUpdater() {
@@ -442,16 +687,61 @@ OpResult<DbSlice::ConstIterator> DbSlice::FindReadOnly(const Context& cntx, stri
   return res.status();
 }
 
+void DbSlice::FindManyReadOnly(const Context& cntx, absl::Span<const std::string_view> keys,
+                               std::optional<unsigned> req_obj_type,
+                               absl::Span<OpResult<ConstIterator>> dest) const {
+  DCHECK_EQ(keys.size(), dest.size());
+  if (!IsDbValid(cntx.db_index)) {
+    std::fill(dest.begin(), dest.end(), OpStatus::KEY_NOTFOUND);
+    return;
+  }
+
+  // Batches are small enough so that the prefetched buckets are not evicted
+  // before we get to resolve them.
+  constexpr size_t kBatchSize = 32;
+  const PrimeTable& prime = db_arr_[cntx.db_index]->prime;
+  uint64_t hashes[kBatchSize];
+
+  for (size_t start = 0; start < keys.size(); start += kBatchSize) {
+    size_t len = std::min(kBatchSize, keys.size() - start);
+    for (size_t i = 0; i < len; ++i) {
+      hashes[i] = prime.DoHash(keys[start + i]);
+      prime.Prefetch(hashes[i]);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+      string_view key = keys[start + i];
+      auto res = FindInternal(cntx, key, req_obj_type, UpdateStatsMode::kReadStats, hashes[i]);
+      if (res.ok()) {
+        dest[start + i] = ConstIterator(res->it, StringOrView::FromView(key));
+      } else {
+        dest[start + i] = res.status();
+      }
+    }
+  }
+}
+
+void DbSlice::PrefetchKeys(DbIndex db_ind, absl::Span<const std::string_view> keys) const {
+  if (!IsDbValid(db_ind))
+    return;
+
+  const PrimeTable& prime = db_arr_[db_ind]->prime;
+  for (string_view key : keys) {
+    prime.Prefetch(prime.DoHash(key));
+  }
+}
+
 OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std::string_view key,
                                                        std::optional<unsigned> req_obj_type,
-                                                       UpdateStatsMode stats_mode) const {
+                                                       UpdateStatsMode stats_mode,
+                                                       std::optional<uint64_t> key_hash) const {
   if (!IsDbValid(cntx.db_index)) {
     return OpStatus::KEY_NOTFOUND;
   }
 
   DbSlice::PrimeItAndExp res;
   auto& db = *db_arr_[cntx.db_index];
-  res.it = db.prime.Find(key);
+  res.it = key_hash ? db.prime.Find(key, *key_hash) : db.prime.Find(key);
 
   absl::Cleanup update_stats_on_miss = [&]() {
     switch (stats_mode) {
@@ -472,6 +762,17 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
     return OpStatus::WRONG_TYPE;
   }
 
+  // Unlike strings, offloaded containers are accessed directly, so they are uploaded back first.
+  if (const PrimeValue& pv = res.it->second;
+      pv.IsExternal() && !pv.IsCool() && pv.ObjType() != OBJ_STRING) {
+    owner_->tiered_storage()->FetchContainer(cntx.db_index, key, pv);
+
+    // The table could have changed while we were waiting for the read.
+    res.it = db.prime.Find(key);
+    if (!IsValid(res.it))
+      return OpStatus::KEY_NOTFOUND;
+  }
+
   if (res.it->second.HasExpire()) {  // check expiry state
     res = ExpireIfNeeded(cntx, res.it);
     if (!IsValid(res.it)) {
@@ -534,9 +835,16 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
   // Mark this entry as being looked up. We use key (first) deliberately to preserve the hotness
   // attribute of the entry in case of value overrides.
   res.it->first.SetTouched(true);
+  if (access_freq_)
+    access_freq_->Increment(CompactObj::HashCode(key));
+  if (access_observer_)
+    access_observer_(cntx.db_index, key);
+  if (owner_->tiered_storage())
+    owner_->tiered_storage()->RecordAccess(key);
 
-  // We do not use TopKey feature, so disable it until we redesign it.
-  // db.top_keys.Touch(key);
+  db.top_keys.Touch(key, [&pv] {
+    return pv.ObjType() == OBJ_STRING ? pv.Size() : pv.MallocUsed();
+  });
 
   return res;
 }
@@ -605,8 +913,8 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
   // snapshot or from replication the conservative memory checks might fail as the new tree might
   // have more segments. Because we dont want to fail loading a snapshot from the same server
   // configuration we disable this checks on loading and replication.
-  bool apply_memory_limit =
-      !owner_->IsReplica() && !(ServerState::tlocal()->gstate() == GlobalState::LOADING);
+  bool loading = ServerState::tlocal()->gstate() == GlobalState::LOADING;
+  bool apply_memory_limit = !owner_->IsReplica() && !loading;
 
   // If we are over limit in non-cache scenario, just be conservative and throw.
   if (apply_memory_limit && !caching_mode_ && memory_budget_ + memory_offset < 0) {
@@ -616,23 +924,43 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
     return OpStatus::OUT_OF_MEMORY;
   }
 
-  PrimeEvictionPolicy evp{cntx,          (bool(caching_mode_) && !owner_->IsReplica()),
-                          memory_offset, ssize_t(soft_budget_limit_),
-                          this,          apply_memory_limit};
+  // Loaded items are not expired, so there is no garbage to collect while loading.
+  PrimeEvictionPolicy evp{cntx,
+                          (bool(caching_mode_) && !owner_->IsReplica()),
+                          memory_offset,
+                          ssize_t(soft_budget_limit_),
+                          this,
+                          apply_memory_limit,
+                          !loading};
 
   // Fast-path if change_cb_ is empty so we Find or Add using
   // the insert operation: twice more efficient.
-  CompactObj co_key{key};
+  CompactObj co_key;
+  co_key.SetKey(key);
   PrimeIterator it;
 
   ssize_t table_before = db.prime.mem_usage();
 
+  // The insertion counts as an access, so that keys written repeatedly get admitted.
+  if (access_freq_)
+    access_freq_->Increment(CompactObj::HashCode(key));
+  if (access_observer_)
+    access_observer_(cntx.db_index, key);
+
+  // Relocated entries are not visible to the bucket versions of snapshots in progress.
+  db.prime.set_max_displacements(
+      HasRegisteredCallbacks() ? 0 : min(GetFlag(FLAGS_dash_max_displacements), 16u));
+
   try {
     it = db.prime.InsertNew(std::move(co_key), PrimeValue{}, evp);
   } catch (bad_alloc& e) {
+    events_.insertion_rejections++;
+    if (evp.rejected()) {
+      events_.admission_rejections++;
+      return OpStatus::OUT_OF_MEMORY;
+    }
     LOG_EVERY_T(ERROR, 1) << "AddOrFind: InsertNew failed, budget: " << memory_budget_
                           << " reclaimed: " << reclaimed << " offset: " << memory_offset;
-    events_.insertion_rejections++;
     return OpStatus::OUT_OF_MEMORY;
   }
 
@@ -671,6 +999,8 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
   if (cluster::IsClusterEnabled()) {
     cluster::SlotId sid = cluster::KeySlot(key);
     db.slots_stats[sid].key_count += 1;
+    if (!db.slot_keys.empty())
+      db.slot_keys[sid].emplace(key);
   }
 
   return DbSlice::AddOrFindResult{
@@ -756,17 +1086,37 @@ void DbSlice::FlushSlotsFb(const cluster::SlotSet& slot_ids) {
 
   ServerState& etl = *ServerState::tlocal();
   PrimeTable* pt = &db_arr_[0]->prime;
-  PrimeTable::Cursor cursor;
   uint64_t i = 0;
-  do {
-    PrimeTable::Cursor next = Traverse(pt, cursor, del_entry_cb);
-    ++i;
-    cursor = next;
-    if (i % 100 == 0) {
-      ThisFiber::Yield();
+  if (const auto& slot_keys = db_arr_[0]->slot_keys; !slot_keys.empty()) {
+    // Visit only the keys of the flushed slots. They are copied because deletions and
+    // concurrent writes change the index while we yield.
+    vector<string> keys;
+    for (cluster::SlotId sid = 0; sid < cluster::SlotSet::kSlotsNumber; ++sid) {
+      if (!slot_ids.Contains(sid))
+        continue;
+
+      keys.assign(slot_keys[sid].begin(), slot_keys[sid].end());
+      for (const string& key : keys) {
+        if (etl.gstate() == GlobalState::SHUTTING_DOWN)
+          break;
+        if (auto it = pt->Find(key); IsValid(it))
+          del_entry_cb(it);
+        if (++i % 100 == 0)
+          ThisFiber::Yield();
+      }
     }
+  } else {
+    PrimeTable::Cursor cursor;
+    do {
+      PrimeTable::Cursor next = Traverse(pt, cursor, del_entry_cb);
+      ++i;
+      cursor = next;
+      if (i % 100 == 0) {
+        ThisFiber::Yield();
+      }
 
-  } while (cursor && etl.gstate() != GlobalState::SHUTTING_DOWN);
+    } while (cursor && etl.gstate() != GlobalState::SHUTTING_DOWN);
+  }
 
   UnregisterOnChange(next_version);
 
@@ -775,7 +1125,8 @@ void DbSlice::FlushSlotsFb(const cluster::SlotSet& slot_ids) {
 
 void DbSlice::FlushSlots(cluster::SlotRanges slot_ranges) {
   cluster::SlotSet slot_set(slot_ranges);
-  InvalidateSlotWatches(slot_set);
+  // Slot flushes are rare, so all the watches of the database are invalidated.
+  db_arr_[0]->flush_version = NextVersion();
   fb2::Fiber("flush_slots", [this, slot_set = std::move(slot_set)]() mutable {
     FlushSlotsFb(slot_set);
   }).Detach();
@@ -797,22 +1148,22 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
     table_memory_ -= db_arr_[index]->table_memory();
     entries_count_ -= db_arr_[index]->prime.size();
 
-    InvalidateDbWatches(index);
+    for (auto& [key, replica] : db_arr_[index]->hot_replicas)
+      HotKeyReplicas::Invalidate(std::move(replica));
+    db_arr_[index]->hot_replicas.clear();
+    reply_cache_.Clear(index);
     flush_db_arr[index] = std::move(db_arr_[index]);
 
     CreateDb(index);
+    db_arr_[index]->flush_version = NextVersion();
     std::swap(db_arr_[index]->trans_locks, flush_db_arr[index]->trans_locks);
   }
 
   CHECK(fetched_items_.empty());
 
-  auto cb = [indexes, flush_db_arr = std::move(flush_db_arr)]() mutable {
-    flush_db_arr.clear();
-    ServerState::tlocal()->DecommitMemory(ServerState::kDataHeap | ServerState::kBackingHeap |
-                                          ServerState::kGlibcmalloc);
-  };
-
-  fb2::Fiber("flush_dbs", std::move(cb)).Detach();
+  // The detached tables are freed in time slices by the background freer, which also returns
+  // the released memory to the OS once it is done.
+  owner_->lazy_freer()->AddTables(std::move(flush_db_arr));
 }
 
 void DbSlice::FlushDb(DbIndex db_ind) {
@@ -840,24 +1191,66 @@ void DbSlice::FlushDb(DbIndex db_ind) {
   FlushDbIndexes(indexes);
 }
 
+void DbSlice::SwapTables(DbSlice* other) {
+  DCHECK_EQ(owner_, other->owner_);
+  util::fb2::LockGuard lk(local_mu_);
+  client_tracking_map_.clear();
+
+  size_t db_cnt = std::max(db_arr_.size(), other->db_arr_.size());
+  for (DbIndex index = 0; index < db_cnt; ++index) {
+    ActivateDb(index);
+    other->ActivateDb(index);
+
+    for (auto& [key, replica] : db_arr_[index]->hot_replicas)
+      HotKeyReplicas::Invalidate(std::move(replica));
+    db_arr_[index]->hot_replicas.clear();
+    reply_cache_.Clear(index);
+
+    std::swap(db_arr_[index], other->db_arr_[index]);
+    std::swap(db_arr_[index]->trans_locks, other->db_arr_[index]->trans_locks);
+  }
+
+  // The swapped in tables were versioned by the other slice. Keep the versions of this one above
+  // theirs and make the watches of the replaced tables stale.
+  version_ = std::max(version_, other->version_);
+  for (auto& db : db_arr_) {
+    if (db)
+      db->flush_version = NextVersion();
+  }
+
+  std::swap(table_memory_, other->table_memory_);
+  std::swap(entries_count_, other->entries_count_);
+  CHECK(fetched_items_.empty());
+}
+
 void DbSlice::AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at) {
   util::fb2::LockGuard lk(local_mu_);
   uint64_t delta = at - expire_base_[0];  // TODO: employ multigen expire updates.
   auto& db = *db_arr_[db_ind];
-  size_t table_before = db.expire.mem_usage();
-  CHECK(db.expire.Insert(main_it->first.AsRef(), ExpirePeriod(delta)).second);
-  table_memory_ += (db.expire.mem_usage() - table_before);
+  DCHECK(!main_it->second.HasExpire());
+  size_t table_before = db.table_memory();
+  db.InsertExpire(main_it.GetInnerIt(), ExpirePeriod(delta));
+  table_memory_ += (db.table_memory() - table_before);
   main_it->second.SetExpire(true);
+  IndexExpiry(&db, main_it.key(), at);
+  InvalidateHotKeyReplica(&db, main_it.key());
+}
+
+void DbSlice::SetExpireTime(DbIndex db_ind, const ExpIterator& exp_it, uint64_t at) {
+  exp_it->second = FromAbsoluteTime(at);
+  IndexExpiry(db_arr_[db_ind].get(), exp_it.key(), at);
 }
 
 bool DbSlice::RemoveExpire(DbIndex db_ind, Iterator main_it) {
   util::fb2::LockGuard lk(local_mu_);
   if (main_it->second.HasExpire()) {
     auto& db = *db_arr_[db_ind];
-    size_t table_before = db.expire.mem_usage();
-    CHECK_EQ(1u, db.expire.Erase(main_it->first));
+    size_t table_before = db.table_memory();
+    auto exp_it = db.FindExpire(main_it.GetInnerIt());
+    CHECK(IsValid(exp_it));
+    db.EraseExpire(exp_it);
     main_it->second.SetExpire(false);
-    table_memory_ += (db.expire.mem_usage() - table_before);
+    table_memory_ += (db.table_memory() - table_before);
     return true;
   }
   return false;
@@ -960,7 +1353,7 @@ OpResult<int64_t> DbSlice::UpdateExpire(const Context& cntx, Iterator prime_it,
       return OpStatus::SKIPPED;
     }
 
-    expire_it->second = FromAbsoluteTime(abs_msec);
+    SetExpireTime(cntx.db_index, expire_it, abs_msec);
     return abs_msec;
   } else {
     if (params.expire_options & ExpireFlags::EXPIRE_XX) {
@@ -995,11 +1388,13 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrUpdateInternal(const Context& c
     uint64_t delta = expire_at_ms - expire_base_[0];
     if (IsValid(res.exp_it) && force_update) {
       res.exp_it->second = ExpirePeriod(delta);
+      IndexExpiry(&db, key, expire_at_ms);
     } else {
-      size_t table_before = db.expire.mem_usage();
-      auto exp_it = db.expire.InsertNew(it->first.AsRef(), ExpirePeriod(delta));
+      size_t table_before = db.table_memory();
+      auto exp_it = db.InsertExpire(it.GetInnerIt(), ExpirePeriod(delta));
       res.exp_it = ExpIterator(exp_it, StringOrView::FromView(key));
-      table_memory_ += (db.expire.mem_usage() - table_before);
+      table_memory_ += (db.table_memory() - table_before);
+      IndexExpiry(&db, key, expire_at_ms);
     }
   }
 
@@ -1020,6 +1415,15 @@ size_t DbSlice::DbSize(DbIndex db_ind) const {
   return 0;
 }
 
+size_t DbSlice::UsedMemory() const {
+  size_t res = table_memory_;
+  for (const auto& db : db_arr_) {
+    if (db)
+      res += db->stats.obj_memory_usage;
+  }
+  return res;
+}
+
 bool DbSlice::Acquire(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
   if (lock_args.fps.empty()) {  // Can be empty for NO_KEY_TRANSACTIONAL commands.
     return true;
@@ -1032,13 +1436,7 @@ bool DbSlice::Acquire(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
     lock_acquired = lt.Acquire(lock_args.fps.front(), mode);
     uniq_fps_ = {lock_args.fps.front()};  // needed only for tests.
   } else {
-    uniq_fps_.clear();
-
-    for (LockFp fp : lock_args.fps) {
-      if (uniq_fps_.insert(fp).second) {
-        lock_acquired &= lt.Acquire(fp, mode);
-      }
-    }
+    lock_acquired = lt.Acquire(lock_args.fps, mode, &uniq_fps_);
   }
 
   DVLOG(2) << "Acquire " << IntentLock::ModeName(mode) << " for " << lock_args.fps[0]
@@ -1058,12 +1456,7 @@ void DbSlice::Release(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
     uint64_t fp = lock_args.fps.front();
     lt.Release(fp, mode);
   } else {
-    uniq_fps_.clear();
-    for (LockFp fp : lock_args.fps) {
-      if (uniq_fps_.insert(fp).second) {
-        lt.Release(fp, mode);
-      }
-    }
+    lt.Release(lock_args.fps, mode, &uniq_fps_);
   }
   uniq_fps_.clear();
 }
@@ -1077,6 +1470,14 @@ bool DbSlice::CheckLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const
   return true;
 }
 
+bool DbSlice::CheckLock(IntentLock::Mode mode, const KeyLockArgs& lock_args) const {
+  for (LockFp fp : lock_args.fps) {
+    if (!CheckLock(mode, lock_args.db_index, fp))
+      return false;
+  }
+  return true;
+}
+
 void DbSlice::PreUpdate(DbIndex db_ind, Iterator it, std::string_view key) {
   FetchedItemsRestorer fetched_restorer(&fetched_items_);
   util::fb2::LockGuard lk(local_mu_);
@@ -1089,24 +1490,14 @@ void DbSlice::PostUpdate(DbIndex db_ind, Iterator it, std::string_view key, size
   AccountObjectMemory(key, it->second.ObjType(), delta, GetDBTable(db_ind));
 
   auto& db = *db_arr_[db_ind];
-  auto& watched_keys = db.watched_keys;
-  if (!watched_keys.empty()) {
-    // Check if the key is watched.
-    if (auto wit = watched_keys.find(key); wit != watched_keys.end()) {
-      for (auto conn_ptr : wit->second) {
-        conn_ptr->watched_dirty.store(true, memory_order_relaxed);
-      }
-      // No connections need to watch it anymore.
-      watched_keys.erase(wit);
-    }
-  }
-
   ++events_.update;
 
   if (cluster::IsClusterEnabled()) {
     db.slots_stats[cluster::KeySlot(key)].total_writes += 1;
   }
 
+  InvalidateHotKeyReplica(&db, key);
+  reply_cache_.Invalidate(db_ind, key);
   SendInvalidationTrackingMessage(key);
 }
 
@@ -1123,7 +1514,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
 
   auto& db = db_arr_[cntx.db_index];
 
-  auto expire_it = db->expire.Find(it->first);
+  auto expire_it = db->FindExpire(it);
 
   // TODO: Accept Iterator instead of PrimeIterator, as this might save an allocation below.
   string scratch;
@@ -1139,7 +1530,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
   } else {
     LOG(ERROR) << "Internal error, entry " << it->first.ToString()
                << " not found in expire table, db_index: " << cntx.db_index
-               << ", expire table size: " << db->expire.size()
+               << ", expire table size: " << db->expire_count()
                << ", prime table size: " << db->prime.size() << util::fb2::GetStacktrace();
   }
 
@@ -1148,8 +1539,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
     RecordExpiry(cntx.db_index, key);
   }
 
-  if (expired_keys_events_recording_)
-    db->expired_keys_events_.emplace_back(key);
+  RecordKeyspaceEvent(db.get(), key);
 
   auto obj_type = it->second.ObjType();
   if (doc_del_cb_ && (obj_type == OBJ_JSON || obj_type == OBJ_HASH)) {
@@ -1170,6 +1560,19 @@ void DbSlice::ExpireAllIfNeeded() {
       continue;
     auto& db = *db_arr_[db_index];
 
+    if (db.inline_expire) {
+      auto cb = [&](PrimeTable::iterator prime_it) {
+        if (prime_it->second.HasExpire())
+          ExpireIfNeeded(Context{nullptr, db_index, GetCurrentTimeMs()}, prime_it);
+      };
+
+      PrimeTable::Cursor cursor;
+      do {
+        cursor = Traverse(&db.prime, cursor, cb);
+      } while (cursor);
+      continue;
+    }
+
     auto cb = [&](ExpireTable::iterator exp_it) {
       auto prime_it = db.prime.Find(exp_it->first);
       if (!IsValid(prime_it)) {
@@ -1228,7 +1631,8 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
 
   std::string stash;
 
-  auto cb = [&](ExpireIterator it) {
+  // prime_it is passed when the expiries are stored inline, saving the lookup by key.
+  auto check_expiry = [&](ExpireIterator it, PrimeIterator prime_it) {
     auto key = it->first.GetSlice(&stash);
     if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key))
       return;
@@ -1236,7 +1640,8 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
     result.traversed++;
     time_t ttl = ExpireTime(it) - cntx.time_now_ms;
     if (ttl <= 0) {
-      auto prime_it = db.prime.Find(it->first);
+      if (prime_it.is_done())
+        prime_it = db.prime.Find(it->first);
       CHECK(!prime_it.is_done());
       ExpireIfNeeded(cntx, prime_it);
       ++result.deleted;
@@ -1245,23 +1650,149 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
     }
   };
 
-  unsigned i = 0;
-  for (; i < count / 3; ++i) {
-    db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
+  auto traverse = [&] {
+    if (db.inline_expire) {
+      db.expire_cursor = db.prime.Traverse(db.expire_cursor, [&](PrimeIterator it) {
+        if (it->second.HasExpire())
+          check_expiry(ExpireIterator::Inline(it), it);
+      });
+    } else {
+      db.expire_cursor = db.expire.Traverse(
+          db.expire_cursor, [&](ExpireTable::iterator it) { check_expiry(it, PrimeIterator{}); });
+    }
+  };
+
+  if (db.expire_wheel) {
+    DeleteDueStep(cntx, count, &result);
+  } else {
+    unsigned i = 0;
+    for (; i < count / 3; ++i) {
+      traverse();
+    }
+
+    // continue traversing only if we had strong deletion rate based on the first sample.
+    if (result.deleted * 4 > result.traversed) {
+      for (; i < count; ++i) {
+        traverse();
+      }
+    }
+
+    // Assumes that the keys left have expired at the rate observed in the sample.
+    db.expired_pending =
+        result.traversed ? db.expire_count() * result.deleted / result.traversed : 0;
+  }
+
+  return result;
+}
+
+void DbSlice::DeleteDueStep(const Context& cntx, unsigned count, DeleteExpiredStats* result) {
+  auto& db = *db_arr_[cntx.db_index];
+
+  // Keys are deleted by the master, replicas keep their deadlines until they are promoted.
+  if (owner_->IsReplica() || !expire_allowed_) {
+    db.expired_pending = db.expire_wheel->DueCount(cntx.time_now_ms);
+    return;
   }
 
-  // continue traversing only if we had strong deletion rate based on the first sample.
-  if (result.deleted * 4 > result.traversed) {
-    for (; i < count; ++i) {
-      db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
+  // A sampling step visits count buckets, the wheel is given a similar budget of keys.
+  size_t limit = size_t(count) * ExpireTable::kSlotNum;
+  vector<string> locked;
+
+  db.expire_wheel->Advance(cntx.time_now_ms, limit, [&](string_view key, uint64_t) {
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      locked.emplace_back(key);
+      return;
+    }
+
+    // The wheel is not updated on deletions and on changes of the expiry time.
+    auto prime_it = db.prime.Find(key);
+    if (!IsValid(prime_it) || !prime_it->second.HasExpire())
+      return;
+
+    result->traversed++;
+    time_t expire_time = ExpireTime(db.FindExpire(prime_it));
+    time_t ttl = expire_time - cntx.time_now_ms;
+    if (ttl <= 0) {
+      ExpireIfNeeded(cntx, prime_it);
+      ++result->deleted;
+    } else {
+      db.expire_wheel->Add(key, expire_time);
+      result->survivor_ttl_sum += ttl;
     }
+  });
+
+  // Retried by the next step, re-adding them above would report them again right away.
+  for (const string& key : locked) {
+    db.expire_wheel->Add(key, cntx.time_now_ms);
   }
+  db.expired_pending = db.expire_wheel->DueCount(cntx.time_now_ms);
+}
 
-  // Send and clear accumulated expired key events
-  if (auto& events = db_arr_[cntx.db_index]->expired_keys_events_; !events.empty()) {
-    ChannelStore* store = ServerState::tlocal()->channel_store();
-    store->SendMessages(absl::StrCat("__keyevent@", cntx.db_index, "__:expired"), events);
-    events.clear();
+void DbSlice::RegisterMemberExpiry(const Context& cntx, string_view key, uint32_t ttl_sec) {
+  uint64_t expire_at = uint64_t(MemberTimeSeconds(cntx.time_now_ms)) + ttl_sec;
+  uint64_t bucket = (expire_at / kMemberExpiryGranularity + 1) * kMemberExpiryGranularity;
+  if (bucket > UINT32_MAX)
+    return;
+  db_arr_[cntx.db_index]->member_expiry[bucket].emplace(key);
+}
+
+auto DbSlice::CollectExpiredMembersStep(const Context& cntx, unsigned budget)
+    -> MemberExpiryStats {
+  auto& db = *db_arr_[cntx.db_index];
+  MemberExpiryStats result;
+  uint32_t now_sec = MemberTimeSeconds(cntx.time_now_ms);
+
+  while (budget > 0) {
+    if (db.member_expiry_key.empty()) {
+      auto bucket_it = db.member_expiry.begin();
+      if (bucket_it == db.member_expiry.end() || bucket_it->first > now_sec)
+        break;
+
+      auto& keys = bucket_it->second;
+      db.member_expiry_key = std::move(keys.extract(keys.begin()).value());
+      db.member_expiry_cursor = 0;
+      if (keys.empty())
+        db.member_expiry.erase(bucket_it);
+    }
+
+    // The updater below refers to the key, so it must outlive member_expiry_key.
+    string key = db.member_expiry_key;
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      // Retry once the transaction holding the key is done.
+      RegisterMemberExpiry(cntx, key, 0);
+      db.member_expiry_key.clear();
+      continue;
+    }
+
+    auto res = FindMutable(cntx, key);
+    if (!IsValid(res.it) || res.it->second.Encoding() != kEncodingStrMap2 ||
+        (res.it->second.ObjType() != OBJ_SET && res.it->second.ObjType() != OBJ_HASH)) {
+      db.member_expiry_key.clear();
+      continue;
+    }
+
+    DenseSet* ds = static_cast<DenseSet*>(res.it->second.RObjPtr());
+    ds->set_time(now_sec);
+    uint32_t start = db.member_expiry_cursor;
+    uint32_t cursor = ds->CollectExpiredStep(start, budget);
+    uint32_t visited = ds->ExpirationUsed() ? (cursor ? cursor : ds->BucketCount()) - start : 0;
+    budget -= std::min<unsigned>(budget, std::max<uint32_t>(visited, 1));
+    res.post_updater.Run();
+
+    if (cursor != 0) {
+      db.member_expiry_cursor = cursor;
+      continue;
+    }
+
+    db.member_expiry_key.clear();
+    ++result.containers;
+    if (ds->Empty()) {
+      if (auto journal = owner_->journal(); journal) {
+        RecordExpiry(cntx.db_index, key);
+      }
+      Del(cntx, res.it);
+      ++result.deleted;
+    }
   }
 
   return result;
@@ -1308,8 +1839,7 @@ pair<uint64_t, size_t> DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t s
       if (auto journal = owner_->journal(); journal)
         RecordExpiry(db_ind, key);
 
-      if (expired_keys_events_recording_)
-        db_table->expired_keys_events_.emplace_back(key);
+      RecordKeyspaceEvent(db_table.get(), key);
     }
 
     auto time_finish = absl::GetCurrentTimeNanos();
@@ -1323,6 +1853,17 @@ pair<uint64_t, size_t> DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t s
 
   {
     FiberAtomicGuard guard;
+    if (evict_volatile_first_ && db_table->expire_count() > 0) {
+      auto [items, bytes] = EvictVolatileStep(db_table.get(), max_eviction_per_hb,
+                                              increase_goal_bytes,
+                                              record_keys ? &keys_to_journal : nullptr);
+      events_.evicted_volatile_keys += items;
+      evicted_items += items;
+      evicted_bytes += bytes;
+      if ((evicted_items >= max_eviction_per_hb) || (evicted_bytes >= increase_goal_bytes))
+        return return_cb();
+    }
+
     for (int32_t slot_id = num_slots - 1; slot_id >= 0; --slot_id) {
       for (int32_t bucket_id = num_buckets - 1; bucket_id >= 0; --bucket_id) {
         // pick a random segment to start with in each eviction,
@@ -1365,53 +1906,97 @@ pair<uint64_t, size_t> DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t s
   return return_cb();
 }
 
+pair<uint64_t, size_t> DbSlice::EvictVolatileStep(DbTable* table, uint64_t max_items,
+                                                  size_t goal_bytes, vector<string>* keys) {
+  // Like redis, a round samples a few keys and evicts the best of them. Every round continues
+  // the traversal of the expire table where the previous one stopped.
+  constexpr size_t kSampleSize = 16;
+  constexpr unsigned kMaxBucketsPerRound = 64;
+
+  struct Candidate {
+    PrimeIterator it;
+    double score;  // milliseconds to live per byte freed, lower is evicted first
+  };
+
+  uint64_t now_ms = GetCurrentTimeMs();
+  uint64_t evicted_items = 0;
+  size_t evicted_bytes = 0;
+  vector<Candidate> candidates;
+  string tmp;
+
+  auto sample = [&](ExpireIterator exp_it, PrimeIterator prime_it) {
+    if (prime_it.is_done())
+      prime_it = table->prime.Find(exp_it->first);
+    if (prime_it.is_done() || prime_it->first.IsSticky() || !prime_it->second.HasAllocated())
+      return;
+
+    // do not evict locked keys
+    string_view key = prime_it->first.GetSlice(&tmp);
+    if (table->trans_locks.Find(LockTag(key)).has_value())
+      return;
+
+    int64_t ttl = max<int64_t>(ExpireTime(exp_it) - int64_t(now_ms), 0);
+    candidates.push_back({prime_it, double(ttl) / (prime_it->second.MallocUsed() + 1)});
+  };
+
+  while (evicted_items < max_items && evicted_bytes < goal_bytes) {
+    candidates.clear();
+    for (unsigned i = 0; i < kMaxBucketsPerRound && candidates.size() < kSampleSize; ++i) {
+      if (table->inline_expire) {
+        table->evict_cursor = table->prime.Traverse(table->evict_cursor, [&](PrimeIterator it) {
+          if (it->second.HasExpire())
+            sample(ExpireIterator::Inline(it), it);
+        });
+      } else {
+        table->evict_cursor = table->expire.Traverse(
+            table->evict_cursor, [&](ExpireTable::iterator it) { sample(it, PrimeIterator{}); });
+      }
+    }
+
+    if (candidates.empty())
+      break;
+
+    auto best = min_element(candidates.begin(), candidates.end(), [](const auto& l, const auto& r) {
+      return l.score < r.score;
+    });
+    string_view key = best->it->first.GetSlice(&tmp);
+    if (keys)
+      keys->emplace_back(key);
+
+    evicted_bytes += best->it->second.MallocUsed();
+    ++evicted_items;
+    PerformDeletion(Iterator(best->it, StringOrView::FromView(key)), table);
+  }
+
+  return {evicted_items, evicted_bytes};
+}
+
 void DbSlice::CreateDb(DbIndex db_ind) {
   auto& db = db_arr_[db_ind];
   if (!db) {
-    db.reset(new DbTable{owner_->memory_resource(), db_ind});
+    db.reset(new DbTable{owner_->segment_memory_resource(), db_ind});
+    if (uint32_t tick_ms = GetFlag(FLAGS_expire_wheel_tick_ms); tick_ms > 0)
+      db->expire_wheel = make_unique<TimerWheel>(tick_ms, GetCurrentTimeMs());
     table_memory_ += db->table_memory();
   }
 }
 
-void DbSlice::RegisterWatchedKey(DbIndex db_indx, std::string_view key,
-                                 ConnectionState::ExecInfo* exec_info) {
-  // Because we might insert while another fiber is preempted
-  util::fb2::LockGuard lk(local_mu_);
-  db_arr_[db_indx]->watched_keys[key].push_back(exec_info);
+uint64_t DbSlice::WatchVersion(const Context& cntx, std::string_view key) const {
+  // Every version assigned from now on is not less than version_.
+  return IsValid(FindReadOnly(cntx, key).it) ? version_ : 0;
 }
 
-void DbSlice::UnregisterConnectionWatches(const ConnectionState::ExecInfo* exec_info) {
-  // Because we might remove while another fiber is preempted and miss a notification
-  util::fb2::LockGuard lk(local_mu_);
-  for (const auto& [db_indx, key] : exec_info->watched_keys) {
-    auto& watched_keys = db_arr_[db_indx]->watched_keys;
-    if (auto it = watched_keys.find(key); it != watched_keys.end()) {
-      it->second.erase(std::remove(it->second.begin(), it->second.end(), exec_info),
-                       it->second.end());
-      if (it->second.empty())
-        watched_keys.erase(it);
-    }
-  }
-}
-
-void DbSlice::InvalidateDbWatches(DbIndex db_indx) {
-  for (const auto& [key, conn_list] : db_arr_[db_indx]->watched_keys) {
-    for (auto conn_ptr : conn_list) {
-      conn_ptr->watched_dirty.store(true, memory_order_relaxed);
-    }
-  }
-}
+bool DbSlice::WatchedKeyChanged(const Context& cntx, std::string_view key,
+                                uint64_t version) const {
+  auto it = FindReadOnly(cntx, key).it;
+  if (!IsValid(it))
+    return version != 0;  // deleted or expired
+  if (version == 0)
+    return true;  // created
 
-void DbSlice::InvalidateSlotWatches(const cluster::SlotSet& slot_ids) {
-  for (const auto& [key, conn_list] : db_arr_[0]->watched_keys) {
-    cluster::SlotId sid = cluster::KeySlot(key);
-    if (!slot_ids.Contains(sid)) {
-      continue;
-    }
-    for (auto conn_ptr : conn_list) {
-      conn_ptr->watched_dirty.store(true, memory_order_relaxed);
-    }
-  }
+  // Updates and insertions stamp the bucket with a new version, and bucket versions never go back
+  // when entries move between buckets.
+  return it.GetVersion() >= version || db_arr_[cntx.db_index]->flush_version >= version;
 }
 
 void DbSlice::ClearOffloadedEntries(absl::Span<const DbIndex> indices, const DbTableArray& db_arr) {
@@ -1458,7 +2043,46 @@ void DbSlice::SetNotifyKeyspaceEvents(std::string_view notify_keyspace_events) {
   expired_keys_events_recording_ = !notify_keyspace_events.empty();
 }
 
+void DbSlice::SetKeyspaceEventsPrefixes(std::vector<std::string> prefixes) {
+  keyspace_events_prefixes_ = std::move(prefixes);
+}
+
+void DbSlice::RecordKeyspaceEvent(DbTable* db, std::string_view key) const {
+  if (!expired_keys_events_recording_)
+    return;
+
+  if (!keyspace_events_prefixes_.empty() &&
+      none_of(keyspace_events_prefixes_.begin(), keyspace_events_prefixes_.end(),
+              [key](const string& prefix) { return absl::StartsWith(key, prefix); })) {
+    return;
+  }
+  db->expired_keys_events_.emplace_back(key);
+}
+
+void DbSlice::FlushKeyspaceEvents() {
+  ChannelStore* store = nullptr;
+  for (DbIndex index = 0; index < db_arr_.size(); ++index) {
+    if (!db_arr_[index] || db_arr_[index]->expired_keys_events_.empty())
+      continue;
+
+    // The events of all the keys expired since the last flush are serialized once for all the
+    // subscribers and sent by a single task per thread.
+    auto& events = db_arr_[index]->expired_keys_events_;
+    if (store == nullptr)
+      store = ServerState::tlocal()->channel_store();
+    store->SendMessages(absl::StrCat("__keyevent@", index, "__:expired"), events);
+    events.clear();
+  }
+}
+
 void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
+  if (const auto& bcast = ServerState::tlocal()->bcast_tracking; bcast) {
+    for (const auto& [prefix, conn] : *bcast) {
+      if (absl::StartsWith(key, prefix))
+        pending_invalidations_.emplace_back(conn, key);
+    }
+  }
+
   if (client_tracking_map_.empty())
     return;
 
@@ -1466,26 +2090,43 @@ void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
   if (it == client_tracking_map_.end()) {
     return;
   }
-  auto& client_set = it->second;
-  // Notify all the clients. We copy key because we dispatch briefly below and
-  // we need to preserve its lifetime
-  // TODO this key is further copied within DispatchFiber. Fix this.
-  auto cb = [key = std::string(key), client_set = std::move(client_set)](unsigned idx,
-                                                                         util::ProactorBase*) {
-    for (auto& client : client_set) {
-      if (client.IsExpired() || (client.Thread() != idx)) {
-        continue;
-      }
-      auto* conn = client.Get();
-      auto* cntx = static_cast<ConnectionContext*>(conn->cntx());
-      if (cntx && cntx->conn_state.tracking_info_.IsTrackingOn()) {
-        conn->SendInvalidationMessageAsync({key});
-      }
-    }
-  };
-  shard_set->pool()->DispatchBrief(std::move(cb));
+
+  for (const auto& client : it->second)
+    pending_invalidations_.emplace_back(client, key);
+
   // remove this key from the tracking table as the key no longer exists
-  client_tracking_map_.erase(key);
+  client_tracking_map_.erase(it);
+}
+
+void DbSlice::FlushInvalidationMessages() {
+  if (pending_invalidations_.empty())
+    return;
+
+  // Group the invalidations by the threads of the clients, every thread gets a single task.
+  absl::flat_hash_map<unsigned, decltype(pending_invalidations_)> by_thread;
+  for (auto& entry : pending_invalidations_) {
+    if (!entry.first.IsExpired())
+      by_thread[entry.first.Thread()].push_back(std::move(entry));
+  }
+  pending_invalidations_.clear();
+
+  for (auto& [thread, entries] : by_thread) {
+    auto cb = [entries = std::move(entries)]() mutable {
+      absl::flat_hash_map<facade::Connection*, vector<string>> by_conn;
+      for (auto& [client, key] : entries) {
+        auto* conn = client.Get();
+        if (conn == nullptr)
+          continue;
+        auto* cntx = static_cast<ConnectionContext*>(conn->cntx());
+        if (cntx && cntx->conn_state.tracking_info_.IsTrackingOn())
+          by_conn[conn].push_back(std::move(key));
+      }
+
+      for (auto& [conn, keys] : by_conn)
+        conn->SendInvalidationMessageAsync({std::move(keys)});
+    };
+    shard_set->pool()->at(thread)->DispatchBrief(std::move(cb));
+  }
 }
 
 void DbSlice::PerformDeletion(PrimeIterator del_it, DbTable* table) {
@@ -1495,7 +2136,7 @@ void DbSlice::PerformDeletion(PrimeIterator del_it, DbTable* table) {
 void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table) {
   size_t table_before = table->table_memory();
   if (!exp_it.is_done()) {
-    table->expire.Erase(exp_it.GetInnerIt());
+    table->EraseExpire(exp_it.GetInnerIt());
   }
 
   if (del_it->second.HasFlag()) {
@@ -1526,8 +2167,12 @@ void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* tabl
   if (cluster::IsClusterEnabled()) {
     cluster::SlotId sid = cluster::KeySlot(del_it.key());
     table->slots_stats[sid].key_count -= 1;
+    if (!table->slot_keys.empty())
+      table->slot_keys[sid].erase(del_it.key());
   }
 
+  // Large containers are handed over to the background freer, Erase releases an empty value then.
+  shard_owner()->lazy_freer()->TryAdd(&del_it->second);
   table->prime.Erase(del_it.GetInnerIt());
 
   // Note, currently we do not shrink our tables upon deletion.
@@ -1538,13 +2183,15 @@ void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* tabl
   --entries_count_;
   memory_budget_ += (value_heap_size + key_size_used);
 
+  InvalidateHotKeyReplica(table, del_it.key());
+  reply_cache_.Invalidate(table->index, del_it.key());
   SendInvalidationTrackingMessage(del_it.key());
 }
 
 void DbSlice::PerformDeletion(Iterator del_it, DbTable* table) {
   ExpIterator exp_it;
   if (del_it->second.HasExpire()) {
-    exp_it = ExpIterator::FromPrime(table->expire.Find(del_it->first));
+    exp_it = ExpIterator::FromPrime(table->FindExpire(del_it.GetInnerIt()));
     DCHECK(!exp_it.is_done());
   }
 
@@ -1555,6 +2202,7 @@ void DbSlice::OnCbFinish() {
   // TBD update bumpups logic we can not clear now after cb finish as cb can preempt
   // btw what do we do with inline?
   fetched_items_.clear();
+  FlushInvalidationMessages();
 }
 
 void DbSlice::CallChangeCallbacks(DbIndex id, std::string_view key, const ChangeReq& cr) const {
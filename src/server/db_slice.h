@@ -11,6 +11,7 @@
 #include "server/cluster/slot_set.h"
 #include "server/common.h"
 #include "server/conn_context.h"
+#include "server/reply_cache.h"
 #include "server/table.h"
 #include "util/fibers/fibers.h"
 #include "util/fibers/synchronization.h"
@@ -32,6 +33,9 @@ struct DbStats : public DbTableStats {
   // Memory used by dictionaries.
   size_t table_mem_usage = 0;
 
+  // Number of keys replicated to all the threads, see hot_key_replicas.
+  size_t hot_key_replicas = 0;
+
   using DbTableStats::operator+=;
   using DbTableStats::operator=;
 
@@ -63,12 +67,20 @@ struct SliceEvents {
   // how many insertions were rejected due to OOM.
   size_t insertion_rejections = 0;
 
+  // how many of the rejected insertions were refused by the tinylfu admission filter.
+  size_t admission_rejections = 0;
+
+  // evictions of keys with the nearest deadlines, with cache_eviction_policy volatile-ttl.
+  size_t evicted_volatile_keys = 0;
+
   // how many updates and insertions of keys between snapshot intervals
   size_t update = 0;
 
   SliceEvents& operator+=(const SliceEvents& o);
 };
 
+class FrequencySketch;
+
 class DbSlice {
   DbSlice(const DbSlice&) = delete;
   void operator=(const DbSlice&) = delete;
@@ -181,6 +193,11 @@ class DbSlice {
     std::vector<DbStats> db_stats;
     SliceEvents events;
     size_t small_string_bytes = 0;
+    size_t key_prefixes = 0;
+    size_t key_prefix_bytes = 0;
+    size_t expire_wheel_bytes = 0;
+    size_t reply_cache_bytes = 0;
+    size_t expired_pending_bytes = 0;  // estimate of the memory held by expired keys.
   };
 
   using Context = DbContext;
@@ -232,8 +249,14 @@ class DbSlice {
   DbSlice(uint32_t index, bool caching_mode, EngineShard* owner);
   ~DbSlice();
 
-  // Activates `db_ind` database if it does not exist (see ActivateDb below).
-  void Reserve(DbIndex db_ind, size_t key_size);
+  // Reserves space for key_size more keys and expire_size more expiries on top of the earlier
+  // calls. Used with the size hints of loaded snapshots, so that the tables are not grown by
+  // repeated segment splits. Activates `db_ind` database if it does not exist (see ActivateDb).
+  void Reserve(DbIndex db_ind, size_t key_size, size_t expire_size = 0);
+
+  // Splits some of the nearly full segments of the prime tables, see dash_presplit_utilization.
+  // Called from the shard heartbeat.
+  void PreSplitStep();
 
   // Returns statistics for the whole db slice. A bit heavy operation.
   Stats GetStats() const;
@@ -241,6 +264,23 @@ class DbSlice {
   // Returns slot statistics for db 0.
   SlotStats GetSlotStats(cluster::SlotId sid) const;
 
+  // Folds the reads and writes of every slot since the last update into an exponentially
+  // weighted ops/sec rate, if at least a second passed. Called from the shard heartbeat.
+  void UpdateSlotLoad(uint64_t now_ms);
+
+  // Replicates the string keys that the top keys tracking reports as hot to all the threads and
+  // drops the replicas that stopped serving reads, see hot_key_replicas. Runs at most once a
+  // second, called from the shard heartbeat.
+  void UpdateHotKeyReplicas(uint64_t now_ms);
+
+  // Returns the rolling ops/sec estimate of the slot for db 0.
+  double GetSlotOpsRate(cluster::SlotId sid) const;
+
+  // Serialized replies of reads of the keys of this shard, see reply_cache_max_memory.
+  ReplyCache& reply_cache() {
+    return reply_cache_;
+  }
+
   void UpdateExpireBase(uint64_t now, unsigned generation) {
     expire_base_[generation & 1] = now;
   }
@@ -296,6 +336,17 @@ class DbSlice {
   OpResult<ConstIterator> FindReadOnly(const Context& cntx, std::string_view key,
                                        unsigned req_obj_type) const;
 
+  // Batched version of FindReadOnly. Hashes the keys and prefetches their PrimeTable buckets
+  // before resolving them, so that the cache misses of different keys overlap.
+  // dest must have the same size as keys, results are stored in the order of keys.
+  void FindManyReadOnly(const Context& cntx, absl::Span<const std::string_view> keys,
+                        std::optional<unsigned> req_obj_type,
+                        absl::Span<OpResult<ConstIterator>> dest) const;
+
+  // Prefetches the PrimeTable buckets of the keys. Meant for loops of mutable lookups
+  // that can not be batched via FindManyReadOnly because they invalidate iterators.
+  void PrefetchKeys(DbIndex db_ind, absl::Span<const std::string_view> keys) const;
+
   struct AddOrFindResult {
     Iterator it;
     ExpIterator exp_it;
@@ -326,6 +377,9 @@ class DbSlice {
   // Adds expiry information.
   void AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at) ABSL_LOCKS_EXCLUDED(local_mu_);
 
+  // Changes the expiry time of a key that already has one.
+  void SetExpireTime(DbIndex db_ind, const ExpIterator& exp_it, uint64_t at);
+
   // Removes the corresponing expiry information if exists.
   // Returns true if expiry existed (and removed).
   bool RemoveExpire(DbIndex db_ind, Iterator main_it) ABSL_LOCKS_EXCLUDED(local_mu_);
@@ -353,6 +407,12 @@ class DbSlice {
   // Flushes the data of given slot ranges.
   void FlushSlots(cluster::SlotRanges slot_ranges);
 
+  // Exchanges the tables of all databases with the ones of other, a slice of the same shard, so
+  // that a dataset that was loaded aside replaces the current one at once. The locks stay with
+  // their slices, and the watches and cached replies of the replaced tables are invalidated.
+  // The search indices of the shard must be rebuilt afterwards.
+  void SwapTables(DbSlice* other) ABSL_LOCKS_EXCLUDED(local_mu_);
+
   EngineShard* shard_owner() const {
     return owner_;
   }
@@ -363,6 +423,9 @@ class DbSlice {
 
   void OnCbFinish();
 
+  // Sends the queued invalidations of tracked keys, a single message per client.
+  void FlushInvalidationMessages();
+
   bool Acquire(IntentLock::Mode m, const KeyLockArgs& lock_args);
   void Release(IntentLock::Mode m, const KeyLockArgs& lock_args);
 
@@ -371,6 +434,7 @@ class DbSlice {
   bool CheckLock(IntentLock::Mode mode, DbIndex dbid, std::string_view key) const {
     return CheckLock(mode, dbid, LockTag(key).Fingerprint());
   }
+  bool CheckLock(IntentLock::Mode mode, const KeyLockArgs& lock_args) const;
 
   size_t db_array_size() const {
     return db_arr_.size();
@@ -420,6 +484,9 @@ class DbSlice {
     return table_memory_;
   }
 
+  // Memory of the tables and the objects of all the databases of the slice.
+  size_t UsedMemory() const;
+
   size_t entries_count() const {
     return entries_count_;
   }
@@ -447,9 +514,23 @@ class DbSlice {
     size_t survivor_ttl_sum = 0;  // total sum of ttl of survivors (traversed - deleted).
   };
 
-  // Deletes some amount of possible expired items.
+  // Deletes some amount of possible expired items. With the expire wheel, deletes up to count
+  // keys that are due, otherwise samples count buckets of the expire table.
   DeleteExpiredStats DeleteExpiredStep(const Context& cntx, unsigned count);
 
+  // Registers a set or a hash that holds members or fields expiring in ttl_sec seconds,
+  // so that CollectExpiredMembersStep deletes them even if the key is not accessed again.
+  void RegisterMemberExpiry(const Context& cntx, std::string_view key, uint32_t ttl_sec);
+
+  struct MemberExpiryStats {
+    uint32_t containers = 0;  // number of containers that were swept.
+    uint32_t deleted = 0;     // number of containers deleted because all their members expired.
+  };
+
+  // Deletes expired members of registered containers, visiting at most about budget buckets.
+  // Containers left empty are deleted.
+  MemberExpiryStats CollectExpiredMembersStep(const Context& cntx, unsigned budget);
+
   // Evicts items with dynamically allocated data from the primary table.
   // Does not shrink tables.
   // Returnes number of (elements,bytes) freed due to evictions.
@@ -466,16 +547,31 @@ class DbSlice {
     caching_mode_ = 1;
   }
 
+  // Access frequencies of the keys, set if cache_eviction_policy is tinylfu.
+  const FrequencySketch* access_freq() const {
+    return access_freq_.get();
+  }
+
+  // Called with the keys that are looked up or added while set, e.g. by MEMORY ANALYZE to
+  // sample the traffic by key prefix. Reset with an empty function.
+  using AccessObserver = std::function<void(DbIndex, std::string_view key)>;
+  void SetAccessObserver(AccessObserver observer) {
+    access_observer_ = std::move(observer);
+  }
+
   // Test hook to inspect last locked keys.
   const auto& TEST_GetLastLockedFps() const {
     return uniq_fps_;
   }
 
-  void RegisterWatchedKey(DbIndex db_indx, std::string_view key,
-                          ConnectionState::ExecInfo* exec_info);
+  // Returns the version that WATCH records for the key, 0 if the key does not exist.
+  // Watches are not registered in the slice, so writes pay nothing for them. Instead EXEC checks
+  // the versions with WatchedKeyChanged.
+  uint64_t WatchVersion(const Context& cntx, std::string_view key) const;
 
-  // Unregisted all watched key entries for connection.
-  void UnregisterConnectionWatches(const ConnectionState::ExecInfo* exec_info);
+  // Returns true if the key was written, created, deleted or flushed since WatchVersion returned
+  // version for it. Writes to other keys of the same bucket may report false positives.
+  bool WatchedKeyChanged(const Context& cntx, std::string_view key, uint64_t version) const;
 
   void SetDocDeletionCallback(DocDeletionCallback ddcb);
 
@@ -485,6 +581,10 @@ class DbSlice {
   // Resets events_ member. Used by CONFIG RESETSTAT
   void ResetEvents();
 
+  const SliceEvents& GetEvents() const {
+    return events_;
+  }
+
   // Controls the expiry/eviction state. The server may enter states where
   // Both evictions and expiries will be stopped for a short period of time.
   void SetExpireAllowed(bool is_allowed) {
@@ -515,6 +615,13 @@ class DbSlice {
   // if it's not empty and not EX.
   void SetNotifyKeyspaceEvents(std::string_view notify_keyspace_events);
 
+  // Restricts the keyspace events to the keys with one of the prefixes, all keys if empty.
+  void SetKeyspaceEventsPrefixes(std::vector<std::string> prefixes);
+
+  // Publishes the keyspace events recorded since the last call, a single batch per database.
+  // Called by the shard heartbeat.
+  void FlushKeyspaceEvents();
+
  private:
   void PreUpdate(DbIndex db_ind, Iterator it, std::string_view key);
   void PostUpdate(DbIndex db_ind, Iterator it, std::string_view key, size_t orig_size);
@@ -528,21 +635,35 @@ class DbSlice {
   void FlushSlotsFb(const cluster::SlotSet& slot_ids);
   void FlushDbIndexes(const std::vector<DbIndex>& indexes);
 
-  // Invalidate all watched keys in database. Used on FLUSH.
-  void InvalidateDbWatches(DbIndex db_indx);
-
-  // Invalidate all watched keys for given slots. Used on FlushSlots.
-  void InvalidateSlotWatches(const cluster::SlotSet& slot_ids);
-
   // Clear tiered storage entries for the specified indices.
   void ClearOffloadedEntries(absl::Span<const DbIndex> indices, const DbTableArray& db_arr);
 
   void PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table);
+
+  void DeleteDueStep(const Context& cntx, unsigned count, DeleteExpiredStats* result);
+
+  // Evicts the keys with the nearest deadlines among samples of the expire table, weighted by
+  // the memory their values free, until max_items keys or goal_bytes are evicted or no more
+  // candidates are found. Appends the evicted keys to keys if it is set.
+  std::pair<uint64_t, size_t> EvictVolatileStep(DbTable* table, uint64_t max_items,
+                                                size_t goal_bytes, std::vector<std::string>* keys);
+
+  // Records the expiry time of a key in the expire wheel of the table, if there is one.
+  static void IndexExpiry(DbTable* db, std::string_view key, uint64_t at) {
+    if (db->expire_wheel)
+      db->expire_wheel->Add(key, at);
+  }
   void PerformDeletion(PrimeIterator del_it, DbTable* table);
 
-  // Send invalidation message to the clients that are tracking the change to a key.
+  // Queues invalidation messages for the clients that are tracking the change to a key.
   void SendInvalidationTrackingMessage(std::string_view key);
 
+  // Invalidates the thread copies of the key if it is replicated.
+  void InvalidateHotKeyReplica(DbTable* db, std::string_view key);
+
+  // Records the expiry or eviction of the key for keyspace notifications if it is enabled for it.
+  void RecordKeyspaceEvent(DbTable* db, std::string_view key) const;
+
   void CreateDb(DbIndex index);
 
   enum class UpdateStatsMode {
@@ -559,9 +680,11 @@ class DbSlice {
 
   OpResult<AddOrFindResult> AddOrFindInternal(const Context& cntx, std::string_view key);
 
+  // key_hash, if set, must be the PrimeTable hash of key.
   OpResult<PrimeItAndExp> FindInternal(const Context& cntx, std::string_view key,
                                        std::optional<unsigned> req_obj_type,
-                                       UpdateStatsMode stats_mode) const;
+                                       UpdateStatsMode stats_mode,
+                                       std::optional<uint64_t> key_hash = std::nullopt) const;
   OpResult<ItAndUpdater> FindMutableInternal(const Context& cntx, std::string_view key,
                                              std::optional<unsigned> req_obj_type);
 
@@ -587,13 +710,20 @@ class DbSlice {
   size_t soft_budget_limit_ = 0;
   size_t table_memory_ = 0;
   uint64_t entries_count_ = 0;
+  uint64_t slot_load_update_ms_ = 0;
+  uint64_t hot_replicas_update_ms_ = 0;
 
   mutable SliceEvents events_;  // we may change this even for const operations.
 
+  std::unique_ptr<FrequencySketch> access_freq_;
+  bool evict_volatile_first_ = false;  // cache_eviction_policy is volatile-ttl
+  AccessObserver access_observer_;
+  ReplyCache reply_cache_;
+
   DbTableArray db_arr_;
 
   // Used in temporary computations in Acquire/Release.
-  mutable absl::flat_hash_set<uint64_t> uniq_fps_;
+  mutable std::vector<LockFp> uniq_fps_;
 
   // ordered from the smallest to largest version.
   std::list<std::pair<uint64_t, ChangeCallback>> change_cb_;
@@ -601,11 +731,16 @@ class DbSlice {
   // Used in temporary computations in Find item and CbFinish
   mutable absl::flat_hash_set<CompactObjectView> fetched_items_;
 
+  // Invalidated keys of tracking clients, queued until the end of the callback or the next
+  // heartbeat, so that clients get a single message for the keys changed in the meantime.
+  std::vector<std::pair<facade::Connection::WeakRef, std::string>> pending_invalidations_;
+
   // Registered by shard indices on when first document index is created.
   DocDeletionCallback doc_del_cb_;
 
   // Record whenever a key expired to DbTable::expired_keys_events_ for keyspace notifications
   bool expired_keys_events_recording_ = true;
+  std::vector<std::string> keyspace_events_prefixes_;
 
   struct Hash {
     size_t operator()(const facade::Connection::WeakRef& c) const {
@@ -658,7 +793,10 @@ template <typename T> void DbSlice::IteratorT<T>::LaunderIfNeeded() const {
   uint64_t current_epoch = util::fb2::FiberSwitchEpoch();
   if (current_epoch != fiber_epoch_) {
     if (!it_.IsOccupied() || it_->first != key_.view()) {
-      it_ = it_.owner().Find(key_.view());
+      if constexpr (std::is_same_v<T, ExpireIterator> || std::is_same_v<T, ExpireConstIterator>)
+        it_ = it_.Refind(key_.view());
+      else
+        it_ = it_.owner().Find(key_.view());
     }
     fiber_epoch_ = current_epoch;
   }
@@ -7,6 +7,7 @@ extern "C" {
 #include "redis/redis_aux.h"
 }
 
+#include <absl/base/internal/cycleclock.h>
 #include <absl/cleanup/cleanup.h>
 #include <absl/random/random.h>
 #include <absl/strings/match.h>
@@ -18,6 +19,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/compact_object.h"
+#include "core/packed_map.h"
 #include "core/string_map.h"
 #include "server/blocking_controller.h"
 #include "server/container_utils.h"
@@ -231,6 +233,14 @@ unsigned AddObjHist(PrimeIterator it, ObjHist* hist) {
         steps += 2;
       }
       val_len = lpBytes(lp);
+    } else if (pv.Encoding() == kEncodingPackedMap) {
+      uint8_t* pm = (uint8_t*)pv.RObjPtr();
+      PackedMap::Iterate(pm, [&](string_view field, string_view value) {
+        hist->entry_len.Add(field.size() + value.size());
+        steps += 2;
+        return true;
+      });
+      val_len = PackedMap::BlobBytes(pm);
     } else {
       StringMap* sm = static_cast<StringMap*>(pv.RObjPtr());
       for (const auto& k_v : *sm) {
@@ -317,7 +327,7 @@ ObjInfo InspectOp(ConnectionContext* cntx, string_view key) {
     }
 
     if (pv.HasExpire()) {
-      ExpireIterator exp_it = exp_t->Find(it->first);
+      ExpireIterator exp_it = db_slice.GetDBTable(db_index)->FindExpire(it);
       CHECK(!exp_it.is_done());
 
       time_t exp_time = db_slice.ExpireTime(exp_it);
@@ -861,6 +871,8 @@ void DebugCmd::TxAnalysis() {
     const auto& info = shard_info[i];
     StrAppend(&result, "shard", i, ":\n", "  tx armed ", info.tx_armed, ", total: ", info.tx_total,
               ",global:", info.tx_global, ",runnable:", info.tx_runnable, "\n");
+    StrAppend(&result, "  lanes single shard:", info.tx_single_shard,
+              ",multi shard:", info.tx_multi_shard, "\n");
     StrAppend(&result, "  locks total:", info.total_locks, ",contended:", info.contended_locks,
               "\n");
     StrAppend(&result, "  max contention score: ", info.max_contention_score,
@@ -914,6 +926,9 @@ void DebugCmd::Shards() {
     size_t key_count = 0;
     size_t expire_count = 0;
     size_t key_reads = 0;
+    size_t exec_usec = 0;  // Time spent running transactions, the load to balance threads by
+    size_t txq_len = 0;
+    size_t thread = 0;
   };
 
   vector<ShardInfo> infos(shard_set->size());
@@ -928,6 +943,10 @@ void DebugCmd::Shards() {
       stats.expire_count += db_stats.expire_count;
     }
     stats.key_reads = slice_stats.events.hits + slice_stats.events.misses;
+    double cycles = shard->stats().tx_exec_cycles;
+    stats.exec_usec = cycles * 1e6 / absl::base_internal::CycleClock::Frequency();
+    stats.txq_len = shard->txq()->size();
+    stats.thread = ProactorBase::me()->GetPoolIndex();
   });
 
 #define ADD_STAT(i, stat) absl::StrAppend(&out, "shard", i, "_", #stat, ": ", infos[i].stat, "\n");
@@ -951,12 +970,16 @@ void DebugCmd::Shards() {
     ADD_STAT(i, key_count);
     ADD_STAT(i, expire_count);
     ADD_STAT(i, key_reads);
+    ADD_STAT(i, exec_usec);
+    ADD_STAT(i, txq_len);
+    ADD_STAT(i, thread);
   }
 
   MAXMIN_STAT(used_memory);
   MAXMIN_STAT(key_count);
   MAXMIN_STAT(expire_count);
   MAXMIN_STAT(key_reads);
+  MAXMIN_STAT(exec_usec);
 
 #undef ADD_STAT
 #undef MAXMIN_STAT
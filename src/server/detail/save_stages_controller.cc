@@ -6,12 +6,16 @@
 #include "server/detail/save_stages_controller.h"
 
 #include <absl/strings/match.h>
+#include <absl/time/clock.h>
 
 #include <numeric>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "io/file_util.h"
 #include "server/detail/snapshot_storage.h"
+#include "server/journal/disk_journal.h"
+#include "server/journal/journal.h"
 #include "server/main_service.h"
 #include "server/namespaces.h"
 #include "server/script_mgr.h"
@@ -64,6 +68,14 @@ void ExtendDfsFilenameWithShard(int shard, string_view extension, fs::path* file
 
 }  // namespace
 
+string DeltaFilename(const fs::path& base_path, unsigned id, unsigned shard) {
+  fs::path filename = base_path;
+  SetExtension(
+      StrCat("delta-", absl::Dec(id, absl::kZeroPad4), "-", absl::Dec(shard, absl::kZeroPad4)),
+      ".dfs", &filename);
+  return filename.string();
+}
+
 GenericError ValidateFilename(const fs::path& filename, bool new_version) {
   if (filename.empty()) {
     return {};
@@ -117,14 +129,20 @@ GenericError RdbSnapshot::Start(SaveMode save_mode, const std::string& path,
   io_sink_.reset(file);
 
   is_linux_file_ = file_type & FileType::IO_URING;
+  is_cloud_file_ = file_type & FileType::CLOUD;
   bool align_writes = (file_type & FileType::DIRECT) != 0;
   saver_.reset(new RdbSaver(io_sink_.get(), save_mode, align_writes));
+  if (save_mode == SaveMode::SINGLE_SHARD || save_mode == SaveMode::SINGLE_SHARD_WITH_SUMMARY)
+    saver_->EnableIndex();
+  saver_->SetPriority(priority_);
 
   return saver_->SaveHeader(std::move(glob_data));
 }
 
 error_code RdbSnapshot::SaveBody() {
-  return saver_->SaveBody(&cntx_, &freq_map_);
+  auto ec = saver_->SaveBody(&cntx_, &freq_map_);
+  peak_buffers_size_ = saver_->GetPeakBuffersSize();
+  return ec;
 }
 
 size_t RdbSnapshot::GetSaveBuffersSize() {
@@ -142,6 +160,15 @@ error_code RdbSnapshot::Close() {
   if (is_linux_file_) {
     return static_cast<LinuxWriteWrapper*>(io_sink_.get())->Close();
   }
+#endif
+#ifdef WITH_AWS
+  if (is_cloud_file_) {
+    auto* file = static_cast<S3MultipartWriteFile*>(io_sink_.get());
+    error_code ec = file->Close();
+    upload_bytes_ = file->uploaded_bytes();
+    upload_usec_ = file->upload_usec();
+    return ec;
+  }
 #endif
   return static_cast<io::WriteFile*>(io_sink_.get())->Close();
 }
@@ -151,15 +178,29 @@ void RdbSnapshot::StartInShard(EngineShard* shard) {
   started_shards_.fetch_add(1, memory_order_relaxed);
 }
 
+void RdbSnapshot::StartIncrementalInShard(EngineShard* shard, LSN start_lsn, LSN end_lsn) {
+  saver_->StartIncrementalSnapshotInShard(&cntx_, shard, start_lsn, end_lsn);
+  started_shards_.fetch_add(1, memory_order_relaxed);
+}
+
 SaveStagesController::SaveStagesController(SaveStagesInputs&& inputs)
     : SaveStagesInputs{std::move(inputs)} {
   start_time_ = time(NULL);
+  start_ns_ = absl::GetCurrentTimeNanos();
 }
 
 SaveStagesController::~SaveStagesController() {
 }
 
 std::optional<SaveInfo> SaveStagesController::InitResourcesAndStart() {
+  if (delta_) {
+    full_path_ = delta_->base_path;
+    is_cloud_ = false;
+    InitResources();
+    SaveDelta();
+    return {};
+  }
+
   if (auto err = BuildFullPath(); err) {
     shared_err_ = err;
     return GetSaveInfo();
@@ -167,6 +208,9 @@ std::optional<SaveInfo> SaveStagesController::InitResourcesAndStart() {
 
   InitResources();
 
+  if (disk_journal_ && disk_journal_->IsOpen())
+    journal_segment_ = disk_journal_->NextSegment();
+
   if (use_dfs_format_)
     SaveDfs();
   else
@@ -186,6 +230,10 @@ SaveInfo SaveStagesController::Finalize() {
     shared_err_ = err;
   }
 
+  // Journal segments before the one started by the snapshot are no longer needed for recovery.
+  if (journal_segment_ && !shared_err_)
+    disk_journal_->RemoveSegmentsBefore(journal_segment_);
+
   return GetSaveInfo();
 }
 
@@ -268,6 +316,8 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard) {
 
   SaveMode mode = shard == nullptr ? SaveMode::SUMMARY : SaveMode::SINGLE_SHARD;
   auto glob_data = shard == nullptr ? RdbSaver::GetGlobalData(service_) : RdbSaver::GlobalData{};
+  if (mode == SaveMode::SUMMARY)
+    glob_data.journal_segment = journal_segment_;
 
   if (auto err = snapshot->Start(mode, filename, glob_data); err) {
     shared_err_ = err;
@@ -275,8 +325,44 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard) {
     return;
   }
 
-  if (mode == SaveMode::SINGLE_SHARD)
+  if (mode == SaveMode::SINGLE_SHARD) {
+    // Changes after this point are not in the snapshot and go to the new journal segment.
+    if (journal_segment_)
+      disk_journal_->StartSegmentInShard(journal_segment_);
+    if (auto* journal = shard->journal(); journal)
+      journal_lsns_[shard->shard_id()] = journal->GetLsn();
     snapshot->StartInShard(shard);
+  }
+}
+
+void SaveStagesController::SaveDelta() {
+  // Deltas have no summary file, so that they are never picked as the snapshot to load.
+  snapshots_.back().first.reset();
+
+  auto cb = [this](Transaction* t, EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    auto& [snapshot, filename] = snapshots_[sid];
+    filename = DeltaFilename(full_path_, delta_->id, sid) + ".tmp";
+
+    auto* journal = shard->journal();
+    if (!journal) {
+      shared_err_ = GenericError{"journal is not running"};
+      snapshot.reset();
+      return OpStatus::OK;
+    }
+
+    if (auto err = snapshot->Start(SaveMode::SINGLE_SHARD, filename, {}); err) {
+      shared_err_ = err;
+      snapshot.reset();
+      return OpStatus::OK;
+    }
+
+    // The end lsns of all shards are taken in the same hop, so the delta is a consistent cut.
+    journal_lsns_[sid] = journal->GetLsn();
+    snapshot->StartIncrementalInShard(shard, delta_->start_lsns[sid], journal_lsns_[sid]);
+    return OpStatus::OK;
+  };
+  trans_->ScheduleSingleHop(std::move(cb));
 }
 
 // Save a single rdb file
@@ -289,12 +375,16 @@ void SaveStagesController::SaveRdb() {
   if (!is_cloud_)
     filename += ".tmp";
 
-  if (auto err = snapshot->Start(SaveMode::RDB, filename, RdbSaver::GetGlobalData(service_)); err) {
+  auto glob_data = RdbSaver::GetGlobalData(service_);
+  glob_data.journal_segment = journal_segment_;
+  if (auto err = snapshot->Start(SaveMode::RDB, filename, glob_data); err) {
     snapshot.reset();
     return;
   }
 
-  auto cb = [snapshot = snapshot.get()](Transaction* t, EngineShard* shard) {
+  auto cb = [this, snapshot = snapshot.get()](Transaction* t, EngineShard* shard) {
+    if (journal_segment_)
+      disk_journal_->StartSegmentInShard(journal_segment_);
     snapshot->StartInShard(shard);
     return OpStatus::OK;
   };
@@ -305,6 +395,19 @@ uint32_t SaveStagesController::GetCurrentSaveDuration() {
   return time(nullptr) - start_time_;
 }
 
+size_t SaveStagesController::UploadThroughput() const {
+  // The files are uploaded in parallel, so the slowest one bounds the upload time.
+  return upload_usec_ ? upload_bytes_ * 1000000 / upload_usec_ : 0;
+}
+
+size_t SaveStagesController::KeysThroughput() const {
+  size_t keys = 0;
+  for (const auto& k_v : rdb_name_map_)
+    keys += k_v.second;
+  uint64_t usec = (absl::GetCurrentTimeNanos() - start_ns_) / 1000;
+  return usec ? keys * 1000000 / usec : 0;
+}
+
 SaveInfo SaveStagesController::GetSaveInfo() {
   SaveInfo info;
   info.save_time = start_time_;
@@ -321,8 +424,15 @@ SaveInfo SaveStagesController::GetSaveInfo() {
   else
     resulting_path.replace_extension();  // remove .tmp
 
-  LOG(INFO) << "Saving " << resulting_path << " finished after "
-            << strings::HumanReadableElapsedTime(info.duration_sec);
+  // The base snapshot is what gets loaded, so it is also reported as the file of a delta.
+  LOG(INFO) << "Saving " << (delta_ ? StrCat("delta ", delta_->id, " of ") : "") << resulting_path
+            << " finished after " << strings::HumanReadableElapsedTime(info.duration_sec)
+            << ", peak buffers " << strings::HumanReadableNumBytes(peak_buffers_size_)
+            << ", " << KeysThroughput() << " keys/s";
+  if (upload_bytes_ > 0) {
+    LOG(INFO) << "Uploaded " << strings::HumanReadableNumBytes(upload_bytes_) << " at "
+              << strings::HumanReadableNumBytes(UploadThroughput()) << "/s";
+  }
 
   info.freq_map.clear();
   for (const auto& k_v : rdb_name_map_) {
@@ -330,6 +440,14 @@ SaveInfo SaveStagesController::GetSaveInfo() {
   }
 
   info.file_name = resulting_path.generic_string();
+  info.peak_buffers_size = peak_buffers_size_;
+  info.upload_bytes = upload_bytes_;
+  info.upload_bytes_per_sec = UploadThroughput();
+  info.keys_per_sec = KeysThroughput();
+
+  bool has_journal = all_of(journal_lsns_.begin(), journal_lsns_.end(), [](LSN l) { return l; });
+  if (use_dfs_format_ && !is_cloud_ && has_journal)
+    info.journal_lsns = journal_lsns_;
 
   return info;
 }
@@ -337,7 +455,8 @@ SaveInfo SaveStagesController::GetSaveInfo() {
 void SaveStagesController::InitResources() {
   snapshots_.resize(use_dfs_format_ ? shard_set->size() + 1 : 1);
   for (auto& [snapshot, _] : snapshots_)
-    snapshot = make_unique<RdbSnapshot>(fq_threadpool_, snapshot_storage_.get());
+    snapshot = make_unique<RdbSnapshot>(fq_threadpool_, snapshot_storage_.get(), priority_);
+  journal_lsns_.assign(use_dfs_format_ ? shard_set->size() : 0, 0);
 }
 
 // Remove .tmp extension or delete files in case of error
@@ -350,7 +469,21 @@ GenericError SaveStagesController::FinalizeFileMovement() {
   bool has_error = bool(shared_err_);
 
   std::error_code ec;
+
+  // Deltas of a snapshot that is replaced must never be applied to the new one, so they are
+  // removed before the new files are moved in place.
+  if (!has_error && use_dfs_format_ && !delta_) {
+    fs::path glob = full_path_;
+    SetExtension("delta-????-????", ".dfs", &glob);
+    if (auto stale = io::StatFiles(glob.string()); stale) {
+      for (const auto& file : *stale)
+        filesystem::remove(file.name, ec);
+    }
+  }
+
   for (const auto& [_, filename] : snapshots_) {
+    if (filename.empty())  // summary of a delta
+      continue;
     if (has_error) {
       filesystem::remove(filename, ec);
     } else {
@@ -407,6 +540,9 @@ void SaveStagesController::CloseCb(unsigned index) {
     unique_lock lk{rdb_name_map_mu_};
     for (const auto& k_v : snapshot->freq_map())
       rdb_name_map_[RdbTypeName(k_v.first)] += k_v.second;
+    peak_buffers_size_ += snapshot->peak_buffers_size();
+    upload_bytes_ += snapshot->upload_bytes();
+    upload_usec_ = max(upload_usec_, snapshot->upload_usec());
     lk.unlock();
     snapshot.reset();
   }
@@ -15,6 +15,10 @@ namespace dfly {
 class Transaction;
 class Service;
 
+namespace journal {
+class DiskJournal;
+}  // namespace journal
+
 namespace detail {
 
 class SnapshotStorage;
@@ -25,8 +29,33 @@ struct SaveInfo {
   std::string file_name;
   std::vector<std::pair<std::string_view, size_t>> freq_map;  // RDB_TYPE_xxx -> count mapping.
   GenericError error;
+
+  // Journal lsns of all shards at the point in time of a local DF snapshot, empty if the journal is
+  // not running. Delta snapshots can be saved on top of it from these lsns.
+  std::vector<LSN> journal_lsns;
+
+  // Sum of the peak memory of the snapshot buffers in every shard.
+  size_t peak_buffers_size = 0;
+
+  // Bytes uploaded to cloud storage and the throughput of the upload, zero for local files.
+  size_t upload_bytes = 0;
+  size_t upload_bytes_per_sec = 0;
+
+  // Keys saved per second, the throughput achieved under the priority of the save.
+  size_t keys_per_sec = 0;
 };
 
+// A delta snapshot holds the journal changes of every shard since the previous snapshot. The
+// files are saved next to the DF snapshot they apply to, and are loaded after it.
+struct DeltaSnapshot {
+  std::filesystem::path base_path;  // path of the base snapshot without the dfs suffixes
+  unsigned id = 0;                  // deltas of a base are numbered from 1
+  std::vector<LSN> start_lsns;      // indexed by shard id
+};
+
+// Returns the filename of a delta snapshot file of the shard.
+std::string DeltaFilename(const std::filesystem::path& base_path, unsigned id, unsigned shard);
+
 struct SaveStagesInputs {
   bool use_dfs_format_;
   std::string_view basename_;
@@ -34,17 +63,24 @@ struct SaveStagesInputs {
   Service* service_;
   util::fb2::FiberQueueThreadPool* fq_threadpool_;
   std::shared_ptr<SnapshotStorage> snapshot_storage_;
+  journal::DiskJournal* disk_journal_ = nullptr;  // starts a new segment with the snapshot if set
+  std::optional<DeltaSnapshot> delta_;            // save a delta instead of a full snapshot if set
+  SavePriority priority_ = SavePriority::kNormal;
 };
 
 class RdbSnapshot {
  public:
-  RdbSnapshot(util::fb2::FiberQueueThreadPool* fq_tp, SnapshotStorage* snapshot_storage)
-      : snapshot_storage_{snapshot_storage} {
+  RdbSnapshot(util::fb2::FiberQueueThreadPool* fq_tp, SnapshotStorage* snapshot_storage,
+              SavePriority priority = SavePriority::kNormal)
+      : snapshot_storage_{snapshot_storage}, priority_{priority} {
   }
 
   GenericError Start(SaveMode save_mode, const string& path, const RdbSaver::GlobalData& glob_data);
   void StartInShard(EngineShard* shard);
 
+  // Save the journal changes of the shard in [start_lsn, end_lsn).
+  void StartIncrementalInShard(EngineShard* shard, LSN start_lsn, LSN end_lsn);
+
   error_code SaveBody();
   error_code Close();
   size_t GetSaveBuffersSize();
@@ -55,6 +91,18 @@ class RdbSnapshot {
     return freq_map_;
   }
 
+  size_t peak_buffers_size() const {
+    return peak_buffers_size_;
+  }
+
+  size_t upload_bytes() const {
+    return upload_bytes_;
+  }
+
+  uint64_t upload_usec() const {
+    return upload_usec_;
+  }
+
   bool HasStarted() const {
     return started_shards_.load(std::memory_order_relaxed) > 0 ||
            (saver_ && saver_->Mode() == SaveMode::SUMMARY);
@@ -62,13 +110,18 @@ class RdbSnapshot {
 
  private:
   bool is_linux_file_ = false;
+  bool is_cloud_file_ = false;
   SnapshotStorage* snapshot_storage_ = nullptr;
+  SavePriority priority_;
 
   std::atomic_uint32_t started_shards_ = 0;
 
   unique_ptr<io::Sink> io_sink_;
   unique_ptr<RdbSaver> saver_;
   RdbTypeFreqMap freq_map_;
+  size_t peak_buffers_size_ = 0;
+  size_t upload_bytes_ = 0;
+  uint64_t upload_usec_ = 0;
 
   Context cntx_{};
 };
@@ -102,9 +155,18 @@ struct SaveStagesController : public SaveStagesInputs {
   // Start saving a dfs file on shard
   void SaveDfsSingle(EngineShard* shard);
 
+  // Save a delta file for every shard.
+  void SaveDelta();
+
   // Save a single rdb file
   void SaveRdb();
 
+  // Bytes per second of the upload to cloud storage.
+  size_t UploadThroughput() const;
+
+  // Keys per second of the whole save.
+  size_t KeysThroughput() const;
+
   SaveInfo GetSaveInfo();
 
   void InitResources();
@@ -123,14 +185,20 @@ struct SaveStagesController : public SaveStagesInputs {
 
  private:
   time_t start_time_;
+  uint64_t start_ns_;
   std::filesystem::path full_path_;
   bool is_cloud_;
+  uint64_t journal_segment_ = 0;
+  std::vector<LSN> journal_lsns_;  // lsns of the shards at the snapshot point, 0 without journal
 
   AggregateGenericError shared_err_;
   std::vector<std::pair<std::unique_ptr<RdbSnapshot>, std::filesystem::path>> snapshots_;
 
   absl::flat_hash_map<string_view, size_t> rdb_name_map_;
-  util::fb2::Mutex rdb_name_map_mu_;
+  size_t peak_buffers_size_ = 0;
+  size_t upload_bytes_ = 0;
+  uint64_t upload_usec_ = 0;
+  util::fb2::Mutex rdb_name_map_mu_;  // guards rdb_name_map_ and the save stats
 };
 
 GenericError ValidateFilename(const std::filesystem::path& filename, bool new_version);
@@ -3,33 +3,95 @@
 
 #include "server/detail/snapshot_storage.h"
 
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 #include <absl/strings/strip.h>
 
 #ifdef WITH_AWS
 #include <aws/core/auth/AWSCredentialsProvider.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsV2Request.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
 
 #include "util/aws/aws.h"
 #include "util/aws/credentials_provider_chain.h"
 #include "util/aws/s3_endpoint_provider.h"
-#include "util/aws/s3_read_file.h"
-#include "util/aws/s3_write_file.h"
 #endif
 
+#include <mimalloc.h>
 #include <regex>
 
+#include "base/flags.h"
 #include "base/logging.h"
+#include "core/uring.h"
 #include "io/file_util.h"
 #include "server/engine_shard_set.h"
 #include "util/fibers/fiber_file.h"
 
+// S3 requires every part but the last one to be at least 5MB.
+ABSL_FLAG(dfly::MemoryBytesFlag, s3_upload_part_size, dfly::MemoryBytesFlag{16ULL << 20},
+          "Size of the parts of the multipart upload of an s3 snapshot file, at least 5MB.");
+ABSL_FLAG(uint32_t, s3_upload_parallelism, 4,
+          "Number of parts of every s3 snapshot file that are uploaded concurrently. "
+          "1 uploads the parts sequentially.");
+ABSL_FLAG(dfly::MemoryBytesFlag, s3_upload_bandwidth_limit, dfly::MemoryBytesFlag{},
+          "Bytes per second the uploads of all s3 snapshot files may use together. "
+          "0 means no limit.");
+ABSL_FLAG(dfly::MemoryBytesFlag, s3_download_chunk_size, dfly::MemoryBytesFlag{8ULL << 20},
+          "Size of the ranged GET requests that load an s3 snapshot file.");
+ABSL_FLAG(uint32_t, s3_download_parallelism, 4,
+          "Number of ranged GET requests of every s3 snapshot file that are fetched ahead of "
+          "the loader concurrently.");
+ABSL_FLAG(uint32_t, snapshot_write_queue_depth, 0,
+          "Number of asynchronous io_uring writes of every local snapshot file that may be in "
+          "flight. The data is copied into buffers of snapshot_write_buffer_size. 0 awaits "
+          "every write.");
+ABSL_FLAG(dfly::MemoryBytesFlag, snapshot_write_buffer_size, dfly::MemoryBytesFlag{1ULL << 20},
+          "Size of the buffers of the asynchronous snapshot writes, rounded up to 4KB.");
+ABSL_FLAG(bool, snapshot_fsync, false,
+          "If true, the data of local snapshot files written with io_uring is synced to the disk "
+          "before they are closed.");
+
 namespace dfly {
 namespace detail {
 
 using namespace util;
+using absl::GetFlag;
+
+#ifdef WITH_AWS
+namespace {
+
+constexpr size_t kMinS3PartSize = 5ULL << 20;
+
+// Reserves the transmission time of `bytes` on the bandwidth budget shared by all uploads, and
+// waits until the reserved slot starts.
+void ThrottleUpload(size_t bytes) {
+  static std::atomic<int64_t> next_free_ns{0};
+
+  uint64_t limit = GetFlag(FLAGS_s3_upload_bandwidth_limit).value;
+  if (limit == 0)
+    return;
+
+  int64_t cost = static_cast<int64_t>(bytes * 1e9 / limit);
+  int64_t now = absl::GetCurrentTimeNanos();
+  int64_t start = next_free_ns.load(std::memory_order_relaxed);
+  while (!next_free_ns.compare_exchange_weak(start, std::max(start, now) + cost,
+                                             std::memory_order_relaxed)) {
+  }
+
+  if (start > now)
+    ThisFiber::SleepFor(std::chrono::nanoseconds(start - now));
+}
+
+}  // namespace
+#endif
 
 std::optional<std::pair<std::string, std::string>> GetBucketPath(std::string_view path) {
   std::string_view clean = absl::StripPrefix(path, kS3Prefix);
@@ -77,7 +139,11 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> FileSnapshotStorage::Ope
     if (kRdbWriteFlags & O_DIRECT) {
       file_type |= FileType::DIRECT;
     }
-    return std::pair(new LinuxWriteWrapper(res->release()), file_type);
+    LinuxWriteWrapper::Options opts;
+    opts.queue_depth = GetFlag(FLAGS_snapshot_write_queue_depth);
+    opts.buf_size = GetFlag(FLAGS_snapshot_write_buffer_size).value;
+    opts.fsync = GetFlag(FLAGS_snapshot_fsync);
+    return std::pair(new LinuxWriteWrapper(res->release(), opts), file_type);
 #else
     LOG(FATAL) << "Linux I/O is not supported on this platform";
 #endif
@@ -180,6 +246,23 @@ io::Result<std::vector<std::string>, GenericError> FileSnapshotStorage::LoadPath
   return paths;
 }
 
+std::vector<std::string> FileSnapshotStorage::LoadDeltaPaths(const std::string& load_path) {
+  if (!absl::EndsWith(load_path, "summary.dfs"))
+    return {};
+
+  std::string glob = absl::StrReplaceAll(load_path, {{"summary", "delta-????-????"}});
+  io::Result<io::StatShortVec> files = io::StatFiles(glob);
+  if (!files)
+    return {};
+
+  // The names only differ in the zero padded delta and shard ids.
+  std::vector<std::string> paths;
+  for (auto& fstat : *files)
+    paths.push_back(std::move(fstat.name));
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
 #ifdef WITH_AWS
 AwsS3SnapshotStorage::AwsS3SnapshotStorage(const std::string& endpoint, bool https,
                                            bool ec2_metadata, bool sign_payload) {
@@ -213,13 +296,15 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> AwsS3SnapshotStorage::Op
       return nonstd::make_unexpected(GenericError("Invalid S3 path"));
     }
     auto [bucket, key] = *bucket_path;
-    io::Result<aws::S3WriteFile> file = aws::S3WriteFile::Open(bucket, key, s3_);
+    S3MultipartWriteFile::Options opts{
+        .part_size = std::max<size_t>(GetFlag(FLAGS_s3_upload_part_size).value, kMinS3PartSize),
+        .parallelism = std::max(GetFlag(FLAGS_s3_upload_parallelism), 1u)};
+    io::Result<S3MultipartWriteFile*> file = S3MultipartWriteFile::Open(bucket, key, s3_, opts);
     if (!file) {
       return nonstd::make_unexpected(GenericError(file.error(), "Failed to open write file"));
     }
 
-    aws::S3WriteFile* f = new aws::S3WriteFile(std::move(*file));
-    return std::pair<io::Sink*, uint8_t>(f, FileType::CLOUD);
+    return std::pair<io::Sink*, uint8_t>(*file, FileType::CLOUD);
   });
 }
 
@@ -229,7 +314,13 @@ io::ReadonlyFileOrError AwsS3SnapshotStorage::OpenReadFile(const std::string& pa
     return nonstd::make_unexpected(GenericError("Invalid S3 path"));
   }
   auto [bucket, key] = *bucket_path;
-  return new aws::S3ReadFile(bucket, key, s3_);
+  S3RangedReadFile::Options opts{
+      .chunk_size = std::max<size_t>(GetFlag(FLAGS_s3_download_chunk_size).value, 1),
+      .parallelism = std::max(GetFlag(FLAGS_s3_download_parallelism), 1u)};
+  io::Result<S3RangedReadFile*> file = S3RangedReadFile::Open(bucket, key, s3_, opts);
+  if (!file)
+    return nonstd::make_unexpected(file.error());
+  return *file;
 }
 
 io::Result<std::string, GenericError> AwsS3SnapshotStorage::LoadPath(std::string_view dir,
@@ -383,16 +474,388 @@ AwsS3SnapshotStorage::ListObjects(std::string_view bucket_name, std::string_view
   } while (!continuation_token.empty());
   return keys;
 }
+
+S3MultipartWriteFile::S3MultipartWriteFile(const std::string& bucket, const std::string& key,
+                                           std::string upload_id,
+                                           std::shared_ptr<Aws::S3::S3Client> client,
+                                           const Options& opts)
+    : io::WriteFile(key),
+      bucket_(bucket),
+      key_(key),
+      upload_id_(std::move(upload_id)),
+      client_(std::move(client)),
+      opts_(opts) {
+  part_buf_.reserve(opts_.part_size);
+  start_usec_ = absl::GetCurrentTimeNanos() / 1000;
+}
+
+S3MultipartWriteFile::~S3MultipartWriteFile() {
+  // Upload fibers reference the file.
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+}
+
+io::Result<S3MultipartWriteFile*> S3MultipartWriteFile::Open(
+    const std::string& bucket, const std::string& key, std::shared_ptr<Aws::S3::S3Client> client,
+    const Options& opts) {
+  Aws::S3::Model::CreateMultipartUploadRequest request;
+  request.SetBucket(bucket);
+  request.SetKey(key);
+  Aws::S3::Model::CreateMultipartUploadOutcome outcome = client->CreateMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to create multipart upload of " << bucket << "/" << key << ": "
+               << outcome.GetError().GetExceptionName() << ": "
+               << outcome.GetError().GetMessage();
+    return nonstd::make_unexpected(std::make_error_code(std::errc::io_error));
+  }
+
+  return new S3MultipartWriteFile(bucket, key, outcome.GetResult().GetUploadId(),
+                                  std::move(client), opts);
+}
+
+io::Result<size_t> S3MultipartWriteFile::WriteSome(const iovec* v, uint32_t len) {
+  if (ec_)
+    return nonstd::make_unexpected(ec_);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    const char* data = static_cast<const char*>(v[i].iov_base);
+    size_t size = v[i].iov_len;
+    while (size > 0) {
+      size_t to_copy = std::min(size, opts_.part_size - part_buf_.size());
+      part_buf_.append(data, to_copy);
+      data += to_copy;
+      size -= to_copy;
+      total += to_copy;
+      if (part_buf_.size() == opts_.part_size)
+        FlushPart();
+    }
+  }
+  return total;
+}
+
+std::error_code S3MultipartWriteFile::Close() {
+  // An upload has at least one part, which may be smaller than the part size.
+  if (!part_buf_.empty() || parts_.empty())
+    FlushPart();
+
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+  if (ec_) {
+    Abort();
+    return ec_;
+  }
+
+  Aws::S3::Model::CompletedMultipartUpload completed;
+  completed.SetParts(parts_);
+
+  Aws::S3::Model::CompleteMultipartUploadRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetMultipartUpload(std::move(completed));
+  Aws::S3::Model::CompleteMultipartUploadOutcome outcome = client_->CompleteMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to complete multipart upload of " << bucket_ << "/" << key_ << ": "
+               << outcome.GetError().GetExceptionName() << ": "
+               << outcome.GetError().GetMessage();
+    ec_ = std::make_error_code(std::errc::io_error);
+    Abort();
+    return ec_;
+  }
+
+  upload_usec_ = absl::GetCurrentTimeNanos() / 1000 - start_usec_;
+  VLOG(1) << "Uploaded " << uploaded_bytes_ << " bytes in " << parts_.size() << " parts to "
+          << bucket_ << "/" << key_ << " in " << upload_usec_ << "us";
+  return {};
+}
+
+void S3MultipartWriteFile::FlushPart() {
+  in_flight_ec_.await([this] { return in_flight_ < opts_.parallelism; });
+
+  parts_.emplace_back();
+  unsigned part_num = parts_.size();
+  std::string body = std::move(part_buf_);
+  part_buf_.clear();
+  part_buf_.reserve(opts_.part_size);
+
+  ++in_flight_;
+  fb2::Fiber("s3_upload_part", [this, part_num, body = std::move(body)]() mutable {
+    UploadPart(part_num, std::move(body));
+    --in_flight_;
+    in_flight_ec_.notifyAll();
+  }).Detach();
+}
+
+void S3MultipartWriteFile::UploadPart(unsigned part_num, std::string body) {
+  if (ec_)
+    return;
+
+  ThrottleUpload(body.size());
+
+  Aws::Utils::Stream::PreallocatedStreamBuf buf(reinterpret_cast<unsigned char*>(body.data()),
+                                                body.size());
+  Aws::S3::Model::UploadPartRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetPartNumber(part_num);
+  request.SetContentLength(body.size());
+  request.SetBody(std::make_shared<Aws::IOStream>(&buf));
+
+  Aws::S3::Model::UploadPartOutcome outcome = client_->UploadPart(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to upload part " << part_num << " of " << bucket_ << "/" << key_ << ": "
+               << outcome.GetError().GetExceptionName() << ": "
+               << outcome.GetError().GetMessage();
+    if (!ec_)
+      ec_ = std::make_error_code(std::errc::io_error);
+    return;
+  }
+
+  parts_[part_num - 1].SetPartNumber(part_num);
+  parts_[part_num - 1].SetETag(outcome.GetResult().GetETag());
+  uploaded_bytes_ += body.size();
+}
+
+S3RangedReadFile::S3RangedReadFile(const std::string& bucket, const std::string& key,
+                                   size_t size, std::shared_ptr<Aws::S3::S3Client> client,
+                                   const Options& opts)
+    : bucket_(bucket), key_(key), size_(size), client_(std::move(client)), opts_(opts) {
+}
+
+S3RangedReadFile::~S3RangedReadFile() {
+  // Fetch fibers reference the file.
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+}
+
+io::Result<S3RangedReadFile*> S3RangedReadFile::Open(const std::string& bucket,
+                                                     const std::string& key,
+                                                     std::shared_ptr<Aws::S3::S3Client> client,
+                                                     const Options& opts) {
+  Aws::S3::Model::HeadObjectRequest request;
+  request.SetBucket(bucket);
+  request.SetKey(key);
+  Aws::S3::Model::HeadObjectOutcome outcome = client->HeadObject(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to stat " << bucket << "/" << key << ": "
+               << outcome.GetError().GetExceptionName() << ": "
+               << outcome.GetError().GetMessage();
+    return nonstd::make_unexpected(std::make_error_code(std::errc::no_such_file_or_directory));
+  }
+
+  return new S3RangedReadFile(bucket, key, outcome.GetResult().GetContentLength(),
+                              std::move(client), opts);
+}
+
+io::Result<size_t> S3RangedReadFile::Read(size_t offset, const iovec* v, uint32_t len) {
+  // Drop the chunks before the offset, restart the window if the read is not sequential.
+  while (!window_.empty() && window_.front()->end <= offset) {
+    if (window_.front()->ready)
+      free_bufs_.push_back(std::move(window_.front()->data));
+    window_.pop_front();
+  }
+  if (window_.empty() ? next_fetch_ != offset : window_.front()->offset > offset)
+    ResetWindow(offset);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len && offset < size_; ++i) {
+    char* dest = static_cast<char*>(v[i].iov_base);
+    size_t size = v[i].iov_len;
+    while (size > 0 && offset < size_) {
+      FillWindow();
+
+      std::shared_ptr<Chunk> chunk = window_.front();
+      in_flight_ec_.await([&chunk] { return chunk->ready; });
+      if (chunk->ec)
+        return nonstd::make_unexpected(chunk->ec);
+
+      size_t pos = offset - chunk->offset;
+      size_t to_copy = std::min(size, chunk->data.size() - pos);
+      memcpy(dest, chunk->data.data() + pos, to_copy);
+      dest += to_copy;
+      size -= to_copy;
+      offset += to_copy;
+      total += to_copy;
+
+      if (pos + to_copy == chunk->data.size()) {
+        free_bufs_.push_back(std::move(chunk->data));
+        window_.pop_front();
+      }
+    }
+  }
+  FillWindow();
+  return total;
+}
+
+std::error_code S3RangedReadFile::Close() {
+  ResetWindow(size_);
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+  free_bufs_.clear();
+  return {};
+}
+
+void S3RangedReadFile::FillWindow() {
+  while (window_.size() < opts_.parallelism && next_fetch_ < size_) {
+    auto chunk = std::make_shared<Chunk>();
+    chunk->offset = next_fetch_;
+    chunk->end = std::min(next_fetch_ + opts_.chunk_size, size_);
+    if (!free_bufs_.empty()) {
+      chunk->data = std::move(free_bufs_.back());
+      free_bufs_.pop_back();
+    }
+    next_fetch_ = chunk->end;
+    window_.push_back(chunk);
+
+    ++in_flight_;
+    fb2::Fiber("s3_fetch_chunk", [this, chunk = std::move(chunk)]() mutable {
+      FetchChunk(std::move(chunk));
+      --in_flight_;
+      in_flight_ec_.notifyAll();
+    }).Detach();
+  }
+}
+
+void S3RangedReadFile::FetchChunk(std::shared_ptr<Chunk> chunk) {
+  Aws::S3::Model::GetObjectRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetRange(absl::StrCat("bytes=", chunk->offset, "-", chunk->end - 1));
+  Aws::S3::Model::GetObjectOutcome outcome = client_->GetObject(request);
+  if (outcome.IsSuccess()) {
+    chunk->data.resize(chunk->end - chunk->offset);
+    std::istream& body = outcome.GetResult().GetBody();
+    body.read(chunk->data.data(), chunk->data.size());
+    if (size_t(body.gcount()) != chunk->data.size()) {
+      LOG(ERROR) << "Short read of " << bucket_ << "/" << key_ << " at " << chunk->offset;
+      chunk->ec = std::make_error_code(std::errc::io_error);
+    }
+  } else {
+    LOG(ERROR) << "Failed to read " << bucket_ << "/" << key_ << " at " << chunk->offset << ": "
+               << outcome.GetError().GetExceptionName() << ": "
+               << outcome.GetError().GetMessage();
+    chunk->ec = std::make_error_code(std::errc::io_error);
+  }
+  chunk->ready = true;
+}
+
+void S3RangedReadFile::ResetWindow(size_t offset) {
+  // Chunks still in flight are owned by their fibers until they finish.
+  for (auto& chunk : window_) {
+    if (chunk->ready)
+      free_bufs_.push_back(std::move(chunk->data));
+  }
+  window_.clear();
+  next_fetch_ = offset;
+}
+
+void S3MultipartWriteFile::Abort() {
+  Aws::S3::Model::AbortMultipartUploadRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  Aws::S3::Model::AbortMultipartUploadOutcome outcome = client_->AbortMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(WARNING) << "Failed to abort multipart upload of " << bucket_ << "/" << key_ << ": "
+                 << outcome.GetError().GetExceptionName();
+  }
+}
 #endif
 
 #ifdef __linux__
+LinuxWriteWrapper::LinuxWriteWrapper(util::fb2::LinuxFile* lf, Options opts)
+    : lf_(lf), opts_(opts) {
+  if (opts_.queue_depth == 0)
+    return;
+
+  // One buffer is filled while the others are written.
+  opts_.buf_size = std::max<size_t>((opts_.buf_size + 4095) & ~size_t(4095), 4096);
+  for (unsigned i = 0; i <= opts_.queue_depth; ++i)
+    bufs_.push_back(static_cast<uint8_t*>(mi_malloc_aligned(opts_.buf_size, 4096)));
+  free_bufs_ = bufs_;
+}
+
+LinuxWriteWrapper::~LinuxWriteWrapper() {
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+  for (uint8_t* buf : bufs_)
+    mi_free(buf);
+}
+
 io::Result<size_t> LinuxWriteWrapper::WriteSome(const iovec* v, uint32_t len) {
-  io::Result<size_t> res = lf_->WriteSome(v, len, offset_, 0);
-  if (res) {
-    offset_ += *res;
+  if (opts_.queue_depth == 0) {
+    io::Result<size_t> res = lf_->WriteSome(v, len, offset_, 0);
+    if (res) {
+      offset_ += *res;
+    }
+
+    return res;
+  }
+
+  if (write_ec_)
+    return nonstd::make_unexpected(write_ec_);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    io::Bytes src{static_cast<const uint8_t*>(v[i].iov_base), v[i].iov_len};
+    while (!src.empty()) {
+      if (!cur_buf_) {
+        in_flight_ec_.await([this] { return !free_bufs_.empty(); });
+        cur_buf_ = free_bufs_.back();
+        free_bufs_.pop_back();
+      }
+
+      size_t to_copy = std::min(src.size(), opts_.buf_size - cur_len_);
+      memcpy(cur_buf_ + cur_len_, src.data(), to_copy);
+      cur_len_ += to_copy;
+      src.remove_prefix(to_copy);
+      total += to_copy;
+
+      if (cur_len_ == opts_.buf_size)
+        SubmitBuffer();
+    }
+  }
+  return total;
+}
+
+void LinuxWriteWrapper::SubmitBuffer() {
+  uint8_t* buf = cur_buf_;
+  size_t len = cur_len_;
+  cur_buf_ = nullptr;
+  cur_len_ = 0;
+
+  ++in_flight_;
+  lf_->WriteAsync(io::Bytes{buf, len}, offset_, [this, buf, len](int io_res) {
+    if (io_res < 0 && !write_ec_)
+      write_ec_ = std::error_code{-io_res, std::system_category()};
+    else if (io_res >= 0 && size_t(io_res) != len && !write_ec_)
+      write_ec_ = std::make_error_code(std::errc::io_error);  // short writes are not resumed
+
+    free_bufs_.push_back(buf);
+    --in_flight_;
+    in_flight_ec_.notifyAll();
+  });
+  offset_ += len;
+}
+
+std::error_code LinuxWriteWrapper::Close() {
+  if (cur_len_ > 0) {
+    SubmitBuffer();
+  } else if (cur_buf_) {
+    free_bufs_.push_back(cur_buf_);
+    cur_buf_ = nullptr;
+  }
+  in_flight_ec_.await([this] { return in_flight_ == 0; });
+
+  std::error_code ec = write_ec_;
+  if (!ec && opts_.fsync) {
+    auto* proactor = static_cast<fb2::UringProactor*>(fb2::ProactorBase::me());
+    FiberCall fc(proactor);
+    fc->PrepFSync(lf_->fd(), IORING_FSYNC_DATASYNC);
+    FiberCall::IoResult io_res = fc.Get();
+    if (io_res < 0)
+      ec = std::error_code{-io_res, std::system_category()};
   }
 
-  return res;
+  std::error_code close_ec = lf_->Close();
+  return ec ? ec : close_ec;
 }
 #endif
 
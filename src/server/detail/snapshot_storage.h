@@ -5,8 +5,10 @@
 
 #ifdef WITH_AWS
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/CompletedPart.h>
 #endif
 
+#include <deque>
 #include <filesystem>
 #include <string>
 #include <string_view>
@@ -51,6 +53,12 @@ class SnapshotStorage {
   // Returns the snapshot paths given the RDB file or DFS summary file path.
   virtual io::Result<std::vector<std::string>, GenericError> LoadPaths(
       const std::string& load_path) = 0;
+
+  // Returns the delta snapshot files of the DFS summary file path, ordered by delta id. Deltas are
+  // only saved to local files.
+  virtual std::vector<std::string> LoadDeltaPaths(const std::string& load_path) {
+    return {};
+  }
 };
 
 class FileSnapshotStorage : public SnapshotStorage {
@@ -68,6 +76,8 @@ class FileSnapshotStorage : public SnapshotStorage {
   io::Result<std::vector<std::string>, GenericError> LoadPaths(
       const std::string& load_path) override;
 
+  std::vector<std::string> LoadDeltaPaths(const std::string& load_path) override;
+
  private:
   util::fb2::FiberQueueThreadPool* fq_threadpool_;
 };
@@ -105,26 +115,160 @@ class AwsS3SnapshotStorage : public SnapshotStorage {
   std::shared_ptr<Aws::S3::S3Client> s3_;
 };
 
+// Uploads a file to S3 with a multipart upload. Written data is cut into parts of part_size
+// bytes, and up to parallelism parts are uploaded concurrently by fibers of the writing thread.
+// The upload of all files shares a global bandwidth limit. The file must be written and closed
+// on the same thread.
+class S3MultipartWriteFile : public io::WriteFile {
+ public:
+  struct Options {
+    size_t part_size;
+    unsigned parallelism;
+  };
+
+  ~S3MultipartWriteFile() override;
+
+  static io::Result<S3MultipartWriteFile*> Open(const std::string& bucket, const std::string& key,
+                                                std::shared_ptr<Aws::S3::S3Client> client,
+                                                const Options& opts);
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) override;
+
+  // Uploads the last part, waits for all parts and completes the upload. Aborts the upload if
+  // any part failed.
+  std::error_code Close() override;
+
+  size_t uploaded_bytes() const {
+    return uploaded_bytes_;
+  }
+
+  // Time from opening the file until the upload was completed.
+  uint64_t upload_usec() const {
+    return upload_usec_;
+  }
+
+ private:
+  S3MultipartWriteFile(const std::string& bucket, const std::string& key, std::string upload_id,
+                       std::shared_ptr<Aws::S3::S3Client> client, const Options& opts);
+
+  // Hands the current part buffer over to an upload fiber, blocks while too many are in flight.
+  void FlushPart();
+  void UploadPart(unsigned part_num, std::string body);
+  void Abort();
+
+  std::string bucket_, key_, upload_id_;
+  std::shared_ptr<Aws::S3::S3Client> client_;
+  Options opts_;
+
+  std::string part_buf_;
+  std::vector<Aws::S3::Model::CompletedPart> parts_;  // indexed by part number - 1
+
+  unsigned in_flight_ = 0;
+  util::fb2::EventCount in_flight_ec_;
+  std::error_code ec_;  // first upload error
+
+  size_t uploaded_bytes_ = 0;
+  uint64_t start_usec_ = 0, upload_usec_ = 0;
+};
+
+// Reads a file from S3 with concurrent ranged GET requests. Sequential reads are served from
+// a window of parallelism chunks of chunk_size bytes that are fetched ahead of the read offset
+// by fibers of the reading thread. The file must be read and closed on the same thread.
+class S3RangedReadFile : public io::ReadonlyFile {
+ public:
+  struct Options {
+    size_t chunk_size;
+    unsigned parallelism;
+  };
+
+  ~S3RangedReadFile() override;
+
+  static io::Result<S3RangedReadFile*> Open(const std::string& bucket, const std::string& key,
+                                            std::shared_ptr<Aws::S3::S3Client> client,
+                                            const Options& opts);
+
+  io::Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) override;
+
+  std::error_code Close() override;
+
+  size_t Size() const override {
+    return size_;
+  }
+
+  int Handle() const override {
+    return -1;
+  }
+
+ private:
+  struct Chunk {
+    size_t offset = 0, end = 0;
+    std::string data;
+    bool ready = false;
+    std::error_code ec;
+  };
+
+  S3RangedReadFile(const std::string& bucket, const std::string& key, size_t size,
+                   std::shared_ptr<Aws::S3::S3Client> client, const Options& opts);
+
+  // Fetches chunks until the window is full or the end of the file is reached.
+  void FillWindow();
+  void FetchChunk(std::shared_ptr<Chunk> chunk);
+
+  // Drops the window, the next FillWindow starts fetching from offset.
+  void ResetWindow(size_t offset);
+
+  std::string bucket_, key_;
+  size_t size_;
+  std::shared_ptr<Aws::S3::S3Client> client_;
+  Options opts_;
+
+  std::deque<std::shared_ptr<Chunk>> window_;  // ordered by offset
+  std::vector<std::string> free_bufs_;         // reused chunk buffers
+  size_t next_fetch_ = 0;                      // offset of the next chunk to fetch
+
+  unsigned in_flight_ = 0;
+  util::fb2::EventCount in_flight_ec_;
+};
+
 // Returns bucket_name, obj_path for an s3 path.
 std::optional<std::pair<std::string, std::string>> GetBucketPath(std::string_view path);
 #endif
 
 #ifdef __linux__
-// takes ownership over the file.
+// Writes a snapshot file with io_uring, takes ownership over the file. By default every write is
+// awaited. With a queue depth, the data is copied into aligned buffers that are written
+// asynchronously, so the serialization goes on while up to queue_depth writes are in flight.
 class LinuxWriteWrapper : public io::Sink {
  public:
-  LinuxWriteWrapper(util::fb2::LinuxFile* lf) : lf_(lf) {
-  }
+  struct Options {
+    unsigned queue_depth = 0;      // 0 awaits every write
+    size_t buf_size = 1ULL << 20;  // size of the buffers of asynchronous writes, 4KB aligned
+    bool fsync = false;            // sync the data of the file on Close
+  };
+
+  explicit LinuxWriteWrapper(util::fb2::LinuxFile* lf, Options opts = {});
+  ~LinuxWriteWrapper();
 
   io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
 
-  std::error_code Close() {
-    return lf_->Close();
-  }
+  // Waits for the writes in flight and syncs the file if requested before closing it.
+  std::error_code Close();
 
  private:
+  // Writes the current buffer asynchronously.
+  void SubmitBuffer();
+
   std::unique_ptr<util::fb2::LinuxFile> lf_;
   off_t offset_ = 0;
+  Options opts_;
+
+  std::vector<uint8_t*> bufs_, free_bufs_;
+  uint8_t* cur_buf_ = nullptr;
+  size_t cur_len_ = 0;
+
+  unsigned in_flight_ = 0;
+  std::error_code write_ec_;  // first error of the asynchronous writes
+  util::fb2::EventCount in_flight_ec_;
 };
 #endif
 
@@ -20,6 +20,9 @@ struct PrimeTablePolicy {
 
   static constexpr bool kUseVersion = true;
 
+  // Expiry of the key, used when the expiries are stored inline (see DbTable::inline_expire).
+  using SlotExt = ExpirePeriod;
+
   static uint64_t HashFn(const PrimeKey& s) {
     return s.HashCode();
   }
@@ -189,17 +189,7 @@ class WrappedJsonPath {
                                                         JsonPathMutateCallback<T> cb,
                                                         CallbackResultOptions options = {}) const {
     JsonCallbackResult<std::optional<T>> mutate_result{InitializePathType(options)};
-
-    auto mutate_callback = [&cb, &mutate_result](std::optional<std::string_view> path,
-                                                 JsonType* val) -> bool {
-      auto res = cb(path, val);
-      if (res.value.has_value()) {
-        mutate_result.AddValue(std::move(res.value).value());
-      } else if (!mutate_result.IsV1()) {
-        mutate_result.AddValue(std::nullopt);
-      }
-      return res.should_be_deleted;
-    };
+    auto mutate_callback = CollectingCallback(cb, &mutate_result);
 
     if (HoldsJsonPath()) {
       const auto& json_path = AsJsonPath();
@@ -236,6 +226,28 @@ class WrappedJsonPath {
     return mutate_result;
   }
 
+  // Same as above but for the flat encoding. Scalar updates that fit are written to the buffer
+  // of json_entry in place, otherwise the mutated json is built into fbb.
+  template <typename T>
+  OpResult<JsonCallbackResult<std::optional<T>>> Mutate(FlatJson json_entry,
+                                                        flexbuffers::Builder* fbb,
+                                                        JsonPathMutateCallback<T> cb,
+                                                        CallbackResultOptions options = {}) const {
+    if (!HoldsJsonPath()) {  // Legacy expressions are evaluated on jsoncons trees only
+      JsonType json = json::FromFlat(json_entry);
+      auto mutate_res = Mutate(&json, cb, options);
+      if (mutate_res) {
+        json::FromJsonType(json, fbb);
+        fbb->Finish();
+      }
+      return mutate_res;
+    }
+
+    JsonCallbackResult<std::optional<T>> mutate_result{InitializePathType(options)};
+    json::MutatePath(AsJsonPath(), CollectingCallback(cb, &mutate_result), json_entry, fbb);
+    return mutate_result;
+  }
+
   bool IsLegacyModePath() const {
     return path_type_ == JsonPathType::kLegacy;
   }
@@ -265,6 +277,21 @@ class WrappedJsonPath {
     return options;
   }
 
+  // Adapts cb to json::MutateCallback and collects its values into result
+  template <typename T>
+  static auto CollectingCallback(JsonPathMutateCallback<T> cb,
+                                 JsonCallbackResult<std::optional<T>>* result) {
+    return [cb, result](std::optional<std::string_view> path, JsonType* val) -> bool {
+      auto res = cb(path, val);
+      if (res.value.has_value()) {
+        result->AddValue(std::move(res.value).value());
+      } else if (!result->IsV1()) {
+        result->AddValue(std::nullopt);
+      }
+      return res.should_be_deleted;
+    };
+  }
+
  private:
   std::variant<json::Path, JsonExpression> parsed_path_;
   StringOrView path_;
@@ -2,12 +2,23 @@
 // See LICENSE for licensing terms.
 //
 
+extern "C" {
+#include "redis/crc16.h"
+}
+
+#include <absl/numeric/bits.h>
 #include <absl/random/random.h>
+#include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
+#include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <queue>
 
 #include "absl/time/clock.h"
@@ -44,8 +55,22 @@ ABSL_FLAG(uint64_t, key_stddev, 0,
 ABSL_FLAG(uint32_t, pipeline, 1, "maximum number of pending requests per connection");
 ABSL_FLAG(string, ratio, "1:10", "Set:Get ratio");
 ABSL_FLAG(string, command, "", "custom command with __key__ placeholder for keys");
+ABSL_FLAG(double, block_timeout, 0,
+          "If positive, the Set:Get ratio sends LPUSH and BLPOP with this timeout in seconds "
+          "instead of SET and GET");
 ABSL_FLAG(string, P, "", "protocol can be empty (for RESP) or memcache_text");
 ABSL_FLAG(bool, tcp_nodelay, false, "If true, set nodelay option on tcp socket");
+ABSL_FLAG(string, workload, "",
+          "Workload spec file with a weighted command mix, value sizes and pipeline depths. "
+          "Overrides ratio and command");
+ABSL_FLAG(string, trace, "",
+          "File with MONITOR output whose commands are replayed in order instead of generated "
+          "ones");
+ABSL_FLAG(bool, cluster, false,
+          "If true, discovers the cluster topology from the h/p node with CLUSTER SLOTS and sends "
+          "every request to the node that owns its key");
+ABSL_FLAG(uint32_t, report_interval, 5, "Interval in seconds between progress reports");
+ABSL_FLAG(string, json_out, "", "If set, writes the results as JSON to this file");
 
 using namespace std;
 using namespace util;
@@ -67,6 +92,30 @@ thread_local base::Xoroshiro128p bit_gen;
 enum Protocol { RESP, MC_TEXT } protocol;
 enum DistType { UNIFORM, NORMAL, ZIPFIAN, SEQUENTIAL } dist_type{UNIFORM};
 
+constexpr unsigned kNumSlots = 16384;
+
+// A node the benchmark sends requests to. Without --cluster it is the single h/p endpoint.
+struct Node {
+  string addr;  // ip:port as announced by the cluster
+  tcp::endpoint ep;
+};
+
+vector<Node> nodes;
+
+// Owner node of every slot as discovered at start, copied to every thread and updated there on
+// MOVED replies.
+vector<uint16_t> slot_owner;
+thread_local vector<uint16_t> tl_slot_owner;
+
+uint16_t KeySlot(string_view key) {
+  // Only the part between the first { and the following } is hashed, if it is not empty.
+  if (size_t start = key.find('{'); start != string_view::npos) {
+    if (size_t end = key.find('}', start + 1); end != string_view::npos && end != start + 1)
+      key = key.substr(start + 1, end - start - 1);
+  }
+  return crc16(key.data(), key.size()) & (kNumSlots - 1);
+}
+
 class KeyGenerator {
  public:
   KeyGenerator(uint32_t min, uint32_t max);
@@ -81,6 +130,181 @@ class KeyGenerator {
   optional<base::ZipfianGenerator> zipf_;
 };
 
+constexpr string_view kDataPlaceholder = "__data__"sv;
+
+// Upper case names of the commands that are sent, results are broken down by them
+vector<string> cmd_names;
+
+uint16_t CmdNameIndex(string_view cmd) {
+  string name = absl::AsciiStrToUpper(cmd.substr(0, cmd.find_first_of(" \r\n")));
+  auto it = find(cmd_names.begin(), cmd_names.end(), name);
+  if (it != cmd_names.end())
+    return it - cmd_names.begin();
+  cmd_names.push_back(std::move(name));
+  return cmd_names.size() - 1;
+}
+
+// Command mix read from the --workload file. Its lines are
+//   <weight> [size=<min>-<max>] <command template>   e.g. "3 size=16-1024 HSET __key__ f __data__"
+//   pipeline <depth>:<weight>...                      e.g. "pipeline 1:80 16:20"
+// where __key__ is replaced by generated keys and __data__ by a value of the given size range.
+// Empty lines and lines starting with # are ignored.
+struct Workload {
+  struct Cmd {
+    string templ;
+    uint32_t weight;
+    uint32_t min_size, max_size;
+    uint16_t name;
+  };
+
+  vector<Cmd> cmds;
+  vector<pair<uint32_t, uint32_t>> depths;  // Pipeline depth and its weight
+  uint32_t total_weight = 0, total_depth_weight = 0;
+  uint32_t max_size = 0;
+
+  void Load(const string& path);
+};
+
+optional<Workload> workload;
+
+void Workload::Load(const string& path) {
+  std::ifstream in(path);
+  CHECK(in) << "Could not open workload " << path;
+
+  string line;
+  while (getline(in, line)) {
+    string_view sv = absl::StripAsciiWhitespace(line);
+    if (sv.empty() || sv[0] == '#')
+      continue;
+
+    pair<string_view, string_view> parts = absl::StrSplit(sv, absl::MaxSplits(' ', 1));
+    if (parts.first == "pipeline") {
+      for (string_view item : absl::StrSplit(parts.second, ' ', absl::SkipEmpty())) {
+        pair<string_view, string_view> dw = absl::StrSplit(item, ':');
+        uint32_t depth, weight;
+        CHECK(absl::SimpleAtoi(dw.first, &depth) && absl::SimpleAtoi(dw.second, &weight) &&
+              depth > 0)
+            << "Invalid pipeline depth " << item;
+        depths.emplace_back(depth, weight);
+        total_depth_weight += weight;
+      }
+      continue;
+    }
+
+    Cmd cmd;
+    CHECK(absl::SimpleAtoi(parts.first, &cmd.weight)) << "Invalid workload line " << line;
+    cmd.min_size = cmd.max_size = GetFlag(FLAGS_d);
+    string_view templ = absl::StripLeadingAsciiWhitespace(parts.second);
+    if (absl::ConsumePrefix(&templ, "size=")) {
+      pair<string_view, string_view> range =
+          absl::StrSplit(templ.substr(0, templ.find(' ')), absl::MaxSplits('-', 1));
+      CHECK(absl::SimpleAtoi(range.first, &cmd.min_size)) << "Invalid size in " << line;
+      if (!range.second.empty())
+        CHECK(absl::SimpleAtoi(range.second, &cmd.max_size)) << "Invalid size in " << line;
+      else
+        cmd.max_size = cmd.min_size;
+      CHECK_LE(cmd.min_size, cmd.max_size) << line;
+      templ = absl::StripLeadingAsciiWhitespace(templ.substr(min(templ.size(), templ.find(' '))));
+    }
+    CHECK(!templ.empty()) << "Missing command in " << line;
+
+    cmd.templ = templ;
+    cmd.name = CmdNameIndex(templ);
+    total_weight += cmd.weight;
+    max_size = std::max(max_size, cmd.max_size);
+    cmds.push_back(std::move(cmd));
+  }
+  CHECK_GT(total_weight, 0u) << "Workload " << path << " has no commands";
+  CHECK(depths.empty() || total_depth_weight > 0) << "Pipeline depths of " << path;
+}
+
+// Commands of the --trace file, serialized in RESP
+struct TraceCmd {
+  string cmd;
+  string key;  // The first argument, used for routing in cluster mode
+  uint16_t name;
+};
+
+vector<TraceCmd> trace;
+
+// Parses the quoted arguments of a MONITOR line, for example
+// 1712345678.123456 [0 127.0.0.1:5000] "SET" "foo" "b\"ar"
+bool ParseMonitorLine(string_view line, vector<string>* args) {
+  size_t pos = line.find("] ");
+  if (pos == string_view::npos)
+    return false;
+
+  line.remove_prefix(pos + 2);
+  while (!line.empty()) {
+    if (line[0] == ' ') {
+      line.remove_prefix(1);
+      continue;
+    }
+    if (line[0] != '"')
+      return false;
+
+    string arg;
+    size_t i = 1;
+    for (; i < line.size() && line[i] != '"'; ++i) {
+      if (line[i] != '\\' || i + 1 == line.size()) {
+        arg.push_back(line[i]);
+        continue;
+      }
+      char c = line[++i];
+      switch (c) {
+        case 'n':
+          arg.push_back('\n');
+          break;
+        case 'r':
+          arg.push_back('\r');
+          break;
+        case 't':
+          arg.push_back('\t');
+          break;
+        case 'x': {
+          int val;
+          if (i + 2 < line.size() && absl::SimpleHexAtoi(line.substr(i + 1, 2), &val)) {
+            arg.push_back(char(val));
+            i += 2;
+          }
+          break;
+        }
+        default:
+          arg.push_back(c);
+      }
+    }
+    if (i == line.size())
+      return false;  // Unterminated argument
+    args->push_back(std::move(arg));
+    line.remove_prefix(i + 1);
+  }
+  return !args->empty();
+}
+
+void LoadTrace(const string& path) {
+  std::ifstream in(path);
+  CHECK(in) << "Could not open trace " << path;
+
+  string line;
+  vector<string> args;
+  size_t skipped = 0;
+  while (getline(in, line)) {
+    args.clear();
+    if (!ParseMonitorLine(line, &args)) {
+      skipped += !absl::StripAsciiWhitespace(line).empty();
+      continue;
+    }
+
+    TraceCmd cmd{absl::StrCat("*", args.size(), "\r\n"), args.size() > 1 ? args[1] : "",
+                 CmdNameIndex(args[0])};
+    for (const string& arg : args)
+      absl::StrAppend(&cmd.cmd, "$", arg.size(), "\r\n", arg, "\r\n");
+    trace.push_back(std::move(cmd));
+  }
+  LOG_IF(WARNING, skipped) << "Skipped " << skipped << " lines of " << path;
+  CHECK(!trace.empty()) << "Trace " << path << " has no commands";
+}
+
 class CommandGenerator {
  public:
   CommandGenerator(KeyGenerator* keygen);
@@ -91,28 +315,59 @@ class CommandGenerator {
     return might_hit_;
   }
 
+  // The last key of the last command
+  string_view key() const {
+    return key_;
+  }
+
+  // Index in cmd_names of the last command
+  uint16_t name() const {
+    return name_;
+  }
+
+  // Number of commands to send in the next pipeline
+  unsigned NextDepth();
+
  private:
   void FillSet(string_view key);
   void FillGet(string_view key);
+  void FillWorkload();
 
   KeyGenerator* keygen_;
   uint32_t ratio_set_ = 0, ratio_get_ = 0;
   string command_;
   string cmd_;
+  string key_;
   std::vector<size_t> key_indices_;
   string value_;
+  string block_timeout_;
   bool might_hit_ = false;
+  uint16_t name_ = 0;
+  uint16_t set_name_ = 0, get_name_ = 0, command_name_ = 0;
+  size_t trace_pos_ = 0;
 };
 
 CommandGenerator::CommandGenerator(KeyGenerator* keygen) : keygen_(keygen) {
   command_ = GetFlag(FLAGS_command);
-  value_ = string(GetFlag(FLAGS_d), 'a');
+  value_ = string(workload ? workload->max_size : GetFlag(FLAGS_d), 'a');
+  if (double timeout = GetFlag(FLAGS_block_timeout); timeout > 0) {
+    CHECK_EQ(protocol, RESP) << "blocking commands require RESP";
+    block_timeout_ = absl::StrCat(timeout);
+  }
 
-  if (command_.empty()) {
+  if (!trace.empty()) {
+    // Threads replay the trace from different positions
+    trace_pos_ = absl::Uniform(bit_gen, size_t{0}, trace.size());
+  } else if (workload) {
+    // The command mix is defined by the workload
+  } else if (command_.empty()) {
     pair<string, string> ratio_str = absl::StrSplit(GetFlag(FLAGS_ratio), ':');
     CHECK(absl::SimpleAtoi(ratio_str.first, &ratio_set_));
     CHECK(absl::SimpleAtoi(ratio_str.second, &ratio_get_));
+    set_name_ = CmdNameIndex(block_timeout_.empty() ? "SET" : "LPUSH");
+    get_name_ = CmdNameIndex(block_timeout_.empty() ? "GET" : "BLPOP");
   } else {
+    command_name_ = CmdNameIndex(command_);
     for (size_t pos = 0; (pos = command_.find(kKeyPlaceholder, pos)) != string::npos;
          pos += kKeyPlaceholder.size()) {
       key_indices_.push_back(pos);
@@ -122,22 +377,35 @@ CommandGenerator::CommandGenerator(KeyGenerator* keygen) : keygen_(keygen) {
 
 string CommandGenerator::Next() {
   cmd_.clear();
-  string key;
-  if (command_.empty()) {
-    key = (*keygen_)();
+  if (!trace.empty()) {
+    const TraceCmd& cmd = trace[trace_pos_];
+    trace_pos_ = (trace_pos_ + 1) % trace.size();
+    key_ = cmd.key;
+    name_ = cmd.name;
+    might_hit_ = false;
+    return cmd.cmd;
+  }
+
+  if (workload) {
+    FillWorkload();
+  } else if (command_.empty()) {
+    key_ = (*keygen_)();
 
     if (absl::Uniform(bit_gen, 0U, ratio_get_ + ratio_set_) < ratio_set_) {
-      FillSet(key);
+      FillSet(key_);
       might_hit_ = false;
+      name_ = set_name_;
     } else {
-      FillGet(key);
+      FillGet(key_);
       might_hit_ = true;
+      name_ = get_name_;
     }
   } else {
+    name_ = command_name_;
     size_t last_pos = 0;
     for (size_t pos : key_indices_) {
-      key = (*keygen_)();
-      absl::StrAppend(&cmd_, command_.substr(last_pos, pos - last_pos), key);
+      key_ = (*keygen_)();
+      absl::StrAppend(&cmd_, command_.substr(last_pos, pos - last_pos), key_);
       last_pos = pos + kKeyPlaceholder.size();
     }
     absl::StrAppend(&cmd_, command_.substr(last_pos), "\r\n");
@@ -146,7 +414,9 @@ string CommandGenerator::Next() {
 }
 
 void CommandGenerator::FillSet(string_view key) {
-  if (protocol == RESP) {
+  if (!block_timeout_.empty()) {
+    absl::StrAppend(&cmd_, "lpush ", key, " ", value_, "\r\n");
+  } else if (protocol == RESP) {
     absl::StrAppend(&cmd_, "set ", key, " ", value_, "\r\n");
   } else {
     DCHECK_EQ(protocol, MC_TEXT);
@@ -155,21 +425,180 @@ void CommandGenerator::FillSet(string_view key) {
   }
 }
 
+void CommandGenerator::FillWorkload() {
+  uint32_t pick = absl::Uniform(bit_gen, 0u, workload->total_weight);
+  auto it = workload->cmds.begin();
+  while (pick >= it->weight) {
+    pick -= it->weight;
+    ++it;
+  }
+
+  // Commands without a value are reads and count towards the hit rate
+  string_view templ = it->templ;
+  name_ = it->name;
+  might_hit_ = true;
+  while (!templ.empty()) {
+    size_t key_pos = templ.find(kKeyPlaceholder), data_pos = templ.find(kDataPlaceholder);
+    size_t pos = min(key_pos, data_pos);
+    absl::StrAppend(&cmd_, templ.substr(0, min(pos, templ.size())));
+    if (pos == string_view::npos)
+      break;
+
+    if (pos == key_pos) {
+      key_ = (*keygen_)();
+      absl::StrAppend(&cmd_, key_);
+      templ.remove_prefix(pos + kKeyPlaceholder.size());
+    } else {
+      uint32_t size = absl::Uniform(absl::IntervalClosed, bit_gen, it->min_size, it->max_size);
+      absl::StrAppend(&cmd_, string_view{value_}.substr(0, size));
+      templ.remove_prefix(pos + kDataPlaceholder.size());
+      might_hit_ = false;
+    }
+  }
+  absl::StrAppend(&cmd_, "\r\n");
+}
+
+unsigned CommandGenerator::NextDepth() {
+  if (!workload || workload->depths.empty())
+    return 1;
+
+  uint32_t pick = absl::Uniform(bit_gen, 0u, workload->total_depth_weight);
+  for (auto [depth, weight] : workload->depths) {
+    if (pick < weight)
+      return depth;
+    pick -= weight;
+  }
+  return 1;
+}
+
 void CommandGenerator::FillGet(string_view key) {
+  if (!block_timeout_.empty()) {
+    absl::StrAppend(&cmd_, "blpop ", key, " ", block_timeout_, "\r\n");
+    return;
+  }
   absl::StrAppend(&cmd_, "get ", key, "\r\n");
 }
 
+// Histogram with the layout of HdrHistogram: values below 2^kSubBits are counted exactly and
+// larger values in buckets of the same relative width, so that recorded values keep three
+// significant digits for the whole range.
+class HdrHistogram {
+ public:
+  static constexpr unsigned kSubBits = 11;
+  static constexpr uint64_t kMaxValue = (1ULL << 36) - 1;  // ~19 hours in usec
+
+  HdrHistogram() : counts_(Index(kMaxValue) + 1) {
+  }
+
+  void Add(uint64_t value) {
+    value = std::min(value, kMaxValue);
+    counts_[Index(value)]++;
+    total_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+  }
+
+  HdrHistogram& operator+=(const HdrHistogram& o) {
+    for (size_t i = 0; i < counts_.size(); ++i)
+      counts_[i] += o.counts_[i];
+    total_ += o.total_;
+    sum_ += o.sum_;
+    max_ = std::max(max_, o.max_);
+    return *this;
+  }
+
+  // Removes the values of an earlier snapshot of this histogram. The maximum is kept.
+  HdrHistogram& operator-=(const HdrHistogram& o) {
+    for (size_t i = 0; i < counts_.size(); ++i)
+      counts_[i] -= o.counts_[i];
+    total_ -= o.total_;
+    sum_ -= o.sum_;
+    return *this;
+  }
+
+  // Highest value that is equivalent to the value at percentile p (0..100).
+  uint64_t Percentile(double p) const {
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(p / 100 * total_)), seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= rank)
+        return std::min(HighestEquivalent(i), max_);
+    }
+    return max_;
+  }
+
+  uint64_t total() const {
+    return total_;
+  }
+
+  uint64_t max() const {
+    return max_;
+  }
+
+  double mean() const {
+    return total_ ? double(sum_) / total_ : 0;
+  }
+
+ private:
+  static constexpr uint64_t kSubCount = 1ULL << kSubBits;
+
+  static size_t Index(uint64_t value) {
+    if (value < kSubCount)
+      return value;
+    unsigned shift = absl::bit_width(value) - kSubBits;
+    return shift * (kSubCount / 2) + (value >> shift);
+  }
+
+  static uint64_t HighestEquivalent(size_t index) {
+    if (index < kSubCount)
+      return index;
+    unsigned shift = index / (kSubCount / 2) - 1;
+    uint64_t sub = index - shift * (kSubCount / 2);
+    return ((sub + 1) << shift) - 1;
+  }
+
+  vector<uint64_t> counts_;
+  uint64_t total_ = 0, sum_ = 0, max_ = 0;
+};
+
+// Results of the requests sent to a single node or of a single command
+struct BreakdownStats {
+  base::Histogram hist;  // Service time in usec
+  uint64_t num_responses = 0;
+  uint64_t num_errors = 0;
+  uint64_t num_moved = 0;  // MOVED replies, which are counted as responses but not as errors
+
+  BreakdownStats& operator+=(const BreakdownStats& o) {
+    hist.Merge(o.hist);
+    num_responses += o.num_responses;
+    num_errors += o.num_errors;
+    num_moved += o.num_moved;
+    return *this;
+  }
+};
+
 struct ClientStats {
-  base::Histogram hist;
+  base::Histogram hist;  // Service time in usec, measured from the actual send time.
+
+  // Latency in usec measured from the time the request was scheduled to be sent. With a qps
+  // schedule, time spent waiting behind slow requests is counted (coordinated omission correction).
+  HdrHistogram lat_hist;
 
   uint64_t num_responses = 0;
   uint64_t hit_count = 0;
   uint64_t hit_opportunities = 0;
   uint64_t num_errors = 0;
   unsigned num_clients = 0;
+  vector<BreakdownStats> nodes = vector<BreakdownStats>(::nodes.size());
+  vector<BreakdownStats> cmds = vector<BreakdownStats>(cmd_names.size());
 
   ClientStats& operator+=(const ClientStats& o) {
+    for (size_t i = 0; i < nodes.size(); ++i)
+      nodes[i] += o.nodes[i];
+    for (size_t i = 0; i < cmds.size(); ++i)
+      cmds[i] += o.cmds[i];
     hist.Merge(o.hist);
+    lat_hist += o.lat_hist;
     num_responses += o.num_responses;
     hit_count += o.hit_count;
     hit_opportunities += o.hit_opportunities;
@@ -184,45 +613,64 @@ class Driver {
  public:
   explicit Driver(uint32_t num_reqs, ClientStats* stats, ProactorBase* p)
       : num_reqs_(num_reqs), stats_(*stats) {
-    socket_.reset(p->CreateSocket());
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+      conns_.emplace_back(new Conn);
+      conns_.back()->socket.reset(p->CreateSocket());
+      conns_.back()->node = i;
+    }
   }
 
   Driver(const Driver&) = delete;
   Driver(Driver&&) = default;
   Driver& operator=(Driver&&) = default;
 
-  void Connect(unsigned index, const tcp::endpoint& ep);
-  void Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen);
+  void Connect(unsigned index);
+  // Sends requests at the pace of cycle_ns, which is adjusted when the server falls behind.
+  // Latencies are measured from the schedule of nominal_cycle_ns.
+  void Run(uint64_t* cycle_ns, uint64_t nominal_cycle_ns, CommandGenerator* cmd_gen);
 
   float done() const {
     return double(received_) / num_reqs_;
   }
 
   unsigned pending_length() const {
-    return reqs_.size();
+    return pending_;
   }
 
  private:
-  void PopRequest();
-  void ReceiveFb();
-  void ParseRESP();
-  void ParseMC();
-
   struct Req {
     uint64_t start;
+    uint64_t intended;  // Time at which the request should have been sent
+    uint16_t name;      // Index of the command in cmd_names
     bool might_hit;
   };
 
+  // Connection to a single node. In cluster mode a driver keeps one to every node.
+  struct Conn {
+    unique_ptr<FiberSocketBase> socket;
+    fb2::Fiber receive_fb;
+    queue<Req> reqs;
+    string out;  // Commands of the current pipeline
+    unsigned node = 0;
+
+    facade::RedisParser parser{1 << 16, false};
+    io::IoBuf io_buf{512};
+  };
+
+  void PopRequest(Conn* conn);
+  void ReceiveFb(Conn* conn);
+  void ParseRESP(Conn* conn);
+  void ParseMC(Conn* conn);
+
+  // Redirects the slot of a MOVED reply to its new owner, if it is a known node
+  void OnMoved(string_view error);
+
   uint32_t num_reqs_, received_ = 0;
+  unsigned pending_ = 0;  // Requests in flight over all connections
 
   ClientStats& stats_;
-  unique_ptr<FiberSocketBase> socket_;
-  fb2::Fiber receive_fb_;
-  queue<Req> reqs_;
+  vector<unique_ptr<Conn>> conns_;
   fb2::CondVarAny cnd_;
-
-  facade::RedisParser parser_{1 << 16, false};
-  io::IoBuf io_buf_{512};
 };
 
 // Per thread client.
@@ -237,7 +685,7 @@ class TLocalClient {
 
   TLocalClient(const TLocalClient&) = delete;
 
-  void Connect(tcp::endpoint ep);
+  void Connect();
   void Start(uint32_t key_min, uint32_t key_max, uint64_t cycle_ns);
   void Join();
 
@@ -329,43 +777,49 @@ string KeyGenerator::operator()() {
   return StrCat(prefix_, key_suffix);
 }
 
-void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
+void Driver::Connect(unsigned index) {
   VLOG(2) << "Connecting " << index;
-  error_code ec = socket_->Connect(ep);
-  CHECK(!ec) << "Could not connect to " << ep << " " << ec;
-  if (GetFlag(FLAGS_tcp_nodelay)) {
-    int yes = 1;
-    CHECK_EQ(0, setsockopt(socket_->native_handle(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)));
-  }
-
-  // TCP Connect does not ensure that the connection was indeed accepted by the server.
-  // if server backlog is too short the connection will get stuck in the accept queue.
-  // Therefore, we send a ping command to ensure that every connection got connected.
-  ec = socket_->Write(io::Buffer("ping\r\n"));
-  CHECK(!ec);
-
-  uint8_t buf[128];
-  auto res_sz = socket_->Recv(io::MutableBytes(buf));
-  CHECK(res_sz) << res_sz.error().message();
-  string_view resp = io::View(io::Bytes(buf, *res_sz));
-  CHECK(absl::EndsWith(resp, "\r\n")) << resp;
-
-  receive_fb_ = MakeFiber(fb2::Launch::dispatch, [this] { ReceiveFb(); });
+  for (auto& conn : conns_) {
+    const tcp::endpoint& ep = nodes[conn->node].ep;
+    FiberSocketBase* socket = conn->socket.get();
+    error_code ec = socket->Connect(ep);
+    CHECK(!ec) << "Could not connect to " << ep << " " << ec;
+    if (GetFlag(FLAGS_tcp_nodelay)) {
+      int yes = 1;
+      CHECK_EQ(0, setsockopt(socket->native_handle(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)));
+    }
+
+    // TCP Connect does not ensure that the connection was indeed accepted by the server.
+    // if server backlog is too short the connection will get stuck in the accept queue.
+    // Therefore, we send a ping command to ensure that every connection got connected.
+    ec = socket->Write(io::Buffer("ping\r\n"));
+    CHECK(!ec);
+
+    uint8_t buf[128];
+    auto res_sz = socket->Recv(io::MutableBytes(buf));
+    CHECK(res_sz) << res_sz.error().message();
+    string_view resp = io::View(io::Bytes(buf, *res_sz));
+    CHECK(absl::EndsWith(resp, "\r\n")) << resp;
+
+    conn->receive_fb = MakeFiber(fb2::Launch::dispatch, [this, conn = conn.get()] {
+      ReceiveFb(conn);
+    });
+  }
 }
 
-void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
+void Driver::Run(uint64_t* cycle_ns, uint64_t nominal_cycle_ns, CommandGenerator* cmd_gen) {
   const int64_t start = absl::GetCurrentTimeNanos();
   unsigned pipeline = GetFlag(FLAGS_pipeline);
 
   stats_.num_clients++;
 
-  for (unsigned i = 0; i < num_reqs_; ++i) {
+  for (unsigned i = 0; i < num_reqs_;) {
     int64_t now = absl::GetCurrentTimeNanos();
 
     if (cycle_ns) {
       int64_t target_ts = start + i * (*cycle_ns);
       int64_t sleep_ns = target_ts - now;
-      if (reqs_.size() > 10 && sleep_ns <= 0) {
+      if (pending_ > 10 && sleep_ns <= 0) {
         sleep_ns = 10'000;
       }
 
@@ -374,7 +828,7 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
         // There is no point in sending more requests if they are piled up in the server.
         do {
           ThisFiber::SleepFor(chrono::nanoseconds(sleep_ns));
-        } while (reqs_.size() > 10);
+        } while (pending_ > 10);
       } else if (i % 256 == 255) {
         ThisFiber::Yield();
         VLOG(5) << "Behind QPS schedule";
@@ -383,23 +837,39 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
       // Coordinated omission.
 
       fb2::NoOpLock lk;
-      cnd_.wait(lk, [this, pipeline] { return reqs_.size() < pipeline; });
+      cnd_.wait(lk, [this, pipeline] { return pending_ < pipeline; });
     }
-    string cmd = cmd_gen->Next();
-
-    Req req;
-    req.start = absl::GetCurrentTimeNanos();
-    req.might_hit = cmd_gen->might_hit();
 
-    reqs_.push(req);
-
-    error_code ec = socket_->Write(io::Buffer(cmd));
-    if (ec && FiberSocketBase::IsConnClosed(ec)) {
-      // TODO: report failure
-      VLOG(1) << "Connection closed";
-      break;
+    // All commands of a pipeline are scheduled at the time of the first one
+    unsigned depth = min(cmd_gen->NextDepth(), num_reqs_ - i);
+    uint64_t send_ts = absl::GetCurrentTimeNanos();
+    uint64_t intended = cycle_ns ? start + i * nominal_cycle_ns : send_ts;
+    for (unsigned j = 0; j < depth; ++j) {
+      string cmd = cmd_gen->Next();
+      Conn* conn = conns_[conns_.size() == 1 ? 0 : tl_slot_owner[KeySlot(cmd_gen->key())]].get();
+      conn->reqs.push(Req{send_ts, intended, cmd_gen->name(), cmd_gen->might_hit()});
+      conn->out.append(cmd);
+      ++pending_;
     }
-    CHECK(!ec) << ec.message();
+    i += depth;
+
+    bool closed = false;
+    for (auto& conn : conns_) {
+      if (conn->out.empty())
+        continue;
+
+      error_code ec = conn->socket->Write(io::Buffer(conn->out));
+      conn->out.clear();
+      if (ec && FiberSocketBase::IsConnClosed(ec)) {
+        // TODO: report failure
+        VLOG(1) << "Connection closed";
+        closed = true;
+        break;
+      }
+      CHECK(!ec) << ec.message();
+    }
+    if (closed)
+      break;
   }
 
   int64_t finish = absl::GetCurrentTimeNanos();
@@ -408,13 +878,15 @@ void Driver::Run(uint64_t* cycle_ns, CommandGenerator* cmd_gen) {
           << ". Waiting for server processing";
 
   // TODO: to change to a condvar or something.
-  while (!reqs_.empty()) {
+  while (pending_ > 0) {
     ThisFiber::SleepFor(1ms);
   }
 
-  socket_->Shutdown(SHUT_RDWR);  // breaks the receive fiber.
-  receive_fb_.Join();
-  std::ignore = socket_->Close();
+  for (auto& conn : conns_) {
+    conn->socket->Shutdown(SHUT_RDWR);  // breaks the receive fiber.
+    conn->receive_fb.Join();
+    std::ignore = conn->socket->Close();
+  }
   stats_.num_clients--;
 }
 
@@ -429,78 +901,109 @@ static string_view FindLine(io::Bytes buf) {
   return {};
 };
 
-void Driver::PopRequest() {
+void Driver::PopRequest(Conn* conn) {
   uint64_t now = absl::GetCurrentTimeNanos();
-  uint64_t usec = (now - reqs_.front().start) / 1000;
+  const Req& req = conn->reqs.front();
+  uint64_t usec = (now - req.start) / 1000;
   stats_.hist.Add(usec);
-  stats_.hit_opportunities += reqs_.front().might_hit;
+  stats_.lat_hist.Add((now - std::min(now, req.intended)) / 1000);
+  stats_.hit_opportunities += req.might_hit;
+  stats_.nodes[conn->node].hist.Add(usec);
+  ++stats_.nodes[conn->node].num_responses;
+  stats_.cmds[req.name].hist.Add(usec);
+  ++stats_.cmds[req.name].num_responses;
   ++received_;
-  reqs_.pop();
-  if (reqs_.empty()) {
+  conn->reqs.pop();
+  if (--pending_ == 0) {
     cnd_.notify_one();
   }
   ++stats_.num_responses;
 }
 
-void Driver::ReceiveFb() {
+void Driver::OnMoved(string_view error) {
+  // MOVED <slot> <ip>:<port>
+  vector<string_view> parts = absl::StrSplit(error, ' ');
+  uint32_t slot;
+  if (parts.size() != 3 || !absl::SimpleAtoi(parts[1], &slot) || slot >= kNumSlots)
+    return;
+
+  for (unsigned i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].addr == parts[2]) {
+      tl_slot_owner[slot] = i;
+      return;
+    }
+  }
+  VLOG(1) << "Slot " << slot << " moved to unknown node " << parts[2];
+}
+
+void Driver::ReceiveFb(Conn* conn) {
   while (true) {
-    io_buf_.EnsureCapacity(256);
-    auto buf = io_buf_.AppendBuffer();
-    VLOG(2) << "Socket read: " << reqs_.size();
+    conn->io_buf.EnsureCapacity(256);
+    auto buf = conn->io_buf.AppendBuffer();
+    VLOG(2) << "Socket read: " << conn->reqs.size();
 
-    ::io::Result<size_t> recv_sz = socket_->Recv(buf);
+    ::io::Result<size_t> recv_sz = conn->socket->Recv(buf);
     if (!recv_sz && FiberSocketBase::IsConnClosed(recv_sz.error())) {
-      LOG_IF(DFATAL, !reqs_.empty())
-          << "Broke with " << reqs_.size() << " requests,  received: " << received_;
+      LOG_IF(DFATAL, !conn->reqs.empty())
+          << "Broke with " << conn->reqs.size() << " requests,  received: " << received_;
       // clear reqs - to prevent Driver::Run block on them indefinitely.
-      decltype(reqs_)().swap(reqs_);
+      pending_ -= conn->reqs.size();
+      decltype(conn->reqs)().swap(conn->reqs);
       break;
     }
 
     CHECK(recv_sz) << recv_sz.error().message();
-    io_buf_.CommitWrite(*recv_sz);
+    conn->io_buf.CommitWrite(*recv_sz);
 
     if (protocol == RESP) {
-      ParseRESP();
+      ParseRESP(conn);
     } else {
       // MC_TEXT
-      ParseMC();
+      ParseMC(conn);
     }
   }
   VLOG(1) << "ReceiveFb done";
 }
 
-void Driver::ParseRESP() {
+void Driver::ParseRESP(Conn* conn) {
   uint32_t consumed = 0;
   RedisParser::Result result = RedisParser::OK;
   RespVec parse_args;
 
   do {
-    result = parser_.Parse(io_buf_.InputBuffer(), &consumed, &parse_args);
+    result = conn->parser.Parse(conn->io_buf.InputBuffer(), &consumed, &parse_args);
     if (result == RedisParser::OK && !parse_args.empty()) {
       if (parse_args[0].type == facade::RespExpr::ERROR) {
-        ++stats_.num_errors;
-      } else if (reqs_.front().might_hit && parse_args[0].type != facade::RespExpr::NIL) {
+        if (string_view error = parse_args[0].GetView(); absl::StartsWith(error, "MOVED ")) {
+          ++stats_.nodes[conn->node].num_moved;
+          ++stats_.cmds[conn->reqs.front().name].num_moved;
+          OnMoved(error);
+        } else {
+          ++stats_.num_errors;
+          ++stats_.nodes[conn->node].num_errors;
+          ++stats_.cmds[conn->reqs.front().name].num_errors;
+        }
+      } else if (conn->reqs.front().might_hit && parse_args[0].type != facade::RespExpr::NIL) {
         ++stats_.hit_count;
       }
       parse_args.clear();
-      PopRequest();
+      PopRequest(conn);
     }
-    io_buf_.ConsumeInput(consumed);
+    conn->io_buf.ConsumeInput(consumed);
   } while (result == RedisParser::OK);
 }
 
-void Driver::ParseMC() {
+void Driver::ParseMC(Conn* conn) {
   unsigned blob_len = 0;
 
   while (true) {
-    string_view line = FindLine(io_buf_.InputBuffer());
+    string_view line = FindLine(conn->io_buf.InputBuffer());
     if (line.empty())
       break;
 
     CHECK_EQ(line.back(), '\n');
     if (line == "STORED\r\n" || line == "END\r\n") {
-      PopRequest();
+      PopRequest(conn);
       blob_len = 0;
     } else if (absl::StartsWith(line, "VALUE")) {
       // last token is a blob length.
@@ -516,26 +1019,29 @@ void Driver::ParseMC() {
       ++stats_.hit_count;
     } else if (absl::StartsWith(line, "SERVER_ERROR")) {
       ++stats_.num_errors;
-      PopRequest();
+      ++stats_.nodes[conn->node].num_errors;
+      ++stats_.cmds[conn->reqs.front().name].num_errors;
+      PopRequest(conn);
       blob_len = 0;
     } else {
-      auto handle = socket_->native_handle();
+      auto handle = conn->socket->native_handle();
       CHECK_EQ(blob_len + 2, line.size()) << line;
       blob_len = 0;
       VLOG(2) << "Got line " << handle << ": " << line;
     }
-    io_buf_.ConsumeInput(line.size());
+    conn->io_buf.ConsumeInput(line.size());
   }
 }
 
-void TLocalClient::Connect(tcp::endpoint ep) {
+void TLocalClient::Connect() {
   VLOG(2) << "Connecting client...";
+  tl_slot_owner = slot_owner;
   vector<fb2::Fiber> fbs(drivers_.size());
 
   for (size_t i = 0; i < fbs.size(); ++i) {
     fbs[i] = MakeFiber([&, i] {
       ThisFiber::SetName(StrCat("connect/", i));
-      drivers_[i]->Connect(i, ep);
+      drivers_[i]->Connect(i);
     });
   }
 
@@ -555,7 +1061,7 @@ void TLocalClient::Start(uint32_t key_min, uint32_t key_max, uint64_t cycle_ns)
 
   for (size_t i = 0; i < driver_fbs_.size(); ++i) {
     driver_fbs_[i] = fb2::Fiber(StrCat("run/", i), [&, i] {
-      drivers_[i]->Run(cur_cycle_ns_ ? &cur_cycle_ns_ : nullptr, &cmd_gen_.value());
+      drivers_[i]->Run(cur_cycle_ns_ ? &cur_cycle_ns_ : nullptr, target_cycle_, &cmd_gen_.value());
     });
   }
 }
@@ -588,7 +1094,96 @@ void TLocalClient::AdjustCycle() {
 
 thread_local unique_ptr<TLocalClient> client;
 
-void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp) {
+// Fills nodes and slot_owner with the masters that CLUSTER SLOTS of the node at seed reports.
+void DiscoverCluster(ProactorBase* p, const tcp::endpoint& seed) {
+  unique_ptr<FiberSocketBase> socket(p->CreateSocket());
+  error_code ec = socket->Connect(seed);
+  CHECK(!ec) << "Could not connect to " << seed << " " << ec;
+  ec = socket->Write(io::Buffer("CLUSTER SLOTS\r\n"));
+  CHECK(!ec) << ec.message();
+
+  RedisParser parser{1 << 16, false};
+  io::IoBuf io_buf{4096};
+  RespVec resp;
+  RedisParser::Result result = RedisParser::INPUT_PENDING;
+  while (result == RedisParser::INPUT_PENDING) {
+    io_buf.EnsureCapacity(4096);
+    auto recv_sz = socket->Recv(io_buf.AppendBuffer());
+    CHECK(recv_sz) << recv_sz.error().message();
+    io_buf.CommitWrite(*recv_sz);
+
+    uint32_t consumed = 0;
+    result = parser.Parse(io_buf.InputBuffer(), &consumed, &resp);
+    io_buf.ConsumeInput(consumed);
+  }
+  std::ignore = socket->Close();
+
+  CHECK_EQ(result, RedisParser::OK);
+  CHECK(!resp.empty());
+  CHECK(resp[0].type == facade::RespExpr::ARRAY) << "CLUSTER SLOTS failed: " << resp[0];
+
+  slot_owner.assign(kNumSlots, 0);
+  vector<bool> owned(kNumSlots, false);
+
+  // Every entry is [start, end, [ip, port, id], replicas...]
+  for (const auto& range : resp[0].GetVec()) {
+    const RespVec& fields = range.GetVec();
+    CHECK_GE(fields.size(), 3u);
+    int64_t start = fields[0].GetInt().value_or(-1), end = fields[1].GetInt().value_or(-1);
+    CHECK(0 <= start && start <= end && end < kNumSlots);
+
+    const RespVec& master = fields[2].GetVec();
+    string ip = master[0].GetString();
+    int64_t port = master[1].GetInt().value_or(0);
+    string addr = StrCat(ip, ":", port);
+
+    auto it = find_if(nodes.begin(), nodes.end(), [&](const Node& n) { return n.addr == addr; });
+    if (it == nodes.end()) {
+      char ip_addr[128];
+      ec = fb2::DnsResolve(ip, 2000, ip_addr, p);
+      CHECK(!ec) << "Could not resolve " << ip << " " << ec;
+      nodes.push_back({addr, tcp::endpoint{::boost::asio::ip::make_address(ip_addr),
+                                           static_cast<uint16_t>(port)}});
+      it = nodes.end() - 1;
+    }
+
+    for (int64_t slot = start; slot <= end; ++slot) {
+      slot_owner[slot] = it - nodes.begin();
+      owned[slot] = true;
+    }
+  }
+
+  CHECK(!nodes.empty()) << "No slots are assigned in the cluster";
+  size_t unowned = count(owned.begin(), owned.end(), false);
+  LOG_IF(WARNING, unowned) << unowned << " slots are not assigned to any node";
+}
+
+// Percentiles of the latencies measured from the intended send time
+constexpr double kPercentiles[] = {50, 99, 99.9, 99.99};
+
+string FormatPercentile(double p) {
+  string res = StrFormat("p%g", p);
+  res.erase(std::remove(res.begin(), res.end(), '.'), res.end());  // p99.9 -> p999
+  return res;
+}
+
+// Progress of the run during a single report interval
+struct IntervalReport {
+  uint64_t time_ms;
+  uint64_t rps;
+  vector<uint64_t> percentiles;  // Of kPercentiles, in usec
+};
+
+string LatencyJson(const HdrHistogram& hist) {
+  string res = "{";
+  for (double p : kPercentiles)
+    absl::StrAppend(&res, "\"", FormatPercentile(p), "\": ", hist.Percentile(p), ", ");
+  absl::StrAppend(&res, "\"max\": ", hist.max(), ", \"mean\": ", StrFormat("%.1f", hist.mean()),
+                  "}");
+  return res;
+}
+
+void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp, vector<IntervalReport>* reports) {
   fb2::Mutex mutex;
 
   int64_t start_time = absl::GetCurrentTimeNanos();
@@ -598,6 +1193,8 @@ void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp) {
   uint64_t num_last_resp_cnt = 0;
 
   uint64_t resp_goal = GetFlag(FLAGS_c) * pp->size() * GetFlag(FLAGS_n);
+  const int64_t report_ns = max(1u, GetFlag(FLAGS_report_interval)) * 1000'000'000LL;
+  HdrHistogram last_lat_hist;
 
   while (*finish_signal == false) {
     // we sleep with resolution of 1s but print with lower frequency to be more responsive
@@ -606,7 +1203,7 @@ void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp) {
     pp->AwaitBrief([](auto, auto*) { client->AdjustCycle(); });
 
     int64_t now = absl::GetCurrentTimeNanos();
-    if (now - last_print < 5000'000'000LL)  // 5s
+    if (now - last_print < report_ns)
       continue;
 
     ClientStats stats;
@@ -634,6 +1231,19 @@ void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp) {
                          : 0;
     unsigned latency = stats.hist.Percentile(99);
 
+    HdrHistogram interval_hist = stats.lat_hist;
+    interval_hist -= last_lat_hist;
+    last_lat_hist = stats.lat_hist;
+
+    IntervalReport report{total_ms, period_resp_cnt * 1000 / period_ms, {}};
+    string interval_lat;
+    for (double p : kPercentiles) {
+      report.percentiles.push_back(interval_hist.Percentile(p));
+      absl::StrAppend(&interval_lat, interval_lat.empty() ? "" : ", ", FormatPercentile(p), ": ",
+                      report.percentiles.back());
+    }
+    reports->push_back(std::move(report));
+
     CONSOLE_INFO << total_ms / 1000 << "s: " << StrFormat("%.1f", done_perc)
                  << "% done, RPS(now/agg): " << period_resp_cnt * 1000 / period_ms << "/"
                  << stats.num_responses * 1000 / total_ms << ", errs: " << stats.num_errors
@@ -641,7 +1251,8 @@ void WatchFiber(atomic_bool* finish_signal, ProactorPool* pp) {
                  << ", clients: " << stats.num_clients << "\n"
                  << "done_min: " << StrFormat("%.2f%%", done_min * 100)
                  << ", done_max: " << StrFormat("%.2f%%", done_max * 100)
-                 << ", p99_lat(us): " << latency << ", max_pending: " << max_pending;
+                 << ", p99_lat(us): " << latency << ", max_pending: " << max_pending << "\n"
+                 << "interval latency from intended send time(us): " << interval_lat;
 
     last_print = now;
     num_last_resp_cnt = stats.num_responses;
@@ -687,6 +1298,32 @@ int main(int argc, char* argv[]) {
   auto address = ::boost::asio::ip::make_address(ip_addr);
   tcp::endpoint ep{address, GetFlag(FLAGS_p)};
 
+  if (GetFlag(FLAGS_cluster)) {
+    CHECK_EQ(protocol, RESP) << "cluster mode requires RESP";
+    proactor->Await([&] { DiscoverCluster(proactor, ep); });
+    CONSOLE_INFO << "Discovered " << nodes.size() << " cluster nodes";
+  } else {
+    nodes.push_back({StrCat(GetFlag(FLAGS_h), ":", GetFlag(FLAGS_p)), ep});
+    slot_owner.assign(kNumSlots, 0);
+  }
+
+  // Commands are registered before the threads start, which only look up their names
+  if (string path = GetFlag(FLAGS_trace); !path.empty()) {
+    CHECK_EQ(protocol, RESP) << "trace replay requires RESP";
+    LoadTrace(path);
+    CONSOLE_INFO << "Replaying " << trace.size() << " commands from " << path;
+  } else if (string path = GetFlag(FLAGS_workload); !path.empty()) {
+    CHECK_EQ(protocol, RESP) << "workloads require RESP";
+    workload.emplace();
+    workload->Load(path);
+  } else if (string command = GetFlag(FLAGS_command); !command.empty()) {
+    CmdNameIndex(command);
+  } else {
+    bool blocking = GetFlag(FLAGS_block_timeout) > 0;
+    CmdNameIndex(blocking ? "LPUSH" : "SET");
+    CmdNameIndex(blocking ? "BLPOP" : "GET");
+  }
+
   LOG(INFO) << "Connecting threads";
   pp->AwaitFiberOnAll([&](unsigned index, auto* p) {
     base::SplitMix64 seed_mix(GetFlag(FLAGS_seed) + index * 0x6a45554a264d72bULL);
@@ -694,7 +1331,7 @@ int main(int argc, char* argv[]) {
     VLOG(1) << "Seeding bitgen with seed " << seed;
     bit_gen.seed(seed);
     client = make_unique<TLocalClient>(p);
-    client->Connect(ep);
+    client->Connect();
   });
 
   const uint32_t key_minimum = GetFlag(FLAGS_key_minimum);
@@ -736,7 +1373,9 @@ int main(int argc, char* argv[]) {
     client->Start(key_minimum + index * thread_key_step, key_max, interval);
   });
 
-  auto watch_fb = pp->GetNextProactor()->LaunchFiber([&] { WatchFiber(&finish, pp.get()); });
+  vector<IntervalReport> reports;
+  auto watch_fb =
+      pp->GetNextProactor()->LaunchFiber([&] { WatchFiber(&finish, pp.get(), &reports); });
   const absl::Time start_time = absl::Now();
 
   // The actual run.
@@ -769,9 +1408,79 @@ int main(int argc, char* argv[]) {
   }
 
   CONSOLE_INFO << "Latency summary, all times are in usec:\n" << summary.hist.ToString();
+
+  string percentiles;
+  for (double p : kPercentiles) {
+    absl::StrAppend(&percentiles, FormatPercentile(p), ": ", summary.lat_hist.Percentile(p), ", ");
+  }
+  CONSOLE_INFO << "Latency from intended send time in usec: " << percentiles
+               << "max: " << summary.lat_hist.max();
+
+  if (GetFlag(FLAGS_cluster)) {
+    CONSOLE_INFO << "Per node results, all times are in usec:";
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      const BreakdownStats& ns = summary.nodes[i];
+      CONSOLE_INFO << nodes[i].addr << ": requests: " << ns.num_responses
+                   << ", errors: " << ns.num_errors << ", moved: " << ns.num_moved
+                   << ", p50: " << ns.hist.Percentile(50) << ", p99: " << ns.hist.Percentile(99);
+    }
+  }
+
+  if (cmd_names.size() > 1) {
+    CONSOLE_INFO << "Per command results, all times are in usec:";
+    for (size_t i = 0; i < cmd_names.size(); ++i) {
+      const BreakdownStats& cs = summary.cmds[i];
+      CONSOLE_INFO << cmd_names[i] << ": requests: " << cs.num_responses
+                   << ", errors: " << cs.num_errors << ", p50: " << cs.hist.Percentile(50)
+                   << ", p99: " << cs.hist.Percentile(99)
+                   << ", p99.9: " << cs.hist.Percentile(99.9);
+    }
+  }
+
+  double hitrate = 0;
   if (summary.hit_opportunities) {
-    CONSOLE_INFO << "----------------------------------\nHit rate: "
-                 << 100 * double(summary.hit_count) / double(summary.hit_opportunities) << "%\n";
+    hitrate = 100 * double(summary.hit_count) / double(summary.hit_opportunities);
+    CONSOLE_INFO << "----------------------------------\nHit rate: " << hitrate << "%\n";
+  }
+
+  if (string path = GetFlag(FLAGS_json_out); !path.empty()) {
+    string json = absl::StrCat(
+        "{\"duration_sec\": ", StrFormat("%.3f", absl::ToDoubleSeconds(duration)),
+        ", \"requests\": ", summary.num_responses, ", \"errors\": ", summary.num_errors,
+        ", \"qps\": ", dur_sec ? summary.num_responses / dur_sec : 0,
+        ", \"scheduled_qps\": ", qps * total_conn_num, ", \"hitrate\": ",
+        StrFormat("%.2f", hitrate), ", \"latency_usec\": ", LatencyJson(summary.lat_hist),
+        ", \"intervals\": [");
+    for (size_t i = 0; i < reports.size(); ++i) {
+      absl::StrAppend(&json, i ? ", " : "", "{\"time_ms\": ", reports[i].time_ms,
+                      ", \"rps\": ", reports[i].rps);
+      for (size_t j = 0; j < reports[i].percentiles.size(); ++j) {
+        absl::StrAppend(&json, ", \"", FormatPercentile(kPercentiles[j]),
+                        "\": ", reports[i].percentiles[j]);
+      }
+      absl::StrAppend(&json, "}");
+    }
+    absl::StrAppend(&json, "], \"nodes\": [");
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      const BreakdownStats& ns = summary.nodes[i];
+      absl::StrAppend(&json, i ? ", " : "", "{\"addr\": \"", nodes[i].addr,
+                      "\", \"requests\": ", ns.num_responses, ", \"errors\": ", ns.num_errors,
+                      ", \"moved\": ", ns.num_moved, ", \"p50\": ", ns.hist.Percentile(50),
+                      ", \"p99\": ", ns.hist.Percentile(99), "}");
+    }
+    absl::StrAppend(&json, "], \"commands\": [");
+    for (size_t i = 0; i < cmd_names.size(); ++i) {
+      const BreakdownStats& cs = summary.cmds[i];
+      absl::StrAppend(&json, i ? ", " : "", "{\"name\": \"", cmd_names[i],
+                      "\", \"requests\": ", cs.num_responses, ", \"errors\": ", cs.num_errors,
+                      ", \"p50\": ", cs.hist.Percentile(50), ", \"p99\": ", cs.hist.Percentile(99),
+                      ", \"p999\": ", cs.hist.Percentile(99.9), "}");
+    }
+    absl::StrAppend(&json, "]}\n");
+
+    std::ofstream out(path);
+    out << json;
+    LOG_IF(ERROR, !out) << "Could not write results to " << path;
   }
   pp->Stop();
 
@@ -35,6 +35,7 @@
 #include "base/init.h"
 #include "base/proc_util.h"  // for GetKernelVersion
 #include "facade/dragonfly_listener.h"
+#include "facade/numa.h"
 #include "io/file.h"
 #include "io/file_util.h"
 #include "io/proc_reader.h"
@@ -61,6 +62,7 @@ ABSL_DECLARE_FLAG(int32_t, port);
 ABSL_DECLARE_FLAG(uint32_t, memcached_port);
 ABSL_DECLARE_FLAG(uint16_t, admin_port);
 ABSL_DECLARE_FLAG(std::string, admin_bind);
+ABSL_DECLARE_FLAG(bool, numa_aware);
 
 ABSL_FLAG(string, bind, "",
           "Bind address. If empty - binds on all interfaces. "
@@ -76,6 +78,9 @@ ABSL_FLAG(bool, force_epoll, false,
 ABSL_FLAG(
     string, allocation_tracker, "",
     "Logs stack trace of memory allocation within these ranges. Format is min:max,min:max,....");
+ABSL_FLAG(uint64_t, heap_profile_sample_bytes, 2_MB,
+          "Mean number of allocated bytes between allocations sampled for the heap profile "
+          "served at /heapz, 0 to disable. Requires a build with memory tracking.");
 
 ABSL_FLAG(bool, version_check, true,
           "If true, Will monitor for new releases on Dragonfly servers once a day.");
@@ -588,7 +593,9 @@ void SetupAllocationTracker(ProactorPool* pool) {
     track_ranges.push_back(p);
   }
 
+  size_t sample_bytes = absl::GetFlag(FLAGS_heap_profile_sample_bytes);
   pool->AwaitBrief([&](unsigned, ProactorBase*) {
+    AllocationTracker::Get().SetSampleInterval(sample_bytes);
     for (auto range : track_ranges) {
       if (!AllocationTracker::Get().Add(
               {.lower_bound = range.first, .upper_bound = range.second, .sample_odds = 1.0})) {
@@ -761,6 +768,10 @@ Usage: dragonfly [FLAGS]
   mi_option_enable(mi_option_show_errors);
   mi_option_set(mi_option_max_warnings, 0);
   mi_option_enable(mi_option_purge_decommits);
+  if (GetFlag(FLAGS_numa_aware)) {
+    // Lets mimalloc prefer arenas of the node the allocating thread is bound to.
+    mi_option_set(mi_option_use_numa_nodes, facade::NumaTopology::Get().num_nodes());
+  }
 
   fb2::SetDefaultStackResource(&fb2::std_malloc_resource, kFiberDefaultStackSize);
 
@@ -35,6 +35,7 @@ using namespace std;
 
 ABSL_DECLARE_FLAG(bool, info_replication_valkey_compatible);
 ABSL_DECLARE_FLAG(uint32_t, replication_timeout);
+ABSL_DECLARE_FLAG(uint32_t, dbnum);
 
 namespace dfly {
 
@@ -84,14 +85,15 @@ bool WaitReplicaFlowToCatchup(absl::Time end_time, const DflyCmd::ReplicaInfo* r
   while (flow->last_acked_lsn < shard->journal()->GetLsn()) {
     if (absl::Now() > end_time) {
       LOG(WARNING) << "Couldn't synchronize with replica for takeover in time: " << replica->address
-                   << ":" << replica->listening_port << ", last acked: " << flow->last_acked_lsn
+                   << ":" << replica->listening_port
+                   << ", last acked: " << flow->last_acked_lsn.load()
                    << ", expecting " << shard->journal()->GetLsn();
       return false;
     }
     if (replica->cntx.IsCancelled()) {
       return false;
     }
-    VLOG(1) << "Replica lsn:" << flow->last_acked_lsn
+    VLOG(1) << "Replica lsn:" << flow->last_acked_lsn.load()
             << " master lsn:" << shard->journal()->GetLsn();
     ThisFiber::SleepFor(1ms);
   }
@@ -180,10 +182,12 @@ void DflyCmd::Run(CmdArgList args, ConnectionContext* cntx) {
         "REPLICAOFFSET",
         "    Returns LSN (log sequence number) per shard. These are the sequential ids of the ",
         "    journal entry.",
-        "LOAD <filename> [APPEND]",
+        "LOAD <filename> [APPEND] [DB <index>]",
         "    Loads <filename> RDB/DFS file into the data store.",
         "    * APPEND: Existing keys are NOT removed before loading the file, conflicting ",
         "      keys (that exist in both data store and in file) are overridden.",
+        "    * DB: Only the keys of db <index> are loaded. Indexed DFS files are only read ",
+        "      where they hold keys of that db. Delta snapshots are not applied.",
         "HELP",
         "    Prints this help.",
     };
@@ -279,6 +283,7 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
     flow.conn = cntx->conn();
     flow.eof_token = eof_token;
     flow.version = replica_ptr->version;
+    flow.journal_compression = replica_ptr->journal_compression;
   }
   if (!cntx->conn()->Migrate(shard_set->pool()->at(flow_id))) {
     // Listener::PreShutdown() triggered
@@ -291,9 +296,8 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
 
   std::string_view sync_type{"FULL"};
 
-#if 0  // Partial synchronization is disabled
   if (seqid.has_value()) {
-    if (sf_->journal()->IsLSNInBuffer(*seqid) || sf_->journal()->GetLsn() == *seqid) {
+    if (sf_->journal()->IsLSNAvailable(*seqid)) {
       // This does not guarantee the lsn will still be present when DFLY SYNC runs,
       // replication will be retried if it gets evicted by then.
       flow.start_partial_sync_at = *seqid;
@@ -305,10 +309,9 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
                 << " that the replication buffer doesn't contain this anymore (current_lsn="
                 << sf_->journal()->GetLsn() << "). Will perform a full sync of the data.";
       LOG(INFO) << "If this happens often you can control the replication buffer's size with the "
-                   "--shard_repl_backlog_len option";
+                   "--shard_repl_backlog_len option or spill it to disk with --repl_backlog_dir";
     }
   }
-#endif
 
   rb->StartArray(2);
   rb->SendSimpleString(sync_type);
@@ -417,6 +420,10 @@ void DflyCmd::TakeOver(CmdArgList args, ConnectionContext* cntx) {
   if (!sync_id)
     return;
 
+  // A replica that serves downstream replicas can't hand over, it does not own the data.
+  if (!ServerState::tlocal()->is_master)
+    return cntx->SendError("Takeover is not supported for chained replicas");
+
   {
     auto lk = replica_ptr->GetSharedLock();
     if (!CheckReplicaStateOrReply(*replica_ptr, SyncState::STABLE_SYNC, rb))
@@ -528,25 +535,36 @@ void DflyCmd::Load(CmdArgList args, ConnectionContext* cntx) {
   parser.ExpectTag("LOAD");
   string_view filename = parser.Next();
   ServerFamily::LoadExistingKeys existing_keys = ServerFamily::LoadExistingKeys::kFail;
+  optional<DbIndex> load_db;
 
-  if (parser.HasNext()) {
-    parser.ExpectTag("APPEND");
-    existing_keys = ServerFamily::LoadExistingKeys::kOverride;
-  }
+  while (parser.HasNext()) {
+    if (parser.Check("APPEND")) {
+      existing_keys = ServerFamily::LoadExistingKeys::kOverride;
+      continue;
+    }
+
+    if (parser.Check("DB")) {
+      load_db = parser.Next<DbIndex>();
+      continue;
+    }
 
-  if (parser.HasNext()) {
     parser.Error();
+    break;
   }
 
   if (parser.HasError()) {
     return cntx->SendError(kSyntaxErr);
   }
 
+  if (load_db && *load_db >= absl::GetFlag(FLAGS_dbnum)) {
+    return cntx->SendError(kInvalidDbIndErr);
+  }
+
   if (existing_keys == ServerFamily::LoadExistingKeys::kFail) {
     sf_->FlushAll(cntx);
   }
 
-  if (auto fut_ec = sf_->Load(filename, existing_keys); fut_ec) {
+  if (auto fut_ec = sf_->Load(filename, existing_keys, load_db); fut_ec) {
     GenericError ec = fut_ec->Get();
     if (ec) {
       string msg = ec.Format();
@@ -619,8 +637,9 @@ OpStatus DflyCmd::StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineS
   DCHECK(shard);
   DCHECK(flow->conn);
 
-  flow->streamer.reset(new JournalStreamer(sf_->journal(), cntx));
+  flow->streamer.reset(new JournalStreamer(sf_->journal(), cntx, flow->journal_compression));
   bool send_lsn = flow->version >= DflyVersion::VER4;
+  flow->streamer->SetSendLsnTime(flow->version >= DflyVersion::VER6);
   flow->streamer->Start(flow->conn->socket(), send_lsn);
 
   // Register cleanup.
@@ -759,12 +778,55 @@ shared_ptr<DflyCmd::ReplicaInfo> DflyCmd::GetReplicaInfo(uint32_t sync_id) {
   return {};
 }
 
+void DflyCmd::OnFlowAck(FlowInfo* flow, uint64_t lsn) {
+  flow->last_acked_lsn.store(lsn, memory_order_relaxed);
+  acks_ec_.notifyAll();
+}
+
+unsigned DflyCmd::WaitForAcks(unsigned num_replicas,
+                              optional<chrono::steady_clock::time_point> deadline) {
+  // The current lsns cover the last write of the client, even if other writes followed it.
+  vector<LSN> lsns(shard_set->size(), 0);
+  shard_set->RunBriefInParallel([&lsns](EngineShard* shard) {
+    if (shard->journal())
+      lsns[shard->shard_id()] = shard->journal()->GetLsn();
+  });
+
+  vector<shared_ptr<ReplicaInfo>> replicas;
+  {
+    util::fb2::LockGuard lk(mu_);
+    for (const auto& [_, info] : replica_infos_)
+      replicas.push_back(info);
+  }
+
+  unsigned acked = 0;
+  auto enough_acks = [&] {
+    acked = 0;
+    for (const auto& info : replicas) {
+      if (info->cntx.IsCancelled() || info->flows.size() != lsns.size())
+        continue;
+      bool caught_up = true;
+      for (size_t sid = 0; sid < lsns.size() && caught_up; ++sid)
+        caught_up = info->flows[sid].last_acked_lsn.load(memory_order_relaxed) >= lsns[sid];
+      acked += caught_up;
+    }
+    return acked >= num_replicas;
+  };
+
+  if (deadline)
+    acks_ec_.await_until(enough_acks, *deadline);
+  else
+    acks_ec_.await(enough_acks);
+  return acked;
+}
+
 std::vector<ReplicaRoleInfo> DflyCmd::GetReplicasRoleInfo() const {
   std::vector<ReplicaRoleInfo> vec;
   util::fb2::LockGuard lk(mu_);
 
   vec.reserve(replica_infos_.size());
   map replication_lags = ReplicationLagsLocked();
+  map flow_stats = FlowStatsLocked();
 
   for (const auto& [id, info] : replica_infos_) {
     LSN lag = replication_lags[id];
@@ -782,8 +844,16 @@ std::vector<ReplicaRoleInfo> DflyCmd::GetReplicasRoleInfo() const {
     } else {
       lag = 0;
     }
-    vec.push_back(
-        ReplicaRoleInfo{info->id, info->address, info->listening_port, SyncStateName(state), lag});
+
+    vector<ReplicaFlowStats> flows = std::move(flow_stats[id]);
+    uint64_t lag_ms = 0;
+    for (const auto& flow : flows)
+      lag_ms = std::max(lag_ms, flow.lag_ms);
+    if (lag == 0)  // caught up or not in stable sync
+      lag_ms = 0;
+
+    vec.push_back(ReplicaRoleInfo{info->id, info->address, info->listening_port,
+                                  SyncStateName(state), lag, lag_ms, std::move(flows)});
   }
   return vec;
 }
@@ -861,6 +931,36 @@ std::map<uint32_t, LSN> DflyCmd::ReplicationLagsLocked() const {
   return rv;
 }
 
+std::map<uint32_t, std::vector<ReplicaFlowStats>> DflyCmd::FlowStatsLocked() const {
+  DCHECK(!mu_.try_lock());  // expects to be under global lock
+  if (replica_infos_.empty())
+    return {};
+
+  std::map<uint32_t, std::vector<ReplicaFlowStats>> rv;
+  for (const auto& [id, info] : replica_infos_)
+    rv[id].resize(shard_set->size());
+
+  // Every shard fills its own slot, so no synchronization is needed.
+  shard_set->RunBlockingInParallel([&rv, this](EngineShard* shard) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    for (const auto& [id, info] : replica_infos_) {
+      auto repl_lk = info->GetSharedLock();
+      if (info->flows.empty())
+        continue;
+
+      const auto& flow = info->flows[shard->shard_id()];
+      if (!flow.streamer)
+        continue;
+
+      auto& stats = rv.at(id)[shard->shard_id()];
+      stats.lag_ms = flow.streamer->LagMs(flow.last_acked_lsn);
+      stats.throttle_count = flow.streamer->GetThrottleCount();
+      stats.throttle_usec = flow.streamer->GetThrottleUsec();
+      stats.buffer_bytes = flow.streamer->GetTotalBufferCapacities();
+    }
+  });
+  return rv;
+}
+
 void DflyCmd::SetDflyClientVersion(ConnectionContext* cntx, DflyVersion version) {
   auto replica_ptr = GetReplicaInfo(cntx->conn_state.replication_info.repl_session_id);
   VLOG(1) << "Client version for session_id=" << cntx->conn_state.replication_info.repl_session_id
@@ -869,6 +969,14 @@ void DflyCmd::SetDflyClientVersion(ConnectionContext* cntx, DflyVersion version)
   replica_ptr->version = version;
 }
 
+void DflyCmd::SetJournalCompression(ConnectionContext* cntx, bool enabled) {
+  auto replica_ptr = GetReplicaInfo(cntx->conn_state.replication_info.repl_session_id);
+  VLOG(1) << "Journal compression for session_id="
+          << cntx->conn_state.replication_info.repl_session_id << " is " << enabled;
+
+  replica_ptr->journal_compression = enabled;
+}
+
 // Must run under locked replica_info.mu.
 // TODO: it's a bad design that we enforce replies under a lock because Send can potentially
 // block, leading to high contention in some case. Split it and avoid replying under a lock.
@@ -891,6 +999,15 @@ bool DflyCmd::CheckReplicaStateOrReply(const ReplicaInfo& repl_info, SyncState e
   return true;
 }
 
+void DflyCmd::CancelAllReplicas() {
+  // Replicas that reconnect must not continue from entries that preceded the replaced data.
+  shard_set->RunBriefInParallel([](EngineShard* shard) {
+    if (shard->journal())
+      shard->journal()->ResetBacklog();
+  });
+  Shutdown();
+}
+
 void DflyCmd::Shutdown() {
   ReplicaInfoMap pending;
   {
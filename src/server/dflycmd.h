@@ -7,7 +7,9 @@
 #include <absl/container/btree_map.h>
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <optional>
 
 #include "server/conn_context.h"
 #include "util/fibers/synchronization.h"
@@ -27,6 +29,7 @@ class ServerFamily;
 class RdbSaver;
 class JournalStreamer;
 struct ReplicaRoleInfo;
+struct ReplicaFlowStats;
 struct ReplicationMemoryStats;
 
 // Stores information related to a single flow.
@@ -45,9 +48,10 @@ struct FlowInfo {
   std::string eof_token;
 
   DflyVersion version = DflyVersion::VER1;
+  bool journal_compression = false;  // send stable sync journal in lz4 frames
 
   std::optional<LSN> start_partial_sync_at;
-  uint64_t last_acked_lsn = 0;
+  std::atomic<uint64_t> last_acked_lsn = 0;  // written by the flow thread, read by WAIT
 
   std::function<void()> cleanup;  // Optional cleanup for cancellation.
 };
@@ -130,6 +134,7 @@ class DflyCmd {
     std::string address;
     uint32_t listening_port;
     DflyVersion version = DflyVersion::VER1;
+    bool journal_compression = false;
 
     // Flows describe the state of shard-local flow.
     // They are always indexed by the shard index on the master.
@@ -148,6 +153,10 @@ class DflyCmd {
   // Stop all background processes so we can exit in orderly manner.
   void Shutdown();
 
+  // Cancel all replication sessions, the replicas reconnect and sync from scratch. Called when the
+  // data set of a replica that serves downstream replicas is replaced by a full sync.
+  void CancelAllReplicas() ABSL_LOCKS_EXCLUDED(mu_);
+
   // Create new sync session. Returns (session_id, number of flows)
   std::pair<uint32_t, unsigned> CreateSyncSession(ConnectionContext* cntx) ABSL_LOCKS_EXCLUDED(mu_);
 
@@ -161,10 +170,20 @@ class DflyCmd {
 
   // Sets metadata.
   void SetDflyClientVersion(ConnectionContext* cntx, DflyVersion version);
+  void SetJournalCompression(ConnectionContext* cntx, bool enabled);
 
   // Tries to break those flows that stuck on socket write for too long time.
   void BreakStalledFlowsInShard() ABSL_NO_THREAD_SAFETY_ANALYSIS;
 
+  // Records an ack of a flow and wakes up the WAIT commands blocked on the acks, all at once.
+  void OnFlowAck(FlowInfo* flow, uint64_t lsn);
+
+  // Blocks until num_replicas replicas have acknowledged the journal records of all shards written
+  // so far, or until the deadline if set. Returns the number of replicas that acknowledged them.
+  unsigned WaitForAcks(unsigned num_replicas,
+                       std::optional<std::chrono::steady_clock::time_point> deadline)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
  private:
   // JOURNAL [START/STOP]
   // Start or stop journaling.
@@ -234,6 +253,10 @@ class DflyCmd {
   // between the master's LSN and the last acknowledged LSN in over all shards.
   std::map<uint32_t, LSN> ReplicationLagsLocked() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Stats of the stable sync flows of every replica, indexed by shard id.
+  std::map<uint32_t, std::vector<ReplicaFlowStats>> FlowStatsLocked() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   ServerFamily* sf_;  // Not owned
 
   uint32_t next_sync_id_ = 1;
@@ -242,6 +265,8 @@ class DflyCmd {
   ReplicaInfoMap replica_infos_ ABSL_GUARDED_BY(mu_);
 
   mutable util::fb2::Mutex mu_;  // Guard global operations. See header top for locking levels.
+
+  util::fb2::EventCount acks_ec_;  // notified on every flow ack, awaited by WaitForAcks
 };
 
 }  // namespace dfly
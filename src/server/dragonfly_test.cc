@@ -25,8 +25,10 @@ extern "C" {
 ABSL_DECLARE_FLAG(float, mem_defrag_threshold);
 ABSL_DECLARE_FLAG(float, mem_defrag_waste_threshold);
 ABSL_DECLARE_FLAG(uint32_t, mem_defrag_check_sec_interval);
+ABSL_DECLARE_FLAG(float, mem_purge_unused_ratio);
 ABSL_DECLARE_FLAG(std::vector<std::string>, rename_command);
 ABSL_DECLARE_FLAG(double, oom_deny_ratio);
+ABSL_DECLARE_FLAG(std::string, cache_eviction_policy);
 ABSL_DECLARE_FLAG(bool, lua_resp2_legacy_float);
 
 namespace dfly {
@@ -40,6 +42,7 @@ using ::io::Result;
 using testing::AnyOf;
 using testing::ElementsAre;
 using testing::HasSubstr;
+using testing::IsEmpty;
 
 namespace {
 
@@ -148,6 +151,30 @@ TEST_F(SingleThreadDflyEngineTest, GlobalSingleThread) {
   Run({"move", "a", "1"});
 }
 
+TEST_F(DflyEngineTest, TransactionPool) {
+  // Multi-key commands exercise the recycled inner buffers as well.
+  for (unsigned i = 0; i < 10; ++i) {
+    Run({"mset", "a", "1", "b", "2", "c", "3", "d", "4", "e", "5"});
+    Run({"get", "a"});
+  }
+  EXPECT_THAT(Run({"mget", "a", "b", "c", "d", "e"}),
+              RespArray(ElementsAre("1", "2", "3", "4", "5")));
+
+  auto metrics = GetMetrics();
+  EXPECT_GT(metrics.coordinator_stats.tx_pool_hits, 0u);
+  EXPECT_GT(metrics.coordinator_stats.tx_pool_misses, 0u);
+}
+
+TEST_F(DflyEngineTest, CommandLookupIgnoresCase) {
+  EXPECT_EQ(Run({"SeT", "key", "val"}), "OK");
+  EXPECT_EQ(Run({"gEt", "key"}), "val");
+  EXPECT_THAT(Run({"XGroup", "Help"}), ArgType(RespExpr::ARRAY));
+  EXPECT_THAT(Run({"Acl", "WhoAmI", "x"}), ErrArg("wrong number of arguments for 'acl whoami'"));
+
+  EXPECT_THAT(Run({"setx", "key"}), ErrArg("unknown command `SETX`"));
+  EXPECT_THAT(Run({"mYcOmMaNd"}), ErrArg("unknown command `MYCOMMAND`"));
+}
+
 TEST_F(DflyEngineTest, EvalResp) {
   auto resp = Run({"eval", "return 43", "0"});
   EXPECT_THAT(resp, IntArg(43));
@@ -368,6 +395,46 @@ TEST_F(DflyEngineTest, Memcache) {
   EXPECT_THAT(resp, ElementsAre("END"));
 }
 
+TEST_F(DflyEngineTest, MemcacheMeta) {
+  EXPECT_THAT(RunMCLine("ms key 3 F5 T100", "bar"), ElementsAre("HD"));
+  EXPECT_THAT(RunMCLine("mg key v f s k Oop"), ElementsAre("VA 3 f5 s3 kkey Oop", "bar"));
+  EXPECT_THAT(RunMCLine("mg key"), ElementsAre("HD"));
+  EXPECT_THAT(RunMCLine("mg miss v"), ElementsAre("EN"));
+  EXPECT_THAT(RunMCLine("mg miss v q"), IsEmpty());
+  EXPECT_THAT(RunMCLine("mn"), ElementsAre("MN"));
+
+  // Store modes.
+  EXPECT_THAT(RunMCLine("ms key 3 ME", "baz"), ElementsAre("NS"));
+  EXPECT_THAT(RunMCLine("ms key 3 MA q", "baz"), IsEmpty());
+  EXPECT_THAT(RunMCLine("mg key v"), ElementsAre("VA 6", "barbaz"));
+  EXPECT_THAT(RunMCLine("ms other 1 MR O1", "x"), ElementsAre("NS O1"));
+
+  // Arithmetic.
+  EXPECT_THAT(RunMCLine("ms cnt 1", "5"), ElementsAre("HD"));
+  EXPECT_THAT(RunMCLine("ma cnt D10 v"), ElementsAre("VA 2", "15"));
+  EXPECT_THAT(RunMCLine("ma cnt MD q"), IsEmpty());
+  EXPECT_THAT(RunMCLine("mg cnt v"), ElementsAre("VA 2", "14"));
+  EXPECT_THAT(RunMCLine("ma miss"), ElementsAre("NF"));
+
+  // Deletes.
+  EXPECT_THAT(RunMCLine("md key k"), ElementsAre("HD kkey"));
+  EXPECT_THAT(RunMCLine("md key"), ElementsAre("NF"));
+  EXPECT_THAT(RunMCLine("md key q"), IsEmpty());
+
+  // A batch of pipelined gets is served by a single command, every key with its own flags.
+  EXPECT_THAT(GetManyMC({"mg cnt v q O1", "mg miss v q O2", "mg cnt k O3", "mg miss O4"}),
+              ElementsAre("VA 2 O1", "14", "HD kcnt O3", "EN O4"));
+}
+
+TEST_F(DflyEngineTest, MemcacheMultiGet) {
+  ASSERT_THAT(RunMC(MemcacheParser::SET, "a", "1", 0), ElementsAre("STORED"));
+  ASSERT_THAT(RunMC(MemcacheParser::SET, "b", "22", 3), ElementsAre("STORED"));
+
+  EXPECT_THAT(GetManyMC({"get a miss b", "get miss", "mg b v O1", "get b a"}),
+              ElementsAre("VALUE a 0 1", "1", "VALUE b 3 2", "22", "END", "END", "VA 2 O1", "22",
+                          "VALUE b 3 2", "22", "VALUE a 0 1", "1", "END"));
+}
+
 TEST_F(DflyEngineTest, MemcacheFlags) {
   using MP = MemcacheParser;
 
@@ -527,8 +594,73 @@ TEST_F(DflyEngineTest, StickyEviction) {
   }
 }
 
+TEST_F(DflyEngineTest, TinyLfuAdmission) {
+  max_memory_limit = 300000;
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_oom_deny_ratio, 4);
+  absl::SetFlag(&FLAGS_cache_eviction_policy, "tinylfu");
+  ResetService();
+  shard_set->TEST_EnableCacheMode();
+
+  // Fills the cache with keys that are read right after being written. Once it is full, new keys
+  // are less popular than any of the resident ones and are not admitted.
+  string tmp_val(100, '.');
+  vector<string> hot_keys;
+  for (unsigned i = 0; i < 5000; ++i) {
+    string key = StrCat("hot", i);
+    if (Run({"set", key, tmp_val}) != "OK")
+      continue;
+    for (unsigned j = 0; j < 5; ++j)
+      Run({"get", key});
+    hot_keys.push_back(key);
+  }
+  ASSERT_LT(hot_keys.size(), 5000u);
+
+  // A scan of keys that are written once does not push out the frequently read keys.
+  for (unsigned i = 0; i < 5000; ++i) {
+    Run({"set", StrCat("scan", i), tmp_val});
+  }
+
+  for (const string& key : hot_keys) {
+    ASSERT_THAT(Run({"exists", key}), IntArg(1)) << key;
+  }
+  EXPECT_THAT(Run({"info", "stats"}).GetString(), HasSubstr("admission_rejections:"));
+}
+
 #endif
 
+TEST_F(DflyEngineTest, VolatileTtlEviction) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_cache_eviction_policy, "volatile-ttl");
+  ResetService();
+  shard_set->TEST_EnableCacheMode();
+
+  string tmp_val(100, '.');
+  for (unsigned i = 0; i < 500; ++i) {
+    Run({"set", StrCat("persistent", i), tmp_val});
+    Run({"set", StrCat("long", i), tmp_val, "EX", "100000"});
+    Run({"set", StrCat("short", i), tmp_val, "EX", "100"});
+  }
+
+  // Evicts a few keys on every shard, all of them among the ones that expire soon.
+  atomic_uint64_t evicted = 0;
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    auto& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id());
+    evicted += db_slice.FreeMemWithEvictionStep(0, 0, 1000).first;
+  });
+  ASSERT_GT(evicted, 0u);
+
+  unsigned short_left = 0;
+  for (unsigned i = 0; i < 500; ++i) {
+    ASSERT_THAT(Run({"exists", StrCat("persistent", i)}), IntArg(1));
+    ASSERT_THAT(Run({"exists", StrCat("long", i)}), IntArg(1));
+    short_left += Run({"exists", StrCat("short", i)}).GetInt();
+  }
+  EXPECT_EQ(short_left, 500 - evicted);
+  EXPECT_THAT(Run({"info", "stats"}).GetString(),
+              HasSubstr(StrCat("evicted_volatile_keys:", evicted.load())));
+}
+
 TEST_F(DflyEngineTest, PSubscribe) {
   single_response_ = false;
   auto resp = pp_->at(1)->Await([&] { return Run({"psubscribe", "a*", "b*"}); });
@@ -581,6 +713,44 @@ TEST_F(DflyEngineTest, PUnsubscribe) {
   EXPECT_THAT(resp.GetVec(), ElementsAre("punsubscribe", "b*", IntArg(0)));
 }
 
+TEST_F(DflyEngineTest, ShardedPubSub) {
+  auto resp = Run({"sunsubscribe"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("sunsubscribe", ArgType(RespExpr::NIL), IntArg(0)));
+
+  single_response_ = false;
+  resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "a"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ssubscribe", "a", IntArg(1)));
+  resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "b"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ssubscribe", "b", IntArg(2)));
+
+  // Shard channels and regular channels do not share subscribers.
+  resp = pp_->at(1)->Await([&] { return Run({"subscribe", "a"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("subscribe", "a", IntArg(1)));
+
+  single_response_ = true;
+  EXPECT_THAT(pp_->at(0)->Await([&] { return Run({"spublish", "a", "foo"}); }), IntArg(1));
+  EXPECT_THAT(Run({"pubsub", "shardnumsub", "a", "c"}),
+              RespArray(ElementsAre("a", IntArg(1), "c", IntArg(0))));
+  EXPECT_THAT(Run({"pubsub", "shardchannels"}).GetVec(), testing::UnorderedElementsAre("a", "b"));
+  EXPECT_THAT(Run({"pubsub", "numsub", "a", "b"}),
+              RespArray(ElementsAre("a", IntArg(1), "b", IntArg(0))));
+
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  ASSERT_EQ(1, SubscriberMessagesLen("IO1"));
+  const auto& msg = GetPublishedMessage("IO1", 0);
+  EXPECT_EQ("foo", msg.message);
+  EXPECT_EQ("a", msg.channel);
+  EXPECT_EQ("3\r\n$8\r\nsmessage\r\n$1\r\na\r\n$3\r\nfoo\r\n", msg.frame_tail);
+
+  single_response_ = false;
+  resp = pp_->at(1)->Await([&] { return Run({"sunsubscribe", "a"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("sunsubscribe", "a", IntArg(1)));
+
+  single_response_ = true;
+  EXPECT_THAT(pp_->at(0)->Await([&] { return Run({"spublish", "a", "foo"}); }), IntArg(0));
+}
+
 TEST_F(DflyEngineTest, Bug468) {
   RespExpr resp = Run({"multi"});
   ASSERT_EQ(resp, "OK");
@@ -735,6 +905,25 @@ TEST_F(DefragDflyEngineTest, TestDefragOption) {
   });
 }
 
+TEST_F(SingleThreadDflyEngineTest, MemPurge) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_mem_purge_unused_ratio, 0.01);
+
+  Run({"DEBUG", "POPULATE", "20000", "key", "1000"});
+  Run({"FLUSHALL"});
+
+  // The shard purges its heap in the background once RSS stays above the used memory.
+  EngineShard::Stats stats;
+  for (int i = 0; i < 50 && stats.mem_purge_total == 0; ++i) {
+    ThisFiber::SleepFor(100ms);
+    stats = shard_set->Await(0, [] { return EngineShard::tlocal()->stats(); });
+  }
+  EXPECT_GT(stats.mem_purge_total, 0u);
+
+  auto info = Run({"INFO", "MEMORY"}).GetString();
+  EXPECT_THAT(info, HasSubstr("mem_purge_returned_bytes:"));
+}
+
 TEST_F(DflyEngineTest, Issue752) {
   // https://github.com/dragonflydb/dragonfly/issues/752
   // local_result_ member was not reset between commands
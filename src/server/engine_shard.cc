@@ -14,6 +14,7 @@ extern "C" {
 }
 
 #include "server/engine_shard_set.h"
+#include "server/lazy_free.h"
 #include "server/namespaces.h"
 #include "server/search/doc_index.h"
 #include "server/server_state.h"
@@ -37,6 +38,18 @@ ABSL_FLAG(float, mem_defrag_page_utilization_threshold, 0.8,
           "memory page under utilization threshold. Ratio between used and committed size, below "
           "this, memory in this page will defragmented");
 
+ABSL_FLAG(uint32_t, mem_defrag_step_budget_usec, 500,
+          "CPU time budget of a single defragmentation step. Members of large containers are "
+          "defragmented incrementally, resuming in the next step once the budget is used up.");
+
+ABSL_FLAG(float, mem_purge_unused_ratio, 0.3,
+          "The ratio of (rss - used memory)/rss above which the shards return the free pages of "
+          "their heaps to the OS in the background. 0 disables.");
+
+ABSL_FLAG(uint32_t, mem_purge_budget_usec, 1000,
+          "CPU time per second a shard may spend on background purging of its heap on average. "
+          "Purges that take longer are spaced further apart.");
+
 ABSL_FLAG(uint32_t, hz, 100,
           "Base frequency at which the server performs other background tasks. "
           "Warning: not advised to decrease in production.");
@@ -52,7 +65,9 @@ ABSL_FLAG(string, tiered_prefix, "",
           "The string denotes the path and prefix of the files "
           " associated with tiered storage. Stronly advised to use "
           "high performance NVME ssd disks for this. Also, seems that pipeline_squash does "
-          "not work well with tiered storage, so it's advised to set it to 0.");
+          "not work well with tiered storage, so it's advised to set it to 0. "
+          "Multiple comma separated prefixes, for example on different drives, stripe "
+          "the storage of each shard across all of them.");
 
 ABSL_FLAG(float, tiered_offload_threshold, 0.5,
           "The ratio of used/max memory above which we start offloading values to disk");
@@ -60,6 +75,16 @@ ABSL_FLAG(float, tiered_offload_threshold, 0.5,
 ABSL_FLAG(bool, enable_heartbeat_eviction, true,
           "Enable eviction during heartbeat when memory is under pressure.");
 
+ABSL_FLAG(uint32_t, tx_queue_scan_depth, 32,
+          "While the head of the transaction queue is blocked, up to this many queued "
+          "transactions are checked for single shard transactions whose keys are no longer "
+          "contended, those run ahead of the head. 0 disables.");
+
+ABSL_FLAG(string, dash_huge_pages, "off",
+          "Back the segments of the key tables with 2MiB huge pages to reduce TLB misses. "
+          "'madvise' uses transparent huge pages, 'explicit' uses preallocated hugetlbfs pages "
+          "and falls back to 'madvise' when none are available. 'off' disables.");
+
 namespace dfly {
 
 using absl::GetFlag;
@@ -210,7 +235,7 @@ ShardId Shard(string_view v, ShardId shard_num) {
 }
 
 EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o) {
-  static_assert(sizeof(Stats) == 64);
+  static_assert(sizeof(Stats) == 104 + sizeof(defrag_moved_bytes));
 
 #define ADD(x) x += o.x
 
@@ -219,9 +244,17 @@ EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o)
   ADD(defrag_task_invocation_total);
   ADD(poll_execution_total);
   ADD(tx_ooo_total);
+  ADD(tx_ooo_promoted_total);
   ADD(tx_optimistic_total);
+  ADD(tx_optimistic_unlocked_total);
   ADD(tx_batch_schedule_calls_total);
   ADD(tx_batch_scheduled_items_total);
+  ADD(mem_purge_total);
+  ADD(mem_purge_returned_bytes);
+  ADD(tx_exec_cycles);
+
+  for (size_t i = 0; i < defrag_moved_bytes.size(); ++i)
+    ADD(defrag_moved_bytes[i]);
 
 #undef ADD
   return *this;
@@ -237,6 +270,7 @@ void EngineShard::DefragTaskState::UpdateScanState(uint64_t cursor_val) {
 
 void EngineShard::DefragTaskState::ResetScanState() {
   dbid = cursor = 0u;
+  pending.clear();
 }
 
 // This function checks 3 things:
@@ -246,7 +280,7 @@ void EngineShard::DefragTaskState::ResetScanState() {
 // 3. in case the above is OK, make sure that we have a "gap" between usage and commited memory
 // (control by mem_defrag_waste_threshold flag)
 bool EngineShard::DefragTaskState::CheckRequired() {
-  if (is_force_defrag || cursor > kCursorDoneState) {
+  if (is_force_defrag || cursor > kCursorDoneState || !pending.empty()) {
     is_force_defrag = false;
     VLOG(2) << "cursor: " << cursor << " and is_force_defrag " << is_force_defrag;
     return true;
@@ -295,40 +329,77 @@ bool EngineShard::DoDefrag() {
   // --------------------------------------------------------------------------
 
   constexpr size_t kMaxTraverses = 40;
+  // Container members visited between two checks of the time budget.
+  constexpr size_t kMembersPerStep = 1024;
+
   const float threshold = GetFlag(FLAGS_mem_defrag_page_utilization_threshold);
+  const uint64_t budget_ns = uint64_t(GetFlag(FLAGS_mem_defrag_step_budget_usec)) * 1000;
+  const uint64_t deadline = fb2::ProactorBase::GetMonotonicTimeNs() + budget_ns;
 
   // TODO: enable tiered storage on non-default db slice
   DbSlice& slice = namespaces.GetDefaultNamespace().GetDbSlice(shard_->shard_id());
 
+  uint64_t reallocations = 0;
+  uint64_t attempts = 0;
+
+  // Defragments the value until it is fully visited or the time budget runs out.
+  // Returns the cursor to resume from, 0 if the value was completed.
+  auto defrag_value = [&](PrimeValue& pv, uint64_t cursor) {
+    DefragState state{.ratio = threshold, .cursor = cursor};
+    do {
+      state.budget = kMembersPerStep;
+      pv.DefragStep(&state);
+    } while (state.cursor && fb2::ProactorBase::GetMonotonicTimeNs() < deadline);
+
+    attempts++;
+    if (state.moved_bytes > 0) {
+      reallocations++;
+      stats_.defrag_moved_bytes[pv.ObjType()] += state.moved_bytes;
+    }
+    return state.cursor;
+  };
+
+  // Continue with the large containers that were not completed by the previous steps.
+  auto& pending = defrag_state_.pending;
+  while (!pending.empty() && fb2::ProactorBase::GetMonotonicTimeNs() < deadline) {
+    auto& value = pending.back();
+    if (slice.IsDbValid(value.dbid)) {
+      PrimeIterator it = slice.GetTables(value.dbid).first->Find(value.key);
+      if (!it.is_done() && (value.cursor = defrag_value(it->second, value.cursor)) != 0)
+        continue;
+    }
+    pending.pop_back();
+  }
+
   // If we moved to an invalid db, skip as long as it's not the last one
   while (!slice.IsDbValid(defrag_state_.dbid) && defrag_state_.dbid + 1 < slice.db_array_size())
     defrag_state_.dbid++;
 
   // If we found no valid db, we finished traversing and start from scratch next time
   if (!slice.IsDbValid(defrag_state_.dbid)) {
+    if (!pending.empty())
+      return true;
     defrag_state_.ResetScanState();
+    mem_purge_state_.after_defrag = true;
     return false;
   }
 
   DCHECK(slice.IsDbValid(defrag_state_.dbid));
   auto [prime_table, expire_table] = slice.GetTables(defrag_state_.dbid);
   PrimeTable::Cursor cur = defrag_state_.cursor;
-  uint64_t reallocations = 0;
   unsigned traverses_count = 0;
-  uint64_t attempts = 0;
 
   do {
     cur = slice.Traverse(prime_table, cur, [&](PrimeIterator it) {
       // for each value check whether we should move it because it
       // seats on underutilized page of memory, and if so, do it.
-      bool did = it->second.DefragIfNeeded(threshold);
-      attempts++;
-      if (did) {
-        reallocations++;
+      if (uint64_t cursor = defrag_value(it->second, 0); cursor != 0) {
+        pending.push_back({DbIndex(defrag_state_.dbid), it->first.ToString(), cursor});
       }
     });
     traverses_count++;
-  } while (traverses_count < kMaxTraverses && cur && namespaces.IsInitialized());
+  } while (traverses_count < kMaxTraverses && cur && namespaces.IsInitialized() &&
+           fb2::ProactorBase::GetMonotonicTimeNs() < deadline);
 
   defrag_state_.UpdateScanState(cur.value());
 
@@ -365,6 +436,11 @@ uint32_t EngineShard::DefragTask() {
 
   constexpr uint32_t kRunAtLowPriority = 0u;
 
+  // Defragmentation moves values, which is not allowed while they are referenced by replies.
+  if (zero_copy_refs_ > 0) {
+    return kRunAtLowPriority;
+  }
+
   if (defrag_state_.CheckRequired()) {
     VLOG(2) << shard_id_ << ": need to run defrag memory cursor state: " << defrag_state_.cursor;
     if (DoDefrag()) {
@@ -380,7 +456,15 @@ EngineShard::EngineShard(util::ProactorBase* pb, mi_heap_t* heap)
       queue2_(kQueueLen / 2, 2, 2),
       txq_([](const Transaction* t) { return t->txid(); }),
       mi_resource_(heap),
-      shard_id_(pb->GetPoolIndex()) {
+      shard_id_(pb->GetPoolIndex()),
+      txq_scan_depth_(GetFlag(FLAGS_tx_queue_scan_depth)) {
+  if (string mode = GetFlag(FLAGS_dash_huge_pages); mode != "off") {
+    LOG_IF(WARNING, mode != "madvise" && mode != "explicit")
+        << "Unknown dash_huge_pages mode " << mode << ", using madvise";
+    segment_resource_ = make_unique<HugePageResource>(
+        mode == "explicit" ? HugePageResource::Mode::kExplicit : HugePageResource::Mode::kMadvise,
+        vector<size_t>{PrimeTable::kSegBytes, ExpireTable::kSegBytes}, &mi_resource_);
+  }
   defrag_task_ = pb->AddOnIdleTask([this]() { return DefragTask(); });
   queue_.Start(absl::StrCat("shard_queue_", shard_id()));
   queue2_.Start(absl::StrCat("l2_queue_", shard_id()));
@@ -428,6 +512,7 @@ void EngineShard::InitThreadLocal(ProactorBase* pb) {
   RoundRobinSharder::Init();
 
   shard_->shard_search_indices_.reset(new ShardDocIndices());
+  shard_->lazy_freer_ = make_unique<LazyFreer>();
 }
 
 void EngineShard::InitTieredStorage(ProactorBase* pb, size_t max_file_size) {
@@ -588,11 +673,47 @@ void EngineShard::PollExecution(const char* context, Transaction* trans) {
     if (is_ooo && !trans->IsMulti())
       DCHECK_EQ(keep, trans->DEBUG_GetTxqPosInShard(sid) != TxQueue::kEnd);
   }
+
+  // Short transactions queued behind a blocked head do not have to wait for it if they do not
+  // conflict with any other queued transaction.
+  if (!txq_.Empty() && txq_scan_depth_ > 0) {
+    Transaction* front = get<Transaction*>(txq_.Front());
+    auto* bc = front->GetNamespace().GetBlockingController(shard_id_);
+    if (!bc || !bc->HasAwakedTransaction()) {
+      RunUncontendedQueued();
+      update_stats = true;
+    }
+  }
+
   if (update_stats) {
     CacheStats();
   }
 }
 
+void EngineShard::RunUncontendedQueued() {
+  ShardId sid = shard_id();
+  absl::InlinedVector<Transaction*, 8> runnable;
+
+  // Running transactions removes them from the queue, so first collect them.
+  auto cur = txq_.Head();
+  for (unsigned i = 0; i < txq_scan_depth_ && i < txq_.size(); ++i) {
+    Transaction* tx = get<Transaction*>(txq_.At(cur));
+    if (tx != continuation_trans_ && tx->DEBUG_IsArmedInShard(sid) &&
+        tx->MaybeMarkOutOfOrder(this)) {
+      runnable.push_back(tx);
+    }
+    cur = txq_.Next(cur);
+  }
+
+  for (Transaction* tx : runnable) {
+    if (!tx->DisarmInShard(sid))
+      continue;
+    stats_.tx_ooo_promoted_total++;
+    if (!tx->RunInShard(this, true))
+      stats_.tx_ooo_total++;
+  }
+}
+
 void EngineShard::RemoveContTx(Transaction* tx) {
   if (continuation_trans_ == tx) {
     continuation_trans_ = nullptr;
@@ -602,6 +723,7 @@ void EngineShard::RemoveContTx(Transaction* tx) {
 void EngineShard::Heartbeat() {
   DVLOG(2) << " Hearbeat";
   DCHECK(namespaces.IsInitialized());
+  CpuClassScope cpu_scope{CpuClass::HEARTBEAT};
 
   CacheStats();
 
@@ -611,6 +733,10 @@ void EngineShard::Heartbeat() {
 
   // TODO: iterate over all namespaces
   DbSlice& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard_id());
+  uint64_t now_ms = fb2::ProactorBase::GetMonotonicTimeNs() / 1000000;
+  db_slice.UpdateSlotLoad(now_ms);
+  db_slice.PreSplitStep();
+  db_slice.UpdateHotKeyReplicas(now_ms);
 
   // Offset CoolMemoryUsage when consider background offloading.
   // TODO: Another approach could be is to align the approach  similarly to how we do with
@@ -632,20 +758,58 @@ void EngineShard::Heartbeat() {
       tiered_storage_->RunOffloading(i);
     }
   }
+
+  MemPurgeStep();
+
+  if (tiered_storage_) {
+    tiered_storage_->RunCompaction();
+    tiered_storage_->FlushStaleBins();
+    tiered_storage_->SampleWriteDepth();
+  }
+}
+
+void EngineShard::MemPurgeStep() {
+  constexpr uint64_t kCheckIntervalNs = 1'000'000'000;
+
+  const float unused_ratio = GetFlag(FLAGS_mem_purge_unused_ratio);
+  const uint64_t start = fb2::ProactorBase::GetMonotonicTimeNs();
+  if (unused_ratio <= 0 || start < mem_purge_state_.next_check_ns)
+    return;
+
+  // RSS is what rss_oom_deny_ratio compares with the limit, so its part above used memory is the
+  // committed memory that is worth returning. Every shard then purges its own heap.
+  size_t rss = rss_mem_current.load(memory_order_relaxed);
+  size_t used = used_mem_current.load(memory_order_relaxed);
+  if (mem_purge_state_.after_defrag || rss - min(used, rss) > rss * unused_ratio) {
+    size_t commit_before = 0, commit_after = 0;
+    mi_process_info(nullptr, nullptr, nullptr, nullptr, nullptr, &commit_before, nullptr, nullptr);
+    ServerState::tlocal()->DecommitMemory(ServerState::kDataHeap);
+    mi_process_info(nullptr, nullptr, nullptr, nullptr, nullptr, &commit_after, nullptr, nullptr);
+
+    // Approximate, as the other threads commit and decommit memory concurrently.
+    size_t returned = commit_before - min(commit_before, commit_after);
+    stats_.mem_purge_total++;
+    stats_.mem_purge_returned_bytes += returned;
+    mem_purge_state_.after_defrag = false;
+    VLOG(1) << "Purged shard heap, rss " << rss << ", used " << used << ", returned " << returned;
+
+    // What remains can be unused parts of pages that only defrag can empty, or memory outside
+    // of the heaps. Back off while purges return nothing.
+    mem_purge_state_.backoff = returned > 0 ? 1 : min(mem_purge_state_.backoff * 2, 16u);
+  } else {
+    mem_purge_state_.backoff = 1;
+  }
+
+  // A purge that took longer than the budget delays the next check accordingly, so purging takes
+  // no more than the budget on average, even with huge heaps.
+  uint64_t budget_ns = max<uint64_t>(GetFlag(FLAGS_mem_purge_budget_usec), 1) * 1000;
+  uint64_t elapsed_ns = fb2::ProactorBase::GetMonotonicTimeNs() - start;
+  uint64_t intervals =
+      max<uint64_t>(mem_purge_state_.backoff, (elapsed_ns + budget_ns - 1) / budget_ns);
+  mem_purge_state_.next_check_ns = start + kCheckIntervalNs * intervals;
 }
 
 void EngineShard::RetireExpiredAndEvict() {
-  // TODO: iterate over all namespaces
-  DbSlice& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard_id());
-  // Some of the functions below might acquire the same lock again so we need to unlock it
-  // asap. We won't yield before we relock the mutex again, so the code below is atomic
-  // in respect to preemptions of big values. An example of that is the call to
-  // DeleteExpiredStep() below, which eventually calls ExpireIfNeeded()
-  // and within that the call to RecordExpiry() will trigger the registered
-  // callback OnJournalEntry which locks the exact same mutex.
-  // We need to lock below and immediately release because there should be no other fiber
-  // that is serializing a big value.
-  { std::unique_lock lk(db_slice.GetSerializationMutex()); }
   constexpr double kTtlDeleteLimit = 200;
   constexpr double kRedLimitFactor = 0.1;
 
@@ -662,6 +826,37 @@ void EngineShard::RetireExpiredAndEvict() {
   }
 
   ssize_t eviction_redline = size_t(max_memory_limit * kRedLimitFactor) / shard_set->size();
+  RetireExpiredAndEvict(namespaces.GetDefaultNamespace().GetDbSlice(shard_id()),
+                        ttl_delete_target, eviction_redline);
+
+  // The budgets of the other namespaces are capped by their quotas, so a namespace that fills its
+  // quota evicts only its own keys.
+  for (Namespace* ns : namespaces.GetNonDefaultNamespaces()) {
+    size_t max_memory = ns->MaxMemory() > 0 ? ns->MaxMemory() : size_t(max_memory_limit);
+    RetireExpiredAndEvict(ns->GetDbSlice(shard_id()), ttl_delete_target,
+                          size_t(max_memory * kRedLimitFactor) / shard_set->size());
+  }
+
+  // Journal entries for expired entries are not writen to socket in the loop above.
+  // Trigger write to socket when loop finishes.
+  if (auto journal = EngineShard::tlocal()->journal(); journal) {
+    TriggerJournalWriteToSink();
+  }
+}
+
+void EngineShard::RetireExpiredAndEvict(DbSlice& db_slice, unsigned ttl_delete_target,
+                                        ssize_t eviction_redline) {
+  // Some of the functions below might acquire the same lock again so we need to unlock it
+  // asap. We won't yield before we relock the mutex again, so the code below is atomic
+  // in respect to preemptions of big values. An example of that is the call to
+  // DeleteExpiredStep() below, which eventually calls ExpireIfNeeded()
+  // and within that the call to RecordExpiry() will trigger the registered
+  // callback OnJournalEntry which locks the exact same mutex.
+  // We need to lock below and immediately release because there should be no other fiber
+  // that is serializing a big value.
+  { std::unique_lock lk(db_slice.GetSerializationMutex()); }
+  // Number of hash buckets of sets and hashes scanned for expired members per db.
+  constexpr unsigned kMemberExpiryBudget = 256;
 
   DbContext db_cntx;
   db_cntx.time_now_ms = GetCurrentTimeMs();
@@ -671,27 +866,29 @@ void EngineShard::RetireExpiredAndEvict() {
       continue;
 
     db_cntx.db_index = i;
-    auto [pt, expt] = db_slice.GetTables(i);
-    if (expt->size() > pt->size() / 4) {
+    const DbTable* db_table = db_slice.GetDBTable(i);
+    // The wheel only visits the keys that are due, so it runs regardless of the share of keys with
+    // expiry.
+    if (db_table->expire_wheel || db_table->expire_count() > db_table->prime.size() / 4) {
       DbSlice::DeleteExpiredStats stats = db_slice.DeleteExpiredStep(db_cntx, ttl_delete_target);
 
       counter_[TTL_TRAVERSE].IncBy(stats.traversed);
       counter_[TTL_DELETE].IncBy(stats.deleted);
     }
 
+    db_slice.CollectExpiredMembersStep(db_cntx, kMemberExpiryBudget);
+
     // if our budget is below the limit
     if (db_slice.memory_budget() < eviction_redline && GetFlag(FLAGS_enable_heartbeat_eviction)) {
-      uint32_t starting_segment_id = rand() % pt->GetSegmentCount();
+      uint32_t starting_segment_id = rand() % db_table->prime.GetSegmentCount();
       db_slice.FreeMemWithEvictionStep(i, starting_segment_id,
                                        eviction_redline - db_slice.memory_budget());
     }
   }
 
-  // Journal entries for expired entries are not writen to socket in the loop above.
-  // Trigger write to socket when loop finishes.
-  if (auto journal = EngineShard::tlocal()->journal(); journal) {
-    TriggerJournalWriteToSink();
-  }
+  // Expired and evicted keys are sent together to tracking clients and keyspace subscribers.
+  db_slice.FlushInvalidationMessages();
+  db_slice.FlushKeyspaceEvents();
 }
 
 void EngineShard::RunPeriodic(std::chrono::milliseconds period_ms,
@@ -746,10 +943,15 @@ void EngineShard::CacheStats() {
 
   size_t bytes_per_obj = entries > 0 ? obj_memory / entries : 0;
   db_slice.SetCachedParams(free_mem / shard_set->size(), bytes_per_obj);
+
+  for (Namespace* ns : namespaces.GetNonDefaultNamespaces())
+    ns->UpdateShardMemory(shard_id(), free_mem, bytes_per_obj);
 }
 
 size_t EngineShard::UsedMemory() const {
-  return mi_resource_.used() + zmalloc_used_memory_tl + SmallString::UsedThreadLocal() +
+  size_t segment_bytes = segment_resource_ ? segment_resource_->stats().chunk_bytes : 0;
+  return mi_resource_.used() + segment_bytes + zmalloc_used_memory_tl +
+         SmallString::UsedThreadLocal() + CompactObj::GetStats().key_prefix_bytes +
          search_indices()->GetUsedMemory();
 }
 
@@ -788,12 +990,21 @@ auto EngineShard::AnalyzeTxQueue() const -> TxQueueInfo {
       max_db_id = trx->GetDbIndex();
     }
 
+    bool is_global =
+        trx->IsGlobal() || (trx->IsMulti() && trx->GetMultiMode() == Transaction::GLOBAL);
+    if (!is_global) {
+      if (trx->GetUniqueShardCnt() == 1)
+        info.tx_single_shard++;
+      else
+        info.tx_multi_shard++;
+    }
+
     bool is_armed = trx->DEBUG_IsArmedInShard(sid);
     DVLOG(1) << "Inspecting " << trx->DebugId() << " is_armed " << is_armed;
     if (is_armed) {
       info.tx_armed++;
 
-      if (trx->IsGlobal() || (trx->IsMulti() && trx->GetMultiMode() == Transaction::GLOBAL)) {
+      if (is_global) {
         info.tx_global++;
       } else {
         const DbTable* table = db_slice.GetDBTable(trx->GetDbIndex());
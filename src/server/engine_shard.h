@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "core/huge_page_resource.h"
 #include "core/intent_lock.h"
 #include "core/mi_memory_resource.h"
 #include "core/task_queue.h"
@@ -12,11 +13,17 @@
 #include "server/tx_base.h"
 #include "util/sliding_counter.h"
 
+extern "C" {
+#include "redis/redis_aux.h"
+}
+
 typedef char* sds;
 
 namespace dfly {
 
+class DbSlice;
 class EngineShardSet;
+class LazyFreer;
 class TieredStorage;
 class ShardDocIndices;
 
@@ -34,16 +41,31 @@ class EngineShard {
     uint64_t defrag_task_invocation_total = 0;
     uint64_t poll_execution_total = 0;
 
+    // bytes re-allocated by defragmentation, by object type.
+    std::array<uint64_t, OBJ_TYPE_MAX> defrag_moved_bytes = {};
+
     // number of optimistic executions - that were run as part of the scheduling.
     uint64_t tx_optimistic_total = 0;
+    // number of optimistic executions of read-only commands that did not lock their keys.
+    uint64_t tx_optimistic_unlocked_total = 0;
     uint64_t tx_ooo_total = 0;
 
+    // number of queued transactions that ran out of order after their keys became uncontended.
+    uint64_t tx_ooo_promoted_total = 0;
+
     // Number of ScheduleBatchInShard calls.
     uint64_t tx_batch_schedule_calls_total = 0;
 
     // Number of transactions scheduled via ScheduleBatchInShard.
     uint64_t tx_batch_scheduled_items_total = 0;
 
+    // Number of background purges of the shard heap and the bytes of pages they released.
+    uint64_t mem_purge_total = 0;
+    uint64_t mem_purge_returned_bytes = 0;
+
+    // Time spent running transaction callbacks, the load of the shard on its thread.
+    uint64_t tx_exec_cycles = 0;
+
     Stats& operator+=(const Stats&);
   };
 
@@ -72,6 +94,26 @@ class EngineShard {
     return &mi_resource_;
   }
 
+  // Memory resource for DashTable segments, see the dash_huge_pages flag.
+  PMR_NS::memory_resource* segment_memory_resource() {
+    return segment_resource_ ? segment_resource_.get() : memory_resource();
+  }
+
+  // nullptr if segments are not backed by huge pages.
+  const HugePageResource* huge_page_resource() const {
+    return segment_resource_.get();
+  }
+
+  // Replies that reference values of this shard directly from another thread (zero-copy GET).
+  // While there are any, values must not be reallocated by defragmentation.
+  void IncZeroCopyRefs() {
+    ++zero_copy_refs_;
+  }
+
+  void DecZeroCopyRefs() {
+    --zero_copy_refs_;
+  }
+
   TaskQueue* GetFiberQueue() {
     return &queue_;
   }
@@ -125,6 +167,10 @@ class EngineShard {
     return shard_search_indices_.get();
   }
 
+  LazyFreer* lazy_freer() {
+    return lazy_freer_.get();
+  }
+
   // Moving average counters.
   enum MovingCnt { TTL_TRAVERSE, TTL_DELETE, COUNTER_TOTAL };
 
@@ -163,6 +209,10 @@ class EngineShard {
     // tx_total is the size of the transaction queue.
     unsigned tx_armed = 0, tx_total = 0, tx_runnable = 0, tx_global = 0;
 
+    // Queued transactions by lane: single shard ones may run ahead of a blocked head once their
+    // keys are uncontended, multi shard and global ones keep the queue order.
+    unsigned tx_single_shard = 0, tx_multi_shard = 0;
+
     // total_locks - total number of the transaction locks in the shard.
     unsigned total_locks = 0;
 
@@ -187,10 +237,18 @@ class EngineShard {
 
  private:
   struct DefragTaskState {
+    // A large container whose members are defragmented over several steps.
+    struct PendingValue {
+      DbIndex dbid;
+      std::string key;
+      uint64_t cursor;
+    };
+
     size_t dbid = 0u;
     uint64_t cursor = 0u;
     time_t last_check_time = 0;
     bool is_force_defrag = false;
+    std::vector<PendingValue> pending;
 
     // check the current threshold and return true if
     // we need to do the defragmentation
@@ -201,6 +259,12 @@ class EngineShard {
     void ResetScanState();
   };
 
+  struct MemPurgeState {
+    uint64_t next_check_ns = 0;  // monotonic
+    unsigned backoff = 1;        // check intervals between two checks
+    bool after_defrag = false;   // a defrag pass completed, the pages it emptied can be released
+  };
+
   EngineShard(util::ProactorBase* pb, mi_heap_t* heap);
 
   // blocks the calling fiber.
@@ -210,11 +274,21 @@ class EngineShard {
 
   void Heartbeat();
   void RetireExpiredAndEvict();
+  void RetireExpiredAndEvict(DbSlice& db_slice, unsigned ttl_delete_target,
+                             ssize_t eviction_redline);
 
   void RunPeriodic(std::chrono::milliseconds period_ms, std::function<void()> shard_handler);
 
   void CacheStats();
 
+  // Returns the free pages of the shard heap to the OS if too much of its committed memory is
+  // unused, so that RSS follows used memory down after large deletions. Called from Heartbeat.
+  void MemPurgeStep();
+
+  // Runs armed single shard transactions from the first txq_scan_depth_ entries of the queue
+  // out of order if their keys are not contended anymore. Called when the head can not run.
+  void RunUncontendedQueued();
+
   // We are running a task that checks whether we need to
   // do memory de-fragmentation here, this task only run
   // when there are available CPU time.
@@ -236,6 +310,7 @@ class EngineShard {
 
   TxQueue txq_;
   MiMemoryResource mi_resource_;
+  std::unique_ptr<HugePageResource> segment_resource_;  // upstream is mi_resource_.
   ShardId shard_id_;
 
   Stats stats_;
@@ -249,6 +324,7 @@ class EngineShard {
   // Logical ts used to order distributed transactions.
   TxId committed_txid_ = 0;
   Transaction* continuation_trans_ = nullptr;
+  unsigned txq_scan_depth_ = 0;
   journal::Journal* journal_ = nullptr;
   IntentLock shard_lock_;
 
@@ -257,9 +333,12 @@ class EngineShard {
   util::fb2::Done fiber_periodic_done_;
 
   DefragTaskState defrag_state_;
+  MemPurgeState mem_purge_state_;
+  uint32_t zero_copy_refs_ = 0;
   std::unique_ptr<TieredStorage> tiered_storage_;
   // TODO: Move indices to Namespace
   std::unique_ptr<ShardDocIndices> shard_search_indices_;
+  std::unique_ptr<LazyFreer> lazy_freer_;
 
   using Counter = util::SlidingCounter<7>;
 
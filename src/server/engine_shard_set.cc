@@ -4,12 +4,14 @@
 
 #include "server/engine_shard_set.h"
 
+#include <absl/strings/str_split.h>
 #include <sys/statvfs.h>
 
 #include <filesystem>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "server/lazy_free.h"
 #include "server/namespaces.h"
 #include "server/tiered_storage.h"
 #include "strings/human_readable.h"
@@ -37,20 +39,24 @@ using strings::HumanReadableNumBytes;
 
 namespace {
 
+// Sums up the sizes of the filesystems of all tiered prefixes.
 uint64_t GetFsLimit() {
-  std::filesystem::path file_path(GetFlag(FLAGS_tiered_prefix));
-  std::string dir_name_str = file_path.parent_path().string();
-
-  if (dir_name_str.empty())
-    dir_name_str = ".";
-
-  struct statvfs stat;
-  if (statvfs(dir_name_str.c_str(), &stat) == 0) {
-    uint64_t limit = stat.f_frsize * stat.f_blocks;
-    return limit;
+  uint64_t limit = 0;
+  for (string_view prefix : absl::StrSplit(GetFlag(FLAGS_tiered_prefix), ',', absl::SkipEmpty())) {
+    std::filesystem::path file_path(prefix);
+    std::string dir_name_str = file_path.parent_path().string();
+
+    if (dir_name_str.empty())
+      dir_name_str = ".";
+
+    struct statvfs stat;
+    if (statvfs(dir_name_str.c_str(), &stat) == 0) {
+      limit += stat.f_frsize * stat.f_blocks;
+    } else {
+      LOG(WARNING) << "Error getting filesystem information " << errno;
+    }
   }
-  LOG(WARNING) << "Error getting filesystem information " << errno;
-  return 0;
+  return limit;
 }
 
 size_t GetTieredFileLimit(size_t threads) {
@@ -129,6 +135,7 @@ void EngineShardSet::Init(uint32_t sz, std::function<void()> shard_handler) {
 void EngineShardSet::PreShutdown() {
   RunBlockingInParallel([](EngineShard* shard) {
     shard->StopPeriodicFiber();
+    shard->lazy_freer()->Shutdown();
 
     // We must close tiered_storage before we destroy namespaces that own db slices.
     if (shard->tiered_storage()) {
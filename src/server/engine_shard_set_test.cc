@@ -4,6 +4,7 @@
 
 #include <absl/flags/reflection.h>
 #include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
 #include <absl/strings/strip.h>
 #include <gmock/gmock.h>
@@ -87,5 +88,30 @@ TEST_F(RoundRobinSharderTest, RoundRobinShard) {
   }
 }
 
+using EngineShardSetTest = BaseFamilyTest;
+
+TEST_F(EngineShardSetTest, ShardLoad) {
+  for (unsigned i = 0; i < 1000; ++i)
+    Run({"set", absl::StrCat("key", i), "value"});
+
+  map<string, string> info;
+  auto res = Run({"debug", "shards"});
+  for (string_view line : absl::StrSplit(res.GetString(), '\n')) {
+    vector<string> parts = absl::StrSplit(line, ": ");
+    if (parts.size() == 2)
+      info[parts[0]] = parts[1];
+  }
+
+  // Every shard runs on the thread of the same index and reports its load.
+  for (unsigned sid = 0; sid < shard_set->size(); ++sid) {
+    EXPECT_EQ(info[absl::StrCat("shard", sid, "_thread")], absl::StrCat(sid));
+    EXPECT_EQ(info[absl::StrCat("shard", sid, "_txq_len")], "0");
+    EXPECT_TRUE(info.contains(absl::StrCat("shard", sid, "_exec_usec")));
+  }
+  uint64_t max_exec_usec = 0;
+  ASSERT_TRUE(absl::SimpleAtoi(info["max_exec_usec"], &max_exec_usec));
+  EXPECT_GT(max_exec_usec, 0u);
+}
+
 }  // namespace
 }  // namespace dfly
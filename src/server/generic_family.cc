@@ -4,6 +4,10 @@
 
 #include "server/generic_family.h"
 
+#include <absl/container/inlined_vector.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_format.h>
+
 #include <boost/operators.hpp>
 #include <optional>
 
@@ -33,6 +37,7 @@ extern "C" {
 #include "server/rdb_save.h"
 #include "server/search/doc_index.h"
 #include "server/set_family.h"
+#include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "util/varz.h"
 
@@ -163,7 +168,9 @@ class RdbRestoreValue : protected RdbLoaderBase {
 std::optional<RdbLoaderBase::OpaqueObj> RdbRestoreValue::Parse(std::string_view payload) {
   InMemSource source(payload);
   src_ = &source;
-  if (io::Result<uint8_t> type_id = FetchType(); type_id && rdbIsObjectTypeDF(type_id.value())) {
+  // Tiered segment references are only valid in snapshots that are loaded on startup.
+  if (io::Result<uint8_t> type_id = FetchType();
+      type_id && rdbIsObjectTypeDF(type_id.value()) && type_id.value() != RDB_TYPE_TIERED_SEGMENT) {
     OpaqueObj obj;
     error_code ec = ReadObj(type_id.value(), &obj);  // load the type from the input stream
     if (ec) {
@@ -199,6 +206,10 @@ std::optional<DbSlice::ItAndUpdater> RdbRestoreValue::Add(std::string_view data,
   res->it->first.SetSticky(args.Sticky());
   if (res) {
     shard->search_indices()->AddDoc(key, cntx, res->it->second);
+
+    // Large values, e.g. restored by a slot migration, are offloaded right away like loaded ones
+    if (auto* ts = shard->tiered_storage(); ts)
+      ts->TryStash(cntx.db_index, key, &res->it->second);
     return std::move(res.value());
   }
   return std::nullopt;
@@ -648,6 +659,80 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
   return cursor;
 }
 
+// A parallel scan cursor concatenates the dash cursors of all the shards as fixed width decimal
+// numbers, so it still looks like an integer to the clients that parse it. Dash cursors fit into
+// 40 bits. Since every call advances all the shards, a shard cursor of 0 marks a finished shard,
+// except for the initial "0" cursor.
+constexpr unsigned kShardCursorDigits = 13;
+
+optional<vector<uint64_t>> ParseParallelCursor(string_view token, unsigned shard_count) {
+  vector<uint64_t> cursors(shard_count, 0);
+  if (token.size() > shard_count * kShardCursorDigits)
+    return nullopt;
+
+  string padded(shard_count * kShardCursorDigits - token.size(), '0');
+  padded.append(token);
+  for (unsigned i = 0; i < shard_count; ++i) {
+    string_view digits = string_view{padded}.substr(i * kShardCursorDigits, kShardCursorDigits);
+    if (!absl::SimpleAtoi(digits, &cursors[i]) || cursors[i] >= (1ULL << 40))
+      return nullopt;
+  }
+  return cursors;
+}
+
+string EncodeParallelCursor(const vector<uint64_t>& cursors) {
+  string res;
+  for (uint64_t cursor : cursors)
+    absl::StrAppendFormat(&res, "%0*u", int(kShardCursorDigits), cursor);
+
+  size_t pos = res.find_first_not_of('0');
+  return pos == string::npos ? "0" : res.substr(pos);
+}
+
+// Scans all the shards at once, each one returning its share of scan_opts.limit keys.
+// Returns the cursor for the next call or nullopt if the token is not a valid parallel cursor.
+optional<string> ScanParallel(string_view token, const ScanOpts& scan_opts, StringVec* keys,
+                              ConnectionContext* cntx) {
+  unsigned shard_count = shard_set->size();
+  optional<vector<uint64_t>> cursors = ParseParallelCursor(token, shard_count);
+  if (!cursors)
+    return nullopt;
+
+  bool first_call = token == "0";
+  ScanOpts shard_opts = scan_opts;
+  shard_opts.limit = (scan_opts.limit + shard_count - 1) / shard_count;
+
+  DbContext db_cntx{cntx->ns, cntx->conn_state.db_index, GetCurrentTimeMs()};
+  vector<StringVec> shard_keys(shard_count);
+  auto cb = [&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    if (first_call || (*cursors)[sid] != 0)
+      OpScan({shard, 0, db_cntx}, shard_opts, &(*cursors)[sid], &shard_keys[sid]);
+  };
+
+  // Run through the shard queues like ScanGeneric, the local shard inline to avoid deadlocking
+  // if called from shard queue script.
+  EngineShard* local = EngineShard::tlocal();
+  util::fb2::BlockingCounter bc{0};
+  for (ShardId sid = 0; sid < shard_count; ++sid) {
+    if (local && local->shard_id() == sid)
+      continue;
+    bc->Add(1);
+    shard_set->Add(sid, [&cb, bc]() mutable {
+      cb(EngineShard::tlocal());
+      bc->Dec();
+    });
+  }
+  if (local)
+    cb(local);
+  bc->Wait();
+
+  for (StringVec& vec : shard_keys)
+    keys->insert(keys->end(), make_move_iterator(vec.begin()), make_move_iterator(vec.end()));
+
+  return EncodeParallelCursor(*cursors);
+}
+
 OpStatus OpExpire(const OpArgs& op_args, string_view key, const DbSlice::ExpireParams& params) {
   auto& db_slice = op_args.GetDbSlice();
   auto find_res = db_slice.FindMutable(op_args.db_cntx, key);
@@ -684,6 +769,7 @@ OpResult<vector<long>> OpFieldExpire(const OpArgs& op_args, string_view key, uin
   }
 
   PrimeValue* pv = &it->second;
+  db_slice.RegisterMemberExpiry(op_args.db_cntx, key, ttl_sec);
   if (pv->ObjType() == OBJ_SET) {
     return SetFamily::SetFieldsExpireTime(op_args, ttl_sec, values, pv);
   } else {
@@ -871,13 +957,29 @@ OpResult<uint32_t> GenericFamily::OpDel(const OpArgs& op_args, const ShardArgs&
 
   uint32_t res = 0;
 
+  // Deletions invalidate iterators so we can not resolve all keys at once, but we can
+  // still prefetch their buckets in batches ahead of the mutable lookups.
+  constexpr size_t kPrefetchBatch = 32;
+  absl::InlinedVector<string_view, kPrefetchBatch> batch;
+
+  auto del_batch = [&] {
+    db_slice.PrefetchKeys(op_args.db_cntx.db_index, batch);
+    for (string_view key : batch) {
+      auto fres = db_slice.FindMutable(op_args.db_cntx, key);
+      if (!IsValid(fres.it))
+        continue;
+      fres.post_updater.Run();
+      res += int(db_slice.Del(op_args.db_cntx, fres.it));
+    }
+    batch.clear();
+  };
+
   for (string_view key : keys) {
-    auto fres = db_slice.FindMutable(op_args.db_cntx, key);
-    if (!IsValid(fres.it))
-      continue;
-    fres.post_updater.Run();
-    res += int(db_slice.Del(op_args.db_cntx, fres.it));
+    batch.push_back(key);
+    if (batch.size() == kPrefetchBatch)
+      del_batch();
   }
+  del_batch();
 
   return res;
 }
@@ -910,7 +1012,7 @@ void GenericFamily::Del(CmdArgList args, ConnectionContext* cntx) {
     if (del_cnt == 0) {
       mc_builder->SendNotFound();
     } else {
-      mc_builder->SendSimpleString("DELETED");
+      mc_builder->SendDeleted();
     }
   } else {
     cntx->SendLong(del_cnt);
@@ -1073,7 +1175,7 @@ void GenericFamily::Keys(CmdArgList args, ConnectionContext* cntx) {
 
   ScanOpts scan_opts;
   if (pattern != "*") {
-    scan_opts.pattern = pattern;
+    scan_opts.matcher.emplace(pattern);
   }
 
   scan_opts.limit = 512;
@@ -1246,7 +1348,7 @@ SortEntryList MakeSortEntryList(bool alpha) {
 }
 
 // Iterate over container with generic function that accepts strings and ints
-template <typename F> bool Iterate(const PrimeValue& pv, F&& func) {
+template <typename F> bool Iterate(const PrimeValue& pv, bool reverse, F&& func) {
   auto cb = [&func](container_utils::ContainerEntry ce) {
     if (ce.value)
       return func(ce.ToString());
@@ -1261,16 +1363,75 @@ template <typename F> bool Iterate(const PrimeValue& pv, F&& func) {
       return container_utils::IterateSet(pv, cb);
     case OBJ_ZSET:
       return container_utils::IterateSortedSet(
-          pv.GetRobjWrapper(),
-          [&cb](container_utils::ContainerEntry ce, double) { return cb(ce); });
+          pv.GetRobjWrapper(), [&cb](container_utils::ContainerEntry ce, double) { return cb(ce); },
+          0, -1, reverse);
     default:
       return false;
   }
 }
 
+struct SortParams {
+  bool alpha = false;
+  bool reversed = false;
+  bool dont_sort = false;  // BY with a pattern that references no external key
+  unsigned get_count = 0;  // number of GET # options, each repeats the element in the reply
+  std::optional<std::pair<size_t, size_t>> bounds;
+
+  // Number of leading entries of the sorted order needed for the reply.
+  size_t FetchLimit() const {
+    if (!bounds)
+      return SIZE_MAX;
+    return bounds->first + std::min(bounds->second, SIZE_MAX - bounds->first);
+  }
+};
+
+// Collects the members of pv into entries. With LIMIT only the first offset + count entries of
+// the sorted order are kept, selected with a bounded heap while iterating, so that paginating
+// over a large container neither materializes nor sorts all its members.
+template <typename Entries>
+bool FetchSortEntries(const PrimeValue& pv, const SortParams& params, Entries* entries) {
+  using value_t = typename Entries::value_type;
+  auto cmp = params.reversed ? &value_t::greater : &value_t::less;
+  const size_t limit = params.FetchLimit();
+  if (limit == 0)
+    return true;
+
+  entries->reserve(std::min<size_t>(pv.Size(), limit));
+  bool parsed = true;
+  auto add = [&](auto&& val) {
+    value_t entry;
+    if (!entry.Parse(std::forward<decltype(val)>(val))) {
+      parsed = false;
+      return false;
+    }
+
+    if (entries->size() < limit) {
+      entries->push_back(std::move(entry));
+      if (entries->size() < limit)
+        return true;
+      // Unsorted replies take the first members in container order.
+      if (params.dont_sort)
+        return false;
+      std::make_heap(entries->begin(), entries->end(), cmp);
+      return true;
+    }
+
+    // The heap front is the last of the entries kept so far.
+    if (cmp(entry, entries->front())) {
+      std::pop_heap(entries->begin(), entries->end(), cmp);
+      entries->back() = std::move(entry);
+      std::push_heap(entries->begin(), entries->end(), cmp);
+    }
+    return true;
+  };
+
+  Iterate(pv, params.dont_sort && params.reversed, add);
+  return parsed;
+}
+
 // Create a SortEntryList from given key
 OpResultTyped<SortEntryList> OpFetchSortEntries(const OpArgs& op_args, std::string_view key,
-                                                bool alpha) {
+                                                const SortParams& params) {
   using namespace container_utils;
 
   auto it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key).it;
@@ -1281,15 +1442,10 @@ OpResultTyped<SortEntryList> OpFetchSortEntries(const OpArgs& op_args, std::stri
     return OpStatus::WRONG_TYPE;
   }
 
-  auto result = MakeSortEntryList(alpha);
+  // Without sorting the members are not compared, so they are not parsed as numbers either.
+  auto result = MakeSortEntryList(params.alpha || params.dont_sort);
   bool success = std::visit(
-      [&pv = it->second](auto& entries) {
-        entries.reserve(pv.Size());
-        return Iterate(pv, [&entries](auto&& val) {
-          return entries.emplace_back().Parse(std::forward<decltype(val)>(val));
-        });
-      },
-      result);
+      [&](auto& entries) { return FetchSortEntries(it->second, params, &entries); }, result);
   auto res = OpResultTyped{std::move(result)};
   res.setType(it->second.ObjType());
   return success ? res : OpStatus::INVALID_NUMERIC_RESULT;
@@ -1297,18 +1453,16 @@ OpResultTyped<SortEntryList> OpFetchSortEntries(const OpArgs& op_args, std::stri
 
 void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
   std::string_view key = ArgS(args, 0);
-  bool alpha = false;
-  bool reversed = false;
-  std::optional<std::pair<size_t, size_t>> bounds;
+  SortParams params;
 
   for (size_t i = 1; i < args.size(); i++) {
     string arg = absl::AsciiStrToUpper(ArgS(args, i));
     if (arg == "ALPHA") {
-      alpha = true;
+      params.alpha = true;
     } else if (arg == "DESC") {
-      reversed = true;
+      params.reversed = true;
     } else if (arg == "ASC") {
-      reversed = false;
+      params.reversed = false;
     } else if (arg == "LIMIT") {
       int offset, limit;
       if (i + 2 >= args.size()) {
@@ -1318,8 +1472,17 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
           !absl::SimpleAtoi(ArgS(args, i + 2), &limit)) {
         return cntx->SendError(kInvalidIntErr);
       }
-      bounds = {offset, limit};
+      params.bounds = {offset, limit};
       i += 2;
+    } else if (arg == "BY" && i + 1 < args.size()) {
+      // A pattern without '*' maps every member to the same key, which means "do not sort".
+      if (absl::StrContains(ArgS(args, ++i), '*'))
+        return cntx->SendError("BY option with external keys is not supported");
+      params.dont_sort = true;
+    } else if (arg == "GET" && i + 1 < args.size()) {
+      if (ArgS(args, ++i) != "#")
+        return cntx->SendError("GET option with external keys is not supported");
+      params.get_count++;
     } else {
       LOG_EVERY_T(ERROR, 1) << "Unsupported option " << arg;
       return cntx->SendError(kSyntaxErr, kSyntaxErrType);
@@ -1328,7 +1491,7 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
 
   OpResultTyped<SortEntryList> fetch_result =
       cntx->transaction->ScheduleSingleHopT([&](Transaction* t, EngineShard* shard) {
-        return OpFetchSortEntries(t->GetOpArgs(shard), key, alpha);
+        return OpFetchSortEntries(t->GetOpArgs(shard), key, params);
       });
 
   if (fetch_result == OpStatus::WRONG_TYPE)
@@ -1342,30 +1505,26 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
     return rb->SendEmptyArray();
 
   auto result_type = fetch_result.type();
-  auto sort_call = [cntx, bounds, reversed, result_type](auto& entries) {
+  auto sort_call = [cntx, &params, result_type](auto& entries) {
     using value_t = typename std::decay_t<decltype(entries)>::value_type;
-    auto cmp = reversed ? &value_t::greater : &value_t::less;
-    if (bounds) {
-      auto sort_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
-      std::partial_sort(entries.begin(), sort_it, entries.end(), cmp);
-    } else {
+    auto cmp = params.reversed ? &value_t::greater : &value_t::less;
+    // entries hold at most offset + count members of the sorted order, see OpFetchSortEntries.
+    if (!params.dont_sort)
       std::sort(entries.begin(), entries.end(), cmp);
-    }
 
     auto start_it = entries.begin();
-    auto end_it = entries.end();
-    if (bounds) {
-      start_it += std::min(bounds->first, entries.size());
-      end_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
-    }
+    if (params.bounds)
+      start_it += std::min(params.bounds->first, entries.size());
 
-    bool is_set = (result_type == OBJ_SET || result_type == OBJ_ZSET);
+    unsigned repeat = std::max(params.get_count, 1u);
+    bool is_set = (result_type == OBJ_SET || result_type == OBJ_ZSET) && repeat == 1;
     auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-    rb->StartCollection(std::distance(start_it, end_it),
+    rb->StartCollection(std::distance(start_it, entries.end()) * repeat,
                         is_set ? RedisReplyBuilder::SET : RedisReplyBuilder::ARRAY);
 
-    for (auto it = start_it; it != end_it; ++it) {
-      rb->SendBulkString(it->key);
+    for (auto it = start_it; it != entries.end(); ++it) {
+      for (unsigned j = 0; j < repeat; ++j)
+        rb->SendBulkString(it->key);
     }
   };
 
@@ -1682,16 +1841,25 @@ void GenericFamily::Echo(CmdArgList args, ConnectionContext* cntx) {
   return rb->SendBulkString(key);
 }
 
-// SCAN cursor [MATCH <glob>] [TYPE <type>] [COUNT <count>] [BUCKET <bucket_id>]
+// SCAN cursor [MATCH <glob>] [TYPE <type>] [COUNT <count>] [BUCKET <bucket_id>] [PARALLEL]
+// With PARALLEL all the shards are scanned in a single hop and the cursor carries the position
+// of every shard, see ParseParallelCursor.
 void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
   string_view token = ArgS(args, 0);
-  uint64_t cursor = 0;
+  CmdArgList opt_args = args.subspan(1);
 
-  if (!absl::SimpleAtoi(token, &cursor)) {
+  // Options come in pairs, so a trailing single token can only be the PARALLEL flag.
+  bool parallel = opt_args.size() % 2 == 1 &&
+                  absl::EqualsIgnoreCase(ArgS(opt_args, opt_args.size() - 1), "PARALLEL");
+  if (parallel)
+    opt_args.remove_suffix(1);
+
+  uint64_t cursor = 0;
+  if (!parallel && !absl::SimpleAtoi(token, &cursor)) {
     return cntx->SendError("invalid cursor");
   }
 
-  OpResult<ScanOpts> ops = ScanOpts::TryFrom(args.subspan(1));
+  OpResult<ScanOpts> ops = ScanOpts::TryFrom(opt_args);
   if (!ops) {
     DVLOG(1) << "Scan invalid args - return " << ops << " to the user";
     return cntx->SendError(ops.status());
@@ -1700,11 +1868,19 @@ void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
   ScanOpts scan_op = ops.value();
 
   StringVec keys;
-  cursor = ScanGeneric(cursor, scan_op, &keys, cntx);
+  string next_cursor;
+  if (parallel) {
+    optional<string> res = ScanParallel(token, scan_op, &keys, cntx);
+    if (!res)
+      return cntx->SendError("invalid cursor");
+    next_cursor = std::move(*res);
+  } else {
+    next_cursor = absl::StrCat(ScanGeneric(cursor, scan_op, &keys, cntx));
+  }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(2);
-  rb->SendBulkString(absl::StrCat(cursor));
+  rb->SendBulkString(next_cursor);
   rb->StartArray(keys.size());
   for (const auto& k : keys) {
     rb->SendBulkString(k);
@@ -1714,11 +1890,17 @@ void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
 OpResult<uint32_t> GenericFamily::OpExists(const OpArgs& op_args, const ShardArgs& keys) {
   DVLOG(1) << "Exists: " << keys.Front();
   auto& db_slice = op_args.GetDbSlice();
-  uint32_t res = 0;
+  absl::InlinedVector<string_view, 32> key_vec;
+  key_vec.reserve(keys.Size());
+  for (string_view key : keys)
+    key_vec.push_back(key);
 
-  for (string_view key : keys) {
-    auto find_res = db_slice.FindReadOnly(op_args.db_cntx, key);
-    res += IsValid(find_res.it);
+  absl::InlinedVector<OpResult<DbSlice::ConstIterator>, 32> find_res(key_vec.size());
+  db_slice.FindManyReadOnly(op_args.db_cntx, key_vec, std::nullopt, absl::MakeSpan(find_res));
+
+  uint32_t res = 0;
+  for (const auto& it_res : find_res) {
+    res += it_res.ok();
   }
   return res;
 }
@@ -1813,7 +1995,7 @@ void GenericFamily::Register(CommandRegistry* registry) {
   constexpr auto kSelectOpts = CO::LOADING | CO::FAST | CO::NOSCRIPT;
   registry->StartFamily();
   *registry
-      << CI{"DEL", CO::WRITE, -2, 1, -1, acl::kDel}.HFUNC(Del)
+      << CI{"DEL", CO::WRITE | CO::IDEMPOTENT, -2, 1, -1, acl::kDel}.HFUNC(Del)
       /* Redis compatibility:
        * We don't allow PING during loading since in Redis PING is used as
        * failure detection, and a loading server is considered to be
@@ -1844,7 +2026,7 @@ void GenericFamily::Register(CommandRegistry* registry) {
       << CI{"TIME", CO::LOADING | CO::FAST, 1, 0, 0, acl::kTime}.HFUNC(Time)
       << CI{"TYPE", CO::READONLY | CO::FAST | CO::LOADING, 2, 1, 1, acl::kType}.HFUNC(Type)
       << CI{"DUMP", CO::READONLY, 2, 1, 1, acl::kDump}.HFUNC(Dump)
-      << CI{"UNLINK", CO::WRITE, -2, 1, -1, acl::kUnlink}.HFUNC(Del)
+      << CI{"UNLINK", CO::WRITE | CO::IDEMPOTENT, -2, 1, -1, acl::kUnlink}.HFUNC(Del)
       << CI{"STICK", CO::WRITE, -2, 1, -1, acl::kStick}.HFUNC(Stick)
       << CI{"SORT", CO::READONLY, -2, 1, 1, acl::kSort}.HFUNC(Sort)
       << CI{"MOVE", CO::WRITE | CO::GLOBAL_TRANS | CO::NO_AUTOJOURNAL, 3, 1, 1, acl::kMove}.HFUNC(
@@ -25,6 +25,8 @@ using namespace boost;
 using absl::StrCat;
 
 ABSL_DECLARE_FLAG(bool, list_rdb_encode_v2);
+ABSL_DECLARE_FLAG(bool, inline_expire);
+ABSL_DECLARE_FLAG(uint32_t, expire_wheel_tick_ms);
 
 namespace dfly {
 
@@ -77,6 +79,74 @@ TEST_F(GenericFamilyTest, Expire) {
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
 }
 
+TEST_F(GenericFamilyTest, InlineExpire) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_inline_expire, true);
+  ResetService();
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"set", StrCat("key", i), "val", "px", StrCat(1000 + i)});
+  }
+  Run({"set", "persistent", "val"});
+  EXPECT_EQ(GetMetrics().db_stats[0].expire_count, 1000u);
+
+  EXPECT_THAT(Run({"pttl", "key10"}), IntArg(1010));
+  EXPECT_THAT(Run({"persist", "key10"}), IntArg(1));
+  EXPECT_THAT(Run({"pttl", "key10"}), IntArg(-1));
+  EXPECT_THAT(Run({"rename", "key20", "renamed"}), "OK");
+  EXPECT_THAT(Run({"pttl", "renamed"}), IntArg(1020));
+  EXPECT_EQ(GetMetrics().db_stats[0].expire_count, 999u);
+
+  AdvanceTime(1500);
+  EXPECT_THAT(Run({"get", "key100"}), ArgType(RespExpr::NIL));
+  EXPECT_EQ(Run({"get", "key600"}), "val");
+  EXPECT_EQ(Run({"get", "key10"}), "val");
+
+  AdvanceTime(1000);
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"exists", StrCat("key", i)});
+  }
+  EXPECT_THAT(Run({"exists", "renamed"}), IntArg(0));
+  EXPECT_THAT(Run({"dbsize"}), IntArg(2));
+  EXPECT_EQ(GetMetrics().db_stats[0].expire_count, 0u);
+}
+
+TEST_F(GenericFamilyTest, ExpireWheel) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_expire_wheel_tick_ms, 10);
+  ResetService();
+
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"set", StrCat("short", i), "val", "px", "1000"});
+    Run({"set", StrCat("long", i), "val", "px", "5000"});
+  }
+  Run({"set", "persisted", "val", "px", "1000"});
+  Run({"persist", "persisted"});
+  Run({"set", "extended", "val", "px", "1000"});
+  Run({"pexpire", "extended", "3000"});
+
+  // The heartbeat may delete some of the keys as well, so only the key count is checked.
+  auto delete_expired = [&] {
+    shard_set->RunBriefInParallel([&](EngineShard* shard) {
+      DbContext cntx{&namespaces.GetDefaultNamespace(), 0, GetCurrentTimeMs()};
+      cntx.GetDbSlice(shard->shard_id()).DeleteExpiredStep(cntx, 100);
+    });
+  };
+
+  AdvanceTime(1000);
+  delete_expired();
+  EXPECT_THAT(Run({"dbsize"}), IntArg(202));
+
+  AdvanceTime(2000);
+  delete_expired();
+  EXPECT_THAT(Run({"dbsize"}), IntArg(201));
+
+  AdvanceTime(2000);
+  delete_expired();
+  EXPECT_THAT(Run({"dbsize"}), IntArg(1));
+  EXPECT_EQ(GetMetrics().db_stats[0].expire_count, 0u);
+}
+
 TEST_F(GenericFamilyTest, ExpireOptions) {
   // NX and XX are mutually exclusive
   Run({"set", "key", "val"});
@@ -176,6 +246,32 @@ TEST_F(GenericFamilyTest, Del) {
   Run({"del", "k1"});
 }
 
+TEST_F(GenericFamilyTest, LazyFree) {
+  Run({"debug", "populate", "10", "key", "10", "type", "set", "elements", "1000"});
+  Run({"debug", "populate", "10", "small", "10", "type", "set", "elements", "10"});
+
+  EXPECT_EQ(10, CheckedInt({"del", "key:0", "key:1", "key:2", "key:3", "key:4", "key:5", "key:6",
+                            "key:7", "key:8", "key:9"}));
+  EXPECT_EQ(1, CheckedInt({"unlink", "small:0"}));
+  EXPECT_EQ(Run({"set", "small:1", "bar"}), "OK");
+  EXPECT_EQ(8, CheckedInt({"dbsize"}));
+
+  ExpectConditionWithinTimeout([&] {
+    Metrics metrics = GetMetrics();
+    return metrics.lazy_free_stats.pending_objects == 0 &&
+           metrics.lazy_free_stats.freed_objects_total == 10;
+  });
+  EXPECT_EQ(GetMetrics().lazy_free_stats.pending_bytes, 0u);
+
+  // Flushed tables are handed over as a whole, SYNC waits for them to be released.
+  EXPECT_EQ(Run({"flushall", "sync"}), "OK");
+  Metrics metrics = GetMetrics();
+  EXPECT_EQ(metrics.lazy_free_stats.pending_objects, 0u);
+  EXPECT_EQ(metrics.lazy_free_stats.freed_objects_total, 18u);
+
+  EXPECT_THAT(Run({"flushdb", "later"}), ErrArg("syntax error"));
+}
+
 TEST_F(GenericFamilyTest, TTL) {
   EXPECT_EQ(-2, CheckedInt({"ttl", "foo"}));
   EXPECT_EQ(-2, CheckedInt({"pttl", "foo"}));
@@ -190,6 +286,25 @@ TEST_F(GenericFamilyTest, Exists) {
   EXPECT_THAT(resp, IntArg(3));
 }
 
+TEST_F(GenericFamilyTest, ExistsDelManyKeys) {
+  // More keys than a single lookup batch to cover batch boundaries.
+  vector<string> set_args = {"mset"};
+  vector<string> exists_args = {"exists"};
+  for (size_t i = 0; i < 100; ++i) {
+    set_args.push_back(StrCat("key", i));
+    set_args.push_back("val");
+    exists_args.push_back(StrCat("key", i));
+    exists_args.push_back(StrCat("nokey", i));
+  }
+  Run(absl::MakeSpan(set_args));
+
+  EXPECT_THAT(Run(absl::MakeSpan(exists_args)), IntArg(100));
+
+  exists_args[0] = "del";
+  EXPECT_THAT(Run(absl::MakeSpan(exists_args)), IntArg(100));
+  EXPECT_EQ(0, CheckedInt({"dbsize"}));
+}
+
 TEST_F(GenericFamilyTest, Touch) {
   RespExpr resp;
 
@@ -414,6 +529,32 @@ TEST_F(GenericFamilyTest, Scan) {
   EXPECT_EQ(resp, "");
 }
 
+TEST_F(GenericFamilyTest, ScanParallel) {
+  Run({"debug", "populate", "1000", "key", "10"});
+  Run({"debug", "populate", "100", "other", "10"});
+
+  std::set<string> keys;
+  string cursor = "0";
+  unsigned calls = 0;
+  do {
+    auto resp = Run({"scan", cursor, "match", "key:*", "count", "100", "parallel"});
+    ASSERT_THAT(resp, ArrLen(2));
+    cursor = resp.GetVec()[0].GetString();
+    for (const auto& key : StrArray(resp.GetVec()[1])) {
+      EXPECT_THAT(key, StartsWith("key:"));
+      keys.insert(key);
+    }
+    ++calls;
+  } while (cursor != "0");
+
+  EXPECT_EQ(keys.size(), 1000u);
+  EXPECT_LT(calls, 100u);
+
+  EXPECT_THAT(Run({"scan", "abc", "parallel"}), ErrArg("invalid cursor"));
+  EXPECT_THAT(Run({"scan", string(1000, '9'), "parallel"}), ErrArg("invalid cursor"));
+  EXPECT_THAT(Run({"scan", "0", "count", "parallel"}), ErrArg("syntax error"));
+}
+
 TEST_F(GenericFamilyTest, Sort) {
   // Test list sort with params
   Run({"del", "list-1"});
@@ -502,6 +643,39 @@ TEST_F(GenericFamilyTest, SortBug3636) {
   ASSERT_THAT(resp, ArrLen(17));
 }
 
+TEST_F(GenericFamilyTest, SortLimitTopK) {
+  for (unsigned i = 0; i < 200; ++i)
+    Run({"rpush", "list", absl::StrCat((i * 37) % 200)});
+
+  EXPECT_THAT(Run({"sort", "list", "LIMIT", "0", "3"}).GetVec(), ElementsAre("0", "1", "2"));
+  EXPECT_THAT(Run({"sort", "list", "LIMIT", "100", "2"}).GetVec(), ElementsAre("100", "101"));
+  EXPECT_THAT(Run({"sort", "list", "DESC", "LIMIT", "1", "2"}).GetVec(),
+              ElementsAre("198", "197"));
+  EXPECT_THAT(Run({"sort", "list", "ALPHA", "LIMIT", "0", "3"}).GetVec(),
+              ElementsAre("0", "1", "10"));
+  EXPECT_THAT(Run({"sort", "list", "LIMIT", "0", "0"}), ArrLen(0));
+  EXPECT_THAT(Run({"sort", "list", "LIMIT", "198", "10"}).GetVec(), ElementsAre("198", "199"));
+
+  // Invalid members are reported even if they would not make it into the reply.
+  Run({"rpush", "list", "notanumber"});
+  EXPECT_THAT(Run({"sort", "list", "LIMIT", "0", "1"}),
+              ErrArg("One or more scores can't be converted into double"));
+}
+
+TEST_F(GenericFamilyTest, SortNoSortAndGet) {
+  Run({"rpush", "list", "c", "a", "b"});
+  EXPECT_THAT(Run({"sort", "list", "BY", "nosort"}).GetVec(), ElementsAre("c", "a", "b"));
+  EXPECT_THAT(Run({"sort", "list", "BY", "nosort", "LIMIT", "1", "1"}), "a");
+  EXPECT_THAT(Run({"sort", "list", "ALPHA", "GET", "#", "GET", "#"}).GetVec(),
+              ElementsAre("a", "a", "b", "b", "c", "c"));
+
+  Run({"zadd", "zset", "1", "z", "2", "y", "3", "x"});
+  EXPECT_THAT(Run({"sort", "zset", "BY", "nosort", "DESC"}).GetVec(), ElementsAre("x", "y", "z"));
+
+  EXPECT_THAT(Run({"sort", "list", "BY", "weight_*"}), ErrArg("BY option with external keys"));
+  EXPECT_THAT(Run({"sort", "list", "GET", "obj_*"}), ErrArg("GET option with external keys"));
+}
+
 TEST_F(GenericFamilyTest, TimeNoKeys) {
   auto resp = Run({"time"});
   EXPECT_THAT(resp, ArrLen(2));
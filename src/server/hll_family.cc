@@ -169,35 +169,56 @@ OpResult<int64_t> CountHllsSingle(const OpArgs& op_args, string_view key) {
   }
 }
 
-OpResult<vector<string>> ReadValues(const OpArgs& op_args, const ShardArgs& keys) {
+// Merges the hlls stored at `keys` into a single dense hll, so that only one buffer per shard
+// is handed to the coordinator. Returns an empty string if none of the keys exist.
+OpResult<string> MergeValues(const OpArgs& op_args, const ShardArgs& keys) {
   try {
-    vector<string> values;
+    // Holds decoded and sparse->dense converted values, reserved so that views into it stay valid.
+    vector<string> scratch;
+    scratch.reserve(keys.Size());
+    vector<HllBufferPtr> ptrs;
+    ptrs.reserve(keys.Size());
+
     for (string_view key : keys) {
       auto it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
       if (it.ok()) {
-        string hll;
-        it.value()->second.GetString(&hll);
-        ConvertToDenseIfNeeded(&hll);
-        if (isValidHLL(StringToHllPtr(hll)) != HLL_VALID_DENSE) {
+        string& tmp = scratch.emplace_back();
+        string_view hll_view = it.value()->second.GetSlice(&tmp);
+        if (isValidHLL(StringToHllPtr(hll_view)) == HLL_VALID_SPARSE) {
+          string hll{hll_view};
+          ConvertToDenseIfNeeded(&hll);
+          tmp = std::move(hll);
+          hll_view = tmp;
+        }
+        if (isValidHLL(StringToHllPtr(hll_view)) != HLL_VALID_DENSE) {
           return OpStatus::INVALID_VALUE;
-        } else {
-          values.push_back(std::move(hll));
         }
+        ptrs.push_back(StringToHllPtr(hll_view));
       } else if (it.status() == OpStatus::WRONG_TYPE) {
         return OpStatus::WRONG_TYPE;
       }
     }
-    return values;
+
+    if (ptrs.empty())
+      return string{};
+
+    string merged;
+    merged.resize(getDenseHllSize());
+    createDenseHll(StringToHllPtr(merged));
+    if (pfmerge(ptrs.data(), ptrs.size(), StringToHllPtr(merged)) != 0) {
+      return OpStatus::INVALID_VALUE;
+    }
+    return merged;
   } catch (const std::bad_alloc&) {
     return OpStatus::OUT_OF_MEMORY;
   }
 }
 
-vector<HllBufferPtr> ConvertShardVector(const vector<vector<string>>& hlls) {
+vector<HllBufferPtr> ConvertShardVector(const vector<string>& hlls) {
   vector<HllBufferPtr> ptrs;
   ptrs.reserve(hlls.size());
-  for (auto& shard_hlls : hlls) {
-    for (auto& hll : shard_hlls) {
+  for (const string& hll : hlls) {
+    if (!hll.empty()) {
       ptrs.push_back(StringToHllPtr(hll));
     }
   }
@@ -205,13 +226,13 @@ vector<HllBufferPtr> ConvertShardVector(const vector<vector<string>>& hlls) {
 }
 
 OpResult<int64_t> PFCountMulti(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
+  vector<string> hlls;
   hlls.resize(shard_set->size());
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
     ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
+    auto result = MergeValues(t->GetOpArgs(shard), shard_args);
     if (result.ok()) {
       hlls[sid] = std::move(result.value());
     }
@@ -246,14 +267,14 @@ void PFCount(CmdArgList args, ConnectionContext* cntx) {
 }
 
 OpResult<int> PFMergeInternal(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
+  vector<string> hlls;
   hlls.resize(shard_set->size());
 
   atomic_bool success = true;
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
     ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
+    auto result = MergeValues(t->GetOpArgs(shard), shard_args);
     if (result.ok()) {
       hlls[sid] = std::move(result.value());
     } else {
@@ -193,4 +193,32 @@ TEST_F(HllFamilyTest, MergeInvalid) {
   EXPECT_EQ(CheckedInt({"pfcount", "key1"}), 3);
 }
 
+TEST_F(HllFamilyTest, CountMergeManyKeys) {
+  // Mixes sparse and dense hlls spread over all shards, so every shard merges several of them.
+  vector<string> keys;
+  for (int i = 0; i < 32; ++i) {
+    string key = "key" + to_string(i);
+    vector<string> cmd = {"pfadd", key};
+    int num_values = i % 2 ? 1000 : 10;
+    for (int j = 0; j < num_values; ++j) {
+      cmd.push_back(GenerateUniqueValue(i * 1000 + j));
+    }
+    EXPECT_THAT(Run(absl::MakeSpan(cmd)), IntArg(1));
+    keys.push_back(key);
+  }
+
+  vector<string> count_cmd = {"pfcount"};
+  count_cmd.insert(count_cmd.end(), keys.begin(), keys.end());
+  count_cmd.push_back("missing");
+  auto resp = Run(absl::MakeSpan(count_cmd));
+  ASSERT_EQ(resp.type, RespExpr::INT64);
+  int64_t count = *resp.GetInt();
+  EXPECT_NEAR(count, 16 * 1000 + 16 * 10, 300);
+
+  vector<string> merge_cmd = {"pfmerge", "dest"};
+  merge_cmd.insert(merge_cmd.end(), keys.begin(), keys.end());
+  EXPECT_EQ(Run(absl::MakeSpan(merge_cmd)), "OK");
+  EXPECT_EQ(CheckedInt({"pfcount", "dest"}), count);
+}
+
 }  // namespace dfly
@@ -0,0 +1,110 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/hot_key_replicas.h"
+
+#include <absl/container/flat_hash_map.h>
+
+#include "facade/reply_builder.h"
+#include "server/engine_shard_set.h"
+#include "server/server_state.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+using ReplicaMap = absl::flat_hash_map<string, shared_ptr<HotKeyReplica>>;
+
+// Replicas of the calling thread indexed by database.
+thread_local vector<ReplicaMap> tl_replicas;
+
+// Sending a reply may preempt, the replicas dropped meanwhile are kept alive until no fiber of
+// the thread is sending.
+thread_local unsigned tl_sending = 0;
+thread_local vector<shared_ptr<HotKeyReplica>> tl_released;
+
+void Erase(ReplicaMap* replicas, ReplicaMap::iterator it) {
+  if (tl_sending > 0)
+    tl_released.push_back(std::move(it->second));
+  replicas->erase(it);
+}
+
+}  // namespace
+
+HotKeyReplica::HotKeyReplica(DbIndex db, string key, string value, unsigned num_threads)
+    : db(db), key(std::move(key)), value(std::move(value)),
+      num_threads(num_threads),
+      hits(new Counter[num_threads]) {
+}
+
+uint64_t HotKeyReplica::Hits() const {
+  uint64_t res = 0;
+  for (unsigned i = 0; i < num_threads; ++i)
+    res += hits[i].value.load(memory_order_relaxed);
+  return res;
+}
+
+bool HotKeyReplicas::TrySend(DbIndex db, string_view key, facade::RedisReplyBuilder* builder) {
+  if (db >= tl_replicas.size() || tl_replicas[db].empty())
+    return false;
+
+  auto it = tl_replicas[db].find(key);
+  if (it == tl_replicas[db].end())
+    return false;
+
+  HotKeyReplica* replica = it->second.get();
+
+  // Pairs with the release store of Invalidate(), the copy is served only if no write to the key
+  // completed before this lookup.
+  if (!replica->valid.load(memory_order_acquire)) {
+    Erase(&tl_replicas[db], it);
+    ++ServerState::tlocal()->stats.hot_key_replica_misses;
+    return false;
+  }
+
+  // Only this thread writes its counter, so a relaxed load and store avoid the locked add.
+  auto& counter = replica->hits[util::ProactorBase::me()->GetPoolIndex()].value;
+  counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  ++ServerState::tlocal()->stats.hot_key_replica_hits;
+
+  ++tl_sending;
+  builder->SendBulkString(replica->value);
+  if (--tl_sending == 0)
+    tl_released.clear();
+  return true;
+}
+
+void HotKeyReplicas::Publish(shared_ptr<HotKeyReplica> replica) {
+  shard_set->pool()->DispatchBrief([replica = std::move(replica)](unsigned, util::ProactorBase*) {
+    // The key could change before the task ran.
+    if (!replica->valid.load(memory_order_acquire))
+      return;
+    if (tl_replicas.size() <= replica->db)
+      tl_replicas.resize(replica->db + 1);
+    auto [it, inserted] = tl_replicas[replica->db].try_emplace(replica->key, replica);
+    if (!inserted) {
+      if (tl_sending > 0)
+        tl_released.push_back(std::move(it->second));
+      it->second = replica;
+    }
+  });
+}
+
+void HotKeyReplicas::Invalidate(shared_ptr<HotKeyReplica> replica) {
+  replica->valid.store(false, memory_order_release);
+
+  shard_set->pool()->DispatchBrief([replica = std::move(replica)](unsigned, util::ProactorBase*) {
+    if (replica->db >= tl_replicas.size())
+      return;
+
+    // Do not remove a newer replica of the same key.
+    ReplicaMap& replicas = tl_replicas[replica->db];
+    if (auto it = replicas.find(replica->key); it != replicas.end() && it->second == replica)
+      Erase(&replicas, it);
+  });
+}
+
+}  // namespace dfly
@@ -0,0 +1,61 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "server/tx_base.h"
+
+namespace facade {
+class RedisReplyBuilder;
+}  // namespace facade
+
+namespace dfly {
+
+// Immutable copy of a hot string key that every proactor thread serves GET from, so that a single
+// key does not saturate the thread of its shard. The owning shard clears `valid` synchronously
+// whenever the key changes, before the write is acknowledged, so a thread never serves a copy
+// older than a completed write. The copies are then dropped from the threads asynchronously.
+struct HotKeyReplica {
+  HotKeyReplica(DbIndex db, std::string key, std::string value, unsigned num_threads);
+
+  // Sum of the GETs served by all the threads.
+  uint64_t Hits() const;
+
+  const DbIndex db;
+  const std::string key;
+  const std::string value;
+  const unsigned num_threads;
+
+  std::atomic_bool valid{true};
+
+  // GETs served by each thread, padded so that the threads do not share cache lines.
+  struct alignas(64) Counter {
+    std::atomic_uint64_t value{0};
+  };
+  std::unique_ptr<Counter[]> hits;
+
+  // Hits() at the last check of the owning shard, accessed only by the shard.
+  uint64_t checked_hits = 0;
+};
+
+// Thread local tables of the replicas of the hot keys of all the shards.
+class HotKeyReplicas {
+ public:
+  // Replies with the value of the key if the calling thread holds a valid copy of it. Returns
+  // false otherwise, invalidated copies are dropped on lookup.
+  static bool TrySend(DbIndex db, std::string_view key, facade::RedisReplyBuilder* builder);
+
+  // Called by the owning shard. Adds the replica to the tables of all the threads.
+  static void Publish(std::shared_ptr<HotKeyReplica> replica);
+
+  // Called by the owning shard. Invalidates the replica and removes it from all the threads.
+  static void Invalidate(std::shared_ptr<HotKeyReplica> replica);
+};
+
+}  // namespace dfly
@@ -4,6 +4,8 @@
 
 #include "server/hset_family.h"
 
+#include <absl/random/random.h>
+
 #include "server/family_utils.h"
 
 extern "C" {
@@ -13,7 +15,10 @@ extern "C" {
 #include "redis/zmalloc.h"
 }
 
+#include "base/flags.h"
 #include "base/logging.h"
+#include "core/listpack_find.h"
+#include "core/packed_map.h"
 #include "core/string_map.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -22,9 +27,15 @@ extern "C" {
 #include "server/container_utils.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/reply_cache.h"
 #include "server/search/doc_index.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, hash_packed_map_max_entries, 256,
+          "Maximal number of fields in a hash that uses the compact PackedMap encoding. "
+          "Hashes that outgrow listpack switch to PackedMap while below this limit. "
+          "0 disables PackedMap encoding.");
+
 using namespace std;
 
 namespace dfly {
@@ -49,6 +60,21 @@ bool IsGoodForListpack(CmdArgList args, const uint8_t* lp) {
   return lpBytes(const_cast<uint8_t*>(lp)) + sum < server.max_listpack_map_bytes;
 }
 
+// Whether adding args pairs to pm keeps it within PackedMap limits.
+// Existing fields are counted as new ones, so the estimate is conservative.
+bool IsGoodForPackedMap(CmdArgList args, const uint8_t* pm) {
+  size_t data_bytes = PackedMap::DataBytes(pm);
+  for (size_t i = 0; i < args.size(); i += 2) {
+    string_view field = ToSV(args[i]);
+    string_view value = ToSV(args[i + 1]);
+    if (!PackedMap::IsGoodEntry(field, value))
+      return false;
+    data_bytes += PackedMap::EntryBytes(field, value);
+  }
+
+  return HSetFamily::IsGoodForPackedMap(PackedMap::Size(pm) + args.size() / 2, data_bytes);
+}
+
 using container_utils::GetStringMap;
 using container_utils::LpFind;
 using container_utils::LpGetView;
@@ -56,7 +82,7 @@ using container_utils::LpGetView;
 pair<uint8_t*, bool> LpDelete(uint8_t* lp, string_view field) {
   uint8_t* fptr = lpFirst(lp);
   DCHECK(fptr);
-  fptr = lpFind(lp, fptr, (unsigned char*)field.data(), field.size(), 1);
+  fptr = LpFindStr(lp, fptr, field, 1);
   if (fptr == NULL) {
     return make_pair(lp, false);
   }
@@ -84,7 +110,7 @@ pair<uint8_t*, bool> LpInsert(uint8_t* lp, string_view field, string_view val, b
   bool updated = false;
 
   if (fptr) {
-    fptr = lpFind(lp, fptr, fsrc, field.size(), 1);
+    fptr = LpFindStr(lp, fptr, field, 1);
     if (fptr) {
       if (skip_exists) {
         return make_pair(lp, false);
@@ -124,6 +150,9 @@ size_t HMapLength(const DbContext& db_cntx, const CompactObj& co) {
     return sm->UpperBoundSize();
   }
 
+  if (co.Encoding() == kEncodingPackedMap)
+    return PackedMap::Size((uint8_t*)ptr);
+
   DCHECK_EQ(kEncodingListPack, co.Encoding());
   return lpLength((uint8_t*)ptr) / 2;
 }
@@ -168,6 +197,9 @@ OpStatus IncrementValue(optional<string_view> prev_val, IncrByParam* param) {
   return OpStatus::OK;
 };
 
+// Size of the buffer used to format HINCRBY and HINCRBYFLOAT results.
+constexpr size_t kMaxIncrValueLen = 128;
+
 OpStatus OpIncrBy(const OpArgs& op_args, string_view key, string_view field, IncrByParam* param) {
   auto& db_slice = op_args.GetDbSlice();
   auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
@@ -198,8 +230,22 @@ OpStatus OpIncrBy(const OpArgs& op_args, string_view key, string_view field, Inc
 
       if (lpb >= server.max_listpack_map_bytes) {
         stats->listpack_blob_cnt--;
-        StringMap* sm = HSetFamily::ConvertToStrMap(lp);
-        pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+        if (uint8_t* pm = HSetFamily::ConvertToPackedMap(lp); pm) {
+          pv.InitRobj(OBJ_HASH, kEncodingPackedMap, pm);
+        } else {
+          StringMap* sm = HSetFamily::ConvertToStrMap(lp);
+          pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+        }
+      }
+    }
+
+    if (pv.Encoding() == kEncodingPackedMap) {
+      // The new value is bounded by the size of the formatting buffer below.
+      uint8_t* pm = (uint8_t*)pv.RObjPtr();
+      size_t data_bytes = PackedMap::DataBytes(pm) + field.size() + 2 + kMaxIncrValueLen;
+      if (field.size() > PackedMap::kMaxStrLen ||
+          !HSetFamily::IsGoodForPackedMap(PackedMap::Size(pm) + 1, data_bytes)) {
+        pv.InitRobj(OBJ_HASH, kEncodingStrMap2, HSetFamily::ConvertPackedToStrMap(pm));
       }
     }
   }
@@ -233,6 +279,22 @@ OpStatus OpIncrBy(const OpArgs& op_args, string_view key, string_view field, Inc
 
     pv.SetRObjPtr(lp);
     stats->listpack_bytes += lpBytes(lp);
+  } else if (enc == kEncodingPackedMap) {
+    uint8_t* pm = (uint8_t*)pv.RObjPtr();
+
+    OpStatus status = IncrementValue(PackedMap::Find(pm, field), param);
+    if (status != OpStatus::OK)
+      return status;
+
+    if (holds_alternative<double>(*param)) {
+      char buf[kMaxIncrValueLen];
+      char* str = RedisReplyBuilder::FormatDouble(get<double>(*param), buf, sizeof(buf));
+      pm = PackedMap::Insert(pm, field, str, false).first;
+    } else {
+      absl::AlphaNum an(get<int64_t>(*param));
+      pm = PackedMap::Insert(pm, field, an.Piece(), false).first;
+    }
+    pv.SetRObjPtr(pm);
   } else {
     DCHECK_EQ(enc, kEncodingStrMap2);
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -316,6 +378,17 @@ OpResult<StringVec> OpScan(const OpArgs& op_args, std::string_view key, uint64_t
       lp_elem = lpNext(lp, lp_elem);  // switch to next key
     } while (lp_elem);
 
+    *cursor = 0;
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    // Single pass as well, PackedMap holds a bounded number of fields.
+    PackedMap::Iterate((uint8_t*)pv.RObjPtr(), [&](string_view field, string_view value) {
+      if (scan_op.Matches(field)) {
+        res.emplace_back(field);
+        res.emplace_back(value);
+      }
+      return true;
+    });
+
     *cursor = 0;
   } else {
     DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
@@ -375,6 +448,17 @@ OpResult<uint32_t> OpDel(const OpArgs& op_args, string_view key, CmdArgList valu
       }
     }
     pv.SetRObjPtr(lp);
+  } else if (enc == kEncodingPackedMap) {
+    uint8_t* pm = (uint8_t*)pv.RObjPtr();
+    for (auto s : values) {
+      if (PackedMap::Erase(pm, ToSV(s))) {
+        ++deleted;
+        if (PackedMap::Size(pm) == 0) {
+          key_remove = true;
+          break;
+        }
+      }
+    }
   } else {
     DCHECK_EQ(enc, kEncodingStrMap2);
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -453,6 +537,12 @@ OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, Cm
 
       lp_elem = lpNext(lp, lp_elem);  // switch to the next key
     } while (lp_elem);
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    uint8_t* pm = (uint8_t*)pv.RObjPtr();
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (auto value = PackedMap::Find(pm, ToSV(fields[i])); value)
+        result[i].emplace(*value);
+    }
   } else {
     DCHECK_EQ(kEncodingStrMap2, pv.Encoding());
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -499,6 +589,9 @@ OpResult<int> OpExist(const OpArgs& op_args, string_view key, string_view field)
     return res.has_value();
   }
 
+  if (pv.Encoding() == kEncodingPackedMap)
+    return PackedMap::Find((uint8_t*)ptr, field).has_value();
+
   DCHECK_EQ(kEncodingStrMap2, pv.Encoding());
   StringMap* sm = GetStringMap(pv, op_args.db_cntx);
 
@@ -523,6 +616,14 @@ OpResult<string> OpGet(const OpArgs& op_args, string_view key, string_view field
     return string(*res);
   }
 
+  if (pv.Encoding() == kEncodingPackedMap) {
+    optional<string_view> res = PackedMap::Find((uint8_t*)ptr, field);
+    if (!res) {
+      return OpStatus::KEY_NOTFOUND;
+    }
+    return string(*res);
+  }
+
   DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
   StringMap* sm = GetStringMap(pv, op_args.db_cntx);
   auto it = sm->Find(field);
@@ -565,6 +666,16 @@ OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_
       }
       fptr = lpNext(lp, fptr);
     }
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    uint8_t* pm = (uint8_t*)pv.RObjPtr();
+    res.reserve(PackedMap::Size(pm) * (keyval ? 2 : 1));
+    PackedMap::Iterate(pm, [&](string_view field, string_view value) {
+      if (mask & FIELDS)
+        res.emplace_back(field);
+      if (mask & VALUES)
+        res.emplace_back(value);
+      return true;
+    });
   } else {
     DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -594,6 +705,43 @@ OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_
   return res;
 }
 
+// Reads the next chunk of OpGetAll. Large hashes are scanned bucket by bucket, which yields every
+// field once as the hash can not change between the hops. Fields with expiry may disappear while
+// scanning, so such hashes are read at once to keep the announced reply length exact.
+OpStatus OpGetAllChunk(const OpArgs& op_args, string_view key, uint8_t mask,
+                       container_utils::ReplyChunk* chunk) {
+  bool keyval = (mask == (FIELDS | VALUES));
+  if (chunk->cursor == 0) {
+    auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
+    RETURN_ON_BAD_STATUS(it_res);
+
+    const PrimeValue& pv = (*it_res)->second;
+    size_t total = pv.Size() * (keyval ? 2 : 1);
+    if (total <= chunk->limit || pv.Encoding() != kEncodingStrMap2 ||
+        GetStringMap(pv, op_args.db_cntx)->ExpirationUsed()) {
+      OpResult<vector<string>> res = OpGetAll(op_args, key, mask);
+      RETURN_ON_BAD_STATUS(res);
+      chunk->total = res->size();
+      chunk->elements = std::move(*res);
+      return OpStatus::OK;
+    }
+    chunk->total = total;
+  }
+
+  ScanOpts scan_op;
+  scan_op.limit = max<size_t>(chunk->limit / (keyval ? 2 : 1), 1);
+  OpResult<StringVec> res = OpScan(op_args, key, &chunk->cursor, scan_op);
+  RETURN_ON_BAD_STATUS(res);
+
+  for (size_t i = 0; i < res->size(); i += 2) {
+    if (mask & FIELDS)
+      chunk->elements.push_back(std::move((*res)[i]));
+    if (mask & VALUES)
+      chunk->elements.push_back(std::move((*res)[i + 1]));
+  }
+  return OpStatus::OK;
+}
+
 OpResult<size_t> OpStrLen(const OpArgs& op_args, string_view key, string_view field) {
   auto& db_slice = op_args.GetDbSlice();
   auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
@@ -613,6 +761,11 @@ OpResult<size_t> OpStrLen(const OpArgs& op_args, string_view key, string_view fi
     return res ? res->size() : 0;
   }
 
+  if (pv.Encoding() == kEncodingPackedMap) {
+    optional<string_view> res = PackedMap::Find((uint8_t*)ptr, field);
+    return res ? res->size() : 0;
+  }
+
   DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
   StringMap* sm = GetStringMap(pv, op_args.db_cntx);
 
@@ -664,12 +817,29 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 
     if (op_sp.ttl != UINT32_MAX || !IsGoodForListpack(values, lp)) {
       stats->listpack_blob_cnt--;
-      StringMap* sm = HSetFamily::ConvertToStrMap(lp);
-      pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+      uint8_t* pm = op_sp.ttl == UINT32_MAX ? HSetFamily::ConvertToPackedMap(lp) : nullptr;
+      if (pm) {
+        pv.InitRobj(OBJ_HASH, kEncodingPackedMap, pm);
+      } else {
+        StringMap* sm = HSetFamily::ConvertToStrMap(lp);
+        pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+      }
       lp = nullptr;
     }
   }
 
+  uint8_t* pm = nullptr;
+  if (pv.Encoding() == kEncodingPackedMap) {
+    pm = (uint8_t*)pv.RObjPtr();
+
+    // PackedMap does not support field expiry.
+    if (op_sp.ttl != UINT32_MAX || !IsGoodForPackedMap(values, pm)) {
+      StringMap* sm = HSetFamily::ConvertPackedToStrMap(pm);
+      pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+      pm = nullptr;
+    }
+  }
+
   unsigned created = 0;
 
   if (lp) {
@@ -685,6 +855,14 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
     }
     pv.SetRObjPtr(lp);
     stats->listpack_bytes += lpBytes(lp);
+  } else if (pm) {
+    bool inserted;
+    for (size_t i = 0; i < values.size(); i += 2) {
+      tie(pm, inserted) =
+          PackedMap::Insert(pm, ArgS(values, i), ArgS(values, i + 1), op_sp.skip_if_exists);
+      created += inserted;
+    }
+    pv.SetRObjPtr(pm);
   } else {
     DCHECK_EQ(kEncodingStrMap2, pv.Encoding());  // Dictionary
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -701,6 +879,9 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 
       created += unsigned(added);
     }
+
+    if (op_sp.ttl != UINT32_MAX)
+      db_slice.RegisterMemberExpiry(op_args.db_cntx, key, op_sp.ttl);
   }
 
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
@@ -708,23 +889,64 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
   return created;
 }
 
-void HGetGeneric(CmdArgList args, ConnectionContext* cntx, uint8_t getall_mask) {
-  string_view key = ArgS(args, 0);
+// Returns the serialized reply of HGETALL, HKEYS or HVALS from the reply cache of the shard, or
+// serializes the reply and caches it.
+OpResult<ReplyCache::Reply> OpGetAllCached(const OpArgs& op_args, string_view key, uint8_t mask,
+                                           bool resp3) {
+  auto& db_slice = op_args.GetDbSlice();
+  auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
+  if (!it_res)
+    return it_res.status();
 
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpGetAll(t->GetOpArgs(shard), key, getall_mask);
-  };
+  ReplyCache::Kind kind = mask == (FIELDS | VALUES) ? ReplyCache::kHGetAll
+                          : mask == FIELDS         ? ReplyCache::kHKeys
+                                                   : ReplyCache::kHVals;
+  uint64_t version = it_res->GetVersion();
+  DbIndex db = op_args.db_cntx.db_index;
+  if (auto reply = db_slice.reply_cache().Get(db, key, kind, resp3, version); reply)
+    return reply;
 
-  OpResult<vector<string>> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  // Fields with expiry are removed lazily by reads, so such hashes may change without writes.
+  const PrimeValue& pv = (*it_res)->second;
+  bool cacheable = pv.Encoding() != kEncodingStrMap2 ||
+                   !GetStringMap(pv, op_args.db_cntx)->ExpirationUsed();
+
+  OpResult<vector<string>> fields = OpGetAll(op_args, key, mask);
+  RETURN_ON_BAD_STATUS(fields);
+
+  auto reply = make_shared<const string>(SerializeStringArr(*fields, kind == ReplyCache::kHGetAll,
+                                                            resp3));
+  if (cacheable)
+    db_slice.reply_cache().Put(db, key, kind, resp3, version, reply);
+  return reply;
+}
 
+void HGetGeneric(CmdArgList args, ConnectionContext* cntx, uint8_t getall_mask) {
+  string_view key = ArgS(args, 0);
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  if (result) {
-    bool is_map = (getall_mask == (VALUES | FIELDS));
-    rb->SendStringArr(absl::Span<const string>{*result},
-                      is_map ? RedisReplyBuilder::MAP : RedisReplyBuilder::ARRAY);
-  } else {
-    cntx->SendError(result.status());
+  bool is_map = (getall_mask == (VALUES | FIELDS));
+
+  // Scripts translate the replies, so they can not send serialized ones either.
+  if (ReplyCache::IsEnabled(rb) && !cntx->transaction->IsMulti()) {
+    auto cb = [&, resp3 = rb->IsResp3()](Transaction* t, EngineShard* shard) {
+      return OpGetAllCached(t->GetOpArgs(shard), key, getall_mask, resp3);
+    };
+
+    OpResult<ReplyCache::Reply> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+    if (result)
+      return rb->SendRawReply(**result);
+    if (result.status() == OpStatus::KEY_NOTFOUND)
+      return rb->SendStringArr(absl::Span<const string>{}, is_map ? RedisReplyBuilder::MAP
+                                                                  : RedisReplyBuilder::ARRAY);
+    return cntx->SendError(result.status());
   }
+
+  auto read_chunk = [&](Transaction* t, EngineShard* shard, container_utils::ReplyChunk* chunk) {
+    return OpGetAllChunk(t->GetOpArgs(shard), key, getall_mask, chunk);
+  };
+  container_utils::SendChunkedReply(cntx->transaction, rb,
+                                    is_map ? RedisReplyBuilder::MAP : RedisReplyBuilder::ARRAY,
+                                    read_chunk);
 }
 
 OpResult<vector<long>> OpHExpire(const OpArgs& op_args, string_view key, uint32_t ttl_sec,
@@ -741,6 +963,7 @@ OpResult<vector<long>> OpHExpire(const OpArgs& op_args, string_view key, uint32_
   }
 
   PrimeValue* pv = &((*op_res).it->second);
+  db_slice.RegisterMemberExpiry(op_args.db_cntx, key, ttl_sec);
   return HSetFamily::SetFieldsExpireTime(op_args, ttl_sec, key, values, pv);
 }
 
@@ -1206,6 +1429,36 @@ void HSetFamily::HRandField(CmdArgList args, ConnectionContext* cntx) {
           }
         }
       }
+    } else if (pv.Encoding() == kEncodingPackedMap) {
+      vector<pair<string_view, string_view>> entries;
+      PackedMap::Iterate((uint8_t*)pv.RObjPtr(), [&](string_view field, string_view value) {
+        entries.emplace_back(field, value);
+        return true;
+      });
+      CHECK(!entries.empty());
+
+      absl::InsecureBitGen gen;
+      if (args.size() == 1) {
+        str_vec.emplace_back(entries[absl::Uniform<size_t>(gen, 0, entries.size())].first);
+      } else {
+        size_t actual_count = (count >= 0) ? std::min(size_t(count), entries.size()) : abs(count);
+        for (size_t i = 0; i < actual_count; ++i) {
+          size_t index;
+          if (count >= 0) {
+            // Partial Fisher-Yates shuffle returns unique entries.
+            index = absl::Uniform<size_t>(gen, i, entries.size());
+            swap(entries[i], entries[index]);
+            index = i;
+          } else {
+            index = absl::Uniform<size_t>(gen, 0, entries.size());
+          }
+
+          str_vec.emplace_back(entries[index].first);
+          if (with_values) {
+            str_vec.emplace_back(entries[index].second);
+          }
+        }
+      }
     } else {
       LOG(ERROR) << "Invalid encoding " << pv.Encoding();
       return OpStatus::INVALID_VALUE;
@@ -1320,6 +1573,57 @@ StringMap* HSetFamily::ConvertToStrMap(uint8_t* lp) {
   return sm;
 }
 
+StringMap* HSetFamily::ConvertPackedToStrMap(const uint8_t* pm) {
+  StringMap* sm = CompactObj::AllocateMR<StringMap>();
+  sm->Reserve(PackedMap::Size(pm));
+
+  PackedMap::Iterate(pm, [sm](string_view field, string_view value) {
+    bool added = sm->AddOrUpdate(field, value);
+    DCHECK(added);  // fields are unique
+    return true;
+  });
+
+  return sm;
+}
+
+uint8_t* HSetFamily::ConvertToPackedMap(uint8_t* lp) {
+  size_t entries = lpLength(lp) / 2;
+  size_t data_bytes = 0;
+  uint8_t intbuf[LP_INTBUF_SIZE];
+
+  // First pass checks the limits and computes the exact size of the map.
+  for (uint8_t* lp_elem = lpFirst(lp); lp_elem; lp_elem = lpNext(lp, lp_elem)) {
+    size_t len = LpGetView(lp_elem, intbuf).size();
+    if (len > PackedMap::kMaxStrLen)
+      return nullptr;
+    data_bytes += len + 1;
+  }
+
+  if (!IsGoodForPackedMap(entries, data_bytes))
+    return nullptr;
+
+  uint8_t* pm = PackedMap::New(entries, data_bytes);
+  uint8_t* lp_elem = lpFirst(lp);
+  uint8_t valbuf[LP_INTBUF_SIZE];
+
+  while (lp_elem) {
+    string_view field = LpGetView(lp_elem, intbuf);
+    lp_elem = lpNext(lp, lp_elem);  // switch to value
+    DCHECK(lp_elem);
+    string_view value = LpGetView(lp_elem, valbuf);
+    lp_elem = lpNext(lp, lp_elem);  // switch to next key
+
+    pm = PackedMap::Insert(pm, field, value, false).first;
+  }
+
+  return pm;
+}
+
+bool HSetFamily::IsGoodForPackedMap(size_t entries, size_t data_bytes) {
+  return entries <= absl::GetFlag(FLAGS_hash_packed_map_max_entries) &&
+         data_bytes <= PackedMap::kMaxDataBytes;
+}
+
 // returns -1 if no expiry is associated with the field, -3 if no field is found.
 int32_t HSetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                     std::string_view field) {
@@ -1330,6 +1634,8 @@ int32_t HSetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValu
     uint8_t* lp = (uint8_t*)pv.RObjPtr();
     optional<string_view> res = LpFind(lp, field, intbuf);
     return res ? -1 : -3;
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    return PackedMap::Find((uint8_t*)pv.RObjPtr(), field) ? -1 : -3;
   } else {
     StringMap* string_map = (StringMap*)pv.RObjPtr();
     string_map->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -1354,6 +1660,9 @@ vector<long> HSetFamily::SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl
     stats->listpack_blob_cnt--;
     StringMap* sm = HSetFamily::ConvertToStrMap(lp);
     pv->InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+  } else if (pv->Encoding() == kEncodingPackedMap) {
+    StringMap* sm = HSetFamily::ConvertPackedToStrMap((uint8_t*)pv->RObjPtr());
+    pv->InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
   }
 
   // This needs to be explicitly fetched again since the pv might have changed.
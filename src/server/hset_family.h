@@ -26,6 +26,16 @@ class HSetFamily {
   // Does not free lp.
   static StringMap* ConvertToStrMap(uint8_t* lp);
 
+  // Does not free pm.
+  static StringMap* ConvertPackedToStrMap(const uint8_t* pm);
+
+  // Returns nullptr if lp does not fit into PackedMap. Does not free lp.
+  static uint8_t* ConvertToPackedMap(uint8_t* lp);
+
+  // Whether a hash with `entries` pairs, taking `data_bytes` as counted by
+  // PackedMap::EntryBytes, can use PackedMap encoding.
+  static bool IsGoodForPackedMap(size_t entries, size_t data_bytes);
+
   static int32_t FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                  std::string_view field);
 
@@ -9,6 +9,7 @@ extern "C" {
 #include "redis/sds.h"
 }
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -20,6 +21,10 @@ using namespace util;
 using namespace boost;
 using namespace facade;
 
+ABSL_DECLARE_FLAG(uint32_t, hash_packed_map_max_entries);
+ABSL_DECLARE_FLAG(dfly::MemoryBytesFlag, reply_cache_max_memory);
+ABSL_DECLARE_FLAG(uint32_t, container_reply_chunk_size);
+
 namespace dfly {
 
 class HSetFamilyTest : public BaseFamilyTest {
@@ -376,6 +381,65 @@ TEST_F(HSetFamilyTest, TriggerConvertToStrMap) {
   EXPECT_THAT(Run({"HLEN", "hk"}), IntArg(kElements));
 }
 
+TEST_F(HSetFamilyTest, PackedMap) {
+  const int kElements = 200;
+  auto fill = [&](string_view key) {
+    // Enough for IsGoodForListpack to become false
+    for (int i = 0; i < kElements; i++)
+      Run({"HSET", key, absl::StrCat("field", i), absl::StrCat("value", i)});
+  };
+
+  fill("hk");
+  EXPECT_THAT(Run({"HLEN", "hk"}), IntArg(kElements));
+  EXPECT_EQ(Run({"HGET", "hk", "field7"}), "value7");
+  EXPECT_THAT(Run({"HEXISTS", "hk", "field8"}), IntArg(1));
+  EXPECT_THAT(Run({"HSTRLEN", "hk", "field10"}), IntArg(7));
+  EXPECT_THAT(Run({"HMGET", "hk", "field1", "nosuchfield"}),
+              RespArray(ElementsAre("value1", ArgType(RespExpr::NIL))));
+  EXPECT_THAT(Run({"HINCRBY", "hk", "counter", "5"}), IntArg(5));
+  EXPECT_THAT(Run({"HINCRBY", "hk", "counter", "-7"}), IntArg(-2));
+  EXPECT_THAT(Run({"HDEL", "hk", "counter", "field0", "nosuchfield"}), IntArg(2));
+  EXPECT_THAT(Run({"HSETNX", "hk", "field1", "other"}), IntArg(0));
+  EXPECT_THAT(Run({"HSET", "hk", "field1", "a longer value"}), IntArg(0));
+  EXPECT_EQ(Run({"HGET", "hk", "field1"}), "a longer value");
+
+  auto resp = Run({"HSCAN", "hk", "0", "MATCH", "field1?"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[1], ArrLen(20));
+
+  EXPECT_THAT(Run({"HKEYS", "hk"}), ArrLen(kElements - 1));
+  EXPECT_THAT(Run({"HRANDFIELD", "hk", "1000"}), ArrLen(kElements - 1));
+  EXPECT_THAT(Run({"HRANDFIELD", "hk", "-1000", "WITHVALUES"}), ArrLen(2000));
+
+  // Survives a save/load cycle.
+  int64_t packed_usage = CheckedInt({"MEMORY", "USAGE", "hk"});
+  Run({"DEBUG", "RELOAD"});
+  EXPECT_THAT(Run({"HLEN", "hk"}), IntArg(kElements - 1));
+  EXPECT_EQ(Run({"HGET", "hk", "field199"}), "value199");
+  EXPECT_LE(CheckedInt({"MEMORY", "USAGE", "hk"}), packed_usage);
+
+  {
+    absl::FlagSaver fs;
+    absl::SetFlag(&FLAGS_hash_packed_map_max_entries, 0);
+    fill("hk2");
+  }
+  EXPECT_LT(packed_usage, CheckedInt({"MEMORY", "USAGE", "hk2"}));
+
+  // Field expiry requires StringMap.
+  EXPECT_THAT(Run({"HEXPIRE", "hk", "10", "FIELDS", "1", "field2"}),
+              RespArray(ElementsAre(IntArg(1))));
+  AdvanceTime(10'000);
+  EXPECT_THAT(Run({"HGET", "hk", "field2"}), ArgType(RespExpr::NIL));
+  EXPECT_EQ(Run({"HGET", "hk", "field3"}), "value3");
+
+  // Long values do not fit into PackedMap.
+  fill("hk3");
+  string long_value(300, 'x');
+  EXPECT_THAT(Run({"HSET", "hk3", "field1", long_value}), IntArg(0));
+  EXPECT_EQ(Run({"HGET", "hk3", "field1"}), long_value);
+  EXPECT_EQ(Run({"HGET", "hk3", "field2"}), "value2");
+}
+
 TEST_F(HSetFamilyTest, Issue1140) {
   Run({"HSET", "CaseKey", "Foo", "Bar"});
 
@@ -456,4 +520,94 @@ TEST_F(HSetFamilyTest, EmptyHashBug) {
   EXPECT_THAT(Run({"EXISTS", "foo"}), IntArg(0));
 }
 
+TEST_F(HSetFamilyTest, ActiveFieldExpiry) {
+  EXPECT_EQ(CheckedInt({"HSETEX", "foo", "10", "a", "1", "b", "2"}), 2);
+  EXPECT_EQ(CheckedInt({"HSETEX", "bar", "10", "a", "1"}), 1);
+  EXPECT_EQ(CheckedInt({"HSETEX", "bar", "100", "b", "2"}), 1);
+  EXPECT_EQ(CheckedInt({"HSET", "baz", "a", "1", "b", "2"}), 2);
+  EXPECT_THAT(Run({"HEXPIRE", "baz", "10", "FIELDS", "1", "a"}), RespArray(ElementsAre(IntArg(1))));
+
+  AdvanceTime(30'000);
+  shard_set->RunBlockingInParallel([](EngineShard* es) { es->RetireExpiredAndEvict(); });
+
+  // foo is deleted without being accessed, the other hashes lost only their expired fields.
+  EXPECT_EQ(CheckedInt({"DBSIZE"}), 2);
+  EXPECT_EQ(CheckedInt({"EXISTS", "foo"}), 0);
+  EXPECT_THAT(Run({"HKEYS", "bar"}), "b");
+  EXPECT_THAT(Run({"HKEYS", "baz"}), "b");
+}
+
+TEST_P(HestFamilyTestProtocolVersioned, ReplyCache) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_reply_cache_max_memory, MemoryBytesFlag{1 << 20});
+  Run({"hello", GetParam()});
+
+  auto hits = [&] { return GetMetrics().coordinator_stats.reply_cache_hits; };
+  auto hgetall = [&](string_view key) {
+    auto resp = Run({"hgetall", key});
+    return resp.type == RespExpr::ARRAY ? resp.GetVec() : RespVec{};
+  };
+
+  Run({"hset", "x", "a", "1", "b", "2"});
+  EXPECT_THAT(hgetall("x"), ElementsAre("a", "1", "b", "2"));
+  EXPECT_EQ(0u, hits());
+  EXPECT_THAT(hgetall("x"), ElementsAre("a", "1", "b", "2"));
+  EXPECT_EQ(1u, hits());
+  EXPECT_GT(GetMetrics().reply_cache_bytes, 0u);
+
+  // HKEYS and HVALS have replies of their own.
+  EXPECT_THAT(Run({"hkeys", "x"}), RespArray(ElementsAre("a", "b")));
+  EXPECT_THAT(Run({"hvals", "x"}), RespArray(ElementsAre("1", "2")));
+  EXPECT_THAT(Run({"hvals", "x"}), RespArray(ElementsAre("1", "2")));
+  EXPECT_EQ(2u, hits());
+
+  // Writes are visible right after they complete.
+  Run({"hset", "x", "c", "3"});
+  EXPECT_THAT(hgetall("x"), ElementsAre("a", "1", "b", "2", "c", "3"));
+  Run({"hdel", "x", "a"});
+  EXPECT_THAT(hgetall("x"), ElementsAre("b", "2", "c", "3"));
+  EXPECT_EQ(2u, hits());
+
+  Run({"del", "x"});
+  EXPECT_THAT(Run({"hgetall", "x"}), RespArray(ElementsAre()));
+  Run({"hset", "x", "d", "4", "e", "5"});
+  EXPECT_THAT(hgetall("x"), ElementsAre("d", "4", "e", "5"));
+  EXPECT_THAT(hgetall("x"), ElementsAre("d", "4", "e", "5"));
+  EXPECT_EQ(3u, hits());
+
+  Run({"flushall"});
+  EXPECT_EQ(0u, GetMetrics().reply_cache_bytes);
+  EXPECT_THAT(Run({"hgetall", "x"}), RespArray(ElementsAre()));
+}
+
+TEST_P(HestFamilyTestProtocolVersioned, ChunkedReply) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_container_reply_chunk_size, 16);
+  Run({"hello", GetParam()});
+
+  vector<string> cmd = {"hset", "x"};
+  vector<string> fields, values, all;
+  for (unsigned i = 0; i < 300; ++i) {
+    fields.push_back(absl::StrCat("f", i));
+    values.push_back(absl::StrCat("v", i));
+    cmd.insert(cmd.end(), {fields.back(), values.back()});
+  }
+  Run(absl::MakeSpan(cmd));
+
+  auto resp = Run({"hgetall", "x"});
+  ASSERT_EQ(resp.GetVec().size(), 600u);
+  for (const auto& elem : resp.GetVec())
+    all.push_back(elem.GetString());
+  for (size_t i = 0; i < all.size(); i += 2)
+    EXPECT_EQ(all[i + 1], "v" + all[i].substr(1));
+
+  EXPECT_THAT(StrArray(Run({"hkeys", "x"})), UnorderedElementsAreArray(fields));
+  EXPECT_THAT(StrArray(Run({"hvals", "x"})), UnorderedElementsAreArray(values));
+
+  // Hashes with field expiry are read at once.
+  Run({"hexpire", "x", "100", "fields", "1", "f0"});
+  EXPECT_THAT(StrArray(Run({"hkeys", "x"})), UnorderedElementsAreArray(fields));
+  EXPECT_THAT(Run({"hgetall", "y"}), RespArray(ElementsAre()));
+}
+
 }  // namespace dfly
@@ -0,0 +1,273 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/journal/disk_backlog.h"
+
+#include <absl/base/internal/endian.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+
+#include <ctime>
+#include <filesystem>
+
+#include "base/logging.h"
+#include "core/uring.h"
+#include "server/error.h"
+
+namespace dfly {
+namespace journal {
+
+using namespace std;
+using namespace util;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t kRecordHeaderSize = 4;      // u32 length of the record
+constexpr size_t kChunkSize = 256 << 10;     // max bytes written at once
+constexpr size_t kIndexInterval = 64 << 10;  // bytes between sparse index entries
+constexpr size_t kReadAheadSize = 256 << 10;
+constexpr size_t kMaxPendingBytes = 64 << 20;
+constexpr size_t kSegmentsPerBacklog = 8;
+
+string SegmentPrefix(unsigned shard_id) {
+  return absl::StrCat("repl-backlog-", absl::Dec(shard_id, absl::kZeroPad4), "-");
+}
+
+}  // namespace
+
+DiskBacklog::Segment::~Segment() {
+  if (file) {
+    auto ec = file->Close();
+    LOG_IF(ERROR, ec) << "Error closing backlog file " << path << ": " << ec.message();
+  }
+  if (read_file)
+    read_file->Close();
+}
+
+DiskBacklog::~DiskBacklog() {
+  DCHECK(segments_.empty());
+}
+
+error_code DiskBacklog::Open(const string& dir, unsigned shard_id, size_t max_bytes) {
+  dir_ = dir;
+  shard_id_ = shard_id;
+  max_bytes_ = max_bytes;
+
+  error_code ec;
+  fs::create_directories(dir_, ec);
+  if (ec)
+    return ec;
+
+  // Leftovers of a previous run can't be used, lsns start from scratch.
+  string prefix = SegmentPrefix(shard_id_);
+  for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+    if (absl::StartsWith(entry.path().filename().string(), prefix))
+      fs::remove(entry.path(), ec);
+  }
+  if (ec)
+    return ec;
+
+  flush_fb_ = fb2::Fiber("repl_backlog_flush", &DiskBacklog::FlushFb, this);
+  return {};
+}
+
+void DiskBacklog::Close() {
+  closing_ = true;
+  waker_.notifyAll();
+  flush_fb_.JoinIfNeeded();
+
+  lock_guard lk(read_mu_);  // wait for running reads
+  for (const auto& segment : segments_) {
+    error_code ec;
+    fs::remove(segment->path, ec);
+  }
+  segments_.clear();
+  disk_bytes_ = 0;
+}
+
+void DiskBacklog::Add(LSN lsn, string_view data) {
+  DCHECK(end_lsn_ == 0 || lsn == end_lsn_);
+  end_lsn_ = lsn + 1;
+  if (ec_ || closing_)
+    return;
+
+  if (pending_.empty() || pending_.back().data.size() >= kChunkSize) {
+    pending_.emplace_back();
+    pending_.back().first_lsn = lsn;
+  }
+
+  Chunk& chunk = pending_.back();
+  if (chunk.index.empty() || chunk.data.size() - chunk.index.back().second >= kIndexInterval)
+    chunk.index.emplace_back(lsn, chunk.data.size());
+
+  char header[kRecordHeaderSize];
+  absl::little_endian::Store32(header, data.size());
+  chunk.data.append(header, kRecordHeaderSize);
+  chunk.data.append(data);
+  chunk.end_lsn = lsn + 1;
+
+  pending_bytes_ += kRecordHeaderSize + data.size();
+  waker_.notify();
+}
+
+void DiskBacklog::AwaitWritable() {
+  waker_.await([this] { return pending_bytes_ < kMaxPendingBytes || closing_ || bool(ec_); });
+}
+
+optional<string> DiskBacklog::Read(LSN lsn) {
+  if (!Contains(lsn))
+    return nullopt;
+
+  lock_guard lk(read_mu_);
+  waker_.await([&] { return closing_ || bool(ec_) || segments_.back()->end_lsn > lsn; });
+  if (closing_ || !Contains(lsn))
+    return nullopt;
+
+  // The last segment that starts at or before lsn.
+  auto it = upper_bound(segments_.begin(), segments_.end(), lsn,
+                        [](LSN l, const auto& segment) { return l < segment->first_lsn; });
+  DCHECK(it != segments_.begin());
+  shared_ptr<Segment> segment = *prev(it);
+
+  auto index_it = upper_bound(segment->index.begin(), segment->index.end(), lsn,
+                              [](LSN l, const auto& entry) { return l < entry.first; });
+  DCHECK(index_it != segment->index.begin());
+  auto [cur_lsn, offset] = *prev(index_it);
+
+  // Continue from the cursor if it is closer than the index entry.
+  if (cursor_.segment_id == segment->id && cursor_.lsn <= lsn && cursor_.lsn >= cur_lsn) {
+    cur_lsn = cursor_.lsn;
+    offset = cursor_.offset;
+  }
+
+  for (;; ++cur_lsn) {
+    auto header = ReadAt(segment.get(), offset, kRecordHeaderSize);
+    if (!header) {
+      LOG(ERROR) << "Failed to read replication backlog: " << header.error().message();
+      return nullopt;
+    }
+    uint32_t len = absl::little_endian::Load32(header->data());
+
+    if (cur_lsn == lsn) {
+      auto data = ReadAt(segment.get(), offset + kRecordHeaderSize, len);
+      if (!data) {
+        LOG(ERROR) << "Failed to read replication backlog: " << data.error().message();
+        return nullopt;
+      }
+      cursor_ = {segment->id, lsn + 1, offset + kRecordHeaderSize + len};
+      return string{*data};
+    }
+    offset += kRecordHeaderSize + len;
+  }
+}
+
+BacklogStats DiskBacklog::GetStats() const {
+  BacklogStats stats;
+  stats.disk_bytes = disk_bytes_;
+  if (!segments_.empty())
+    stats.first_time = segments_.front()->first_time;
+  return stats;
+}
+
+void DiskBacklog::FlushFb() {
+  while (true) {
+    waker_.await([this] { return !pending_.empty() || closing_; });
+    if (pending_.empty())
+      break;
+
+    Chunk chunk = std::move(pending_.front());
+    pending_.pop_front();
+    pending_bytes_ -= chunk.data.size();
+
+    if (!ec_) {
+      ec_ = WriteChunk(std::move(chunk));
+      LOG_IF(ERROR, ec_) << "Replication backlog of shard " << shard_id_
+                         << " stopped: " << ec_.message();
+    }
+    waker_.notifyAll();  // unblock readers and throttled writers
+  }
+}
+
+error_code DiskBacklog::WriteChunk(Chunk chunk) {
+  if (segments_.empty() || segments_.back()->size >= max_bytes_ / kSegmentsPerBacklog)
+    RETURN_ON_ERR(AddSegment(chunk.first_lsn));
+
+  Segment* segment = segments_.back().get();
+  DCHECK_EQ(segment->end_lsn, chunk.first_lsn);
+  RETURN_ON_ERR(segment->file->Write(io::Buffer(chunk.data), segment->size, 0));
+
+  for (auto [lsn, offset] : chunk.index)
+    segment->index.emplace_back(lsn, segment->size + offset);
+  segment->size += chunk.data.size();
+  segment->end_lsn = chunk.end_lsn;
+  disk_bytes_ += chunk.data.size();
+
+  Truncate();
+  return {};
+}
+
+error_code DiskBacklog::AddSegment(LSN first_lsn) {
+  auto segment = make_shared<Segment>();
+  segment->id = next_segment_id_++;
+  segment->path =
+      (fs::path(dir_) / absl::StrCat(SegmentPrefix(shard_id_), segment->id, ".log")).string();
+  segment->first_lsn = segment->end_lsn = first_lsn;
+  segment->first_time = time(nullptr);
+
+  auto res = OpenLinux(segment->path, O_CLOEXEC | O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  if (!res)
+    return res.error();
+  segment->file = std::move(res).value();
+
+  auto read_res = OpenRead(segment->path);
+  if (!read_res)
+    return read_res.error();
+  segment->read_file.reset(*read_res);
+
+  VLOG(1) << "Opened backlog segment " << segment->path << " at lsn " << first_lsn;
+  segments_.push_back(std::move(segment));
+  return {};
+}
+
+void DiskBacklog::Truncate() {
+  while (segments_.size() > 1 && disk_bytes_ > max_bytes_) {
+    auto& segment = segments_.front();
+    disk_bytes_ -= segment->size;
+
+    error_code ec;
+    fs::remove(segment->path, ec);
+    LOG_IF(WARNING, ec) << "Failed to remove backlog file " << segment->path << ": "
+                        << ec.message();
+
+    // Readers of the segment keep it open until they finish.
+    segments_.pop_front();
+  }
+}
+
+io::Result<string_view> DiskBacklog::ReadAt(Segment* segment, size_t offset, size_t size) {
+  DCHECK_LE(offset + size, segment->size);
+  if (read_buf_segment_ != segment->id || offset < read_buf_offset_ ||
+      offset + size > read_buf_offset_ + read_buf_.size()) {
+    size_t len = min(max(size, kReadAheadSize), segment->size - offset);
+    read_buf_.resize(len);
+    read_buf_segment_ = UINT64_MAX;
+
+    io::MutableBytes dest{reinterpret_cast<uint8_t*>(read_buf_.data()), len};
+    auto res = segment->read_file->Read(offset, dest);
+    if (!res)
+      return nonstd::make_unexpected(res.error());
+    if (*res < size)
+      return nonstd::make_unexpected(make_error_code(errc::io_error));
+
+    read_buf_.resize(*res);
+    read_buf_segment_ = segment->id;
+    read_buf_offset_ = offset;
+  }
+  return string_view{read_buf_}.substr(offset - read_buf_offset_, size);
+}
+
+}  // namespace journal
+}  // namespace dfly
@@ -0,0 +1,168 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "io/file.h"
+#include "server/journal/types.h"
+
+#ifdef __linux__
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+#include "util/fibers/uring_file.h"
+#endif
+
+namespace dfly {
+namespace journal {
+
+struct BacklogStats {
+  size_t disk_bytes = 0;
+  uint64_t first_time = 0;  // unix time of the oldest record, 0 if empty
+
+  // Partial sync needs the records of all shards, so the newest of the oldest records bounds the
+  // retention.
+  BacklogStats& operator+=(const BacklogStats& o) {
+    disk_bytes += o.disk_bytes;
+    if (o.first_time && (!first_time || o.first_time > first_time))
+      first_time = o.first_time;
+    return *this;
+  }
+};
+
+#ifdef __linux__
+
+// Replication backlog of a shard that spills serialized journal records to disk, so that replicas
+// can partially sync after much longer disconnects than the in-memory ring allows.
+// Records are appended to segment files by a background fiber. Once the files exceed the size
+// bound, the oldest segment is removed.
+class DiskBacklog {
+ public:
+  DiskBacklog() = default;
+  ~DiskBacklog();
+
+  std::error_code Open(const std::string& dir, unsigned shard_id, size_t max_bytes);
+
+  // Write out pending records and stop. The files are removed, they are of no use after restart.
+  void Close();
+
+  // Append a record. Does not preempt.
+  void Add(LSN lsn, std::string_view data);
+
+  // Wait until the pending records are below the bound, to apply backpressure to writers.
+  void AwaitWritable();
+
+  bool Contains(LSN lsn) const {
+    return !ec_ && !segments_.empty() && segments_.front()->first_lsn <= lsn && lsn < end_lsn_;
+  }
+
+  // Read the record with the given lsn. Preempts. Returns nullopt without preempting if the record
+  // is not in the backlog, or if reading it failed.
+  std::optional<std::string> Read(LSN lsn);
+
+  BacklogStats GetStats() const;
+
+ private:
+  struct Chunk {
+    LSN first_lsn = 0;
+    LSN end_lsn = 0;
+    std::string data;  // framed records
+    std::vector<std::pair<LSN, size_t>> index;  // offsets of records in data
+  };
+
+  struct Segment {
+    ~Segment();
+
+    uint64_t id = 0;
+    std::string path;
+    LSN first_lsn = 0;
+    LSN end_lsn = 0;  // lsn after the last written record
+    size_t size = 0;  // bytes written
+    uint64_t first_time = 0;
+    std::vector<std::pair<LSN, size_t>> index;  // sparse offsets of records
+    std::unique_ptr<util::fb2::LinuxFile> file;
+    std::unique_ptr<io::ReadonlyFile> read_file;
+  };
+
+  void FlushFb();
+  std::error_code WriteChunk(Chunk chunk);
+  std::error_code AddSegment(LSN first_lsn);
+  void Truncate();
+
+  // Read size bytes at the offset of the segment, using the read buffer.
+  io::Result<std::string_view> ReadAt(Segment* segment, size_t offset, size_t size);
+
+  std::string dir_;
+  unsigned shard_id_ = 0;
+  size_t max_bytes_ = 0;
+
+  std::deque<Chunk> pending_;
+  size_t pending_bytes_ = 0;
+  LSN end_lsn_ = 0;  // lsn after the last added record
+  uint64_t next_segment_id_ = 0;
+
+  // Written segments, the last one is appended to. Segments are shared with readers that might
+  // outlive their removal.
+  std::deque<std::shared_ptr<Segment>> segments_;
+  size_t disk_bytes_ = 0;
+
+  // Position of the next record for sequential reads.
+  struct {
+    uint64_t segment_id = UINT64_MAX;
+    LSN lsn = 0;
+    size_t offset = 0;
+  } cursor_;
+
+  // Read ahead buffer with the data of a segment at read_buf_offset_.
+  std::string read_buf_;
+  uint64_t read_buf_segment_ = UINT64_MAX;
+  size_t read_buf_offset_ = 0;
+  util::fb2::Mutex read_mu_;  // guards the cursor and the read buffer
+
+  bool closing_ = false;
+  std::error_code ec_;  // first io error, disables the backlog
+  util::fb2::EventCount waker_;
+  util::fb2::Fiber flush_fb_;
+};
+
+#else
+
+class DiskBacklog {
+ public:
+  std::error_code Open(const std::string& dir, unsigned shard_id, size_t max_bytes) {
+    return std::make_error_code(std::errc::not_supported);
+  }
+
+  void Close() {
+  }
+
+  void Add(LSN lsn, std::string_view data) {
+  }
+
+  void AwaitWritable() {
+  }
+
+  bool Contains(LSN lsn) const {
+    return false;
+  }
+
+  std::optional<std::string> Read(LSN lsn) {
+    return std::nullopt;
+  }
+
+  BacklogStats GetStats() const {
+    return {};
+  }
+};
+
+#endif  // __linux__
+
+}  // namespace journal
+}  // namespace dfly
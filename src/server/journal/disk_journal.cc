@@ -0,0 +1,376 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/journal/disk_journal.h"
+
+#include <absl/flags/flag.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/strip.h>
+#include <fcntl.h>
+
+#include <deque>
+#include <filesystem>
+#include <map>
+
+#include "base/logging.h"
+#include "core/uring.h"
+#include "io/file.h"
+#include "server/engine_shard_set.h"
+#include "server/error.h"
+#include "server/journal/executor.h"
+#include "server/journal/journal.h"
+#include "server/journal/serializer.h"
+#include "server/journal/tx_executor.h"
+#include "util/fibers/synchronization.h"
+
+ABSL_FLAG(uint32_t, journal_fsync_ms, 1000,
+          "Interval in milliseconds for syncing the journal files to disk. 0 syncs them after every "
+          "write, committing all records that were added during the previous write and sync.");
+
+namespace dfly {
+namespace journal {
+
+using namespace std;
+using namespace util;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bound on records waiting to be written by a shard, commands that allow awaiting are blocked
+// above it.
+constexpr size_t kMaxPendingBytes = 64 << 20;
+
+string SegmentName(uint64_t segment, unsigned shard) {
+  return absl::StrCat("journal-", absl::Dec(segment, absl::kZeroPad6), "-",
+                      absl::Dec(shard, absl::kZeroPad4), ".log");
+}
+
+optional<uint64_t> ParseSegment(string_view name) {
+  if (!absl::ConsumePrefix(&name, "journal-") || !absl::ConsumeSuffix(&name, ".log"))
+    return nullopt;
+
+  uint64_t segment;
+  size_t pos = name.find('-');
+  if (pos == string_view::npos || !absl::SimpleAtoi(name.substr(0, pos), &segment))
+    return nullopt;
+  return segment;
+}
+
+// Returns the files of all shards for every segment in the directory, ordered by segment id.
+map<uint64_t, vector<string>> ListSegments(const string& dir) {
+  map<uint64_t, vector<string>> res;
+  error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    if (auto segment = ParseSegment(entry.path().filename().string()); segment)
+      res[*segment].push_back(entry.path().string());
+  }
+  return res;
+}
+
+error_code FSync(int fd, unsigned flags) {
+  auto* proactor = static_cast<fb2::UringProactor*>(ProactorBase::me());
+  FiberCall fc(proactor);
+  fc->PrepFSync(fd, flags);
+  FiberCall::IoResult io_res = fc.Get();
+  return io_res < 0 ? error_code{-io_res, system_category()} : error_code{};
+}
+
+}  // namespace
+
+struct DiskJournal::ShardLog {
+  void OnJournalItem(const JournalItem& item, bool allow_await);
+
+  // Writes pending records to the files of their segments until closing.
+  void FlushFb();
+
+  error_code SwitchFile(uint64_t segment);
+  error_code Sync();
+
+  string dir;
+  unsigned shard_id = 0;
+  uint64_t segment = 0;  // segment of newly added records
+
+  deque<pair<uint64_t, string>> pending;  // records to write, grouped by segment
+  size_t pending_bytes = 0;
+  bool closing = false;
+  error_code ec;  // first io error, stops journaling the shard
+
+  unique_ptr<LinuxFile> file;
+  uint64_t file_segment = 0;
+  size_t file_offset = 0;
+  bool dirty = false;  // written since the last sync
+
+  uint32_t cb_id = 0;
+  fb2::EventCount waker;
+  fb2::Fiber flush_fb;
+};
+
+void DiskJournal::ShardLog::OnJournalItem(const JournalItem& item, bool allow_await) {
+  if (allow_await && pending_bytes >= kMaxPendingBytes) {
+    waker.await([this] { return pending_bytes < kMaxPendingBytes || closing || bool(ec); });
+  }
+
+  if (item.data().empty() || ec)
+    return;
+
+  if (pending.empty() || pending.back().first != segment)
+    pending.emplace_back(segment, string{});
+  pending.back().second.append(item.data());
+  pending_bytes += item.data().size();
+  waker.notifyAll();
+}
+
+void DiskJournal::ShardLog::FlushFb() {
+  const uint32_t fsync_ms = absl::GetFlag(FLAGS_journal_fsync_ms);
+  auto next_sync = chrono::steady_clock::now() + chrono::milliseconds(fsync_ms);
+  auto has_work = [this] { return !pending.empty() || closing; };
+
+  while (true) {
+    if (dirty && fsync_ms > 0)
+      waker.await_until(has_work, next_sync);
+    else
+      waker.await(has_work);
+
+    if (!pending.empty() && !ec) {
+      auto [chunk_segment, data] = std::move(pending.front());
+      pending.pop_front();
+
+      if (chunk_segment != file_segment)
+        ec = SwitchFile(chunk_segment);
+      if (!ec)
+        ec = file->Write(io::Buffer(data), file_offset, 0);
+
+      file_offset += data.size();
+      pending_bytes -= data.size();
+      dirty = true;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (dirty && !ec && (fsync_ms == 0 || now >= next_sync || (closing && pending.empty()))) {
+      ec = Sync();
+      next_sync = now + chrono::milliseconds(fsync_ms);
+    }
+
+    if (ec && !pending.empty()) {
+      LOG(ERROR) << "Journal of shard " << shard_id << " stopped: " << ec.message();
+      pending.clear();
+      pending_bytes = 0;
+    }
+    waker.notifyAll();  // unblock throttled callbacks
+
+    if (closing && pending.empty())
+      break;
+  }
+
+  if (file) {
+    auto close_ec = file->Close();
+    LOG_IF(ERROR, close_ec) << "Error closing journal file " << close_ec.message();
+    file.reset();
+  }
+}
+
+error_code DiskJournal::ShardLog::SwitchFile(uint64_t segment) {
+  if (file) {
+    if (dirty)
+      RETURN_ON_ERR(Sync());
+    RETURN_ON_ERR(file->Close());
+  }
+
+  string path = (fs::path(dir) / SegmentName(segment, shard_id)).string();
+  auto res = OpenLinux(path, O_CLOEXEC | O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  if (!res)
+    return res.error();
+  file = std::move(res).value();
+  file_segment = segment;
+  file_offset = 0;
+  VLOG(1) << "Opened journal " << path;
+
+  // Persist the directory entry, otherwise the whole file can be lost on a crash.
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0)
+    return error_code{errno, system_category()};
+  error_code ec = FSync(dir_fd, 0);
+  close(dir_fd);
+  return ec;
+}
+
+error_code DiskJournal::ShardLog::Sync() {
+  dirty = false;
+  return FSync(file->fd(), IORING_FSYNC_DATASYNC);
+}
+
+DiskJournal::DiskJournal(Journal* journal, string dir) : journal_{journal}, dir_{std::move(dir)} {
+}
+
+DiskJournal::~DiskJournal() {
+  DCHECK(shard_logs_.empty());
+}
+
+error_code DiskJournal::Replay(uint64_t first_segment, Service* service) {
+  DCHECK(!IsOpen());
+  for (const auto& [segment, paths] : ListSegments(dir_)) {
+    if (segment < first_segment)
+      continue;
+
+    LOG(INFO) << "Replaying journal segment " << segment;
+    RETURN_ON_ERR(ReplaySegment(paths, service));
+  }
+  return {};
+}
+
+// Global commands like FLUSHALL were recorded by all shards, so the files are replayed in turns up
+// to the next global command, which is executed once when every file reached it.
+error_code DiskJournal::ReplaySegment(const vector<string>& paths, Service* service) {
+  struct FileReplay {
+    explicit FileReplay(io::ReadonlyFile* file) : source{file}, reader{&source, 0} {
+    }
+
+    io::FileSource source;
+    JournalReader reader;
+    optional<TransactionData> global;  // global command the replay stopped at
+    bool done = false;
+  };
+
+  vector<unique_ptr<FileReplay>> files;
+  for (const auto& path : paths) {
+    auto res = fb2::OpenRead(path);
+    if (!res)
+      return res.error();
+    files.push_back(make_unique<FileReplay>(*res));
+  }
+
+  JournalExecutor executor{service};
+  size_t executed = 0;
+  while (true) {
+    for (auto& file : files) {
+      while (!file->done && !file->global) {
+        auto res = file->reader.ReadEntry();
+        if (!res) {  // end of file, the last record might be torn by a crash
+          file->done = true;
+          break;
+        }
+        if (res->opcode != Op::COMMAND && res->opcode != Op::EXPIRED)
+          continue;
+
+        auto tx_data = TransactionData::FromEntry(std::move(*res));
+        if (tx_data.IsGlobalCmd()) {
+          file->global = std::move(tx_data);
+        } else {
+          executor.Execute(tx_data.dbid, tx_data.command);
+          ++executed;
+        }
+      }
+    }
+
+    // Take the earliest global command in case a torn file is missing some of them.
+    FileReplay* next = nullptr;
+    for (auto& file : files) {
+      if (file->global && (!next || file->global->txid < next->global->txid))
+        next = file.get();
+    }
+    if (!next)
+      break;
+
+    TxId txid = next->global->txid;
+    executor.Execute(next->global->dbid, next->global->command);
+    ++executed;
+    for (auto& file : files) {
+      if (file->global && file->global->txid == txid)
+        file->global.reset();
+    }
+  }
+
+  LOG(INFO) << "Replayed " << executed << " journal records from " << files.size() << " files";
+  return {};
+}
+
+error_code DiskJournal::Open() {
+  CHECK(!IsOpen());
+
+  error_code ec;
+  fs::create_directories(dir_, ec);
+  if (ec)
+    return ec;
+
+  // New segments must follow all existing ones, so that they are replayed in order.
+  if (auto segments = ListSegments(dir_); !segments.empty())
+    last_segment_.store(max(last_segment_.load(), segments.rbegin()->first));
+  uint64_t segment = NextSegment();
+
+  vector<error_code> errors(shard_set->size());
+  shard_logs_.resize(shard_set->size());
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    auto& log = shard_logs_[shard->shard_id()];
+    log = make_unique<ShardLog>();
+    log->dir = dir_;
+    log->shard_id = shard->shard_id();
+    log->segment = segment;
+
+    errors[shard->shard_id()] = log->SwitchFile(segment);
+    if (errors[shard->shard_id()])
+      return;
+
+    journal_->StartInThread();
+    log->cb_id = journal_->RegisterOnChange(
+        [log = log.get()](const JournalItem& item, bool allow_await) {
+          log->OnJournalItem(item, allow_await);
+        });
+    log->flush_fb = fb2::Fiber("journal_flush", &ShardLog::FlushFb, log.get());
+  });
+
+  for (auto shard_ec : errors) {
+    if (shard_ec) {
+      Close();
+      return shard_ec;
+    }
+  }
+
+  LOG(INFO) << "Journaling to " << dir_ << " with segment " << segment;
+  return {};
+}
+
+void DiskJournal::Close() {
+  if (!IsOpen())
+    return;
+
+  shard_set->RunBlockingInParallel([this](EngineShard* shard) {
+    auto& log = shard_logs_[shard->shard_id()];
+    if (!log)
+      return;
+
+    if (log->cb_id)
+      journal_->UnregisterOnChange(log->cb_id);
+    log->closing = true;
+    log->waker.notifyAll();
+    log->flush_fb.JoinIfNeeded();
+    if (log->file)  // opened, but the flush fiber never started
+      log->file->Close();
+  });
+  shard_logs_.clear();
+}
+
+void DiskJournal::StartSegmentInShard(uint64_t segment) {
+  if (!IsOpen())
+    return;
+
+  if (auto& log = shard_logs_[EngineShard::tlocal()->shard_id()]; log)
+    log->segment = segment;
+}
+
+void DiskJournal::RemoveSegmentsBefore(uint64_t segment) {
+  for (const auto& [id, paths] : ListSegments(dir_)) {
+    if (id >= segment)
+      break;
+
+    for (const auto& path : paths) {
+      error_code ec;
+      fs::remove(path, ec);
+      LOG_IF(WARNING, ec) << "Failed to remove journal file " << path << ": " << ec.message();
+    }
+  }
+}
+
+}  // namespace journal
+}  // namespace dfly
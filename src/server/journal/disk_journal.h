@@ -0,0 +1,108 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace dfly {
+
+class Service;
+
+namespace journal {
+
+class Journal;
+
+#ifdef __linux__
+
+// DiskJournal makes the journal durable: every shard appends its journal records to its own file
+// and syncs it in groups, either periodically or after every write. Records that were added while
+// a write or a sync is in flight are committed together with the next one.
+//
+// The files are split into segments. Each snapshot starts a new segment in all shards at the
+// point in time it captures and stores its id, so after the snapshot is loaded, replaying the
+// segments from that id onwards restores the changes it is missing.
+class DiskJournal {
+ public:
+  DiskJournal(Journal* journal, std::string dir);
+  ~DiskJournal();
+
+  // Replay segments with ids starting from first_segment. Must be called before Open.
+  std::error_code Replay(uint64_t first_segment, Service* service);
+
+  // Start journaling in all shards and append records to a new segment.
+  std::error_code Open();
+
+  // Write out pending records, sync and close files.
+  void Close();
+
+  bool IsOpen() const {
+    return !shard_logs_.empty();
+  }
+
+  // Allocate an id for a segment that will be started by a snapshot.
+  uint64_t NextSegment() {
+    return last_segment_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // Records added to the shard from now on are written to the given segment. Does not preempt, so
+  // that the switch is atomic with the start of the snapshot in the shard.
+  void StartSegmentInShard(uint64_t segment);
+
+  // Remove files of the segments before the given one. Called once the snapshot that started it
+  // was saved.
+  void RemoveSegmentsBefore(uint64_t segment);
+
+ private:
+  struct ShardLog;
+
+  std::error_code ReplaySegment(const std::vector<std::string>& paths, Service* service);
+
+  Journal* journal_;
+  std::string dir_;
+  std::atomic_uint64_t last_segment_ = 0;
+  std::vector<std::unique_ptr<ShardLog>> shard_logs_;  // indexed by shard id
+};
+
+#else
+
+class DiskJournal {
+ public:
+  DiskJournal(Journal* journal, std::string dir) {
+  }
+
+  std::error_code Replay(uint64_t first_segment, Service* service) {
+    return {};
+  }
+
+  std::error_code Open() {
+    return std::make_error_code(std::errc::not_supported);
+  }
+
+  void Close() {
+  }
+
+  bool IsOpen() const {
+    return false;
+  }
+
+  uint64_t NextSegment() {
+    return 0;
+  }
+
+  void StartSegmentInShard(uint64_t segment) {
+  }
+
+  void RemoveSegmentsBefore(uint64_t segment) {
+  }
+};
+
+#endif  // __linux__
+
+}  // namespace journal
+}  // namespace dfly
@@ -63,6 +63,16 @@ void JournalExecutor::Execute(DbIndex dbid, journal::ParsedEntry::CmdData& cmd)
   Execute(cmd);
 }
 
+void JournalExecutor::ExecuteBatch(DbIndex dbid, absl::Span<CmdArgList> cmds) {
+  SelectDb(dbid);
+  size_t dispatched = service_->DispatchManyCommands(cmds, &conn_context_);
+
+  // DispatchManyCommands stops early when the server is paused.
+  for (auto args : cmds.subspan(dispatched)) {
+    service_->DispatchCommand(args, &conn_context_);
+  }
+}
+
 void JournalExecutor::FlushAll() {
   auto cmd = BuildFromParts("FLUSHALL");
   Execute(cmd);
@@ -25,6 +25,9 @@ class JournalExecutor {
   void Execute(DbIndex dbid, absl::Span<journal::ParsedEntry::CmdData> cmds);
   void Execute(DbIndex dbid, journal::ParsedEntry::CmdData& cmd);
 
+  // Execute independent commands together, squashing them into hops over the shards.
+  void ExecuteBatch(DbIndex dbid, absl::Span<CmdArgList> cmds);
+
   void FlushAll();  // Execute FLUSHALL.
   void FlushSlots(const cluster::SlotRange& slot_range);
 
@@ -35,6 +35,7 @@ void Journal::StartInThread() {
   EngineShard* shard = EngineShard::tlocal();
   if (shard) {
     shard->set_journal(this);
+    journal_slice.StartDiskBacklog(shard->shard_id());
   }
 }
 
@@ -52,6 +53,7 @@ error_code Journal::Close() {
     if (shard) {
       shard->set_journal(nullptr);
     }
+    journal_slice.CloseDiskBacklog();
   };
 
   shard_set->pool()->AwaitFiberOnAll(close_cb);
@@ -75,10 +77,22 @@ bool Journal::IsLSNInBuffer(LSN lsn) const {
   return journal_slice.IsLSNInBuffer(lsn);
 }
 
-std::string_view Journal::GetEntry(LSN lsn) const {
+bool Journal::IsLSNAvailable(LSN lsn) const {
+  return journal_slice.IsLSNAvailable(lsn);
+}
+
+void Journal::ResetBacklog() {
+  journal_slice.ResetBacklog();
+}
+
+std::optional<std::string> Journal::GetEntry(LSN lsn) const {
   return journal_slice.GetEntry(lsn);
 }
 
+BacklogStats Journal::GetBacklogStats() const {
+  return journal_slice.GetBacklogStats();
+}
+
 LSN Journal::GetLsn() const {
   return journal_slice.cur_lsn();
 }
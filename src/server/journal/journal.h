@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "server/journal/disk_backlog.h"
 #include "server/journal/types.h"
 #include "util/proactor_pool.h"
 
@@ -30,7 +31,13 @@ class Journal {
   bool HasRegisteredCallbacks() const;
 
   bool IsLSNInBuffer(LSN lsn) const;
-  std::string_view GetEntry(LSN lsn) const;
+  bool IsLSNAvailable(LSN lsn) const;
+  void ResetBacklog();
+
+  // Can preempt, see JournalSlice::GetEntry.
+  std::optional<std::string> GetEntry(LSN lsn) const;
+
+  BacklogStats GetBacklogStats() const;
 
   LSN GetLsn() const;
 
@@ -18,6 +18,11 @@
 
 ABSL_FLAG(uint32_t, shard_repl_backlog_len, 1 << 10,
           "The length of the circular replication log per shard");
+ABSL_FLAG(std::string, repl_backlog_dir, "",
+          "If set, the replication log of every shard is also appended to files in this "
+          "directory, so that replicas can partially sync after long disconnects");
+ABSL_FLAG(uint64_t, shard_repl_backlog_disk_bytes, 1ULL << 30,
+          "Bound on the size of the replication log files per shard, see repl_backlog_dir");
 
 namespace dfly {
 namespace journal {
@@ -31,6 +36,7 @@ namespace {
 string ShardName(std::string_view base, unsigned index) {
   return absl::StrCat(base, "-", absl::Dec(index, absl::kZeroPad4), ".log");
 }
+*/
 
 uint32_t NextPowerOf2(uint32_t x) {
   if (x < 2) {
@@ -40,8 +46,6 @@ uint32_t NextPowerOf2(uint32_t x) {
   return 1 << log;
 }
 
-*/
-
 }  // namespace
 
 #define CHECK_EC(x)                                                                 \
@@ -62,7 +66,28 @@ void JournalSlice::Init(unsigned index) {
     return;
 
   slice_index_ = index;
-  ring_buffer_.emplace(2);
+  ring_buffer_.emplace(NextPowerOf2(absl::GetFlag(FLAGS_shard_repl_backlog_len)));
+}
+
+void JournalSlice::StartDiskBacklog(unsigned shard_id) {
+  string dir = absl::GetFlag(FLAGS_repl_backlog_dir);
+  if (disk_backlog_ || dir.empty())
+    return;
+
+  disk_backlog_ = make_unique<DiskBacklog>();
+  error_code ec =
+      disk_backlog_->Open(dir, shard_id, absl::GetFlag(FLAGS_shard_repl_backlog_disk_bytes));
+  if (ec) {
+    LOG(ERROR) << "Could not open replication backlog in " << dir << ": " << ec.message();
+    disk_backlog_.reset();
+  }
+}
+
+void JournalSlice::CloseDiskBacklog() {
+  if (disk_backlog_) {
+    disk_backlog_->Close();
+    disk_backlog_.reset();
+  }
 }
 
 #if 0
@@ -128,18 +153,31 @@ error_code JournalSlice::Close() {
 
 bool JournalSlice::IsLSNInBuffer(LSN lsn) const {
   DCHECK(ring_buffer_);
-
-  if (ring_buffer_->empty()) {
+  if (lsn <= reset_lsn_)
     return false;
+
+  if (!ring_buffer_->empty() && (*ring_buffer_)[0].lsn <= lsn &&
+      lsn <= ((*ring_buffer_)[ring_buffer_->size() - 1].lsn)) {
+    return true;
   }
-  return (*ring_buffer_)[0].lsn <= lsn && lsn <= ((*ring_buffer_)[ring_buffer_->size() - 1].lsn);
+  return disk_backlog_ && disk_backlog_->Contains(lsn);
 }
 
-std::string_view JournalSlice::GetEntry(LSN lsn) const {
-  DCHECK(ring_buffer_ && IsLSNInBuffer(lsn));
-  auto start = (*ring_buffer_)[0].lsn;
-  DCHECK((*ring_buffer_)[lsn - start].lsn == lsn);
-  return (*ring_buffer_)[lsn - start].data;
+std::optional<std::string> JournalSlice::GetEntry(LSN lsn) {
+  DCHECK(ring_buffer_);
+  if (lsn <= reset_lsn_)
+    return std::nullopt;
+
+  if (!ring_buffer_->empty() && (*ring_buffer_)[0].lsn <= lsn &&
+      lsn <= ((*ring_buffer_)[ring_buffer_->size() - 1].lsn)) {
+    auto start = (*ring_buffer_)[0].lsn;
+    DCHECK((*ring_buffer_)[lsn - start].lsn == lsn);
+    return string{(*ring_buffer_)[lsn - start].data()};
+  }
+
+  if (disk_backlog_)
+    return disk_backlog_->Read(lsn);
+  return std::nullopt;
 }
 
 void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
@@ -151,13 +189,15 @@ void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
     item = &dummy;
     item->lsn = -1;
     item->opcode = entry.opcode;
-    item->data = "";
     item->slot = entry.slot;
   } else {
+    if (disk_backlog_ && await)
+      disk_backlog_->AwaitWritable();
+
     FiberAtomicGuard fg;
     // GetTail gives a pointer to a new tail entry in the buffer, possibly overriding the last entry
     // if the buffer is full.
-    item = &dummy;
+    item = ring_buffer_->GetTail(true);
     item->opcode = entry.opcode;
     item->lsn = lsn_++;
     item->cmd = entry.payload.cmd;
@@ -167,9 +207,13 @@ void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
     JournalWriter writer{&buf_sink};
     writer.Write(entry);
 
-    item->data = io::View(ring_serialize_buf_.InputBuffer());
+    // The arguments were serialized right from the command, this is the only copy of the record.
+    item->record = make_shared<const string>(io::View(ring_serialize_buf_.InputBuffer()));
     ring_serialize_buf_.Clear();
     VLOG(2) << "Writing item [" << item->lsn << "]: " << entry.ToString();
+
+    if (disk_backlog_)
+      disk_backlog_->Add(item->lsn, item->data());
   }
 
 #if 0
@@ -10,6 +10,7 @@
 
 #include "base/ring_buffer.h"
 #include "server/common.h"
+#include "server/journal/disk_backlog.h"
 #include "server/journal/types.h"
 
 namespace dfly {
@@ -23,6 +24,10 @@ class JournalSlice {
 
   void Init(unsigned index);
 
+  // Spill the replication backlog of the shard to disk if repl_backlog_dir is set.
+  void StartDiskBacklog(unsigned shard_id);
+  void CloseDiskBacklog();
+
   // This is always the LSN of the *next* journal entry.
   LSN cur_lsn() const {
     return lsn_;
@@ -51,20 +56,40 @@ class JournalSlice {
   }
 
   /// Returns whether the journal entry with this LSN is available
-  /// from the buffer.
+  /// from the buffer or the disk backlog.
   bool IsLSNInBuffer(LSN lsn) const;
-  std::string_view GetEntry(LSN lsn) const;
+
+  // Returns whether a replica that received all entries before lsn can continue from it.
+  bool IsLSNAvailable(LSN lsn) const {
+    return lsn > reset_lsn_ && (lsn == lsn_ || IsLSNInBuffer(lsn));
+  }
+
+  // Called when the data was replaced without journaling, e.g. by a full sync of a replica.
+  // Replicas can't continue from the entries recorded so far anymore.
+  void ResetBacklog() {
+    reset_lsn_ = lsn_;
+  }
+
+  // Returns the serialized entry or nullopt if it is not available anymore. Can preempt when the
+  // entry is read from the disk backlog.
+  std::optional<std::string> GetEntry(LSN lsn);
+
+  BacklogStats GetBacklogStats() const {
+    return disk_backlog_ ? disk_backlog_->GetStats() : BacklogStats{};
+  }
 
  private:
   // std::string shard_path_;
   // std::unique_ptr<LinuxFile> shard_file_;
   std::optional<base::RingBuffer<JournalItem>> ring_buffer_;
   base::IoBuf ring_serialize_buf_;
+  std::unique_ptr<DiskBacklog> disk_backlog_;
 
   mutable util::fb2::SharedMutex cb_mu_;  // to prevent removing callback during call
   std::list<std::pair<uint32_t, ChangeCallback>> change_cb_arr_;
 
   LSN lsn_ = 1;
+  LSN reset_lsn_ = 0;
 
   uint32_t slice_index_ = UINT32_MAX;
   uint32_t next_cb_id_ = 1;
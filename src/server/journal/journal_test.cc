@@ -125,5 +125,71 @@ TEST(Journal, WriteRead) {
   }
 }
 
+// Test reading entries back from compressed frames.
+TEST(Journal, WriteReadFrames) {
+  StoredSlices slices{};
+  auto slice = [v = &slices](auto... ss) { return StoreSlice(v, ss...); };
+  using Payload = Entry::Payload;
+
+  string value(1000, 'x');
+  std::vector<Entry> test_entries;
+  for (unsigned i = 0; i < 20; i++)
+    test_entries.push_back({i, Op::COMMAND, 0, 1, nullopt, Payload("SET", slice("key", value))});
+
+  // Batch the entries into frames of a few records each.
+  std::vector<uint8_t> frames;
+  for (unsigned i = 0; i < test_entries.size(); i += 3) {
+    io::StringSink sink;
+    JournalWriter writer{&sink};
+    for (unsigned j = i; j < min<size_t>(i + 3, test_entries.size()); j++)
+      writer.Write(test_entries[j]);
+    AppendJournalFrame(io::Buffer(sink.str()), &frames);
+  }
+
+  base::IoBuf buf;
+  buf.WriteAndCommit(frames.data(), frames.size());
+  io::BufSource source{&buf};
+  std::atomic_size_t raw_bytes = 0, wire_bytes = 0;
+  JournalFrameSource frame_source{&source, &raw_bytes, &wire_bytes};
+  JournalReader reader{&frame_source, 0};
+
+  for (auto& expected : test_entries) {
+    auto res = reader.ReadEntry();
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(expected.txid, res->txid);
+    ASSERT_EQ(ExtractPayload(expected), ExtractPayload(*res));
+  }
+
+  EXPECT_EQ(wire_bytes, frames.size());
+  EXPECT_GT(raw_bytes, 10 * wire_bytes);
+  EXPECT_FALSE(reader.ReadEntry().has_value());
+}
+
+// LSN markers with the master time are read back as plain LSN markers.
+TEST(Journal, WriteReadLsnTime) {
+  io::StringSink sink;
+  JournalWriter writer{&sink};
+  writer.Write(Entry{Op::LSN, 42});
+  Entry timed{Op::LSN, 43};
+  timed.opcode = Op::LSN_TIME;
+  timed.time_ms = 1700000000123;
+  writer.Write(timed);
+
+  io::BytesSource source{io::Buffer(sink.str())};
+  JournalReader reader{&source, 0};
+
+  auto res = reader.ReadEntry();
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(Op::LSN, res->opcode);
+  EXPECT_EQ(42u, res->lsn);
+  EXPECT_EQ(0u, res->time_ms);
+
+  res = reader.ReadEntry();
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(Op::LSN, res->opcode);
+  EXPECT_EQ(43u, res->lsn);
+  EXPECT_EQ(1700000000123u, res->time_ms);
+}
+
 }  // namespace journal
 }  // namespace dfly
@@ -4,6 +4,9 @@
 
 #include "server/journal/serializer.h"
 
+#include <absl/base/internal/endian.h>
+#include <lz4.h>
+
 #include <system_error>
 
 #include "base/logging.h"
@@ -58,7 +61,8 @@ void JournalWriter::Write(const journal::Entry::Payload& payload) {
 void JournalWriter::Write(const journal::Entry& entry) {
   // Check if entry has a new db index and we need to emit a SELECT entry.
   if (entry.opcode != journal::Op::SELECT && entry.opcode != journal::Op::LSN &&
-      entry.opcode != journal::Op::PING && (!cur_dbid_ || entry.dbid != *cur_dbid_)) {
+      entry.opcode != journal::Op::LSN_TIME && entry.opcode != journal::Op::PING &&
+      (!cur_dbid_ || entry.dbid != *cur_dbid_)) {
     Write(journal::Entry{journal::Op::SELECT, entry.dbid, entry.slot});
     cur_dbid_ = entry.dbid;
   }
@@ -72,6 +76,9 @@ void JournalWriter::Write(const journal::Entry& entry) {
       return Write(entry.dbid);
     case journal::Op::LSN:
       return Write(entry.lsn);
+    case journal::Op::LSN_TIME:
+      Write(entry.lsn);
+      return Write(entry.time_ms);
     case journal::Op::PING:
       return;
     case journal::Op::COMMAND:
@@ -195,8 +202,12 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
     return entry;
   }
 
-  if (opcode == journal::Op::LSN) {
+  if (opcode == journal::Op::LSN || opcode == journal::Op::LSN_TIME) {
     SET_OR_UNEXPECT(ReadUInt<uint64_t>(), entry.lsn);
+    if (opcode == journal::Op::LSN_TIME) {
+      SET_OR_UNEXPECT(ReadUInt<uint64_t>(), entry.time_ms);
+      entry.opcode = journal::Op::LSN;
+    }
     return entry;
   }
 
@@ -212,4 +223,81 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
   return entry;
 }
 
+void AppendJournalFrame(io::Bytes records, std::vector<uint8_t>* dest) {
+  DCHECK(!records.empty());
+  size_t start = dest->size();
+  int bound = LZ4_compressBound(records.size());
+  dest->resize(start + kJournalFrameHeaderSize + bound);
+
+  uint8_t* header = dest->data() + start;
+  char* payload = reinterpret_cast<char*>(header + kJournalFrameHeaderSize);
+  int comp_len = LZ4_compress_default(reinterpret_cast<const char*>(records.data()), payload,
+                                      records.size(), bound);
+
+  // Store incompressible records as is, so that the frame is never larger than needed.
+  if (comp_len <= 0 || size_t(comp_len) >= records.size()) {
+    memcpy(payload, records.data(), records.size());
+    comp_len = 0;
+  }
+
+  absl::little_endian::Store32(header, records.size());
+  absl::little_endian::Store32(header + 4, comp_len);
+  dest->resize(start + kJournalFrameHeaderSize + (comp_len ? comp_len : records.size()));
+}
+
+std::error_code JournalFrameSource::ReadFrame() {
+  uint8_t header[kJournalFrameHeaderSize];
+  size_t read;
+  SET_OR_RETURN(upstream_->ReadAtLeast(io::MutableBytes{header}, sizeof(header)), read);
+  records_.clear();
+  offs_ = 0;
+  if (read == 0)  // end of stream on a frame boundary
+    return {};
+  if (read < sizeof(header))
+    return make_error_code(errc::io_error);
+
+  uint32_t raw_len = absl::little_endian::Load32(header);
+  uint32_t comp_len = absl::little_endian::Load32(header + 4);
+  if (raw_len == 0 || (comp_len && comp_len > unsigned(LZ4_compressBound(raw_len))))
+    return make_error_code(errc::bad_message);
+
+  size_t payload_len = comp_len ? comp_len : raw_len;
+  std::vector<uint8_t>& payload = comp_len ? compressed_ : records_;
+  payload.resize(payload_len);
+  SET_OR_RETURN(upstream_->ReadAtLeast(io::MutableBytes{payload}, payload_len), read);
+  if (read < payload_len)
+    return make_error_code(errc::io_error);
+
+  if (comp_len) {
+    records_.resize(raw_len);
+    int res = LZ4_decompress_safe(reinterpret_cast<const char*>(compressed_.data()),
+                                  reinterpret_cast<char*>(records_.data()), comp_len, raw_len);
+    if (res < 0 || unsigned(res) != raw_len)
+      return make_error_code(errc::bad_message);
+  }
+
+  raw_bytes_->fetch_add(raw_len, memory_order_relaxed);
+  wire_bytes_->fetch_add(sizeof(header) + payload_len, memory_order_relaxed);
+  return {};
+}
+
+io::Result<size_t> JournalFrameSource::ReadSome(const iovec* v, uint32_t len) {
+  if (offs_ == records_.size()) {
+    if (auto ec = ReadFrame(); ec)
+      return make_unexpected(ec);
+  }
+
+  size_t read_total = 0;
+  while (offs_ < records_.size() && len > 0) {
+    size_t read_sz = min<size_t>(records_.size() - offs_, v->iov_len);
+    memcpy(v->iov_base, records_.data() + offs_, read_sz);
+    read_total += read_sz;
+    offs_ += read_sz;
+
+    ++v;
+    --len;
+  }
+  return read_total;
+}
+
 }  // namespace dfly
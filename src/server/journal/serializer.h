@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "io/io.h"
 #include "io/io_buf.h"
@@ -50,6 +52,11 @@ struct JournalReader {
   // Try reading entry from source.
   io::Result<journal::ParsedEntry> ReadEntry();
 
+  // Whether data that was already read from the source is waiting to be parsed.
+  bool HasBufferedData() const {
+    return buf_.InputLen() > 0;
+  }
+
  private:
   // Read from source until buffer contains at least num bytes.
   std::error_code EnsureRead(size_t num);
@@ -69,4 +76,33 @@ struct JournalReader {
   DbIndex dbid_;
 };
 
+// A compressed journal stream consists of frames, each holding a batch of journal records.
+// A frame starts with the 4 byte little endian lengths of the records and of the lz4
+// compressed payload that follows. A compressed length of zero means that the records did not
+// compress and are stored as is.
+constexpr size_t kJournalFrameHeaderSize = 8;
+
+// Append a frame with the compressed records to dest.
+void AppendJournalFrame(io::Bytes records, std::vector<uint8_t>* dest);
+
+// JournalFrameSource decompresses the frames read from upstream and exposes the records.
+// raw_bytes and wire_bytes are increased by the decompressed and received frame sizes.
+class JournalFrameSource : public io::Source {
+ public:
+  JournalFrameSource(io::Source* upstream, std::atomic_size_t* raw_bytes,
+                     std::atomic_size_t* wire_bytes)
+      : upstream_{upstream}, raw_bytes_{raw_bytes}, wire_bytes_{wire_bytes} {
+  }
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  std::error_code ReadFrame();
+
+  io::Source* upstream_;
+  std::atomic_size_t *raw_bytes_, *wire_bytes_;
+  std::vector<uint8_t> compressed_, records_;
+  size_t offs_ = 0;  // read offset into records_
+};
+
 }  // namespace dfly
@@ -5,10 +5,14 @@
 #include "server/journal/streamer.h"
 
 #include <absl/functional/bind_front.h>
+#include <absl/time/clock.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/cluster/cluster_defs.h"
+#include "server/engine_shard.h"
+#include "server/server_state.h"
+#include "server/tiered_storage.h"
 #include "util/fibers/synchronization.h"
 
 using namespace facade;
@@ -25,6 +29,14 @@ using namespace journal;
 
 namespace {
 
+constexpr uint64_t kLsnSampleIntervalMs = 10;
+constexpr size_t kMaxLsnSamples = 4096;
+
+uint64_t NowMs() {
+  using namespace chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 iovec IoVec(io::Bytes src) {
   return iovec{const_cast<uint8_t*>(src.data()), src.size()};
 }
@@ -33,8 +45,8 @@ uint32_t replication_stream_output_limit_cached = 64_KB;
 
 }  // namespace
 
-JournalStreamer::JournalStreamer(journal::Journal* journal, Context* cntx)
-    : cntx_(cntx), journal_(journal) {
+JournalStreamer::JournalStreamer(journal::Journal* journal, Context* cntx, bool compress)
+    : cntx_(cntx), journal_(journal), compress_(compress) {
   // cache the flag to avoid accessing it later.
   replication_stream_output_limit_cached = absl::GetFlag(FLAGS_replication_stream_output_limit);
 }
@@ -56,19 +68,33 @@ void JournalStreamer::Start(util::FiberSocketBase* dest, bool send_lsn) {
             return;
         }
 
-        if (!ShouldWrite(item)) {
+        if (!item.record || !ShouldWrite(item)) {
           return;
         }
 
-        Write(item.data);
+        CpuClassScope cpu_scope{CpuClass::REPLICATION};
+        WriteJournalRecord(item.record);
         time_t now = time(nullptr);
 
+        uint64_t now_ms = NowMs();
+        if (lsn_times_.empty() || now_ms - lsn_times_.back().second >= kLsnSampleIntervalMs) {
+          // Beyond the bound the lag is underestimated, which only matters for hopeless replicas.
+          if (lsn_times_.size() >= kMaxLsnSamples)
+            lsn_times_.pop_front();
+          lsn_times_.emplace_back(item.lsn, now_ms);
+        }
+
         // TODO: to chain it to the previous Write call.
         if (send_lsn && now - last_lsn_time_ > 3) {
           last_lsn_time_ = now;
           io::StringSink sink;
           JournalWriter writer(&sink);
-          writer.Write(Entry{journal::Op::LSN, item.lsn});
+          Entry entry{journal::Op::LSN, item.lsn};
+          if (send_lsn_time_) {
+            entry.opcode = journal::Op::LSN_TIME;
+            entry.time_ms = absl::GetCurrentTimeNanos() / 1000000;
+          }
+          writer.Write(entry);
           Write(sink.str());
         }
       });
@@ -85,11 +111,25 @@ size_t JournalStreamer::GetTotalBufferCapacities() const {
   return in_flight_bytes_ + pending_buf_.capacity();
 }
 
+double JournalStreamer::GetCompressionRatio() const {
+  return total_sent_ ? double(raw_bytes_) / total_sent_ : 1;
+}
+
 void JournalStreamer::Write(std::string_view str) {
   DCHECK(!str.empty());
   DVLOG(2) << "Writing " << str.size() << " bytes";
 
   size_t total_pending = pending_buf_.size() + str.size();
+  if (compress_) {
+    // Records written while a frame is in flight are batched into the next frame.
+    size_t tail = pending_buf_.size();
+    pending_buf_.resize(total_pending);
+    memcpy(pending_buf_.data() + tail, str.data(), str.size());
+    if (in_flight_bytes_ == 0)
+      SendFrame();
+    return;
+  }
+
   if (in_flight_bytes_ > 0) {
     // We can not flush data while there are in flight requests because AsyncWrite
     // is not atomic. Therefore, we just aggregate.
@@ -101,14 +141,19 @@ void JournalStreamer::Write(std::string_view str) {
 
   // If we do not have any in flight requests we send the string right a way.
   // We can not aggregate it since we do not know when the next update will follow.
-  // because of potential SOO with strings, we allocate explicitly on heap.
-  uint8_t* buf(new uint8_t[str.size()]);
+  Write(make_shared<const string>(str));
+}
 
-  // TODO: it is possible to remove these redundant copies if we adjust high level
-  // interfaces to pass reference-counted buffers.
-  memcpy(buf, str.data(), str.size());
+void JournalStreamer::Write(journal::SerializedRecord record) {
+  string_view str = *record;
+  if (compress_ || in_flight_bytes_ > 0)
+    return Write(str);
+
+  // The record is sent from the buffer shared with the journal and the other streamers.
+  size_t total_pending = pending_buf_.size() + str.size();
   in_flight_bytes_ += total_pending;
   total_sent_ += total_pending;
+  raw_bytes_ += total_pending;
 
   iovec v[2];
   unsigned next_buf_id = 0;
@@ -117,14 +162,11 @@ void JournalStreamer::Write(std::string_view str) {
     v[0] = IoVec(pending_buf_);
     ++next_buf_id;
   }
-  v[next_buf_id++] = IoVec(io::Bytes(buf, str.size()));
+  v[next_buf_id++] = IoVec(io::Buffer(str));
 
-  dest_->AsyncWrite(
-      v, next_buf_id,
-      [buf0 = std::move(pending_buf_), buf, this, len = total_pending](std::error_code ec) {
-        delete[] buf;
-        OnCompletion(ec, len);
-      });
+  dest_->AsyncWrite(v, next_buf_id,
+                    [buf0 = std::move(pending_buf_), record = std::move(record), this,
+                     len = total_pending](std::error_code ec) { OnCompletion(ec, len); });
 }
 
 void JournalStreamer::OnCompletion(std::error_code ec, size_t len) {
@@ -136,11 +178,17 @@ void JournalStreamer::OnCompletion(std::error_code ec, size_t len) {
     cntx_->ReportError(ec);
   } else if (in_flight_bytes_ == 0 && !pending_buf_.empty() && !IsStopped()) {
     // If everything was sent but we have a pending buf, flush it.
-    io::Bytes src(pending_buf_);
-    in_flight_bytes_ += src.size();
-    dest_->AsyncWrite(src, [buf = std::move(pending_buf_), this](std::error_code ec) {
-      OnCompletion(ec, buf.size());
-    });
+    if (compress_) {
+      SendFrame();
+    } else {
+      io::Bytes src(pending_buf_);
+      in_flight_bytes_ += src.size();
+      total_sent_ += src.size();
+      raw_bytes_ += src.size();
+      dest_->AsyncWrite(src, [buf = std::move(pending_buf_), this](std::error_code ec) {
+        OnCompletion(ec, buf.size());
+      });
+    }
   }
 
   // notify ThrottleIfNeeded or WaitForInflightToComplete that waits
@@ -151,17 +199,43 @@ void JournalStreamer::OnCompletion(std::error_code ec, size_t len) {
   waker_.notifyAll();
 }
 
+void JournalStreamer::SendFrame() {
+  DCHECK_EQ(in_flight_bytes_, 0u);
+  std::vector<uint8_t> frame;
+  AppendJournalFrame(pending_buf_, &frame);
+  raw_bytes_ += pending_buf_.size();
+  pending_buf_.clear();
+
+  io::Bytes src(frame);
+  in_flight_bytes_ += src.size();
+  total_sent_ += src.size();
+  dest_->AsyncWrite(src, [buf = std::move(frame), this](std::error_code ec) {
+    OnCompletion(ec, buf.size());
+  });
+}
+
+uint64_t JournalStreamer::LagMs(LSN acked_lsn) {
+  while (!lsn_times_.empty() && lsn_times_.front().first < acked_lsn)
+    lsn_times_.pop_front();
+  if (lsn_times_.empty())
+    return 0;
+  return NowMs() - lsn_times_.front().second;
+}
+
 void JournalStreamer::ThrottleIfNeeded() {
   if (IsStopped() || !IsStalled())
     return;
 
-  auto next =
-      chrono::steady_clock::now() + chrono::milliseconds(absl::GetFlag(FLAGS_replication_timeout));
+  auto start = chrono::steady_clock::now();
+  auto next = start + chrono::milliseconds(absl::GetFlag(FLAGS_replication_timeout));
   size_t inflight_start = in_flight_bytes_;
   size_t sent_start = total_sent_;
 
   std::cv_status status =
       waker_.await_until([this]() { return !IsStalled() || IsStopped(); }, next);
+  ++throttle_count_;
+  throttle_usec_ +=
+      chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
   if (status == std::cv_status::timeout) {
     LOG(WARNING) << "Stream timed out, inflight bytes/sent start: " << inflight_start << "/"
                  << sent_start << ", end: " << in_flight_bytes_ << "/" << total_sent_;
@@ -207,12 +281,22 @@ void RestoreStreamer::Run() {
   PrimeTable::Cursor cursor;
   uint64_t last_yield = 0;
   PrimeTable* pt = &db_array_[0]->prime;
+  run_start_ms_ = NowMs();
+  run_start_sent_ = GetTotalSent();
+
+  if (!db_array_[0]->slot_keys.empty()) {
+    RunOverSlotKeys();
+    return;
+  }
 
   do {
     if (fiber_cancelled_)
       return;
 
     bool written = false;
+    TieredStorage* tiered_storage = EngineShard::tlocal()->tiered_storage();
+    if (tiered_storage)
+      tiered_storage->StartReadBatch();
     cursor = db_slice_->Traverse(pt, cursor, [&](PrimeTable::bucket_iterator it) {
       db_slice_->FlushChangeToEarlierCallbacks(0 /*db_id always 0 for cluster*/,
                                                DbSlice::Iterator::FromPrime(it), snapshot_version_);
@@ -220,8 +304,13 @@ void RestoreStreamer::Run() {
         written = true;
       }
     });
+    if (tiered_storage)
+      tiered_storage->FlushReadBatch();
+    FlushDelayedEntries();
+
     if (written) {
       ThrottleIfNeeded();
+      ThrottleRate();
     }
 
     if (++last_yield >= 100) {
@@ -231,8 +320,66 @@ void RestoreStreamer::Run() {
   } while (cursor);
 }
 
+void RestoreStreamer::RunOverSlotKeys() {
+  const auto& slot_keys = db_array_[0]->slot_keys;
+  PrimeTable* pt = &db_array_[0]->prime;
+  uint64_t last_yield = 0;
+
+  // Buckets of the keys are written as a whole, like with the full traversal, so that the
+  // versions stay consistent for OnDbChange. Keys are copied because the index changes while we
+  // yield, keys added meanwhile are sent by OnDbChange or the journal.
+  vector<string> keys;
+  for (cluster::SlotId sid = 0; sid < cluster::SlotSet::kSlotsNumber; ++sid) {
+    if (!my_slots_.Contains(sid))
+      continue;
+
+    keys.assign(slot_keys[sid].begin(), slot_keys[sid].end());
+    bool written = false;
+    for (const string& key : keys) {
+      if (fiber_cancelled_)
+        return;
+
+      if (auto it = pt->Find(key); IsValid(it)) {
+        PrimeTable::bucket_iterator bit{it};
+        db_slice_->FlushChangeToEarlierCallbacks(0 /*db_id always 0 for cluster*/,
+                                                 DbSlice::Iterator::FromPrime(bit),
+                                                 snapshot_version_);
+        written |= WriteBucket(bit);
+      }
+
+      if (++last_yield >= 100) {
+        FlushDelayedEntries();
+        if (written) {
+          ThrottleIfNeeded();
+          ThrottleRate();
+        }
+        written = false;
+        ThisFiber::Yield();
+        last_yield = 0;
+      }
+    }
+    FlushDelayedEntries();
+    if (written) {
+      ThrottleIfNeeded();
+      ThrottleRate();
+    }
+  }
+}
+
+void RestoreStreamer::ThrottleRate() {
+  if (rate_limit_ == 0)
+    return;
+
+  // Sleep in short steps to notice cancellation
+  uint64_t deadline = run_start_ms_ + (GetTotalSent() - run_start_sent_) * 1000 / rate_limit_;
+  for (uint64_t now = NowMs(); !fiber_cancelled_ && now < deadline; now = NowMs())
+    ThisFiber::SleepFor(chrono::milliseconds(std::min<uint64_t>(deadline - now, 10)));
+}
+
 void RestoreStreamer::SendFinalize(long attempt) {
   VLOG(1) << "RestoreStreamer LSN opcode for : " << db_slice_->shard_id() << " attempt " << attempt;
+  // Changes after the traversal may have added offloaded values
+  FlushDelayedEntries();
   journal::Entry entry(journal::Op::LSN, attempt);
 
   io::StringSink sink;
@@ -296,7 +443,7 @@ bool RestoreStreamer::WriteBucket(PrimeTable::bucket_iterator it) {
 
         uint64_t expire = 0;
         if (pv.HasExpire()) {
-          auto eit = db_slice_->databases()[0]->expire.Find(it->first);
+          auto eit = db_slice_->databases()[0]->FindExpire(it);
           expire = db_slice_->ExpireTime(eit);
         }
 
@@ -326,23 +473,70 @@ void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req
 
 void RestoreStreamer::WriteEntry(string_view key, const PrimeValue& pk, const PrimeValue& pv,
                                  uint64_t expire_ms) {
+  // Cool values are still kept in memory
+  if (pv.IsExternal() && pv.IsCool())
+    return WriteEntry(key, pk, pv.GetCool().record->value, expire_ms);
+
+  if (pv.IsExternal()) {
+    // We can't block here, the value is read as it is stored and written by FlushDelayedEntries
+    TieredStorage* tiered_storage = EngineShard::tlocal()->tiered_storage();
+    delayed_entries_.push_back({string(key), pv.ObjType(), expire_ms, pk.IsSticky(),
+                                tiered_storage->ReadSerialized(0, key, pv)});
+    return;
+  }
+
+  io::StringSink value_dump_sink;
+  SerializerBase::DumpObject(pv, &value_dump_sink);
+  WriteRestore(key, expire_ms, value_dump_sink.str(), pk.IsSticky());
+}
+
+void RestoreStreamer::WriteRestore(string_view key, uint64_t expire_ms, string_view dump,
+                                   bool sticky) {
   absl::InlinedVector<string_view, 5> args;
   args.push_back(key);
 
   string expire_str = absl::StrCat(expire_ms);
   args.push_back(expire_str);
-
-  io::StringSink value_dump_sink;
-  SerializerBase::DumpObject(pv, &value_dump_sink);
-  args.push_back(value_dump_sink.str());
-
+  args.push_back(dump);
   args.push_back("ABSTTL");  // Means expire string is since epoch
 
-  if (pk.IsSticky()) {
+  if (sticky) {
     args.push_back("STICK");
   }
 
   WriteCommand(journal::Entry::Payload("RESTORE", ArgSlice(args)));
+  keys_written_++;
+}
+
+void RestoreStreamer::WriteJournalRecord(const journal::SerializedRecord& record) {
+  if (delayed_entries_.empty() && held_records_.empty())
+    Write(record);
+  else
+    held_records_.emplace_back(record);
+}
+
+void RestoreStreamer::FlushDelayedEntries() {
+  // Changed buckets can add more entries while we wait for the reads
+  while (!delayed_entries_.empty()) {
+    vector<DelayedEntry> entries = std::move(delayed_entries_);
+    delayed_entries_.clear();
+
+    for (DelayedEntry& entry : entries) {
+      // Offloaded containers are stored in the DUMP format already
+      string value = entry.value.Get();
+      string_view dump = value;
+      io::StringSink sink;
+      if (entry.obj_type == OBJ_STRING) {
+        SerializerBase::DumpString(value, &sink);
+        dump = sink.str();
+      }
+      WriteRestore(entry.key, entry.expire_ms, dump, entry.sticky);
+    }
+  }
+
+  for (const journal::SerializedRecord& record : held_records_)
+    Write(record);
+  held_records_.clear();
 }
 
 void RestoreStreamer::WriteCommand(journal::Entry::Payload cmd_payload) {
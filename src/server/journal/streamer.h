@@ -4,11 +4,14 @@
 
 #pragma once
 
+#include <deque>
+
 #include "server/common.h"
 #include "server/db_slice.h"
 #include "server/journal/journal.h"
 #include "server/journal/serializer.h"
 #include "server/rdb_save.h"
+#include "util/fibers/future.h"
 
 namespace dfly {
 
@@ -16,7 +19,8 @@ namespace dfly {
 // journal listener and writes them to a destination sink in a separate fiber.
 class JournalStreamer {
  public:
-  JournalStreamer(journal::Journal* journal, Context* cntx);
+  // If compress is set, the records are sent in lz4 compressed frames, see AppendJournalFrame.
+  JournalStreamer(journal::Journal* journal, Context* cntx, bool compress = false);
   virtual ~JournalStreamer();
 
   // Self referential.
@@ -32,17 +36,49 @@ class JournalStreamer {
 
   size_t GetTotalBufferCapacities() const;
 
+  // Ratio of journal record bytes to bytes sent over the wire.
+  double GetCompressionRatio() const;
+
+  // Attach the current time to LSN markers, so that the consumer can derive its lag.
+  void SetSendLsnTime(bool send_time) {
+    send_lsn_time_ = send_time;
+  }
+
+  // Milliseconds since the oldest record with lsn at or after acked_lsn was written, 0 if all
+  // written records were acknowledged.
+  uint64_t LagMs(LSN acked_lsn);
+
+  // Number of times and total microseconds the journal callback was blocked by a full buffer.
+  uint64_t GetThrottleCount() const {
+    return throttle_count_;
+  }
+
+  uint64_t GetThrottleUsec() const {
+    return throttle_usec_;
+  }
+
+  // Bytes passed to the socket so far.
+  size_t GetTotalSent() const {
+    return total_sent_;
+  }
+
  protected:
-  // TODO: we copy the string on each write because JournalItem may be passed to multiple
-  // streamers so we can not move it. However, if we would either wrap JournalItem in shared_ptr
-  // or wrap JournalItem::data in shared_ptr, we can avoid the cost of copying strings.
-  // Also, for small strings it's more peformant to copy to the intermediate buffer than
-  // to issue an io operation.
+  // Copies str into the pending buffer, or into a buffer of its own if nothing is in flight.
+  // For small strings it's more peformant to copy to the intermediate buffer than to issue an io
+  // operation.
   void Write(std::string_view str);
 
+  // Same, but sends the shared record without copying it if nothing is in flight.
+  void Write(journal::SerializedRecord record);
+
   // Blocks the if the consumer if not keeping up.
   void ThrottleIfNeeded();
 
+  // Called with the serialized journal records that pass ShouldWrite.
+  virtual void WriteJournalRecord(const journal::SerializedRecord& record) {
+    Write(record);
+  }
+
   virtual bool ShouldWrite(const journal::JournalItem& item) const {
     return !IsStopped();
   }
@@ -55,6 +91,9 @@ class JournalStreamer {
  private:
   void OnCompletion(std::error_code ec, size_t len);
 
+  // Compress pending_buf_ into a single frame and send it.
+  void SendFrame();
+
   bool IsStopped() const {
     return cntx_->IsCancelled();
   }
@@ -64,8 +103,16 @@ class JournalStreamer {
   journal::Journal* journal_;
   std::vector<uint8_t> pending_buf_;
   size_t in_flight_bytes_ = 0, total_sent_ = 0;
+  bool compress_ = false;
+  size_t raw_bytes_ = 0;  // record bytes sent, equal to total_sent_ if not compressed
 
   time_t last_lsn_time_ = 0;
+  bool send_lsn_time_ = false;
+
+  // Write times of sampled lsns in ms, to compute the lag of acknowledgements.
+  std::deque<std::pair<LSN, uint64_t>> lsn_times_;
+
+  uint64_t throttle_count_ = 0, throttle_usec_ = 0;
   util::fb2::EventCount waker_;
   uint32_t journal_cb_id_{0};
 };
@@ -90,7 +137,31 @@ class RestoreStreamer : public JournalStreamer {
     return snapshot_finished_;
   }
 
+  // Limits the traversal of Run() to bytes_per_sec on average, 0 means no limit.
+  // Changes from OnDbChange and the journal are not limited.
+  void SetRateLimit(uint64_t bytes_per_sec) {
+    rate_limit_ = bytes_per_sec;
+  }
+
+  // Number of RESTORE entries written, including entries sent again after a change.
+  size_t GetKeysWritten() const {
+    return keys_written_;
+  }
+
  private:
+  // Sleeps while the bytes sent since the start of Run() are above the rate limit
+  void ThrottleRate();
+
+  // Holds back journal records while offloaded values are read, see FlushDelayedEntries
+  void WriteJournalRecord(const journal::SerializedRecord& record) override;
+
+  // Waits for the reads of offloaded values and writes their RESTORE commands, followed by the
+  // journal records that were held back meanwhile. Must be called from a fiber that can block.
+  void FlushDelayedEntries();
+
+  // Same as Run, but visits only the keys of my_slots_ with the slot key index of the table
+  void RunOverSlotKeys();
+
   void OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req);
   bool ShouldWrite(const journal::JournalItem& item) const override;
   bool ShouldWrite(std::string_view key) const;
@@ -99,14 +170,33 @@ class RestoreStreamer : public JournalStreamer {
   // Returns whether anything was written
   bool WriteBucket(PrimeTable::bucket_iterator it);
   void WriteEntry(string_view key, const PrimeValue& pk, const PrimeValue& pv, uint64_t expire_ms);
+  void WriteRestore(std::string_view key, uint64_t expire_ms, std::string_view dump, bool sticky);
   void WriteCommand(journal::Entry::Payload cmd_payload);
 
+  // Offloaded value that is streamed as stored on disk instead of being loaded into memory.
+  // Commands on the key must follow its RESTORE, so journal records are held back until then.
+  struct DelayedEntry {
+    std::string key;
+    CompactObjType obj_type;
+    uint64_t expire_ms;
+    bool sticky;
+    util::fb2::Future<std::string> value;
+  };
+
   DbSlice* db_slice_;
   DbTableArray db_array_;
   uint64_t snapshot_version_ = 0;
   cluster::SlotSet my_slots_;
   bool fiber_cancelled_ = false;
   bool snapshot_finished_ = false;
+
+  uint64_t rate_limit_ = 0;
+  uint64_t run_start_ms_ = 0;
+  size_t run_start_sent_ = 0;
+  size_t keys_written_ = 0;
+
+  std::vector<DelayedEntry> delayed_entries_;
+  std::vector<journal::SerializedRecord> held_records_;
 };
 
 }  // namespace dfly
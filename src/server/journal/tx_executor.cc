@@ -53,6 +53,7 @@ void TransactionData::AddEntry(journal::ParsedEntry&& entry) {
   switch (entry.opcode) {
     case journal::Op::LSN:
       lsn = entry.lsn;
+      lsn_time_ms = entry.time_ms;
       return;
     case journal::Op::PING:
     case journal::Op::FIN:
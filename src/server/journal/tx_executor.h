@@ -52,6 +52,7 @@ struct TransactionData {
 
   journal::Op opcode = journal::Op::NOOP;
   uint64_t lsn = 0;
+  uint64_t lsn_time_ms = 0;  // master time of an LSN marker, 0 if not sent
 };
 
 // Utility for reading TransactionData from a journal reader.
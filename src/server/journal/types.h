@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <variant>
@@ -21,7 +22,8 @@ enum class Op : uint8_t {
   COMMAND = 10,
   PING = 13,
   FIN = 14,
-  LSN = 15
+  LSN = 15,
+  LSN_TIME = 16,  // LSN with the unix time in ms, read back as LSN with time_ms set
 };
 
 struct EntryBase {
@@ -31,6 +33,7 @@ struct EntryBase {
   uint32_t shard_cnt;
   std::optional<cluster::SlotId> slot;
   LSN lsn{0};
+  uint64_t time_ms{0};  // for LSN_TIME
 };
 
 // This struct represents a single journal entry.
@@ -89,12 +92,20 @@ struct ParsedEntry : public EntryBase {
   std::string ToString() const;
 };
 
+// A serialized journal record. It is shared by the ring buffer and all the consumers of the
+// journal, so it is written once and never copied per replica or migration.
+using SerializedRecord = std::shared_ptr<const std::string>;
+
 struct JournalItem {
   LSN lsn;
   Op opcode;
-  std::string data;
+  SerializedRecord record;  // null for NOOP
   std::string_view cmd;
   std::optional<cluster::SlotId> slot;
+
+  std::string_view data() const {
+    return record ? std::string_view{*record} : std::string_view{};
+  }
 };
 
 using ChangeCallback = std::function<void(const JournalItem&, bool await)>;
@@ -4,6 +4,8 @@
 
 #include "server/json_family.h"
 
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/inlined_vector.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
@@ -21,6 +23,8 @@
 #include "core/flatbuffers.h"
 #include "core/json/json_object.h"
 #include "core/json/path.h"
+#include "core/json/simd_parser.h"
+#include "core/lru.h"
 #include "core/mi_memory_resource.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/op_status.h"
@@ -30,6 +34,7 @@
 #include "server/detail/wrapped_json_path.h"
 #include "server/error.h"
 #include "server/journal/journal.h"
+#include "server/reply_cache.h"
 #include "server/search/doc_index.h"
 #include "server/string_family.h"
 #include "server/tiered_storage.h"
@@ -38,6 +43,9 @@
 ABSL_FLAG(bool, jsonpathv2, true,
           "If true uses Dragonfly jsonpath implementation, "
           "otherwise uses legacy jsoncons implementation.");
+ABSL_FLAG(bool, json_simd_parse, false,
+          "If true, parses JSON values with simdjson and falls back to jsoncons for inputs "
+          "it rejects.");
 
 namespace dfly {
 
@@ -59,6 +67,10 @@ class JsonMemTracker {
   }
 
   void SetJsonSize(PrimeValue& pv, bool is_op_set) {
+    // Flat json is allocated at once and does not track its size yet
+    if (JsonEnconding() == kEncodingJsonFlat) {
+      return;
+    }
     const size_t current = static_cast<MiMemoryResource*>(CompactObj::memory_resource())->used();
     int64_t diff = static_cast<int64_t>(current) - static_cast<int64_t>(start_size_);
     // If the diff is 0 it means the object use the same memory as before. No action needed.
@@ -90,13 +102,57 @@ ParseResult<JsonExpression> ParseJsonPathAsExpression(std::string_view path) {
   return res;
 }
 
+// Per thread cache of parsed paths, clients usually query a small set of distinct paths.
+class JsonPathCache {
+ public:
+  static constexpr uint32_t kCapacity = 128;
+
+  JsonPathCache() : lru_{kCapacity, PMR_NS::get_default_resource()} {
+  }
+
+  const json::Path* Find(std::string_view path_str) {
+    auto it = paths_.find(path_str);
+    if (it == paths_.end())
+      return nullptr;
+    lru_.Put(it->first);
+    return &it->second;
+  }
+
+  void Insert(std::string_view path_str, const json::Path& path) {
+    // Copies of function segments share their aggregation state, so they are not cached
+    auto is_function = [](const json::PathSegment& segment) {
+      return segment.type() == json::SegmentType::FUNCTION;
+    };
+    if (any_of(path.begin(), path.end(), is_function))
+      return;
+
+    if (paths_.size() >= kCapacity) {
+      std::string tail = *lru_.GetTail();
+      lru_.Remove(tail);
+      paths_.erase(tail);
+    }
+
+    auto it = paths_.emplace(path_str, path).first;
+    lru_.Put(it->first);
+  }
+
+ private:
+  Lru<std::string> lru_;
+  absl::flat_hash_map<std::string, json::Path> paths_;
+};
+
 ParseResult<WrappedJsonPath> ParseJsonPath(StringOrView path, JsonPathType path_type) {
   if (absl::GetFlag(FLAGS_jsonpathv2)) {
+    static thread_local JsonPathCache cache;
+    if (const json::Path* cached = cache.Find(path.view()); cached)
+      return WrappedJsonPath{*cached, std::move(path), path_type};
+
     auto path_result = json::ParsePath(path.view());
     if (!path_result) {
       VLOG(1) << "Invalid Json path: " << path << ' ' << path_result.error() << std::endl;
       return nonstd::make_unexpected(kSyntaxErr);
     }
+    cache.Insert(path.view(), path_result.value());
     return WrappedJsonPath{std::move(path_result).value(), std::move(path), path_type};
   }
 
@@ -316,25 +372,38 @@ bool JsonAreEquals(const JsonType& lhs, const JsonType& rhs) {
   }
 }
 
-OpResult<DbSlice::AddOrFindResult> SetJson(const OpArgs& op_args, string_view key, JsonType value) {
-  auto& db_slice = op_args.GetDbSlice();
-
-  auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+// Sets key to a finished flat json buffer
+OpResult<DbSlice::AddOrFindResult> SetFlatJson(const OpArgs& op_args, string_view key,
+                                               const flexbuffers::Builder& fbb) {
+  auto op_res = op_args.GetDbSlice().AddOrFind(op_args.db_cntx, key);
   RETURN_ON_BAD_STATUS(op_res);
 
   auto& res = *op_res;
 
   op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, res.it->second);
+  const auto& buf = fbb.GetBuffer();
+  res.it->second.SetJson(buf.data(), buf.size());
+  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, res.it->second);
+  return std::move(res);
+}
 
+OpResult<DbSlice::AddOrFindResult> SetJson(const OpArgs& op_args, string_view key, JsonType value) {
   if (JsonEnconding() == kEncodingJsonFlat) {
     flexbuffers::Builder fbb;
     json::FromJsonType(value, &fbb);
     fbb.Finish();
-    const auto& buf = fbb.GetBuffer();
-    res.it->second.SetJson(buf.data(), buf.size());
-  } else {
-    res.it->second.SetJson(std::move(value));
+    return SetFlatJson(op_args, key, fbb);
   }
+
+  auto& db_slice = op_args.GetDbSlice();
+
+  auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  RETURN_ON_BAD_STATUS(op_res);
+
+  auto& res = *op_res;
+
+  op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, res.it->second);
+  res.it->second.SetJson(std::move(value));
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, res.it->second);
   return std::move(res);
 }
@@ -387,6 +456,8 @@ std::optional<JsonType> JsonFromString(std::string_view input) {
 
 // Use this method on the shard thread
 std::optional<JsonType> ShardJsonFromString(std::string_view input) {
+  if (absl::GetFlag(FLAGS_json_simd_parse))
+    return json::ParseSimd(input, CompactObj::memory_resource());
   return dfly::JsonFromString(input, CompactObj::memory_resource());
 }
 
@@ -620,6 +691,38 @@ OpResult<JsonCallbackResult<optional<T>>> JsonMutateOperation(const OpArgs& op_a
 
   PrimeValue& pv = it_res->it->second;
 
+  if (JsonEnconding() == kEncodingJsonFlat) {
+    op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, pv);
+
+    absl::Span<uint8_t> buf = pv.GetJsonFlat();
+    FlatJson flat_json = flexbuffers::GetRoot(buf.data(), buf.size());
+    flexbuffers::Builder fbb;
+
+    OpResult<JsonCallbackResult<optional<T>>> mutate_res;
+    if (options.verify_op) {  // Verification runs on jsoncons trees only
+      JsonType json_val = json::FromFlat(flat_json);
+      mutate_res = json_path.Mutate(&json_val, cb, options.cb_result_options);
+      if (mutate_res) {
+        options.verify_op(json_val);
+        json::FromJsonType(json_val, &fbb);
+        fbb.Finish();
+      }
+    } else {
+      mutate_res = json_path.Mutate(flat_json, &fbb, cb, options.cb_result_options);
+    }
+
+    if (fbb.GetSize() > 0) {  // Could not be mutated in place
+      const auto& new_buf = fbb.GetBuffer();
+      pv.SetJson(new_buf.data(), new_buf.size());
+    }
+
+    it_res->post_updater.Run();
+    op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
+
+    RETURN_ON_BAD_STATUS(mutate_res);
+    return mutate_res;
+  }
+
   JsonType* json_val = pv.GetJson();
   DCHECK(json_val) << "should have a valid JSON object for key '" << key << "' the type for it is '"
                    << pv.ObjType() << "'";
@@ -647,6 +750,27 @@ bool LegacyModeIsEnabled(const std::vector<std::pair<std::string_view, WrappedJs
                      [](auto& parsed_path) { return parsed_path.second.IsLegacyModePath(); });
 }
 
+// Returns the serialized reply of JSON.GET of the whole document from the reply cache of the
+// shard, or serializes the reply and caches it.
+OpResult<ReplyCache::Reply> OpJsonGetCached(const OpArgs& op_args, string_view key) {
+  auto& db_slice = op_args.GetDbSlice();
+  auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
+  if (!it_res.ok())
+    return it_res.status();
+
+  uint64_t version = it_res->GetVersion();
+  DbIndex db = op_args.db_cntx.db_index;
+  ReplyCache& cache = db_slice.reply_cache();
+  if (auto reply = cache.Get(db, key, ReplyCache::kJsonGet, false, version); reply)
+    return reply;
+
+  // The bulk string reply is the same in both protocol versions.
+  const JsonType* json_val = it_res.value()->second.GetJson();
+  auto reply = make_shared<const string>(SerializeBulkString(json_val->to_string()));
+  cache.Put(db, key, ReplyCache::kJsonGet, false, version, reply);
+  return reply;
+}
+
 OpResult<std::string> OpJsonGet(const OpArgs& op_args, string_view key,
                                 const JsonGetParams& params) {
   OpResult<JsonType*> result = GetJson(op_args, key);
@@ -1204,51 +1328,68 @@ auto OpArrIndex(const OpArgs& op_args, string_view key, const WrappedJsonPath& j
   return JsonEvaluateOperation<std::optional<long>>(op_args, key, json_path, std::move(cb));
 }
 
-// Returns string vector that represents the query result of each supplied key.
-std::vector<std::optional<std::string>> OpJsonMGet(const WrappedJsonPath& json_path,
-                                                   const Transaction* t, EngineShard* shard) {
+// Query results of JSON.MGET on a shard, serialized into a single buffer.
+struct MGetShardResult {
+  std::string buf;
+  // Offset and length in buf of the result of each key of the shard, unset for missing keys.
+  std::vector<std::optional<std::pair<size_t, size_t>>> values;
+};
+
+MGetShardResult OpJsonMGet(const WrappedJsonPath& json_path, const Transaction* t,
+                           EngineShard* shard) {
   ShardArgs args = t->GetShardArgs(shard->shard_id());
   DCHECK(!args.Empty());
-  std::vector<std::optional<std::string>> response(args.Size());
 
-  auto& db_slice = t->GetDbSlice(shard->shard_id());
-  unsigned index = 0;
-  for (string_view key : args) {
-    auto it_res = db_slice.FindReadOnly(t->GetDbContext(), key, OBJ_JSON);
-    auto& dest = response[index++];
-    if (!it_res.ok())
-      continue;
+  absl::InlinedVector<string_view, 32> keys;
+  keys.reserve(args.Size());
+  for (string_view key : args)
+    keys.push_back(key);
 
-    JsonType* json_val = it_res.value()->second.GetJson();
-    DCHECK(json_val) << "should have a valid JSON object for key " << key;
+  // The lookups are batched to overlap their cache misses.
+  absl::InlinedVector<OpResult<DbSlice::ConstIterator>, 32> it_results(keys.size());
+  auto& db_slice = t->GetDbSlice(shard->shard_id());
+  db_slice.FindManyReadOnly(t->GetDbContext(), keys, OBJ_JSON, absl::MakeSpan(it_results));
 
-    auto cb = [](std::string_view, const JsonType& val) { return val; };
+  MGetShardResult response;
+  response.values.resize(keys.size());
 
-    auto eval_wrapped = [&json_val,
-                         &cb](const WrappedJsonPath& json_path) -> std::optional<JsonType> {
-      auto eval_result = json_path.Evaluate<JsonType>(json_val, std::move(cb));
+  // Legacy paths return only the last match.
+  bool is_legacy = json_path.IsLegacyModePath();
+  std::string& buf = response.buf;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!it_results[i].ok())
+      continue;
 
-      if (eval_result.IsV1()) {
-        return eval_result.AsV1();
+    JsonType* json_val = it_results[i].value()->second.GetJson();
+    DCHECK(json_val) << "should have a valid JSON object for key " << keys[i];
+
+    // Matches are serialized right away instead of being copied into a result array.
+    size_t start = buf.size();
+    bool matched = false;
+    auto cb = [&](std::string_view, const JsonType& val) {
+      if (is_legacy)
+        buf.resize(start);
+      else
+        buf.push_back(matched ? ',' : '[');
+      matched = true;
+
+      std::error_code ec;
+      val.dump(buf, {}, ec);
+      if (ec) {
+        VLOG(1) << "Failed to dump JSON to string with the error: " << ec.message();
       }
-
-      return JsonType{eval_result.AsV2()};
+      return Nothing{};
     };
+    json_path.Evaluate<Nothing>(json_val, cb);
 
-    auto eval_result = eval_wrapped(json_path);
-
-    if (!eval_result) {
-      continue;
-    }
-
-    std::string str;
-    std::error_code ec;
-    eval_result->dump(str, {}, ec);
-    if (ec) {
-      VLOG(1) << "Failed to dump JSON array to string with the error: " << ec.message();
+    if (is_legacy) {
+      if (!matched)
+        continue;
+    } else {
+      buf.append(matched ? "]" : "[]");
     }
 
-    dest = std::move(str);
+    response.values[i].emplace(start, buf.size() - start);
   }
 
   return response;
@@ -1273,10 +1414,19 @@ auto OpResp(const OpArgs& op_args, string_view key, const WrappedJsonPath& json_
 OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
                      const WrappedJsonPath& json_path, std::string_view json_str,
                      bool is_nx_condition, bool is_xx_condition) {
-  std::optional<JsonType> parsed_json = ShardJsonFromString(json_str);
-  if (!parsed_json) {
-    VLOG(1) << "got invalid JSON string '" << json_str << "' cannot be saved";
-    return OpStatus::SYNTAX_ERR;
+  // Whole flat documents are encoded straight from the simdjson tape, without a jsoncons tree
+  flexbuffers::Builder flat_json;
+  bool is_flat_parsed = json_path.RefersToRootElement() && JsonEnconding() == kEncodingJsonFlat &&
+                        absl::GetFlag(FLAGS_json_simd_parse) &&
+                        json::ParseSimdFlat(json_str, &flat_json);
+
+  std::optional<JsonType> parsed_json;
+  if (!is_flat_parsed) {
+    parsed_json = ShardJsonFromString(json_str);
+    if (!parsed_json) {
+      VLOG(1) << "got invalid JSON string '" << json_str << "' cannot be saved";
+      return OpStatus::SYNTAX_ERR;
+    }
   }
 
   // The whole key should be replaced.
@@ -1303,7 +1453,9 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
     // of this function. Because of this, the memory tracking will be off. Another solution here,
     // is to use absl::Cleanup and dispatch another Find() but that's too complicated because then
     // you need to take into account the order of destructors.
-    OpResult<DbSlice::AddOrFindResult> st = SetJson(op_args, key, parsed_json.value());
+    OpResult<DbSlice::AddOrFindResult> st = is_flat_parsed
+                                                ? SetFlatJson(op_args, key, flat_json)
+                                                : SetJson(op_args, key, parsed_json.value());
     if (st.status() != OpStatus::OK) {
       return st.status();
     }
@@ -1365,26 +1517,43 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
   return operation_result;
 }
 
-OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
-                     std::string_view json_str, bool is_nx_condition, bool is_xx_condition) {
-  auto res_json_path = ParseJsonPath(path);
-  if (!res_json_path) {
-    return OpStatus::SYNTAX_ERR;  // TODO(Return initial error)
-  }
-  return OpSet(op_args, key, path, res_json_path.value(), json_str, is_nx_condition,
-               is_xx_condition);
-}
-
 OpStatus OpMSet(const OpArgs& op_args, const ShardArgs& args) {
   DCHECK_EQ(args.Size() % 3, 0u);
 
+  // Sets invalidate iterators, so the buckets of the keys are prefetched in batches ahead of
+  // the mutable lookups instead.
+  constexpr size_t kPrefetchBatch = 32;
+  vector<string_view> keys;
+  keys.reserve(args.Size() / 3);
+  for (auto it = args.begin(); it != args.end(); ++it, ++it, ++it)
+    keys.push_back(*it);
+
+  // Batches usually set the same path on all keys, so it is parsed once per run of equal paths.
+  optional<WrappedJsonPath> json_path;
+  string_view parsed_path;
+
   OpStatus result = OpStatus::OK;
   size_t stored = 0;
   for (auto it = args.begin(); it != args.end();) {
+    if (stored % kPrefetchBatch == 0) {
+      size_t len = min(kPrefetchBatch, keys.size() - stored);
+      op_args.GetDbSlice().PrefetchKeys(op_args.db_cntx.db_index, {keys.data() + stored, len});
+    }
+
     string_view key = *(it++);
     string_view path = *(it++);
     string_view value = *(it++);
-    if (auto res = OpSet(op_args, key, path, value, false, false); !res.ok()) {
+    if (!json_path || path != parsed_path) {
+      auto res = ParseJsonPath(path);
+      if (!res) {
+        result = OpStatus::SYNTAX_ERR;
+        break;
+      }
+      json_path.emplace(std::move(res.value()));
+      parsed_path = path;
+    }
+
+    if (auto res = OpSet(op_args, key, path, *json_path, value, false, false); !res.ok()) {
       result = res.status();
       break;
     }
@@ -1583,7 +1752,7 @@ void JsonFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
 
   Transaction* transaction = cntx->transaction;
   unsigned shard_count = shard_set->size();
-  std::vector<std::vector<std::optional<std::string>>> mget_resp(shard_count);
+  std::vector<MGetShardResult> mget_resp(shard_count);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
@@ -1594,25 +1763,29 @@ void JsonFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
   OpStatus result = transaction->ScheduleSingleHop(std::move(cb));
   CHECK_EQ(OpStatus::OK, result);
 
-  std::vector<std::optional<std::string>> results(args.size() - 1);
+  // The reply is spliced from views into the shard buffers, in the order of the keys.
+  std::vector<std::optional<std::string_view>> results(args.size() - 1);
   for (ShardId sid = 0; sid < shard_count; ++sid) {
     if (!transaction->IsActive(sid))
       continue;
 
-    std::vector<std::optional<std::string>>& res = mget_resp[sid];
+    const MGetShardResult& res = mget_resp[sid];
     ShardArgs shard_args = transaction->GetShardArgs(sid);
     unsigned src_index = 0;
     for (auto it = shard_args.begin(); it != shard_args.end(); ++it, ++src_index) {
-      if (!res[src_index])
-        continue;
-
-      uint32_t dst_indx = it.index();
-      results[dst_indx] = std::move(res[src_index]);
+      if (const auto& value = res.values[src_index]; value)
+        results[it.index()] = std::string_view{res.buf}.substr(value->first, value->second);
     }
   }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  reply_generic::Send(results.begin(), results.end(), rb);
+  rb->StartArray(results.size());
+  for (const auto& value : results) {
+    if (value)
+      rb->SendBulkString(*value);
+    else
+      rb->SendNull();
+  }
 }
 
 void JsonFamily::ArrIndex(CmdArgList args, ConnectionContext* cntx) {
@@ -1970,14 +2143,28 @@ void JsonFamily::Get(CmdArgList args, ConnectionContext* cntx) {
   if (auto err = parser.Error(); err)
     return cntx->SendError(err->MakeReply());
 
+  Transaction* trans = cntx->transaction;
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+
+  // Scripts translate the replies, so they can not send serialized ones.
+  if (params->paths.empty() && ReplyCache::IsEnabled(rb) && !trans->IsMulti()) {
+    auto cb = [&](Transaction* t, EngineShard* shard) {
+      return OpJsonGetCached(t->GetOpArgs(shard), key);
+    };
+
+    OpResult<ReplyCache::Reply> result = trans->ScheduleSingleHopT(std::move(cb));
+    if (result)
+      return rb->SendRawReply(**result);
+    if (result == OpStatus::KEY_NOTFOUND)
+      return rb->SendNull();  // Match Redis
+    return cntx->SendError(result.status());
+  }
+
   auto cb = [&](Transaction* t, EngineShard* shard) {
     return OpJsonGet(t->GetOpArgs(shard), key, params.value());
   };
 
-  Transaction* trans = cntx->transaction;
   OpResult<string> result = trans->ScheduleSingleHopT(std::move(cb));
-  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-
   if (result == OpStatus::KEY_NOTFOUND) {
     rb->SendNull();  // Match Redis
   } else {
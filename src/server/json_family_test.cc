@@ -4,6 +4,7 @@
 
 #include "server/json_family.h"
 
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 
 #include <jsoncons/json.hpp>
@@ -18,6 +19,9 @@ using namespace testing;
 using namespace std;
 using namespace util;
 
+ABSL_DECLARE_FLAG(bool, json_simd_parse);
+ABSL_DECLARE_FLAG(dfly::MemoryBytesFlag, reply_cache_max_memory);
+
 namespace dfly {
 
 class JsonFamilyTest : public BaseFamilyTest {
@@ -2519,6 +2523,105 @@ TEST_F(JsonFamilyTest, MGet) {
   resp = Run({"JSON.MGET", "json3", "json4", "$..a"});
   ASSERT_EQ(RespExpr::ARRAY, resp.type);
   EXPECT_THAT(resp.GetVec(), ElementsAre(R"([1,3])", R"([4,6])"));
+
+  resp = Run({"JSON.MGET", "json3", "json4", "$.missing"});
+  ASSERT_EQ(RespExpr::ARRAY, resp.type);
+  EXPECT_THAT(resp.GetVec(), ElementsAre("[]", "[]"));
+}
+
+TEST_F(JsonFamilyTest, CachedPaths) {
+  auto resp = Run({"JSON.SET", "json", ".", R"({"a":1})"});
+  ASSERT_THAT(resp, "OK");
+
+  // Legacy and v2 paths share the parsed path, but keep their reply formats
+  for (unsigned i = 0; i < 2; i++) {
+    EXPECT_EQ(Run({"JSON.GET", "json", "$.a"}), "[1]");
+    EXPECT_EQ(Run({"JSON.GET", "json", ".a"}), "1");
+  }
+
+  resp = Run({"JSON.SET", "json", "$.a", "2"});
+  ASSERT_THAT(resp, "OK");
+  EXPECT_EQ(Run({"JSON.GET", "json", "$.a"}), "[2]");
+}
+
+TEST_F(JsonFamilyTest, SimdParse) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_json_simd_parse, true);
+
+  auto resp = Run({"JSON.SET", "json", "$", R"({"a":[1,2.5,"x"],"b":{"c":18446744073709551615}})"});
+  ASSERT_THAT(resp, "OK");
+  resp = Run({"JSON.SET", "json", "$.d", R"({"e":null})"});
+  ASSERT_THAT(resp, "OK");
+  EXPECT_EQ(Run({"JSON.GET", "json"}),
+            R"({"a":[1,2.5,"x"],"b":{"c":18446744073709551615},"d":{"e":null}})");
+
+  // Inputs that simdjson rejects are parsed by jsoncons
+  resp = Run({"JSON.SET", "json", "$.big", "123456789012345678901234567890"});
+  ASSERT_THAT(resp, "OK");
+  resp = Run({"JSON.SET", "json", "$", R"({"a":)"});
+  EXPECT_THAT(resp, ErrArg("ERR syntax error"));
+}
+
+TEST_F(JsonFamilyTest, ReplyCache) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_reply_cache_max_memory, MemoryBytesFlag{1 << 20});
+  auto hits = [&] { return GetMetrics().coordinator_stats.reply_cache_hits; };
+
+  ASSERT_THAT(Run({"JSON.SET", "json", "$", R"({"a":1,"b":[1,2]})"}), "OK");
+  for (unsigned i = 0; i < 2; i++) {
+    EXPECT_EQ(Run({"JSON.GET", "json"}), R"({"a":1,"b":[1,2]})");
+  }
+  EXPECT_EQ(1u, hits());
+
+  // Reads of paths are not cached.
+  EXPECT_EQ(Run({"JSON.GET", "json", "$.a"}), "[1]");
+  EXPECT_EQ(1u, hits());
+
+  // Writes are visible right after they complete.
+  ASSERT_THAT(Run({"JSON.NUMINCRBY", "json", "$.a", "1"}), "[2]");
+  EXPECT_EQ(Run({"JSON.GET", "json"}), R"({"a":2,"b":[1,2]})");
+  ASSERT_THAT(Run({"JSON.ARRAPPEND", "json", "$.b", "3"}), IntArg(3));
+  EXPECT_EQ(Run({"JSON.GET", "json"}), R"({"a":2,"b":[1,2,3]})");
+  EXPECT_EQ(1u, hits());
+
+  Run({"del", "json"});
+  EXPECT_THAT(Run({"JSON.GET", "json"}), ArgType(RespExpr::NIL));
+}
+
+TEST_F(JsonFamilyTest, MGetManyKeys) {
+  vector<string> mset_args = {"JSON.MSET"};
+  for (unsigned i = 0; i < 100; i += 2) {
+    string key = absl::StrCat("j", i);
+    mset_args.insert(mset_args.end(), {key, "$", absl::StrCat(R"({"a":)", i, "}")});
+    // A different path on the same key is applied after the document is set.
+    if (i % 10 == 0)
+      mset_args.insert(mset_args.end(), {key, "$.b", R"("x")"});
+  }
+  EXPECT_EQ(Run(absl::MakeSpan(mset_args)), "OK");
+
+  vector<string> mget_args = {"JSON.MGET"};
+  for (unsigned i = 0; i < 100; ++i)
+    mget_args.push_back(absl::StrCat("j", i));
+
+  mget_args.push_back("$.a");
+  auto resp = Run(absl::MakeSpan(mget_args));
+  ASSERT_THAT(resp, ArrLen(100));
+  for (unsigned i = 0; i < 100; ++i) {
+    if (i % 2 == 0)
+      EXPECT_EQ(resp.GetVec()[i], absl::StrCat("[", i, "]"));
+    else
+      EXPECT_THAT(resp.GetVec()[i], ArgType(RespExpr::NIL));
+  }
+
+  mget_args.back() = ".b";
+  resp = Run(absl::MakeSpan(mget_args));
+  ASSERT_THAT(resp, ArrLen(100));
+  for (unsigned i = 0; i < 100; ++i) {
+    if (i % 10 == 0)
+      EXPECT_EQ(resp.GetVec()[i], R"("x")");
+    else
+      EXPECT_THAT(resp.GetVec()[i], ArgType(RespExpr::NIL));
+  }
 }
 
 TEST_F(JsonFamilyTest, MGetLegacy) {
@@ -0,0 +1,189 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/lazy_free.h"
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "server/server_state.h"
+#include "util/fibers/proactor_base.h"
+
+ABSL_FLAG(uint32_t, lazy_free_threshold, 64,
+          "Containers with at least this many members are freed in the background when they are "
+          "deleted or overwritten. 0 frees everything inline");
+
+ABSL_FLAG(uint32_t, lazy_free_slice_usec, 1000,
+          "Maximal time the background freeing runs before it yields to other fibers");
+
+namespace dfly {
+
+using namespace std;
+using namespace util;
+using absl::GetFlag;
+
+namespace {
+
+// Number of container members released by a single FreeStep call.
+constexpr uint32_t kStepMembers = 256;
+
+bool IsLargeContainer(const PrimeValue& pv, uint32_t threshold) {
+  switch (pv.ObjType()) {
+    case OBJ_SET:
+    case OBJ_HASH:
+    case OBJ_ZSET:
+    case OBJ_LIST:
+      return threshold > 0 && pv.Size() >= threshold;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+LazyFreer::Stats& LazyFreer::Stats::operator+=(const Stats& o) {
+  pending_bytes += o.pending_bytes;
+  pending_objects += o.pending_objects;
+  freed_objects_total += o.freed_objects_total;
+  return *this;
+}
+
+LazyFreer::LazyFreer()
+    : threshold_(GetFlag(FLAGS_lazy_free_threshold)),
+      slice_ns_(GetFlag(FLAGS_lazy_free_slice_usec) * 1000ULL) {
+}
+
+LazyFreer::~LazyFreer() {
+  DCHECK(!fiber_.IsJoinable());
+}
+
+bool LazyFreer::TryAdd(PrimeValue* pv) {
+  if (stopped_ || !IsLargeContainer(*pv, threshold_))
+    return false;
+
+  Enqueue(pv, pv->MallocUsed());
+  EnsureFiber();
+  return true;
+}
+
+void LazyFreer::AddTables(DbTableArray tables) {
+  for (auto& table : tables) {
+    if (!table)
+      continue;
+
+    if (stopped_) {
+      table.reset();
+      continue;
+    }
+
+    size_t bytes = table->table_memory() + table->stats.obj_memory_usage;
+    stats_.pending_bytes += bytes;
+    stats_.pending_objects += table->prime.size();
+    tables_.push_back({std::move(table), bytes, {}});
+  }
+
+  if (HasWork())
+    EnsureFiber();
+}
+
+void LazyFreer::WaitIdle() {
+  fb2::NoOpLock noop_lk;
+  idle_cnd_.wait(noop_lk, [this] { return !HasWork(); });
+}
+
+void LazyFreer::Shutdown() {
+  stopped_ = true;
+  work_cnd_.notify_one();
+  fiber_.JoinIfNeeded();
+
+  values_.clear();
+  tables_.clear();
+  stats_.pending_bytes = stats_.pending_objects = 0;
+  idle_cnd_.notify_all();
+}
+
+void LazyFreer::Enqueue(PrimeValue* pv, size_t bytes) {
+  // The move leaves pv with an empty mask, but the key still owns an expiry and mc flag entries.
+  bool has_expire = pv->HasExpire(), has_flag = pv->HasFlag(), sticky = pv->IsSticky();
+  values_.push_back({std::move(*pv), bytes});
+  pv->SetExpire(has_expire);
+  pv->SetFlag(has_flag);
+  pv->SetSticky(sticky);
+
+  stats_.pending_bytes += bytes;
+  ++stats_.pending_objects;
+}
+
+void LazyFreer::EnsureFiber() {
+  if (fiber_.IsJoinable()) {
+    work_cnd_.notify_one();
+    return;
+  }
+  fiber_ = fb2::Fiber("lazy_free", [this] { Run(); });
+}
+
+void LazyFreer::Run() {
+  fb2::NoOpLock noop_lk;
+  while (true) {
+    work_cnd_.wait(noop_lk, [this] { return stopped_ || HasWork(); });
+    if (stopped_)
+      break;
+
+    const uint64_t deadline = fb2::ProactorBase::GetMonotonicTimeNs() + slice_ns_;
+    do {
+      decommit_pending_ |= FreeStep();
+    } while (HasWork() && fb2::ProactorBase::GetMonotonicTimeNs() < deadline);
+
+    if (!HasWork()) {
+      // Return the pages of the flushed tables to the OS, like the synchronous flush did.
+      if (decommit_pending_) {
+        decommit_pending_ = false;
+        ServerState::tlocal()->DecommitMemory(ServerState::kDataHeap | ServerState::kBackingHeap |
+                                              ServerState::kGlibcmalloc);
+      }
+      idle_cnd_.notify_all();
+    }
+    ThisFiber::Yield();
+  }
+}
+
+bool LazyFreer::FreeStep() {
+  if (!values_.empty()) {
+    PendingValue& pending = values_.front();
+    if (pending.value.FreeStep(&pending.cursor, kStepMembers)) {
+      pending.value.Reset();
+      stats_.pending_bytes -= pending.bytes;
+      --stats_.pending_objects;
+      ++stats_.freed_objects_total;
+      values_.pop_front();
+    }
+    return false;
+  }
+
+  PendingTable& pending = tables_.front();
+  DbTable* table = pending.table.get();
+
+  // Keys and values are released in place, the buckets and the expire table that references
+  // the keys are dropped at once with the table. Large values continue on the value queue.
+  pending.cursor = table->prime.Traverse(pending.cursor, [&](PrimeIterator it) {
+    if (IsLargeContainer(it->second, threshold_)) {
+      size_t bytes = min(it->second.MallocUsed(), pending.bytes);
+      pending.bytes -= bytes;
+      stats_.pending_bytes -= bytes;
+      Enqueue(&it->second, bytes);
+    }
+    it->first.Reset();
+    it->second.Reset();
+    --stats_.pending_objects;
+    ++stats_.freed_objects_total;
+  });
+
+  if (pending.cursor)
+    return false;
+
+  stats_.pending_bytes -= pending.bytes;
+  tables_.pop_front();
+  return true;
+}
+
+}  // namespace dfly
@@ -0,0 +1,89 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <deque>
+
+#include "server/table.h"
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+
+namespace dfly {
+
+// Frees large values and flushed tables in the background of a shard thread, so that UNLINK,
+// DEL, FLUSHALL or an overwrite of a big container do not stall the shard for the time it takes
+// to release millions of allocations. The work runs in a dedicated fiber in time slices of
+// --lazy_free_slice_usec, yielding to the other fibers of the thread in between.
+// Objects handed over to LazyFreer are detached from the keyspace, so nothing else can reach
+// them and the fiber needs no synchronization besides running on the owning thread.
+class LazyFreer {
+ public:
+  struct Stats {
+    size_t pending_bytes = 0;    // memory still held by queued objects
+    size_t pending_objects = 0;  // queued values plus the entries of queued tables
+    uint64_t freed_objects_total = 0;
+
+    Stats& operator+=(const Stats& o);
+  };
+
+  LazyFreer();
+  ~LazyFreer();
+
+  // Takes over the value if it is a container with at least --lazy_free_threshold members,
+  // leaving pv empty but with its expire and flag bits preserved. Returns false if the value is
+  // small and should be freed inline by the caller.
+  bool TryAdd(PrimeValue* pv);
+
+  // Takes over the flushed tables, null entries are ignored.
+  void AddTables(DbTableArray tables);
+
+  // Blocks the calling fiber until all the queued objects have been freed.
+  void WaitIdle();
+
+  // Stops the fiber and frees the remaining objects inline.
+  void Shutdown();
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  struct PendingValue {
+    PrimeValue value;
+    size_t bytes;
+    uint32_t cursor = 0;
+  };
+
+  struct PendingTable {
+    boost::intrusive_ptr<DbTable> table;
+    size_t bytes;
+    PrimeTable::Cursor cursor;
+  };
+
+  bool HasWork() const {
+    return !values_.empty() || !tables_.empty();
+  }
+
+  void Enqueue(PrimeValue* pv, size_t bytes);
+  void EnsureFiber();
+  void Run();
+
+  // Frees a bounded portion of the queued objects. Returns true if a table was released.
+  bool FreeStep();
+
+  std::deque<PendingValue> values_;
+  std::deque<PendingTable> tables_;
+  Stats stats_;
+
+  uint32_t threshold_;
+  uint64_t slice_ns_;
+  bool stopped_ = false;
+  bool decommit_pending_ = false;  // a table was released since the queue was last drained
+
+  util::fb2::CondVarAny work_cnd_, idle_cnd_;
+  util::fb2::Fiber fiber_;
+};
+
+}  // namespace dfly
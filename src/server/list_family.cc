@@ -14,6 +14,7 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/qlist.h"
 #include "server/blocking_controller.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
@@ -60,6 +61,9 @@ ABSL_FLAG(int32_t, list_max_listpack_size, -2, "Maximum listpack size, default i
 
 ABSL_FLAG(int32_t, list_compress_depth, 0, "Compress depth of the list. Default is no compression");
 
+ABSL_FLAG(bool, list_experimental_v2, false,
+          "If true, new lists use QList, which seeks by index in logarithmic time");
+
 namespace dfly {
 
 using namespace std;
@@ -73,13 +77,51 @@ quicklist* GetQL(const PrimeValue& mv) {
   return (quicklist*)mv.RObjPtr();
 }
 
+QList* GetQList(const PrimeValue& mv) {
+  DCHECK_EQ(mv.Encoding(), kEncodingQL2);
+  return (QList*)mv.RObjPtr();
+}
+
+bool IsQList(const PrimeValue& mv) {
+  return mv.Encoding() == kEncodingQL2;
+}
+
+size_t ListLen(const PrimeValue& mv) {
+  return IsQList(mv) ? GetQList(mv)->Size() : quicklistCount(GetQL(mv));
+}
+
+void InitList(PrimeValue* pv) {
+  int fill = GetFlag(FLAGS_list_max_listpack_size);
+  int compress = GetFlag(FLAGS_list_compress_depth);
+  if (GetFlag(FLAGS_list_experimental_v2)) {
+    QList* ql = CompactObj::AllocateMR<QList>(fill, compress, CompactObj::memory_resource());
+    pv->InitRobj(OBJ_LIST, kEncodingQL2, ql);
+  } else {
+    quicklist* ql = quicklistCreate();
+    quicklistSetOptions(ql, fill, compress);
+    pv->InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);
+  }
+}
+
+void ListPush(PrimeValue* pv, string_view val, ListDir dir) {
+  if (IsQList(*pv)) {
+    GetQList(*pv)->Push(val, dir == ListDir::LEFT ? QList::HEAD : QList::TAIL);
+    return;
+  }
+
+  // Left push is LIST_HEAD.
+  int pos = (dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+  auto vsds = WrapSds(val);
+  quicklistPush(GetQL(*pv), vsds, sdslen(vsds), pos);
+}
+
 void* listPopSaver(unsigned char* data, size_t sz) {
   return new string((char*)data, sz);
 }
 
 enum InsertParam { INSERT_BEFORE, INSERT_AFTER };
 
-string ListPop(ListDir dir, quicklist* ql) {
+string QlPop(ListDir dir, quicklist* ql) {
   long long vlong;
   string* pop_str = nullptr;
 
@@ -99,6 +141,12 @@ string ListPop(ListDir dir, quicklist* ql) {
   return res;
 }
 
+string ListPop(ListDir dir, PrimeValue* pv) {
+  if (IsQList(*pv))
+    return GetQList(*pv)->Pop(dir == ListDir::LEFT ? QList::HEAD : QList::TAIL);
+  return QlPop(dir, GetQL(*pv));
+}
+
 ListDir ParseDir(facade::CmdArgParser* parser) {
   return parser->MapNext("LEFT", ListDir::LEFT, "RIGHT", ListDir::RIGHT);
 }
@@ -149,13 +197,11 @@ std::string OpBPop(Transaction* t, EngineShard* shard, std::string_view key, Lis
   CHECK(it_res) << t->DebugId() << " " << key;  // must exist and must be ok.
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
-
-  std::string value = ListPop(dir, ql);
+  std::string value = ListPop(dir, &it->second);
   it_res->post_updater.Run();
 
   OpArgs op_args = t->GetOpArgs(shard);
-  if (quicklistCount(ql) == 0) {
+  if (ListLen(it->second) == 0) {
     DVLOG(1) << "deleting key " << key << " " << t->DebugId();
     CHECK(op_args.GetDbSlice().Del(op_args.db_cntx, it));
   }
@@ -176,18 +222,13 @@ OpResult<string> OpMoveSingleShard(const OpArgs& op_args, string_view src, strin
     return src_res.status();
 
   auto src_it = src_res->it;
-  quicklist* src_ql = GetQL(src_it->second);
 
   if (src == dest) {  // simple case.
-    string val = ListPop(src_dir, src_ql);
-
-    int pos = (dest_dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-    quicklistPush(src_ql, val.data(), val.size(), pos);
-
+    string val = ListPop(src_dir, &src_it->second);
+    ListPush(&src_it->second, val, dest_dir);
     return val;
   }
 
-  quicklist* dest_ql = nullptr;
   src_res->post_updater.Run();
   auto op_res = db_slice.AddOrFind(op_args.db_cntx, dest);
   RETURN_ON_BAD_STATUS(op_res);
@@ -198,26 +239,20 @@ OpResult<string> OpMoveSingleShard(const OpArgs& op_args, string_view src, strin
   src_it = src_res->it;
 
   if (dest_res.is_new) {
-    dest_ql = quicklistCreate();
-    quicklistSetOptions(dest_ql, GetFlag(FLAGS_list_max_listpack_size),
-                        GetFlag(FLAGS_list_compress_depth));
-    dest_res.it->second.InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, dest_ql);
+    InitList(&dest_res.it->second);
     DCHECK(IsValid(src_it));
   } else {
     if (dest_res.it->second.ObjType() != OBJ_LIST)
       return OpStatus::WRONG_TYPE;
-
-    dest_ql = GetQL(dest_res.it->second);
   }
 
-  string val = ListPop(src_dir, src_ql);
-  int pos = (dest_dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-  quicklistPush(dest_ql, val.data(), val.size(), pos);
+  string val = ListPop(src_dir, &src_it->second);
+  ListPush(&dest_res.it->second, val, dest_dir);
 
   src_res->post_updater.Run();
   dest_res.post_updater.Run();
 
-  if (quicklistCount(src_ql) == 0) {
+  if (ListLen(src_it->second) == 0) {
     CHECK(db_slice.Del(op_args.db_cntx, src_it));
   }
 
@@ -235,7 +270,14 @@ OpResult<string> Peek(const OpArgs& op_args, string_view key, ListDir dir, bool
   if (!fetch)
     return OpStatus::OK;
 
-  quicklist* ql = GetQL(it_res.value()->second);
+  const PrimeValue& pv = it_res.value()->second;
+  if (IsQList(pv)) {
+    auto it = GetQList(pv)->GetIterator(dir == ListDir::LEFT ? QList::HEAD : QList::TAIL);
+    CHECK(it.Next());
+    return it.Get().to_string();
+  }
+
+  quicklist* ql = GetQL(pv);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* iter = (dir == ListDir::LEFT) ? quicklistGetIterator(ql, AL_START_HEAD)
                                                : quicklistGetIterator(ql, AL_START_TAIL);
@@ -265,26 +307,17 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
     res = std::move(*op_res);
   }
 
-  quicklist* ql = nullptr;
   DVLOG(1) << "OpPush " << key << " new_key " << res.is_new;
 
   if (res.is_new) {
-    ql = quicklistCreate();
-    quicklistSetOptions(ql, GetFlag(FLAGS_list_max_listpack_size),
-                        GetFlag(FLAGS_list_compress_depth));
-    res.it->second.InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);
+    InitList(&res.it->second);
   } else {
     if (res.it->second.ObjType() != OBJ_LIST)
       return OpStatus::WRONG_TYPE;
-    ql = GetQL(res.it->second);
   }
 
-  // Left push is LIST_HEAD.
-  int pos = (dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-
   for (string_view v : vals) {
-    auto vsds = WrapSds(v);
-    quicklistPush(ql, vsds, sdslen(vsds), pos);
+    ListPush(&res.it->second, v, dir);
   }
 
   if (res.is_new) {
@@ -305,7 +338,7 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
     RecordJournal(op_args, command, mapped, 2);
   }
 
-  return quicklistCount(ql);
+  return ListLen(res.it->second);
 }
 
 OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, uint32_t count,
@@ -319,27 +352,29 @@ OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, u
     return StringVec{};
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
+  PrimeValue& pv = it->second;
 
   StringVec res;
-  if (quicklistCount(ql) < count) {
-    count = quicklistCount(ql);
+  if (ListLen(pv) < count) {
+    count = ListLen(pv);
   }
   res.reserve(count);
 
   if (return_results) {
     for (unsigned i = 0; i < count; ++i) {
-      res.push_back(ListPop(dir, ql));
+      res.push_back(ListPop(dir, &pv));
     }
+  } else if (IsQList(pv) && count == ListLen(pv)) {
+    GetQList(pv)->Clear();
   } else {
     for (unsigned i = 0; i < count; ++i) {
-      ListPop(dir, ql);
+      ListPop(dir, &pv);
     }
   }
 
   it_res->post_updater.Run();
 
-  if (quicklistCount(ql) == 0) {
+  if (ListLen(pv) == 0) {
     CHECK(db_slice.Del(op_args.db_cntx, it));
   }
 
@@ -418,16 +453,23 @@ OpResult<uint32_t> OpLen(const OpArgs& op_args, std::string_view key) {
   if (!res)
     return res.status();
 
-  quicklist* ql = GetQL(res.value()->second);
-
-  return quicklistCount(ql);
+  return ListLen(res.value()->second);
 }
 
 OpResult<string> OpIndex(const OpArgs& op_args, std::string_view key, long index) {
   auto res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
   if (!res)
     return res.status();
-  quicklist* ql = GetQL(res.value()->second);
+
+  const PrimeValue& pv = res.value()->second;
+  if (IsQList(pv)) {
+    optional<string> val = GetQList(pv)->Get(index);
+    if (!val)
+      return OpStatus::KEY_NOTFOUND;
+    return std::move(*val);
+  }
+
+  quicklist* ql = GetQL(pv);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* iter = quicklistGetIteratorAtIdx(ql, AL_START_TAIL, index);
   if (!iter)
@@ -460,13 +502,32 @@ OpResult<vector<uint32_t>> OpPos(const OpArgs& op_args, string_view key, string_
     direction = AL_START_TAIL;
   }
 
-  quicklist* ql = GetQL(it_res.value()->second);
-  quicklistIter* ql_iter = quicklistGetIterator(ql, direction);
-  quicklistEntry entry;
-
   int index = 0;
   int matched = 0;
   vector<uint32_t> matches;
+
+  const PrimeValue& pv = it_res.value()->second;
+  if (IsQList(pv)) {
+    const QList* ql = GetQList(pv);
+    auto it = ql->GetIterator(direction == AL_START_HEAD ? QList::HEAD : QList::TAIL);
+    while (it.Next() && (max_len == 0 || index < max_len)) {
+      if (it.Get() == element) {
+        matched++;
+        auto k = (direction == AL_START_TAIL) ? ql->Size() - index - 1 : index;
+        if (matched >= rank) {
+          matches.push_back(k);
+          if (count && matched - rank + 1 >= count)
+            break;
+        }
+      }
+      index++;
+    }
+    return matches;
+  }
+
+  quicklist* ql = GetQL(pv);
+  quicklistIter* ql_iter = quicklistGetIterator(ql, direction);
+  quicklistEntry entry;
   string str;
 
   while (quicklistNext(ql_iter, &entry) && (max_len == 0 || index < max_len)) {
@@ -500,7 +561,16 @@ OpResult<int> OpInsert(const OpArgs& op_args, string_view key, string_view pivot
   if (!it_res)
     return it_res.status();
 
-  quicklist* ql = GetQL(it_res->it->second);
+  const PrimeValue& pv = it_res->it->second;
+  if (IsQList(pv)) {
+    QList* ql = GetQList(pv);
+    QList::InsertOpt opt = insert_param == INSERT_AFTER ? QList::AFTER : QList::BEFORE;
+    if (!ql->Insert(pivot, elem, opt))
+      return -1;
+    return int(ql->Size());
+  }
+
+  quicklist* ql = GetQL(pv);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* qiter = quicklistGetIterator(ql, AL_START_HEAD);
   bool found = false;
@@ -533,6 +603,15 @@ OpResult<uint32_t> OpRem(const OpArgs& op_args, string_view key, string_view ele
     return it_res.status();
 
   auto it = it_res->it;
+  if (IsQList(it->second)) {
+    unsigned removed = GetQList(it->second)->Remove(elem, count);
+    it_res->post_updater.Run();
+    if (ListLen(it->second) == 0) {
+      CHECK(db_slice.Del(op_args.db_cntx, it));
+    }
+    return removed;
+  }
+
   quicklist* ql = GetQL(it->second);
 
   int iter_direction = AL_START_HEAD;
@@ -586,9 +665,12 @@ OpStatus OpSet(const OpArgs& op_args, string_view key, string_view elem, long in
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
-
-  int replaced = quicklistReplaceAtIndex(ql, index, elem.data(), elem.size());
+  int replaced;
+  if (IsQList(it->second)) {
+    replaced = GetQList(it->second)->Replace(index, elem);
+  } else {
+    replaced = quicklistReplaceAtIndex(GetQL(it->second), index, elem.data(), elem.size());
+  }
 
   if (!replaced) {
     return OpStatus::OUT_OF_RANGE;
@@ -603,8 +685,7 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
-  long llen = quicklistCount(ql);
+  long llen = ListLen(it->second);
 
   /* convert negative indexes */
   if (start < 0)
@@ -629,24 +710,33 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
     rtrim = llen - end - 1;
   }
 
-  quicklistDelRange(ql, 0, ltrim);
-  quicklistDelRange(ql, -rtrim, rtrim);
+  if (IsQList(it->second)) {
+    QList* ql = GetQList(it->second);
+    ql->Erase(0, ltrim);
+    ql->Erase(-rtrim, rtrim);
+  } else {
+    quicklist* ql = GetQL(it->second);
+    quicklistDelRange(ql, 0, ltrim);
+    quicklistDelRange(ql, -rtrim, rtrim);
+  }
 
   it_res->post_updater.Run();
 
-  if (quicklistCount(ql) == 0) {
+  if (ListLen(it->second) == 0) {
     CHECK(db_slice.Del(op_args.db_cntx, it));
   }
   return OpStatus::OK;
 }
 
-OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long start, long end) {
+// Reads the next chunk of the elements in [start, end], which stays the same between the hops as
+// the list is locked.
+OpStatus OpRangeChunk(const OpArgs& op_args, std::string_view key, long start, long end,
+                      container_utils::ReplyChunk* chunk) {
   auto res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
   if (!res)
     return res.status();
 
-  quicklist* ql = GetQL(res.value()->second);
-  long llen = quicklistCount(ql);
+  long llen = ListLen(res.value()->second);
 
   /* convert negative indexes */
   if (start < 0)
@@ -655,24 +745,29 @@ OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long st
     end = llen + end;
   if (start < 0)
     start = 0;
+  if (end >= llen)
+    end = llen - 1;
 
   /* Invariant: start >= 0, so this test will be true when end < 0.
    * The range is empty when start > end or start >= length. */
   if (start > end || start >= llen) {
     /* Out of range start or start > end result in empty list */
-    return StringVec{};
+    return OpStatus::OK;
   }
 
-  StringVec str_vec;
+  chunk->total = end - start + 1;
+  long from = start + chunk->cursor;
+  long to = from + long(min<size_t>(end - from, chunk->limit - 1));
   container_utils::IterateList(
       res.value()->second,
-      [&str_vec](container_utils::ContainerEntry ce) {
-        str_vec.emplace_back(ce.ToString());
+      [chunk](container_utils::ContainerEntry ce) {
+        chunk->elements.emplace_back(ce.ToString());
         return true;
       },
-      start, end);
+      from, to);
 
-  return str_vec;
+  chunk->cursor = to == end ? 0 : to - start + 1;
+  return OpStatus::OK;
 }
 
 void MoveGeneric(ConnectionContext* cntx, string_view src, string_view dest, ListDir src_dir,
@@ -1051,17 +1146,12 @@ void ListFamily::LRange(CmdArgList args, ConnectionContext* cntx) {
     return;
   }
 
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpRange(t->GetOpArgs(shard), key, start, end);
+  auto read_chunk = [&](Transaction* t, EngineShard* shard, container_utils::ReplyChunk* chunk) {
+    return OpRangeChunk(t->GetOpArgs(shard), key, start, end, chunk);
   };
 
-  auto res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
-  if (!res && res.status() != OpStatus::KEY_NOTFOUND) {
-    return cntx->SendError(res.status());
-  }
-
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->SendStringArr(*res);
+  container_utils::SendChunkedReply(cntx->transaction, rb, RedisReplyBuilder::ARRAY, read_chunk);
 }
 
 // lrem key 5 foo, will remove foo elements from the list if exists at most 5 times.
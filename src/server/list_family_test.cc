@@ -22,6 +22,9 @@ using namespace std;
 using namespace util;
 using absl::StrCat;
 
+ABSL_DECLARE_FLAG(bool, list_experimental_v2);
+ABSL_DECLARE_FLAG(uint32_t, container_reply_chunk_size);
+
 namespace dfly {
 
 class ListFamilyTest : public BaseFamilyTest {
@@ -411,6 +414,23 @@ TEST_F(ListFamilyTest, LRange) {
   ASSERT_THAT(resp.GetVec(), ElementsAre("1", "2"));
 }
 
+TEST_F(ListFamilyTest, LRangeChunked) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_container_reply_chunk_size, 16);
+
+  vector<string> args = {"rpush", kKey1};
+  for (int i = 0; i < 100; ++i)
+    args.push_back(StrCat(i));
+  Run(absl::MakeSpan(args));
+
+  EXPECT_THAT(StrArray(Run({"lrange", kKey1, "0", "-1"})),
+              ElementsAreArray(args.begin() + 2, args.end()));
+  EXPECT_THAT(StrArray(Run({"lrange", kKey1, "10", "41"})),
+              ElementsAreArray(args.begin() + 12, args.begin() + 44));
+  EXPECT_THAT(StrArray(Run({"lrange", kKey1, "-20", "1000"})),
+              ElementsAreArray(args.end() - 20, args.end()));
+}
+
 TEST_F(ListFamilyTest, Lset) {
   Run({"rpush", kKey1, "0", "1", "2"});
   ASSERT_EQ(Run({"lset", kKey1, "0", "bar"}), "OK");
@@ -1080,5 +1100,34 @@ TEST_F(ListFamilyTest, ContendExpire) {
   }
 }
 
+TEST_F(ListFamilyTest, QListEncoding) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_list_experimental_v2, true);
+
+  vector<string> cmd = {"rpush", "l"};
+  for (unsigned i = 0; i < 5000; ++i)
+    cmd.push_back(StrCat("val", i));
+  Run(absl::MakeSpan(cmd));
+
+  EXPECT_THAT(Run({"llen", "l"}), IntArg(5000));
+  EXPECT_EQ(Run({"lindex", "l", "4000"}), "val4000");
+  EXPECT_THAT(Run({"lrange", "l", "2500", "2501"}).GetVec(), ElementsAre("val2500", "val2501"));
+  EXPECT_THAT(Run({"lpos", "l", "val10"}), IntArg(10));
+  EXPECT_THAT(Run({"linsert", "l", "before", "val1", "x"}), IntArg(5001));
+  EXPECT_THAT(Run({"lrem", "l", "0", "x"}), IntArg(1));
+  EXPECT_EQ(Run({"lset", "l", "-1", "last"}), "OK");
+  EXPECT_EQ(Run({"ltrim", "l", "1", "-1"}), "OK");
+  EXPECT_EQ(Run({"lpop", "l"}), "val1");
+  EXPECT_EQ(Run({"rpoplpush", "l", "l2"}), "last");
+  EXPECT_EQ(Run({"lmove", "l2", "l2", "left", "right"}), "last");
+
+  // The list survives DUMP and RESTORE.
+  auto dump = Run({"dump", "l"});
+  Run({"del", "l"});
+  EXPECT_EQ(Run({"restore", "l", "0", dump.GetString()}), "OK");
+  EXPECT_THAT(Run({"llen", "l"}), IntArg(4997));
+  EXPECT_EQ(Run({"lindex", "l", "-1"}), "val4998");
+}
+
 #pragma GCC diagnostic pop
 }  // namespace dfly
@@ -20,6 +20,7 @@ extern "C" {
 #include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_join.h>
 #include <xxhash.h>
 
 #include <csignal>
@@ -27,10 +28,13 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/allocation_tracker.h"
+#include "facade/cpu_topology.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "facade/reply_builder.h"
 #include "facade/reply_capture.h"
+#include "io/file_util.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/acl/acl_family.h"
 #include "server/acl/user_registry.h"
@@ -40,7 +44,9 @@ extern "C" {
 #include "server/channel_store.h"
 #include "server/cluster/cluster_family.h"
 #include "server/cluster/cluster_utility.h"
+#include "server/cluster/forwarding.h"
 #include "server/conn_context.h"
+#include "server/counter_family.h"
 #include "server/error.h"
 #include "server/generic_family.h"
 #include "server/hll_family.h"
@@ -54,8 +60,10 @@ extern "C" {
 #include "server/search/search_family.h"
 #include "server/server_state.h"
 #include "server/set_family.h"
+#include "server/sketch_family.h"
 #include "server/stream_family.h"
 #include "server/string_family.h"
+#include "server/timeseries_family.h"
 #include "server/transaction.h"
 #include "server/version.h"
 #include "server/zset_family.h"
@@ -86,6 +94,15 @@ ABSL_FLAG(bool, track_exec_frequencies, true, "Whether to track exec frequencies
 ABSL_FLAG(bool, lua_resp2_legacy_float, false,
           "Return rounded down integers instead of floats for lua scripts with RESP2");
 ABSL_FLAG(uint32_t, multi_eval_squash_buffer, 4096, "Max buffer for squashed commands per script");
+ABSL_FLAG(uint32_t, lua_profile_sampling_period, 0,
+          "If positive, samples the lua stacks of running scripts every given number of VM "
+          "instructions. The samples are reported by SCRIPT PROFILE.");
+ABSL_FLAG(dfly::MemoryBytesFlag, lua_arena_size, dfly::MemoryBytesFlag{64 << 10},
+          "Size of the arena of every lua interpreter that serves the small allocations of "
+          "scripts without calling the allocator. 0 disables the arena.");
+ABSL_FLAG(dfly::MemoryBytesFlag, lua_script_max_memory, dfly::MemoryBytesFlag{},
+          "Max memory that a single script run can add to the lua heap, scripts that exceed it "
+          "are aborted with an error. 0 means no limit.");
 
 ABSL_DECLARE_FLAG(bool, primary_port_http_enabled);
 ABSL_FLAG(bool, admin_nopass, false,
@@ -150,25 +167,12 @@ std::optional<VarzFunction> engine_varz;
 
 constexpr size_t kMaxThreadSize = 1024;
 
-// Unwatch all keys for a connection and unregister from DbSlices.
-// Used by UNWATCH, DICARD and EXEC.
-void UnwatchAllKeys(Namespace* ns, ConnectionState::ExecInfo* exec_info) {
-  if (!exec_info->watched_keys.empty()) {
-    auto cb = [&](EngineShard* shard) {
-      ns->GetDbSlice(shard->shard_id()).UnregisterConnectionWatches(exec_info);
-    };
-    shard_set->RunBriefInParallel(std::move(cb));
-  }
-  exec_info->ClearWatched();
-}
-
 void MultiCleanup(ConnectionContext* cntx) {
   auto& exec_info = cntx->conn_state.exec_info;
   if (auto* borrowed = exec_info.preborrowed_interpreter; borrowed) {
     ServerState::tlocal()->ReturnInterpreter(borrowed);
     exec_info.preborrowed_interpreter = nullptr;
   }
-  UnwatchAllKeys(cntx->ns, &exec_info);
   exec_info.Clear();
 }
 
@@ -256,7 +260,7 @@ std::string MakeMonitorMessage(const ConnectionContext* cntx, const CommandId* c
   return message;
 }
 
-void SendMonitor(const std::string& msg) {
+void SendMonitor(const std::string& msg, const MonitorsRepo::MonitorIds& ids) {
   const auto& monitor_repo = ServerState::tlocal()->Monitors();
   const auto& monitors = monitor_repo.monitors();
   if (!monitors.empty()) {
@@ -265,24 +269,49 @@ void SendMonitor(const std::string& msg) {
 
     for (auto monitor_conn : monitors) {
       // never preempts, so we can iterate safely.
-      monitor_conn->SendMonitorMessageAsync(msg);
+      if (find(ids.begin(), ids.end(), monitor_conn->GetClientId()) != ids.end())
+        monitor_conn->SendMonitorMessageAsync(msg);
     }
   }
 }
 
 void DispatchMonitor(ConnectionContext* cntx, const CommandId* cid, CmdArgList tail_args) {
+  // Filter the command before formatting the message, most of the commands are not sent when
+  // the monitors are filtered or sampled.
+  const ConnectionContext* owner =
+      cntx->conn_state.squashing_info ? cntx->conn_state.squashing_info->owner : cntx;
+  uint32_t client_id = owner->conn() ? owner->conn()->GetClientId() : 0;
+  auto key_matches = [&](const vector<string>& prefixes) {
+    auto key_index = DetermineKeys(cid, tail_args);
+    if (!key_index)
+      return false;
+    for (string_view key : key_index->Range(tail_args)) {
+      for (const string& prefix : prefixes) {
+        if (absl::StartsWith(key, prefix))
+          return true;
+      }
+    }
+    return false;
+  };
+  auto ids = ServerState::tlocal()->Monitors().Select(cid->name(), client_id, key_matches);
+  if (ids.empty())
+    return;
+
   //  We have connections waiting to get the info on the last command, send it to them
   string monitor_msg = MakeMonitorMessage(cntx, cid, tail_args);
 
   VLOG(2) << "Sending command '" << monitor_msg << "' to the clients that registered on it";
 
   shard_set->pool()->DispatchBrief(
-      [msg = std::move(monitor_msg)](unsigned idx, util::ProactorBase*) { SendMonitor(msg); });
+      [msg = std::move(monitor_msg), ids = std::move(ids)](unsigned idx, util::ProactorBase*) {
+        SendMonitor(msg, ids);
+      });
 }
 
 class InterpreterReplier : public RedisReplyBuilder {
  public:
-  InterpreterReplier(ObjectExplorer* explr) : RedisReplyBuilder(nullptr), explr_(explr) {
+  InterpreterReplier(ObjectExplorer* explr, bool multiple_replies = false)
+      : RedisReplyBuilder(nullptr), explr_(explr), multiple_replies_(multiple_replies) {
   }
 
   void SendError(std::string_view str, std::string_view type = std::string_view{}) final;
@@ -300,6 +329,7 @@ class InterpreterReplier : public RedisReplyBuilder {
   void SendDouble(double val) final;
 
   void SendBulkString(std::string_view str) final;
+  void SendBulkString(absl::Span<const std::string_view> pieces) final;
 
   void StartCollection(unsigned len, CollectionType type) final;
   void SendScoredArray(absl::Span<const std::pair<std::string, double>> arr,
@@ -309,8 +339,9 @@ class InterpreterReplier : public RedisReplyBuilder {
   void PostItem();
 
   ObjectExplorer* explr_;
-  vector<pair<unsigned, unsigned>> array_len_;
+  absl::InlinedVector<pair<unsigned, unsigned>, 4> array_len_;
   unsigned num_elems_ = 0;
+  bool multiple_replies_;
 };
 
 // Serialized result of script invocation to Redis protocol
@@ -376,7 +407,7 @@ class EvalSerializer : public ObjectExplorer {
 
 void InterpreterReplier::PostItem() {
   if (array_len_.empty()) {
-    DCHECK_EQ(0u, num_elems_);
+    DCHECK(num_elems_ == 0 || multiple_replies_);
     ++num_elems_;
   } else {
     ++num_elems_;
@@ -465,6 +496,10 @@ void InterpreterReplier::SendBulkString(string_view str) {
   PostItem();
 }
 
+void InterpreterReplier::SendBulkString(absl::Span<const string_view> pieces) {
+  SendBulkString(absl::StrJoin(pieces, ""));
+}
+
 void InterpreterReplier::StartCollection(unsigned len, CollectionType) {
   explr_->OnArrayStart(len);
 
@@ -534,14 +569,17 @@ void Topkeys(const http::QueryArgs& args, HttpContext* send) {
     shard_set->RunBriefInParallel([&](EngineShard* shard) {
       for (const auto& db :
            namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id()).databases()) {
-        if (db->top_keys.IsEnabled()) {
+        if (db && db->top_keys.IsEnabled()) {
           is_enabled = true;
-          for (const auto& [key, count] : db->top_keys.GetTopKeys()) {
-            absl::StrAppend(&resp.body(), key, ":\t", count, "\n");
+          for (const auto& entry : db->top_keys.GetTopEntries()) {
+            absl::StrAppend(&rows[shard->shard_id()], entry.key, ":\t", entry.count, "\t",
+                            entry.bytes, "\n");
           }
         }
       }
     });
+    for (const auto& row : rows)
+      resp.body() += row;
   }
 
   resp.body() += "</pre>";
@@ -552,6 +590,34 @@ void Topkeys(const http::QueryArgs& args, HttpContext* send) {
   send->Invoke(std::move(resp));
 }
 
+// Serves the sampled live allocations of all threads in a format that pprof reads, e.g.
+// pprof -http=: dragonfly http://host:6379/heapz
+void HeapProfile(const http::QueryArgs& args, HttpContext* send) {
+  http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
+#ifdef DFLY_ENABLE_MEMORY_TRACKING
+  size_t sample_interval = AllocationTracker::Get().sample_interval();
+  if (sample_interval > 0 && shard_set) {
+    vector<AllocationTracker::Sample> samples;
+    util::fb2::Mutex mu;
+    shard_set->pool()->AwaitFiberOnAll([&](ProactorBase*) {
+      vector<AllocationTracker::Sample> local;
+      AllocationTracker::Get().CollectSamples(&local);
+      util::fb2::LockGuard lk(mu);
+      samples.insert(samples.end(), local.begin(), local.end());
+    });
+
+    auto maps = io::ReadFileToString("/proc/self/maps");
+    resp.body() =
+        AllocationTracker::HeapProfile(samples, sample_interval, maps ? *maps : string_view{});
+  } else {
+    resp.body() = "Heap profiling is disabled, see heap_profile_sample_bytes.";
+  }
+#else
+  resp.body() = "Heap profiling must be enabled at build time.";
+#endif
+  send->Invoke(std::move(resp));
+}
+
 void TxTable(const http::QueryArgs& args, HttpContext* send) {
   using html::SortedTable;
 
@@ -750,8 +816,10 @@ Transaction::MultiMode DeduceExecMode(ExecEvalState state,
   if (!transactional && exec_info.watched_keys.empty())
     return Transaction::NOT_DETERMINED;
 
-  // Atomic modes fall back to GLOBAL if they contain global commands.
-  if (contains_global && multi_mode == Transaction::LOCK_AHEAD)
+  // Atomic modes fall back to GLOBAL if they contain global commands. Keys declared with MULTI KEYS
+  // are locked ahead anyway, as the commands were checked to access only them when queued.
+  if (contains_global && multi_mode == Transaction::LOCK_AHEAD &&
+      exec_info.declared_keys.empty())
     multi_mode = Transaction::GLOBAL;
 
   return multi_mode;
@@ -830,6 +898,47 @@ string FailedCommandToString(std::string_view command, facade::CmdArgList args,
   return result;
 }
 
+// Checks that all keys hash to the same slot and that it is owned by this node.
+template <typename Range> optional<ErrorReply> CheckSlotOwnership(const Range& keys) {
+  optional<cluster::SlotId> keys_slot;
+  bool cross_slot = false;
+  // Iterate keys and check to which slot they belong.
+  for (string_view key : keys) {
+    if (cluster::SlotId slot = cluster::KeySlot(key); keys_slot && slot != *keys_slot) {
+      cross_slot = true;  // keys belong to different slots
+      break;
+    } else {
+      keys_slot = slot;
+    }
+  }
+
+  if (cross_slot) {
+    return ErrorReply{"-CROSSSLOT Keys in request don't hash to the same slot"};
+  }
+
+  if (keys_slot.has_value()) {
+    if (auto error_str = cluster::SlotOwnershipErrorStr(*keys_slot); error_str) {
+      return ErrorReply{std::move(*error_str)};
+    }
+  }
+
+  return nullopt;
+}
+
+// Whether a command rejected with err can be executed on the owner of its slot instead
+bool IsMovedForwardable(const ErrorReply& err, const CommandId* cid,
+                        const ConnectionContext& cntx) {
+  if (!absl::StartsWith(err.ToSv(), "-MOVED") || !cluster::IsForwardingEnabled())
+    return false;
+
+  // Blocking commands would hold a pooled connection for their whole timeout
+  if (cid->IsBlocking() || !cntx.conn() || cntx.conn()->IsPrivileged())
+    return false;
+
+  return !cntx.conn_state.exec_info.IsCollecting() && !cntx.conn_state.exec_info.IsRunning() &&
+         !cntx.conn_state.script_info;
+}
+
 }  // namespace
 
 Service::Service(ProactorPool* pp)
@@ -892,14 +1001,18 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     return true;
   });
 
+  config_registry.RegisterMutable("cluster_forward_moved");
   config_registry.RegisterMutable("dbfilename");
   config_registry.Register("dbnum");  // equivalent to databases in redis.
   config_registry.Register("dir");
   config_registry.RegisterMutable("enable_heartbeat_eviction");
+  config_registry.RegisterMutable("fiber_lag_warn_usec");
+  config_registry.RegisterMutable("lua_profile_sampling_period");
   config_registry.RegisterMutable("masterauth");
   config_registry.RegisterMutable("masteruser");
   config_registry.RegisterMutable("max_eviction_per_heartbeat");
   config_registry.RegisterMutable("max_segment_to_consider");
+  config_registry.RegisterMutable("namespace_max_memory");
 
   config_registry.RegisterMutable("oom_deny_ratio", [](const absl::CommandLineFlag& flag) {
     auto res = flag.TryGet<double>();
@@ -929,6 +1042,7 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
                                   });
   config_registry.RegisterMutable("replica_partial_sync");
   config_registry.RegisterMutable("replication_timeout");
+  config_registry.RegisterMutable("slot_migration_max_bandwidth");
   config_registry.RegisterMutable("table_growth_margin");
   config_registry.RegisterMutable("tcp_keepalive");
 
@@ -951,6 +1065,21 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
         return true;
       });
 
+  config_registry.RegisterMutable(
+      "notify_keyspace_events_prefixes", [pool = &pp_](const absl::CommandLineFlag& flag) {
+        auto res = flag.TryGet<std::vector<std::string>>();
+        if (!res.has_value())
+          return false;
+
+        pool->AwaitBrief([&res](unsigned, auto*) {
+          if (auto* shard = EngineShard::tlocal(); shard) {
+            auto& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id());
+            db_slice.SetKeyspaceEventsPrefixes(*res);
+          }
+        });
+        return true;
+      });
+
   serialization_max_chunk_size = GetFlag(FLAGS_serialization_max_chunk_size);
   uint32_t shard_num = GetFlag(FLAGS_num_shards);
   if (shard_num == 0 || shard_num > pp_.size()) {
@@ -960,12 +1089,16 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     shard_num = pp_.size();
   }
 
+  // Pin the threads before ServerState binds them to the numa nodes of their cpus.
+  facade::PlaceProactorThreads(&pp_, shard_num);
+
   ChannelStore* cs = new ChannelStore{};
   // Must initialize before the shard_set because EngineShard::Init references ServerState.
   pp_.AwaitBrief([&](uint32_t index, ProactorBase* pb) {
     tl_facade_stats = new FacadeStats;
     ServerState::Init(index, shard_num, &user_registry_);
     ServerState::tlocal()->UpdateChannelStore(cs);
+    ServerState::tlocal()->StartLagProbe();
   });
 
   const auto tcp_disabled = GetFlag(FLAGS_port) == 0u;
@@ -979,9 +1112,15 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   shard_set->Init(shard_num, [this] {
     server_family_.GetDflyCmd()->BreakStalledFlowsInShard();
     server_family_.UpdateMemoryGlobalStats();
+    server_family_.RebalanceConnections();
   });
   Transaction::Init(shard_num);
 
+  const CommandId* cflush_cid = registry_.Find("CFLUSH");
+  pp_.AwaitBrief([cflush_cid](uint32_t, ProactorBase*) {
+    CounterFamily::InitThreadLocal(cflush_cid);
+  });
+
   SetOomDenyRatioOnAllThreads(absl::GetFlag(FLAGS_oom_deny_ratio));
   SetRssOomDenyRatioOnAllThreads(absl::GetFlag(FLAGS_rss_oom_deny_ratio));
 
@@ -997,6 +1136,8 @@ void Service::Shutdown() {
   // rejected
   pp_.AwaitFiberOnAll([](ProactorBase* pb) {
     ServerState::tlocal()->EnterLameDuck();
+    ServerState::tlocal()->StopLagProbe();
+    CounterFamily::ShutdownThreadLocal();
     facade::Connection::ShutdownThreadLocal();
   });
 
@@ -1037,30 +1178,7 @@ optional<ErrorReply> Service::CheckKeysOwnership(const CommandId* cid, CmdArgLis
     return ErrorReply{key_index_res.status()};
   }
 
-  const auto& key_index = *key_index_res;
-  optional<cluster::SlotId> keys_slot;
-  bool cross_slot = false;
-  // Iterate keys and check to which slot they belong.
-  for (string_view key : key_index.Range(args)) {
-    if (cluster::SlotId slot = cluster::KeySlot(key); keys_slot && slot != *keys_slot) {
-      cross_slot = true;  // keys belong to different slots
-      break;
-    } else {
-      keys_slot = slot;
-    }
-  }
-
-  if (cross_slot) {
-    return ErrorReply{"-CROSSSLOT Keys in request don't hash to the same slot"};
-  }
-
-  if (keys_slot.has_value()) {
-    if (auto error_str = cluster::SlotOwnershipErrorStr(*keys_slot); error_str) {
-      return ErrorReply{std::move(*error_str)};
-    }
-  }
-
-  return nullopt;
+  return CheckSlotOwnership(key_index_res->Range(args));
 }
 
 // Return OK if all keys are allowed to be accessed: either declared in EVAL or
@@ -1090,6 +1208,29 @@ optional<ErrorReply> CheckKeysDeclared(const ConnectionState::ScriptInfo& eval_i
   return nullopt;
 }
 
+// Return OK if the command queued in a MULTI KEYS transaction accesses only the declared keys.
+optional<ErrorReply> CheckMultiKeysDeclared(const ConnectionState::ExecInfo& exec_info,
+                                            const CommandId* cid, CmdArgList args) {
+  // Commands without keys access arbitrary shards, which requires a global transaction.
+  if (cid->opt_mask() & (CO::GLOBAL_TRANS | CO::NO_KEY_TRANSACTIONAL))
+    return ErrorReply{absl::StrCat("'", cid->name(), "' inside MULTI KEYS is not allowed")};
+
+  if (!cid->IsTransactional())
+    return nullopt;
+
+  OpResult<KeyIndex> key_index_res = DetermineKeys(cid, args);
+  if (!key_index_res)
+    return ErrorReply{key_index_res.status()};
+
+  const auto& declared = exec_info.declared_keys;
+  for (string_view key : key_index_res->Range(args)) {
+    if (!binary_search(declared.begin(), declared.end(), key, std::less<>{}))
+      return ErrorReply{absl::StrCat("transaction tried accessing undeclared key, key: ", key)};
+  }
+
+  return nullopt;
+}
+
 static optional<ErrorReply> VerifyConnectionAclStatus(const CommandId* cid,
                                                       const ConnectionContext* cntx,
                                                       string_view error_msg, CmdArgList tail_args) {
@@ -1105,9 +1246,16 @@ static optional<ErrorReply> VerifyConnectionAclStatus(const CommandId* cid,
   return nullopt;
 }
 
-bool ShouldDenyOnOOM(const CommandId* cid) {
+bool ShouldDenyOnOOM(const CommandId* cid, const Namespace* ns) {
   ServerState& etl = *ServerState::tlocal();
   if ((cid->opt_mask() & CO::DENYOOM) && etl.is_master) {
+    if (ns && ns->IsOverQuota(etl.oom_deny_ratio)) {
+      DLOG(WARNING) << "Namespace out of memory, used " << ns->UsedMemory() << " ,limit "
+                    << ns->MaxMemory();
+      etl.stats.oom_error_cmd_cnt++;
+      return true;
+    }
+
     uint64_t start_ns = absl::GetCurrentTimeNanos();
     auto memory_stats = etl.GetMemoryUsage(start_ns);
 
@@ -1126,7 +1274,7 @@ bool ShouldDenyOnOOM(const CommandId* cid) {
 optional<ErrorReply> Service::VerifyCommandExecution(const CommandId* cid,
                                                      const ConnectionContext* cntx,
                                                      CmdArgList tail_args) {
-  if (ShouldDenyOnOOM(cid)) {
+  if (ShouldDenyOnOOM(cid, cntx->ns)) {
     return facade::ErrorReply{kOutOfMemory};
   }
 
@@ -1204,6 +1352,11 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
 
     if (cmd_name == "WATCH" || cmd_name == "FLUSHALL" || cmd_name == "FLUSHDB")
       return ErrorReply{absl::StrCat("'", cmd_name, "' inside MULTI is not allowed")};
+
+    if (const auto& exec_info = dfly_cntx.conn_state.exec_info; !exec_info.declared_keys.empty()) {
+      if (auto err = CheckMultiKeysDeclared(exec_info, cid, tail_args); err)
+        return err;
+    }
   }
 
   if (cluster::IsClusterEnabled()) {
@@ -1246,11 +1399,11 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
 
   ServerState& etl = *ServerState::tlocal();
 
-  string cmd = absl::AsciiStrToUpper(ArgS(args, 0));
+  string_view cmd = ArgS(args, 0);
   const auto [cid, args_no_cmd] = registry_.FindExtended(cmd, args.subspan(1));
 
   if (cid == nullptr) {
-    return cntx->SendError(ReportUnknownCmd(cmd));
+    return cntx->SendError(ReportUnknownCmd(absl::AsciiStrToUpper(cmd)));
   }
 
   ConnectionContext* dfly_cntx = static_cast<ConnectionContext*>(cntx);
@@ -1266,7 +1419,8 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
   // Don't interrupt running multi commands or admin connections.
   if (etl.IsPaused() && !dispatching_in_multi && cntx->conn() && !cntx->conn()->IsPrivileged()) {
     bool is_write = cid->IsWriteOnly();
-    is_write |= cid->name() == "PUBLISH" || cid->name() == "EVAL" || cid->name() == "EVALSHA";
+    is_write |= cid->name() == "PUBLISH" || cid->name() == "SPUBLISH" || cid->name() == "EVAL" ||
+                cid->name() == "EVALSHA";
     is_write |= cid->name() == "EXEC" && dfly_cntx->conn_state.exec_info.is_write;
 
     cntx->paused = true;
@@ -1285,6 +1439,11 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
       server_family_.GetDflyCmd()->OnClose(dfly_cntx);
       return;
     }
+    // Clients that fetched the topology get a single MOVED hint before forwarding resumes
+    if (IsMovedForwardable(*err, cid, *dfly_cntx) &&
+        !std::exchange(dfly_cntx->conn_state.moved_hint_pending, false) &&
+        cluster::ForwardMovedCommand(err->ToSv(), args, dfly_cntx))
+      return;
     dfly_cntx->SendError(std::move(*err));
     return;
   }
@@ -1321,7 +1480,7 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
     DCHECK(dfly_cntx->transaction == nullptr);
 
     if (cid->IsTransactional()) {
-      dist_trans.reset(new Transaction{cid});
+      dist_trans.reset(Transaction::Create(cid));
 
       if (!dist_trans->IsMulti()) {  // Multi command initialize themself based on their mode.
         CHECK(dfly_cntx->ns != nullptr);
@@ -1443,6 +1602,16 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
   // Verifies that we reply to the client when needed.
   ReplyGuard reply_guard(cntx, cid->name());
 #endif
+  // Commands that are part of a multi transaction share its timings, so only its owner
+  // command tracks them. The slow log reports them as well, at the cost of a few clock reads.
+  auto* ss = ServerState::tlocal();
+  bool track_phases =
+      (ss->latency_tracking || ss->GetSlowLog().IsEnabled()) && trans && !trans->IsMulti();
+  if (track_phases)
+    trans->EnablePhaseTimings();
+
+  size_t reply_bytes = cntx->reply_builder()->reply_bytes();
+  uint64_t send_usec = cntx->reply_builder()->send_usec();
   uint64_t invoke_time_usec = 0;
   auto last_error = cntx->reply_builder()->ConsumeLastError();
   DCHECK(last_error.empty());
@@ -1453,6 +1622,10 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
     return false;
   }
 
+  // Multi transactions report the shards of their scripts themselves, see EvalInternal.
+  if (trans && !trans->IsMulti() && trans->GetUniqueShardCnt() == 1)
+    server_family_.UpdateShardAffinity(trans->GetUniqueShard(), cntx);
+
   std::string reason = cntx->reply_builder()->ConsumeLastError();
 
   if (!reason.empty()) {
@@ -1470,6 +1643,20 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
     cntx->conn_state.tracking_info_.IncrementSequenceNumber();
   }
 
+  optional<Transaction::PhaseTimings> phases;
+  if (track_phases)
+    phases = trans->GetPhaseTimings();
+
+  if (ServerState::SafeTLocal()->latency_tracking) {
+    auto& latency = ServerState::SafeTLocal()->GetCmdLatency(cid_name);
+    latency.total_usec.Add(invoke_time_usec);
+    if (phases) {
+      latency.schedule_usec.Add(phases->schedule_usec);
+      latency.queue_usec.Add(phases->queue_usec);
+      latency.exec_usec.Add(phases->exec_usec);
+    }
+  }
+
   // TODO: we should probably discard more commands here,
   // not just the blocking ones
   const auto* conn = cntx->conn();
@@ -1485,9 +1672,20 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
       aux_slices.emplace_back(aux_params.back());
       tail_args = absl::MakeSpan(aux_slices);
     }
+    SlowLogDetails details;
+    if (phases) {
+      details.schedule_usec = phases->schedule_usec;
+      details.queue_usec = phases->queue_usec;
+      details.exec_usec = phases->exec_usec;
+      details.hops = phases->hops;
+      details.shards = phases->shards;
+      details.tiered_reads = phases->tiered_reads;
+    }
+    details.reply_usec = cntx->reply_builder()->send_usec() - send_usec;
+    details.reply_bytes = cntx->reply_builder()->reply_bytes() - reply_bytes;
     ServerState::SafeTLocal()->GetSlowLog().Add(cid->name(), tail_args, conn->GetName(),
                                                 conn->RemoteEndpointStr(), invoke_time_usec,
-                                                absl::GetCurrentTimeNanos() / 1000);
+                                                absl::GetCurrentTimeNanos() / 1000, details);
   }
 
   if (cntx->transaction && !cntx->conn_state.exec_info.IsRunning() &&
@@ -1509,6 +1707,9 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list,
   size_t dispatched = 0;
   auto* ss = dfly::ServerState::tlocal();
 
+  facade::SquashInfo& squash_info = dfly_cntx->squash_info;
+  squash_info.squashed = squash_info.hops = squash_info.full_hops = 0;
+
   auto perform_squash = [&] {
     if (stored_cmds.empty())
       return;
@@ -1522,9 +1723,14 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list,
     }
 
     dfly_cntx->transaction = dist_trans.get();
-    MultiCommandSquasher::Execute(absl::MakeSpan(stored_cmds), dfly_cntx, this, true, false);
+    auto stats = MultiCommandSquasher::Execute(absl::MakeSpan(stored_cmds), dfly_cntx, this, true,
+                                               false, squash_info.batch_limit);
     dfly_cntx->transaction = nullptr;
 
+    squash_info.squashed += stats.squashed;
+    squash_info.hops += stats.hops;
+    squash_info.full_hops += stats.full_hops;
+
     dispatched += stored_cmds.size();
     ss->stats.squashed_commands += stored_cmds.size();
     stored_cmds.clear();
@@ -1535,8 +1741,7 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list,
     return 0;
 
   for (auto args : args_list) {
-    string cmd = absl::AsciiStrToUpper(ArgS(args, 0));
-    const auto [cid, tail_args] = registry_.FindExtended(cmd, args.subspan(1));
+    const auto [cid, tail_args] = registry_.FindExtended(ArgS(args, 0), args.subspan(1));
 
     // MULTI...EXEC commands need to be collected into a single context, so squashing is not
     // possible
@@ -1588,6 +1793,7 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
 
   MCReplyBuilder* mc_builder = static_cast<MCReplyBuilder*>(cntx->reply_builder());
   mc_builder->SetNoreply(cmd.no_reply);
+  const MemcacheParser::Command* meta_cmd = &cmd;
 
   switch (cmd.type) {
     case MemcacheParser::REPLACE:
@@ -1633,6 +1839,38 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
     case MemcacheParser::VERSION:
       mc_builder->SendSimpleString("VERSION 1.5.0 DF");
       return;
+    case MemcacheParser::META_NOOP:
+      mc_builder->SendSimpleString("MN");
+      return;
+    case MemcacheParser::META_GET:
+      DispatchManyMC({&meta_cmd, 1}, cntx);
+      return;
+    case MemcacheParser::META_SET:
+      switch (cmd.meta.mode) {
+        case 'A':
+          strcpy(cmd_name, "APPEND");
+          break;
+        case 'P':
+          strcpy(cmd_name, "PREPEND");
+          break;
+        default:
+          strcpy(cmd_name, "SET");
+          if (cmd.meta.mode == 'E')
+            strcpy(store_opt, "NX");
+          else if (cmd.meta.mode == 'R')
+            strcpy(store_opt, "XX");
+      }
+      break;
+    case MemcacheParser::META_DELETE:
+      strcpy(cmd_name, "DEL");
+      break;
+    case MemcacheParser::META_ARITHM:
+      if (cmd.meta.mode == 'I' || cmd.meta.mode == '+')
+        strcpy(cmd_name, "INCRBY");
+      else
+        strcpy(cmd_name, "DECRBY");
+      absl::numbers_internal::FastIntToBuffer(cmd.delta, store_opt);
+      break;
     default:
       mc_builder->SendClientError("bad command line format");
       return;
@@ -1678,10 +1916,42 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
     }
   }
 
+  if (cmd.IsMeta())
+    mc_builder->SetCommands({&meta_cmd, 1});
+
   DispatchCommand(CmdArgList{args}, cntx);
 
   // Reset back.
   dfly_cntx->conn_state.memcache_flag = 0;
+  mc_builder->SetCommands({});
+}
+
+void Service::DispatchManyMC(absl::Span<const MemcacheParser::Command* const> cmds,
+                             facade::ConnectionContext* cntx) {
+  // A batch of gets is served by one MGET over the keys of all of them, which replies to every
+  // command separately.
+  absl::InlinedVector<MutableSlice, 16> args;
+  char cmd_name[] = "MGET";
+  args.emplace_back(cmd_name, strlen(cmd_name));
+
+  ConnectionContext* dfly_cntx = static_cast<ConnectionContext*>(cntx);
+  for (const auto* cmd : cmds) {
+    DCHECK(cmd->type == MemcacheParser::GET || cmd->type == MemcacheParser::META_GET);
+    args.emplace_back(const_cast<char*>(cmd->key.data()), cmd->key.size());
+    for (string_view key : cmd->keys_ext)
+      args.emplace_back(const_cast<char*>(key.data()), key.size());
+    if (cmd->meta.return_cas)
+      dfly_cntx->conn_state.memcache_flag = ConnectionState::FETCH_CAS_VER;
+  }
+
+  MCReplyBuilder* mc_builder = static_cast<MCReplyBuilder*>(cntx->reply_builder());
+  mc_builder->SetNoreply(false);
+  mc_builder->SetCommands(cmds);
+
+  DispatchCommand(CmdArgList{args}, cntx);
+
+  dfly_cntx->conn_state.memcache_flag = 0;
+  mc_builder->SetCommands({});
 }
 
 ErrorReply Service::ReportUnknownCmd(string_view cmd_name) {
@@ -1764,7 +2034,28 @@ void Service::Multi(CmdArgList args, ConnectionContext* cntx) {
   if (cntx->conn_state.exec_info.IsCollecting()) {
     return cntx->SendError("MULTI calls can not be nested");
   }
-  cntx->conn_state.exec_info.state = ConnectionState::ExecInfo::EXEC_COLLECT;
+
+  // MULTI KEYS key [key ...] declares all the keys the transaction accesses.
+  vector<string> declared_keys;
+  if (!args.empty()) {
+    CmdArgParser parser{args};
+    parser.ExpectTag("KEYS");
+    if (!parser.HasError() && !parser.HasNext())
+      return cntx->SendError(kSyntaxErr);
+
+    while (parser.HasNext())
+      declared_keys.emplace_back(parser.Next<string_view>());
+
+    if (auto err = parser.Error(); err)
+      return cntx->SendError(err->MakeReply());
+
+    sort(declared_keys.begin(), declared_keys.end());
+    declared_keys.erase(unique(declared_keys.begin(), declared_keys.end()), declared_keys.end());
+  }
+
+  auto& exec_info = cntx->conn_state.exec_info;
+  exec_info.state = ConnectionState::ExecInfo::EXEC_COLLECT;
+  exec_info.declared_keys = std::move(declared_keys);
   // TODO: to protect against huge exec transactions.
   return cntx->SendOk();
 }
@@ -1772,36 +2063,28 @@ void Service::Multi(CmdArgList args, ConnectionContext* cntx) {
 void Service::Watch(CmdArgList args, ConnectionContext* cntx) {
   auto& exec_info = cntx->conn_state.exec_info;
 
-  // Skip if EXEC will already fail due previous WATCH.
-  if (exec_info.watched_dirty.load(memory_order_relaxed)) {
-    return cntx->SendOk();
-  }
-
-  atomic_uint32_t keys_existed = 0;
+  // Keys are not registered anywhere, only their versions are recorded for EXEC to validate.
+  vector<uint64_t> versions(args.size());
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    ShardId shard_id = shard->shard_id();
-    ShardArgs largs = t->GetShardArgs(shard_id);
-    for (auto k : largs) {
-      t->GetDbSlice(shard_id).RegisterWatchedKey(cntx->db_index(), k, &exec_info);
-    }
-
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), largs);
-    keys_existed.fetch_add(res.value_or(0), memory_order_relaxed);
+    ShardArgs largs = t->GetShardArgs(shard->shard_id());
+    auto& db_slice = t->GetDbSlice(shard->shard_id());
+    for (auto it = largs.begin(); it != largs.end(); ++it)
+      versions[it.index()] = db_slice.WatchVersion(t->GetDbContext(), *it);
     return OpStatus::OK;
   };
   cntx->transaction->ScheduleSingleHop(std::move(cb));
 
-  // Duplicate keys are stored to keep correct count.
-  exec_info.watched_existed += keys_existed.load(memory_order_relaxed);
   for (std::string_view key : ArgS(args)) {
     exec_info.watched_keys.emplace_back(cntx->db_index(), key);
   }
+  exec_info.watched_versions.insert(exec_info.watched_versions.end(), versions.begin(),
+                                    versions.end());
 
   return cntx->SendOk();
 }
 
 void Service::Unwatch(CmdArgList args, ConnectionContext* cntx) {
-  UnwatchAllKeys(cntx->ns, &cntx->conn_state.exec_info);
+  cntx->conn_state.exec_info.ClearWatched();
   return cntx->SendOk();
 }
 
@@ -1821,6 +2104,7 @@ optional<CapturingReplyBuilder::Payload> Service::FlushEvalAsyncCmds(ConnectionC
     return nullopt;
 
   ++ServerState::tlocal()->stats.eval_squashed_flushes;
+  ++info->hops;
 
   auto* eval_cid = registry_.Find("EVAL");
   DCHECK(eval_cid);
@@ -1838,14 +2122,71 @@ optional<CapturingReplyBuilder::Payload> Service::FlushEvalAsyncCmds(ConnectionC
   return CapturingReplyBuilder::TryExtractError(reply) ? make_optional(std::move(reply)) : nullopt;
 }
 
+void Service::FlushEvalBatchCmds(ConnectionContext* cntx) {
+  auto& info = cntx->conn_state.script_info;
+  if (info->batch_cmds.empty())
+    return;
+
+  ++ServerState::tlocal()->stats.eval_squashed_flushes;
+  ++info->hops;
+
+  auto* eval_cid = registry_.Find("EVAL");
+  DCHECK(eval_cid);
+  cntx->transaction->MultiSwitchCmd(eval_cid);
+
+  MultiCommandSquasher::Execute(absl::MakeSpan(info->batch_cmds), cntx, this, true, false);
+
+  info->batch_cmds_heap_mem = 0;
+  info->batch_cmds.clear();
+}
+
 void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca) {
   DCHECK(cntx->transaction);
-  DVLOG(2) << "CallFromScript " << ArgS(ca.args, 0);
+  DVLOG(2) << "CallFromScript " << (ca.args.empty() ? "<batch end>" : ArgS(ca.args, 0));
+
+  auto& sinfo = cntx->conn_state.script_info;
+  uint64_t start = absl::GetCurrentTimeNanos();
+  absl::Cleanup record_time = [&sinfo, start] {
+    sinfo->redis_call_ns += absl::GetCurrentTimeNanos() - start;
+  };
+  sinfo->redis_calls += !ca.args.empty();
 
-  InterpreterReplier replier(ca.translator);
+  // Batched calls send several replies, one per command.
+  InterpreterReplier replier(ca.translator, ca.batch);
   facade::SinkReplyBuilder* orig = cntx->Inject(&replier);
   absl::Cleanup clean = [orig, cntx] { cntx->Inject(orig); };
 
+  if (ca.batch) {
+    // Flush the preceding acalls to keep the order of effects.
+    if (auto err = FlushEvalAsyncCmds(cntx, true); err) {
+      CapturingReplyBuilder::Apply(std::move(*err), &replier);
+      *ca.requested_abort = true;
+      return;
+    }
+
+    auto& info = cntx->conn_state.script_info;
+    if (ca.args.empty())
+      return FlushEvalBatchCmds(cntx);
+
+    // Commands that can not be queued are executed directly after the queued ones. When the
+    // script runs remotely on a single shard there is nothing to gain from queueing.
+    auto* cid = registry_.Find(absl::AsciiStrToUpper(ArgS(ca.args, 0)));
+    if (cid == nullptr || !ca.async) {
+      FlushEvalBatchCmds(cntx);
+      if (cid == nullptr)
+        return replier.RedisReplyBuilder::SendError(ReportUnknownCmd(ArgS(ca.args, 0)));
+      ++sinfo->hops;
+      return DispatchCommand(ca.args, cntx);
+    }
+
+    info->batch_cmds.emplace_back(std::move(*ca.buffer), cid, ca.args.subspan(1));
+    info->batch_cmds_heap_mem += info->batch_cmds.back().UsedMemory();
+    if (info->batch_cmds_heap_mem + info->batch_cmds.size() * sizeof(StoredCmd) >=
+        info->async_cmds_heap_limit)
+      FlushEvalBatchCmds(cntx);
+    return;
+  }
+
   optional<ErrorReply> findcmd_err;
 
   if (ca.async) {
@@ -1876,6 +2217,7 @@ void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca)
   if (ca.async)
     return;
 
+  ++sinfo->hops;
   DispatchCommand(ca.args, cntx);
 }
 
@@ -1914,11 +2256,15 @@ void Service::CallSHA(CmdArgList args, string_view sha, Interpreter* interpreter
   ev_args.keys = args.subspan(2, num_keys);
   ev_args.args = args.subspan(2 + num_keys);
 
+  ServerState::ScriptStats run;
   uint64_t start = absl::GetCurrentTimeNanos();
-  EvalInternal(args, ev_args, interpreter, cntx);
+  EvalInternal(args, ev_args, interpreter, cntx, &run);
 
   uint64_t end = absl::GetCurrentTimeNanos();
-  ServerState::tlocal()->RecordCallLatency(sha, (end - start) / 1000);
+  run.calls = 1;
+  run.total_usec = run.max_usec = (end - start) / 1000;
+  ServerState::tlocal()->RecordCallLatency(sha, run.total_usec);
+  ServerState::tlocal()->RecordScriptRun(sha, run);
 }
 
 optional<ScriptMgr::ScriptParams> LoadScript(string_view sha, ScriptMgr* script_mgr,
@@ -2015,7 +2361,7 @@ static bool CanRunSingleShardMulti(optional<ShardId> sid, const ScriptMgr::Scrip
 }
 
 void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpreter* interpreter,
-                           ConnectionContext* cntx) {
+                           ConnectionContext* cntx, ServerState::ScriptStats* run) {
   DCHECK(!eval_args.sha.empty());
 
   // Sanitizing the input to avoid code injection.
@@ -2039,6 +2385,7 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
   sinfo->lock_tags.reserve(eval_args.keys.size());
 
   optional<ShardId> sid;
+  absl::InlinedVector<ShardId, 4> key_shards;
 
   cluster::UniqueSlotChecker slot_checker;
   for (size_t i = 0; i < eval_args.keys.size(); ++i) {
@@ -2053,7 +2400,10 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
     if (sid.has_value() && *sid != cur_sid) {
       sid = nullopt;
     }
+    if (find(key_shards.begin(), key_shards.end(), cur_sid) == key_shards.end())
+      key_shards.push_back(cur_sid);
   }
+  run->shards = key_shards.size();
 
   sinfo->async_cmds_heap_limit = absl::GetFlag(FLAGS_multi_eval_squash_buffer);
   Transaction* tx = cntx->transaction;
@@ -2061,8 +2411,14 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
 
   interpreter->SetGlobalArray("KEYS", eval_args.keys);
   interpreter->SetGlobalArray("ARGV", eval_args.args);
-
-  absl::Cleanup clean = [interpreter, &sinfo]() {
+  interpreter->SetSamplingPeriod(absl::GetFlag(FLAGS_lua_profile_sampling_period));
+  interpreter->SetRunMemory(absl::GetFlag(FLAGS_lua_arena_size).value,
+                            absl::GetFlag(FLAGS_lua_script_max_memory).value);
+
+  absl::Cleanup clean = [interpreter, &sinfo, run]() {
+    run->redis_call_usec = sinfo->redis_call_ns / 1000;
+    run->redis_calls = sinfo->redis_calls;
+    run->hops = sinfo->hops;
     interpreter->ResetStack();
     sinfo.reset();
   };
@@ -2089,8 +2445,12 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
       cntx->transaction = tx;
       return OpStatus::OK;
     });
+    sinfo->hops = 1;  // the commands ran inside the single hop.
 
-    if (*sid != ServerState::tlocal()->thread_index()) {
+    // Without the affinity controller, scripts move the connection to their shard right away.
+    server_family_.UpdateShardAffinity(*sid, cntx);
+    if (ServerState::tlocal()->conn_affinity_window == 0 &&
+        *sid != ServerState::tlocal()->thread_index()) {
       VLOG(2) << "Migrating connection " << cntx->conn() << " from "
               << ProactorBase::me()->GetPoolIndex() << " to " << *sid;
       cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(*sid));
@@ -2146,9 +2506,9 @@ void Service::Discard(CmdArgList args, ConnectionContext* cntx) {
   rb->SendOk();
 }
 
-// Return true if non of the connections watched keys expired.
-bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandId* exists_cid,
-                           const CommandId* exec_cid) {
+// Return true if none of the connection's watched keys changed since WATCH.
+bool CheckWatchedKeyVersions(ConnectionContext* cntx, const CommandId* exists_cid,
+                             const CommandId* exec_cid) {
   auto& exec_info = cntx->conn_state.exec_info;
 
   CmdArgVec str_list(exec_info.watched_keys.size());
@@ -2157,12 +2517,17 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandId* exists_cid,
     str_list[i] = MutableSlice{s.data(), s.size()};
   }
 
-  atomic_uint32_t watch_exist_count{0};
-  auto cb = [&watch_exist_count](Transaction* t, EngineShard* shard) {
+  atomic_bool changed{false};
+  auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardArgs args = t->GetShardArgs(shard->shard_id());
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), args);
-    watch_exist_count.fetch_add(res.value_or(0), memory_order_relaxed);
-
+    auto& db_slice = t->GetDbSlice(shard->shard_id());
+    for (auto it = args.begin(); it != args.end(); ++it) {
+      uint64_t version = exec_info.watched_versions[it.index()];
+      if (db_slice.WatchedKeyChanged(t->GetDbContext(), *it, version)) {
+        changed.store(true, memory_order_relaxed);
+        break;
+      }
+    }
     return OpStatus::OK;
   };
 
@@ -2174,10 +2539,7 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandId* exists_cid,
   // Reset cid to EXEC as it was before
   cntx->transaction->MultiSwitchCmd(exec_cid);
 
-  // The comparison can still be true even if a key expired due to another one being created.
-  // So we have to check the watched_dirty flag, which is set if a key expired.
-  return watch_exist_count.load() == exec_info.watched_existed &&
-         !exec_info.watched_dirty.load(memory_order_relaxed);
+  return !changed.load(memory_order_relaxed);
 }
 
 // Check if exec_info watches keys on dbs other than db_indx.
@@ -2194,6 +2556,13 @@ template <typename F> void IterateAllKeys(ConnectionState::ExecInfo* exec_info,
   for (auto& [dbid, key] : exec_info->watched_keys)
     f(MutableSlice{key.data(), key.size()});
 
+  // The queued commands access only the declared keys, including the keys of their scripts.
+  if (!exec_info->declared_keys.empty()) {
+    for (string& key : exec_info->declared_keys)
+      f(MutableSlice{key.data(), key.size()});
+    return;
+  }
+
   CmdArgVec arg_vec{};
 
   for (auto& scmd : exec_info->body) {
@@ -2261,10 +2630,6 @@ void Service::Exec(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendError("Dragonfly does not allow WATCH and EXEC on different databases");
   }
 
-  if (exec_info.watched_dirty.load(memory_order_relaxed)) {
-    return rb->SendNull();
-  }
-
   cntx->last_command_debug.exec_body_len = exec_info.body.size();
 
   // The transaction can contain scripts, determine their presence ahead to customize logic below.
@@ -2285,9 +2650,9 @@ void Service::Exec(CmdArgList args, ConnectionContext* cntx) {
     scheduled = true;
   }
 
-  // EXEC should not run if any of the watched keys expired.
+  // EXEC should not run if any of the watched keys changed or expired.
   if (!exec_info.watched_keys.empty() &&
-      !CheckWatchedKeyExpiry(cntx, registry_.Find("EXISTS"), exec_cid_)) {
+      !CheckWatchedKeyVersions(cntx, registry_.Find("EXISTS"), exec_cid_)) {
     cntx->transaction->UnlockMulti();
     return rb->SendNull();
   }
@@ -2357,6 +2722,19 @@ void Service::Publish(CmdArgList args, ConnectionContext* cntx) {
   cntx->SendLong(cs->SendMessages(channel, messages));
 }
 
+void Service::SPublish(CmdArgList args, ConnectionContext* cntx) {
+  if (cluster::IsClusterEnabled()) {
+    if (auto err = CheckSlotOwnership(ArgS(args.subspan(0, 1))); err)
+      return cntx->SendError(std::move(*err));
+  }
+
+  string_view channel = ArgS(args, 0);
+  string_view messages[] = {ArgS(args, 1)};
+
+  auto* cs = ServerState::tlocal()->channel_store();
+  cntx->SendLong(cs->SendMessages(channel, messages, true));
+}
+
 void Service::Subscribe(CmdArgList args, ConnectionContext* cntx) {
   if (cluster::IsClusterEnabled()) {
     return cntx->SendError("SUBSCRIBE is not supported in cluster mode yet");
@@ -2393,6 +2771,22 @@ void Service::PUnsubscribe(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
+void Service::SSubscribe(CmdArgList args, ConnectionContext* cntx) {
+  if (cluster::IsClusterEnabled()) {
+    if (auto err = CheckSlotOwnership(ArgS(args)); err)
+      return cntx->SendError(std::move(*err));
+  }
+  cntx->ChangeSSubscription(true, true, args);
+}
+
+void Service::SUnsubscribe(CmdArgList args, ConnectionContext* cntx) {
+  if (args.size() == 0) {
+    cntx->SUnsubscribeAll(true);
+  } else {
+    cntx->ChangeSSubscription(false, true, args);
+  }
+}
+
 // Not a real implementation. Serves as a decorator to accept some function commands
 // for testing.
 void Service::Function(CmdArgList args, ConnectionContext* cntx) {
@@ -2406,9 +2800,9 @@ void Service::Function(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendError(err, kSyntaxErrType);
 }
 
-void Service::PubsubChannels(string_view pattern, ConnectionContext* cntx) {
+void Service::PubsubChannels(string_view pattern, bool sharded, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->SendStringArr(ServerState::tlocal()->channel_store()->ListChannels(pattern));
+  rb->SendStringArr(ServerState::tlocal()->channel_store()->ListChannels(pattern, sharded));
 }
 
 void Service::PubsubPatterns(ConnectionContext* cntx) {
@@ -2417,34 +2811,59 @@ void Service::PubsubPatterns(ConnectionContext* cntx) {
   cntx->SendLong(pattern_count);
 }
 
-void Service::PubsubNumSub(CmdArgList args, ConnectionContext* cntx) {
+void Service::PubsubNumSub(CmdArgList args, bool sharded, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(args.size() * 2);
 
+  auto* cs = ServerState::tlocal()->channel_store();
   for (string_view channel : ArgS(args)) {
     rb->SendBulkString(channel);
-    rb->SendLong(ServerState::tlocal()->channel_store()->FetchSubscribers(channel).size());
+    rb->SendLong(cs->FetchSubscribers(channel, sharded).size());
   }
 }
 
 void Service::Monitor(CmdArgList args, ConnectionContext* cntx) {
+  // MONITOR [SAMPLE ratio] [MAXRATE count] [CMD name]... [PREFIX key-prefix]... [CLIENT id]...
+  MonitorFilter filter;
+  CmdArgParser parser{args};
+  while (parser.HasNext()) {
+    if (parser.Check("SAMPLE")) {
+      filter.sample_ratio = parser.Next<double>();
+      if (!parser.HasError() && !(filter.sample_ratio > 0 && filter.sample_ratio <= 1))
+        return cntx->SendError("ERR SAMPLE ratio must be in (0, 1]");
+    } else if (parser.Check("MAXRATE")) {
+      filter.max_rate = parser.Next<uint32_t>();
+    } else if (parser.Check("CMD")) {
+      filter.commands.push_back(absl::AsciiStrToUpper(parser.Next<string_view>()));
+    } else if (parser.Check("PREFIX")) {
+      filter.key_prefixes.emplace_back(parser.Next<string_view>());
+    } else if (parser.Check("CLIENT")) {
+      filter.clients.push_back(parser.Next<uint32_t>());
+    } else {
+      return cntx->SendError(kSyntaxErr);
+    }
+  }
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
   VLOG(1) << "starting monitor on this connection: " << cntx->conn()->GetClientId();
   // we are registering the current connection for all threads so they will be aware of
   // this connection, to send to it any command
   cntx->SendOk();
-  cntx->ChangeMonitor(true /* start */);
+  cntx->ChangeMonitor(true /* start */, std::move(filter));
 }
 
 void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
-  if (cluster::IsClusterEnabled()) {
-    return cntx->SendError("PUBSUB is not supported in cluster mode yet");
-  }
   if (args.size() < 1) {
     cntx->SendError(WrongNumArgsError(cntx->cid->name()));
     return;
   }
 
   string subcmd = absl::AsciiStrToUpper(ArgS(args, 0));
+  bool sharded = absl::StartsWith(subcmd, "SHARD");
+  if (cluster::IsClusterEnabled() && !sharded && subcmd != "HELP") {
+    return cntx->SendError("PUBSUB is not supported in cluster mode yet");
+  }
 
   if (subcmd == "HELP") {
     string_view help_arr[] = {
@@ -2456,6 +2875,10 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
         "NUMSUB [<channel> <channel...>]",
         "\tReturns the number of subscribers for the specified channels, excluding",
         "\tpattern subscriptions.",
+        "SHARDCHANNELS [<pattern>]",
+        "\tReturn the currently active shard level channels matching a <pattern> (default: '*').",
+        "SHARDNUMSUB [<shardchannel> <shardchannel...>]",
+        "\tReturns the number of subscribers for the specified shard level channel(s).",
         "HELP",
         "\tPrints this help."};
 
@@ -2464,18 +2887,18 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
     return;
   }
 
-  if (subcmd == "CHANNELS") {
+  if (subcmd == "CHANNELS" || subcmd == "SHARDCHANNELS") {
     string_view pattern;
     if (args.size() > 1) {
       pattern = ArgS(args, 1);
     }
 
-    PubsubChannels(pattern, cntx);
+    PubsubChannels(pattern, sharded, cntx);
   } else if (subcmd == "NUMPAT") {
     PubsubPatterns(cntx);
-  } else if (subcmd == "NUMSUB") {
+  } else if (subcmd == "NUMSUB" || subcmd == "SHARDNUMSUB") {
     args.remove_prefix(1);
-    PubsubNumSub(args, cntx);
+    PubsubNumSub(args, sharded, cntx);
   } else {
     cntx->SendError(UnknownSubCmd(subcmd, "PUBSUB"));
   }
@@ -2625,6 +3048,7 @@ void Service::ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privil
   server_family_.ConfigureMetrics(base);
   base->RegisterCb("/txz", TxTable);
   base->RegisterCb("/topkeys", Topkeys);
+  base->RegisterCb("/heapz", HeapProfile);
   base->RegisterCb("/clusterz", [this](const http::QueryArgs& args, HttpContext* send) {
     return ClusterHtmlPage(args, send, &cluster_family_);
   });
@@ -2646,16 +3070,18 @@ void Service::OnConnectionClose(facade::ConnectionContext* cntx) {
       server_cntx->UnsubscribeAll(false);
     }
 
-    if (conn_state.subscribe_info) {
-      DCHECK(!conn_state.subscribe_info->patterns.empty());
+    if (conn_state.subscribe_info && !conn_state.subscribe_info->patterns.empty()) {
       server_cntx->PUnsubscribeAll(false);
     }
 
+    if (conn_state.subscribe_info) {
+      DCHECK(!conn_state.subscribe_info->shard_channels.empty());
+      server_cntx->SUnsubscribeAll(false);
+    }
+
     DCHECK(!conn_state.subscribe_info);
   }
 
-  UnwatchAllKeys(server_cntx->ns, &conn_state.exec_info);
-
   DeactivateMonitoring(server_cntx);
 
   server_family_.OnClose(server_cntx);
@@ -2692,6 +3118,9 @@ constexpr uint32_t kSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPUnsubsribe = PUBSUB | SLOW;
+constexpr uint32_t kSPublish = PUBSUB | FAST;
+constexpr uint32_t kSSubscribe = PUBSUB | SLOW;
+constexpr uint32_t kSUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kFunction = SLOW;
 constexpr uint32_t kMonitor = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kPubSub = SLOW;
@@ -2703,7 +3132,7 @@ void Service::Register(CommandRegistry* registry) {
   registry->StartFamily();
   *registry
       << CI{"QUIT", CO::FAST, 1, 0, 0, acl::kQuit}.HFUNC(Quit)
-      << CI{"MULTI", CO::NOSCRIPT | CO::FAST | CO::LOADING, 1, 0, 0, acl::kMulti}.HFUNC(Multi)
+      << CI{"MULTI", CO::NOSCRIPT | CO::FAST | CO::LOADING, -1, 0, 0, acl::kMulti}.HFUNC(Multi)
       << CI{"WATCH", CO::LOADING, -2, 1, -1, acl::kWatch}.HFUNC(Watch)
       << CI{"UNWATCH", CO::LOADING, 1, 0, 0, acl::kUnwatch}.HFUNC(Unwatch)
       << CI{"DISCARD", CO::NOSCRIPT | CO::FAST | CO::LOADING, 1, 0, 0, acl::kDiscard}.MFUNC(Discard)
@@ -2721,8 +3150,12 @@ void Service::Register(CommandRegistry* registry) {
       << CI{"PSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kPSubscribe}.MFUNC(PSubscribe)
       << CI{"PUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kPUnsubsribe}.MFUNC(
              PUnsubscribe)
+      << CI{"SPUBLISH", CO::LOADING | CO::FAST, 3, 0, 0, acl::kSPublish}.MFUNC(SPublish)
+      << CI{"SSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kSSubscribe}.MFUNC(SSubscribe)
+      << CI{"SUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kSUnsubscribe}.MFUNC(
+             SUnsubscribe)
       << CI{"FUNCTION", CO::NOSCRIPT, 2, 0, 0, acl::kFunction}.MFUNC(Function)
-      << CI{"MONITOR", CO::ADMIN, 1, 0, 0, acl::kMonitor}.MFUNC(Monitor)
+      << CI{"MONITOR", CO::ADMIN, -1, 0, 0, acl::kMonitor}.MFUNC(Monitor)
       << CI{"PUBSUB", CO::LOADING | CO::FAST, -1, 0, 0, acl::kPubSub}.MFUNC(Pubsub)
       << CI{"COMMAND", CO::LOADING | CO::NOSCRIPT, -1, 0, 0, acl::kCommand}.MFUNC(Command);
 }
@@ -2741,6 +3174,9 @@ void Service::RegisterCommands() {
   HllFamily::Register(&registry_);
   SearchFamily::Register(&registry_);
   BloomFamily::Register(&registry_);
+  TimeSeriesFamily::Register(&registry_);
+  SketchFamily::Register(&registry_);
+  CounterFamily::Register(&registry_);
   server_family_.Register(&registry_);
   cluster_family_.Register(&registry_);
 
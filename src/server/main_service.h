@@ -61,6 +61,9 @@ class Service : public facade::ServiceInterface {
   void DispatchMC(const MemcacheParser::Command& cmd, std::string_view value,
                   facade::ConnectionContext* cntx) final;
 
+  void DispatchManyMC(absl::Span<const MemcacheParser::Command* const> cmds,
+                      facade::ConnectionContext* cntx) final;
+
   facade::ConnectionContext* CreateContext(util::FiberSocketBase* peer,
                                            facade::Connection* owner) final;
 
@@ -134,14 +137,17 @@ class Service : public facade::ServiceInterface {
   void Unsubscribe(CmdArgList args, ConnectionContext* cntx);
   void PSubscribe(CmdArgList args, ConnectionContext* cntx);
   void PUnsubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SPublish(CmdArgList args, ConnectionContext* cntx);
+  void SSubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SUnsubscribe(CmdArgList args, ConnectionContext* cntx);
   void Function(CmdArgList args, ConnectionContext* cntx);
   void Monitor(CmdArgList args, ConnectionContext* cntx);
   void Pubsub(CmdArgList args, ConnectionContext* cntx);
   void Command(CmdArgList args, ConnectionContext* cntx);
 
-  void PubsubChannels(std::string_view pattern, ConnectionContext* cntx);
+  void PubsubChannels(std::string_view pattern, bool sharded, ConnectionContext* cntx);
   void PubsubPatterns(ConnectionContext* cntx);
-  void PubsubNumSub(CmdArgList channels, ConnectionContext* cntx);
+  void PubsubNumSub(CmdArgList channels, bool sharded, ConnectionContext* cntx);
 
   struct EvalArgs {
     std::string_view sha;  // only one of them is defined.
@@ -152,8 +158,9 @@ class Service : public facade::ServiceInterface {
   std::optional<facade::ErrorReply> CheckKeysOwnership(const CommandId* cid, CmdArgList args,
                                                        const ConnectionContext& dfly_cntx);
 
+  // Runs the script and fills the statistics of the run, except for its duration.
   void EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpreter* interpreter,
-                    ConnectionContext* cntx);
+                    ConnectionContext* cntx, ServerState::ScriptStats* run);
   void CallSHA(CmdArgList args, std::string_view sha, Interpreter* interpreter,
                ConnectionContext* cntx);
 
@@ -161,6 +168,10 @@ class Service : public facade::ServiceInterface {
   std::optional<facade::CapturingReplyBuilder::Payload> FlushEvalAsyncCmds(ConnectionContext* cntx,
                                                                            bool force = false);
 
+  // Executes the commands queued by redis.mcall in a squashed hop, their replies are sent to the
+  // reply builder of cntx in order.
+  void FlushEvalBatchCmds(ConnectionContext* cntx);
+
   void CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& args);
 
   void RegisterCommands();
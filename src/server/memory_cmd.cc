@@ -4,6 +4,7 @@
 
 #include "server/memory_cmd.h"
 
+#include <absl/random/random.h>
 #include <absl/strings/str_cat.h>
 
 #ifdef __linux__
@@ -12,6 +13,8 @@
 
 #include <mimalloc.h>
 
+#include <cmath>
+
 #include "base/logging.h"
 #include "core/allocation_tracker.h"
 #include "facade/cmd_arg_parser.h"
@@ -86,6 +89,106 @@ size_t MemoryUsage(PrimeIterator it) {
   return it->first.MallocUsed() + it->second.MallocUsed();
 }
 
+struct AnalyzeParams {
+  char delimiter = ':';
+  size_t top = 10;
+  double sample_ratio = 0.01;
+  uint32_t duration_sec = 1;
+  uint32_t cpu_budget_percent = 10;
+};
+
+// Sampled statistics of a key prefix in MEMORY ANALYZE. Keys and memory are sampled by buckets
+// of the prime table and accesses by key hashes, both with the probability sample_ratio.
+struct PrefixStats {
+  double keys = 0, keys_sq = 0;    // sums over the sampled buckets and of their squares
+  double bytes = 0, bytes_sq = 0;  // used for the variance of the estimates
+  uint64_t accesses = 0;
+};
+
+using PrefixStatsMap = absl::flat_hash_map<string, PrefixStats>;
+
+// Prefixes beyond this many per shard are accounted together to kOtherPrefix.
+constexpr size_t kMaxPrefixes = 4096;
+constexpr string_view kOtherPrefix = "(other)";
+
+atomic_bool analyze_running{false};
+
+// Returns the key up to and including the first delimiter, empty if it has none.
+string_view KeyPrefix(string_view key, char delimiter) {
+  size_t pos = key.find(delimiter);
+  return pos == string_view::npos ? string_view{} : key.substr(0, pos + 1);
+}
+
+PrefixStats& GetPrefixStats(string_view prefix, PrefixStatsMap* stats) {
+  if (auto it = stats->find(prefix); it != stats->end())
+    return it->second;
+  return (*stats)[stats->size() < kMaxPrefixes ? prefix : kOtherPrefix];
+}
+
+// Traverses a sample of the buckets of the shard under the CPU budget and samples the accesses
+// to its keys for at least duration_sec. Returns the sampling window in seconds.
+double AnalyzeShard(const AnalyzeParams& params, DbSlice* db_slice, DbIndex db_index,
+                    PrefixStatsMap* stats) {
+  uint64_t sample_bound = params.sample_ratio >= 1
+                              ? numeric_limits<uint64_t>::max()
+                              : uint64_t(params.sample_ratio * numeric_limits<uint64_t>::max());
+  db_slice->SetAccessObserver([&](DbIndex db, string_view key) {
+    if (db == db_index && CompactObj::HashCode(key) <= sample_bound)
+      GetPrefixStats(KeyPrefix(key, params.delimiter), stats).accesses++;
+  });
+
+  const uint64_t start = util::fb2::ProactorBase::GetMonotonicTimeNs();
+
+  // Hold the table so that it stays valid if the db is flushed while we sleep.
+  DbTableArray dbs = db_slice->databases();
+  if (db_index < dbs.size() && dbs[db_index]) {
+    PrimeTable* pt = &dbs[db_index]->prime;
+    absl::InsecureBitGen bitgen;
+    absl::flat_hash_map<string, pair<uint64_t, uint64_t>> bucket;  // keys and bytes by prefix
+    string scratch;
+    PrimeTable::Cursor cursor;
+    uint64_t work_start = start;
+    do {
+      bool sampled = absl::Bernoulli(bitgen, params.sample_ratio);
+      bucket.clear();
+      cursor = db_slice->Traverse(pt, cursor, [&](PrimeIterator it) {
+        if (!sampled)
+          return;
+        auto& [keys, bytes] = bucket[KeyPrefix(it->first.GetSlice(&scratch), params.delimiter)];
+        keys++;
+        bytes += MemoryUsage(it);
+      });
+
+      for (const auto& [prefix, keys_bytes] : bucket) {
+        auto [keys, bytes] = keys_bytes;
+        PrefixStats& ps = GetPrefixStats(prefix, stats);
+        ps.keys += keys;
+        ps.keys_sq += double(keys) * keys;
+        ps.bytes += bytes;
+        ps.bytes_sq += double(bytes) * bytes;
+      }
+
+      // Sleep in proportion to the time worked to stay within the CPU budget.
+      uint64_t work_ns = util::fb2::ProactorBase::GetMonotonicTimeNs() - work_start;
+      if (work_ns > 500'000) {
+        uint32_t budget = params.cpu_budget_percent;
+        util::ThisFiber::SleepFor(chrono::nanoseconds(work_ns * (100 - budget) / budget));
+        work_start = util::fb2::ProactorBase::GetMonotonicTimeNs();
+      }
+    } while (cursor);
+  }
+
+  uint64_t elapsed = util::fb2::ProactorBase::GetMonotonicTimeNs() - start;
+  const uint64_t duration_ns = params.duration_sec * 1'000'000'000ULL;
+  if (elapsed < duration_ns) {
+    util::ThisFiber::SleepFor(chrono::nanoseconds(duration_ns - elapsed));
+    elapsed = util::fb2::ProactorBase::GetMonotonicTimeNs() - start;
+  }
+
+  db_slice->SetAccessObserver({});
+  return elapsed * 1e-9;
+}
+
 }  // namespace
 
 MemoryCmd::MemoryCmd(ServerFamily* owner, ConnectionContext* cntx) : cntx_(cntx), owner_(owner) {
@@ -129,6 +232,12 @@ void MemoryCmd::Run(CmdArgList args) {
         "    ADDRESS <address>",
         "        Returns whether <address> is known to be allocated internally by any of the "
         "backing heaps",
+        "ANALYZE [DELIMITER <char>] [TOP <n>] [SAMPLE <ratio>] [DURATION <sec>] [CPU <percent>]",
+        "    Estimates the keys, memory and operations per second by key prefix up to the first",
+        "    delimiter (':' by default) from a sample of the keys of the current db, and returns",
+        "    the top n prefixes by memory with the 95% error bounds of the estimates.",
+        "    Accesses are sampled for DURATION seconds, the keys are traversed using up to CPU",
+        "    percent of every thread.",
     };
     auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
     return rb->SendSimpleStrArr(help_arr);
@@ -162,6 +271,11 @@ void MemoryCmd::Run(CmdArgList args) {
     return Track(args);
   }
 
+  if (sub_cmd == "ANALYZE") {
+    args.remove_prefix(1);
+    return Analyze(args);
+  }
+
   if (sub_cmd == "DEFRAGMENT") {
     shard_set->pool()->DispatchOnAll([](util::ProactorBase*) {
       if (auto* shard = EngineShard::tlocal(); shard)
@@ -362,6 +476,88 @@ void MemoryCmd::Usage(std::string_view key) {
   rb->SendLong(memory_usage);
 }
 
+void MemoryCmd::Analyze(CmdArgList args) {
+  AnalyzeParams params;
+  string_view delimiter = ":";
+  CmdArgParser parser(args);
+  while (parser.HasNext()) {
+    if (!parser.Check("DELIMITER", &delimiter) && !parser.Check("TOP", &params.top) &&
+        !parser.Check("SAMPLE", &params.sample_ratio) &&
+        !parser.Check("DURATION", &params.duration_sec) &&
+        !parser.Check("CPU", &params.cpu_budget_percent)) {
+      return cntx_->SendError(kSyntaxErr);
+    }
+  }
+  if (parser.HasError())
+    return cntx_->SendError(parser.Error()->MakeReply());
+
+  if (delimiter.size() != 1 || params.sample_ratio <= 0 || params.sample_ratio > 1 ||
+      params.cpu_budget_percent == 0 || params.cpu_budget_percent > 100) {
+    return cntx_->SendError(kSyntaxErr);
+  }
+  params.delimiter = delimiter[0];
+
+  if (analyze_running.exchange(true))
+    return cntx_->SendError("MEMORY ANALYZE is already running");
+
+  vector<PrefixStatsMap> shard_stats(shard_set->size());
+  vector<double> windows(shard_set->size());
+  DbIndex db_index = cntx_->db_index();
+  Namespace* ns = cntx_->ns;
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    windows[sid] = AnalyzeShard(params, &ns->GetDbSlice(sid), db_index, &shard_stats[sid]);
+  });
+  analyze_running.store(false);
+
+  // The sampled sums are scaled by 1/p. For sums over independently sampled buckets the variance
+  // of the estimate is (1-p)/p^2 times the sum of squares, we report 1.96 standard deviations.
+  struct Estimate {
+    double keys = 0, keys_var = 0;
+    double bytes = 0, bytes_var = 0;
+    double ops = 0, ops_var = 0;
+  };
+  const double p = params.sample_ratio, var_scale = (1 - p) / (p * p);
+  absl::flat_hash_map<string, Estimate> estimates;
+  for (size_t sid = 0; sid < shard_stats.size(); ++sid) {
+    for (const auto& [prefix, ps] : shard_stats[sid]) {
+      Estimate& est = estimates[prefix];
+      est.keys += ps.keys / p;
+      est.keys_var += ps.keys_sq * var_scale;
+      est.bytes += ps.bytes / p;
+      est.bytes_var += ps.bytes_sq * var_scale;
+      double window = max(windows[sid], 1e-3);
+      est.ops += ps.accesses / p / window;
+      est.ops_var += ps.accesses * var_scale / (window * window);
+    }
+  }
+
+  vector<pair<string, Estimate>> top(estimates.begin(), estimates.end());
+  sort(top.begin(), top.end(),
+       [](const auto& l, const auto& r) { return l.second.bytes > r.second.bytes; });
+  top.resize(min(top.size(), params.top));
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  rb->StartArray(top.size());
+  for (const auto& [prefix, est] : top) {
+    rb->StartCollection(7, RedisReplyBuilder::MAP);
+    rb->SendBulkString("prefix");
+    rb->SendBulkString(prefix);
+    rb->SendBulkString("keys");
+    rb->SendLong(llround(est.keys));
+    rb->SendBulkString("keys_error");
+    rb->SendLong(llround(1.96 * sqrt(est.keys_var)));
+    rb->SendBulkString("memory");
+    rb->SendLong(llround(est.bytes));
+    rb->SendBulkString("memory_error");
+    rb->SendLong(llround(1.96 * sqrt(est.bytes_var)));
+    rb->SendBulkString("ops_per_sec");
+    rb->SendDouble(est.ops);
+    rb->SendBulkString("ops_per_sec_error");
+    rb->SendDouble(1.96 * sqrt(est.ops_var));
+  }
+}
+
 void MemoryCmd::Track(CmdArgList args) {
 #ifndef DFLY_ENABLE_MEMORY_TRACKING
   return cntx_->SendError("MEMORY TRACK must be enabled at build time.");
@@ -22,6 +22,7 @@ class MemoryCmd {
   void ArenaStats(CmdArgList args);
   void Usage(std::string_view key);
   void Track(CmdArgList args);
+  void Analyze(CmdArgList args);
 
   ConnectionContext* cntx_;
   ServerFamily* owner_;
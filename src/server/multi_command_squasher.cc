@@ -33,13 +33,15 @@ void CheckConnStateClean(const ConnectionState& state) {
 }  // namespace
 
 MultiCommandSquasher::MultiCommandSquasher(absl::Span<StoredCmd> cmds, ConnectionContext* cntx,
-                                           Service* service, bool verify_commands, bool error_abort)
+                                           Service* service, bool verify_commands, bool error_abort,
+                                           unsigned max_squash_size)
     : cmds_{cmds},
       cntx_{cntx},
       service_{service},
       base_cid_{nullptr},
       verify_commands_{verify_commands},
-      error_abort_{error_abort} {
+      error_abort_{error_abort},
+      max_squash_size_{max_squash_size ? min(max_squash_size, kMaxSquashing) : kMaxSquashing} {
   auto mode = cntx->transaction->GetMultiMode();
   base_cid_ = cntx->transaction->GetCId();
   atomic_ = mode != Transaction::NON_ATOMIC;
@@ -104,11 +106,11 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
   sinfo.cmds.push_back(cmd);
   order_.push_back(last_sid);
 
-  num_squashed_++;
+  stats_.squashed++;
 
   // Because the squashed hop is currently blocking, we cannot add more than the max channel size,
   // otherwise a deadlock occurs.
-  bool need_flush = sinfo.cmds.size() >= kMaxSquashing - 1;
+  bool need_flush = sinfo.cmds.size() >= max_squash_size_ - 1;
   return need_flush ? SquashResult::SQUASHED_FULL : SquashResult::SQUASHED;
 }
 
@@ -201,6 +203,7 @@ bool MultiCommandSquasher::ExecuteSquashed() {
 
   Transaction* tx = cntx_->transaction;
   ServerState::tlocal()->stats.multi_squash_executions++;
+  stats_.hops++;
   ProactorBase* proactor = ProactorBase::me();
   uint64_t start = proactor->GetMonotonicTimeNs();
 
@@ -269,6 +272,9 @@ void MultiCommandSquasher::Run() {
     if (res == SquashResult::ERROR)
       break;
 
+    if (res == SquashResult::SQUASHED_FULL)
+      stats_.full_hops++;
+
     if (res == SquashResult::NOT_SQUASHED || res == SquashResult::SQUASHED_FULL) {
       if (!ExecuteSquashed())
         break;
@@ -294,7 +300,7 @@ void MultiCommandSquasher::Run() {
     }
   }
 
-  VLOG(1) << "Squashed " << num_squashed_ << " of " << cmds_.size()
+  VLOG(1) << "Squashed " << stats_.squashed << " of " << cmds_.size()
           << " commands, max fanout: " << num_shards_ << ", atomic: " << atomic_;
 }
 
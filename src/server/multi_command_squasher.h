@@ -22,9 +22,24 @@ namespace dfly {
 // contains a non-atomic multi transaction to execute squashed commands.
 class MultiCommandSquasher {
  public:
-  static void Execute(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* service,
-                      bool verify_commands = false, bool error_abort = false) {
-    MultiCommandSquasher{cmds, cntx, service, verify_commands, error_abort}.Run();
+  static constexpr unsigned kMaxSquashing = 32;
+
+  // Squashing results, used as feedback for adaptive pipeline squashing.
+  struct Stats {
+    size_t squashed = 0;   // commands executed within squashed hops
+    size_t hops = 0;       // number of squashed hops
+    size_t full_hops = 0;  // hops flushed early because a shard reached max_squash_size
+  };
+
+  // max_squash_size limits the number of commands per shard within a single hop, it's capped by
+  // kMaxSquashing and 0 means kMaxSquashing.
+  static Stats Execute(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* service,
+                       bool verify_commands = false, bool error_abort = false,
+                       unsigned max_squash_size = kMaxSquashing) {
+    MultiCommandSquasher squasher{cmds, cntx, service, verify_commands, error_abort,
+                                  max_squash_size};
+    squasher.Run();
+    return squasher.stats_;
   }
 
  private:
@@ -40,11 +55,9 @@ class MultiCommandSquasher {
 
   enum class SquashResult { SQUASHED, SQUASHED_FULL, NOT_SQUASHED, ERROR };
 
-  static constexpr int kMaxSquashing = 32;
-
  private:
   MultiCommandSquasher(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* Service,
-                       bool verify_commands, bool error_abort);
+                       bool verify_commands, bool error_abort, unsigned max_squash_size);
 
   // Lazy initialize shard info.
   ShardExecInfo& PrepareShardInfo(ShardId sid, std::optional<cluster::SlotId> slot_id);
@@ -76,11 +89,12 @@ class MultiCommandSquasher {
 
   bool verify_commands_ = false;  // Whether commands need to be verified before execution
   bool error_abort_ = false;      // Abort upon receiving error
+  unsigned max_squash_size_;      // Max number of commands per shard within a single hop
 
   std::vector<ShardExecInfo> sharded_;
   std::vector<ShardId> order_;  // reply order for squashed cmds
 
-  size_t num_squashed_ = 0;
+  Stats stats_;
   size_t num_shards_ = 0;
 
   std::vector<MutableSlice> tmp_keylist_;
@@ -21,6 +21,7 @@ ABSL_DECLARE_FLAG(bool, multi_exec_squash);
 ABSL_DECLARE_FLAG(bool, lua_auto_async);
 ABSL_DECLARE_FLAG(bool, lua_allow_undeclared_auto_correct);
 ABSL_DECLARE_FLAG(std::string, default_lua_flags);
+ABSL_DECLARE_FLAG(uint32_t, lua_profile_sampling_period);
 
 namespace dfly {
 
@@ -346,6 +347,34 @@ TEST_F(MultiTest, MultiHop) {
   p2_fb.Join();
 }
 
+// Single shard transactions that contend with each other behind multi hop transactions may run
+// ahead of them once their keys are uncontended, they must still observe each other in order.
+TEST_F(MultiTest, ContendedSingleShardBehindMultiHop) {
+  Run({"set", kKey1, "1"});
+
+  auto rename_fb = pp_->at(1)->LaunchFiber([&] {
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(Run({"rename", kKey1, kKey2}), "OK");
+      ASSERT_EQ(Run({"rename", kKey2, kKey1}), "OK");
+    }
+  });
+
+  vector<Fiber> incr_fbs;
+  for (unsigned j = 0; j < 2; ++j) {
+    incr_fbs.push_back(pp_->at((2 + j) % pp_->size())->LaunchFiber([&] {
+      for (int i = 0; i < 100; ++i)
+        Run({"incr", kKey3});
+    }));
+  }
+
+  rename_fb.Join();
+  for (auto& fb : incr_fbs)
+    fb.Join();
+
+  EXPECT_EQ(Run({"get", kKey3}), "200");
+  EXPECT_EQ(Run({"get", kKey1}), "1");
+}
+
 TEST_F(MultiTest, FlushDb) {
   Run({"mset", kKey1, "1", kKey4, "2"});
   auto resp = Run({"flushdb"});
@@ -566,6 +595,34 @@ TEST_F(MultiTest, Watch) {
   ASSERT_THAT(Run({"exec"}), kExecSuccess);
 }
 
+TEST_F(MultiTest, WatchVersions) {
+  // A key that is deleted and created again is changed even though it exists as before.
+  Run({"set", "a", "1"});
+  Run({"watch", "a"});
+  Run({"del", "a"});
+  Run({"set", "a", "1"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), ArgType(RespExpr::NIL));
+
+  // Reading the key does not change it.
+  Run({"watch", "a"});
+  Run({"get", "a"});
+  Run({"multi"});
+  Run({"get", "a"});
+  ASSERT_THAT(Run({"exec"}), "1");
+
+  // Watches of the same key by two connections are validated independently.
+  Run({"watch", "a"});
+  pp_->at(1)->Await([&] {
+    Run("other", {"watch", "a"});
+    Run("other", {"multi"});
+    Run("other", {"set", "a", "2"});
+    EXPECT_THAT(Run("other", {"exec"}), "OK");
+  });
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), ArgType(RespExpr::NIL));
+}
+
 TEST_F(MultiTest, MultiOOO) {
   GTEST_SKIP() << "Command squashing breaks stats";
 
@@ -633,6 +690,41 @@ TEST_F(MultiTest, EvalOOO) {
   EXPECT_EQ(1 + 2 * kTimes, sum);
 }
 
+TEST_F(MultiTest, EvalStats) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_lua_auto_async, false);
+  absl::SetFlag(&FLAGS_lua_profile_sampling_period, 1);
+
+  const char* kScript = R"(
+    local n = 0
+    for i = 1, 100 do n = n + i end
+    redis.call('SET', KEYS[1], n)
+    return redis.call('GET', KEYS[2])
+  )";
+  for (int i = 0; i < 2; i++)
+    Run({"eval", kScript, "2", kKeySid0, kKeySid1});
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(1u, metrics.script_stats.size());
+  const auto& [sha, stats] = *metrics.script_stats.begin();
+  EXPECT_EQ(2u, stats.calls);
+  EXPECT_EQ(4u, stats.redis_calls);
+  EXPECT_EQ(4u, stats.hops);
+  EXPECT_EQ(4u, stats.shards);
+  EXPECT_LE(stats.max_usec, stats.total_usec);
+  EXPECT_LE(stats.redis_call_usec, stats.total_usec);
+
+  auto resp = Run({"script", "stats"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_EQ(resp.GetVec()[0], sha);
+
+  resp = Run({"script", "profile"});
+  EXPECT_THAT(resp.GetString(), HasSubstr(sha));
+
+  Run({"config", "resetstat"});
+  EXPECT_TRUE(GetMetrics().script_stats.empty());
+}
+
 // Run MULTI/EXEC commands in parallel, where each command is:
 //        MULTI - SET k1 v - SET k2 v - SET k3 v - EXEC
 // but the order of the commands inside appears in any permutation.
@@ -715,6 +807,47 @@ TEST_F(MultiTest, ExecGlobalFallback) {
   EXPECT_EQ(1, stats.tx_normal_cnt);  // move is global
 }
 
+TEST_F(MultiTest, MultiKeys) {
+  if (auto flags = absl::GetFlag(FLAGS_default_lua_flags); flags != "") {
+    GTEST_SKIP() << "Skipped MultiKeys test because default_lua_flags is set";
+    return;
+  }
+
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_multi_exec_mode, Transaction::LOCK_AHEAD);
+
+  EXPECT_THAT(Run({"multi", "keys"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"multi", "nokeys", "a"}), ErrArg("syntax error"));
+
+  // Commands with undeclared keys or without keys abort the transaction when queued.
+  EXPECT_EQ(Run({"multi", "keys", "a", "b"}), "OK");
+  EXPECT_EQ(Run({"set", "a", "1"}), "QUEUED");
+  EXPECT_THAT(Run({"set", "c", "1"}), ErrArg("tried accessing undeclared key, key: c"));
+  EXPECT_THAT(Run({"exec"}), ErrArg("EXECABORT"));
+
+  EXPECT_EQ(Run({"multi", "keys", "a"}), "OK");
+  EXPECT_THAT(Run({"move", "a", "1"}), ErrArg("'MOVE' inside MULTI KEYS is not allowed"));
+  EXPECT_THAT(Run({"eval", "return 1", "1", "b"}), ErrArg("undeclared key, key: b"));
+  EXPECT_THAT(Run({"exec"}), ErrArg("EXECABORT"));
+
+  // Only the declared keys are locked ahead, scripts included.
+  ClearMetrics();
+  EXPECT_EQ(Run({"multi", "keys", "b", "a", "b"}), "OK");
+  EXPECT_EQ(Run({"set", "a", "1"}), "QUEUED");
+  EXPECT_EQ(Run({"eval", "return redis.call('GET', KEYS[1])", "1", "a"}), "QUEUED");
+  EXPECT_EQ(Run({"mset", "a", "2", "b", "3"}), "QUEUED");
+  EXPECT_THAT(Run({"exec"}), RespArray(ElementsAre("OK", "1", "OK")));
+
+  EXPECT_EQ(0, GetMetrics().coordinator_stats.tx_global_cnt);
+  EXPECT_FALSE(IsLocked(0, "a"));
+  EXPECT_FALSE(IsLocked(0, "b"));
+
+  // The next transaction declares no keys.
+  Run({"multi"});
+  Run({"set", "c", "1"});
+  EXPECT_THAT(Run({"exec"}), "OK");
+}
+
 #ifndef SANITIZERS
 TEST_F(MultiTest, ScriptFlagsCommand) {
   if (auto flags = absl::GetFlag(FLAGS_default_lua_flags); flags != "") {
@@ -826,6 +959,21 @@ TEST_F(MultiTest, ScriptBadCommand) {
   resp = Run({"eval", s4, "0"});
   EXPECT_EQ(resp, "OK");
 }
+
+TEST_F(MultiTest, EvalMCall) {
+  const char* script = R"(
+    return redis.mcall({'set', KEYS[1], 'v1'}, {'incr', KEYS[2]}, {'get', KEYS[3]},
+                       {'nosuchcmd'}, {'lpush', KEYS[1], 'x'}, {'get', KEYS[1]})
+  )";
+
+  auto resp = Run({"eval", script, "3", "a", "b", "c"});
+  ASSERT_THAT(resp, ArrLen(6));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("OK", IntArg(1), ArgType(RespExpr::NIL),
+                                         ErrArg("unknown command"), ErrArg("WRONGTYPE"), "v1"));
+
+  resp = Run({"eval", "return redis.mcall({'get', KEYS[1]}, 'get')", "1", "a"});
+  EXPECT_THAT(resp, ErrArg("must be tables"));
+}
 #endif
 
 TEST_F(MultiTest, MultiEvalModeConflict) {
@@ -5,13 +5,17 @@
 #include "server/common.h"
 #include "server/engine_shard_set.h"
 
+ABSL_FLAG(dfly::MemoryBytesFlag, namespace_max_memory, dfly::MemoryBytesFlag{},
+          "Memory quota of each namespace other than the default one. A namespace that reaches "
+          "it is denied writes, or evicts its own keys in cache mode. 0 means no quota.");
+
 ABSL_DECLARE_FLAG(bool, cache_mode);
 
 namespace dfly {
 
 using namespace std;
 
-Namespace::Namespace() {
+Namespace::Namespace() : shard_used_memory_(shard_set->size()) {
   shard_db_slices_.resize(shard_set->size());
   shard_blocking_controller_.resize(shard_set->size());
   shard_set->RunBriefInParallel([&](EngineShard* es) {
@@ -22,6 +26,16 @@ Namespace::Namespace() {
   });
 }
 
+Namespace::~Namespace() {
+  // DbSlices are destroyed on their shards. Namespaces::Clear() already released the slices of
+  // the registered namespaces, so this is needed only by standalone ones.
+  auto has_slice = [](const auto& slice) { return slice != nullptr; };
+  if (any_of(shard_db_slices_.begin(), shard_db_slices_.end(), has_slice)) {
+    shard_set->RunBriefInParallel(
+        [&](EngineShard* es) { shard_db_slices_[es->shard_id()].reset(); });
+  }
+}
+
 DbSlice& Namespace::GetCurrentDbSlice() {
   EngineShard* es = EngineShard::tlocal();
   CHECK(es != nullptr);
@@ -45,6 +59,35 @@ BlockingController* Namespace::GetBlockingController(ShardId sid) {
   return shard_blocking_controller_[sid].get();
 }
 
+size_t Namespace::MaxMemory() const {
+  return is_default_ ? 0 : absl::GetFlag(FLAGS_namespace_max_memory).value;
+}
+
+size_t Namespace::UsedMemory() const {
+  size_t res = 0;
+  for (const auto& used : shard_used_memory_)
+    res += used.load(memory_order_relaxed);
+  return res;
+}
+
+void Namespace::UpdateShardMemory(ShardId sid, ssize_t free_mem, size_t bytes_per_obj) {
+  DbSlice& db_slice = GetDbSlice(sid);
+  size_t used_mem = db_slice.UsedMemory();
+  shard_used_memory_[sid].store(used_mem, memory_order_relaxed);
+
+  ssize_t budget = free_mem / ssize_t(shard_set->size());
+  if (size_t max_memory = MaxMemory(); max_memory > 0) {
+    ssize_t quota_budget = ssize_t(max_memory / shard_set->size()) - ssize_t(used_mem);
+    budget = min(budget, quota_budget);
+  }
+  db_slice.SetCachedParams(budget, bytes_per_obj);
+}
+
+bool Namespace::IsOverQuota(double oom_deny_ratio) const {
+  size_t max_memory = MaxMemory();
+  return max_memory > 0 && UsedMemory() > max_memory * oom_deny_ratio;
+}
+
 Namespaces namespaces;
 
 Namespaces::~Namespaces() {
@@ -54,6 +97,7 @@ Namespaces::~Namespaces() {
 void Namespaces::Init() {
   DCHECK(default_namespace_ == nullptr);
   default_namespace_ = &GetOrInsert("");
+  default_namespace_->is_default_ = true;
 }
 
 bool Namespaces::IsInitialized() const {
@@ -101,4 +145,14 @@ Namespace& Namespaces::GetOrInsert(std::string_view ns) {
   }
 }
 
+vector<Namespace*> Namespaces::GetNonDefaultNamespaces() {
+  vector<Namespace*> res;
+  dfly::SharedLock guard(mu_);
+  for (auto& [name, ns] : namespaces_) {
+    if (&ns != default_namespace_)
+      res.push_back(&ns);
+  }
+  return res;
+}
+
 }  // namespace dfly
@@ -6,6 +6,7 @@
 
 #include <absl/container/node_hash_map.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -21,9 +22,12 @@ namespace dfly {
 // It can be used to allow multiple tenants to use the same server without hacks of using a common
 // prefix, or SELECT-ing a different database.
 // Each Namespace contains per-shard DbSlice, as well as a BlockingController.
+// Namespaces other than the default one are limited by namespace_max_memory besides maxmemory, so
+// that a tenant that fills its quota is denied and evicts its own keys instead of everyone else's.
 class Namespace {
  public:
   Namespace();
+  ~Namespace();
 
   DbSlice& GetCurrentDbSlice();
 
@@ -31,9 +35,25 @@ class Namespace {
   BlockingController* GetOrAddBlockingController(EngineShard* shard);
   BlockingController* GetBlockingController(ShardId sid);
 
+  // Memory quota of the namespace, or 0 if it is limited only by maxmemory.
+  size_t MaxMemory() const;
+
+  // Memory of the tables and objects of the namespace on all shards, as accounted by the last
+  // heartbeat of each shard.
+  size_t UsedMemory() const;
+
+  // Accounts the memory of the namespace on the shard and limits the budget of its DbSlice to the
+  // share of the shard in the quota, which bounds the inserts and drives the heartbeat eviction.
+  void UpdateShardMemory(ShardId sid, ssize_t free_mem, size_t bytes_per_obj);
+
+  // Returns true if the namespace used more than oom_deny_ratio of its quota.
+  bool IsOverQuota(double oom_deny_ratio) const;
+
  private:
   std::vector<std::unique_ptr<DbSlice>> shard_db_slices_;
   std::vector<std::unique_ptr<BlockingController>> shard_blocking_controller_;
+  std::vector<std::atomic_size_t> shard_used_memory_;
+  bool is_default_ = false;
 
   friend class Namespaces;
 };
@@ -59,6 +79,10 @@ class Namespaces {
   Namespace& GetDefaultNamespace() const;  // No locks
   Namespace& GetOrInsert(std::string_view ns) ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Returns all the namespaces but the default one. Namespaces are not removed before Clear(),
+  // so the pointers stay valid while the shards run.
+  std::vector<Namespace*> GetNonDefaultNamespaces() ABSL_LOCKS_EXCLUDED(mu_);
+
  private:
   util::fb2::SharedMutex mu_{};
   absl::node_hash_map<std::string, Namespace> namespaces_ ABSL_GUARDED_BY(mu_);
@@ -16,11 +16,14 @@ extern "C" {
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
+#include <sys/un.h>
+
 #include <boost/asio/ip/tcp.hpp>
 #include <string>
 
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
+#include "facade/ktls.h"
 #include "facade/redis_parser.h"
 #include "server/error.h"
 #include "server/journal/executor.h"
@@ -90,6 +93,7 @@ static ProtocolClient::SSL_CTX* CreateSslClientCntx() {
   SSL_CTX_set_verify(ctx, mask, NULL);
 
   DFLY_SSL_CHECK(1 == SSL_CTX_set_dh_auto(ctx, 1));
+  facade::PrepareKtlsContext(ctx);
   return ctx;
 }
 #endif
@@ -108,6 +112,8 @@ error_code Recv(FiberSocketBase* input, base::IoBuf* dest) {
 }  // namespace
 
 std::string ProtocolClient::ServerContext::Description() const {
+  if (IsUnixSocket())
+    return host;
   return absl::StrCat(host, ":", port);
 }
 
@@ -172,6 +178,9 @@ ProtocolClient::~ProtocolClient() {
 }
 
 error_code ProtocolClient::ResolveHostDns() {
+  if (server_context_.IsUnixSocket())
+    return error_code{};
+
   char ip_addr[INET6_ADDRSTRLEN];
   auto ec = util::fb2::DnsResolve(server_context_.host, 0, ip_addr, ProactorBase::me());
   if (ec) {
@@ -202,7 +211,7 @@ error_code ProtocolClient::ConnectAndAuth(std::chrono::milliseconds connect_time
         sock_.reset(nullptr);
       }
 
-      if (ssl_ctx_) {
+      if (ssl_ctx_ && !server_context_.IsUnixSocket()) {
         auto tls_sock = std::make_unique<tls::TlsSocket>(mythread->CreateSocket());
         tls_sock->InitSSL(ssl_ctx_);
         sock_ = std::move(tls_sock);
@@ -219,10 +228,25 @@ error_code ProtocolClient::ConnectAndAuth(std::chrono::milliseconds connect_time
   {
     uint32_t timeout = sock_->timeout();
     sock_->set_timeout(connect_timeout_ms.count());
-    RETURN_ON_ERR(sock_->Connect(server_context_.endpoint));
+    if (server_context_.IsUnixSocket()) {
+      RETURN_ON_ERR(ConnectUnixSocket(connect_timeout_ms));
+    } else {
+      RETURN_ON_ERR(sock_->Connect(server_context_.endpoint));
+    }
     sock_->set_timeout(timeout);
   }
 
+#ifdef DFLY_USE_SSL
+  if (ssl_ctx_ && !server_context_.IsUnixSocket()) {
+    unique_lock lk(sock_mu_);
+    auto offloaded = facade::OffloadTlsToKernel(&sock_);
+    if (!offloaded)
+      return offloaded.error();
+    LOG_IF(INFO, *offloaded) << "Moved TLS of the connection to " << server_context_.Description()
+                             << " to the kernel";
+  }
+#endif
+
   /* These may help but require additional field testing to learn.
    int yes = 1;
    CHECK_EQ(0, setsockopt(sock_->native_handle(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)));
@@ -250,6 +274,30 @@ error_code ProtocolClient::ConnectAndAuth(std::chrono::milliseconds connect_time
   return error_code{};
 }
 
+error_code ProtocolClient::ConnectUnixSocket(std::chrono::milliseconds connect_timeout_ms) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  const string& path = server_context_.host;
+  if (path.size() >= sizeof(addr.sun_path))
+    return make_error_code(errc::filename_too_long);
+  memcpy(addr.sun_path, path.data(), path.size());
+
+  auto* sock = static_cast<LinuxSocketBase*>(sock_.get());
+  RETURN_ON_ERR(sock->Create(AF_UNIX));
+
+  // Connecting a unix socket does not block on the peer, it either succeeds or fails with
+  // EAGAIN while the accept queue of the master is full.
+  auto deadline = chrono::steady_clock::now() + connect_timeout_ms;
+  while (connect(sock->native_handle(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    if (errno != EAGAIN && errno != EINTR)
+      return error_code{errno, system_category()};
+    if (chrono::steady_clock::now() >= deadline)
+      return make_error_code(errc::timed_out);
+    ThisFiber::SleepFor(1ms);
+  }
+  return error_code{};
+}
+
 void ProtocolClient::CloseSocket() {
   unique_lock lk(sock_mu_);
   if (sock_) {
@@ -51,6 +51,12 @@ class ProtocolClient {
     uint16_t port;
     boost::asio::ip::tcp::endpoint endpoint;
 
+    // A host that starts with '/' is the path of a unix socket of a master on the same machine.
+    // The port is not used then.
+    bool IsUnixSocket() const {
+      return !host.empty() && host.front() == '/';
+    }
+
     std::string Description() const;
   };
 
@@ -111,6 +117,8 @@ class ProtocolClient {
   }
 
  private:
+  std::error_code ConnectUnixSocket(std::chrono::milliseconds connect_timeout_ms);
+
   ServerContext server_context_;
 
   std::unique_ptr<facade::RedisParser> parser_;
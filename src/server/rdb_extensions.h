@@ -8,17 +8,25 @@ extern "C" {
 #include "redis/rdb.h"
 }
 
-//  Custom types: Range 30-35 is used by DF RDB types.
+//  Custom types: Range 30-39 is used by DF RDB types.
 constexpr uint8_t RDB_TYPE_JSON_OLD = 20;
 constexpr uint8_t RDB_TYPE_JSON = 30;
 constexpr uint8_t RDB_TYPE_HASH_WITH_EXPIRY = 31;
 constexpr uint8_t RDB_TYPE_SET_WITH_EXPIRY = 32;
 constexpr uint8_t RDB_TYPE_SBF = 33;
 
+// Reference to a value offloaded to the tiered backing file, which is preserved across restarts.
+constexpr uint8_t RDB_TYPE_TIERED_SEGMENT = 34;
+
+constexpr uint8_t RDB_TYPE_TIMESERIES = 35;
+constexpr uint8_t RDB_TYPE_CMS = 36;
+constexpr uint8_t RDB_TYPE_TOPK = 37;
+
 constexpr bool rdbIsObjectTypeDF(uint8_t type) {
   return __rdbIsObjectType(type) || (type == RDB_TYPE_JSON) ||
          (type == RDB_TYPE_HASH_WITH_EXPIRY) || (type == RDB_TYPE_SET_WITH_EXPIRY) ||
-         (type == RDB_TYPE_SBF);
+         (type == RDB_TYPE_SBF) || (type == RDB_TYPE_TIERED_SEGMENT) ||
+         (type == RDB_TYPE_TIMESERIES) || (type == RDB_TYPE_CMS) || (type == RDB_TYPE_TOPK);
 }
 
 //  Opcodes: Range 200-240 is used by DF extensions.
@@ -32,6 +40,10 @@ constexpr uint8_t RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START = 201;
 constexpr uint8_t RDB_OPCODE_COMPRESSED_LZ4_BLOB_START = 202;
 constexpr uint8_t RDB_OPCODE_COMPRESSED_BLOB_END = 203;
 
+// A zstd dictionary that the compressed blobs after it may use, identified by the dictionary id
+// of their frames.
+constexpr uint8_t RDB_OPCODE_COMPRESSION_DICT = 204;
+
 constexpr uint8_t RDB_OPCODE_JOURNAL_BLOB = 210;
 
 // A full sync will continue to send information in journal blobs until the replica
@@ -19,6 +19,7 @@ extern "C" {
 #include "redis/zset.h"
 }
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
@@ -32,9 +33,14 @@ extern "C" {
 #include "base/logging.h"
 #include "core/bloom.h"
 #include "core/json/json_object.h"
+#include "core/packed_map.h"
+#include "core/qlist.h"
+#include "core/roaring_int_set.h"
+#include "core/sketch.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/time_series.h"
 #include "server/cluster/cluster_defs.h"
 #include "server/cluster/cluster_family.h"
 #include "server/container_utils.h"
@@ -56,6 +62,7 @@ extern "C" {
 
 ABSL_DECLARE_FLAG(int32_t, list_max_listpack_size);
 ABSL_DECLARE_FLAG(int32_t, list_compress_depth);
+ABSL_DECLARE_FLAG(bool, list_experimental_v2);
 ABSL_DECLARE_FLAG(uint32_t, dbnum);
 
 namespace dfly {
@@ -230,7 +237,8 @@ string ModuleTypeName(uint64_t module_id) {
 bool RdbTypeAllowedEmpty(int type) {
   return type == RDB_TYPE_STRING || type == RDB_TYPE_JSON || type == RDB_TYPE_SBF ||
          type == RDB_TYPE_STREAM_LISTPACKS || type == RDB_TYPE_SET_WITH_EXPIRY ||
-         type == RDB_TYPE_HASH_WITH_EXPIRY;
+         type == RDB_TYPE_HASH_WITH_EXPIRY || type == RDB_TYPE_TIMESERIES ||
+         type == RDB_TYPE_CMS || type == RDB_TYPE_TOPK;
 }
 
 }  // namespace
@@ -253,15 +261,39 @@ class ZstdDecompress : public DecompressImpl {
     dctx_ = ZSTD_createDCtx();
   }
   ~ZstdDecompress() {
+    for (auto& [_, ddict] : ddicts_)
+      ZSTD_freeDDict(ddict);
     ZSTD_freeDCtx(dctx_);
   }
 
   io::Result<io::IoBuf*> Decompress(std::string_view str);
 
+  // Adds a dictionary for the frames that reference its id.
+  error_code AddDictionary(std::string_view dict);
+
  private:
   ZSTD_DCtx* dctx_;
+  absl::flat_hash_map<unsigned, ZSTD_DDict*> ddicts_;
 };
 
+error_code ZstdDecompress::AddDictionary(std::string_view dict) {
+  unsigned dict_id = ZSTD_getDictID_fromDict(dict.data(), dict.size());
+  ZSTD_DDict* ddict = ZSTD_createDDict(dict.data(), dict.size());
+  if (dict_id == 0 || !ddict) {
+    ZSTD_freeDDict(ddict);
+    LOG(ERROR) << "Invalid ZSTD dictionary";
+    return RdbError(errc::rdb_file_corrupted);
+  }
+
+  // Streams of different serializers may share a file, a later dictionary with the same id
+  // belongs to the blobs after it.
+  if (auto [it, inserted] = ddicts_.emplace(dict_id, ddict); !inserted) {
+    ZSTD_freeDDict(it->second);
+    it->second = ddict;
+  }
+  return {};
+}
+
 io::Result<io::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
   // Prepare membuf memory to uncompressed string.
   auto uncomp_size = ZSTD_getFrameContentSize(str.data(), str.size());
@@ -274,6 +306,16 @@ io::Result<io::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
     return Unexpected(errc::invalid_encoding);
   }
 
+  ZSTD_DDict* ddict = nullptr;
+  if (unsigned dict_id = ZSTD_getDictID_fromFrame(str.data(), str.size()); dict_id != 0) {
+    auto it = ddicts_.find(dict_id);
+    if (it == ddicts_.end()) {
+      LOG(ERROR) << "Missing ZSTD dictionary " << dict_id;
+      return Unexpected(errc::rdb_file_corrupted);
+    }
+    ddict = it->second;
+  }
+
   uncompressed_mem_buf_.Reserve(uncomp_size + 1);
 
   // Uncompress string to membuf
@@ -282,7 +324,9 @@ io::Result<io::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
     return Unexpected(errc::out_of_memory);
   }
   size_t const d_size =
-      ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
+      ddict ? ZSTD_decompress_usingDDict(dctx_, dest.data(), dest.size(), str.data(), str.size(),
+                                         ddict)
+            : ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
   if (d_size == 0 || d_size != uncomp_size) {
     LOG(ERROR) << "Invalid ZSTD compressed string";
     return Unexpected(errc::rdb_file_corrupted);
@@ -395,6 +439,10 @@ class RdbLoaderBase::OpaqueObjLoader {
   void operator()(const LzfString& lzfstr);
   void operator()(const unique_ptr<LoadTrace>& ptr);
   void operator()(const RdbSBF& src);
+  void operator()(const RdbTieredSegment& src);
+  void operator()(const RdbTimeSeries& src);
+  void operator()(const RdbCMS& src);
+  void operator()(const RdbTopK& src);
 
   std::error_code ec() const {
     return ec_;
@@ -402,6 +450,7 @@ class RdbLoaderBase::OpaqueObjLoader {
 
  private:
   void CreateSet(const LoadTrace* ltrace);
+  bool CreateRoaringSet(const LoadTrace* ltrace);
   void CreateHMap(const LoadTrace* ltrace);
   void CreateList(const LoadTrace* ltrace);
   void CreateZSet(const LoadTrace* ltrace);
@@ -483,14 +532,110 @@ void RdbLoaderBase::OpaqueObjLoader::operator()(const unique_ptr<LoadTrace>& ptr
 void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbSBF& src) {
   SBF* sbf =
       CompactObj::AllocateMR<SBF>(src.grow_factor, src.fp_prob, src.max_capacity, src.prev_size,
-                                  src.current_size, CompactObj::memory_resource());
+                                  src.current_size, CompactObj::memory_resource(), src.blocked);
   for (unsigned i = 0; i < src.filters.size(); ++i) {
     sbf->AddFilter(src.filters[i].blob, src.filters[i].hash_cnt);
   }
   pv_->SetSBF(sbf);
 }
 
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTieredSegment& src) {
+  pv_->SetExternal(src.offset, src.length, src.obj_type);
+  if (src.raw_len > 0)
+    pv_->SetExternalCompressed(src.raw_len);
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTimeSeries& src) {
+  TimeSeries* ts =
+      CompactObj::AllocateMR<TimeSeries>(src.retention_ms, CompactObj::memory_resource());
+  for (const auto& chunk : src.chunks) {
+    if (!ts->AddChunk(chunk.data, chunk.count)) {
+      LOG(ERROR) << "Corrupted time series chunk";
+      CompactObj::DeleteMR<TimeSeries>(ts);
+      ec_ = RdbError(errc::rdb_file_corrupted);
+      return;
+    }
+  }
+  pv_->SetTimeSeries(ts);
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbCMS& src) {
+  CountMinSketch* cms =
+      CompactObj::AllocateMR<CountMinSketch>(src.width, src.depth, CompactObj::memory_resource());
+  if (!cms->Load(src.counters, src.count)) {
+    LOG(ERROR) << "Corrupted count-min sketch";
+    CompactObj::DeleteMR<CountMinSketch>(cms);
+    ec_ = RdbError(errc::rdb_file_corrupted);
+    return;
+  }
+  pv_->SetCMS(cms);
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTopK& src) {
+  TopK* topk = CompactObj::AllocateMR<TopK>(src.k, src.width, src.depth, src.decay,
+                                            CompactObj::memory_resource());
+  vector<TopK::Entry> list;
+  for (const auto& item : src.list)
+    list.push_back({item.item, item.count});
+  if (!topk->Load(src.seed, src.buckets, list)) {
+    LOG(ERROR) << "Corrupted top-k sketch";
+    CompactObj::DeleteMR<TopK>(topk);
+    ec_ = RdbError(errc::rdb_file_corrupted);
+    return;
+  }
+  pv_->SetTopK(topk);
+}
+
+// Loads a large set of integers as a roaring bitmap like SADD keeps it. Streamed sets are checked
+// by their first part, and converted to a StringSet once a later part holds other members.
+// Returns false if the set should be loaded as a StringSet.
+bool RdbLoaderBase::OpaqueObjLoader::CreateRoaringSet(const LoadTrace* ltrace) {
+  bool all_ints = true;
+  Iterate(*ltrace, [&](const LoadBlob& blob) {
+    all_ints = holds_alternative<long long>(blob.rdb_var);
+    return all_ints;
+  });
+
+  RoaringIntSet* rs = nullptr;
+  if (config_.append) {
+    if (pv_->ObjType() != OBJ_SET || pv_->Encoding() != kEncodingRoaring)
+      return false;
+
+    rs = static_cast<RoaringIntSet*>(pv_->RObjPtr());
+    if (!all_ints) {
+      pv_->InitRobj(OBJ_SET, kEncodingStrMap2, SetFamily::ConvertToStrSet(*rs));
+      return false;
+    }
+  } else {
+    if (!all_ints || ltrace->arr.size() <= SetFamily::MaxIntsetEntries())
+      return false;
+    rs = CompactObj::AllocateMR<RoaringIntSet>();
+  }
+
+  bool added = true;
+  Iterate(*ltrace, [&](const LoadBlob& blob) {
+    added = rs->Add(get<long long>(blob.rdb_var));
+    return added;
+  });
+
+  if (!config_.append) {
+    if (!added || !SetFamily::KeepAsRoaring(*rs)) {
+      CompactObj::DeleteMR<RoaringIntSet>(rs);
+      // Duplicates are reported by the StringSet path.
+      return false;
+    }
+    pv_->InitRobj(OBJ_SET, kEncodingRoaring, rs);
+  } else if (!added) {
+    LOG(ERROR) << "Duplicate set members detected";
+    ec_ = RdbError(errc::duplicate_key);
+  }
+  return true;
+}
+
 void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
+  if (rdb_type_ == RDB_TYPE_SET && CreateRoaringSet(ltrace))
+    return;
+
   size_t len = ltrace->arr.size();
 
   bool is_intset = true;
@@ -623,7 +768,53 @@ void RdbLoaderBase::OpaqueObjLoader::CreateHMap(const LoadTrace* ltrace) {
     });
   }
 
-  if (keep_lp) {
+  // Hashes that outgrow listpack but still consist of short strings use PackedMap.
+  size_t pm_data_bytes = 0;
+  bool keep_pm = !config_.streamed && rdb_type_ != RDB_TYPE_HASH_WITH_EXPIRY &&
+                 (!keep_lp || lp_size >= server.max_listpack_map_bytes);
+  if (keep_pm) {
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      size_t str_len = StrLen(blob.rdb_var);
+      pm_data_bytes += str_len + 1;
+
+      if (str_len > PackedMap::kMaxStrLen) {
+        keep_pm = false;
+        return false;
+      }
+      return true;
+    });
+    keep_pm = keep_pm && HSetFamily::IsGoodForPackedMap(len, pm_data_bytes);
+    keep_lp = keep_lp && !keep_pm;
+  }
+
+  if (keep_pm) {
+    uint8_t* pm = PackedMap::New(len, pm_data_bytes);
+
+    CHECK(ltrace->arr.size() % 2 == 0);
+    std::string field;
+    for (size_t i = 0; i < ltrace->arr.size(); i += 2) {
+      // ToSV may reference an internal buffer, so copy the field before reading the value.
+      field = ToSV(ltrace->arr[i].rdb_var);
+      string_view value = ToSV(ltrace->arr[i + 1].rdb_var);
+      if (ec_)
+        break;
+
+      bool inserted;
+      tie(pm, inserted) = PackedMap::Insert(pm, field, value, true);
+      if (!inserted) {
+        LOG(ERROR) << "Duplicate hash fields detected for field " << field;
+        ec_ = RdbError(errc::rdb_file_corrupted);
+        break;
+      }
+    }
+
+    if (ec_) {
+      PackedMap::Free(pm);
+      return;
+    }
+
+    pv_->InitRobj(OBJ_HASH, kEncodingPackedMap, pm);
+  } else if (keep_lp) {
     uint8_t* lp = lpNew(lp_size);
 
     CHECK(ltrace->arr.size() % 2 == 0);
@@ -709,20 +900,33 @@ void RdbLoaderBase::OpaqueObjLoader::CreateHMap(const LoadTrace* ltrace) {
 }
 
 void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
-  quicklist* ql;
+  quicklist* ql = nullptr;
+  QList* qlv2 = nullptr;
+  unsigned encoding =
+      GetFlag(FLAGS_list_experimental_v2) ? kEncodingQL2 : unsigned(OBJ_ENCODING_QUICKLIST);
   if (config_.append) {
-    if (!EnsureObjEncoding(OBJ_LIST, OBJ_ENCODING_QUICKLIST)) {
+    if (!EnsureObjEncoding(OBJ_LIST, encoding)) {
       return;
     }
 
-    ql = static_cast<quicklist*>(pv_->RObjPtr());
+    if (encoding == kEncodingQL2)
+      qlv2 = static_cast<QList*>(pv_->RObjPtr());
+    else
+      ql = static_cast<quicklist*>(pv_->RObjPtr());
+  } else if (encoding == kEncodingQL2) {
+    qlv2 = CompactObj::AllocateMR<QList>(GetFlag(FLAGS_list_max_listpack_size),
+                                         GetFlag(FLAGS_list_compress_depth),
+                                         CompactObj::memory_resource());
   } else {
     ql = quicklistNew(GetFlag(FLAGS_list_max_listpack_size), GetFlag(FLAGS_list_compress_depth));
   }
 
   auto cleanup = absl::Cleanup([&] {
     if (!config_.append) {
-      quicklistRelease(ql);
+      if (qlv2)
+        CompactObj::DeleteMR<QList>(qlv2);
+      else
+        quicklistRelease(ql);
     }
   });
 
@@ -735,6 +939,10 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
 
     uint8_t* lp = nullptr;
     if (container == QUICKLIST_NODE_CONTAINER_PLAIN) {
+      if (qlv2) {  // QList keeps large elements in single element listpacks.
+        qlv2->AppendListpack(lpAppend(lpNew(0), (uint8_t*)sv.data(), sv.size()));
+        return true;
+      }
       lp = (uint8_t*)zmalloc(sv.size());
       ::memcpy(lp, (uint8_t*)sv.data(), sv.size());
       quicklistAppendPlainNode(ql, lp, sv.size());
@@ -774,13 +982,16 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
       lp = lpShrinkToFit(lp);
     }
 
-    quicklistAppendListpack(ql, lp);
+    if (qlv2)
+      qlv2->AppendListpack(lp);
+    else
+      quicklistAppendListpack(ql, lp);
     return true;
   });
 
   if (ec_)
     return;
-  if (quicklistCount(ql) == 0) {
+  if ((qlv2 ? qlv2->Size() : quicklistCount(ql)) == 0) {
     ec_ = RdbError(errc::empty_key);
     return;
   }
@@ -788,7 +999,10 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
   std::move(cleanup).Cancel();
 
   if (!config_.append) {
-    pv_->InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);
+    if (qlv2)
+      pv_->InitRobj(OBJ_LIST, kEncodingQL2, qlv2);
+    else
+      pv_->InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);
   }
 }
 
@@ -901,11 +1115,18 @@ void RdbLoaderBase::OpaqueObjLoader::CreateStream(const LoadTrace* ltrace) {
       ec_ = RdbError(errc::rdb_file_corrupted);
       return;
     }
+    if (nodekey.size() != sizeof(streamID)) {
+      LOG(ERROR) << "Stream node key has invalid length";
+      ec_ = RdbError(errc::rdb_file_corrupted);
+      return;
+    }
+    streamID node_id;
+    streamDecodeID((void*)nodekey.data(), &node_id);
+
     uint8_t* copy_lp = (uint8_t*)zmalloc(data.size());
     ::memcpy(copy_lp, lp, data.size());
-    /* Insert the key in the radix tree. */
-    int retval =
-        raxTryInsert(s->rax_tree, (unsigned char*)nodekey.data(), nodekey.size(), copy_lp, NULL);
+    /* Insert the node into the stream index. */
+    int retval = streamNodesTryInsert(s->nodes, &node_id, copy_lp);
     if (!retval) {
       zfree(copy_lp);
       LOG(ERROR) << "Listpack re-added with existing key";
@@ -1085,9 +1306,12 @@ void RdbLoaderBase::OpaqueObjLoader::HandleBlob(string_view blob) {
     }
 
     if (lpBytes(lp) > server.max_listpack_map_bytes) {
-      StringMap* sm = HSetFamily::ConvertToStrMap(lp);
+      if (uint8_t* pm = HSetFamily::ConvertToPackedMap(lp); pm) {
+        pv_->InitRobj(OBJ_HASH, kEncodingPackedMap, pm);
+      } else {
+        pv_->InitRobj(OBJ_HASH, kEncodingStrMap2, HSetFamily::ConvertToStrMap(lp));
+      }
       lpFree(lp);
-      pv_->InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
     } else {
       lp = lpShrinkToFit(lp);
       pv_->InitRobj(OBJ_HASH, kEncodingListPack, lp);
@@ -1497,6 +1721,18 @@ error_code RdbLoaderBase::ReadObj(int rdbtype, OpaqueObj* dest) {
     case RDB_TYPE_SBF:
       iores = ReadSBF();
       break;
+    case RDB_TYPE_TIERED_SEGMENT:
+      iores = ReadTieredSegment();
+      break;
+    case RDB_TYPE_TIMESERIES:
+      iores = ReadTimeSeries();
+      break;
+    case RDB_TYPE_CMS:
+      iores = ReadCMS();
+      break;
+    case RDB_TYPE_TOPK:
+      iores = ReadTopK();
+      break;
     default:
       LOG(ERROR) << "Unsupported rdb type " << rdbtype;
 
@@ -2017,8 +2253,9 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
   RdbSBF res;
   uint64_t options;
   SET_OR_UNEXPECT(LoadLen(nullptr), options);
-  if (options != 0)
+  if (options > 1)
     return Unexpected(errc::rdb_file_corrupted);
+  res.blocked = options & 1;
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.grow_factor);
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.fp_prob);
   if (res.fp_prob <= 0 || res.fp_prob > 0.5) {
@@ -2041,11 +2278,103 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
     if (!is_power2(bit_len)) {  // must be power of two
       return Unexpected(errc::rdb_file_corrupted);
     }
+    if (res.blocked && filter_data.size() < Bloom::kBlockSize) {
+      return Unexpected(errc::rdb_file_corrupted);
+    }
     res.filters.emplace_back(hash_cnt, std::move(filter_data));
   }
   return OpaqueObj{std::move(res), RDB_TYPE_SBF};
 }
 
+auto RdbLoaderBase::ReadTimeSeries() -> io::Result<OpaqueObj> {
+  RdbTimeSeries res;
+  uint64_t options;
+  SET_OR_UNEXPECT(LoadLen(nullptr), options);
+  if (options != 0)
+    return Unexpected(errc::rdb_file_corrupted);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.retention_ms);
+
+  uint64_t num_chunks;
+  SET_OR_UNEXPECT(LoadLen(nullptr), num_chunks);
+  for (uint64_t i = 0; i < num_chunks; ++i) {
+    uint64_t count;
+    string data;
+    SET_OR_UNEXPECT(LoadLen(nullptr), count);
+    SET_OR_UNEXPECT(FetchGenericString(), data);
+    if (count == 0 || count > UINT32_MAX)
+      return Unexpected(errc::rdb_file_corrupted);
+    res.chunks.emplace_back(count, std::move(data));
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_TIMESERIES};
+}
+
+auto RdbLoaderBase::ReadCMS() -> io::Result<OpaqueObj> {
+  RdbCMS res;
+  uint64_t options;
+  SET_OR_UNEXPECT(LoadLen(nullptr), options);
+  if (options != 0)
+    return Unexpected(errc::rdb_file_corrupted);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.width);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.depth);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.count);
+  SET_OR_UNEXPECT(FetchGenericString(), res.counters);
+  if (res.width == 0 || res.depth == 0 ||
+      res.counters.size() != uint64_t(res.width) * res.depth * sizeof(uint32_t)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_CMS};
+}
+
+auto RdbLoaderBase::ReadTopK() -> io::Result<OpaqueObj> {
+  RdbTopK res;
+  uint64_t options;
+  SET_OR_UNEXPECT(LoadLen(nullptr), options);
+  if (options != 0)
+    return Unexpected(errc::rdb_file_corrupted);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.k);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.width);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.depth);
+  SET_OR_UNEXPECT(FetchBinaryDouble(), res.decay);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.seed);
+  SET_OR_UNEXPECT(FetchGenericString(), res.buckets);
+  if (res.k == 0 || res.width == 0 || res.depth == 0 || !(res.decay > 0 && res.decay <= 1) ||
+      res.buckets.size() != uint64_t(res.width) * res.depth * 2 * sizeof(uint32_t)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+
+  uint64_t list_size;
+  SET_OR_UNEXPECT(LoadLen(nullptr), list_size);
+  if (list_size > res.k)
+    return Unexpected(errc::rdb_file_corrupted);
+  res.list.resize(list_size);
+  for (auto& item : res.list) {
+    SET_OR_UNEXPECT(FetchGenericString(), item.item);
+    SET_OR_UNEXPECT(LoadLen(nullptr), item.count);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_TOPK};
+}
+
+auto RdbLoaderBase::ReadTieredSegment() -> io::Result<OpaqueObj> {
+  uint64_t shard_id, offset, length, obj_type, raw_len;
+  SET_OR_UNEXPECT(LoadLen(nullptr), shard_id);
+  SET_OR_UNEXPECT(LoadLen(nullptr), offset);
+  SET_OR_UNEXPECT(LoadLen(nullptr), length);
+  SET_OR_UNEXPECT(LoadLen(nullptr), obj_type);
+  SET_OR_UNEXPECT(LoadLen(nullptr), raw_len);
+
+  // Only strings and containers serialized with DumpObject are offloaded.
+  bool valid_type = obj_type == OBJ_STRING || obj_type == OBJ_LIST || obj_type == OBJ_SET ||
+                    obj_type == OBJ_HASH;
+  if (!valid_type || shard_id >= kInvalidSid || length == 0 || length > UINT32_MAX ||
+      raw_len > UINT32_MAX || (raw_len > 0 && offset % tiering::kPageSize != 0)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+
+  RdbTieredSegment res{ShardId(shard_id), offset, length, CompactObjType(obj_type),
+                       uint32_t(raw_len)};
+  return OpaqueObj{std::move(res), RDB_TYPE_TIERED_SEGMENT};
+}
+
 template <typename T> io::Result<T> RdbLoaderBase::FetchInt() {
   auto ec = EnsureRead(sizeof(T));
   if (ec)
@@ -2095,6 +2424,7 @@ struct RdbLoader::ObjSettings {
 
 RdbLoader::RdbLoader(Service* service)
     : service_{service},
+      ns_{&namespaces.GetDefaultNamespace()},
       script_mgr_{service == nullptr ? nullptr : service->script_mgr()},
       shard_buf_{shard_set->size()} {
 }
@@ -2257,8 +2587,7 @@ error_code RdbLoader::Load(io::Source* src) {
         FlushShardAsync(i);
 
         // Active database if not existed before.
-        shard_set->Add(
-            i, [dbid] { namespaces.GetDefaultNamespace().GetCurrentDbSlice().ActivateDb(dbid); });
+        shard_set->Add(i, [ns = ns_, dbid] { ns->GetCurrentDbSlice().ActivateDb(dbid); });
       }
 
       cur_db_index_ = dbid;
@@ -2302,9 +2631,14 @@ error_code RdbLoader::Load(io::Source* src) {
       continue;
     }
 
+    if (type == RDB_OPCODE_COMPRESSION_DICT) {
+      RETURN_ON_ERR(HandleCompressionDict());
+      continue;
+    }
+
     if (type == RDB_OPCODE_JOURNAL_BLOB) {
       FlushAllShards();  // Always flush before applying incremental on top
-      RETURN_ON_ERR(HandleJournalBlob(service_));
+      RETURN_ON_ERR(HandleJournalBlob(service_, ns_));
       continue;
     }
 
@@ -2500,6 +2834,17 @@ error_code RdbLoaderBase::HandleCompressedBlob(int op_type) {
   return kOk;
 }
 
+error_code RdbLoaderBase::HandleCompressionDict() {
+  string dict;
+  SET_OR_RETURN(FetchGenericString(), dict);
+
+  AllocateDecompressOnce(RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START);
+  auto* zstd = dynamic_cast<ZstdDecompress*>(decompress_impl_.get());
+  if (!zstd)
+    return RdbError(errc::rdb_file_corrupted);
+  return zstd->AddDictionary(dict);
+}
+
 error_code RdbLoaderBase::HandleCompressedBlobFinish() {
   CHECK_NE(&origin_mem_buf_, mem_buf_);
   CHECK_EQ(mem_buf_->InputLen(), size_t(0));
@@ -2507,7 +2852,7 @@ error_code RdbLoaderBase::HandleCompressedBlobFinish() {
   return kOk;
 }
 
-error_code RdbLoaderBase::HandleJournalBlob(Service* service) {
+error_code RdbLoaderBase::HandleJournalBlob(Service* service, Namespace* ns) {
   // Read the number of entries in the journal blob.
   size_t num_entries;
   bool _encoded;
@@ -2523,6 +2868,7 @@ error_code RdbLoaderBase::HandleJournalBlob(Service* service) {
   // Parse and exectue in loop.
   size_t done = 0;
   JournalExecutor ex{service};
+  ex.connection_context()->ns = ns;
   while (done < num_entries) {
     journal::ParsedEntry entry{};
     SET_OR_RETURN(journal_reader_.ReadEntry(), entry);
@@ -2594,6 +2940,9 @@ error_code RdbLoader::HandleAux() {
     /* Just ignored. */
   } else if (auxkey == "search-index") {
     LoadSearchIndexDefFromAux(std::move(auxval));
+  } else if (auxkey == "journal-segment") {
+    if (!absl::SimpleAtoi(auxval, &journal_segment_))
+      LOG(WARNING) << "Invalid journal segment " << auxval;
   } else {
     /* We ignore fields we don't understand, as by AUX field
      * contract. */
@@ -2620,6 +2969,19 @@ void RdbLoader::FlushShardAsync(ShardId sid) {
   if (out_buf.empty())
     return;
 
+  // The loader runs on the thread of the target shard, for example when a DF snapshot is loaded
+  // with the same number of shards it was saved with. Load directly instead of going through the
+  // shard queue.
+  if (EngineShard* es = EngineShard::tlocal(); es && es->shard_id() == sid) {
+    ItemsBuf ib = std::move(out_buf);
+    out_buf.clear();
+    LoadItemsBuffer(cur_db_index_, ib);
+
+    while (es->ShouldThrottleForTiering())
+      ThisFiber::SleepFor(100us);
+    return;
+  }
+
   auto cb = [indx = this->cur_db_index_, this, ib = std::move(out_buf)] {
     this->LoadItemsBuffer(indx, ib);
 
@@ -2656,7 +3018,7 @@ std::error_code RdbLoaderBase::FromOpaque(const OpaqueObj& opaque, LoadConfig co
 
 void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
   EngineShard* es = EngineShard::tlocal();
-  DbContext db_cntx{&namespaces.GetDefaultNamespace(), db_ind, GetCurrentTimeMs()};
+  DbContext db_cntx{ns_, db_ind, GetCurrentTimeMs()};
   DbSlice& db_slice = db_cntx.GetDbSlice(es->shard_id());
 
   auto error_msg = [](const auto* item, auto db_ind) {
@@ -2712,6 +3074,25 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
       continue;
     }
 
+    // References are valid only for the backing file of the shard that saved them.
+    if (item->val.rdb_type == RDB_TYPE_TIERED_SEGMENT) {
+      auto* ts = es->tiered_storage();
+      if (get<RdbTieredSegment>(item->val.obj).shard_id != es->shard_id() || !ts ||
+          !ts->Restore(db_ind, pv)) {
+        LOG(ERROR) << "Could not restore offloaded value for key '" << item->key << "' in DB "
+                   << db_ind;
+        ec_ = RdbError(errc::rdb_file_corrupted);
+        stop_early_ = true;
+        break;
+      }
+    }
+
+    // Loading disables the memory limit, so when memory runs low, wait for room on disk for the
+    // value instead of keeping it in memory. The wait yields, so no iterators are held over it.
+    auto* ts = es->tiered_storage();
+    if (ts)
+      ts->AwaitStashCapacity(pv);
+
     auto op_res = db_slice.AddOrUpdate(db_cntx, item->key, std::move(pv), item->expire_ms);
     if (!op_res) {
       LOG(ERROR) << "OOM failed to add key '" << item->key << "' in DB " << db_ind;
@@ -2731,7 +3112,7 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
       LOG(WARNING) << "RDB has duplicated key '" << item->key << "' in DB " << db_ind;
     }
 
-    if (auto* ts = es->tiered_storage(); ts)
+    if (ts)
       ts->TryStash(db_cntx.db_index, item->key, &res.it->second);
   }
 
@@ -2743,8 +3124,27 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
 void RdbLoader::ResizeDb(size_t key_num, size_t expire_num) {
   DCHECK_LT(key_num, 1U << 31);
   DCHECK_LT(expire_num, 1U << 31);
-  // Note: To reserve space, it's necessary to allocate space at the shard level. We might
-  // load with different number of shards which makes database resizing unfeasible.
+  if (key_num == 0 || (load_db_ && cur_db_index_ != *load_db_))
+    return;
+
+  // Keys are spread over the shards by their hash, and we might load with a different number of
+  // shards than the snapshot was saved with. So every shard reserves its share, and the hints of
+  // the files that are loaded concurrently add up.
+  size_t shards = shard_set->size();
+  size_t keys = key_num / shards + 1;
+  size_t expires = expire_num ? expire_num / shards + 1 : 0;
+  auto cb = [ns = ns_, db_ind = cur_db_index_, keys, expires] {
+    EngineShard* es = EngineShard::tlocal();
+    ns->GetDbSlice(es->shard_id()).Reserve(db_ind, keys, expires);
+  };
+
+  // Reserve before the items of the db that are dispatched afterwards, see FlushShardAsync.
+  for (ShardId sid = 0; sid < shards; ++sid) {
+    if (EngineShard* es = EngineShard::tlocal(); es && es->shard_id() == sid)
+      cb();
+    else
+      shard_set->Add(sid, cb);
+  }
 }
 
 // Loads the next key/val pair.
@@ -2819,6 +3219,9 @@ error_code RdbLoader::LoadKeyValPair(int type, ObjSettings* settings) {
 }
 
 bool RdbLoader::ShouldDiscardKey(std::string_view key, ObjSettings* settings) const {
+  if (load_db_ && cur_db_index_ != *load_db_)
+    return true;
+
   if (!load_unowned_slots_ && cluster::IsClusterEnabled()) {
     const cluster::ClusterConfig* cluster_config = cluster::ClusterFamily::cluster_config();
     if (cluster_config != nullptr && !cluster_config->IsMySlot(key)) {
@@ -2860,7 +3263,7 @@ void RdbLoader::LoadSearchIndexDefFromAux(string&& def) {
   cntx.is_replicating = true;
   cntx.journal_emulated = true;
   cntx.skip_acl_validation = true;
-  cntx.ns = &namespaces.GetDefaultNamespace();
+  cntx.ns = ns_;
 
   // Avoid deleting local crb
   absl::Cleanup cntx_clean = [&cntx] { cntx.Inject(nullptr); };
@@ -19,6 +19,7 @@ extern "C" {
 namespace dfly {
 
 class EngineShardSet;
+class Namespace;
 class ScriptMgr;
 class CompactObj;
 class Service;
@@ -44,6 +45,7 @@ class RdbLoaderBase {
     double grow_factor, fp_prob;
     size_t prev_size, current_size;
     size_t max_capacity;
+    bool blocked = false;
 
     struct Filter {
       unsigned hash_cnt;
@@ -54,8 +56,48 @@ class RdbLoaderBase {
     std::vector<Filter> filters;
   };
 
-  using RdbVariant =
-      std::variant<long long, base::PODArray<char>, LzfString, std::unique_ptr<LoadTrace>, RdbSBF>;
+  struct RdbTimeSeries {
+    uint64_t retention_ms;
+
+    struct Chunk {
+      uint32_t count;
+      std::string data;
+      Chunk(uint32_t c, std::string d) : count(c), data(std::move(d)) {
+      }
+    };
+    std::vector<Chunk> chunks;
+  };
+
+  struct RdbCMS {
+    uint32_t width, depth;
+    uint64_t count;
+    std::string counters;
+  };
+
+  struct RdbTopK {
+    uint32_t k, width, depth;
+    double decay;
+    uint64_t seed;
+    std::string buckets;
+
+    struct Item {
+      std::string item;
+      uint32_t count;
+    };
+    std::vector<Item> list;
+  };
+
+  // Reference to an offloaded value in the backing file preserved from before the restart.
+  struct RdbTieredSegment {
+    ShardId shard_id;
+    size_t offset, length;
+    CompactObjType obj_type;
+    uint32_t raw_len;  // non zero if the value is compressed
+  };
+
+  using RdbVariant = std::variant<long long, base::PODArray<char>, LzfString,
+                                  std::unique_ptr<LoadTrace>, RdbSBF, RdbTieredSegment,
+                                  RdbTimeSeries, RdbCMS, RdbTopK>;
 
   struct OpaqueObj {
     RdbVariant obj;
@@ -170,13 +212,18 @@ class RdbLoaderBase {
   ::io::Result<OpaqueObj> ReadRedisJson();
   ::io::Result<OpaqueObj> ReadJson();
   ::io::Result<OpaqueObj> ReadSBF();
+  ::io::Result<OpaqueObj> ReadTieredSegment();
+  ::io::Result<OpaqueObj> ReadTimeSeries();
+  ::io::Result<OpaqueObj> ReadCMS();
+  ::io::Result<OpaqueObj> ReadTopK();
 
   std::error_code SkipModuleData();
   std::error_code HandleCompressedBlob(int op_type);
   std::error_code HandleCompressedBlobFinish();
+  std::error_code HandleCompressionDict();
   void AllocateDecompressOnce(int op_type);
 
-  std::error_code HandleJournalBlob(Service* service);
+  std::error_code HandleJournalBlob(Service* service, Namespace* ns);
 
   static size_t StrLen(const RdbVariant& tset);
 
@@ -212,6 +259,16 @@ class RdbLoader : protected RdbLoaderBase {
     load_unowned_slots_ = load_unowned;
   }
 
+  // Discard the keys of all other dbs if set.
+  void SetLoadDb(std::optional<DbIndex> db) {
+    load_db_ = db;
+  }
+
+  // Loads into the given namespace instead of the default one.
+  void SetNamespace(Namespace* ns) {
+    ns_ = ns;
+  }
+
   std::error_code Load(::io::Source* src);
 
   void set_source_limit(size_t n) {
@@ -243,6 +300,11 @@ class RdbLoader : protected RdbLoaderBase {
     pause_ = pause;
   }
 
+  // Returns the disk journal segment that was started with the snapshot, or 0 if none.
+  uint64_t journal_segment() const {
+    return journal_segment_;
+  }
+
   // Return the offset that was received with a RDB_OPCODE_JOURNAL_OFFSET command,
   // or 0 if no offset was received.
   std::optional<uint64_t> journal_offset() const {
@@ -310,6 +372,9 @@ class RdbLoader : protected RdbLoaderBase {
   Service* service_;
   bool override_existing_keys_ = false;
   bool load_unowned_slots_ = false;
+  std::optional<DbIndex> load_db_;
+  Namespace* ns_;
+  uint64_t journal_segment_ = 0;
   ScriptMgr* script_mgr_;
   std::vector<ItemsBuf> shard_buf_;
 
@@ -8,6 +8,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <lz4frame.h>
+#include <zdict.h>
 #include <zstd.h>
 
 #include <queue>
@@ -29,9 +30,14 @@ extern "C" {
 #include "base/logging.h"
 #include "core/bloom.h"
 #include "core/json/json_object.h"
+#include "core/packed_map.h"
+#include "core/qlist.h"
+#include "core/roaring_int_set.h"
+#include "core/sketch.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/time_series.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/main_service.h"
@@ -40,6 +46,7 @@ extern "C" {
 #include "server/search/doc_index.h"
 #include "server/serializer_commons.h"
 #include "server/snapshot.h"
+#include "server/snapshot_index.h"
 #include "server/tiering/common.h"
 #include "util/fibers/simple_channel.h"
 
@@ -49,6 +56,11 @@ ABSL_FLAG(dfly::CompressionMode, compression_mode, dfly::CompressionMode::MULTI_
           "set 2 for multi entry zstd compression on df snapshot and single entry on rdb snapshot,"
           "set 3 for multi entry lz4 compression on df snapshot and single entry on rdb snapshot");
 ABSL_FLAG(int, compression_level, 2, "The compression level to use on zstd/lz4 compression");
+ABSL_FLAG(uint32_t, compression_dict_size, 0,
+          "Size of the zstd dictionary that every snapshot serializer trains on its first "
+          "compressed blobs and uses for the following ones with MULTI_ENTRY_ZSTD compression. "
+          "Snapshots and full sync streams with dictionaries can not be loaded by older versions. "
+          "0 disables dictionaries.");
 ABSL_FLAG(bool, list_rdb_encode_v2, true,
           "V2 rdb encoding of list uses listpack encoding format, compatible with redis 7. V1 rdb "
           "enconding of list uses ziplist encoding compatible with redis 6");
@@ -167,7 +179,7 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_STRING:
       return RDB_TYPE_STRING;
     case OBJ_LIST:
-      if (compact_enc == OBJ_ENCODING_QUICKLIST) {
+      if (compact_enc == OBJ_ENCODING_QUICKLIST || compact_enc == kEncodingQL2) {
         if (absl::GetFlag(FLAGS_list_rdb_encode_v2))
           return RDB_TYPE_LIST_QUICKLIST_2;
         return RDB_TYPE_LIST_QUICKLIST;
@@ -177,6 +189,8 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_SET:
       if (compact_enc == kEncodingIntSet)
         return RDB_TYPE_SET_INTSET;
+      else if (compact_enc == kEncodingRoaring)
+        return RDB_TYPE_SET;
       else if (compact_enc == kEncodingStrMap || compact_enc == kEncodingStrMap2) {
         if (((StringSet*)pv.RObjPtr())->ExpirationUsed())
           return RDB_TYPE_SET_WITH_EXPIRY;
@@ -193,6 +207,8 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_HASH:
       if (compact_enc == kEncodingListPack)
         return RDB_TYPE_HASH_ZIPLIST;
+      else if (compact_enc == kEncodingPackedMap)
+        return RDB_TYPE_HASH;
       else if (compact_enc == kEncodingStrMap2) {
         if (((StringMap*)pv.RObjPtr())->ExpirationUsed())
           return RDB_TYPE_HASH_WITH_EXPIRY;  // Incompatible with Redis
@@ -209,6 +225,12 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
                              // 2024.
     case OBJ_SBF:
       return RDB_TYPE_SBF;
+    case OBJ_TS:
+      return RDB_TYPE_TIMESERIES;
+    case OBJ_CMS:
+      return RDB_TYPE_CMS;
+    case OBJ_TOPK:
+      return RDB_TYPE_TOPK;
   }
   LOG(FATAL) << "Unknown encoding " << compact_enc << " for type " << type;
   return 0; /* avoid warning */
@@ -225,6 +247,12 @@ class CompressorImpl {
   }
   virtual io::Result<io::Bytes> Compress(io::Bytes data) = 0;
 
+  // Returns a dictionary that was created by the last Compress call and must be sent before its
+  // blob, or an empty string.
+  virtual std::string TakeNewDictionary() {
+    return {};
+  }
+
  protected:
   int compression_level_ = 1;
   size_t compressed_size_total_ = 0;
@@ -236,25 +264,77 @@ class ZstdCompressor : public CompressorImpl {
  public:
   ZstdCompressor() {
     cctx_ = ZSTD_createCCtx();
+    dict_size_ = absl::GetFlag(FLAGS_compression_dict_size);
   }
   ~ZstdCompressor() {
+    ZSTD_freeCDict(cdict_);
     ZSTD_freeCCtx(cctx_);
   }
 
   io::Result<io::Bytes> Compress(io::Bytes data);
 
+  std::string TakeNewDictionary() {
+    return std::move(new_dict_);
+  }
+
  private:
+  // Adds the blob to the samples, and trains the dictionary once there are enough of them.
+  void SampleForDictionary(io::Bytes data);
+
   ZSTD_CCtx* cctx_;
   base::PODArray<uint8_t> compr_buf_;
+
+  // Training a dictionary of dict_size_ bytes works best with about a hundred times more samples.
+  // Blobs are cut into samples of kSampleSize, as the entries in them are not delimited.
+  static constexpr size_t kSampleSize = 4096;
+  static constexpr size_t kSamplesPerDictByte = 100;
+  size_t dict_size_ = 0;  // 0 if dictionaries are disabled or training failed
+  std::string samples_;
+  std::vector<size_t> sample_sizes_;
+  ZSTD_CDict* cdict_ = nullptr;
+  std::string new_dict_;
 };
 
+void ZstdCompressor::SampleForDictionary(io::Bytes data) {
+  for (size_t offs = 0; offs < data.size(); offs += kSampleSize) {
+    size_t len = std::min(kSampleSize, data.size() - offs);
+    samples_.append(reinterpret_cast<const char*>(data.data()) + offs, len);
+    sample_sizes_.push_back(len);
+  }
+  if (samples_.size() < dict_size_ * kSamplesPerDictByte)
+    return;
+
+  std::string dict(dict_size_, '\0');
+  size_t res = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples_.data(),
+                                     sample_sizes_.data(), sample_sizes_.size());
+  if (ZDICT_isError(res)) {
+    LOG(WARNING) << "Could not train a compression dictionary: " << ZDICT_getErrorName(res);
+    dict_size_ = 0;
+  } else {
+    dict.resize(res);
+    cdict_ = ZSTD_createCDict(dict.data(), dict.size(), compression_level_);
+    new_dict_ = std::move(dict);
+    VLOG(1) << "Trained a compression dictionary of " << res << " bytes on "
+            << sample_sizes_.size() << " samples";
+  }
+
+  samples_ = {};
+  sample_sizes_ = {};
+}
+
 io::Result<io::Bytes> ZstdCompressor::Compress(io::Bytes data) {
+  if (dict_size_ > 0 && !cdict_)
+    SampleForDictionary(data);
+
   size_t buf_size = ZSTD_compressBound(data.size());
   if (compr_buf_.capacity() < buf_size) {
     compr_buf_.reserve(buf_size);
   }
-  size_t compressed_size = ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(),
-                                             data.data(), data.size(), compression_level_);
+  size_t compressed_size =
+      cdict_ ? ZSTD_compress_usingCDict(cctx_, compr_buf_.data(), compr_buf_.capacity(),
+                                        data.data(), data.size(), cdict_)
+             : ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(), data.data(),
+                                 data.size(), compression_level_);
 
   if (ZSTD_isError(compressed_size)) {
     return make_unexpected(error_code{int(compressed_size), generic_category()});
@@ -342,6 +422,13 @@ error_code RdbSerializer::SelectDb(uint32_t dbid) {
   return WriteRaw(Bytes{buf, enclen + 1});
 }
 
+error_code RdbSerializer::SendDbSize(DbIndex dbid, size_t keys, size_t expires) {
+  RETURN_ON_ERR(SelectDb(dbid));
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_RESIZEDB));
+  RETURN_ON_ERR(SaveLen(keys));
+  return SaveLen(expires);
+}
+
 // Called by snapshot
 io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValue& pv,
                                              uint64_t expire_ms, uint32_t mc_flags, DbIndex dbid) {
@@ -352,6 +439,52 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
     return 0;
   }
 
+  // Offloaded values are only passed here when their segments are referenced, see SliceSnapshot.
+  uint8_t rdb_type = pv.IsExternal() ? RDB_TYPE_TIERED_SEGMENT : RdbObjectType(pv);
+  if (auto ec = SaveEntryHeader(pk, pv.HasFlag(), expire_ms, mc_flags, dbid, rdb_type); ec)
+    return make_unexpected(ec);
+
+  if (auto ec = pv.IsExternal() ? SaveTieredSegment(pv) : SaveValue(pv); ec) {
+    LOG(ERROR) << "Problems saving value for key " << pk.GetSlice(&tmp_str_)
+               << " in dbid=" << dbid;
+    return make_unexpected(ec);
+  }
+
+  return rdb_type;
+}
+
+io::Result<uint8_t> RdbSerializer::SaveExternalEntry(const PrimeKey& pk, CompactObjType obj_type,
+                                                     string_view blob, uint64_t expire_ms,
+                                                     bool has_mc_flags, uint32_t mc_flags,
+                                                     DbIndex dbid) {
+  // A container dump is the rdb type, the value and the footer, see DumpObject.
+  constexpr size_t kFooterSize = sizeof(uint16_t) + sizeof(uint64_t);
+  uint8_t rdb_type = RDB_TYPE_STRING;
+  if (obj_type != OBJ_STRING) {
+    if (blob.size() <= kFooterSize + 1 || !rdbIsObjectTypeDF(blob[0]))
+      return make_unexpected(make_error_code(errc::illegal_byte_sequence));
+    rdb_type = blob[0];
+    blob = blob.substr(1, blob.size() - kFooterSize - 1);
+  }
+
+  if (auto ec = SaveEntryHeader(pk, has_mc_flags, expire_ms, mc_flags, dbid, rdb_type); ec)
+    return make_unexpected(ec);
+
+  error_code ec;
+  if (obj_type == OBJ_STRING)
+    ec = SaveString(blob);
+  else
+    ec = WriteRaw(io::Buffer(blob));
+  if (ec)
+    return make_unexpected(ec);
+
+  FlushIfNeeded(FlushState::kFlushEndEntry);
+  return rdb_type;
+}
+
+error_code RdbSerializer::SaveEntryHeader(const PrimeKey& pk, bool has_mc_flags,
+                                          uint64_t expire_ms, uint32_t mc_flags, DbIndex dbid,
+                                          uint8_t rdb_type) {
   DVLOG(3) << "Selecting " << dbid << " previous: " << last_entry_db_index_;
   SelectDb(dbid);
 
@@ -359,13 +492,12 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
   if (expire_ms > 0) {
     uint8_t buf[16] = {RDB_OPCODE_EXPIRETIME_MS};
     absl::little_endian::Store64(buf + 1, expire_ms);
-    if (auto ec = WriteRaw(Bytes{buf, 9}); ec)
-      return make_unexpected(ec);
+    RETURN_ON_ERR(WriteRaw(Bytes{buf, 9}));
   }
 
   /* Save the key poperties */
   uint32_t df_mask_flags = pk.IsSticky() ? DF_MASK_FLAG_STICKY : 0;
-  df_mask_flags |= pv.HasFlag() ? DF_MASK_FLAG_MC_FLAGS : 0;
+  df_mask_flags |= has_mc_flags ? DF_MASK_FLAG_MC_FLAGS : 0;
   if (df_mask_flags != 0) {
     uint8_t buf[9] = {RDB_OPCODE_DF_MASK};
     absl::little_endian::Store32(buf + 1, df_mask_flags);
@@ -374,27 +506,14 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
       absl::little_endian::Store32(buf + buf_size, mc_flags);
       buf_size += 4;
     }
-    if (auto ec = WriteRaw(Bytes{buf, buf_size}); ec)
-      return make_unexpected(ec);
+    RETURN_ON_ERR(WriteRaw(Bytes{buf, buf_size}));
   }
 
-  uint8_t rdb_type = RdbObjectType(pv);
-
   string_view key = pk.GetSlice(&tmp_str_);
   DVLOG(3) << ((void*)this) << ": Saving key/val start " << key << " in dbid=" << dbid;
 
-  if (auto ec = WriteOpcode(rdb_type); ec)
-    return make_unexpected(ec);
-
-  if (auto ec = SaveString(key); ec)
-    return make_unexpected(ec);
-
-  if (auto ec = SaveValue(pv); ec) {
-    LOG(ERROR) << "Problems saving value for key " << key << " in dbid=" << dbid;
-    return make_unexpected(ec);
-  }
-
-  return rdb_type;
+  RETURN_ON_ERR(WriteOpcode(rdb_type));
+  return SaveString(key);
 }
 
 error_code RdbSerializer::SaveObject(const PrimeValue& pv) {
@@ -429,12 +548,43 @@ error_code RdbSerializer::SaveObject(const PrimeValue& pv) {
     return SaveSBFObject(pv);
   }
 
+  if (obj_type == OBJ_TS) {
+    return SaveTimeSeriesObject(pv);
+  }
+
+  if (obj_type == OBJ_CMS) {
+    return SaveCMSObject(pv);
+  }
+
+  if (obj_type == OBJ_TOPK) {
+    return SaveTopKObject(pv);
+  }
+
   LOG(ERROR) << "Not implemented " << obj_type;
   return make_error_code(errc::function_not_supported);
 }
 
 error_code RdbSerializer::SaveListObject(const PrimeValue& pv) {
   /* Save a list value */
+  if (pv.Encoding() == kEncodingQL2) {
+    // QList nodes are listpacks and are saved like quicklist nodes.
+    const QList* ql = reinterpret_cast<const QList*>(pv.RObjPtr());
+    RETURN_ON_ERR(SaveLen(ql->node_count()));
+
+    unique_ptr<uint8_t[]> buf;
+    for (const QList::Node* node = ql->Head(); node; node = node->next) {
+      uint8_t* lp = const_cast<uint8_t*>(QList::NodeListpack(node, &buf));
+      if (absl::GetFlag(FLAGS_list_rdb_encode_v2)) {
+        SaveLen(QUICKLIST_NODE_CONTAINER_PACKED);
+        RETURN_ON_ERR(SaveString(lp, node->sz));
+        FlushIfNeeded(node->next ? FlushState::kFlushMidEntry : FlushState::kFlushEndEntry);
+      } else {
+        RETURN_ON_ERR(SaveListPackAsZiplist(lp));
+      }
+    }
+    return error_code{};
+  }
+
   DCHECK_EQ(OBJ_ENCODING_QUICKLIST, pv.Encoding());
   const quicklist* ql = reinterpret_cast<const quicklist*>(pv.RObjPtr());
   quicklistNode* node = ql->head;
@@ -514,6 +664,22 @@ error_code RdbSerializer::SaveSetObject(const PrimeValue& obj) {
         flush_state = FlushState::kFlushEndEntry;
       FlushIfNeeded(flush_state);
     }
+  } else if (obj.Encoding() == kEncodingRoaring) {
+    // Saved as a plain set of integers, the loader turns it into a roaring bitmap again.
+    const RoaringIntSet* rs = (const RoaringIntSet*)obj.RObjPtr();
+    RETURN_ON_ERR(SaveLen(rs->Size()));
+
+    error_code ec;
+    size_t saved = 0;
+    rs->Iterate([&](int64_t val) {
+      ec = SaveLongLongAsString(val);
+      if (ec)
+        return false;
+      FlushIfNeeded(++saved == rs->Size() ? FlushState::kFlushEndEntry
+                                          : FlushState::kFlushMidEntry);
+      return true;
+    });
+    RETURN_ON_ERR(ec);
   } else {
     CHECK_EQ(obj.Encoding(), kEncodingIntSet);
     intset* is = (intset*)obj.RObjPtr();
@@ -549,6 +715,19 @@ error_code RdbSerializer::SaveHSetObject(const PrimeValue& pv) {
         flush_state = FlushState::kFlushEndEntry;
       FlushIfNeeded(flush_state);
     }
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    uint8_t* pm = (uint8_t*)pv.RObjPtr();
+
+    // PackedMap is limited to 64KB, so it is serialized as a single entry.
+    RETURN_ON_ERR(SaveLen(PackedMap::Size(pm)));
+    error_code ec;
+    PackedMap::Iterate(pm, [&](string_view field, string_view value) {
+      ec = SaveString(field);
+      if (!ec)
+        ec = SaveString(value);
+      return !ec;
+    });
+    RETURN_ON_ERR(ec);
   } else {
     CHECK_EQ(kEncodingListPack, pv.Encoding());
 
@@ -601,34 +780,23 @@ error_code RdbSerializer::SaveZSetObject(const PrimeValue& pv) {
 }
 
 error_code RdbSerializer::SaveStreamObject(const PrimeValue& pv) {
-  /* Store how many listpacks we have inside the radix tree. */
+  /* Store how many listpacks we have inside the stream. */
   stream* s = (stream*)pv.RObjPtr();
-  rax* rax = s->rax_tree;
-
-  RETURN_ON_ERR(SaveLen(raxSize(rax)));
 
-  /* Serialize all the listpacks inside the radix tree as they are,
-   * when loading back, we'll use the first entry of each listpack
-   * to insert it back into the radix tree. */
-  raxIterator ri;
-  raxStart(&ri, rax);
-  raxSeek(&ri, "^", NULL, 0);
-  while (raxNext(&ri)) {
-    uint8_t* lp = (uint8_t*)ri.data;
-    size_t lp_bytes = lpBytes(lp);
-    error_code ec = SaveString((uint8_t*)ri.key, ri.key_len);
-    if (ec) {
-      raxStop(&ri);
-      return ec;
-    }
+  RETURN_ON_ERR(SaveLen(streamNodesSize(s->nodes)));
 
-    ec = SaveString(lp, lp_bytes);
-    if (ec) {
-      raxStop(&ri);
-      return ec;
-    }
+  /* Serialize all the listpacks as they are, each one preceded by its master ID
+   * encoded as a 128 bit big endian number, like the keys of the radix tree
+   * that redis uses to index them. */
+  streamNodesIterator ri;
+  streamNodesIterStart(&ri, s->nodes);
+  streamNodesSeek(&ri, "^", NULL);
+  while (streamNodesNext(&ri)) {
+    uint8_t node_key[sizeof(streamID)];
+    streamEncodeID(node_key, &ri.id);
+    RETURN_ON_ERR(SaveString(node_key, sizeof(node_key)));
+    RETURN_ON_ERR(SaveString(ri.lp, lpBytes(ri.lp)));
   }
-  raxStop(&ri);
 
   /* Save the number of elements inside the stream. We cannot obtain
    * this easily later, since our macro nodes should be checked for
@@ -682,11 +850,22 @@ error_code RdbSerializer::SaveJsonObject(const PrimeValue& pv) {
   return SaveString(json_string);
 }
 
+std::error_code RdbSerializer::SaveTieredSegment(const PrimeValue& pv) {
+  auto [offset, length] = pv.GetExternalSlice();
+
+  // The shard id guards against loading the reference into a different backing file.
+  RETURN_ON_ERR(SaveLen(EngineShard::tlocal()->shard_id()));
+  RETURN_ON_ERR(SaveLen(offset));
+  RETURN_ON_ERR(SaveLen(length));
+  RETURN_ON_ERR(SaveLen(pv.ObjType()));
+  return SaveLen(pv.IsExternalCompressed() ? pv.Size() : 0);  // raw length of compressed values
+}
+
 std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   SBF* sbf = pv.GetSBF();
 
-  // options to allow format mutations in the future.
-  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  // options to allow format mutations in the future. Bit 0 marks the blocked layout.
+  RETURN_ON_ERR(SaveLen(sbf->blocked() ? 1 : 0));
   RETURN_ON_ERR(SaveBinaryDouble(sbf->grow_factor()));
   RETURN_ON_ERR(SaveBinaryDouble(sbf->fp_probability()));
   RETURN_ON_ERR(SaveLen(sbf->prev_size()));
@@ -709,6 +888,63 @@ std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   return {};
 }
 
+error_code RdbSerializer::SaveTimeSeriesObject(const PrimeValue& pv) {
+  const TimeSeries* ts = pv.GetTimeSeries();
+
+  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  RETURN_ON_ERR(SaveLen(ts->retention_ms()));
+  RETURN_ON_ERR(SaveLen(ts->num_chunks()));
+
+  // Chunks are saved in their compressed form.
+  for (unsigned i = 0; i < ts->num_chunks(); ++i) {
+    RETURN_ON_ERR(SaveLen(ts->chunk_count(i)));
+    RETURN_ON_ERR(SaveString(ts->chunk_data(i)));
+
+    FlushState flush_state = FlushState::kFlushMidEntry;
+    if ((i + 1) == ts->num_chunks())
+      flush_state = FlushState::kFlushEndEntry;
+
+    FlushIfNeeded(flush_state);
+  }
+
+  return {};
+}
+
+error_code RdbSerializer::SaveCMSObject(const PrimeValue& pv) {
+  const CountMinSketch* cms = pv.GetCMS();
+
+  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  RETURN_ON_ERR(SaveLen(cms->width()));
+  RETURN_ON_ERR(SaveLen(cms->depth()));
+  RETURN_ON_ERR(SaveLen(cms->count()));
+  RETURN_ON_ERR(SaveString(cms->data()));
+  FlushIfNeeded(FlushState::kFlushEndEntry);
+
+  return {};
+}
+
+error_code RdbSerializer::SaveTopKObject(const PrimeValue& pv) {
+  const TopK* topk = pv.GetTopK();
+
+  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  RETURN_ON_ERR(SaveLen(topk->k()));
+  RETURN_ON_ERR(SaveLen(topk->width()));
+  RETURN_ON_ERR(SaveLen(topk->depth()));
+  RETURN_ON_ERR(SaveBinaryDouble(topk->decay()));
+  RETURN_ON_ERR(SaveLen(topk->seed()));
+  RETURN_ON_ERR(SaveString(topk->data()));
+
+  vector<TopK::Entry> list = topk->List();
+  RETURN_ON_ERR(SaveLen(list.size()));
+  for (const TopK::Entry& entry : list) {
+    RETURN_ON_ERR(SaveString(entry.item));
+    RETURN_ON_ERR(SaveLen(entry.count));
+  }
+  FlushIfNeeded(FlushState::kFlushEndEntry);
+
+  return {};
+}
+
 /* Save a long long value as either an encoded string or a string. */
 error_code RdbSerializer::SaveLongLongAsString(int64_t value) {
   uint8_t buf[32];
@@ -957,6 +1193,22 @@ void SerializerBase::DumpObject(const CompactObj& obj, io::StringSink* out) {
   CHECK_GT(out->str().size(), 10u);
 }
 
+void SerializerBase::DumpString(string_view str, io::StringSink* out) {
+  CompressionMode compression_mode = GetDefaultCompressionMode();
+  if (compression_mode != CompressionMode::NONE) {
+    compression_mode = CompressionMode::SINGLE_ENTRY;
+  }
+  RdbSerializer serializer(compression_mode);
+
+  std::error_code ec = serializer.WriteOpcode(RDB_TYPE_STRING);
+  CHECK(!ec);
+  ec = serializer.SaveString(str);
+  CHECK(!ec);
+  ec = serializer.FlushToSink(out, SerializerBase::FlushState::kFlushMidEntry);
+  CHECK(!ec);
+  AppendFooter(out);
+}
+
 size_t SerializerBase::SerializedLen() const {
   return mem_buf_.InputLen();
 }
@@ -970,7 +1222,10 @@ io::Bytes SerializerBase::PrepareFlush(SerializerBase::FlushState flush_state) {
   if (is_last_chunk && number_of_chunks_ == 0) {
     if (compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
         compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4) {
-      CompressBlob();
+      if (offload_compression_)
+        compression_pending_ = true;
+      else
+        CompressBlob();
     }
   }
 
@@ -1108,7 +1363,8 @@ class RdbSaver::Impl {
   ~Impl();
 
   void StartSnapshotting(bool stream_journal, const Cancellation* cll, EngineShard* shard);
-  void StartIncrementalSnapshotting(Context* cntx, EngineShard* shard, LSN start_lsn);
+  void StartIncrementalSnapshotting(Context* cntx, EngineShard* shard, LSN start_lsn,
+                                    std::optional<LSN> end_lsn);
 
   void StopSnapshotting(EngineShard* shard);
 
@@ -1122,6 +1378,8 @@ class RdbSaver::Impl {
 
   size_t GetTotalBuffersSize() const;
 
+  size_t GetPeakBuffersSize() const;
+
   RdbSaver::SnapshotStats GetCurrentSnapshotProgress() const;
 
   error_code FlushSerializer();
@@ -1142,6 +1400,23 @@ class RdbSaver::Impl {
     return last_write_time_ns_;
   }
 
+  void EnableIndex() {
+    index_.emplace();
+  }
+
+  void SetPriority(SavePriority priority) {
+    priority_ = priority;
+  }
+
+  SnapshotIndex* index() {
+    return index_ ? &*index_ : nullptr;
+  }
+
+  // Bytes written to the sink so far, which is the offset of the next write.
+  size_t bytes_written() const {
+    return bytes_written_;
+  }
+
  private:
   error_code WriteRecord(io::Bytes src);
 
@@ -1160,6 +1435,10 @@ class RdbSaver::Impl {
   // make snapshot size smaller and opreation faster.
   CompressionMode compression_mode_;
   SaveMode save_mode_;
+
+  std::optional<SnapshotIndex> index_;
+  size_t bytes_written_ = 0;
+  SavePriority priority_ = SavePriority::kNormal;
 };
 
 // We pass K=sz to say how many producers are pushing data in order to maintain
@@ -1228,6 +1507,10 @@ error_code RdbSaver::Impl::ConsumeChannel(const Cancellation* cll) {
         continue;
 
       DVLOG(2) << "Pulled " << record.id;
+      if (index_) {
+        index_->AddRecord(bytes_written_, record.value.size(), record.entry_start,
+                          record.db_mask, record.slot_groups);
+      }
       auto start = absl::GetCurrentTimeNanos();
       io_error = WriteRecord(io::Buffer(record.value));
       if (io_error) {
@@ -1255,6 +1538,7 @@ error_code RdbSaver::Impl::WriteRecord(io::Bytes src) {
   // so we could be more responsive.
   error_code ec;
   size_t start_size = src.size();
+  bytes_written_ += src.size();
   last_write_time_ns_ = absl::GetCurrentTimeNanos();
   do {
     io::Bytes part = src.subspan(0, 8_MB);
@@ -1283,6 +1567,7 @@ void RdbSaver::Impl::StartSnapshotting(bool stream_journal, const Cancellation*
   auto& s = GetSnapshot(shard);
   auto& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id());
   s = std::make_unique<SliceSnapshot>(&db_slice, &channel_, compression_mode_);
+  s->SetPriority(priority_);
 
   const auto allow_flush = (save_mode_ != SaveMode::RDB) ? SliceSnapshot::SnapshotFlush::kAllow
                                                          : SliceSnapshot::SnapshotFlush::kDisallow;
@@ -1290,12 +1575,12 @@ void RdbSaver::Impl::StartSnapshotting(bool stream_journal, const Cancellation*
 }
 
 void RdbSaver::Impl::StartIncrementalSnapshotting(Context* cntx, EngineShard* shard,
-                                                  LSN start_lsn) {
+                                                  LSN start_lsn, std::optional<LSN> end_lsn) {
   auto& db_slice = namespaces.GetDefaultNamespace().GetDbSlice(shard->shard_id());
   auto& s = GetSnapshot(shard);
   s = std::make_unique<SliceSnapshot>(&db_slice, &channel_, compression_mode_);
 
-  s->StartIncremental(cntx, start_lsn);
+  s->StartIncremental(cntx, start_lsn, end_lsn);
 }
 
 void RdbSaver::Impl::StopSnapshotting(EngineShard* shard) {
@@ -1330,6 +1615,16 @@ size_t RdbSaver::Impl::GetTotalBuffersSize() const {
   return channel_bytes.load(memory_order_relaxed) + serializer_bytes.load(memory_order_relaxed);
 }
 
+// Called once the snapshots finished.
+size_t RdbSaver::Impl::GetPeakBuffersSize() const {
+  size_t res = 0;
+  for (auto& ptr : shard_snapshots_) {
+    if (ptr)
+      res += ptr->GetPeakBuffersMemory();
+  }
+  return res;
+}
+
 RdbSaver::SnapshotStats RdbSaver::Impl::GetCurrentSnapshotProgress() const {
   std::vector<RdbSaver::SnapshotStats> results(shard_snapshots_.size());
 
@@ -1353,6 +1648,7 @@ RdbSaver::SnapshotStats RdbSaver::Impl::GetCurrentSnapshotProgress() const {
 
 error_code RdbSaver::Impl::FlushSerializer() {
   last_write_time_ns_ = absl::GetCurrentTimeNanos();
+  bytes_written_ += serializer()->SerializedLen();
   auto ec = serializer()->FlushToSink(sink_, SerializerBase::FlushState::kFlushMidEntry);
   last_write_time_ns_ = -1;
   return ec;
@@ -1442,8 +1738,9 @@ void RdbSaver::StartSnapshotInShard(bool stream_journal, const Cancellation* cll
   impl_->StartSnapshotting(stream_journal, cll, shard);
 }
 
-void RdbSaver::StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn) {
-  impl_->StartIncrementalSnapshotting(cntx, shard, start_lsn);
+void RdbSaver::StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn,
+                                               optional<LSN> end_lsn) {
+  impl_->StartIncrementalSnapshotting(cntx, shard, start_lsn, end_lsn);
 }
 
 void RdbSaver::StopFullSyncInShard(EngineShard* shard) {
@@ -1463,8 +1760,20 @@ error_code RdbSaver::SaveHeader(const GlobalData& glob_state) {
   return error_code{};
 }
 
+void RdbSaver::EnableIndex() {
+  DCHECK(save_mode_ == SaveMode::SINGLE_SHARD ||
+         save_mode_ == SaveMode::SINGLE_SHARD_WITH_SUMMARY);
+  impl_->EnableIndex();
+}
+
+void RdbSaver::SetPriority(SavePriority priority) {
+  impl_->SetPriority(priority);
+}
+
 error_code RdbSaver::SaveBody(Context* cntx, RdbTypeFreqMap* freq_map) {
   RETURN_ON_ERR(impl_->FlushSerializer());
+  if (SnapshotIndex* index = impl_->index())
+    index->body_offset = impl_->bytes_written();
 
   if (save_mode_ == SaveMode::SUMMARY) {
     impl_->serializer()->SendFullSyncCut();
@@ -1518,6 +1827,9 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
       RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("search-index", s));
   }
 
+  if (glob_state.journal_segment)
+    RETURN_ON_ERR(SaveAuxFieldStrInt("journal-segment", glob_state.journal_segment));
+
   // TODO: "repl-stream-db", "repl-id", "repl-offset"
   return error_code{};
 }
@@ -1527,6 +1839,10 @@ error_code RdbSaver::SaveEpilog() {
   uint64_t chksum;
 
   auto& ser = *impl_->serializer();
+  RETURN_ON_ERR(impl_->FlushSerializer());
+  SnapshotIndex* index = impl_->index();
+  if (index)
+    index->epilog_offset = impl_->bytes_written();
 
   /* EOF opcode */
   RETURN_ON_ERR(ser.WriteOpcode(RDB_OPCODE_EOF));
@@ -1538,6 +1854,10 @@ error_code RdbSaver::SaveEpilog() {
   absl::little_endian::Store64(buf, chksum);
   RETURN_ON_ERR(ser.WriteRaw(buf));
 
+  // The index follows the checksum, where loaders stop reading.
+  if (index)
+    RETURN_ON_ERR(ser.WriteRaw(io::Buffer(index->Serialize())));
+
   RETURN_ON_ERR(impl_->FlushSerializer());
 
   return impl_->FlushSink();
@@ -1557,6 +1877,10 @@ size_t RdbSaver::GetTotalBuffersSize() const {
   return impl_->GetTotalBuffersSize();
 }
 
+size_t RdbSaver::GetPeakBuffersSize() const {
+  return impl_->GetPeakBuffersSize();
+}
+
 RdbSaver::SnapshotStats RdbSaver::GetCurrentSnapshotProgress() const {
   return impl_->GetCurrentSnapshotProgress();
 }
@@ -1579,51 +1903,87 @@ void SerializerBase::AllocateCompressorOnce() {
 }
 
 void SerializerBase::CompressBlob() {
+  Bytes blob_to_compress = mem_buf_.InputBuffer();
+  std::optional<Bytes> compressed_blob = TryCompress(blob_to_compress);
+  if (!compressed_blob)
+    return;
+
+  // Clear membuf and write the compressed blob to it
+  mem_buf_.ConsumeInput(blob_to_compress.size());
+  dict_written_ |= WriteCompressedBlob(*compressed_blob, &mem_buf_);
+}
+
+bool SerializerBase::CompressRecord(string* blob) {
+  std::optional<Bytes> compressed_blob = TryCompress(io::Buffer(*blob));
+  if (!compressed_blob)
+    return false;
+
+  io::IoBuf buf{compressed_blob->size() + 16};
+  bool dict_written = WriteCompressedBlob(*compressed_blob, &buf);
+  blob->assign(io::View(buf.InputBuffer()));
+  return dict_written;
+}
+
+std::optional<Bytes> SerializerBase::TryCompress(Bytes blob) {
   if (!compression_stats_) {
     compression_stats_.emplace(CompressionStats{});
   }
-  Bytes blob_to_compress = mem_buf_.InputBuffer();
-  size_t blob_size = blob_to_compress.size();
+  size_t blob_size = blob.size();
   if (blob_size < kMinStrSizeToCompress) {
     ++compression_stats_->small_str_count;
-    return;
+    return std::nullopt;
   }
 
   AllocateCompressorOnce();
   // Compress the data
-  auto ec = compressor_impl_->Compress(blob_to_compress);
+  auto ec = compressor_impl_->Compress(blob);
   if (!ec) {
     ++compression_stats_->compression_failed;
-    return;
+    return std::nullopt;
   }
   Bytes compressed_blob = *ec;
   if (compressed_blob.length() > blob_size * kMinCompressionReductionPrecentage) {
     ++compression_stats_->compression_no_effective;
-    return;
+    return std::nullopt;
   }
+  return compressed_blob;
+}
 
-  // Clear membuf and write the compressed blob to it
-  mem_buf_.ConsumeInput(blob_size);
-  mem_buf_.Reserve(compressed_blob.length() + 1 + 9);  // reserve space for blob + opcode + len
+bool SerializerBase::WriteCompressedBlob(Bytes compressed_blob, io::IoBuf* dest_buf) {
+  // The dictionary that the blob was compressed with goes first.
+  bool dict_written = false;
+  if (string dict = compressor_impl_->TakeNewDictionary(); !dict.empty()) {
+    dest_buf->Reserve(dict.size() + 1 + 9);
+    auto dest = dest_buf->AppendBuffer();
+    dest[0] = RDB_OPCODE_COMPRESSION_DICT;
+    unsigned enclen = WritePackedUInt(dict.size(), dest.subspan(1));
+    memcpy(dest.data() + 1 + enclen, dict.data(), dict.size());
+    dest_buf->CommitWrite(1 + enclen + dict.size());
+    dict_written = true;
+  }
+
+  // reserve space for blob + opcode + len
+  dest_buf->Reserve(dest_buf->InputLen() + compressed_blob.length() + 1 + 9);
 
   // First write opcode for compressed string
-  auto dest = mem_buf_.AppendBuffer();
+  auto dest = dest_buf->AppendBuffer();
   uint8_t opcode = compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD
                        ? RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START
                        : RDB_OPCODE_COMPRESSED_LZ4_BLOB_START;
   dest[0] = opcode;
-  mem_buf_.CommitWrite(1);
+  dest_buf->CommitWrite(1);
 
   // Write encoded compressed blob len
-  dest = mem_buf_.AppendBuffer();
+  dest = dest_buf->AppendBuffer();
   unsigned enclen = WritePackedUInt(compressed_blob.length(), dest);
-  mem_buf_.CommitWrite(enclen);
+  dest_buf->CommitWrite(enclen);
 
   // Write compressed blob
-  dest = mem_buf_.AppendBuffer();
+  dest = dest_buf->AppendBuffer();
   memcpy(dest.data(), compressed_blob.data(), compressed_blob.length());
-  mem_buf_.CommitWrite(compressed_blob.length());
+  dest_buf->CommitWrite(compressed_blob.length());
   ++compression_stats_->compressed_blobs;
+  return dict_written;
 }
 
 size_t RdbSerializer::GetTempBufferSize() const {
@@ -11,6 +11,7 @@ extern "C" {
 }
 
 #include <optional>
+#include <utility>
 
 #include "base/pod_array.h"
 #include "io/io.h"
@@ -67,6 +68,10 @@ enum class SaveMode {
   RDB,                        // Save .rdb file. Expected to read all shards.
 };
 
+// Low priority snapshots adapt their pace to hold the latency they add to commands, see
+// --snapshot_latency_target_usec.
+enum class SavePriority { kNormal, kLow };
+
 enum class CompressionMode { NONE, SINGLE_ENTRY, MULTI_ENTRY_ZSTD, MULTI_ENTRY_LZ4 };
 CompressionMode GetDefaultCompressionMode();
 
@@ -76,6 +81,7 @@ class RdbSaver {
   struct GlobalData {
     const StringVec lua_scripts;     // bodies of lua scripts
     const StringVec search_indices;  // ft.create commands to re-create search indices
+    uint64_t journal_segment = 0;    // disk journal segment started by the snapshot, if any
   };
 
   // single_shard - true means that we run RdbSaver on a single shard and we do not use
@@ -91,12 +97,20 @@ class RdbSaver {
   // cll allows breaking in the middle.
   void StartSnapshotInShard(bool stream_journal, const Cancellation* cll, EngineShard* shard);
 
-  // Send only the incremental snapshot since start_lsn.
-  void StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn);
+  // Send only the incremental snapshot since start_lsn. If end_lsn is set, the snapshot ends before
+  // it instead of switching to journal streaming.
+  void StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn,
+                                       std::optional<LSN> end_lsn = std::nullopt);
 
   // Stops full-sync serialization for replication in the shard's thread.
   void StopFullSyncInShard(EngineShard* shard);
 
+  // Appends a SnapshotIndex of the records after the epilog. Only for DF snapshot shard files.
+  void EnableIndex();
+
+  // Sets the priority of the snapshots started afterwards.
+  void SetPriority(SavePriority priority);
+
   // Stores auxiliary (meta) values and header_info
   std::error_code SaveHeader(const GlobalData& header_info);
 
@@ -114,6 +128,9 @@ class RdbSaver {
   // Get total size of all rdb serializer buffers and items currently placed in channel
   size_t GetTotalBuffersSize() const;
 
+  // Sum of the peak buffer sizes of the shard snapshots. Must be called after SaveBody.
+  size_t GetPeakBuffersSize() const;
+
   struct SnapshotStats {
     size_t current_keys = 0;
     size_t total_keys = 0;
@@ -153,6 +170,9 @@ class SerializerBase {
   // Dumps `obj` in DUMP command format into `out`. Uses default compression mode.
   static void DumpObject(const CompactObj& obj, io::StringSink* out);
 
+  // Same as DumpObject for a string value that is not held by an object.
+  static void DumpString(std::string_view str, io::StringSink* out);
+
   // Internal buffer size. Might shrink after flush due to compression.
   size_t SerializedLen() const;
 
@@ -162,6 +182,29 @@ class SerializerBase {
   size_t GetBufferCapacity() const;
   virtual size_t GetTempBufferSize() const;
 
+  // Returns true once after a compression dictionary was written, as the blobs after it can not
+  // be loaded without it.
+  bool ConsumeDictionaryWritten() {
+    return std::exchange(dict_written_, false);
+  }
+
+  // Makes the flushes leave the blobs that should be compressed as is, so that the caller can
+  // compress them with CompressRecord on another thread.
+  void OffloadCompression() {
+    offload_compression_ = true;
+  }
+
+  // Returns true once after a flush that left its blob for CompressRecord.
+  bool ConsumeCompressionPending() {
+    return std::exchange(compression_pending_, false);
+  }
+
+  // Replaces a flushed blob with its compressed form, if compressing it pays off, and returns true
+  // if a compression dictionary was written before it. Touches only the compression state, so it
+  // may run on another thread while the serializer is used, but not concurrently with itself.
+  // Blobs must be compressed in the order in which they are loaded.
+  bool CompressRecord(std::string* blob);
+
   std::error_code WriteRaw(const ::io::Bytes& buf);
 
   // Write journal entry as an embedded journal blob.
@@ -186,6 +229,13 @@ class SerializerBase {
   void CompressBlob();
   void AllocateCompressorOnce();
 
+  // Returns the compressed blob or nullopt if compressing it does not pay off.
+  std::optional<io::Bytes> TryCompress(io::Bytes blob);
+
+  // Writes the compressed blob, preceded by the dictionary it was compressed with if it is new.
+  // Returns true if the dictionary was written.
+  bool WriteCompressedBlob(io::Bytes compressed_blob, io::IoBuf* dest);
+
   std::error_code SaveLzfBlob(const ::io::Bytes& src, size_t uncompressed_len);
 
   CompressionMode compression_mode_;
@@ -204,6 +254,9 @@ class SerializerBase {
   base::PODArray<uint8_t> tmp_buf_;
   std::unique_ptr<LZF_HSLOT[]> lzf_;
   size_t number_of_chunks_ = 0;
+  bool dict_written_ = false;
+  bool offload_compression_ = false;
+  bool compression_pending_ = false;
 };
 
 class RdbSerializer : public SerializerBase {
@@ -216,12 +269,22 @@ class RdbSerializer : public SerializerBase {
   std::error_code FlushToSink(io::Sink* s, FlushState flush_state) override;
   std::error_code SelectDb(uint32_t dbid);
 
+  // Sends a RESIZEDB hint with the number of keys and expiries of the db, so that the loader can
+  // presize its tables.
+  std::error_code SendDbSize(DbIndex dbid, size_t keys, size_t expires);
+
   // Must be called in the thread to which `it` belongs.
   // Returns the serialized rdb_type or the error.
   // expire_ms = 0 means no expiry.
   io::Result<uint8_t> SaveEntry(const PrimeKey& pk, const PrimeValue& pv, uint64_t expire_ms,
                                 uint32_t mc_flags, DbIndex dbid);
 
+  // Same as SaveEntry, but for an offloaded value read from disk. blob is either the string or
+  // the container serialized with DumpObject, which is written as is instead of being decoded.
+  io::Result<uint8_t> SaveExternalEntry(const PrimeKey& pk, CompactObjType obj_type,
+                                        std::string_view blob, uint64_t expire_ms,
+                                        bool has_mc_flags, uint32_t mc_flags, DbIndex dbid);
+
   // This would work for either string or an object.
   // The arg pv is taken from it->second if accessing
   // this by finding the key. This function is used
@@ -234,6 +297,10 @@ class RdbSerializer : public SerializerBase {
   size_t GetTempBufferSize() const override;
 
  private:
+  // Writes the expiry, key properties, rdb type and key of an entry.
+  std::error_code SaveEntryHeader(const PrimeKey& pk, bool has_mc_flags, uint64_t expire_ms,
+                                  uint32_t mc_flags, DbIndex dbid, uint8_t rdb_type);
+
   // Might preempt if flush_fun_ is used
   std::error_code SaveObject(const PrimeValue& pv);
   std::error_code SaveListObject(const PrimeValue& pv);
@@ -243,6 +310,10 @@ class RdbSerializer : public SerializerBase {
   std::error_code SaveStreamObject(const PrimeValue& obj);
   std::error_code SaveJsonObject(const PrimeValue& pv);
   std::error_code SaveSBFObject(const PrimeValue& pv);
+  std::error_code SaveTimeSeriesObject(const PrimeValue& pv);
+  std::error_code SaveCMSObject(const PrimeValue& pv);
+  std::error_code SaveTopKObject(const PrimeValue& pv);
+  std::error_code SaveTieredSegment(const PrimeValue& pv);
 
   std::error_code SaveLongLongAsString(int64_t value);
   std::error_code SaveBinaryDouble(double val);
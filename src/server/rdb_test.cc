@@ -11,6 +11,7 @@ extern "C" {
 }
 
 #include <absl/flags/reflection.h>
+#include <absl/time/clock.h>
 #include <mimalloc.h>
 
 #include "base/flags.h"
@@ -33,6 +34,12 @@ using absl::StrCat;
 ABSL_DECLARE_FLAG(int32, list_compress_depth);
 ABSL_DECLARE_FLAG(int32, list_max_listpack_size);
 ABSL_DECLARE_FLAG(dfly::CompressionMode, compression_mode);
+ABSL_DECLARE_FLAG(uint32_t, compression_dict_size);
+ABSL_DECLARE_FLAG(dfly::MemoryBytesFlag, snapshot_buffer_limit);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_compression_threads);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_write_queue_depth);
+ABSL_DECLARE_FLAG(dfly::MemoryBytesFlag, snapshot_write_buffer_size);
+ABSL_DECLARE_FLAG(bool, snapshot_fsync);
 
 namespace dfly {
 
@@ -170,6 +177,61 @@ TEST_F(RdbTest, ComressionModeSaveDragonflyAndReload) {
   }
 }
 
+TEST_F(RdbTest, CompressionDictSaveAndReload) {
+  SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_ZSTD);
+  SetFlag(&FLAGS_compression_dict_size, 1024);
+  serialization_max_chunk_size = 4096;  // compress every blob above it
+  Run({"debug", "populate", "50000", "key", "64"});
+
+  RespExpr resp = Run({"save", "df"});
+  ASSERT_EQ(resp, "OK");
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  resp = Run({"dfly", "load", save_info.file_name});
+  ASSERT_EQ(resp, "OK");
+  EXPECT_EQ(50000, CheckedInt({"dbsize"}));
+
+  serialization_max_chunk_size = 0;
+  SetFlag(&FLAGS_compression_dict_size, 0);
+}
+
+TEST_F(RdbTest, CompressionOffloadSaveAndReload) {
+  SetFlag(&FLAGS_snapshot_compression_threads, 2);
+  SetFlag(&FLAGS_compression_dict_size, 1024);
+  serialization_max_chunk_size = 4096;
+  Run({"debug", "populate", "50000", "key", "64"});
+
+  for (auto mode : {CompressionMode::MULTI_ENTRY_ZSTD, CompressionMode::MULTI_ENTRY_LZ4}) {
+    SetFlag(&FLAGS_compression_mode, mode);
+    ASSERT_EQ(Run({"save", "df"}), "OK");
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    ASSERT_EQ(Run({"dfly", "load", save_info.file_name}), "OK");
+    EXPECT_EQ(50000, CheckedInt({"dbsize"}));
+  }
+
+  serialization_max_chunk_size = 0;
+  SetFlag(&FLAGS_compression_dict_size, 0);
+  SetFlag(&FLAGS_snapshot_compression_threads, 0);
+}
+
+TEST_F(RdbTest, DfsLoadProgress) {
+  Run({"debug", "populate", "200000"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  auto start = absl::Now();
+  ASSERT_EQ(Run({"dfly", "load", save_info.file_name}), "OK");
+  LOG(INFO) << "Loaded 200000 keys in " << absl::Now() - start;
+
+  ASSERT_EQ(200000, CheckedInt({"dbsize"}));
+  auto ls = GetMetrics().loading_stats;
+  EXPECT_GT(ls.load_bytes_total, 0u);
+  EXPECT_EQ(ls.load_bytes_total, ls.load_bytes_read);
+  EXPECT_EQ(shard_set->size() + 1, ls.load_files_total);
+  EXPECT_EQ(ls.load_files_total, ls.load_files_done);
+}
+
 TEST_F(RdbTest, RdbLoaderOnReadCompressedDataShouldNotEnterEnsureReadFlow) {
   SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_ZSTD);
   for (int i = 0; i < 1000; ++i) {
@@ -338,6 +400,54 @@ TEST_F(RdbTest, SaveFlush) {
   EXPECT_EQ(500000, k_v.second);
 }
 
+TEST_F(RdbTest, SaveBufferLimit) {
+  SetFlag(&FLAGS_snapshot_buffer_limit, MemoryBytesFlag{64 << 10});
+  Run({"debug", "populate", "100000", "key", "100"});
+
+  auto resp = Run({"save", "df"});
+  ASSERT_EQ(resp, "OK");
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  EXPECT_GT(save_info.peak_buffers_size, 0u);
+
+  resp = Run({"debug", "reload"});
+  ASSERT_EQ(resp, "OK");
+  EXPECT_EQ(100000, CheckedInt({"dbsize"}));
+  SetFlag(&FLAGS_snapshot_buffer_limit, MemoryBytesFlag{});
+}
+
+TEST_F(RdbTest, SaveQueuedWrites) {
+  SetFlag(&FLAGS_snapshot_write_queue_depth, 4);
+  SetFlag(&FLAGS_snapshot_write_buffer_size, MemoryBytesFlag{64 << 10});
+  SetFlag(&FLAGS_snapshot_fsync, true);
+  Run({"debug", "populate", "100000", "key", "100"});
+
+  auto resp = Run({"save", "df"});
+  ASSERT_EQ(resp, "OK");
+
+  resp = Run({"debug", "reload"});
+  ASSERT_EQ(resp, "OK");
+  EXPECT_EQ(100000, CheckedInt({"dbsize"}));
+
+  SetFlag(&FLAGS_snapshot_write_queue_depth, 0);
+  SetFlag(&FLAGS_snapshot_write_buffer_size, MemoryBytesFlag{1 << 20});
+  SetFlag(&FLAGS_snapshot_fsync, false);
+}
+
+TEST_F(RdbTest, SaveLowPriority) {
+  Run({"debug", "populate", "100000"});
+
+  auto resp = Run({"save", "df", "PRIORITY", "low"});
+  ASSERT_EQ(resp, "OK");
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  EXPECT_GT(save_info.keys_per_sec, 0u);
+
+  resp = Run({"debug", "reload"});
+  ASSERT_EQ(resp, "OK");
+  EXPECT_EQ(100000, CheckedInt({"dbsize"}));
+
+  EXPECT_THAT(Run({"save", "df", "PRIORITY", "high"}), ErrArg("syntax error"));
+}
+
 TEST_F(RdbTest, SaveManyDbs) {
   Run({"debug", "populate", "50000"});
   pp_->at(1)->Await([&] {
@@ -547,6 +657,26 @@ TEST_F(RdbTest, DflyLoadAppend) {
   EXPECT_EQ(Run({"get", "k2"}), "2");
 }
 
+TEST_F(RdbTest, DflyLoadDb) {
+  Run({"debug", "populate", "20000", "a"});
+  pp_->at(1)->Await([&] {
+    Run({"select", "1"});
+    Run({"debug", "populate", "10000", "b"});
+  });
+  EXPECT_EQ(Run({"save", "df"}), "OK");
+  string filename = service_->server_family().GetLastSaveInfo().file_name;
+
+  EXPECT_EQ(Run({"dfly", "load", filename, "db", "1"}), "OK");
+  EXPECT_THAT(Run({"dbsize"}), IntArg(0));
+  pp_->at(1)->Await([&] {
+    Run({"select", "1"});
+    EXPECT_THAT(Run({"dbsize"}), IntArg(10000));
+    EXPECT_EQ(Run({"get", "b:0"}), "value:0");
+  });
+
+  EXPECT_THAT(Run({"dfly", "load", filename, "db", "100"}), ErrArg("invalid DB index"));
+}
+
 // Tests loading a huge set, where the set is loaded in multiple partial reads.
 TEST_F(RdbTest, LoadHugeSet) {
   // Add 2 sets with 100k elements each (note must have more than kMaxBlobLen
@@ -17,6 +17,7 @@ extern "C" {
 #include <absl/strings/escaping.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
+#include <absl/time/clock.h>
 
 #include <boost/asio/ip/tcp.hpp>
 #include <memory>
@@ -28,10 +29,15 @@ extern "C" {
 #include "server/journal/executor.h"
 #include "server/journal/serializer.h"
 #include "server/main_service.h"
+#include "server/namespaces.h"
 #include "server/rdb_load.h"
 #include "strings/human_readable.h"
 
 ABSL_FLAG(int, replication_acks_interval, 1000, "Interval between acks in milliseconds.");
+ABSL_FLAG(uint32_t, replication_acks_coalesce_usec, 1000,
+          "If positive, flows ack the executed journal records as soon as they advance, at most "
+          "once per this many microseconds, so that WAIT on the master returns promptly. "
+          "If 0, flows ack only every 1024 records or replication_acks_interval.");
 ABSL_FLAG(int, master_connect_timeout_ms, 20000,
           "Timeout for establishing connection to a replication master");
 ABSL_FLAG(int, master_reconnect_timeout_ms, 1000,
@@ -53,6 +59,17 @@ ABSL_FLAG(
 ABSL_FLAG(bool, replica_reconnect_on_master_restart, false,
           "Deprecated - please use --break_replication_on_master_restart.");
 
+ABSL_FLAG(uint32_t, replica_apply_batch, 0,
+          "Max number of consecutive single shard journal records a replica flow applies "
+          "together with squashed hops. 0 or 1 apply the records one by one");
+ABSL_FLAG(bool, replication_journal_compression, false,
+          "Ask a dragonfly master to send the stable sync journal stream lz4 compressed");
+ABSL_FLAG(bool, replica_serve_stale_reads, false,
+          "Keep serving the previous dataset while a replica does a full sync, and replace it at "
+          "once when the sync is done. Needs memory for both datasets. Not supported with tiered "
+          "storage or when replicating slot ranges");
+ABSL_DECLARE_FLAG(std::string, tiered_prefix);
+
 namespace dfly {
 
 using namespace std;
@@ -378,6 +395,14 @@ std::error_code Replica::ConfigureDflyMaster() {
       SendCommandAndReadResponse(StrCat("REPLCONF CLIENT-VERSION ", DflyVersion::CURRENT_VER)));
   PC_RETURN_ON_BAD_RESPONSE(CheckRespIsSimpleReply("OK"));
 
+  master_context_.journal_compression = false;
+  if (absl::GetFlag(FLAGS_replication_journal_compression) &&
+      master_context_.version >= DflyVersion::VER5) {
+    RETURN_ON_ERR(SendCommandAndReadResponse("REPLCONF JOURNAL-COMPRESSION lz4"));
+    PC_RETURN_ON_BAD_RESPONSE(CheckRespIsSimpleReply("OK"));
+    master_context_.journal_compression = true;
+  }
+
   return error_code{};
 }
 
@@ -416,17 +441,28 @@ error_code Replica::InitiatePSync() {
 
     io::PrefixSource ps{io_buf.InputBuffer(), Sock()};
 
-    // Set LOADING state.
-    service_.RequestLoadingState();
-    absl::Cleanup cleanup = [this]() { service_.RemoveLoadingState(); };
+    // Set LOADING state, unless the previous dataset keeps serving reads.
+    bool staged = CanServeStaleReads();
+    if (!staged)
+      service_.RequestLoadingState();
+    absl::Cleanup cleanup = [this, staged]() {
+      if (!staged)
+        service_.RemoveLoadingState();
+      staging_ns_.reset();
+    };
 
-    if (slot_range_.has_value()) {
+    // The loaded snapshot is not journaled, so downstream replicas must resync.
+    service_.server_family().GetDflyCmd()->CancelAllReplicas();
+
+    RdbLoader loader(NULL);
+    if (staged) {
+      loader.SetNamespace(StartStagedSync(repl_offs_));
+    } else if (slot_range_.has_value()) {
       JournalExecutor{&service_}.FlushSlots(slot_range_.value());
     } else {
       JournalExecutor{&service_}.FlushAll();
     }
 
-    RdbLoader loader(NULL);
     loader.SetLoadUnownedSlots(true);
     loader.set_source_limit(snapshot_size);
     // TODO: to allow registering callbacks within loader to send '\n' pings back to master.
@@ -455,6 +491,9 @@ error_code Replica::InitiatePSync() {
     CHECK(ps.UnusedPrefix().empty());
     io_buf.ConsumeInput(io_buf.InputLen());
     TouchIoTime();
+
+    if (staged)
+      PublishStagedSync();
   } else {
     LOG(INFO) << "Re-established sync with Redis master with ID=" << id;
   }
@@ -474,6 +513,11 @@ error_code Replica::InitiatePSync() {
 error_code Replica::InitiateDflySync() {
   auto start_time = absl::Now();
 
+  // The offset of the current dataset, which is served if the full sync is staged.
+  uint64_t prev_offset = 0;
+  for (uint64_t offs : GetReplicaOffset())
+    prev_offset += offs;
+
   // Initialize MultiShardExecution.
   multi_shard_exe_.reset(new MultiShardExecution());
 
@@ -504,16 +548,20 @@ error_code Replica::InitiateDflySync() {
   };
   RETURN_ON_ERR(cntx_.SwitchErrorHandler(std::move(err_handler)));
 
-  // Make sure we're in LOADING state.
-  service_.RequestLoadingState();
+  // Make sure we're in LOADING state, unless the previous dataset keeps serving reads.
+  bool serve_stale = CanServeStaleReads();
+  if (!serve_stale)
+    service_.RequestLoadingState();
 
   // Start full sync flows.
   state_mask_.fetch_or(R_SYNCING);
 
-  absl::Cleanup cleanup = [this]() {
+  absl::Cleanup cleanup = [this, serve_stale]() {
     // We do the following operations regardless of outcome.
     JoinDflyFlows();
-    service_.RemoveLoadingState();
+    staging_ns_.reset();
+    if (!serve_stale)
+      service_.RemoveLoadingState();
     state_mask_.fetch_and(~R_SYNCING);
     last_journal_LSNs_.reset();
   };
@@ -545,7 +593,17 @@ error_code Replica::InitiateDflySync() {
         std::accumulate(is_full_sync.get(), is_full_sync.get() + num_df_flows, 0);
 
     if (num_full_flows == num_df_flows) {
-      if (slot_range_.has_value()) {
+      // The full sync is not journaled, so downstream replicas must resync.
+      service_.server_family().GetDflyCmd()->CancelAllReplicas();
+
+      if (serve_stale) {
+        Namespace* ns = StartStagedSync(prev_offset);
+        auto set_ns_cb = [&](unsigned index, auto*) {
+          for (auto id : thread_flow_map_[index])
+            shard_flows_[id]->SetLoadNamespace(ns);
+        };
+        shard_set->pool()->AwaitFiberOnAll(std::move(set_ns_cb));
+      } else if (slot_range_.has_value()) {
         JournalExecutor{&service_}.FlushSlots(slot_range_.value());
       } else {
         JournalExecutor{&service_}.FlushAll();
@@ -577,13 +635,22 @@ error_code Replica::InitiateDflySync() {
   if (cntx_.IsCancelled())
     return cntx_.GetError();
 
-  RdbLoader::PerformPostLoad(&service_);
+  if (!staging_ns_)
+    RdbLoader::PerformPostLoad(&service_);
 
   // Send DFLY STARTSTABLE.
   if (auto ec = SendNextPhaseRequest("STARTSTABLE"); ec) {
     return cntx_.ReportError(ec);
   }
 
+  if (staging_ns_) {
+    // The flows apply the changes that precede the stable sync to the staged dataset until they
+    // read the eof token, so it is complete only once they finish.
+    JoinDflyFlows();
+    RETURN_ON_ERR(cntx_.GetError());
+    PublishStagedSync();
+  }
+
   // Joining flows and resetting state is done by cleanup.
   double seconds = double(absl::ToInt64Milliseconds(absl::Now() - start_time)) / 1000;
   LOG(INFO) << sync_type << " sync finished in " << strings::HumanReadableElapsedTime(seconds);
@@ -705,6 +772,27 @@ error_code Replica::ConsumeDflyStream() {
   return cntx_.GetError();
 }
 
+bool Replica::CanServeStaleReads() const {
+  // Tiered storage offloads the values of the default namespace only.
+  return GetFlag(FLAGS_replica_serve_stale_reads) && !slot_range_.has_value() &&
+         GetFlag(FLAGS_tiered_prefix).empty();
+}
+
+Namespace* Replica::StartStagedSync(uint64_t repl_offset) {
+  DCHECK(!staging_ns_);
+  staging_ns_ = make_unique<Namespace>();
+  stale_repl_offset_ = repl_offset;
+  LOG(INFO) << "Serving the dataset at offset " << repl_offset << " during the full sync";
+  return staging_ns_.get();
+}
+
+void Replica::PublishStagedSync() {
+  service_.server_family().ReplaceDataset(staging_ns_.get());
+  staging_ns_.reset();  // its slices handed the replaced tables to the background freer.
+  RdbLoader::PerformPostLoad(&service_);
+  LOG(INFO) << "Replaced the stale dataset with the full sync";
+}
+
 void Replica::JoinDflyFlows() {
   for (auto& flow : shard_flows_) {
     flow->JoinFlow();
@@ -852,12 +940,23 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
 
   io::PrefixSource ps{prefix, Sock()};
 
-  JournalReader reader{&ps, 0};
+  // Compressed streams are framed, so records are decoded from the decompressed frames.
+  JournalFrameSource frame_source{&ps, &journal_raw_bytes_, &journal_wire_bytes_};
+  io::Source* source = &ps;
+  if (master_context_.journal_compression)
+    source = &frame_source;
+
+  JournalReader reader{source, 0};
   DCHECK_GE(journal_rec_executed_, 1u);
   TransactionReader tx_reader{journal_rec_executed_.load(std::memory_order_relaxed) - 1};
 
   acks_fb_ = fb2::Fiber("shard_acks", &DflyShardReplica::StableSyncDflyAcksFb, this, cntx);
 
+  // Records that are already buffered are collected into a batch, so that they are applied with
+  // squashed hops instead of one hop per record. We never wait for more data while holding one.
+  size_t batch_limit = absl::GetFlag(FLAGS_replica_apply_batch);
+  vector<TransactionData> batch;
+
   while (!cntx->IsCancelled()) {
     auto tx_data = tx_reader.NextTxData(&reader, cntx);
     if (!tx_data)
@@ -866,8 +965,26 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
     DVLOG(3) << "Lsn: " << tx_data->lsn;
 
     last_io_time_ = Proactor()->GetMonotonicTimeNs();
+    bool batchable = batch_limit > 1 && !tx_data->IsGlobalCmd() &&
+                     (batch.empty() || batch.front().dbid == tx_data->dbid) &&
+                     (tx_data->opcode == journal::Op::COMMAND ||
+                      tx_data->opcode == journal::Op::EXPIRED);
+    if (batchable) {
+      batch.push_back(std::move(*tx_data));
+      if (batch.size() >= batch_limit || !reader.HasBufferedData())
+        ExecuteBatch(&batch, cntx);
+      continue;
+    }
+
+    if (!batch.empty())
+      ExecuteBatch(&batch, cntx);
+
     if (tx_data->opcode == journal::Op::LSN) {
-      //  Do nothing
+      if (tx_data->lsn_time_ms) {
+        uint64_t now_ms = absl::GetCurrentTimeNanos() / 1000000;
+        apply_lag_ms_.store(now_ms - min(now_ms, tx_data->lsn_time_ms), memory_order_relaxed);
+        has_apply_lag_.store(true, memory_order_relaxed);
+      }
     } else if (tx_data->opcode == journal::Op::PING) {
       force_ping_ = true;
       journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
@@ -905,9 +1022,11 @@ void Replica::RedisStreamAcksFb() {
 void DflyShardReplica::StableSyncDflyAcksFb(Context* cntx) {
   DCHECK_EQ(proactor_index_, ProactorBase::me()->GetPoolIndex());
 
-  constexpr size_t kAckRecordMaxInterval = 1024;
   std::chrono::duration ack_time_max_interval =
       1ms * absl::GetFlag(FLAGS_replication_acks_interval);
+  std::chrono::microseconds coalesce_interval{
+      absl::GetFlag(FLAGS_replication_acks_coalesce_usec)};
+  size_t ack_record_interval = coalesce_interval.count() > 0 ? 0 : 1024;
   std::string ack_cmd;
   auto next_ack_tp = std::chrono::steady_clock::now();
 
@@ -919,7 +1038,8 @@ void DflyShardReplica::StableSyncDflyAcksFb(Context* cntx) {
     VLOG(1) << "Sending an ACK with offset=" << current_offset << " forced=" << force_ping_;
     ack_cmd = absl::StrCat("REPLCONF ACK ", current_offset);
     force_ping_ = false;
-    next_ack_tp = std::chrono::steady_clock::now() + ack_time_max_interval;
+    auto ack_tp = std::chrono::steady_clock::now();
+    next_ack_tp = ack_tp + ack_time_max_interval;
     if (auto ec = SendCommand(ack_cmd); ec) {
       cntx->ReportError(ec);
       break;
@@ -929,10 +1049,17 @@ void DflyShardReplica::StableSyncDflyAcksFb(Context* cntx) {
     shard_replica_waker_.await_until(
         [&]() {
           return journal_rec_executed_.load(std::memory_order_relaxed) >
-                     ack_offs_ + kAckRecordMaxInterval ||
+                     ack_offs_ + ack_record_interval ||
                  force_ping_ || cntx->IsCancelled();
         },
         next_ack_tp);
+
+    // Records executed in a burst are acked together once the coalescing interval passes, so a
+    // busy flow sends a bounded number of acks while an idle one acks its last records at once.
+    if (coalesce_interval.count() > 0) {
+      shard_replica_waker_.await_until([&]() { return force_ping_ || cntx->IsCancelled(); },
+                                       ack_tp + coalesce_interval);
+    }
   }
 }
 
@@ -953,6 +1080,23 @@ DflyShardReplica::~DflyShardReplica() {
   JoinFlow();
 }
 
+void DflyShardReplica::ExecuteBatch(std::vector<TransactionData>* batch, Context* cntx) {
+  if (!cntx->IsCancelled()) {
+    vector<CmdArgList> cmds(batch->size());
+    for (size_t i = 0; i < batch->size(); ++i) {
+      auto& args = (*batch)[i].command.cmd_args;
+      cmds[i] = CmdArgList{args.data(), args.size()};
+    }
+
+    VLOG(3) << "Execute batch of " << cmds.size() << " records";
+    executor_->ExecuteBatch(batch->front().dbid, absl::MakeSpan(cmds));
+  }
+
+  journal_rec_executed_.fetch_add(batch->size(), std::memory_order_relaxed);
+  batch->clear();
+  shard_replica_waker_.notifyAll();
+}
+
 void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
   if (cntx->IsCancelled()) {
     return;
@@ -1107,6 +1251,18 @@ auto Replica::GetSummary() const -> Summary {
     for (uint64_t offs : GetReplicaOffset()) {
       res.repl_offset_sum += offs;
     }
+    if (master_context_.journal_compression) {
+      res.flow_compression_ratios.resize(shard_flows_.size());
+      for (const auto& flow : shard_flows_)
+        res.flow_compression_ratios[flow->FlowId()] = flow->JournalCompressionRatio();
+    }
+    if (!shard_flows_.empty() && shard_flows_.front()->HasApplyLag()) {
+      res.flow_lag_ms.resize(shard_flows_.size());
+      for (const auto& flow : shard_flows_)
+        res.flow_lag_ms[flow->FlowId()] = flow->ApplyLagMs();
+    }
+    if (staging_ns_)
+      res.stale_repl_offset = stale_repl_offset_;
     return res;
   };
 
@@ -1141,6 +1297,13 @@ std::string Replica::GetSyncId() const {
   return master_context_.dfly_session_id;
 }
 
+double DflyShardReplica::JournalCompressionRatio() const {
+  uint64_t wire_bytes = journal_wire_bytes_.load(std::memory_order_relaxed);
+  if (wire_bytes == 0)
+    return 1;
+  return double(journal_raw_bytes_.load(std::memory_order_relaxed)) / wire_bytes;
+}
+
 uint32_t DflyShardReplica::FlowId() const {
   return flow_id_;
 }
@@ -1151,6 +1314,11 @@ void DflyShardReplica::Pause(bool pause) {
   }
 }
 
+void DflyShardReplica::SetLoadNamespace(Namespace* ns) {
+  DCHECK_EQ(proactor_index_, ProactorBase::me()->GetPoolIndex());
+  rdb_loader_->SetNamespace(ns);
+}
+
 void DflyShardReplica::JoinFlow() {
   sync_fb_.JoinIfNeeded();
   acks_fb_.JoinIfNeeded();
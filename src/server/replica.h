@@ -27,6 +27,7 @@ class ConnectionContext;
 class JournalExecutor;
 struct JournalReader;
 class DflyShardReplica;
+class Namespace;
 
 // The attributes of the master we are connecting to.
 struct MasterContext {
@@ -34,6 +35,7 @@ struct MasterContext {
   std::string dfly_session_id;  // Sync session id for dfly sync.
   unsigned num_flows = 0;
   DflyVersion version = DflyVersion::VER1;
+  bool journal_compression = false;  // stable sync journal stream is lz4 framed
 };
 
 // This class manages replication from both Dragonfly and Redis masters.
@@ -94,6 +96,17 @@ class Replica : ProtocolClient {
   void JoinDflyFlows();
   void SetShardStates(bool replica);  // Call SetReplica(replica) on all shards.
 
+  // Returns true if replica_serve_stale_reads is set and a full sync can be staged, so that the
+  // previous dataset keeps serving reads until the new one is loaded.
+  bool CanServeStaleReads() const;
+
+  // Starts a full sync into a staging namespace while the dataset that was replicated up to
+  // repl_offset is served. Returns the staging namespace.
+  Namespace* StartStagedSync(uint64_t repl_offset);
+
+  // Replaces the dataset with the staged one and ends the staged sync.
+  void PublishStagedSync();
+
   // Send DFLY ${kind} to the master instance.
   std::error_code SendNextPhaseRequest(std::string_view kind);
 
@@ -120,6 +133,15 @@ class Replica : ProtocolClient {
 
     // sum of the offsets on all the flows.
     uint64_t repl_offset_sum;
+
+    // raw to wire bytes of the journal stream per flow, empty if it's not compressed.
+    std::vector<double> flow_compression_ratios;
+
+    // apply lag of the flows in ms, empty if the master does not send its time.
+    std::vector<uint64_t> flow_lag_ms;
+
+    // set while a full sync is staged, to the offset of the stale dataset that is served.
+    std::optional<uint64_t> stale_repl_offset;
   };
 
   Summary GetSummary() const;  // thread-safe, blocks fiber, makes a hop.
@@ -162,6 +184,10 @@ class Replica : ProtocolClient {
 
   std::optional<cluster::SlotRange> slot_range_;
 
+  // The dataset of a staged full sync and the offset of the stale one that is served meanwhile.
+  std::unique_ptr<Namespace> staging_ns_;
+  uint64_t stale_repl_offset_ = 0;
+
   uint32_t reconnect_count_ = 0;
 };
 
@@ -195,15 +221,35 @@ class DflyShardReplica : public ProtocolClient {
 
   void ExecuteTx(TransactionData&& tx_data, Context* cntx);
 
+  // Execute collected single shard records with squashed hops and clear the batch.
+  void ExecuteBatch(std::vector<TransactionData>* batch, Context* cntx);
+
   uint32_t FlowId() const;
 
   uint64_t JournalExecutedCount() const {
     return journal_rec_executed_.load(std::memory_order_relaxed);
   }
 
+  // Ratio of decompressed to received journal bytes. Can be called from any thread.
+  double JournalCompressionRatio() const;
+
+  // Time from the master writing the last received LSN marker until all records before it were
+  // applied. Depends on the clocks of both instances being in sync. Can be called from any thread.
+  uint64_t ApplyLagMs() const {
+    return apply_lag_ms_.load(std::memory_order_relaxed);
+  }
+
+  bool HasApplyLag() const {
+    return has_apply_lag_.load(std::memory_order_relaxed);
+  }
+
   // Can be called from any thread.
   void Pause(bool pause);
 
+  // Loads the full sync into the given namespace. Must be called on the thread of the flow
+  // before the master starts sending the snapshot.
+  void SetLoadNamespace(Namespace* ns);
+
  private:
   Service& service_;
   MasterContext master_context_;
@@ -225,6 +271,12 @@ class DflyShardReplica : public ProtocolClient {
   // Atomic, because JournalExecutedCount() can be called from any thread.
   std::atomic_uint64_t journal_rec_executed_ = 0;
 
+  // Decompressed and received bytes of a compressed journal stream.
+  std::atomic_size_t journal_raw_bytes_ = 0, journal_wire_bytes_ = 0;
+
+  std::atomic_uint64_t apply_lag_ms_ = 0;
+  std::atomic_bool has_apply_lag_ = false;  // set once an LSN marker with the master time arrived
+
   util::fb2::Fiber sync_fb_, acks_fb_;
   size_t ack_offs_ = 0;
   int proactor_index_ = -1;
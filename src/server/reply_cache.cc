@@ -0,0 +1,161 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/reply_cache.h"
+
+#include <absl/strings/str_cat.h>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "facade/reply_capture.h"
+#include "server/common.h"
+#include "server/server_state.h"
+
+ABSL_FLAG(dfly::MemoryBytesFlag, reply_cache_max_memory, dfly::MemoryBytesFlag{},
+          "Max memory per shard of the serialized replies of HGETALL, HKEYS, HVALS and JSON.GET "
+          "that are cached for the keys that did not change since. 0 disables the cache.");
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Approximate size of the bookkeeping of a key in the table and the lru list.
+constexpr size_t kEntryOverhead = 128;
+
+inline uint8_t ReplyId(ReplyCache::Kind kind, bool resp3) {
+  return (uint8_t(kind) << 1) | resp3;
+}
+
+}  // namespace
+
+ReplyCache::ReplyCache() : lru_{16, PMR_NS::get_default_resource()} {
+}
+
+bool ReplyCache::IsEnabled(facade::SinkReplyBuilder* builder) {
+  return absl::GetFlag(FLAGS_reply_cache_max_memory).value > 0 &&
+         dynamic_cast<facade::CapturingReplyBuilder*>(builder) == nullptr;
+}
+
+auto ReplyCache::Get(DbIndex db, string_view key, Kind kind, bool resp3, uint64_t version)
+    -> Reply {
+  auto& stats = ServerState::tlocal()->stats;
+  if (entries_.empty()) {
+    ++stats.reply_cache_misses;
+    return nullptr;
+  }
+
+  CacheKey cache_key{db, string{key}};
+  auto it = entries_.find(cache_key);
+  if (it == entries_.end()) {
+    ++stats.reply_cache_misses;
+    return nullptr;
+  }
+
+  // The bucket changed, so the key may have changed as well.
+  if (it->second.version != version) {
+    Erase(cache_key);
+    ++stats.reply_cache_misses;
+    return nullptr;
+  }
+
+  uint8_t id = ReplyId(kind, resp3);
+  for (const auto& [reply_id, reply] : it->second.replies) {
+    if (reply_id == id) {
+      lru_.Put(cache_key);
+      ++stats.reply_cache_hits;
+      return reply;
+    }
+  }
+  ++stats.reply_cache_misses;
+  return nullptr;
+}
+
+void ReplyCache::Put(DbIndex db, string_view key, Kind kind, bool resp3, uint64_t version,
+                     Reply reply) {
+  size_t max_memory = absl::GetFlag(FLAGS_reply_cache_max_memory).value;
+  size_t reply_bytes = reply->capacity() + kEntryOverhead;
+  if (reply_bytes + key.size() * 2 > max_memory)
+    return;
+
+  CacheKey cache_key{db, string{key}};
+  auto [it, inserted] = entries_.try_emplace(cache_key);
+  Entry& entry = it->second;
+  size_t bytes_before = entry.bytes;
+  if (inserted) {
+    entry.bytes = key.size() * 2;  // in the table and in the lru list.
+  } else if (entry.version != version) {
+    // The replies of older versions are stale.
+    for (const auto& id_reply : entry.replies)
+      entry.bytes -= id_reply.second->capacity() + kEntryOverhead;
+    entry.replies.clear();
+  }
+
+  entry.version = version;
+  uint8_t id = ReplyId(kind, resp3);
+  auto reply_it = find_if(entry.replies.begin(), entry.replies.end(),
+                          [id](const auto& id_reply) { return id_reply.first == id; });
+  if (reply_it == entry.replies.end()) {
+    entry.replies.emplace_back(id, std::move(reply));
+    entry.bytes += reply_bytes;
+  } else {
+    entry.bytes += reply_bytes - (reply_it->second->capacity() + kEntryOverhead);
+    reply_it->second = std::move(reply);
+  }
+  bytes_ += entry.bytes - bytes_before;
+  lru_.Put(cache_key);
+
+  while (bytes_ > max_memory) {
+    optional<CacheKey> tail = lru_.GetTail();
+    DCHECK(tail);
+    Erase(*tail);
+  }
+}
+
+void ReplyCache::Clear(DbIndex db) {
+  vector<CacheKey> keys;
+  for (const auto& [cache_key, entry] : entries_) {
+    if (cache_key.first == db)
+      keys.push_back(cache_key);
+  }
+  for (const CacheKey& cache_key : keys)
+    Erase(cache_key);
+}
+
+void ReplyCache::Erase(const CacheKey& cache_key) {
+  auto it = entries_.find(cache_key);
+  if (it == entries_.end())
+    return;
+
+  bytes_ -= it->second.bytes;
+  entries_.erase(it);
+  lru_.Remove(cache_key);
+}
+
+string SerializeStringArr(absl::Span<const string> arr, bool is_map, bool resp3) {
+  size_t len = arr.size();
+  char type = '*';
+  if (is_map && resp3) {
+    type = '%';
+    len /= 2;  // each key value pair counts as one.
+  }
+
+  size_t size = 32;
+  for (const string& str : arr)
+    size += str.size() + 16;
+
+  string res;
+  res.reserve(size);
+  absl::StrAppend(&res, string_view(&type, 1), len, "\r\n");
+  for (const string& str : arr)
+    absl::StrAppend(&res, "$", str.size(), "\r\n", str, "\r\n");
+  return res;
+}
+
+string SerializeBulkString(string_view str) {
+  return absl::StrCat("$", str.size(), "\r\n", str, "\r\n");
+}
+
+}  // namespace dfly
@@ -0,0 +1,94 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/types/span.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/lru.h"
+#include "server/tx_base.h"
+
+namespace facade {
+class SinkReplyBuilder;
+}  // namespace facade
+
+namespace dfly {
+
+// Serialized replies of reads of keys that rarely change, like HGETALL of a static hash or
+// JSON.GET of a configuration document, so that hot reads send the cached RESP buffer instead of
+// serializing the value again. Each shard owns a cache bounded by reply_cache_max_memory that
+// evicts the least recently used keys.
+// A reply is cached together with the version of the bucket of its key, which every write to the
+// bucket advances, and is served only while the version is unchanged. Writes and deletions of a
+// key also drop its replies right away to release their memory.
+class ReplyCache {
+  ReplyCache(const ReplyCache&) = delete;
+  ReplyCache& operator=(const ReplyCache&) = delete;
+
+ public:
+  // Reads whose replies are cached.
+  enum Kind : uint8_t { kHGetAll, kHKeys, kHVals, kJsonGet };
+
+  using Reply = std::shared_ptr<const std::string>;
+
+  ReplyCache();
+
+  // Returns true if reply_cache_max_memory enables the cache and the builder can send serialized
+  // replies, which the capturing builders of squashed pipelines and the HTTP API can not.
+  static bool IsEnabled(facade::SinkReplyBuilder* builder);
+
+  // Returns the reply of the read of the key if it was cached at the given bucket version.
+  // The reply depends on the protocol version, so resp3 is a part of its identity.
+  Reply Get(DbIndex db, std::string_view key, Kind kind, bool resp3, uint64_t version);
+
+  // Caches the reply of the read of the key at the given bucket version and evicts the least
+  // recently used keys to stay within reply_cache_max_memory.
+  void Put(DbIndex db, std::string_view key, Kind kind, bool resp3, uint64_t version, Reply reply);
+
+  // Drops the replies of the key.
+  void Invalidate(DbIndex db, std::string_view key) {
+    if (!entries_.empty())
+      Erase(CacheKey{db, std::string{key}});
+  }
+
+  // Drops the replies of all the keys of the database.
+  void Clear(DbIndex db);
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  size_t MallocUsed() const {
+    return bytes_;
+  }
+
+ private:
+  using CacheKey = std::pair<DbIndex, std::string>;
+
+  struct Entry {
+    uint64_t version = 0;
+    size_t bytes = 0;
+    std::vector<std::pair<uint8_t, Reply>> replies;  // by kind and protocol version.
+  };
+
+  void Erase(const CacheKey& key);
+
+  absl::flat_hash_map<CacheKey, Entry> entries_;
+  Lru<CacheKey> lru_;
+  size_t bytes_ = 0;
+};
+
+// Serializes an array of bulk strings, or a map of alternating keys and values, like
+// RedisReplyBuilder::SendStringArr.
+std::string SerializeStringArr(absl::Span<const std::string> arr, bool is_map, bool resp3);
+
+std::string SerializeBulkString(std::string_view str);
+
+}  // namespace dfly
@@ -89,6 +89,13 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
         "   Lists loaded scripts.",
         "LATENCY",
         "   Prints latency histograms in usec for every called function.",
+        "STATS",
+        "   Prints the number of calls, their total and max time in usec, the time spent in",
+        "   redis.call and in lua code, the number of commands, hops and shards of every called",
+        "   function.",
+        "PROFILE",
+        "   Prints the lua stack samples of running scripts in the folded format of flamegraph",
+        "   tools. Stacks are sampled with the lua_profile_sampling_period flag.",
         "GC",
         "   Invokes garbage collection on all unused interpreter instances.",
         "HELP",
@@ -109,6 +116,12 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
   if (subcmd == "LATENCY")
     return LatencyCmd(cntx);
 
+  if (subcmd == "STATS")
+    return StatsCmd(cntx);
+
+  if (subcmd == "PROFILE")
+    return ProfileCmd(cntx);
+
   if (subcmd == "LOAD" && args.size() == 2)
     return LoadCmd(args, cntx);
 
@@ -218,6 +231,59 @@ void ScriptMgr::LatencyCmd(ConnectionContext* cntx) const {
   }
 }
 
+void ScriptMgr::StatsCmd(ConnectionContext* cntx) const {
+  absl::flat_hash_map<std::string, ServerState::ScriptStats> result;
+  fb2::Mutex mu;
+
+  shard_set->pool()->AwaitFiberOnAll([&](auto* pb) {
+    auto* ss = ServerState::tlocal();
+    lock_guard lk{mu};
+    for (const auto& [sha, stats] : ss->script_stats())
+      result[sha] += stats;
+  });
+
+  auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(result.size());
+  for (const auto& [sha, stats] : result) {
+    const pair<string_view, uint64_t> fields[] = {
+        {"calls", stats.calls},
+        {"total_usec", stats.total_usec},
+        {"max_usec", stats.max_usec},
+        {"redis_call_usec", stats.redis_call_usec},
+        {"lua_usec", stats.lua_usec()},
+        {"redis_calls", stats.redis_calls},
+        {"hops", stats.hops},
+        {"shards", stats.shards},
+    };
+
+    rb->StartArray(2);
+    rb->SendBulkString(sha);
+    rb->StartCollection(std::size(fields), RedisReplyBuilder::MAP);
+    for (const auto& [name, value] : fields) {
+      rb->SendBulkString(name);
+      rb->SendLong(value);
+    }
+  }
+}
+
+void ScriptMgr::ProfileCmd(ConnectionContext* cntx) const {
+  absl::flat_hash_map<std::string, uint64_t> samples;
+  fb2::Mutex mu;
+
+  shard_set->pool()->AwaitFiberOnAll([&](auto* pb) {
+    lock_guard lk{mu};
+    for (const auto& [stack, count] : Interpreter::tl_stack_samples())
+      samples[stack] += count;
+  });
+
+  string folded;
+  for (const auto& [stack, count] : samples)
+    absl::StrAppend(&folded, stack, " ", count, "\n");
+
+  auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->SendVerbatimString(folded);
+}
+
 void ScriptMgr::GCCmd(ConnectionContext* cntx) const {
   auto cb = [](Interpreter* ir) {
     ir->RunGC();
@@ -338,6 +404,7 @@ void ScriptMgr::FlushAllScript() {
     ServerState* ss = ServerState::tlocal();
     ss->ResetInterpreter();
   });
+  Interpreter::ClearBytecodeCache();
 }
 
 vector<pair<string, ScriptMgr::ScriptData>> ScriptMgr::GetAll() const {
@@ -67,6 +67,8 @@ class ScriptMgr {
   void ConfigCmd(CmdArgList args, ConnectionContext* cntx);
   void ListCmd(ConnectionContext* cntx) const;
   void LatencyCmd(ConnectionContext* cntx) const;
+  void StatsCmd(ConnectionContext* cntx) const;
+  void ProfileCmd(ConnectionContext* cntx) const;
   void GCCmd(ConnectionContext* cntx) const;
 
   void UpdateScriptCaches(ScriptKey sha, ScriptParams params) const;
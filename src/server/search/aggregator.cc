@@ -10,97 +10,129 @@ namespace dfly::aggregate {
 
 namespace {
 
-struct GroupStep {
-  PipelineResult operator()(std::vector<DocValues> values) {
-    // Separate items into groups
-    absl::flat_hash_map<absl::FixedArray<Value>, std::vector<DocValues>> groups;
-    for (auto& value : values) {
-      groups[Extract(value)].push_back(std::move(value));
-    }
-
-    // Restore DocValues and apply reducers
-    std::vector<DocValues> out;
-    while (!groups.empty()) {
-      auto node = groups.extract(groups.begin());
-      DocValues doc = Unpack(std::move(node.key()));
-      for (auto& reducer : reducers_) {
-        doc[reducer.result_field] = reducer.func({reducer.source_field, node.mapped()});
-      }
-      out.push_back(std::move(doc));
-    }
-    return out;
-  }
-
-  absl::FixedArray<Value> Extract(const DocValues& dv) {
-    absl::FixedArray<Value> out(fields_.size());
-    for (size_t i = 0; i < fields_.size(); i++) {
-      auto it = dv.find(fields_[i]);
-      out[i] = (it != dv.end()) ? it->second : Value{};
-    }
-    return out;
-  }
+const Value kEmptyValue = Value{};
 
-  DocValues Unpack(absl::FixedArray<Value>&& values) {
-    DCHECK_EQ(values.size(), fields_.size());
-    DocValues out;
-    for (size_t i = 0; i < fields_.size(); i++)
-      out[fields_[i]] = std::move(values[i]);
-    return out;
+absl::FixedArray<Value> ExtractGroup(absl::Span<const std::string> fields, const DocValues& dv) {
+  absl::FixedArray<Value> out(fields.size());
+  for (size_t i = 0; i < fields.size(); i++) {
+    auto it = dv.find(fields[i]);
+    out[i] = (it != dv.end()) ? it->second : Value{};
   }
+  return out;
+}
 
-  std::vector<std::string> fields_;
-  std::vector<Reducer> reducers_;
-};
-
-const Value kEmptyValue = Value{};
+DocValues UnpackGroup(absl::Span<const std::string> fields, absl::FixedArray<Value>&& values) {
+  DCHECK_EQ(values.size(), fields.size());
+  DocValues out;
+  for (size_t i = 0; i < fields.size(); i++)
+    out[fields[i]] = std::move(values[i]);
+  return out;
+}
 
 }  // namespace
 
-const Value& ValueIterator::operator*() const {
-  auto it = values_.front().find(field_);
-  return it == values_.front().end() ? kEmptyValue : it->second;
+void ReducerState::Add(ReducerFunc func, const Value& value) {
+  count++;
+  AddValue(func, value);
 }
 
-ValueIterator& ValueIterator::operator++() {
-  values_.remove_prefix(1);
-  return *this;
+void ReducerState::AddValue(ReducerFunc func, const Value& value) {
+  switch (func) {
+    case ReducerFunc::COUNT:
+      break;
+    case ReducerFunc::COUNT_DISTINCT:
+      distinct.insert(value);
+      break;
+    case ReducerFunc::SUM:
+    case ReducerFunc::AVG:
+      sum += std::holds_alternative<double>(value) ? std::get<double>(value) : 0.0;
+      break;
+    case ReducerFunc::MAX:
+      if (!extremum || *extremum < value)
+        extremum = value;
+      break;
+    case ReducerFunc::MIN:
+      if (!extremum || value < *extremum)
+        extremum = value;
+      break;
+  }
 }
 
-Reducer::Func FindReducerFunc(ReducerFunc name) {
-  const static auto kCountReducer = [](ValueIterator it) -> double {
-    return std::distance(it, it.end());
-  };
-
-  const static auto kSumReducer = [](ValueIterator it) -> double {
-    double sum = 0;
-    for (; it != it.end(); ++it)
-      sum += std::holds_alternative<double>(*it) ? std::get<double>(*it) : 0.0;
-    return sum;
-  };
+void ReducerState::Merge(ReducerFunc func, ReducerState&& other) {
+  count += other.count;
+  sum += other.sum;
+  distinct.merge(other.distinct);
+  if (other.extremum)
+    AddValue(func, *other.extremum);
+}
 
-  switch (name) {
+Value ReducerState::Result(ReducerFunc func) const {
+  switch (func) {
     case ReducerFunc::COUNT:
-      return [](ValueIterator it) -> Value { return kCountReducer(it); };
+      return count;
     case ReducerFunc::COUNT_DISTINCT:
-      return [](ValueIterator it) -> Value {
-        return double(std::unordered_set<Value>(it, it.end()).size());
-      };
+      return double(distinct.size());
     case ReducerFunc::SUM:
-      return [](ValueIterator it) -> Value { return kSumReducer(it); };
+      return sum;
     case ReducerFunc::AVG:
-      return [](ValueIterator it) -> Value { return kSumReducer(it) / kCountReducer(it); };
+      return sum / count;
     case ReducerFunc::MAX:
-      return [](ValueIterator it) -> Value { return *std::max_element(it, it.end()); };
     case ReducerFunc::MIN:
-      return [](ValueIterator it) -> Value { return *std::min_element(it, it.end()); };
+      return extremum.value_or(kEmptyValue);
   }
+  return kEmptyValue;
+}
 
-  return nullptr;
+void ReduceGroups(const GroupParams& params, absl::Span<const DocValues> docs,
+                  GroupStates* states) {
+  for (const auto& doc : docs) {
+    auto [it, inserted] = states->try_emplace(ExtractGroup(params.fields, doc));
+    if (inserted)
+      it->second.resize(params.reducers.size());
+
+    for (size_t i = 0; i < params.reducers.size(); i++) {
+      const Reducer& reducer = params.reducers[i];
+      auto value_it = doc.find(reducer.source_field);
+      it->second[i].Add(reducer.func, value_it != doc.end() ? value_it->second : kEmptyValue);
+    }
+  }
+}
+
+void MergeGroups(const GroupParams& params, GroupStates other, GroupStates* states) {
+  while (!other.empty()) {
+    auto node = other.extract(other.begin());
+    auto [it, inserted] = states->try_emplace(std::move(node.key()));
+    if (inserted) {
+      it->second = std::move(node.mapped());
+      continue;
+    }
+
+    for (size_t i = 0; i < params.reducers.size(); i++)
+      it->second[i].Merge(params.reducers[i].func, std::move(node.mapped()[i]));
+  }
+}
+
+std::vector<DocValues> FinalizeGroups(const GroupParams& params, GroupStates states) {
+  std::vector<DocValues> out;
+  out.reserve(states.size());
+  while (!states.empty()) {
+    auto node = states.extract(states.begin());
+    DocValues doc = UnpackGroup(params.fields, std::move(node.key()));
+    for (size_t i = 0; i < params.reducers.size(); i++)
+      doc[params.reducers[i].result_field] = node.mapped()[i].Result(params.reducers[i].func);
+    out.push_back(std::move(doc));
+  }
+  return out;
 }
 
 PipelineStep MakeGroupStep(absl::Span<const std::string_view> fields,
                            std::vector<Reducer> reducers) {
-  return GroupStep{std::vector<std::string>(fields.begin(), fields.end()), std::move(reducers)};
+  GroupParams params{std::vector<std::string>(fields.begin(), fields.end()), std::move(reducers)};
+  return [params = std::move(params)](std::vector<DocValues> values) -> PipelineResult {
+    GroupStates states;
+    ReduceGroups(params, values, &states);
+    return FinalizeGroups(params, std::move(states));
+  };
 }
 
 PipelineStep MakeSortStep(std::string_view field, bool descending) {
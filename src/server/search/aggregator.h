@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <absl/container/fixed_array.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/types/span.h>
 
+#include <optional>
 #include <string>
 #include <variant>
 
@@ -24,52 +27,46 @@ using DocValues = absl::flat_hash_map<std::string, Value>;  // documents sent th
 using PipelineResult = io::Result<std::vector<DocValues>, facade::ErrorReply>;
 using PipelineStep = std::function<PipelineResult(std::vector<DocValues>)>;  // Group, Sort, etc.
 
-// Iterator over Span<DocValues> that yields doc[field] or monostate if not present.
-// Extra clumsy for STL compatibility!
-struct ValueIterator {
-  using iterator_category = std::forward_iterator_tag;
-  using difference_type = std::ptrdiff_t;
-  using value_type = const Value;
-  using pointer = const Value*;
-  using reference = const Value&;
-
-  ValueIterator(std::string_view field, absl::Span<const DocValues> values)
-      : field_{field}, values_{values} {
-  }
-
-  const Value& operator*() const;
-
-  ValueIterator& operator++();
-
-  bool operator==(const ValueIterator& other) const {
-    return values_.size() == other.values_.size();
-  }
+enum class ReducerFunc { COUNT, COUNT_DISTINCT, SUM, AVG, MAX, MIN };
 
-  bool operator!=(const ValueIterator& other) const {
-    return !operator==(other);
-  }
+struct Reducer {
+  std::string source_field, result_field;
+  ReducerFunc func;
+};
 
-  static ValueIterator end() {
-    return ValueIterator{};
-  }
+// State of a reducer over a part of the documents of a group. States of the same group computed
+// on different shards are merged before the result is taken.
+struct ReducerState {
+  void Add(ReducerFunc func, const Value& value);
+  void Merge(ReducerFunc func, ReducerState&& other);
+  Value Result(ReducerFunc func) const;
 
- private:
-  ValueIterator() = default;
+  // Update value specific parts of the state, count is maintained by the caller
+  void AddValue(ReducerFunc func, const Value& value);
 
-  std::string_view field_;
-  absl::Span<const DocValues> values_;
+  double count = 0, sum = 0;            // COUNT, SUM, AVG
+  std::optional<Value> extremum;        // MAX, MIN
+  absl::flat_hash_set<Value> distinct;  // COUNT_DISTINCT
 };
 
-struct Reducer {
-  using Func = Value (*)(ValueIterator);
-  std::string source_field, result_field;
-  Func func;
+// `GROUPBY [fields...]` with REDUCE steps
+struct GroupParams {
+  std::vector<std::string> fields;
+  std::vector<Reducer> reducers;
 };
 
-enum class ReducerFunc { COUNT, COUNT_DISTINCT, SUM, AVG, MAX, MIN };
+// Reducer states by the values of the group fields
+using GroupStates = absl::flat_hash_map<absl::FixedArray<Value>, std::vector<ReducerState>>;
+
+// Add documents to the reducer states of their groups
+void ReduceGroups(const GroupParams& params, absl::Span<const DocValues> docs,
+                  GroupStates* states);
+
+// Merge states of other documents, usually from another shard, into states
+void MergeGroups(const GroupParams& params, GroupStates other, GroupStates* states);
 
-// Find reducer function by uppercase name (COUNT, MAX, etc...), empty functor if not found
-Reducer::Func FindReducerFunc(ReducerFunc name);
+// Make a document for every group with its fields and reducer results
+std::vector<DocValues> FinalizeGroups(const GroupParams& params, GroupStates states);
 
 // Make `GROUPBY [fields...]`  with REDUCE step
 PipelineStep MakeGroupStep(absl::Span<const std::string_view> fields,
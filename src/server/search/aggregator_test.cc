@@ -77,10 +77,10 @@ TEST(AggregatorTest, GroupWithReduce) {
 
   std::string_view fields[] = {"tag"};
   std::vector<Reducer> reducers = {
-      Reducer{"", "count", FindReducerFunc(ReducerFunc::COUNT)},
-      Reducer{"i", "sum-i", FindReducerFunc(ReducerFunc::SUM)},
-      Reducer{"half-i", "distinct-hi", FindReducerFunc(ReducerFunc::COUNT_DISTINCT)},
-      Reducer{"null-field", "distinct-null", FindReducerFunc(ReducerFunc::COUNT_DISTINCT)}};
+      Reducer{"", "count", ReducerFunc::COUNT},
+      Reducer{"i", "sum-i", ReducerFunc::SUM},
+      Reducer{"half-i", "distinct-hi", ReducerFunc::COUNT_DISTINCT},
+      Reducer{"null-field", "distinct-null", ReducerFunc::COUNT_DISTINCT}};
   PipelineStep steps[] = {MakeGroupStep(fields, std::move(reducers))};
 
   auto result = Process(values, steps);
@@ -104,4 +104,47 @@ TEST(AggregatorTest, GroupWithReduce) {
   EXPECT_EQ(result->at(1).at("distinct-null"), Value{(double)1});
 }
 
+// Reducing parts of the documents separately and merging the states gives the same result
+TEST(AggregatorTest, MergeGroups) {
+  std::vector<DocValues> values;
+  for (size_t i = 0; i < 20; i++) {
+    values.push_back(DocValues{
+        {"i", double(i)},
+        {"half-i", double(i / 4)},
+        {"tag", i % 3 == 0 ? "three" : "other"},
+    });
+  }
+
+  GroupParams params{{"tag"},
+                     {Reducer{"", "count", ReducerFunc::COUNT},
+                      Reducer{"i", "avg-i", ReducerFunc::AVG},
+                      Reducer{"i", "min-i", ReducerFunc::MIN},
+                      Reducer{"i", "max-i", ReducerFunc::MAX},
+                      Reducer{"half-i", "distinct-hi", ReducerFunc::COUNT_DISTINCT}}};
+
+  GroupStates all_states;
+  ReduceGroups(params, values, &all_states);
+  auto expected = FinalizeGroups(params, std::move(all_states));
+
+  GroupStates states, other_states;
+  ReduceGroups(params, absl::MakeSpan(values).subspan(0, 7), &states);
+  ReduceGroups(params, absl::MakeSpan(values).subspan(7), &other_states);
+  MergeGroups(params, std::move(other_states), &states);
+  auto result = FinalizeGroups(params, std::move(states));
+
+  auto by_tag = [](const DocValues& l, const DocValues& r) { return l.at("tag") < r.at("tag"); };
+  std::sort(expected.begin(), expected.end(), by_tag);
+  std::sort(result.begin(), result.end(), by_tag);
+  EXPECT_EQ(result, expected);
+
+  // Other comes first
+  ASSERT_EQ(result.size(), 2u);
+  EXPECT_EQ(result[0].at("count"), Value{13.0});
+  EXPECT_EQ(result[0].at("min-i"), Value{1.0});
+  EXPECT_EQ(result[0].at("max-i"), Value{19.0});
+  EXPECT_EQ(result[1].at("count"), Value{7.0});
+  EXPECT_EQ(result[1].at("avg-i"), Value{9.0});
+  EXPECT_EQ(result[1].at("distinct-hi"), Value{5.0});
+}
+
 }  // namespace dfly::aggregate
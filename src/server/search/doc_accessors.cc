@@ -9,6 +9,7 @@
 
 #include "server/search/doc_accessors.h"
 
+#include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
 
@@ -17,6 +18,7 @@
 #include "base/flags.h"
 #include "core/json/path.h"
 #include "core/overloaded.h"
+#include "core/packed_map.h"
 #include "core/search/search.h"
 #include "core/search/vector_utils.h"
 #include "core/string_map.h"
@@ -120,6 +122,25 @@ SearchDocData ListPackAccessor::Serialize(const search::Schema& schema) const {
   return out;
 }
 
+BaseAccessor::StringList PackedMapAccessor::GetStrings(string_view active_field) const {
+  auto strsv = PackedMap::Find(pm_, active_field);
+  return strsv.has_value() ? StringList{*strsv} : StringList{};
+}
+
+BaseAccessor::VectorInfo PackedMapAccessor::GetVector(string_view active_field) const {
+  auto strlist = GetStrings(active_field);
+  return strlist.empty() ? VectorInfo{} : search::BytesToFtVector(strlist.front());
+}
+
+SearchDocData PackedMapAccessor::Serialize(const search::Schema& schema) const {
+  SearchDocData out{};
+  PackedMap::Iterate(pm_, [&](string_view k, string_view v) {
+    out[k] = ExtractSortableValue(schema, k, v);
+    return true;
+  });
+  return out;
+}
+
 BaseAccessor::StringList StringMapAccessor::GetStrings(string_view active_field) const {
   auto it = hset_->Find(active_field);
   return it != hset_->end() ? StringList{SdsToSafeSv(it->second)} : StringList{};
@@ -138,6 +159,79 @@ SearchDocData StringMapAccessor::Serialize(const search::Schema& schema) const {
   return out;
 }
 
+JsonPathTrie::JsonPathTrie(const search::Schema& schema) : nodes_(1) {
+  for (const auto& [ident, field] : schema.fields) {
+    auto path = json::ParsePath(ident);
+    if (!path)
+      continue;
+
+    bool plain = all_of(path->begin(), path->end(), [](const json::PathSegment& segment) {
+      return segment.type() == json::SegmentType::IDENTIFIER ||
+             segment.type() == json::SegmentType::INDEX;
+    });
+    if (!plain)
+      continue;
+
+    unsigned node = 0;
+    for (const auto& segment : *path)
+      node = Child(node, segment);
+
+    unsigned slot = slots_.size();
+    nodes_[node].slots.push_back(slot);
+    slots_[ident] = slot;
+  }
+}
+
+int JsonPathTrie::Slot(string_view field) const {
+  auto it = slots_.find(field);
+  return it != slots_.end() ? int(it->second) : -1;
+}
+
+JsonPathTrie::Matches JsonPathTrie::Evaluate(const JsonType& json) const {
+  Matches out(slots_.size());
+  Evaluate(0, json, &out);
+  return out;
+}
+
+unsigned JsonPathTrie::Child(unsigned node, const json::PathSegment& segment) {
+  unsigned next = nodes_.size();
+  if (segment.type() == json::SegmentType::IDENTIFIER) {
+    for (const auto& [name, child] : nodes_[node].members) {
+      if (name == segment.identifier())
+        return child;
+    }
+    nodes_[node].members.emplace_back(segment.identifier(), next);
+  } else {
+    for (const auto& [index, child] : nodes_[node].elements) {
+      if (index == segment.index())
+        return child;
+    }
+    nodes_[node].elements.emplace_back(segment.index(), next);
+  }
+  nodes_.emplace_back();  // invalidates references into nodes_
+  return next;
+}
+
+void JsonPathTrie::Evaluate(unsigned node, const JsonType& json, Matches* out) const {
+  const Node& n = nodes_[node];
+  for (unsigned slot : n.slots)
+    (*out)[slot].push_back(&json);
+
+  if (!n.members.empty() && json.is_object()) {
+    for (const auto& [name, child] : n.members) {
+      if (auto it = json.find(name); it != json.object_range().end())
+        Evaluate(child, it->value(), out);
+    }
+  }
+
+  if (!n.elements.empty() && json.is_array()) {
+    for (const auto& [index, child] : n.elements) {
+      for (auto range = index.Normalize(json.size()); range.first <= range.second; ++range.first)
+        Evaluate(child, json[range.first], out);
+    }
+  }
+}
+
 struct JsonAccessor::JsonPathContainer {
   vector<JsonType> Evaluate(const JsonType& json) const {
     vector<JsonType> res;
@@ -159,55 +253,85 @@ struct JsonAccessor::JsonPathContainer {
   variant<json::Path, jsoncons::jsonpath::jsonpath_expression<JsonType>> val;
 };
 
-BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) const {
-  auto* path = GetPath(active_field);
+JsonAccessor::JsonAccessor(const JsonType* json, const JsonPathTrie* paths)
+    : json_{*json}, paths_{paths} {
+  if (paths_)
+    matches_ = paths_->Evaluate(json_);
+}
+
+JsonAccessor::Values JsonAccessor::GetValues(string_view field, vector<JsonType>* storage) const {
+  if (int slot = paths_ ? paths_->Slot(field) : -1; slot >= 0)
+    return matches_[slot];
+
+  auto* path = GetPath(field);
   if (!path)
     return {};
 
-  auto path_res = path->Evaluate(json_);
-  if (path_res.empty())
-    return {};
+  *storage = path->Evaluate(json_);
+  Values out;
+  for (const auto& v : *storage)
+    out.push_back(&v);
+  return out;
+}
 
-  if (path_res.size() == 1) {
-    buf_ = path_res[0].as_string();
-    return {buf_};
-  }
+BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) const {
+  vector<JsonType> storage;
+  Values values = GetValues(active_field, &storage);
+
+  // Strings of the document are viewed in place, other values are converted into buf_. The views
+  // into buf_ are created once it stopped growing, so only their end offsets are recorded first.
+  constexpr size_t kInPlace = SIZE_MAX;
+  bool in_place = storage.empty();
   buf_.clear();
 
-  // First, grow buffer and compute string sizes
-  vector<size_t> sizes;
-  for (const auto& element : path_res) {
-    size_t start = buf_.size();
-    buf_ += element.as_string();
-    sizes.push_back(buf_.size() - start);
+  StringList out(values.size());
+  vector<size_t> ends(values.size(), kInPlace);
+  for (size_t i = 0; i < values.size(); i++) {
+    if (in_place && values[i]->is_string()) {
+      out[i] = values[i]->as_string_view();
+    } else {
+      buf_ += values[i]->as_string();
+      ends[i] = buf_.size();
+    }
   }
 
-  // Reposition start pointers to the most recent allocation of buf
-  StringList out(sizes.size());
-
   size_t start = 0;
   for (size_t i = 0; i < out.size(); i++) {
-    out[i] = string_view{buf_}.substr(start, sizes[i]);
-    start += sizes[i];
+    if (ends[i] == kInPlace)
+      continue;
+    out[i] = string_view{buf_}.substr(start, ends[i] - start);
+    start = ends[i];
   }
 
   return out;
 }
 
-BaseAccessor::VectorInfo JsonAccessor::GetVector(string_view active_field) const {
-  auto* path = GetPath(active_field);
-  if (!path)
-    return {};
+BaseAccessor::NumsList JsonAccessor::GetNumbers(string_view active_field) const {
+  vector<JsonType> storage;
+  NumsList out;
+  for (const JsonType* value : GetValues(active_field, &storage)) {
+    if (value->is_number()) {
+      out.push_back(value->as_double());
+    } else if (value->is_string()) {
+      double num;
+      if (absl::SimpleAtod(value->as_string_view(), &num))
+        out.push_back(num);
+    }
+  }
+  return out;
+}
 
-  auto res = path->Evaluate(json_);
-  if (res.empty())
+BaseAccessor::VectorInfo JsonAccessor::GetVector(string_view active_field) const {
+  vector<JsonType> storage;
+  Values values = GetValues(active_field, &storage);
+  if (values.empty())
     return {nullptr, 0};
 
-  size_t size = res[0].size();
+  size_t size = values[0]->size();
   auto ptr = make_unique<float[]>(size);
 
   size_t i = 0;
-  for (const auto& v : res[0].array_range())
+  for (const auto& v : values[0]->array_range())
     ptr[i++] = v.as<float>();
 
   return {std::move(ptr), size};
@@ -257,11 +381,10 @@ SearchDocData JsonAccessor::Serialize(const search::Schema& schema) const {
 SearchDocData JsonAccessor::Serialize(const search::Schema& schema,
                                       const FieldsList& fields) const {
   SearchDocData out{};
+  vector<JsonType> storage;
   for (const auto& [ident, name] : fields) {
-    if (auto* path = GetPath(ident); path) {
-      if (auto res = path->Evaluate(json_); !res.empty())
-        out[name] = ExtractSortableValueFromJson(schema, ident, res[0]);
-    }
+    if (Values values = GetValues(ident, &storage); !values.empty())
+      out[name] = ExtractSortableValueFromJson(schema, ident, *values[0]);
   }
   return out;
 }
@@ -277,17 +400,20 @@ void JsonAccessor::RemoveFieldFromCache(string_view field) {
 thread_local absl::flat_hash_map<std::string, std::unique_ptr<JsonAccessor::JsonPathContainer>>
     JsonAccessor::path_cache_;
 
-unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue& pv) {
+unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue& pv,
+                                     const JsonPathTrie* json_paths) {
   DCHECK(pv.ObjType() == OBJ_HASH || pv.ObjType() == OBJ_JSON);
 
   if (pv.ObjType() == OBJ_JSON) {
     DCHECK(pv.GetJson());
-    return make_unique<JsonAccessor>(pv.GetJson());
+    return make_unique<JsonAccessor>(pv.GetJson(), json_paths);
   }
 
   if (pv.Encoding() == kEncodingListPack) {
     auto ptr = reinterpret_cast<ListPackAccessor::LpPtr>(pv.RObjPtr());
     return make_unique<ListPackAccessor>(ptr);
+  } else if (pv.Encoding() == kEncodingPackedMap) {
+    return make_unique<PackedMapAccessor>(reinterpret_cast<const uint8_t*>(pv.RObjPtr()));
   } else {
     auto* sm = container_utils::GetStringMap(pv, db_cntx);
     return make_unique<StringMapAccessor>(sm);
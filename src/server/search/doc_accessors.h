@@ -11,6 +11,7 @@
 #include <utility>
 
 #include "core/json/json_object.h"
+#include "core/json/path.h"
 #include "core/search/search.h"
 #include "server/common.h"
 #include "server/search/doc_index.h"
@@ -54,6 +55,19 @@ struct ListPackAccessor : public BaseAccessor {
   LpPtr lp_;
 };
 
+// Accessor for hashes stored with PackedMap
+struct PackedMapAccessor : public BaseAccessor {
+  explicit PackedMapAccessor(const uint8_t* pm) : pm_{pm} {
+  }
+
+  StringList GetStrings(std::string_view field) const override;
+  VectorInfo GetVector(std::string_view field) const override;
+  SearchDocData Serialize(const search::Schema& schema) const override;
+
+ private:
+  const uint8_t* pm_;
+};
+
 // Accessor for hashes stored with StringMap
 struct StringMapAccessor : public BaseAccessor {
   explicit StringMapAccessor(StringMap* hset) : hset_{hset} {
@@ -67,15 +81,49 @@ struct StringMapAccessor : public BaseAccessor {
   StringMap* hset_;
 };
 
+// The json paths of the fields of a schema, compiled into a trie that is evaluated in a single
+// traversal of the document instead of one per field. Only paths of identifiers and array indices
+// are compiled, fields with other paths are evaluated separately by JsonAccessor.
+class JsonPathTrie {
+ public:
+  // Values matched per compiled field, pointing into the document.
+  using Matches = std::vector<absl::InlinedVector<const JsonType*, 1>>;
+
+  explicit JsonPathTrie(const search::Schema& schema);
+
+  // Returns the index of the field in Matches or -1 if its path was not compiled.
+  int Slot(std::string_view field) const;
+
+  bool Empty() const {
+    return slots_.empty();
+  }
+
+  Matches Evaluate(const JsonType& json) const;
+
+ private:
+  struct Node {
+    std::vector<std::pair<std::string, unsigned>> members;       // children by object member
+    std::vector<std::pair<json::IndexExpr, unsigned>> elements;  // children by array range
+    std::vector<unsigned> slots;                                 // fields whose paths end here
+  };
+
+  unsigned Child(unsigned node, const json::PathSegment& segment);
+  void Evaluate(unsigned node, const JsonType& json, Matches* out) const;
+
+  std::vector<Node> nodes_;  // the root is nodes_[0]
+  absl::flat_hash_map<std::string, unsigned> slots_;
+};
+
 // Accessor for json values
 struct JsonAccessor : public BaseAccessor {
   struct JsonPathContainer;  // contains jsoncons::jsonpath::jsonpath_expression
 
-  explicit JsonAccessor(const JsonType* json) : json_{*json} {
-  }
+  // If paths is set, the values of its fields are extracted right away in a single traversal.
+  explicit JsonAccessor(const JsonType* json, const JsonPathTrie* paths = nullptr);
 
   StringList GetStrings(std::string_view field) const override;
   VectorInfo GetVector(std::string_view field) const override;
+  NumsList GetNumbers(std::string_view field) const override;
 
   // The JsonAccessor works with structured types and not plain strings, so an overload is needed
   SearchDocData Serialize(const search::Schema& schema, const FieldsList& fields) const override;
@@ -85,10 +133,18 @@ struct JsonAccessor : public BaseAccessor {
   static void RemoveFieldFromCache(std::string_view field);
 
  private:
+  using Values = absl::InlinedVector<const JsonType*, 1>;
+
   /// Parses `field` into a JSON path. Caches the results internally.
   JsonPathContainer* GetPath(std::string_view field) const;
 
+  // Returns the values matched by the path of field. Values that are not part of the document are
+  // copied to storage.
+  Values GetValues(std::string_view field, std::vector<JsonType>* storage) const;
+
   const JsonType& json_;
+  const JsonPathTrie* paths_;
+  JsonPathTrie::Matches matches_;  // of paths_
   mutable std::string buf_;
 
   // Contains built json paths to avoid parsing them repeatedly
@@ -96,7 +152,8 @@ struct JsonAccessor : public BaseAccessor {
       path_cache_;
 };
 
-// Get accessor for value
-std::unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue& pv);
+// Get accessor for value. Json documents are read through json_paths if it is set.
+std::unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue& pv,
+                                          const JsonPathTrie* json_paths = nullptr);
 
 }  // namespace dfly
@@ -5,10 +5,12 @@
 #include "server/search/doc_index.h"
 
 #include <absl/strings/str_join.h>
+#include <absl/time/clock.h>
 
 #include <memory>
 
 #include "absl/strings/str_cat.h"
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/overloaded.h"
 #include "core/search/indices.h"
@@ -16,22 +18,35 @@
 #include "server/search/doc_accessors.h"
 #include "server/server_state.h"
 
+ABSL_FLAG(uint32_t, search_build_slice_usec, 1000,
+          "Time slice in microseconds for indexing existing keys of a new search index. The "
+          "first slice runs in FT.CREATE, the rest in the background, yielding to commands "
+          "between slices.");
+
+ABSL_DECLARE_FLAG(bool, jsonpathv2);
+
 namespace dfly {
 
 using namespace std;
+using namespace util;
 using facade::ErrorReply;
 using nonstd::make_unexpected;
 
 namespace {
 
+// Traverse documents matching index from cursor until the deadline and return the cursor to
+// continue from. Counts all traversed keys.
 template <typename F>
-void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
-  auto& db_slice = op_args.GetDbSlice();
-  DCHECK(db_slice.IsDbValid(op_args.db_cntx.db_index));
-  auto [prime_table, _] = db_slice.GetTables(op_args.db_cntx.db_index);
+PrimeTable::Cursor TraverseMatching(const DocIndex& index, const JsonPathTrie* json_paths,
+                                    DbSlice* db_slice, const DbContext& db_cntx,
+                                    PrimeTable::Cursor cursor, uint64_t deadline_ns,
+                                    size_t* traversed, F&& f) {
+  DCHECK(db_slice->IsDbValid(db_cntx.db_index));
+  auto [prime_table, _] = db_slice->GetTables(db_cntx.db_index);
 
   string scratch;
   auto cb = [&](PrimeTable::iterator it) {
+    ++*traversed;
     const PrimeValue& pv = it->second;
     if (pv.ObjType() != index.GetObjCode())
       return;
@@ -40,14 +55,14 @@ void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
     if (key.rfind(index.prefix, 0) != 0)
       return;
 
-    auto accessor = GetAccessor(op_args.db_cntx, pv);
+    auto accessor = GetAccessor(db_cntx, pv, json_paths);
     f(key, accessor.get());
   };
 
-  PrimeTable::Cursor cursor;
   do {
-    cursor = prime_table->Traverse(cursor, cb);
-  } while (cursor);
+    cursor = db_slice->Traverse(prime_table, cursor, cb);
+  } while (cursor && absl::GetCurrentTimeNanos() < deadline_ns);
+  return cursor;
 }
 
 }  // namespace
@@ -95,6 +110,9 @@ string DocIndexInfo::BuildRestoreCommand() const {
   for (const auto& sw : base_index.options.stopwords)
     absl::StrAppend(&out, " ", sw);
 
+  if (base_index.query_cache_bytes > 0)
+    absl::StrAppend(&out, " QUERYCACHE ", base_index.query_cache_bytes);
+
   absl::StrAppend(&out, " SCHEMA");
   for (const auto& [fident, finfo] : base_index.schema.fields) {
     // Store field name, alias and type
@@ -113,14 +131,26 @@ string DocIndexInfo::BuildRestoreCommand() const {
         [](monostate) {},
         [out = &out](const search::SchemaField::VectorParams& params) {
           auto sim = params.sim == search::VectorSimilarity::L2 ? "L2" : "COSINE";
-          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", " 6 ", "DIM ", params.dim,
-                          " DISTANCE_METRIC ", sim, " INITIAL_CAP ", params.capacity);
+          bool float32 = params.storage == search::VectorStorage::FLOAT32;
+          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", float32 ? " 6 " : " 8 ",
+                          "DIM ", params.dim, " DISTANCE_METRIC ", sim, " INITIAL_CAP ",
+                          params.capacity);
+          if (!float32) {
+            auto storage = params.storage == search::VectorStorage::FLOAT16 ? "FLOAT16" : "INT8";
+            absl::StrAppend(out, " STORAGE ", storage);
+          }
         },
         [out = &out](const search::SchemaField::TagParams& params) {
           absl::StrAppend(out, " ", "SEPARATOR", " ", string{params.separator});
           if (params.case_sensitive)
             absl::StrAppend(out, " ", "CASESENSITIVE");
         },
+        [out = &out](const search::SchemaField::TextParams& params) {
+          if (params.with_positions)
+            absl::StrAppend(out, " ", "WITHPOSITIONS");
+          if (params.with_suffix_trie)
+            absl::StrAppend(out, " ", "WITHSUFFIXTRIE");
+        },
     };
     visit(info, finfo.special_params);
   }
@@ -164,6 +194,10 @@ string_view ShardDocIndex::DocKeyIndex::Get(DocId id) const {
   return keys_[id];
 }
 
+bool ShardDocIndex::DocKeyIndex::Contains(string_view key) const {
+  return ids_.contains(key);
+}
+
 size_t ShardDocIndex::DocKeyIndex::Size() const {
   return ids_.size();
 }
@@ -178,33 +212,96 @@ bool DocIndex::Matches(string_view key, unsigned obj_code) const {
 
 ShardDocIndex::ShardDocIndex(shared_ptr<const DocIndex> index)
     : base_{std::move(index)}, key_index_{} {
+  if (base_->query_cache_bytes > 0)
+    query_cache_.emplace(base_->query_cache_bytes);
+
+  // The legacy jsonpath implementation is evaluated per field by JsonAccessor.
+  if (base_->type == DocIndex::JSON && absl::GetFlag(FLAGS_jsonpathv2)) {
+    json_paths_ = make_unique<JsonPathTrie>(base_->schema);
+    if (json_paths_->Empty())
+      json_paths_.reset();
+  }
+}
+
+ShardDocIndex::~ShardDocIndex() {
+  CancelBuild();
 }
 
 void ShardDocIndex::Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr) {
+  CancelBuild();
+
   key_index_ = DocKeyIndex{};
   indices_.emplace(base_->schema, base_->options, mr);
+  version_++;
+
+  auto& db_slice = op_args.GetDbSlice();
+  build_.emplace(BuildState{&db_slice, op_args.db_cntx});
+  build_->total = db_slice.DbSize(op_args.db_cntx.db_index);
+
+  if (!BuildSlice()) {
+    build_.reset();
+    VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
+    return;
+  }
+
+  build_fb_ = fb2::Fiber("index_build", [this] {
+    do {
+      ThisFiber::Yield();
+      if (build_->cancelled)
+        return;
+    } while (BuildSlice());
+
+    VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix << " in "
+            << build_->traversed << " keys";
+    build_.reset();
+  });
+}
+
+bool ShardDocIndex::BuildSlice() {
+  if (!build_->db_slice->IsDbValid(build_->db_cntx.db_index))
+    return false;
+
+  // Skip documents that were added by writes since the build started
+  auto cb = [this](string_view key, BaseAccessor* doc) {
+    if (!key_index_.Contains(key)) {
+      indices_->Add(key_index_.Add(key), doc);
+      version_++;
+    }
+  };
 
-  auto cb = [this](string_view key, BaseAccessor* doc) { indices_->Add(key_index_.Add(key), doc); };
-  TraverseAllMatching(*base_, op_args, cb);
+  build_->db_cntx.time_now_ms = GetCurrentTimeMs();
+  uint64_t deadline_ns =
+      absl::GetCurrentTimeNanos() + absl::GetFlag(FLAGS_search_build_slice_usec) * 1000;
+  build_->cursor = TraverseMatching(*base_, json_paths_.get(), build_->db_slice, build_->db_cntx,
+                                    build_->cursor, deadline_ns, &build_->traversed, cb);
+  return bool(build_->cursor);
+}
 
-  VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
+void ShardDocIndex::CancelBuild() {
+  if (build_)
+    build_->cancelled = true;
+  build_fb_.JoinIfNeeded();
+  build_.reset();
 }
 
 void ShardDocIndex::AddDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
   if (!indices_)
     return;
 
-  auto accessor = GetAccessor(db_cntx, pv);
+  auto accessor = GetAccessor(db_cntx, pv, json_paths_.get());
   indices_->Add(key_index_.Add(key), accessor.get());
+  version_++;
 }
 
 void ShardDocIndex::RemoveDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
-  if (!indices_)
+  // Keys are not indexed yet while the index is being built
+  if (!indices_ || !key_index_.Contains(key))
     return;
 
-  auto accessor = GetAccessor(db_cntx, pv);
+  auto accessor = GetAccessor(db_cntx, pv, json_paths_.get());
   DocId id = key_index_.Remove(key);
   indices_->Remove(id, accessor.get());
+  version_++;
 }
 
 bool ShardDocIndex::Matches(string_view key, unsigned obj_code) const {
@@ -213,14 +310,27 @@ bool ShardDocIndex::Matches(string_view key, unsigned obj_code) const {
 
 SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& params,
                                    search::SearchAlgorithm* search_algo) const {
+  auto candidates = SearchIds(op_args, params, search_algo);
+  if (candidates.error)
+    return SearchResult{std::move(*candidates.error)};
+
+  size_t total_hits = candidates.total_hits;
+  auto profile = std::move(candidates.profile);
+  return SearchResult{total_hits, LoadDocs(op_args, params, std::move(candidates)),
+                      std::move(profile)};
+}
+
+SearchCandidates ShardDocIndex::SearchIds(const OpArgs& op_args, const SearchParams& params,
+                                          search::SearchAlgorithm* search_algo) const {
   auto& db_slice = op_args.GetDbSlice();
-  auto search_results = search_algo->Search(&*indices_, params.limit_offset + params.limit_total);
+  auto search_results = RunSearch(search_algo, params.limit_offset + params.limit_total);
 
   if (!search_results.error.empty())
-    return SearchResult{facade::ErrorReply{std::move(search_results.error)}};
+    return SearchCandidates{facade::ErrorReply{std::move(search_results.error)}};
 
-  vector<SerializedSearchDoc> out;
-  out.reserve(search_results.ids.size());
+  SearchCandidates out;
+  out.ids.reserve(search_results.ids.size());
+  out.scores.reserve(search_results.scores.size());
 
   size_t expired_count = 0;
   for (size_t i = 0; i < search_results.ids.size(); i++) {
@@ -232,6 +342,46 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
       continue;
     }
 
+    out.ids.push_back(search_results.ids[i]);
+    if (!search_results.scores.empty())
+      out.scores.push_back(std::move(search_results.scores[i]));
+  }
+
+  out.total_hits = search_results.total - expired_count;
+  out.profile = std::move(search_results.profile);
+  return out;
+}
+
+search::SearchResult ShardDocIndex::RunSearch(search::SearchAlgorithm* search_algo,
+                                              size_t limit) const {
+  optional<string> key = query_cache_ ? search_algo->CacheKey() : nullopt;
+  if (!key)
+    return search_algo->Search(&*indices_, limit);
+
+  // Results of KNN and SORTBY queries depend on the limit
+  absl::StrAppend(&*key, ":", limit);
+  if (auto cached = query_cache_->Find(*key, version_); cached)
+    return std::move(*cached);
+
+  auto result = search_algo->Search(&*indices_, limit);
+  if (result.error.empty())
+    query_cache_->Insert(std::move(*key), version_, result);
+  return result;
+}
+
+vector<SerializedSearchDoc> ShardDocIndex::LoadDocs(const OpArgs& op_args,
+                                                    const SearchParams& params,
+                                                    SearchCandidates candidates) const {
+  auto& db_slice = op_args.GetDbSlice();
+  vector<SerializedSearchDoc> out;
+  out.reserve(candidates.ids.size());
+
+  for (size_t i = 0; i < candidates.ids.size(); i++) {
+    auto key = key_index_.Get(candidates.ids[i]);
+    auto it = db_slice.FindReadOnly(op_args.db_cntx, key, base_->GetObjCode());
+    if (!it || !IsValid(*it))
+      continue;
+
     auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
 
     SearchDocData doc_data;
@@ -246,19 +396,17 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
       doc_data = accessor->Serialize(base_->schema, params.return_fields.GetFields());
     }
 
-    auto score = search_results.scores.empty() ? monostate{} : std::move(search_results.scores[i]);
+    auto score = candidates.scores.empty() ? monostate{} : std::move(candidates.scores[i]);
     out.push_back(SerializedSearchDoc{string{key}, std::move(doc_data), std::move(score)});
   }
-
-  return SearchResult{search_results.total - expired_count, std::move(out),
-                      std::move(search_results.profile)};
+  return out;
 }
 
 vector<SearchDocData> ShardDocIndex::SearchForAggregator(
     const OpArgs& op_args, const AggregateParams& params,
     search::SearchAlgorithm* search_algo) const {
   auto& db_slice = op_args.GetDbSlice();
-  auto search_results = search_algo->Search(&*indices_);
+  auto search_results = RunSearch(search_algo, numeric_limits<size_t>::max());
 
   if (!search_results.error.empty())
     return {};
@@ -291,7 +439,14 @@ vector<SearchDocData> ShardDocIndex::SearchForAggregator(
 }
 
 DocIndexInfo ShardDocIndex::GetInfo() const {
-  return {*base_, key_index_.Size()};
+  DocIndexInfo info{*base_, key_index_.Size()};
+  if (build_) {
+    info.indexing = true;
+    info.percent_indexed = min(double(build_->traversed) / max<size_t>(build_->total, 1), 0.99);
+  }
+  if (query_cache_)
+    info.query_cache = query_cache_->GetStats();
+  return info;
 }
 
 io::Result<StringVec, ErrorReply> ShardDocIndex::GetTagVals(string_view field) const {
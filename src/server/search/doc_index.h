@@ -17,6 +17,7 @@
 #include "core/search/search.h"
 #include "server/common.h"
 #include "server/search/aggregator.h"
+#include "server/search/query_cache.h"
 #include "server/table.h"
 
 namespace dfly {
@@ -52,6 +53,22 @@ struct SearchResult {
   std::optional<facade::ErrorReply> error;
 };
 
+// Ids and scores of the matches on a shard without their values, the first phase of a search
+// whose results are ranked across shards. Only the global winners are serialized afterwards.
+struct SearchCandidates {
+  SearchCandidates() = default;
+
+  SearchCandidates(facade::ErrorReply error) : error{std::move(error)} {
+  }
+
+  size_t total_hits = 0;
+  std::vector<search::DocId> ids;
+  std::vector<search::ResultScore> scores;
+  std::optional<search::AlgorithmProfile> profile;
+
+  std::optional<facade::ErrorReply> error;
+};
+
 using FieldsList = std::vector<std::pair<std::string /*identifier*/, std::string /*short name*/>>;
 
 struct SelectedFields {
@@ -94,6 +111,9 @@ struct SearchParams {
   std::optional<search::SortOption> sort_option;
   search::QueryParams query_params;
 
+  // Rank results by the BM25 score of their text terms
+  bool bm25_scoring = false;
+
   bool IdsOnly() const {
     return return_fields.ShouldReturnNoFields();
   }
@@ -106,6 +126,9 @@ struct AggregateParams {
   search::QueryParams params;
 
   SelectedFields load_fields;
+
+  // Leading GROUPBY step, reduced on every shard and merged on the coordinator
+  std::optional<aggregate::GroupParams> group;
   std::vector<aggregate::PipelineStep> steps;
 };
 
@@ -123,17 +146,25 @@ struct DocIndex {
   search::IndicesOptions options{};
   std::string prefix{};
   DataType type{HASH};
+
+  size_t query_cache_bytes = 0;  // Memory limit of the result cache on every shard, 0 disables it
 };
 
 struct DocIndexInfo {
   DocIndex base_index;
   size_t num_docs = 0;
 
+  bool indexing = false;        // Whether existing keys are still being indexed
+  double percent_indexed = 1.0;  // Share of existing keys traversed so far
+
+  std::optional<SearchResultCache::Stats> query_cache;  // Set if the query cache is enabled
+
   // Build original ft.create command that can be used to re-create this index
   std::string BuildRestoreCommand() const;
 };
 
 class ShardDocIndices;
+class JsonPathTrie;
 
 // Stores internal search indices for documents of a document index on a specific shard.
 class ShardDocIndex {
@@ -146,6 +177,7 @@ class ShardDocIndex {
     DocId Remove(std::string_view key);
 
     std::string_view Get(DocId id) const;
+    bool Contains(std::string_view key) const;
     size_t Size() const;
 
    private:
@@ -158,11 +190,20 @@ class ShardDocIndex {
  public:
   // Index must be rebuilt at least once after intialization
   ShardDocIndex(std::shared_ptr<const DocIndex> index);
+  ~ShardDocIndex();
 
   // Perform search on all indexed documents and return results.
   SearchResult Search(const OpArgs& op_args, const SearchParams& params,
                       search::SearchAlgorithm* search_algo) const;
 
+  // Perform search without loading the documents, expired documents are filtered out.
+  SearchCandidates SearchIds(const OpArgs& op_args, const SearchParams& params,
+                             search::SearchAlgorithm* search_algo) const;
+
+  // Load the documents of the candidates, in the same transaction as SearchIds.
+  std::vector<SerializedSearchDoc> LoadDocs(const OpArgs& op_args, const SearchParams& params,
+                                            SearchCandidates candidates) const;
+
   // Perform search and load requested values - note params might be interpreted differently.
   std::vector<SearchDocData> SearchForAggregator(const OpArgs& op_args,
                                                  const AggregateParams& params,
@@ -179,13 +220,41 @@ class ShardDocIndex {
   io::Result<StringVec, facade::ErrorReply> GetTagVals(std::string_view field) const;
 
  private:
-  // Clears internal data. Traverses all matching documents and assigns ids.
+  // State of indexing the keys that existed when the index was (re)built
+  struct BuildState {
+    DbSlice* db_slice;
+    DbContext db_cntx;
+    PrimeTable::Cursor cursor{};
+    size_t traversed = 0;  // Keys traversed so far, of any type
+    size_t total = 0;      // Keys in the database when the build started
+    bool cancelled = false;
+  };
+
+  // Clears internal data and starts traversing all matching documents to assign ids.
+  // The first time slice is indexed right away, the rest by a background fiber that yields to
+  // other work between slices. Documents changed in the meantime are updated by AddDoc/RemoveDoc.
   void Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr);
 
+  // Index documents for one time slice, return false once all were traversed
+  bool BuildSlice();
+
+  // Stop the background build if it is running
+  void CancelBuild();
+
+  // Run the search algorithm or take its result from the query cache
+  search::SearchResult RunSearch(search::SearchAlgorithm* search_algo, size_t limit) const;
+
  private:
   std::shared_ptr<const DocIndex> base_;
   std::optional<search::FieldIndices> indices_;
   DocKeyIndex key_index_;
+  std::unique_ptr<JsonPathTrie> json_paths_;  // Set for json indices with compilable field paths
+
+  uint64_t version_ = 0;  // Bumped whenever indexed documents change
+  mutable std::optional<SearchResultCache> query_cache_;
+
+  std::optional<BuildState> build_;  // Set while existing keys are being indexed
+  util::fb2::Fiber build_fb_;
 };
 
 // Stores shard doc indices by name on a specific shard.
@@ -0,0 +1,89 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/search/query_cache.h"
+
+#include "base/logging.h"
+#include "core/overloaded.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+search::SearchResult CopyResult(const search::SearchResult& result) {
+  DCHECK(!result.profile && result.error.empty());
+
+  search::SearchResult out{result.total, result.pre_aggregation_total, result.ids};
+  out.scores.reserve(result.scores.size());
+
+  // Wrapped strings own their memory and can't be copied directly
+  Overloaded copy_score{
+      [](const search::WrappedStrPtr& str) -> search::ResultScore { return string{str}; },
+      [](const auto& score) -> search::ResultScore { return score; }};
+  for (const auto& score : result.scores)
+    out.scores.push_back(visit(copy_score, score));
+  return out;
+}
+
+size_t EntryBytes(string_view key, const search::SearchResult& result) {
+  size_t bytes = key.size() + sizeof(search::SearchResult);
+  bytes += result.ids.size() * sizeof(search::DocId);
+  bytes += result.scores.size() * sizeof(search::ResultScore);
+  for (const auto& score : result.scores) {
+    if (const auto* str = get_if<search::WrappedStrPtr>(&score); str)
+      bytes += string_view{*str}.size() + 1;
+  }
+  return bytes;
+}
+
+}  // namespace
+
+optional<search::SearchResult> SearchResultCache::Find(string_view key, uint64_t version) {
+  if (version != version_)
+    Reset(version);
+
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    stats_.misses++;
+    return nullopt;
+  }
+
+  stats_.hits++;
+  return CopyResult(it->second);
+}
+
+void SearchResultCache::Insert(string key, uint64_t version, const search::SearchResult& result) {
+  if (version != version_)
+    Reset(version);
+
+  size_t bytes = EntryBytes(key, result);
+  if (bytes > max_bytes_ || entries_.contains(key))
+    return;
+
+  // Evict arbitrary entries, all of them are equally recent for the current version
+  while (stats_.bytes + bytes > max_bytes_) {
+    auto it = entries_.begin();
+    stats_.bytes -= EntryBytes(it->first, it->second);
+    entries_.erase(it);
+  }
+
+  stats_.bytes += bytes;
+  entries_.emplace(std::move(key), CopyResult(result));
+}
+
+SearchResultCache::Stats SearchResultCache::GetStats() const {
+  Stats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void SearchResultCache::Reset(uint64_t version) {
+  version_ = version;
+  entries_.clear();
+  stats_.bytes = 0;
+}
+
+}  // namespace dfly
@@ -0,0 +1,47 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "core/search/search.h"
+
+namespace dfly {
+
+// Caches the results of searches on a shard index by their normalized query.
+// The cache is bound to a version of the index that is bumped whenever documents are added or
+// removed, so all entries of an older version are dropped on the first access after a change.
+class SearchResultCache {
+ public:
+  struct Stats {
+    size_t hits = 0, misses = 0;
+    size_t entries = 0, bytes = 0;
+  };
+
+  explicit SearchResultCache(size_t max_bytes) : max_bytes_{max_bytes} {
+  }
+
+  // Return a copy of the result cached for key on this version of the index
+  std::optional<search::SearchResult> Find(std::string_view key, uint64_t version);
+
+  // Cache result, evicting other entries if it doesn't fit into the memory limit
+  void Insert(std::string key, uint64_t version, const search::SearchResult& result);
+
+  Stats GetStats() const;
+
+ private:
+  void Reset(uint64_t version);
+
+  size_t max_bytes_;
+  uint64_t version_ = 0;
+  Stats stats_;
+  absl::flat_hash_map<std::string, search::SearchResult> entries_;
+};
+
+}  // namespace dfly
@@ -55,6 +55,10 @@ search::SchemaField::VectorParams ParseVectorParams(CmdArgParser* parser) {
     } else if (parser->Check("DISTANCE_METRIC")) {
       params.sim = parser->MapNext("L2", search::VectorSimilarity::L2, "COSINE",
                                    search::VectorSimilarity::COSINE);
+    } else if (parser->Check("STORAGE")) {
+      params.storage = parser->MapNext("FLOAT32", search::VectorStorage::FLOAT32, "FLOAT16",
+                                       search::VectorStorage::FLOAT16, "INT8",
+                                       search::VectorStorage::INT8);
     } else if (parser->Check("INITIAL_CAP", &params.capacity)) {
     } else if (parser->Check("M", &params.hnsw_m)) {
     } else if (parser->Check("EF_CONSTRUCTION", &params.hnsw_ef_construction)) {
@@ -144,8 +148,14 @@ optional<search::Schema> ParseSchemaOrReply(DocIndex::DataType type, CmdArgParse
       params = vector_params;
     }
 
-    // Flags: check for SORTABLE and NOINDEX
+    // Flags: check for SORTABLE and NOINDEX, and WITHPOSITIONS and WITHSUFFIXTRIE for text fields
     uint8_t flags = 0;
+    auto text_params = [&params]() -> SchemaField::TextParams& {
+      if (!holds_alternative<SchemaField::TextParams>(params))
+        params = SchemaField::TextParams{};
+      return get<SchemaField::TextParams>(params);
+    };
+
     while (parser.HasNext()) {
       if (parser.Check("NOINDEX")) {
         flags |= search::SchemaField::NOINDEX;
@@ -157,6 +167,16 @@ optional<search::Schema> ParseSchemaOrReply(DocIndex::DataType type, CmdArgParse
         continue;
       }
 
+      if (type == SchemaField::TEXT && parser.Check("WITHPOSITIONS")) {
+        text_params().with_positions = true;
+        continue;
+      }
+
+      if (type == SchemaField::TEXT && parser.Check("WITHSUFFIXTRIE")) {
+        text_params().with_suffix_trie = true;
+        continue;
+      }
+
       break;
     }
 
@@ -193,32 +213,57 @@ search::QueryParams ParseQueryParams(CmdArgParser* parser) {
   return params;
 }
 
+enum class SearchOpt { LIMIT, RETURN, NOCONTENT, PARAMS, SORTBY, SCORER };
+
+constexpr auto kSearchOpts = MakeTagTable<SearchOpt>({{"LIMIT", SearchOpt::LIMIT},
+                                                      {"RETURN", SearchOpt::RETURN},
+                                                      {"NOCONTENT", SearchOpt::NOCONTENT},
+                                                      {"PARAMS", SearchOpt::PARAMS},
+                                                      {"SORTBY", SearchOpt::SORTBY},
+                                                      {"SCORER", SearchOpt::SCORER}});
+
 optional<SearchParams> ParseSearchParamsOrReply(CmdArgParser parser, ConnectionContext* cntx) {
   SearchParams params;
 
   while (parser.HasNext()) {
-    // [LIMIT offset total]
-    if (parser.Check("LIMIT")) {
-      params.limit_offset = parser.Next<size_t>();
-      params.limit_total = parser.Next<size_t>();
-    } else if (parser.Check("RETURN")) {
-      // RETURN {num} [{ident} AS {name}...]
-      size_t num_fields = parser.Next<size_t>();
-      params.return_fields.fields.emplace();
-      while (params.return_fields->size() < num_fields) {
-        string_view ident = parser.Next();
-        string_view alias = parser.Check("AS") ? parser.Next() : ident;
-        params.return_fields->emplace_back(ident, alias);
-      }
-    } else if (parser.Check("NOCONTENT")) {  // NOCONTENT
-      params.return_fields.fields.emplace();
-    } else if (parser.Check("PARAMS")) {  // [PARAMS num(ignored) name(ignored) knn_vector]
-      params.query_params = ParseQueryParams(&parser);
-    } else if (parser.Check("SORTBY")) {
-      params.sort_option = search::SortOption{string{parser.Next()}, bool(parser.Check("DESC"))};
-    } else {
+    optional<SearchOpt> opt = parser.TryMapNextTag(kSearchOpts);
+    if (!opt) {
       // Unsupported parameters are ignored for now
       parser.Skip(1);
+      continue;
+    }
+
+    switch (*opt) {
+      case SearchOpt::LIMIT:  // [LIMIT offset total]
+        params.limit_offset = parser.Next<size_t>();
+        params.limit_total = parser.Next<size_t>();
+        break;
+      case SearchOpt::RETURN: {
+        // RETURN {num} [{ident} AS {name}...]
+        size_t num_fields = parser.Next<size_t>();
+        params.return_fields.fields.emplace();
+        while (params.return_fields->size() < num_fields) {
+          string_view ident = parser.Next();
+          string_view alias = parser.Check("AS") ? parser.Next() : ident;
+          params.return_fields->emplace_back(ident, alias);
+        }
+        break;
+      }
+      case SearchOpt::NOCONTENT:
+        params.return_fields.fields.emplace();
+        break;
+      case SearchOpt::PARAMS:  // [PARAMS num(ignored) name(ignored) knn_vector]
+        params.query_params = ParseQueryParams(&parser);
+        break;
+      case SearchOpt::SORTBY:
+        params.sort_option = search::SortOption{string{parser.Next()}, bool(parser.Check("DESC"))};
+        break;
+      case SearchOpt::SCORER:
+        // Other scorers are not supported, their results are returned unranked
+        params.bm25_scoring = bool(parser.Check("BM25")) || bool(parser.Check("BM25STD"));
+        if (!params.bm25_scoring)
+          parser.Skip(1);
+        break;
     }
   }
 
@@ -301,7 +346,6 @@ optional<AggregateParams> ParseAggregatorParamsOrReply(CmdArgParser parser,
           return nullopt;
         }
 
-        auto func = aggregate::FindReducerFunc(*func_name);
         auto nargs = parser.Next<size_t>();
 
         string source_field;
@@ -313,10 +357,16 @@ optional<AggregateParams> ParseAggregatorParamsOrReply(CmdArgParser parser,
         string result_field = parser.Next<string>();
 
         reducers.push_back(
-            aggregate::Reducer{std::move(source_field), std::move(result_field), std::move(func)});
+            aggregate::Reducer{std::move(source_field), std::move(result_field), *func_name});
       }
 
-      params.steps.push_back(aggregate::MakeGroupStep(fields, std::move(reducers)));
+      // The first step can be reduced on the shards, all later ones run on the coordinator
+      if (params.steps.empty() && !params.group) {
+        params.group = aggregate::GroupParams{vector<string>(fields.begin(), fields.end()),
+                                              std::move(reducers)};
+      } else {
+        params.steps.push_back(aggregate::MakeGroupStep(fields, std::move(reducers)));
+      }
       continue;
     }
 
@@ -466,6 +516,86 @@ void ReplySorted(search::AggregationInfo agg, const SearchParams& params,
   }
 }
 
+// Search whose results are ranked by KNN distance or SORTBY across shards, in two hops. The
+// shards return only ids and scores first, then only the documents of the global winners are
+// loaded, instead of limit documents from every shard.
+void SearchRanked(string_view index_name, search::AggregationInfo agg, const SearchParams& params,
+                  search::SearchAlgorithm* search_algo, ConnectionContext* cntx) {
+  atomic<bool> index_not_found{false};
+  vector<SearchCandidates> candidates(shard_set->size());
+
+  cntx->transaction->Execute(
+      [&](Transaction* t, EngineShard* es) {
+        if (auto* index = es->search_indices()->GetIndex(index_name); index)
+          candidates[es->shard_id()] = index->SearchIds(t->GetOpArgs(es), params, search_algo);
+        else
+          index_not_found.store(true, memory_order_relaxed);
+        return OpStatus::OK;
+      },
+      false);
+
+  optional<ErrorReply> error;
+  if (index_not_found.load())
+    error = ErrorReply{string{index_name} + ": no such index"};
+  for (auto& shard_candidates : candidates) {
+    if (!error && shard_candidates.error)
+      error = std::move(shard_candidates.error);
+  }
+
+  if (error) {
+    cntx->transaction->Conclude();
+    return cntx->SendError(*error);
+  }
+
+  vector<pair<unsigned /*shard*/, size_t /*pos*/>> ranked;
+  for (unsigned sid = 0; sid < candidates.size(); sid++) {
+    DCHECK_EQ(candidates[sid].ids.size(), candidates[sid].scores.size());
+    for (size_t i = 0; i < candidates[sid].scores.size(); i++)
+      ranked.emplace_back(sid, i);
+  }
+
+  auto score = [&](const auto& entry) -> const search::ResultScore& {
+    return candidates[entry.first].scores[entry.second];
+  };
+  size_t prefix = min(params.limit_offset + params.limit_total, agg.limit.value_or(ranked.size()));
+  prefix = min(prefix, ranked.size());
+  partial_sort(ranked.begin(), ranked.begin() + prefix, ranked.end(),
+               [&](const auto& l, const auto& r) {
+                 return agg.descending ? score(r) < score(l) : score(l) < score(r);
+               });
+
+  vector<vector<size_t>> winners(candidates.size());
+  for (auto [sid, i] : absl::MakeSpan(ranked).subspan(0, prefix))
+    winners[sid].push_back(i);
+
+  for (unsigned sid = 0; sid < candidates.size(); sid++) {
+    auto& shard_candidates = candidates[sid];
+    vector<search::DocId> ids;
+    vector<search::ResultScore> scores;
+    for (size_t i : winners[sid]) {
+      ids.push_back(shard_candidates.ids[i]);
+      scores.push_back(std::move(shard_candidates.scores[i]));
+    }
+    shard_candidates.ids = std::move(ids);
+    shard_candidates.scores = std::move(scores);
+  }
+
+  vector<SearchResult> docs(shard_set->size());
+  cntx->transaction->Execute(
+      [&](Transaction* t, EngineShard* es) {
+        auto& shard_candidates = candidates[es->shard_id()];
+        size_t total_hits = shard_candidates.total_hits;
+        auto* index = es->search_indices()->GetIndex(index_name);
+        docs[es->shard_id()] = SearchResult{
+            total_hits, index->LoadDocs(t->GetOpArgs(es), params, std::move(shard_candidates)),
+            nullopt};
+        return OpStatus::OK;
+      },
+      true);
+
+  ReplySorted(std::move(agg), params, absl::MakeSpan(docs), cntx);
+}
+
 }  // namespace
 
 void SearchFamily::FtCreate(CmdArgList args, ConnectionContext* cntx) {
@@ -501,6 +631,12 @@ void SearchFamily::FtCreate(CmdArgList args, ConnectionContext* cntx) {
       continue;
     }
 
+    // QUERYCACHE max_bytes - Dragonfly extension to cache results on every shard
+    if (parser.Check("QUERYCACHE")) {
+      index.query_cache_bytes = parser.Next<size_t>();
+      continue;
+    }
+
     // SCHEMA
     if (parser.Check("SCHEMA")) {
       auto schema = ParseSchemaOrReply(index.type, parser.Tail(), cntx);
@@ -639,14 +775,29 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
          infos.back().base_index.schema.fields.size());
 
   size_t total_num_docs = 0;
-  for (const auto& info : infos)
+  bool indexing = false;
+  double percent_indexed = 0;
+  optional<SearchResultCache::Stats> cache_stats;
+  for (const auto& info : infos) {
     total_num_docs += info.num_docs;
+    indexing |= info.indexing;
+    percent_indexed += info.percent_indexed / infos.size();
+
+    if (info.query_cache) {
+      if (!cache_stats)
+        cache_stats.emplace();
+      cache_stats->hits += info.query_cache->hits;
+      cache_stats->misses += info.query_cache->misses;
+      cache_stats->entries += info.query_cache->entries;
+      cache_stats->bytes += info.query_cache->bytes;
+    }
+  }
 
   const auto& info = infos.front();
   const auto& schema = info.base_index.schema;
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->StartCollection(cache_stats ? 7 : 6, RedisReplyBuilder::MAP);
 
   rb->SendSimpleString("index_name");
   rb->SendSimpleString(idx_name);
@@ -681,6 +832,27 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
 
   rb->SendSimpleString("num_docs");
   rb->SendLong(total_num_docs);
+
+  rb->SendSimpleString("indexing");
+  rb->SendLong(indexing);
+
+  rb->SendSimpleString("percent_indexed");
+  rb->SendDouble(indexing ? percent_indexed : 1.0);
+
+  if (cache_stats) {
+    rb->SendSimpleString("query_cache");
+    rb->StartCollection(5, RedisReplyBuilder::MAP);
+    rb->SendSimpleString("max_bytes");
+    rb->SendLong(info.base_index.query_cache_bytes);
+    rb->SendSimpleString("bytes");
+    rb->SendLong(cache_stats->bytes);
+    rb->SendSimpleString("entries");
+    rb->SendLong(cache_stats->entries);
+    rb->SendSimpleString("hits");
+    rb->SendLong(cache_stats->hits);
+    rb->SendSimpleString("misses");
+    rb->SendLong(cache_stats->misses);
+  }
 }
 
 void SearchFamily::FtList(CmdArgList args, ConnectionContext* cntx) {
@@ -710,6 +882,12 @@ void SearchFamily::FtSearch(CmdArgList args, ConnectionContext* cntx) {
   if (!search_algo.Init(query_str, &params->query_params, sort_opt))
     return cntx->SendError("Query syntax error");
 
+  if (params->bm25_scoring)
+    search_algo.EnableBm25Scoring();
+
+  if (auto agg = search_algo.HasAggregation(); agg && shard_set->size() > 1)
+    return SearchRanked(index_name, std::move(*agg), *params, &search_algo, cntx);
+
   // Because our coordinator thread may not have a shard, we can't check ahead if the index exists.
   atomic<bool> index_not_found{false};
   vector<SearchResult> docs(shard_set->size());
@@ -749,6 +927,9 @@ void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
   if (!search_algo.Init(query_str, &params->query_params, sort_opt))
     return cntx->SendError("Query syntax error");
 
+  if (params->bm25_scoring)
+    search_algo.EnableBm25Scoring();
+
   search_algo.EnableProfiling();
 
   absl::Time start = absl::Now();
@@ -864,16 +1045,28 @@ void SearchFamily::FtAggregate(CmdArgList args, ConnectionContext* cntx) {
   using ResultContainer = decltype(declval<ShardDocIndex>().SearchForAggregator(
       declval<OpArgs>(), params.value(), &search_algo));
 
+  // With a leading GROUPBY, shards reply only with the reducer states of their groups
   vector<ResultContainer> query_results(shard_set->size());
+  vector<aggregate::GroupStates> group_states(shard_set->size());
   cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
     if (auto* index = es->search_indices()->GetIndex(params->index); index) {
-      query_results[es->shard_id()] =
-          index->SearchForAggregator(t->GetOpArgs(es), params.value(), &search_algo);
+      auto docs = index->SearchForAggregator(t->GetOpArgs(es), params.value(), &search_algo);
+      if (params->group)
+        aggregate::ReduceGroups(*params->group, docs, &group_states[es->shard_id()]);
+      else
+        query_results[es->shard_id()] = std::move(docs);
     }
     return OpStatus::OK;
   });
 
   vector<aggregate::DocValues> values;
+  if (params->group) {
+    aggregate::GroupStates merged;
+    for (auto& states : group_states)
+      aggregate::MergeGroups(*params->group, std::move(states), &merged);
+    values = aggregate::FinalizeGroups(*params->group, std::move(merged));
+  }
+
   for (auto& sub_results : query_results) {
     values.insert(values.end(), make_move_iterator(sub_results.begin()),
                   make_move_iterator(sub_results.end()));
@@ -4,12 +4,15 @@
 
 #include "server/search/search_family.h"
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/command_registry.h"
 #include "server/test_utils.h"
 
+ABSL_DECLARE_FLAG(uint32_t, search_build_slice_usec);
+
 using namespace testing;
 using namespace std;
 using namespace util;
@@ -213,7 +216,59 @@ TEST_F(SearchFamilyTest, InfoIndex) {
   EXPECT_THAT(info,
               IsArray(_, _, _, IsArray("key_type", "HASH", "prefix", "doc-"), "attributes",
                       IsArray(IsArray("identifier", "name", "attribute", "name", "type", "TEXT")),
-                      "num_docs", IntArg(15)));
+                      "num_docs", IntArg(15), "indexing", IntArg(0), "percent_indexed", _));
+}
+
+TEST_F(SearchFamilyTest, BackgroundBuild) {
+  // Traverse a single bucket in FT.CREATE and the rest in the background
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_search_build_slice_usec, 0);
+
+  for (size_t i = 0; i < 2000; i++)
+    Run({"hset", absl::StrCat("d:", i), "n", absl::StrCat(i)});
+
+  EXPECT_EQ(Run({"ft.create", "i1", "PREFIX", "1", "d:", "SCHEMA", "n", "NUMERIC"}), "OK");
+
+  // Documents changed during the build are indexed once with their latest values
+  Run({"del", "d:0", "d:1"});
+  Run({"hset", "d:2", "n", "-1"});
+  Run({"hset", "d:5000", "n", "5000"});
+
+  EXPECT_TRUE(WaitUntilCondition(
+      [this] { return Run({"ft.info", "i1"}).GetVec()[9].GetInt() == 0; }, 5s));
+
+  auto info = Run({"ft.info", "i1"});
+  EXPECT_THAT(info.GetVec()[7], IntArg(1999));
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[-1 1]"}), AreDocIds("d:2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[1999 5000]"}), AreDocIds("d:1999", "d:5000"));
+}
+
+TEST_F(SearchFamilyTest, QueryCache) {
+  EXPECT_EQ(Run({"ft.create", "i1", "QUERYCACHE", "100000", "SCHEMA", "t", "TAG", "n", "NUMERIC"}),
+            "OK");
+  for (size_t i = 0; i < 10; i++)
+    Run({"hset", absl::StrCat("d:", i), "t", i % 2 ? "odd" : "even", "n", absl::StrCat(i)});
+
+  // Queries with reordered operands share their entries
+  EXPECT_THAT(Run({"ft.search", "i1", "@t:{odd} @n:[0 5]"}), AreDocIds("d:1", "d:3", "d:5"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@n:[0 5] @t:{odd}"}), AreDocIds("d:1", "d:3", "d:5"));
+
+  // Changed documents invalidate the entries on their shard
+  Run({"hset", "d:7", "n", "4"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@t:{odd} @n:[0 5]"}),
+              AreDocIds("d:1", "d:3", "d:5", "d:7"));
+  Run({"del", "d:1"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@t:{odd} @n:[0 5]"}), AreDocIds("d:3", "d:5", "d:7"));
+
+  size_t shards = shard_set->size();
+  auto info = Run({"ft.info", "i1"});
+  EXPECT_THAT(info.GetVec()[13],
+              IsArray("max_bytes", IntArg(100000), "bytes", _, "entries", IntArg(shards), "hits",
+                      IntArg(3 * shards - 2), "misses", IntArg(shards + 2)));
+
+  // Indices without the option have no cache
+  EXPECT_THAT(Run({"ft.create", "i2", "SCHEMA", "t", "TAG"}), "OK");
+  EXPECT_EQ(Run({"ft.info", "i2"}).GetVec().size(), 12u);
 }
 
 TEST_F(SearchFamilyTest, Stats) {
@@ -410,6 +465,55 @@ TEST_F(SearchFamilyTest, JsonArrayValues) {
 }
 #endif
 
+// Fields with plain paths share a single traversal of the document, the others are evaluated
+// separately. Both must index the same values, for new and for existing documents.
+TEST_F(SearchFamilyTest, JsonPathsTraversal) {
+  string_view D1 = R"({"user": {"name": "alex", "age": 30},
+                       "tags": ["red", "blue"], "price": "12.5", "sizes": [3, 5]})";
+  string_view D2 = R"({"user": {"name": "bob", "age": "41"},
+                       "tags": ["green"], "price": 7, "sizes": [4]})";
+
+  Run({"json.set", "k1", ".", D1});
+
+  auto resp = Run({"ft.create", "i1",
+                   "on",        "json",
+                   "schema",    "$.user.name",
+                   "as",        "name",
+                   "tag",       "$.user.age",
+                   "as",        "age",
+                   "numeric",   "sortable",
+                   "$.tags[*]", "as",
+                   "tags",      "tag",
+                   "$.tags[0]", "as",
+                   "first",     "tag",
+                   "$.price",   "as",
+                   "price",     "numeric",
+                   "$..sizes[*]", "as",
+                   "sizes",     "numeric"});
+  EXPECT_EQ(resp, "OK");
+
+  Run({"json.set", "k2", ".", D2});
+
+  EXPECT_THAT(Run({"ft.search", "i1", "@name:{alex}"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@age:[35 45]"}), AreDocIds("k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{blue}"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{green}"}), AreDocIds("k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@first:{blue}"}), AreDocIds());
+  EXPECT_THAT(Run({"ft.search", "i1", "@first:{red | green}"}), AreDocIds("k1", "k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@price:[10 15]"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@price:[5 10]"}), AreDocIds("k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@sizes:[5 5]"}), AreDocIds("k1"));
+
+  resp = Run({"ft.search", "i1", "*", "sortby", "age", "desc", "return", "1", "name"});
+  EXPECT_THAT(resp,
+              IsArray(IntArg(2), "k2", IsArray("name", "bob"), "k1", IsArray("name", "alex")));
+
+  // Updates remove the old values from the indices.
+  Run({"json.set", "k1", "$.tags[0]", R"("yellow")"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{red}"}), AreDocIds());
+  EXPECT_THAT(Run({"ft.search", "i1", "@first:{yellow}"}), AreDocIds("k1"));
+}
+
 TEST_F(SearchFamilyTest, Tags) {
   Run({"hset", "d:1", "color", "red, green"});
   Run({"hset", "d:2", "color", "green, blue"});
@@ -977,6 +1081,69 @@ TEST_F(SearchFamilyTest, Vector) {
   EXPECT_EQ(resp, "OK");
 }
 
+TEST_F(SearchFamilyTest, VectorStorage) {
+  auto resp = Run({"ft.create", "i1", "ON", "HASH", "SCHEMA", "v", "VECTOR", "FLAT", "8", "TYPE",
+                   "FLOAT32", "DIM", "1", "DISTANCE_METRIC", "L2", "STORAGE", "INT8"});
+  EXPECT_EQ(resp, "OK");
+  resp = Run({"ft.create", "i2", "ON", "HASH", "SCHEMA", "v", "VECTOR", "HNSW", "8", "TYPE",
+              "FLOAT32", "DIM", "1", "DISTANCE_METRIC", "L2", "STORAGE", "FLOAT16"});
+  EXPECT_EQ(resp, "OK");
+
+  auto to_bytes = [](float f) { return string{reinterpret_cast<const char*>(&f), sizeof(f)}; };
+  for (int i = 0; i < 5; i++)
+    Run({"hset", absl::StrCat("k", i), "v", to_bytes(i)});
+
+  for (string_view index : {"i1", "i2"}) {
+    resp = Run({"ft.search", index, "* => [KNN 2 @v $vec]", "PARAMS", "2", "vec", to_bytes(3.9)});
+    EXPECT_THAT(resp, AreDocIds("k4", "k3")) << index;
+  }
+}
+
+// Results ranked across shards are selected by their scores before the documents are loaded.
+TEST_F(SearchFamilyTest, KnnAcrossShards) {
+  auto resp = Run({"ft.create", "i1", "ON", "HASH", "SCHEMA", "v", "VECTOR", "FLAT", "6", "TYPE",
+                   "FLOAT32", "DIM", "1", "DISTANCE_METRIC", "L2", "n", "NUMERIC", "SORTABLE"});
+  EXPECT_EQ(resp, "OK");
+
+  auto to_bytes = [](float f) { return string{reinterpret_cast<const char*>(&f), sizeof(f)}; };
+  for (int i = 0; i < 50; i++)
+    Run({"hset", absl::StrCat("k", i), "v", to_bytes(i), "n", absl::StrCat(i)});
+
+  resp = Run({"ft.search", "i1", "* => [KNN 5 @v $vec]", "PARAMS", "2", "vec", to_bytes(20.2),
+              "RETURN", "0"});
+  EXPECT_THAT(resp, IsArray(IntArg(5), "k20", "k21", "k19", "k22", "k18"));
+
+  resp = Run({"ft.search", "i1", "* => [KNN 5 @v $vec]", "PARAMS", "2", "vec", to_bytes(20.2),
+              "LIMIT", "1", "2", "RETURN", "1", "n"});
+  EXPECT_THAT(resp, IsArray(IntArg(5), "k21", IsArray("n", "21"), "k19", IsArray("n", "19")));
+
+  resp = Run({"ft.search", "i1", "@n:[10 40]", "SORTBY", "n", "DESC", "LIMIT", "0", "3", "RETURN",
+              "0"});
+  ASSERT_EQ(resp.type, RespExpr::ARRAY);
+  auto ids = resp.GetVec();
+  EXPECT_THAT(vector(ids.begin() + 1, ids.end()), ElementsAre("k40", "k39", "k38"));
+}
+
+TEST_F(SearchFamilyTest, Bm25Scoring) {
+  auto resp = Run({"ft.create", "i1", "ON", "HASH", "SCHEMA", "title", "TEXT", "WITHPOSITIONS"});
+  EXPECT_EQ(resp, "OK");
+
+  Run({"hset", "d1", "title", "red apple pie"});
+  Run({"hset", "d2", "title", "apple red"});
+  Run({"hset", "d3", "title", "red red red apple"});
+  Run({"hset", "d4", "title", "green pear"});
+
+  // The statistics for the scores are kept per shard, so the order depends on the distribution
+  resp = Run({"ft.search", "i1", "red", "SCORER", "BM25"});
+  EXPECT_THAT(resp, AreDocIds("d1", "d2", "d3"));
+
+  resp = Run({"ft.search", "i1", "\"red apple\"", "SCORER", "BM25"});
+  EXPECT_THAT(resp, AreDocIds("d1", "d3"));
+
+  resp = Run({"ft.search", "i1", "\"apple red\""});
+  EXPECT_THAT(resp, AreDocIds("d2"));
+}
+
 TEST_F(SearchFamilyTest, EscapedSymbols) {
   Run({"ft.create", "i1", "ON", "HASH", "SCHEMA", "color", "tag"});
 
@@ -5,6 +5,7 @@
 #include "server/server_family.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/random/random.h>  // for master_replid_ generation.
 #include <absl/strings/match.h>
 #include <absl/strings/str_join.h>
@@ -33,11 +34,13 @@ extern "C" {
 #include "core/compact_object.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/dragonfly_connection.h"
+#include "facade/numa.h"
 #include "facade/reply_builder.h"
 #include "io/file_util.h"
 #include "io/proc_reader.h"
 #include "search/doc_index.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/cluster/cluster_defs.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/debugcmd.h"
@@ -47,6 +50,7 @@ extern "C" {
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/generic_family.h"
+#include "server/journal/disk_journal.h"
 #include "server/journal/journal.h"
 #include "server/main_service.h"
 #include "server/memory_cmd.h"
@@ -56,6 +60,7 @@ extern "C" {
 #include "server/script_mgr.h"
 #include "server/server_state.h"
 #include "server/snapshot.h"
+#include "server/snapshot_index.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "server/version.h"
@@ -92,6 +97,10 @@ ABSL_FLAG(string, dbfilename, "dump-{timestamp}",
 ABSL_FLAG(string, requirepass, "",
           "password for AUTH authentication. "
           "If empty can also be set with DFLY_PASSWORD environment variable.");
+ABSL_FLAG(string, journal_dir, "",
+          "If set, shards append their journal records to files in this directory. On startup they "
+          "are replayed on top of the loaded snapshot, so a crash loses at most journal_fsync_ms "
+          "of changes. The directory must be used together with the snapshots of the same dir");
 ABSL_FLAG(uint32_t, maxclients, 64000, "Maximum number of concurrent clients allowed.");
 
 ABSL_FLAG(string, save_schedule, "", "the flag is deprecated, please use snapshot_cron instead");
@@ -99,6 +108,12 @@ ABSL_FLAG(CronExprFlag, snapshot_cron, {},
           "cron expression for the time to save a snapshot, crontab style");
 ABSL_FLAG(bool, df_snapshot_format, true,
           "if true, save in dragonfly-specific snapshotting format");
+ABSL_FLAG(uint32_t, snapshot_max_deltas, 0,
+          "If positive, scheduled snapshots in dragonfly format only save the journal changes "
+          "since the previous snapshot to delta files next to the last full snapshot, until this "
+          "many deltas were saved and a full snapshot is taken again. The changes must still be "
+          "in the journal backlog, see shard_repl_backlog_len and repl_backlog_dir, otherwise a "
+          "full snapshot is taken instead.");
 ABSL_FLAG(int, epoll_file_threads, 0,
           "thread size for file workers when running in epoll mode, default is hardware concurrent "
           "threads");
@@ -110,6 +125,22 @@ ABSL_FLAG(int32_t, slowlog_log_slower_than, 10000,
           "Add commands slower than this threshold to slow log. The value is expressed in "
           "microseconds and if it's negative - disables the slowlog.");
 ABSL_FLAG(uint32_t, slowlog_max_len, 20, "Slow log maximum length.");
+ABSL_FLAG(double, conn_rebalance_threshold, 0,
+          "If positive, once per second a client connection is moved from the connection thread "
+          "with the highest CPU utilization to the one with the lowest, when their utilization "
+          "differs by more than this threshold (0-1). Every connection moves at most once.");
+ABSL_FLAG(uint32_t, conn_affinity_window, 0,
+          "If positive, the shards accessed by the single shard commands of every connection are "
+          "sampled in windows of this many commands. When one shard gets most commands for "
+          "several windows in a row, the connection moves to the thread of that shard, provided "
+          "its CPU utilization is below conn_affinity_max_cpu.");
+ABSL_FLAG(double, conn_affinity_max_cpu, 0.8,
+          "Connections are moved to the thread of their dominant shard only if its CPU "
+          "utilization (0-1) is below this threshold, see conn_affinity_window.");
+ABSL_FLAG(bool, latency_tracking, false,
+          "Collect per command latency histograms split by the phases of their transactions. "
+          "They are reported by LATENCY HISTOGRAM and /metrics, and slow log entries get a trace "
+          "of the phases.");
 
 ABSL_FLAG(string, s3_endpoint, "", "endpoint for s3 snapshots, default uses aws regional endpoint");
 ABSL_FLAG(bool, s3_use_https, true, "whether to use https for s3 endpoints");
@@ -382,14 +413,14 @@ void ClientPauseCmd(CmdArgList args, vector<facade::Listener*> listeners, Connec
   }
 }
 
-void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
+void ClientTracking(CmdArgList args, ServerFamily* sf, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   if (!rb->IsResp3())
     return cntx->SendError(
         "Client tracking is currently not supported for RESP2. Please use RESP3.");
 
   CmdArgParser parser{args};
-  if (!parser.HasAtLeast(1) || args.size() > 3)
+  if (!parser.HasAtLeast(1))
     return cntx->SendError(kSyntaxErr);
 
   bool is_on = false;
@@ -402,34 +433,53 @@ void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
   }
 
   bool noloop = false;
+  bool bcast = false;
+  vector<string> prefixes;
 
-  if (parser.HasNext()) {
-    if (parser.Check("OPTIN")) {
+  while (parser.HasNext()) {
+    if (option == Tracking::NONE && parser.Check("OPTIN")) {
       option = Tracking::OPTIN;
-    } else if (parser.Check("OPTOUT")) {
+    } else if (option == Tracking::NONE && parser.Check("OPTOUT")) {
       option = Tracking::OPTOUT;
-    } else if (parser.Check("NOLOOP")) {
+    } else if (!noloop && parser.Check("NOLOOP")) {
       noloop = true;
+    } else if (!bcast && parser.Check("BCAST")) {
+      bcast = true;
+    } else if (parser.Check("PREFIX")) {
+      if (!parser.HasNext())
+        return cntx->SendError(kSyntaxErr);
+      prefixes.emplace_back(parser.Next<string_view>());
     } else {
       return cntx->SendError(kSyntaxErr);
     }
   }
 
-  if (parser.HasNext()) {
-    if (!noloop && parser.Check("NOLOOP")) {
-      noloop = true;
-    } else {
-      return cntx->SendError(kSyntaxErr);
-    }
-  }
+  if (!prefixes.empty() && !bcast)
+    return cntx->SendError("ERR PREFIX option requires BCAST mode to be enabled");
+  if (bcast && option != Tracking::NONE)
+    return cntx->SendError("ERR OPTIN and OPTOUT are not compatible with BCAST");
+
+  auto& info = cntx->conn_state.tracking_info_;
+  if (is_on && info.IsTrackingOn() && info.IsBcast() != bcast)
+    return cntx->SendError(
+        "ERR You can't switch BCAST mode on/off before disabling tracking for this client, "
+        "and then re-enabling it with a different mode.");
 
   if (is_on) {
     ++cntx->subscriptions;
   }
 
-  cntx->conn_state.tracking_info_.SetClientTracking(is_on);
-  cntx->conn_state.tracking_info_.SetOption(option);
-  cntx->conn_state.tracking_info_.SetNoLoop(noloop);
+  if (bcast || info.IsBcast()) {
+    // Without prefixes a broadcasting client is notified about every key.
+    if (is_on && prefixes.empty())
+      prefixes.emplace_back();
+    sf->SetBcastTracking(cntx, is_on ? std::move(prefixes) : vector<string>{});
+  }
+
+  info.SetClientTracking(is_on);
+  info.SetOption(option);
+  info.SetNoLoop(noloop);
+  info.SetBcast(is_on && bcast);
   return cntx->SendOk();
 }
 
@@ -498,6 +548,33 @@ void ClientId(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendLong(cntx->conn()->GetClientId());
 }
 
+// CLIENT DEADLINE [msec | DEFAULT]
+void ClientDeadline(CmdArgList args, ConnectionContext* cntx) {
+  auto* conn = cntx->conn();
+  if (conn == nullptr) {
+    return cntx->SendError("No connection");
+  }
+
+  if (args.empty()) {
+    return cntx->SendLong(conn->GetDeadline());
+  }
+
+  CmdArgParser parser{args};
+  if (parser.Check("DEFAULT")) {
+    conn->SetDeadline(nullopt);
+  } else {
+    conn->SetDeadline(parser.Next<uint32_t>());
+  }
+
+  if (auto err = parser.Error(); err) {
+    return cntx->SendError(err->MakeReply());
+  }
+  if (parser.HasNext()) {
+    return cntx->SendError(kSyntaxErr);
+  }
+  cntx->SendOk();
+}
+
 void ClientKill(CmdArgList args, absl::Span<facade::Listener*> listeners, ConnectionContext* cntx) {
   std::function<bool(facade::Connection * conn)> evaluator;
 
@@ -582,13 +659,15 @@ struct ReplicaOfArgs {
   std::optional<cluster::SlotRange> slot_range;
   static optional<ReplicaOfArgs> FromCmdArgs(CmdArgList args, ConnectionContext* cntx);
   bool IsReplicaOfNoOne() const {
-    return port == 0;
+    return host.empty();
   }
   friend std::ostream& operator<<(std::ostream& os, const ReplicaOfArgs& args) {
     if (args.IsReplicaOfNoOne()) {
       return os << "NO ONE";
     }
-    os << args.host << ":" << args.port;
+    os << args.host;
+    if (args.host.front() != '/')
+      os << ":" << args.port;
     if (args.slot_range.has_value()) {
       os << " SLOTS [" << args.slot_range.value().start << "-" << args.slot_range.value().end
          << "]";
@@ -607,10 +686,16 @@ optional<ReplicaOfArgs> ReplicaOfArgs::FromCmdArgs(CmdArgList args, ConnectionCo
   } else {
     replicaof_args.host = parser.Next<string>();
     replicaof_args.port = parser.Next<uint16_t>();
-    if (auto err = parser.Error(); err || replicaof_args.port < 1) {
+    // A master on the same host can be replicated over its unix socket, REPLICAOF <path> 0.
+    bool is_unix_socket = !replicaof_args.host.empty() && replicaof_args.host.front() == '/';
+    if (auto err = parser.Error(); err || (replicaof_args.port < 1 && !is_unix_socket)) {
       cntx->SendError("port is out of range");
       return nullopt;
     }
+    if (replicaof_args.host.empty()) {
+      cntx->SendError("host is empty");
+      return nullopt;
+    }
     if (parser.HasNext()) {
       auto [slot_start, slot_end] = parser.Next<cluster::SlotId, cluster::SlotId>();
       replicaof_args.slot_range = cluster::SlotRange{slot_start, slot_end};
@@ -628,12 +713,25 @@ optional<ReplicaOfArgs> ReplicaOfArgs::FromCmdArgs(CmdArgList args, ConnectionCo
   return replicaof_args;
 }
 
+// Makes the space of the preserved tiered backing files that was not referenced by the loaded
+// snapshot available for allocations.
+void FinishTieredRestore() {
+  shard_set->RunBriefInParallel([](EngineShard* es) {
+    if (auto* ts = es->tiered_storage(); ts)
+      ts->FinishRestore();
+  });
+}
+
 }  // namespace
 
 void SlowLogGet(dfly::CmdArgList args, dfly::ConnectionContext* cntx, std::string_view sub_cmd,
                 util::ProactorPool* pp) {
   size_t requested_slow_log_length = UINT32_MAX;
   size_t argc = args.size();
+  bool verbose = argc >= 2 && absl::EqualsIgnoreCase(facade::ArgS(args, argc - 1), "VERBOSE");
+  if (verbose)
+    argc--;
+
   if (argc >= 3) {
     cntx->SendError(facade::UnknownSubCmd(sub_cmd, "SLOWLOG"), facade::kSyntaxErrType);
     return;
@@ -675,7 +773,7 @@ void SlowLogGet(dfly::CmdArgList args, dfly::ConnectionContext* cntx, std::strin
     const auto& entry = merged_slow_log[i].first;
     const auto& args = entry.cmd_args;
 
-    rb->StartArray(6);
+    rb->StartArray(verbose ? 7 : 6);
 
     rb->SendLong(entry.entry_id * pp->size() + merged_slow_log[i].second);
     rb->SendLong(entry.unix_ts_usec / 1000000);
@@ -704,7 +802,40 @@ void SlowLogGet(dfly::CmdArgList args, dfly::ConnectionContext* cntx, std::strin
 
     rb->SendBulkString(entry.client_ip);
     rb->SendBulkString(entry.client_name);
+
+    if (verbose) {
+      const SlowLogDetails& d = entry.details;
+      pair<string_view, uint64_t> fields[] = {
+          {"schedule_usec", d.schedule_usec}, {"queue_usec", d.queue_usec},
+          {"exec_usec", d.exec_usec},         {"reply_usec", d.reply_usec},
+          {"hops", d.hops},                   {"shards", d.shards},
+          {"tiered_reads", d.tiered_reads},   {"reply_bytes", d.reply_bytes},
+      };
+      rb->StartCollection(ABSL_ARRAYSIZE(fields), facade::RedisReplyBuilder::MAP);
+      for (const auto& [name, value] : fields) {
+        rb->SendSimpleString(name);
+        rb->SendLong(value);
+      }
+    }
+  }
+}
+
+// Parses the optional ASYNC|SYNC argument of FLUSHDB and FLUSHALL. The flushed tables are
+// always freed in the background, SYNC only delays the reply until the memory is released.
+std::optional<bool> ParseFlushMode(CmdArgList args) {
+  if (args.empty())
+    return false;
+
+  if (args.size() == 1) {
+    string mode = absl::AsciiStrToUpper(ArgS(args, 0));
+    if (mode == "ASYNC" || mode == "SYNC")
+      return mode == "SYNC";
   }
+  return std::nullopt;
+}
+
+void WaitLazyFree() {
+  shard_set->RunBlockingInParallel([](EngineShard* shard) { shard->lazy_freer()->WaitIdle(); });
 }
 
 std::optional<fb2::Fiber> Pause(std::vector<facade::Listener*> listeners, Namespace* ns,
@@ -758,7 +889,8 @@ std::optional<fb2::Fiber> Pause(std::vector<facade::Listener*> listeners, Namesp
   });
 }
 
-ServerFamily::ServerFamily(Service* service) : service_(*service) {
+ServerFamily::ServerFamily(Service* service)
+    : service_(*service), thread_utilization_(service->proactor_pool().size()) {
   start_time_ = time(NULL);
   last_save_info_.save_time = start_time_;
   script_mgr_.reset(new ScriptMgr());
@@ -807,6 +939,20 @@ void SetSlowLogThreshold(util::ProactorPool& pool, int32_t val) {
   });
 }
 
+void SetLatencyTracking(util::ProactorPool& pool, bool val) {
+  pool.AwaitFiberOnAll([val](auto index, auto* context) {
+    ServerState::tlocal()->latency_tracking = val;
+    if (!val)
+      ServerState::tlocal()->ResetCmdLatency();
+  });
+}
+
+void SetConnAffinityWindow(util::ProactorPool& pool, uint32_t val) {
+  pool.AwaitBrief([val](auto index, auto* context) {
+    ServerState::tlocal()->conn_affinity_window = val;
+  });
+}
+
 void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*> listeners) {
   CHECK(acceptor_ == nullptr);
   acceptor_ = acceptor;
@@ -831,6 +977,22 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
                                       SetSlowLogThreshold(service_.proactor_pool(), res.value());
                                     return res.has_value();
                                   });
+  SetLatencyTracking(service_.proactor_pool(), absl::GetFlag(FLAGS_latency_tracking));
+  config_registry.RegisterMutable("latency_tracking", [this](const absl::CommandLineFlag& flag) {
+    auto res = flag.TryGet<bool>();
+    if (res.has_value())
+      SetLatencyTracking(service_.proactor_pool(), res.value());
+    return res.has_value();
+  });
+  SetConnAffinityWindow(service_.proactor_pool(), absl::GetFlag(FLAGS_conn_affinity_window));
+  config_registry.RegisterMutable("conn_affinity_window",
+                                  [this](const absl::CommandLineFlag& flag) {
+                                    auto res = flag.TryGet<uint32_t>();
+                                    if (res.has_value())
+                                      SetConnAffinityWindow(service_.proactor_pool(), res.value());
+                                    return res.has_value();
+                                  });
+  config_registry.RegisterMutable("conn_affinity_max_cpu");
   SetSlowLogMaxLen(service_.proactor_pool(), absl::GetFlag(FLAGS_slowlog_max_len));
   config_registry.RegisterMutable("slowlog_max_len", [this](const absl::CommandLineFlag& flag) {
     auto res = flag.TryGet<uint32_t>();
@@ -882,8 +1044,17 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
     snapshot_storage_ = std::make_shared<detail::FileSnapshotStorage>(nullptr);
   }
 
+  if (string journal_dir = GetFlag(FLAGS_journal_dir); !journal_dir.empty())
+    disk_journal_ = make_unique<journal::DiskJournal>(journal_.get(), journal_dir);
+
+  // Delta snapshots are cut from the journal, so it runs even without replicas.
+  if (GetFlag(FLAGS_snapshot_max_deltas) > 0)
+    shard_set->RunBlockingInParallel([this](EngineShard*) { journal_->StartInThread(); });
+
   // check for '--replicaof' before loading anything
   if (ReplicaOfFlag flag = GetFlag(FLAGS_replicaof); flag.has_value()) {
+    FinishTieredRestore();
+    StartDiskJournal(false);  // the data is replaced by the full sync
     service_.proactor_pool().GetNextProactor()->Await(
         [this, &flag]() { this->Replicate(flag.host, flag.port); });
   } else {  // load from snapshot only if --replicaof is empty
@@ -916,14 +1087,18 @@ void ServerFamily::LoadFromSnapshot() {
     const std::string load_path = *load_path_result;
     if (!load_path.empty()) {
       auto future = Load(load_path, LoadExistingKeys::kFail);
-      load_fiber_ = service_.proactor_pool().GetNextProactor()->LaunchFiber([future]() mutable {
+      load_fiber_ = service_.proactor_pool().GetNextProactor()->LaunchFiber([this,
+                                                                             future]() mutable {
         // Wait for load to finish in a dedicated fiber.
         // Failure to load on start causes Dragonfly to exit with an error code.
         if (!future.has_value() || future->Get()) {
           // Error was already printed to log at this point.
           exit(1);
         }
+        FinishTieredRestore();
+        StartDiskJournal(true);
       });
+      return;
     }
   } else {
     if (std::error_code(load_path_result.error()) == std::errc::no_such_file_or_directory) {
@@ -934,6 +1109,34 @@ void ServerFamily::LoadFromSnapshot() {
       LOG(ERROR) << "Failed to load snapshot: " << load_path_result.error().Format();
     }
   }
+  FinishTieredRestore();
+  StartDiskJournal(true);
+}
+
+void ServerFamily::StartDiskJournal(bool replay) {
+  if (!disk_journal_)
+    return;
+
+  pb_task_->Await([this, replay] {
+    if (replay) {
+      bool switched =
+          service_.SwitchState(GlobalState::ACTIVE, GlobalState::LOADING) == GlobalState::LOADING;
+      uint64_t segment = loaded_journal_segment_.load(memory_order_relaxed);
+      auto ec = disk_journal_->Replay(segment, &service_);
+      if (switched)
+        service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+      if (ec) {
+        LOG(ERROR) << "Failed to replay journal: " << ec.message();
+        exit(1);
+      }
+    }
+
+    if (auto ec = disk_journal_->Open(); ec) {
+      LOG(ERROR) << "Failed to open journal in " << GetFlag(FLAGS_journal_dir) << ": "
+                 << ec.message();
+      exit(1);
+    }
+  });
 }
 
 void ServerFamily::JoinSnapshotSchedule() {
@@ -966,6 +1169,9 @@ void ServerFamily::Shutdown() {
   }
 
   pb_task_->Await([this] {
+    if (disk_journal_)
+      disk_journal_->Close();
+
     auto ec = journal_->Close();
     LOG_IF(ERROR, ec) << "Error closing journal " << ec;
 
@@ -980,6 +1186,94 @@ void ServerFamily::Shutdown() {
   });
 }
 
+void ServerFamily::RebalanceConnections() {
+#ifndef __APPLE__
+  if (EngineShard::tlocal()->shard_id() != 0)  // runs periodically on all shards
+    return;
+
+  uint64_t now = fb2::ProactorBase::GetMonotonicTimeNs();
+  if (now < last_rebalance_ns_ + 1'000'000'000)
+    return;
+  uint64_t interval_usec = last_rebalance_ns_ ? (now - last_rebalance_ns_) / 1000 : 0;
+  last_rebalance_ns_ = now;
+
+  auto* pool = shard_set->pool();
+  vector<double> utilization(pool->size());
+  pool->AwaitBrief([&](unsigned index, auto*) {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    uint64_t cpu_usec = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1'000'000ULL +
+                        ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+
+    auto* ss = ServerState::tlocal();
+    if (interval_usec)
+      ss->cpu_utilization = double(cpu_usec - ss->cpu_usec) / interval_usec;
+    ss->cpu_usec = cpu_usec;
+    utilization[index] = ss->cpu_utilization;
+    thread_utilization_[index].store(ss->cpu_utilization, memory_order_relaxed);
+  });
+
+  double threshold = absl::GetFlag(FLAGS_conn_rebalance_threshold);
+  if (threshold <= 0 || interval_usec == 0)
+    return;
+
+  auto [start, total] = facade::Listener::ConnectionThreads(pool->size());
+  auto conn_threads = absl::MakeSpan(utilization).subspan(start, total);
+  auto [min_it, max_it] = minmax_element(conn_threads.begin(), conn_threads.end());
+  if (*max_it - *min_it <= threshold)
+    return;
+
+  // Move a connection that was active recently, idle ones do not add to the load.
+  ProactorBase* dest = pool->at(start + (min_it - conn_threads.begin()));
+  pool->at(start + (max_it - conn_threads.begin()))->Await([this, dest] {
+    time_t recent = time(nullptr) - 1;
+    bool moved = false;
+    auto cb = [&](unsigned thread_index, util::Connection* conn) {
+      auto* fconn = static_cast<facade::Connection*>(conn);
+      auto* cntx = fconn->cntx();
+      if (moved || cntx == nullptr || cntx->replica_conn || cntx->journal_emulated ||
+          fconn->LastInteractionTime() < recent)
+        return;
+      moved = fconn->RequestAsyncMigration(dest);
+    };
+    for (auto* listener : listeners_)
+      listener->TraverseConnectionsOnThread(cb);
+
+    if (moved)
+      ServerState::tlocal()->stats.conn_rebalances++;
+  });
+#endif
+}
+
+void ServerFamily::UpdateShardAffinity(ShardId sid, ConnectionContext* cntx) {
+  ServerState* ss = ServerState::SafeTLocal();
+  unsigned thread = ss->thread_index();
+  if (sid == thread)
+    ss->stats.local_shard_cmds++;
+  else
+    ss->stats.remote_shard_cmds++;
+
+  if (ss->conn_affinity_window == 0 || cntx->conn() == nullptr || cntx->replica_conn ||
+      cntx->journal_emulated)
+    return;
+
+  auto target = cntx->conn_state.shard_affinity.Record(sid, thread, ss->conn_affinity_window);
+  if (!target)
+    return;
+
+  // Moving to a busy thread would trade the hops for queueing behind its other work.
+  if (thread_utilization_[*target].load(memory_order_relaxed) >=
+      absl::GetFlag(FLAGS_conn_affinity_max_cpu))
+    return;
+
+  VLOG(2) << "Moving connection " << cntx->conn()->GetClientId() << " from thread " << thread
+          << " to its dominant shard " << *target;
+  if (cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(*target), false)) {
+    cntx->conn_state.shard_affinity.OnMigrated();
+    ss->stats.affinity_migrations++;
+  }
+}
+
 bool ServerFamily::HasPrivilegedInterface() {
   for (auto* listener : listeners_) {
     if (listener->IsPrivilegedInterface()) {
@@ -1036,6 +1330,47 @@ struct AggregateLoadResult {
   std::atomic<size_t> keys_read;
 };
 
+// Returns the shard id encoded in the name of a DF snapshot shard file, e.g. "dump-0003.dfs".
+optional<ShardId> DfsShardId(string_view path) {
+  unsigned sid;
+  if (!absl::ConsumeSuffix(&path, ".dfs") || path.size() < 5 || path[path.size() - 5] != '-' ||
+      !absl::SimpleAtoi(path.substr(path.size() - 4), &sid)) {
+    return nullopt;
+  }
+  return sid;
+}
+
+// Returns the id encoded in the name of a delta snapshot file, e.g. "dump-delta-0002-0003.dfs".
+optional<unsigned> DeltaId(string_view path) {
+  constexpr string_view kTag = "delta-";
+  unsigned id;
+  if (!absl::ConsumeSuffix(&path, ".dfs") || path.size() < 15 ||
+      path.substr(path.size() - 15, kTag.size()) != kTag ||
+      !absl::SimpleAtoi(path.substr(path.size() - 9, 4), &id)) {
+    return nullopt;
+  }
+  return id;
+}
+
+// Forwards reads to the underlying source and counts the bytes read.
+class ProgressSource : public ::io::Source {
+ public:
+  ProgressSource(::io::Source* src, std::atomic_size_t* bytes_read)
+      : src_{src}, bytes_read_{bytes_read} {
+  }
+
+  ::io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final {
+    auto res = src_->ReadSome(v, len);
+    if (res)
+      bytes_read_->fetch_add(*res, memory_order_relaxed);
+    return res;
+  }
+
+ private:
+  ::io::Source* src_;
+  std::atomic_size_t* bytes_read_;
+};
+
 void ServerFamily::FlushAll(ConnectionContext* cntx) {
   const CommandId* cid = service_.FindCmd("FLUSHALL");
   boost::intrusive_ptr<Transaction> flush_trans(new Transaction{cid});
@@ -1047,11 +1382,28 @@ void ServerFamily::FlushAll(ConnectionContext* cntx) {
   }
 }
 
+void ServerFamily::ReplaceDataset(Namespace* staged) {
+  const CommandId* cid = service_.FindCmd("FLUSHALL");
+  boost::intrusive_ptr<Transaction> swap_trans(new Transaction{cid});
+  swap_trans->InitByArgs(&namespaces.GetDefaultNamespace(), 0, {});
+  flush_epoch_.fetch_add(1, memory_order_relaxed);  // deltas can't replay the replacement
+
+  swap_trans->Execute(
+      [staged](Transaction* t, EngineShard* shard) {
+        DbSlice& staged_slice = staged->GetDbSlice(shard->shard_id());
+        t->GetDbSlice(shard->shard_id()).SwapTables(&staged_slice);
+        staged_slice.FlushDb(DbSlice::kDbAll);
+        return OpStatus::OK;
+      },
+      true);
+}
+
 // Load starts as many fibers as there are files to load each one separately.
 // It starts one more fiber that waits for all load fibers to finish and returns the first
 // error (if any occured) with a future.
 std::optional<fb2::Future<GenericError>> ServerFamily::Load(string_view load_path,
-                                                            LoadExistingKeys existing_keys) {
+                                                            LoadExistingKeys existing_keys,
+                                                            optional<DbIndex> load_db) {
   std::string path(load_path);
 
   if (load_path.empty()) {
@@ -1087,6 +1439,7 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(string_view load_pat
     LOG(WARNING) << new_state << " in progress, ignored";
     return {};
   }
+  flush_epoch_.fetch_add(1, memory_order_relaxed);  // loaded keys are not journaled
 
   auto& pool = service_.proactor_pool();
 
@@ -1095,22 +1448,38 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(string_view load_pat
 
   auto aggregated_result = std::make_shared<AggregateLoadResult>();
 
+  load_progress_.start_time.store(time(nullptr), memory_order_relaxed);
+  load_progress_.bytes_total.store(0, memory_order_relaxed);
+  load_progress_.bytes_read.store(0, memory_order_relaxed);
+  load_progress_.files_total.store(paths.size(), memory_order_relaxed);
+  load_progress_.files_done.store(0, memory_order_relaxed);
+
+  // DF snapshots have a file per shard besides the summary. If it was saved with the same number
+  // of shards, keys of each file belong to a single shard. Decoding a file on the thread of that
+  // shard lets the loader insert its keys directly and spreads decoding over all shard threads.
+  bool shard_affinity = paths.size() == shard_count() + 1;
+
   for (auto& path : paths) {
     // For single file, choose thread that does not handle shards if possible.
     // This will balance out the CPU during the load.
     ProactorBase* proactor;
+    optional<ShardId> sid = shard_affinity ? DfsShardId(path) : nullopt;
     if (paths.size() == 1 && shard_count() < pool.size()) {
       proactor = pool.at(shard_count());
+    } else if (sid && *sid < shard_count()) {
+      proactor = pool.at(*sid);
     } else {
       proactor = pool.GetNextProactor();
     }
 
-    auto load_fiber = [this, aggregated_result, existing_keys, path = std::move(path)]() {
-      auto load_result = LoadRdb(path, existing_keys);
+    auto load_fiber = [this, aggregated_result, existing_keys, load_db,
+                       path = std::move(path)]() {
+      auto load_result = LoadRdb(path, existing_keys, load_db);
       if (load_result.has_value())
         aggregated_result->keys_read.fetch_add(*load_result);
       else
         aggregated_result->first_error = load_result.error();
+      load_progress_.files_done.fetch_add(1, memory_order_relaxed);
     };
     load_fibers.push_back(proactor->LaunchFiber(std::move(load_fiber)));
   }
@@ -1118,12 +1487,23 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(string_view load_pat
   fb2::Future<GenericError> future;
 
   // Run fiber that empties the channel and sets ec_promise.
-  auto load_join_fiber = [this, aggregated_result, load_fibers = std::move(load_fibers),
-                          future]() mutable {
+  auto load_join_fiber = [this, aggregated_result, load_fibers = std::move(load_fibers), future,
+                          path, load_db]() mutable {
     for (auto& fiber : load_fibers) {
       fiber.Join();
     }
 
+    // Deltas replay journal changes of all dbs.
+    if (load_db) {
+      LOG_IF(WARNING, !snapshot_storage_->LoadDeltaPaths(path).empty())
+          << "Delta snapshots of " << path << " are not applied when loading a single db";
+    } else if (!aggregated_result->first_error) {
+      if (auto err = LoadDeltas(path); err) {
+        LOG(ERROR) << err.Format();
+        aggregated_result->first_error = err;
+      }
+    }
+
     if (aggregated_result->first_error) {
       LOG(ERROR) << "Rdb load failed. " << (*aggregated_result->first_error).message();
       service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
@@ -1142,6 +1522,44 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(string_view load_pat
   return future;
 }
 
+GenericError ServerFamily::LoadDeltas(const string& summary_path) {
+  vector<string> paths = snapshot_storage_->LoadDeltaPaths(summary_path);
+  auto& pool = service_.proactor_pool();
+  load_progress_.files_total.fetch_add(paths.size(), memory_order_relaxed);
+
+  // Every delta depends on the previous ones. Its files hold the changes of different shards, so
+  // they are applied in parallel.
+  size_t pos = 0;
+  for (unsigned id = 1; pos < paths.size(); ++id) {
+    if (DeltaId(paths[pos]) != id) {
+      LOG(WARNING) << "Delta snapshot " << id << " of " << summary_path
+                   << " is missing, skipping the later ones";
+      break;
+    }
+
+    LOG(INFO) << "Loading delta snapshot " << id << " of " << summary_path;
+    AggregateError first_error;
+    vector<fb2::Fiber> load_fibers;
+    for (; pos < paths.size() && DeltaId(paths[pos]) == id; ++pos) {
+      optional<ShardId> sid = DfsShardId(paths[pos]);
+      ProactorBase* proactor =
+          sid && *sid < shard_count() ? pool.at(*sid) : pool.GetNextProactor();
+      load_fibers.push_back(proactor->LaunchFiber([this, &first_error, path = paths[pos]] {
+        auto load_result = LoadRdb(path, LoadExistingKeys::kOverride);
+        if (!load_result)
+          first_error = load_result.error();
+        load_progress_.files_done.fetch_add(1, memory_order_relaxed);
+      }));
+    }
+
+    for (auto& fiber : load_fibers)
+      fiber.Join();
+    if (first_error)
+      return GenericError{*first_error, StrCat("Failed to load delta snapshot ", id)};
+  }
+  return {};
+}
+
 void ServerFamily::SnapshotScheduling() {
   const std::optional<cron::cronexpr> cron_expr = InferSnapshotCronExpr();
   if (!cron_expr) {
@@ -1161,7 +1579,7 @@ void ServerFamily::SnapshotScheduling() {
       break;
     };
 
-    GenericError ec = DoSave();
+    GenericError ec = DoSave(false, true);
 
     util::fb2::LockGuard lk{loading_stats_mu_};
     loading_stats_.backup_count++;
@@ -1174,20 +1592,54 @@ void ServerFamily::SnapshotScheduling() {
 }
 
 io::Result<size_t> ServerFamily::LoadRdb(const std::string& rdb_file,
-                                         LoadExistingKeys existing_keys) {
+                                         LoadExistingKeys existing_keys,
+                                         optional<DbIndex> load_db) {
+  SnapshotFilter filter;
+  if (load_db)
+    filter.db_mask = SnapshotIndex::DbBit(*load_db);
+  if (const auto* config = cluster::ClusterFamily::cluster_config();
+      config && cluster::IsClusterEnabled()) {
+    filter.slot_groups = 0;
+    for (cluster::SlotId slot = 0; slot <= cluster::kMaxSlotNum; ++slot) {
+      if (config->IsMySlot(slot))
+        filter.slot_groups |= SnapshotIndex::SlotGroupBit(slot);
+    }
+  }
+
   error_code ec;
   io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(rdb_file);
   if (res) {
-    io::FileSource fs(*res);
+    optional<SnapshotIndex> index;
+    if (!filter.IsAll())
+      index = SnapshotIndex::Read(*res);
+
+    // Only the parts of the file that may hold the requested keys are read if it has an index.
+    unique_ptr<::io::Source> file_src;
+    size_t file_size = (*res)->Size();
+    if (index) {
+      auto* index_src = new SnapshotIndexSource(*res, *index, filter);
+      VLOG(1) << "Reading " << index_src->size() << " of " << file_size << " bytes of "
+              << rdb_file;
+      file_size = index_src->size();
+      file_src.reset(index_src);
+    } else {
+      file_src.reset(new io::FileSource(*res));
+    }
+
+    load_progress_.bytes_total.fetch_add(file_size, memory_order_relaxed);
+    ProgressSource src(file_src.get(), &load_progress_.bytes_read);
 
     RdbLoader loader{&service_};
     if (existing_keys == LoadExistingKeys::kOverride) {
       loader.SetOverrideExistingKeys(true);
     }
+    loader.SetLoadDb(load_db);
 
-    ec = loader.Load(&fs);
+    ec = loader.Load(&src);
     if (!ec) {
       VLOG(1) << "Done loading RDB from " << rdb_file << ", keys loaded: " << loader.keys_loaded();
+      if (loader.journal_segment())
+        loaded_journal_segment_.store(loader.journal_segment(), memory_order_relaxed);
       VLOG(1) << "Loading finished after " << strings::HumanReadableElapsedTime(loader.load_time());
       return loader.keys_loaded();
     }
@@ -1254,6 +1706,101 @@ void AppendMetricWithoutLabels(string_view name, string_view help, const absl::A
   AppendMetricValue(name, value, {}, {}, dest);
 }
 
+// Names of the tiered storage histograms, as reported by INFO and /metrics.
+vector<pair<string_view, const base::Histogram*>> TieredHistogramList(
+    const tiering::Histograms& h) {
+  return {{"stash_latency_usec", &h.stash_usec},
+          {"read_latency_usec", &h.read_usec},
+          {"read_queue_usec", &h.read_queue_usec},
+          {"small_bins_dwell_ms", &h.bin_dwell_ms},
+          {"write_depth_percent", &h.write_depth}};
+}
+
+void AppendTieredHistograms(const tiering::Histograms& histograms, string* dest) {
+  constexpr pair<double, string_view> kQuantiles[] = {{50, "0.5"}, {99, "0.99"}, {99.9, "0.999"}};
+  for (const auto& [name, hist] : TieredHistogramList(histograms)) {
+    string metric_name = StrCat("tiered_", name);
+    AppendMetricHeader(metric_name, "", MetricType::SUMMARY, dest);
+    for (auto [percentile, quantile] : kQuantiles)
+      AppendMetricValue(metric_name, hist->Percentile(percentile), {"quantile"}, {quantile}, dest);
+    AppendMetricValue(StrCat(metric_name, "_sum"), hist->Average() * hist->count(), {}, {}, dest);
+    AppendMetricValue(StrCat(metric_name, "_count"), hist->count(), {}, {}, dest);
+  }
+}
+
+// Names of the command latency histograms, as reported by LATENCY HISTOGRAM and /metrics.
+vector<pair<string_view, const base::Histogram*>> CmdLatencyList(
+    const ServerState::CmdLatency& l) {
+  return {{"total", &l.total_usec},
+          {"schedule", &l.schedule_usec},
+          {"queue", &l.queue_usec},
+          {"exec", &l.exec_usec}};
+}
+
+void AppendCmdLatencyHistograms(const map<string, ServerState::CmdLatency>& latency,
+                                string* dest) {
+  constexpr pair<double, string_view> kQuantiles[] = {{50, "0.5"}, {99, "0.99"}, {99.9, "0.999"}};
+  constexpr string_view kName = "command_latency_usec";
+  AppendMetricHeader(kName, "Latency of commands by transaction phase", MetricType::SUMMARY, dest);
+  for (const auto& [cmd, cmd_latency] : latency) {
+    for (const auto& [phase, hist] : CmdLatencyList(cmd_latency)) {
+      if (hist->count() == 0)
+        continue;
+      for (auto [percentile, quantile] : kQuantiles) {
+        AppendMetricValue(kName, hist->Percentile(percentile), {"cmd", "phase", "quantile"},
+                          {cmd, phase, quantile}, dest);
+      }
+      AppendMetricValue(StrCat(kName, "_sum"), hist->Average() * hist->count(), {"cmd", "phase"},
+                        {cmd, phase}, dest);
+      AppendMetricValue(StrCat(kName, "_count"), hist->count(), {"cmd", "phase"}, {cmd, phase},
+                        dest);
+    }
+  }
+}
+
+// Exports the latency buckets of the commands as prometheus histograms
+void AppendCmdLatencyBuckets(const Metrics& m, string* dest) {
+  constexpr string_view kName = "commands_latency_seconds";
+  absl::Span<const uint64_t> bounds = CommandId::LatencyBounds();
+  vector<string> le(bounds.size() + 1, "+Inf");
+  for (size_t i = 0; i < bounds.size(); ++i)
+    le[i] = absl::StrCat(bounds[i] * 1e-6);
+
+  AppendMetricHeader(kName, "Execution time of commands", MetricType::HISTOGRAM, dest);
+  for (const auto& [cmd, buckets] : m.cmd_latency_buckets) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < buckets.size() && i < le.size(); ++i) {
+      cumulative += buckets[i];
+      AppendMetricValue(StrCat(kName, "_bucket"), cumulative, {"cmd", "le"}, {cmd, le[i]}, dest);
+    }
+
+    auto it = m.cmd_stats_map.find(cmd);
+    double sum = it == m.cmd_stats_map.end() ? 0 : it->second.second * 1e-6;
+    AppendMetricValue(StrCat(kName, "_sum"), sum, {"cmd"}, {cmd}, dest);
+    AppendMetricValue(StrCat(kName, "_count"), cumulative, {"cmd"}, {cmd}, dest);
+  }
+}
+
+void AppendScriptStats(const map<string, ServerState::ScriptStats>& script_stats, string* dest) {
+  AppendMetricHeader("lua_script_calls_total", "Calls of lua scripts", MetricType::COUNTER, dest);
+  for (const auto& [sha, stats] : script_stats)
+    AppendMetricValue("lua_script_calls_total", stats.calls, {"sha"}, {sha}, dest);
+
+  // Time in redis.call and the rest of the time, spent running lua code.
+  constexpr string_view kDuration = "lua_script_duration_seconds_total";
+  AppendMetricHeader(kDuration, "Time spent running lua scripts", MetricType::COUNTER, dest);
+  for (const auto& [sha, stats] : script_stats) {
+    AppendMetricValue(kDuration, stats.lua_usec() * 1e-6, {"sha", "part"}, {sha, "lua"}, dest);
+    AppendMetricValue(kDuration, stats.redis_call_usec * 1e-6, {"sha", "part"},
+                      {sha, "redis_call"}, dest);
+  }
+
+  AppendMetricHeader("lua_script_hops_total", "Hops of lua scripts to the shards",
+                     MetricType::COUNTER, dest);
+  for (const auto& [sha, stats] : script_stats)
+    AppendMetricValue("lua_script_hops_total", stats.hops, {"sha"}, {sha}, dest);
+}
+
 void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse* resp) {
   // Server metrics
   AppendMetricHeader("version", "", MetricType::GAUGE, &resp->body());
@@ -1418,6 +1965,14 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
                             &resp->body());
   AppendMetricWithoutLabels("evicted_keys_total", "", m.events.evicted_keys, MetricType::COUNTER,
                             &resp->body());
+  AppendMetricWithoutLabels("expired_pending_bytes",
+                            "Estimated memory of expired keys not deleted yet",
+                            m.expired_pending_bytes, MetricType::GAUGE, &resp->body());
+  AppendMetricWithoutLabels("lazyfree_pending_bytes",
+                            "Memory of deleted values and flushed tables not freed yet",
+                            m.lazy_free_stats.pending_bytes, MetricType::GAUGE, &resp->body());
+  AppendMetricWithoutLabels("lazyfreed_objects_total", "", m.lazy_free_stats.freed_objects_total,
+                            MetricType::COUNTER, &resp->body());
 
   // Command stats
   if (!m.cmd_stats_map.empty()) {
@@ -1446,6 +2001,38 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
                         &replication_lag_metrics);
     }
     absl::StrAppend(&resp->body(), replication_lag_metrics);
+
+    string flow_lag_metrics, flow_throttle_metrics, flow_throttle_time_metrics, flow_buf_metrics;
+    AppendMetricHeader("connected_replica_flow_lag_seconds",
+                       "Time since the oldest unacknowledged record of a replica flow was sent.",
+                       MetricType::GAUGE, &flow_lag_metrics);
+    AppendMetricHeader("connected_replica_flow_throttle_total",
+                       "Number of times a replica flow blocked the journal.", MetricType::COUNTER,
+                       &flow_throttle_metrics);
+    AppendMetricHeader("connected_replica_flow_throttle_seconds_total",
+                       "Time a replica flow blocked the journal.", MetricType::COUNTER,
+                       &flow_throttle_time_metrics);
+    AppendMetricHeader("connected_replica_flow_buffer_bytes",
+                       "Capacity of the output buffers of a replica flow.", MetricType::GAUGE,
+                       &flow_buf_metrics);
+    for (const auto& replica : m.master_side_replicas_info) {
+      for (size_t i = 0; i < replica.flows.size(); ++i) {
+        const auto& flow = replica.flows[i];
+        const vector<string_view> labels = {"replica_ip", "replica_port", "flow"};
+        const string port = absl::StrCat(replica.listening_port), flow_id = absl::StrCat(i);
+        const vector<string_view> values = {replica.address, port, flow_id};
+        AppendMetricValue("connected_replica_flow_lag_seconds", flow.lag_ms * 1e-3, labels, values,
+                          &flow_lag_metrics);
+        AppendMetricValue("connected_replica_flow_throttle_total", flow.throttle_count, labels,
+                          values, &flow_throttle_metrics);
+        AppendMetricValue("connected_replica_flow_throttle_seconds_total",
+                          flow.throttle_usec * 1e-6, labels, values, &flow_throttle_time_metrics);
+        AppendMetricValue("connected_replica_flow_buffer_bytes", flow.buffer_bytes, labels, values,
+                          &flow_buf_metrics);
+      }
+    }
+    absl::StrAppend(&resp->body(), flow_lag_metrics, flow_throttle_metrics,
+                    flow_throttle_time_metrics, flow_buf_metrics);
   }
 
   if (m.replica_side_info) {
@@ -1467,6 +2054,34 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
                             &resp->body());
   AppendMetricWithoutLabels("tx_queue_len", "", m.tx_queue_len, MetricType::GAUGE, &resp->body());
 
+  {
+    constexpr string_view kName = "thread_cpu_seconds_total";
+    AppendMetricHeader(kName, "CPU time of the server threads by class of work",
+                       MetricType::COUNTER, &resp->body());
+    uint64_t other_ns = m.threads_cpu_ns;
+    for (size_t i = 0; i < kNumCpuClasses; ++i) {
+      AppendMetricValue(kName, m.class_cpu_ns[i] * 1e-9, {"class"}, {CpuClassName(CpuClass(i))},
+                        &resp->body());
+      other_ns -= min(other_ns, m.class_cpu_ns[i]);
+    }
+    AppendMetricValue(kName, other_ns * 1e-9, {"class"}, {"other"}, &resp->body());
+  }
+
+  {
+    constexpr pair<double, string_view> kQuantiles[] = {{50, "0.5"}, {99, "0.99"}, {99.9, "0.999"}};
+    constexpr string_view kName = "fiber_run_queue_lag_usec";
+    const base::Histogram& hist = m.run_queue_lag_usec;
+    AppendMetricHeader(kName, "Time ready fibers wait to run", MetricType::SUMMARY, &resp->body());
+    for (auto [percentile, quantile] : kQuantiles) {
+      AppendMetricValue(kName, hist.Percentile(percentile), {"quantile"}, {quantile},
+                        &resp->body());
+    }
+    AppendMetricValue(StrCat(kName, "_sum"), hist.Average() * hist.count(), {}, {}, &resp->body());
+    AppendMetricValue(StrCat(kName, "_count"), hist.count(), {}, {}, &resp->body());
+    AppendMetricWithoutLabels("fiber_run_queue_lag_max_usec", "", m.run_queue_lag_max_usec,
+                              MetricType::GAUGE, &resp->body());
+  }
+
   {
     bool added = false;
     string str;
@@ -1502,6 +2117,18 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
 
   absl::StrAppend(&resp->body(), db_key_metrics);
   absl::StrAppend(&resp->body(), db_key_expire_metrics);
+
+  if (m.tiered_histograms)
+    AppendTieredHistograms(*m.tiered_histograms, &resp->body());
+
+  if (!m.cmd_latency_map.empty())
+    AppendCmdLatencyHistograms(m.cmd_latency_map, &resp->body());
+
+  if (!m.cmd_latency_buckets.empty())
+    AppendCmdLatencyBuckets(m, &resp->body());
+
+  if (!m.script_stats.empty())
+    AppendScriptStats(m.script_stats, &resp->body());
 }
 
 void ServerFamily::ConfigureMetrics(util::HttpListenerBase* http_base) {
@@ -1564,6 +2191,27 @@ optional<Replica::Summary> ServerFamily::GetReplicaSummary() const {
 
 void ServerFamily::OnClose(ConnectionContext* cntx) {
   dfly_cmd_->OnClose(cntx);
+  if (cntx->conn_state.tracking_info_.IsBcast())
+    SetBcastTracking(cntx, {});
+}
+
+void ServerFamily::SetBcastTracking(ConnectionContext* cntx, vector<string> prefixes) {
+  uint32_t client_id = cntx->conn()->GetClientId();
+  util::fb2::LockGuard lk{bcast_tracking_mu_};
+  auto& entries = bcast_tracking_;
+  entries.erase(remove_if(entries.begin(), entries.end(),
+                          [&](const auto& e) { return e.conn.GetClientId() == client_id; }),
+                entries.end());
+  for (auto& prefix : prefixes)
+    entries.push_back({std::move(prefix), cntx->conn()->Borrow()});
+
+  shared_ptr<const ServerState::BcastTrackingTable> table;
+  if (!entries.empty())
+    table = make_shared<const ServerState::BcastTrackingTable>(entries);
+
+  // Published under the lock, so that concurrent updates are applied in order.
+  service_.proactor_pool().AwaitBrief(
+      [&](unsigned, util::ProactorBase*) { ServerState::tlocal()->bcast_tracking = table; });
 }
 
 void ServerFamily::StatsMC(std::string_view section, facade::ConnectionContext* cntx) {
@@ -1611,16 +2259,46 @@ void ServerFamily::StatsMC(std::string_view section, facade::ConnectionContext*
 #undef ADD_LINE
 }
 
-GenericError ServerFamily::DoSave(bool ignore_state) {
+GenericError ServerFamily::DoSave(bool ignore_state, bool allow_delta) {
   const CommandId* cid = service().FindCmd("SAVE");
   CHECK_NOTNULL(cid);
-  boost::intrusive_ptr<Transaction> trans(new Transaction{cid});
-  trans->InitByArgs(&namespaces.GetDefaultNamespace(), 0, {});
-  return DoSave(absl::GetFlag(FLAGS_df_snapshot_format), {}, trans.get(), ignore_state);
+  auto save = [&](bool delta) {
+    boost::intrusive_ptr<Transaction> trans(new Transaction{cid});
+    trans->InitByArgs(&namespaces.GetDefaultNamespace(), 0, {});
+    return DoSave(absl::GetFlag(FLAGS_df_snapshot_format), {}, trans.get(), ignore_state, delta);
+  };
+
+  GenericError ec = save(allow_delta);
+  if (ec && allow_delta) {
+    bool delta_failed;
+    {
+      util::fb2::LockGuard lk(save_mu_);
+      delta_failed = save_delta_role_ == DeltaRole::kDelta;
+    }
+    if (delta_failed) {
+      LOG(WARNING) << "Failed to save delta snapshot, saving a full one: " << ec.Format();
+      ec = save(false);
+    }
+  }
+  return ec;
+}
+
+optional<detail::DeltaSnapshot> ServerFamily::NextDeltaSnapshot() const {
+  if (!delta_chain_ || delta_chain_->deltas >= GetFlag(FLAGS_snapshot_max_deltas))
+    return nullopt;
+
+  // Replicas load full syncs and cluster nodes migrate slots without journaling the values.
+  if (delta_chain_->flush_epoch != flush_epoch_.load(memory_order_relaxed) ||
+      !ServerState::tlocal()->is_master || cluster::IsClusterEnabled()) {
+    return nullopt;
+  }
+  return detail::DeltaSnapshot{delta_chain_->base_path, delta_chain_->deltas + 1,
+                               delta_chain_->lsns};
 }
 
 GenericError ServerFamily::DoSaveCheckAndStart(bool new_version, string_view basename,
-                                               Transaction* trans, bool ignore_state) {
+                                               Transaction* trans, bool ignore_state,
+                                               bool allow_delta, SavePriority priority) {
   auto state = service_.GetGlobalState();
   // In some cases we want to create a snapshot even if server is not active, f.e in takeover
   if (!ignore_state && (state != GlobalState::ACTIVE)) {
@@ -1634,8 +2312,18 @@ GenericError ServerFamily::DoSaveCheckAndStart(bool new_version, string_view bas
                           "SAVING - can not save database"};
     }
 
+    // Only full snapshots in the default location can be the base of deltas, as those are loaded.
+    optional<detail::DeltaSnapshot> delta;
+    save_delta_role_ = DeltaRole::kNone;
+    if (new_version && basename.empty()) {
+      delta = allow_delta ? NextDeltaSnapshot() : nullopt;
+      save_delta_role_ = delta ? DeltaRole::kDelta : DeltaRole::kBase;
+    }
+    save_flush_epoch_ = flush_epoch_.load(memory_order_relaxed);
+
     save_controller_ = make_unique<SaveStagesController>(detail::SaveStagesInputs{
-        new_version, basename, trans, &service_, fq_threadpool_.get(), snapshot_storage_});
+        new_version, basename, trans, &service_, fq_threadpool_.get(), snapshot_storage_,
+        disk_journal_.get(), std::move(delta), priority});
 
     auto res = save_controller_->InitResourcesAndStart();
 
@@ -1660,11 +2348,29 @@ GenericError ServerFamily::WaitUntilSaveFinished(Transaction* trans, bool ignore
 
     if (save_info.error) {
       last_save_info_.SetLastSaveError(save_info);
+      if (save_delta_role_ == DeltaRole::kDelta)
+        delta_chain_.reset();  // the next snapshot is a full one
     } else {
       last_save_info_.save_time = save_info.save_time;
       last_save_info_.success_duration_sec = save_info.duration_sec;
       last_save_info_.file_name = save_info.file_name;
       last_save_info_.freq_map = save_info.freq_map;
+      last_save_info_.peak_buffers_size = save_info.peak_buffers_size;
+      last_save_info_.upload_bytes = save_info.upload_bytes;
+      last_save_info_.upload_bytes_per_sec = save_info.upload_bytes_per_sec;
+      last_save_info_.keys_per_sec = save_info.keys_per_sec;
+
+      if (save_delta_role_ == DeltaRole::kDelta) {
+        delta_chain_->lsns = std::move(save_info.journal_lsns);
+        delta_chain_->deltas++;
+      } else if (save_delta_role_ == DeltaRole::kBase && !save_info.journal_lsns.empty()) {
+        string_view base = save_info.file_name;
+        absl::ConsumeSuffix(&base, "-summary.dfs");
+        delta_chain_ = DeltaChain{string{base}, std::move(save_info.journal_lsns), 0,
+                                  save_flush_epoch_};
+      } else {
+        delta_chain_.reset();
+      }
     }
     save_controller_.reset();
   }
@@ -1673,8 +2379,10 @@ GenericError ServerFamily::WaitUntilSaveFinished(Transaction* trans, bool ignore
 }
 
 GenericError ServerFamily::DoSave(bool new_version, string_view basename, Transaction* trans,
-                                  bool ignore_state) {
-  if (auto ec = DoSaveCheckAndStart(new_version, basename, trans, ignore_state); ec) {
+                                  bool ignore_state, bool allow_delta, SavePriority priority) {
+  if (auto ec =
+          DoSaveCheckAndStart(new_version, basename, trans, ignore_state, allow_delta, priority);
+      ec) {
     return ec;
   }
 
@@ -1692,6 +2400,7 @@ bool ServerFamily::TEST_IsSaving() const {
 
 error_code ServerFamily::Drakarys(Transaction* transaction, DbIndex db_ind) {
   VLOG(1) << "Drakarys";
+  flush_epoch_.fetch_add(1, memory_order_relaxed);  // deltas can't replay flushes
 
   transaction->Execute(
       [db_ind](Transaction* t, EngineShard* shard) {
@@ -1769,14 +2478,23 @@ void ServerFamily::SendInvalidationMessages() const {
 }
 
 void ServerFamily::FlushDb(CmdArgList args, ConnectionContext* cntx) {
+  optional<bool> sync = ParseFlushMode(args);
+  if (!sync) {
+    cntx->SendError(kSyntaxErr);
+    return;
+  }
+
   DCHECK(cntx->transaction);
   Drakarys(cntx->transaction, cntx->transaction->GetDbIndex());
   SendInvalidationMessages();
+  if (*sync)
+    WaitLazyFree();
   cntx->reply_builder()->SendOk();
 }
 
 void ServerFamily::FlushAll(CmdArgList args, ConnectionContext* cntx) {
-  if (args.size() > 1) {
+  optional<bool> sync = ParseFlushMode(args);
+  if (!sync) {
     cntx->SendError(kSyntaxErr);
     return;
   }
@@ -1784,6 +2502,8 @@ void ServerFamily::FlushAll(CmdArgList args, ConnectionContext* cntx) {
   DCHECK(cntx->transaction);
   Drakarys(cntx->transaction, DbSlice::kDbAll);
   SendInvalidationMessages();
+  if (*sync)
+    WaitLazyFree();
   cntx->SendOk();
 }
 
@@ -1852,7 +2572,7 @@ void ServerFamily::Client(CmdArgList args, ConnectionContext* cntx) {
   } else if (sub_cmd == "PAUSE") {
     return ClientPauseCmd(sub_args, GetNonPriviligedListeners(), cntx);
   } else if (sub_cmd == "TRACKING") {
-    return ClientTracking(sub_args, cntx);
+    return ClientTracking(sub_args, this, cntx);
   } else if (sub_cmd == "KILL") {
     return ClientKill(sub_args, absl::MakeSpan(listeners_), cntx);
   } else if (sub_cmd == "CACHING") {
@@ -1861,6 +2581,8 @@ void ServerFamily::Client(CmdArgList args, ConnectionContext* cntx) {
     return ClientSetInfo(sub_args, cntx);
   } else if (sub_cmd == "ID") {
     return ClientId(sub_args, cntx);
+  } else if (sub_cmd == "DEADLINE") {
+    return ClientDeadline(sub_args, cntx);
   }
 
   LOG_FIRST_N(ERROR, 10) << "Subcommand " << sub_cmd << " not supported";
@@ -1967,46 +2689,59 @@ void ServerFamily::BgSaveFb(boost::intrusive_ptr<Transaction> trans) {
   }
 }
 
-std::optional<ServerFamily::VersionBasename> ServerFamily::GetVersionAndBasename(
+std::optional<ServerFamily::SaveCmdOptions> ServerFamily::GetSaveCmdOptions(
     CmdArgList args, ConnectionContext* cntx) {
+  SaveCmdOptions opts{absl::GetFlag(FLAGS_df_snapshot_format), {}};
+
+  // PRIORITY LOW|NORMAL is always the last pair of arguments.
+  if (args.size() >= 2 && absl::EqualsIgnoreCase(ArgS(args, args.size() - 2), "PRIORITY")) {
+    string priority = absl::AsciiStrToUpper(ArgS(args, args.size() - 1));
+    if (priority == "LOW") {
+      opts.priority = SavePriority::kLow;
+    } else if (priority != "NORMAL") {
+      cntx->SendError(kSyntaxErr);
+      return {};
+    }
+    args.remove_suffix(2);
+  }
+
   if (args.size() > 2) {
     cntx->SendError(kSyntaxErr);
     return {};
   }
 
-  bool new_version = absl::GetFlag(FLAGS_df_snapshot_format);
-
   if (args.size() >= 1) {
     string sub_cmd = absl::AsciiStrToUpper(ArgS(args, 0));
     if (sub_cmd == "DF") {
-      new_version = true;
+      opts.new_version = true;
     } else if (sub_cmd == "RDB") {
-      new_version = false;
+      opts.new_version = false;
     } else {
       cntx->SendError(UnknownSubCmd(sub_cmd, "SAVE"), kSyntaxErrType);
       return {};
     }
   }
 
-  string_view basename;
   if (args.size() == 2) {
-    basename = ArgS(args, 1);
+    opts.basename = ArgS(args, 1);
   }
 
-  return ServerFamily::VersionBasename{new_version, basename};
+  return opts;
 }
 
-// BGSAVE [DF|RDB] [basename]
+// BGSAVE [DF|RDB] [basename] [PRIORITY LOW|NORMAL]
 // TODO add missing [SCHEDULE]
 void ServerFamily::BgSave(CmdArgList args, ConnectionContext* cntx) {
-  auto maybe_res = GetVersionAndBasename(args, cntx);
+  auto maybe_res = GetSaveCmdOptions(args, cntx);
   if (!maybe_res) {
     return;
   }
 
-  const auto [version, basename] = *maybe_res;
+  const auto& opts = *maybe_res;
 
-  if (auto ec = DoSaveCheckAndStart(version, basename, cntx->transaction); ec) {
+  if (auto ec = DoSaveCheckAndStart(opts.new_version, opts.basename, cntx->transaction, false,
+                                    false, opts.priority);
+      ec) {
     cntx->SendError(ec.Format());
     return;
   }
@@ -2016,18 +2751,19 @@ void ServerFamily::BgSave(CmdArgList args, ConnectionContext* cntx) {
   cntx->SendOk();
 }
 
-// SAVE [DF|RDB] [basename]
+// SAVE [DF|RDB] [basename] [PRIORITY LOW|NORMAL]
 // Allows saving the snapshot of the dataset on disk, potentially overriding the format
-// and the snapshot name.
+// and the snapshot name. A low priority save adapts its pace to the load of the shards.
 void ServerFamily::Save(CmdArgList args, ConnectionContext* cntx) {
-  auto maybe_res = GetVersionAndBasename(args, cntx);
+  auto maybe_res = GetSaveCmdOptions(args, cntx);
   if (!maybe_res) {
     return;
   }
 
-  const auto [version, basename] = *maybe_res;
+  const auto& opts = *maybe_res;
 
-  GenericError ec = DoSave(version, basename, cntx->transaction);
+  GenericError ec =
+      DoSave(opts.new_version, opts.basename, cntx->transaction, false, false, opts.priority);
   if (ec) {
     cntx->SendError(ec.Format());
   } else {
@@ -2044,6 +2780,11 @@ static void MergeDbSliceStats(const DbSlice::Stats& src, Metrics* dest) {
 
   dest->events += src.events;
   dest->small_string_bytes += src.small_string_bytes;
+  dest->key_prefixes += src.key_prefixes;
+  dest->key_prefix_bytes += src.key_prefix_bytes;
+  dest->expire_wheel_bytes += src.expire_wheel_bytes;
+  dest->reply_cache_bytes += src.reply_cache_bytes;
+  dest->expired_pending_bytes += src.expired_pending_bytes;
 }
 
 void ServerFamily::ResetStat(Namespace* ns) {
@@ -2053,11 +2794,13 @@ void ServerFamily::ResetStat(Namespace* ns) {
         ns->GetCurrentDbSlice().ResetEvents();
         facade::ResetStats();
         ServerState::tlocal()->exec_freq_count.clear();
+        ServerState::tlocal()->ResetScriptStats();
       });
 }
 
 Metrics ServerFamily::GetMetrics(Namespace* ns) const {
   Metrics result;
+  result.thread_utilization.resize(service_.proactor_pool().size());
   util::fb2::Mutex mu;
 
   auto cmd_stat_cb = [&dest = result.cmd_stats_map](string_view name, const CmdCallStats& stat) {
@@ -2066,12 +2809,28 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
     sum += stat.second;
   };
 
+  auto cmd_latency_bucket_cb = [&dest = result.cmd_latency_buckets](
+                                   string_view name, absl::Span<const uint64_t> buckets) {
+    if (buckets.empty())
+      return;
+    auto& merged = dest[absl::AsciiStrToLower(name)];
+    merged.resize(buckets.size());
+    for (size_t i = 0; i < buckets.size(); ++i)
+      merged[i] += buckets[i];
+  };
+
   auto cb = [&](unsigned index, ProactorBase* pb) {
     EngineShard* shard = EngineShard::tlocal();
     ServerState* ss = ServerState::tlocal();
 
     lock_guard lk(mu);
 
+    result.thread_utilization[index] = ss->cpu_utilization;
+    result.threads_cpu_ns += CpuClassScope::ThreadCpuNs();
+    for (size_t i = 0; i < kNumCpuClasses; ++i)
+      result.class_cpu_ns[i] += ss->class_cpu_ns[i];
+    result.run_queue_lag_usec.Merge(ss->run_queue_lag_usec);
+    result.run_queue_lag_max_usec = max(result.run_queue_lag_max_usec, ss->run_queue_lag_max_usec);
     result.fiber_switch_cnt += fb2::FiberSwitchEpoch();
     result.fiber_switch_delay_usec += fb2::FiberSwitchDelayUsec();
     result.fiber_longrun_cnt += fb2::FiberLongRunCnt();
@@ -2091,15 +2850,34 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
       result.heap_used_bytes += shard->UsedMemory();
       MergeDbSliceStats(ns->GetDbSlice(shard->shard_id()).GetStats(), &result);
       result.shard_stats += shard->stats();
+      result.lazy_free_stats += shard->lazy_freer()->stats();
+
+      if (const HugePageResource* hp = shard->huge_page_resource(); hp) {
+        if (!result.segment_huge_pages)
+          result.segment_huge_pages.emplace();
+        const HugePageResource::Stats& st = hp->stats();
+        result.segment_huge_pages->chunk_bytes += st.chunk_bytes;
+        result.segment_huge_pages->used_bytes += st.used_bytes;
+        result.segment_huge_pages->explicit_chunks += st.explicit_chunks;
+        result.segment_huge_pages->fallback_allocs += st.fallback_allocs;
+      }
 
       if (shard->tiered_storage()) {
         result.tiered_stats += shard->tiered_storage()->GetStats();
+        if (const auto* histograms = shard->tiered_storage()->GetHistograms(); histograms) {
+          if (!result.tiered_histograms)
+            result.tiered_histograms.emplace();
+          result.tiered_histograms->Merge(*histograms);
+        }
       }
 
       if (shard->search_indices()) {
         result.search_stats += shard->search_indices()->GetStats();
       }
 
+      if (shard->journal())
+        result.repl_backlog_stats += shard->journal()->GetBacklogStats();
+
       result.traverse_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_TRAVERSE);
       result.delete_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_DELETE);
       if (result.tx_queue_len < shard->txq()->size())
@@ -2117,6 +2895,13 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
     }
 
     service_.mutable_registry()->MergeCallStats(index, cmd_stat_cb);
+    service_.mutable_registry()->MergeLatencyBuckets(index, cmd_latency_bucket_cb);
+
+    for (const auto& [cmd, latency] : ss->cmd_latency_histos())
+      result.cmd_latency_map[absl::AsciiStrToLower(cmd)].Merge(latency);
+
+    for (const auto& [sha, stats] : ss->script_stats())
+      result.script_stats[sha] += stats;
   };  // cb
 
   service_.proactor_pool().AwaitFiberOnAll(std::move(cb));
@@ -2126,10 +2911,11 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
   result.traverse_ttl_per_sec /= 6;
   result.delete_ttl_per_sec /= 6;
 
+  // Replicas can serve downstream replicas as well.
+  result.master_side_replicas_info = dfly_cmd_->GetReplicasRoleInfo();
+
   bool is_master = ServerState::tlocal() && ServerState::tlocal()->is_master;
-  if (is_master) {
-    result.master_side_replicas_info = dfly_cmd_->GetReplicasRoleInfo();
-  } else {
+  if (!is_master) {
     auto info = GetReplicaSummary();
     if (info) {
       result.replica_side_info = {
@@ -2142,6 +2928,11 @@ Metrics ServerFamily::GetMetrics(Namespace* ns) const {
     util::fb2::LockGuard lk{loading_stats_mu_};
     result.loading_stats = loading_stats_;
   }
+  result.loading_stats.load_start_time = load_progress_.start_time.load(memory_order_relaxed);
+  result.loading_stats.load_bytes_total = load_progress_.bytes_total.load(memory_order_relaxed);
+  result.loading_stats.load_bytes_read = load_progress_.bytes_read.load(memory_order_relaxed);
+  result.loading_stats.load_files_total = load_progress_.files_total.load(memory_order_relaxed);
+  result.loading_stats.load_files_done = load_progress_.files_done.load(memory_order_relaxed);
 
   // Update peak stats. We rely on the fact that GetMetrics is called frequently enough to
   // update peak_stats_ from it.
@@ -2255,12 +3046,36 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("listpack_blobs", total.listpack_blob_cnt);
     append("listpack_bytes", total.listpack_bytes);
     append("small_string_bytes", m.small_string_bytes);
+    if (m.key_prefixes > 0) {
+      append("key_prefixes", m.key_prefixes);
+      append("key_prefix_bytes", m.key_prefix_bytes);
+    }
+    if (m.expire_wheel_bytes > 0) {
+      append("expire_wheel_bytes", m.expire_wheel_bytes);
+    }
+    if (m.reply_cache_bytes > 0) {
+      append("reply_cache_bytes", m.reply_cache_bytes);
+    }
+    append("expired_pending_bytes", m.expired_pending_bytes);
+    append("lazyfree_pending_objects", m.lazy_free_stats.pending_objects);
+    append("lazyfree_pending_bytes", m.lazy_free_stats.pending_bytes);
+    append("lazyfreed_objects", m.lazy_free_stats.freed_objects_total);
+    append("mem_purge_total", m.shard_stats.mem_purge_total);
+    append("mem_purge_returned_bytes", m.shard_stats.mem_purge_returned_bytes);
+    if (m.segment_huge_pages) {
+      append("segment_hugepage_bytes", m.segment_huge_pages->chunk_bytes);
+      append("segment_hugepage_used_bytes", m.segment_huge_pages->used_bytes);
+      append("segment_hugepage_explicit_chunks", m.segment_huge_pages->explicit_chunks);
+      append("segment_hugepage_fallbacks", m.segment_huge_pages->fallback_allocs);
+    }
     append("pipeline_cache_bytes", m.facade_stats.conn_stats.pipeline_cmd_cache_bytes);
     append("dispatch_queue_bytes", m.facade_stats.conn_stats.dispatch_queue_bytes);
     append("dispatch_queue_subscriber_bytes",
            m.facade_stats.conn_stats.dispatch_queue_subscriber_bytes);
     append("dispatch_queue_peak_bytes", m.peak_stats.conn_dispatch_queue_bytes);
     append("client_read_buffer_peak_bytes", m.peak_stats.conn_read_buf_capacity);
+    append("client_read_buffer_pool_bytes", m.facade_stats.conn_stats.read_buf_pool_bytes);
+    append("client_read_buffer_saved_bytes", m.facade_stats.conn_stats.read_buf_saved_bytes);
     append("tls_bytes", m.tls_bytes);
     append("snapshot_serialization_bytes", m.serialization_bytes);
 
@@ -2274,6 +3089,15 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       append("maxmemory_policy", "noeviction");
     }
 
+    // Host wide counters of the pages allocated on the intended node vs. on other nodes.
+    if (facade::NumaMemoryStats numa; facade::ReadNumaMemoryStats(&numa)) {
+      uint64_t total_pages = numa.local_pages + numa.remote_pages;
+      append("numa_nodes", facade::NumaTopology::Get().num_nodes());
+      append("numa_local_pages", numa.local_pages);
+      append("numa_remote_pages", numa.remote_pages);
+      append("numa_remote_ratio", total_pages ? double(numa.remote_pages) / total_pages : 0.0);
+    }
+
     if (!m.master_side_replicas_info.empty()) {
       ReplicationMemoryStats repl_mem;
       dfly_cmd_->GetReplicationMemoryStats(&repl_mem);
@@ -2299,22 +3123,49 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("total_pipelined_commands", conn_stats.pipelined_cmd_cnt);
     append("total_pipelined_squashed_commands", m.coordinator_stats.squashed_commands);
     append("pipelined_latency_usec", conn_stats.pipelined_cmd_latency);
+    append("pipeline_squash_threshold_updates", conn_stats.squash_threshold_updates);
+    append("pipeline_squash_batch_updates", conn_stats.squash_batch_updates);
+    append("pipeline_shed_commands", conn_stats.pipeline_shed_cnt);
+    append("slow_subscriber_disconnections", conn_stats.slow_subscriber_disconnects);
+    append("tls_handshakes", conn_stats.tls_handshakes);
+    append("tls_handshakes_resumed", conn_stats.tls_handshakes_resumed);
+    append("tls_handshake_failures", conn_stats.tls_handshake_failures);
+    append("tls_handshakes_throttled", conn_stats.tls_handshakes_throttled);
+    append("tls_handshake_usec", conn_stats.tls_handshake_usec);
     append("total_net_input_bytes", conn_stats.io_read_bytes);
     append("connection_migrations", conn_stats.num_migrations);
+    append("connection_rebalances", m.coordinator_stats.conn_rebalances);
+    append("connection_affinity_migrations", m.coordinator_stats.affinity_migrations);
+    append("local_shard_commands", m.coordinator_stats.local_shard_cmds);
+    append("remote_shard_commands", m.coordinator_stats.remote_shard_cmds);
     append("total_net_output_bytes", reply_stats.io_write_bytes);
+    append("zerocopy_sends", reply_stats.zerocopy_send_cnt);
+    append("zerocopy_send_bytes", reply_stats.zerocopy_send_bytes);
+    append("zerocopy_copied_sends", reply_stats.zerocopy_copied_cnt);
     append("rdb_save_usec", m.coordinator_stats.rdb_save_usec);
     append("rdb_save_count", m.coordinator_stats.rdb_save_count);
+    append("zero_copy_get_replies", m.coordinator_stats.zero_copy_get_cnt);
+    append("zero_copy_get_bytes", m.coordinator_stats.zero_copy_get_bytes);
+    append("hot_key_replicas", total.hot_key_replicas);
+    append("hot_key_replica_hits", m.coordinator_stats.hot_key_replica_hits);
+    append("hot_key_replica_misses", m.coordinator_stats.hot_key_replica_misses);
+    append("reply_cache_hits", m.coordinator_stats.reply_cache_hits);
+    append("reply_cache_misses", m.coordinator_stats.reply_cache_misses);
     append("instantaneous_input_kbps", -1);
     append("instantaneous_output_kbps", -1);
     append("rejected_connections", -1);
     append("expired_keys", m.events.expired_keys);
     append("evicted_keys", m.events.evicted_keys);
+    append("evicted_volatile_keys", m.events.evicted_volatile_keys);
     append("hard_evictions", m.events.hard_evictions);
     append("garbage_checked", m.events.garbage_checked);
     append("garbage_collected", m.events.garbage_collected);
     append("bump_ups", m.events.bumpups);
     append("stash_unloaded", m.events.stash_unloaded);
     append("oom_rejections", m.events.insertion_rejections + m.coordinator_stats.oom_error_cmd_cnt);
+    if (m.events.admission_rejections > 0) {
+      append("admission_rejections", m.events.admission_rejections);
+    }
     append("traverse_ttl_sec", m.traverse_ttl_per_sec);
     append("delete_ttl_sec", m.delete_ttl_per_sec);
     append("keyspace_hits", m.events.hits);
@@ -2325,11 +3176,24 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("defrag_attempt_total", m.shard_stats.defrag_attempt_total);
     append("defrag_realloc_total", m.shard_stats.defrag_realloc_total);
     append("defrag_task_invocation_total", m.shard_stats.defrag_task_invocation_total);
+    for (unsigned type = 0; type < m.shard_stats.defrag_moved_bytes.size(); type++) {
+      if (size_t bytes = m.shard_stats.defrag_moved_bytes[type]; bytes > 0)
+        append(absl::StrCat("defrag_moved_bytes_", ObjTypeToString(type)), bytes);
+    }
     append("reply_count", reply_stats.send_stats.count);
     append("reply_latency_usec", reply_stats.send_stats.total_duration);
     append("blocked_on_interpreter", m.coordinator_stats.blocked_on_interpreter);
     append("lua_interpreter_cnt", m.lua_stats.interpreter_cnt);
     append("lua_blocked", m.lua_stats.blocked_cnt);
+    append("lua_bytecode_loads", m.lua_stats.bytecode_loads);
+    append("lua_arena_allocs", m.lua_stats.arena_allocs);
+    append("lua_arena_resets", m.lua_stats.arena_resets);
+    append("lua_arena_peak_bytes", m.lua_stats.arena_peak_bytes);
+    append("lua_memory_aborts", m.lua_stats.memory_aborts);
+
+    Interpreter::BytecodeCacheStats bytecode_stats = Interpreter::GetBytecodeCacheStats();
+    append("lua_bytecode_cache_entries", bytecode_stats.entries);
+    append("lua_bytecode_cache_bytes", bytecode_stats.bytes);
   }
 
   if (should_enter("TIERED", true)) {
@@ -2344,12 +3208,24 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tiered_total_stash_overflows", m.tiered_stats.total_stash_overflows);
     append("tiered_heap_buf_allocations", m.tiered_stats.total_heap_buf_allocs);
     append("tiered_registered_buf_allocations", m.tiered_stats.total_registered_buf_allocs);
+    append("tiered_total_coalesced_reads", m.tiered_stats.total_coalesced_reads);
+    append("tiered_total_range_reads", m.tiered_stats.total_range_reads);
+    append("tiered_total_compressed_stashes", m.tiered_stats.total_compressed_stashes);
 
     append("tiered_allocated_bytes", m.tiered_stats.allocated_bytes);
     append("tiered_capacity_bytes", m.tiered_stats.capacity_bytes);
+    append("tiered_committed_bytes", m.tiered_stats.committed_bytes);
+    double fragmentation = 0;
+    if (m.tiered_stats.committed_bytes > 0)
+      fragmentation = 1 - double(m.tiered_stats.allocated_bytes) / m.tiered_stats.committed_bytes;
+    append("tiered_fragmentation_ratio", fragmentation);
+    append("tiered_released_bytes", m.tiered_stats.total_released_bytes);
+    append("tiered_evacuations", m.tiered_stats.total_evacuations);
 
     append("tiered_pending_read_cnt", m.tiered_stats.pending_read_cnt);
     append("tiered_pending_stash_cnt", m.tiered_stats.pending_stash_cnt);
+    for (unsigned i = 0; i < m.tiered_stats.backing_files; ++i)
+      append(absl::StrCat("tiered_file", i, "_pending_ops"), m.tiered_stats.file_pending_ops[i]);
 
     append("tiered_small_bins_cnt", m.tiered_stats.small_bins_cnt);
     append("tiered_small_bins_entries_cnt", m.tiered_stats.small_bins_entries_cnt);
@@ -2357,9 +3233,25 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tiered_cold_storage_bytes", m.tiered_stats.cold_storage_bytes);
     append("tiered_offloading_steps", m.tiered_stats.total_offloading_steps);
     append("tiered_offloading_stashes", m.tiered_stats.total_offloading_stashes);
+    append("tiered_hot_skips", m.tiered_stats.total_hot_skips);
+
+    // Share of stashed values that were read back into memory.
+    double upload_churn = 0;
+    if (m.tiered_stats.total_stashes > 0)
+      upload_churn = double(m.tiered_stats.total_uploads) / m.tiered_stats.total_stashes;
+    append("tiered_upload_churn", upload_churn);
     append("tiered_ram_hits", m.events.ram_hits);
     append("tiered_ram_cool_hits", m.events.ram_cool_hits);
     append("tiered_ram_misses", m.events.ram_misses);
+
+    if (m.tiered_histograms) {
+      for (const auto& [name, hist] : TieredHistogramList(*m.tiered_histograms)) {
+        append(StrCat("tiered_", name, "_count"), hist->count());
+        append(StrCat("tiered_", name, "_p50"), hist->Percentile(50));
+        append(StrCat("tiered_", name, "_p99"), hist->Percentile(99));
+        append(StrCat("tiered_", name, "_p999"), hist->Percentile(99.9));
+      }
+    }
   }
 
   if (should_enter("PERSISTENCE", true)) {
@@ -2391,9 +3283,29 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("last_success_save", save_info.save_time);
     append("last_saved_file", save_info.file_name);
     append("last_success_save_duration_sec", save_info.success_duration_sec);
+    append("last_success_save_peak_buffers_bytes", save_info.peak_buffers_size);
+    append("last_success_save_upload_bytes", save_info.upload_bytes);
+    append("last_success_save_upload_bytes_per_sec", save_info.upload_bytes_per_sec);
+    append("last_success_save_keys_per_sec", save_info.keys_per_sec);
 
     size_t is_loading = service_.GetGlobalState() == GlobalState::LOADING;
     append("loading", is_loading);
+    if (is_loading) {
+      const LoadingStats& ls = m.loading_stats;
+      time_t elapsed = time(nullptr) - ls.load_start_time;
+      double perc = ls.load_bytes_total ? 100.0 * ls.load_bytes_read / ls.load_bytes_total : 0;
+      size_t eta = 0;
+      if (ls.load_bytes_read > 0 && ls.load_bytes_read < ls.load_bytes_total)
+        eta = elapsed * (ls.load_bytes_total - ls.load_bytes_read) / ls.load_bytes_read;
+
+      append("loading_start_time", ls.load_start_time);
+      append("loading_total_bytes", ls.load_bytes_total);
+      append("loading_loaded_bytes", ls.load_bytes_read);
+      append("loading_loaded_perc", perc);
+      append("loading_eta_seconds", eta);
+      append("loading_files_total", ls.load_files_total);
+      append("loading_files_done", ls.load_files_done);
+    }
     append("saving", is_saving);
     append("current_save_duration_sec", curent_durration_sec);
 
@@ -2411,7 +3323,9 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
   if (should_enter("TRANSACTION", true)) {
     append("tx_shard_polls", m.shard_stats.poll_execution_total);
     append("tx_shard_optimistic_total", m.shard_stats.tx_optimistic_total);
+    append("tx_shard_optimistic_unlocked_total", m.shard_stats.tx_optimistic_unlocked_total);
     append("tx_shard_ooo_total", m.shard_stats.tx_ooo_total);
+    append("tx_shard_ooo_promoted_total", m.shard_stats.tx_ooo_promoted_total);
     append("tx_global_total", m.coordinator_stats.tx_global_cnt);
     append("tx_normal_total", m.coordinator_stats.tx_normal_cnt);
     append("tx_inline_runs_total", m.coordinator_stats.tx_inline_runs);
@@ -2420,6 +3334,8 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tx_batch_schedule_calls_total", m.shard_stats.tx_batch_schedule_calls_total);
     append("tx_with_freq", absl::StrJoin(m.coordinator_stats.tx_width_freq_arr, ","));
     append("tx_queue_len", m.tx_queue_len);
+    append("tx_pool_hits_total", m.coordinator_stats.tx_pool_hits);
+    append("tx_pool_misses_total", m.coordinator_stats.tx_pool_misses);
 
     append("eval_io_coordination_total", m.coordinator_stats.eval_io_coordination_cnt);
     append("eval_shardlocal_coordination_total",
@@ -2436,17 +3352,43 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     // ensuring eventual consistency of is_master. When determining if the server is a replica and
     // accessing the replica_ object, we must lock replicaof_mu_. Using is_master alone is
     // insufficient in this scenario.
-    if (!replica_) {
-      append("role", "master");
+    auto replicas_info_cb = [&] {
       append("connected_slaves", m.facade_stats.conn_stats.num_replicas);
       const auto& replicas = m.master_side_replicas_info;
       for (size_t i = 0; i < replicas.size(); i++) {
         auto& r = replicas[i];
-        // e.g. slave0:ip=172.19.0.3,port=6379,state=full_sync
-        append(StrCat("slave", i), StrCat("ip=", r.address, ",port=", r.listening_port,
-                                          ",state=", r.state, ",lag=", r.lsn_lag));
+        ReplicaFlowStats total;
+        for (const auto& flow : r.flows) {
+          total.throttle_count += flow.throttle_count;
+          total.throttle_usec += flow.throttle_usec;
+          total.buffer_bytes += flow.buffer_bytes;
+        }
+        // e.g. slave0:ip=172.19.0.3,port=6379,state=full_sync,lag_ms=0,...,lag=0
+        // lag stays last, as clients parse it as the end of the line.
+        append(StrCat("slave", i),
+               StrCat("ip=", r.address, ",port=", r.listening_port, ",state=", r.state,
+                      ",lag_ms=", r.lag_ms, ",throttle_count=", total.throttle_count,
+                      ",throttle_usec=", total.throttle_usec, ",buffer_bytes=", total.buffer_bytes,
+                      ",lag=", r.lsn_lag));
+        for (size_t j = 0; j < r.flows.size(); ++j) {
+          const auto& flow = r.flows[j];
+          append(StrCat("slave", i, "_flow", j),
+                 StrCat("lag_ms=", flow.lag_ms, ",throttle_count=", flow.throttle_count,
+                        ",throttle_usec=", flow.throttle_usec,
+                        ",buffer_bytes=", flow.buffer_bytes));
+        }
       }
+    };
+
+    if (!replica_) {
+      append("role", "master");
+      replicas_info_cb();
       append("master_replid", master_replid_);
+      if (uint64_t first_time = m.repl_backlog_stats.first_time; first_time) {
+        uint64_t now = time(nullptr);
+        append("repl_backlog_disk_bytes", m.repl_backlog_stats.disk_bytes);
+        append("repl_backlog_retention_sec", now - min(now, first_time));
+      }
     } else {
       append("role", GetFlag(FLAGS_info_replication_valkey_compatible) ? "slave" : "replica");
 
@@ -2458,9 +3400,21 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
         append("master_link_status", link);
         append("master_last_io_seconds_ago", rinfo.master_last_io_sec);
         append("master_sync_in_progress", rinfo.full_sync_in_progress);
+        if (rinfo.stale_repl_offset) {
+          append("master_sync_serving_stale", 1);
+          append("stale_repl_offset", *rinfo.stale_repl_offset);
+        }
         append("master_replid", rinfo.master_id);
         if (rinfo.full_sync_done)
           append("slave_repl_offset", rinfo.repl_offset_sum);
+        for (size_t i = 0; i < rinfo.flow_compression_ratios.size(); ++i) {
+          append(StrCat("flow", i, "_compression_ratio"), rinfo.flow_compression_ratios[i]);
+        }
+        if (!rinfo.flow_lag_ms.empty()) {
+          append("master_lag_ms", *max_element(rinfo.flow_lag_ms.begin(), rinfo.flow_lag_ms.end()));
+          for (size_t i = 0; i < rinfo.flow_lag_ms.size(); ++i)
+            append(StrCat("flow", i, "_lag_ms"), rinfo.flow_lag_ms[i]);
+        }
         append("slave_priority", GetFlag(FLAGS_replica_priority));
         append("slave_read_only", 1);
       };
@@ -2470,6 +3424,10 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       for (const auto& replica : cluster_replicas_) {
         replication_info_cb(replica->GetSummary());
       }
+
+      // Downstream replicas of this replica.
+      if (!m.master_side_replicas_info.empty())
+        replicas_info_cb();
     }
   }
 
@@ -2542,6 +3500,23 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("used_cpu_user_children", StrCat(cu.ru_utime.tv_sec, ".", cu.ru_utime.tv_usec));
     append("used_cpu_sys_main_thread", StrCat(tu.ru_stime.tv_sec, ".", tu.ru_stime.tv_usec));
     append("used_cpu_user_main_thread", StrCat(tu.ru_utime.tv_sec, ".", tu.ru_utime.tv_usec));
+    append("thread_utilization", absl::StrJoin(m.thread_utilization, ",", [](string* out, double u) {
+             absl::StrAppend(out, absl::SixDigits(u));
+           }));
+
+    auto cpu_seconds = [](uint64_t ns) {
+      uint64_t usec = ns / 1000;
+      return StrCat(usec / 1'000'000, ".", absl::Dec(usec % 1'000'000, absl::kZeroPad6));
+    };
+    uint64_t other_ns = m.threads_cpu_ns;
+    for (size_t i = 0; i < kNumCpuClasses; ++i) {
+      append(StrCat("used_cpu_", CpuClassName(CpuClass(i))), cpu_seconds(m.class_cpu_ns[i]));
+      other_ns -= min(other_ns, m.class_cpu_ns[i]);
+    }
+    append("used_cpu_other", cpu_seconds(other_ns));
+    append("run_queue_lag_p50_usec", m.run_queue_lag_usec.Percentile(50));
+    append("run_queue_lag_p99_usec", m.run_queue_lag_usec.Percentile(99));
+    append("run_queue_lag_max_usec", m.run_queue_lag_max_usec);
   }
 #endif
 
@@ -2715,6 +3690,9 @@ void ServerFamily::ReplicaOfInternal(CmdArgList args, ConnectionContext* cntx,
       Drakarys(cntx->transaction, DbSlice::kDbAll);
     }
 
+    // The flush and the full sync are not journaled, so downstream replicas must resync.
+    dfly_cmd_->CancelAllReplicas();
+
     // Create a new replica and assing it
     new_replica = make_shared<Replica>(replicaof_args->host, replicaof_args->port, &service_,
                                        master_replid(), replicaof_args->slot_range);
@@ -2823,14 +3801,9 @@ void ServerFamily::ReplTakeOver(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendOk();
 }
 
+// Replicas can serve downstream replicas as well: the records they apply from their master are
+// recorded to their own journal, which is streamed with their own lsns.
 void ServerFamily::ReplConf(CmdArgList args, ConnectionContext* cntx) {
-  {
-    util::fb2::LockGuard lk(replicaof_mu_);
-    if (!ServerState::tlocal()->is_master) {
-      return cntx->SendError("Replicating a replica is unsupported");
-    }
-  }
-
   auto err_cb = [&]() mutable {
     LOG(ERROR) << "Error in receiving command: " << args;
     cntx->SendError(kSyntaxErr);
@@ -2892,6 +3865,11 @@ void ServerFamily::ReplConf(CmdArgList args, ConnectionContext* cntx) {
         return cntx->SendError(kInvalidIntErr);
       }
       dfly_cmd_->SetDflyClientVersion(cntx, DflyVersion(version));
+    } else if (cmd == "JOURNAL-COMPRESSION" && args.size() == 2) {
+      if (!absl::EqualsIgnoreCase(arg, "lz4")) {
+        return cntx->SendError(kSyntaxErr);
+      }
+      dfly_cmd_->SetJournalCompression(cntx, true);
     } else if (cmd == "ACK" && args.size() == 2) {
       // Don't send error/Ok back through the socket, because we don't want to interleave with
       // the journal writes that we write into the same socket.
@@ -2907,7 +3885,7 @@ void ServerFamily::ReplConf(CmdArgList args, ConnectionContext* cntx) {
         return;
       }
       VLOG(2) << "Received client ACK=" << ack;
-      cntx->replication_flow->last_acked_lsn = ack;
+      dfly_cmd_->OnFlowAck(cntx->replication_flow, ack);
       return;
     } else if (cmd == "ACL-CHECK") {
       // TODO(kostasrim): Remove this branch 20/6/2024
@@ -2970,6 +3948,26 @@ void ServerFamily::Script(CmdArgList args, ConnectionContext* cntx) {
   script_mgr_->Run(std::move(args), cntx);
 }
 
+// WAIT numreplicas timeout
+void ServerFamily::Wait(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser{args};
+  auto [num_replicas, timeout_ms] = parser.Next<uint32_t, uint64_t>();
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  if (!ServerState::tlocal()->is_master)
+    return cntx->SendError("WAIT cannot be used with replica instances");
+
+  // As in Redis, a WAIT inside MULTI/EXEC does not block and returns the current count.
+  optional<chrono::steady_clock::time_point> deadline;
+  if (cntx->conn_state.exec_info.IsRunning())
+    deadline = chrono::steady_clock::now();
+  else if (timeout_ms > 0)
+    deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+
+  cntx->SendLong(dfly_cmd_->WaitForAcks(num_replicas, deadline));
+}
+
 void ServerFamily::LastSave(CmdArgList args, ConnectionContext* cntx) {
   time_t save_time;
   {
@@ -2987,6 +3985,50 @@ void ServerFamily::Latency(CmdArgList args, ConnectionContext* cntx) {
     return rb->SendEmptyArray();
   }
 
+  // LATENCY HISTOGRAM [command ...]
+  if (sub_cmd == "HISTOGRAM") {
+    absl::flat_hash_set<string> filter;
+    for (size_t i = 1; i < args.size(); ++i)
+      filter.insert(absl::AsciiStrToUpper(ArgS(args, i)));
+
+    map<string, ServerState::CmdLatency> result;
+    util::fb2::Mutex mu;
+    service_.proactor_pool().AwaitFiberOnAll([&](auto* pb) {
+      lock_guard lk(mu);
+      for (const auto& [cmd, latency] : ServerState::tlocal()->cmd_latency_histos()) {
+        if (filter.empty() || filter.contains(cmd))
+          result[absl::AsciiStrToLower(cmd)].Merge(latency);
+      }
+    });
+
+    // Every command maps to its number of calls and to the percentiles of each phase.
+    rb->StartCollection(result.size(), RedisReplyBuilder::MAP);
+    for (const auto& [cmd, latency] : result) {
+      rb->SendBulkString(cmd);
+      auto phases = CmdLatencyList(latency);
+      rb->StartCollection(phases.size() + 1, RedisReplyBuilder::MAP);
+      rb->SendBulkString("calls");
+      rb->SendLong(latency.total_usec.count());
+      for (const auto& [phase, hist] : phases) {
+        rb->SendBulkString(StrCat(phase, "_usec"));
+        constexpr pair<double, string_view> kPercentiles[] = {
+            {50, "p50"}, {99, "p99"}, {99.9, "p99.9"}};
+        rb->StartCollection(size(kPercentiles), RedisReplyBuilder::MAP);
+        for (auto [percentile, name] : kPercentiles) {
+          rb->SendBulkString(name);
+          rb->SendLong(static_cast<long>(hist->Percentile(percentile)));
+        }
+      }
+    }
+    return;
+  }
+
+  if (sub_cmd == "RESET") {
+    service_.proactor_pool().AwaitFiberOnAll(
+        [](auto* pb) { ServerState::tlocal()->ResetCmdLatency(); });
+    return rb->SendOk();
+  }
+
   LOG_FIRST_N(ERROR, 10) << "Subcommand " << sub_cmd << " not supported";
   cntx->SendError(kSyntaxErr);
 }
@@ -3025,11 +4067,13 @@ void ServerFamily::SlowLog(CmdArgList args, ConnectionContext* cntx) {
   if (sub_cmd == "HELP") {
     string_view help[] = {
         "SLOWLOG <subcommand> [<arg> [value] [opt] ...]. Subcommands are:",
-        "GET [<count>]",
+        "GET [<count>] [VERBOSE]",
         "    Return top <count> entries from the slowlog (default: 10, -1 mean all).",
         "    Entries are made of:",
         "    id, timestamp, time in microseconds, arguments array, client IP and port,",
         "    client name",
+        "    VERBOSE adds a map with the time spent scheduling, queued, executing and",
+        "    replying, the number of hops, shards and tiered reads, and the reply size.",
         "LEN",
         "    Return the length of the slowlog.",
         "RESET",
@@ -3063,6 +4107,65 @@ void ServerFamily::SlowLog(CmdArgList args, ConnectionContext* cntx) {
   cntx->SendError(UnknownSubCmd(sub_cmd, "SLOWLOG"), kSyntaxErrType);
 }
 
+// HOTKEYS [COUNT <n>] [BYBYTES]
+// Merges the sampled per shard hot key sketches of the current database. Every key lives on a
+// single shard, so merging is a union sorted by the estimated accesses or bytes served.
+void ServerFamily::HotKeys(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser{args};
+  uint32_t count = 10;
+  bool by_bytes = false;
+  while (parser.HasNext()) {
+    if (parser.Check("COUNT", &count))
+      continue;
+    if (parser.Check("BYBYTES")) {
+      by_bytes = true;
+      continue;
+    }
+    return cntx->SendError(kSyntaxErr);
+  }
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  DbIndex db_index = cntx->conn_state.db_index;
+  vector<vector<TopKeys::Entry>> shard_entries(shard_set->size());
+  atomic_bool enabled = false;
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    DbTable* table = cntx->ns->GetDbSlice(shard->shard_id()).GetDBTable(db_index);
+    if (table == nullptr || !table->top_keys.IsEnabled())
+      return;
+    enabled.store(true, memory_order_relaxed);
+    table->top_keys.MaybeDecay(absl::GetCurrentTimeNanos() / 1000000);
+    shard_entries[shard->shard_id()] = table->top_keys.GetTopEntries();
+  });
+
+  if (!enabled.load(memory_order_relaxed))
+    return cntx->SendError("hot keys tracking is disabled, see --enable_top_keys_tracking");
+
+  vector<TopKeys::Entry> entries;
+  for (auto& v : shard_entries)
+    move(v.begin(), v.end(), back_inserter(entries));
+
+  auto key_fn = [by_bytes](const TopKeys::Entry& e) { return by_bytes ? e.bytes : e.count; };
+  size_t limit = min<size_t>(count, entries.size());
+  partial_sort(entries.begin(), entries.begin() + limit, entries.end(),
+               [&](const auto& l, const auto& r) { return key_fn(l) > key_fn(r); });
+  entries.resize(limit);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(entries.size());
+  for (const auto& e : entries) {
+    rb->StartCollection(4, RedisReplyBuilder::MAP);
+    rb->SendSimpleString("key");
+    rb->SendBulkString(e.key);
+    rb->SendSimpleString("slot");
+    rb->SendLong(cluster::KeySlot(e.key));
+    rb->SendSimpleString("accesses");
+    rb->SendLong(e.count);
+    rb->SendSimpleString("bytes");
+    rb->SendLong(e.bytes);
+  }
+}
+
 void ServerFamily::Module(CmdArgList args, ConnectionContext* cntx) {
   string sub_cmd = absl::AsciiStrToUpper(ArgS(args, 0));
   if (sub_cmd != "LIST")
@@ -3099,6 +4202,7 @@ constexpr uint32_t kFlushDB = KEYSPACE | WRITE | SLOW | DANGEROUS;
 constexpr uint32_t kFlushAll = KEYSPACE | WRITE | SLOW | DANGEROUS;
 constexpr uint32_t kInfo = SLOW | DANGEROUS;
 constexpr uint32_t kHello = FAST | CONNECTION;
+constexpr uint32_t kHotKeys = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kLastSave = ADMIN | FAST | DANGEROUS;
 constexpr uint32_t kLatency = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kMemory = READ | SLOW;
@@ -3112,6 +4216,7 @@ constexpr uint32_t kRole = ADMIN | FAST | DANGEROUS;
 constexpr uint32_t kSlowLog = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kScript = SLOW | SCRIPTING;
 constexpr uint32_t kModule = ADMIN | SLOW | DANGEROUS;
+constexpr uint32_t kWait = SLOW | CONNECTION;
 // TODO(check this)
 constexpr uint32_t kDfly = ADMIN;
 }  // namespace acl
@@ -3127,12 +4232,13 @@ void ServerFamily::Register(CommandRegistry* registry) {
       << CI{"CONFIG", CO::ADMIN | CO::DANGEROUS, -2, 0, 0, acl::kConfig}.HFUNC(Config)
       << CI{"DBSIZE", CO::READONLY | CO::FAST | CO::LOADING, 1, 0, 0, acl::kDbSize}.HFUNC(DbSize)
       << CI{"DEBUG", CO::ADMIN | CO::LOADING, -2, 0, 0, acl::kDebug}.HFUNC(Debug)
-      << CI{"FLUSHDB", CO::WRITE | CO::GLOBAL_TRANS | CO::DANGEROUS, 1, 0, 0, acl::kFlushDB}.HFUNC(
-             FlushDb)
+      << CI{"FLUSHDB", CO::WRITE | CO::GLOBAL_TRANS | CO::DANGEROUS, -1, 0, 0, acl::kFlushDB}
+             .HFUNC(FlushDb)
       << CI{"FLUSHALL", CO::WRITE | CO::GLOBAL_TRANS | CO::DANGEROUS, -1, 0, 0, acl::kFlushAll}
              .HFUNC(FlushAll)
       << CI{"INFO", CO::LOADING, -1, 0, 0, acl::kInfo}.HFUNC(Info)
       << CI{"HELLO", CO::LOADING, -1, 0, 0, acl::kHello}.HFUNC(Hello)
+      << CI{"HOTKEYS", CO::ADMIN | CO::LOADING, -1, 0, 0, acl::kHotKeys}.HFUNC(HotKeys)
       << CI{"LASTSAVE", CO::LOADING | CO::FAST, 1, 0, 0, acl::kLastSave}.HFUNC(LastSave)
       << CI{"LATENCY", CO::NOSCRIPT | CO::LOADING | CO::FAST, -2, 0, 0, acl::kLatency}.HFUNC(
              Latency)
@@ -3151,7 +4257,8 @@ void ServerFamily::Register(CommandRegistry* registry) {
       << CI{"SLOWLOG", CO::ADMIN | CO::FAST, -2, 0, 0, acl::kSlowLog}.HFUNC(SlowLog)
       << CI{"SCRIPT", CO::NOSCRIPT | CO::NO_KEY_TRANSACTIONAL, -2, 0, 0, acl::kScript}.HFUNC(Script)
       << CI{"DFLY", CO::ADMIN | CO::GLOBAL_TRANS | CO::HIDDEN, -2, 0, 0, acl::kDfly}.HFUNC(Dfly)
-      << CI{"MODULE", CO::ADMIN, 2, 0, 0, acl::kModule}.HFUNC(Module);
+      << CI{"MODULE", CO::ADMIN, 2, 0, 0, acl::kModule}.HFUNC(Module)
+      << CI{"WAIT", CO::NOSCRIPT | CO::LOADING, 3, 0, 0, acl::kWait}.HFUNC(Wait);
 }
 
 }  // namespace dfly
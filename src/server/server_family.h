@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <optional>
 #include <string>
 
@@ -11,9 +12,12 @@
 #include "server/detail/save_stages_controller.h"
 #include "server/dflycmd.h"
 #include "server/engine_shard_set.h"
+#include "server/journal/disk_backlog.h"
+#include "server/lazy_free.h"
 #include "server/namespaces.h"
 #include "server/replica.h"
 #include "server/server_state.h"
+#include "server/tiering/common.h"
 #include "util/fibers/fiberqueue_threadpool.h"
 #include "util/fibers/future.h"
 
@@ -37,6 +41,7 @@ std::string GetPassword();
 
 namespace journal {
 class Journal;
+class DiskJournal;
 }  // namespace journal
 
 namespace cluster {
@@ -48,12 +53,21 @@ class CommandRegistry;
 class Service;
 class ScriptMgr;
 
+struct ReplicaFlowStats {
+  uint64_t lag_ms = 0;          // time since the oldest unacknowledged record was sent
+  uint64_t throttle_count = 0;  // times the journal was blocked by the output buffer
+  uint64_t throttle_usec = 0;
+  size_t buffer_bytes = 0;
+};
+
 struct ReplicaRoleInfo {
   std::string id;
   std::string address;
   uint32_t listening_port;
   std::string_view state;
   uint64_t lsn_lag;
+  uint64_t lag_ms = 0;                  // max lag of the flows
+  std::vector<ReplicaFlowStats> flows;  // indexed by shard id
 };
 
 struct ReplicationMemoryStats {
@@ -67,6 +81,13 @@ struct LoadingStats {
 
   size_t backup_count = 0;
   size_t failed_backup_count = 0;
+
+  // Progress of the current or the last snapshot load.
+  time_t load_start_time = 0;
+  size_t load_bytes_total = 0;  // grows as the snapshot files are opened
+  size_t load_bytes_read = 0;
+  size_t load_files_total = 0;
+  size_t load_files_done = 0;
 };
 
 // Global peak stats recorded after aggregating metrics over all shards.
@@ -84,6 +105,7 @@ struct Metrics {
 
   facade::FacadeStats facade_stats;  // client stats and buffer sizes
   TieredStats tiered_stats;
+  std::optional<tiering::Histograms> tiered_histograms;  // set if tiered_latency_histograms
 
   SearchStats search_stats;
   ServerState::Stats coordinator_stats;  // stats on transaction running
@@ -94,10 +116,26 @@ struct Metrics {
 
   size_t heap_used_bytes = 0;
   size_t small_string_bytes = 0;
+  size_t key_prefixes = 0;      // prefixes in the key prefix dictionaries of all shards.
+  size_t key_prefix_bytes = 0;  // memory used by the key prefix dictionaries.
+  size_t expire_wheel_bytes = 0;
+  size_t reply_cache_bytes = 0;
+  size_t expired_pending_bytes = 0;  // estimate of the memory held by expired keys.
+  LazyFreer::Stats lazy_free_stats;  // objects waiting for the background freer.
+  std::optional<HugePageResource::Stats> segment_huge_pages;  // set if dash_huge_pages is on
   uint32_t traverse_ttl_per_sec = 0;
   uint32_t delete_ttl_per_sec = 0;
   uint64_t fiber_switch_cnt = 0;
   uint64_t fiber_switch_delay_usec = 0;
+  std::vector<double> thread_utilization;  // CPU utilization of each thread in the last second
+
+  // CPU time of all the threads, in total and by class of work, see CpuClassScope.
+  uint64_t threads_cpu_ns = 0;
+  std::array<uint64_t, kNumCpuClasses> class_cpu_ns{};
+
+  // Fiber run queue lag of all the threads, see ServerState::run_queue_lag_usec.
+  base::Histogram run_queue_lag_usec;
+  uint64_t run_queue_lag_max_usec = 0;
   uint64_t tls_bytes = 0;
   uint64_t refused_conn_max_clients_reached_count = 0;
   uint64_t serialization_bytes = 0;
@@ -117,10 +155,18 @@ struct Metrics {
   // command call frequencies (count, aggregated latency in usec).
   std::map<std::string, std::pair<uint64_t, uint64_t>> cmd_stats_map;
 
+  // per command counts of calls per latency bucket, if command_latency_buckets is set.
+  std::map<std::string, std::vector<uint64_t>> cmd_latency_buckets;
+
+  // per command latency histograms, only collected if latency_tracking is set.
+  std::map<std::string, ServerState::CmdLatency> cmd_latency_map;
+  std::map<std::string, ServerState::ScriptStats> script_stats;
+
   absl::flat_hash_map<std::string, uint64_t> connections_lib_name_ver_map;
 
   // Replica info on the master side.
   std::vector<ReplicaRoleInfo> master_side_replicas_info;
+  journal::BacklogStats repl_backlog_stats;
 
   struct ReplicaInfo {
     uint32_t reconnect_count;
@@ -144,6 +190,10 @@ struct LastSaveInfo {
   uint32_t success_duration_sec = 0;
   std::string file_name;                                      //
   std::vector<std::pair<std::string_view, size_t>> freq_map;  // RDB_TYPE_xxx -> count mapping.
+  size_t peak_buffers_size = 0;  // peak memory of the snapshot buffers
+  size_t upload_bytes = 0;       // bytes uploaded to cloud storage
+  size_t upload_bytes_per_sec = 0;
+  size_t keys_per_sec = 0;  // throughput achieved under the priority of the save
   // last error save info
   GenericError last_error;
   time_t last_error_time = 0;      // epoch time in seconds.
@@ -191,12 +241,15 @@ class ServerFamily {
 
   // if new_version is true, saves DF specific, non redis compatible snapshot.
   // if basename is not empty it will override dbfilename flag.
+  // if allow_delta is true, saves a delta snapshot instead when possible, see snapshot_max_deltas.
+  // Low priority saves pace themselves by the load of the shards, see SavePriority.
   GenericError DoSave(bool new_version, std::string_view basename, Transaction* transaction,
-                      bool ignore_state = false);
+                      bool ignore_state = false, bool allow_delta = false,
+                      SavePriority priority = SavePriority::kNormal);
 
   // Calls DoSave with a default generated transaction and with the format
   // specified in --df_snapshot_format
-  GenericError DoSave(bool ignore_state = false);
+  GenericError DoSave(bool ignore_state = false, bool allow_delta = false);
 
   // Burns down and destroy all the data from the database.
   // if kDbAll is passed, burns all the databases to the ground.
@@ -206,11 +259,17 @@ class ServerFamily {
 
   void FlushAll(ConnectionContext* cntx);
 
+  // Replaces the dataset of the default namespace with the one that was loaded into staged, whose
+  // slices receive the replaced tables and free them in the background.
+  void ReplaceDataset(Namespace* staged);
+
   // Load snapshot from file (.rdb file or summary.dfs file) and return
-  // future with error_code.
+  // future with error_code. If load_db is set, only the keys of that db are loaded and delta
+  // snapshots are not applied.
   enum class LoadExistingKeys { kFail, kOverride };
-  std::optional<util::fb2::Future<GenericError>> Load(std::string_view file_name,
-                                                      LoadExistingKeys existing_keys);
+  std::optional<util::fb2::Future<GenericError>> Load(
+      std::string_view file_name, LoadExistingKeys existing_keys,
+      std::optional<DbIndex> load_db = std::nullopt);
 
   bool TEST_IsSaving() const;
 
@@ -249,6 +308,11 @@ class ServerFamily {
 
   void OnClose(ConnectionContext* cntx);
 
+  // Replaces the prefixes the connection tracks in the broadcasting mode of CLIENT TRACKING, an
+  // empty list unregisters it. The table is copied to every thread.
+  void SetBcastTracking(ConnectionContext* cntx, std::vector<std::string> prefixes)
+      ABSL_LOCKS_EXCLUDED(bcast_tracking_mu_);
+
   void CancelBlockingOnThread(std::function<facade::OpStatus(ArgSlice)> = {});
 
   // Sets the server to replicate another instance. Does not flush the database beforehand!
@@ -256,11 +320,24 @@ class ServerFamily {
 
   void UpdateMemoryGlobalStats();
 
+  // Measures the CPU utilization of all threads once per second and, if conn_rebalance_threshold
+  // is set, moves a client connection off the busiest connection thread. Runs on shard 0.
+  void RebalanceConnections();
+
+  // Records that a command of the connection ran only on shard sid and, once the shard dominates
+  // its recent commands, moves the connection to the thread of the shard if that thread has spare
+  // CPU, see conn_affinity_window. Must run on the connection thread.
+  void UpdateShardAffinity(ShardId sid, ConnectionContext* cntx);
+
  private:
   bool HasPrivilegedInterface();
   void JoinSnapshotSchedule();
   void LoadFromSnapshot() ABSL_LOCKS_EXCLUDED(loading_stats_mu_);
 
+  // Replay the disk journal on top of the loaded snapshot if replay is set, then start appending
+  // to it. Exits on failure like a failed load on startup.
+  void StartDiskJournal(bool replay);
+
   uint32_t shard_count() const {
     return shard_set->size();
   }
@@ -276,6 +353,7 @@ class ServerFamily {
   void FlushAll(CmdArgList args, ConnectionContext* cntx);
   void Info(CmdArgList args, ConnectionContext* cntx) ABSL_LOCKS_EXCLUDED(save_mu_, replicaof_mu_);
   void Hello(CmdArgList args, ConnectionContext* cntx);
+  void HotKeys(CmdArgList args, ConnectionContext* cntx);
   void LastSave(CmdArgList args, ConnectionContext* cntx) ABSL_LOCKS_EXCLUDED(save_mu_);
   void Latency(CmdArgList args, ConnectionContext* cntx);
   void ReplicaOf(CmdArgList args, ConnectionContext* cntx);
@@ -288,6 +366,7 @@ class ServerFamily {
   void Script(CmdArgList args, ConnectionContext* cntx);
   void SlowLog(CmdArgList args, ConnectionContext* cntx);
   void Module(CmdArgList args, ConnectionContext* cntx);
+  void Wait(CmdArgList args, ConnectionContext* cntx);
 
   void SyncGeneric(std::string_view repl_master_id, uint64_t offs, ConnectionContext* cntx);
 
@@ -301,22 +380,38 @@ class ServerFamily {
   void ReplicaOfInternal(CmdArgList args, ConnectionContext* cntx, ActionOnConnectionFail on_error)
       ABSL_LOCKS_EXCLUDED(replicaof_mu_);
 
-  // Returns the number of loaded keys if successful.
-  io::Result<size_t> LoadRdb(const std::string& rdb_file, LoadExistingKeys existing_keys);
+  // Returns the number of loaded keys if successful. Files with a SnapshotIndex are only read
+  // where they may hold keys of load_db and, in cluster mode, of the owned slots.
+  io::Result<size_t> LoadRdb(const std::string& rdb_file, LoadExistingKeys existing_keys,
+                             std::optional<DbIndex> load_db = std::nullopt);
+
+  // Apply the delta snapshots saved on top of the loaded DFS summary file, in order.
+  GenericError LoadDeltas(const std::string& summary_path);
 
   void SnapshotScheduling() ABSL_LOCKS_EXCLUDED(loading_stats_mu_);
 
   void SendInvalidationMessages() const;
 
-  // Helper function to retrieve version(true if format is dfs rdb), and basename from args.
+  struct SaveCmdOptions {
+    bool new_version;  // true if format is dfs rdb
+    std::string_view basename;
+    SavePriority priority = SavePriority::kNormal;
+  };
+
+  // Helper function to retrieve the options of SAVE and BGSAVE from args.
   // In case of an error an empty optional is returned.
-  using VersionBasename = std::pair<bool, std::string_view>;
-  std::optional<VersionBasename> GetVersionAndBasename(CmdArgList args, ConnectionContext* cntx);
+  std::optional<SaveCmdOptions> GetSaveCmdOptions(CmdArgList args, ConnectionContext* cntx);
 
   void BgSaveFb(boost::intrusive_ptr<Transaction> trans);
 
   GenericError DoSaveCheckAndStart(bool new_version, string_view basename, Transaction* trans,
-                                   bool ignore_state = false) ABSL_LOCKS_EXCLUDED(save_mu_);
+                                   bool ignore_state = false, bool allow_delta = false,
+                                   SavePriority priority = SavePriority::kNormal)
+      ABSL_LOCKS_EXCLUDED(save_mu_);
+
+  // Returns the next delta of the chain if one can be saved instead of a full snapshot.
+  std::optional<detail::DeltaSnapshot> NextDeltaSnapshot() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(save_mu_);
 
   GenericError WaitUntilSaveFinished(Transaction* trans,
                                      bool ignore_state = false) ABSL_NO_THREAD_SAFETY_ANALYSIS;
@@ -333,6 +428,11 @@ class ServerFamily {
   std::vector<facade::Listener*> listeners_;
   bool accepting_connections_ = true;
   util::ProactorBase* pb_task_ = nullptr;
+  uint64_t last_rebalance_ns_ = 0;  // accessed only by RebalanceConnections
+
+  // CPU utilization of every thread as last measured by RebalanceConnections, read by
+  // UpdateShardAffinity on all threads.
+  std::vector<std::atomic<float>> thread_utilization_;
 
   mutable util::fb2::Mutex replicaof_mu_, save_mu_;
   std::shared_ptr<Replica> replica_ ABSL_GUARDED_BY(replicaof_mu_);
@@ -341,6 +441,7 @@ class ServerFamily {
 
   std::unique_ptr<ScriptMgr> script_mgr_;
   std::unique_ptr<journal::Journal> journal_;
+  std::unique_ptr<journal::DiskJournal> disk_journal_;  // set if journal_dir is given
   std::unique_ptr<DflyCmd> dfly_cmd_;
 
   std::string master_replid_;
@@ -361,11 +462,44 @@ class ServerFamily {
   // protected by save_mu_
   util::fb2::Fiber bg_save_fb_;
 
+  // Delta snapshots saved on top of the last full snapshot in the default location.
+  struct DeltaChain {
+    std::filesystem::path base_path;
+    std::vector<LSN> lsns;  // journal lsns of the shards at the last snapshot of the chain
+    unsigned deltas = 0;
+    uint64_t flush_epoch = 0;  // deltas can't be saved once it changed
+  };
+  std::optional<DeltaChain> delta_chain_ ABSL_GUARDED_BY(save_mu_);
+
+  // How the running save relates to the chain, and the flush epoch when it started.
+  enum class DeltaRole { kNone, kBase, kDelta };
+  DeltaRole save_delta_role_ ABSL_GUARDED_BY(save_mu_) = DeltaRole::kNone;
+  uint64_t save_flush_epoch_ ABSL_GUARDED_BY(save_mu_) = 0;
+
+  // Incremented by changes the journal can't express to delta snapshots, like flushes and loads.
+  std::atomic_uint64_t flush_epoch_{0};
+
   mutable util::fb2::Mutex peak_stats_mu_;
   mutable PeakStats peak_stats_;
 
   mutable util::fb2::Mutex loading_stats_mu_;
   LoadingStats loading_stats_ ABSL_GUARDED_BY(loading_stats_mu_);
+
+  // Updated concurrently by the load fibers, reported as part of LoadingStats.
+  struct LoadProgress {
+    std::atomic<time_t> start_time{0};
+    std::atomic_size_t bytes_total{0};
+    std::atomic_size_t bytes_read{0};
+    std::atomic_size_t files_total{0};
+    std::atomic_size_t files_done{0};
+  };
+  LoadProgress load_progress_;
+
+  // Disk journal segment stored in the last loaded snapshot.
+  std::atomic_uint64_t loaded_journal_segment_{0};
+
+  util::fb2::Mutex bcast_tracking_mu_;
+  ServerState::BcastTrackingTable bcast_tracking_ ABSL_GUARDED_BY(bcast_tracking_mu_);
 };
 
 // Reusable CLIENT PAUSE implementation that blocks while polling is_pause_in_progress
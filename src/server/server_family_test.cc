@@ -419,7 +419,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   Run({"GET", "FOO"});
   Run({"SET", "FOO", "10"});
   const auto& msg = GetInvalidationMessage("IO0", 0);
-  EXPECT_EQ(msg.key, "FOO");
+  EXPECT_THAT(msg.keys, ElementsAre("FOO"));
 
   // make sure invalidation message only gets sent once.
   Run({"GET", "FOO"});
@@ -431,17 +431,18 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   pp_->at(1)->Await([&] { return Run({"SET", "FOO", "30"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   const auto& msg2 = GetInvalidationMessage("IO0", 1);
-  EXPECT_EQ(msg2.key, "FOO");
+  EXPECT_THAT(msg2.keys, ElementsAre("FOO"));
 
   // case 4. test multi command
   Run({"MGET", "X1", "X2", "X3", "X4", "Y1", "Y2", "Y3", "Y4", "Z1", "Z2", "Z3", "Z4"});
   pp_->at(1)->Await([&] { return Run({"MSET", "X1", "1", "Y3", "2", "Z2", "3", "Z4", "5"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(InvalidationMessagesLen("IO0"), 6);
-  std::vector<std::string_view> keys_invalidated;
-  for (unsigned int i = 2; i < 6; ++i)
-    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).key);
-  ASSERT_THAT(keys_invalidated, ElementsAre("X1", "Y3", "Z2", "Z4"));
+  // The keys of a shard are sent in a single message.
+  EXPECT_LE(InvalidationMessagesLen("IO0"), 6);
+  std::vector<std::string> keys_invalidated = GetInvalidatedKeys("IO0");
+  ASSERT_EQ(keys_invalidated.size(), 6u);
+  keys_invalidated.erase(keys_invalidated.begin(), keys_invalidated.begin() + 2);
+  ASSERT_THAT(keys_invalidated, UnorderedElementsAre("X1", "Y3", "Z2", "Z4"));
 
   // The following doesn't work correctly as we currently can't mock listener.
   // flushdb command
@@ -455,7 +456,7 @@ TEST_F(ServerFamilyTest, ClientTrackingDeleteKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"DEL", "FOO"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
@@ -465,7 +466,7 @@ TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"RENAME", "FOO", "BAR"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
@@ -478,7 +479,7 @@ TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
   auto resp = Run({"GET", "C"});
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
@@ -490,7 +491,7 @@ TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
   pp_->at(1)->Await([&] { return Run({"SET", "C", "1000"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingNonTransactionalBug) {
@@ -513,7 +514,49 @@ TEST_F(ServerFamilyTest, ClientTrackingLuaBug) {
   absl::StrAppend(&eval, R"(redis.call('get', 'oof'); redis.call('set', 'oof', 'bar'); return 1)");
   Run({"EVAL", eval, "2", "foo", "oof"});
   Run({"PING"});
-  EXPECT_EQ(InvalidationMessagesLen("IO0"), 3);
+  EXPECT_THAT(GetInvalidatedKeys("IO0"), ElementsAre("foo", "foo", "oof"));
+}
+
+TEST_F(ServerFamilyTest, ClientTrackingBatch) {
+  Run({"HELLO", "3"});
+  Run({"CLIENT", "TRACKING", "ON"});
+  Run({"MGET", "{t}a", "{t}b", "{t}c"});
+
+  // The keys of a single shard are changed by one callback and sent in one message.
+  pp_->at(1)->Await([&] { return Run({"MSET", "{t}a", "1", "{t}b", "2", "{t}c", "3"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  ASSERT_EQ(InvalidationMessagesLen("IO0"), 1);
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, UnorderedElementsAre("{t}a", "{t}b", "{t}c"));
+}
+
+TEST_F(ServerFamilyTest, ClientTrackingBcast) {
+  Run({"HELLO", "3"});
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "PREFIX", "user:"}),
+              ErrArg("PREFIX option requires BCAST mode to be enabled"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "OPTIN"}),
+              ErrArg("OPTIN and OPTOUT are not compatible with BCAST"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX"}), ErrArg("syntax error"));
+
+  EXPECT_EQ(Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX", "user:", "PREFIX", "job:"}), "OK");
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON"}), ErrArg("switch BCAST mode"));
+
+  // Keys are not read before, the prefixes are enough.
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "a"}); });
+  pp_->at(1)->Await([&] { return Run({"SET", "session:1", "a"}); });
+  pp_->at(1)->Await([&] { return Run({"DEL", "job:2"}); });
+  pp_->at(1)->Await([&] { return Run({"SET", "job:2", "a"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_THAT(GetInvalidatedKeys("IO0"), ElementsAre("user:1", "job:2"));
+
+  // Keys are not removed from the table once invalidated.
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "b"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_THAT(GetInvalidatedKeys("IO0"), ElementsAre("user:1", "job:2", "user:1"));
+
+  EXPECT_EQ(Run({"CLIENT", "TRACKING", "OFF"}), "OK");
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "c"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(GetInvalidatedKeys("IO0").size(), 3u);
 }
 
 TEST_F(ServerFamilyTest, ConfigNormalization) {
@@ -545,4 +588,68 @@ TEST_F(ServerFamilyTest, ConfigNormalization) {
               RespArray(ElementsAre("replica_priority", "13")));
 }
 
+TEST_F(ServerFamilyTest, LatencyHistogram) {
+  absl::FlagSaver fs;
+
+  EXPECT_THAT(Run({"config", "set", "latency_tracking", "true"}), "OK");
+  Run({"set", "foo", "bar"});
+  Run({"get", "foo"});
+  Run({"mset", "a", "1", "b", "2"});
+
+  auto resp = Run({"latency", "histogram", "set", "mset"});
+  ASSERT_THAT(resp, ArrLen(4));
+  auto cmds = resp.GetVec();
+  EXPECT_EQ(cmds[0], "mset");
+  EXPECT_EQ(cmds[2], "set");
+
+  // calls and the percentiles of the total, schedule, queue and exec phases.
+  auto mset = cmds[1].GetVec();
+  ASSERT_EQ(mset.size(), 10u);
+  EXPECT_EQ(mset[0], "calls");
+  EXPECT_THAT(mset[1], IntArg(1));
+  EXPECT_EQ(mset[2], "total_usec");
+  EXPECT_THAT(mset[3], RespArray(ElementsAre("p50", _, "p99", _, "p99.9", _)));
+  EXPECT_EQ(mset[8], "exec_usec");
+
+  // Verbose slow log entries break down where the command spent its time.
+  Run({"config", "set", "slowlog_log_slower_than", "0"});
+  Run({"get", "foo"});
+  resp = Run({"slowlog", "get", "1"});
+  auto entry = resp.GetVec()[0].GetVec();
+  ASSERT_EQ(entry.size(), 6u);
+  EXPECT_THAT(entry[3].GetVec(), ElementsAre("get", "foo"));
+
+  resp = Run({"slowlog", "get", "2", "verbose"});
+  entry = resp.GetVec()[1].GetVec();
+  ASSERT_EQ(entry.size(), 7u);
+  auto details = entry[6].GetVec();
+  ASSERT_EQ(details.size(), 16u);
+  EXPECT_EQ(details[0], "schedule_usec");
+  EXPECT_EQ(details[8], "hops");
+  EXPECT_THAT(details[9], IntArg(1));
+  EXPECT_EQ(details[10], "shards");
+  EXPECT_THAT(details[11], IntArg(1));
+  EXPECT_EQ(details[14], "reply_bytes");
+  EXPECT_THAT(details[15], IntArg(9));  // $3\r\nbar\r\n
+
+  EXPECT_THAT(Run({"latency", "reset"}), "OK");
+  EXPECT_THAT(Run({"latency", "histogram", "get"}), ArrLen(0));
+}
+
+TEST_F(ServerFamilyTest, ThreadUtilization) {
+  auto info = Run({"info", "cpu"}).GetString();
+  EXPECT_THAT(info, HasSubstr("thread_utilization:"));
+
+  info = Run({"info", "stats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("connection_rebalances:0"));
+}
+
+TEST_F(ServerFamilyTest, WaitWithoutReplicas) {
+  Run({"set", "foo", "bar"});
+  EXPECT_THAT(Run({"wait", "0", "0"}), IntArg(0));
+  EXPECT_THAT(Run({"wait", "1", "10"}), IntArg(0));
+  EXPECT_THAT(Run({"wait", "1"}), ErrArg("wrong number of arguments"));
+  EXPECT_THAT(Run({"wait", "x", "0"}), ErrArg("not an integer"));
+}
+
 }  // namespace dfly
@@ -4,7 +4,10 @@
 
 #include "server/server_state.h"
 
+#include <absl/random/random.h>
+#include <absl/time/clock.h>
 #include <mimalloc.h>
+#include <time.h>
 
 #include "server/acl/user_registry.h"
 
@@ -15,19 +18,85 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "facade/conn_context.h"
+#include "facade/numa.h"
 #include "server/journal/journal.h"
 
 ABSL_FLAG(uint32_t, interpreter_per_thread, 10, "Lua interpreters per thread");
+ABSL_FLAG(bool, cpu_class_accounting, false,
+          "If true, accounts the CPU time of heartbeats, snapshots, tiering and replication "
+          "separately in INFO CPU and /metrics.");
+ABSL_FLAG(uint32_t, fiber_lag_probe_ms, 10,
+          "Interval of sampling the fiber run queue lag of every thread, 0 to disable.");
+ABSL_FLAG(uint32_t, fiber_lag_warn_usec, 50'000,
+          "Log a warning when the fiber run queue lag of a thread exceeds this, 0 to disable.");
+ABSL_DECLARE_FLAG(bool, numa_aware);
 
 namespace dfly {
 
 __thread ServerState* ServerState::state_ = nullptr;
 
+namespace {
+
+__thread CpuClassScope* tl_cpu_scope = nullptr;
+
+}  // namespace
+
+std::string_view CpuClassName(CpuClass cls) {
+  switch (cls) {
+    case CpuClass::HEARTBEAT:
+      return "heartbeat";
+    case CpuClass::SNAPSHOT:
+      return "snapshot";
+    case CpuClass::TIERING:
+      return "tiering";
+    case CpuClass::REPLICATION:
+      return "replication";
+  }
+  return "";
+}
+
+CpuClassScope::CpuClassScope(CpuClass cls) : cls_{cls} {
+  static const bool enabled = absl::GetFlag(FLAGS_cpu_class_accounting);
+  ServerState* ss = ServerState::tlocal();
+  if (!enabled || ss == nullptr)
+    return;
+
+  active_ = true;
+  switch_epoch_ = util::fb2::FiberSwitchEpoch();
+  // Nest only within a scope of the same fiber, i.e. one opened without switching since.
+  if (tl_cpu_scope && tl_cpu_scope->switch_epoch_ == switch_epoch_)
+    outer_ = tl_cpu_scope;
+  tl_cpu_scope = this;
+  start_ns_ = ThreadCpuNs();
+}
+
+CpuClassScope::~CpuClassScope() {
+  if (!active_)
+    return;
+
+  uint64_t elapsed = ThreadCpuNs() - start_ns_;
+  if (tl_cpu_scope == this)
+    tl_cpu_scope = outer_;
+
+  if (util::fb2::FiberSwitchEpoch() != switch_epoch_)
+    return;
+
+  if (outer_)
+    outer_->nested_ns_ += elapsed;
+  ServerState::tlocal()->class_cpu_ns[size_t(cls_)] += elapsed - std::min(elapsed, nested_ns_);
+}
+
+uint64_t CpuClassScope::ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return uint64_t(ts.tv_sec) * 1'000'000'000ULL + ts.tv_nsec;
+}
+
 ServerState::Stats::Stats(unsigned num_shards) : tx_width_freq_arr(num_shards) {
 }
 
 ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
-  static_assert(sizeof(Stats) == 17 * 8, "Stats size mismatch");
+  static_assert(sizeof(Stats) == 29 * 8, "Stats size mismatch");
 
 #define ADD(x) this->x += (other.x)
 
@@ -50,6 +119,18 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
   ADD(rdb_save_usec);
   ADD(rdb_save_count);
   ADD(oom_error_cmd_cnt);
+  ADD(zero_copy_get_cnt);
+  ADD(zero_copy_get_bytes);
+  ADD(hot_key_replica_hits);
+  ADD(hot_key_replica_misses);
+  ADD(reply_cache_hits);
+  ADD(reply_cache_misses);
+  ADD(tx_pool_hits);
+  ADD(tx_pool_misses);
+  ADD(conn_rebalances);
+  ADD(local_shard_cmds);
+  ADD(remote_shard_cmds);
+  ADD(affinity_migrations);
 
   if (this->tx_width_freq_arr.size() > 0) {
     DCHECK_EQ(this->tx_width_freq_arr.size(), other.tx_width_freq_arr.size());
@@ -80,18 +161,63 @@ void MonitorsRepo::Remove(const facade::Connection* conn) {
   }
 }
 
-void MonitorsRepo::NotifyChangeCount(bool added) {
-  if (added) {
-    ++global_count_;
-  } else {
-    DCHECK(global_count_ > 0);
-    --global_count_;
+void MonitorsRepo::AddFilter(const Filter& filter) {
+  filters_.push_back({filter});
+}
+
+void MonitorsRepo::RemoveFilter(uint32_t monitor_id) {
+  auto it = std::find_if(filters_.begin(), filters_.end(), [monitor_id](const auto& state) {
+    return state.filter.monitor_id == monitor_id;
+  });
+  DCHECK(it != filters_.end());
+  if (it != filters_.end())
+    filters_.erase(it);
+}
+
+MonitorsRepo::MonitorIds MonitorsRepo::Select(
+    std::string_view cmd, uint32_t client_id,
+    absl::FunctionRef<bool(const std::vector<std::string>&)> key_matches) {
+  thread_local absl::InsecureBitGen bitgen;
+
+  MonitorIds res;
+  uint64_t now_sec = 0;
+  for (auto& state : filters_) {
+    const Filter& filter = state.filter;
+    if (!filter.commands.empty() &&
+        std::find(filter.commands.begin(), filter.commands.end(), cmd) == filter.commands.end())
+      continue;
+    if (!filter.clients.empty() &&
+        std::find(filter.clients.begin(), filter.clients.end(), client_id) == filter.clients.end())
+      continue;
+    if (!filter.key_prefixes.empty() && !key_matches(filter.key_prefixes))
+      continue;
+    if (filter.sample_ratio < 1.0 && !absl::Bernoulli(bitgen, filter.sample_ratio))
+      continue;
+
+    if (filter.max_rate > 0) {
+      if (now_sec == 0)
+        now_sec = absl::GetCurrentTimeNanos() / 1000000000;
+      if (state.window_sec != now_sec) {
+        state.window_sec = now_sec;
+        state.window_sent = 0;
+      }
+      if (state.window_sent >= filter.max_rate)
+        continue;
+      ++state.window_sent;
+    }
+    res.push_back(filter.monitor_id);
   }
+  return res;
 }
 
 ServerState::ServerState() : interpreter_mgr_{absl::GetFlag(FLAGS_interpreter_per_thread)} {
   CHECK(mi_heap_get_backing() == mi_heap_get_default());
 
+  // Bind the thread before creating its heap, so that the heap is backed by node-local memory.
+  if (absl::GetFlag(FLAGS_numa_aware)) {
+    numa_node_ = facade::BindThreadToCurrentNode();
+  }
+
   mi_heap_t* tlh = mi_heap_new();
   init_zmalloc_threadlocal(tlh);
   data_heap_ = tlh;
@@ -108,6 +234,36 @@ void ServerState::Init(uint32_t thread_index, uint32_t num_shards, acl::UserRegi
   state_->stats = Stats(num_shards);
 }
 
+void ServerState::StartLagProbe() {
+  uint32_t period_ms = absl::GetFlag(FLAGS_fiber_lag_probe_ms);
+  if (period_ms == 0)
+    return;
+
+  lag_probe_fb_ = util::fb2::Fiber("lag_probe", [this, period_ms] {
+    while (!lag_probe_done_.WaitFor(std::chrono::milliseconds(period_ms))) {
+      // Yielding puts the fiber at the end of the run queue, so it runs again after all the
+      // fibers that were ready before it.
+      uint64_t start = util::fb2::ProactorBase::GetMonotonicTimeNs();
+      util::ThisFiber::Yield();
+      uint64_t lag_usec = (util::fb2::ProactorBase::GetMonotonicTimeNs() - start) / 1000;
+
+      run_queue_lag_usec.Add(lag_usec);
+      run_queue_lag_max_usec = std::max(run_queue_lag_max_usec, lag_usec);
+
+      uint32_t warn_usec = absl::GetFlag(FLAGS_fiber_lag_warn_usec);
+      if (warn_usec > 0 && lag_usec > warn_usec) {
+        LOG_EVERY_T(WARNING, 10) << "Fiber run queue lag of thread " << thread_index_ << " is "
+                                 << lag_usec << "us";
+      }
+    }
+  });
+}
+
+void ServerState::StopLagProbe() {
+  lag_probe_done_.Notify();
+  lag_probe_fb_.JoinIfNeeded();
+}
+
 void ServerState::Destroy() {
   delete state_;
   state_ = nullptr;
@@ -201,6 +357,24 @@ ServerState* ServerState::SafeTLocal() {
   return state_;
 }
 
+auto ServerState::ScriptStats::operator+=(const ScriptStats& other) -> ScriptStats& {
+  calls += other.calls;
+  total_usec += other.total_usec;
+  max_usec = std::max(max_usec, other.max_usec);
+  redis_call_usec += other.redis_call_usec;
+  redis_calls += other.redis_calls;
+  hops += other.hops;
+  shards += other.shards;
+  return *this;
+}
+
+void ServerState::CmdLatency::Merge(const CmdLatency& other) {
+  total_usec.Merge(other.total_usec);
+  schedule_usec.Merge(other.schedule_usec);
+  queue_usec.Merge(other.queue_usec);
+  exec_usec.Merge(other.exec_usec);
+}
+
 bool ServerState::ShouldLogSlowCmd(unsigned latency_usec) const {
   return slow_log_shard_.IsEnabled() && latency_usec >= log_slower_than_usec;
 }
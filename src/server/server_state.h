@@ -4,12 +4,17 @@
 
 #pragma once
 
+#include <absl/container/inlined_vector.h>
+#include <absl/functional/function_ref.h>
+
+#include <array>
 #include <optional>
 #include <valarray>
 #include <vector>
 
 #include "base/histogram.h"
 #include "core/interpreter.h"
+#include "facade/dragonfly_connection.h"
 #include "server/acl/acl_log.h"
 #include "server/acl/user_registry.h"
 #include "server/common.h"
@@ -19,10 +24,6 @@
 
 typedef struct mi_heap_s mi_heap_t;
 
-namespace facade {
-class Connection;
-}
-
 namespace dfly {
 
 namespace journal {
@@ -42,10 +43,15 @@ class Journal;
 // since monitoring is for debugging only, we would have less than 1 in most cases.
 // Also note that we holding this list on the thread level since this is the context
 // at which this would run. It also minimized the number of copied for this list.
+// The options of all the monitors are copied to every thread, so that the commands are filtered
+// by the thread that runs them, before their message is formatted.
 class MonitorsRepo {
  public:
   using MonitorVec = std::vector<facade::Connection*>;
 
+  using Filter = MonitorFilter;
+  using MonitorIds = absl::InlinedVector<uint32_t, 2>;
+
   // This function adds a new connection to be monitored. This function only add
   // new connection that belong to this thread! Must not be called outside of this
   // thread context
@@ -56,17 +62,23 @@ class MonitorsRepo {
   // thread context
   void Remove(const facade::Connection* conn);
 
-  // We have for each thread the total number of monitors in the application.
-  // So this call is thread safe since we hold a copy of this for each thread.
+  // We have for each thread the filters of all the monitors in the application.
+  // So this call is thread safe since we hold a copy of them for each thread.
   // If this return true, then we don't need to run the monitor operation at all.
   bool Empty() const {
-    return global_count_ == 0u;
+    return filters_.empty();
   }
 
-  // This function is run on all threads to either increment or decrement the "shared" counter
-  // of the monitors - it must be called as part of removing a monitor (for example
-  // when a connection is closed).
-  void NotifyChangeCount(bool added);
+  // These functions are run on all threads when a monitor is added or removed - the latter
+  // must be called as part of removing a monitor (for example when a connection is closed).
+  void AddFilter(const Filter& filter);
+  void RemoveFilter(uint32_t monitor_id);
+
+  // Returns the ids of the monitors that should get the command of the client. Matches the
+  // commands with the filters, then applies their sampling and the rate limits of this thread.
+  // key_matches checks whether a key of the command starts with one of the prefixes.
+  MonitorIds Select(std::string_view cmd, uint32_t client_id,
+                    absl::FunctionRef<bool(const std::vector<std::string>&)> key_matches);
 
   std::size_t Size() const {
     return monitors_.size();
@@ -77,12 +89,49 @@ class MonitorsRepo {
   }
 
  private:
-  MonitorVec monitors_;            // save connections belonging to this thread only!
-  unsigned int global_count_ = 0;  // by global its means that we count the monitor for all threads
+  struct FilterState {
+    Filter filter;
+    uint64_t window_sec = 0;  // second of the current rate limit window
+    uint32_t window_sent = 0;
+  };
+
+  MonitorVec monitors_;               // save connections belonging to this thread only!
+  std::vector<FilterState> filters_;  // filters of the monitors of all threads
 };
 
 enum class ClientPause { WRITE, ALL };
 
+// Classes of background work whose CPU time is accounted separately, see CpuClassScope.
+// The rest of the CPU time of a thread is spent on connections and command dispatch.
+enum class CpuClass : uint8_t { HEARTBEAT, SNAPSHOT, TIERING, REPLICATION };
+constexpr size_t kNumCpuClasses = 4;
+
+// Names of the classes as reported by INFO CPU and /metrics.
+std::string_view CpuClassName(CpuClass cls);
+
+// Accounts the CPU time of the thread spent in its scope to a class, if cpu_class_accounting is
+// set. Time spent in nested scopes is accounted to their own class only. A scope during which the
+// fiber was switched out is dropped, because the time of the other fibers can't be separated.
+class CpuClassScope {
+ public:
+  explicit CpuClassScope(CpuClass cls);
+  ~CpuClassScope();
+
+  CpuClassScope(const CpuClassScope&) = delete;
+  void operator=(const CpuClassScope&) = delete;
+
+  // CPU time used by the current thread.
+  static uint64_t ThreadCpuNs();
+
+ private:
+  CpuClass cls_;
+  bool active_ = false;
+  uint64_t start_ns_ = 0;
+  uint64_t nested_ns_ = 0;  // time of nested scopes
+  uint64_t switch_epoch_ = 0;
+  CpuClassScope* outer_ = nullptr;
+};
+
 // Present in every server thread. This class differs from EngineShard. The latter manages
 // state around engine shards while the former represents coordinator/connection state.
 // There may be threads that handle engine shards but not IO, there may be threads that handle IO
@@ -125,6 +174,32 @@ class ServerState {  // public struct - to allow initialization.
     // Number of times we rejected command dispatch due to OOM condition.
     uint64_t oom_error_cmd_cnt = 0;
 
+    // GET replies sent directly from shard memory, see zero_copy_get_min_size.
+    uint64_t zero_copy_get_cnt = 0;
+    uint64_t zero_copy_get_bytes = 0;
+
+    // GETs served from the thread local copy of a hot key vs. finding the copy invalidated,
+    // see hot_key_replicas.
+    uint64_t hot_key_replica_hits = 0;
+    uint64_t hot_key_replica_misses = 0;
+
+    // Reads served from the reply cache of the shard vs. serialized, see reply_cache_max_memory.
+    uint64_t reply_cache_hits = 0;
+    uint64_t reply_cache_misses = 0;
+
+    // Transactions created by reusing a pooled object vs. allocating a new one.
+    uint64_t tx_pool_hits = 0;
+    uint64_t tx_pool_misses = 0;
+
+    // Connections moved off this thread by the rebalancer, see conn_rebalance_threshold.
+    uint64_t conn_rebalances = 0;
+
+    // Single shard commands whose shard is local to the connection thread vs. on another thread,
+    // and connections moved to the thread of their dominant shard, see conn_affinity_window.
+    uint64_t local_shard_cmds = 0;
+    uint64_t remote_shard_cmds = 0;
+    uint64_t affinity_migrations = 0;
+
     std::valarray<uint64_t> tx_width_freq_arr;
   };
 
@@ -211,6 +286,11 @@ class ServerState {  // public struct - to allow initialization.
     return data_heap_;
   }
 
+  // Numa node the thread and its data heap are bound to, -1 if not bound.
+  int numa_node() const {
+    return numa_node_;
+  }
+
   journal::Journal* journal() {
     return journal_;
   }
@@ -231,6 +311,59 @@ class ServerState {  // public struct - to allow initialization.
     call_latency_histos_[sha].Add(latency_usec);
   }
 
+  // Statistics of the runs of a script, see SCRIPT STATS.
+  struct ScriptStats {
+    uint64_t calls = 0;
+    uint64_t total_usec = 0;
+    uint64_t max_usec = 0;
+    uint64_t redis_call_usec = 0;  // spent in redis.call and its variants, the rest runs lua code
+    uint64_t redis_calls = 0;
+    uint64_t hops = 0;    // dispatches of commands and squashed batches to the shards
+    uint64_t shards = 0;  // shards of the declared keys, summed over the calls
+
+    uint64_t lua_usec() const {
+      return total_usec - std::min(total_usec, redis_call_usec);
+    }
+
+    ScriptStats& operator+=(const ScriptStats& other);
+  };
+
+  const absl::flat_hash_map<std::string, ScriptStats>& script_stats() const {
+    return script_stats_;
+  }
+
+  void RecordScriptRun(std::string_view sha, const ScriptStats& run) {
+    script_stats_[sha] += run;
+  }
+
+  void ResetScriptStats() {
+    script_stats_.clear();
+    Interpreter::tl_stack_samples().clear();
+  }
+
+  // Latency of a command, split by the phases of its transaction when it ran one of its own.
+  // The time not covered by the phases is spent on coordinating hops and on replying.
+  struct CmdLatency {
+    base::Histogram total_usec;
+    base::Histogram schedule_usec;  // scheduling on all shards
+    base::Histogram queue_usec;     // waiting in a shard queue, slowest shard
+    base::Histogram exec_usec;      // running callbacks, slowest shard
+
+    void Merge(const CmdLatency& other);
+  };
+
+  const absl::flat_hash_map<std::string, CmdLatency>& cmd_latency_histos() const {
+    return cmd_latency_histos_;
+  }
+
+  CmdLatency& GetCmdLatency(std::string_view cmd) {
+    return cmd_latency_histos_[cmd];
+  }
+
+  void ResetCmdLatency() {
+    cmd_latency_histos_.clear();
+  }
+
   void SetScriptParams(const ScriptMgr::ScriptKey& key, ScriptMgr::ScriptParams params) {
     cached_script_params_[key] = params;
   }
@@ -258,6 +391,35 @@ class ServerState {  // public struct - to allow initialization.
 
   bool is_master = true;
   uint32_t log_slower_than_usec = UINT32_MAX;
+  bool latency_tracking = false;      // collect cmd_latency_histos, see latency_tracking flag
+  uint32_t conn_affinity_window = 0;  // see conn_affinity_window flag
+
+  // A client tracking the keys with a prefix in the broadcasting mode of CLIENT TRACKING.
+  struct BcastTracking {
+    std::string prefix;  // empty prefix matches all keys.
+    facade::Connection::WeakRef conn;
+  };
+  using BcastTrackingTable = std::vector<BcastTracking>;
+
+  // Clients in broadcasting tracking mode, shared by the threads and replaced as a whole when it
+  // changes, see ServerFamily::SetBcastTracking. Null if there are none.
+  std::shared_ptr<const BcastTrackingTable> bcast_tracking;
+
+  // CPU utilization of the thread over the last interval, see ServerFamily::RebalanceConnections.
+  double cpu_utilization = 0;
+  uint64_t cpu_usec = 0;  // CPU time used by the thread at the last measurement
+
+  // CPU time of the thread by class of work, see CpuClassScope.
+  std::array<uint64_t, kNumCpuClasses> class_cpu_ns{};
+
+  // Time the lag probe fiber waited in the run queue after yielding, i.e. how long ready fibers
+  // wait for the thread. Sampled every fiber_lag_probe_ms.
+  base::Histogram run_queue_lag_usec;
+  uint64_t run_queue_lag_max_usec = 0;
+
+  // Start and stop the lag probe fiber of the thread. Stop must be called from a fiber.
+  void StartLagProbe();
+  void StopLagProbe();
 
   acl::UserRegistry* user_registry;
 
@@ -301,6 +463,7 @@ class ServerState {  // public struct - to allow initialization.
   int64_t live_transactions_ = 0;
   SlowLogShard slow_log_shard_;
   mi_heap_t* data_heap_;
+  int numa_node_ = -1;
   journal::Journal* journal_ = nullptr;
 
   InterpreterManager interpreter_mgr_;
@@ -323,8 +486,13 @@ class ServerState {  // public struct - to allow initialization.
   MonitorsRepo monitors_;
 
   absl::flat_hash_map<std::string, base::Histogram> call_latency_histos_;
+  absl::flat_hash_map<std::string, ScriptStats> script_stats_;
+  absl::flat_hash_map<std::string, CmdLatency> cmd_latency_histos_;
   uint32_t thread_index_ = 0;
 
+  util::fb2::Fiber lag_probe_fb_;
+  util::fb2::Done lag_probe_done_;
+
   uint64_t used_mem_last_update_ = 0;
   MemoryUsageStats memory_stats_cached_;  // thread local cache of used and rss memory current
 
@@ -15,6 +15,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/roaring_int_set.h"
 #include "core/string_set.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -28,6 +29,10 @@ extern "C" {
 
 ABSL_DECLARE_FLAG(bool, use_set2);
 
+ABSL_FLAG(bool, set_roaring_encoding, true,
+          "If true, sets of integers that outgrow the intset encoding are kept as roaring bitmaps "
+          "instead of hash sets of strings, as long as their members are dense enough.");
+
 namespace dfly {
 
 using namespace facade;
@@ -51,29 +56,57 @@ auto EntriesRange(const NewEntries& entries) {
 
 constexpr uint32_t kMaxIntSetEntries = 256;
 
+// Roaring bitmaps are kept for sets of integers that take at most this many bytes per member,
+// sparse sets whose members take a chunk each are smaller as hash sets.
+constexpr size_t kMaxRoaringBytesPerMember = 16;
+
 bool IsDenseEncoding(const CompactObj& co) {
   return co.Encoding() == kEncodingStrMap2;
 }
 
-intset* IntsetAddSafe(string_view val, intset* is, bool* success, bool* added) {
-  long long llval;
-  *added = false;
-  if (!string2ll(val.data(), val.size(), &llval)) {
-    *success = false;
-    return is;
+bool IsIntEncoding(unsigned encoding) {
+  return encoding == kEncodingIntSet || encoding == kEncodingRoaring;
+}
+
+// Converts the intset that outgrew kMaxIntSetEntries to a roaring bitmap, or to a StringSet if its
+// members are too sparse. Returns false on OOM.
+bool ConvertLargeIntSet(CompactObj* set) {
+  intset* is = (intset*)set->RObjPtr();
+  if (GetFlag(FLAGS_set_roaring_encoding)) {
+    RoaringIntSet* rs = CompactObj::AllocateMR<RoaringIntSet>();
+    int64_t intele;
+    int ii = 0;
+    while (intsetGet(is, ii++, &intele))
+      rs->Add(intele);
+
+    if (SetFamily::KeepAsRoaring(*rs)) {
+      set->InitRobj(OBJ_SET, kEncodingRoaring, rs);
+      return true;
+    }
+    CompactObj::DeleteMR<RoaringIntSet>(rs);
   }
 
-  uint8_t inserted = 0;
-  is = intsetAdd(is, llval, &inserted);
-  if (inserted) {
-    *added = true;
-    *success = intsetLen(is) <= kMaxIntSetEntries;
+  StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
+  if (!ss)
+    return false;
+  set->InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+  return true;
+}
+
+// Converts a set of integers to a StringSet, e.g. to add a member that is not an integer.
+// Returns false on OOM.
+bool ConvertIntsToStrSet(CompactObj* set) {
+  StringSet* ss;
+  if (set->Encoding() == kEncodingIntSet) {
+    intset* is = (intset*)set->RObjPtr();
+    ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
   } else {
-    *added = false;
-    *success = true;
+    ss = SetFamily::ConvertToStrSet(*(const RoaringIntSet*)set->RObjPtr());
   }
-
-  return is;
+  if (!ss)
+    return false;
+  set->InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+  return true;
 }
 
 struct StringSetWrapper {
@@ -91,7 +124,8 @@ struct StringSetWrapper {
     obj->InitRobj(OBJ_SET, kEncodingStrMap2, CompactObj::AllocateMR<StringSet>());
   }
 
-  unsigned Add(const NewEntries& entries, uint32_t ttl_sec) const {
+  // Adds the entries after the first skip ones.
+  unsigned Add(const NewEntries& entries, uint32_t ttl_sec, size_t skip = 0) const {
     unsigned res = 0;
     string_view members[StringSet::kMaxBatchLen];
     size_t entries_len = std::visit([](const auto& e) { return e.size(); }, entries);
@@ -100,6 +134,10 @@ struct StringSetWrapper {
       ss->Reserve(entries_len);
     }
     for (string_view member : EntriesRange(entries)) {
+      if (skip > 0) {
+        --skip;
+        continue;
+      }
       members[len++] = member;
       if (len == StringSet::kMaxBatchLen) {
         res += ss->AddMany(absl::MakeSpan(members, StringSet::kMaxBatchLen), ttl_sec);
@@ -172,6 +210,16 @@ pair<unsigned, bool> RemoveSet(const DbContext& db_context, facade::ArgRange val
     set->SetRObjPtr(is);
 
     return {removed, intsetLen(is) == 0};
+  } else if (set->Encoding() == kEncodingRoaring) {
+    RoaringIntSet* rs = (RoaringIntSet*)set->RObjPtr();
+    long long llval;
+
+    unsigned removed = 0;
+    for (string_view val : vals) {
+      if (string2ll(val.data(), val.size(), &llval))
+        removed += rs->Remove(llval);
+    }
+    return {removed, rs->Size() == 0};
   } else {
     return StringSetWrapper{*set, db_context}.Remove(vals);
   }
@@ -199,6 +247,8 @@ void InitSet(const NewEntries& vals, CompactObj* set) {
 uint32_t SetTypeLen(const DbContext& db_context, const SetType& set) {
   if (set.second == kEncodingIntSet) {
     return intsetLen((const intset*)set.first);
+  } else if (set.second == kEncodingRoaring) {
+    return ((const RoaringIntSet*)set.first)->Size();
   } else {
     return StringSetWrapper(set, db_context)->UpperBoundSize();
   }
@@ -207,6 +257,8 @@ uint32_t SetTypeLen(const DbContext& db_context, const SetType& set) {
 bool IsInSet(const DbContext& db_context, const SetType& st, int64_t val) {
   if (st.second == kEncodingIntSet)
     return intsetFind((intset*)st.first, val);
+  if (st.second == kEncodingRoaring)
+    return ((const RoaringIntSet*)st.first)->Contains(val);
 
   char buf[32];
   char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
@@ -216,12 +268,12 @@ bool IsInSet(const DbContext& db_context, const SetType& st, int64_t val) {
 }
 
 bool IsInSet(const DbContext& db_context, const SetType& st, string_view member) {
-  if (st.second == kEncodingIntSet) {
+  if (IsIntEncoding(st.second)) {
     long long llval;
     if (!string2ll(member.data(), member.size(), &llval))
       return false;
 
-    return intsetFind((intset*)st.first, llval);
+    return IsInSet(db_context, st, int64_t(llval));
   } else {
     return StringSetWrapper(st, db_context)->Contains(member);
   }
@@ -229,7 +281,7 @@ bool IsInSet(const DbContext& db_context, const SetType& st, string_view member)
 
 // returns -3 if member is not found, -1 if no ttl is associated with this member.
 int32_t GetExpiry(const DbContext& db_context, const SetType& st, string_view member) {
-  if (st.second == kEncodingIntSet) {
+  if (IsIntEncoding(st.second)) {
     long long llval;
     if (!string2ll(member.data(), member.size(), &llval))
       return -3;
@@ -252,7 +304,9 @@ void DiffStrSet(const DbContext& db_context, const SetType& st,
     result->erase(entry);
 }
 
-void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, StringVec* result) {
+// Stops after limit members if limit is not 0.
+void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, unsigned limit,
+                 StringVec* result) {
   for (string_view str : StringSetWrapper{vec.front(), db_context}.Range()) {
     size_t j = 1;
     for (j = 1; j < vec.size(); ++j) {
@@ -263,6 +317,78 @@ void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, String
 
     if (j == vec.size()) {
       result->emplace_back(str);
+      if (limit && result->size() >= limit)
+        return;
+    }
+  }
+}
+
+// Reads the element at pos directly, intsets are little endian on the platforms we support.
+int64_t IntsetAt(const intset* is, uint32_t pos) {
+  switch (is->encoding) {
+    case sizeof(int16_t): {
+      int16_t v;
+      memcpy(&v, is->contents + pos * sizeof(v), sizeof(v));
+      return v;
+    }
+    case sizeof(int32_t): {
+      int32_t v;
+      memcpy(&v, is->contents + pos * sizeof(v), sizeof(v));
+      return v;
+    }
+  }
+  int64_t v;
+  memcpy(&v, is->contents + pos * sizeof(v), sizeof(v));
+  return v;
+}
+
+// Returns the first position at or after from with an element not less than val, or the length
+// of the intset. Gallops from the previous position, so that a sequence of searches for
+// ascending values costs O(log distance) each instead of O(log length).
+uint32_t IntsetLowerBound(const intset* is, uint32_t from, int64_t val) {
+  uint32_t len = intsetLen(is);
+  uint32_t lo = from, hi = from, step = 1;
+  while (hi < len && IntsetAt(is, hi) < val) {
+    lo = hi + 1;
+    hi += step;
+    step <<= 1;
+  }
+  hi = min(hi, len);
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (IntsetAt(is, mid) < val)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Intersects intsets sorted by length. Intsets are sorted arrays, so the smallest one is merged
+// with the others and the intersection is over once any of them is exhausted.
+void InterIntSets(const vector<SetType>& vec, unsigned limit, StringVec* result) {
+  const intset* smallest = (const intset*)vec.front().first;
+  vector<uint32_t> cursors(vec.size(), 0);
+
+  for (uint32_t i = 0, len = intsetLen(smallest); i < len; ++i) {
+    int64_t val = IntsetAt(smallest, i);
+    bool found = true;
+    for (size_t j = 1; j < vec.size() && found; ++j) {
+      const intset* is = (const intset*)vec[j].first;
+      if (is == smallest)
+        continue;
+
+      cursors[j] = IntsetLowerBound(is, cursors[j], val);
+      if (cursors[j] == intsetLen(is))
+        return;
+      found = IntsetAt(is, cursors[j]) == val;
+    }
+
+    if (found) {
+      result->push_back(absl::StrCat(val));
+      if (limit && result->size() >= limit)
+        return;
     }
   }
 }
@@ -296,9 +422,7 @@ StringVec RandMemberStrSet(const DbContext& db_context, const CompactObj& co,
 
 StringVec RandMemberSet(const DbContext& db_context, const CompactObj& co,
                         PicksGenerator& generator, std::size_t picks_count) {
-  if (co.Encoding() == kEncodingIntSet) {
-    intset* is = static_cast<intset*>(co.RObjPtr());
-
+  if (IsIntEncoding(co.Encoding())) {
     StringVec result;
     result.reserve(picks_count);
 
@@ -306,7 +430,12 @@ StringVec RandMemberSet(const DbContext& db_context, const CompactObj& co,
       const std::size_t picked_index = generator.Generate();
 
       int64_t value = 0;
-      CHECK_GT(intsetGet(is, picked_index, &value), std::uint8_t(0));
+      if (co.Encoding() == kEncodingIntSet) {
+        CHECK_GT(intsetGet(static_cast<intset*>(co.RObjPtr()), picked_index, &value),
+                 std::uint8_t(0));
+      } else {
+        value = static_cast<const RoaringIntSet*>(co.RObjPtr())->Select(picked_index);
+      }
 
       result.push_back(absl::StrCat(value));
     }
@@ -375,8 +504,6 @@ ResultSetView DiffResultVec(const ResultStringVec& result_vec, ShardId src_shard
 
 OpResult<SvArray> InterResultVec(const ResultStringVec& result_vec, unsigned required_shard_cnt,
                                  unsigned limit = 0) {
-  absl::flat_hash_map<std::string_view, unsigned> uniques;
-
   for (const auto& res : result_vec) {
     if (!res && !base::_in(res.status(), {OpStatus::SKIPPED, OpStatus::KEY_NOTFOUND}))
       return res.status();
@@ -387,39 +514,43 @@ OpResult<SvArray> InterResultVec(const ResultStringVec& result_vec, unsigned req
       return OpStatus::OK;  // empty set.
   }
 
-  bool first = true;
+  vector<const StringVec*> shard_results;
   for (const auto& res : result_vec) {
-    if (res.status() == OpStatus::SKIPPED)
-      continue;
+    if (res.status() != OpStatus::SKIPPED)
+      shard_results.push_back(&res.value());
+  }
+  if (shard_results.size() != required_shard_cnt || shard_results.empty())
+    return SvArray{};
 
-    DCHECK(res);  // we handled it above.
+  // The candidates are the members of the smallest shard result. Every other result, in order
+  // of size, filters them, so the work is bounded by the smallest result and stops as soon as
+  // no candidates are left.
+  sort(shard_results.begin(), shard_results.end(),
+       [](const StringVec* l, const StringVec* r) { return l->size() < r->size(); });
 
-    // I use this awkward 'first' condition instead of table[s]++ deliberately.
-    // I do not want to add keys that I know will not stay in the set.
-    if (first) {
-      for (const string& s : res.value()) {
-        uniques.emplace(s, 1);
-      }
-      first = false;
-    } else {
-      for (const string& s : res.value()) {
-        auto it = uniques.find(s);
-        if (it != uniques.end()) {
-          ++it->second;
-        }
+  absl::flat_hash_map<std::string_view, unsigned> uniques;
+  uniques.reserve(shard_results.front()->size());
+  for (const string& s : *shard_results.front()) {
+    uniques.emplace(s, 1);
+  }
+
+  for (size_t i = 1; i < shard_results.size() && !uniques.empty(); ++i) {
+    for (const string& s : *shard_results[i]) {
+      auto it = uniques.find(s);
+      if (it != uniques.end()) {
+        ++it->second;
       }
     }
+    absl::erase_if(uniques, [i](const auto& k_v) { return k_v.second <= i; });
   }
 
   SvArray result;
-  result.reserve(uniques.size());
+  result.reserve(limit ? min<size_t>(limit, uniques.size()) : uniques.size());
 
   for (const auto& k_v : uniques) {
-    if (k_v.second == required_shard_cnt) {
-      if (limit != 0 && result.size() >= limit)
-        return result;
-      result.push_back(k_v.first);
-    }
+    if (limit != 0 && result.size() >= limit)
+      return result;
+    result.push_back(k_v.first);
   }
 
   return result;
@@ -471,36 +602,35 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, const NewE
   }
 
   uint32_t res = 0;
+  size_t int_vals = 0;  // the leading values that were added to a set of integers.
 
-  if (co.Encoding() == kEncodingIntSet) {
-    intset* is = (intset*)co.RObjPtr();
-    bool success = true;
-
-    for (auto val : vals_it) {
-      bool added = false;
-      is = IntsetAddSafe(val, is, &success, &added);
-      res += added;
-
-      if (!success) {
-        co.SetRObjPtr(is);
+  for (string_view val : vals_it) {
+    if (!IsIntEncoding(co.Encoding()))
+      break;
 
-        StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
-        if (!ss) {
-          return OpStatus::OUT_OF_MEMORY;
-        }
+    long long llval;
+    if (!string2ll(val.data(), val.size(), &llval)) {
+      if (!ConvertIntsToStrSet(&co))
+        return OpStatus::OUT_OF_MEMORY;
+      break;
+    }
 
-        // frees 'is' on a way.
-        co.InitRobj(OBJ_SET, kEncodingStrMap2, ss);
-        break;
-      }
+    ++int_vals;
+    if (co.Encoding() == kEncodingRoaring) {
+      res += ((RoaringIntSet*)co.RObjPtr())->Add(llval);
+      continue;
     }
 
-    if (success)
-      co.SetRObjPtr(is);
+    uint8_t inserted = 0;
+    intset* is = intsetAdd((intset*)co.RObjPtr(), llval, &inserted);
+    co.SetRObjPtr(is);
+    res += inserted;
+    if (intsetLen(is) > kMaxIntSetEntries && !ConvertLargeIntSet(&co))
+      return OpStatus::OUT_OF_MEMORY;
   }
 
-  if (co.Encoding() != kEncodingIntSet) {
-    res = StringSetWrapper{co, op_args.db_cntx}.Add(vals, UINT32_MAX);
+  if (IsDenseEncoding(co)) {
+    res += StringSetWrapper{co, op_args.db_cntx}.Add(vals, UINT32_MAX, int_vals);
   }
 
   if (journal_update && op_args.shard->journal()) {
@@ -534,19 +664,16 @@ OpResult<uint32_t> OpAddEx(const OpArgs& op_args, string_view key, uint32_t ttl_
       return OpStatus::WRONG_TYPE;
 
     // Update stats and trigger any handle the old value if needed.
-    if (co.Encoding() == kEncodingIntSet) {
-      intset* is = (intset*)co.RObjPtr();
-      StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
-      if (!ss) {
-        return OpStatus::OUT_OF_MEMORY;
-      }
-      co.InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+    if (IsIntEncoding(co.Encoding()) && !ConvertIntsToStrSet(&co)) {
+      return OpStatus::OUT_OF_MEMORY;
     }
 
     CHECK(IsDenseEncoding(co));
   }
 
-  return StringSetWrapper{co, op_args.db_cntx}.Add(vals, ttl_sec);
+  uint32_t res = StringSetWrapper{co, op_args.db_cntx}.Add(vals, ttl_sec);
+  db_slice.RegisterMemberExpiry(op_args.db_cntx, key, ttl_sec);
+  return res;
 }
 
 OpResult<uint32_t> OpRem(const OpArgs& op_args, string_view key, facade::ArgRange vals,
@@ -666,24 +793,41 @@ OpResult<unsigned> Mover::Commit(Transaction* t) {
   return res;
 }
 
+// Unites sets of integers, of which at least one is a roaring bitmap, as a roaring bitmap.
+StringVec UniteRoaringSets(const vector<SetType>& sets) {
+  RoaringIntSet united{PMR_NS::get_default_resource()};
+  for (const SetType& st : sets) {
+    if (st.second == kEncodingRoaring) {
+      united.Unite(*(const RoaringIntSet*)st.first);
+      continue;
+    }
+
+    int64_t intele;
+    int ii = 0;
+    while (intsetGet((intset*)st.first, ii++, &intele))
+      united.Add(intele);
+  }
+
+  StringVec result;
+  result.reserve(united.Size());
+  united.Iterate([&result](int64_t val) {
+    result.push_back(absl::StrCat(val));
+    return true;
+  });
+  return result;
+}
+
 // Read-only OpUnion op on sets.
 OpResult<StringVec> OpUnion(const OpArgs& op_args, ShardArgs::Iterator start,
                             ShardArgs::Iterator end) {
   DCHECK(start != end);
-  absl::flat_hash_set<string> uniques;
+  vector<SetType> sets;
 
   for (; start != end; ++start) {
     auto find_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, *start, OBJ_SET);
     if (find_res) {
       const PrimeValue& pv = find_res.value()->second;
-      if (IsDenseEncoding(pv)) {
-        StringSet* ss = (StringSet*)pv.RObjPtr();
-        ss->set_time(MemberTimeSeconds(op_args.db_cntx.time_now_ms));
-      }
-      container_utils::IterateSet(pv, [&uniques](container_utils::ContainerEntry ce) {
-        uniques.emplace(ce.ToString());
-        return true;
-      });
+      sets.emplace_back(pv.RObjPtr(), pv.Encoding());
       continue;
     }
 
@@ -692,6 +836,31 @@ OpResult<StringVec> OpUnion(const OpArgs& op_args, ShardArgs::Iterator start,
     }
   }
 
+  bool all_ints =
+      all_of(sets.begin(), sets.end(), [](const SetType& st) { return IsIntEncoding(st.second); });
+  if (all_ints && any_of(sets.begin(), sets.end(),
+                         [](const SetType& st) { return st.second == kEncodingRoaring; })) {
+    return UniteRoaringSets(sets);
+  }
+
+  absl::flat_hash_set<string> uniques;
+  for (const SetType& st : sets) {
+    if (st.second == kEncodingIntSet) {
+      int64_t intele;
+      int ii = 0;
+      while (intsetGet((intset*)st.first, ii++, &intele))
+        uniques.emplace(absl::StrCat(intele));
+    } else if (st.second == kEncodingRoaring) {
+      ((const RoaringIntSet*)st.first)->Iterate([&uniques](int64_t val) {
+        uniques.emplace(absl::StrCat(val));
+        return true;
+      });
+    } else {
+      for (string_view str : StringSetWrapper{st, op_args.db_cntx}.Range())
+        uniques.emplace(str);
+    }
+  }
+
   return ToVec(std::move(uniques));
 }
 
@@ -731,7 +900,22 @@ OpResult<StringVec> OpDiff(const OpArgs& op_args, ShardArgs::Iterator start,
     }
 
     SetType st2{diff_res.value()->second.RObjPtr(), diff_res.value()->second.Encoding()};
-    if (st2.second == kEncodingIntSet) {
+    if (st2.second == kEncodingRoaring) {
+      // Looks up the remaining members in the bitmap, or the members of the bitmap in them.
+      const RoaringIntSet* rs = (const RoaringIntSet*)st2.first;
+      if (uniques.size() < rs->Size()) {
+        absl::erase_if(uniques, [&](const string& member) {
+          return IsInSet(op_args.db_cntx, st2, member);
+        });
+      } else {
+        char buf[32];
+        rs->Iterate([&](int64_t val) {
+          char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
+          uniques.erase(string_view{buf, size_t(next - buf)});
+          return !uniques.empty();
+        });
+      }
+    } else if (st2.second == kEncodingIntSet) {
       int ii = 0;
       intset* is = (intset*)st2.first;
       int64_t intele;
@@ -749,8 +933,10 @@ OpResult<StringVec> OpDiff(const OpArgs& op_args, ShardArgs::Iterator start,
   return ToVec(std::move(uniques));
 }
 
-// Read-only OpInter op on sets.
-OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first) {
+// Read-only OpInter op on sets. Stops after limit members if limit is not 0, which is only
+// correct if the shard holds all the keys.
+OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first,
+                            unsigned limit = 0) {
   auto& db_slice = t->GetDbSlice(es->shard_id());
   ShardArgs args = t->GetShardArgs(es->shard_id());
   auto it = args.begin();
@@ -772,9 +958,9 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
     }
 
     container_utils::IterateSet(find_res.value()->second,
-                                [&result](container_utils::ContainerEntry ce) {
+                                [&result, limit](container_utils::ContainerEntry ce) {
                                   result.push_back(ce.ToString());
-                                  return true;
+                                  return limit == 0 || result.size() < limit;
                                 });
     return result;
   }
@@ -807,8 +993,34 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
 
   std::sort(sets.begin(), sets.end(), comp);
 
+  bool all_intsets = all_of(sets.begin(), sets.end(),
+                            [](const SetType& st) { return st.second == kEncodingIntSet; });
+  bool all_roaring = all_of(sets.begin(), sets.end(),
+                            [](const SetType& st) { return st.second == kEncodingRoaring; });
   int encoding = sets.front().second;
-  if (encoding == kEncodingIntSet) {
+  if (all_intsets) {
+    InterIntSets(sets, limit, &result);
+  } else if (all_roaring) {
+    vector<const RoaringIntSet*> roaring_sets(sets.size());
+    for (size_t i = 0; i < sets.size(); ++i)
+      roaring_sets[i] = (const RoaringIntSet*)sets[i].first;
+
+    vector<int64_t> values;
+    RoaringIntSet::Intersect(roaring_sets, limit, &values);
+    result.reserve(values.size());
+    for (int64_t val : values)
+      result.push_back(absl::StrCat(val));
+  } else if (encoding == kEncodingRoaring) {
+    const RoaringIntSet* rs = (const RoaringIntSet*)sets.front().first;
+    rs->Iterate([&](int64_t val) {
+      for (size_t j = 1; j < sets.size(); j++) {
+        if (sets[j].first != rs && !IsInSet(t->GetDbContext(), sets[j], val))
+          return true;
+      }
+      result.push_back(absl::StrCat(val));
+      return limit == 0 || result.size() < limit;
+    });
+  } else if (encoding == kEncodingIntSet) {
     int ii = 0;
     intset* is = (intset*)sets.front().first;
     int64_t intele;
@@ -823,10 +1035,12 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
       /* Only take action when all sets contain the member */
       if (j == sets.size()) {
         result.push_back(absl::StrCat(intele));
+        if (limit && result.size() >= limit)
+          break;
       }
     }
   } else {
-    InterStrSet(t->GetDbContext(), sets, &result);
+    InterStrSet(t->GetDbContext(), sets, limit, &result);
   }
 
   return result;
@@ -932,7 +1146,27 @@ OpResult<StringVec> OpScan(const OpArgs& op_args, string_view key, uint64_t* cur
   auto it = find_res.value();
   StringVec res;
 
-  if (it->second.Encoding() == kEncodingIntSet) {
+  if (it->second.Encoding() == kEncodingRoaring) {
+    // The cursor is the last visited member, biased so that it is never 0 while more members
+    // may follow.
+    const RoaringIntSet* rs = (const RoaringIntSet*)it->second.RObjPtr();
+    int64_t from = numeric_limits<int64_t>::min();
+    if (*cursor != 0)
+      from = int64_t((*cursor - 1) ^ (uint64_t{1} << 63)) + 1;
+
+    uint32_t visited = 0;
+    bool done = rs->Iterate(
+        [&](int64_t val) {
+          std::string int_str = absl::StrCat(val);
+          if (scan_op.Matches(int_str))
+            res.push_back(std::move(int_str));
+          *cursor = (uint64_t(val) ^ (uint64_t{1} << 63)) + 1;
+          return ++visited < scan_op.limit;
+        },
+        from);
+    if (done)
+      *cursor = 0;
+  } else if (it->second.Encoding() == kEncodingIntSet) {
     intset* is = (intset*)it->second.RObjPtr();
     int64_t intele;
     uint32_t pos = 0;
@@ -1033,10 +1267,13 @@ void SMIsMember(CmdArgList args, ConnectionContext* cntx) {
     auto find_res = t->GetDbSlice(shard->shard_id()).FindReadOnly(db_cntx, key, OBJ_SET);
     if (find_res) {
       SetType st{(*find_res)->second.RObjPtr(), find_res.value()->second.Encoding()};
-      for (size_t i = 0; i < members.size(); ++i) {
-        auto member = members[i];
-        bool status = IsInSet(db_cntx, st, ToSV(member));
-        memberships[i] = status;
+      if (IsIntEncoding(st.second)) {
+        for (size_t i = 0; i < members.size(); ++i)
+          memberships[i] = IsInSet(db_cntx, st, ToSV(members[i]));
+      } else {
+        StringSetWrapper ss{st, db_cntx};
+        for (size_t i = 0; i < members.size(); ++i)
+          memberships[i] = ss->Contains(ToSV(members[i]));
       }
       return OpStatus::OK;
     }
@@ -1209,7 +1446,44 @@ void SDiffStore(CmdArgList args, ConnectionContext* cntx) {
   cntx->SendLong(result_size);
 }
 
+// Reads the next chunk of SMEMBERS. Large sets are scanned, which yields every member once as the
+// set can not change between the hops, unless members expire, so such sets are read at once.
+OpStatus OpMembersChunk(Transaction* t, EngineShard* es, container_utils::ReplyChunk* chunk) {
+  OpArgs op_args = t->GetOpArgs(es);
+  string_view key = t->GetShardArgs(es->shard_id()).Front();
+  if (chunk->cursor == 0) {
+    auto find_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_SET);
+    RETURN_ON_BAD_STATUS(find_res);
+
+    const PrimeValue& pv = find_res.value()->second;
+    bool scannable = pv.Encoding() == kEncodingRoaring ||
+                     (IsDenseEncoding(pv) && !((StringSet*)pv.RObjPtr())->ExpirationUsed());
+    if (pv.Size() <= chunk->limit || !scannable) {
+      OpResult<StringVec> res = OpInter(t, es, false);
+      RETURN_ON_BAD_STATUS(res);
+      chunk->total = res->size();
+      chunk->elements = std::move(*res);
+      return OpStatus::OK;
+    }
+    chunk->total = pv.Size();
+  }
+
+  ScanOpts scan_op;
+  scan_op.limit = chunk->limit;
+  OpResult<StringVec> res = OpScan(op_args, key, &chunk->cursor, scan_op);
+  RETURN_ON_BAD_STATUS(res);
+  chunk->elements = std::move(*res);
+  return OpStatus::OK;
+}
+
 void SMembers(CmdArgList args, ConnectionContext* cntx) {
+  // Scripts sort the members, so they need the whole reply at once.
+  if (!cntx->transaction->IsMulti()) {
+    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+    return container_utils::SendChunkedReply(cntx->transaction, rb, RedisReplyBuilder::SET,
+                                             OpMembersChunk);
+  }
+
   auto cb = [](Transaction* t, EngineShard* shard) { return OpInter(t, shard, false); };
 
   OpResult<StringVec> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
@@ -1324,7 +1598,9 @@ void SInterCard(CmdArgList args, ConnectionContext* cntx) {
 
   ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
+    // A single shard computes the final intersection and can stop at the limit.
+    unsigned shard_limit = t->GetUniqueShardCnt() == 1 ? limit : 0;
+    result_set[shard->shard_id()] = OpInter(t, shard, false, shard_limit);
     return OpStatus::OK;
   };
 
@@ -1461,6 +1737,24 @@ void SAddEx(CmdArgList args, ConnectionContext* cntx) {
 
 }  // namespace
 
+StringSet* SetFamily::ConvertToStrSet(const RoaringIntSet& rs) {
+  char buf[32];
+  StringSet* ss = CompactObj::AllocateMR<StringSet>();
+  ss->Reserve(rs.Size());
+
+  rs.Iterate([&](int64_t val) {
+    char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
+    CHECK(ss->Add(string_view{buf, size_t(next - buf)}));
+    return true;
+  });
+  return ss;
+}
+
+bool SetFamily::KeepAsRoaring(const RoaringIntSet& rs) {
+  return GetFlag(FLAGS_set_roaring_encoding) &&
+         rs.MallocUsed() <= rs.Size() * kMaxRoaringBytesPerMember;
+}
+
 StringSet* SetFamily::ConvertToStrSet(const intset* is, size_t expected_len) {
   int64_t intele;
   char buf[32];
@@ -1549,15 +1843,10 @@ vector<long> SetFamily::SetFieldsExpireTime(const OpArgs& op_args, uint32_t ttl_
                                             CmdArgList values, PrimeValue* pv) {
   DCHECK_EQ(OBJ_SET, pv->ObjType());
 
-  if (pv->Encoding() == kEncodingIntSet) {
-    // a valid result can never be a intset, since it doesnt keep ttl
-    intset* is = (intset*)pv->RObjPtr();
-    StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
-    if (!ss) {
-      std::vector<long> out(values.size(), -2);
-      return out;
-    }
-    pv->InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+  // a valid result can never be a set of integers, since they do not keep ttl
+  if (IsIntEncoding(pv->Encoding()) && !ConvertIntsToStrSet(pv)) {
+    std::vector<long> out(values.size(), -2);
+    return out;
   }
 
   return ExpireElements((StringSet*)pv->RObjPtr(), values, ttl_sec);
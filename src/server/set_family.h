@@ -18,6 +18,7 @@ class ConnectionContext;
 class CommandRegistry;
 class EngineShard;
 class StringSet;
+class RoaringIntSet;
 
 class SetFamily {
  public:
@@ -27,6 +28,11 @@ class SetFamily {
 
   // Returns nullptr on OOM.
   static StringSet* ConvertToStrSet(const intset* is, size_t expected_len);
+  static StringSet* ConvertToStrSet(const RoaringIntSet& rs);
+
+  // Returns true if a large set of integers should be kept as the roaring bitmap rs rather than
+  // a StringSet: if set_roaring_encoding is on and the bitmap is small enough for its size.
+  static bool KeepAsRoaring(const RoaringIntSet& rs);
 
   // returns expiry time in seconds since kMemberExpiryBase date.
   // returns -3 if field was not found, -1 if no ttl is associated with the item.
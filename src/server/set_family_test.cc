@@ -4,6 +4,7 @@
 
 #include "server/set_family.h"
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -19,6 +20,8 @@ using namespace std;
 using namespace util;
 using namespace boost;
 
+ABSL_DECLARE_FLAG(uint32_t, container_reply_chunk_size);
+
 namespace dfly {
 
 class SetFamilyTest : public BaseFamilyTest {
@@ -138,6 +141,36 @@ TEST_F(SetFamilyTest, SInterCard) {
   EXPECT_THAT(resp, ErrArg("value is not an integer or out of range"));
 }
 
+TEST_F(SetFamilyTest, SInterIntSets) {
+  vector<string> cmd_a = {"sadd", "{t}a"}, cmd_b = {"sadd", "{t}b"}, cmd_c = {"sadd", "{t}c"};
+  for (int i = -50; i < 100; ++i) {
+    cmd_a.push_back(absl::StrCat(i * 2));
+    cmd_b.push_back(absl::StrCat(i * 3));
+    if (i % 2 == 0)
+      cmd_c.push_back(absl::StrCat(i * 100000));
+  }
+  Run(absl::MakeSpan(cmd_a));
+  Run(absl::MakeSpan(cmd_b));
+  Run(absl::MakeSpan(cmd_c));
+
+  auto resp = Run({"sinter", "{t}a", "{t}b"});
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  EXPECT_EQ(50u, resp.GetVec().size());  // multiples of 6 in [-100, 198]
+  EXPECT_EQ(50, CheckedInt({"sintercard", "2", "{t}a", "{t}b"}));
+  EXPECT_EQ(7, CheckedInt({"sintercard", "2", "{t}a", "{t}b", "LIMIT", "7"}));
+
+  // Elements of different intset encodings.
+  resp = Run({"sinter", "{t}a", "{t}b", "{t}c"});
+  EXPECT_EQ(resp, "0");
+  Run({"sadd", "{t}a", "600000"});
+  Run({"sadd", "{t}b", "600000"});
+  EXPECT_THAT(Run({"sinter", "{t}c", "{t}b", "{t}a"}).GetVec(),
+              UnorderedElementsAre("0", "600000"));
+
+  EXPECT_THAT(Run({"smismember", "{t}c", "0", "1", "x", "600000"}).GetVec(),
+              ElementsAre(IntArg(1), IntArg(0), IntArg(0), IntArg(1)));
+}
+
 TEST_F(SetFamilyTest, SMove) {
   auto resp = Run({"sadd", "a", "1", "2", "3", "4"});
   Run({"sadd", "b", "3", "5", "6", "2"});
@@ -353,6 +386,74 @@ TEST_F(SetFamilyTest, SScan) {
   EXPECT_THAT(vec.size(), 0);
 }
 
+TEST_F(SetFamilyTest, ActiveMemberExpiry) {
+  EXPECT_EQ(CheckedInt({"SADDEX", "foo", "10", "a", "b"}), 2);
+  EXPECT_EQ(CheckedInt({"SADDEX", "bar", "10", "a"}), 1);
+  EXPECT_EQ(CheckedInt({"SADDEX", "bar", "100", "b"}), 1);
+
+  AdvanceTime(30'000);
+  shard_set->RunBlockingInParallel([](EngineShard* es) { es->RetireExpiredAndEvict(); });
+
+  EXPECT_EQ(CheckedInt({"DBSIZE"}), 1);
+  EXPECT_EQ(CheckedInt({"EXISTS", "foo"}), 0);
+  EXPECT_THAT(Run({"SMEMBERS", "bar"}), "b");
+}
+
+TEST_F(SetFamilyTest, LargeIntSet) {
+  vector<string> args = {"SADD", "ids"};
+  for (int i = 0; i < 1000; ++i)
+    args.push_back(absl::StrCat(i * 3));
+  EXPECT_THAT(Run(absl::MakeSpan(args)), IntArg(1000));
+  EXPECT_EQ(1, CheckedInt({"SADD", "ids", "1", "3"}));
+  EXPECT_EQ(1001, CheckedInt({"SCARD", "ids"}));
+  EXPECT_EQ(1, CheckedInt({"SISMEMBER", "ids", "2997"}));
+  EXPECT_EQ(0, CheckedInt({"SISMEMBER", "ids", "2998"}));
+
+  Run({"SADD", "small", "6", "7", "-1"});
+  EXPECT_THAT(Run({"SINTER", "ids", "small"}).GetString(), "6");
+  EXPECT_EQ(1003, CheckedInt({"SUNIONSTORE", "all", "ids", "small"}));
+  EXPECT_EQ(1, CheckedInt({"SINTERCARD", "2", "ids", "all", "LIMIT", "1"}));
+
+  vector<string> members;
+  string cursor = "0";
+  do {
+    auto resp = Run({"SSCAN", "all", cursor, "COUNT", "100"});
+    ASSERT_THAT(resp, ArrLen(2));
+    cursor = resp.GetVec()[0].GetString();
+    for (const auto& member : StrArray(resp.GetVec()[1]))
+      members.push_back(member);
+  } while (cursor != "0");
+  EXPECT_EQ(1003u, members.size());
+
+  Run({"DEBUG", "RELOAD"});
+  EXPECT_EQ(1003, CheckedInt({"SCARD", "all"}));
+  EXPECT_EQ(1, CheckedInt({"SISMEMBER", "all", "-1"}));
+
+  // A member that is not an integer converts the set.
+  EXPECT_EQ(1, CheckedInt({"SADD", "ids", "x", "6"}));
+  EXPECT_EQ(1002, CheckedInt({"SCARD", "ids"}));
+  EXPECT_EQ(1, CheckedInt({"SISMEMBER", "ids", "2997"}));
+}
+
+TEST_F(SetFamilyTest, ChunkedMembers) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_container_reply_chunk_size, 16);
+
+  // Both the string and the roaring encodings are read in chunks.
+  vector<string> strs = {"SADD", "strs"}, ids = {"SADD", "ids"};
+  for (int i = 0; i < 1000; ++i) {
+    strs.push_back(absl::StrCat("m", i));
+    ids.push_back(absl::StrCat(i * 3));
+  }
+  Run(absl::MakeSpan(strs));
+  Run(absl::MakeSpan(ids));
+
+  EXPECT_THAT(StrArray(Run({"SMEMBERS", "strs"})),
+              UnorderedElementsAreArray(strs.begin() + 2, strs.end()));
+  EXPECT_THAT(StrArray(Run({"SMEMBERS", "ids"})), ElementsAreArray(ids.begin() + 2, ids.end()));
+  EXPECT_THAT(Run({"SMEMBERS", "none"}), ArrLen(0));
+}
+
 TEST_F(SetFamilyTest, IntSetMemcpy) {
   // This logic is used in CompactObject::DefragIntSet
   intset* original = intsetNew();
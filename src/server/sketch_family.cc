@@ -0,0 +1,568 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/sketch_family.h"
+
+#include <absl/strings/numbers.h>
+
+#include <cmath>
+
+#include "core/sketch.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+constexpr string_view kCmsKeyNotFoundErr = "CMS: key does not exist";
+constexpr string_view kCmsKeyExistsErr = "CMS: key already exists";
+constexpr string_view kTopKKeyNotFoundErr = "TopK: key does not exist";
+constexpr string_view kTopKKeyExistsErr = "TopK: key already exists";
+
+// Bounds the memory of a single sketch.
+constexpr uint64_t kMaxCounters = 1ULL << 27;
+
+// Same limit as RedisBloom, every unit of an increment may decay a colliding counter.
+constexpr uint32_t kMaxTopKIncr = 100000;
+
+using Counts = vector<uint32_t>;
+using Expelled = vector<optional<string>>;
+
+// Copy of a source of CMS.MERGE that lives on another shard.
+struct CmsCopy {
+  uint32_t width = 0, depth = 0;
+  uint64_t count = 0;
+  string counters;
+};
+
+bool ValidDimensions(uint64_t width, uint64_t depth) {
+  return width > 0 && depth > 0 && width * depth <= kMaxCounters;
+}
+
+// Parses <item> <increment> pairs.
+bool ParseIncrements(CmdArgList args, vector<pair<string_view, uint32_t>>* res) {
+  if (args.empty() || args.size() % 2 != 0)
+    return false;
+  for (size_t i = 0; i < args.size(); i += 2) {
+    uint32_t incr;
+    if (!absl::SimpleAtoi(ArgS(args, i + 1), &incr))
+      return false;
+    res->emplace_back(ArgS(args, i), incr);
+  }
+  return true;
+}
+
+void SendCounts(const Counts& counts, ConnectionContext* cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(counts.size());
+  for (uint32_t count : counts)
+    rb->SendLong(count);
+}
+
+void SendExpelled(const Expelled& expelled, ConnectionContext* cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(expelled.size());
+  for (const auto& item : expelled) {
+    if (item)
+      rb->SendBulkString(*item);
+    else
+      rb->SendNull();
+  }
+}
+
+OpStatus OpCmsInit(const OpArgs& op_args, string_view key, uint32_t width, uint32_t depth) {
+  OpResult op_res = op_args.GetDbSlice().AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetCMS(width, depth);
+  return OpStatus::OK;
+}
+
+OpResult<Counts> OpCmsIncrBy(const OpArgs& op_args, string_view key,
+                             const vector<pair<string_view, uint32_t>>& items) {
+  auto it_res = op_args.GetDbSlice().FindMutable(op_args.db_cntx, key, OBJ_CMS);
+  if (!it_res)
+    return it_res.status();
+
+  CountMinSketch* cms = it_res->it->second.GetCMS();
+  Counts res(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    res[i] = cms->IncrBy(items[i].first, items[i].second);
+  return res;
+}
+
+OpResult<Counts> OpCmsQuery(const OpArgs& op_args, string_view key, CmdArgList items) {
+  auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_CMS);
+  if (!it_res)
+    return it_res.status();
+
+  const CountMinSketch* cms = (*it_res)->second.GetCMS();
+  Counts res(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    res[i] = cms->Query(ToSV(items[i]));
+  return res;
+}
+
+// Merges the sources into the destination. All the keys belong to the shard of op_args, so
+// the sketches are merged in place without copying them.
+OpStatus OpCmsMergeLocal(const OpArgs& op_args, string_view dest, const vector<string_view>& srcs,
+                         const vector<int64_t>& weights) {
+  auto& db_slice = op_args.GetDbSlice();
+  vector<const CountMinSketch*> src_cms;
+  for (string_view src : srcs) {
+    auto it_res = db_slice.FindReadOnly(op_args.db_cntx, src, OBJ_CMS);
+    if (!it_res)
+      return it_res.status();
+    src_cms.push_back((*it_res)->second.GetCMS());
+  }
+
+  auto it_res = db_slice.FindMutable(op_args.db_cntx, dest, OBJ_CMS);
+  if (!it_res)
+    return it_res.status();
+
+  CountMinSketch* cms = it_res->it->second.GetCMS();
+  for (const CountMinSketch* src : src_cms) {
+    if (src->width() != cms->width() || src->depth() != cms->depth())
+      return OpStatus::INVALID_VALUE;
+  }
+  cms->Merge(src_cms, weights);
+  return OpStatus::OK;
+}
+
+// Copies the sources that belong to the shard.
+OpStatus OpCmsCopySources(Transaction* t, EngineShard* shard, const vector<string_view>& srcs,
+                          vector<CmsCopy>* copies) {
+  auto& db_slice = t->GetDbSlice(shard->shard_id());
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    if (Shard(srcs[i], shard_set->size()) != shard->shard_id())
+      continue;
+
+    auto it_res = db_slice.FindReadOnly(t->GetDbContext(), srcs[i], OBJ_CMS);
+    if (!it_res)
+      return it_res.status();
+
+    const CountMinSketch* cms = (*it_res)->second.GetCMS();
+    (*copies)[i] = {cms->width(), cms->depth(), cms->count(), string{cms->data()}};
+  }
+  return OpStatus::OK;
+}
+
+OpStatus OpCmsMergeCopies(const OpArgs& op_args, string_view dest, const vector<CmsCopy>& copies,
+                          const vector<int64_t>& weights) {
+  auto it_res = op_args.GetDbSlice().FindMutable(op_args.db_cntx, dest, OBJ_CMS);
+  if (!it_res)
+    return it_res.status();
+
+  CountMinSketch* cms = it_res->it->second.GetCMS();
+  vector<unique_ptr<CountMinSketch>> srcs;
+  for (const CmsCopy& copy : copies) {
+    if (copy.width != cms->width() || copy.depth != cms->depth())
+      return OpStatus::INVALID_VALUE;
+    srcs.push_back(
+        make_unique<CountMinSketch>(copy.width, copy.depth, PMR_NS::get_default_resource()));
+    srcs.back()->Load(copy.counters, copy.count);
+  }
+
+  vector<const CountMinSketch*> src_ptrs;
+  for (const auto& src : srcs)
+    src_ptrs.push_back(src.get());
+  cms->Merge(src_ptrs, weights);
+  return OpStatus::OK;
+}
+
+OpStatus OpTopKReserve(const OpArgs& op_args, string_view key, uint32_t k, uint32_t width,
+                       uint32_t depth, double decay) {
+  OpResult op_res = op_args.GetDbSlice().AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetTopK(k, width, depth, decay);
+  return OpStatus::OK;
+}
+
+OpResult<Expelled> OpTopKAdd(const OpArgs& op_args, string_view key,
+                             const vector<pair<string_view, uint32_t>>& items) {
+  auto it_res = op_args.GetDbSlice().FindMutable(op_args.db_cntx, key, OBJ_TOPK);
+  if (!it_res)
+    return it_res.status();
+
+  TopK* topk = it_res->it->second.GetTopK();
+  Expelled res(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (items[i].second > 0)
+      res[i] = topk->Add(items[i].first, items[i].second);
+  }
+  return res;
+}
+
+// Runs f on the top-k sketch of the key and returns its result.
+template <typename F> auto ReadTopK(ConnectionContext* cntx, string_view key, F&& f) {
+  using Result = OpResult<decltype(f(declval<const TopK&>()))>;
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> Result {
+    auto it_res = t->GetDbSlice(shard->shard_id()).FindReadOnly(t->GetDbContext(), key, OBJ_TOPK);
+    if (!it_res)
+      return it_res.status();
+    return f(*(*it_res)->second.GetTopK());
+  };
+  return cntx->transaction->ScheduleSingleHopT(std::move(cb));
+}
+
+void SendTopKError(OpStatus status, ConnectionContext* cntx) {
+  if (status == OpStatus::KEY_NOTFOUND)
+    return cntx->SendError(kTopKKeyNotFoundErr);
+  return cntx->SendError(status);
+}
+
+void SendCmsError(OpStatus status, ConnectionContext* cntx) {
+  switch (status) {
+    case OpStatus::KEY_NOTFOUND:
+      return cntx->SendError(kCmsKeyNotFoundErr);
+    case OpStatus::KEY_EXISTS:
+      return cntx->SendError(kCmsKeyExistsErr);
+    case OpStatus::INVALID_VALUE:
+      return cntx->SendError("CMS: width/depth is not equal");
+    default:
+      return cntx->SendError(status);
+  }
+}
+
+void CmsInit(string_view key, uint64_t width, uint64_t depth, ConnectionContext* cntx) {
+  if (!ValidDimensions(width, depth))
+    return cntx->SendError("CMS: invalid width/depth");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCmsInit(t->GetOpArgs(shard), key, width, depth);
+  };
+  SendCmsError(cntx->transaction->ScheduleSingleHop(std::move(cb)), cntx);
+}
+
+}  // namespace
+
+void SketchFamily::CmsInitByDim(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  auto [key, width, depth] = parser.Next<string_view, uint32_t, uint32_t>();
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  CmsInit(key, width, depth, cntx);
+}
+
+void SketchFamily::CmsInitByProb(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  auto [key, error, prob] = parser.Next<string_view, double, double>();
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  if (!(error > 0 && error < 1))
+    return cntx->SendError("CMS: invalid overestimation value");
+  if (!(prob > 0 && prob < 1))
+    return cntx->SendError("CMS: invalid prob value");
+
+  // The estimate exceeds the true count by more than error * total with probability prob.
+  double width = ceil(2 / error);
+  double depth = ceil(log10(prob) / log10(0.5));
+  if (width * depth > kMaxCounters)
+    return cntx->SendError("CMS: invalid width/depth");
+
+  CmsInit(key, uint64_t(width), uint64_t(depth), cntx);
+}
+
+void SketchFamily::CmsIncrBy(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  vector<pair<string_view, uint32_t>> items;
+  if (!ParseIncrements(args.subspan(1), &items))
+    return cntx->SendError("CMS: Cannot parse number");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCmsIncrBy(t->GetOpArgs(shard), key, items);
+  };
+
+  OpResult<Counts> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendCmsError(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+void SketchFamily::CmsQuery(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCmsQuery(t->GetOpArgs(shard), key, args.subspan(1));
+  };
+
+  OpResult<Counts> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendCmsError(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+void SketchFamily::CmsMerge(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  auto [dest, num_keys] = parser.Next<string_view, uint32_t>();
+  if (num_keys == 0)
+    return cntx->SendError(kSyntaxErr);
+
+  vector<string_view> srcs(num_keys);
+  for (auto& src : srcs)
+    src = parser.Next();
+
+  vector<int64_t> weights(num_keys, 1);
+  if (parser.Check("WEIGHTS")) {
+    for (auto& weight : weights)
+      weight = parser.Next<int32_t>();
+  }
+
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  Transaction* trans = cntx->transaction;
+  OpStatus status = OpStatus::OK;
+  if (trans->GetUniqueShardCnt() == 1) {
+    const auto cb = [&](Transaction* t, EngineShard* shard) {
+      return OpCmsMergeLocal(t->GetOpArgs(shard), dest, srcs, weights);
+    };
+    status = trans->ScheduleSingleHop(std::move(cb));
+  } else {
+    // Copy the sources in the first hop and merge them into the destination in the second.
+    vector<CmsCopy> copies(srcs.size());
+    vector<OpStatus> shard_status(shard_set->size(), OpStatus::OK);
+    const auto copy_cb = [&](Transaction* t, EngineShard* shard) {
+      shard_status[shard->shard_id()] = OpCmsCopySources(t, shard, srcs, &copies);
+      return OpStatus::OK;
+    };
+    trans->Execute(std::move(copy_cb), false);
+
+    for (OpStatus st : shard_status) {
+      if (st != OpStatus::OK)
+        status = st;
+    }
+    if (status != OpStatus::OK) {
+      trans->Conclude();
+      return SendCmsError(status, cntx);
+    }
+
+    ShardId dest_shard = Shard(dest, shard_set->size());
+    const auto merge_cb = [&](Transaction* t, EngineShard* shard) {
+      if (shard->shard_id() == dest_shard)
+        status = OpCmsMergeCopies(t->GetOpArgs(shard), dest, copies, weights);
+      return OpStatus::OK;
+    };
+    trans->Execute(std::move(merge_cb), true);
+  }
+
+  if (status != OpStatus::OK)
+    return SendCmsError(status, cntx);
+  cntx->SendOk();
+}
+
+void SketchFamily::CmsInfo(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  struct InfoResult {
+    uint32_t width, depth;
+    uint64_t count;
+  };
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<InfoResult> {
+    auto it_res = t->GetDbSlice(shard->shard_id()).FindReadOnly(t->GetDbContext(), key, OBJ_CMS);
+    if (!it_res)
+      return it_res.status();
+    const CountMinSketch* cms = (*it_res)->second.GetCMS();
+    return InfoResult{cms->width(), cms->depth(), cms->count()};
+  };
+
+  OpResult<InfoResult> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendCmsError(res.status(), cntx);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartCollection(3, RedisReplyBuilder::MAP);
+  rb->SendSimpleString("width");
+  rb->SendLong(res->width);
+  rb->SendSimpleString("depth");
+  rb->SendLong(res->depth);
+  rb->SendSimpleString("count");
+  rb->SendLong(res->count);
+}
+
+void SketchFamily::TopKReserve(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  auto [key, k] = parser.Next<string_view, uint32_t>();
+  uint32_t width = 8, depth = 7;
+  double decay = 0.9;
+  if (parser.HasNext())
+    tie(width, depth, decay) = parser.Next<uint32_t, uint32_t, double>();
+
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  if (k == 0)
+    return cntx->SendError("TopK: invalid k");
+  if (!ValidDimensions(width, depth))
+    return cntx->SendError("TopK: invalid width/depth");
+  if (!(decay > 0 && decay <= 1))
+    return cntx->SendError("TopK: invalid decay value. must be '<= 1' & '> 0'");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpTopKReserve(t->GetOpArgs(shard), key, k, width, depth, decay);
+  };
+
+  OpStatus status = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (status == OpStatus::KEY_EXISTS)
+    return cntx->SendError(kTopKKeyExistsErr);
+  cntx->SendError(status);
+}
+
+void SketchFamily::TopKAdd(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  vector<pair<string_view, uint32_t>> items;
+  for (size_t i = 1; i < args.size(); ++i)
+    items.emplace_back(ArgS(args, i), 1);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpTopKAdd(t->GetOpArgs(shard), key, items);
+  };
+
+  OpResult<Expelled> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+  SendExpelled(*res, cntx);
+}
+
+void SketchFamily::TopKIncrBy(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  vector<pair<string_view, uint32_t>> items;
+  if (!ParseIncrements(args.subspan(1), &items))
+    return cntx->SendError(kSyntaxErr);
+  for (const auto& item : items) {
+    if (item.second > kMaxTopKIncr)
+      return cntx->SendError("TopK: increment must be an integer greater or equal to 0 and "
+                             "less than or equal to 100,000");
+  }
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpTopKAdd(t->GetOpArgs(shard), key, items);
+  };
+
+  OpResult<Expelled> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+  SendExpelled(*res, cntx);
+}
+
+void SketchFamily::TopKQuery(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgList items = args.subspan(1);
+  auto res = ReadTopK(cntx, ArgS(args, 0), [&](const TopK& topk) {
+    Counts res(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+      res[i] = topk.Query(ToSV(items[i]));
+    return res;
+  });
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+void SketchFamily::TopKCount(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgList items = args.subspan(1);
+  auto res = ReadTopK(cntx, ArgS(args, 0), [&](const TopK& topk) {
+    Counts res(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+      res[i] = topk.Count(ToSV(items[i]));
+    return res;
+  });
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+void SketchFamily::TopKList(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  bool with_count = parser.Check("WITHCOUNT");
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  using List = vector<pair<string, uint32_t>>;
+  auto res = ReadTopK(cntx, key, [](const TopK& topk) {
+    List res;
+    for (const TopK::Entry& entry : topk.List())
+      res.emplace_back(entry.item, entry.count);
+    return res;
+  });
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(res->size() * (with_count ? 2 : 1));
+  for (const auto& [item, count] : *res) {
+    rb->SendBulkString(item);
+    if (with_count)
+      rb->SendLong(count);
+  }
+}
+
+void SketchFamily::TopKInfo(CmdArgList args, ConnectionContext* cntx) {
+  struct InfoResult {
+    uint32_t k, width, depth;
+    double decay;
+  };
+
+  auto res = ReadTopK(cntx, ArgS(args, 0), [](const TopK& topk) {
+    return InfoResult{topk.k(), topk.width(), topk.depth(), topk.decay()};
+  });
+  if (!res)
+    return SendTopKError(res.status(), cntx);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->SendSimpleString("k");
+  rb->SendLong(res->k);
+  rb->SendSimpleString("width");
+  rb->SendLong(res->width);
+  rb->SendSimpleString("depth");
+  rb->SendLong(res->depth);
+  rb->SendSimpleString("decay");
+  rb->SendDouble(res->decay);
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&SketchFamily::x)
+
+void SketchFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  constexpr uint32_t kWriteMask = CO::WRITE | CO::DENYOOM | CO::FAST;
+  constexpr uint32_t kReadMask = CO::READONLY | CO::FAST;
+  *registry
+      << CI{"CMS.INITBYDIM", kWriteMask, 4, 1, 1, acl::CMS}.HFUNC(CmsInitByDim)
+      << CI{"CMS.INITBYPROB", kWriteMask, 4, 1, 1, acl::CMS}.HFUNC(CmsInitByProb)
+      << CI{"CMS.INCRBY", kWriteMask, -4, 1, 1, acl::CMS}.HFUNC(CmsIncrBy)
+      << CI{"CMS.QUERY", kReadMask, -3, 1, 1, acl::CMS}.HFUNC(CmsQuery)
+      << CI{"CMS.MERGE", CO::WRITE | CO::VARIADIC_KEYS | CO::DENYOOM, -4, 3, 3, acl::CMS}.HFUNC(
+             CmsMerge)
+      << CI{"CMS.INFO", kReadMask, 2, 1, 1, acl::CMS}.HFUNC(CmsInfo)
+      << CI{"TOPK.RESERVE", kWriteMask, -3, 1, 1, acl::TOPK}.HFUNC(TopKReserve)
+      << CI{"TOPK.ADD", kWriteMask, -3, 1, 1, acl::TOPK}.HFUNC(TopKAdd)
+      << CI{"TOPK.INCRBY", kWriteMask, -4, 1, 1, acl::TOPK}.HFUNC(TopKIncrBy)
+      << CI{"TOPK.QUERY", kReadMask, -3, 1, 1, acl::TOPK}.HFUNC(TopKQuery)
+      << CI{"TOPK.COUNT", kReadMask, -3, 1, 1, acl::TOPK}.HFUNC(TopKCount)
+      << CI{"TOPK.LIST", kReadMask, -2, 1, 1, acl::TOPK}.HFUNC(TopKList)
+      << CI{"TOPK.INFO", kReadMask, 2, 1, 1, acl::TOPK}.HFUNC(TopKInfo);
+};
+
+}  // namespace dfly
@@ -0,0 +1,36 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// The CMS.* and TOPK.* commands of RedisBloom over the CountMinSketch and TopK types.
+class SketchFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void CmsInitByDim(CmdArgList args, ConnectionContext* cntx);
+  static void CmsInitByProb(CmdArgList args, ConnectionContext* cntx);
+  static void CmsIncrBy(CmdArgList args, ConnectionContext* cntx);
+  static void CmsQuery(CmdArgList args, ConnectionContext* cntx);
+  static void CmsMerge(CmdArgList args, ConnectionContext* cntx);
+  static void CmsInfo(CmdArgList args, ConnectionContext* cntx);
+
+  static void TopKReserve(CmdArgList args, ConnectionContext* cntx);
+  static void TopKAdd(CmdArgList args, ConnectionContext* cntx);
+  static void TopKIncrBy(CmdArgList args, ConnectionContext* cntx);
+  static void TopKQuery(CmdArgList args, ConnectionContext* cntx);
+  static void TopKCount(CmdArgList args, ConnectionContext* cntx);
+  static void TopKList(CmdArgList args, ConnectionContext* cntx);
+  static void TopKInfo(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
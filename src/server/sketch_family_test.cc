@@ -0,0 +1,133 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/sketch_family.h"
+
+#include "base/gtest.h"
+#include "facade/facade_test.h"
+#include "server/engine_shard_set.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::_;
+using testing::ElementsAre;
+
+class SketchFamilyTest : public BaseFamilyTest {
+ protected:
+  // Returns a key with the given prefix that belongs or does not belong to the shard of key.
+  string KeyOnShard(string_view key, string_view prefix, bool same) {
+    ShardId sid = Shard(key, shard_set->size());
+    for (unsigned i = 0;; ++i) {
+      string res = absl::StrCat(prefix, i);
+      if ((Shard(res, shard_set->size()) == sid) == same)
+        return res;
+    }
+  }
+};
+
+TEST_F(SketchFamilyTest, Cms) {
+  EXPECT_EQ(Run({"cms.initbydim", "c", "1000", "5"}), "OK");
+  EXPECT_EQ(Run({"type", "c"}), "CMSk-TYPE");
+  EXPECT_THAT(Run({"cms.initbydim", "c", "1000", "5"}), ErrArg("key already exists"));
+  EXPECT_THAT(Run({"cms.initbydim", "c2", "0", "5"}), ErrArg("invalid width/depth"));
+
+  EXPECT_THAT(Run({"cms.incrby", "c", "a", "3", "b", "1"}),
+              RespArray(ElementsAre(IntArg(3), IntArg(1))));
+  EXPECT_THAT(Run({"cms.incrby", "c", "a", "2"}), IntArg(5));
+  EXPECT_THAT(Run({"cms.incrby", "c", "a", "-2"}), ErrArg("Cannot parse number"));
+  EXPECT_THAT(Run({"cms.incrby", "c", "a", "1", "b"}), ErrArg("Cannot parse number"));
+  EXPECT_THAT(Run({"cms.query", "c", "a", "b", "x"}),
+              RespArray(ElementsAre(IntArg(5), IntArg(1), IntArg(0))));
+  EXPECT_THAT(Run({"cms.info", "c"}),
+              RespArray(ElementsAre("width", IntArg(1000), "depth", IntArg(5), "count",
+                                    IntArg(6))));
+
+  EXPECT_THAT(Run({"cms.incrby", "missing", "a", "1"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.query", "missing", "a"}), ErrArg("key does not exist"));
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"cms.query", "str", "a"}), ErrArg("WRONGTYPE"));
+
+  // width = 2 / error, depth = log2(1 / prob).
+  EXPECT_EQ(Run({"cms.initbyprob", "p", "0.001", "0.01"}), "OK");
+  EXPECT_THAT(Run({"cms.info", "p"}),
+              RespArray(ElementsAre("width", IntArg(2000), "depth", IntArg(7), "count",
+                                    IntArg(0))));
+  EXPECT_THAT(Run({"cms.initbyprob", "p2", "1", "0.01"}), ErrArg("invalid overestimation"));
+
+  Run({"cms.incrby", "c", "big", "1000"});
+  EXPECT_EQ(Run({"debug", "reload"}), "OK");
+  EXPECT_THAT(Run({"cms.query", "c", "a", "big"}),
+              RespArray(ElementsAre(IntArg(5), IntArg(1000))));
+}
+
+TEST_F(SketchFamilyTest, CmsMerge) {
+  // Sources on the shard of the destination are merged in a single hop, the others in two.
+  string dest = "dest";
+  string local = KeyOnShard(dest, "local", true);
+  string remote = KeyOnShard(dest, "remote", false);
+  for (const string& key : {dest, local, remote}) {
+    Run({"cms.initbydim", key, "100", "4"});
+  }
+  Run({"cms.incrby", local, "a", "3", "b", "1"});
+  Run({"cms.incrby", remote, "a", "10"});
+
+  EXPECT_EQ(Run({"cms.merge", dest, "1", local}), "OK");
+  EXPECT_THAT(Run({"cms.query", dest, "a", "b"}), RespArray(ElementsAre(IntArg(3), IntArg(1))));
+
+  EXPECT_EQ(Run({"cms.merge", dest, "2", local, remote, "WEIGHTS", "2", "1"}), "OK");
+  EXPECT_THAT(Run({"cms.query", dest, "a", "b"}), RespArray(ElementsAre(IntArg(16), IntArg(2))));
+
+  // The destination may be one of the sources.
+  EXPECT_EQ(Run({"cms.merge", dest, "2", dest, remote}), "OK");
+  EXPECT_THAT(Run({"cms.query", dest, "a"}), IntArg(26));
+  EXPECT_THAT(Run({"cms.info", dest}),
+              RespArray(ElementsAre("width", IntArg(100), "depth", IntArg(4), "count",
+                                    IntArg(28))));
+
+  Run({"cms.initbydim", "other", "50", "4"});
+  EXPECT_THAT(Run({"cms.merge", dest, "1", "other"}), ErrArg("width/depth is not equal"));
+  EXPECT_THAT(Run({"cms.merge", dest, "2", local, "missing"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.merge", "missing", "1", local}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.merge", dest, "1", local, "WEIGHTS"}), ErrArg("syntax error"));
+}
+
+TEST_F(SketchFamilyTest, TopK) {
+  EXPECT_EQ(Run({"topk.reserve", "t", "2", "50", "4", "0.9"}), "OK");
+  EXPECT_EQ(Run({"type", "t"}), "TopK-TYPE");
+  EXPECT_THAT(Run({"topk.reserve", "t", "2"}), ErrArg("key already exists"));
+  EXPECT_THAT(Run({"topk.reserve", "t2", "2", "50", "4", "1.5"}), ErrArg("invalid decay"));
+  EXPECT_THAT(Run({"topk.reserve", "t2", "2", "50"}), ErrArg("syntax error"));
+
+  auto resp = Run({"topk.add", "t", "a", "b", "a"});
+  ASSERT_THAT(resp, ArrLen(3));
+  for (const auto& val : resp.GetVec()) {
+    EXPECT_EQ(val.type, RespExpr::NIL);
+  }
+
+  // c enters the list and expels the least frequent item.
+  resp = Run({"topk.incrby", "t", "c", "5"});
+  EXPECT_EQ(resp, "b");
+  EXPECT_THAT(Run({"topk.incrby", "t", "c", "100001"}), ErrArg("increment must be"));
+
+  EXPECT_THAT(Run({"topk.query", "t", "a", "b", "c"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(0), IntArg(1))));
+  EXPECT_THAT(Run({"topk.count", "t", "a", "c"}), RespArray(ElementsAre(IntArg(2), IntArg(5))));
+  EXPECT_THAT(Run({"topk.list", "t"}), RespArray(ElementsAre("c", "a")));
+  EXPECT_THAT(Run({"topk.list", "t", "withcount"}),
+              RespArray(ElementsAre("c", IntArg(5), "a", IntArg(2))));
+  EXPECT_THAT(Run({"topk.info", "t"}), RespArray(ElementsAre("k", IntArg(2), "width", IntArg(50),
+                                                             "depth", IntArg(4), "decay", _)));
+
+  EXPECT_THAT(Run({"topk.add", "missing", "a"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"topk.list", "missing"}), ErrArg("key does not exist"));
+
+  EXPECT_EQ(Run({"debug", "reload"}), "OK");
+  EXPECT_THAT(Run({"topk.list", "t", "withcount"}),
+              RespArray(ElementsAre("c", IntArg(5), "a", IntArg(2))));
+  EXPECT_THAT(Run({"topk.add", "t", "c"}), ArgType(RespExpr::NIL));
+}
+
+}  // namespace dfly
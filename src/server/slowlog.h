@@ -15,6 +15,19 @@ namespace dfly {
 constexpr size_t kMaximumSlowlogArgCount = 31;  // 32 - 1 for the command name
 constexpr size_t kMaximumSlowlogArgLength = 128;
 
+// Where a slow command spent its time, reported by SLOWLOG GET VERBOSE. The transaction fields
+// are zero for commands without a transaction.
+struct SlowLogDetails {
+  uint32_t schedule_usec = 0;
+  uint32_t queue_usec = 0;  // waiting in the shard tx queue, slowest shard
+  uint32_t exec_usec = 0;   // running the shard callbacks, slowest shard
+  uint32_t reply_usec = 0;  // writing the reply to the socket
+  uint32_t hops = 0;
+  uint32_t shards = 0;
+  uint32_t tiered_reads = 0;
+  uint64_t reply_bytes = 0;
+};
+
 struct SlowLogEntry {
   uint32_t entry_id;
   uint64_t unix_ts_usec;
@@ -24,6 +37,7 @@ struct SlowLogEntry {
   std::vector<std::pair<std::string, uint32_t>> cmd_args;
   std::string client_ip;
   std::string client_name;
+  SlowLogDetails details;
 };
 
 class SlowLogShard {
@@ -33,7 +47,8 @@ class SlowLogShard {
   }
 
   void Add(const std::string_view command_name, CmdArgList args, const std::string_view client_name,
-           const std::string_view client_ip, uint64_t exec_time_usec, uint64_t unix_ts_usec);
+           const std::string_view client_ip, uint64_t exec_time_usec, uint64_t unix_ts_usec,
+           const SlowLogDetails& details = {});
   void Reset();
   void ChangeLength(size_t new_length);
 
@@ -7,20 +7,39 @@
 #include <absl/functional/bind_front.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
 
 #include <mutex>
 
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/heap_size.h"
+#include "core/usdt.h"
+#include "server/cluster/cluster_defs.h"
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
 #include "server/journal/journal.h"
 #include "server/rdb_extensions.h"
 #include "server/rdb_save.h"
+#include "server/server_state.h"
+#include "server/snapshot_index.h"
 #include "server/tiered_storage.h"
+#include "util/fibers/fiberqueue_threadpool.h"
 #include "util/fibers/synchronization.h"
 
+ABSL_FLAG(dfly::MemoryBytesFlag, snapshot_buffer_limit, dfly::MemoryBytesFlag{},
+          "Bound on the memory of the serialization buffers of a snapshot in every shard, "
+          "including its records waiting in the output channel. Above it, serialized data is "
+          "pushed right away, and snapshotting and writes that allow awaiting are throttled until "
+          "the sink drains the channel. 0 means no bound.");
+ABSL_FLAG(uint32_t, snapshot_latency_target_usec, 500,
+          "Latency in microseconds that a low priority snapshot may add to the commands of a "
+          "shard. The snapshot adapts the number of buckets it serializes between yields so that "
+          "it runs for about this long while commands are waiting.");
+ABSL_FLAG(uint32_t, snapshot_compression_threads, 0,
+          "Number of helper threads that compress the blobs of snapshots and full syncs in the "
+          "multi entry compression modes, instead of the shard threads. 0 compresses them inline.");
+
 namespace dfly {
 
 using namespace std;
@@ -34,6 +53,20 @@ thread_local absl::flat_hash_set<SliceSnapshot*> tl_slice_snapshots;
 
 constexpr size_t kMinChannelBlobSize = 32_KB;
 
+// Bounds the offloaded values that are being read for the snapshot at any given time.
+constexpr size_t kMaxDelayedBytes = 4_MB;
+
+// Bounds of the buckets a low priority snapshot traverses between yields.
+constexpr uint32_t kMinPaceBudget = 1;
+constexpr uint32_t kMaxPaceBudget = 4096;
+
+// Shared by the snapshots of all shards, created with the first one that offloads compression.
+fb2::FiberQueueThreadPool* CompressionPool() {
+  static auto* pool =
+      new fb2::FiberQueueThreadPool(absl::GetFlag(FLAGS_snapshot_compression_threads));
+  return pool;
+}
+
 }  // namespace
 
 size_t SliceSnapshot::DbRecord::size() const {
@@ -43,6 +76,8 @@ size_t SliceSnapshot::DbRecord::size() const {
 SliceSnapshot::SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMode compression_mode)
     : db_slice_(slice), dest_(dest), compression_mode_(compression_mode) {
   db_array_ = slice->databases();
+  buffer_limit_ = absl::GetFlag(FLAGS_snapshot_buffer_limit).value;
+  latency_target_usec_ = max(absl::GetFlag(FLAGS_snapshot_latency_target_usec), 1u);
   tl_slice_snapshots.insert(this);
 }
 
@@ -78,15 +113,28 @@ void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll, Snapshot
   const auto flush_threshold = serialization_max_chunk_size;
   std::function<void(size_t, RdbSerializer::FlushState)> flush_fun;
   if (flush_threshold != 0 && allow_flush == SnapshotFlush::kAllow) {
+    allow_flush_ = true;
     flush_fun = [this, flush_threshold](size_t bytes_serialized,
                                         RdbSerializer::FlushState flush_state) {
       if (bytes_serialized > flush_threshold) {
         size_t serialized = FlushChannelRecord(flush_state);
         VLOG(2) << "FlushedToChannel " << serialized << " bytes";
+        // The next record continues the entry that is being serialized.
+        if (serialized && flush_state == RdbSerializer::FlushState::kFlushMidEntry)
+          record_continues_entry_ = true;
       }
     };
   }
   serializer_ = std::make_unique<RdbSerializer>(compression_mode_, flush_fun);
+  if (absl::GetFlag(FLAGS_snapshot_compression_threads) > 0)
+    serializer_->OffloadCompression();
+
+  // The snapshot saved on shutdown is loaded on the next start, when the tiered backing files
+  // can be preserved, so it stores references to offloaded values instead of reading them.
+  reference_tiered_ =
+      !stream_journal && ServerState::tlocal()->gstate() == GlobalState::SHUTTING_DOWN;
+  if (auto* ts = db_slice_->shard_owner()->tiered_storage(); ts && reference_tiered_)
+    ts->PreserveSegments();
 
   VLOG(1) << "DbSaver::Start - saving entries with version less than " << snapshot_version_;
 
@@ -101,11 +149,11 @@ void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll, Snapshot
   });
 }
 
-void SliceSnapshot::StartIncremental(Context* cntx, LSN start_lsn) {
+void SliceSnapshot::StartIncremental(Context* cntx, LSN start_lsn, std::optional<LSN> end_lsn) {
   serializer_ = std::make_unique<RdbSerializer>(compression_mode_);
 
-  snapshot_fb_ = fb2::Fiber("incremental_snapshot", [cntx, start_lsn, this] {
-    this->SwitchIncrementalFb(cntx, start_lsn);
+  snapshot_fb_ = fb2::Fiber("incremental_snapshot", [cntx, start_lsn, end_lsn, this] {
+    this->SwitchIncrementalFb(cntx, start_lsn, end_lsn);
   });
 }
 
@@ -155,6 +203,7 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
   for (DbIndex db_indx = 0; db_indx < db_array_.size(); ++db_indx) {
     stats_.keys_total += db_slice_->DbSize(db_indx);
   }
+  pacer_.slice_start_ns = absl::GetCurrentTimeNanos();
 
   for (DbIndex db_indx = 0; db_indx < db_array_.size(); ++db_indx) {
     if (cll->IsCancelled())
@@ -168,16 +217,33 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
     current_db_ = db_indx;
 
     VLOG(1) << "Start traversing " << pt->size() << " items for index " << db_indx;
+    if (pt->size() > 0) {
+      // Lets the loader presize the tables of the db.
+      std::unique_lock lk(db_slice_->GetSerializationMutex());
+      serializer_->SendDbSize(db_indx, pt->size(), db_array_[db_indx]->expire_count());
+      record_db_mask_ |= SnapshotIndex::DbBit(db_indx);
+    }
     do {
       if (cll->IsCancelled())
         return;
 
-      PrimeTable::Cursor next =
-          db_slice_->Traverse(pt, cursor, absl::bind_front(&SliceSnapshot::BucketSaveCb, this));
-      cursor = next;
+      // Offloaded values of the traversed buckets are read together, so that neighbouring
+      // segments are fetched with coalesced disk requests.
+      TieredStorage* tiered_storage = EngineShard::tlocal()->tiered_storage();
+      if (tiered_storage)
+        tiered_storage->StartReadBatch();
+      {
+        CpuClassScope cpu_scope{CpuClass::SNAPSHOT};
+        cursor = db_slice_->Traverse(pt, cursor,
+                                     absl::bind_front(&SliceSnapshot::BucketSaveCb, this));
+      }
+      if (tiered_storage)
+        tiered_storage->FlushReadBatch();
       PushSerializedToChannel(false);
 
-      if (stats_.loop_serialized >= last_yield + 100) {
+      if (priority_ == SavePriority::kLow) {
+        PaceIteration();
+      } else if (stats_.loop_serialized >= last_yield + 100) {
         DVLOG(2) << "Before sleep " << ThisFiber::GetName();
         ThisFiber::Yield();
         DVLOG(2) << "After sleep";
@@ -201,10 +267,47 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
 
   // serialized + side_saved must be equal to the total saved.
   VLOG(1) << "Exit SnapshotSerializer (loop_serialized/side_saved/cbcalls): "
-          << stats_.loop_serialized << "/" << stats_.side_saved << "/" << stats_.savecb_calls;
+          << stats_.loop_serialized << "/" << stats_.side_saved << "/" << stats_.savecb_calls
+          << ", throttled " << stats_.throttle_count << " times for " << stats_.throttle_usec
+          << "us, peak buffers " << peak_buffers_memory_;
+  if (priority_ == SavePriority::kLow) {
+    VLOG(1) << "Low priority pacing (slices/busy slices): " << stats_.pace_slices << "/"
+            << stats_.pace_busy_slices << ", last budget " << pacer_.budget << " buckets";
+  }
 }
 
-void SliceSnapshot::SwitchIncrementalFb(Context* cntx, LSN lsn) {
+// The snapshot runs in time slices of pacer_.budget buckets and yields after each of them. The
+// budget is controlled by the load of the shard: when commands waited for the slice, either queued
+// in the transaction queue or as fibers that delayed our yield by more than the target, the budget
+// is scaled so that the next slice runs for about the target latency. Otherwise it grows, so that
+// an idle shard is saved at full speed.
+void SliceSnapshot::PaceIteration() {
+  if (++pacer_.traversed < pacer_.budget)
+    return;
+
+  EngineShard* shard = db_slice_->shard_owner();
+  bool queued = !shard->txq()->Empty();
+  uint64_t now = absl::GetCurrentTimeNanos();
+  uint64_t run_usec = (now - pacer_.slice_start_ns) / 1000;
+
+  ThisFiber::Yield();
+  uint64_t wait_usec = (absl::GetCurrentTimeNanos() - now) / 1000;
+  PushSerializedToChannel(false);
+
+  uint64_t budget = uint64_t(pacer_.budget) * 2;
+  if (queued || wait_usec > latency_target_usec_) {
+    // Average with the current budget to damp the oscillation of noisy slices.
+    budget = pacer_.budget * latency_target_usec_ / max<uint64_t>(run_usec, 1);
+    budget = (budget + pacer_.budget) / 2;
+    stats_.pace_busy_slices++;
+  }
+  pacer_.budget = clamp<uint64_t>(budget, kMinPaceBudget, kMaxPaceBudget);
+  pacer_.traversed = 0;
+  pacer_.slice_start_ns = absl::GetCurrentTimeNanos();
+  stats_.pace_slices++;
+}
+
+void SliceSnapshot::SwitchIncrementalFb(Context* cntx, LSN lsn, std::optional<LSN> end_lsn) {
   auto* journal = db_slice_->shard_owner()->journal();
   DCHECK(journal);
   DCHECK_LE(lsn, journal->GetLsn()) << "The replica tried to sync from the future.";
@@ -212,14 +315,32 @@ void SliceSnapshot::SwitchIncrementalFb(Context* cntx, LSN lsn) {
   VLOG(1) << "Starting incremental snapshot from lsn=" << lsn;
 
   // The replica sends the LSN of the next entry is wants to receive.
-  while (!cntx->IsCancelled() && journal->IsLSNInBuffer(lsn)) {
-    serializer_->WriteJournalEntry(journal->GetEntry(lsn));
+  // Entries are read from the in-memory ring or the disk backlog. Once none is available, the
+  // check below runs without preempting.
+  while (!cntx->IsCancelled() && (!end_lsn || lsn < *end_lsn)) {
+    auto entry = journal->GetEntry(lsn);
+    if (!entry)
+      break;
+
+    serializer_->WriteJournalEntry(*entry);
+    TrackRecordJournal();
     PushSerializedToChannel(false);
     lsn++;
   }
 
   VLOG(1) << "Last LSN sent in incremental snapshot was " << (lsn - 1);
 
+  if (end_lsn) {
+    if (lsn != *end_lsn && !cntx->IsCancelled()) {
+      cntx->ReportError(std::make_error_code(errc::state_not_recoverable),
+                        absl::StrCat("Delta snapshot failed because entry #", lsn,
+                                     " was dropped from the buffer"));
+    }
+    PushSerializedToChannel(true);
+    CloseRecordChannel();
+    return;
+  }
+
   // This check is safe, but it is not trivially safe.
   // We rely here on the fact that JournalSlice::AddLogRecord can
   // only preempt while holding the callback lock.
@@ -281,6 +402,7 @@ unsigned SliceSnapshot::SerializeBucket(DbIndex db_index, PrimeTable::bucket_ite
   serialize_bucket_running_ = true;
   it.SetVersion(snapshot_version_);
   unsigned result = 0;
+  DFLY_TRACE(snapshot_bucket_start, this, db_index);
 
   while (!it.is_done()) {
     ++result;
@@ -289,6 +411,7 @@ unsigned SliceSnapshot::SerializeBucket(DbIndex db_index, PrimeTable::bucket_ite
     ++it;
   }
   serialize_bucket_running_ = false;
+  DFLY_TRACE(snapshot_bucket_done, this, db_index, result);
   return result;
 }
 
@@ -299,28 +422,44 @@ void SliceSnapshot::SerializeEntry(DbIndex db_indx, const PrimeKey& pk, const Pr
 
   time_t expire_time = expire.value_or(0);
   if (!expire && pv.HasExpire()) {
-    auto eit = db_array_[db_indx]->expire.Find(pk);
+    auto eit = db_array_[db_indx]->FindExpire(pk);
     expire_time = db_slice_->ExpireTime(eit);
   }
 
   uint32_t mc_flags = pv.HasFlag() ? db_slice_->GetMCFlag(db_indx, pk) : 0;
 
-  if (pv.IsExternal()) {
-    // We can't block, so we just schedule a tiered read and append it to the delayed entries
-    util::fb2::Future<PrimeValue> future;
-    EngineShard::tlocal()->tiered_storage()->Read(
-        db_indx, pk.ToString(), pv,
-        [future](const std::string& v) mutable { future.Resolve(PrimeValue(v)); });
-    delayed_entries_.push_back(
-        {db_indx, PrimeKey(pk.ToString()), std::move(future), expire_time, mc_flags});
-    ++type_freq_map_[RDB_TYPE_STRING];
+  if (pv.IsExternal() &&
+      !(reference_tiered_ && EngineShard::tlocal()->tiered_storage()->CanReference(pv))) {
+    // We can't block, so we just schedule a tiered read and append it to the delayed entries.
+    // The value is written to the snapshot as it is stored, without being decoded into memory.
+    util::fb2::Future<string> future =
+        EngineShard::tlocal()->tiered_storage()->ReadSerialized(db_indx, pk.ToString(), pv);
+    delayed_entries_.push_back({db_indx, PrimeKey(pk.ToString()), pv.ObjType(), pv.HasFlag(),
+                                std::move(future), expire_time, mc_flags});
+    delayed_bytes_ += pv.GetExternalSlice().second;
+    // Offloaded containers are accounted once they are read and their encoding is known.
+    if (pv.ObjType() == OBJ_STRING)
+      ++type_freq_map_[RDB_TYPE_STRING];
   } else {
+    TrackRecordEntry(db_indx, pk);
     io::Result<uint8_t> res = serializer->SaveEntry(pk, pv, expire_time, mc_flags, db_indx);
     CHECK(res);
     ++type_freq_map_[*res];
   }
 }
 
+void SliceSnapshot::TrackRecordEntry(DbIndex db_indx, const PrimeKey& pk) {
+  record_db_mask_ |= SnapshotIndex::DbBit(db_indx);
+  if (cluster::IsClusterEnabled()) {
+    string scratch;
+    record_slot_groups_ |= SnapshotIndex::SlotGroupBit(cluster::KeySlot(pk.GetSlice(&scratch)));
+  }
+}
+
+void SliceSnapshot::TrackRecordJournal() {
+  record_db_mask_ = record_slot_groups_ = SnapshotIndex::kAll;
+}
+
 size_t SliceSnapshot::FlushChannelRecord(SerializerBase::FlushState flush_state) {
   io::StringFile sfile;
   serializer_->FlushToSink(&sfile, flush_state);
@@ -329,9 +468,21 @@ size_t SliceSnapshot::FlushChannelRecord(SerializerBase::FlushState flush_state)
   if (serialized == 0)
     return 0;
 
+  bool compress = serializer_->ConsumeCompressionPending();
+
+  // The following records can not be loaded without the compression dictionary in this one.
+  if (serializer_->ConsumeDictionaryWritten())
+    record_db_mask_ = record_slot_groups_ = SnapshotIndex::kAll;
+
   uint64_t id = rec_id_++;
   DVLOG(2) << "Pushing " << id;
-  DbRecord db_rec{.id = id, .value = std::move(sfile.val)};
+  DbRecord db_rec{.id = id,
+                  .value = std::move(sfile.val),
+                  .entry_start = !record_continues_entry_,
+                  .db_mask = record_db_mask_,
+                  .slot_groups = record_slot_groups_};
+  record_continues_entry_ = false;
+  record_db_mask_ = record_slot_groups_ = 0;
   fb2::NoOpLock lk;
 
   // We create a critical section here that ensures that records are pushed in sequential order.
@@ -341,6 +492,14 @@ size_t SliceSnapshot::FlushChannelRecord(SerializerBase::FlushState flush_state)
   // update last_pushed_id_ to 5.
   seq_cond_.wait(lk, [&] { return id == this->last_pushed_id_ + 1; });
 
+  // The blob is compressed on a helper thread while the shard thread runs other fibers. It is
+  // compressed only when it is its turn to be pushed, since a dictionary trained on it applies
+  // to the blobs of the following records.
+  if (compress &&
+      CompressionPool()->Await([&] { return serializer_->CompressRecord(&db_rec.value); })) {
+    db_rec.db_mask = db_rec.slot_groups = SnapshotIndex::kAll;
+  }
+
   // Blocking point.
   size_t channel_usage = dest_->Push(std::move(db_rec));
   DCHECK_EQ(last_pushed_id_ + 1, id);
@@ -354,7 +513,9 @@ size_t SliceSnapshot::FlushChannelRecord(SerializerBase::FlushState flush_state)
 }
 
 bool SliceSnapshot::PushSerializedToChannel(bool force) {
-  if (!force && serializer_->SerializedLen() < kMinChannelBlobSize)
+  // Above the limit small blobs are pushed too, so that the sink drains them.
+  if (!force && serializer_->SerializedLen() < kMinChannelBlobSize &&
+      delayed_bytes_ < kMaxDelayedBytes && !IsOverBufferLimit())
     return false;
 
   // Flush any of the leftovers to avoid interleavings
@@ -363,19 +524,45 @@ bool SliceSnapshot::PushSerializedToChannel(bool force) {
   if (!delayed_entries_.empty()) {
     // Async bucket serialization might have accumulated some delayed values.
     // Because we can finally block in this function, we'll await and serialize them
-    do {
-      auto& entry = delayed_entries_.back();
-      serializer_->SaveEntry(entry.key, entry.value.Get(), entry.expire, entry.dbid,
-                             entry.mc_flags);
-      delayed_entries_.pop_back();
-    } while (!delayed_entries_.empty());
+    for (auto& entry : delayed_entries_) {
+      TrackRecordEntry(entry.dbid, entry.key);
+      io::Result<uint8_t> res =
+          serializer_->SaveExternalEntry(entry.key, entry.obj_type, entry.value.Get(), entry.expire,
+                                         entry.has_mc_flags, entry.mc_flags, entry.dbid);
+      if (res && entry.obj_type != OBJ_STRING)
+        ++type_freq_map_[*res];
+    }
+    delayed_entries_.clear();
+    delayed_bytes_ = 0;
 
     // blocking point.
     serialized += FlushChannelRecord(FlushState::kFlushMidEntry);
   }
+
+  ThrottleIfNeeded();
   return serialized > 0;
 }
 
+void SliceSnapshot::ThrottleIfNeeded() {
+  if (!IsOverBufferLimit())
+    return;
+
+  // The consumer might run on another thread, so the channel is polled.
+  auto start = chrono::steady_clock::now();
+  while (dest_->GetItemsSize() > 0 && !dest_->IsClosing() && IsOverBufferLimit())
+    ThisFiber::SleepFor(100us);
+
+  ++stats_.throttle_count;
+  stats_.throttle_usec +=
+      chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+bool SliceSnapshot::IsOverBufferLimit() {
+  size_t memory = GetBuffersMemory();
+  peak_buffers_memory_ = max(peak_buffers_memory_, memory);
+  return buffer_limit_ && memory >= buffer_limit_;
+}
+
 void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
   PrimeTable* table = db_slice_->GetTables(db_index).first;
   const PrimeTable::bucket_iterator* bit = req.update();
@@ -391,6 +578,11 @@ void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req)
       stats_.side_saved += SerializeBucket(db_index, it);
     });
   }
+
+  // Writes can't wait here, but if the snapshot may push from the change callback, the serialized
+  // buckets are moved to the channel towards the sink instead of piling up in the serializer.
+  if (IsOverBufferLimit() && allow_flush_)
+    FlushChannelRecord(FlushState::kFlushMidEntry);
 }
 
 // For any key any journal entry must arrive at the replica strictly after its first original rdb
@@ -403,7 +595,8 @@ void SliceSnapshot::OnJournalEntry(const journal::JournalItem& item, bool await)
   // additional journal change to serialize, it simply invokes PushSerializedToChannel.
   std::unique_lock lk(db_slice_->GetSerializationMutex());
   if (item.opcode != journal::Op::NOOP) {
-    serializer_->WriteJournalEntry(item.data);
+    serializer_->WriteJournalEntry(item.data());
+    TrackRecordJournal();
   }
 
   if (await) {
@@ -445,6 +638,10 @@ size_t SliceSnapshot::GetTempBuffersSize() const {
   return serializer_->GetTempBufferSize();
 }
 
+size_t SliceSnapshot::GetBuffersMemory() const {
+  return GetBufferCapacity() + GetTempBuffersSize() + dest_->GetItemsSize() + delayed_bytes_;
+}
+
 RdbSaver::SnapshotStats SliceSnapshot::GetCurrentSnapshotProgress() const {
   return {stats_.loop_serialized + stats_.side_saved, stats_.keys_total};
 }
@@ -54,6 +54,11 @@ class SliceSnapshot {
     uint64_t id;
     std::string value;
 
+    // Used to build the SnapshotIndex of the file.
+    bool entry_start = true;   // false if the record continues an entry of the previous one
+    uint64_t db_mask = 0;      // dbs of the entries, see SnapshotIndex::DbBit
+    uint64_t slot_groups = 0;  // cluster slots of the entries, see SnapshotIndex::SlotGroupBit
+
     size_t size() const;
   };
 
@@ -72,12 +77,19 @@ class SliceSnapshot {
   void Start(bool stream_journal, const Cancellation* cll,
              SnapshotFlush allow_flush = SnapshotFlush::kDisallow);
 
+  // Must be called before Start.
+  void SetPriority(SavePriority priority) {
+    priority_ = priority;
+  }
+
   // Initialize a snapshot that sends only the missing journal updates
   // since start_lsn and then registers a callback switches into the
   // journal streaming mode until stopped.
   // If we're slower than the buffer and can't continue, `Cancel()` is
   // called.
-  void StartIncremental(Context* cntx, LSN start_lsn);
+  // If end_lsn is set, only the updates before it are sent and the channel is closed afterwards,
+  // which is used for saving delta snapshots.
+  void StartIncremental(Context* cntx, LSN start_lsn, std::optional<LSN> end_lsn = std::nullopt);
 
   // Finalizes journal streaming writes. Only called for replication.
   // Blocking. Must be called from the Snapshot thread.
@@ -94,8 +106,12 @@ class SliceSnapshot {
   // and submits them to SerializeBucket.
   void IterateBucketsFb(const Cancellation* cll, bool send_full_sync_cut);
 
+  // Called by IterateBucketsFb after each traversed bucket of a low priority snapshot, yields
+  // once the bucket budget of the time slice is used.
+  void PaceIteration();
+
   // A fiber function that switches to the incremental mode
-  void SwitchIncrementalFb(Context* cntx, LSN lsn);
+  void SwitchIncrementalFb(Context* cntx, LSN lsn, std::optional<LSN> end_lsn);
 
   // Called on traversing cursor by IterateBucketsFb.
   bool BucketSaveCb(PrimeIterator it);
@@ -108,6 +124,10 @@ class SliceSnapshot {
   void SerializeEntry(DbIndex db_index, const PrimeKey& pk, const PrimeValue& pv,
                       std::optional<uint64_t> expire, RdbSerializer* serializer);
 
+  // Add an entry or journal changes to the index fields of the next record.
+  void TrackRecordEntry(DbIndex db_index, const PrimeKey& pk);
+  void TrackRecordJournal();
+
   // DbChange listener
   void OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req);
 
@@ -122,6 +142,13 @@ class SliceSnapshot {
   // Return true if pushed. Can block. Is called from the snapshot thread.
   bool PushSerializedToChannel(bool force);
 
+  // Waits for the consumer to drain the channel while the buffers are above the limit. Blocks the
+  // iteration fiber and writers that allow awaiting, so the buffers are not growing unbounded.
+  void ThrottleIfNeeded();
+
+  // Also records the peak memory of the buffers.
+  bool IsOverBufferLimit();
+
   // Helper function that flushes the serialized items into the RecordStream.
   // Can block on the channel.
   using FlushState = SerializerBase::FlushState;
@@ -141,14 +168,25 @@ class SliceSnapshot {
   size_t GetTotalChannelCapacity() const;
   size_t GetTempBuffersSize() const;
 
+  // Memory held by the snapshot buffers, which is bounded by --snapshot_buffer_limit.
+  size_t GetBuffersMemory() const;
+
+  // Highest GetBuffersMemory() value seen during the snapshot.
+  size_t GetPeakBuffersMemory() const {
+    return peak_buffers_memory_;
+  }
+
   RdbSaver::SnapshotStats GetCurrentSnapshotProgress() const;
 
  private:
-  // An entry whose value must be awaited
+  // An offloaded entry whose value must be awaited. The value is kept in its serialized form,
+  // see TieredStorage::ReadSerialized.
   struct DelayedEntry {
     DbIndex dbid;
     CompactObj key;
-    util::fb2::Future<PrimeValue> value;
+    CompactObjType obj_type;
+    bool has_mc_flags;
+    util::fb2::Future<std::string> value;
     time_t expire;
     uint32_t mc_flags;
   };
@@ -163,6 +201,7 @@ class SliceSnapshot {
 
   std::unique_ptr<RdbSerializer> serializer_;
   std::vector<DelayedEntry> delayed_entries_;  // collected during atomic bucket traversal
+  size_t delayed_bytes_ = 0;                   // disk bytes requested by delayed_entries_
 
   // Used for sanity checks.
   bool serialize_bucket_running_ = false;
@@ -170,6 +209,25 @@ class SliceSnapshot {
   util::fb2::CondVarAny seq_cond_;
   CompressionMode compression_mode_;
   RdbTypeFreqMap type_freq_map_;
+  bool reference_tiered_ = false;  // save offloaded values as references to their segments
+  bool allow_flush_ = false;       // entries may be pushed from the change callback
+
+  // The index fields of the next record, see DbRecord.
+  bool record_continues_entry_ = false;
+  uint64_t record_db_mask_ = 0, record_slot_groups_ = 0;
+
+  SavePriority priority_ = SavePriority::kNormal;
+  uint64_t latency_target_usec_ = 0;
+
+  // Time slice state of low priority snapshots, see PaceIteration.
+  struct Pacer {
+    uint64_t slice_start_ns = 0;
+    uint32_t budget = 64;    // buckets to traverse in the time slice
+    uint32_t traversed = 0;  // buckets traversed in the time slice
+  } pacer_;
+
+  size_t buffer_limit_ = 0;  // 0 if unbounded
+  size_t peak_buffers_memory_ = 0;
 
   // version upper bound for entries that should be saved (not included).
   uint64_t snapshot_version_ = 0;
@@ -183,6 +241,10 @@ class SliceSnapshot {
     size_t side_saved = 0;
     size_t savecb_calls = 0;
     size_t keys_total = 0;
+    size_t throttle_count = 0;
+    uint64_t throttle_usec = 0;
+    size_t pace_slices = 0;
+    size_t pace_busy_slices = 0;
   } stats_;
 };
 
@@ -0,0 +1,190 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/snapshot_index.h"
+
+#include <absl/base/internal/endian.h>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr string_view kIndexMagic = "DFSIDX01";  // ends with a non zero byte, see Read
+constexpr size_t kTrailerSize = 8 + kIndexMagic.size();
+constexpr size_t kExtentSize = 4 * 8;
+
+// Records of the same dbs are merged into extents of up to this size.
+constexpr uint64_t kMaxExtentSize = 1ULL << 20;
+
+// Files written with direct I/O are padded with zeros to the page size.
+constexpr size_t kMaxPadding = 4096;
+
+error_code ReadFull(io::ReadonlyFile* file, size_t offset, io::MutableBytes dest) {
+  while (!dest.empty()) {
+    io::Result<size_t> res = file->Read(offset, dest);
+    if (!res)
+      return res.error();
+    if (*res == 0)
+      return make_error_code(errc::io_error);
+    offset += *res;
+    dest.remove_prefix(*res);
+  }
+  return {};
+}
+
+}  // namespace
+
+void SnapshotIndex::AddRecord(uint64_t offset, uint64_t length, bool entry_start,
+                              uint64_t db_mask, uint64_t slot_groups) {
+  if (!entry_start && !extents.empty()) {
+    Extent& back = extents.back();
+    DCHECK_EQ(back.offset + back.length, offset);
+    back.length += length;
+    back.db_mask |= db_mask;
+    back.slot_groups |= slot_groups;
+    return;
+  }
+
+  db_mask = db_mask ? db_mask : kAll;
+  slot_groups = slot_groups ? slot_groups : kAll;
+
+  if (!extents.empty()) {
+    Extent& back = extents.back();
+    if (back.offset + back.length == offset && back.length < kMaxExtentSize &&
+        back.db_mask == db_mask) {
+      back.length += length;
+      back.slot_groups |= slot_groups;
+      return;
+    }
+  }
+
+  extents.push_back({offset, length, db_mask, slot_groups});
+}
+
+string SnapshotIndex::Serialize() const {
+  string res(3 * 8 + extents.size() * kExtentSize + kTrailerSize, '\0');
+  char* next = res.data();
+  auto store = [&next](uint64_t val) {
+    absl::little_endian::Store64(next, val);
+    next += 8;
+  };
+
+  store(body_offset);
+  store(epilog_offset);
+  store(extents.size());
+  for (const Extent& extent : extents) {
+    store(extent.offset);
+    store(extent.length);
+    store(extent.db_mask);
+    store(extent.slot_groups);
+  }
+  store(res.size() - kTrailerSize);
+  memcpy(next, kIndexMagic.data(), kIndexMagic.size());
+  return res;
+}
+
+optional<SnapshotIndex> SnapshotIndex::Read(io::ReadonlyFile* file) {
+  size_t size = file->Size();
+  size_t tail_len = min(size, kMaxPadding + kTrailerSize);
+  string tail(tail_len, '\0');
+  if (ReadFull(file, size - tail_len, io::MutableBytes{reinterpret_cast<uint8_t*>(tail.data()),
+                                                       tail.size()})) {
+    return nullopt;
+  }
+
+  // Strip the padding of direct I/O.
+  size_t end = tail.find_last_not_of('\0');
+  if (end == string::npos || end + 1 < kTrailerSize)
+    return nullopt;
+  end += 1;
+  if (string_view{tail}.substr(end - kIndexMagic.size(), kIndexMagic.size()) != kIndexMagic)
+    return nullopt;
+
+  uint64_t index_len = absl::little_endian::Load64(tail.data() + end - kTrailerSize);
+  uint64_t index_end = size - tail_len + end - kTrailerSize;
+  if (index_len < 3 * 8 || index_len > index_end || (index_len - 3 * 8) % kExtentSize != 0)
+    return nullopt;
+
+  string buf(index_len, '\0');
+  if (ReadFull(file, index_end - index_len,
+               io::MutableBytes{reinterpret_cast<uint8_t*>(buf.data()), buf.size()})) {
+    return nullopt;
+  }
+
+  const char* next = buf.data();
+  auto load = [&next] {
+    uint64_t val = absl::little_endian::Load64(next);
+    next += 8;
+    return val;
+  };
+
+  SnapshotIndex index;
+  index.body_offset = load();
+  index.epilog_offset = load();
+  uint64_t count = load();
+  if (count != (index_len - 3 * 8) / kExtentSize)
+    return nullopt;
+
+  index.extents.resize(count);
+  for (Extent& extent : index.extents) {
+    extent.offset = load();
+    extent.length = load();
+    extent.db_mask = load();
+    extent.slot_groups = load();
+  }
+  return index;
+}
+
+SnapshotIndexSource::SnapshotIndexSource(io::ReadonlyFile* file, const SnapshotIndex& index,
+                                         const SnapshotFilter& filter)
+    : file_{file} {
+  auto add_range = [this](uint64_t offset, uint64_t length) {
+    if (length == 0)
+      return;
+    size_ += length;
+    if (!ranges_.empty() && ranges_.back().first + ranges_.back().second == offset)
+      ranges_.back().second += length;
+    else
+      ranges_.emplace_back(offset, length);
+  };
+
+  add_range(0, index.body_offset);
+  for (const auto& extent : index.extents) {
+    if ((extent.db_mask & filter.db_mask) && (extent.slot_groups & filter.slot_groups))
+      add_range(extent.offset, extent.length);
+  }
+  // The EOF opcode and the checksum.
+  add_range(index.epilog_offset, 9);
+}
+
+io::Result<size_t> SnapshotIndexSource::ReadSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < len && range_ < ranges_.size(); ++i) {
+    io::MutableBytes dest{reinterpret_cast<uint8_t*>(v[i].iov_base), v[i].iov_len};
+    while (!dest.empty() && range_ < ranges_.size()) {
+      auto [offset, length] = ranges_[range_];
+      size_t to_read = min<size_t>(dest.size(), length - range_pos_);
+      io::Result<size_t> res = file_->Read(offset + range_pos_, dest.subspan(0, to_read));
+      if (!res)
+        return res;
+      if (*res == 0)
+        return total;
+
+      dest.remove_prefix(*res);
+      total += *res;
+      range_pos_ += *res;
+      if (range_pos_ == length) {
+        ++range_;
+        range_pos_ = 0;
+      }
+    }
+  }
+  return total;
+}
+
+}  // namespace dfly
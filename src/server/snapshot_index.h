@@ -0,0 +1,87 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "io/file.h"
+#include "io/io.h"
+#include "server/cluster/cluster_defs.h"
+#include "server/common.h"
+
+namespace dfly {
+
+// Index of the records of a snapshot file. It is appended after the EOF opcode and the checksum
+// of the file, where loaders stop reading, so files with an index are still loaded as a whole by
+// loaders that do not know about it. A loader that only needs some databases or cluster slots
+// reads the header, the extents that may contain them and the epilog.
+struct SnapshotIndex {
+  // A run of records that starts at an entry boundary.
+  struct Extent {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    uint64_t db_mask = 0;      // bit per db index, db indices above 63 share the last bit
+    uint64_t slot_groups = 0;  // bit per group of kSlotsPerGroup cluster slots
+  };
+
+  static constexpr unsigned kSlotsPerGroup = (cluster::kMaxSlotNum + 1) / 64;
+  static constexpr uint64_t kAll = ~0ULL;
+
+  static uint64_t DbBit(DbIndex db) {
+    return 1ULL << std::min<DbIndex>(db, 63);
+  }
+
+  static uint64_t SlotGroupBit(cluster::SlotId slot) {
+    return 1ULL << (slot / kSlotsPerGroup);
+  }
+
+  // Adds a record written at offset. A record that continues an entry is added to the extent
+  // of the record before it. Records without known dbs or slots use kAll masks.
+  void AddRecord(uint64_t offset, uint64_t length, bool entry_start, uint64_t db_mask,
+                 uint64_t slot_groups);
+
+  std::string Serialize() const;
+
+  // Reads the index at the end of the file, returns nullopt if the file has none.
+  static std::optional<SnapshotIndex> Read(io::ReadonlyFile* file);
+
+  uint64_t body_offset = 0;    // end of the header and the aux fields
+  uint64_t epilog_offset = 0;  // offset of the EOF opcode
+  std::vector<Extent> extents;
+};
+
+// Which part of a snapshot to load.
+struct SnapshotFilter {
+  uint64_t db_mask = SnapshotIndex::kAll;
+  uint64_t slot_groups = SnapshotIndex::kAll;
+
+  bool IsAll() const {
+    return db_mask == SnapshotIndex::kAll && slot_groups == SnapshotIndex::kAll;
+  }
+};
+
+// Reads the header, the extents of the index that match the filter and the epilog of a
+// snapshot file as a single stream. Takes ownership over the file.
+class SnapshotIndexSource : public io::Source {
+ public:
+  SnapshotIndexSource(io::ReadonlyFile* file, const SnapshotIndex& index,
+                      const SnapshotFilter& filter);
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+  // Total bytes of the selected ranges.
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  std::unique_ptr<io::ReadonlyFile> file_;
+  std::vector<std::pair<uint64_t, uint64_t>> ranges_;  // offset, length
+  size_t range_ = 0, range_pos_ = 0, size_ = 0;
+};
+
+}  // namespace dfly
@@ -11,6 +11,7 @@ extern "C" {
 #include "redis/zmalloc.h"
 }
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -22,6 +23,11 @@ extern "C" {
 #include "server/family_utils.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, stream_add_trim_max_nodes, 8,
+          "Maximum number of listpack nodes that XADD with approximate MAXLEN or MINID and "
+          "without LIMIT removes from the head of the stream. 0 for no limit other than "
+          "the default entries limit.");
+
 namespace dfly {
 
 using namespace facade;
@@ -73,6 +79,13 @@ struct AddTrimOpts {
   bool no_mkstream = false;
 };
 
+enum class AddTrimOpt : uint8_t { NOMKSTREAM, MAXLEN, MINID, LIMIT };
+
+constexpr auto kAddTrimOpts = MakeTagTable<AddTrimOpt>({{"NOMKSTREAM", AddTrimOpt::NOMKSTREAM},
+                                                        {"MAXLEN", AddTrimOpt::MAXLEN},
+                                                        {"MINID", AddTrimOpt::MINID},
+                                                        {"LIMIT", AddTrimOpt::LIMIT}});
+
 struct NACKInfo {
   streamID pel_id;
   string consumer_name;
@@ -371,25 +384,14 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
   }
 
   /* Add the new entry. */
-  raxIterator ri;
-  raxStart(&ri, s->rax_tree);
-  raxSeek(&ri, "$", NULL, 0);
-
-  size_t lp_bytes = 0;      /* Total bytes in the tail listpack. */
-  unsigned char* lp = NULL; /* Tail listpack pointer. */
+  streamID master_id; /* ID of the master entry in the listpack. */
+  size_t lp_bytes = 0; /* Total bytes in the tail listpack. */
 
-  if (!raxEOF(&ri)) {
-    /* Get a reference to the tail node listpack. */
-    lp = (uint8_t*)ri.data;
+  /* Get a reference to the tail node listpack. */
+  unsigned char* tail_lp = streamNodesLast(s->nodes, &master_id);
+  unsigned char* lp = tail_lp; /* Tail listpack pointer. */
+  if (lp)
     lp_bytes = lpBytes(lp);
-  }
-  raxStop(&ri);
-
-  /* We have to add the key into the radix tree in lexicographic order,
-   * to do so we consider the ID as a single 128 bit number written in
-   * big endian, so that the most significant bytes are the first ones. */
-  uint8_t rax_key[16]; /* Key in the radix tree containing the listpack.*/
-  streamID master_id;  /* ID of the master entry in the listpack. */
 
   /* Create a new listpack and radix tree node if needed. Note that when
    * a new listpack is created, we populate it with a "master entry". This
@@ -414,7 +416,7 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
    *
    * The real entries will be encoded with an ID that is just the
    * millisecond and sequence difference compared to the key stored at
-   * the radix tree node containing the listpack (delta encoding), and
+   * the index node containing the listpack (delta encoding), and
    * if the fields of the entry are the same as the master entry fields, the
    * entry flags will specify this fact and the entry fields and number
    * of fields will be omitted (see later in the code of this function).
@@ -439,8 +441,8 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
       if (count >= kStreamNodeMaxEntries) {
         /* Shrink extra pre-allocated memory */
         lp = lpShrinkToFit(lp);
-        if (ri.data != lp)
-          raxInsert(s->rax_tree, ri.key, ri.key_len, lp, NULL);
+        if (tail_lp != lp)
+          streamNodesInsert(s->nodes, &master_id, lp);
         lp = NULL;
       }
     }
@@ -450,7 +452,6 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
   unsigned numfields = fields.size() / 2;
   if (lp == NULL) {
     master_id = id;
-    StreamEncodeID(rax_key, &id);
     /* Create the listpack having the master entry ID and fields.
      * Pre-allocate some bytes when creating listpack to avoid realloc on
      * every XADD. Since listpack.c uses malloc_size, it'll grow in steps,
@@ -469,16 +470,12 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
       lp = lpAppend(lp, SafePtr(field), field.size());
     }
     lp = lpAppendInteger(lp, 0); /* Master entry zero terminator. */
-    raxInsert(s->rax_tree, (unsigned char*)&rax_key, sizeof(rax_key), lp, NULL);
+    streamNodesInsert(s->nodes, &master_id, lp);
+    tail_lp = lp;
     /* The first entry we insert, has obviously the same fields of the
      * master entry. */
     flags |= STREAM_ITEM_FLAG_SAMEFIELDS;
   } else {
-    serverAssert(ri.key_len == sizeof(rax_key));
-    memcpy(rax_key, ri.key, sizeof(rax_key));
-
-    /* Read the master ID from the radix tree key. */
-    streamDecodeID(rax_key, &master_id);
     unsigned char* lp_ele = lpFirst(lp);
 
     /* Update count and skip the deleted fields. */
@@ -553,9 +550,9 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
   }
   lp = lpAppendInteger(lp, lp_count);
 
-  /* Insert back into the tree in order to update the listpack pointer. */
-  if (ri.data != lp)
-    raxInsert(s->rax_tree, (unsigned char*)&rax_key, sizeof(rax_key), lp, NULL);
+  /* Insert back into the index in order to update the listpack pointer. */
+  if (tail_lp != lp)
+    streamNodesInsert(s->nodes, &master_id, lp);
   s->length++;
   s->entries_added++;
   s->last_id = id;
@@ -577,8 +574,9 @@ streamNACK* StreamCreateNACK(streamConsumer* consumer) {
   return nack;
 }
 
-int StreamTrim(const AddTrimOpts& opts, stream* s) {
-  if (!opts.limit) {
+// limit_nodes bounds approximate trimming without LIMIT by whole nodes instead of entries.
+int StreamTrim(const AddTrimOpts& opts, stream* s, uint32_t limit_nodes = 0) {
+  if (!opts.limit && !(opts.trim_approx && limit_nodes)) {
     if (opts.trim_strategy == TrimStrategy::kMaxLen) {
       /* Notify xtrim event if needed. */
       return streamTrimByLength(s, opts.max_len, opts.trim_approx);
@@ -591,6 +589,7 @@ int StreamTrim(const AddTrimOpts& opts, stream* s) {
     trim_args.trim_strategy = static_cast<int>(opts.trim_strategy);
     trim_args.approx_trim = opts.trim_approx;
     trim_args.limit = opts.limit;
+    trim_args.limit_nodes = opts.limit ? 0 : limit_nodes;
 
     if (opts.trim_strategy == TrimStrategy::kMaxLen) {
       trim_args.maxlen = opts.max_len;
@@ -646,7 +645,9 @@ OpResult<streamID> OpAdd(const OpArgs& op_args, const AddTrimOpts& opts, CmdArgL
     return OpStatus::OUT_OF_MEMORY;
   }
 
-  StreamTrim(opts, stream_inst);
+  // Every addition drops a bounded number of head nodes, so capped streams pay O(1) per entry and
+  // a trim backlog, e.g. after lowering MAXLEN, is worked off by the following additions.
+  StreamTrim(opts, stream_inst, absl::GetFlag(FLAGS_stream_add_trim_max_nodes));
 
   auto blocking_controller = op_args.db_cntx.ns->GetBlockingController(op_args.shard->shard_id());
   if (blocking_controller) {
@@ -997,8 +998,8 @@ OpResult<StreamInfo> OpStreams(const DbContext& db_cntx, string_view key, Engine
   StreamInfo sinfo;
   sinfo.length = s->length;
 
-  sinfo.radix_tree_keys = raxSize(s->rax_tree);
-  sinfo.radix_tree_nodes = s->rax_tree->numnodes;
+  sinfo.radix_tree_keys = streamNodesSize(s->nodes);
+  sinfo.radix_tree_nodes = streamNodesTreeNodes(s->nodes);
   sinfo.last_generated_id = s->last_id;
   sinfo.max_deleted_entry_id = s->max_deleted_entry_id;
   sinfo.entries_added = s->entries_added;
@@ -1888,25 +1889,25 @@ optional<pair<AddTrimOpts, unsigned>> ParseAddOrTrimArgsOrReply(CmdArgList args,
 
   unsigned id_indx = 1;
   for (; id_indx < args.size(); ++id_indx) {
-    string arg = absl::AsciiStrToUpper(ArgS(args, id_indx));
+    optional<AddTrimOpt> opt = kAddTrimOpts.Find(ArgS(args, id_indx));
     size_t remaining_args = args.size() - id_indx - 1;
 
-    if (is_xadd && arg == "NOMKSTREAM") {
+    if (is_xadd && opt == AddTrimOpt::NOMKSTREAM) {
       opts.no_mkstream = true;
-    } else if ((arg == "MAXLEN" || arg == "MINID") && remaining_args >= 1) {
+    } else if ((opt == AddTrimOpt::MAXLEN || opt == AddTrimOpt::MINID) && remaining_args >= 1) {
       if (opts.trim_strategy != TrimStrategy::kNone) {
         cntx->SendError("MAXLEN and MINID options at the same time are not compatible", kSyntaxErr);
         return std::nullopt;
       }
 
-      if (arg == "MAXLEN") {
+      if (opt == AddTrimOpt::MAXLEN) {
         opts.trim_strategy = TrimStrategy::kMaxLen;
       } else {
         opts.trim_strategy = TrimStrategy::kMinId;
       }
 
       id_indx++;
-      arg = ArgS(args, id_indx);
+      string_view arg = ArgS(args, id_indx);
       if (remaining_args >= 2 && arg == "~") {
         opts.trim_approx = true;
         id_indx++;
@@ -1925,7 +1926,8 @@ optional<pair<AddTrimOpts, unsigned>> ParseAddOrTrimArgsOrReply(CmdArgList args,
         cntx->SendError(kSyntaxErr);
         return std::nullopt;
       }
-    } else if (arg == "LIMIT" && remaining_args >= 1 && opts.trim_strategy != TrimStrategy::kNone) {
+    } else if (opt == AddTrimOpt::LIMIT && remaining_args >= 1 &&
+               opts.trim_strategy != TrimStrategy::kNone) {
       if (!opts.trim_approx) {
         cntx->SendError(kSyntaxErr);
         return std::nullopt;
@@ -2741,11 +2743,6 @@ void XReadBlock(ReadOpts* opts, ConnectionContext* cntx) {
     return streamCompareID(&last_id, &sitem.group->last_id) > 0;
   };
 
-  if (auto status = cntx->transaction->WaitOnWatch(tp, std::move(wcb), key_checker, &cntx->blocked,
-                                                   &cntx->paused);
-      status != OpStatus::OK)
-    return rb->SendNullArray();
-
   // Resolve the entry in the woken key. Note this must not use OpRead since
   // only the shard that contains the woken key blocks for the awoken
   // transaction to proceed.
@@ -2798,7 +2795,14 @@ void XReadBlock(ReadOpts* opts, ConnectionContext* cntx) {
     }
     return OpStatus::OK;
   };
-  cntx->transaction->Execute(std::move(range_cb), true);
+
+  // Readers of a stream are served by the shard of the key as soon as it has new entries, so an
+  // XADD wakes all the ready readers at once instead of one per hop.
+  Transaction::RunnableType deliver_cb{range_cb};
+  if (auto status = cntx->transaction->WaitOnWatch(tp, std::move(wcb), key_checker, &cntx->blocked,
+                                                   &cntx->paused, &deliver_cb);
+      status != OpStatus::OK)
+    return rb->SendNullArray();
 
   if (result) {
     SinkReplyBuilder::ReplyAggregator agg(rb);
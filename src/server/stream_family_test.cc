@@ -90,6 +90,25 @@ TEST_F(StreamFamilyTest, AddExtended) {
   EXPECT_THAT(Run({"xlen", "key4"}), IntArg(601));
 }
 
+TEST_F(StreamFamilyTest, AddApproxTrimNodes) {
+  // 2000 entries span 20 nodes, an addition removes at most 8 of them.
+  for (unsigned i = 1; i <= 2000; ++i) {
+    Run({"xadd", "key", absl::StrCat(i, "-0"), "f", "v"});
+  }
+
+  Run({"xadd", "key", "maxlen", "~", "100", "2001-0", "f", "v"});
+  EXPECT_THAT(Run({"xlen", "key"}), IntArg(1201));
+  Run({"xadd", "key", "maxlen", "~", "100", "2002-0", "f", "v"});
+  EXPECT_THAT(Run({"xlen", "key"}), IntArg(402));
+  Run({"xadd", "key", "maxlen", "~", "100", "2003-0", "f", "v"});
+  EXPECT_THAT(Run({"xlen", "key"}), IntArg(103));
+
+  Run({"xadd", "key", "minid", "~", "2002", "2004-0", "f", "v"});
+  EXPECT_THAT(Run({"xlen", "key"}), IntArg(4));
+  auto resp = Run({"xrange", "key", "-", "+", "COUNT", "1"});
+  EXPECT_THAT(resp, ElementsAre("2001-0", ArrLen(2)));
+}
+
 TEST_F(StreamFamilyTest, Range) {
   Run({"xadd", "key", "1-*", "f1", "v1"});
   Run({"xadd", "key", "1-*", "f2", "v2"});
@@ -110,6 +129,36 @@ TEST_F(StreamFamilyTest, Range) {
   EXPECT_THAT(sub1, ElementsAre("1-0", ArrLen(2)));
 }
 
+TEST_F(StreamFamilyTest, RangeManyNodes) {
+  // 1000 entries span 10 listpack nodes of 100 entries each.
+  for (unsigned i = 1; i <= 1000; ++i) {
+    Run({"xadd", "key", absl::StrCat(i, "-0"), "f", "v"});
+  }
+
+  auto resp = Run({"xrange", "key", "250", "260"});
+  ASSERT_THAT(resp, ArrLen(11));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("250-0", ArrLen(2)));
+  EXPECT_THAT(resp.GetVec()[10].GetVec(), ElementsAre("260-0", ArrLen(2)));
+
+  resp = Run({"xrevrange", "key", "+", "-", "COUNT", "150"});
+  ASSERT_THAT(resp, ArrLen(150));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("1000-0", ArrLen(2)));
+  EXPECT_THAT(resp.GetVec()[149].GetVec(), ElementsAre("851-0", ArrLen(2)));
+
+  // Deleting all entries of a node removes the node.
+  for (unsigned i = 101; i <= 200; ++i) {
+    Run({"xdel", "key", absl::StrCat(i, "-0")});
+  }
+  resp = Run({"xrange", "key", "99", "202"});
+  ASSERT_THAT(resp, ArrLen(4));
+  EXPECT_THAT(resp.GetVec()[2].GetVec(), ElementsAre("201-0", ArrLen(2)));
+
+  EXPECT_THAT(Run({"xtrim", "key", "minid", "~", "500"}), IntArg(300));
+  EXPECT_THAT(Run({"xlen", "key"}), IntArg(600));
+  resp = Run({"xrange", "key", "-", "+", "COUNT", "1"});
+  EXPECT_THAT(resp, ElementsAre("401-0", ArrLen(2)));
+}
+
 TEST_F(StreamFamilyTest, GroupCreate) {
   auto resp = Run({"xadd", "key", "1-*", "f1", "v1"});
   EXPECT_EQ(resp, "1-0");
@@ -382,6 +431,45 @@ TEST_F(StreamFamilyTest, XReadGroupBlock) {
   EXPECT_THAT(resp0, ErrArg("consumer group this client was blocked on no longer exists"));
 }
 
+TEST_F(StreamFamilyTest, XReadGroupBlockFanOut) {
+  // Consumers of a single stream are served by the XADD itself, one per group.
+  constexpr unsigned kGroups = 3, kConsumers = 2;
+  for (unsigned g = 0; g < kGroups; ++g)
+    Run({"xgroup", "create", "events", absl::StrCat("g", g), "$", "MKSTREAM"});
+
+  vector<RespExpr> resps(kGroups * kConsumers);
+  vector<fb2::Fiber> fibers;
+  for (unsigned i = 0; i < resps.size(); ++i) {
+    fibers.push_back(pp_->at(i % 2)->LaunchFiber(Launch::dispatch, [&, i] {
+      string group = absl::StrCat("g", i % kGroups), consumer = absl::StrCat("c", i);
+      resps[i] = Run(consumer, {"xreadgroup", "group", group, consumer, "count", "1", "block", "0",
+                                "streams", "events", ">"});
+    }));
+  }
+
+  auto num_blocked = [this] { return GetMetrics().facade_stats.conn_stats.num_blocked_clients; };
+  ASSERT_TRUE(WaitUntilCondition([&] { return num_blocked() == resps.size(); }, 1000ms));
+
+  Run({"xadd", "events", "1-1", "k", "v1"});
+  ASSERT_TRUE(WaitUntilCondition([&] { return num_blocked() == kGroups; }, 1000ms));
+  Run({"xadd", "events", "2-1", "k", "v2"});
+
+  for (auto& fb : fibers)
+    fb.Join();
+
+  // Every group got each entry once.
+  for (unsigned g = 0; g < kGroups; ++g) {
+    vector<string> ids;
+    for (unsigned i = g; i < resps.size(); i += kGroups) {
+      ASSERT_THAT(resps[i].GetVec(), ElementsAre("events", ArrLen(1)));
+      ids.push_back(resps[i].GetVec()[1].GetVec()[0].GetVec()[0].GetString());
+    }
+    EXPECT_THAT(ids, UnorderedElementsAre("1-1", "2-1"));
+    EXPECT_THAT(Run({"xpending", "events", absl::StrCat("g", g)}),
+                RespArray(ElementsAre(IntArg(2), "1-1", "2-1", _)));
+  }
+}
+
 TEST_F(StreamFamilyTest, XReadInvalidArgs) {
   // Invalid COUNT value.
   auto resp = Run({"xread", "count", "invalid", "streams", "s1", "s2", "0", "0"});
@@ -972,7 +1060,7 @@ TEST_F(StreamFamilyTest, XInfoStream) {
   EXPECT_THAT(resp, ArrLen(20));
   EXPECT_THAT(
       resp.GetVec(),
-      ElementsAre("length", IntArg(0), "radix-tree-keys", IntArg(0), "radix-tree-nodes", IntArg(1),
+      ElementsAre("length", IntArg(0), "radix-tree-keys", IntArg(0), "radix-tree-nodes", IntArg(0),
                   "last-generated-id", "0-0", "max-deleted-entry-id", "0-0", "entries-added",
                   IntArg(0), "recorded-first-entry-id", "0-0", "groups", IntArg(1), "first-entry",
                   ArgType(RespExpr::NIL_ARRAY), "last-entry", ArgType(RespExpr::NIL_ARRAY)));
@@ -991,7 +1079,7 @@ TEST_F(StreamFamilyTest, XInfoStream) {
   resp = Run({"xinfo", "stream", "mystream"});
   EXPECT_THAT(resp.GetVec(),
               ElementsAre("length", IntArg(11), "radix-tree-keys", IntArg(1), "radix-tree-nodes",
-                          IntArg(2), "last-generated-id", "11-1", "max-deleted-entry-id", "0-0",
+                          IntArg(1), "last-generated-id", "11-1", "max-deleted-entry-id", "0-0",
                           "entries-added", IntArg(11), "recorded-first-entry-id", "1-1", "groups",
                           IntArg(1), "first-entry", ArrLen(2), "last-entry", ArrLen(2)));
   EXPECT_THAT(resp.GetVec()[17].GetVec()[0], "1-1");
@@ -1007,7 +1095,7 @@ TEST_F(StreamFamilyTest, XInfoStream) {
   EXPECT_THAT(resp.GetVec()[17].GetVec()[0], ArrLen(14));
   EXPECT_THAT(resp.GetVec(),
               ElementsAre("length", IntArg(11), "radix-tree-keys", IntArg(1), "radix-tree-nodes",
-                          IntArg(2), "last-generated-id", "11-1", "max-deleted-entry-id", "0-0",
+                          IntArg(1), "last-generated-id", "11-1", "max-deleted-entry-id", "0-0",
                           "entries-added", IntArg(11), "recorded-first-entry-id", "1-1", "entries",
                           ArrLen(10), "groups", ArrLen(1)));
   EXPECT_THAT(resp.GetVec()[17].GetVec()[0].GetVec(),
@@ -1050,7 +1138,7 @@ TEST_F(StreamFamilyTest, XInfoStream) {
   resp = Run({"xinfo", "stream", "mystream"});
   EXPECT_THAT(resp.GetVec(),
               ElementsAre("length", IntArg(10), "radix-tree-keys", IntArg(1), "radix-tree-nodes",
-                          IntArg(2), "last-generated-id", "11-1", "max-deleted-entry-id", "1-1",
+                          IntArg(1), "last-generated-id", "11-1", "max-deleted-entry-id", "1-1",
                           "entries-added", IntArg(11), "recorded-first-entry-id", "2-1", "groups",
                           IntArg(1), "first-entry", ArrLen(2), "last-entry", ArrLen(2)));
   EXPECT_THAT(resp.GetVec()[17].GetVec()[0], "2-1");
@@ -1062,7 +1150,7 @@ TEST_F(StreamFamilyTest, XInfoStream) {
   EXPECT_THAT(resp.GetVec()[15], ArrLen(10));
   EXPECT_THAT(resp.GetVec(),
               ElementsAre("length", IntArg(10), "radix-tree-keys", IntArg(1), "radix-tree-nodes",
-                          IntArg(2), "last-generated-id", "11-1", "max-deleted-entry-id", "1-1",
+                          IntArg(1), "last-generated-id", "11-1", "max-deleted-entry-id", "1-1",
                           "entries-added", IntArg(11), "recorded-first-entry-id", "2-1", "entries",
                           ArrLen(10), "groups", ArrLen(1)));
   EXPECT_THAT(resp.GetVec()[17].GetVec()[0].GetVec(),
@@ -17,6 +17,7 @@
 #include "base/flags.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/chunked_string.h"
 #include "core/overloaded.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/op_status.h"
@@ -29,12 +30,25 @@
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/generic_family.h"
+#include "server/hot_key_replicas.h"
 #include "server/journal/journal.h"
+#include "server/lazy_free.h"
+#include "server/namespaces.h"
+#include "server/server_state.h"
 #include "server/table.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "util/fibers/future.h"
 
+ABSL_FLAG(uint32_t, zero_copy_get_min_size, 0,
+          "If positive, GET replies for in-memory string values of at least this size are "
+          "written directly from the shard memory instead of being copied. The key stays "
+          "read-locked until the reply is sent. 0 disables zero-copy replies.");
+ABSL_FLAG(uint32_t, chunked_string_min_size, 1u << 20,
+          "Strings that APPEND or SETRANGE grow to at least this size are kept in fixed size "
+          "chunks, so that appending does not copy the whole value and GETRANGE reads only the "
+          "requested range. 0 keeps all strings contiguous.");
+
 namespace dfly {
 
 namespace {
@@ -42,10 +56,26 @@ namespace {
 using namespace std;
 using namespace facade;
 
+using absl::GetFlag;
+
 using CI = CommandId;
 
 enum class ExpT { EX, PX, EXAT, PXAT };
 
+// Options of SET, starting with the expiry types.
+enum class SetOpt : uint8_t { EX, PX, EXAT, PXAT, MCFLAGS, GET, STICK, KEEPTTL, XX, NX };
+
+constexpr auto kSetOpts = MakeTagTable<SetOpt>({{"EX", SetOpt::EX},
+                                                {"PX", SetOpt::PX},
+                                                {"EXAT", SetOpt::EXAT},
+                                                {"PXAT", SetOpt::PXAT},
+                                                {"_MCFLAGS", SetOpt::MCFLAGS},
+                                                {"GET", SetOpt::GET},
+                                                {"STICK", SetOpt::STICK},
+                                                {"KEEPTTL", SetOpt::KEEPTTL},
+                                                {"XX", SetOpt::XX},
+                                                {"NX", SetOpt::NX}});
+
 constexpr uint32_t kMaxStrLen = 1 << 28;
 
 // Stores a string, the pending result of a tiered read or nothing
@@ -166,10 +196,10 @@ OpResult<TResult<size_t>> OpStrLen(const OpArgs& op_args, string_view key) {
   }
   RETURN_ON_BAD_STATUS(it_res);
 
-  // For external entries we have to enqueue reads because modify operations like append could be
-  // already pending.
-  // TODO: Optimize to return co.Size() if no modify operations are present
-  if (const auto& co = it_res.value()->second; co.IsExternal()) {
+  // For external entries with pending operations we have to enqueue reads because modify
+  // operations like append could change the size, otherwise it's known without reading.
+  if (const auto& co = it_res.value()->second;
+      co.IsExternal() && op_args.shard->tiered_storage()->HasPendingOps(co)) {
     util::fb2::Future<size_t> fut;
     op_args.shard->tiered_storage()->Read(
         op_args.db_cntx.db_index, key, co,
@@ -180,6 +210,14 @@ OpResult<TResult<size_t>> OpStrLen(const OpArgs& op_args, string_view key) {
   }
 }
 
+// Returns true if the string value should be kept as a ChunkedString after it grows to new_size.
+bool ShouldChunk(const PrimeValue& pv, size_t new_size) {
+  if (pv.GetChunked())
+    return true;
+  uint32_t min_size = GetFlag(FLAGS_chunked_string_min_size);
+  return min_size > 0 && new_size >= min_size;
+}
+
 OpResult<TResult<size_t>> OpSetRange(const OpArgs& op_args, string_view key, size_t start,
                                      string_view range) {
   VLOG(2) << "SetRange(" << key << ", " << start << ", " << range << ")";
@@ -204,6 +242,12 @@ OpResult<TResult<size_t>> OpSetRange(const OpArgs& op_args, string_view key, siz
     if (!res.is_new && res.it->second.ObjType() != OBJ_STRING)
       return OpStatus::WRONG_TYPE;
 
+    if (PrimeValue& pv = res.it->second; ShouldChunk(pv, start + range.size())) {
+      ChunkedString* cs = pv.ToChunked();
+      cs->Write(start, range);
+      return {cs->Size()};
+    }
+
     if (!res.is_new)
       value = GetString(res.it->second);
 
@@ -215,31 +259,35 @@ OpResult<TResult<size_t>> OpSetRange(const OpArgs& op_args, string_view key, siz
 
 OpResult<StringValue> OpGetRange(const OpArgs& op_args, string_view key, int32_t start,
                                  int32_t end) {
-  auto read = [start, end](std::string_view slice) mutable -> string_view {
-    int32_t strlen = slice.size();
+  // Returns the offset and the length of the range in a string of strlen bytes.
+  auto bounds = [start, end](int32_t strlen) -> pair<size_t, size_t> {
+    int32_t from = start, to = end;
     if (strlen == 0)
-      return "";
+      return {0, 0};
 
-    if (start < 0) {
-      if (end < start) {
-        return "";
+    if (from < 0) {
+      if (to < from) {
+        return {0, 0};
       }
-      start = strlen + start;
-      start = max(start, 0);
+      from = max(strlen + from, 0);
     }
 
-    if (end < 0) {
-      end = strlen + end;
-      end = max(end, 0);
+    if (to < 0) {
+      to = max(strlen + to, 0);
     } else {
-      end = min(end, strlen - 1);
+      to = min(to, strlen - 1);
     }
 
-    if (start > end) {
-      return "";
+    if (from > to) {
+      return {0, 0};
     }
 
-    return slice.substr(start, end - start + 1);
+    return {size_t(from), size_t(to - from + 1)};
+  };
+
+  auto read = [bounds](std::string_view slice) -> string_view {
+    auto [pos, len] = bounds(slice.size());
+    return slice.substr(pos, len);
   };
 
   auto& db_slice = op_args.GetDbSlice();
@@ -251,10 +299,24 @@ OpResult<StringValue> OpGetRange(const OpArgs& op_args, string_view key, int32_t
 
   if (const CompactObj& co = it_res.value()->second; co.IsExternal()) {
     util::fb2::Future<std::string> fut;
-    op_args.shard->tiered_storage()->Read(
-        op_args.db_cntx.db_index, key, co,
-        [read, fut](const std::string& s) mutable { fut.Resolve(string{read(s)}); });
+    TieredStorage* tiered_storage = op_args.shard->tiered_storage();
+    if (tiered_storage->HasPendingOps(co)) {  // pending appends might change the bounds
+      tiered_storage->Read(
+          op_args.db_cntx.db_index, key, co,
+          [read, fut](const std::string& s) mutable { fut.Resolve(string{read(s)}); });
+    } else {
+      auto [pos, len] = bounds(co.Size());
+      tiered_storage->ReadRange(op_args.db_cntx.db_index, key, co, pos, len,
+                                [fut](std::string s) mutable { fut.Resolve(std::move(s)); });
+    }
     return {std::move(fut)};
+  } else if (const ChunkedString* cs = co.GetChunked(); cs) {
+    // Copy only the range instead of flattening the whole value.
+    auto [pos, len] = bounds(cs->Size());
+    string res;
+    res.reserve(len);
+    cs->Read(pos, len, [&res](string_view piece) { res.append(piece); });
+    return {std::move(res)};
   } else {
     string tmp;
     string_view slice = co.GetSlice(&tmp);
@@ -263,6 +325,13 @@ OpResult<StringValue> OpGetRange(const OpArgs& op_args, string_view key, int32_t
 };
 
 size_t ExtendExisting(DbSlice::Iterator it, string_view key, string_view val, bool prepend) {
+  // Appends to chunked strings do not move the existing bytes, prepends flatten the value.
+  if (PrimeValue& pv = it->second; !prepend && ShouldChunk(pv, pv.Size() + val.size())) {
+    ChunkedString* cs = pv.ToChunked();
+    cs->Append(val);
+    return cs->Size();
+  }
+
   string tmp, new_val;
   string_view slice = it->second.GetSlice(&tmp);
 
@@ -498,7 +567,7 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
   if (!limited) {
     if (IsValid(res.it)) {
       if (IsValid(res.exp_it)) {
-        res.exp_it->second = db_slice.FromAbsoluteTime(new_tat_ms);
+        db_slice.SetExpireTime(op_args.db_cntx.db_index, res.exp_it, new_tat_ms);
       } else {
         db_slice.AddExpire(op_args.db_cntx.db_index, res.it, new_tat_ms);
       }
@@ -530,15 +599,20 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, uint8_
 
   SinkReplyBuilder::MGetResponse response(keys.Size());
   absl::InlinedVector<DbSlice::ConstIterator, 32> iters(keys.Size());
+  absl::InlinedVector<string_view, 32> key_vec;
+  key_vec.reserve(keys.Size());
+  for (string_view key : keys)
+    key_vec.push_back(key);
 
   // First, fetch all iterators and count total size ahead
+  absl::InlinedVector<OpResult<DbSlice::ConstIterator>, 32> it_results(keys.Size());
+  db_slice.FindManyReadOnly(t->GetDbContext(), key_vec, OBJ_STRING, absl::MakeSpan(it_results));
+
   size_t total_size = 0;
-  unsigned index = 0;
-  for (string_view key : keys) {
-    auto it_res = db_slice.FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
-    if (auto& dest = iters[index++]; it_res) {
-      dest = *it_res;
-      total_size += (*it_res)->second.Size();
+  for (size_t i = 0; i < it_results.size(); ++i) {
+    if (it_results[i]) {
+      iters[i] = *it_results[i];
+      total_size += iters[i]->second.Size();
     }
   }
 
@@ -547,6 +621,12 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, uint8_
   char* next = response.storage_list->data;
   bool fetch_mcflag = fetch_mask & FETCH_MCFLAG;
   bool fetch_mcver = fetch_mask & FETCH_MCVER;
+
+  // Offloaded values are fetched with as few disk requests as possible.
+  TieredStorage* tiered = shard->tiered_storage();
+  if (tiered)
+    tiered->StartReadBatch();
+
   for (size_t i = 0; i < iters.size(); ++i) {
     auto it = iters[i];
     if (it.is_done())
@@ -562,7 +642,7 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, uint8_
         memcpy(next, v.data(), v.size());
         wait_bc->Dec();
       };
-      shard->tiered_storage()->Read(t->GetDbIndex(), it.key(), it->second, std::move(cb));
+      tiered->Read(t->GetDbIndex(), it.key(), it->second, std::move(cb));
     } else {
       CopyValueToBuffer(it->second, next);
     }
@@ -582,6 +662,9 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, uint8_
     }
   }
 
+  if (tiered)
+    tiered->FlushReadBatch();
+
   return response;
 }
 
@@ -753,6 +836,75 @@ void IncrByGeneric(string_view key, int64_t val, Transaction* tx, SinkReplyBuild
   }
 }
 
+// Returns true if pv can be referenced directly from another thread until the key is unlocked.
+// Only heap allocated raw strings qualify: inline values move together with the table entry
+// and small strings use the thread local translation table of SmallString.
+bool CanReferenceDirectly(const PrimeValue& pv, uint32_t min_size, EngineShard* es) {
+  // Tiered storage may offload the value (and free its memory) without taking locks.
+  if (es->tiered_storage())
+    return false;
+
+  return pv.IsRObj() && !pv.IsExternal() && pv.Size() >= min_size;
+}
+
+// GET variant that does not copy large values: the shard callback only references the value,
+// the coordinator writes it to the socket and then releases the key with a concluding hop.
+// The concluding hop does not add latency since the reply was already sent.
+void GetZeroCopy(string_view key, uint32_t min_size, Transaction* tx, SinkReplyBuilder* builder) {
+  vector<string_view> value_refs;  // the chunks of chunked strings or a single slice.
+  size_t value_size = 0;
+  OpResult<StringValue> copied;
+  bool referenced = false;
+
+  auto cb = [&](Transaction* t, EngineShard* es) -> OpStatus {
+    auto it_res = t->GetDbSlice(es->shard_id()).FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
+    if (!it_res.ok()) {
+      copied = it_res.status();
+      return it_res.status();
+    }
+
+    const PrimeValue& pv = (*it_res)->second;
+    if (CanReferenceDirectly(pv, min_size, es)) {
+      if (const ChunkedString* cs = pv.GetChunked(); cs) {
+        cs->Read(0, cs->Size(), [&value_refs](string_view piece) { value_refs.push_back(piece); });
+      } else {
+        string scratch;
+        value_refs.push_back(pv.GetSlice(&scratch));
+        DCHECK(scratch.empty());
+      }
+      value_size = pv.Size();
+      referenced = true;
+      es->IncZeroCopyRefs();
+    } else {
+      copied = StringValue::Read(t->GetDbIndex(), key, pv, es);
+    }
+    return OpStatus::OK;
+  };
+
+  tx->Execute(cb, false);
+
+  if (!referenced) {
+    tx->Conclude();
+    GetReplies{builder}.Send(std::move(copied));
+    return;
+  }
+
+  // Reply builders either write large strings to the socket directly or copy them into
+  // their buffers, so value_refs are not accessed once SendBulkString returns.
+  static_cast<RedisReplyBuilder*>(builder)->SendBulkString(absl::MakeConstSpan(value_refs));
+
+  auto& stats = ServerState::tlocal()->stats;
+  stats.zero_copy_get_cnt++;
+  stats.zero_copy_get_bytes += value_size;
+
+  tx->Execute(
+      [](Transaction* t, EngineShard* es) {
+        es->DecZeroCopyRefs();
+        return OpStatus::OK;
+      },
+      true);
+}
+
 }  // namespace
 
 StringValue StringValue::Read(DbIndex dbid, string_view key, const PrimeValue& pv,
@@ -828,7 +980,7 @@ OpStatus SetCmd::SetExisting(const SetParams& params, DbSlice::Iterator it,
     if (at_ms) {  // Command has an expiry paramater.
       if (IsValid(e_it)) {
         // Updated existing expiry information.
-        e_it->second = db_slice.FromAbsoluteTime(at_ms);
+        db_slice.SetExpireTime(op_args_.db_cntx.db_index, e_it, at_ms);
       } else {
         // Add new expiry information.
         db_slice.AddExpire(op_args_.db_cntx.db_index, it, at_ms);
@@ -851,7 +1003,8 @@ OpStatus SetCmd::SetExisting(const SetParams& params, DbSlice::Iterator it,
     shard->tiered_storage()->Delete(op_args_.db_cntx.db_index, &prime_value);
   }
 
-  // overwrite existing entry.
+  // overwrite existing entry, a large container that is replaced is freed in the background.
+  shard->lazy_freer()->TryAdd(&prime_value);
   prime_value.SetString(value);
 
   PostEdit(params, key, value, &prime_value);
@@ -941,9 +1094,11 @@ void StringFamily::Set(CmdArgList args, Transaction* tx, SinkReplyBuilder* build
   sparams.memcache_flags = cntx->conn_state.memcache_flag;
 
   while (parser.HasNext()) {
-    if (auto exp_type = parser.TryMapNext("EX", ExpT::EX, "PX", ExpT::PX, "EXAT", ExpT::EXAT,
-                                          "PXAT", ExpT::PXAT);
-        exp_type) {
+    SetOpt opt = parser.MapNextTag(kSetOpts);
+    if (parser.HasError())
+      break;
+
+    if (opt <= SetOpt::PXAT) {
       auto int_arg = parser.Next<int64_t>();
 
       if (auto err = parser.Error(); err) {
@@ -963,8 +1118,8 @@ void StringFamily::Set(CmdArgList args, Transaction* tx, SinkReplyBuilder* build
 
       DbSlice::ExpireParams expiry{
           .value = int_arg,
-          .unit = *exp_type == ExpT::PX || *exp_type == ExpT::PXAT ? TimeUnit::MSEC : TimeUnit::SEC,
-          .absolute = *exp_type == ExpT::EXAT || *exp_type == ExpT::PXAT,
+          .unit = opt == SetOpt::PX || opt == SetOpt::PXAT ? TimeUnit::MSEC : TimeUnit::SEC,
+          .absolute = opt == SetOpt::EXAT || opt == SetOpt::PXAT,
       };
 
       int64_t now_ms = GetCurrentTimeMs();
@@ -983,13 +1138,30 @@ void StringFamily::Set(CmdArgList args, Transaction* tx, SinkReplyBuilder* build
       }
 
       tie(sparams.expire_after_ms, ignore) = expiry.Calculate(now_ms, true);
-    } else if (parser.Check("_MCFLAGS")) {
-      sparams.memcache_flags = parser.Next<uint32_t>();
-    } else {
-      uint16_t flag = parser.MapNext(  //
-          "GET", SetCmd::SET_GET, "STICK", SetCmd::SET_STICK, "KEEPTTL", SetCmd::SET_KEEP_EXPIRE,
-          "XX", SetCmd::SET_IF_EXISTS, "NX", SetCmd::SET_IF_NOTEXIST);
-      sparams.flags |= flag;
+      continue;
+    }
+
+    switch (opt) {
+      case SetOpt::MCFLAGS:
+        sparams.memcache_flags = parser.Next<uint32_t>();
+        break;
+      case SetOpt::GET:
+        sparams.flags |= SetCmd::SET_GET;
+        break;
+      case SetOpt::STICK:
+        sparams.flags |= SetCmd::SET_STICK;
+        break;
+      case SetOpt::KEEPTTL:
+        sparams.flags |= SetCmd::SET_KEEP_EXPIRE;
+        break;
+      case SetOpt::XX:
+        sparams.flags |= SetCmd::SET_IF_EXISTS;
+        break;
+      case SetOpt::NX:
+        sparams.flags |= SetCmd::SET_IF_NOTEXIST;
+        break;
+      default:
+        break;
     }
   }
 
@@ -1069,6 +1241,17 @@ void StringFamily::SetNx(CmdArgList args, Transaction* tx, SinkReplyBuilder* bui
 }
 
 void StringFamily::Get(CmdArgList args, Transaction* tx, SinkReplyBuilder* builder) {
+  if (builder->type() == SinkReplyBuilder::REDIS && !tx->IsMulti()) {
+    // Hot keys are replicated only for the default namespace, see hot_key_replicas.
+    if (&tx->GetNamespace() == &namespaces.GetDefaultNamespace() &&
+        HotKeyReplicas::TrySend(tx->GetDbIndex(), ArgS(args, 0),
+                                static_cast<RedisReplyBuilder*>(builder)))
+      return;
+
+    if (uint32_t min_size = GetFlag(FLAGS_zero_copy_get_min_size); min_size > 0)
+      return GetZeroCopy(ArgS(args, 0), min_size, tx, builder);
+  }
+
   auto cb = [key = ArgS(args, 0)](Transaction* tx, EngineShard* es) -> OpResult<StringValue> {
     auto it_res = tx->GetDbSlice(es->shard_id()).FindReadOnly(tx->GetDbContext(), key, OBJ_STRING);
     if (!it_res.ok())
@@ -1560,7 +1743,7 @@ constexpr uint32_t kClThrottle = THROTTLE;
 
 void StringFamily::Register(CommandRegistry* registry) {
   constexpr uint32_t kMSetMask =
-      CO::WRITE | CO::DENYOOM | CO::INTERLEAVED_KEYS | CO::NO_AUTOJOURNAL;
+      CO::WRITE | CO::DENYOOM | CO::INTERLEAVED_KEYS | CO::NO_AUTOJOURNAL | CO::IDEMPOTENT;
 
   registry->StartFamily();
   *registry
@@ -4,6 +4,9 @@
 
 #include "server/string_family.h"
 
+#include <absl/flags/reflection.h>
+
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -19,6 +22,14 @@ using namespace std;
 using namespace util;
 using absl::StrCat;
 
+ABSL_DECLARE_FLAG(uint32_t, zero_copy_get_min_size);
+ABSL_DECLARE_FLAG(uint32_t, chunked_string_min_size);
+ABSL_DECLARE_FLAG(bool, tx_optimistic_multi_shard_writes);
+ABSL_DECLARE_FLAG(uint32_t, hot_key_replicas);
+ABSL_DECLARE_FLAG(uint32_t, hot_key_replica_min_rps);
+ABSL_DECLARE_FLAG(uint32_t, top_keys_sample_rate);
+ABSL_DECLARE_FLAG(uint32_t, top_keys_half_life_sec);
+
 namespace dfly {
 
 class StringFamilyTest : public BaseFamilyTest {
@@ -55,6 +66,114 @@ TEST_F(StringFamilyTest, SetGet) {
   EXPECT_EQ(3, metrics.events.mutations);
 }
 
+TEST_F(StringFamilyTest, GetWithoutLocking) {
+  Run({"set", "key", "val"});
+  auto before = GetMetrics().shard_stats;
+
+  EXPECT_EQ(Run({"get", "key"}), "val");
+  EXPECT_THAT(Run({"mget", "key"}), "val");
+  auto after = GetMetrics().shard_stats;
+  EXPECT_EQ(2u, after.tx_optimistic_unlocked_total - before.tx_optimistic_unlocked_total);
+  EXPECT_EQ(2u, after.tx_optimistic_total - before.tx_optimistic_total);
+
+  // Writes still lock their keys.
+  Run({"set", "key", "val2"});
+  EXPECT_EQ(after.tx_optimistic_unlocked_total,
+            GetMetrics().shard_stats.tx_optimistic_unlocked_total);
+  EXPECT_EQ(Run({"get", "key"}), "val2");
+}
+
+TEST_F(StringFamilyTest, MSetOptimisticMultiShard) {
+  absl::FlagSaver fs;
+  vector<string> keys = {"x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8"};
+  vector<string> mset = {"mset"};
+  for (const auto& key : keys) {
+    mset.push_back(key);
+    mset.push_back("v");
+  }
+  vector<string> del = {"del"};
+  del.insert(del.end(), keys.begin(), keys.end());
+
+  Run(mset);
+  auto before = GetMetrics().shard_stats.tx_optimistic_total;
+  EXPECT_THAT(Run(del), IntArg(8));
+  EXPECT_EQ(before, GetMetrics().shard_stats.tx_optimistic_total);
+
+  absl::SetFlag(&FLAGS_tx_optimistic_multi_shard_writes, true);
+  EXPECT_EQ(Run(mset), "OK");
+  EXPECT_GT(GetMetrics().shard_stats.tx_optimistic_total, before);
+  EXPECT_THAT(Run({"mget", "x1", "x8"}).GetVec(), ElementsAre("v", "v"));
+  EXPECT_THAT(Run(del), IntArg(8));
+  EXPECT_EQ(0, CheckedInt({"exists", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8"}));
+}
+
+TEST_F(StringFamilyTest, ZeroCopyGet) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_zero_copy_get_min_size, 1024);
+
+  string big(4096, 'x');
+  Run({"set", "big", big});
+  Run({"set", "small", "val"});
+  Run({"set", "num", "123"});
+
+  EXPECT_EQ(Run({"get", "big"}), big);
+  EXPECT_EQ(Run({"get", "small"}), "val");
+  EXPECT_EQ(Run({"get", "num"}), "123");
+  EXPECT_THAT(Run({"get", "missing"}), ArgType(RespExpr::NIL));
+
+  Run({"lpush", "list", "a"});
+  EXPECT_THAT(Run({"get", "list"}), ErrArg("WRONGTYPE"));
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(1u, metrics.coordinator_stats.zero_copy_get_cnt);
+  EXPECT_EQ(big.size(), metrics.coordinator_stats.zero_copy_get_bytes);
+
+  // The key must be unlocked after the reply was sent.
+  Run({"set", "big", "other"});
+  EXPECT_EQ(Run({"get", "big"}), "other");
+}
+
+TEST_F(StringFamilyTest, HotKeyReplicas) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_hot_key_replicas, 1);
+  absl::SetFlag(&FLAGS_hot_key_replica_min_rps, 1);
+  absl::SetFlag(&FLAGS_top_keys_sample_rate, 1);
+  absl::SetFlag(&FLAGS_top_keys_half_life_sec, 0);
+  ResetService();
+
+  auto replicate = [&](string_view key) {
+    uint64_t hits = GetMetrics().coordinator_stats.hot_key_replica_hits;
+    ExpectConditionWithinTimeout([&] {
+      Run({"get", key});
+      return GetMetrics().coordinator_stats.hot_key_replica_hits > hits;
+    });
+  };
+
+  Run({"set", "hot", "v1"});
+  Run({"set", "cold", "c"});
+  for (unsigned i = 0; i < 200; ++i)
+    Run({"get", "hot"});
+
+  replicate("hot");
+  EXPECT_EQ(1u, GetMetrics().db_stats[0].hot_key_replicas);
+  EXPECT_EQ(Run({"get", "hot"}), "v1");
+  EXPECT_EQ(Run({"get", "cold"}), "c");
+
+  // Writes are visible right after they complete.
+  Run({"set", "hot", "v2"});
+  EXPECT_EQ(Run({"get", "hot"}), "v2");
+  EXPECT_EQ(0u, GetMetrics().db_stats[0].hot_key_replicas);
+
+  replicate("hot");
+  EXPECT_EQ(Run({"get", "hot"}), "v2");
+  Run({"append", "hot", "x"});
+  EXPECT_EQ(Run({"get", "hot"}), "v2x");
+
+  replicate("hot");
+  Run({"flushall"});
+  EXPECT_THAT(Run({"get", "hot"}), ArgType(RespExpr::NIL));
+}
+
 TEST_F(StringFamilyTest, Incr) {
   ASSERT_EQ(Run({"set", "key", "0"}), "OK");
   ASSERT_THAT(Run({"incr", "key"}), IntArg(1));
@@ -84,6 +203,40 @@ TEST_F(StringFamilyTest, Append) {
   EXPECT_THAT(Run({"ttl", "key"}), IntArg(100));
 }
 
+TEST_F(StringFamilyTest, ChunkedString) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_chunked_string_min_size, 1000);
+  absl::SetFlag(&FLAGS_zero_copy_get_min_size, 1000);
+
+  // Appends cross the chunk borders.
+  string expected;
+  for (unsigned i = 0; i < 5; ++i) {
+    string part(50'000, 'a' + i);
+    expected.append(part);
+    EXPECT_THAT(Run({"append", "key", part}), IntArg(expected.size()));
+  }
+
+  EXPECT_THAT(Run({"strlen", "key"}), IntArg(expected.size()));
+  EXPECT_EQ(Run({"getrange", "key", "49990", "100009"}), expected.substr(49'990, 50'020));
+  EXPECT_EQ(Run({"getrange", "key", "-5", "-1"}), expected.substr(expected.size() - 5));
+  EXPECT_EQ(Run({"get", "key"}), expected);
+
+  EXPECT_THAT(Run({"setrange", "key", "65534", "xyz"}), IntArg(expected.size()));
+  expected.replace(65'534, 3, "xyz");
+  EXPECT_THAT(Run({"setrange", "key", "300000", "end"}), IntArg(300'003));
+  expected.resize(300'000, '\0');
+  expected.append("end");
+  EXPECT_EQ(Run({"get", "key"}), expected);
+
+  Run({"debug", "reload"});
+  EXPECT_EQ(Run({"get", "key"}), expected);
+
+  // Prepending stores the value contiguously again.
+  EXPECT_THAT(Run({"append", "key", "tail"}), IntArg(expected.size() + 4));
+  EXPECT_THAT(Run({"prepend", "key", "pre"}), IntArg(expected.size() + 7));
+  EXPECT_EQ(Run({"get", "key"}), absl::StrCat("pre", expected, "tail"));
+}
+
 TEST_F(StringFamilyTest, Expire) {
   ASSERT_EQ(Run({"set", "key", "val", "PX", "20"}), "OK");
 
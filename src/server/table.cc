@@ -4,13 +4,27 @@
 
 #include "server/table.h"
 
+#include <algorithm>
+
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/cluster/cluster_defs.h"
 #include "server/server_state.h"
 
-ABSL_FLAG(bool, enable_top_keys_tracking, false,
-          "Enables / disables tracking of hot keys debugging feature");
+ABSL_FLAG(bool, enable_top_keys_tracking, true,
+          "Enables / disables sampled tracking of hot keys, reported by HOTKEYS and /topkeys");
+ABSL_FLAG(uint32_t, top_keys_sample_rate, 100,
+          "Hot key tracking updates its sketch for 1 out of this many key lookups on average");
+ABSL_FLAG(uint32_t, top_keys_buckets, 1024,
+          "Number of buckets in each array of the per shard hot key sketch");
+ABSL_FLAG(uint32_t, top_keys_half_life_sec, 60,
+          "Hot key counts are halved every this many seconds. 0 disables the decay");
+ABSL_FLAG(bool, inline_expire, false,
+          "If true, key expiries are stored inside the prime table entries instead of a separate "
+          "expire table. Reduces the memory and lookup overhead when most keys have a TTL");
+ABSL_FLAG(bool, cluster_slot_key_index, false,
+          "If true, keeps the keys of every cluster slot in a separate index, so that slot "
+          "migrations and slot flushes do not scan the whole keyspace. Costs a copy of every key");
 
 using namespace std;
 namespace dfly {
@@ -58,36 +72,133 @@ SlotStats& SlotStats::operator+=(const SlotStats& o) {
   return *this;
 }
 
+namespace {
+
+constexpr size_t kMinLockSlots = 16;
+
+// Fills uniq with the distinct fingerprints of fps.
+void Dedup(absl::Span<const LockFp> fps, vector<LockFp>* uniq) {
+  uniq->assign(fps.begin(), fps.end());
+  sort(uniq->begin(), uniq->end());
+  uniq->erase(unique(uniq->begin(), uniq->end()), uniq->end());
+}
+
+}  // namespace
+
 std::optional<const IntentLock> LockTable::Find(LockTag tag) const {
-  LockFp fp = tag.Fingerprint();
-  if (auto it = locks_.find(fp); it != locks_.end())
-    return it->second;
-  return std::nullopt;
+  return Find(tag.Fingerprint());
 }
 
 std::optional<const IntentLock> LockTable::Find(uint64_t fp) const {
-  if (auto it = locks_.find(fp); it != locks_.end())
-    return it->second;
-  return std::nullopt;
+  if (size_ == 0)
+    return std::nullopt;
+
+  const Entry& entry = slots_[Probe(fp)];
+  if (entry.second.IsFree())
+    return std::nullopt;
+  return entry.second;
+}
+
+size_t LockTable::Probe(LockFp fp) const {
+  size_t mask = slots_.size() - 1;
+  size_t index = SlotIndex(fp);
+
+  // The load factor is at most 1/2, so there is always an empty slot.
+  while (!slots_[index].second.IsFree() && slots_[index].first != fp)
+    index = (index + 1) & mask;
+  return index;
+}
+
+bool LockTable::Acquire(LockFp fp, IntentLock::Mode mode) {
+  if ((size_ + 1) * 2 > slots_.size())
+    Grow();
+
+  Entry& entry = slots_[Probe(fp)];
+  if (entry.second.IsFree()) {
+    entry.first = fp;
+    ++size_;
+  }
+  return entry.second.Acquire(mode);
 }
 
 void LockTable::Release(uint64_t fp, IntentLock::Mode mode) {
-  auto it = locks_.find(fp);
-  DCHECK(it != locks_.end()) << fp;
+  DCHECK_GT(size_, 0u) << fp;
+  size_t index = Probe(fp);
+  Entry& entry = slots_[index];
+  DCHECK(!entry.second.IsFree()) << fp;
+
+  entry.second.Release(mode);
+  if (entry.second.IsFree())
+    Erase(index);
+}
+
+bool LockTable::Acquire(absl::Span<const LockFp> fps, IntentLock::Mode mode,
+                        vector<LockFp>* uniq) {
+  Dedup(fps, uniq);
+
+  // Grow once for the whole batch.
+  while ((size_ + uniq->size()) * 2 > slots_.size())
+    Grow();
+
+  bool acquired = true;
+  for (LockFp fp : *uniq)
+    acquired &= Acquire(fp, mode);
+  return acquired;
+}
+
+void LockTable::Release(absl::Span<const LockFp> fps, IntentLock::Mode mode,
+                        vector<LockFp>* uniq) {
+  Dedup(fps, uniq);
+  for (LockFp fp : *uniq)
+    Release(fp, mode);
+}
+
+void LockTable::Grow() {
+  vector<Entry> old(max(slots_.size() * 2, kMinLockSlots));
+  old.swap(slots_);
 
-  it->second.Release(mode);
-  if (it->second.IsFree())
-    locks_.erase(it);
+  for (const Entry& entry : old) {
+    if (!entry.second.IsFree())
+      slots_[Probe(entry.first)] = entry;
+  }
+}
+
+void LockTable::Erase(size_t index) {
+  size_t mask = slots_.size() - 1;
+  --size_;
+
+  // Shift back the entries of the probe sequence that follows the erased slot, so lookups never
+  // stop early at the hole.
+  size_t hole = index;
+  for (size_t next = (hole + 1) & mask; !slots_[next].second.IsFree(); next = (next + 1) & mask) {
+    size_t home = SlotIndex(slots_[next].first);
+    // Move the entry if its home slot does not lie cyclically in (hole, next].
+    bool in_between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (!in_between) {
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+  }
+  slots_[hole] = Entry{};
 }
 
 DbTable::DbTable(PMR_NS::memory_resource* mr, DbIndex db_index)
     : prime(kInitSegmentLog, detail::PrimeTablePolicy{}, mr),
       expire(0, detail::ExpireTablePolicy{}, mr),
       mcflag(0, detail::ExpireTablePolicy{}, mr),
-      top_keys({.enabled = absl::GetFlag(FLAGS_enable_top_keys_tracking)}),
-      index(db_index) {
+      top_keys({.buckets = absl::GetFlag(FLAGS_top_keys_buckets),
+                // Counts are in samples, so a handful of them already marks a hot key.
+                .min_key_count_to_record = 4,
+                .sample_rate = max(absl::GetFlag(FLAGS_top_keys_sample_rate), 1u),
+                .decay_period_ms = absl::GetFlag(FLAGS_top_keys_half_life_sec) * 1000ull,
+                .enabled = absl::GetFlag(FLAGS_enable_top_keys_tracking)}),
+      index(db_index),
+      inline_expire(absl::GetFlag(FLAGS_inline_expire)) {
   if (cluster::IsClusterEnabled()) {
     slots_stats.resize(cluster::kMaxSlotNum + 1);
+    slots_load.resize(cluster::kMaxSlotNum + 1);
+    if (absl::GetFlag(FLAGS_cluster_slot_key_index))
+      slot_keys.resize(cluster::kMaxSlotNum + 1);
   }
   thread_index = ServerState::tlocal()->thread_index();
 }
@@ -101,9 +212,72 @@ void DbTable::Clear() {
   prime.Clear();
   expire.Clear();
   mcflag.Clear();
+  member_expiry.clear();
+  member_expiry_key.clear();
+  member_expiry_cursor = 0;
+  inline_expire_count = 0;
+  if (expire_wheel)
+    expire_wheel->Clear();
+  expired_pending = 0;
+  for (auto& keys : slot_keys)
+    keys.clear();
   stats = DbTableStats{};
 }
 
+ExpireIterator DbTable::FindExpire(PrimeIterator it) {
+  DCHECK(it->second.HasExpire());
+  if (inline_expire)
+    return ExpireIterator::Inline(it);
+  return expire.Find(it->first);
+}
+
+ExpireConstIterator DbTable::FindExpire(PrimeConstIterator it) const {
+  DCHECK(it->second.HasExpire());
+  if (inline_expire)
+    return ExpireConstIterator::Inline(it);
+  return expire.Find(it->first);
+}
+
+ExpireConstIterator DbTable::FindExpire(string_view key) const {
+  if (!inline_expire)
+    return expire.Find(key);
+
+  PrimeConstIterator it = prime.Find(key);
+  if (IsValid(it) && it->second.HasExpire())
+    return ExpireConstIterator::Inline(it);
+  return {};
+}
+
+ExpireConstIterator DbTable::FindExpire(const PrimeKey& key) const {
+  if (!inline_expire)
+    return expire.Find(key);
+
+  PrimeConstIterator it = prime.Find(key);
+  if (IsValid(it) && it->second.HasExpire())
+    return ExpireConstIterator::Inline(it);
+  return {};
+}
+
+ExpireIterator DbTable::InsertExpire(PrimeIterator it, ExpirePeriod period) {
+  if (!inline_expire)
+    return expire.InsertNew(it->first.AsRef(), period);
+
+  prime.MutableExt(it) = period;
+  ++inline_expire_count;
+  return ExpireIterator::Inline(it);
+}
+
+void DbTable::EraseExpire(ExpireIterator it) {
+  if (!inline_expire) {
+    expire.Erase(it.table_it_);
+    return;
+  }
+
+  DCHECK_GT(inline_expire_count, 0u);
+  it.prime_it_.ext() = ExpirePeriod{};
+  --inline_expire_count;
+}
+
 PrimeIterator DbTable::Launder(PrimeIterator it, string_view key) {
   if (!it.IsOccupied() || it->first != key) {
     it = prime.Find(key);
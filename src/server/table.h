@@ -4,13 +4,17 @@
 
 #pragma once
 
+#include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <absl/types/span.h>
 
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
 #include "core/expire_period.h"
 #include "core/intent_lock.h"
+#include "core/timer_wheel.h"
 #include "server/conn_context.h"
 #include "server/detail/table.h"
 #include "server/top_keys.h"
@@ -20,6 +24,8 @@ extern "C" {
 }
 namespace dfly {
 
+struct HotKeyReplica;
+
 using PrimeKey = detail::PrimeKey;
 using PrimeValue = detail::PrimeValue;
 
@@ -30,8 +36,67 @@ using ExpireTable = DashTable<PrimeKey, ExpirePeriod, detail::ExpireTablePolicy>
 /// Iterators are still valid if a different entry in the table was mutated.
 using PrimeIterator = PrimeTable::iterator;
 using PrimeConstIterator = PrimeTable::const_iterator;
-using ExpireIterator = ExpireTable::iterator;
-using ExpireConstIterator = ExpireTable::const_iterator;
+
+// Iterator to the expiry of a key. Points either to an entry of the expire table or, when the
+// expiries are stored inline (see DbTable::inline_expire), to the prime table entry whose slot
+// payload holds the expiry. In both cases it->first is the key and it->second its ExpirePeriod.
+template <bool IsConst> class ExpireIteratorT {
+  using TableIt = std::conditional_t<IsConst, ExpireTable::const_iterator, ExpireTable::iterator>;
+  using PrimeIt = std::conditional_t<IsConst, PrimeConstIterator, PrimeIterator>;
+  using Pair = detail::IteratorPair<std::conditional_t<IsConst, const PrimeKey, PrimeKey>,
+                                    std::conditional_t<IsConst, const ExpirePeriod, ExpirePeriod>>;
+
+ public:
+  ExpireIteratorT() = default;
+
+  ExpireIteratorT(TableIt it) : table_it_(it) {
+  }
+
+  // Conversion to a const iterator.
+  template <bool C = IsConst, std::enable_if_t<C>* = nullptr>
+  ExpireIteratorT(const ExpireIteratorT<false>& o) : table_it_(o.table_it_), prime_it_(o.prime_it_) {
+  }
+
+  // Requires: the expiry of the entry is stored inline.
+  static ExpireIteratorT Inline(PrimeIt it) {
+    ExpireIteratorT res;
+    res.prime_it_ = it;
+    return res;
+  }
+
+  Pair operator->() const {
+    if (!prime_it_.is_done())
+      return Pair{prime_it_->first, prime_it_.ext()};
+    return Pair{table_it_->first, table_it_->second};
+  }
+
+  bool is_done() const {
+    return table_it_.is_done() && prime_it_.is_done();
+  }
+
+  bool IsOccupied() const {
+    return prime_it_.is_done() ? table_it_.IsOccupied() : prime_it_.IsOccupied();
+  }
+
+  // Finds the expiry of key in the table of this iterator. Used to launder the iterator.
+  ExpireIteratorT Refind(std::string_view key) const {
+    if (prime_it_.is_done())
+      return table_it_.owner().Find(key);
+
+    PrimeIt it = prime_it_.owner().Find(key);
+    return !it.is_done() && it->second.HasExpire() ? Inline(it) : ExpireIteratorT{};
+  }
+
+ private:
+  friend class ExpireIteratorT<!IsConst>;
+  friend struct DbTable;
+
+  TableIt table_it_;
+  PrimeIt prime_it_;
+};
+
+using ExpireIterator = ExpireIteratorT<false>;
+using ExpireConstIterator = ExpireIteratorT<true>;
 
 inline bool IsValid(PrimeIterator it) {
   return !it.is_done();
@@ -57,6 +122,12 @@ struct SlotStats {
   SlotStats& operator+=(const SlotStats& o);
 };
 
+// Rolling estimate of the reads and writes per second of a slot, see DbSlice::UpdateSlotLoad.
+struct SlotLoad {
+  uint64_t last_ops = 0;  // total_reads + total_writes at the last update
+  double ops_per_sec = 0;
+};
+
 struct DbTableStats {
   // Number of inline keys.
   uint64_t inline_keys = 0;
@@ -79,38 +150,93 @@ struct DbTableStats {
 };
 
 // Table for recording locks. Keys used with the lock table should be normalized with LockTag.
+// Open addressing table with linear probing whose slots hold the fingerprint and the lock
+// counters inline, so a lookup touches a single cache line in the common case. A slot is empty
+// iff its lock is free, released slots are reclaimed with backward shift deletion.
 class LockTable {
  public:
+  using Entry = std::pair<LockFp, IntentLock>;
+
+  class const_iterator {
+   public:
+    const_iterator(const Entry* cur, const Entry* end) : cur_(cur), end_(end) {
+      SkipFree();
+    }
+
+    const Entry& operator*() const {
+      return *cur_;
+    }
+
+    const Entry* operator->() const {
+      return cur_;
+    }
+
+    const_iterator& operator++() {
+      ++cur_;
+      SkipFree();
+      return *this;
+    }
+
+    bool operator==(const const_iterator& o) const {
+      return cur_ == o.cur_;
+    }
+
+    bool operator!=(const const_iterator& o) const {
+      return cur_ != o.cur_;
+    }
+
+   private:
+    void SkipFree() {
+      while (cur_ != end_ && cur_->second.IsFree())
+        ++cur_;
+    }
+
+    const Entry* cur_;
+    const Entry* end_;
+  };
+
   size_t Size() const {
-    return locks_.size();
+    return size_;
   }
+
   std::optional<const IntentLock> Find(LockTag tag) const;
   std::optional<const IntentLock> Find(LockFp fp) const;
 
-  bool Acquire(LockFp fp, IntentLock::Mode mode) {
-    return locks_[fp].Acquire(mode);
-  }
-
+  bool Acquire(LockFp fp, IntentLock::Mode mode);
   void Release(LockFp fp, IntentLock::Mode mode);
 
-  auto begin() const {
-    return locks_.cbegin();
+  // Acquire and release the locks of all fingerprints of a transaction. Duplicates are locked
+  // once, uniq is filled with the distinct fingerprints. Returns true if all locks were granted.
+  bool Acquire(absl::Span<const LockFp> fps, IntentLock::Mode mode, std::vector<LockFp>* uniq);
+  void Release(absl::Span<const LockFp> fps, IntentLock::Mode mode, std::vector<LockFp>* uniq);
+
+  const_iterator begin() const {
+    return const_iterator{slots_.data(), slots_.data() + slots_.size()};
   }
 
-  auto end() const {
-    return locks_.cend();
+  const_iterator end() const {
+    const Entry* end = slots_.data() + slots_.size();
+    return const_iterator{end, end};
   }
 
  private:
   // We use fingerprinting before accessing locks - no need to mix more.
-  struct Hasher {
-    size_t operator()(LockFp val) const {
-      return val;
-    }
-  };
-  absl::flat_hash_map<LockFp, IntentLock, Hasher> locks_;
+  size_t SlotIndex(LockFp fp) const {
+    return fp & (slots_.size() - 1);
+  }
+
+  // Returns the slot of fp or the empty slot where it should be inserted.
+  size_t Probe(LockFp fp) const;
+
+  void Grow();
+  void Erase(size_t index);
+
+  std::vector<Entry> slots_;
+  size_t size_ = 0;
 };
 
+constexpr uint32_t kMemberExpiryGranularity = 16;
+
 // A single Db table that represents a table that can be chosen with "SELECT" command.
 struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_counter> {
   PrimeTable prime;
@@ -120,20 +246,59 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   // Contains transaction locks
   LockTable trans_locks;
 
-  // Stores a list of dependant connections for each watched key.
-  absl::flat_hash_map<std::string, std::vector<ConnectionState::ExecInfo*>> watched_keys;
+  // Slice version at the time the table was flushed or swapped in, watches recorded before it
+  // are stale.
+  uint64_t flush_version = 0;
 
   // Keyspace notifications: list of expired keys since last batch of messages was published.
   mutable std::vector<std::string> expired_keys_events_;
 
   mutable DbTableStats stats;
   std::vector<SlotStats> slots_stats;
+  std::vector<SlotLoad> slots_load;
+
+  // Keys of every slot, kept in cluster mode if cluster_slot_key_index is set. Lets slot
+  // migrations and slot flushes visit only the keys of their slots instead of the whole table.
+  std::vector<absl::flat_hash_set<std::string>> slot_keys;
   ExpireTable::Cursor expire_cursor;
+  ExpireTable::Cursor evict_cursor;  // samples the expire table for volatile-ttl eviction
+
+  // Deadlines of the keys with expiry, set if active expiry uses a timing wheel instead of
+  // sampling the expire table with expire_cursor.
+  std::unique_ptr<TimerWheel> expire_wheel;
+
+  // Estimate of the keys that already expired but were not deleted yet.
+  size_t expired_pending = 0;
+
+  // Sets and hashes whose members or fields have a TTL, grouped by the earliest time in seconds
+  // a member may expire, rounded up to kMemberExpiryGranularity. Used to delete expired members
+  // without waiting for a command to touch them.
+  absl::btree_map<uint32_t, absl::flat_hash_set<std::string>> member_expiry;
+
+  // The container currently being swept for expired members and the bucket to resume from.
+  std::string member_expiry_key;
+  uint32_t member_expiry_cursor = 0;
 
   TopKeys top_keys;
+
+  // Hot keys whose values are replicated to all the threads, see DbSlice::UpdateHotKeyReplicas.
+  absl::flat_hash_map<std::string, std::shared_ptr<HotKeyReplica>> hot_replicas;
+
+  // Position of the segment sweep of DbSlice::PreSplitStep in the prime directory.
+  size_t presplit_cursor = 0;
+
+  // Sums of the size hints of loaded snapshots, see DbSlice::Reserve.
+  size_t reserved_keys = 0;
+  size_t reserved_expires = 0;
+
   DbIndex index;
   uint32_t thread_index;
 
+  // If true, the expiries are kept in the slot payloads of the prime table instead of the expire
+  // table, which then stays empty. Saves the copy of the key and the second lookup per expiry.
+  const bool inline_expire;
+  size_t inline_expire_count = 0;
+
   explicit DbTable(PMR_NS::memory_resource* mr, DbIndex index);
   ~DbTable();
 
@@ -143,6 +308,23 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   size_t table_memory() const {
     return expire.mem_usage() + prime.mem_usage();
   }
+
+  size_t expire_count() const {
+    return inline_expire ? inline_expire_count : expire.size();
+  }
+
+  // Return the expiry of the key. The variants accepting an iterator require
+  // it->second.HasExpire().
+  ExpireIterator FindExpire(PrimeIterator it);
+  ExpireConstIterator FindExpire(PrimeConstIterator it) const;
+  ExpireConstIterator FindExpire(std::string_view key) const;
+  ExpireConstIterator FindExpire(const PrimeKey& key) const;
+
+  // Stores the expiry of a key that has none. The EXPIRE bit of the value is managed by the
+  // caller.
+  ExpireIterator InsertExpire(PrimeIterator it, ExpirePeriod period);
+
+  void EraseExpire(ExpireIterator it);
 };
 
 // We use reference counting semantics of DbTable when doing snapshotting.
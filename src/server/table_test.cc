@@ -0,0 +1,184 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/table.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+
+#include <random>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class LockTableTest : public ::testing::Test {
+ protected:
+  LockTable table_;
+  vector<LockFp> uniq_;
+};
+
+TEST_F(LockTableTest, AcquireRelease) {
+  EXPECT_TRUE(table_.Acquire(1, IntentLock::SHARED));
+  EXPECT_TRUE(table_.Acquire(1, IntentLock::SHARED));
+  EXPECT_FALSE(table_.Acquire(1, IntentLock::EXCLUSIVE));
+  EXPECT_EQ(1u, table_.Size());
+
+  table_.Release(1, IntentLock::SHARED);
+  table_.Release(1, IntentLock::SHARED);
+  ASSERT_TRUE(table_.Find(1));
+  EXPECT_FALSE(table_.Find(1)->Check(IntentLock::SHARED));
+
+  table_.Release(1, IntentLock::EXCLUSIVE);
+  EXPECT_FALSE(table_.Find(1));
+  EXPECT_EQ(0u, table_.Size());
+  EXPECT_TRUE(table_.begin() == table_.end());
+}
+
+TEST_F(LockTableTest, Batch) {
+  vector<LockFp> fps = {5, 3, 5, 7, 3};
+  EXPECT_TRUE(table_.Acquire(fps, IntentLock::EXCLUSIVE, &uniq_));
+  EXPECT_EQ(uniq_, vector<LockFp>({3, 5, 7}));
+  EXPECT_EQ(3u, table_.Size());
+
+  // Duplicates are locked once.
+  EXPECT_FALSE(table_.Find(5)->Check(IntentLock::SHARED));
+  EXPECT_FALSE(table_.Find(5)->IsContended());
+
+  EXPECT_FALSE(table_.Acquire(absl::Span<const LockFp>{fps}.subspan(0, 2), IntentLock::SHARED,
+                              &uniq_));
+  table_.Release(absl::Span<const LockFp>{fps}.subspan(0, 2), IntentLock::SHARED, &uniq_);
+  table_.Release(fps, IntentLock::EXCLUSIVE, &uniq_);
+  EXPECT_EQ(0u, table_.Size());
+}
+
+// Colliding fingerprints must stay reachable after others in their probe sequence are released.
+TEST_F(LockTableTest, Collisions) {
+  constexpr unsigned kNum = 1000;
+  absl::flat_hash_map<LockFp, unsigned> expected;
+  mt19937_64 rng(42);
+
+  // Low bits are shared by many fingerprints, so probe sequences overlap and wrap around.
+  auto next_fp = [&] { return (rng() << 3) | 7; };
+
+  for (unsigned i = 0; i < kNum * 10; ++i) {
+    if (expected.empty() || rng() % 3 != 0) {
+      LockFp fp = expected.size() < kNum ? next_fp() : expected.begin()->first;
+      table_.Acquire(fp, IntentLock::SHARED);
+      expected[fp]++;
+    } else {
+      auto it = expected.begin();
+      advance(it, rng() % expected.size());
+      table_.Release(it->first, IntentLock::SHARED);
+      if (--it->second == 0)
+        expected.erase(it);
+    }
+
+    ASSERT_EQ(expected.size(), table_.Size());
+  }
+
+  for (const auto& [fp, cnt] : expected) {
+    auto lock = table_.Find(fp);
+    ASSERT_TRUE(lock);
+    EXPECT_EQ(cnt, lock->ContentionScore());
+  }
+
+  size_t iterated = 0;
+  for (const auto& [fp, lock] : table_) {
+    EXPECT_TRUE(expected.contains(fp));
+    ++iterated;
+  }
+  EXPECT_EQ(expected.size(), iterated);
+}
+
+// The lock table used before, kept here to compare against.
+class MapLockTable {
+ public:
+  bool Acquire(absl::Span<const LockFp> fps, IntentLock::Mode mode) {
+    uniq_.clear();
+    bool acquired = true;
+    for (LockFp fp : fps) {
+      if (uniq_.insert(fp).second)
+        acquired &= locks_[fp].Acquire(mode);
+    }
+    return acquired;
+  }
+
+  void Release(absl::Span<const LockFp> fps, IntentLock::Mode mode) {
+    uniq_.clear();
+    for (LockFp fp : fps) {
+      if (!uniq_.insert(fp).second)
+        continue;
+      auto it = locks_.find(fp);
+      it->second.Release(mode);
+      if (it->second.IsFree())
+        locks_.erase(it);
+    }
+  }
+
+ private:
+  struct Hasher {
+    size_t operator()(LockFp val) const {
+      return val;
+    }
+  };
+  absl::flat_hash_map<LockFp, IntentLock, Hasher> locks_;
+  absl::flat_hash_set<uint64_t> uniq_;
+};
+
+// Batches of state.range(0) keys are locked and unlocked while 10k other locks are held.
+template <typename T, typename Acquire, typename Release>
+void BenchLockTable(benchmark::State& state, T* table, Acquire acquire, Release release) {
+  mt19937_64 rng(42);
+  for (unsigned i = 0; i < 10000; ++i) {
+    LockFp fp = rng();
+    acquire(table, absl::Span<const LockFp>{&fp, 1});
+  }
+
+  vector<vector<LockFp>> batches(1024);
+  for (auto& batch : batches) {
+    batch.resize(state.range(0));
+    for (auto& fp : batch)
+      fp = rng();
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const auto& batch = batches[i++ % batches.size()];
+    acquire(table, batch);
+    release(table, batch);
+  }
+}
+
+static void BM_LockTable(benchmark::State& state) {
+  LockTable table;
+  vector<LockFp> uniq;
+  BenchLockTable(
+      state, &table,
+      [&](LockTable* t, absl::Span<const LockFp> fps) {
+        t->Acquire(fps, IntentLock::EXCLUSIVE, &uniq);
+      },
+      [&](LockTable* t, absl::Span<const LockFp> fps) {
+        t->Release(fps, IntentLock::EXCLUSIVE, &uniq);
+      });
+}
+BENCHMARK(BM_LockTable)->Arg(1)->Arg(10)->Arg(100);
+
+static void BM_MapLockTable(benchmark::State& state) {
+  MapLockTable table;
+  BenchLockTable(
+      state, &table,
+      [](MapLockTable* t, absl::Span<const LockFp> fps) {
+        t->Acquire(fps, IntentLock::EXCLUSIVE);
+      },
+      [](MapLockTable* t, absl::Span<const LockFp> fps) {
+        t->Release(fps, IntentLock::EXCLUSIVE);
+      });
+}
+BENCHMARK(BM_MapLockTable)->Arg(1)->Arg(10)->Arg(100);
+
+}  // namespace dfly
@@ -483,6 +483,46 @@ auto BaseFamilyTest::GetMC(MP::CmdType cmd_type, std::initializer_list<std::stri
   return conn->SplitLines();
 }
 
+auto BaseFamilyTest::RunMCLine(string_view line, string_view value) -> MCResponse {
+  if (!ProactorBase::IsProactorThread()) {
+    return pp_->at(0)->Await([&] { return this->RunMCLine(line, value); });
+  }
+
+  string buf = absl::StrCat(line, "\r\n");
+  MP::Command cmd;
+  uint32_t consumed = 0;
+  CHECK_EQ(MP{}.Parse(buf, &consumed, &cmd), MP::OK) << line;
+
+  TestConnWrapper* conn = AddFindConn(Protocol::MEMCACHE, GetId());
+  service_->DispatchMC(cmd, value, conn->cmd_cntx());
+
+  return conn->SplitLines();
+}
+
+auto BaseFamilyTest::GetManyMC(std::initializer_list<std::string_view> lines) -> MCResponse {
+  if (!ProactorBase::IsProactorThread()) {
+    return pp_->at(0)->Await([&] { return this->GetManyMC(lines); });
+  }
+
+  vector<string> bufs;
+  for (string_view line : lines)
+    bufs.push_back(absl::StrCat(line, "\r\n"));
+
+  vector<MP::Command> cmds(bufs.size());
+  vector<const MP::Command*> cmd_ptrs;
+  for (size_t i = 0; i < bufs.size(); ++i) {
+    uint32_t consumed = 0;
+    CHECK_EQ(MP{}.Parse(bufs[i], &consumed, &cmds[i]), MP::OK) << bufs[i];
+    CHECK(cmds[i].type == MP::GET || cmds[i].type == MP::META_GET) << bufs[i];
+    cmd_ptrs.push_back(&cmds[i]);
+  }
+
+  TestConnWrapper* conn = AddFindConn(Protocol::MEMCACHE, GetId());
+  service_->DispatchManyMC(cmd_ptrs, conn->cmd_cntx());
+
+  return conn->SplitLines();
+}
+
 int64_t BaseFamilyTest::CheckedInt(ArgSlice list) {
   RespExpr resp = Run(list);
   if (resp.type == RespExpr::INT64) {
@@ -588,6 +628,17 @@ size_t BaseFamilyTest::InvalidationMessagesLen(string_view conn_id) const {
   return it->second->conn()->invalidate_messages.size();
 }
 
+vector<string> BaseFamilyTest::GetInvalidatedKeys(string_view conn_id) const {
+  vector<string> res;
+  auto it = connections_.find(conn_id);
+  if (it == connections_.end())
+    return res;
+
+  for (const auto& msg : it->second->conn()->invalidate_messages)
+    res.insert(res.end(), msg.keys.begin(), msg.keys.end());
+  return res;
+}
+
 const facade::Connection::PubMessage& BaseFamilyTest::GetPublishedMessage(string_view conn_id,
                                                                           size_t index) const {
   auto it = connections_.find(conn_id);
@@ -93,6 +93,12 @@ class BaseFamilyTest : public ::testing::Test {
   MCResponse RunMC(MemcacheParser::CmdType cmd_type, std::string_view key = std::string_view{});
   MCResponse GetMC(MemcacheParser::CmdType cmd_type, std::initializer_list<std::string_view> list);
 
+  // Parses and runs a memcache command line, value is the data block of store commands.
+  MCResponse RunMCLine(std::string_view line, std::string_view value = std::string_view{});
+
+  // Runs get and meta get command lines as a pipelined batch.
+  MCResponse GetManyMC(std::initializer_list<std::string_view> lines);
+
   int64_t CheckedInt(std::initializer_list<std::string_view> list) {
     return CheckedInt(ArgSlice{list.begin(), list.size()});
   }
@@ -138,6 +144,9 @@ class BaseFamilyTest : public ::testing::Test {
 
   size_t InvalidationMessagesLen(std::string_view conn_id) const;
 
+  // Keys of all the invalidation messages the connection got, in order.
+  std::vector<std::string> GetInvalidatedKeys(std::string_view conn_id) const;
+
   const facade::Connection::PubMessage& GetPublishedMessage(std::string_view conn_id,
                                                             size_t index) const;
 
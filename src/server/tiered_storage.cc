@@ -12,12 +12,19 @@
 #include <variant>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/strings/str_split.h"
 #include "absl/flags/internal/flag.h"
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/detail/bitpacking.h"
+#include "core/frequency_sketch.h"
+#include "core/overloaded.h"
 #include "server/common.h"
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
+#include "server/rdb_load.h"
+#include "server/rdb_save.h"
+#include "server/server_state.h"
 #include "server/snapshot.h"
 #include "server/table.h"
 #include "server/tiering/common.h"
@@ -37,6 +44,27 @@ ABSL_FLAG(float, tiered_low_memory_factor, 0.1,
           "Determines the low limit per shard that "
           "tiered storage should not cross");
 
+ABSL_FLAG(bool, tiered_offload_containers, false,
+          "If true, large hashes, sets and lists are offloaded as well as strings");
+
+ABSL_FLAG(float, tiered_compaction_threshold, 0,
+          "Fragmentation ratio of the backing file, above which entries of its pages that are "
+          "used less than that are moved back to memory, so the pages can be released. "
+          "0 disables compaction");
+
+ABSL_FLAG(unsigned, tiered_offload_hot_threshold, 0,
+          "Entries looked up at least this many times recently (estimated, up to 15) are not "
+          "offloaded. 0 disables the estimate");
+
+ABSL_FLAG(uint32_t, tiered_small_bins_flush_ms, 0,
+          "Small values that were not packed into a full page within this time are stashed "
+          "with a partially filled page. 0 waits until pages fill up");
+
+ABSL_FLAG(bool, tiered_warm_restart, false,
+          "If true, the snapshot saved on shutdown references offloaded values in the backing "
+          "files instead of containing them, and the backing files are preserved on startup. "
+          "Requires the same tiered_prefix and number of shards after the restart");
+
 namespace dfly {
 
 using namespace std;
@@ -53,6 +81,9 @@ bool OccupiesWholePages(size_t size) {
 // Stashed bins no longer have bin ids, so this sentinel is used to differentiate from regular reads
 constexpr auto kFragmentedBin = tiering::SmallBins::kInvalidBin - 1;
 
+// Size of the access frequency estimate, 128KB per shard.
+constexpr size_t kHotnessCounters = 1 << 18;
+
 // Called after setting new value in place of previous segment
 void RecordDeleted(const PrimeValue& pv, size_t tiered_len, DbTableStats* stats) {
   stats->AddTypeMemoryUsage(pv.ObjType(), pv.MallocUsed());
@@ -74,6 +105,35 @@ tiering::DiskSegment FromCoolItem(const PrimeValue::CoolItem& item) {
   return {item.record->page_index * tiering::kPageSize + item.page_offset, item.serialized_size};
 }
 
+bool IsOffloadableContainer(CompactObjType type) {
+  return type == OBJ_HASH || type == OBJ_SET || type == OBJ_LIST;
+}
+
+// Decodes containers serialized with SerializerBase::DumpObject.
+class ContainerDecoder : protected RdbLoaderBase {
+ public:
+  error_code Decode(string_view blob, PrimeValue* pv) {
+    io::BytesSource source{io::Buffer(blob)};
+    src_ = &source;
+
+    io::Result<uint8_t> type_id = FetchType();
+    if (!type_id)
+      return type_id.error();
+
+    OpaqueObj obj;
+    if (error_code ec = ReadObj(*type_id, &obj); ec)
+      return ec;
+    return FromOpaque(obj, pv);
+  }
+};
+
+PrimeValue DecodeContainer(string_view blob) {
+  PrimeValue pv;
+  error_code ec = ContainerDecoder{}.Decode(blob, &pv);
+  LOG_IF(DFATAL, ec) << "Failed to decode offloaded container: " << ec.message();
+  return pv;
+}
+
 }  // anonymous namespace
 
 class TieredStorage::ShardOpManager : public tiering::OpManager {
@@ -115,12 +175,15 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
   // Load all values from bin by their hashes
   void Defragment(tiering::DiskSegment segment, string_view value);
 
-  void NotifyStashed(EntryId id, const io::Result<tiering::DiskSegment>& segment) override {
+  void NotifyStashed(EntryId id, const io::Result<tiering::DiskSegment>& segment,
+                     optional<uint32_t> raw_len) override {
     if (!segment) {
       VLOG(1) << "Stash failed " << segment.error().message();
       visit([this](auto id) { ClearIoPending(id); }, id);
     } else {
-      visit([this, segment](auto id) { SetExternal(id, *segment); }, id);
+      visit(Overloaded{[&](OpManager::KeyRef key) { SetExternal(key, *segment, raw_len); },
+                       [&](tiering::SmallBins::BinId id) { SetExternal(id, *segment); }},
+            id);
     }
   }
 
@@ -137,13 +200,17 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
   void Upload(DbIndex dbid, string_view value, bool is_raw, size_t serialized_len, PrimeValue* pv) {
     DCHECK(!value.empty());
 
-    pv->Materialize(value, is_raw);
+    if (pv->ObjType() == OBJ_STRING)
+      pv->Materialize(value, is_raw);
+    else
+      pv->Materialize(DecodeContainer(value));
     RecordDeleted(*pv, serialized_len, GetDbTableStats(dbid));
   }
 
   // Find entry by key in db_slice and store external segment in place of original value.
-  // Update memory stats
-  void SetExternal(OpManager::KeyRef key, tiering::DiskSegment segment) {
+  // raw_len is set if the value was compressed. Update memory stats
+  void SetExternal(OpManager::KeyRef key, tiering::DiskSegment segment,
+                   optional<uint32_t> raw_len = nullopt) {
     if (auto* pv = Find(key); pv) {
       auto* stats = GetDbTableStats(key.first);
 
@@ -154,10 +221,12 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
 
       if (absl::GetFlag(FLAGS_tiered_experimental_cooling)) {
         RetireColdEntries(pv->MallocUsed());
-        ts_->CoolDown(key.first, key.second, segment, pv);
+        ts_->CoolDown(key.first, key.second, segment, raw_len, pv);
       } else {
         stats->AddTypeMemoryUsage(pv->ObjType(), -pv->MallocUsed());
-        pv->SetExternal(segment.offset, segment.length);
+        pv->SetExternal(segment.offset, segment.length, pv->ObjType());
+        if (raw_len)
+          pv->SetExternalCompressed(*raw_len);
       }
     } else {
       LOG(DFATAL) << "Should not reach here";
@@ -311,6 +380,15 @@ TieredStorage::TieredStorage(size_t max_size, DbSlice* db_slice)
     : op_manager_{make_unique<ShardOpManager>(this, db_slice, max_size)},
       bins_{make_unique<tiering::SmallBins>()} {
   write_depth_limit_ = absl::GetFlag(FLAGS_tiered_storage_write_depth);
+  offload_containers_ = absl::GetFlag(FLAGS_tiered_offload_containers);
+  compaction_threshold_ = absl::GetFlag(FLAGS_tiered_compaction_threshold);
+  hot_threshold_ = absl::GetFlag(FLAGS_tiered_offload_hot_threshold);
+  warm_restart_ = absl::GetFlag(FLAGS_tiered_warm_restart);
+  bins_flush_ms_ = absl::GetFlag(FLAGS_tiered_small_bins_flush_ms);
+  if (hot_threshold_ > 0)
+    hotness_ = make_unique<FrequencySketch>(kHotnessCounters);
+  if (auto* histograms = op_manager_->histograms(); histograms)
+    bins_->SetDwellHistogram(&histograms->bin_dwell_ms);
   size_t mem_per_shard = max_memory_limit / shard_set->size();
   SetMemoryLowWatermark(absl::GetFlag(FLAGS_tiered_low_memory_factor) * mem_per_shard);
 }
@@ -319,10 +397,15 @@ TieredStorage::~TieredStorage() {
 }
 
 error_code TieredStorage::Open(string_view base_path) {
-  // dts - dragonfly tiered storage.
-  string path = absl::StrCat(
-      base_path, "-", absl::Dec(ProactorBase::me()->GetPoolIndex(), absl::kZeroPad4), ".dts");
-  return op_manager_->Open(path);
+  vector<string> paths;
+  for (string_view prefix : absl::StrSplit(base_path, ',', absl::SkipEmpty())) {
+    // dts - dragonfly tiered storage.
+    paths.push_back(absl::StrCat(
+        prefix, "-", absl::Dec(ProactorBase::me()->GetPoolIndex(), absl::kZeroPad4), ".dts"));
+  }
+  if (paths.empty() || paths.size() > tiering::kMaxBackingFiles)
+    return make_error_code(errc::invalid_argument);
+  return op_manager_->Open(paths, warm_restart_);
 }
 
 void TieredStorage::Close() {
@@ -355,7 +438,91 @@ void TieredStorage::Read(DbIndex dbid, std::string_view key, const PrimeValue& v
     readf(DecodeString(is_raw, *raw_val, std::move(decoder)));
     return false;
   };
-  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb));
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), value.IsExternalCompressed(),
+                       std::move(cb));
+}
+
+void TieredStorage::ReadRange(DbIndex dbid, string_view key, const PrimeValue& value,
+                              size_t offset, size_t len, function<void(string)> readf) {
+  DCHECK(value.IsExternal());
+  DCHECK(!value.IsCool());
+  DCHECK_LE(offset + len, value.Size());
+
+  if (len == 0)
+    return readf(string{});
+
+  // Offsets into compressed blobs are unknown and values sharing their pages are read whole.
+  tiering::DiskSegment segment{value.GetExternalSlice()};
+  if (value.IsExternalCompressed() || !OccupiesWholePages(segment.length) ||
+      op_manager_->HasPendingOps(segment)) {
+    Read(dbid, key, value, [readf = std::move(readf), offset, len](const string& str) {
+      readf(str.substr(offset, len));
+    });
+    return;
+  }
+
+  if (!value.IsAsciiPacked()) {
+    op_manager_->ReadRange(segment, {segment.offset + offset, len},
+                           [readf = std::move(readf)](string_view range) { readf(string{range}); });
+    return;
+  }
+
+  // Ascii packing stores every 8 characters in 7 bytes and the characters after the last full
+  // group as is, so whole groups are read and unpacked.
+  size_t first = offset / 8 * 8;
+  size_t chars = min((offset + len + 7) / 8 * 8, value.Size()) - first;
+  size_t from = first / 8 * 7, to = min((offset + len + 7) / 8 * 7, segment.length);
+  auto cb = [readf = std::move(readf), offset, len, first, chars](string_view range) {
+    string packed{range};
+    packed.push_back('\0');  // ascii_unpack loads 8 bytes for every 7 byte group
+    string str(chars, '\0');
+    detail::ascii_unpack(reinterpret_cast<const uint8_t*>(packed.data()), chars, str.data());
+    readf(str.substr(offset - first, len));
+  };
+  op_manager_->ReadRange(segment, {segment.offset + from, to - from}, std::move(cb));
+}
+
+bool TieredStorage::HasPendingOps(const PrimeValue& value) const {
+  DCHECK(value.IsExternal());
+  return op_manager_->HasPendingOps(value.GetExternalSlice());
+}
+
+util::fb2::Future<string> TieredStorage::ReadSerialized(DbIndex dbid, string_view key,
+                                                        const PrimeValue& value) {
+  if (value.ObjType() == OBJ_STRING)
+    return Read(dbid, key, value);
+
+  util::fb2::Future<string> fut;
+  auto cb = [fut](bool, const string* blob) mutable {
+    fut.Resolve(*blob);
+    return false;
+  };
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), value.IsExternalCompressed(),
+                       std::move(cb));
+  return fut;
+}
+
+void TieredStorage::FetchContainer(DbIndex dbid, string_view key, const PrimeValue& value) {
+  DCHECK(value.IsExternal() && !value.IsCool());
+  DCHECK_NE(value.ObjType(), OBJ_STRING);
+
+  // Reporting the value as modified makes OpManager upload it back to memory.
+  util::fb2::Future<bool> fut;
+  auto cb = [fut](bool, string*) mutable {
+    fut.Resolve(true);
+    return true;
+  };
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), value.IsExternalCompressed(),
+                       std::move(cb));
+  fut.Get();
+}
+
+void TieredStorage::StartReadBatch() {
+  op_manager_->StartReadBatch();
+}
+
+void TieredStorage::FlushReadBatch() {
+  op_manager_->FlushReadBatch();
 }
 
 template <typename T>
@@ -377,7 +544,8 @@ util::fb2::Future<T> TieredStorage::Modify(DbIndex dbid, std::string_view key,
     future.Resolve(modf(raw_val));
     return true;
   };
-  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb));
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), value.IsExternalCompressed(),
+                       std::move(cb));
   return future;
 }
 
@@ -393,14 +561,23 @@ bool TieredStorage::TryStash(DbIndex dbid, string_view key, PrimeValue* value) {
   // This invariant should always hold because ShouldStash tests for IoPending flag.
   DCHECK(!bins_->IsPending(dbid, key));
 
-  // TODO: When we are low on memory we should introduce a back-pressure, to avoid OOMs
-  // with a lot of underutilized disk space.
+  // Writes are not paced here, the loader applies back-pressure with AwaitStashCapacity.
   if (op_manager_->GetStats().pending_stash_cnt >= write_depth_limit_) {
     ++stats_.stash_overflow_cnt;
     return false;
   }
 
+  // Offloading hot entries only causes them to be read back soon
+  if (IsHot(key)) {
+    ++stats_.hot_skips;
+    return false;
+  }
+
+  if (value->ObjType() != OBJ_STRING)
+    return TryStashContainer(dbid, key, value);
+
   StringOrView raw_string = value->GetRawString();
+  uint64_t ttl_ms = TimeToLive(dbid, key, *value);
   value->SetStashPending(true);
 
   tiering::OpManager::EntryId id;
@@ -408,7 +585,8 @@ bool TieredStorage::TryStash(DbIndex dbid, string_view key, PrimeValue* value) {
   if (OccupiesWholePages(value->Size())) {  // large enough for own page
     id = KeyRef(dbid, key);
     ec = op_manager_->Stash(id, raw_string.view(), {});
-  } else if (auto bin = bins_->Stash(dbid, key, raw_string.view(), {}); bin) {
+  } else if (auto bin = bins_->Stash(dbid, key, raw_string.view(), {}, ttl_ms, GetCurrentTimeMs());
+             bin) {
     id = bin->first;
     ec = op_manager_->Stash(id, bin->second, {});
   }
@@ -422,6 +600,41 @@ bool TieredStorage::TryStash(DbIndex dbid, string_view key, PrimeValue* value) {
   return true;
 }
 
+void TieredStorage::AwaitStashCapacity(const PrimeValue& value) {
+  if (!ShouldStash(value))
+    return;
+
+  // The memory of stashed values is released only when their writes finish, so past the budget
+  // wait for all of them and otherwise only for room in the write queue.
+  auto must_wait = [&] {
+    size_t pending = op_manager_->GetStats().pending_stash_cnt;
+    if (pending == 0 || op_manager_->HasEnoughMemoryMargin(value.MallocUsed()))
+      return false;
+    return pending >= write_depth_limit_ || op_manager_->db_slice_.memory_budget() < 0;
+  };
+
+  while (must_wait())
+    ThisFiber::SleepFor(100us);
+}
+
+bool TieredStorage::TryStashContainer(DbIndex dbid, string_view key, PrimeValue* value) {
+  io::StringSink sink;
+  SerializerBase::DumpObject(*value, &sink);
+
+  // Containers always take whole pages, so that NotifyDelete does not look for them in bins.
+  if (!OccupiesWholePages(sink.str().size()))
+    return false;
+
+  value->SetStashPending(true);
+  KeyRef id(dbid, key);
+  if (error_code ec = op_manager_->Stash(id, sink.str(), {}); ec) {
+    LOG_IF(ERROR, ec != errc::file_too_large) << "Stash failed immediately" << ec.message();
+    op_manager_->ClearIoPending(id);
+    return false;
+  }
+  return true;
+}
+
 void TieredStorage::Delete(DbIndex dbid, PrimeValue* value) {
   DCHECK(value->IsExternal());
   ++stats_.total_deletes;
@@ -429,7 +642,7 @@ void TieredStorage::Delete(DbIndex dbid, PrimeValue* value) {
   tiering::DiskSegment segment = value->GetExternalSlice();
   if (value->IsCool()) {
     auto hot = DeleteCool(value->GetCool().record);
-    DCHECK_EQ(hot.ObjType(), OBJ_STRING);
+    DCHECK_EQ(hot.ObjType(), value->ObjType());
   }
 
   // In any case we delete the offloaded segment and reset the value.
@@ -439,7 +652,7 @@ void TieredStorage::Delete(DbIndex dbid, PrimeValue* value) {
 
 void TieredStorage::CancelStash(DbIndex dbid, std::string_view key, PrimeValue* value) {
   DCHECK(value->HasStashPending());
-  if (OccupiesWholePages(value->Size())) {
+  if (value->ObjType() != OBJ_STRING || OccupiesWholePages(value->Size())) {
     op_manager_->Delete(KeyRef(dbid, key));
   } else if (auto bin = bins_->Delete(dbid, key); bin) {
     op_manager_->Delete(*bin);
@@ -451,6 +664,15 @@ float TieredStorage::WriteDepthUsage() const {
   return 1.0f * op_manager_->GetStats().pending_stash_cnt / write_depth_limit_;
 }
 
+void TieredStorage::SampleWriteDepth() {
+  if (auto* histograms = op_manager_->histograms(); histograms)
+    histograms->write_depth.Add(100 * WriteDepthUsage());
+}
+
+const tiering::Histograms* TieredStorage::GetHistograms() const {
+  return op_manager_->histograms();
+}
+
 TieredStats TieredStorage::GetStats() const {
   TieredStats stats{};
 
@@ -469,8 +691,18 @@ TieredStats TieredStorage::GetStats() const {
     stats.pending_stash_cnt = op_stats.pending_stash_cnt;
     stats.allocated_bytes = op_stats.disk_stats.allocated_bytes;
     stats.capacity_bytes = op_stats.disk_stats.capacity_bytes;
+    stats.committed_bytes = op_stats.disk_stats.committed_bytes;
+    stats.total_released_bytes = op_stats.disk_stats.released_bytes;
     stats.total_heap_buf_allocs = op_stats.disk_stats.heap_buf_alloc_count;
     stats.total_registered_buf_allocs = op_stats.disk_stats.registered_buf_alloc_count;
+    stats.total_coalesced_reads = op_stats.coalesced_read_cnt;
+    stats.total_range_reads = op_stats.range_read_cnt;
+    stats.total_compressed_stashes = op_stats.compressed_stash_cnt;
+
+    static_assert(tiering::kMaxBackingFiles == stats.file_pending_ops.size());
+    stats.backing_files = op_stats.disk_stats.backing_files;
+    for (size_t i = 0; i < stats.file_pending_ops.size(); ++i)
+      stats.file_pending_ops[i] = op_stats.disk_stats.file_pending_ops[i];
   }
 
   {  // SmallBins stats
@@ -485,12 +717,15 @@ TieredStats TieredStorage::GetStats() const {
     stats.cold_storage_bytes = stats_.cool_memory_used;
     stats.total_offloading_steps = stats_.offloading_steps;
     stats.total_offloading_stashes = stats_.offloading_stashes;
+    stats.total_hot_skips = stats_.hot_skips;
+    stats.total_evacuations = stats_.evacuations;
   }
   return stats;
 }
 
 void TieredStorage::RunOffloading(DbIndex dbid) {
   const size_t kMaxIterations = 500;
+  CpuClassScope cpu_scope{CpuClass::TIERING};
 
   if (SliceSnapshot::IsSnaphotInProgress())
     return;
@@ -527,6 +762,101 @@ void TieredStorage::RunOffloading(DbIndex dbid) {
   } while (offloading_cursor_ != start_cursor && iterations++ < kMaxIterations);
 }
 
+void TieredStorage::FlushStaleBins() {
+  if (bins_flush_ms_ == 0)
+    return;
+
+  for (auto& [id, blob] : bins_->FlushStale(GetCurrentTimeMs(), bins_flush_ms_)) {
+    if (error_code ec = op_manager_->Stash(id, blob, {}); ec) {
+      LOG_IF(ERROR, ec != errc::file_too_large) << "Stash failed immediately" << ec.message();
+      op_manager_->ClearIoPending(id);
+    }
+  }
+}
+
+uint64_t TieredStorage::TimeToLive(DbIndex dbid, string_view key, const PrimeValue& value) const {
+  if (!value.HasExpire())
+    return 0;
+
+  const DbSlice& db_slice = op_manager_->db_slice_;
+  auto eit = db_slice.GetDBTable(dbid)->FindExpire(key);
+  uint64_t expire_ms = db_slice.ExpireTime(eit), now_ms = GetCurrentTimeMs();
+  return expire_ms > now_ms ? expire_ms - now_ms : 1;
+}
+
+void TieredStorage::RecordAccess(string_view key) {
+  if (hotness_)
+    hotness_->Increment(CompactObj::HashCode(key));
+}
+
+bool TieredStorage::IsHot(string_view key) const {
+  return hotness_ && hotness_->Estimate(CompactObj::HashCode(key)) >= hot_threshold_;
+}
+
+void TieredStorage::RunCompaction() {
+  const size_t kMaxIterations = 100;
+  CpuClassScope cpu_scope{CpuClass::TIERING};
+
+  if (compaction_threshold_ <= 0 || SliceSnapshot::IsSnaphotInProgress())
+    return;
+
+  if (!evacuating_) {
+    auto disk_stats = op_manager_->GetStats().disk_stats;
+    if (disk_stats.allocated_bytes >= disk_stats.committed_bytes * (1 - compaction_threshold_))
+      return;
+
+    evacuating_ = op_manager_->StartEvacuation(compaction_threshold_);
+    if (!evacuating_)
+      return;
+
+    VLOG(1) << "Evacuating page " << evacuating_->offset << ", fragmentation: "
+            << 1 - double(disk_stats.allocated_bytes) / disk_stats.committed_bytes;
+    stats_.evacuations++;
+    compaction_db_ = 0;
+    compaction_cursor_ = {};
+  }
+
+  // Entries are uploaded by NotifyFetched once their reads finish, which frees their segments.
+  string tmp;
+  auto cb = [this, &tmp, page = *evacuating_](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    if (!pv.IsExternal())
+      return;
+
+    tiering::DiskSegment segment = pv.GetExternalSlice();
+    if (segment.offset < page.offset || segment.offset >= page.offset + page.length)
+      return;
+
+    if (pv.IsCool()) {
+      pv = Warmup(compaction_db_, pv.GetCool());
+    } else if (op_manager_->HasEnoughMemoryMargin(segment.length)) {
+      pv.SetTouched(true);
+      op_manager_->Enqueue(KeyRef(compaction_db_, it->first.GetSlice(&tmp)), segment,
+                           pv.IsExternalCompressed(), [](bool, string*) { return false; });
+    }
+  };
+
+  DbSlice& db_slice = op_manager_->db_slice_;
+  for (size_t iterations = 0; iterations < kMaxIterations; iterations++) {
+    if (compaction_db_ >= db_slice.db_array_size()) {
+      // All entries were traversed. The page was released if all of them were uploaded.
+      op_manager_->StopEvacuation(evacuating_->offset);
+      evacuating_.reset();
+      return;
+    }
+
+    if (!db_slice.IsDbValid(compaction_db_)) {
+      compaction_db_++;
+      continue;
+    }
+
+    PrimeTable& table = db_slice.GetDBTable(compaction_db_)->prime;
+    compaction_cursor_ = table.TraverseBySegmentOrder(compaction_cursor_, cb);
+    if (compaction_cursor_ == PrimeTable::Cursor{})
+      compaction_db_++;
+  }
+}
+
 size_t TieredStorage::ReclaimMemory(size_t goal) {
   size_t gained = 0;
   do {
@@ -547,9 +877,13 @@ size_t TieredStorage::ReclaimMemory(size_t goal) {
     CHECK(IsValid(it));
     PrimeValue& pv = it->second;
     tiering::DiskSegment segment = FromCoolItem(pv.GetCool());
+    bool compressed = pv.IsExternalCompressed();
+    uint32_t raw_len = pv.Size();
 
     // Now the item is only in storage.
-    pv.SetExternal(segment.offset, segment.length);
+    pv.SetExternal(segment.offset, segment.length, record->value.ObjType());
+    if (compressed)
+      pv.SetExternalCompressed(raw_len);
 
     auto* stats = op_manager_->GetDbTableStats(record->db_index);
     stats->AddTypeMemoryUsage(record->value.ObjType(), -record->value.MallocUsed());
@@ -559,15 +893,66 @@ size_t TieredStorage::ReclaimMemory(size_t goal) {
   return gained;
 }
 
+bool TieredStorage::CanReference(const PrimeValue& pv) const {
+  // Cool values are serialized from memory, their segments are released on restart. Large values
+  // are not tracked by allocator pages, so they can't be restored.
+  return warm_restart_ && pv.IsExternal() && !pv.IsCool() &&
+         pv.GetExternalSlice().second <= tiering::ExternalAllocator::kMaxPageBlockSize;
+}
+
+void TieredStorage::PreserveSegments() {
+  if (warm_restart_)
+    op_manager_->KeepFreedSegments();
+}
+
+bool TieredStorage::Restore(DbIndex dbid, const PrimeValue& pv) {
+  DCHECK(pv.IsExternal());
+  if (!op_manager_->IsRestoring())
+    return false;
+
+  tiering::DiskSegment segment = pv.GetExternalSlice();
+  if (OccupiesWholePages(segment.length)) {
+    if (!op_manager_->Restore(segment))
+      return false;
+  } else if (bins_->Restore(segment) && !op_manager_->Restore(segment.ContainingPages())) {
+    return false;
+  }
+
+  auto* stats = op_manager_->GetDbTableStats(dbid);
+  stats->tiered_entries++;
+  stats->tiered_used_bytes += segment.length;
+  return true;
+}
+
+void TieredStorage::FinishRestore() {
+  op_manager_->FinishRestore();
+}
+
 bool TieredStorage::ShouldStash(const PrimeValue& pv) const {
+  if (pv.IsExternal() || pv.HasStashPending())
+    return false;
+
+  // Containers are serialized on their own pages, so only the large ones are worth it.
+  size_t size;
+  if (pv.ObjType() == OBJ_STRING) {
+    size = pv.Size();
+    if (size < kMinValueSize)
+      return false;
+  } else if (IsOffloadableContainer(pv.ObjType()) && offload_containers_) {
+    size = pv.MallocUsed();
+    if (size < kMinOccupancySize)
+      return false;
+  } else {
+    return false;
+  }
+
   const auto& disk_stats = op_manager_->GetStats().disk_stats;
-  return !pv.IsExternal() && !pv.HasStashPending() && pv.ObjType() == OBJ_STRING &&
-         pv.Size() >= kMinValueSize &&
-         disk_stats.allocated_bytes + tiering::kPageSize + pv.Size() < disk_stats.max_file_size;
+  return disk_stats.allocated_bytes + tiering::kPageSize + size < disk_stats.max_file_size;
 }
 
 void TieredStorage::CoolDown(DbIndex db_ind, std::string_view str,
-                             const tiering::DiskSegment& segment, PrimeValue* pv) {
+                             const tiering::DiskSegment& segment, optional<uint32_t> raw_len,
+                             PrimeValue* pv) {
   detail::TieredColdRecord* record = CompactObj::AllocateMR<detail::TieredColdRecord>();
   cool_queue_.push_front(*record);
   stats_.cool_memory_used += (sizeof(detail::TieredColdRecord) + pv->MallocUsed());
@@ -578,6 +963,8 @@ void TieredStorage::CoolDown(DbIndex db_ind, std::string_view str,
   record->value = std::move(*pv);
 
   pv->SetCool(segment.offset, segment.length, record);
+  if (raw_len)
+    pv->SetExternalCompressed(*raw_len);
   DCHECK_EQ(pv->Size(), record->value.Size());
 }
 
@@ -589,8 +976,6 @@ PrimeValue TieredStorage::Warmup(DbIndex dbid, PrimeValue::CoolItem item) {
   op_manager_->DeleteOffloaded(dbid, segment);
 
   // Bring it back to the PrimeTable.
-  DCHECK(hot.ObjType() == OBJ_STRING);
-
   return hot;
 }
 
@@ -5,6 +5,7 @@
 
 #include <boost/intrusive/list.hpp>
 #include <memory>
+#include <optional>
 #include <utility>
 
 #include "server/tiering/common.h"
@@ -20,6 +21,7 @@
 namespace dfly {
 
 class DbSlice;
+class FrequencySketch;
 
 namespace tiering {
 class SmallBins;
@@ -53,6 +55,28 @@ class TieredStorage {
   void Read(DbIndex dbid, std::string_view key, const PrimeValue& value,
             std::function<void(const std::string&)> readf);
 
+  // Read offloaded value without decoding containers: resolves with the string value or the
+  // container serialized with DumpObject, as it is stored on disk.
+  util::fb2::Future<std::string> ReadSerialized(DbIndex dbid, std::string_view key,
+                                                const PrimeValue& value);
+
+  // Read len bytes at offset of an offloaded string, within its Size(). Only the pages covering
+  // the range are fetched if the value is stored as is, otherwise the whole value is read.
+  void ReadRange(DbIndex dbid, std::string_view key, const PrimeValue& value, size_t offset,
+                 size_t len, std::function<void(std::string)> readf);
+
+  // Returns true if operations are pending for the offloaded value. Pending modifications might
+  // change it, so its Size() is only accurate if there are none.
+  bool HasPendingOps(const PrimeValue& value) const;
+
+  // Upload offloaded container back to memory. Blocks until it's done.
+  void FetchContainer(DbIndex dbid, std::string_view key, const PrimeValue& value);
+
+  // Reads issued between StartReadBatch and FlushReadBatch are submitted together on flush,
+  // so that values located on neighbouring pages are fetched with a single disk request.
+  void StartReadBatch();
+  void FlushReadBatch();
+
   // Apply modification to offloaded value, return generic result from callback.
   // Unlike immutable Reads - the modified value must be uploaded back to memory.
   // This is handled by OpManager when modf completes.
@@ -64,6 +88,12 @@ class TieredStorage {
   // Returns true if item was scheduled for stashing.
   bool TryStash(DbIndex dbid, std::string_view key, PrimeValue* value);
 
+  // Called by the snapshot loader before it inserts a value that should be stashed. Below the low
+  // memory watermark, blocks until the pending stashes release enough memory and leave room in
+  // the write queue, so that the value is stashed right away instead of the load outgrowing
+  // memory with values that wait for the disk.
+  void AwaitStashCapacity(const PrimeValue& value);
+
   // Delete value, must be offloaded (external type)
   void Delete(DbIndex dbid, PrimeValue* value);
 
@@ -73,11 +103,42 @@ class TieredStorage {
   // Percentage (0-1) of currently used storage_write_depth for ongoing stashes
   float WriteDepthUsage() const;
 
+  // Add the current WriteDepthUsage to its histogram, if histograms are collected.
+  void SampleWriteDepth();
+
   TieredStats GetStats() const;
 
+  // Returns null unless tiered_latency_histograms is set.
+  const tiering::Histograms* GetHistograms() const;
+
+  // Record key lookup for the access frequency estimate that keeps hot entries in memory.
+  void RecordAccess(std::string_view key);
+
+  // Returns true if a snapshot can save a reference to the offloaded value instead of its contents,
+  // because the backing files are preserved for the restart (tiered_warm_restart).
+  bool CanReference(const PrimeValue& pv) const;
+
+  // Called before snapshot references are saved: segments are no longer freed and reused
+  // afterwards, so that the referenced contents stay valid.
+  void PreserveSegments();
+
+  // Register an offloaded value loaded from a reference into the preserved backing files.
+  // Returns false if the segment can't be restored, e.g. because the files were not preserved.
+  bool Restore(DbIndex dbid, const PrimeValue& pv);
+
+  // Make the space of the preserved backing files that no restored value references available.
+  void FinishRestore();
+
   // Run offloading loop until i/o device is loaded or all entries were traversed
   void RunOffloading(DbIndex dbid);
 
+  // Run a step of backing file compaction: if the file is fragmented, relocate entries of its
+  // sparsest page back to memory, so that the page is released once empty.
+  void RunCompaction();
+
+  // Stash small bins that were not filled in time, see tiered_small_bins_flush_ms.
+  void FlushStaleBins();
+
   // Prune cool entries to reach the set memory goal with freed memory
   size_t ReclaimMemory(size_t goal);
 
@@ -92,27 +153,48 @@ class TieredStorage {
   // Returns if a value should be stashed
   bool ShouldStash(const PrimeValue& pv) const;
 
+  // Returns true if the key is accessed too often to be offloaded
+  bool IsHot(std::string_view key) const;
+
+  // Returns the remaining time to live of the entry, 0 if it does not expire.
+  uint64_t TimeToLive(DbIndex dbid, std::string_view key, const PrimeValue& value) const;
+
+  // Serializes the container and stashes it on its own pages
+  bool TryStashContainer(DbIndex dbid, std::string_view key, PrimeValue* value);
+
   // Moves pv contents to the cool storage and updates pv to point to it.
   void CoolDown(DbIndex db_ind, std::string_view str, const tiering::DiskSegment& segment,
-                PrimeValue* pv);
+                std::optional<uint32_t> raw_len, PrimeValue* pv);
 
   PrimeValue DeleteCool(detail::TieredColdRecord* record);
   detail::TieredColdRecord* PopCool();
 
   PrimeTable::Cursor offloading_cursor_{};  // where RunOffloading left off
 
+  std::optional<tiering::DiskSegment> evacuating_;  // page that RunCompaction empties
+  DbIndex compaction_db_ = 0;
+  PrimeTable::Cursor compaction_cursor_{};
+
   std::unique_ptr<ShardOpManager> op_manager_;
   std::unique_ptr<tiering::SmallBins> bins_;
+  std::unique_ptr<FrequencySketch> hotness_;  // null if hot entries are not detected
   typedef ::boost::intrusive::list<detail::TieredColdRecord> CoolQueue;
 
   CoolQueue cool_queue_;
 
   unsigned write_depth_limit_ = 10;
+  bool offload_containers_ = false;
+  float compaction_threshold_ = 0;
+  unsigned hot_threshold_ = 0;
+  bool warm_restart_ = false;
+  uint32_t bins_flush_ms_ = 0;
   struct {
     uint64_t stash_overflow_cnt = 0;
     uint64_t total_deletes = 0;
     uint64_t offloading_steps = 0;
     uint64_t offloading_stashes = 0;
+    uint64_t hot_skips = 0;
+    uint64_t evacuations = 0;
     size_t cool_memory_used = 0;
   } stats_;
 };
@@ -157,6 +239,28 @@ class TieredStorage {
             std::function<void(const std::string&)> readf) {
   }
 
+  util::fb2::Future<std::string> ReadSerialized(DbIndex dbid, std::string_view key,
+                                                const PrimeValue& value) {
+    return {};
+  }
+
+  void ReadRange(DbIndex dbid, std::string_view key, const PrimeValue& value, size_t offset,
+                 size_t len, std::function<void(std::string)> readf) {
+  }
+
+  bool HasPendingOps(const PrimeValue& value) const {
+    return false;
+  }
+
+  void FetchContainer(DbIndex dbid, std::string_view key, const PrimeValue& value) {
+  }
+
+  void StartReadBatch() {
+  }
+
+  void FlushReadBatch() {
+  }
+
   template <typename T>
   util::fb2::Future<T> Modify(DbIndex dbid, std::string_view key, const PrimeValue& value,
                               std::function<T(std::string*)> modf) {
@@ -166,6 +270,9 @@ class TieredStorage {
   void TryStash(DbIndex dbid, std::string_view key, PrimeValue* value) {
   }
 
+  void AwaitStashCapacity(const PrimeValue& value) {
+  }
+
   void Delete(DbIndex dbid, PrimeValue* value) {
   }
 
@@ -177,6 +284,13 @@ class TieredStorage {
     return 0;
   }
 
+  void SampleWriteDepth() {
+  }
+
+  const tiering::Histograms* GetHistograms() const {
+    return nullptr;
+  }
+
   size_t CoolMemoryUsage() const {
     return 0;
   }
@@ -192,9 +306,32 @@ class TieredStorage {
     return {};
   }
 
+  void RecordAccess(std::string_view key) {
+  }
+
+  bool CanReference(const PrimeValue& pv) const {
+    return false;
+  }
+
+  void PreserveSegments() {
+  }
+
+  bool Restore(DbIndex dbid, const PrimeValue& pv) {
+    return false;
+  }
+
+  void FinishRestore() {
+  }
+
   void RunOffloading(DbIndex dbid) {
   }
 
+  void RunCompaction() {
+  }
+
+  void FlushStaleBins() {
+  }
+
   PrimeValue Warmup(DbIndex dbid, PrimeValue::CoolItem item) {
     return PrimeValue{};
   }
@@ -27,6 +27,9 @@ ABSL_DECLARE_FLAG(string, tiered_prefix);
 ABSL_DECLARE_FLAG(float, tiered_offload_threshold);
 ABSL_DECLARE_FLAG(unsigned, tiered_storage_write_depth);
 ABSL_DECLARE_FLAG(bool, tiered_experimental_cooling);
+ABSL_DECLARE_FLAG(bool, tiered_offload_containers);
+ABSL_DECLARE_FLAG(unsigned, tiered_offload_hot_threshold);
+ABSL_DECLARE_FLAG(bool, tiered_latency_histograms);
 
 namespace dfly {
 
@@ -145,6 +148,35 @@ TEST_F(TieredStorageTest, Ranges) {
   EXPECT_EQ(resp, string(500, 'c') + string(500, 'd'));
 }
 
+// Ranges of large values are read from the pages that cover them, without uploading the values.
+TEST_F(TieredStorageTest, PartialRanges) {
+  string ascii, binary;
+  for (size_t i = 0; i < 100'003; i++) {
+    ascii.push_back('a' + i % 26);
+    binary.push_back(char(128 + i % 100));
+  }
+  Run({"SET", "ascii", ascii});
+  Run({"SET", "binary", binary});
+  ExpectConditionWithinTimeout([this] { return GetMetrics().tiered_stats.total_stashes >= 2; });
+
+  EXPECT_THAT(Run({"STRLEN", "ascii"}), IntArg(ascii.size()));
+  for (string_view key : {"ascii", "binary"}) {
+    const string& value = key == "ascii" ? ascii : binary;
+    EXPECT_EQ(Run({"GETRANGE", key, "0", "99"}), value.substr(0, 100));
+    EXPECT_EQ(Run({"GETRANGE", key, "50001", "60006"}), value.substr(50'001, 10'006));
+    EXPECT_EQ(Run({"GETRANGE", key, "-3", "-1"}), value.substr(value.size() - 3));
+  }
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(metrics.tiered_stats.total_range_reads, 6u);
+  EXPECT_EQ(metrics.tiered_stats.total_fetches, 0u);
+  EXPECT_EQ(metrics.db_stats[0].tiered_entries, 2);
+
+  // Appending uploads the value, the range is then read from memory.
+  Run({"APPEND", "ascii", "tail"});
+  EXPECT_EQ(Run({"GETRANGE", "ascii", "-4", "-1"}), "tail");
+}
+
 TEST_F(TieredStorageTest, MultiDb) {
   for (size_t i = 0; i < 10; i++) {
     Run({"SELECT", absl::StrCat(i)});
@@ -247,6 +279,87 @@ TEST_F(TieredStorageTest, BackgroundOffloading) {
   EXPECT_EQ(metrics.tiered_stats.allocated_bytes, kNum * 4096);
 }
 
+TEST_F(TieredStorageTest, OffloadContainers) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+  SetFlag(&FLAGS_tiered_offload_containers, true);
+  ResetService();
+
+  const int kNum = 50;
+  string value = BuildString(64);
+  for (size_t i = 0; i < kNum; i++) {
+    string key = absl::StrCat("k", i);
+    for (size_t j = 0; j < 100; j++) {
+      Run({"HSET", absl::StrCat("h", key), absl::StrCat("f", j), value});
+      Run({"SADD", absl::StrCat("s", key), absl::StrCat(value, j)});
+      Run({"RPUSH", absl::StrCat("l", key), value});
+    }
+  }
+
+  ExpectConditionWithinTimeout(
+      [&] { return GetMetrics().db_stats[0].tiered_entries == kNum * 3; });
+
+  for (size_t i = 0; i < kNum; i++) {
+    string key = absl::StrCat("k", i);
+    EXPECT_EQ(Run({"HGET", absl::StrCat("h", key), "f42"}), value);
+    EXPECT_THAT(Run({"SCARD", absl::StrCat("s", key)}), IntArg(100));
+    EXPECT_THAT(Run({"LLEN", absl::StrCat("l", key)}), IntArg(100));
+    EXPECT_EQ(Run({"TYPE", absl::StrCat("h", key)}), "hash");
+  }
+
+  // Background offloading may stash uploaded containers again, so they can be fetched twice.
+  EXPECT_GE(GetMetrics().tiered_stats.total_uploads, kNum * 3);
+}
+
+TEST_F(TieredStorageTest, HotEntriesStayInMemory) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+  SetFlag(&FLAGS_tiered_offload_hot_threshold, 3u);
+  ResetService();
+
+  const int kNum = 10;
+  for (size_t i = 0; i < kNum; i++)
+    Run({"SET", absl::StrCat("k", i), BuildString(3000)});
+  Run({"SET", "hot", BuildString(3000)});
+  ExpectConditionWithinTimeout(
+      [&] { return GetMetrics().db_stats[0].tiered_entries == kNum + 1; });
+
+  // Reading the value uploads it and makes it hot, so it's not offloaded again
+  for (size_t i = 0; i < 5; i++)
+    EXPECT_EQ(Run({"GET", "hot"}), BuildString(3000));
+  ExpectConditionWithinTimeout([&] { return GetMetrics().tiered_stats.total_hot_skips > 0; });
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(metrics.db_stats[0].tiered_entries, kNum);
+  EXPECT_EQ(metrics.tiered_stats.total_uploads, 1u);
+}
+
+TEST_F(TieredStorageTest, LatencyHistograms) {
+  EXPECT_FALSE(GetMetrics().tiered_histograms);
+
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_latency_histograms, true);
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);  // reads must go to disk
+  ResetService();
+
+  const int kNum = 10;
+  for (size_t i = 0; i < kNum; i++)
+    Run({"SET", absl::StrCat("k", i), BuildString(3000)});
+  ExpectConditionWithinTimeout([&] { return GetMetrics().tiered_stats.total_stashes == kNum; });
+  for (size_t i = 0; i < kNum; i++)
+    EXPECT_EQ(Run({"GET", absl::StrCat("k", i)}), BuildString(3000));
+
+  auto metrics = GetMetrics();
+  ASSERT_TRUE(metrics.tiered_histograms);
+  EXPECT_EQ(metrics.tiered_histograms->stash_usec.count(), kNum);
+  EXPECT_EQ(metrics.tiered_histograms->read_usec.count(), kNum);
+
+  auto resp = Run({"INFO", "TIERED"});
+  EXPECT_THAT(resp.GetString(), HasSubstr("tiered_stash_latency_usec_p99:"));
+}
+
 TEST_F(TieredStorageTest, FlushAll) {
   absl::FlagSaver saver;
   SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
@@ -317,4 +430,31 @@ TEST_F(TieredStorageTest, MemoryPressure) {
   EXPECT_LT(used_mem_peak.load(), 20_MB);
 }
 
+TEST_F(TieredStorageTest, LoadUnderMemoryPressure) {
+  absl::FlagSaver saver;
+  SetFlag(&FLAGS_tiered_offload_threshold, 0.0f);  // offload all values
+  SetFlag(&FLAGS_tiered_experimental_cooling, false);
+
+  max_memory_limit = 20_MB;
+  pp_->at(0)->AwaitBrief(
+      [] { EngineShard::tlocal()->tiered_storage()->SetMemoryLowWatermark(2_MB); });
+
+  // The dataset is twice as large as the memory, so the load must stash values as it goes.
+  constexpr size_t kNum = 4000;
+  string value = BuildString(10000);
+  for (size_t i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("k", i), value});
+    ThisFiber::SleepFor(500us);
+  }
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries == kNum; });
+
+  used_mem_peak.store(0);
+  EXPECT_EQ(Run({"DEBUG", "RELOAD"}), "OK");
+
+  EXPECT_EQ(CheckedInt({"DBSIZE"}), kNum);
+  EXPECT_EQ(Run({"GET", "k0"}), value);
+  EXPECT_EQ(Run({"GET", absl::StrCat("k", kNum - 1)}), value);
+  EXPECT_LT(used_mem_peak.load(), 20_MB);
+}
+
 }  // namespace dfly
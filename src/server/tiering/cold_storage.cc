@@ -0,0 +1,224 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tiering/cold_storage.h"
+
+#include <absl/strings/str_cat.h>
+
+#ifdef WITH_AWS
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
+#include <aws/s3/S3Client.h>
+#include <aws/s3/model/DeleteObjectRequest.h>
+#include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/PutObjectRequest.h>
+#endif
+
+#include "base/logging.h"
+#include "util/fibers/fibers.h"
+
+namespace dfly::tiering {
+
+using namespace std;
+
+#ifdef WITH_AWS
+namespace {
+
+class S3ObjectStore : public ObjectStore {
+ public:
+  S3ObjectStore(shared_ptr<Aws::S3::S3Client> client, string bucket, string prefix)
+      : client_(std::move(client)), bucket_(std::move(bucket)), prefix_(std::move(prefix)) {
+  }
+
+  void Put(const string& name, string_view body, PutCb cb) override;
+  void GetRange(const string& name, size_t offset, size_t len, GetCb cb) override;
+  void Delete(const string& name) override;
+
+ private:
+  shared_ptr<Aws::S3::S3Client> client_;
+  string bucket_, prefix_;
+};
+
+void S3ObjectStore::Put(const string& name, string_view body, PutCb cb) {
+  util::fb2::Fiber("s3_cold_put", [client = client_, bucket = bucket_, key = prefix_ + name, body,
+                                   cb = std::move(cb)] {
+    Aws::Utils::Stream::PreallocatedStreamBuf buf(
+        reinterpret_cast<unsigned char*>(const_cast<char*>(body.data())), body.size());
+    Aws::S3::Model::PutObjectRequest request;
+    request.SetBucket(bucket);
+    request.SetKey(key);
+    request.SetContentLength(body.size());
+    request.SetBody(std::make_shared<Aws::IOStream>(&buf));
+
+    Aws::S3::Model::PutObjectOutcome outcome = client->PutObject(request);
+    if (!outcome.IsSuccess()) {
+      LOG(ERROR) << "Failed to upload " << bucket << "/" << key << ": "
+                 << outcome.GetError().GetExceptionName() << ": "
+                 << outcome.GetError().GetMessage();
+      cb(make_error_code(errc::io_error));
+      return;
+    }
+    cb({});
+  }).Detach();
+}
+
+void S3ObjectStore::GetRange(const string& name, size_t offset, size_t len, GetCb cb) {
+  util::fb2::Fiber("s3_cold_get", [client = client_, bucket = bucket_, key = prefix_ + name,
+                                   offset, len, cb = std::move(cb)] {
+    Aws::S3::Model::GetObjectRequest request;
+    request.SetBucket(bucket);
+    request.SetKey(key);
+    request.SetRange(absl::StrCat("bytes=", offset, "-", offset + len - 1));
+
+    Aws::S3::Model::GetObjectOutcome outcome = client->GetObject(request);
+    if (!outcome.IsSuccess()) {
+      LOG(ERROR) << "Failed to read " << bucket << "/" << key << " at " << offset << ": "
+                 << outcome.GetError().GetExceptionName() << ": "
+                 << outcome.GetError().GetMessage();
+      cb(nonstd::make_unexpected(make_error_code(errc::io_error)));
+      return;
+    }
+
+    string value(len, '\0');
+    std::istream& body = outcome.GetResult().GetBody();
+    body.read(value.data(), len);
+    if (size_t(body.gcount()) != len) {
+      LOG(ERROR) << "Short read of " << bucket << "/" << key << " at " << offset;
+      cb(nonstd::make_unexpected(make_error_code(errc::io_error)));
+      return;
+    }
+    cb(std::move(value));
+  }).Detach();
+}
+
+void S3ObjectStore::Delete(const string& name) {
+  util::fb2::Fiber("s3_cold_delete",
+                   [client = client_, bucket = bucket_, key = prefix_ + name] {
+                     Aws::S3::Model::DeleteObjectRequest request;
+                     request.SetBucket(bucket);
+                     request.SetKey(key);
+                     Aws::S3::Model::DeleteObjectOutcome outcome = client->DeleteObject(request);
+                     if (!outcome.IsSuccess()) {
+                       LOG(WARNING) << "Failed to delete " << bucket << "/" << key << ": "
+                                    << outcome.GetError().GetMessage();
+                     }
+                   })
+      .Detach();
+}
+
+}  // namespace
+
+unique_ptr<ObjectStore> MakeS3ObjectStore(shared_ptr<Aws::S3::S3Client> client, string bucket,
+                                          string prefix) {
+  return make_unique<S3ObjectStore>(std::move(client), std::move(bucket), std::move(prefix));
+}
+#endif
+
+ColdStorage::ColdStorage(ObjectStore* store, string name_prefix, size_t object_size)
+    : store_(store), name_prefix_(std::move(name_prefix)), object_size_(object_size) {
+}
+
+void ColdStorage::Close() {
+  using namespace chrono_literals;
+
+  Flush();
+  while (pending_ops_ > 0)
+    util::ThisFiber::SleepFor(10ms);
+}
+
+void ColdStorage::Stash(io::Bytes bytes, StashCb cb) {
+  DCHECK(!bytes.empty());
+
+  // Values larger than the object size get an object of their own.
+  if (filling_ && filling_->body.size() + bytes.size() > object_size_)
+    Flush();
+
+  if (!filling_) {
+    filling_ = make_unique<Upload>();
+    filling_->id = next_id_++;
+    filling_->body.reserve(object_size_);
+  }
+
+  ColdSegment segment{filling_->id, filling_->body.size(), bytes.size()};
+  filling_->body.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  filling_->waiters.emplace_back(segment, std::move(cb));
+
+  if (filling_->body.size() >= object_size_)
+    Flush();
+}
+
+void ColdStorage::Flush() {
+  if (!filling_)
+    return;
+
+  // The callback owns the upload, which keeps the body alive until the store is done with it.
+  Upload* upload = filling_.release();
+  pending_ops_++;
+  store_->Put(ObjectName(upload->id), upload->body, [this, upload](error_code ec) {
+    pending_ops_--;
+    FinishUpload(unique_ptr<Upload>{upload}, ec);
+  });
+}
+
+void ColdStorage::FinishUpload(unique_ptr<Upload> upload, error_code ec) {
+  if (ec) {
+    for (auto& [segment, cb] : upload->waiters)
+      cb(nonstd::make_unexpected(ec));
+    return;
+  }
+
+  size_t size = upload->body.size();
+  objects_[upload->id] = Object{size, size};
+  upload->body = {};
+
+  // Callbacks may delete their segments right away, which is safe since the object is indexed.
+  for (auto& [segment, cb] : upload->waiters)
+    cb(segment);
+}
+
+void ColdStorage::Read(ColdSegment segment, ReadCb cb) {
+  DCHECK_GT(segment.length, 0u);
+  DCHECK(objects_.contains(segment.object_id)) << segment.object_id;
+
+  pending_ops_++;
+  store_->GetRange(ObjectName(segment.object_id), segment.offset, segment.length,
+                   [this, cb = std::move(cb)](io::Result<string> res) {
+                     pending_ops_--;
+                     cb(std::move(res));
+                   });
+}
+
+void ColdStorage::Delete(ColdSegment segment) {
+  auto it = objects_.find(segment.object_id);
+  DCHECK(it != objects_.end()) << segment.object_id;
+  if (it == objects_.end())
+    return;
+
+  DCHECK_LE(segment.length, it->second.live_bytes);
+  it->second.live_bytes -= segment.length;
+  if (it->second.live_bytes > 0)
+    return;
+
+  store_->Delete(ObjectName(segment.object_id));
+  objects_.erase(it);
+  deleted_objects_++;
+}
+
+ColdStorage::Stats ColdStorage::GetStats() const {
+  Stats stats;
+  stats.objects = objects_.size();
+  for (const auto& [id, object] : objects_) {
+    stats.object_bytes += object.size;
+    stats.live_bytes += object.live_bytes;
+  }
+  stats.filling_bytes = filling_ ? filling_->body.size() : 0;
+  stats.pending_ops = pending_ops_;
+  stats.deleted_objects = deleted_objects_;
+  return stats;
+}
+
+string ColdStorage::ObjectName(uint64_t id) const {
+  return absl::StrCat(name_prefix_, absl::Hex(id, absl::kZeroPad16));
+}
+
+}  // namespace dfly::tiering
@@ -0,0 +1,130 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "io/io.h"
+#include "server/tiering/common.h"
+
+#ifdef WITH_AWS
+namespace Aws::S3 {
+class S3Client;
+}  // namespace Aws::S3
+#endif
+
+namespace dfly::tiering {
+
+// Asynchronous access to an object store. Callbacks are called on the thread that issued the
+// request.
+class ObjectStore {
+ public:
+  using PutCb = std::function<void(std::error_code)>;
+  using GetCb = std::function<void(io::Result<std::string>)>;
+
+  virtual ~ObjectStore() = default;
+
+  // Uploads body as the object name. body must stay valid until cb is called.
+  virtual void Put(const std::string& name, std::string_view body, PutCb cb) = 0;
+
+  // Reads [offset, offset + len) of the object name.
+  virtual void GetRange(const std::string& name, size_t offset, size_t len, GetCb cb) = 0;
+
+  // Deletes the object name in the background, failures are only logged.
+  virtual void Delete(const std::string& name) = 0;
+};
+
+#ifdef WITH_AWS
+// Object store on top of an s3 bucket, with the objects named prefix + name. Every request runs
+// in its own fiber.
+std::unique_ptr<ObjectStore> MakeS3ObjectStore(std::shared_ptr<Aws::S3::S3Client> client,
+                                               std::string bucket, std::string prefix);
+#endif
+
+// Location of a value within the objects of ColdStorage.
+struct ColdSegment {
+  uint64_t object_id = 0;
+  size_t offset = 0, length = 0;
+};
+
+// Cold tier that keeps values in an object store. Object stores charge per request and have a
+// high latency per request, so values are packed into large objects that are uploaded with a
+// single request and read back with ranged gets of a single value. The index of the objects and
+// their live bytes is kept locally, an object is deleted once all of its values are deleted.
+class ColdStorage {
+ public:
+  static constexpr size_t kDefaultObjectSize = 8_MB;
+
+  struct Stats {
+    size_t objects = 0;            // uploaded objects
+    size_t object_bytes = 0;       // total size of the uploaded objects
+    size_t live_bytes = 0;         // bytes of the values that were not deleted
+    size_t filling_bytes = 0;      // bytes of the object that is not uploaded yet
+    size_t pending_ops = 0;        // uploads and reads in flight
+    uint64_t deleted_objects = 0;  // objects deleted after all their values were deleted
+  };
+
+  using ReadCb = std::function<void(io::Result<std::string>)>;
+  using StashCb = std::function<void(io::Result<ColdSegment>)>;
+
+  ColdStorage(ObjectStore* store, std::string name_prefix,
+              size_t object_size = kDefaultObjectSize);
+
+  // Flushes the filling object and waits for the pending operations to finish.
+  void Close();
+
+  // Appends bytes to the filling object, which is uploaded once it reaches the object size.
+  // cb is called with the segment of the value after the upload finished, so the caller must
+  // keep the value until then. Bytes are copied and can be dropped right away.
+  void Stash(io::Bytes bytes, StashCb cb);
+
+  // Uploads the filling object even if it did not reach the object size.
+  void Flush();
+
+  // Reads the segment with a ranged get of its object.
+  void Read(ColdSegment segment, ReadCb cb);
+
+  // Marks the segment as deleted. The object is deleted from the store when it has no live bytes.
+  void Delete(ColdSegment segment);
+
+  Stats GetStats() const;
+
+ private:
+  struct Object {
+    size_t size = 0;
+    size_t live_bytes = 0;
+  };
+
+  // Filled object waiting for its upload to finish.
+  struct Upload {
+    uint64_t id = 0;
+    std::string body;
+    std::vector<std::pair<ColdSegment, StashCb>> waiters;
+  };
+
+  std::string ObjectName(uint64_t id) const;
+
+  void FinishUpload(std::unique_ptr<Upload> upload, std::error_code ec);
+
+  ObjectStore* store_;
+  std::string name_prefix_;
+  size_t object_size_;
+
+  uint64_t next_id_ = 1;
+  std::unique_ptr<Upload> filling_;
+  size_t pending_ops_ = 0;
+  uint64_t deleted_objects_ = 0;
+
+  absl::flat_hash_map<uint64_t, Object> objects_;
+};
+
+}  // namespace dfly::tiering
@@ -0,0 +1,182 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tiering/cold_storage.h"
+
+#include <absl/strings/str_cat.h>
+
+#include <deque>
+#include <map>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly::tiering {
+
+using namespace std;
+
+// In-memory object store that runs the requests only when the test completes them.
+class FakeObjectStore : public ObjectStore {
+ public:
+  void Put(const string& name, string_view body, PutCb cb) override {
+    puts++;
+    pending_.push_back([this, name, body, cb = std::move(cb)] {
+      if (fail_puts) {
+        cb(make_error_code(errc::io_error));
+        return;
+      }
+      objects[name] = string{body};
+      cb({});
+    });
+  }
+
+  void GetRange(const string& name, size_t offset, size_t len, GetCb cb) override {
+    pending_.push_back([this, name, offset, len, cb = std::move(cb)] {
+      auto it = objects.find(name);
+      if (it == objects.end() || offset + len > it->second.size()) {
+        cb(nonstd::make_unexpected(make_error_code(errc::io_error)));
+        return;
+      }
+      cb(it->second.substr(offset, len));
+    });
+  }
+
+  void Delete(const string& name) override {
+    objects.erase(name);
+  }
+
+  void RunPending() {
+    while (!pending_.empty()) {
+      auto op = std::move(pending_.front());
+      pending_.pop_front();
+      op();
+    }
+  }
+
+  map<string, string> objects;
+  unsigned puts = 0;
+  bool fail_puts = false;
+
+ private:
+  deque<function<void()>> pending_;
+};
+
+class ColdStorageTest : public ::testing::Test {
+ protected:
+  // Stashes value and waits for its upload.
+  ColdSegment Stash(string_view value) {
+    ColdSegment res;
+    storage_.Stash(io::Buffer(value), [&res](io::Result<ColdSegment> segment) {
+      ASSERT_TRUE(segment.has_value());
+      res = *segment;
+    });
+    storage_.Flush();
+    store_.RunPending();
+    return res;
+  }
+
+  string Read(ColdSegment segment) {
+    string res;
+    storage_.Read(segment, [&res](io::Result<string> value) {
+      ASSERT_TRUE(value.has_value());
+      res = std::move(*value);
+    });
+    store_.RunPending();
+    return res;
+  }
+
+  FakeObjectStore store_;
+  ColdStorage storage_{&store_, "cold/", 1_KB};
+};
+
+TEST_F(ColdStorageTest, StashReadDelete) {
+  vector<ColdSegment> segments;
+  for (unsigned i = 0; i < 100; ++i) {
+    storage_.Stash(io::Buffer(absl::StrCat("value:", i)), [&](io::Result<ColdSegment> segment) {
+      ASSERT_TRUE(segment.has_value());
+      segments.push_back(*segment);
+    });
+  }
+
+  // Nothing is known before the uploads finish.
+  EXPECT_TRUE(segments.empty());
+  EXPECT_GT(storage_.GetStats().filling_bytes, 0u);
+  storage_.Flush();
+  EXPECT_EQ(storage_.GetStats().pending_ops, 1u);
+  store_.RunPending();
+
+  // The values are packed into objects of about 1KB.
+  ASSERT_EQ(segments.size(), 100u);
+  EXPECT_EQ(store_.puts, 1u);
+  EXPECT_EQ(store_.objects.size(), 1u);
+
+  for (unsigned i = 0; i < 100; ++i)
+    EXPECT_EQ(Read(segments[i]), absl::StrCat("value:", i));
+
+  auto stats = storage_.GetStats();
+  EXPECT_EQ(stats.objects, 1u);
+  EXPECT_EQ(stats.live_bytes, stats.object_bytes);
+  EXPECT_EQ(stats.pending_ops, 0u);
+
+  // The object is deleted with its last value.
+  for (unsigned i = 0; i < 99; ++i)
+    storage_.Delete(segments[i]);
+  EXPECT_EQ(store_.objects.size(), 1u);
+  EXPECT_EQ(storage_.GetStats().live_bytes, segments[99].length);
+  EXPECT_EQ(Read(segments[99]), "value:99");
+
+  storage_.Delete(segments[99]);
+  EXPECT_TRUE(store_.objects.empty());
+  EXPECT_EQ(storage_.GetStats().objects, 0u);
+  EXPECT_EQ(storage_.GetStats().deleted_objects, 1u);
+}
+
+TEST_F(ColdStorageTest, ObjectSize) {
+  string value(300, 'a');
+  vector<ColdSegment> segments;
+  for (unsigned i = 0; i < 10; ++i) {
+    value[0] = 'a' + i;
+    storage_.Stash(io::Buffer(value), [&](io::Result<ColdSegment> segment) {
+      segments.push_back(*segment);
+    });
+  }
+
+  // Three values fit into an object, the tenth one is still filling.
+  EXPECT_EQ(store_.puts, 3u);
+  EXPECT_EQ(storage_.GetStats().filling_bytes, 300u);
+  store_.RunPending();
+  EXPECT_EQ(segments.size(), 9u);
+
+  // A value larger than the object size flushes the filling object and gets an object of its
+  // own.
+  ColdSegment large = Stash(string(3_KB, 'x'));
+  EXPECT_EQ(store_.puts, 5u);
+  EXPECT_EQ(large.offset, 0u);
+  EXPECT_EQ(Read(large), string(3_KB, 'x'));
+
+  ASSERT_EQ(segments.size(), 10u);
+  for (unsigned i = 0; i < 10; ++i) {
+    value[0] = 'a' + i;
+    EXPECT_EQ(Read(segments[i]), value);
+  }
+  storage_.Close();
+}
+
+TEST_F(ColdStorageTest, FailedUpload) {
+  store_.fail_puts = true;
+  unsigned errors = 0;
+  for (unsigned i = 0; i < 3; ++i) {
+    storage_.Stash(io::Buffer("value"), [&errors](io::Result<ColdSegment> segment) {
+      errors += !segment.has_value();
+    });
+  }
+  storage_.Flush();
+  store_.RunPending();
+
+  EXPECT_EQ(errors, 3u);
+  EXPECT_EQ(storage_.GetStats().objects, 0u);
+  EXPECT_EQ(storage_.GetStats().pending_ops, 0u);
+}
+
+}  // namespace dfly::tiering
@@ -7,6 +7,7 @@
 #include <memory>
 #include <optional>
 
+#include "base/histogram.h"
 #include "util/fibers/synchronization.h"
 
 namespace dfly::tiering {
@@ -25,6 +26,9 @@ constexpr inline unsigned long long operator""_KB(unsigned long long x) {
 
 constexpr size_t kPageSize = 4_KB;
 
+// DiskStorage can be striped across up to this many backing files, ideally on different devices.
+constexpr unsigned kMaxBackingFiles = 8;
+
 // Location on the offloaded blob, measured in bytes
 struct DiskSegment {
   DiskSegment ContainingPages() const {
@@ -44,4 +48,21 @@ struct DiskSegment {
   size_t offset = 0, length = 0;
 };
 
+// Latency distributions of tiering operations, only collected if tiered_latency_histograms is set.
+struct Histograms {
+  base::Histogram stash_usec;       // from stash request until the write completes
+  base::Histogram read_usec;        // from disk read submission until it completes
+  base::Histogram read_queue_usec;  // time reads are deferred by a read batch before submission
+  base::Histogram bin_dwell_ms;     // time small values wait in their bin until it's flushed
+  base::Histogram write_depth;      // WriteDepthUsage in percent, sampled on every heartbeat
+
+  void Merge(const Histograms& o) {
+    stash_usec.Merge(o.stash_usec);
+    read_usec.Merge(o.read_usec);
+    read_queue_usec.Merge(o.read_queue_usec);
+    bin_dwell_ms.Merge(o.bin_dwell_ms);
+    write_depth.Merge(o.write_depth);
+  }
+};
+
 };  // namespace dfly::tiering
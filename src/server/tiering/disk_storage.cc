@@ -4,6 +4,11 @@
 
 #include "server/tiering/disk_storage.h"
 
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <system_error>
 
 #include "base/flags.h"
@@ -21,6 +26,9 @@ ABSL_FLAG(bool, backing_file_direct, true, "If true uses O_DIRECT to open backin
 ABSL_FLAG(uint64_t, registered_buffer_size, 512_KB,
           "Size of registered buffer for IoUring fixed read/writes");
 
+ABSL_FLAG(bool, backing_file_registered, false,
+          "If true, registers backing files with IoUring and submits disk io with fixed files");
+
 namespace dfly::tiering {
 
 using namespace std;
@@ -53,6 +61,12 @@ void ReturnBuf(UringBuf buf) {
 
 constexpr off_t kInitialSize = 1UL << 28;  // 256MB
 
+// Rounds size up, so that it's distributed evenly across stripes of all files.
+size_t StripeAligned(size_t size, size_t files) {
+  size_t unit = DiskStorage::kStripeSize * files;
+  return (size + unit - 1) / unit * unit;
+}
+
 template <typename... Ts> error_code DoFiberCall(void (SubmitEntry::*c)(Ts...), Ts... args) {
   auto* proactor = static_cast<UringProactor*>(ProactorBase::me());
   FiberCall fc(proactor);
@@ -66,26 +80,70 @@ template <typename... Ts> error_code DoFiberCall(void (SubmitEntry::*c)(Ts...),
 DiskStorage::DiskStorage(size_t max_size) : max_size_(max_size) {
 }
 
-error_code DiskStorage::Open(string_view path) {
+error_code DiskStorage::Open(const vector<string>& paths, bool restore) {
   DCHECK_EQ(ProactorBase::me()->GetKind(), ProactorBase::IOURING);
-  CHECK(!backing_file_);
+  CHECK(backing_files_.empty());
+  CHECK(!paths.empty() && paths.size() <= kMaxBackingFiles) << paths.size();
 
-  int kFlags = O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC;
+  int kFlags = O_CREAT | O_RDWR | O_CLOEXEC;
+  if (!restore)
+    kFlags |= O_TRUNC;
   if (absl::GetFlag(FLAGS_backing_file_direct))
     kFlags |= O_DIRECT;
 
-  auto res = OpenLinux(path, kFlags, 0666);
-  if (!res)
-    return res.error();
-  backing_file_ = std::move(res.value());
+  size_t initial_size = StripeAligned(kInitialSize, paths.size());
+  vector<off_t> existing_sizes;
+  for (const string& path : paths) {
+    auto res = OpenLinux(path, kFlags, 0666);
+    if (!res)
+      return res.error();
+    backing_files_.push_back(std::move(res.value()));
+
+    int fd = backing_files_.back()->fd();
+    if (restore) {
+      struct stat st;
+      if (fstat(fd, &st) < 0)
+        return error_code{errno, system_category()};
+      existing_sizes.push_back(st.st_size);
+    }
 
-  int fd = backing_file_->fd();
-  RETURN_ON_ERR(DoFiberCall(&SubmitEntry::PrepFallocate, fd, 0, 0L, kInitialSize));
-  RETURN_ON_ERR(DoFiberCall(&SubmitEntry::PrepFadvise, fd, 0L, 0L, POSIX_FADV_RANDOM));
+    off_t file_size = initial_size / paths.size();
+    RETURN_ON_ERR(DoFiberCall(&SubmitEntry::PrepFallocate, fd, 0, 0L, file_size));
+    RETURN_ON_ERR(DoFiberCall(&SubmitEntry::PrepFadvise, fd, 0L, 0L, POSIX_FADV_RANDOM));
+  }
+
+  // Stripes are mapped to the files in round-robin order, so the previous layout can only be
+  // recovered if all files have the same number of stripes.
+  size_t restored_size = 0;
+  if (!existing_sizes.empty()) {
+    off_t size = existing_sizes.front();
+    bool aligned = size % kStripeSize == 0 &&
+                   all_of(existing_sizes.begin(), existing_sizes.end(),
+                          [size](off_t s) { return s == size; });
+    if (aligned)
+      restored_size = size * paths.size();
+    else
+      LOG(WARNING) << "Backing files have different sizes, their contents won't be restored";
+  }
 
-  alloc_.AddStorage(0, kInitialSize);
+  if (restored_size > 0)
+    alloc_.StartRestore(restored_size);
+  if (initial_size > restored_size)
+    alloc_.AddStorage(restored_size, initial_size - restored_size);
 
   auto* up = static_cast<UringProactor*>(ProactorBase::me());
+  if (absl::GetFlag(FLAGS_backing_file_registered)) {
+    for (const auto& file : backing_files_) {
+      int fixed_fd = up->RegisterFd(file->fd());
+      if (fixed_fd < 0) {
+        LOG(WARNING) << "Could not register backing file, falling back to regular io";
+        UnregisterFiles();
+        break;
+      }
+      fixed_fds_.push_back(fixed_fd);
+    }
+  }
+
   auto registered_buffer_size = absl::GetFlag(FLAGS_registered_buffer_size);
   if (registered_buffer_size > 0) {
     if (int io_res = up->RegisterBuffers(registered_buffer_size); io_res < 0)
@@ -101,8 +159,10 @@ void DiskStorage::Close() {
   while (pending_ops_ > 0 || grow_pending_)
     util::ThisFiber::SleepFor(10ms);
 
-  backing_file_->Close();
-  backing_file_.reset();
+  UnregisterFiles();
+  for (auto& file : backing_files_)
+    file->Close();
+  backing_files_.clear();
 }
 
 void DiskStorage::Read(DiskSegment segment, ReadCb cb) {
@@ -123,17 +183,18 @@ void DiskStorage::Read(DiskSegment segment, ReadCb cb) {
   };
 
   pending_ops_++;
-  if (buf.buf_idx)
-    backing_file_->ReadFixedAsync(buf.bytes, segment.offset, *buf.buf_idx, std::move(io_cb));
-  else
-    backing_file_->ReadAsync(buf.bytes, segment.offset, std::move(io_cb));
+  SubmitIo(false, segment.offset, buf, std::move(io_cb));
 }
 
 void DiskStorage::MarkAsFree(DiskSegment segment) {
   DCHECK_GT(segment.length, 0u);
   DCHECK_EQ(segment.offset % kPageSize, 0u);
 
-  alloc_.Free(segment.offset, segment.length);
+  if (keep_freed_)
+    return;
+
+  if (auto page = alloc_.Free(segment.offset, segment.length); page && punch_holes_)
+    PunchHole(*page);
 }
 
 std::error_code DiskStorage::Stash(io::Bytes bytes, io::Bytes footer, StashCb cb) {
@@ -173,10 +234,7 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, io::Bytes footer, StashCb cb
   };
 
   pending_ops_++;
-  if (buf.buf_idx)
-    backing_file_->WriteFixedAsync(buf.bytes, offset, *buf.buf_idx, std::move(io_cb));
-  else
-    backing_file_->WriteAsync(buf.bytes, offset, std::move(io_cb));
+  SubmitIo(true, offset, buf, std::move(io_cb));
 
   // Grow in advance if needed and possible
   size_t capacity = alloc_.capacity();
@@ -190,9 +248,17 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, io::Bytes footer, StashCb cb
 }
 
 DiskStorage::Stats DiskStorage::GetStats() const {
-  return {
-      alloc_.allocated_bytes(),       alloc_.capacity(), heap_buf_alloc_cnt_, reg_buf_alloc_cnt_,
-      static_cast<size_t>(max_size_), pending_ops_};
+  return {alloc_.allocated_bytes(),
+          alloc_.capacity(),
+          alloc_.committed_bytes(),
+          released_bytes_,
+          heap_buf_alloc_cnt_,
+          reg_buf_alloc_cnt_,
+          static_cast<size_t>(max_size_),
+          pending_ops_,
+          unsigned(backing_files_.size()),
+          !fixed_fds_.empty(),
+          file_pending_ops_};
 }
 
 bool DiskStorage::CanGrow() const {
@@ -208,8 +274,16 @@ error_code DiskStorage::Grow(off_t grow_size) {
     LOG(WARNING) << "Concurrent grow request detected ";
     return make_error_code(errc::operation_in_progress);
   }
+  // capacity is always aligned to full stripes of all files.
+  size_t files = backing_files_.size();
+  grow_size = StripeAligned(grow_size, files);
   off_t end = alloc_.capacity();
-  auto err = DoFiberCall(&SubmitEntry::PrepFallocate, backing_file_->fd(), 0, end, grow_size);
+
+  error_code err;
+  for (size_t i = 0; i < files && !err; i++) {
+    err = DoFiberCall(&SubmitEntry::PrepFallocate, backing_files_[i]->fd(), 0, end / off_t(files),
+                      grow_size / off_t(files));
+  }
   grow_pending_ = false;
   RETURN_ON_ERR(err);
 
@@ -218,6 +292,83 @@ error_code DiskStorage::Grow(off_t grow_size) {
   return {};
 }
 
+void DiskStorage::SubmitIo(bool write, size_t offset, UringBuf buf, std::function<void(int)> cb) {
+  struct State {
+    unsigned parts = 0;
+    int res = 0;
+    std::function<void(int)> cb;
+  };
+  auto state = make_shared<State>();
+  state->cb = std::move(cb);
+
+  const size_t files = backing_files_.size();
+  io::MutableBytes bytes = buf.bytes;
+  do {
+    size_t stripe = offset / kStripeSize;
+    size_t in_stripe = offset % kStripeSize;
+    size_t len = files == 1 ? bytes.size() : min(bytes.size(), kStripeSize - in_stripe);
+    size_t file_index = stripe % files;
+    size_t file_offset = stripe / files * kStripeSize + in_stripe;
+    io::MutableBytes part = bytes.subspan(0, len);
+
+    auto io_cb = [this, state, file_index](int io_res) {
+      file_pending_ops_[file_index]--;
+      if (io_res < 0 && state->res >= 0)
+        state->res = io_res;
+      if (--state->parts == 0)
+        state->cb(state->res);
+    };
+
+    state->parts++;
+    file_pending_ops_[file_index]++;
+    LinuxFile* file = backing_files_[file_index].get();
+    if (!fixed_fds_.empty()) {
+      SubmitFixedFile(write, fixed_fds_[file_index], part, file_offset, buf.buf_idx,
+                      std::move(io_cb));
+    } else if (write) {
+      if (buf.buf_idx)
+        file->WriteFixedAsync(part, file_offset, *buf.buf_idx, std::move(io_cb));
+      else
+        file->WriteAsync(part, file_offset, std::move(io_cb));
+    } else {
+      if (buf.buf_idx)
+        file->ReadFixedAsync(part, file_offset, *buf.buf_idx, std::move(io_cb));
+      else
+        file->ReadAsync(part, file_offset, std::move(io_cb));
+    }
+
+    offset += len;
+    bytes.remove_prefix(len);
+  } while (!bytes.empty());
+}
+
+void DiskStorage::SubmitFixedFile(bool write, int fixed_fd, io::MutableBytes bytes, off_t offset,
+                                  optional<unsigned> buf_idx, std::function<void(int)> cb) {
+  auto* up = static_cast<UringProactor*>(ProactorBase::me());
+  auto io_cb = [cb = std::move(cb)](detail::FiberInterface*, UringProactor::IoResult res,
+                                    uint32_t) { cb(res); };
+  SubmitEntry se = up->GetSubmitEntry(std::move(io_cb));
+  if (write) {
+    if (buf_idx)
+      se.PrepWriteFixed(fixed_fd, bytes.data(), bytes.size(), offset, *buf_idx);
+    else
+      se.PrepWrite(fixed_fd, bytes.data(), bytes.size(), offset);
+  } else {
+    if (buf_idx)
+      se.PrepReadFixed(fixed_fd, bytes.data(), bytes.size(), offset, *buf_idx);
+    else
+      se.PrepRead(fixed_fd, bytes.data(), bytes.size(), offset);
+  }
+  se.sqe()->flags |= IOSQE_FIXED_FILE;
+}
+
+void DiskStorage::UnregisterFiles() {
+  auto* up = static_cast<UringProactor*>(ProactorBase::me());
+  for (int fixed_fd : fixed_fds_)
+    up->UnregisterFd(fixed_fd);
+  fixed_fds_.clear();
+}
+
 UringBuf DiskStorage::PrepareBuf(size_t size) {
   DCHECK_EQ(ProactorBase::me()->GetKind(), ProactorBase::IOURING);
   auto* up = static_cast<UringProactor*>(ProactorBase::me());
@@ -230,4 +381,25 @@ UringBuf DiskStorage::PrepareBuf(size_t size) {
   return AllocateTmpBuf(size);
 }
 
+void DiskStorage::PunchHole(DiskSegment segment) {
+  const size_t files = backing_files_.size();
+  size_t offset = segment.offset, end = segment.offset + segment.length;
+  while (offset < end && files > 0) {
+    size_t stripe = offset / kStripeSize;
+    size_t in_stripe = offset % kStripeSize;
+    size_t len = files == 1 ? end - offset : min(end - offset, kStripeSize - in_stripe);
+    int fd = backing_files_[stripe % files]->fd();
+    off_t file_offset = stripe / files * kStripeSize + in_stripe;
+
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, file_offset, len) < 0) {
+      LOG(WARNING) << "Could not punch hole in backing file: " << strerror(errno)
+                   << ", freed pages won't be returned to the filesystem";
+      punch_holes_ = false;
+      return;
+    }
+    offset += len;
+  }
+  released_bytes_ += segment.length;
+}
+
 }  // namespace dfly::tiering
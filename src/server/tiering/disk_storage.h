@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <array>
+#include <string>
 #include <system_error>
+#include <vector>
 
 #include "io/io.h"
 #include "server/tiering/common.h"
@@ -15,15 +18,25 @@
 namespace dfly::tiering {
 
 // Disk storage controlled by asynchronous operations.
+// The storage can be striped across multiple backing files: consecutive stripes of the address
+// space are mapped to the files in round-robin order, so io is spread over all of them.
 class DiskStorage {
  public:
+  static constexpr size_t kStripeSize = 1_MB;
+
   struct Stats {
     size_t allocated_bytes = 0;
     size_t capacity_bytes = 0;
+    size_t committed_bytes = 0;  // see ExternalAllocator::committed_bytes()
+    uint64_t released_bytes = 0;  // total bytes of freed pages returned to the filesystem
     uint64_t heap_buf_alloc_count = 0;
     uint64_t registered_buf_alloc_count = 0;
     size_t max_file_size = 0;
     size_t pending_ops = 0;
+
+    unsigned backing_files = 0;
+    bool registered_files = false;  // io is submitted with fixed files
+    std::array<size_t, kMaxBackingFiles> file_pending_ops{};  // io queue depth per backing file
   };
 
   using ReadCb = std::function<void(io::Result<std::string_view>)>;
@@ -31,15 +44,46 @@ class DiskStorage {
 
   explicit DiskStorage(size_t max_size);
 
-  std::error_code Open(std::string_view path);
+  // Open backing files, one per path. If restore is set, existing files are preserved and their
+  // contents can be referenced again with Restore until FinishRestore is called.
+  std::error_code Open(const std::vector<std::string>& paths, bool restore = false);
   void Close();
 
   // Request read for segment, cb will be called on completion with read value
   void Read(DiskSegment segment, ReadCb cb);
 
-  // Mark segment as free, performed immediately
+  // Mark segment as free, performed immediately. Pages that become free are returned to the
+  // filesystem by punching holes in the backing files.
   void MarkAsFree(DiskSegment segment);
 
+  // See ExternalAllocator::StartEvacuation.
+  std::optional<DiskSegment> StartEvacuation(double max_utilization) {
+    return alloc_.StartEvacuation(max_utilization);
+  }
+
+  void StopEvacuation(size_t offset) {
+    alloc_.StopEvacuation(offset);
+  }
+
+  // Marks a segment that was stashed before the restart as used. Returns false if it does not
+  // belong to the preserved backing files.
+  bool Restore(DiskSegment segment) {
+    return alloc_.Restore(segment.offset, segment.length);
+  }
+
+  void FinishRestore() {
+    alloc_.FinishRestore();
+  }
+
+  bool IsRestoring() const {
+    return alloc_.restoring();
+  }
+
+  // Stop freeing segments, so that the contents of all segments stay intact until Close.
+  void KeepFreedSegments() {
+    keep_freed_ = true;
+  }
+
   // Request bytes to be stored, cb will be called with assigned segment on completion. Can block to
   // grow backing file. Returns error code if operation failed  immediately (most likely it failed
   // to grow the backing file) or passes an empty segment if the final write operation failed.
@@ -56,6 +100,21 @@ class DiskStorage {
   // Returns a buffer with size greater or equal to len.
   util::fb2::UringBuf PrepareBuf(size_t len);
 
+  // Read or write buf at the offset, splitting the request on stripe boundaries.
+  // cb is called once with the first error or a non-negative result when all parts finished.
+  void SubmitIo(bool write, size_t offset, util::fb2::UringBuf buf, std::function<void(int)> cb);
+
+  // Submit a single read or write of a backing file registered with the ring, which saves the
+  // file reference lookup on every submission.
+  void SubmitFixedFile(bool write, int fixed_fd, io::MutableBytes bytes, off_t offset,
+                       std::optional<unsigned> buf_idx, std::function<void(int)> cb);
+
+  void UnregisterFiles();
+
+  // Deallocate the disk space of the segment in all backing files. Runs synchronously, so that
+  // the segment can't be allocated again before the hole is punched.
+  void PunchHole(DiskSegment segment);
+
   off_t max_size_;
   size_t pending_ops_ = 0;  // number of ongoing ops for safe shutdown
 
@@ -63,7 +122,13 @@ class DiskStorage {
   uint64_t heap_buf_alloc_cnt_ = 0, reg_buf_alloc_cnt_ = 0;
 
   bool grow_pending_ = false;
-  std::unique_ptr<util::fb2::LinuxFile> backing_file_;
+  bool punch_holes_ = true;  // reset if the filesystem does not support it
+  bool keep_freed_ = false;
+  uint64_t released_bytes_ = 0;
+
+  std::vector<std::unique_ptr<util::fb2::LinuxFile>> backing_files_;
+  std::vector<int> fixed_fds_;  // indices of registered backing_files_, if enabled
+  std::array<size_t, kMaxBackingFiles> file_pending_ops_{};
 
   ExternalAllocator alloc_;
 };
@@ -5,13 +5,18 @@
 #include "server/tiering/disk_storage.h"
 
 #include <memory>
+#include <numeric>
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "server/tiering/common.h"
 #include "server/tiering/test_common.h"
 #include "util/fibers/fibers.h"
 #include "util/fibers/pool.h"
+#include "util/fibers/synchronization.h"
+
+ABSL_DECLARE_FLAG(bool, backing_file_registered);
 
 namespace dfly::tiering {
 
@@ -23,15 +28,22 @@ struct DiskStorageTest : public PoolTestBase {
     EXPECT_EQ(pending_ops_, 0);
   }
 
-  void Open() {
+  void Open(unsigned files = 1, bool restore = false) {
+    paths_.clear();
+    for (unsigned i = 0; i < files; i++)
+      paths_.push_back(absl::StrCat("disk_storage_test_backing", i));
+
     storage_ = make_unique<DiskStorage>(256_MB);
-    storage_->Open("disk_storage_test_backing");
+    storage_->Open(paths_, restore);
   }
 
-  void Close() {
+  void Close(bool keep_files = false) {
     storage_->Close();
     storage_.reset();
-    unlink("disk_storage_test_backing");
+    for (const auto& path : paths_) {
+      if (!keep_files)
+        unlink(path.c_str());
+    }
   }
 
   void Stash(size_t index, string value) {
@@ -76,6 +88,7 @@ struct DiskStorageTest : public PoolTestBase {
   std::unordered_map<size_t, string> last_reads_;
   std::unordered_map<size_t, DiskSegment> segments_;
   std::unique_ptr<DiskStorage> storage_;
+  std::vector<std::string> paths_;
 };
 
 TEST_F(DiskStorageTest, Basic) {
@@ -125,4 +138,153 @@ TEST_F(DiskStorageTest, ReUse) {
   });
 }
 
+TEST_F(DiskStorageTest, ReleaseFreedPages) {
+  pp_->at(0)->Await([this] {
+    Open(2);
+
+    // Fill more than one allocator page
+    for (size_t i = 0; i < 300; i++)
+      Stash(i, absl::StrCat("value", i));
+    Wait();
+    EXPECT_GT(GetStats().committed_bytes, GetStats().allocated_bytes);
+
+    for (size_t i = 0; i < 300; i++)
+      Delete(i);
+    EXPECT_EQ(GetStats().committed_bytes, 0u);
+    EXPECT_GT(GetStats().released_bytes, 0u);
+
+    Close();
+  });
+}
+
+TEST_F(DiskStorageTest, Restore) {
+  pp_->at(0)->Await([this] {
+    Open(2);
+    for (size_t i = 0; i < 100; i++)
+      Stash(i, absl::StrCat("value", i));
+    Wait();
+    Close(true);
+
+    // Reopen the files and restore every other segment
+    Open(2, true);
+    EXPECT_TRUE(storage_->IsRestoring());
+    for (size_t i = 0; i < 100; i += 2)
+      EXPECT_TRUE(storage_->Restore(segments_[i]));
+    EXPECT_FALSE(storage_->Restore(segments_[0]));
+    storage_->FinishRestore();
+    EXPECT_EQ(GetStats().allocated_bytes, 50 * kPageSize);
+
+    // New values reuse the segments that were not restored
+    for (size_t i = 1; i < 100; i += 2)
+      Stash(i, absl::StrCat("new", i));
+    Wait();
+
+    for (size_t i = 0; i < 100; i++)
+      Read(i);
+    Wait();
+    for (size_t i = 0; i < 100; i++) {
+      EXPECT_LT(segments_[i].offset, 100 * kPageSize);
+      EXPECT_EQ(last_reads_[i], absl::StrCat(i % 2 ? "new" : "value", i));
+    }
+
+    Close();
+  });
+}
+
+TEST_F(DiskStorageTest, Striped) {
+  pp_->at(0)->Await([this] {
+    Open(3);
+    EXPECT_EQ(GetStats().backing_files, 3u);
+
+    // Large values span multiple stripes and thus multiple files.
+    for (size_t i = 0; i < 10; i++)
+      Stash(i, string(i * DiskStorage::kStripeSize / 2 + 100, 'a' + i));
+    for (size_t i = 10; i < 100; i++)
+      Stash(i, absl::StrCat("value", i));
+    Wait();
+
+    for (size_t i = 0; i < 100; i++)
+      Read(i);
+    auto stats = GetStats();
+    EXPECT_EQ(accumulate(stats.file_pending_ops.begin(), stats.file_pending_ops.end(), 0u),
+              stats.pending_ops);
+    Wait();
+
+    for (size_t i = 0; i < 10; i++)
+      EXPECT_EQ(last_reads_[i], string(i * DiskStorage::kStripeSize / 2 + 100, 'a' + i));
+    for (size_t i = 10; i < 100; i++)
+      EXPECT_EQ(last_reads_[i], absl::StrCat("value", i));
+
+    for (size_t i = 0; i < GetStats().backing_files; i++)
+      EXPECT_EQ(GetStats().file_pending_ops[i], 0u);
+
+    Close();
+  });
+}
+
+TEST_F(DiskStorageTest, RegisteredFiles) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_backing_file_registered, true);
+
+  pp_->at(0)->Await([this] {
+    Open(2);
+    EXPECT_TRUE(GetStats().registered_files);
+
+    Stash(0, string(3 * DiskStorage::kStripeSize / 2, 'a'));
+    for (size_t i = 1; i < 100; i++)
+      Stash(i, absl::StrCat("value", i));
+    Wait();
+
+    for (size_t i = 0; i < 100; i++)
+      Read(i);
+    Wait();
+
+    EXPECT_EQ(last_reads_[0], string(3 * DiskStorage::kStripeSize / 2, 'a'));
+    for (size_t i = 1; i < 100; i++)
+      EXPECT_EQ(last_reads_[i], absl::StrCat("value", i));
+
+    Close();
+  });
+}
+
+// Reads pages with regular or fixed files, see backing_file_registered.
+static void BM_DiskStorageRead(benchmark::State& state) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_backing_file_registered, state.range(0) != 0);
+
+  unique_ptr<util::ProactorPool> pp(util::fb2::Pool::IOUring(16, 1));
+  pp->Run();
+
+  const vector<string> paths = {"disk_storage_bench_backing"};
+  DiskStorage storage(256_MB);
+  vector<DiskSegment> segments(256);
+  pp->at(0)->Await([&] {
+    CHECK(!storage.Open(paths));
+    string value(kPageSize, 'a');
+    util::fb2::BlockingCounter bc(segments.size());
+    for (auto& segment : segments) {
+      storage.Stash(io::Buffer(value), {}, [&segment, bc](io::Result<DiskSegment> res) mutable {
+        segment = *res;
+        bc->Dec();
+      });
+    }
+    bc->Wait();
+  });
+
+  while (state.KeepRunning()) {
+    pp->at(0)->Await([&] {
+      util::fb2::BlockingCounter bc(segments.size());
+      for (const auto& segment : segments)
+        storage.Read(segment, [bc](io::Result<string_view>) mutable { bc->Dec(); });
+      bc->Wait();
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * segments.size());
+
+  pp->at(0)->Await([&] { storage.Close(); });
+  pp->Stop();
+  unlink(paths.front().c_str());
+}
+BENCHMARK(BM_DiskStorageRead)->ArgName("registered")->Arg(0)->Arg(1);
+
 }  // namespace dfly::tiering
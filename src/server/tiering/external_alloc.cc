@@ -8,6 +8,7 @@
 
 #include <bitset>
 #include <cstring>
+#include <utility>
 
 #include "base/logging.h"
 
@@ -58,6 +59,7 @@ constexpr size_t kBinWordLens[kNumBins] = {
 
 static_assert(kBinWordLens[kLargeSizeBin - 1] * 8 == kMediumObjMaxSize);
 static_assert(kBinWordLens[kLargeSizeBin] == UINT64_MAX);
+static_assert(ExternalAllocator::kMaxPageBlockSize == kMediumObjMaxSize);
 
 constexpr inline BinIdx ToBinIdx(size_t size) {
   // first 4 bins are multiplies of kMinBlockSize.
@@ -144,6 +146,7 @@ struct Page {
   // need some mapping function to map from block_size to real_block_size given Page class.
   BinIdx bin_idx;
   uint8_t segment_inuse : 1;  // true if segment allocated this page.
+  uint8_t evacuating : 1;     // true if no blocks should be allocated from this page.
   uint8_t reserved[3];
 
   // can be computed via free_blocks.count().
@@ -352,6 +355,7 @@ int64_t ExternalAllocator::Malloc(size_t sz) {
 
     free_pages_[bin_idx] = page;
     page->Init(pc, bin_idx);
+    committed_bytes_ += 1 << ToSegDescr(page)->page_shift();
   }
 
   DCHECK(page->available);
@@ -366,7 +370,7 @@ int64_t ExternalAllocator::Malloc(size_t sz) {
   return seg->BlockOffset(page, pos);
 }
 
-void ExternalAllocator::Free(size_t offset, size_t sz) {
+optional<DiskSegment> ExternalAllocator::Free(size_t offset, size_t sz) {
   size_t idx = offset / 256_MB;
   size_t delta = offset % 256_MB;
   CHECK_LT(idx, segments_.size());
@@ -391,16 +395,74 @@ void ExternalAllocator::Free(size_t offset, size_t sz) {
   ++page->available;
 
   DCHECK_EQ(page->available, page->free_blocks.count());
+  allocated_bytes_ -= block_size;
+
   // If page becomes fully free, return it to segment list, otherwise if it just became non-empty,
   // then return it to free pages list
   if (page->available == blocks_num) {
     FreePage(page, seg, block_size);
-  } else if (page->available == 1) {
+    return DiskSegment{seg->BlockOffset(page, 0), page_size};
+  }
+
+  // Pages that are being restored are added to the free lists by FinishRestore.
+  if (page->available == 1 && !page->evacuating && offset >= restore_end_) {
     DCHECK_NE(page, free_pages_[page->bin_idx]);
     page->next_free = free_pages_[page->bin_idx];
     free_pages_[page->bin_idx] = page;
   }
-  allocated_bytes_ -= block_size;
+  return nullopt;
+}
+
+optional<DiskSegment> ExternalAllocator::StartEvacuation(double max_utilization) {
+  Page* best = nullptr;
+  SegmentDescr* best_seg = nullptr;
+  double best_utilization = max_utilization;
+
+  for (SegmentDescr* seg : segments_) {
+    if (seg == nullptr || seg->offset_ < restore_end_)
+      continue;
+
+    for (unsigned i = 0; i < seg->capacity(); ++i) {
+      Page* page = seg->GetPage(i);
+      if (!page->segment_inuse || page->available == 0 || page->evacuating)
+        continue;
+
+      unsigned blocks_num = (1 << seg->page_shift()) / ToBlockSize(page->bin_idx);
+      double utilization = double(blocks_num - page->available) / blocks_num;
+      if (utilization < best_utilization) {
+        best = page;
+        best_seg = seg;
+        best_utilization = utilization;
+      }
+    }
+  }
+
+  if (best == nullptr)
+    return nullopt;
+
+  // Remove from the free list, so that Malloc does not fill the page again.
+  UnlinkFreePage(best, best->bin_idx);
+  best->next_free = nullptr;
+  best->evacuating = 1;
+
+  return DiskSegment{best_seg->BlockOffset(best, 0), size_t(1) << best_seg->page_shift()};
+}
+
+void ExternalAllocator::StopEvacuation(size_t offset) {
+  size_t idx = offset / 256_MB;
+  CHECK_LT(idx, segments_.size());
+  SegmentDescr* seg = segments_[idx];
+  Page* page = seg->GetPage((offset % 256_MB) >> seg->page_shift());
+
+  // FreePage resets the flag, so the page could've been reused since.
+  if (!page->evacuating)
+    return;
+
+  page->evacuating = 0;
+  if (page->available > 0) {
+    page->next_free = free_pages_[page->bin_idx];
+    free_pages_[page->bin_idx] = page;
+  }
 }
 
 void ExternalAllocator::AddStorage(size_t start, size_t size) {
@@ -410,6 +472,84 @@ void ExternalAllocator::AddStorage(size_t start, size_t size) {
   capacity_ += size;
 }
 
+void ExternalAllocator::StartRestore(size_t size) {
+  VLOG(1) << "StartRestore " << size;
+  DCHECK_EQ(capacity_, 0u);
+
+  restore_end_ = size;
+  capacity_ += size;
+}
+
+bool ExternalAllocator::Restore(size_t offset, size_t sz) {
+  PageClass pc = detail::ClassFromSize(sz);
+  size_t idx = offset / kSegmentSize;
+  if (pc == PageClass::LARGE_P || (idx + 1) * kSegmentSize > restore_end_)
+    return false;
+
+  if (segments_.size() <= idx)
+    segments_.resize(idx + 1);
+  if (segments_[idx] == nullptr)
+    segments_[idx] = CreateSegment(pc, idx * kSegmentSize);
+
+  // All blocks of a segment come from pages of the same class.
+  SegmentDescr* seg = segments_[idx];
+  if (seg->page_class() != pc)
+    return false;
+
+  size_t delta = offset % kSegmentSize;
+  Page* page = seg->GetPage(delta >> seg->page_shift());
+  uint8_t bin_idx = ToBinIdx(sz);
+  if (!page->segment_inuse) {
+    page->segment_inuse = 1;
+    ++seg->page_info_.used;
+    page->Init(pc, bin_idx);
+    committed_bytes_ += 1 << seg->page_shift();
+  }
+
+  size_t block_size = ToBlockSize(page->bin_idx);
+  size_t block_offs = delta % (1 << seg->page_shift());
+  if (page->bin_idx != bin_idx || block_offs % block_size != 0)
+    return false;
+
+  unsigned block_id = block_offs / block_size;
+  if (!page->free_blocks[block_id])
+    return false;
+
+  page->free_blocks.reset(block_id);
+  --page->available;
+  allocated_bytes_ += block_size;
+  return true;
+}
+
+void ExternalAllocator::FinishRestore() {
+  size_t end = std::exchange(restore_end_, 0);
+  for (size_t start = 0; start < end; start += kSegmentSize) {
+    size_t idx = start / kSegmentSize;
+    SegmentDescr* seg = idx < segments_.size() ? segments_[idx] : nullptr;
+    if (seg == nullptr) {
+      extent_tree_.Add(start, min(kSegmentSize, end - start));
+      continue;
+    }
+
+    for (unsigned i = 0; i < seg->capacity(); ++i) {
+      Page* page = seg->GetPage(i);
+      if (page->segment_inuse && page->available > 0) {
+        page->next_free = free_pages_[page->bin_idx];
+        free_pages_[page->bin_idx] = page;
+      }
+    }
+
+    if (seg->HasFreePages()) {
+      auto& sq = sq_[seg->page_class()];
+      if (sq == nullptr) {
+        sq = seg;
+      } else {
+        sq->LinkBefore(seg);
+      }
+    }
+  }
+}
+
 size_t ExternalAllocator::GoodSize(size_t sz) {
   uint8_t bin_idx = ToBinIdx(sz);
   if (bin_idx < kLargeSizeBin)
@@ -451,7 +591,6 @@ auto ExternalAllocator::FindPage(PageClass pc) -> Page* {
   if (op_range) {
     DCHECK_EQ(0u, op_range->first % kSegmentAlignment);
 
-    unsigned num_pages = NumPagesInSegment(pc);
     size_t seg_idx = op_range->first / kSegmentAlignment;
 
     if (segments_.size() > seg_idx) {
@@ -460,9 +599,7 @@ auto ExternalAllocator::FindPage(PageClass pc) -> Page* {
       segments_.resize(seg_idx + 1);
     }
 
-    void* ptr =
-        mi_malloc_aligned(sizeof(SegmentDescr) + num_pages * sizeof(Page), kSegDescrAlignment);
-    SegmentDescr* seg = new (ptr) SegmentDescr(pc, op_range->first, num_pages);
+    SegmentDescr* seg = CreateSegment(pc, op_range->first);
     segments_[seg_idx] = seg;
 
     DCHECK(sq_[pc] == NULL);
@@ -475,6 +612,13 @@ auto ExternalAllocator::FindPage(PageClass pc) -> Page* {
   return nullptr;
 }
 
+auto ExternalAllocator::CreateSegment(PageClass pc, size_t offset) -> SegmentDescr* {
+  unsigned num_pages = NumPagesInSegment(pc);
+  void* ptr =
+      mi_malloc_aligned(sizeof(SegmentDescr) + num_pages * sizeof(Page), kSegDescrAlignment);
+  return new (ptr) SegmentDescr(pc, offset, num_pages);
+}
+
 int64_t ExternalAllocator::LargeMalloc(size_t size) {
   size_t align_sz = alignup(size, 4_KB);
   auto op_range = extent_tree_.GetRange(align_sz, 4_KB);
@@ -490,25 +634,16 @@ void ExternalAllocator::FreePage(Page* page, SegmentDescr* owner, size_t block_s
   // page is fully free. Return it to the segment even if it's
   // referenced via free_pages_. The allows more elasticity by potentially reassigning
   // it to other bin sizes.
-  BinIdx bidx = ToBinIdx(block_size);
-
   // Remove fast allocation reference.
-  if (free_pages_[bidx] == page) {
-    free_pages_[bidx] = page->next_free ? page->next_free : &empty_page;
-  } else {
-    for (auto* cur = free_pages_[bidx]; cur != nullptr; cur = cur->next_free) {
-      if (cur->next_free == page) {
-        cur->next_free = page->next_free;
-        break;
-      }
-    }
-  }
+  UnlinkFreePage(page, ToBinIdx(block_size));
 
   page->segment_inuse = 0;
+  page->evacuating = 0;
   page->available = 0;
   page->next_free = nullptr;
+  committed_bytes_ -= 1 << owner->page_shift();
 
-  if (!owner->HasFreePages()) {
+  if (!owner->HasFreePages() && owner->offset_ >= restore_end_) {
     // Segment was fully booked but now it has a free page.
     // Add it to the tail of segment queue.
     DCHECK(owner->next == owner->prev);
@@ -523,6 +658,20 @@ void ExternalAllocator::FreePage(Page* page, SegmentDescr* owner, size_t block_s
   --owner->page_info_.used;
 }
 
+void ExternalAllocator::UnlinkFreePage(Page* page, uint8_t bin_idx) {
+  if (free_pages_[bin_idx] == page) {
+    free_pages_[bin_idx] = page->next_free ? page->next_free : &empty_page;
+    return;
+  }
+
+  for (auto* cur = free_pages_[bin_idx]; cur != nullptr; cur = cur->next_free) {
+    if (cur->next_free == page) {
+      cur->next_free = page->next_free;
+      break;
+    }
+  }
+}
+
 inline auto ExternalAllocator::ToSegDescr(Page* page) -> SegmentDescr* {
   uintptr_t ptr = (uintptr_t)page;
 
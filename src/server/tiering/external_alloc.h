@@ -5,6 +5,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <vector>
 
 #include "core/extent_tree.h"
@@ -52,6 +53,9 @@ class ExternalAllocator {
   static constexpr size_t kExtAlignment = 256_MB;     // 256 MB
   static constexpr size_t kMinBlockSize = kPageSize;  // 4KB
 
+  // Blocks up to this size are allocated from pages, larger ones directly from the extent tree.
+  static constexpr size_t kMaxPageBlockSize = 1_MB;
+
   ExternalAllocator();
   ~ExternalAllocator();
 
@@ -61,12 +65,35 @@ class ExternalAllocator {
   // size sz.
   int64_t Malloc(size_t sz);
 
-  void Free(size_t offset, size_t sz);
+  // Returns the range of the page if it became fully free, so its backing storage can be released.
+  std::optional<DiskSegment> Free(size_t offset, size_t sz);
+
+  // Picks the partly used page with the lowest utilization below max_utilization and stops
+  // allocating from it, so that it becomes free once its blocks are freed. Returns its range.
+  std::optional<DiskSegment> StartEvacuation(double max_utilization);
+
+  // Allows allocating from the page at offset again if it was not freed yet.
+  void StopEvacuation(size_t offset);
 
   /// Adds backing storage to the allocator. The range should not overlap with already
   /// added storage ranges.
   void AddStorage(size_t start, size_t size);
 
+  // Starts restoring allocations on the storage range [0, size) that was used before a restart.
+  // The range is not allocated from until FinishRestore is called.
+  void StartRestore(size_t size);
+
+  // Marks the block at offset that was returned by Malloc(sz) before the restart as allocated.
+  // Returns false if it does not fit the allocations restored so far.
+  bool Restore(size_t offset, size_t sz);
+
+  // Makes the remaining space of the restored range available for allocations.
+  void FinishRestore();
+
+  bool restoring() const {
+    return restore_end_ > 0;
+  }
+
   // Similar to mi_good_size, returns the size of the underlying block as if
   // were returned by Malloc. Guaranteed that the result not less than sz.
   // No allocation is done.
@@ -80,6 +107,12 @@ class ExternalAllocator {
     return allocated_bytes_;
   }
 
+  // Bytes of pages that host allocated blocks. The part not covered by allocated_bytes()
+  // is lost to fragmentation.
+  size_t committed_bytes() const {
+    return committed_bytes_;
+  }
+
  private:
   class SegmentDescr;
   using Page = detail::Page;
@@ -90,8 +123,12 @@ class ExternalAllocator {
 
   int64_t LargeMalloc(size_t size);
   SegmentDescr* GetNewSegment(detail::PageClass sc);
+  SegmentDescr* CreateSegment(detail::PageClass sc, size_t offset);
   void FreePage(Page* page, SegmentDescr* owner, size_t block_size);
 
+  // Removes page from the free_pages_ list of bin_idx if it's there.
+  void UnlinkFreePage(Page* page, uint8_t bin_idx);
+
   static SegmentDescr* ToSegDescr(Page*);
 
   SegmentDescr* sq_[2];                      // map: PageClass -> free Segment.
@@ -104,6 +141,8 @@ class ExternalAllocator {
 
   size_t capacity_ = 0;  // in bytes.
   size_t allocated_bytes_ = 0;
+  size_t committed_bytes_ = 0;
+  size_t restore_end_ = 0;  // end of the range that is being restored
 };
 
 }  // namespace dfly::tiering
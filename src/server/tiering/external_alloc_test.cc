@@ -146,4 +146,79 @@ TEST_F(ExternalAllocatorTest, EmptyFull) {
     EXPECT_GT(ext_alloc_.Malloc(kAllocSize), 0u);
 }
 
+TEST_F(ExternalAllocatorTest, Evacuation) {
+  ext_alloc_.AddStorage(0, kSegSize);
+
+  // Fill two pages, then keep only one block on the first one.
+  vector<int64_t> offsets;
+  for (unsigned i = 0; i < 512; i++)
+    offsets.push_back(ext_alloc_.Malloc(kMinBlockSize));
+  ASSERT_EQ(offsets.back(), 1_MB + 255 * kMinBlockSize);
+  EXPECT_EQ(ext_alloc_.committed_bytes(), 2_MB);
+
+  for (unsigned i = 1; i < 256; i++)
+    EXPECT_FALSE(ext_alloc_.Free(offsets[i], kMinBlockSize));
+  ext_alloc_.Free(offsets[256], kMinBlockSize);
+
+  // The first page is the sparsest one
+  EXPECT_FALSE(ext_alloc_.StartEvacuation(0.001));
+  auto page = ext_alloc_.StartEvacuation(0.5);
+  ASSERT_TRUE(page);
+  EXPECT_EQ(page->offset, 0u);
+  EXPECT_EQ(page->length, 1_MB);
+
+  // New blocks are not allocated from the evacuated page
+  EXPECT_EQ(ext_alloc_.Malloc(kMinBlockSize), 1_MB);
+  EXPECT_EQ(ext_alloc_.Malloc(kMinBlockSize), 2_MB);
+
+  // Freeing the last block releases the page
+  auto released = ext_alloc_.Free(offsets[0], kMinBlockSize);
+  ASSERT_TRUE(released);
+  EXPECT_EQ(released->offset, 0u);
+  EXPECT_EQ(ext_alloc_.committed_bytes(), 2_MB);
+  ext_alloc_.StopEvacuation(0);
+}
+
+TEST_F(ExternalAllocatorTest, Restore) {
+  ext_alloc_.AddStorage(0, 2 * kSegSize);
+
+  std::map<int64_t, size_t> blocks;
+  for (unsigned i = 0; i < 1000; i++) {
+    size_t sz = kMinBlockSize * (1 + i % 40);
+    int64_t offset = ext_alloc_.Malloc(sz);
+    ASSERT_GE(offset, 0);
+    if (i % 3 == 0)
+      ext_alloc_.Free(offset, sz);
+    else
+      blocks.emplace(offset, sz);
+  }
+
+  ExternalAllocator restored;
+  restored.StartRestore(2 * kSegSize);
+  for (auto [offset, sz] : blocks)
+    EXPECT_TRUE(restored.Restore(offset, sz));
+  EXPECT_FALSE(restored.Restore(blocks.begin()->first, blocks.begin()->second));
+  EXPECT_EQ(restored.allocated_bytes(), ext_alloc_.allocated_bytes());
+  EXPECT_EQ(restored.committed_bytes(), ext_alloc_.committed_bytes());
+
+  // Nothing is allocated from the restored range before the restore has finished
+  EXPECT_LT(restored.Malloc(kMinBlockSize), 0);
+  restored.FinishRestore();
+
+  for (unsigned i = 0; i < 1000; i++) {
+    size_t sz = kMinBlockSize * (1 + i % 40);
+    int64_t offset = restored.Malloc(sz);
+    ASSERT_GE(offset, 0);
+
+    auto it = blocks.upper_bound(offset);
+    if (it != blocks.end())
+      ASSERT_LE(offset + ExternalAllocator::GoodSize(sz), it->first);
+    if (it != blocks.begin()) {
+      --it;
+      ASSERT_LE(it->first + ExternalAllocator::GoodSize(it->second), size_t(offset));
+    }
+    blocks.emplace(offset, sz);
+  }
+}
+
 }  // namespace dfly::tiering
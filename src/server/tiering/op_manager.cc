@@ -4,18 +4,43 @@
 
 #include "server/tiering/op_manager.h"
 
+#include <absl/time/clock.h>
+#include <lz4frame.h>
+
+#include <algorithm>
 #include <variant>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/overloaded.h"
+#include "core/usdt.h"
 #include "io/io.h"
 #include "server/tiering/common.h"
 #include "server/tiering/disk_storage.h"
 #include "util/fibers/fibers.h"
+
+ABSL_FLAG(bool, tiered_compression, false,
+          "If true, offloaded values are compressed with lz4 when it saves disk pages");
+
+ABSL_FLAG(bool, tiered_latency_histograms, false,
+          "If true, latency histograms of tiered operations are collected and reported");
+
 namespace dfly::tiering {
 
+using namespace ::dfly::tiering::literals;
+
 namespace {
 
+// Reads are merged as long as the result is not larger than this
+constexpr size_t kMaxCoalescedRead = 256_KB;
+
+// Max unused gap between merged reads. Reading a few extra pages is cheaper than another request.
+constexpr size_t kMaxCoalesceGap = 2 * kPageSize;
+
+uint64_t NowUsec() {
+  return absl::GetCurrentTimeNanos() / 1000;
+}
+
 OpManager::OwnedEntryId ToOwned(OpManager::EntryId id) {
   Overloaded convert{[](unsigned i) -> OpManager::OwnedEntryId { return i; },
                      [](std::pair<DbIndex, std::string_view> p) -> OpManager::OwnedEntryId {
@@ -28,18 +53,68 @@ OpManager::EntryId Borrowed(const OpManager::OwnedEntryId& id) {
   return std::visit([](const auto& v) -> OpManager::EntryId { return v; }, id);
 }
 
+// Returns an lz4 frame of value if it occupies less pages than the value itself.
+std::optional<std::string> Compress(std::string_view value) {
+  if (value.size() <= kPageSize)
+    return std::nullopt;
+
+  LZ4F_preferences_t prefs = LZ4F_INIT_PREFERENCES;
+  prefs.frameInfo.contentSize = value.size();
+
+  std::string frame(LZ4F_compressFrameBound(value.size(), &prefs), '\0');
+  size_t res = LZ4F_compressFrame(frame.data(), frame.size(), value.data(), value.size(), &prefs);
+  if (LZ4F_isError(res) || DiskSegment{0, res}.ContainingPages().length >=
+                               DiskSegment{0, value.size()}.ContainingPages().length) {
+    return std::nullopt;
+  }
+
+  frame.resize(res);
+  return frame;
+}
+
+// Decompresses the lz4 frame at the start of blob. Bytes past the frame end are ignored.
+std::string Decompress(std::string_view blob) {
+  LZ4F_dctx* dctx = nullptr;
+  CHECK(!LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)));
+
+  LZ4F_frameInfo_t info;
+  size_t consumed = blob.size();
+  size_t res = LZ4F_getFrameInfo(dctx, &info, blob.data(), &consumed);
+  CHECK(!LZ4F_isError(res)) << LZ4F_getErrorName(res);
+  blob.remove_prefix(consumed);
+
+  std::string value(info.contentSize, '\0');
+  size_t written = 0;
+  while (res != 0) {
+    CHECK(!blob.empty()) << "Truncated lz4 frame";
+    size_t dst_size = value.size() - written, src_size = blob.size();
+    res = LZ4F_decompress(dctx, value.data() + written, &dst_size, blob.data(), &src_size, nullptr);
+    CHECK(!LZ4F_isError(res)) << LZ4F_getErrorName(res);
+    written += dst_size;
+    blob.remove_prefix(src_size);
+  }
+  LZ4F_freeDecompressionContext(dctx);
+
+  CHECK_EQ(written, value.size());
+  return value;
+}
+
 }  // namespace
 
-OpManager::OpManager(size_t max_size) : storage_{max_size} {
+OpManager::OpManager(size_t max_size)
+    : storage_{max_size}, compress_{absl::GetFlag(FLAGS_tiered_compression)} {
+  if (absl::GetFlag(FLAGS_tiered_latency_histograms))
+    histograms_ = std::make_unique<Histograms>();
 }
 
 OpManager::~OpManager() {
   DCHECK(pending_stash_ver_.empty());
   DCHECK(pending_reads_.empty());
+  DCHECK(range_reads_.empty());
 }
 
-std::error_code OpManager::Open(std::string_view file) {
-  return storage_.Open(file);
+std::error_code OpManager::Open(const std::vector<std::string>& files, bool restore) {
+  return storage_.Open(files, restore);
 }
 
 void OpManager::Close() {
@@ -48,11 +123,92 @@ void OpManager::Close() {
   DCHECK(pending_reads_.empty());
 }
 
-void OpManager::Enqueue(EntryId id, DiskSegment segment, ReadCallback cb) {
+void OpManager::Enqueue(EntryId id, DiskSegment segment, bool compressed, ReadCallback cb) {
   // Fill pages for prepared read as it has no penalty and potentially covers more small segments
-  PrepareRead(segment.ContainingPages())
-      .ForSegment(segment, id)
-      .callbacks.emplace_back(std::move(cb));
+  DFLY_TRACE(tiering_read_enqueue, segment.offset, segment.length);
+  EntryOps& ops = PrepareRead(segment.ContainingPages()).ForSegment(segment, id);
+  ops.compressed = compressed;
+  ops.callbacks.emplace_back(std::move(cb));
+}
+
+void OpManager::ReadRange(DiskSegment segment, DiskSegment range,
+                          std::function<void(std::string_view)> cb) {
+  DCHECK_GE(range.offset, segment.offset);
+  DCHECK_LE(range.offset + range.length, segment.offset + segment.length);
+  DCHECK(!HasPendingOps(segment));
+
+  size_t end = (range.offset + range.length + kPageSize - 1) / kPageSize * kPageSize;
+  DiskSegment pages{range.offset / kPageSize * kPageSize, 0};
+  pages.length = end - pages.offset;
+  range_reads_.try_emplace(segment.offset, segment).first->second.pending++;
+  range_read_cnt_++;
+
+  uint64_t start_usec = histograms_ ? NowUsec() : 0;
+  auto io_cb = [this, segment, range, pages, start_usec,
+                cb = std::move(cb)](io::Result<std::string_view> result) {
+    CHECK(result) << result.error();
+    if (histograms_)
+      histograms_->read_usec.Add(NowUsec() - start_usec);
+    cb(result->substr(range.offset - pages.offset, range.length));
+
+    auto it = range_reads_.find(segment.offset);
+    if (--it->second.pending > 0)
+      return;
+    bool deleting = it->second.deleting;
+    range_reads_.erase(it);
+    if (deleting)
+      DeleteOffloaded(segment);
+  };
+  storage_.Read(pages, std::move(io_cb));
+}
+
+bool OpManager::HasPendingOps(DiskSegment segment) const {
+  auto it = pending_reads_.find(segment.ContainingPages().offset);
+  if (it == pending_reads_.end())
+    return false;
+
+  const auto& key_ops = it->second.key_ops;
+  return std::any_of(key_ops.begin(), key_ops.end(),
+                     [&](const EntryOps& ops) { return ops.segment.offset == segment.offset; });
+}
+
+void OpManager::StartReadBatch() {
+  read_batch_depth_++;
+}
+
+void OpManager::FlushReadBatch() {
+  DCHECK_GT(read_batch_depth_, 0u);
+  if (--read_batch_depth_ > 0 || deferred_reads_.empty())
+    return;
+
+  std::vector<size_t> offsets = std::move(deferred_reads_);
+  deferred_reads_.clear();
+  std::sort(offsets.begin(), offsets.end());
+
+  DiskSegment merged;
+  absl::InlinedVector<size_t, 4> members;
+  uint64_t now_usec = histograms_ ? NowUsec() : 0;
+  for (size_t offset : offsets) {
+    const ReadOp& op = pending_reads_.at(offset);
+    if (histograms_)
+      histograms_->read_queue_usec.Add(now_usec - op.deferred_usec);
+
+    DiskSegment segment = op.segment;
+    size_t merged_end = merged.offset + merged.length;
+    if (!members.empty() && segment.offset <= merged_end + kMaxCoalesceGap &&
+        segment.offset + segment.length - merged.offset <= kMaxCoalescedRead) {
+      merged.length = std::max(merged_end, segment.offset + segment.length) - merged.offset;
+      members.push_back(offset);
+      coalesced_read_cnt_++;
+      continue;
+    }
+
+    if (!members.empty())
+      SubmitRead(merged, std::move(members));
+    merged = segment;
+    members = {offset};
+  }
+  SubmitRead(merged, std::move(members));
 }
 
 void OpManager::Delete(EntryId id) {
@@ -62,6 +218,11 @@ void OpManager::Delete(EntryId id) {
 }
 
 void OpManager::DeleteOffloaded(DiskSegment segment) {
+  if (auto it = range_reads_.find(segment.offset); it != range_reads_.end()) {
+    it->second.deleting = true;
+    return;
+  }
+
   EntryOps* pending_read = nullptr;
 
   auto base_it = pending_reads_.find(segment.ContainingPages().offset);
@@ -80,9 +241,29 @@ std::error_code OpManager::Stash(EntryId id_ref, std::string_view value, io::Byt
   auto id = ToOwned(id_ref);
   unsigned version = pending_stash_ver_[id] = ++pending_stash_counter_;
 
+  // Only key values are compressed, bins pack multiple small values into a single page.
+  std::optional<std::string> compressed;
+  if (compress_ && footer.empty() && std::holds_alternative<KeyRef>(id_ref))
+    compressed = Compress(value);
+
+  std::optional<uint32_t> raw_len;
   io::Bytes buf_view = io::Buffer(value);
-  auto io_cb = [this, version, id = std::move(id)](io::Result<DiskSegment> segment) {
-    ProcessStashed(Borrowed(id), version, segment);
+  if (compressed) {
+    raw_len = value.size();
+    buf_view = io::Buffer(*compressed);
+    compressed_stash_cnt_++;
+  }
+
+  uint64_t start_usec = histograms_ ? NowUsec() : 0;
+  auto io_cb = [this, version, raw_len, start_usec,
+                id = std::move(id)](io::Result<DiskSegment> segment) {
+    if (histograms_)
+      histograms_->stash_usec.Add(NowUsec() - start_usec);
+
+    // Compressed values are always read as whole pages, as the frame length is not tracked.
+    if (segment && raw_len)
+      segment = segment->ContainingPages();
+    ProcessStashed(Borrowed(id), version, segment, raw_len);
   };
 
   // May block due to blocking call to Grow.
@@ -98,21 +279,39 @@ OpManager::ReadOp& OpManager::PrepareRead(DiskSegment aligned_segment) {
 
   auto [it, inserted] = pending_reads_.try_emplace(aligned_segment.offset, aligned_segment);
   if (inserted) {
-    auto io_cb = [this, aligned_segment](io::Result<std::string_view> result) {
-      CHECK(result) << result.error();  // TODO: to handle this gracefully.
-      ProcessRead(aligned_segment.offset, *result);
-    };
-    storage_.Read(aligned_segment, io_cb);
+    if (read_batch_depth_ > 0) {
+      deferred_reads_.push_back(aligned_segment.offset);
+      if (histograms_)
+        it->second.deferred_usec = NowUsec();
+    } else
+      SubmitRead(aligned_segment, {aligned_segment.offset});
   }
   return it->second;
 }
 
-void OpManager::ProcessStashed(EntryId id, unsigned version,
-                               const io::Result<DiskSegment>& segment) {
+void OpManager::SubmitRead(DiskSegment segment, absl::InlinedVector<size_t, 4> offsets) {
+  uint64_t start_usec = histograms_ ? NowUsec() : 0;
+  auto io_cb = [this, segment, start_usec,
+                offsets = std::move(offsets)](io::Result<std::string_view> result) {
+    CHECK(result) << result.error();  // TODO: to handle this gracefully.
+    if (histograms_)
+      histograms_->read_usec.Add(NowUsec() - start_usec);
+
+    for (size_t offset : offsets) {
+      // Enqueue does not change the segment of a pending read, so it's safe to look it up again.
+      size_t length = pending_reads_.at(offset).segment.length;
+      ProcessRead(offset, result->substr(offset - segment.offset, length));
+    }
+  };
+  storage_.Read(segment, std::move(io_cb));
+}
+
+void OpManager::ProcessStashed(EntryId id, unsigned version, const io::Result<DiskSegment>& segment,
+                               std::optional<uint32_t> raw_len) {
   if (auto it = pending_stash_ver_.find(ToOwned(id));
       it != pending_stash_ver_.end() && it->second == version) {
     pending_stash_ver_.erase(it);
-    NotifyStashed(id, segment);
+    NotifyStashed(id, segment, raw_len);
   } else if (segment) {
     // Throw away the value because it's no longer up-to-date even if no error occured
     storage_.MarkAsFree(*segment);
@@ -122,6 +321,7 @@ void OpManager::ProcessStashed(EntryId id, unsigned version,
 void OpManager::ProcessRead(size_t offset, std::string_view page) {
   util::FiberAtomicGuard guard;  // atomically update items, no in-between states should be possible
   ReadOp* info = &pending_reads_.at(offset);
+  DFLY_TRACE(tiering_read_done, offset, page.size(), info->key_ops.size());
 
   // Reorder base read (offset 0) to be last, so reads for defragmentation are handled last.
   // If we already have a page read for defragmentation pending and some other read for the
@@ -141,6 +341,8 @@ void OpManager::ProcessRead(size_t offset, std::string_view page) {
   for (size_t i = 0; i < info->key_ops.size(); i++) {
     auto& ko = info->key_ops[i];
     key_value = page.substr(ko.segment.offset - info->segment.offset, ko.segment.length);
+    if (ko.compressed)
+      key_value = Decompress(key_value);
 
     bool modified = false;
     for (auto& cb : ko.callbacks)
@@ -153,8 +355,12 @@ void OpManager::ProcessRead(size_t offset, std::string_view page) {
     if (!delete_from_storage)
       delete_from_storage |= NotifyFetched(Borrowed(ko.id), key_value, ko.segment, modified);
 
-    // If the item is being deleted, check if the full page needs to be deleted.
-    if (delete_from_storage)
+    // If the item is being deleted, check if the full page needs to be deleted. Entries with
+    // range reads in flight are deleted once the reads complete.
+    if (auto it = range_reads_.find(ko.segment.offset);
+        delete_from_storage && it != range_reads_.end())
+      it->second.deleting = true;
+    else if (delete_from_storage)
       deleting_full |= NotifyDelete(ko.segment);
   }
 
@@ -187,7 +393,10 @@ OpManager::EntryOps* OpManager::ReadOp::Find(DiskSegment key_segment) {
 OpManager::Stats OpManager::GetStats() const {
   return {.disk_stats = storage_.GetStats(),
           .pending_read_cnt = pending_reads_.size(),
-          .pending_stash_cnt = pending_stash_ver_.size()};
+          .pending_stash_cnt = pending_stash_ver_.size(),
+          .coalesced_read_cnt = coalesced_read_cnt_,
+          .range_read_cnt = range_read_cnt_,
+          .compressed_stash_cnt = compressed_stash_cnt_};
 }
 
 }  // namespace dfly::tiering
@@ -7,7 +7,11 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
 
+#include <functional>
+#include <memory>
+#include <optional>
 #include <variant>
+#include <vector>
 
 #include "server/tiering/common.h"
 #include "server/tiering/disk_storage.h"
@@ -26,6 +30,9 @@ class OpManager {
 
     size_t pending_read_cnt = 0;
     size_t pending_stash_cnt = 0;
+    uint64_t coalesced_read_cnt = 0;  // reads saved by merging neighbouring segments
+    uint64_t range_read_cnt = 0;      // reads of a part of an entry, see ReadRange
+    uint64_t compressed_stash_cnt = 0;
   };
 
   using KeyRef = std::pair<DbIndex, std::string_view>;
@@ -50,15 +57,35 @@ class OpManager {
   explicit OpManager(size_t max_size);
   virtual ~OpManager();
 
-  // Open file with underlying disk storage, must be called before use
-  std::error_code Open(std::string_view file);
+  // Open files with underlying disk storage, must be called before use. See DiskStorage::Open
+  // for restore.
+  std::error_code Open(const std::vector<std::string>& files, bool restore = false);
 
   void Close();
 
   // Enqueue callback to be executed once value is read. Trigger read if none is pending yet for
   // this segment. Multiple entries can be obtained from a single segment, but every distinct id
   // will have it's own independent callback loop that can safely modify the underlying value
-  void Enqueue(EntryId id, DiskSegment segment, ReadCallback cb);
+  void Enqueue(EntryId id, DiskSegment segment, ReadCallback cb) {
+    Enqueue(id, segment, false, std::move(cb));
+  }
+
+  // Same as above, but compressed segments are decompressed before the callbacks are invoked.
+  void Enqueue(EntryId id, DiskSegment segment, bool compressed, ReadCallback cb);
+
+  // Read only the pages that cover range, a part of the uncompressed entry at segment. The
+  // callbacks of the entry are bypassed, so ranges must not be read while it has pending
+  // operations that might modify it, see HasPendingOps. Freeing the entry is delayed until the
+  // range reads complete.
+  void ReadRange(DiskSegment segment, DiskSegment range, std::function<void(std::string_view)> cb);
+
+  // Returns true if operations enqueued for the entry at segment are pending.
+  bool HasPendingOps(DiskSegment segment) const;
+
+  // Defer reads triggered by Enqueue until FlushReadBatch is called, so that reads of neighbouring
+  // pages can be merged into a single disk request. Batches can be nested.
+  void StartReadBatch();
+  void FlushReadBatch();
 
   // Delete entry with pending io
   void Delete(EntryId id);
@@ -67,14 +94,52 @@ class OpManager {
   void DeleteOffloaded(DiskSegment segment);
 
   // Stash (value, footer) to be offloaded. Both arguments are opaque to OpManager.
+  // With tiered_compression, key values are compressed if it saves at least a page.
   std::error_code Stash(EntryId id, std::string_view value, io::Bytes footer);
 
+  // Stop allocating from the sparsest page, see ExternalAllocator::StartEvacuation.
+  std::optional<DiskSegment> StartEvacuation(double max_utilization) {
+    return storage_.StartEvacuation(max_utilization);
+  }
+
+  void StopEvacuation(size_t offset) {
+    storage_.StopEvacuation(offset);
+  }
+
+  // See DiskStorage::Restore.
+  bool Restore(DiskSegment segment) {
+    return storage_.Restore(segment);
+  }
+
+  void FinishRestore() {
+    storage_.FinishRestore();
+  }
+
+  bool IsRestoring() const {
+    return storage_.IsRestoring();
+  }
+
+  void KeepFreedSegments() {
+    storage_.KeepFreedSegments();
+  }
+
   Stats GetStats() const;
 
+  // Returns null unless tiered_latency_histograms is set.
+  Histograms* histograms() {
+    return histograms_.get();
+  }
+
+  const Histograms* histograms() const {
+    return histograms_.get();
+  }
+
  protected:
   // Notify that a stash succeeded and the entry was stored at the provided segment or failed with
-  // given error
-  virtual void NotifyStashed(EntryId id, const io::Result<DiskSegment>& segment) = 0;
+  // given error. If the value was compressed, raw_len holds its original length and the segment
+  // spans whole pages.
+  virtual void NotifyStashed(EntryId id, const io::Result<DiskSegment>& segment,
+                             std::optional<uint32_t> raw_len) = 0;
 
   // Notify that an entry was successfully fetched. Includes whether entry was modified.
   // Returns true if value needs to be deleted from the storage.
@@ -94,6 +159,7 @@ class OpManager {
     DiskSegment segment;
     absl::InlinedVector<ReadCallback, 1> callbacks;
     bool deleting = false;
+    bool compressed = false;
   };
 
   // Describes an ongoing read operation for a fixed segment
@@ -109,6 +175,17 @@ class OpManager {
 
     DiskSegment segment;                       // spanning segment of whole read
     absl::InlinedVector<EntryOps, 1> key_ops;  // enqueued operations for different keys
+    uint64_t deferred_usec = 0;                // when the read was deferred, for histograms
+  };
+
+  // Range reads in flight for a single entry
+  struct RangeReads {
+    explicit RangeReads(DiskSegment segment) : segment(segment) {
+    }
+
+    DiskSegment segment;
+    unsigned pending = 0;
+    bool deleting = false;  // the entry is deleted once the reads complete
   };
 
   // Prepare read operation for aligned segment or return pending if it exists.
@@ -118,13 +195,28 @@ class OpManager {
   // Called once read finished
   void ProcessRead(size_t offset, std::string_view value);
 
+  // Issue a single disk read covering the pending reads at the given sorted offsets.
+  void SubmitRead(DiskSegment segment, absl::InlinedVector<size_t, 4> offsets);
+
   // Called once Stash finished
-  void ProcessStashed(EntryId id, unsigned version, const io::Result<DiskSegment>& segment);
+  void ProcessStashed(EntryId id, unsigned version, const io::Result<DiskSegment>& segment,
+                      std::optional<uint32_t> raw_len);
 
  protected:
   DiskStorage storage_;
 
   absl::flat_hash_map<size_t /* offset */, ReadOp> pending_reads_;
+  absl::flat_hash_map<size_t /* entry offset */, RangeReads> range_reads_;
+  uint64_t range_read_cnt_ = 0;
+
+  unsigned read_batch_depth_ = 0;
+  std::vector<size_t> deferred_reads_;  // offsets of pending reads not submitted yet
+  uint64_t coalesced_read_cnt_ = 0;
+
+  bool compress_ = false;
+  uint64_t compressed_stash_cnt_ = 0;
+
+  std::unique_ptr<Histograms> histograms_;
 
   size_t pending_stash_counter_ = 0;
   // todo: allow heterogeneous lookups with non owned id
@@ -36,7 +36,7 @@ struct OpManagerTest : PoolTestBase, OpManager {
   }
 
   void Open() {
-    EXPECT_FALSE(OpManager::Open("op_manager_test_backing"));
+    EXPECT_FALSE(OpManager::Open({"op_manager_test_backing"}));
   }
 
   void Close() {
@@ -44,18 +44,21 @@ struct OpManagerTest : PoolTestBase, OpManager {
     EXPECT_EQ(unlink("op_manager_test_backing"), 0);
   }
 
-  util::fb2::Future<std::string> Read(EntryId id, DiskSegment segment) {
+  util::fb2::Future<std::string> Read(EntryId id, DiskSegment segment, bool compressed = false) {
     util::fb2::Future<std::string> future;
-    Enqueue(id, segment, [future](bool, std::string* value) mutable {
+    Enqueue(id, segment, compressed, [future](bool, std::string* value) mutable {
       future.Resolve(*value);
       return false;
     });
     return future;
   }
 
-  void NotifyStashed(EntryId id, const io::Result<DiskSegment>& segment) override {
+  void NotifyStashed(EntryId id, const io::Result<DiskSegment>& segment,
+                     std::optional<uint32_t> raw_len) override {
     ASSERT_TRUE(segment);
     stashed_[id] = *segment;
+    if (raw_len)
+      raw_lens_[id] = *raw_len;
   }
 
   bool NotifyFetched(EntryId id, std::string_view value, DiskSegment segment,
@@ -70,6 +73,7 @@ struct OpManagerTest : PoolTestBase, OpManager {
 
   absl::flat_hash_map<EntryId, std::string> fetched_;
   absl::flat_hash_map<EntryId, DiskSegment> stashed_;
+  absl::flat_hash_map<EntryId, uint32_t> raw_lens_;
 };
 
 TEST_F(OpManagerTest, SimpleStashesWithReads) {
@@ -151,6 +155,67 @@ TEST_F(OpManagerTest, ReadSamePageDifferentOffsets) {
   });
 }
 
+TEST_F(OpManagerTest, BatchedReads) {
+  pp_->at(0)->Await([this] {
+    Open();
+
+    for (unsigned i = 0; i < 20; i++)
+      EXPECT_FALSE(Stash(i, absl::StrCat("VALUE", i), {}));
+    while (stashed_.size() < 20)
+      util::ThisFiber::SleepFor(1ms);
+
+    // Values occupy a page each and are allocated next to each other, so reads are merged.
+    StartReadBatch();
+    std::vector<util::fb2::Future<std::string>> futures;
+    for (unsigned i = 0; i < 20; i++)
+      futures.emplace_back(Read(i, stashed_[i]));
+    EXPECT_EQ(GetStats().disk_stats.pending_ops, 0u);
+    FlushReadBatch();
+    EXPECT_LT(GetStats().disk_stats.pending_ops, 20u);
+
+    for (unsigned i = 0; i < 20; i++)
+      EXPECT_EQ(futures[i].Get(), absl::StrCat("VALUE", i));
+    EXPECT_GT(GetStats().coalesced_read_cnt, 0u);
+
+    Close();
+  });
+}
+
+TEST_F(OpManagerTest, CompressedStash) {
+  pp_->at(0)->Await([this] {
+    compress_ = true;
+    Open();
+
+    // Only values that save pages are compressed.
+    std::string value;
+    for (unsigned i = 0; value.size() < 10 * kPageSize; i++)
+      absl::StrAppend(&value, "{\"field\": ", i % 100, "}");
+    KeyRef key{0, "compressed"}, small_key{0, "small"};
+    EXPECT_FALSE(Stash(key, value, {}));
+    EXPECT_FALSE(Stash(small_key, "small value", {}));
+    while (stashed_.size() < 2)
+      util::ThisFiber::SleepFor(1ms);
+
+    EXPECT_EQ(GetStats().compressed_stash_cnt, 1u);
+    EXPECT_EQ(raw_lens_[key], value.size());
+    EXPECT_EQ(raw_lens_.count(small_key), 0u);
+    EXPECT_EQ(stashed_[key].length % kPageSize, 0u);
+    EXPECT_LT(stashed_[key].length, value.size());
+
+    // Neighbouring reads of compressed values can still be merged.
+    StartReadBatch();
+    auto compressed_read = Read(key, stashed_[key], true);
+    auto small_read = Read(small_key, stashed_[small_key]);
+    FlushReadBatch();
+
+    EXPECT_EQ(compressed_read.Get(), value);
+    EXPECT_EQ(fetched_[key], value);
+    EXPECT_EQ(small_read.Get(), "small value");
+
+    Close();
+  });
+}
+
 TEST_F(OpManagerTest, Modify) {
   pp_->at(0)->Await([this] {
     Open();
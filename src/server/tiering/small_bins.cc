@@ -25,37 +25,71 @@ size_t StashedValueSize(string_view value) {
   return 2 /* dbid */ + 8 /* hash */ + 2 /* strlen*/ + value.size();
 }
 
+// Upper bounds of stashed sizes of the size classes
+constexpr size_t kSizeClassLimits[SmallBins::kSizeClasses - 1] = {256, 1_KB};
+
+// Entries that expire within an hour are grouped apart from entries that live longer.
+constexpr uint64_t kShortTtlMs = 3600 * 1000;
+
 }  // namespace
 
+unsigned SmallBins::BinIndex(size_t stashed_size, uint64_t ttl_ms) {
+  unsigned size_class =
+      upper_bound(begin(kSizeClassLimits), end(kSizeClassLimits), stashed_size) -
+      begin(kSizeClassLimits);
+  unsigned ttl_group = ttl_ms == 0 ? 0 : (ttl_ms < kShortTtlMs ? 1 : 2);
+  return ttl_group * kSizeClasses + size_class;
+}
+
+bool SmallBins::IsPending(DbIndex dbid, std::string_view key) const {
+  std::pair<DbIndex, std::string> key_pair{dbid, key};
+  return any_of(open_bins_.begin(), open_bins_.end(),
+                [&key_pair](const OpenBin& bin) { return bin.entries.contains(key_pair); });
+}
+
 std::optional<SmallBins::FilledBin> SmallBins::Stash(DbIndex dbid, std::string_view key,
-                                                     std::string_view value, io::Bytes footer) {
+                                                     std::string_view value, io::Bytes footer,
+                                                     uint64_t ttl_ms, uint64_t now_ms) {
   DCHECK_LT(value.size(), 2_KB);
 
   size_t value_bytes = StashedValueSize(value) + footer.size();
+  OpenBin& bin = open_bins_[BinIndex(value_bytes, ttl_ms)];
 
   std::optional<FilledBin> filled_bin;
-  if (2 /* num entries */ + current_bin_bytes_ + value_bytes >= kPageSize) {
-    filled_bin = FlushBin();
+  if (2 /* num entries */ + bin.bytes + value_bytes >= kPageSize) {
+    filled_bin = FlushBin(&bin, now_ms);
   }
 
-  current_bin_bytes_ += value_bytes;
+  if (bin.entries.empty())
+    bin.start_ms = now_ms;
+  bin.bytes += value_bytes;
   string blob;
   blob.reserve(value.size() + footer.size());
   blob.append(value);
   blob.append(io::View(footer));
-  auto [it, inserted] = current_bin_.emplace(std::make_pair(dbid, key), std::move(blob));
+  auto [it, inserted] = bin.entries.emplace(std::make_pair(dbid, key), std::move(blob));
   CHECK(inserted);
 
-  DVLOG(2) << "current_bin_bytes: " << current_bin_bytes_
-           << ", current_bin_size:" << current_bin_.size();
+  DVLOG(2) << "bin_bytes: " << bin.bytes << ", bin_size:" << bin.entries.size();
   return filled_bin;
 }
 
-SmallBins::FilledBin SmallBins::FlushBin() {
-  DCHECK_GT(current_bin_.size(), 0u);
+std::vector<SmallBins::FilledBin> SmallBins::FlushStale(uint64_t now_ms, uint64_t max_age_ms) {
+  std::vector<FilledBin> out;
+  for (OpenBin& bin : open_bins_) {
+    if (!bin.entries.empty() && bin.start_ms + max_age_ms <= now_ms)
+      out.push_back(FlushBin(&bin, now_ms));
+  }
+  return out;
+}
+
+SmallBins::FilledBin SmallBins::FlushBin(OpenBin* bin, uint64_t now_ms) {
+  DCHECK_GT(bin->entries.size(), 0u);
+  if (dwell_hist_)
+    dwell_hist_->Add(now_ms - bin->start_ms);
 
   std::string out;
-  out.resize(current_bin_bytes_ + 2);
+  out.resize(bin->bytes + 2);
 
   BinId id = ++last_bin_id_;
   auto& pending_set = pending_bins_[id];
@@ -63,11 +97,11 @@ SmallBins::FilledBin SmallBins::FlushBin() {
   char* data = out.data();
 
   // Store number of entries, 2 bytes
-  absl::little_endian::Store16(data, current_bin_.size());
+  absl::little_endian::Store16(data, bin->entries.size());
   data += sizeof(uint16_t);
 
   // Store all dbids and hashes, n * 10 bytes
-  for (const auto& [key, _] : current_bin_) {
+  for (const auto& [key, _] : bin->entries) {
     absl::little_endian::Store16(data, key.first);
     data += sizeof(DbIndex);
 
@@ -76,7 +110,7 @@ SmallBins::FilledBin SmallBins::FlushBin() {
   }
 
   // Store all values with sizes, n * (2 + x) bytes
-  for (const auto& [key, value] : current_bin_) {
+  for (const auto& [key, value] : bin->entries) {
     absl::little_endian::Store16(data, value.size());
     data += sizeof(uint16_t);
 
@@ -85,10 +119,10 @@ SmallBins::FilledBin SmallBins::FlushBin() {
     data += value.size();
   }
 
-  current_bin_bytes_ = 0;
+  bin->bytes = 0;
 
   // erase does not shrink, unlike clear().
-  current_bin_.erase(current_bin_.begin(), current_bin_.end());
+  bin->entries.erase(bin->entries.begin(), bin->entries.end());
 
   return {id, std::move(out)};
 }
@@ -128,14 +162,16 @@ std::vector<std::pair<DbIndex, std::string>> SmallBins::ReportStashAborted(BinId
 
 std::optional<SmallBins::BinId> SmallBins::Delete(DbIndex dbid, std::string_view key) {
   std::pair<DbIndex, std::string> key_pair{dbid, key};
-  auto it = current_bin_.find(key_pair);
+  for (OpenBin& bin : open_bins_) {
+    auto it = bin.entries.find(key_pair);
+    if (it == bin.entries.end())
+      continue;
 
-  if (it != current_bin_.end()) {
     size_t stashed_size = StashedValueSize(it->second);
-    DCHECK_GE(current_bin_bytes_, stashed_size);
+    DCHECK_GE(bin.bytes, stashed_size);
 
-    current_bin_bytes_ -= stashed_size;
-    current_bin_.erase(it);
+    bin.bytes -= stashed_size;
+    bin.entries.erase(it);
     return std::nullopt;
   }
 
@@ -169,10 +205,22 @@ SmallBins::BinInfo SmallBins::Delete(DiskSegment segment) {
   return {segment};
 }
 
+bool SmallBins::Restore(DiskSegment segment) {
+  auto [it, inserted] = stashed_bins_.try_emplace(segment.ContainingPages().offset);
+  it->second.entries++;
+  it->second.bytes += segment.length;
+  stats_.stashed_entries_cnt++;
+  return inserted;
+}
+
 SmallBins::Stats SmallBins::GetStats() const {
+  size_t open_bytes = 0;
+  for (const OpenBin& bin : open_bins_)
+    open_bytes += bin.bytes;
+
   return Stats{.stashed_bins_cnt = stashed_bins_.size(),
                .stashed_entries_cnt = stats_.stashed_entries_cnt,
-               .current_bin_bytes = current_bin_bytes_};
+               .current_bin_bytes = open_bytes};
 }
 
 SmallBins::KeyHashDbList SmallBins::DeleteBin(DiskSegment segment, std::string_view value) {
@@ -6,6 +6,7 @@
 
 #include <absl/container/flat_hash_map.h>
 
+#include <array>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -17,13 +18,17 @@
 namespace dfly::tiering {
 
 // Small bins accumulate small values into larger bins that fill up 4kb pages.
-// SIMPLEST VERSION for now.
+// Values are filled into separate bins by their size class and time to live, so that the entries
+// of a page are alike and are more likely to be deleted together, which frees the whole page.
 class SmallBins {
  public:
+  static constexpr unsigned kSizeClasses = 3;
+  static constexpr unsigned kTtlGroups = 3;  // no expiry, short and long ttl
+
   struct Stats {
     size_t stashed_bins_cnt = 0;
     size_t stashed_entries_cnt = 0;
-    size_t current_bin_bytes = 0;
+    size_t current_bin_bytes = 0;  // of all open bins
   };
 
   using BinId = unsigned;
@@ -44,13 +49,17 @@ class SmallBins {
   using KeyHashDbList = std::vector<std::tuple<DbIndex, uint64_t /* hash */, DiskSegment>>;
 
   // Returns true if the entry is pending inside SmallBins.
-  bool IsPending(DbIndex dbid, std::string_view key) const {
-    return current_bin_.count({dbid, std::string(key)}) > 0;
-  }
+  bool IsPending(DbIndex dbid, std::string_view key) const;
 
-  // Enqueue key/value pair for stash. Returns page to be stashed if it filled up.
+  // Enqueue key/value pair for stash. Returns page to be stashed if it filled up. ttl_ms is the
+  // remaining time to live of the entry, 0 if it does not expire. now_ms starts the flush deadline
+  // of an empty bin, see FlushStale.
   std::optional<FilledBin> Stash(DbIndex dbid, std::string_view key, std::string_view value,
-                                 io::Bytes footer);
+                                 io::Bytes footer, uint64_t ttl_ms = 0, uint64_t now_ms = 0);
+
+  // Flush bins that were started at least max_age_ms before now_ms, so that values don't stay
+  // pending for long under low write rates.
+  std::vector<FilledBin> FlushStale(uint64_t now_ms, uint64_t max_age_ms);
 
   // Report that a stash succeeeded. Returns list of stored keys with calculated value locations.
   KeySegmentList ReportStashed(BinId id, DiskSegment segment);
@@ -65,15 +74,34 @@ class SmallBins {
   // the need for external actions like deleting empty segments or triggering defragmentation
   BinInfo Delete(DiskSegment segment);
 
+  // Register an entry of a bin that was stashed before the restart. Returns true if it's the
+  // first entry of its bin, so the bin's page has to be restored as well.
+  bool Restore(DiskSegment segment);
+
   // Delete stashed bin. Returns list of recovered item key hashes and db indices.
   // Mainly used for defragmentation
   KeyHashDbList DeleteBin(DiskSegment segment, std::string_view value);
 
   Stats GetStats() const;
 
+  // Record how long bins stay open, in ms, into hist when they are flushed.
+  void SetDwellHistogram(base::Histogram* hist) {
+    dwell_hist_ = hist;
+  }
+
  private:
-  // Flush current bin
-  FilledBin FlushBin();
+  using BinEntries = absl::flat_hash_map<std::pair<DbIndex, std::string>, std::string>;
+
+  struct OpenBin {
+    unsigned bytes = 0;
+    uint64_t start_ms = 0;  // time of the first stash
+    BinEntries entries;
+  };
+
+  static unsigned BinIndex(size_t stashed_size, uint64_t ttl_ms);
+
+  // Flush open bin
+  FilledBin FlushBin(OpenBin* bin, uint64_t now_ms);
 
  private:
   struct StashInfo {
@@ -84,8 +112,7 @@ class SmallBins {
 
   BinId last_bin_id_ = 0;
 
-  unsigned current_bin_bytes_ = 0;
-  absl::flat_hash_map<std::pair<DbIndex, std::string>, std::string> current_bin_;
+  std::array<OpenBin, kSizeClasses * kTtlGroups> open_bins_;  // indexed by BinIndex
 
   // Pending stashes, their keys and value sizes
   absl::flat_hash_map<unsigned /* id */,
@@ -98,6 +125,8 @@ class SmallBins {
   struct {
     size_t stashed_entries_cnt = 0;
   } stats_;
+
+  base::Histogram* dwell_hist_ = nullptr;
 };
 
 };  // namespace dfly::tiering
@@ -115,4 +115,44 @@ TEST_F(SmallBinsTest, UpdateStatsAfterDelete) {
   EXPECT_EQ(0u, bins_.GetStats().current_bin_bytes);
 }
 
+TEST_F(SmallBinsTest, SizeClassesAndTtl) {
+  // Values of different sizes and ttls never share a bin
+  EXPECT_FALSE(bins_.Stash(0, "l0", SmallString(1500), {}));
+  EXPECT_FALSE(bins_.Stash(0, "t0", SmallString(20), {}, 1000));
+
+  std::optional<SmallBins::FilledBin> bin;
+  unsigned i = 0;
+  for (; !bin; i++)
+    bin = bins_.Stash(0, absl::StrCat("s", i), SmallString(20), {});
+
+  auto segments = bins_.ReportStashed(bin->first, DiskSegment{0, 4_KB});
+  EXPECT_EQ(segments.size(), i - 1);
+  for (auto& [dbid, key, segment] : segments)
+    EXPECT_EQ(key[0], 's');
+
+  EXPECT_TRUE(bins_.IsPending(0, "l0"));
+  EXPECT_TRUE(bins_.IsPending(0, "t0"));
+}
+
+TEST_F(SmallBinsTest, FlushStale) {
+  EXPECT_FALSE(bins_.Stash(0, "k1", SmallString(20), {}, 0, 100));
+  EXPECT_FALSE(bins_.Stash(0, "k2", SmallString(20), {}, 0, 150));
+  EXPECT_FALSE(bins_.Stash(0, "k3", SmallString(1500), {}, 0, 180));
+
+  EXPECT_TRUE(bins_.FlushStale(199, 100).empty());
+
+  // Only the bin started first is due
+  auto bins = bins_.FlushStale(200, 100);
+  ASSERT_EQ(bins.size(), 1u);
+  auto segments = bins_.ReportStashed(bins[0].first, DiskSegment{0, 4_KB});
+  EXPECT_EQ(segments.size(), 2u);
+  EXPECT_FALSE(bins_.IsPending(0, "k1"));
+  EXPECT_TRUE(bins_.IsPending(0, "k3"));
+
+  // The deadline of a new bin starts with its first value
+  EXPECT_FALSE(bins_.Stash(0, "k4", SmallString(20), {}, 0, 250));
+  EXPECT_EQ(bins_.FlushStale(300, 100).size(), 1u);  // k3
+  EXPECT_EQ(bins_.FlushStale(350, 100).size(), 1u);  // k4
+}
+
 }  // namespace dfly::tiering
@@ -0,0 +1,450 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/timeseries_family.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+
+#include "core/time_series.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+constexpr string_view kKeyNotFoundErr = "TSDB: the key does not exist";
+constexpr string_view kOldTimestampErr =
+    "TSDB: timestamp must be greater than the timestamp of the last sample";
+
+enum class AggType : uint8_t { kAvg, kSum, kMin, kMax, kCount, kFirst, kLast };
+
+struct RangeParams {
+  int64_t from = INT64_MIN;
+  int64_t to = INT64_MAX;
+  optional<AggType> agg;
+  int64_t bucket_ms = 0;
+  uint64_t limit = UINT64_MAX;  // max number of samples or buckets in the reply.
+};
+
+using Samples = vector<TimeSeries::Sample>;
+
+// Argument index of the key and its samples.
+using ShardSeries = vector<pair<size_t, Samples>>;
+
+bool ParseTimestamp(string_view str, int64_t* ts) {
+  if (str == "-") {
+    *ts = INT64_MIN;
+    return true;
+  }
+  if (str == "+") {
+    *ts = INT64_MAX;
+    return true;
+  }
+  return absl::SimpleAtoi(str, ts);
+}
+
+// Parses <from> <to> [AGGREGATION type bucket_ms] [COUNT count]
+bool ParseRangeParams(CmdArgParser* parser, RangeParams* params) {
+  auto [from, to] = parser->Next<string_view, string_view>();
+  if (parser->HasError() || !ParseTimestamp(from, &params->from) ||
+      !ParseTimestamp(to, &params->to))
+    return false;
+
+  while (parser->HasNext()) {
+    if (parser->Check("AGGREGATION")) {
+      params->agg = parser->MapNext("AVG", AggType::kAvg, "SUM", AggType::kSum, "MIN",
+                                    AggType::kMin, "MAX", AggType::kMax, "COUNT", AggType::kCount,
+                                    "FIRST", AggType::kFirst, "LAST", AggType::kLast);
+      params->bucket_ms = parser->Next<int64_t>();
+      if (params->bucket_ms <= 0)
+        return false;
+    } else if (parser->Check("COUNT")) {
+      params->limit = parser->Next<uint64_t>();
+    } else {
+      return false;
+    }
+  }
+  return !parser->HasError();
+}
+
+// Buckets are aligned to multiples of bucket_ms.
+int64_t BucketStart(int64_t ts, int64_t bucket_ms) {
+  int64_t rem = ts % bucket_ms;
+  return ts - (rem < 0 ? rem + bucket_ms : rem);
+}
+
+void Fold(AggType agg, double value, uint64_t count, double* acc) {
+  switch (agg) {
+    case AggType::kAvg:
+    case AggType::kSum:
+      *acc = count ? *acc + value : value;
+      break;
+    case AggType::kMin:
+      *acc = count ? min(*acc, value) : value;
+      break;
+    case AggType::kMax:
+      *acc = count ? max(*acc, value) : value;
+      break;
+    case AggType::kCount:
+      break;
+    case AggType::kFirst:
+      if (count == 0)
+        *acc = value;
+      break;
+    case AggType::kLast:
+      *acc = value;
+      break;
+  }
+}
+
+// Reads the samples of the range, downsampling them into buckets if aggregation is requested.
+Samples CollectRange(const TimeSeries& ts, const RangeParams& params) {
+  Samples res;
+  if (!params.agg) {
+    ts.Range(params.from, params.to, [&](const TimeSeries::Sample& sample) {
+      res.push_back(sample);
+      return res.size() < params.limit;
+    });
+    return res;
+  }
+
+  AggType agg = *params.agg;
+  int64_t bucket = 0;
+  double acc = 0;
+  uint64_t count = 0;
+  auto flush = [&] {
+    if (count == 0)
+      return;
+    if (agg == AggType::kAvg)
+      acc /= count;
+    else if (agg == AggType::kCount)
+      acc = count;
+    res.push_back({bucket, acc});
+    count = 0;
+  };
+
+  ts.Range(params.from, params.to, [&](const TimeSeries::Sample& sample) {
+    int64_t start = BucketStart(sample.ts, params.bucket_ms);
+    if (count > 0 && start != bucket) {
+      flush();
+      if (res.size() >= params.limit)
+        return false;
+    }
+    bucket = start;
+    Fold(agg, sample.value, count++, &acc);
+    return true;
+  });
+  flush();
+
+  return res;
+}
+
+OpStatus OpCreate(const OpArgs& op_args, string_view key, uint64_t retention_ms) {
+  auto& db_slice = op_args.GetDbSlice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetTimeSeries(retention_ms);
+  return OpStatus::OK;
+}
+
+// Appends a sample, creating the series if needed. Returns the timestamp of the sample.
+OpResult<int64_t> OpAdd(const OpArgs& op_args, string_view key, optional<int64_t> ts,
+                        string_view value_arg, double value, uint64_t retention_ms) {
+  auto& db_slice = op_args.GetDbSlice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+
+  PrimeValue& pv = op_res->it->second;
+  if (op_res->is_new) {
+    pv.SetTimeSeries(retention_ms);
+  } else if (pv.ObjType() != OBJ_TS) {
+    return OpStatus::WRONG_TYPE;
+  }
+
+  int64_t sample_ts = ts.value_or(op_args.db_cntx.time_now_ms);
+  if (!pv.GetTimeSeries()->Add(sample_ts, value))
+    return OpStatus::OUT_OF_RANGE;
+
+  // Replicate with the resolved timestamp, so that '*' is not evaluated again on replicas.
+  if (op_args.shard->journal()) {
+    string ts_str = absl::StrCat(sample_ts);
+    string retention_str = absl::StrCat(retention_ms);
+    RecordJournal(op_args, "TS.ADD"sv,
+                  ArgSlice{key, ts_str, value_arg, "RETENTION"sv, retention_str});
+  }
+  return sample_ts;
+}
+
+OpResult<Samples> OpRange(const OpArgs& op_args, string_view key, const RangeParams& params) {
+  auto it_res = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_TS);
+  if (!it_res)
+    return it_res.status();
+
+  return CollectRange(*(*it_res)->second.GetTimeSeries(), params);
+}
+
+// Runs the range query over all the keys of the shard. Missing keys are skipped.
+OpStatus OpMRange(Transaction* t, EngineShard* shard, const RangeParams& params,
+                  ShardSeries* dest) {
+  ShardArgs keys = t->GetShardArgs(shard->shard_id());
+  auto& db_slice = t->GetDbSlice(shard->shard_id());
+
+  for (auto it = keys.begin(); it != keys.end(); ++it) {
+    auto it_res = db_slice.FindReadOnly(t->GetDbContext(), *it, OBJ_TS);
+    if (it_res.status() == OpStatus::KEY_NOTFOUND)
+      continue;
+    if (!it_res)
+      return it_res.status();
+
+    dest->emplace_back(it.index(), CollectRange(*(*it_res)->second.GetTimeSeries(), params));
+  }
+  return OpStatus::OK;
+}
+
+void SendSamples(const Samples& samples, RedisReplyBuilder* rb) {
+  rb->StartArray(samples.size());
+  for (const auto& sample : samples) {
+    rb->StartArray(2);
+    rb->SendLong(sample.ts);
+    rb->SendDouble(sample.value);
+  }
+}
+
+}  // namespace
+
+void TimeSeriesFamily::Create(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  uint64_t retention_ms = 0;
+  parser.Check("RETENTION", &retention_ms);
+
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCreate(t->GetOpArgs(shard), key, retention_ms);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::KEY_EXISTS) {
+    return cntx->SendError("TSDB: key already exists");
+  }
+  return cntx->SendError(res);
+}
+
+void TimeSeriesFamily::Add(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  auto [key, ts_arg, value_arg] = parser.Next<string_view, string_view, string_view>();
+  uint64_t retention_ms = 0;
+  parser.Check("RETENTION", &retention_ms);
+
+  if (!parser.Finalize())
+    return cntx->SendError(kSyntaxErr);
+
+  optional<int64_t> ts;
+  if (ts_arg != "*") {
+    int64_t val;
+    if (!absl::SimpleAtoi(ts_arg, &val))
+      return cntx->SendError("TSDB: invalid timestamp");
+    ts = val;
+  }
+
+  double value;
+  if (!absl::SimpleAtod(value_arg, &value))
+    return cntx->SendError("TSDB: invalid value");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpAdd(t->GetOpArgs(shard), key, ts, value_arg, value, retention_ms);
+  };
+
+  OpResult<int64_t> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (res)
+    return cntx->SendLong(*res);
+  if (res.status() == OpStatus::OUT_OF_RANGE)
+    return cntx->SendError(kOldTimestampErr);
+  return cntx->SendError(res.status());
+}
+
+void TimeSeriesFamily::Get(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  using LastSample = optional<TimeSeries::Sample>;
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<LastSample> {
+    auto it_res = t->GetDbSlice(shard->shard_id()).FindReadOnly(t->GetDbContext(), key, OBJ_TS);
+    if (!it_res)
+      return it_res.status();
+
+    const TimeSeries* ts = (*it_res)->second.GetTimeSeries();
+    return ts->size() ? LastSample{ts->last()} : LastSample{};
+  };
+
+  auto res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (res.status() == OpStatus::KEY_NOTFOUND)
+    return cntx->SendError(kKeyNotFoundErr);
+  if (!res)
+    return cntx->SendError(res.status());
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  if (!*res)
+    return rb->SendEmptyArray();
+
+  rb->StartArray(2);
+  rb->SendLong((*res)->ts);
+  rb->SendDouble((*res)->value);
+}
+
+void TimeSeriesFamily::Range(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  RangeParams params;
+  if (!ParseRangeParams(&parser, &params))
+    return cntx->SendError(kSyntaxErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpRange(t->GetOpArgs(shard), key, params);
+  };
+
+  OpResult<Samples> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (res.status() == OpStatus::KEY_NOTFOUND)
+    return cntx->SendError(kKeyNotFoundErr);
+  if (!res)
+    return cntx->SendError(res.status());
+
+  SendSamples(*res, static_cast<RedisReplyBuilder*>(cntx->reply_builder()));
+}
+
+// TS.MRANGE numkeys key [key ...] from to [AGGREGATION type bucket_ms] [COUNT count]
+// Every shard reads and downsamples its own series in parallel, the coordinator only merges
+// the replies back in the order of the keys.
+void TimeSeriesFamily::MRange(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  uint32_t num_keys = parser.Next<uint32_t>();
+  parser.Skip(num_keys);
+
+  RangeParams params;
+  if (!ParseRangeParams(&parser, &params))
+    return cntx->SendError(kSyntaxErr);
+
+  vector<ShardSeries> shard_series(shard_set->size());
+  vector<OpStatus> shard_status(shard_set->size(), OpStatus::OK);
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    shard_status[sid] = OpMRange(t, shard, params, &shard_series[sid]);
+    return OpStatus::OK;
+  };
+
+  OpStatus status = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  for (OpStatus st : shard_status) {
+    if (st != OpStatus::OK)
+      status = st;
+  }
+  if (status != OpStatus::OK)
+    return cntx->SendError(status);
+
+  // Restore the order of the keys.
+  vector<Samples*> by_key(args.size(), nullptr);
+  size_t found = 0;
+  for (ShardSeries& series : shard_series) {
+    for (auto& [index, samples] : series) {
+      by_key[index] = &samples;
+      ++found;
+    }
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(found);
+  for (size_t i = 0; i < by_key.size(); ++i) {
+    if (!by_key[i])
+      continue;
+    rb->StartArray(3);
+    rb->SendBulkString(ArgS(args, i));
+    rb->SendEmptyArray();  // labels are not supported.
+    SendSamples(*by_key[i], rb);
+  }
+}
+
+void TimeSeriesFamily::Info(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  struct InfoResult {
+    size_t total_samples, memory_usage;
+    uint64_t retention_ms;
+    uint32_t chunk_count;
+    int64_t first_ts = 0, last_ts = 0;
+  };
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<InfoResult> {
+    auto it_res = t->GetDbSlice(shard->shard_id()).FindReadOnly(t->GetDbContext(), key, OBJ_TS);
+    if (!it_res)
+      return it_res.status();
+
+    const TimeSeries* ts = (*it_res)->second.GetTimeSeries();
+    InfoResult res{ts->size(), ts->MallocUsed(), ts->retention_ms(), ts->num_chunks()};
+    if (ts->size() > 0) {
+      ts->Range(INT64_MIN, INT64_MAX, [&](const TimeSeries::Sample& sample) {
+        res.first_ts = sample.ts;
+        return false;
+      });
+      res.last_ts = ts->last().ts;
+    }
+    return res;
+  };
+
+  OpResult<InfoResult> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (res.status() == OpStatus::KEY_NOTFOUND)
+    return cntx->SendError(kKeyNotFoundErr);
+  if (!res)
+    return cntx->SendError(res.status());
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartCollection(7, RedisReplyBuilder::MAP);
+  rb->SendSimpleString("totalSamples");
+  rb->SendLong(res->total_samples);
+  rb->SendSimpleString("memoryUsage");
+  rb->SendLong(res->memory_usage);
+  rb->SendSimpleString("firstTimestamp");
+  rb->SendLong(res->first_ts);
+  rb->SendSimpleString("lastTimestamp");
+  rb->SendLong(res->last_ts);
+  rb->SendSimpleString("retentionTime");
+  rb->SendLong(res->retention_ms);
+  rb->SendSimpleString("chunkCount");
+  rb->SendLong(res->chunk_count);
+  rb->SendSimpleString("chunkSize");
+  rb->SendLong(TimeSeries::kMaxChunkBytes);
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&TimeSeriesFamily::x)
+
+void TimeSeriesFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  constexpr uint32_t kWriteMask = CO::WRITE | CO::DENYOOM | CO::FAST;
+  *registry
+      << CI{"TS.CREATE", kWriteMask, -2, 1, 1, acl::TIMESERIES}.HFUNC(Create)
+      << CI{"TS.ADD", kWriteMask | CO::NO_AUTOJOURNAL, -4, 1, 1, acl::TIMESERIES}.HFUNC(Add)
+      << CI{"TS.GET", CO::READONLY | CO::FAST, 2, 1, 1, acl::TIMESERIES}.HFUNC(Get)
+      << CI{"TS.RANGE", CO::READONLY, -4, 1, 1, acl::TIMESERIES}.HFUNC(Range)
+      << CI{"TS.MRANGE", CO::READONLY | CO::VARIADIC_KEYS, -5, 2, 2, acl::TIMESERIES}.HFUNC(
+             MRange)
+      << CI{"TS.INFO", CO::READONLY | CO::FAST, 2, 1, 1, acl::TIMESERIES}.HFUNC(Info);
+};
+
+}  // namespace dfly
@@ -0,0 +1,28 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// Subset of the RedisTimeSeries commands over the compressed TimeSeries type.
+class TimeSeriesFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void Create(CmdArgList args, ConnectionContext* cntx);
+  static void Add(CmdArgList args, ConnectionContext* cntx);
+  static void Get(CmdArgList args, ConnectionContext* cntx);
+  static void Range(CmdArgList args, ConnectionContext* cntx);
+  static void MRange(CmdArgList args, ConnectionContext* cntx);
+  static void Info(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
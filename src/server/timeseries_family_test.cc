@@ -0,0 +1,124 @@
+// Copyright 2025, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/timeseries_family.h"
+
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using testing::ElementsAre;
+
+class TimeSeriesFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(TimeSeriesFamilyTest, Basic) {
+  EXPECT_EQ(Run({"ts.create", "t1"}), "OK");
+  EXPECT_THAT(Run({"ts.create", "t1"}), ErrArg("key already exists"));
+  EXPECT_EQ(Run({"type", "t1"}), "TSDB-TYPE");
+
+  EXPECT_THAT(Run({"ts.add", "t1", "1000", "1.5"}), IntArg(1000));
+  EXPECT_THAT(Run({"ts.add", "t1", "2000", "2.5"}), IntArg(2000));
+  EXPECT_THAT(Run({"ts.add", "t1", "2000", "3"}), ErrArg("timestamp must be greater"));
+  EXPECT_THAT(Run({"ts.add", "t1", "3000", "abc"}), ErrArg("invalid value"));
+
+  auto resp = Run({"ts.get", "t1"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(2000), DoubleArg(2.5))));
+  EXPECT_THAT(Run({"ts.get", "t2"}), ErrArg("key does not exist"));
+
+  // Adding to a missing key creates it.
+  EXPECT_THAT(Run({"ts.add", "t2", "10", "1"}), IntArg(10));
+  EXPECT_THAT(Run({"ts.info", "t2"}), RespArray(testing::Contains("totalSamples")));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"ts.add", "str", "10", "1"}), ErrArg("WRONGTYPE"));
+  EXPECT_THAT(Run({"ts.range", "str", "-", "+"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(TimeSeriesFamilyTest, Range) {
+  for (int i = 0; i < 10; ++i) {
+    Run({"ts.add", "t1", absl::StrCat(i * 100), absl::StrCat(i)});
+  }
+
+  auto resp = Run({"ts.range", "t1", "250", "500"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_THAT(resp.GetVec()[0], RespArray(ElementsAre(IntArg(300), DoubleArg(3))));
+
+  resp = Run({"ts.range", "t1", "-", "+", "COUNT", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[1], RespArray(ElementsAre(IntArg(100), DoubleArg(1))));
+
+  // Buckets [0, 300), [300, 600), [600, 900), [900, 1200).
+  resp = Run({"ts.range", "t1", "-", "+", "AGGREGATION", "avg", "300"});
+  ASSERT_THAT(resp, ArrLen(4));
+  EXPECT_THAT(resp.GetVec()[0], RespArray(ElementsAre(IntArg(0), DoubleArg(1))));
+  EXPECT_THAT(resp.GetVec()[3], RespArray(ElementsAre(IntArg(900), DoubleArg(9))));
+
+  resp = Run({"ts.range", "t1", "100", "+", "AGGREGATION", "max", "500", "COUNT", "1"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(RespArray(ElementsAre(IntArg(0), DoubleArg(4))))));
+
+  resp = Run({"ts.range", "t1", "-", "+", "AGGREGATION", "count", "1000"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(RespArray(ElementsAre(IntArg(0), DoubleArg(10))))));
+
+  EXPECT_THAT(Run({"ts.range", "t1", "-", "+", "AGGREGATION", "median", "10"}),
+              ErrArg("syntax error"));
+  EXPECT_THAT(Run({"ts.range", "t1", "-", "+", "AGGREGATION", "sum", "0"}),
+              ErrArg("syntax error"));
+}
+
+TEST_F(TimeSeriesFamilyTest, Retention) {
+  EXPECT_EQ(Run({"ts.create", "t1", "RETENTION", "1000"}), "OK");
+  for (int i = 0; i < 100; ++i) {
+    Run({"ts.add", "t1", absl::StrCat(i * 100), "1"});
+  }
+
+  auto resp = Run({"ts.range", "t1", "-", "+"});
+  ASSERT_THAT(resp, ArrLen(11));
+  EXPECT_THAT(resp.GetVec()[0], RespArray(ElementsAre(IntArg(8900), DoubleArg(1))));
+}
+
+TEST_F(TimeSeriesFamilyTest, MRange) {
+  Run({"ts.add", "a", "1", "1"});
+  Run({"ts.add", "a", "2", "2"});
+  Run({"ts.add", "b", "1", "10"});
+  Run({"ts.add", "c", "5", "20"});
+
+  auto resp = Run({"ts.mrange", "4", "c", "a", "missing", "b", "-", "2"});
+  ASSERT_THAT(resp, ArrLen(3));
+  const auto& series = resp.GetVec();
+  EXPECT_THAT(series[0], RespArray(ElementsAre("c", ArrLen(0), ArrLen(0))));
+  EXPECT_THAT(series[1].GetVec()[0], "a");
+  EXPECT_THAT(series[1].GetVec()[2], ArrLen(2));
+  EXPECT_THAT(series[2].GetVec()[0], "b");
+
+  resp = Run({"ts.mrange", "2", "a", "b", "-", "+", "AGGREGATION", "sum", "10"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec()[2],
+              RespArray(ElementsAre(RespArray(ElementsAre(IntArg(0), DoubleArg(3))))));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"ts.mrange", "2", "a", "str", "-", "+"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(TimeSeriesFamilyTest, Reload) {
+  Run({"ts.create", "t1", "RETENTION", "100000"});
+  for (int i = 0; i < 5000; ++i) {
+    Run({"ts.add", "t1", absl::StrCat(i * 10), absl::StrCat(i * 0.5)});
+  }
+  size_t len = Run({"ts.range", "t1", "-", "+"}).GetVec().size();
+  EXPECT_EQ(5000u, len);
+
+  EXPECT_EQ(Run({"debug", "reload"}), "OK");
+  auto after = Run({"ts.range", "t1", "-", "+"});
+  ASSERT_THAT(after, ArrLen(len));
+  EXPECT_THAT(after.GetVec().back(), RespArray(ElementsAre(IntArg(49990), DoubleArg(2499.5))));
+
+  // The reloaded series keeps accepting samples.
+  EXPECT_THAT(Run({"ts.add", "t1", "50000", "1"}), IntArg(50000));
+  EXPECT_THAT(Run({"ts.add", "t1", "10", "1"}), ErrArg("timestamp must be greater"));
+}
+
+}  // namespace dfly
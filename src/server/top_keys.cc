@@ -6,8 +6,11 @@
 
 #include <xxhash.h>
 
+#include <cmath>
+
 #include "absl/numeric/bits.h"
 #include "absl/random/distributions.h"
+#include "absl/time/clock.h"
 #include "base/logging.h"
 
 namespace dfly {
@@ -16,14 +19,25 @@ TopKeys::TopKeys(Options options)
     : options_(options), fingerprints_(options.enabled ? options_.buckets * options_.arrays : 0) {
 }
 
-void TopKeys::Touch(std::string_view key) {
-  if (!IsEnabled()) {
-    return;
+void TopKeys::TouchSampled(std::string_view key, uint64_t bytes) {
+  // Draw the distance to the next sampled touch from a geometric distribution, so that periodic
+  // access patterns do not alias with the sampling.
+  if (options_.sample_rate > 1) {
+    const double u = absl::Uniform(absl::IntervalOpenOpen, bitgen_, 0.0, 1.0);
+    const double skip = std::log(u) / std::log1p(-1.0 / options_.sample_rate);
+    until_sample_ = 1 + static_cast<int64_t>(skip);
+  } else {
+    until_sample_ = 1;
+  }
+
+  if (options_.decay_period_ms) {
+    MaybeDecay(absl::GetCurrentTimeNanos() / 1000000);
   }
 
   auto ResetCell = [&](Cell& cell, uint64_t fingerprint) {
     cell.fingerprint = fingerprint;
     cell.count = 1;
+    cell.bytes = bytes;
     if (cell.count >= options_.min_key_count_to_record) {
       cell.key = key;
     }
@@ -45,6 +59,7 @@ void TopKeys::Touch(std::string_view key) {
       // We could make sure that, if !cell.key.empty(), then key == cell.key.empty() here. However,
       // what do we do in case they are different?
       ++cell.count;
+      cell.bytes += bytes;
 
       if (cell.count >= options_.min_key_count_to_record && cell.key.empty()) {
         cell.key = key;
@@ -72,13 +87,61 @@ absl::flat_hash_map<std::string, uint64_t> TopKeys::GetTopKeys() const {
     for (uint64_t bucket = 0; bucket < options_.buckets; ++bucket) {
       const Cell& cell = GetCell(array, bucket);
       if (!cell.key.empty()) {
-        results[cell.key] = std::max(results[cell.key], cell.count);
+        results[cell.key] = std::max(results[cell.key], cell.count * options_.sample_rate);
       }
     }
   }
   return results;
 }
 
+std::vector<TopKeys::Entry> TopKeys::GetTopEntries() const {
+  if (!IsEnabled()) {
+    return {};
+  }
+
+  // A key may be recorded in several arrays; take the cell with the highest count, which was
+  // least affected by collisions.
+  absl::flat_hash_map<std::string_view, const Cell*> best;
+  for (const Cell& cell : fingerprints_) {
+    if (cell.key.empty())
+      continue;
+    const Cell*& dest = best[cell.key];
+    if (dest == nullptr || dest->count < cell.count)
+      dest = &cell;
+  }
+
+  std::vector<Entry> results;
+  results.reserve(best.size());
+  for (const auto& [key, cell] : best) {
+    results.push_back(Entry{std::string{key}, cell->count * options_.sample_rate,
+                            cell->bytes * options_.sample_rate});
+  }
+  return results;
+}
+
+void TopKeys::MaybeDecay(uint64_t now_ms) {
+  if (!IsEnabled() || options_.decay_period_ms == 0)
+    return;
+
+  if (next_decay_ms_ == 0) {
+    next_decay_ms_ = now_ms + options_.decay_period_ms;
+    return;
+  }
+  if (now_ms < next_decay_ms_)
+    return;
+
+  const uint64_t periods = (now_ms - next_decay_ms_) / options_.decay_period_ms + 1;
+  next_decay_ms_ += periods * options_.decay_period_ms;
+  const unsigned shift = std::min<uint64_t>(periods, 63);
+
+  for (Cell& cell : fingerprints_) {
+    cell.count >>= shift;
+    cell.bytes >>= shift;
+    if (cell.count < options_.min_key_count_to_record)
+      cell.key.clear();
+  }
+}
+
 bool TopKeys::IsEnabled() const {
   return options_.enabled;
 }
@@ -20,6 +20,11 @@ namespace dfly {
 // - For every used key k, call Touch(k)
 // - At some point(s) in time, call GetTopKeys() to get an estimated list of top keys along with
 //   their approximate count (i.e. how many times Touch() was invoked for them).
+// - With sample_rate N > 1 only about every N-th Touch() updates the sketch; reported counts are
+//   scaled back by N. Skipped touches cost a single decrement, so the class can stay enabled on
+//   the lookup path.
+// - With a decay period set, all counts are halved once per period, so the reported keys reflect
+//   recent traffic rather than the whole uptime.
 //
 // Notes:
 // - This class implements a slightly modified version of HeavyKeeper, a data structure designed
@@ -41,14 +46,42 @@ class TopKeys {
     // low value for high load is frequent string copying and memory allocation.
     uint64_t min_key_count_to_record = 100;
 
+    // Update the sketch for 1 out of sample_rate touches on average.
+    uint32_t sample_rate = 1;
+
+    // Halve all counts every decay_period_ms milliseconds. 0 disables decay.
+    uint64_t decay_period_ms = 0;
+
     // Pass false to disable, making this class no-op.
     bool enabled = true;
   };
 
+  struct Entry {
+    std::string key;
+    uint64_t count = 0;  // Estimated number of touches, scaled by sample_rate.
+    uint64_t bytes = 0;  // Estimated number of bytes served, scaled by sample_rate.
+  };
+
   explicit TopKeys(Options options);
 
-  void Touch(std::string_view key);
+  void Touch(std::string_view key) {
+    Touch(key, [] { return uint64_t{0}; });
+  }
+
+  // bytes_fn returns the size of the value served by this access. It is called only for the
+  // sampled accesses.
+  template <typename F> void Touch(std::string_view key, F&& bytes_fn) {
+    if (!options_.enabled || --until_sample_ > 0)
+      return;
+    TouchSampled(key, bytes_fn());
+  }
+
   absl::flat_hash_map<std::string, uint64_t> GetTopKeys() const;
+  std::vector<Entry> GetTopEntries() const;
+
+  // Applies the pending halvings if the decay period passed. Called by Touch() on sampled
+  // accesses, call it before reading the keys of an idle table.
+  void MaybeDecay(uint64_t now_ms);
 
   bool IsEnabled() const;
 
@@ -58,13 +91,17 @@ class TopKeys {
   struct Cell {
     uint64_t fingerprint = 0;
     uint64_t count = 0;
+    uint64_t bytes = 0;
     std::string key;
   };
+  void TouchSampled(std::string_view key, uint64_t bytes);
   Cell& GetCell(uint64_t array, uint64_t bucket);
   const Cell& GetCell(uint64_t array, uint64_t bucket) const;
 
   Options options_;
   absl::BitGen bitgen_;
+  int64_t until_sample_ = 1;
+  uint64_t next_decay_ms_ = 0;
 
   // fingerprints_'s size is options_.buckets * options_.arrays. Always access fields via GetCell().
   std::vector<Cell> fingerprints_;
@@ -5,6 +5,7 @@
 #include "server/top_keys.h"
 
 #include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
 #include <gmock/gmock.h>
 
 #include "base/gtest.h"
@@ -146,4 +147,57 @@ TEST(TopKeysTest, SavedByMultipleArrays) {
   }
 }
 
+TEST(TopKeysTest, Sampling) {
+  TopKeys top_keys({.min_key_count_to_record = 1, .sample_rate = 10});
+  for (int i = 0; i < 10000; ++i) {
+    top_keys.Touch("key1");
+  }
+
+  auto top_keys_table = top_keys.GetTopKeys();
+  // Counts are scaled back by the sample rate.
+  EXPECT_GE(top_keys_table["key1"], 8000);
+  EXPECT_LE(top_keys_table["key1"], 12000);
+}
+
+TEST(TopKeysTest, BytesServed) {
+  TopKeys top_keys({.min_key_count_to_record = 1});
+  for (int i = 0; i < 3; ++i) {
+    top_keys.Touch("key1", [] { return 100; });
+  }
+  top_keys.Touch("key2", [] { return 1000; });
+
+  auto entries = top_keys.GetTopEntries();
+  ASSERT_EQ(entries.size(), 2u);
+  for (const auto& entry : entries) {
+    if (entry.key == "key1") {
+      EXPECT_EQ(entry.count, 3u);
+      EXPECT_EQ(entry.bytes, 300u);
+    } else {
+      EXPECT_EQ(entry.key, "key2");
+      EXPECT_EQ(entry.count, 1u);
+      EXPECT_EQ(entry.bytes, 1000u);
+    }
+  }
+}
+
+TEST(TopKeysTest, Decay) {
+  const uint64_t kPeriodMs = 3600'000;
+  TopKeys top_keys({.min_key_count_to_record = 2, .decay_period_ms = kPeriodMs});
+  uint64_t now_ms = absl::GetCurrentTimeNanos() / 1000000;
+  for (int i = 0; i < 8; ++i) {
+    top_keys.Touch("key1");
+  }
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key1", 8)));
+
+  top_keys.MaybeDecay(now_ms + kPeriodMs / 2);
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key1", 8)));
+
+  top_keys.MaybeDecay(now_ms + kPeriodMs + kPeriodMs / 2);
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key1", 4)));
+
+  // Two more periods pass, the count drops below min_key_count_to_record.
+  top_keys.MaybeDecay(now_ms + 3 * kPeriodMs + kPeriodMs / 2);
+  EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre());
+}
+
 }  // end of namespace dfly
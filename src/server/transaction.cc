@@ -4,12 +4,14 @@
 
 #include "server/transaction.h"
 
+#include <absl/base/internal/cycleclock.h>
 #include <absl/strings/match.h>
 
 #include <new>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/usdt.h"
 #include "facade/op_status.h"
 #include "redis/redis_aux.h"
 #include "server/blocking_controller.h"
@@ -23,6 +25,11 @@
 ABSL_FLAG(uint32_t, tx_queue_warning_len, 96,
           "Length threshold for warning about long transaction queue");
 
+ABSL_FLAG(bool, tx_optimistic_multi_shard_writes, false,
+          "Lets idempotent multi shard writes like MSET and DEL run on arrival in every shard "
+          "where their keys are not locked, saving a hop. Their effects may then become visible "
+          "in some shards before others. Not used while the journal is active.");
+
 namespace dfly {
 
 using namespace std;
@@ -30,6 +37,7 @@ using namespace util;
 using absl::StrCat;
 
 thread_local Transaction::TLTmpSpace Transaction::tmp_space;
+thread_local Transaction::TLPool Transaction::tl_pool;
 
 namespace {
 
@@ -203,6 +211,62 @@ Transaction::Transaction(const Transaction* parent, ShardId shard_id,
   }
 }
 
+Transaction* Transaction::Create(const CommandId* cid) {
+  auto& stats = ServerState::tlocal()->stats;
+  auto& entries = tl_pool.entries;
+  if (entries.empty()) {
+    stats.tx_pool_misses++;
+    Transaction* res = new Transaction{cid};
+    res->pooled_ = true;
+    return res;
+  }
+
+  stats.tx_pool_hits++;
+  TLPool::Entry entry = std::move(entries.back());
+  entries.pop_back();
+
+  Transaction* res = new (entry.mem) Transaction{cid};
+  res->shard_data_ = std::move(entry.shard_data);
+  res->args_slices_ = std::move(entry.args_slices);
+  res->kv_fp_ = std::move(entry.kv_fp);
+  res->pooled_ = true;
+  return res;
+}
+
+void Transaction::Recycle(Transaction* trans) noexcept {
+  // Bounds the memory held by the pool, especially with connections migrating between threads
+  // where transactions are released on a different thread than the one that created them.
+  constexpr size_t kMaxPoolSize = 256;
+
+  auto& entries = tl_pool.entries;
+  if (!trans->pooled_ || entries.size() >= kMaxPoolSize) {
+    delete trans;
+    return;
+  }
+
+  TLPool::Entry entry{trans};
+  entry.shard_data = std::move(trans->shard_data_);
+  entry.args_slices = std::move(trans->args_slices_);
+  entry.kv_fp = std::move(trans->kv_fp_);
+
+  // erase() keeps the allocated capacity unlike clear().
+  entry.shard_data.erase(entry.shard_data.begin(), entry.shard_data.end());
+  entry.args_slices.erase(entry.args_slices.begin(), entry.args_slices.end());
+  entry.kv_fp.erase(entry.kv_fp.begin(), entry.kv_fp.end());
+
+  trans->~Transaction();
+  entries.push_back(std::move(entry));
+}
+
+// TLPool releases raw memory with the aligned operator delete.
+static_assert(alignof(Transaction) > __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+Transaction::TLPool::~TLPool() {
+  for (auto& entry : entries) {
+    ::operator delete(entry.mem, std::align_val_t{alignof(Transaction)});
+  }
+}
+
 Transaction::~Transaction() {
   DVLOG(3) << "Transaction " << StrCat(Name(), "@", txid_, "/", unique_shard_cnt_, ")")
            << " destroyed";
@@ -593,7 +657,9 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
 
   /*************************************************************************/
 
+  DFLY_TRACE(tx_run_start, txid_, shard->shard_id(), txq_ooo);
   RunCallback(shard);
+  DFLY_TRACE(tx_run_done, txid_, shard->shard_id());
 
   /*************************************************************************/
   // at least the coordinator thread owns the reference.
@@ -662,8 +728,21 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
 void Transaction::RunCallback(EngineShard* shard) {
   DCHECK_EQ(shard, EngineShard::tlocal());
 
-  RunnableResult result;
   auto& db_slice = GetDbSlice(shard->shard_id());
+  uint64_t start_ns = 0;
+  size_t ram_misses = 0;
+  if (track_phases_) {
+    auto& sd = shard_data_[SidToId(shard->shard_id())];
+    start_ns = ProactorBase::GetMonotonicTimeNs();
+    ram_misses = db_slice.GetEvents().ram_misses;
+    if (sd.queue_start_ns) {
+      sd.queue_usec += (start_ns - sd.queue_start_ns) / 1000;
+      sd.queue_start_ns = 0;
+    }
+  }
+
+  uint64_t start_cycles = absl::base_internal::CycleClock::Now();
+  RunnableResult result;
   try {
     result = (*cb_ptr_)(this, shard);
 
@@ -688,6 +767,15 @@ void Transaction::RunCallback(EngineShard* shard) {
   }
 
   db_slice.OnCbFinish();
+  shard->stats().tx_exec_cycles += absl::base_internal::CycleClock::Now() - start_cycles;
+
+  if (start_ns) {
+    auto& sd = shard_data_[SidToId(shard->shard_id())];
+    sd.exec_usec += (ProactorBase::GetMonotonicTimeNs() - start_ns) / 1000;
+    size_t misses_after = db_slice.GetEvents().ram_misses;
+    // Events may be reset by CONFIG RESETSTAT while the callback runs.
+    sd.tiered_reads += misses_after >= ram_misses ? misses_after - ram_misses : misses_after;
+  }
 
   // Handle result flags to alter behaviour.
   if (result.flags & RunnableResult::AVOID_CONCLUDING) {
@@ -715,16 +803,28 @@ void Transaction::ScheduleInternal() {
   DCHECK_GT(unique_shard_cnt_, 0u);
   DCHECK(!IsAtomicMulti() || cid_->IsMultiTransactional());
 
+  uint64_t start_ns = track_phases_ ? ProactorBase::GetMonotonicTimeNs() : 0;
+
   // Try running immediately (during scheduling) if we're concluding and either:
   // - have a single shard, and thus never have to cancel scheduling due to reordering
   // - run as an idempotent command, meaning we can safely repeat the operation if scheduling fails
+  bool idempotent = cid_->opt_mask() & CO::IDEMPOTENT;
+
+  // Idempotent writes that fail scheduling in one shard are repeated in the others. Partial runs
+  // would be journaled with a txid that never completes on replicas, hence not with a journal.
+  if (idempotent && !cid_->IsReadOnly()) {
+    idempotent = absl::GetFlag(FLAGS_tx_optimistic_multi_shard_writes) &&
+                 ServerState::tlocal()->journal() == nullptr;
+  }
+
   bool optimistic_exec = !IsGlobal() && (coordinator_state_ & COORD_CONCLUDING) &&
-                         (unique_shard_cnt_ == 1 || (cid_->opt_mask() & CO::IDEMPOTENT));
+                         (unique_shard_cnt_ == 1 || idempotent);
 
   DVLOG(1) << "ScheduleInternal " << cid_->name() << " on " << unique_shard_cnt_ << " shards "
            << " optimistic_execution: " << optimistic_exec;
 
   auto is_active = [this](uint32_t i) { return IsActive(i); };
+  DFLY_TRACE(tx_schedule_start, this, cid_->name().data(), unique_shard_cnt_, optimistic_exec);
 
   // Loop until successfully scheduled in all shards.
   while (true) {
@@ -814,6 +914,33 @@ void Transaction::ScheduleInternal() {
 
   coordinator_state_ |= COORD_SCHED;
   RecordTxScheduleStats(this);
+  DFLY_TRACE(tx_schedule_done, this, txid_, unique_shard_cnt_);
+
+  if (start_ns)
+    schedule_usec_ += (ProactorBase::GetMonotonicTimeNs() - start_ns) / 1000;
+}
+
+void Transaction::EnablePhaseTimings() {
+  DCHECK_EQ(coordinator_state_ & COORD_SCHED, 0);
+  track_phases_ = true;
+  schedule_usec_ = hop_cnt_ = 0;
+  for (auto& sd : shard_data_) {
+    sd.queue_start_ns = 0;
+    sd.queue_usec = sd.exec_usec = sd.tiered_reads = 0;
+  }
+}
+
+Transaction::PhaseTimings Transaction::GetPhaseTimings() const {
+  PhaseTimings res;
+  res.schedule_usec = schedule_usec_;
+  res.hops = hop_cnt_;
+  res.shards = unique_shard_cnt_;
+  for (const auto& sd : shard_data_) {
+    res.queue_usec = max(res.queue_usec, sd.queue_usec);
+    res.exec_usec = max(res.exec_usec, sd.exec_usec);
+    res.tiered_reads += sd.tiered_reads;
+  }
+  return res;
 }
 
 // Runs in the coordinator fiber.
@@ -871,6 +998,8 @@ void Transaction::Execute(RunnableType cb, bool conclude) {
     ScheduleInternal();
   }
 
+  if (track_phases_)
+    hop_cnt_++;
   DispatchHop();
   run_barrier_.Wait();
   cb_ptr_ = nullptr;
@@ -1048,6 +1177,32 @@ pair<uint16_t, bool> Transaction::DisarmInShardWhen(ShardId sid, uint16_t releva
   return {0, false};
 }
 
+bool Transaction::MaybeMarkOutOfOrder(EngineShard* shard) {
+  auto& sd = shard_data_[SidToId(shard->shard_id())];
+  if (sd.local_mask & OUT_OF_ORDER)
+    return true;
+
+  // Blocking transactions are ordered by the queue when they are suspended or awaked.
+  if (unique_shard_cnt_ != 1 || IsGlobal() || multi_ ||
+      (sd.local_mask & (SUSPENDED_Q | AWAKED_Q)) || (sd.local_mask & KEYLOCK_ACQUIRED) == 0)
+    return false;
+
+  IntentLock::Mode mode = LockMode();
+  if (!shard->shard_lock()->Check(mode))
+    return false;
+
+  // The transaction holds its own intents, so its keys are free if nobody else records one.
+  KeyLockArgs lock_args = GetLockArgs(shard->shard_id());
+  const DbTable* table = GetDbSlice(shard->shard_id()).GetDBTable(lock_args.db_index);
+  for (LockFp fp : lock_args.fps) {
+    if (table->trans_locks.Find(fp)->IsContended())
+      return false;
+  }
+
+  sd.local_mask |= OUT_OF_ORDER;
+  return true;
+}
+
 bool Transaction::IsActive(ShardId sid) const {
   // If we have only one shard, we often don't store infromation about all shards, so determine it
   // solely by id
@@ -1079,6 +1234,9 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
   DCHECK_EQ(sd.local_mask & KEYLOCK_ACQUIRED, 0);
   sd.local_mask &= ~(OUT_OF_ORDER | OPTIMISTIC_EXECUTION);
 
+  if (track_phases_)
+    sd.queue_start_ns = ProactorBase::GetMonotonicTimeNs();
+
   TxQueue* txq = shard->txq();
   KeyLockArgs lock_args;
   IntentLock::Mode mode = LockMode();
@@ -1098,6 +1256,22 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
     lock_args = GetLockArgs(shard->shard_id());
     bool shard_unlocked = shard->shard_lock()->Check(mode);
 
+    // Read-only callbacks do not preempt, so a read-only command on a single shard can run
+    // without taking its intent locks if no other transaction holds conflicting ones.
+    if (shard_unlocked && execute_optimistic && unique_shard_cnt_ == 1 &&
+        (cid_->opt_mask() & CO::READONLY) &&
+        GetDbSlice(shard->shard_id()).CheckLock(mode, lock_args)) {
+      sd.local_mask |= OPTIMISTIC_EXECUTION;
+      shard->stats().tx_optimistic_total++;
+      shard->stats().tx_optimistic_unlocked_total++;
+
+      RunCallback(shard);
+
+      if (coordinator_state_ & COORD_CONCLUDING)
+        return true;
+      // Otherwise the command continues with more hops and must lock its keys as usual.
+    }
+
     // We need to acquire the fp locks because the executing callback
     // within RunCallback below might preempt.
     bool keys_unlocked = GetDbSlice(shard->shard_id()).Acquire(mode, lock_args);
@@ -1111,7 +1285,8 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
     DVLOG(3) << "Lock granted " << lock_granted << " for trans " << DebugId();
 
     // Check if we can run immediately
-    if (shard_unlocked && execute_optimistic && lock_granted) {
+    if (shard_unlocked && execute_optimistic && lock_granted &&
+        (sd.local_mask & OPTIMISTIC_EXECUTION) == 0) {
       sd.local_mask |= OPTIMISTIC_EXECUTION;
       shard->stats().tx_optimistic_total++;
 
@@ -1152,6 +1327,7 @@ bool Transaction::ScheduleInShard(EngineShard* shard, bool execute_optimistic) {
   TxQueue::Iterator it = txq->Insert(this);
   DCHECK_EQ(TxQueue::kEnd, sd.pq_pos);
   sd.pq_pos = it;
+  DFLY_TRACE(tx_queued, txid_, shard->shard_id(), txq->size());
 
   AnalyzeTxQueue(shard, txq);
   DVLOG(1) << "Insert into tx-queue, sid(" << sid << ") " << DebugId() << ", qlen " << txq->size();
@@ -1245,7 +1421,8 @@ ShardArgs Transaction::GetShardArgs(ShardId sid) const {
 }
 
 OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_provider,
-                                  KeyReadyChecker krc, bool* block_flag, bool* pause_flag) {
+                                  KeyReadyChecker krc, bool* block_flag, bool* pause_flag,
+                                  RunnableType* deliver_cb) {
   if (blocking_barrier_.IsClaimed()) {  // Might have been cancelled ahead by a dropping connection
     Conclude();
     return OpStatus::CANCELLED;
@@ -1253,6 +1430,10 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_p
 
   DCHECK(!IsAtomicMulti());  // blocking inside MULTI is not allowed
 
+  // Shards read it until the transaction leaves their watch queues below.
+  deliver_cb_ = deliver_cb;
+  block_delivered_ = false;
+
   // Register keys on active shards blocking controllers and mark shard state as suspended.
   auto cb = [&](Transaction* t, EngineShard* shard) {
     auto keys = wkeys_provider(t, shard);
@@ -1289,9 +1470,12 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_p
   }
 
   // If we don't follow up with an "action" hop, we must clean up manually on all shards.
-  if (result != OpStatus::OK)
+  if (result != OpStatus::OK || block_delivered_)
     ExpireBlocking(wkeys_provider);
+  else if (deliver_cb)
+    Execute(*deliver_cb, true);
 
+  deliver_cb_ = nullptr;
   return result;
 }
 
@@ -1407,6 +1591,39 @@ bool Transaction::NotifySuspended(TxId committed_txid, ShardId sid, string_view
   DVLOG(1) << "NotifySuspended " << DebugId() << ", local_mask:" << sd.local_mask
            << " by commited_id " << committed_txid;
 
+  AwakeSuspendedShard(sid, key);
+  blocking_barrier_.Close();
+  return true;
+}
+
+bool Transaction::DeliverSuspended(EngineShard* shard, string_view key) {
+  DCHECK(CanDeliverSuspended());
+  if (!blocking_barrier_.TryClaim())
+    return false;
+
+  ShardId sid = shard->shard_id();
+  DVLOG(1) << "DeliverSuspended " << DebugId(sid);
+
+  // The callback finds the key with GetWakeKey, like in the concluding hop of awaked transactions.
+  AwakeSuspendedShard(sid, key);
+  RunnableResult result = (*deliver_cb_)(this, shard);
+  GetDbSlice(sid).OnCbFinish();
+
+  // We run inside the notification of the blocking controller that must not preempt, so the
+  // entry is written to the sink by the next journal write or the heartbeat.
+  LogAutoJournalOnShard(shard, result, false);
+  MaybeInvokeTrackingCb();
+
+  // The keys stay locked until the coordinator expires the watch.
+  shard_data_[SidToId(sid)].local_mask &= ~AWAKED_Q;
+  block_delivered_ = true;
+  blocking_barrier_.Close();
+  return true;
+}
+
+void Transaction::AwakeSuspendedShard(ShardId sid, string_view key) {
+  auto& sd = shard_data_[SidToId(sid)];
+
   // We're the first and only to wake this transaction, expect the shard to be suspended
   CHECK(sd.local_mask & SUSPENDED_Q);
   CHECK_EQ(sd.local_mask & AWAKED_Q, 0);
@@ -1420,9 +1637,6 @@ bool Transaction::NotifySuspended(TxId committed_txid, ShardId sid, string_view
   sd.local_mask &= ~SUSPENDED_Q;
   sd.local_mask |= AWAKED_Q;
   sd.wake_key_pos = it.index();
-
-  blocking_barrier_.Close();
-  return true;
 }
 
 optional<string_view> Transaction::GetWakeKey(ShardId sid) const {
@@ -1434,7 +1648,8 @@ optional<string_view> Transaction::GetWakeKey(ShardId sid) const {
   return ArgS(full_args_, sd.wake_key_pos);
 }
 
-void Transaction::LogAutoJournalOnShard(EngineShard* shard, RunnableResult result) {
+void Transaction::LogAutoJournalOnShard(EngineShard* shard, RunnableResult result,
+                                        bool allow_await) {
   // TODO: For now, we ignore non shard coordination.
   if (shard == nullptr)
     return;
@@ -1455,7 +1670,8 @@ void Transaction::LogAutoJournalOnShard(EngineShard* shard, RunnableResult resul
     // We log NOOP even for NO_AUTOJOURNAL commands because the non-success status could have been
     // due to OOM in a single shard, while other shards succeeded
     journal->RecordEntry(txid_, journal::Op::NOOP, db_index_, unique_shard_cnt_,
-                         unique_slot_checker_.GetUniqueSlotId(), journal::Entry::Payload{}, true);
+                         unique_slot_checker_.GetUniqueSlotId(), journal::Entry::Payload{},
+                         allow_await);
     return;
   }
 
@@ -1464,7 +1680,8 @@ void Transaction::LogAutoJournalOnShard(EngineShard* shard, RunnableResult resul
   // from callbacks does not allow await.
   // To make sure we flush the changes to sync we call TriggerJournalWriteToSink here.
   if ((cid_->opt_mask() & CO::NO_AUTOJOURNAL) && !re_enabled_auto_journal_) {
-    TriggerJournalWriteToSink();
+    if (allow_await)
+      TriggerJournalWriteToSink();
     return;
   }
 
@@ -1478,7 +1695,7 @@ void Transaction::LogAutoJournalOnShard(EngineShard* shard, RunnableResult resul
   }
   // Record to journal autojournal commands, here we allow await which anables writing to sync
   // the journal change.
-  LogJournalOnShard(shard, std::move(entry_payload), unique_shard_cnt_, true);
+  LogJournalOnShard(shard, std::move(entry_payload), unique_shard_cnt_, allow_await);
 }
 
 void Transaction::LogJournalOnShard(EngineShard* shard, journal::Entry::Payload&& payload,
@@ -1568,8 +1785,8 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
       return OpStatus::SYNTAX_ERR;
     }
 
-    if (absl::EndsWith(name, "STORE"))
-      bonus = 0;  // Z<xxx>STORE <key> commands
+    if (absl::EndsWith(name, "STORE") || name == "CMS.MERGE")
+      bonus = 0;  // Z<xxx>STORE <key> and CMS.MERGE <key> commands
 
     unsigned num_keys_index;
     if (absl::StartsWith(name, "EVAL"))
@@ -101,10 +101,14 @@ class Transaction {
   friend void intrusive_ptr_release(Transaction* trans) noexcept {
     if (1 == trans->use_count_.fetch_sub(1, std::memory_order_release)) {
       std::atomic_thread_fence(std::memory_order_acquire);
-      delete trans;
+      Recycle(trans);
     }
   }
 
+  // Returns trans to the pool of the current thread if it was created with Create(),
+  // otherwise deletes it.
+  static void Recycle(Transaction* trans) noexcept;
+
  public:
   // Result returned by callbacks. Most should use the implicit conversion from OpStatus.
   struct RunnableResult {
@@ -183,6 +187,10 @@ class Transaction {
 
   explicit Transaction(const CommandId* cid);
 
+  // Same as `new Transaction{cid}` but reuses the memory and the inner buffers of transactions
+  // recycled on this thread. Meant for the per-command transactions created on the hot path.
+  static Transaction* Create(const CommandId* cid);
+
   // Initialize transaction for squashing placed on a specific shard with a given parent tx
   explicit Transaction(const Transaction* parent, ShardId shard_id,
                        std::optional<cluster::SlotId> slot_id);
@@ -217,13 +225,27 @@ class Transaction {
   // or b) tp is reached. If tp is time_point::max() then waits indefinitely.
   // Expects that the transaction had been scheduled before, and uses Execute(.., true) to register.
   // Returns false if timeout occurred, true if was notified by one of the keys.
+  // If deliver_cb is set, it is run as the concluding hop once notified. A single shard
+  // transaction is then run by the notifying shard itself, see DeliverSuspended.
   facade::OpStatus WaitOnWatch(const time_point& tp, WaitKeysProvider cb, KeyReadyChecker krc,
-                               bool* block_flag, bool* pause_flag);
+                               bool* block_flag, bool* pause_flag,
+                               RunnableType* deliver_cb = nullptr);
 
   // Returns true if transaction is awaked, false if it's timed-out and can be removed from the
   // blocking queue.
   bool NotifySuspended(TxId committed_ts, ShardId sid, std::string_view key);
 
+  // Whether the suspended transaction can be run with DeliverSuspended instead of being awaked.
+  bool CanDeliverSuspended() const {
+    return deliver_cb_ != nullptr && unique_shard_cnt_ == 1;
+  }
+
+  // Runs the callback passed to WaitOnWatch on the shard that found the key ready, and wakes the
+  // coordinator only to release the locks. Unlike awaked transactions, which halt the shard queue
+  // for a hop each, a notification serves all the ready waiters of a key in a single pass.
+  // Returns false if the transaction was already awaked or expired.
+  bool DeliverSuspended(EngineShard* shard, std::string_view key);
+
   // Cancel all blocking watches. Set COORD_CANCELLED.
   // Must be called from coordinator thread.
   void CancelBlocking(std::function<OpStatus(ArgSlice)>);
@@ -266,6 +288,11 @@ class Transaction {
   // If the transaction is armed, returns the local mask and a flag whether it was disarmed.
   std::pair<uint16_t, bool /* disarmed */> DisarmInShardWhen(ShardId sid, uint16_t req_flags);
 
+  // Marks a queued single shard transaction as out of order if none of its keys is contended by
+  // other transactions anymore, so it can run before the head of the queue. Returns true if the
+  // transaction is out of order. Safe only when the transaction is armed.
+  bool MaybeMarkOutOfOrder(EngineShard* shard);
+
   // Returns if the transaction spans this shard. Safe only when the transaction is armed.
   bool IsActive(ShardId sid) const;
 
@@ -368,6 +395,26 @@ class Transaction {
     return shard_data_[SidToId(sid)].local_mask;
   }
 
+  // Latency of the phases of a transaction, used to tell where a slow command spends its time.
+  struct PhaseTimings {
+    uint32_t schedule_usec = 0;  // scheduling on all shards
+    uint32_t queue_usec = 0;     // waiting in a shard queue until the first callback, slowest shard
+    uint32_t exec_usec = 0;      // running callbacks over all hops, slowest shard
+    uint32_t hops = 0;
+    uint32_t shards = 0;
+    uint32_t tiered_reads = 0;  // values read from disk by the callbacks, all shards
+  };
+
+  // Starts collecting phase timings, must be called before the transaction is scheduled.
+  void EnablePhaseTimings();
+
+  // Returns the timings collected since EnablePhaseTimings(), once the transaction concluded.
+  PhaseTimings GetPhaseTimings() const;
+
+  bool PhaseTimingsEnabled() const {
+    return track_phases_;
+  }
+
   void SetTrackingCallback(std::function<void(Transaction* trans)> f) {
     tracking_cb_ = std::move(f);
   }
@@ -430,8 +477,14 @@ class Transaction {
       unsigned total_runs = 0;  // total number of runs
     } stats;
 
+    // Phase timings, only set if they are enabled for the transaction.
+    uint64_t queue_start_ns = 0;  // when the shard started scheduling the transaction
+    uint32_t queue_usec = 0;
+    uint32_t exec_usec = 0;
+    uint32_t tiered_reads = 0;
+
     // Prevent "false sharing" between cache lines: occupy a full cache line (64 bytes)
-    char pad[64 - 7 * sizeof(uint32_t) - sizeof(Stats)];
+    char pad[64 - 10 * sizeof(uint32_t) - sizeof(uint64_t) - sizeof(Stats)];
   };
 
   static_assert(sizeof(PerShardData) == 64);  // cacheline
@@ -559,7 +612,11 @@ class Transaction {
 
   // Log command in shard's journal, if this is a write command with auto-journaling enabled.
   // Should be called immediately after the last hop.
-  void LogAutoJournalOnShard(EngineShard* shard, RunnableResult shard_result);
+  void LogAutoJournalOnShard(EngineShard* shard, RunnableResult shard_result,
+                             bool allow_await = true);
+
+  // Marks the suspended shard as awaked by the key.
+  void AwakeSuspendedShard(ShardId sid, std::string_view key);
 
   // Whether the callback can be run directly on this thread without dispatching on the shard queue
   bool CanRunInlined() const;
@@ -619,9 +676,10 @@ class Transaction {
   // Set if a NO_AUTOJOURNAL command asked to enable auto journal again
   bool re_enabled_auto_journal_ = false;
 
-  RunnableType* cb_ptr_ = nullptr;    // Run on shard threads
-  const CommandId* cid_ = nullptr;    // Underlying command
-  std::unique_ptr<MultiData> multi_;  // Initialized when the transaction is multi/exec.
+  RunnableType* cb_ptr_ = nullptr;      // Run on shard threads
+  RunnableType* deliver_cb_ = nullptr;  // Set by WaitOnWatch while watching.
+  const CommandId* cid_ = nullptr;      // Underlying command
+  std::unique_ptr<MultiData> multi_;    // Initialized when the transaction is multi/exec.
 
   TxId txid_{0};
   bool global_{false};
@@ -640,10 +698,16 @@ class Transaction {
   // Stores status if COORD_CANCELLED was set. Apart from cancelled, it can be moved for cluster
   // changes
   OpStatus block_cancel_result_ = OpStatus::OK;
+  // Set by DeliverSuspended before it closes blocking_barrier_.
+  bool block_delivered_ = false;
 
   // Transaction coordinator state, written and read by coordinator thread.
   uint8_t coordinator_state_ = 0;
 
+  bool track_phases_ = false;   // set by EnablePhaseTimings
+  uint32_t schedule_usec_ = 0;  // time spent in ScheduleInternal if track_phases_ is set
+  uint32_t hop_cnt_ = 0;        // hops executed if track_phases_ is set
+
   // Result of callbacks. Usually written by single shard only, lock below for multishard oom error
   OpStatus local_result_ = OpStatus::OK;
   absl::base_internal::SpinLock local_result_mu_;
@@ -665,6 +729,25 @@ class Transaction {
   };
 
   static thread_local TLTmpSpace tmp_space;
+
+  // Thread local pool of destroyed transactions. Keeps their raw memory together with
+  // the cleared inner vectors, so that heap storage allocated for wide transactions is reused.
+  struct TLPool {
+    struct Entry {
+      void* mem;
+      decltype(shard_data_) shard_data;
+      decltype(args_slices_) args_slices;
+      decltype(kv_fp_) kv_fp;
+    };
+
+    ~TLPool();
+
+    std::vector<Entry> entries;
+  };
+
+  static thread_local TLPool tl_pool;
+
+  bool pooled_ = false;  // Created with Create() and eligible for recycling.
 };
 
 template <typename F> auto Transaction::ScheduleSingleHopT(F&& f) -> decltype(f(this, nullptr)) {
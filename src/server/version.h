@@ -33,8 +33,14 @@ enum class DflyVersion {
   // - Periodic lag checks from master to replica
   VER4,
 
+  // - Stable sync journal stream can be lz4 compressed on replica request
+  VER5,
+
+  // - LSN markers of the stable sync stream carry the master time
+  VER6,
+
   // Always points to the latest version
-  CURRENT_VER = VER4,
+  CURRENT_VER = VER6,
 };
 
 }  // namespace dfly
@@ -19,6 +19,7 @@ extern "C" {
 
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/listpack_find.h"
 #include "core/sorted_map.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/error.h"
@@ -68,9 +69,12 @@ struct GeoPoint {
   double score;
   std::string member;
   GeoPoint() : longitude(0.0), latitude(0.0), dist(0.0), score(0.0){};
-  GeoPoint(double _longitude, double _latitude, double _dist, double _score,
-           const std::string& _member)
-      : longitude(_longitude), latitude(_latitude), dist(_dist), score(_score), member(_member){};
+  GeoPoint(double _longitude, double _latitude, double _dist, double _score, std::string _member)
+      : longitude(_longitude),
+        latitude(_latitude),
+        dist(_dist),
+        score(_score),
+        member(std::move(_member)){};
 };
 using GeoArray = std::vector<GeoPoint>;
 
@@ -134,11 +138,23 @@ zlexrangespec GetLexRange(bool reverse, const ZSetFamily::LexInterval& li) {
  * taken from t_zset.c
  */
 
+// zzlFind with the vectorized member search.
+uint8_t* ZzlFind(uint8_t* lp, sds ele, double* score) {
+  uint8_t* eptr = lpFirst(lp);
+  if (eptr == nullptr)
+    return nullptr;
+
+  eptr = LpFindStr(lp, eptr, string_view{ele, sdslen(ele)}, 1);
+  if (eptr && score)
+    *score = zzlGetScore(lpNext(lp, eptr));
+  return eptr;
+}
+
 int ZsetDel(detail::RobjWrapper* robj_wrapper, sds ele) {
   if (robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK) {
     unsigned char* eptr;
     uint8_t* lp = (uint8_t*)robj_wrapper->inner_obj();
-    if ((eptr = zzlFind(lp, ele, NULL)) != NULL) {
+    if ((eptr = ZzlFind(lp, ele, NULL)) != NULL) {
       lp = lpDeleteRangeWithEntry(lp, &eptr, 2);
       robj_wrapper->set_inner_obj(lp);
       return 1;
@@ -155,7 +171,7 @@ int ZsetDel(detail::RobjWrapper* robj_wrapper, sds ele) {
 std::optional<double> GetZsetScore(const detail::RobjWrapper* robj_wrapper, sds member) {
   if (robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK) {
     double score;
-    if (zzlFind((uint8_t*)robj_wrapper->inner_obj(), member, &score) == NULL)
+    if (ZzlFind((uint8_t*)robj_wrapper->inner_obj(), member, &score) == NULL)
       return std::nullopt;
     return score;
   }
@@ -173,6 +189,7 @@ struct ZParams {
   unsigned flags = 0;  // mask of ZADD_IN_ macros.
   bool ch = false;     // Corresponds to CH option.
   bool override = false;
+  bool unique = false;  // members are distinct, so a new sorted map can be bulk loaded
 };
 
 void OutputScoredArrayResult(const OpResult<ScoredArray>& result,
@@ -719,7 +736,7 @@ void SendAtLeastOneKeyError(ConnectionContext* cntx) {
 enum class AggType : uint8_t { SUM, MIN, MAX, NOOP };
 using ScoredMap = absl::flat_hash_map<std::string, double>;
 
-ScoredMap FromObject(const CompactObj& co, double weight) {
+ScoredArray FromObjectArr(const CompactObj& co, double weight) {
   ZSetFamily::RangeParams params;
   params.with_scores = true;
   // RANGE is a read-only operation, but requires const_cast
@@ -727,26 +744,21 @@ ScoredMap FromObject(const CompactObj& co, double weight) {
   vis(ZSetFamily::IndexInterval(0, -1));
 
   ScoredArray arr = vis.PopResult();
-  ScoredMap res;
-  res.reserve(arr.size());
-
   for (auto& elem : arr) {
     elem.second *= weight;
     if (isnan(elem.second))
       elem.second = 0;
-    res.emplace(std::move(elem));
   }
-
-  return res;
+  return arr;
 }
 
-ScoredMap ScoreMapFromSet(const PrimeValue& pv, double weight) {
-  ScoredMap result;
-  container_utils::IterateSet(pv, [&result, weight](container_utils::ContainerEntry ce) {
-    result.emplace(ce.ToString(), weight);
-    return true;
-  });
-  return result;
+ScoredMap FromObject(const CompactObj& co, double weight) {
+  ScoredArray arr = FromObjectArr(co, weight);
+  ScoredMap res;
+  res.reserve(arr.size());
+  for (auto& elem : arr)
+    res.emplace(std::move(elem));
+  return res;
 }
 
 double Aggregate(double v1, double v2, AggType atype) {
@@ -764,73 +776,102 @@ double Aggregate(double v1, double v2, AggType atype) {
   return 0;
 }
 
-// the result is in the destination.
-void UnionScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
-  ScoredMap* target = dest;
-  ScoredMap* iter = src;
-
-  if (iter->size() > target->size())
-    swap(target, iter);
+// Members with their scores sorted by member. Shards produce them and the coordinator merges
+// them in a single pass, which takes less memory than hash maps of the same members.
+using SortedScoredVec = vector<pair<string, double>>;
 
-  for (const auto& elem : *iter) {
-    auto [it, inserted] = target->emplace(elem);
-    if (!inserted) {
-      it->second = Aggregate(it->second, elem.second, agg_type);
-    }
+SortedScoredVec SortedFromObject(const PrimeValue& pv, double weight) {
+  SortedScoredVec res;
+  if (pv.ObjType() == OBJ_ZSET) {
+    res = FromObjectArr(pv, weight);
+  } else {
+    DCHECK_EQ(pv.ObjType(), OBJ_SET);
+    container_utils::IterateSet(pv, [&res, weight](container_utils::ContainerEntry ce) {
+      res.emplace_back(ce.ToString(), weight);
+      return true;
+    });
   }
 
-  if (target != dest)
-    dest->swap(*src);
+  sort(res.begin(), res.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+  return res;
 }
 
-void InterScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
-  ScoredMap* target = dest;
-  ScoredMap* iter = src;
+// K-way merge of inputs sorted by member. Union keeps all the members, intersection only those
+// present in every input. Scores of a member are aggregated in the order of the inputs.
+SortedScoredVec MergeSorted(vector<SortedScoredVec>* inputs, AggType agg_type, bool is_union) {
+  vector<SortedScoredVec>& in = *inputs;
+  if (in.empty())
+    return {};
+  if (in.size() == 1)
+    return std::move(in.front());
+
+  size_t reserve = 0;
+  for (const auto& vec : in) {
+    if (!is_union && vec.empty())
+      return {};
+    reserve = max(reserve, vec.size());
+  }
 
-  if (iter->size() > target->size())
-    swap(target, iter);
+  vector<size_t> pos(in.size(), 0);
+  auto cur = [&](unsigned i) -> const string& { return in[i][pos[i]].first; };
 
-  auto it = iter->begin();
-  while (it != iter->end()) {
-    auto inter_it = target->find(it->first);
-    if (inter_it == target->end()) {
-      auto copy_it = it++;
-      iter->erase(copy_it);
+  // Min heap by the current member of each input, ties are broken by input order.
+  auto greater = [&](unsigned a, unsigned b) {
+    int cmp = cur(a).compare(cur(b));
+    return cmp != 0 ? cmp > 0 : a > b;
+  };
+  vector<unsigned> heap;
+  for (unsigned i = 0; i < in.size(); ++i) {
+    if (!in[i].empty())
+      heap.push_back(i);
+  }
+  make_heap(heap.begin(), heap.end(), greater);
+
+  // Pops the input at the top of the heap and pushes it back if it has more members.
+  bool exhausted = false;
+  auto advance = [&] {
+    pop_heap(heap.begin(), heap.end(), greater);
+    unsigned i = heap.back();
+    if (++pos[i] < in[i].size()) {
+      push_heap(heap.begin(), heap.end(), greater);
     } else {
-      it->second = Aggregate(it->second, inter_it->second, agg_type);
-      ++it;
+      heap.pop_back();
+      exhausted = true;
     }
-  }
+  };
 
-  if (iter != dest)
-    dest->swap(*src);
-}
+  SortedScoredVec res;
+  res.reserve(reserve);
+  while (!heap.empty()) {
+    unsigned i = heap.front();
+    size_t p = pos[i];
+    advance();
 
-using KeyIterWeightVec = vector<pair<DbSlice::ConstIterator, double>>;
+    // The heap does not reference the member anymore, so it can be moved.
+    string member = std::move(in[i][p].first);
+    double score = in[i][p].second;
+    unsigned count = 1;
 
-ScoredMap UnionShardKeysWithScore(const KeyIterWeightVec& key_iter_weight_vec, AggType agg_type) {
-  ScoredMap result;
-  for (const auto& [it, weight] : key_iter_weight_vec) {
-    if (it.is_done()) {
-      continue;
+    while (!heap.empty() && cur(heap.front()) == member) {
+      unsigned j = heap.front();
+      score = Aggregate(score, in[j][pos[j]].second, agg_type);
+      ++count;
+      advance();
     }
 
-    ScoredMap sm;
-    if (it->second.ObjType() == OBJ_ZSET)
-      sm = FromObject(it->second, weight);
-    else {
-      DCHECK_EQ(it->second.ObjType(), OBJ_SET);
-      sm = ScoreMapFromSet(it->second, weight);
-    }
-    if (result.empty()) {
-      result.swap(sm);
-    } else {
-      UnionScoredMap(&result, &sm, agg_type);
-    }
+    if (is_union || count == in.size())
+      res.emplace_back(std::move(member), score);
+
+    // Members of an exhausted input are all behind us.
+    if (!is_union && exhausted)
+      break;
   }
-  return result;
+
+  return res;
 }
 
+using KeyIterWeightVec = vector<pair<DbSlice::ConstIterator, double>>;
+
 double GetKeyWeight(const vector<double>& weights, unsigned windex) {
   if (weights.empty()) {
     return 1;
@@ -890,52 +931,40 @@ OpResult<KeyIterWeightVec> PrepareWeightedSets(const Transaction& trans, bool st
   return key_weight_vec;
 }
 
-OpResult<ScoredMap> OpUnion(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
-                            const vector<double>& weights, bool store) {
+// Returns the merge of the sets of the shard, see MergeSorted.
+OpResult<SortedScoredVec> OpSetOp(EngineShard* shard, Transaction* t, string_view dest,
+                                  AggType agg_type, const vector<double>& weights, bool store,
+                                  bool is_union) {
   OpResult<KeyIterWeightVec> key_vec_res = PrepareWeightedSets(*t, store, dest, weights, shard);
   if (!key_vec_res)
     return key_vec_res.status();
 
   // Only dest is hosted on this shard.
   if (key_vec_res->empty())
-    return OpStatus::OK;
-
-  return UnionShardKeysWithScore(*key_vec_res, agg_type);
-}
-
-OpResult<ScoredMap> OpInter(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
-                            const vector<double>& weights, bool store) {
-  OpResult<KeyIterWeightVec> key_vec_res = PrepareWeightedSets(*t, store, dest, weights, shard);
-  if (!key_vec_res)
-    return key_vec_res.status();
+    return is_union ? OpStatus::OK : OpStatus::SKIPPED;
 
-  // Only dest is hosted on this shard.
-  if (key_vec_res->empty())
-    return OpStatus::SKIPPED;
-
-  ScoredMap result;
+  vector<SortedScoredVec> inputs;
+  inputs.reserve(key_vec_res->size());
   for (const auto& [it, weight] : *key_vec_res) {
     if (it.is_done()) {
-      return ScoredMap{};
+      if (!is_union)
+        return SortedScoredVec{};
+      continue;
     }
+    inputs.push_back(SortedFromObject(it->second, weight));
+  }
 
-    ScoredMap sm;
-    if (it->second.ObjType() == OBJ_ZSET)
-      sm = FromObject(it->second, weight);
-    else {
-      DCHECK_EQ(it->second.ObjType(), OBJ_SET);
-      sm = ScoreMapFromSet(it->second, weight);
-    }
-    if (result.empty())
-      result.swap(sm);
-    else
-      InterScoredMap(&result, &sm, agg_type);
+  return MergeSorted(&inputs, agg_type, is_union);
+}
 
-    if (result.empty())
-      return result;
-  }
+OpResult<SortedScoredVec> OpUnion(EngineShard* shard, Transaction* t, string_view dest,
+                                  AggType agg_type, const vector<double>& weights, bool store) {
+  return OpSetOp(shard, t, dest, agg_type, weights, store, true);
+}
 
-  return result;
+OpResult<SortedScoredVec> OpInter(EngineShard* shard, Transaction* t, string_view dest,
+                                  AggType agg_type, const vector<double>& weights, bool store) {
+  return OpSetOp(shard, t, dest, agg_type, weights, store, false);
 }
 
 using ScoredMemberView = std::pair<double, std::string_view>;
@@ -988,6 +1017,20 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, const ZParams& zparams, string_
   detail::RobjWrapper* robj_wrapper = res_it->it->second.GetRobjWrapper();
   bool is_list_pack = robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK;
 
+  // A new sorted map of distinct members is bulk loaded, without looking members up.
+  if (zparams.override && zparams.unique && !is_list_pack) {
+    detail::SortedMap* sm = (detail::SortedMap*)robj_wrapper->inner_obj();
+    if (sm->Size() == 0 && std::is_sorted(members.begin(), members.end())) {
+      sm->InsertSorted(members);
+    } else {
+      sm->Reserve(members.size());
+      for (const auto& m : members)
+        sm->InsertNew(m.first, m.second);
+    }
+    aresult.num_updated = members.size();
+    return aresult;
+  }
+
   // opportunistically reserve space if multiple entries are about to be added.
   if ((zparams.flags & ZADD_IN_XX) == 0 && members.size() > 2) {
     if (is_list_pack) {
@@ -1061,30 +1104,20 @@ void HandleOpStatus(ConnectionContext* cntx, OpStatus op_status) {
   }
 }
 
-OpResult<ScoredMap> IntersectResults(vector<OpResult<ScoredMap>>& results, AggType agg_type) {
-  ScoredMap result;
-  for (auto& op_res : results) {
+// Merges the results of the shards, skipping the shards that did not run.
+OpResult<SortedScoredVec> MergeResults(vector<OpResult<SortedScoredVec>>* results,
+                                       AggType agg_type, bool is_union) {
+  vector<SortedScoredVec> inputs;
+  for (auto& op_res : *results) {
     if (op_res.status() == OpStatus::SKIPPED)
       continue;
 
     if (!op_res) {
       return op_res.status();
     }
-
-    if (op_res->empty()) {
-      return ScoredMap{};
-    }
-
-    if (result.empty()) {
-      result.swap(op_res.value());
-    } else {
-      InterScoredMap(&result, &op_res.value(), agg_type);
-    }
-
-    if (result.empty())
-      break;
+    inputs.push_back(std::move(op_res.value()));
   }
-  return result;
+  return MergeSorted(&inputs, agg_type, is_union);
 }
 
 OpResult<void> FillAggType(string_view agg, SetOpArgs* op_args) {
@@ -1352,24 +1385,6 @@ auto OpRange(const ZSetFamily::ZRangeSpec& range_spec, const OpArgs& op_args, st
   return iv.PopResult();
 }
 
-auto OpRanges(const std::vector<ZSetFamily::ZRangeSpec>& range_specs, const OpArgs& op_args,
-              string_view key) -> OpResult<vector<ScoredArray>> {
-  auto res_it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
-  if (!res_it)
-    return res_it.status();
-
-  // Action::RANGE is read-only, but requires mutable pointer, thus const_cast
-  PrimeValue& pv = const_cast<PrimeValue&>(res_it.value()->second);
-  vector<ScoredArray> result_arrays;
-  for (auto& range_spec : range_specs) {
-    IntervalVisitor iv{Action::RANGE, range_spec.params, &pv};
-    std::visit(iv, range_spec.interval);
-    result_arrays.push_back(iv.PopResult());
-  }
-
-  return result_arrays;
-}
-
 OpResult<unsigned> OpRemRange(const OpArgs& op_args, string_view key,
                               const ZSetFamily::ZRangeSpec& range_spec) {
   auto& db_slice = op_args.GetDbSlice();
@@ -1727,7 +1742,6 @@ double ExtractUnit(std::string_view arg) {
 // Boolean operation: union or intersection, optionally storing output to destination key
 void ZBooleanOperation(CmdArgList args, ConnectionContext* cntx, bool is_union, bool store) {
   auto shard_func = is_union ? OpUnion : OpInter;
-  auto merge_func = is_union ? UnionScoredMap : InterScoredMap;
 
   string_view dest_key = ArgS(args, 0);
   OpResult<SetOpArgs> op_args = ParseSetOpArgs(args, store);
@@ -1737,7 +1751,7 @@ void ZBooleanOperation(CmdArgList args, ConnectionContext* cntx, bool is_union,
   if (op_args->num_keys == 0)
     return SendAtLeastOneKeyError(cntx);
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size(), OpStatus::SKIPPED);
+  vector<OpResult<SortedScoredVec>> maps(shard_set->size(), OpStatus::SKIPPED);
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] =
         shard_func(shard, t, dest_key, op_args->agg_type, op_args->weights, store);
@@ -1746,44 +1760,32 @@ void ZBooleanOperation(CmdArgList args, ConnectionContext* cntx, bool is_union,
   cntx->transaction->Execute(cb, !store /* if we don't store, conclude */);
 
   // Merge results from all shards
-  ScoredMap result;
-  for (auto& op_res : maps) {
-    if (op_res.status() == OpStatus::SKIPPED)
-      continue;
-    if (!op_res) {
-      if (store) {
-        cntx->transaction->Conclude();
-      }
-      return cntx->SendError(op_res.status());
+  OpResult<SortedScoredVec> result = MergeResults(&maps, op_args->agg_type, is_union);
+  maps.clear();
+  if (!result) {
+    if (store) {
+      cntx->transaction->Conclude();
     }
-
-    if (result.empty())
-      result = std::move(op_res.value());
-    else
-      merge_func(&result, &op_res.value(), op_args->agg_type);
-
-    if (result.empty() && !is_union)  // intersection only shrinks
-      break;
+    return cntx->SendError(result.status());
   }
 
-  // Copy to vector for sorting
-  vector<ScoredMemberView> smvec(result.size());
+  // Sorted by score, both for the reply and for bulk loading the destination.
+  vector<ScoredMemberView> smvec(result->size());
   size_t i = 0;
-  for (const auto& [str, score] : result)
+  for (const auto& [str, score] : *result)
     smvec[i++] = {score, str};
+  std::sort(std::begin(smvec), std::end(smvec));
 
   if (store) {
-    // TODO: Use variant collection to avoid smvec copy for store operation
-    auto store_cb = [&, dest_shard = Shard(dest_key, maps.size())](Transaction* t,
-                                                                   EngineShard* shard) {
+    auto store_cb = [&, dest_shard = Shard(dest_key, shard_set->size())](Transaction* t,
+                                                                        EngineShard* shard) {
       if (shard->shard_id() == dest_shard)
-        OpAdd(t->GetOpArgs(shard), ZParams{.override = true}, dest_key, smvec);
+        OpAdd(t->GetOpArgs(shard), ZParams{.override = true, .unique = true}, dest_key, smvec);
       return OpStatus::OK;
     };
     cntx->transaction->Execute(store_cb, true);
     cntx->SendLong(smvec.size());
   } else {
-    std::sort(std::begin(smvec), std::end(smvec));
 
     // We can't use SendScoredArray because it expects strings, not string_views
     // TOOD: Not longer relevant with new io, use scoping
@@ -1798,6 +1800,15 @@ void ZBooleanOperation(CmdArgList args, ConnectionContext* cntx, bool is_union,
   }
 }
 
+enum class ZAddOpt : uint8_t { XX, NX, GT, LT, CH, INCR };
+
+constexpr auto kZAddOpts = MakeTagTable<ZAddOpt>({{"XX", ZAddOpt::XX},
+                                                  {"NX", ZAddOpt::NX},
+                                                  {"GT", ZAddOpt::GT},
+                                                  {"LT", ZAddOpt::LT},
+                                                  {"CH", ZAddOpt::CH},
+                                                  {"INCR", ZAddOpt::INCR}});
+
 }  // namespace
 
 void ZSetFamily::BZPopMin(CmdArgList args, ConnectionContext* cntx) {
@@ -1814,22 +1825,29 @@ void ZSetFamily::ZAdd(CmdArgList args, ConnectionContext* cntx) {
   ZParams zparams;
   size_t i = 1;
   for (; i < args.size() - 1; ++i) {
-    string cur_arg = absl::AsciiStrToUpper(ArgS(args, i));
-
-    if (cur_arg == "XX") {
-      zparams.flags |= ZADD_IN_XX;  // update only
-    } else if (cur_arg == "NX") {
-      zparams.flags |= ZADD_IN_NX;  // add new only.
-    } else if (cur_arg == "GT") {
-      zparams.flags |= ZADD_IN_GT;
-    } else if (cur_arg == "LT") {
-      zparams.flags |= ZADD_IN_LT;
-    } else if (cur_arg == "CH") {
-      zparams.ch = true;
-    } else if (cur_arg == "INCR") {
-      zparams.flags |= ZADD_IN_INCR;
-    } else {
+    optional<ZAddOpt> opt = kZAddOpts.Find(ArgS(args, i));
+    if (!opt)
       break;
+
+    switch (*opt) {
+      case ZAddOpt::XX:
+        zparams.flags |= ZADD_IN_XX;  // update only
+        break;
+      case ZAddOpt::NX:
+        zparams.flags |= ZADD_IN_NX;  // add new only.
+        break;
+      case ZAddOpt::GT:
+        zparams.flags |= ZADD_IN_GT;
+        break;
+      case ZAddOpt::LT:
+        zparams.flags |= ZADD_IN_LT;
+        break;
+      case ZAddOpt::CH:
+        zparams.ch = true;
+        break;
+      case ZAddOpt::INCR:
+        zparams.flags |= ZADD_IN_INCR;
+        break;
     }
   }
 
@@ -2070,7 +2088,7 @@ void ZSetFamily::ZInterCard(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendError(kSyntaxErr);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size(), OpStatus::SKIPPED);
+  vector<OpResult<SortedScoredVec>> maps(shard_set->size(), OpStatus::SKIPPED);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] = OpInter(shard, t, "", AggType::NOOP, {}, false);
@@ -2079,7 +2097,7 @@ void ZSetFamily::ZInterCard(CmdArgList args, ConnectionContext* cntx) {
 
   cntx->transaction->ScheduleSingleHop(std::move(cb));
 
-  OpResult<ScoredMap> result = IntersectResults(maps, AggType::NOOP);
+  OpResult<SortedScoredVec> result = MergeResults(&maps, AggType::NOOP, false);
   if (!result)
     return cntx->SendError(result.status());
 
@@ -2480,8 +2498,8 @@ void ZSetFamily::ZRangeInternal(CmdArgList args, RangeParams range_params,
       mvec[i++] = {score, str};
     }
 
-    add_result =
-        OpAdd(t->GetOpArgs(shard), ZParams{.override = true}, *range_params.store_key, mvec);
+    add_result = OpAdd(t->GetOpArgs(shard), ZParams{.override = true, .unique = true},
+                       *range_params.store_key, mvec);
 
     return OpStatus::OK;
   };
@@ -2692,7 +2710,8 @@ void ZSetFamily::GeoDist(CmdArgList args, ConnectionContext* cntx) {
 }
 
 namespace {
-std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
+// Returns the score ranges of the geohash box of the shape and of its neighbors.
+vector<zrangespec> GetGeoRanges(const GeoHashRadius& n) {
   array<GeoHashBits, 9> neighbors;
   unsigned int last_processed = 0;
 
@@ -2706,8 +2725,8 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
   neighbors[7] = n.neighbors.south_east;
   neighbors[8] = n.neighbors.south_west;
 
-  // Get range_specs for neighbors (*and* our own hashbox)
-  std::vector<ZSetFamily::ZRangeSpec> range_specs;
+  // Get ranges for neighbors (*and* our own hashbox)
+  vector<zrangespec> ranges;
   for (unsigned int i = 0; i < neighbors.size(); i++) {
     if (HASHISZERO(neighbors[i])) {
       continue;
@@ -2724,19 +2743,44 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
 
     GeoHashFix52Bits min, max;
     scoresOfGeoHashBox(neighbors[i], &min, &max);
+    ranges.push_back({.min = double(min), .max = double(max), .minex = 0, .maxex = 1});
 
-    ZSetFamily::ScoreInterval si;
-    si.first = ZSetFamily::Bound{static_cast<double>(min), false};
-    si.second = ZSetFamily::Bound{static_cast<double>(max), true};
+    last_processed = i;
+  }
+  return ranges;
+}
 
-    ZSetFamily::RangeParams range_params;
-    range_params.interval_type = ZSetFamily::RangeParams::IntervalType::SCORE;
-    range_params.with_scores = true;
-    range_specs.emplace_back(si, range_params);
+// Calls cb(member, score) for the members of the sorted set with a score within range, without
+// copying them. Stops once cb returns false and returns false in this case.
+bool IterateScoreRange(const detail::RobjWrapper* robj_wrapper, const zrangespec& range,
+                       absl::FunctionRef<bool(string_view, double)> cb) {
+  if (robj_wrapper->encoding() == OBJ_ENCODING_SKIPLIST) {
+    auto* zs = static_cast<const detail::SortedMap*>(robj_wrapper->inner_obj());
+    return zs->IterateScoreRange(range, cb);
+  }
 
-    last_processed = i;
+  CHECK_EQ(robj_wrapper->encoding(), OBJ_ENCODING_LISTPACK);
+  uint8_t* zl = (uint8_t*)robj_wrapper->inner_obj();
+  uint8_t* eptr = zzlFirstInRange(zl, &range);
+  uint8_t* sptr = eptr ? lpNext(zl, eptr) : nullptr;
+  while (eptr) {
+    double score = zzlGetScore(sptr);
+    if (!zslValueLteMax(score, &range))
+      break;
+
+    unsigned int vlen = 0;
+    long long vlong = 0;
+    uint8_t* vstr = lpGetValue(eptr, &vlen, &vlong);
+    char buf[32];
+    if (!vstr) {
+      vstr = (uint8_t*)buf;
+      vlen = absl::numbers_internal::FastIntToBuffer(vlong, buf) - buf;
+    }
+    if (!cb(string_view{(char*)vstr, vlen}, score))
+      return false;
+    zzlNext(zl, &eptr, &sptr);
   }
-  return range_specs;
+  return true;
 }
 
 void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
@@ -2752,7 +2796,7 @@ void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
     }
   };
 
-  if (count > 0) {
+  if (count > 0 && count < ga->size()) {
     std::partial_sort(ga->begin(), ga->begin() + count, ga->end(), comparator);
     ga->resize(count);
   } else {
@@ -2760,9 +2804,59 @@ void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
   }
 }
 
+// Collects the members within the shape. Candidates of the geohash boxes are tested while the
+// sorted set is iterated, so only the members within the shape are copied. COUNT ANY stops at
+// the first count matches, and a sorted COUNT keeps only the count best matches in a bounded
+// heap instead of collecting the whole area.
+OpResult<GeoArray> OpGeoSearch(const OpArgs& op_args, string_view key, GeoShape* shape,
+                               const vector<zrangespec>& ranges, const GeoSearchOpts& geo_ops) {
+  auto res_it = op_args.GetDbSlice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
+  if (!res_it)
+    return res_it.status();
+
+  auto worse = [&](const GeoPoint& a, const GeoPoint& b) {
+    return geo_ops.sorting == Sorting::kDesc ? a.dist > b.dist : a.dist < b.dist;
+  };
+  const bool bounded = geo_ops.count > 0 && !geo_ops.any && geo_ops.sorting != Sorting::kUnsorted;
+
+  GeoArray ga;
+  auto cb = [&](string_view member, double score) {
+    double xy[2];
+    double distance;
+    if (geoWithinShape(shape, score, xy, &distance) != 0)
+      return true;
+
+    if (bounded && ga.size() == geo_ops.count) {
+      // The heap front is the worst of the kept points, skip candidates that are not better.
+      GeoPoint& top = ga.front();
+      if (!(geo_ops.sorting == Sorting::kDesc ? distance > top.dist : distance < top.dist))
+        return true;
+      std::pop_heap(ga.begin(), ga.end(), worse);
+      ga.back() = GeoPoint{xy[0], xy[1], distance, score, string{member}};
+      std::push_heap(ga.begin(), ga.end(), worse);
+      return true;
+    }
+
+    ga.emplace_back(xy[0], xy[1], distance, score, string{member});
+    if (bounded && ga.size() == geo_ops.count)
+      std::make_heap(ga.begin(), ga.end(), worse);
+    return !geo_ops.any || ga.size() < geo_ops.count;
+  };
+
+  const detail::RobjWrapper* robj_wrapper = res_it.value()->second.GetRobjWrapper();
+  for (const zrangespec& range : ranges) {
+    if (!IterateScoreRange(robj_wrapper, range, cb))
+      break;
+  }
+  return ga;
+}
+
 void GeoSearchStoreGeneric(ConnectionContext* cntx, const GeoShape& shape_ref, string_view key,
-                           string_view member, const GeoSearchOpts& geo_ops) {
+                           string_view member, GeoSearchOpts geo_ops) {
   GeoShape* shape = &(const_cast<GeoShape&>(shape_ref));
+  // COUNT without ANY returns the nearest members, like in Redis.
+  if (geo_ops.count > 0 && !geo_ops.any && geo_ops.sorting == Sorting::kUnsorted)
+    geo_ops.sorting = Sorting::kAsc;
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
 
   ShardId from_shard = Shard(key, shard_set->size());
@@ -2820,34 +2914,16 @@ void GeoSearchStoreGeneric(ConnectionContext* cntx, const GeoShape& shape_ref, s
 
   // query
   GeoHashRadius georadius = geohashCalculateAreasByShapeWGS84(shape);
-  GeoArray ga;
-  auto range_specs = GetGeoRangeSpec(georadius);
-  // get all the matching members and add them to the potential result list
-  vector<OpResult<vector<ScoredArray>>> result_arrays;
+  auto ranges = GetGeoRanges(georadius);
+  OpResult<GeoArray> result;
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    auto res_it = OpRanges(range_specs, t->GetOpArgs(shard), key);
-    if (res_it) {
-      result_arrays.emplace_back(res_it);
+    if (shard->shard_id() == from_shard) {
+      result = OpGeoSearch(t->GetOpArgs(shard), key, shape, ranges, geo_ops);
     }
     return OpStatus::OK;
   };
   cntx->transaction->Execute(std::move(cb), geo_ops.store == GeoStoreType::kNoStore);
-
-  // filter potential result list
-  double xy[2];
-  double distance;
-  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
-  for (auto& result_array : result_arrays) {
-    for (auto& arr : *result_array) {
-      for (auto& p : arr) {
-        if (geoWithinShape(shape, p.second, xy, &distance) == 0) {
-          ga.emplace_back(xy[0], xy[1], distance, p.second, p.first);
-          if (limit > 0 && ga.size() >= limit)
-            break;
-        }
-      }
-    }
-  }
+  GeoArray ga = result ? std::move(*result) : GeoArray{};
 
   // sort and trim by count
   SortIfNeeded(&ga, geo_ops.sorting, geo_ops.count);
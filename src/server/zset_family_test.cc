@@ -616,6 +616,37 @@ TEST_F(ZSetFamilyTest, ZUnionStore) {
   EXPECT_THAT(resp.GetVec(), ElementsAre("b", "2", "c", "3"));
 }
 
+// Many members, spread over shards and over set and sorted set sources.
+TEST_F(ZSetFamilyTest, ZUnionInterStoreLarge) {
+  constexpr unsigned kNum = 2000;
+  vector<string> z1 = {"zadd", "z1"}, z2 = {"zadd", "z2"}, s3 = {"sadd", "s3"};
+  for (unsigned i = 0; i < kNum; ++i) {
+    z1.insert(z1.end(), {absl::StrCat(i), absl::StrCat("m", i)});
+    z2.insert(z2.end(), {absl::StrCat(2 * i), absl::StrCat("m", i * 2)});
+    if (i % 4 == 0)
+      s3.push_back(absl::StrCat("m", i));
+  }
+  Run(absl::MakeSpan(z1));
+  Run(absl::MakeSpan(z2));
+  Run(absl::MakeSpan(s3));
+
+  // m0..m1999 and the even m2000..m3998.
+  EXPECT_EQ(3000, CheckedInt({"zunionstore", "u", "2", "z1", "z2"}));
+  EXPECT_EQ(Run({"zscore", "u", "m10"}), "20");
+  EXPECT_EQ(Run({"zscore", "u", "m3998"}), "3998");
+  EXPECT_THAT(Run({"zrange", "u", "0", "2"}).GetVec(), ElementsAre("m0", "m1", "m3"));
+
+  EXPECT_EQ(500, CheckedInt({"zinterstore", "i", "3", "z1", "z2", "s3", "aggregate", "max"}));
+  EXPECT_EQ(Run({"zscore", "i", "m8"}), "8");
+  EXPECT_THAT(Run({"zscore", "i", "m9"}), ArgType(RespExpr::NIL));
+  EXPECT_EQ(500, CheckedInt({"zintercard", "3", "z1", "z2", "s3"}));
+
+  auto resp = Run({"zinter", "2", "z1", "s3", "weights", "2", "1", "withscores"});
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  EXPECT_EQ(1000u, resp.GetVec().size());
+  EXPECT_EQ(resp.GetVec()[1], "1");  // m0 gets the weight of s3.
+}
+
 TEST_F(ZSetFamilyTest, ZUnionStoreOpts) {
   EXPECT_EQ(2, CheckedInt({"zadd", "z1", "1", "a", "2", "b"}));
   EXPECT_EQ(2, CheckedInt({"zadd", "z2", "3", "c", "2", "b"}));
@@ -1102,6 +1133,33 @@ TEST_F(ZSetFamilyTest, GeoSearch) {
                                 RespArray(ElementsAre(DoubleArg(9.1427), DoubleArg(38.7369))))))));
 }
 
+TEST_F(ZSetFamilyTest, GeoSearchCount) {
+  // Points along the equator, 1.1km apart. 300 members use the skiplist encoding.
+  for (unsigned i = 0; i < 300; ++i) {
+    Run({"geoadd", "points", absl::StrCat(i * 0.01), "0", absl::StrCat("p", i)});
+  }
+  Run({"geoadd", "small", "0", "0", "17", "0.01", "0", "p1", "0.02", "0", "42"});
+
+  EXPECT_THAT(Run({"GEOSEARCH", "points", "FROMLONLAT", "0", "0", "BYRADIUS", "100", "KM",
+                   "COUNT", "3"}),
+              RespArray(ElementsAre("p0", "p1", "p2")));
+  EXPECT_THAT(Run({"GEOSEARCH", "points", "FROMLONLAT", "0", "0", "BYRADIUS", "10.5", "KM", "DESC",
+                   "COUNT", "2"}),
+              RespArray(ElementsAre("p9", "p8")));
+  EXPECT_THAT(Run({"GEOSEARCH", "points", "FROMLONLAT", "0", "0", "BYRADIUS", "100", "KM",
+                   "COUNT", "5", "ANY"}),
+              ArrLen(5));
+  EXPECT_THAT(Run({"GEOSEARCH", "points", "FROMLONLAT", "0", "0", "BYRADIUS", "1", "KM",
+                   "COUNT", "5"}),
+              "p0");
+
+  EXPECT_THAT(Run({"GEOSEARCH", "small", "FROMLONLAT", "0", "0", "BYRADIUS", "10", "KM", "ASC"}),
+              RespArray(ElementsAre("17", "p1", "42")));
+  EXPECT_THAT(Run({"GEOSEARCH", "small", "FROMLONLAT", "0.02", "0", "BYRADIUS", "10", "KM",
+                   "COUNT", "1"}),
+              "42");
+}
+
 TEST_F(ZSetFamilyTest, GeoRadiusByMember) {
   EXPECT_EQ(10, CheckedInt({"geoadd",  "Europe",    "13.4050", "52.5200", "Berlin",   "3.7038",
                             "40.4168", "Madrid",    "9.1427",  "38.7369", "Lisbon",   "2.3522",
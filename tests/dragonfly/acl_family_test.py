@@ -593,6 +593,32 @@ async def test_namespaces(df_server):
     assert await roman.execute_command("GET foo") == None
 
 
+@pytest.mark.asyncio
+@dfly_args({"proactor_threads": 2, "namespace_max_memory": "10mb"})
+async def test_namespace_memory_quota(df_server):
+    admin = df_server.client()
+    await admin.execute_command("ACL SETUSER tenant NAMESPACE:ns1 ON >pass +@all ~*")
+    tenant = df_server.client()
+    await tenant.execute_command("AUTH tenant pass")
+
+    val = "x" * 100_000
+    with pytest.raises(redis.exceptions.ResponseError, match="Out of memory"):
+        for i in range(1000):
+            await tenant.set(f"key{i}", val)
+            if i % 10 == 0:
+                await asyncio.sleep(0.01)  # let the heartbeat account the memory
+
+    # Only the tenant over its quota is denied.
+    assert await tenant.get("key0") == val
+    assert await admin.set("foo", val)
+    assert await admin.get("foo") == val
+
+    # The quota is mutable.
+    await admin.config_set("namespace_max_memory", "0")
+    await asyncio.sleep(0.1)
+    assert await tenant.set("extra", val)
+
+
 @pytest.mark.asyncio
 async def test_default_user_bug(df_server):
     client = df_server.client()
@@ -5,6 +5,7 @@ import redis
 from binascii import crc_hqx
 from redis import asyncio as aioredis
 import asyncio
+import time
 from dataclasses import dataclass
 
 from .instance import DflyInstanceFactory, DflyInstance
@@ -1197,6 +1198,43 @@ async def test_cluster_data_migration(df_factory: DflyInstanceFactory, interrupt
     await check_for_no_state_status([node.admin_client for node in nodes])
 
 
+
+@dfly_args({"proactor_threads": 4, "cluster_mode": "yes"})
+async def test_cluster_sharded_pubsub(df_factory: DflyInstanceFactory):
+    instances = [
+        df_factory.create(port=BASE_PORT + i, admin_port=BASE_PORT + i + 1000) for i in range(2)
+    ]
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 8191)]
+    nodes[1].slots = [(8192, 16383)]
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    channel = next(f"chan{i}" for i in range(100) if key_slot(f"chan{i}") < 8192)
+    sub = nodes[0].client.pubsub()
+    await sub.ssubscribe(channel)
+    assert (await sub.get_message(timeout=1))["type"] == "ssubscribe"
+
+    assert await nodes[0].client.execute_command("SPUBLISH", channel, "hello") == 1
+    message = await sub.get_message(timeout=1)
+    assert message["type"] == "smessage" and message["data"] == "hello"
+
+    # Shard channels are served only by the owner of their slot.
+    with pytest.raises(redis.exceptions.ResponseError, match="MOVED"):
+        await nodes[1].client.execute_command("SPUBLISH", channel, "hello")
+
+    # Subscribers are unsubscribed once the slot of their channel is moved away.
+    nodes[0].slots = [(8192, 16383)]
+    nodes[1].slots = [(0, 8191)]
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    message = await sub.get_message(timeout=5)
+    assert message["type"] == "sunsubscribe" and message["channel"] == channel
+    assert await nodes[1].client.execute_command("PUBSUB", "SHARDNUMSUB", channel) == [channel, 0]
+    assert await nodes[0].client.execute_command("PUBSUB", "SHARDCHANNELS") == []
+    await sub.close()
+
 @dfly_args({"proactor_threads": 2, "cluster_mode": "yes", "cache_mode": "true"})
 async def test_migration_with_key_ttl(df_factory):
     instances = [
@@ -1246,6 +1284,146 @@ async def test_migration_with_key_ttl(df_factory):
     assert await nodes[1].client.execute_command("stick k_sticky") == 0
 
 
+@dfly_args({"proactor_threads": 2, "cluster_mode": "yes"})
+async def test_migration_of_tiered_values(df_factory):
+    instances = [
+        df_factory.create(
+            port=BASE_PORT + i,
+            admin_port=BASE_PORT + i + 1000,
+            tiered_prefix=f"/tmp/tiered/migration{i}",
+            tiered_experimental_cooling="false",
+            maxmemory="1G",
+        )
+        for i in range(2)
+    ]
+
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 16383)]
+    nodes[1].slots = []
+
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    values = {f"key{i}": random.randbytes(2000).hex() for i in range(1000)}
+    p = nodes[0].client.pipeline(transaction=False)
+    for key, value in values.items():
+        p.set(key, value)
+    await p.execute()
+
+    # Values are streamed from disk, so make sure they were offloaded before the migration
+    async for info, breaker in info_tick_timer(nodes[0].client, section="TIERED"):
+        with breaker:
+            assert info["tiered_entries"] > 900
+
+    nodes[0].migrations.append(
+        MigrationInfo("127.0.0.1", nodes[1].instance.admin_port, [(0, 16383)], nodes[1].id)
+    )
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+    await wait_for_status(nodes[0].admin_client, nodes[1].id, "FINISHED")
+
+    nodes[0].migrations = []
+    nodes[0].slots = []
+    nodes[1].slots = [(0, 16383)]
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    p = nodes[1].client.pipeline(transaction=False)
+    for key in values.keys():
+        p.get(key)
+    assert await p.execute() == list(values.values())
+
+    # The target offloads the restored values as well
+    async for info, breaker in info_tick_timer(nodes[1].client, section="TIERED"):
+        with breaker:
+            assert info["tiered_entries"] > 900
+
+
+@dfly_args({"proactor_threads": 2, "cluster_mode": "yes"})
+async def test_migration_rate_limit_and_progress(df_factory):
+    instances = [
+        df_factory.create(
+            port=BASE_PORT + i,
+            admin_port=BASE_PORT + i + 1000,
+            slot_migration_max_bandwidth=1_000_000 if i == 0 else 0,
+        )
+        for i in range(2)
+    ]
+
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 16383)]
+    nodes[1].slots = []
+
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    # About 3MB of values, which take a few seconds to send at 1MB/s
+    await nodes[0].client.execute_command("DEBUG POPULATE 30000 key 100")
+
+    nodes[0].migrations.append(
+        MigrationInfo("127.0.0.1", nodes[1].instance.admin_port, [(0, 16383)], nodes[1].id)
+    )
+    start = time.time()
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    await asyncio.sleep(1)
+    [progress] = await nodes[0].admin_client.execute_command(
+        "DFLYCLUSTER", "SLOT-MIGRATION-PROGRESS", nodes[1].id
+    )
+    progress = dict(zip(progress[::2], progress[1::2]))
+    assert progress["node_id"] == nodes[1].id
+    assert progress["state"] == "SYNC"
+    assert progress["total_keys"] == 30000
+    assert 0 < progress["keys_sent"] < 30000
+    assert 0 < progress["bytes_sent"] < 3_000_000
+    assert progress["keys_per_sec"] > 0 and progress["eta_sec"] > 0
+
+    await wait_for_status(nodes[0].admin_client, nodes[1].id, "FINISHED", timeout=30)
+    assert time.time() - start > 2
+
+    [progress] = await nodes[0].admin_client.execute_command(
+        "DFLYCLUSTER", "SLOT-MIGRATION-PROGRESS"
+    )
+    progress = dict(zip(progress[::2], progress[1::2]))
+    assert progress["state"] == "FINISHED"
+    assert progress["keys_sent"] >= 30000
+    assert progress["eta_sec"] == 0
+
+
+@dfly_args({"proactor_threads": 2, "cluster_mode": "yes", "cluster_forward_moved": "true"})
+async def test_cluster_forward_moved(df_factory):
+    instances = [
+        df_factory.create(port=BASE_PORT + i, admin_port=BASE_PORT + i + 1000) for i in range(2)
+    ]
+    df_factory.start_all(instances)
+
+    nodes = [(await create_node_info(instance)) for instance in instances]
+    nodes[0].slots = [(0, 8000)]
+    nodes[1].slots = [(8001, 16383)]
+    await push_config(json.dumps(generate_config(nodes)), [node.admin_client for node in nodes])
+
+    remote_key = next(f"key{i}" for i in range(100) if key_slot(f"key{i}") > 8000)
+
+    # Commands for slots of node 1 are executed there and its replies are relayed
+    assert await nodes[0].client.set(remote_key, "value")
+    assert await nodes[1].client.get(remote_key) == "value"
+    assert await nodes[0].client.get(remote_key) == "value"
+    with pytest.raises(redis.exceptions.ResponseError, match="not an integer"):
+        await nodes[0].client.incr(remote_key)
+
+    # Clients that fetch the topology get a single MOVED hint
+    client = instances[0].client(single_connection_client=True)
+    await client.execute_command("CLUSTER", "SLOTS")
+    with pytest.raises(redis.exceptions.ResponseError, match="MOVED"):
+        await client.get(remote_key)
+    assert await client.get(remote_key) == "value"
+
+    # Forwarding stops when the flag is disabled at runtime
+    await nodes[0].admin_client.config_set("cluster_forward_moved", "false")
+    with pytest.raises(redis.exceptions.ResponseError, match="MOVED"):
+        await nodes[0].client.get(remote_key)
+
+
 @dfly_args({"proactor_threads": 4, "cluster_mode": "yes"})
 async def test_network_disconnect_during_migration(df_factory, df_seeder_factory):
     instances = [
@@ -148,6 +148,38 @@ async def test_monitor_command_lua(async_pool):
     assert expected == collected[1:]
 
 
+async def test_monitor_command_filters(async_pool):
+    monitor = aioredis.Redis(connection_pool=async_pool).monitor()
+    conn = await async_pool.get_connection("MONITOR")
+    monitor.connection = conn
+    await conn.send_command("MONITOR", "CMD", "set", "CMD", "get", "PREFIX", "user:")
+    assert await conn.read_response() in (b"OK", "OK")
+
+    c = aioredis.Redis(connection_pool=async_pool)
+    await c.set("user:1", "a")
+    await c.set("session:1", "a")
+    await c.lpush("user:list", "a")
+    await c.get("user:1")
+    await c.mget("user:2", "user:3")
+
+    commands = []
+    for _ in range(2):
+        async with async_timeout.timeout(1):
+            commands.append((await monitor.next_command())["command"])
+    assert commands == ["SET user:1 a", "GET user:1"]
+
+    with pytest.raises(asyncio.TimeoutError):
+        async with async_timeout.timeout(0.3):
+            await monitor.next_command()
+    await conn.disconnect()
+    await async_pool.release(conn)
+
+    with pytest.raises(ResponseError):
+        await c.execute_command("MONITOR", "SAMPLE", "2")
+    with pytest.raises(ResponseError):
+        await c.execute_command("MONITOR", "FOO")
+
+
 """
 Run test in pipeline mode.
 This is mostly how this is done with python - its more like a transaction that
@@ -373,6 +405,41 @@ async def test_publish_stuck(df_server: DflyInstance, async_client: aioredis.Red
         await pub
 
 
+@dfly_args(
+    {
+        "proactor_threads": "2",
+        "subscriber_output_limit": "100000",
+        "disconnect_slow_subscribers": True,
+    }
+)
+async def test_disconnect_slow_subscriber(df_server: DflyInstance, async_client: aioredis.Redis):
+    """
+    A subscriber that does not read is disconnected once its queued messages exceed the limit,
+    while a reading subscriber keeps receiving them.
+    """
+    reader, writer = await asyncio.open_connection("127.0.0.1", df_server.port, limit=10)
+    writer.write(b"SUBSCRIBE channel\r\n")
+    await writer.drain()
+
+    async with async_client.pubsub() as pubsub:
+        await pubsub.subscribe("channel")
+        assert (await pubsub.get_message(timeout=1))["type"] == "subscribe"
+
+        payload = "msg" * 10000
+        for _ in range(500):
+            await async_client.publish("channel", payload)
+            message = await pubsub.get_message(timeout=1)
+            assert message["data"] == payload
+
+        clients = await async_client.client_list()
+        assert all("omem" in c for c in clients)
+
+        info = await async_client.info("stats")
+        assert info["slow_subscriber_disconnections"] == 1
+
+    writer.close()
+
+
 @pytest.mark.slow
 @dfly_args({"proactor_threads": "4"})
 async def test_pubsub_busy_connections(df_server: DflyInstance):
@@ -523,6 +590,22 @@ async def test_keyspace_events_config_set(async_client: aioredis.Redis):
         pass
 
 
+@dfly_args({"notify_keyspace_events": "Ex", "notify_keyspace_events_prefixes": "k1,k3"})
+async def test_keyspace_events_prefixes(async_client: aioredis.Redis):
+    pclient = async_client.pubsub()
+    await pclient.subscribe("__keyevent@0__:expired")
+
+    keys = await produce_expiring_keys(async_client)
+    expected = [key for key in keys if key.startswith(("k1", "k3"))]
+
+    events = await collect_expiring_events(pclient, expected)
+    assert set(ev["data"] for ev in events) == set(expected)
+
+    # Keys with other prefixes are not published.
+    await asyncio.sleep(0.5)
+    assert await pclient.get_message(timeout=0.1) is None
+
+
 async def test_reply_count(async_client: aioredis.Redis):
     """Make sure reply aggregations reduce reply counts for common cases"""
 
@@ -715,6 +798,30 @@ async def test_large_cmd(async_client: aioredis.Redis):
     assert len(res) == MAX_ARR_SIZE
 
 
+async def test_pipeline_deadline(df_server: DflyInstance, async_client: aioredis.Redis):
+    reader, writer = await asyncio.open_connection("127.0.0.1", df_server.port)
+
+    # Commands queued behind the sleep wait longer than the deadline and are dropped.
+    writer.write(b"CLIENT DEADLINE 10\r\nDEBUG SLEEP 0.1\r\nSET a 1\r\nPING\r\n")
+    await writer.drain()
+
+    replies = [(await reader.readline()).decode().strip() for _ in range(4)]
+    assert replies[:2] == ["+OK", "+OK"]
+    assert all(r.startswith("-TIMEOUT") for r in replies[2:])
+    assert await async_client.get("a") is None
+
+    info = await async_client.info("STATS")
+    assert info["pipeline_shed_commands"] == 2
+
+    writer.write(b"CLIENT DEADLINE DEFAULT\r\nCLIENT DEADLINE\r\n")
+    await writer.drain()
+    assert (await reader.readline()).decode().strip() == "+OK"
+    assert (await reader.readline()).decode().strip() == ":0"
+
+    writer.close()
+    await writer.wait_closed()
+
+
 @dfly_args({"proactor_threads": 1})
 async def test_parser_memory_stats(df_server, async_client: aioredis.Redis):
     reader, writer = await asyncio.open_connection("127.0.0.1", df_server.port, limit=10)
@@ -1000,3 +1107,44 @@ async def test_lib_name_ver(async_client: aioredis.Redis):
     assert len(list) == 1
     assert list[0]["lib-name"] == "dragonfly"
     assert list[0]["lib-ver"] == "1.2.3.4"
+
+
+@dfly_args({"proactor_threads": "4", "conn_affinity_window": 16})
+async def test_shard_affinity_migration(df_server: DflyInstance):
+    """
+    A connection that keeps accessing a single key moves to the thread of its shard, after which
+    its commands no longer hop to other threads.
+    """
+    client = df_server.client(single_connection_client=True)
+    for _ in range(100):
+        await client.get("a")
+
+    stats = await client.info("stats")
+    assert stats["connection_affinity_migrations"] <= 1
+    remote = stats["remote_shard_commands"]
+
+    for _ in range(20):
+        await client.get("a")
+
+    stats = await client.info("stats")
+    assert stats["remote_shard_commands"] == remote
+    assert stats["local_shard_commands"] >= 20
+    await client.close()
+
+
+@dfly_args({"proactor_threads": "2", "conn_shared_read_buffers": True})
+async def test_shared_read_buffers(df_server: DflyInstance):
+    """
+    Idle connections give their read buffers back, and large requests still go through.
+    """
+    clients = [df_server.client(single_connection_client=True) for _ in range(50)]
+    for i, client in enumerate(clients):
+        await client.set(f"k{i}", "x" * 10000)
+        assert await client.get(f"k{i}") == "x" * 10000
+
+    info = await clients[0].info("memory")
+    assert info["client_read_buffer_saved_bytes"] > 0
+    assert info["client_read_buffer_pool_bytes"] <= info["client_read_buffer_saved_bytes"]
+
+    for client in clients:
+        await client.close()
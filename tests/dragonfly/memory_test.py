@@ -105,3 +105,25 @@ async def test_rss_oom_ratio(df_factory, admin_port):
     # new client create shoud not fail after memory usage decrease
     client = aioredis.Redis(port=df_server.port)
     await client.execute_command("set x y")
+
+
+@pytest.mark.asyncio
+async def test_memory_analyze(async_client: aioredis.Redis):
+    await async_client.execute_command("DEBUG POPULATE 2000 tenant 100")
+    await async_client.execute_command("DEBUG POPULATE 500 session 10")
+
+    res = await async_client.execute_command("MEMORY ANALYZE SAMPLE 1 DURATION 0 CPU 100")
+    stats = {}
+    for entry in res:
+        entry = dict(zip(entry[::2], entry[1::2]))
+        stats[entry["prefix"]] = entry
+
+    # With all the keys sampled the estimates are exact
+    assert list(stats.keys()) == ["tenant:", "session:"]
+    assert stats["tenant:"]["keys"] == 2000
+    assert stats["tenant:"]["keys_error"] == 0
+    assert stats["session:"]["keys"] == 500
+    assert stats["tenant:"]["memory"] > stats["session:"]["memory"] > 0
+
+    res = await async_client.execute_command("MEMORY ANALYZE TOP 1 DURATION 0")
+    assert len(res) <= 1
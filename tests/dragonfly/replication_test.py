@@ -134,6 +134,64 @@ async def test_replication_all(
     await check()
 
 
+@pytest.mark.parametrize("t_master, t_replica", [(4, 4), (2, 6)])
+async def test_replication_batched_apply(df_factory: DflyInstanceFactory, t_master, t_replica):
+    master = df_factory.create(proactor_threads=t_master)
+    replica = df_factory.create(proactor_threads=t_replica, replica_apply_batch=32)
+    df_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    seeder = SeederV2(key_target=5_000)
+    await seeder.run(c_master, target_deviation=0.01)
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_for_replicas_state(c_replica)
+
+    # Pipelined writes in stable state arrive in bursts that are applied in batches
+    await seeder.run(c_master, target_ops=20_000)
+
+    await check_all_replicas_finished([c_replica], c_master)
+    hashes = await asyncio.gather(*(SeederV2.capture(c) for c in [c_master, c_replica]))
+    assert hashes[0] == hashes[1]
+
+
+async def test_cascading_replication(df_factory: DflyInstanceFactory):
+    master = df_factory.create(proactor_threads=4)
+    replica = df_factory.create(proactor_threads=4)
+    downstream = df_factory.create(proactor_threads=2)
+    df_factory.start_all([master, replica, downstream])
+    c_master, c_replica, c_downstream = (i.client() for i in [master, replica, downstream])
+
+    seeder = SeederV2(key_target=5_000)
+    await seeder.run(c_master, target_deviation=0.01)
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_for_replicas_state(c_replica)
+    await c_downstream.execute_command(f"REPLICAOF localhost {replica.port}")
+    await wait_for_replicas_state(c_downstream)
+
+    # Changes in stable state are forwarded by the replica
+    await seeder.run(c_master, target_ops=5_000)
+    await check_all_replicas_finished([c_replica], c_master)
+    await check_all_replicas_finished([c_downstream], c_replica)
+
+    hashes = await asyncio.gather(*(SeederV2.capture(c) for c in [c_master, c_downstream]))
+    assert hashes[0] == hashes[1]
+
+    # A full sync of the replica drops its downstream replicas, which resync from scratch
+    await c_master.set("after-resync", "1")
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_for_replicas_state(c_replica)
+    async with async_timeout.timeout(20):
+        while await c_downstream.get("after-resync") != "1":
+            await asyncio.sleep(0.1)
+    await check_all_replicas_finished([c_downstream], c_replica)
+
+    hashes = await asyncio.gather(*(SeederV2.capture(c) for c in [c_master, c_downstream]))
+    assert hashes[0] == hashes[1]
+
+
 async def check_replica_finished_exec(c_replica: aioredis.Redis, m_offset):
     role = await c_replica.role()
     if role[0] != "slave" or role[3] != "online":
@@ -1068,7 +1126,9 @@ async def assert_replica_reconnections(replica_inst, initial_reconnects_count):
 @pytest.mark.asyncio
 async def test_replication_info(df_factory: DflyInstanceFactory, df_seeder_factory, n_keys=2000):
     master = df_factory.create()
-    replica = df_factory.create(logtostdout=True, replication_acks_interval=100)
+    replica = df_factory.create(
+        logtostdout=True, replication_acks_interval=100, replication_acks_coalesce_usec=0
+    )
     df_factory.start_all([master, replica])
     c_master = master.client()
     c_replica = replica.client()
@@ -1090,6 +1150,72 @@ async def test_replication_info(df_factory: DflyInstanceFactory, df_seeder_facto
     await c_replica.connection_pool.disconnect()
 
 
+@dfly_args({"proactor_threads": 2})
+@pytest.mark.asyncio
+async def test_replication_flow_stats(df_factory: DflyInstanceFactory):
+    master = df_factory.create()
+    replica = df_factory.create(replication_acks_interval=100)
+    df_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    # LSN markers with the master time are sent at most every few seconds.
+    for i in range(5):
+        await c_master.mset({f"key{i}-{j}": "v" for j in range(100)})
+        await asyncio.sleep(1)
+    await check_all_replicas_finished([c_replica], c_master)
+
+    info = await c_master.execute_command("info replication")
+    assert re.search("slave0:.*,lag_ms=[0-9]+,throttle_count=[0-9]+,", info)
+    assert len(re.findall("slave0_flow[0-9]+:lag_ms=", info)) == 2
+
+    metrics = await master.metrics()
+    assert len(metrics["dragonfly_connected_replica_flow_lag_seconds"].samples) == 2
+    assert len(metrics["dragonfly_connected_replica_flow_buffer_bytes"].samples) == 2
+
+    info = await c_replica.execute_command("info replication")
+    assert re.search("master_lag_ms:[0-9]+", info)
+    assert len(re.findall("flow[0-9]+_lag_ms:", info)) == 2
+
+
+@dfly_args({"proactor_threads": 2})
+@pytest.mark.asyncio
+async def test_wait(df_factory: DflyInstanceFactory):
+    master = df_factory.create()
+    replicas = [df_factory.create(replication_acks_interval=60000) for _ in range(2)]
+    df_factory.start_all([master] + replicas)
+    c_master = master.client()
+    c_replicas = [replica.client() for replica in replicas]
+
+    for c_replica in c_replicas:
+        await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+        await wait_available_async(c_replica)
+
+    # The periodic acks are a minute apart, so WAIT relies on the streamed ones.
+    for i in range(20):
+        await c_master.mset({f"key{i}-{j}": "v" for j in range(100)})
+        start = time.time()
+        assert await c_master.execute_command("WAIT", 2, 10000) == 2
+        assert time.time() - start < 5
+        for c_replica in c_replicas:
+            assert await c_replica.get(f"key{i}-99") == "v"
+
+    # Many clients blocked together are all released by the same acks.
+    clients = [master.client() for _ in range(10)]
+    assert all(await asyncio.gather(*(c.set(f"concurrent{k}", k) for k, c in enumerate(clients))))
+    assert await asyncio.gather(*(c.execute_command("WAIT", 2, 10000) for c in clients)) == [2] * 10
+
+    # A WAIT for more replicas than there are times out with the count of those that acked.
+    await c_master.set("foo", "bar")
+    assert await c_master.execute_command("WAIT", 3, 200) == 2
+
+    with pytest.raises(redis.exceptions.ResponseError, match="replica"):
+        await c_replicas[0].execute_command("WAIT", 1, 100)
+
+
 """
 Test flushall command that's invoked while in full sync mode.
 This can cause an issue because it will be executed on each shard independently.
@@ -1556,6 +1682,30 @@ async def test_replicaof_flag(df_factory):
     assert "VALUE" == val
 
 
+@pytest.mark.asyncio
+async def test_replicaof_unix_socket(df_factory, tmp_dir):
+    # a master on the same host is replicated and taken over through its unix socket
+    master = df_factory.create(proactor_threads=2, unixsocket="./master.sock")
+    replica = df_factory.create(proactor_threads=2)
+    df_factory.start_all([master, replica])
+
+    c_master = master.client()
+    c_replica = replica.client()
+    await c_master.execute_command("DEBUG POPULATE 10000")
+
+    await c_replica.execute_command(f"REPLICAOF {tmp_dir / 'master.sock'} 0")
+    await wait_available_async(c_replica)
+    await check_all_replicas_finished([c_replica], c_master)
+    assert await c_replica.dbsize() == 10000
+
+    info = await c_replica.info("replication")
+    assert info["master_host"] == str(tmp_dir / "master.sock")
+
+    await c_replica.execute_command("REPLTAKEOVER 5")
+    assert await c_replica.execute_command("role") == ["master", []]
+    assert await c_replica.dbsize() == 10000
+
+
 @pytest.mark.asyncio
 async def test_replicaof_flag_replication_waits(df_factory):
     # tests --replicaof works when we launch replication before the master
@@ -1804,6 +1954,48 @@ async def test_network_disconnect_small_buffer(df_factory, df_seeder_factory):
     # assert master.is_in_logs("Partial sync requested from stale LSN")
 
 
+async def test_network_disconnect_disk_backlog(df_factory, df_seeder_factory):
+    # The in-memory ring is too short, so partial sync relies on the disk backlog
+    master = df_factory.create(
+        proactor_threads=4, shard_repl_backlog_len=1, repl_backlog_dir="{DRAGONFLY_TMP}/backlog"
+    )
+    replica = df_factory.create(proactor_threads=4)
+
+    df_factory.start_all([replica, master])
+    seeder = df_seeder_factory.create(port=master.port)
+
+    async with replica.client() as c_replica, master.client() as c_master:
+        await seeder.run(target_deviation=0.1)
+
+        proxy = Proxy("127.0.0.1", 1114, "127.0.0.1", master.port)
+        await proxy.start()
+        task = asyncio.create_task(proxy.serve())
+        try:
+            await c_replica.execute_command(f"REPLICAOF localhost {proxy.port}")
+            await wait_available_async(c_replica)
+
+            fill_task = asyncio.create_task(seeder.run(target_ops=4000))
+            await asyncio.sleep(1.0)
+            proxy.drop_connection()
+
+            seeder.stop()
+            await fill_task
+
+            await asyncio.sleep(1.0)
+            await wait_available_async(c_replica)
+
+            info = await c_master.info("replication")
+            assert info["repl_backlog_disk_bytes"] > 0
+            assert info["repl_backlog_retention_sec"] >= 0
+
+            capture = await seeder.capture()
+            assert await seeder.compare(capture, replica.port)
+        finally:
+            await proxy.close(task)
+
+    assert replica.is_in_logs("Started partial sync")
+
+
 async def test_replica_reconnections_after_network_disconnect(df_factory, df_seeder_factory):
     master = df_factory.create(proactor_threads=6)
     replica = df_factory.create(proactor_threads=4)
@@ -2626,3 +2818,41 @@ async def test_replica_of_replica(df_factory):
         await c_replica2.execute_command(f"REPLICAOF localhost {replica.port}")
 
     assert await c_replica2.execute_command(f"REPLICAOF localhost {master.port}") == "OK"
+
+
+@pytest.mark.asyncio
+async def test_replica_serve_stale_reads(df_factory):
+    master = df_factory.create(proactor_threads=2, dbfilename=f"dump_{tmp_file_name()}")
+    replica = df_factory.create(proactor_threads=2, replica_serve_stale_reads=True)
+    df_factory.start_all([master, replica])
+
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_master.execute_command("DEBUG POPULATE 200000 key 100")
+    await c_master.set("k", "snapshot")
+    await c_master.execute_command("SAVE")
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    await c_master.set("k", "stale")
+    await check_all_replicas_finished([c_replica], c_master)
+
+    # The restarted master loads the snapshot and has a new id, so the replica fully resyncs.
+    # Meanwhile it serves the previous dataset instead of replying with LOADING errors.
+    master.stop()
+    master.start()
+    c_master = master.client()
+
+    saw_stale = False
+    async with async_timeout.timeout(30):
+        while (value := await c_replica.get("k")) != "snapshot":
+            assert value == "stale"
+            info = await c_replica.info("REPLICATION")
+            saw_stale = saw_stale or info.get("master_sync_serving_stale") == 1
+            await asyncio.sleep(0.01)
+
+    logging.debug(f"Observed a staged full sync: {saw_stale}")
+    await check_all_replicas_finished([c_replica], c_master)
+    assert await c_replica.dbsize() == await c_master.dbsize()
+    assert "master_sync_serving_stale" not in await c_replica.info("REPLICATION")
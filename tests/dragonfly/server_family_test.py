@@ -172,3 +172,62 @@ async def test_blocking_commands_should_not_show_up_in_slow_log(
 
     # blpop does not show up, only the previous reset
     assert reply[0]["command"] == "SLOWLOG RESET"
+
+
+@pytest.mark.asyncio
+@dfly_args({"command_latency_buckets": "100,1000,1000000"})
+async def test_command_latency_histograms(df_server, async_client: aioredis.Redis):
+    for i in range(10):
+        await async_client.set(f"key{i}", "value")
+
+    metrics = await df_server.metrics()
+    buckets = {
+        sample.labels["le"]: sample.value
+        for sample in metrics["dragonfly_commands_latency_seconds"].samples
+        if sample.name.endswith("_bucket") and sample.labels["cmd"] == "set"
+    }
+    assert len(buckets) == 4
+    assert buckets["+Inf"] == 10
+    assert sorted(buckets.values()) == list(buckets.values())
+
+
+@pytest.mark.asyncio
+@dfly_args({"cpu_class_accounting": True, "fiber_lag_probe_ms": 1})
+async def test_cpu_classes_and_run_queue_lag(df_server, async_client: aioredis.Redis):
+    await async_client.execute_command("DEBUG POPULATE 10000")
+    await async_client.execute_command("SAVE")
+    await asyncio.sleep(0.1)
+
+    info = await async_client.info("cpu")
+    for cls in ["heartbeat", "snapshot", "tiering", "replication", "other"]:
+        assert f"used_cpu_{cls}" in info
+    assert info["used_cpu_snapshot"] > 0
+    assert "run_queue_lag_max_usec" in info
+
+    metrics = await df_server.metrics()
+    classes = {s.labels["class"] for s in metrics["dragonfly_thread_cpu_seconds"].samples}
+    assert "snapshot" in classes and "other" in classes
+    assert metrics["dragonfly_fiber_run_queue_lag_usec"].samples
+
+
+@pytest.mark.asyncio
+@dfly_args({"top_keys_sample_rate": 1})
+async def test_hotkeys(async_client: aioredis.Redis):
+    await async_client.set("hot", "x" * 100)
+    await async_client.set("warm", "y")
+    for _ in range(50):
+        await async_client.get("hot")
+    for _ in range(20):
+        await async_client.get("warm")
+
+    def parse(reply):
+        return [dict(zip(entry[::2], entry[1::2])) for entry in reply]
+
+    reply = parse(await async_client.execute_command("HOTKEYS COUNT 1"))
+    assert len(reply) == 1
+    assert reply[0]["key"] == "hot"
+    assert reply[0]["accesses"] >= 50
+    assert reply[0]["bytes"] >= 5000
+
+    reply = parse(await async_client.execute_command("HOTKEYS BYBYTES"))
+    assert [entry["key"] for entry in reply] == ["hot", "warm"]
@@ -652,3 +652,81 @@ async def test_mc_flags_saving(memcached_client: MCClient, async_client: aioredi
 
     await check_flag("key1", 2)
     await check_flag("key2", 123456)
+
+
+@dfly_args(
+    {
+        **BASIC_ARGS,
+        "dbfilename": "test-disk-journal",
+        "journal_dir": "{DRAGONFLY_TMP}/journal",
+        "journal_fsync_ms": 0,
+    }
+)
+async def test_disk_journal_replay(df_factory):
+    """Changes after the last snapshot are restored from the disk journal after a crash"""
+    df_server = df_factory.create()
+    df_server.start()
+    client = df_server.client()
+
+    await StaticSeeder(key_target=1000).run(client)
+    await client.execute_command("SAVE", "DF")
+
+    # Changes after the snapshot, including a global command recorded by all shards
+    await client.flushall()
+    await StaticSeeder(key_target=2000, data_size=100).run(client)
+    await client.set("after-snapshot", "1")
+    start_capture = await StaticSeeder.capture(client)
+    await client.close()
+
+    df_server.stop(kill=True)
+    df_server.start()
+    client = df_server.client()
+    await wait_available_async(client)
+
+    assert await client.get("after-snapshot") == "1"
+    assert await StaticSeeder.capture(client) == start_capture
+
+
+@pytest.mark.slow
+@dfly_args(
+    {
+        **BASIC_ARGS,
+        "dbfilename": "test-delta",
+        "snapshot_cron": "* * * * *",
+        "snapshot_max_deltas": 5,
+        "shard_repl_backlog_len": 1 << 16,
+    }
+)
+async def test_delta_snapshot(df_factory, tmp_dir: Path):
+    """Scheduled snapshots after the first one only save deltas, which are loaded on top of it"""
+    df_server = df_factory.create()
+    df_server.start()
+    client = df_server.client()
+
+    await StaticSeeder(key_target=1000).run(client)
+    await client.mset({f"a:{i}": i for i in range(1000)})
+    async with timeout(65):
+        while find_main_file(tmp_dir, "test-delta-summary.dfs") is None:
+            await asyncio.sleep(1)
+
+    # Changes after the base snapshot are only saved to the delta. DEBUG POPULATE is not journaled,
+    # so they are made with regular commands.
+    await client.mset({f"b:{i}": i for i in range(2000)})
+    await client.delete(*[f"a:{i}" for i in range(100)])
+    await client.hset("hash", mapping={f"f{i}": i for i in range(100)})
+    await client.set("after-base", "1")
+    start_capture = await StaticSeeder.capture(client)
+
+    async with timeout(65):
+        while find_main_file(tmp_dir, "test-delta-delta-0001-0003.dfs") is None:
+            await asyncio.sleep(1)
+    assert len(glob.glob(str(tmp_dir / "test-delta-delta-0001-*.dfs"))) == 4
+    await client.close()
+
+    df_server.stop(kill=True)
+    df_server.start()
+    client = df_server.client()
+    await wait_available_async(client)
+
+    assert await client.get("after-base") == "1"
+    assert await StaticSeeder.capture(client) == start_capture
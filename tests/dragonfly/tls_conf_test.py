@@ -1,5 +1,7 @@
 import pytest
 import redis
+import socket
+import ssl
 from .utility import *
 from .instance import DflyStartException
 
@@ -36,6 +38,52 @@ async def test_tls_client_certs(
             await client.ping()
 
 
+@pytest.mark.parametrize("ktls", [False, True])
+async def test_tls_mode_in_client_list(
+    df_factory, with_tls_server_args, with_tls_ca_cert_args, ktls
+):
+    with df_factory.create(requirepass="XXX", tls_ktls=ktls, **with_tls_server_args) as server:
+        async with server.client(
+            ssl=True, password="XXX", ssl_ca_certs=with_tls_ca_cert_args["ca_cert"]
+        ) as client:
+            await client.set("foo", "bar" * 1000)
+            assert await client.get("foo") == "bar" * 1000
+
+            # Offloading depends on the kernel, so both modes are accepted with kTLS.
+            clients = await client.client_list()
+            assert clients[0]["tls"] in (["user", "kernel"] if ktls else ["user"])
+
+
+@pytest.mark.parametrize("tickets", [False, True])
+async def test_tls_session_resumption(
+    df_factory, with_tls_server_args, with_tls_ca_cert_args, tickets
+):
+    with df_factory.create(
+        requirepass="XXX", tls_session_tickets=tickets, **with_tls_server_args
+    ) as server:
+        context = ssl.create_default_context(cafile=with_tls_ca_cert_args["ca_cert"])
+        context.check_hostname = False
+        # TLS 1.3 delivers the session only after the handshake, with the first records.
+        context.maximum_version = ssl.TLSVersion.TLSv1_2
+
+        session = None
+        for resumed in [False, True]:
+            with socket.create_connection(("127.0.0.1", server.port)) as sock:
+                with context.wrap_socket(sock, session=session) as tls_sock:
+                    assert tls_sock.session_reused == resumed
+                    tls_sock.sendall(b"PING\r\n")
+                    assert tls_sock.recv(1024).startswith(b"-NOAUTH")
+                    session = tls_sock.session
+
+        async with server.client(
+            ssl=True, password="XXX", ssl_ca_certs=with_tls_ca_cert_args["ca_cert"]
+        ) as client:
+            stats = await client.info("stats")
+            assert stats["tls_handshakes"] >= 3
+            assert stats["tls_handshakes_resumed"] == 1
+            assert stats["tls_handshake_failures"] == 0
+
+
 async def test_client_tls_no_auth(df_factory):
     server = df_factory.create(tls_replication=None)
     with pytest.raises(DflyStartException):